@@ -65,23 +65,64 @@ double CAddrInfo::GetChance(int64_t nNow) const
     return fChance;
 }
 
+int CAddrInfoTable::Insert(const CAddrInfo& info)
+{
+    int nId;
+    if (vFree.empty()) {
+        nId = vEntries.size();
+        vEntries.push_back(info);
+        vUsed.push_back(true);
+    } else {
+        nId = vFree.back();
+        vFree.pop_back();
+        vEntries[nId] = info;
+        vUsed[nId] = true;
+    }
+    nEntries++;
+    return nId;
+}
+
+void CAddrInfoTable::erase(int nId)
+{
+    assert(count(nId));
+    vEntries[nId] = CAddrInfo();
+    vUsed[nId] = false;
+    vFree.push_back(nId);
+    nEntries--;
+}
+
+void CAddrInfoTable::clear()
+{
+    std::vector<CAddrInfo>().swap(vEntries);
+    std::vector<bool>().swap(vUsed);
+    std::vector<int>().swap(vFree);
+    nEntries = 0;
+}
+
+SaltedNetAddrHasher::SaltedNetAddrHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t SaltedNetAddrHasher::operator()(const CNetAddr& addr) const
+{
+    struct in6_addr ip;
+    addr.GetIn6Addr(&ip);
+    return CSipHasher(k0, k1).Write((const unsigned char*)&ip, sizeof(ip)).Finalize();
+}
+
 CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int* pnId)
 {
-    std::map<CNetAddr, int>::iterator it = mapAddr.find(addr);
+    auto it = mapAddr.find(addr);
     if (it == mapAddr.end())
         return nullptr;
     if (pnId)
         *pnId = (*it).second;
-    std::map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
-    if (it2 != mapInfo.end())
-        return &(*it2).second;
+    if (mapInfo.count((*it).second))
+        return &mapInfo[(*it).second];
     return nullptr;
 }
 
 CAddrInfo* CAddrMan::Create(const CAddress& addr, const CNetAddr& addrSource, int* pnId)
 {
-    int nId = nIdCount++;
-    mapInfo[nId] = CAddrInfo(addr, addrSource);
+    int nId = mapInfo.Insert(CAddrInfo(addr, addrSource));
     mapAddr[addr] = nId;
     mapInfo[nId].nRandomPos = vRandom.size();
     vRandom.push_back(nId);
@@ -121,6 +162,7 @@ void CAddrMan::Delete(int nId)
     vRandom.pop_back();
     mapAddr.erase(info);
     mapInfo.erase(nId);
+    m_tried_collisions.erase(nId); // The nId will be reused
     nNew--;
 }
 
@@ -402,9 +444,10 @@ int CAddrMan::Check_()
     if (vRandom.size() != (size_t)(nTried + nNew))
         return -7;
 
-    for (const auto& entry : mapInfo) {
-        int n = entry.first;
-        const CAddrInfo& info = entry.second;
+    for (int n = 0; n < mapInfo.IdBound(); n++) {
+        if (!mapInfo.count(n))
+            continue;
+        const CAddrInfo& info = mapInfo[n];
         if (info.fInTried) {
             if (!info.nLastSuccess)
                 return -1;
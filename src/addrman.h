@@ -16,6 +16,7 @@
 #include <map>
 #include <set>
 #include <stdint.h>
+#include <unordered_map>
 #include <vector>
 
 /**
@@ -182,6 +183,62 @@ public:
 //! the maximum number of tried addr collisions to store
 #define ADDRMAN_SET_TRIED_COLLISION_SIZE 10
 
+/**
+ * Table of CAddrInfo indexed by nId. The entries are stored contiguously and the nIds of deleted
+ * entries are handed out again, so the table stays as dense as the set of known addresses and
+ * the lookups from the bucket tables and vRandom are a single index.
+ */
+class CAddrInfoTable
+{
+private:
+    std::vector<CAddrInfo> vEntries;
+    std::vector<bool> vUsed;
+    std::vector<int> vFree;
+    size_t nEntries = 0;
+
+public:
+    //! Store info under an unused nId and return it. nIds are sequential while none were erased.
+    int Insert(const CAddrInfo &info);
+
+    size_t count(int nId) const
+    {
+        return nId >= 0 && (size_t)nId < vUsed.size() && vUsed[nId];
+    }
+
+    CAddrInfo &operator[](int nId)
+    {
+        assert(count(nId));
+        return vEntries[nId];
+    }
+
+    const CAddrInfo &operator[](int nId) const
+    {
+        assert(count(nId));
+        return vEntries[nId];
+    }
+
+    void erase(int nId);
+    void clear();
+
+    size_t size() const { return nEntries; }
+
+    //! All nIds in use are below this bound, iterate up to it to visit the entries in nId order.
+    int IdBound() const { return vEntries.size(); }
+};
+
+/** Salted hash of the IP of a CNetAddr, consistent with CNetAddr::operator== */
+class SaltedNetAddrHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedNetAddrHasher();
+
+    size_t operator()(const CNetAddr &addr) const;
+};
+
 /**
  * Stochastical (IP) address manager
  */
@@ -191,14 +248,11 @@ private:
     //! critical section to protect the inner data structures
     mutable CCriticalSection cs;
 
-    //! last used nId
-    int nIdCount;
-
     //! table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo;
+    CAddrInfoTable mapInfo;
 
     //! find an nId based on its network address
-    std::map<CNetAddr, int> mapAddr;
+    std::unordered_map<CNetAddr, int, SaltedNetAddrHasher> mapAddr;
 
     //! randomly-ordered vector of all nIds
     std::vector<int> vRandom;
@@ -326,11 +380,13 @@ public:
 
         int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
         s << nUBuckets;
-        std::map<int, int> mapUnkIds;
+        std::vector<int> vUnkIds(mapInfo.IdBound(), -1);
         int nIds = 0;
-        for (const auto& entry : mapInfo) {
-            mapUnkIds[entry.first] = nIds;
-            const CAddrInfo &info = entry.second;
+        for (int nId = 0; nId < mapInfo.IdBound(); nId++) {
+            if (!mapInfo.count(nId))
+                continue;
+            vUnkIds[nId] = nIds;
+            const CAddrInfo &info = mapInfo[nId];
             if (info.nRefCount) {
                 assert(nIds != nNew); // this means nNew was wrong, oh ow
                 s << info;
@@ -338,8 +394,10 @@ public:
             }
         }
         nIds = 0;
-        for (const auto& entry : mapInfo) {
-            const CAddrInfo &info = entry.second;
+        for (int nId = 0; nId < mapInfo.IdBound(); nId++) {
+            if (!mapInfo.count(nId))
+                continue;
+            const CAddrInfo &info = mapInfo[nId];
             if (info.fInTried) {
                 assert(nIds != nTried); // this means nTried was wrong, oh ow
                 s << info;
@@ -355,7 +413,7 @@ public:
             s << nSize;
             for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
                 if (vvNew[bucket][i] != -1) {
-                    int nIndex = mapUnkIds[vvNew[bucket][i]];
+                    int nIndex = vUnkIds[vvNew[bucket][i]];
                     s << nIndex;
                 }
             }
@@ -391,9 +449,10 @@ public:
             throw std::ios_base::failure("Corrupt CAddrMan serialization, nTried exceeds limit.");
         }
 
-        // Deserialize entries from the new table.
+        // Deserialize entries from the new table, the table is empty so they get nIds 0..nNew-1.
+        mapAddr.reserve(nNew + nTried);
         for (int n = 0; n < nNew; n++) {
-            CAddrInfo &info = mapInfo[n];
+            CAddrInfo &info = mapInfo[mapInfo.Insert(CAddrInfo())];
             s >> info;
             mapAddr[info] = n;
             info.nRandomPos = vRandom.size();
@@ -409,7 +468,6 @@ public:
                 }
             }
         }
-        nIdCount = nNew;
 
         // Deserialize entries from the tried table.
         int nLost = 0;
@@ -421,11 +479,10 @@ public:
             if (vvTried[nKBucket][nKBucketPos] == -1) {
                 info.nRandomPos = vRandom.size();
                 info.fInTried = true;
-                vRandom.push_back(nIdCount);
-                mapInfo[nIdCount] = info;
-                mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
-                nIdCount++;
+                int nId = mapInfo.Insert(info);
+                vRandom.push_back(nId);
+                mapAddr[info] = nId;
+                vvTried[nKBucket][nKBucketPos] = nId;
             } else {
                 nLost++;
             }
@@ -452,13 +509,10 @@ public:
 
         // Prune new entries with refcount 0 (as a result of collisions).
         int nLostUnk = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
-            if (it->second.fInTried == false && it->second.nRefCount == 0) {
-                std::map<int, CAddrInfo>::const_iterator itCopy = it++;
-                Delete(itCopy->first);
+        for (int nId = 0; nId < mapInfo.IdBound(); nId++) {
+            if (mapInfo.count(nId) && mapInfo[nId].fInTried == false && mapInfo[nId].nRefCount == 0) {
+                Delete(nId);
                 nLostUnk++;
-            } else {
-                it++;
             }
         }
         if (nLost + nLostUnk > 0) {
@@ -484,12 +538,12 @@ public:
             }
         }
 
-        nIdCount = 0;
         nTried = 0;
         nNew = 0;
         nLastGood = 1; //Initially at 1 so that "never" is strictly worse.
         mapInfo.clear();
         mapAddr.clear();
+        m_tried_collisions.clear(); // nIds are reused
     }
 
     CAddrMan()
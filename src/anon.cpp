@@ -18,9 +18,110 @@
 #include <consensus/validation.h>
 #include <chainparams.h>
 #include <txmempool.h>
+#include <perfstats.h>
 
 
-bool VerifyMLSAG(const CTransaction &tx, CValidationState &state)
+bool CMLSAGCheck::Prepare()
+{
+    std::vector<const uint8_t*> vpInCommits(vCommitments.size());
+    for (size_t i = 0; i < vCommitments.size(); ++i)
+        vpInCommits[i] = vCommitments[i].data;
+
+    std::vector<const uint8_t*> vpOutCommits;
+    if (fSplitCommitments)
+    {
+        const std::vector<uint8_t> &vDL = ptxTo->vin[nIn].scriptWitness.stack[1];
+        vpOutCommits.push_back(&vDL[(1 + nRows * nCols) * 32]);
+    } else
+    {
+        vpOutCommits.push_back(plainCommitment.data);
+
+        secp256k1_pedersen_commitment *pc;
+        for (const auto &txout : ptxTo->vpout)
+        {
+            if ((pc = txout->GetPCommitment()))
+                vpOutCommits.push_back(pc->data);
+        };
+    };
+
+    if (0 != (nError = secp256k1_prepare_mlsag(&vM[0], nullptr,
+        vpOutCommits.size(), vpOutCommits.size(), nCols, nRows,
+        &vpInCommits[0], &vpOutCommits[0], nullptr)))
+    {
+        sReason = "prepare-mlsag-failed";
+        return false;
+    };
+
+    return true;
+};
+
+bool CMLSAGCheck::operator()()
+{
+    CMLSAGCheck *pCheck = this;
+    return VerifyBatch(&pCheck, 1);
+};
+
+bool CMLSAGCheck::VerifyBatch(CMLSAGCheck * const *ppChecks, size_t nChecks)
+{
+    CPerfTimer timer(PERF_HISTOGRAM("verify:mlsag"));
+
+    bool fAllValid = true;
+    std::vector<CMLSAGCheck*> vpPrepared;
+    vpPrepared.reserve(nChecks);
+    for (size_t i = 0; i < nChecks; ++i)
+    {
+        if (!ppChecks[i]->Prepare())
+        {
+            fAllValid = false;
+            continue;
+        };
+        vpPrepared.push_back(ppChecks[i]);
+    };
+
+    size_t nRings = vpPrepared.size();
+    if (nRings == 0)
+        return fAllValid;
+
+    std::vector<const uint8_t*> vpPreimages(nRings), vpM(nRings), vpKeyImages(nRings), vpC(nRings), vpS(nRings);
+    std::vector<size_t> vCols(nRings), vRows(nRings);
+    std::vector<int> vResults(nRings);
+    for (size_t i = 0; i < nRings; ++i)
+    {
+        const CMLSAGCheck &check = *vpPrepared[i];
+        const CTxIn &txin = check.ptxTo->vin[check.nIn];
+        const std::vector<uint8_t> &vDL = txin.scriptWitness.stack[1];
+
+        vpPreimages[i] = check.ptxTo->GetHash().begin();
+        vCols[i] = check.nCols;
+        vRows[i] = check.nRows;
+        vpM[i] = check.vM.data();
+        vpKeyImages[i] = txin.scriptData.stack[0].data();
+        vpC[i] = &vDL[0];
+        vpS[i] = &vDL[32];
+    };
+
+    CBlindScratch scratch;
+    if (0 != secp256k1_verify_mlsag_batch(secp256k1_ctx_blind, scratch.get(), nRings,
+        vpPreimages.data(), vCols.data(), vRows.data(),
+        vpM.data(), vpKeyImages.data(), vpC.data(), vpS.data(), vResults.data()))
+        fAllValid = false;
+
+    for (size_t i = 0; i < nRings; ++i)
+    {
+        CMLSAGCheck &check = *vpPrepared[i];
+        if (0 != (check.nError = vResults[i]))
+        {
+            check.sReason = "verify-mlsag-failed";
+            continue;
+        };
+        if (check.cacheStore)
+            SetMLSAGCacheEntry(check.hashCacheEntry);
+    };
+
+    return fAllValid;
+};
+
+bool VerifyMLSAG(const CTransaction &tx, CValidationState &state, std::vector<CMLSAGCheck> *pvChecks, bool cacheStore)
 {
     int rv;
     std::set<int64_t> setHaveI; // Anon prev-outputs can only be used once per transaction.
@@ -51,8 +152,11 @@ bool VerifyMLSAG(const CTransaction &tx, CValidationState &state)
     if (fSplitCommitments)
         vpInputSplitCommits.reserve(tx.vin.size());
 
-    for (const auto &txin : tx.vin)
+    std::vector<CMLSAGCheck> vChecksInline;
+
+    for (unsigned int nIn = 0; nIn < tx.vin.size(); ++nIn)
     {
+        const CTxIn &txin = tx.vin[nIn];
         if (!txin.IsAnonInput())
             return state.DoS(100, false, REJECT_MALFORMED, "bad-anon-input");
 
@@ -90,25 +194,11 @@ bool VerifyMLSAG(const CTransaction &tx, CValidationState &state)
 
         std::vector<secp256k1_pedersen_commitment> vCommitments;
         vCommitments.reserve(nCols * nInputs);
-        std::vector<const uint8_t*> vpOutCommits;
-        std::vector<const uint8_t*> vpInCommits(nCols * nInputs);
 
         if (fSplitCommitments)
-        {
-            vpOutCommits.push_back(&vDL[(1 + (nInputs+1) * nRingSize) * 32]);
             vpInputSplitCommits.push_back(&vDL[(1 + (nInputs+1) * nRingSize) * 32]);
-        } else
-        {
-            vpOutCommits.push_back(plainCommitment.data);
-
-            secp256k1_pedersen_commitment *pc;
-            for (const auto &txout : tx.vpout)
-            {
-                if ((pc = txout->GetPCommitment()))
-                    vpOutCommits.push_back(pc->data);
-            };
-        };
 
+        std::vector<int64_t> vIndices(nCols * nInputs);
         size_t ofs = 0, nB = 0;
         for (size_t k = 0; k < nInputs; ++k)
         for (size_t i = 0; i < nCols; ++i)
@@ -122,15 +212,20 @@ bool VerifyMLSAG(const CTransaction &tx, CValidationState &state)
             if (!setHaveI.insert(nIndex).second)
                 return state.DoS(100, false, REJECT_MALFORMED, "bad-anonin-dup-i");
 
-            CAnonOutput ao;
-            if (!pblocktree->ReadRCTOutput(nIndex, ao))
-            {
-                LogPrint(BCLog::RINGCT, "bad-anonin-unknown-i %ld\n", nIndex);
-                return state.DoS(100, false, REJECT_MALFORMED, "bad-anonin-unknown-i");
-            };
-            memcpy(&vM[(i+k*nCols)*33], ao.pubkey.begin(), 33);
-            vCommitments.push_back(ao.commitment);
-            vpInCommits[i+k*nCols] = vCommitments.back().data;
+            vIndices[i+k*nCols] = nIndex;
+        };
+
+        std::vector<CAnonOutput> vao;
+        if (!pblocktree->ReadRCTOutputs(vIndices, vao))
+        {
+            LogPrint(BCLog::RINGCT, "bad-anonin-unknown-i in txn %s\n", txhash.ToString());
+            return state.DoS(100, false, REJECT_MALFORMED, "bad-anonin-unknown-i");
+        };
+
+        for (size_t k = 0; k < vao.size(); ++k)
+        {
+            memcpy(&vM[k*33], vao[k].pubkey.begin(), 33);
+            vCommitments.push_back(vao[k].commitment);
         };
 
         uint256 txhashKI;
@@ -165,15 +260,35 @@ bool VerifyMLSAG(const CTransaction &tx, CValidationState &state)
             };
         };
 
-        if (0 != (rv = secp256k1_prepare_mlsag(&vM[0], nullptr,
-            vpOutCommits.size(), vpOutCommits.size(), nCols, nRows,
-            &vpInCommits[0], &vpOutCommits[0], nullptr)))
-            return state.DoS(100, error("%s: prepare-mlsag-failed %d", __func__, rv), REJECT_INVALID, "prepare-mlsag-failed");
+        uint256 hashCacheEntry;
+        ComputeMLSAGCacheEntry(hashCacheEntry, tx.GetWitnessHash(), nIn, vM, vCommitments);
+        if (GetMLSAGCacheEntry(hashCacheEntry, !cacheStore))
+            continue;
+
+        CMLSAGCheck check(tx, nIn, nCols, nRows, fSplitCommitments, vM, vCommitments, plainCommitment, hashCacheEntry, cacheStore);
+        std::vector<CMLSAGCheck> &vChecks = pvChecks ? *pvChecks : vChecksInline;
+        vChecks.push_back(CMLSAGCheck());
+        check.swap(vChecks.back());
+    };
+
+    // Ring signatures checked here are verified together
+    if (!vChecksInline.empty())
+    {
+        std::vector<CMLSAGCheck*> vpChecks(vChecksInline.size());
+        for (size_t i = 0; i < vChecksInline.size(); ++i)
+            vpChecks[i] = &vChecksInline[i];
 
-        if (0 != (rv = secp256k1_verify_mlsag(secp256k1_ctx_blind,
-            txhash.begin(), nCols, nRows,
-            &vM[0], &vKeyImages[0], &vDL[0], &vDL[32])))
-            return state.DoS(100, error("%s: verify-mlsag-failed %d", __func__, rv), REJECT_INVALID, "verify-mlsag-failed");
+        if (!CMLSAGCheck::VerifyBatch(vpChecks.data(), vpChecks.size()))
+        {
+            for (const auto &check : vChecksInline)
+            {
+                if (!check.IsError())
+                    continue;
+                return state.DoS(100, error("%s: %s %d", __func__, check.GetRejectReason(), check.GetError()),
+                    REJECT_INVALID, check.GetRejectReason());
+            };
+            return state.DoS(100, error("%s: verify-mlsag-failed", __func__), REJECT_INVALID, "verify-mlsag-failed");
+        };
     };
 
     // Verify commitment sums match
@@ -199,27 +314,23 @@ bool VerifyMLSAG(const CTransaction &tx, CValidationState &state)
     return true;
 }
 
-bool AddKeyImagesToMempool(const CTransaction &tx, CTxMemPool &pool)
+bool AddKeyImagesToMempool(const CTransaction &tx, const CTxIn &txin, CTxMemPool &pool)
 {
-    for (const CTxIn &txin : tx.vin)
-    {
-        if (!txin.IsAnonInput())
-            continue;
-        uint256 txhash = tx.GetHash();
-        LOCK(pool.cs);
-        uint32_t nInputs, nRingSize;
-        txin.GetAnonInfo(nInputs, nRingSize);
+    if (!txin.IsAnonInput())
+        return false;
+    LOCK(pool.cs);
+    uint32_t nInputs, nRingSize;
+    txin.GetAnonInfo(nInputs, nRingSize);
 
-        const std::vector<uint8_t> &vKeyImages = txin.scriptData.stack[0];
+    const std::vector<uint8_t> &vKeyImages = txin.scriptData.stack[0];
 
-        if (vKeyImages.size() != nInputs * 33)
-            return false;
+    if (vKeyImages.size() != nInputs * 33)
+        return false;
 
-        for (size_t k = 0; k < nInputs; ++k)
-        {
-            const CCmpPubKey &ki = *((CCmpPubKey*)&vKeyImages[k*33]);
-            pool.mapKeyImages[ki] = txhash;
-        };
+    for (size_t k = 0; k < nInputs; ++k)
+    {
+        const CCmpPubKey &ki = *((CCmpPubKey*)&vKeyImages[k*33]);
+        pool.mapKeyImages[ki] = &tx;
     };
 
     return true;
@@ -241,7 +352,10 @@ bool RemoveKeyImagesFromMempool(const uint256 &hash, const CTxIn &txin, CTxMemPo
     for (size_t k = 0; k < nInputs; ++k)
     {
         const CCmpPubKey &ki = *((CCmpPubKey*)&vKeyImages[k*33]);
-        pool.mapKeyImages.erase(ki);
+        auto it = pool.mapKeyImages.find(ki);
+        // Only drop the entry if it still belongs to the txn being removed
+        if (it != pool.mapKeyImages.end() && it->second->GetHash() == hash)
+            pool.mapKeyImages.erase(it);
     };
 
     return true;
@@ -295,6 +409,9 @@ bool RollBackRCTIndex(int64_t nLastValidRCTOutput, int64_t nExpectErase, std::se
 
     AssertLockHeld(cs_main);
 
+    // Nothing records the pubkeys of outputs above the last valid index, read them
+    // to drop the links, but erase everything in one batch
+    std::vector<std::pair<int64_t, CCmpPubKey> > vOutputs;
     int64_t nRemRCTOutput = nLastValidRCTOutput;
     CAnonOutput ao;
     while (true)
@@ -302,11 +419,10 @@ bool RollBackRCTIndex(int64_t nLastValidRCTOutput, int64_t nExpectErase, std::se
         nRemRCTOutput++;
         if (!pblocktree->ReadRCTOutput(nRemRCTOutput, ao))
             break;
-        pblocktree->EraseRCTOutput(nRemRCTOutput);
-        pblocktree->EraseRCTOutputLink(ao.pubkey);
+        vOutputs.push_back(std::make_pair(nRemRCTOutput, ao.pubkey));
     };
 
-    LogPrintf("%s: Removed up to %d\n", __func__, nRemRCTOutput);
+    LogPrintf("%s: Removing up to %d\n", __func__, nRemRCTOutput);
     if (nExpectErase > nRemRCTOutput)
     {
         nRemRCTOutput = nExpectErase;
@@ -314,17 +430,15 @@ bool RollBackRCTIndex(int64_t nLastValidRCTOutput, int64_t nExpectErase, std::se
         {
             if (!pblocktree->ReadRCTOutput(nRemRCTOutput, ao))
                 break;
-            pblocktree->EraseRCTOutput(nRemRCTOutput);
-            pblocktree->EraseRCTOutputLink(ao.pubkey);
+            vOutputs.push_back(std::make_pair(nRemRCTOutput, ao.pubkey));
             nRemRCTOutput--;
         };
-        LogPrintf("%s: Removed down to %d\n", __func__, nRemRCTOutput);
+        LogPrintf("%s: Removing down to %d\n", __func__, nRemRCTOutput);
     };
 
-    for (const auto &ki : setKi)
-    {
-        pblocktree->EraseRCTKeyImage(ki);
-    };
+    std::vector<CCmpPubKey> vKeyImages(setKi.begin(), setKi.end());
+    if (!pblocktree->EraseRCTOutputs(vOutputs, vKeyImages))
+        return error("%s: EraseRCTOutputs failed.", __func__);
 
     return true;
 };
@@ -340,6 +454,15 @@ bool RewindToCheckpoint(int nCheckPointHeight, int &nBlocks, std::string &sError
     view.fForceDisconnect = true;
     CValidationState state;
 
+    // Fail before disconnecting anything if pruning removed a block or its undo data
+    for (CBlockIndex *pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
+    {
+        if (pindex->nHeight <= nCheckPointHeight)
+            break;
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA) || !(pindex->nStatus & BLOCK_HAVE_UNDO))
+            return errorN(false, sError, __func__, "Block %d not available (pruned data).", pindex->nHeight);
+    };
+
     for (CBlockIndex *pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
     {
         if (pindex->nHeight <= nCheckPointHeight)
@@ -365,14 +488,17 @@ bool RewindToCheckpoint(int nCheckPointHeight, int &nBlocks, std::string &sError
     };
     nLastRCTOutput = chainActive.Tip()->nAnonOutputs;
 
-    int nRemoveOutput = nLastRCTOutput+1;
+    // Disconnecting erased the outputs of each block, drop any left above the tip
+    std::vector<std::pair<int64_t, CCmpPubKey> > vOutputs;
+    int64_t nRemoveOutput = nLastRCTOutput+1;
     CAnonOutput ao;
     while (pblocktree->ReadRCTOutput(nRemoveOutput, ao))
     {
-        pblocktree->EraseRCTOutput(nRemoveOutput);
-        pblocktree->EraseRCTOutputLink(ao.pubkey);
+        vOutputs.push_back(std::make_pair(nRemoveOutput, ao.pubkey));
         nRemoveOutput++;
     };
+    if (!vOutputs.empty() && !pblocktree->EraseRCTOutputs(vOutputs, std::vector<CCmpPubKey>()))
+        return errorN(false, sError, __func__, "EraseRCTOutputs failed.");
 
     return true;
 };
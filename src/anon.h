@@ -22,11 +22,94 @@ const size_t ANON_FEE_MULTIPLIER = 2;
 const size_t DEFAULT_RING_SIZE = 7;
 const size_t DEFAULT_INPUTS_PER_SIG = 1;
 
-
-
-bool VerifyMLSAG(const CTransaction &tx, CValidationState &state);
-
-bool AddKeyImagesToMempool(const CTransaction &tx, CTxMemPool &pool);
+//! Check queue cost of a ring signature per ring member and row, in signature checks
+const unsigned int MLSAG_CHECK_COST_NUM = 3;
+const unsigned int MLSAG_CHECK_COST_DEN = 2;
+
+
+/**
+ * Closure representing the elliptic curve part of verifying one anon input.
+ * Ring members are resolved by VerifyMLSAG before the check is created, so
+ * the check itself touches no shared state and can run on a script check thread.
+ */
+class CMLSAGCheck
+{
+private:
+    const CTransaction *ptxTo;
+    unsigned int nIn;
+    size_t nCols;
+    size_t nRows;
+    bool fSplitCommitments;
+    std::vector<uint8_t> vM;
+    std::vector<secp256k1_pedersen_commitment> vCommitments;
+    secp256k1_pedersen_commitment plainCommitment;
+    uint256 hashCacheEntry;
+    bool cacheStore;
+    int nError;
+    const char *sReason;
+
+    /** Sum the commitments into the last row of vM */
+    bool Prepare();
+
+public:
+    CMLSAGCheck() : ptxTo(nullptr), nIn(0), nCols(0), nRows(0), fSplitCommitments(false), plainCommitment(), cacheStore(false), nError(0), sReason("") {}
+    CMLSAGCheck(const CTransaction &txToIn, unsigned int nInIn, size_t nColsIn, size_t nRowsIn, bool fSplitCommitmentsIn,
+        std::vector<uint8_t> &vMIn, std::vector<secp256k1_pedersen_commitment> &vCommitmentsIn,
+        const secp256k1_pedersen_commitment &plainCommitmentIn, const uint256 &hashCacheEntryIn, bool cacheIn) :
+        ptxTo(&txToIn), nIn(nInIn), nCols(nColsIn), nRows(nRowsIn), fSplitCommitments(fSplitCommitmentsIn),
+        plainCommitment(plainCommitmentIn), hashCacheEntry(hashCacheEntryIn), cacheStore(cacheIn), nError(0), sReason("")
+    {
+        vM.swap(vMIn);
+        vCommitments.swap(vCommitmentsIn);
+    };
+
+    bool operator()();
+
+    /**
+     * Verify the ring signatures of several checks together.
+     * Returns false if any failed, the error and reject reason are set on each failed check.
+     */
+    static bool VerifyBatch(CMLSAGCheck * const *ppChecks, size_t nChecks);
+
+    void swap(CMLSAGCheck &check)
+    {
+        std::swap(ptxTo, check.ptxTo);
+        std::swap(nIn, check.nIn);
+        std::swap(nCols, check.nCols);
+        std::swap(nRows, check.nRows);
+        std::swap(fSplitCommitments, check.fSplitCommitments);
+        vM.swap(check.vM);
+        vCommitments.swap(check.vCommitments);
+        std::swap(plainCommitment, check.plainCommitment);
+        std::swap(hashCacheEntry, check.hashCacheEntry);
+        std::swap(cacheStore, check.cacheStore);
+        std::swap(nError, check.nError);
+        std::swap(sReason, check.sReason);
+    };
+
+    int GetError() const { return nError; };
+    bool IsError() const { return nError != 0; };
+    const char *GetRejectReason() const { return sReason; };
+
+    unsigned int GetCost() const { return nCols * nRows * MLSAG_CHECK_COST_NUM / MLSAG_CHECK_COST_DEN; };
+};
+
+/** Batch sizing hint of CCheckQueue, ring signatures cost many times a script check */
+inline unsigned int GetCheckCost(const CMLSAGCheck &check)
+{
+    return check.GetCost();
+};
+
+/**
+ * Check the anon inputs of tx.
+ * If pvChecks is not nullptr the ring signature checks are pushed onto it instead of being run inline,
+ * the commitment tally is always verified inline.
+ * Ring signatures found in the MLSAG cache are skipped, cacheStore works as in CachingTransactionSignatureChecker.
+ */
+bool VerifyMLSAG(const CTransaction &tx, CValidationState &state, std::vector<CMLSAGCheck> *pvChecks = nullptr, bool cacheStore = true);
+
+/** tx must be the transaction held by the mempool entry, pool.mapKeyImages keeps a pointer to it */
+bool AddKeyImagesToMempool(const CTransaction &tx, const CTxIn &txin, CTxMemPool &pool);
 bool RemoveKeyImagesFromMempool(const uint256 &hash, const CTxIn &txin, CTxMemPool &pool);
 
 bool AllAnonOutputsUnknown(const CTransaction &tx, CValidationState &state);
@@ -0,0 +1,448 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <backgroundverify.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <insight/spentindex.h>
+#include <rctindex.h>
+#include <shutdown.h>
+#include <txdb.h>
+#include <undo.h>
+#include <util.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <set>
+
+CBackgroundVerifier g_background_verifier;
+
+CBackgroundVerifier::~CBackgroundVerifier()
+{
+    Stop();
+};
+
+bool CBackgroundVerifier::Start(const CChainParams &chainparams, int nCheckLevel, int nBlocks, int nThreads, uint64_t nMaxRateIn, std::string &sError)
+{
+    if (IsRunning()) {
+        sError = "Background verification is already running";
+        return false;
+    }
+    // Join the workers of a finished run
+    Stop();
+
+    nCheckLevel = std::max(0, std::min(4, nCheckLevel));
+    nThreads = std::max(1, std::min(MAX_BACKGROUND_CHECKTHREADS, nThreads));
+
+    vBlocks.clear();
+    {
+        LOCK(cs_main);
+        const CBlockIndex *pindexTip = chainActive.Tip();
+        if (!pindexTip || !pindexTip->pprev) {
+            sError = "No blocks to verify";
+            return false;
+        }
+        if (nBlocks <= 0 || nBlocks > pindexTip->nHeight) {
+            nBlocks = pindexTip->nHeight;
+        }
+        vBlocks.reserve(nBlocks);
+        for (const CBlockIndex *pindex = pindexTip; pindex->pprev && (int)vBlocks.size() < nBlocks; pindex = pindex->pprev) {
+            vBlocks.push_back(pindex);
+        }
+    }
+
+    {
+        LOCK(cs);
+        status = CVerifyStatus();
+        status.fRunning = true;
+        status.nCheckLevel = nCheckLevel;
+        status.nThreads = nThreads;
+        status.nEndHeight = vBlocks.front()->nHeight;
+        status.nStartHeight = vBlocks.back()->nHeight;
+        status.nBlocks = vBlocks.size();
+        status.nStartTime = GetTimeMicros();
+    }
+
+    m_params = &chainparams;
+    nMaxRate = nMaxRateIn;
+    nNext = 0;
+    nChecked = 0;
+    nSkipped = 0;
+    nFailed = 0;
+    nBytesRead = 0;
+    m_interrupt.reset();
+
+    LogPrintf("Verifying blocks %d to %d at level %d in the background, %d threads.\n",
+        status.nStartHeight, status.nEndHeight, nCheckLevel, nThreads);
+
+    nRunning = nThreads;
+    for (int i = 0; i < nThreads; ++i) {
+        vThreads.emplace_back(&TraceThread<std::function<void()> >, "verify",
+            std::bind(&CBackgroundVerifier::ThreadWorker, this));
+    }
+
+    return true;
+};
+
+void CBackgroundVerifier::Stop()
+{
+    if (IsRunning()) {
+        LOCK(cs);
+        status.fAborted = true;
+    }
+    m_interrupt();
+    for (auto &t : vThreads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+    vThreads.clear();
+};
+
+CVerifyStatus CBackgroundVerifier::GetStatus() const
+{
+    LOCK(cs);
+    CVerifyStatus rv = status;
+    rv.nChecked = nChecked;
+    rv.nSkipped = nSkipped;
+    rv.nFailed = nFailed;
+    rv.nBytesRead = nBytesRead;
+    return rv;
+};
+
+void CBackgroundVerifier::ThreadWorker()
+{
+    int nLevel;
+    {
+        LOCK(cs);
+        nLevel = status.nCheckLevel;
+    }
+
+    while (!m_interrupt && !ShutdownRequested()) {
+        size_t i = nNext++;
+        if (i >= vBlocks.size()) {
+            break;
+        }
+        if (CheckBlockIndex(vBlocks[i])) {
+            nChecked++;
+        }
+    }
+
+    if (--nRunning == 0) {
+        LOCK(cs);
+        status.fRunning = false;
+        status.fAborted |= (bool)m_interrupt || ShutdownRequested();
+        status.nEndTime = GetTimeMicros();
+        LogPrintf("Background verification of blocks %d to %d at level %d %s: %d checked, %d skipped, %d failed.\n",
+            status.nStartHeight, status.nEndHeight, nLevel, status.fAborted ? "aborted" : "done",
+            (int64_t)nChecked, (int64_t)nSkipped, (int64_t)nFailed);
+    }
+};
+
+bool CBackgroundVerifier::CheckBlockIndex(const CBlockIndex *pindex)
+{
+    int nLevel;
+    {
+        LOCK(cs);
+        nLevel = status.nCheckLevel;
+    }
+
+    auto fail = [&](const std::string &sCheck, const std::string &sMessage) {
+        {
+            // A block disconnected while it was checked may have lost its undo and RCT rows
+            LOCK(cs_main);
+            if (!chainActive.Contains(pindex)) {
+                nSkipped++;
+                return false;
+            }
+        }
+        AddFailure(pindex, sCheck, sMessage);
+        return false;
+    };
+
+    {
+        LOCK(cs_main);
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA) || !chainActive.Contains(pindex)) {
+            nSkipped++;
+            return false;
+        }
+    }
+
+    // check level 0: read from disk
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, m_params->GetConsensus())) {
+        {
+            LOCK(cs_main);
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA)) { // Pruned meanwhile
+                nSkipped++;
+                return false;
+            }
+        }
+        return fail("read", "ReadBlockFromDisk failed");
+    }
+    Throttle(::GetSerializeSize(block, SER_DISK, CLIENT_VERSION));
+
+    // check level 1: verify block validity
+    CValidationState state;
+    if (nLevel >= 1 && !CheckBlock(block, state, m_params->GetConsensus())) {
+        return fail("block", FormatStateMessage(state));
+    }
+
+    std::string sCheck, sMessage;
+    if (nLevel >= 2 && !CheckUndo(block, pindex, sCheck, sMessage)) {
+        return fail(sCheck, sMessage);
+    }
+    if (nLevel >= 3 && !CheckRCT(block, pindex, sCheck, sMessage)) {
+        return fail(sCheck, sMessage);
+    }
+    if (nLevel >= 4 && !CheckInsight(block, pindex, sCheck, sMessage)) {
+        return fail(sCheck, sMessage);
+    }
+
+    return true;
+};
+
+bool CBackgroundVerifier::CheckUndo(const CBlock &block, const CBlockIndex *pindex, std::string &sCheck, std::string &sMessage)
+{
+    sCheck = "undo";
+
+    bool fHaveUndo;
+    {
+        LOCK(cs_main);
+        fHaveUndo = pindex->nStatus & BLOCK_HAVE_UNDO;
+    }
+    if (!fHaveUndo) {
+        return true;
+    }
+
+    CBlockUndo blockUndo;
+    if (!UndoReadFromDisk(blockUndo, pindex)) {
+        sMessage = "UndoReadFromDisk failed";
+        return false;
+    }
+    Throttle(::GetSerializeSize(blockUndo, SER_DISK, CLIENT_VERSION));
+
+    // Same pairing of txns and undo records as DisconnectBlock
+    std::vector<const CTransaction*> vUndoTxns;
+    for (size_t i = fBitcoinCMode ? 0 : 1; i < block.vtx.size(); ++i) {
+        if (!fBitcoinCMode || !block.vtx[i]->IsCoinBase()) {
+            vUndoTxns.push_back(block.vtx[i].get());
+        }
+    }
+    if (blockUndo.vtxundo.size() != vUndoTxns.size()) {
+        sMessage = strprintf("%d undo records for %d txns", blockUndo.vtxundo.size(), vUndoTxns.size());
+        return false;
+    }
+
+    for (size_t i = 0; i < vUndoTxns.size(); ++i) {
+        const CTransaction &tx = *vUndoTxns[i];
+        const CTxUndo &txundo = blockUndo.vtxundo[i];
+
+        size_t nExpectUndo = 0;
+        for (const auto &txin : tx.vin) {
+            if (!txin.IsAnonInput()) {
+                nExpectUndo++;
+            }
+        }
+        if (txundo.vprevout.size() != nExpectUndo) {
+            sMessage = strprintf("%d undo coins for %d inputs, txn %s", txundo.vprevout.size(), nExpectUndo, tx.GetHash().ToString());
+            return false;
+        }
+        for (const auto &coin : txundo.vprevout) {
+            if ((int)coin.nHeight > pindex->nHeight) {
+                sMessage = strprintf("Undo coin from height %d, txn %s", coin.nHeight, tx.GetHash().ToString());
+                return false;
+            }
+        }
+    }
+
+    if (!blockUndo.fHaveRCT) {
+        return true;
+    }
+
+    int64_t nRCTOutputs = 0;
+    std::set<CCmpPubKey> setKeyImages;
+    for (const auto &tx : block.vtx) {
+        for (const auto &txout : tx->vpout) {
+            if (txout->IsType(OUTPUT_RINGCT)) {
+                nRCTOutputs++;
+            }
+        }
+        for (const auto &txin : tx->vin) {
+            if (!txin.IsAnonInput()) {
+                continue;
+            }
+            uint32_t nInputs, nRingSize;
+            txin.GetAnonInfo(nInputs, nRingSize);
+            if (txin.scriptData.stack.size() != 1
+                || txin.scriptData.stack[0].size() != 33 * nInputs) {
+                sMessage = strprintf("Bad scriptData stack, txn %s", tx->GetHash().ToString());
+                return false;
+            }
+            for (size_t k = 0; k < nInputs; ++k) {
+                setKeyImages.insert(*((CCmpPubKey*)&txin.scriptData.stack[0][k*33]));
+            }
+        }
+    }
+
+    if (blockUndo.nLastRCTOutput != pindex->nAnonOutputs
+        || blockUndo.nLastRCTOutput - blockUndo.nFirstRCTOutput + 1 != nRCTOutputs) {
+        sMessage = strprintf("RCT range %d-%d for %d outputs, index %d",
+            blockUndo.nFirstRCTOutput, blockUndo.nLastRCTOutput, nRCTOutputs, pindex->nAnonOutputs);
+        return false;
+    }
+    if (std::set<CCmpPubKey>(blockUndo.vKeyImages.begin(), blockUndo.vKeyImages.end()) != setKeyImages) {
+        sMessage = strprintf("%d undo key images for %d spent", blockUndo.vKeyImages.size(), setKeyImages.size());
+        return false;
+    }
+
+    return true;
+};
+
+bool CBackgroundVerifier::CheckRCT(const CBlock &block, const CBlockIndex *pindex, std::string &sCheck, std::string &sMessage)
+{
+    sCheck = "rct";
+
+    int64_t nRCTOutputs = 0;
+    for (const auto &tx : block.vtx) {
+        for (const auto &txout : tx->vpout) {
+            if (txout->IsType(OUTPUT_RINGCT)) {
+                nRCTOutputs++;
+            }
+        }
+    }
+
+    // The block's anon outputs are numbered in order up to the block index's count
+    int64_t nIndex = pindex->nAnonOutputs - nRCTOutputs + 1;
+    for (const auto &tx : block.vtx) {
+        const uint256 txhash = tx->GetHash();
+        for (size_t k = 0; k < tx->vpout.size(); ++k) {
+            if (!tx->vpout[k]->IsType(OUTPUT_RINGCT)) {
+                continue;
+            }
+            const CTxOutRingCT *txout = (const CTxOutRingCT*)tx->vpout[k].get();
+
+            CAnonOutput ao;
+            int64_t nLinked;
+            if (!pblocktree->ReadRCTOutput(nIndex, ao)) {
+                sMessage = strprintf("RCT output %d missing, txn %s, %d", nIndex, txhash.ToString(), k);
+                return false;
+            }
+            if (ao.pubkey != txout->pk
+                || memcmp(ao.commitment.data, txout->commitment.data, 33) != 0
+                || ao.outpoint != COutPoint(txhash, k)
+                || ao.nBlockHeight != pindex->nHeight) {
+                sMessage = strprintf("RCT output %d mismatch, txn %s, %d", nIndex, txhash.ToString(), k);
+                return false;
+            }
+            if (!pblocktree->ReadRCTOutputLink(txout->pk, nLinked) || nLinked != nIndex) {
+                sMessage = strprintf("RCT output link of %d missing or mismatched, txn %s, %d", nIndex, txhash.ToString(), k);
+                return false;
+            }
+            nIndex++;
+        }
+
+        for (const auto &txin : tx->vin) {
+            if (!txin.IsAnonInput()) {
+                continue;
+            }
+            uint32_t nInputs, nRingSize;
+            txin.GetAnonInfo(nInputs, nRingSize);
+            if (txin.scriptData.stack.size() != 1
+                || txin.scriptData.stack[0].size() != 33 * nInputs) {
+                sMessage = strprintf("Bad scriptData stack, txn %s", txhash.ToString());
+                return false;
+            }
+            for (size_t k = 0; k < nInputs; ++k) {
+                const CCmpPubKey &ki = *((CCmpPubKey*)&txin.scriptData.stack[0][k*33]);
+                uint256 txhashKI;
+                if (!pblocktree->ReadRCTKeyImage(ki, txhashKI) || txhashKI != txhash) {
+                    sMessage = strprintf("Key image %s missing or mismatched, txn %s", HexStr(ki.begin(), ki.end()), txhash.ToString());
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+};
+
+bool CBackgroundVerifier::CheckInsight(const CBlock &block, const CBlockIndex *pindex, std::string &sCheck, std::string &sMessage)
+{
+    sCheck = "insight";
+
+    if (fTimestampIndex) {
+        unsigned int nLogicalTS;
+        if (!pblocktree->ReadTimestampBlockIndex(pindex->GetBlockHash(), nLogicalTS)) {
+            sMessage = "Timestamp index row missing";
+            return false;
+        }
+    }
+
+    if (!fSpentIndex) {
+        return true;
+    }
+
+    // Spread the samples over the block's inputs
+    std::vector<std::pair<size_t, unsigned int> > vInputs;
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const CTransaction &tx = *block.vtx[i];
+        if (tx.IsCoinBase()) {
+            continue;
+        }
+        for (unsigned int j = 0; j < tx.vin.size(); ++j) {
+            if (!tx.vin[j].IsAnonInput()) {
+                vInputs.emplace_back(i, j);
+            }
+        }
+    }
+    size_t nStep = std::max((size_t)1, vInputs.size() / BACKGROUND_VERIFY_SPENT_SAMPLES);
+    for (size_t s = 0; s < vInputs.size(); s += nStep) {
+        const CTransaction &tx = *block.vtx[vInputs[s].first];
+        unsigned int j = vInputs[s].second;
+        CSpentIndexKey key(tx.vin[j].prevout.hash, tx.vin[j].prevout.n);
+        CSpentIndexValue value;
+        if (!pblocktree->ReadSpentIndex(key, value)
+            || value.txid != tx.GetHash() || value.inputIndex != j || value.blockHeight != pindex->nHeight) {
+            sMessage = strprintf("Spent index row of %s missing or mismatched", tx.vin[j].prevout.ToString());
+            return false;
+        }
+    }
+
+    return true;
+};
+
+void CBackgroundVerifier::Throttle(size_t nBytes)
+{
+    uint64_t nRead = nBytesRead += nBytes;
+    if (nMaxRate == 0) {
+        return;
+    }
+
+    int64_t nStartTime;
+    {
+        LOCK(cs);
+        nStartTime = status.nStartTime;
+    }
+    int64_t nAllowedTime = nStartTime + (int64_t)(nRead * 1000000 / nMaxRate);
+    int64_t nWait = nAllowedTime - GetTimeMicros();
+    if (nWait > 0) {
+        m_interrupt.sleep_for(std::chrono::milliseconds(nWait / 1000));
+    }
+};
+
+void CBackgroundVerifier::AddFailure(const CBlockIndex *pindex, const std::string &sCheck, const std::string &sMessage)
+{
+    nFailed++;
+    LogPrintf("Background verification failed at height %d, hash %s, check %s: %s\n",
+        pindex->nHeight, pindex->GetBlockHash().ToString(), sCheck, sMessage);
+
+    LOCK(cs);
+    if (status.vFailures.size() < MAX_BACKGROUND_VERIFY_FAILURES) {
+        status.vFailures.push_back(CVerifyFailure{pindex->nHeight, pindex->GetBlockHash(), sCheck, sMessage});
+    }
+};
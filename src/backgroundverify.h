@@ -0,0 +1,125 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_BACKGROUNDVERIFY_H
+#define BITCOINC_BACKGROUNDVERIFY_H
+
+#include <sync.h>
+#include <threadinterrupt.h>
+#include <uint256.h>
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CChainParams;
+
+//! Default check level and thread count of the background verifier
+static const int DEFAULT_BACKGROUND_CHECKLEVEL = 4;
+static const int DEFAULT_BACKGROUND_CHECKTHREADS = 2;
+static const int MAX_BACKGROUND_CHECKTHREADS = 16;
+//! Default block and undo data read per second by the background verifier, in MiB, 0 = no limit
+static const int DEFAULT_BACKGROUND_CHECKRATE = 32;
+//! Blocks to check in the background after startup, 0 = off
+static const int DEFAULT_BACKGROUND_CHECKBLOCKS = 0;
+//! Failures kept for getverifychaininfo, later ones are only logged
+static const size_t MAX_BACKGROUND_VERIFY_FAILURES = 100;
+//! Spent index rows checked per block at level 4
+static const size_t BACKGROUND_VERIFY_SPENT_SAMPLES = 8;
+
+/** A check the background verifier found to fail */
+struct CVerifyFailure
+{
+    int nHeight;
+    uint256 hashBlock;
+    std::string sCheck;
+    std::string sMessage;
+};
+
+/** Progress of a background verification, see CBackgroundVerifier::GetStatus */
+struct CVerifyStatus
+{
+    bool fRunning = false;
+    bool fAborted = false;
+    int nCheckLevel = 0;
+    int nThreads = 0;
+    int nStartHeight = 0;       //!< Lowest height to check
+    int nEndHeight = 0;         //!< Tip when the verification started
+    int64_t nBlocks = 0;        //!< Blocks to check
+    int64_t nChecked = 0;
+    int64_t nSkipped = 0;       //!< Pruned or disconnected while checking
+    int64_t nFailed = 0;
+    uint64_t nBytesRead = 0;
+    int64_t nStartTime = 0;
+    int64_t nEndTime = 0;
+    std::vector<CVerifyFailure> vFailures;
+};
+
+/**
+ * Checks active chain blocks across worker threads without holding cs_main.
+ *
+ * Check levels, each including the ones below it:
+ *  0. read the block from disk
+ *  1. CheckBlock
+ *  2. read the undo data and check it against the block: txn and input counts,
+ *     prevout heights, the RCT output range and key images it records
+ *  3. RCT output index: every anon output of the block is at its index with the
+ *     pubkey link, commitment and outpoint, every key image spent by the block maps to its txn
+ *  4. insight spot checks: the timestamp index of the block and up to
+ *     BACKGROUND_VERIFY_SPENT_SAMPLES spent index rows
+ *
+ * Unlike CVerifyDB the coins database is not disconnected and reconnected. Block
+ * and undo reads are throttled to nMaxRate bytes per second over all workers.
+ * A failing block that left the active chain while it was checked is counted as skipped.
+ */
+class CBackgroundVerifier
+{
+public:
+    ~CBackgroundVerifier();
+
+    /** Verify the nBlocks blocks below and including the tip, 0 for all. False if already running */
+    bool Start(const CChainParams &chainparams, int nCheckLevel, int nBlocks, int nThreads, uint64_t nMaxRate, std::string &sError);
+
+    /** Stop the workers and wait for them */
+    void Stop();
+
+    CVerifyStatus GetStatus() const;
+
+    bool IsRunning() const { return nRunning > 0; };
+
+private:
+    void ThreadWorker();
+    bool CheckBlockIndex(const CBlockIndex *pindex);
+    void Throttle(size_t nBytes);
+    void AddFailure(const CBlockIndex *pindex, const std::string &sCheck, const std::string &sMessage);
+
+    bool CheckUndo(const CBlock &block, const CBlockIndex *pindex, std::string &sCheck, std::string &sMessage);
+    bool CheckRCT(const CBlock &block, const CBlockIndex *pindex, std::string &sCheck, std::string &sMessage);
+    bool CheckInsight(const CBlock &block, const CBlockIndex *pindex, std::string &sCheck, std::string &sMessage);
+
+    mutable CCriticalSection cs;
+    CVerifyStatus status GUARDED_BY(cs);
+
+    const CChainParams *m_params = nullptr;
+    std::vector<const CBlockIndex*> vBlocks; // Highest first, fixed while the workers run
+    std::vector<std::thread> vThreads;
+    CThreadInterrupt m_interrupt;
+    uint64_t nMaxRate = 0;
+
+    std::atomic<size_t> nNext{0};
+    std::atomic<int> nRunning{0};
+    std::atomic<int64_t> nChecked{0};
+    std::atomic<int64_t> nSkipped{0};
+    std::atomic<int64_t> nFailed{0};
+    std::atomic<uint64_t> nBytesRead{0};
+};
+
+extern CBackgroundVerifier g_background_verifier;
+
+#endif // BITCOINC_BACKGROUNDVERIFY_H
@@ -31,6 +31,10 @@ static const int8_t mapBase58[256] = {
     -1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,
 };
 
+//! Base58 digits held per limb, 58^5 fits in 32 bits
+static const int BASE58_LIMB_DIGITS = 5;
+static const uint32_t BASE58_LIMB = 58 * 58 * 58 * 58 * 58;
+
 bool DecodeBase58(const char* psz, std::vector<unsigned char>& vch)
 {
     // Skip leading spaces.
@@ -43,40 +47,54 @@ bool DecodeBase58(const char* psz, std::vector<unsigned char>& vch)
         zeroes++;
         psz++;
     }
-    // Allocate enough space in big-endian base256 representation.
-    int size = strlen(psz) * 733 /1000 + 1; // log(58) / log(256), rounded up.
-    std::vector<unsigned char> b256(size);
-    // Process the characters.
+    const char* pend = psz;
+    while (*pend && !isspace(*pend))
+        pend++;
+    // Allocate enough space in big-endian base 2^32 representation.
+    int size = (pend - psz) * 733 /1000 + 1; // log(58) / log(256), rounded up.
+    std::vector<uint32_t> b256((size + 3) / 4);
+    // Process the characters, up to five at a time so each pass over the
+    // result multiplies by 58^5 instead of 58.
     static_assert(sizeof(mapBase58)/sizeof(mapBase58[0]) == 256, "mapBase58.size() should be 256"); // guarantee not out of range
-    while (*psz && !isspace(*psz)) {
-        // Decode base58 character
-        int carry = mapBase58[(uint8_t)*psz];
-        if (carry == -1)  // Invalid b58 character
-            return false;
+    while (psz != pend) {
+        // The first chunk takes the remainder so the rest are whole.
+        int n = (pend - psz) % BASE58_LIMB_DIGITS;
+        if (n == 0)
+            n = BASE58_LIMB_DIGITS;
+        uint64_t carry = 0;
+        uint64_t multiplier = 1;
+        for (int k = 0; k < n; ++k, ++psz) {
+            // Decode base58 character
+            int digit = mapBase58[(uint8_t)*psz];
+            if (digit == -1)  // Invalid b58 character
+                return false;
+            carry = carry * 58 + digit;
+            multiplier *= 58;
+        }
         int i = 0;
-        for (std::vector<unsigned char>::reverse_iterator it = b256.rbegin(); (carry != 0 || i < length) && (it != b256.rend()); ++it, ++i) {
-            carry += 58 * (*it);
-            *it = carry % 256;
-            carry /= 256;
+        for (std::vector<uint32_t>::reverse_iterator it = b256.rbegin(); (carry != 0 || i < length) && (it != b256.rend()); ++it, ++i) {
+            carry += multiplier * (*it);
+            *it = (uint32_t)carry;
+            carry >>= 32;
         }
         assert(carry == 0);
         length = i;
-        psz++;
     }
     // Skip trailing spaces.
     while (isspace(*psz))
         psz++;
     if (*psz != 0)
         return false;
-    // Skip leading zeroes in b256.
-    std::vector<unsigned char>::iterator it = b256.begin() + (size - length);
-    while (it != b256.end() && *it == 0)
-        it++;
-    // Copy result into output vector.
-    vch.reserve(zeroes + (b256.end() - it));
+    // Copy result into output vector, skipping leading zeroes in b256.
+    vch.reserve(zeroes + length * 4);
     vch.assign(zeroes, 0x00);
-    while (it != b256.end())
-        vch.push_back(*(it++));
+    for (std::vector<uint32_t>::iterator it = b256.end() - length; it != b256.end(); ++it) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            unsigned char c = (*it) >> shift;
+            if (c != 0 || vch.size() > (size_t)zeroes)
+                vch.push_back(c);
+        }
+    }
     return true;
 }
 
@@ -89,34 +107,46 @@ std::string EncodeBase58(const unsigned char* pbegin, const unsigned char* pend)
         pbegin++;
         zeroes++;
     }
-    // Allocate enough space in big-endian base58 representation.
+    // Allocate enough space in big-endian base 58^5 representation.
     int size = (pend - pbegin) * 138 / 100 + 1; // log(256) / log(58), rounded up.
-    std::vector<unsigned char> b58(size);
-    // Process the bytes.
+    std::vector<uint32_t> b58((size + BASE58_LIMB_DIGITS - 1) / BASE58_LIMB_DIGITS);
+    // Process the bytes, up to four at a time.
     while (pbegin != pend) {
-        int carry = *pbegin;
+        // The first chunk takes the remainder so the rest are whole.
+        int n = (pend - pbegin) % 4;
+        if (n == 0)
+            n = 4;
+        uint64_t carry = 0;
+        for (int k = 0; k < n; ++k)
+            carry = (carry << 8) | *(pbegin++);
+        uint64_t multiplier = (uint64_t)1 << (8 * n);
         int i = 0;
-        // Apply "b58 = b58 * 256 + ch".
-        for (std::vector<unsigned char>::reverse_iterator it = b58.rbegin(); (carry != 0 || i < length) && (it != b58.rend()); it++, i++) {
-            carry += 256 * (*it);
-            *it = carry % 58;
-            carry /= 58;
+        // Apply "b58 = b58 * 256^n + chunk".
+        for (std::vector<uint32_t>::reverse_iterator it = b58.rbegin(); (carry != 0 || i < length) && (it != b58.rend()); it++, i++) {
+            carry += multiplier * (*it);
+            *it = carry % BASE58_LIMB;
+            carry /= BASE58_LIMB;
         }
 
         assert(carry == 0);
         length = i;
-        pbegin++;
     }
-    // Skip leading zeroes in base58 result.
-    std::vector<unsigned char>::iterator it = b58.begin() + (size - length);
-    while (it != b58.end() && *it == 0)
-        it++;
-    // Translate the result into a string.
+    // Translate the result into a string, skipping leading zeroes in base58 result.
     std::string str;
-    str.reserve(zeroes + (b58.end() - it));
+    str.reserve(zeroes + length * BASE58_LIMB_DIGITS);
     str.assign(zeroes, '1');
-    while (it != b58.end())
-        str += pszBase58[*(it++)];
+    for (std::vector<uint32_t>::iterator it = b58.end() - length; it != b58.end(); ++it) {
+        char digits[BASE58_LIMB_DIGITS];
+        uint32_t limb = *it;
+        for (int k = BASE58_LIMB_DIGITS - 1; k >= 0; --k) {
+            digits[k] = limb % 58;
+            limb /= 58;
+        }
+        for (int k = 0; k < BASE58_LIMB_DIGITS; ++k) {
+            if (digits[k] != 0 || str.size() > (size_t)zeroes)
+                str += pszBase58[(int)digits[k]];
+        }
+    }
     return str;
 }
 
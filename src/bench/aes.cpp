@@ -0,0 +1,52 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <crypto/aes.h>
+
+#include <vector>
+
+/* Number of bytes to encrypt per iteration */
+static const uint64_t BUFFER_SIZE = 1000*1000;
+
+/* Size of an encrypted wallet key, each is encrypted with its own IV */
+static const uint64_t KEY_SIZE = 48;
+
+static const unsigned char key[AES256_KEYSIZE] = {1};
+static const unsigned char iv[AES_BLOCKSIZE] = {2};
+
+static void Encrypt(benchmark::State& state, bool allow_hardware, size_t size)
+{
+    AES256AutoDetect(allow_hardware);
+    std::vector<unsigned char> in(size, 0), out(size + AES_BLOCKSIZE);
+    while (state.KeepRunning()) {
+        AES256CBCEncrypt(key, iv, true).Encrypt(in.data(), in.size(), out.data());
+    }
+    AES256AutoDetect();
+}
+
+static void Decrypt(benchmark::State& state, bool allow_hardware, size_t size)
+{
+    AES256AutoDetect(allow_hardware);
+    std::vector<unsigned char> in(size, 0), enc(size + AES_BLOCKSIZE), out(size + AES_BLOCKSIZE);
+    int enc_size = AES256CBCEncrypt(key, iv, true).Encrypt(in.data(), in.size(), enc.data());
+    while (state.KeepRunning()) {
+        AES256CBCDecrypt(key, iv, true).Decrypt(enc.data(), enc_size, out.data());
+    }
+    AES256AutoDetect();
+}
+
+static void AES256CBCEncrypt_ctaes(benchmark::State& state) { Encrypt(state, false, BUFFER_SIZE); }
+static void AES256CBCEncrypt_autodetect(benchmark::State& state) { Encrypt(state, true, BUFFER_SIZE); }
+static void AES256CBCDecrypt_ctaes(benchmark::State& state) { Decrypt(state, false, BUFFER_SIZE); }
+static void AES256CBCDecrypt_autodetect(benchmark::State& state) { Decrypt(state, true, BUFFER_SIZE); }
+static void AES256CBCDecrypt_48b_ctaes(benchmark::State& state) { Decrypt(state, false, KEY_SIZE); }
+static void AES256CBCDecrypt_48b_autodetect(benchmark::State& state) { Decrypt(state, true, KEY_SIZE); }
+
+BENCHMARK(AES256CBCEncrypt_ctaes, 10);
+BENCHMARK(AES256CBCEncrypt_autodetect, 100);
+BENCHMARK(AES256CBCDecrypt_ctaes, 10);
+BENCHMARK(AES256CBCDecrypt_autodetect, 500);
+BENCHMARK(AES256CBCDecrypt_48b_ctaes, 100 * 1000);
+BENCHMARK(AES256CBCDecrypt_48b_autodetect, 500 * 1000);
@@ -53,7 +53,42 @@ static void Base58Decode(benchmark::State& state)
     }
 }
 
+static void Base58CheckDecode(benchmark::State& state)
+{
+    const char* addr = "17VZNX1SN5NtKa8UQFxwQbFeFc3iqRYhem";
+    std::vector<unsigned char> vch;
+    while (state.KeepRunning()) {
+        DecodeBase58Check(addr, vch);
+    }
+}
+
+
+static void Base58EncodeLong(benchmark::State& state)
+{
+    // Extended keys are the longest strings encoded
+    std::vector<unsigned char> vch(78 + 4);
+    for (size_t i = 0; i < vch.size(); ++i) {
+        vch[i] = i * 37 + 11;
+    }
+    while (state.KeepRunning()) {
+        EncodeBase58(vch);
+    }
+}
+
+
+static void Base58DecodeLong(benchmark::State& state)
+{
+    const char* xpub = "xpub661MyMwAqRbcFtXgS5sYJABqqG9YLmC4Q1Rdap9gSE8NqtwybGhePY2gZ29ESFjqJoCu1Rupje8YtGqsefD265TMg7usUDFdp6W1EGMcet8";
+    std::vector<unsigned char> vch;
+    while (state.KeepRunning()) {
+        DecodeBase58(xpub, vch);
+    }
+}
+
 
 BENCHMARK(Base58Encode, 470 * 1000);
 BENCHMARK(Base58CheckEncode, 320 * 1000);
 BENCHMARK(Base58Decode, 800 * 1000);
+BENCHMARK(Base58CheckDecode, 500 * 1000);
+BENCHMARK(Base58EncodeLong, 100 * 1000);
+BENCHMARK(Base58DecodeLong, 100 * 1000);
@@ -4,7 +4,9 @@
 
 #include <bench/bench.h>
 
+#include <crypto/aes.h>
 #include <crypto/sha256.h>
+#include <crypto/sha512.h>
 #include <key.h>
 #include <random.h>
 #include <util.h>
@@ -65,6 +67,8 @@ int main(int argc, char** argv)
     const fs::path bench_datadir{SetDataDir()};
 
     SHA256AutoDetect();
+    SHA512AutoDetect();
+    AES256AutoDetect();
     RandomInit();
     ECC_Start();
     SetupEnvironment();
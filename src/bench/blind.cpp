@@ -12,6 +12,7 @@
 #include <key.h>
 
 #include <secp256k1_rangeproof.h>
+#include <secp256k1_bulletproofs.h>
 
 static void Blind(benchmark::State& state)
 {
@@ -31,7 +32,7 @@ static void Blind(benchmark::State& state)
     std::vector<uint8_t> vBlind(32);
     GetStrongRandBytes(&vBlind[0], 32);
 
-    assert(secp256k1_pedersen_commit(secp256k1_ctx_blind, &commitment, &vBlind[0], (uint64_t)nValue, secp256k1_generator_h));
+    assert(secp256k1_pedersen_commit(secp256k1_ctx_blind, &commitment, &vBlind[0], (uint64_t)nValue, secp256k1_generator_h, &secp256k1_generator_const_g));
 
     // Create range proof
     size_t nRangeProofLen = 5134;
@@ -61,3 +62,117 @@ static void Blind(benchmark::State& state)
 }
 
 BENCHMARK(Blind, 10);
+
+static void PedersenCommit(benchmark::State& state, bool fPrecomputed)
+{
+    secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
+    if (fPrecomputed)
+        secp256k1_pedersen_context_initialize(ctx);
+
+    secp256k1_pedersen_commitment commitment;
+    std::vector<uint8_t> vBlind(32);
+    GetStrongRandBytes(vBlind.data(), 32);
+    uint64_t nValue = 0;
+
+    while (state.KeepRunning())
+    {
+        nValue += COIN;
+        assert(secp256k1_pedersen_commit(ctx, &commitment, vBlind.data(), nValue,
+            &secp256k1_generator_const_h, &secp256k1_generator_const_g));
+    };
+
+    secp256k1_context_destroy(ctx);
+}
+
+static void PedersenCommitGeneric(benchmark::State& state) { PedersenCommit(state, false); }
+static void PedersenCommitPrecomputed(benchmark::State& state) { PedersenCommit(state, true); }
+
+BENCHMARK(PedersenCommitGeneric, 5000);
+BENCHMARK(PedersenCommitPrecomputed, 5000);
+
+static void MakeBulletproofs(size_t nProofs, std::vector<secp256k1_pedersen_commitment> &vCommitments, std::vector<std::vector<uint8_t> > &vRangeproofs)
+{
+    vCommitments.resize(nProofs);
+    vRangeproofs.resize(nProofs);
+
+    CBlindScratch scratch;
+    std::vector<uint8_t> vBlind(32);
+    uint8_t nonce[32];
+    for (size_t k = 0; k < nProofs; ++k)
+    {
+        uint64_t nValue = GetRand(MAX_MONEY);
+        GetStrongRandBytes(vBlind.data(), 32);
+        GetStrongRandBytes(nonce, 32);
+
+        assert(secp256k1_pedersen_commit(secp256k1_ctx_blind, &vCommitments[k], vBlind.data(), nValue,
+            &secp256k1_generator_const_h, &secp256k1_generator_const_g));
+
+        const uint8_t *bp[1] = {vBlind.data()};
+        size_t nRangeProofLen = 5134;
+        vRangeproofs[k].resize(nRangeProofLen);
+        assert(secp256k1_bulletproof_rangeproof_prove(secp256k1_ctx_blind, scratch.get(), blind_gens,
+            vRangeproofs[k].data(), &nRangeProofLen, &nValue, nullptr, bp, 1,
+            &secp256k1_generator_const_h, 64, nonce, nullptr, 0));
+        vRangeproofs[k].resize(nRangeProofLen);
+    };
+}
+
+static void BulletproofVerify(benchmark::State& state, size_t nProofs, bool fMulti)
+{
+    ECC_Start_Blinding();
+
+    std::vector<secp256k1_pedersen_commitment> vCommitments;
+    std::vector<std::vector<uint8_t> > vRangeproofs;
+    MakeBulletproofs(nProofs, vCommitments, vRangeproofs);
+
+    std::vector<const unsigned char*> vpProofs(nProofs);
+    std::vector<const secp256k1_pedersen_commitment*> vpCommitments(nProofs);
+    std::vector<secp256k1_generator> vValueGens(nProofs, secp256k1_generator_const_h);
+    for (size_t k = 0; k < nProofs; ++k)
+    {
+        vpProofs[k] = vRangeproofs[k].data();
+        vpCommitments[k] = &vCommitments[k];
+    };
+
+    // Sized for the largest run, consensus code splits batches at MAX_BULLETPROOF_BATCH
+    secp256k1_scratch_space *scratch = secp256k1_scratch_space_create(secp256k1_ctx_blind,
+        BLIND_SCRATCH_SIZE + nProofs * 16 * 1024);
+    assert(scratch);
+
+    while (state.KeepRunning())
+    {
+        if (fMulti)
+        {
+            assert(1 == secp256k1_bulletproof_rangeproof_verify_multi(secp256k1_ctx_blind,
+                scratch, blind_gens, vpProofs.data(), nProofs, vRangeproofs[0].size(),
+                nullptr, vpCommitments.data(), 1, 64, vValueGens.data(), nullptr, nullptr));
+            continue;
+        };
+
+        for (size_t k = 0; k < nProofs; ++k)
+            assert(1 == secp256k1_bulletproof_rangeproof_verify(secp256k1_ctx_blind,
+                scratch, blind_gens, vRangeproofs[k].data(), vRangeproofs[k].size(),
+                nullptr, &vCommitments[k], 1, 64, &secp256k1_generator_const_h, nullptr, 0));
+    };
+
+    secp256k1_scratch_space_destroy(scratch);
+    ECC_Stop_Blinding();
+}
+
+static void BulletproofVerify1(benchmark::State& state) { BulletproofVerify(state, 1, false); }
+static void BulletproofVerify2(benchmark::State& state) { BulletproofVerify(state, 2, false); }
+static void BulletproofVerify16(benchmark::State& state) { BulletproofVerify(state, 16, false); }
+static void BulletproofVerify256(benchmark::State& state) { BulletproofVerify(state, 256, false); }
+static void BulletproofVerifyMulti1(benchmark::State& state) { BulletproofVerify(state, 1, true); }
+static void BulletproofVerifyMulti2(benchmark::State& state) { BulletproofVerify(state, 2, true); }
+static void BulletproofVerifyMulti16(benchmark::State& state) { BulletproofVerify(state, 16, true); }
+static void BulletproofVerifyMulti256(benchmark::State& state) { BulletproofVerify(state, 256, true); }
+
+BENCHMARK(BulletproofVerify1, 100);
+BENCHMARK(BulletproofVerify2, 50);
+BENCHMARK(BulletproofVerify16, 10);
+BENCHMARK(BulletproofVerify256, 1);
+BENCHMARK(BulletproofVerifyMulti1, 100);
+BENCHMARK(BulletproofVerifyMulti2, 50);
+BENCHMARK(BulletproofVerifyMulti16, 10);
+BENCHMARK(BulletproofVerifyMulti256, 1);
@@ -6,6 +6,7 @@
 #include <util.h>
 #include <validation.h>
 #include <checkqueue.h>
+#include <crypto/sha256.h>
 #include <prevector.h>
 #include <vector>
 #include <boost/thread/thread.hpp>
@@ -60,3 +61,71 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.join_all();
 }
 BENCHMARK(CCheckQueueSpeedPrevectorJob, 1400);
+
+//! Share of the checks that are costly, and their cost: about a ring signature of ring size 7
+static const uint64_t COSTLY_JOB_RANGE = 20;
+static const unsigned int COSTLY_JOB_COST = 21;
+//! Hashes per unit of cost
+static const int COST_UNIT_HASHES = 8;
+
+// A check doing an amount of work proportional to its cost, as script checks
+// mixed with rangeproof or ring signature checks.
+struct CostlyJob {
+    unsigned int nCost;
+    CostlyJob() : nCost(0) {}
+    explicit CostlyJob(unsigned int nCostIn) : nCost(nCostIn) {}
+    bool operator()()
+    {
+        uint8_t hash[CSHA256::OUTPUT_SIZE] = {0};
+        for (unsigned int i = 0; i < nCost * COST_UNIT_HASHES; ++i)
+            CSHA256().Write(hash, sizeof(hash)).Finalize(hash);
+        return true;
+    }
+    void swap(CostlyJob& x) { std::swap(nCost, x.nCost); };
+};
+
+static unsigned int GetCheckCost(const CostlyJob& job)
+{
+    return job.nCost;
+}
+
+static void RunCostlyJobs(benchmark::State& state, bool fCostlyLast)
+{
+    CCheckQueue<CostlyJob> queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        FastRandomContext insecure_rand(true);
+        CCheckQueueControl<CostlyJob> control(&queue);
+        for (size_t b = 0; b < BATCHES; ++b) {
+            std::vector<CostlyJob> vChecks;
+            vChecks.reserve(BATCH_SIZE);
+            for (size_t x = 0; x < BATCH_SIZE; ++x) {
+                bool fCostly = fCostlyLast ? b >= BATCHES - BATCHES / COSTLY_JOB_RANGE
+                                           : insecure_rand.randrange(COSTLY_JOB_RANGE) == 0;
+                vChecks.emplace_back(fCostly ? COSTLY_JOB_COST : 1);
+            }
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+// Costly checks spread over the block
+static void CCheckQueueSpeedMixedCost(benchmark::State& state)
+{
+    RunCostlyJobs(state, false);
+}
+
+// Costly checks added at the end of the block, where fixed size batches leave workers idle
+static void CCheckQueueSpeedCostlyTail(benchmark::State& state)
+{
+    RunCostlyJobs(state, true);
+}
+
+BENCHMARK(CCheckQueueSpeedMixedCost, 100);
+BENCHMARK(CCheckQueueSpeedCostlyTail, 100);
@@ -10,6 +10,7 @@
 #include <random.h>
 #include <uint256.h>
 #include <utiltime.h>
+#include <crypto/hmac_sha512.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
@@ -68,6 +69,40 @@ static void SHA512(benchmark::State& state)
         CSHA512().Write(in.data(), in.size()).Finalize(hash);
 }
 
+static void SHA512Midstate64_1024(benchmark::State& state)
+{
+    std::vector<uint64_t> states(8 * 1024, 0);
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA512Midstate(in.data(), states.data(), in.data(), 64, 1024);
+    }
+}
+
+static void HMAC_SHA512_BIP32_1024(benchmark::State& state)
+{
+    uint8_t chaincode[32] = {0};
+    std::vector<uint8_t> in(37 * 1024, 0), out(64 * 1024);
+    while (state.KeepRunning()) {
+        HMAC_SHA512_Multi(out.data(), chaincode, sizeof(chaincode), in.data(), 37, 1024);
+    }
+}
+
+static void PBKDF2_HMAC_SHA512_2048_4(benchmark::State& state)
+{
+    static const uint8_t key[] = "abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon about";
+    static const uint8_t salt[] = "mnemonicTREZOR";
+    const uint8_t *keys[4] = {key, key, key, key}, *salts[4] = {salt, salt, salt, salt};
+    size_t keylens[4], saltlens[4];
+    for (int i = 0; i < 4; ++i) {
+        keylens[i] = sizeof(key) - 1;
+        saltlens[i] = sizeof(salt) - 1;
+    }
+    uint8_t out[4 * 64];
+    while (state.KeepRunning()) {
+        PBKDF2_HMAC_SHA512_64(out, keys, keylens, salts, saltlens, 2048, 4);
+    }
+}
+
 static void SipHash_32b(benchmark::State& state)
 {
     uint256 x;
@@ -103,5 +138,8 @@ BENCHMARK(SHA512, 330);
 BENCHMARK(SHA256_32b, 4700 * 1000);
 BENCHMARK(SipHash_32b, 40 * 1000 * 1000);
 BENCHMARK(SHA256D64_1024, 7400);
+BENCHMARK(SHA512Midstate64_1024, 1000);
+BENCHMARK(HMAC_SHA512_BIP32_1024, 500);
+BENCHMARK(PBKDF2_HMAC_SHA512_2048_4, 20);
 BENCHMARK(FastRandom_32bit, 110 * 1000 * 1000);
 BENCHMARK(FastRandom_1bit, 440 * 1000 * 1000);
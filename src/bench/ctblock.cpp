@@ -0,0 +1,334 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <anon.h>
+#include <blind.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <consensus/merkle.h>
+#include <consensus/tx_verify.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <random.h>
+#include <rctindex.h>
+#include <script/script.h>
+#include <timedata.h>
+#include <txdb.h>
+#include <validation.h>
+
+#include <secp256k1.h>
+#include <secp256k1_bulletproofs.h>
+#include <secp256k1_mlsag.h>
+
+#include <set>
+#include <vector>
+
+namespace {
+
+const CAmount CT_FEE = 20000;
+const size_t CT_BLOCK_TXNS = 20;
+const size_t CT_DECOYS_PER_TXN = 16;
+const int CT_BLOCK_HEIGHT = 2;
+
+struct CTOutput
+{
+    CKey key;
+    uint256 blind;
+    CAmount nValue;
+};
+
+/**
+ * A regtest block of anon to anon transactions with realistic rings.
+ * Each transaction spends one output from an in-memory rct index, hidden among
+ * decoys, to two bulletproofed outputs and a fee output. The first transaction
+ * is a coinbase collecting the fees.
+ */
+class CTBlockFixture
+{
+public:
+    CBlock block;
+
+    CTBlockFixture(size_t nTxns, size_t nRingSize)
+    {
+        fBitcoinCModeSaved = fBitcoinCMode;
+        fBitcoinCMode = true;
+        SelectParams(CBaseChainParams::REGTEST);
+        InitCTVerificationCache();
+        ECC_Start_Blinding();
+
+        pblocktreeSaved = std::move(pblocktree);
+        pblocktree.reset(new CBlockTreeDB(1 << 20, true));
+
+        // Spent outputs first, each input gets a different one
+        for (size_t k = 0; k < nTxns * (1 + CT_DECOYS_PER_TXN); ++k)
+            AddIndexedOutput(COIN + GetRand(COIN));
+
+        CMutableTransaction coinbase;
+        coinbase.nVersion = BITCOINC_TXN_VERSION;
+        coinbase.SetType(TXN_COINBASE);
+        coinbase.vin.resize(1);
+        coinbase.vin[0].prevout.SetNull();
+        coinbase.vin[0].scriptSig = CScript() << CT_BLOCK_HEIGHT << OP_0;
+        CKey key;
+        key.MakeNewKey(true);
+        CScript scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(key.GetPubKey().GetID()) << OP_EQUALVERIFY << OP_CHECKSIG;
+        coinbase.vpout.push_back(MAKE_OUTPUT<CTxOutStandard>(nTxns * CT_FEE, scriptPubKey));
+        block.vtx.push_back(MakeTransactionRef(coinbase));
+
+        for (size_t k = 0; k < nTxns; ++k)
+            block.vtx.push_back(MakeTransactionRef(MakeAnonTx(k + 1, nRingSize)));
+
+        block.nVersion = BITCOINC_BLOCK_VERSION;
+        block.nTime = GetAdjustedTime();
+        block.nBits = Params().GenesisBlock().nBits;
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+        block.hashWitnessMerkleRoot = BlockWitnessMerkleRoot(block);
+    }
+
+    ~CTBlockFixture()
+    {
+        pblocktree = std::move(pblocktreeSaved);
+        ECC_Stop_Blinding();
+        fBitcoinCMode = fBitcoinCModeSaved;
+    }
+
+private:
+    std::vector<CTOutput> vOutputs; // indexed from 1, as in the rct index
+    std::unique_ptr<CBlockTreeDB> pblocktreeSaved;
+    bool fBitcoinCModeSaved;
+
+    void AddIndexedOutput(CAmount nValue)
+    {
+        CTOutput out;
+        out.key.MakeNewKey(true);
+        out.blind = GetRandHash();
+        out.nValue = nValue;
+
+        secp256k1_pedersen_commitment commitment;
+        assert(secp256k1_pedersen_commit(secp256k1_ctx_blind, &commitment, out.blind.begin(), out.nValue,
+            &secp256k1_generator_const_h, &secp256k1_generator_const_g));
+
+        int64_t nIndex = vOutputs.size() + 1;
+        COutPoint op(GetRandHash(), 0);
+        CAnonOutput ao(out.key.GetPubKey(), commitment, op, 1, 0);
+        assert(pblocktree->WriteRCTOutput(nIndex, ao));
+        assert(pblocktree->WriteRCTOutputLink(ao.pubkey, nIndex));
+        vOutputs.push_back(out);
+    }
+
+    static void AddRingCTOutput(CMutableTransaction &mtx, CAmount nValue, uint256 &blind, secp256k1_pedersen_commitment *&pCommitment)
+    {
+        auto txout = MAKE_OUTPUT<CTxOutRingCT>();
+        CKey key, keyEphem;
+        key.MakeNewKey(true);
+        keyEphem.MakeNewKey(true);
+        txout->pk = CCmpPubKey(key.GetPubKey());
+        CPubKey pkEphem = keyEphem.GetPubKey();
+        txout->vData.assign(pkEphem.begin(), pkEphem.end());
+
+        blind = GetRandHash();
+        assert(secp256k1_pedersen_commit(secp256k1_ctx_blind, &txout->commitment, blind.begin(), nValue,
+            &secp256k1_generator_const_h, &secp256k1_generator_const_g));
+
+        CBlindScratch scratch;
+        uint64_t nValueProve = nValue;
+        const uint8_t *bp[1] = {blind.begin()};
+        uint256 nonce = GetRandHash();
+        size_t nRangeProofLen = 5134;
+        txout->vRangeproof.resize(nRangeProofLen);
+        assert(secp256k1_bulletproof_rangeproof_prove(secp256k1_ctx_blind, scratch.get(), blind_gens,
+            txout->vRangeproof.data(), &nRangeProofLen, &nValueProve, nullptr, bp, 1,
+            &secp256k1_generator_const_h, 64, nonce.begin(), nullptr, 0));
+        txout->vRangeproof.resize(nRangeProofLen);
+
+        pCommitment = &txout->commitment;
+        mtx.vpout.push_back(txout);
+    }
+
+    CMutableTransaction MakeAnonTx(int64_t nRealIndex, size_t nRingSize)
+    {
+        const CTOutput &real = vOutputs[nRealIndex - 1];
+        const size_t nCols = nRingSize, nRows = 2;
+
+        CMutableTransaction mtx;
+        mtx.nVersion = BITCOINC_TXN_VERSION;
+        mtx.SetType(TXN_STANDARD);
+        mtx.vin.resize(1);
+        CTxIn &txin = mtx.vin[0];
+        txin.prevout.n = COutPoint::ANON_MARKER;
+        txin.nSequence = CTxIn::SEQUENCE_FINAL;
+        txin.SetAnonInfo(1, nRingSize);
+
+        // Hide the real output at a random column among decoys from the whole index
+        size_t nSecretColumn = GetRandInt(nCols);
+        std::set<int64_t> setUsed{nRealIndex};
+        std::vector<int64_t> vIndices(nCols);
+        for (size_t i = 0; i < nCols; ++i)
+        {
+            if (i == nSecretColumn)
+            {
+                vIndices[i] = nRealIndex;
+                continue;
+            };
+            do {
+                vIndices[i] = 1 + GetRandInt(vOutputs.size());
+            } while (!setUsed.insert(vIndices[i]).second);
+        };
+
+        std::vector<uint8_t> vMI;
+        for (const auto nIndex : vIndices)
+            PutVarInt(vMI, nIndex);
+
+        std::vector<uint8_t> vFee(1, DO_FEE);
+        PutVarInt(vFee, CT_FEE);
+        mtx.vpout.push_back(MAKE_OUTPUT<CTxOutData>(vFee));
+
+        CAmount nValueOut = real.nValue / 3;
+        uint256 vOutBlinds[2];
+        secp256k1_pedersen_commitment *vpOutCommitments[2];
+        AddRingCTOutput(mtx, nValueOut, vOutBlinds[0], vpOutCommitments[0]);
+        AddRingCTOutput(mtx, real.nValue - nValueOut - CT_FEE, vOutBlinds[1], vpOutCommitments[1]);
+
+        // The fee is committed to with a zero blinding factor
+        uint8_t zeroBlind[32] = {0};
+        secp256k1_pedersen_commitment feeCommitment;
+        assert(secp256k1_pedersen_commit(secp256k1_ctx_blind, &feeCommitment, zeroBlind, CT_FEE,
+            &secp256k1_generator_const_h, &secp256k1_generator_const_g));
+
+        std::vector<uint8_t> vm(nCols * nRows * 33);
+        std::vector<secp256k1_pedersen_commitment> vCommitments(nCols);
+        std::vector<const uint8_t*> vpInCommits(nCols);
+        for (size_t i = 0; i < nCols; ++i)
+        {
+            CAnonOutput ao;
+            assert(pblocktree->ReadRCTOutput(vIndices[i], ao));
+            memcpy(&vm[i * 33], ao.pubkey.begin(), 33);
+            vCommitments[i] = ao.commitment;
+            vpInCommits[i] = vCommitments[i].data;
+        };
+
+        std::vector<const uint8_t*> vpOutCommits{feeCommitment.data, vpOutCommitments[0]->data, vpOutCommitments[1]->data};
+        std::vector<const uint8_t*> vpBlinds{real.blind.begin(), zeroBlind, vOutBlinds[0].begin(), vOutBlinds[1].begin()};
+
+        uint8_t blindSum[32];
+        assert(0 == secp256k1_prepare_mlsag(&vm[0], blindSum,
+            vpOutCommits.size(), vpOutCommits.size(), nCols, nRows,
+            &vpInCommits[0], &vpOutCommits[0], &vpBlinds[0]));
+
+        std::vector<uint8_t> vKeyImages(33);
+        assert(0 == secp256k1_get_keyimage(secp256k1_ctx_blind, &vKeyImages[0], &vm[nSecretColumn * 33], real.key.begin()));
+
+        txin.scriptData.stack.push_back(vKeyImages);
+        txin.scriptWitness.stack.push_back(vMI);
+        txin.scriptWitness.stack.push_back(std::vector<uint8_t>((1 + nRows * nCols) * 32));
+
+        // Key images are set and the signature data is witness, the hash is fixed
+        uint256 txhash = mtx.GetHash();
+        uint256 randSeed = GetRandHash();
+        std::vector<uint8_t> &vDL = txin.scriptWitness.stack[1];
+        const uint8_t *vpsk[2] = {real.key.begin(), blindSum};
+        assert(0 == secp256k1_generate_mlsag(secp256k1_ctx_blind, &txin.scriptData.stack[0][0], &vDL[0], &vDL[32],
+            randSeed.begin(), txhash.begin(), nCols, nRows, nSecretColumn, vpsk, &vm[0]));
+
+        return mtx;
+    }
+};
+
+} // namespace
+
+// Context free checks of the whole block, including the batched bulletproof verification.
+static void CTBlockCheck(benchmark::State& state)
+{
+    CTBlockFixture fixture(CT_BLOCK_TXNS, DEFAULT_RING_SIZE);
+    const Consensus::Params &consensusParams = Params().GetConsensus();
+
+    while (state.KeepRunning()) {
+        CValidationState validationState;
+        bool checked = CheckBlock(fixture.block, validationState, consensusParams, false, true, true);
+        assert(checked);
+    }
+}
+
+// The bulletproofs of all outputs in the block, verified as CheckBlock does.
+static void CTBlockRangeproofVerify(benchmark::State& state)
+{
+    CTBlockFixture fixture(CT_BLOCK_TXNS, DEFAULT_RING_SIZE);
+
+    while (state.KeepRunning()) {
+        CBulletproofBatch batch;
+        for (const auto &tx : fixture.block.vtx)
+            for (const auto &txout : tx->vpout)
+                if (txout->IsType(OUTPUT_RINGCT))
+                {
+                    const CTxOutRingCT *p = (const CTxOutRingCT*)txout.get();
+                    batch.Add(tx->GetHash(), p->vRangeproof, p->commitment);
+                };
+        uint256 txidFailed;
+        assert(batch.Verify(txidFailed));
+    }
+}
+
+// Ring resolution from the rct index and the ring signature of each input.
+static void CTBlockVerifyMLSAG(benchmark::State& state, size_t nRingSize)
+{
+    CTBlockFixture fixture(CT_BLOCK_TXNS, nRingSize);
+
+    while (state.KeepRunning()) {
+        for (size_t i = 1; i < fixture.block.vtx.size(); ++i)
+        {
+            CValidationState validationState;
+            bool verified = VerifyMLSAG(*fixture.block.vtx[i], validationState, nullptr, false);
+            assert(verified);
+        }
+    }
+}
+
+/**
+ * The per transaction work of ConnectBlock: input and fee checks, ring signatures
+ * and the coins update, on an in-memory coins view and block tree db.
+ * ConnectBlock itself also needs a chain tip and a valid coinstake kernel.
+ */
+static void CTBlockConnectInputs(benchmark::State& state, size_t nRingSize)
+{
+    CTBlockFixture fixture(CT_BLOCK_TXNS, nRingSize);
+
+    LOCK(cs_main);
+    while (state.KeepRunning()) {
+        CCoinsView viewDummy;
+        CCoinsViewCache view(&viewDummy);
+        for (const auto &tx : fixture.block.vtx)
+        {
+            if (!tx->IsCoinBase())
+            {
+                CValidationState validationState;
+                CAmount nTxFee;
+                bool valid = Consensus::CheckTxInputs(*tx, validationState, view, CT_BLOCK_HEIGHT, nTxFee)
+                    && VerifyMLSAG(*tx, validationState, nullptr, false);
+                assert(valid);
+            }
+            UpdateCoins(*tx, view, CT_BLOCK_HEIGHT);
+
+            for (const auto &txout : tx->vpout)
+            {
+                int64_t nTestExists;
+                if (txout->IsType(OUTPUT_RINGCT))
+                    assert(!pblocktree->ReadRCTOutputLink(((const CTxOutRingCT*)txout.get())->pk, nTestExists));
+            }
+        }
+    }
+}
+
+static void CTBlockVerifyMLSAGRing7(benchmark::State& state) { CTBlockVerifyMLSAG(state, DEFAULT_RING_SIZE); }
+static void CTBlockVerifyMLSAGRing16(benchmark::State& state) { CTBlockVerifyMLSAG(state, 16); }
+static void CTBlockConnectInputsRing7(benchmark::State& state) { CTBlockConnectInputs(state, DEFAULT_RING_SIZE); }
+static void CTBlockConnectInputsRing16(benchmark::State& state) { CTBlockConnectInputs(state, 16); }
+
+BENCHMARK(CTBlockCheck, 5);
+BENCHMARK(CTBlockRangeproofVerify, 5);
+BENCHMARK(CTBlockVerifyMLSAGRing7, 5);
+BENCHMARK(CTBlockVerifyMLSAGRing16, 3);
+BENCHMARK(CTBlockConnectInputsRing7, 5);
+BENCHMARK(CTBlockConnectInputsRing16, 3);
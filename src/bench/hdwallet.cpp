@@ -0,0 +1,336 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <wallet/hdwallet.h>
+#include <wallet/hdwalletdb.h>
+#include <wallet/coincontrol.h>
+#include <wallet/rpchdwallet.h>
+
+#include <blind.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <key/stealth.h>
+#include <random.h>
+#include <rpc/server.h>
+#include <script/standard.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <univalue.h>
+
+#include <memory>
+#include <vector>
+
+namespace {
+
+const int WALLET_CHAIN_LENGTH = 1000;
+const size_t WALLET_RECEIVE_KEYS = 100;
+const size_t WALLET_SCAN_BLOCK_TXNS = 200;
+
+/**
+ * A CHDWallet on an in-memory database over a synthetic chain of block indexes.
+ * Half the records are txns paying a standard output to one of the wallet's keys,
+ * the other half are records of owned anon outputs, all confirmed.
+ */
+class HDWalletBenchSetup
+{
+public:
+    std::shared_ptr<CHDWallet> pwallet;
+    std::vector<CKeyID> vKeys;
+    CStealthAddress sxAddr;
+
+    explicit HDWalletBenchSetup(size_t nRecords)
+    {
+        fBitcoinCModeSaved = fBitcoinCMode;
+        fBitcoinCWalletSaved = fBitcoinCWallet;
+        fBitcoinCMode = true;
+        fBitcoinCWallet = true;
+        SelectParams(CBaseChainParams::REGTEST);
+        ECC_Start_Stealth();
+        ECC_Start_Blinding();
+
+        LOCK(cs_main);
+        pindexTipSaved = chainActive.Tip();
+        CBlockIndex *pprev = nullptr;
+        int64_t nTimeStart = GetTime() - WALLET_CHAIN_LENGTH * 120;
+        for (int h = 0; h < WALLET_CHAIN_LENGTH; ++h)
+        {
+            vBlockIndex.emplace_back(new CBlockIndex());
+            CBlockIndex *pindex = vBlockIndex.back().get();
+            pindex->nHeight = h;
+            pindex->nTime = nTimeStart + h * 120;
+            pindex->pprev = pprev;
+            pindex->phashBlock = &mapBlockIndex.emplace(GetRandHash(), pindex).first->first;
+            pindex->BuildSkip();
+            pprev = pindex;
+        };
+        chainActive.SetTip(pprev);
+
+        pwallet = std::make_shared<CHDWallet>("bench", WalletDatabase::CreateMock());
+        bool fFirstRun;
+        pwallet->LoadWallet(fFirstRun);
+
+        LOCK(pwallet->cs_wallet);
+        {
+            CHDWalletDB wdb(pwallet->GetDBHandle());
+            assert(0 == pwallet->ExtKeyCreateInitial(&wdb));
+        }
+        for (size_t k = 0; k < WALLET_RECEIVE_KEYS; ++k)
+        {
+            CPubKey pk;
+            assert(0 == pwallet->NewKeyFromAccount(pk));
+            vKeys.push_back(pk.GetID());
+        };
+        CEKAStealthKey aks;
+        std::string sLabel = "bench";
+        assert(0 == pwallet->NewStealthKeyFromAccount(sLabel, aks, 0, nullptr));
+        aks.SetSxAddr(sxAddr);
+
+        CKey keyForeign;
+        keyForeign.MakeNewKey(true);
+        CScript scriptForeign = GetScriptForDestination(keyForeign.GetPubKey().GetID());
+
+        // Spread over all but the last blocks so every record is mature
+        const size_t nBlocks = WALLET_CHAIN_LENGTH - 10;
+        for (size_t i = 0; i < nRecords; ++i)
+        {
+            const CBlockIndex *pindex = chainActive[1 + i % nBlocks];
+            int nIndex = 1 + i / nBlocks;
+            CAmount nValue = COIN + GetRand(COIN);
+
+            if (i % 2 == 0)
+            {
+                CMutableTransaction mtx;
+                mtx.nVersion = BITCOINC_TXN_VERSION;
+                mtx.vin.emplace_back(COutPoint(GetRandHash(), 0));
+                mtx.vpout.push_back(MAKE_OUTPUT<CTxOutStandard>(nValue, GetScriptForDestination(vKeys[i % vKeys.size()])));
+                mtx.vpout.push_back(MAKE_OUTPUT<CTxOutStandard>(nValue / 2, scriptForeign));
+
+                CWalletTx wtx(pwallet.get(), MakeTransactionRef(mtx));
+                wtx.hashBlock = pindex->GetBlockHash();
+                wtx.nIndex = nIndex;
+                wtx.nTimeReceived = pindex->nTime;
+                wtx.nOrderPos = i;
+                pwallet->LoadToWallet(wtx);
+                continue;
+            };
+
+            CTransactionRecord rtx;
+            rtx.SetMerkleBranch(pindex->GetBlockHash(), nIndex);
+            rtx.nBlockTime = pindex->nTime;
+            rtx.nTimeReceived = pindex->nTime;
+            COutputRecord r;
+            r.nType = OUTPUT_RINGCT;
+            r.nFlags = ORF_OWNED;
+            r.n = 1;
+            r.nValue = nValue;
+            rtx.InsertOutput(r);
+            pwallet->LoadToWallet(GetRandHash(), rtx);
+        };
+
+        // Mark the wallet synced to the tip, RPC calls would wait on the validation queue otherwise
+        pwallet->BlockConnected(std::make_shared<const CBlock>(), chainActive.Tip(), {});
+        AddWallet(pwallet);
+    }
+
+    ~HDWalletBenchSetup()
+    {
+        RemoveWallet(pwallet);
+        pwallet.reset();
+
+        LOCK(cs_main);
+        chainActive.SetTip(pindexTipSaved);
+        for (const auto &pindex : vBlockIndex)
+            mapBlockIndex.erase(pindex->GetBlockHash());
+
+        ECC_Stop_Blinding();
+        ECC_Stop_Stealth();
+        fBitcoinCWallet = fBitcoinCWalletSaved;
+        fBitcoinCMode = fBitcoinCModeSaved;
+    }
+
+private:
+    std::vector<std::unique_ptr<CBlockIndex> > vBlockIndex;
+    CBlockIndex *pindexTipSaved;
+    bool fBitcoinCModeSaved;
+    bool fBitcoinCWalletSaved;
+};
+
+} // namespace
+
+static void WalletGetBalances(benchmark::State& state, size_t nRecords)
+{
+    HDWalletBenchSetup setup(nRecords);
+    CHDWallet &wallet = *setup.pwallet;
+
+    while (state.KeepRunning()) {
+        wallet.ClearCachedBalances();
+        CHDWalletBalances bal;
+        wallet.GetBalances(bal);
+        assert(bal.nSpending > 0);
+    }
+}
+
+static void WalletAvailableCoins(benchmark::State& state, size_t nRecords)
+{
+    HDWalletBenchSetup setup(nRecords);
+    CHDWallet &wallet = *setup.pwallet;
+
+    LOCK2(cs_main, wallet.cs_wallet);
+    while (state.KeepRunning()) {
+        std::vector<COutput> vCoins;
+        wallet.AvailableCoins(vCoins);
+        assert(!vCoins.empty());
+    }
+}
+
+static void WalletAvailableAnonCoins(benchmark::State& state, size_t nRecords)
+{
+    HDWalletBenchSetup setup(nRecords);
+    CHDWallet &wallet = *setup.pwallet;
+
+    LOCK2(cs_main, wallet.cs_wallet);
+    while (state.KeepRunning()) {
+        std::vector<COutputR> vCoins;
+        wallet.AvailableAnonCoins(vCoins);
+        assert(!vCoins.empty());
+    }
+}
+
+// Select, sign and, for anon outputs, range prove a send from the standard outputs.
+static void WalletCreateTransaction(benchmark::State& state, size_t nRecords, uint8_t nTypeOut)
+{
+    HDWalletBenchSetup setup(nRecords);
+    CHDWallet &wallet = *setup.pwallet;
+
+    // A fixed change address, otherwise each iteration derives and saves a new key
+    CCoinControl coinControl;
+    coinControl.destChange = setup.vKeys[0];
+    CKey keyTo;
+    keyTo.MakeNewKey(true);
+
+    while (state.KeepRunning()) {
+        std::vector<CTempRecipient> vecSend(1);
+        CTempRecipient &r = vecSend[0];
+        r.nType = nTypeOut;
+        r.SetAmount(10 * COIN);
+        if (nTypeOut == OUTPUT_RINGCT)
+            r.address = setup.sxAddr;
+        else
+            r.address = keyTo.GetPubKey().GetID();
+
+        CWalletTx wtx(&wallet, MakeTransactionRef());
+        CTransactionRecord rtx;
+        CAmount nFee;
+        std::string sError;
+        bool created = 0 == wallet.AddStandardInputs(wtx, rtx, vecSend, true, nFee, &coinControl, sError);
+        assert(created);
+    }
+}
+
+// Sorting by amount builds an entry for every txn and record in the wallet.
+static void WalletFilterTransactions(benchmark::State& state, size_t nRecords)
+{
+    HDWalletBenchSetup setup(nRecords);
+    RegisterHDWalletRPCCommands(tableRPC);
+    const CRPCCommand *pcmd = tableRPC["filtertransactions"];
+    assert(pcmd);
+
+    JSONRPCRequest request;
+    request.strMethod = "filtertransactions";
+    UniValue options(UniValue::VOBJ);
+    options.pushKV("count", 100);
+    options.pushKV("sort", "amount");
+    request.params = UniValue(UniValue::VARR);
+    request.params.push_back(options);
+
+    while (state.KeepRunning()) {
+        UniValue result = pcmd->actor(request);
+        assert(result.size() == 100);
+    }
+}
+
+// A block of foreign txns with standard and anon outputs, one in ten paying the wallet.
+static void WalletScanForOwnedOutputs(benchmark::State& state)
+{
+    HDWalletBenchSetup setup(10000);
+    CHDWallet &wallet = *setup.pwallet;
+
+    std::vector<CTransactionRef> vtx;
+    for (size_t i = 0; i < WALLET_SCAN_BLOCK_TXNS; ++i)
+    {
+        CKey key, keyEphem;
+        key.MakeNewKey(true);
+        keyEphem.MakeNewKey(true);
+
+        CMutableTransaction mtx;
+        mtx.nVersion = BITCOINC_TXN_VERSION;
+        mtx.vin.emplace_back(COutPoint(GetRandHash(), 0));
+        CKeyID idTo = i % 10 == 0 ? setup.vKeys[i % setup.vKeys.size()] : key.GetPubKey().GetID();
+        mtx.vpout.push_back(MAKE_OUTPUT<CTxOutStandard>(COIN, GetScriptForDestination(idTo)));
+
+        auto txout = MAKE_OUTPUT<CTxOutRingCT>();
+        txout->pk = CCmpPubKey(key.GetPubKey());
+        CPubKey pkEphem = keyEphem.GetPubKey();
+        txout->vData.assign(pkEphem.begin(), pkEphem.end());
+        mtx.vpout.push_back(txout);
+
+        vtx.push_back(MakeTransactionRef(mtx));
+    };
+
+    LOCK(wallet.cs_wallet);
+    while (state.KeepRunning()) {
+        for (const auto &tx : vtx) {
+            size_t nRingCT = 0;
+            mapValue_t mapNarr;
+            wallet.ScanForOwnedOutputs(*tx, nRingCT, mapNarr);
+        }
+    }
+}
+
+// Refill the look-ahead pools of all accounts from empty, as on wallet load.
+static void WalletPrepareLookahead(benchmark::State& state)
+{
+    HDWalletBenchSetup setup(0);
+    CHDWallet &wallet = *setup.pwallet;
+
+    LOCK(wallet.cs_wallet);
+    while (state.KeepRunning()) {
+        for (auto &mi : wallet.mapExtAccounts) {
+            CExtKeyAccount *sea = mi.second;
+            sea->mapLookAhead.clear();
+            for (auto *sek : sea->vExtKeys)
+                sek->nLastLookAhead = 0;
+        }
+        wallet.PrepareLookahead();
+    }
+}
+
+static void WalletGetBalances10k(benchmark::State& state) { WalletGetBalances(state, 10000); }
+static void WalletGetBalances100k(benchmark::State& state) { WalletGetBalances(state, 100000); }
+static void WalletAvailableCoins10k(benchmark::State& state) { WalletAvailableCoins(state, 10000); }
+static void WalletAvailableCoins100k(benchmark::State& state) { WalletAvailableCoins(state, 100000); }
+static void WalletAvailableAnonCoins10k(benchmark::State& state) { WalletAvailableAnonCoins(state, 10000); }
+static void WalletAvailableAnonCoins100k(benchmark::State& state) { WalletAvailableAnonCoins(state, 100000); }
+static void WalletCreateTransactionPlain10k(benchmark::State& state) { WalletCreateTransaction(state, 10000, OUTPUT_STANDARD); }
+static void WalletCreateTransactionPlain100k(benchmark::State& state) { WalletCreateTransaction(state, 100000, OUTPUT_STANDARD); }
+static void WalletCreateTransactionAnonOut10k(benchmark::State& state) { WalletCreateTransaction(state, 10000, OUTPUT_RINGCT); }
+static void WalletFilterTransactions10k(benchmark::State& state) { WalletFilterTransactions(state, 10000); }
+static void WalletFilterTransactions100k(benchmark::State& state) { WalletFilterTransactions(state, 100000); }
+
+BENCHMARK(WalletGetBalances10k, 50);
+BENCHMARK(WalletGetBalances100k, 5);
+BENCHMARK(WalletAvailableCoins10k, 50);
+BENCHMARK(WalletAvailableCoins100k, 5);
+BENCHMARK(WalletAvailableAnonCoins10k, 50);
+BENCHMARK(WalletAvailableAnonCoins100k, 5);
+BENCHMARK(WalletCreateTransactionPlain10k, 10);
+BENCHMARK(WalletCreateTransactionPlain100k, 2);
+BENCHMARK(WalletCreateTransactionAnonOut10k, 10);
+BENCHMARK(WalletFilterTransactions10k, 10);
+BENCHMARK(WalletFilterTransactions100k, 2);
+BENCHMARK(WalletScanForOwnedOutputs, 10);
+BENCHMARK(WalletPrepareLookahead, 10);
@@ -0,0 +1,161 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <insight/addressindex.h>
+#include <insight/spentindex.h>
+#include <coins.h>
+#include <random.h>
+#include <streams.h>
+#include <txdb.h>
+#include <txmempool.h>
+#include <version.h>
+
+static const size_t BENCH_ADDRESSES = 100;
+
+static uint256 AddressHash(size_t n)
+{
+    uint256 hash;
+    memcpy(hash.begin(), &n, sizeof(n));
+    return hash;
+}
+
+// An in memory address index of BENCH_ADDRESSES addresses with nRows rows each,
+// rows of different addresses interleave in blocks as they would on chain
+static std::unique_ptr<CBlockTreeDB> BuildAddressIndex(size_t nRows)
+{
+    std::unique_ptr<CBlockTreeDB> db(new CBlockTreeDB(1 << 20, true, true));
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vRows;
+    for (size_t r = 0; r < nRows; ++r) {
+        for (size_t a = 0; a < BENCH_ADDRESSES; ++a) {
+            uint256 txid = GetRandHash();
+            vRows.emplace_back(CAddressIndexKey(ADDR_INDT_PUBKEY_ADDRESS, AddressHash(a), r + 1, a, txid, 0, false), 1 * COIN);
+        }
+        if (vRows.size() >= 10000) {
+            assert(db->WriteAddressIndex(vRows));
+            vRows.clear();
+        }
+    }
+    assert(db->WriteAddressIndex(vRows));
+    return db;
+}
+
+static void AddressIndexKeySerialize(benchmark::State& state)
+{
+    CAddressIndexKey key(ADDR_INDT_PUBKEY_ADDRESS, AddressHash(1), 100000, 12, GetRandHash(), 3, true);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+
+    while (state.KeepRunning())
+    {
+        ss << key;
+        CAddressIndexKey keyRead;
+        ss >> keyRead;
+        assert(keyRead.blockHeight == key.blockHeight);
+    };
+}
+
+// First txn of an address, as a paged query asks for
+static void AddressIndexPointQuery(benchmark::State& state, size_t nRows)
+{
+    std::unique_ptr<CBlockTreeDB> db = BuildAddressIndex(nRows);
+
+    size_t n = 0;
+    while (state.KeepRunning())
+    {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vRows;
+        assert(db->ReadAddressIndexPage(AddressHash(n++ % BENCH_ADDRESSES), ADDR_INDT_PUBKEY_ADDRESS, vRows, 0, 0, 0, 1));
+        assert(vRows.size() == 1);
+    };
+}
+
+// All rows of an address
+static void AddressIndexRangeScan(benchmark::State& state, size_t nRows)
+{
+    std::unique_ptr<CBlockTreeDB> db = BuildAddressIndex(nRows);
+
+    size_t n = 0;
+    while (state.KeepRunning())
+    {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vRows;
+        assert(db->ReadAddressIndex(AddressHash(n++ % BENCH_ADDRESSES), ADDR_INDT_PUBKEY_ADDRESS, vRows));
+        assert(vRows.size() == nRows);
+    };
+}
+
+static void AddressIndexPointQuery10Rows(benchmark::State& state) { AddressIndexPointQuery(state, 10); }
+static void AddressIndexPointQuery1000Rows(benchmark::State& state) { AddressIndexPointQuery(state, 1000); }
+static void AddressIndexRangeScan10Rows(benchmark::State& state) { AddressIndexRangeScan(state, 10); }
+static void AddressIndexRangeScan1000Rows(benchmark::State& state) { AddressIndexRangeScan(state, 1000); }
+
+// Spent rows of a block of 100 inputs
+static void SpentIndexUpdate(benchmark::State& state)
+{
+    std::unique_ptr<CBlockTreeDB> db(new CBlockTreeDB(1 << 20, true, true));
+
+    int nHeight = 0;
+    while (state.KeepRunning())
+    {
+        std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpent;
+        nHeight++;
+        for (unsigned int i = 0; i < 100; ++i) {
+            vSpent.emplace_back(CSpentIndexKey(GetRandHash(), i),
+                CSpentIndexValue(GetRandHash(), 0, nHeight, 1 * COIN, ADDR_INDT_PUBKEY_ADDRESS, AddressHash(i)));
+        }
+        assert(db->UpdateSpentIndex(vSpent));
+    };
+}
+
+// Add 1000 txns paying BENCH_ADDRESSES addresses to the mempool address index, query and remove them
+static void MempoolAddressDeltas(benchmark::State& state)
+{
+    std::vector<CTransactionRef> vtx;
+    for (size_t t = 0; t < 1000; ++t) {
+        CMutableTransaction tx;
+        tx.nVersion = BITCOINC_TXN_VERSION;
+        tx.nLockTime = t;
+        for (size_t o = 0; o < 2; ++o) {
+            uint160 id;
+            size_t a = (t * 2 + o) % BENCH_ADDRESSES;
+            memcpy(id.begin(), &a, sizeof(a));
+            OUTPUT_PTR<CTxOutStandard> out = MAKE_OUTPUT<CTxOutStandard>();
+            out->nValue = 1 * COIN;
+            out->scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(id) << OP_EQUALVERIFY << OP_CHECKSIG;
+            tx.vpout.push_back(out);
+        }
+        vtx.push_back(MakeTransactionRef(tx));
+    }
+
+    std::vector<std::pair<uint256, int> > vAddresses;
+    for (size_t a = 0; a < BENCH_ADDRESSES; ++a) {
+        vAddresses.emplace_back(AddressHash(a), ADDR_INDT_PUBKEY_ADDRESS);
+    }
+
+    CTxMemPool pool;
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+    LockPoints lp;
+
+    while (state.KeepRunning())
+    {
+        for (const auto &tx : vtx) {
+            pool.addAddressIndex(CTxMemPoolEntry(tx, 0, 0, 1, false, 1, lp), view);
+        }
+        std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > vDeltas;
+        assert(pool.getAddressIndex(vAddresses, vDeltas));
+        assert(vDeltas.size() == vtx.size() * 2);
+        for (const auto &tx : vtx) {
+            pool.removeAddressIndex(tx->GetHash());
+        }
+    };
+}
+
+BENCHMARK(AddressIndexKeySerialize, 500000);
+BENCHMARK(AddressIndexPointQuery10Rows, 20000);
+BENCHMARK(AddressIndexPointQuery1000Rows, 20000);
+BENCHMARK(AddressIndexRangeScan10Rows, 10000);
+BENCHMARK(AddressIndexRangeScan1000Rows, 200);
+BENCHMARK(SpentIndexUpdate, 200);
+BENCHMARK(MempoolAddressDeltas, 20);
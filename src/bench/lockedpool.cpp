@@ -7,6 +7,7 @@
 #include <support/lockedpool.h>
 
 #include <iostream>
+#include <thread>
 #include <vector>
 
 #define ASIZE 2048
@@ -44,3 +45,37 @@ static void BenchLockedPool(benchmark::State& state)
 }
 
 BENCHMARK(BenchLockedPool, 1300);
+
+#define MT_THREADS 4
+#define MT_ITER 2000
+
+// Key sized chunks allocated and freed by several threads at once, as when signing
+// and scanning in parallel, through the per-thread caches of the LockedPoolManager
+static void BenchLockedPoolManagerThreads(benchmark::State& state)
+{
+    LockedPoolManager &pool = LockedPoolManager::Instance();
+    while (state.KeepRunning()) {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < MT_THREADS; ++t) {
+            threads.emplace_back([&pool, t] {
+                void *held[8] = {nullptr};
+                for (int x = 0; x < MT_ITER; ++x) {
+                    size_t size = (x + t) & 1 ? 32 : 64;
+                    void *&slot = held[x & 7];
+                    if (slot) {
+                        pool.free(slot, (x + t - 8) & 1 ? 32 : 64);
+                    }
+                    slot = pool.alloc(size);
+                }
+                for (int x = MT_ITER - 8; x < MT_ITER; ++x) {
+                    pool.free(held[x & 7], (x + t) & 1 ? 32 : 64);
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+}
+
+BENCHMARK(BenchLockedPoolManagerThreads, 100);
@@ -7,6 +7,9 @@
 #include <uint256.h>
 #include <random.h>
 #include <consensus/merkle.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <version.h>
 
 static void MerkleRoot(benchmark::State& state)
 {
@@ -23,4 +26,81 @@ static void MerkleRoot(benchmark::State& state)
     }
 }
 
+// Sizes of a typical two output RingCT txn, the rangeproof is a bulletproof
+static const size_t CT_MERKLE_TXNS = 2000;
+static const size_t CT_RANGEPROOF_SIZE = 739;
+static const size_t CT_RING_SIZE = 11;
+
+static std::vector<uint8_t> RandBytes(FastRandomContext& rng, size_t nSize)
+{
+    std::vector<uint8_t> v(nSize);
+    for (auto& b : v) {
+        b = rng.randbits(8);
+    }
+    return v;
+}
+
+/** A block of CT sized txns, the proofs are random bytes as nothing is verified */
+static CBlock MakeCTBlock()
+{
+    FastRandomContext rng(true);
+    CBlock block;
+    block.nVersion = BITCOINC_BLOCK_VERSION;
+    for (size_t k = 0; k < CT_MERKLE_TXNS; ++k) {
+        CMutableTransaction mtx;
+        mtx.nVersion = BITCOINC_TXN_VERSION;
+        mtx.SetType(k == 0 ? TXN_COINBASE : TXN_STANDARD);
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout.hash = rng.rand256();
+        mtx.vin[0].scriptData.stack.push_back(RandBytes(rng, 33));
+        mtx.vin[0].scriptWitness.stack.push_back(RandBytes(rng, 32 * (CT_RING_SIZE * 2 + 1)));
+        for (size_t i = 0; i < 2; ++i) {
+            auto out = MAKE_OUTPUT<CTxOutRingCT>();
+            out->pk = CCmpPubKey(RandBytes(rng, 33));
+            out->vData = RandBytes(rng, 33);
+            memcpy(out->commitment.data, RandBytes(rng, 33).data(), 33);
+            out->vRangeproof = RandBytes(rng, CT_RANGEPROOF_SIZE);
+            mtx.vpout.push_back(out);
+        }
+        block.vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+    return block;
+}
+
+// Both roots of a block from the txid and wtxid each txn cached
+static void MerkleRootCTBlock(benchmark::State& state)
+{
+    const CBlock block = MakeCTBlock();
+    while (state.KeepRunning()) {
+        bool mutated = false;
+        uint256 root = BlockMerkleRoot(block, &mutated);
+        uint256 witness_root = BlockWitnessMerkleRoot(block, &mutated);
+        assert(!root.IsNull() && !witness_root.IsNull() && !mutated);
+    }
+}
+
+// The block as received, the txid and wtxid are hashed while each txn is read
+static void DeserializeMerkleRootCTBlock(benchmark::State& state)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << MakeCTBlock();
+    size_t nSize = stream.size();
+    char a = '\0';
+    stream.write(&a, 1); // Prevent compaction
+
+    while (state.KeepRunning()) {
+        CBlock block;
+        stream >> block;
+        bool rewound = stream.Rewind(nSize);
+        assert(rewound);
+
+        bool mutated = false;
+        uint256 root = BlockMerkleRoot(block, &mutated);
+        uint256 witness_root = BlockWitnessMerkleRoot(block, &mutated);
+        assert(!root.IsNull() && !witness_root.IsNull() && !mutated);
+    }
+}
+
 BENCHMARK(MerkleRoot, 800);
+BENCHMARK(MerkleRootCTBlock, 500);
+BENCHMARK(DeserializeMerkleRootCTBlock, 5);
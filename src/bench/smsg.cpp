@@ -0,0 +1,181 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <smsg/smessage.h>
+#include <key.h>
+#include <random.h>
+#include <utiltime.h>
+
+#include <secp256k1.h>
+
+namespace smsg {
+extern secp256k1_context *secp256k1_context_smsg;
+} // namespace smsg
+
+static const std::string sBenchMessage =
+    "A short test message 0123456789 !@#$%^&*()_+-=";
+
+static void InitSmsg()
+{
+    // Enough of CSMSG::Start to encrypt and store without a node or wallet
+    smsg::fSecMsgEnabled = true;
+    if (!smsg::secp256k1_context_smsg)
+        smsg::secp256k1_context_smsg = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+}
+
+static CKeyID AddLocalKey(CKey &key)
+{
+    key.MakeNewKey(true);
+    smsg::SecMsgKey keyStored;
+    keyStored.key = key;
+    keyStored.pubkey = key.GetPubKey();
+    CKeyID id = keyStored.pubkey.GetID();
+    smsgModule.keyStore.AddKey(id, keyStored);
+    return id;
+}
+
+static void MakeMessage(smsg::SecureMessage &smsg, const CKeyID &idTo)
+{
+    smsg.SetNull();
+    assert(0 == smsgModule.Encrypt(smsg, CKeyID(), idTo, sBenchMessage));
+}
+
+static void SMSGSetHash(benchmark::State& state)
+{
+    InitSmsg();
+    CKey key;
+    CKeyID idTo = AddLocalKey(key);
+    smsg::SecureMessage smsg;
+    MakeMessage(smsg, idTo);
+
+    while (state.KeepRunning())
+    {
+        smsg.timestamp = GetTime();
+        assert(0 == smsgModule.SetHash(smsg.data(), smsg.pPayload, smsg.nPayload));
+    };
+}
+
+static void SMSGEncrypt(benchmark::State& state)
+{
+    InitSmsg();
+    CKey key;
+    CKeyID idTo = AddLocalKey(key);
+
+    while (state.KeepRunning())
+    {
+        smsg::SecureMessage smsg;
+        MakeMessage(smsg, idTo);
+    };
+}
+
+static void SMSGDecrypt(benchmark::State& state)
+{
+    InitSmsg();
+    CKey key;
+    CKeyID idTo = AddLocalKey(key);
+    smsg::SecureMessage smsg;
+    MakeMessage(smsg, idTo);
+
+    while (state.KeepRunning())
+    {
+        smsg::MessageData msg;
+        assert(0 == smsgModule.Decrypt(false, key, idTo, smsg, msg));
+    };
+}
+
+// Trial decryption of a message for none of the nKeys local keys, the common case
+static void ScanMessage(benchmark::State& state, size_t nKeys)
+{
+    InitSmsg();
+    CKey keyOther;
+    CKeyID idOther = AddLocalKey(keyOther);
+    smsg::SecureMessage smsg;
+    MakeMessage(smsg, idOther);
+
+    std::vector<smsg::SecMsgScanKey> vKeys(nKeys);
+    for (auto &scanKey : vKeys)
+    {
+        scanKey.key.MakeNewKey(true);
+        scanKey.address = scanKey.key.GetPubKey().GetID();
+        scanKey.fFullDecrypt = false;
+    };
+    std::vector<smsg::SecMsgScanItem> vItems{{smsg.data(), smsg.pPayload, smsg.nPayload}};
+
+    while (state.KeepRunning())
+    {
+        std::vector<int> vFirst;
+        smsgModule.FindFirstKeys(vItems, vKeys, vFirst, 1);
+        smsgModule.ScanMessage(smsg.data(), smsg.pPayload, smsg.nPayload, false, vKeys, vFirst[0], smsg::SMSG_NO_ERROR);
+    };
+}
+
+static void SMSGScanMessage1Key(benchmark::State& state) { ScanMessage(state, 1); }
+static void SMSGScanMessage100Keys(benchmark::State& state) { ScanMessage(state, 100); }
+
+static void SMSGStoreRetrieve(benchmark::State& state)
+{
+    InitSmsg();
+    smsg::SecureMessage smsg;
+    smsg.SetNull();
+    smsg.timestamp = GetTime();
+    std::vector<uint8_t> vchPayload(256);
+    GetRandBytes(vchPayload.data(), vchPayload.size());
+    smsg.nPayload = vchPayload.size();
+    int64_t bucketTime = smsg.timestamp - (smsg.timestamp % smsg::SMSG_BUCKET_LEN);
+
+    uint64_t n = 0;
+    std::vector<uint8_t> vchData;
+    while (state.KeepRunning())
+    {
+        // The sample must differ or the message is a duplicate
+        memcpy(vchPayload.data(), &(++n), 8);
+        assert(0 == smsgModule.Store(smsg.data(), vchPayload.data(), vchPayload.size(), false));
+
+        smsg::SecMsgToken token(smsg.timestamp, vchPayload.data(), vchPayload.size(), 0, 0);
+        {
+            boost::shared_lock<boost::shared_mutex> lock(smsgModule.cs_buckets);
+            smsg::SecMsgBucket &bucket = smsgModule.buckets[bucketTime];
+            LOCK(bucket.cs_bucket);
+            token = *bucket.setTokens.find(token);
+            assert(0 == smsgModule.Retrieve(token, vchData));
+        }
+    };
+
+    boost::unique_lock<boost::shared_mutex> lock(smsgModule.cs_buckets);
+    smsgModule.buckets.erase(bucketTime);
+}
+
+// Full rehash of a bucket holding many tokens, as after a removal or an expiry
+static void SMSGHashBucket(benchmark::State& state)
+{
+    const size_t nTokens = 100000;
+    int64_t now = GetTime();
+    std::vector<smsg::SecMsgToken> vTokens(nTokens);
+    for (size_t i = 0; i < nTokens; ++i)
+    {
+        uint8_t sample[8];
+        GetRandBytes(sample, 8);
+        vTokens[i] = smsg::SecMsgToken(now, sample, 8, i, 2);
+    };
+
+    smsg::SecMsgBucket bucket;
+    bucket.AddTokens(vTokens);
+    bucket.hashBucket();
+
+    while (state.KeepRunning())
+    {
+        bucket.SetTokenTTL(bucket.setTokens.begin(), 2);
+        bucket.hashBucket();
+    };
+}
+
+BENCHMARK(SMSGSetHash, 1);
+BENCHMARK(SMSGEncrypt, 2000);
+BENCHMARK(SMSGDecrypt, 5000);
+BENCHMARK(SMSGScanMessage1Key, 5000);
+BENCHMARK(SMSGScanMessage100Keys, 100);
+BENCHMARK(SMSGStoreRetrieve, 1000);
+BENCHMARK(SMSGHashBucket, 1000);
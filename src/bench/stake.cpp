@@ -0,0 +1,300 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <pos/kernel.h>
+#include <random.h>
+#include <script/interpreter.h>
+#include <script/script.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+/**
+ * Stake kernel search cost over a synthetic set of stakeable outputs.
+ *
+ * StakeKernelHash and StakeKernelRound time a single kernel hash, so one
+ * iteration is the inverse of the hash rate. A StakeTick iteration is one
+ * timestamp slot of ThreadStakeMiner: a round is set up and every output is
+ * checked, divide the number of outputs by its time for hashes per second.
+ * StakeSimulation iterations replay an hour of slots, growing the chain with
+ * each kernel found so the stake modifier and output depths evolve as they
+ * would on a staking node.
+ */
+
+namespace {
+
+const int STAKE_CHAIN_LENGTH = 1000;
+const int STAKE_BLOCK_SPACING = 120;
+const int STAKE_SIMULATION_SLOTS = 3600 / 16;
+const CAmount STAKE_MAX_VALUE = 1000 * COIN;
+
+enum StakeValueDistribution
+{
+    STAKE_VALUES_UNIFORM,   // Values evenly spread up to STAKE_MAX_VALUE
+    STAKE_VALUES_SKEWED,    // Mostly small values with a few large ones, as in a real utxo set
+};
+
+struct StakeCoin
+{
+    COutPoint prevout;
+    CAmount nValue;
+    int nHeight;
+};
+
+/**
+ * A mainnet chain of STAKE_CHAIN_LENGTH blocks and nCoins stakeable outputs,
+ * all mature at the tip. nBits is set so the outputs together find a block
+ * every STAKE_BLOCK_SPACING seconds.
+ */
+class StakeSetup
+{
+public:
+    std::vector<StakeCoin> vCoins;
+    uint32_t nBits;
+    uint32_t nSlotSpacing;
+
+    StakeSetup(size_t nCoins, StakeValueDistribution distribution)
+    {
+        fBitcoinCModeSaved = fBitcoinCMode;
+        fBitcoinCMode = true;
+        SelectParams(CBaseChainParams::MAIN);
+        nSlotSpacing = Params().GetStakeTimestampMask(0) + 1;
+
+        int nMaxCoinHeight = STAKE_CHAIN_LENGTH - Params().GetStakeMinConfirmations();
+        CAmount nTotal = 0;
+        vCoins.resize(nCoins);
+        for (auto &c : vCoins)
+        {
+            c.prevout = COutPoint(GetRandHash(), GetRand(4));
+            c.nHeight = GetRand(nMaxCoinHeight);
+            uint64_t r = 1 + GetRand(STAKE_MAX_VALUE);
+            if (distribution == STAKE_VALUES_SKEWED)
+            {
+                // r^4 / max^3, stays within (0, max]
+                arith_uint256 bn = arith_uint256(r), bnMax = arith_uint256(STAKE_MAX_VALUE);
+                bn = bn * bn * bn * bn / (bnMax * bnMax * bnMax);
+                r = std::max((uint64_t)1, bn.GetLow64());
+            };
+            c.nValue = r;
+            nTotal += c.nValue;
+        };
+
+        // Expect target * nTotal / 2^256 kernels per slot
+        uint64_t nSlotsPerBlock = STAKE_BLOCK_SPACING / nSlotSpacing;
+        arith_uint256 bnTarget = ~arith_uint256(0);
+        bnTarget /= arith_uint256(nTotal) * nSlotsPerBlock;
+        nBits = bnTarget.GetCompact();
+
+        uint32_t nTime = (GetTime() - STAKE_CHAIN_LENGTH * STAKE_BLOCK_SPACING) & ~Params().GetStakeTimestampMask(0);
+        for (int h = 0; h < STAKE_CHAIN_LENGTH; ++h)
+            AddBlock(nTime + h * STAKE_BLOCK_SPACING, GetRandHash());
+    }
+
+    ~StakeSetup()
+    {
+        fBitcoinCMode = fBitcoinCModeSaved;
+    }
+
+    CBlockIndex *Tip() const
+    {
+        return vBlockIndex.back().get();
+    }
+
+    void AddBlock(uint32_t nTime, const uint256 &kernel)
+    {
+        CBlockIndex *pprev = vBlockIndex.empty() ? nullptr : Tip();
+        vBlockIndex.emplace_back(new CBlockIndex());
+        vHashes.push_back(GetRandHash());
+
+        CBlockIndex *pindex = Tip();
+        pindex->phashBlock = &vHashes.back();
+        pindex->pprev = pprev;
+        pindex->nHeight = pprev ? pprev->nHeight + 1 : 0;
+        pindex->nTime = nTime;
+        pindex->nBits = nBits;
+        pindex->bnStakeModifier = ComputeStakeModifierV2(pprev, kernel);
+        pindex->BuildSkip();
+    }
+
+private:
+    std::vector<std::unique_ptr<CBlockIndex> > vBlockIndex;
+    std::deque<uint256> vHashes;
+    bool fBitcoinCModeSaved;
+};
+
+} // namespace
+
+static void StakeKernelHash(benchmark::State& state)
+{
+    StakeSetup setup(1000, STAKE_VALUES_UNIFORM);
+    const CBlockIndex *pindexPrev = setup.Tip();
+    uint32_t nTime = pindexPrev->nTime + setup.nSlotSpacing;
+
+    size_t i = 0;
+    uint256 hashProofOfStake, targetProofOfStake;
+    while (state.KeepRunning()) {
+        const StakeCoin &c = setup.vCoins[i++ % setup.vCoins.size()];
+        CheckStakeKernelHash(pindexPrev, setup.nBits, pindexPrev->GetAncestor(c.nHeight)->nTime,
+            c.nValue, c.prevout, nTime, hashProofOfStake, targetProofOfStake);
+    }
+}
+
+static void StakeKernelRound(benchmark::State& state)
+{
+    StakeSetup setup(1000, STAKE_VALUES_UNIFORM);
+    const CBlockIndex *pindexPrev = setup.Tip();
+    CStakeKernelRound round(pindexPrev, setup.nBits, pindexPrev->nTime + setup.nSlotSpacing);
+
+    size_t i = 0;
+    uint256 hashProofOfStake, targetProofOfStake;
+    while (state.KeepRunning()) {
+        const StakeCoin &c = setup.vCoins[i++ % setup.vCoins.size()];
+        round.Check(pindexPrev->GetAncestor(c.nHeight)->nTime, c.nValue, c.prevout, hashProofOfStake, targetProofOfStake);
+    }
+}
+
+// One staking tick: every output checked against the next timestamp slot.
+static void StakeTick(benchmark::State& state, size_t nCoins, StakeValueDistribution distribution)
+{
+    StakeSetup setup(nCoins, distribution);
+    const CBlockIndex *pindexPrev = setup.Tip();
+
+    uint32_t nTime = pindexPrev->nTime;
+    while (state.KeepRunning()) {
+        nTime += setup.nSlotSpacing;
+        CStakeKernelRound round(pindexPrev, setup.nBits, nTime);
+        for (const auto &c : setup.vCoins)
+            CheckKernel(round, c.prevout, c.nValue, c.nHeight);
+    }
+}
+
+// Staking over STAKE_SIMULATION_SLOTS slots, each kernel found adds a block and restakes its output.
+static void StakeSimulation(benchmark::State& state, size_t nCoins, StakeValueDistribution distribution)
+{
+    StakeSetup setup(nCoins, distribution);
+
+    uint32_t nTime = setup.Tip()->nTime;
+    while (state.KeepRunning()) {
+        for (int s = 0; s < STAKE_SIMULATION_SLOTS; ++s) {
+            nTime += setup.nSlotSpacing;
+            CStakeKernelRound round(setup.Tip(), setup.nBits, nTime);
+            for (auto &c : setup.vCoins) {
+                if (!CheckKernel(round, c.prevout, c.nValue, c.nHeight))
+                    continue;
+                setup.AddBlock(nTime, c.prevout.hash);
+                c.prevout = COutPoint(GetRandHash(), 1);
+                c.nHeight = setup.Tip()->nHeight;
+                break;
+            }
+        }
+    }
+}
+
+// Kernel checks of outputs looked up in the coins view, as before the stakeable output index.
+static void StakeTickCoinsView(benchmark::State& state)
+{
+    StakeSetup setup(10000, STAKE_VALUES_UNIFORM);
+    const CBlockIndex *pindexPrev = setup.Tip();
+
+    LOCK(cs_main);
+    CCoinsView viewDummy;
+    std::unique_ptr<CCoinsViewCache> pcoinsTipSaved(pcoinsTip.release());
+    pcoinsTip.reset(new CCoinsViewCache(&viewDummy));
+    for (const auto &c : setup.vCoins)
+        pcoinsTip->AddCoin(c.prevout, Coin(CTxOut(c.nValue, CScript() << OP_TRUE), c.nHeight, false), false);
+
+    uint32_t nTime = pindexPrev->nTime;
+    while (state.KeepRunning()) {
+        nTime += setup.nSlotSpacing;
+        CStakeKernelRound round(pindexPrev, setup.nBits, nTime);
+        for (const auto &c : setup.vCoins)
+            CheckKernel(round, c.prevout);
+    }
+
+    pcoinsTip.reset(pcoinsTipSaved.release());
+}
+
+// Full check of a signed coinstake with an unspent kernel, as when a staked block arrives.
+static void StakeCheckProofOfStake(benchmark::State& state)
+{
+    StakeSetup setup(1, STAKE_VALUES_UNIFORM);
+    CBlockIndex *pindexPrev = setup.Tip();
+    const StakeCoin &c = setup.vCoins[0];
+
+    // An easy target, so a passing slot is found quickly
+    arith_uint256 bnTarget = ~arith_uint256(0);
+    bnTarget /= arith_uint256(c.nValue) * 4;
+    uint32_t nBits = bnTarget.GetCompact();
+    uint32_t nTime = pindexPrev->nTime;
+    uint256 hashProofOfStake, targetProofOfStake;
+    do {
+        nTime += setup.nSlotSpacing;
+    } while (!CStakeKernelRound(pindexPrev, nBits, nTime).Check(pindexPrev->GetAncestor(c.nHeight)->nTime,
+        c.nValue, c.prevout, hashProofOfStake, targetProofOfStake));
+
+    CKey key;
+    key.MakeNewKey(true);
+    CScript scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(key.GetPubKey().GetID()) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    CMutableTransaction txn;
+    txn.nVersion = BITCOINC_TXN_VERSION;
+    txn.SetType(TXN_COINSTAKE);
+    txn.vin.emplace_back(c.prevout);
+    std::vector<uint8_t> vData(4);
+    WriteLE32(vData.data(), pindexPrev->nHeight + 1);
+    txn.vpout.push_back(MAKE_OUTPUT<CTxOutData>(vData));
+    txn.vpout.push_back(MAKE_OUTPUT<CTxOutStandard>(c.nValue, scriptPubKey));
+
+    std::vector<uint8_t> vchAmount(8), vchSig;
+    memcpy(vchAmount.data(), &c.nValue, 8);
+    uint256 hash = SignatureHash(scriptPubKey, txn, 0, SIGHASH_ALL, vchAmount, SigVersion::BASE);
+    key.Sign(hash, vchSig);
+    vchSig.push_back(SIGHASH_ALL);
+    txn.vin[0].scriptWitness.stack.emplace_back(vchSig);
+    txn.vin[0].scriptWitness.stack.emplace_back(ToByteVector(key.GetPubKey()));
+    CTransaction tx(txn);
+
+    LOCK(cs_main);
+    CBlockIndex *pindexTipSaved = chainActive.Tip();
+    chainActive.SetTip(pindexPrev);
+    CCoinsView viewDummy;
+    std::unique_ptr<CCoinsViewCache> pcoinsTipSaved(pcoinsTip.release());
+    pcoinsTip.reset(new CCoinsViewCache(&viewDummy));
+    pcoinsTip->AddCoin(c.prevout, Coin(CTxOut(c.nValue, scriptPubKey), c.nHeight, false), false);
+
+    while (state.KeepRunning()) {
+        CValidationState valState;
+        bool fValid = CheckProofOfStake(valState, pindexPrev, tx, nTime, nBits, hashProofOfStake, targetProofOfStake);
+        assert(fValid);
+    }
+
+    pcoinsTip.reset(pcoinsTipSaved.release());
+    chainActive.SetTip(pindexTipSaved);
+}
+
+static void StakeTick1k(benchmark::State& state) { StakeTick(state, 1000, STAKE_VALUES_UNIFORM); }
+static void StakeTick100k(benchmark::State& state) { StakeTick(state, 100000, STAKE_VALUES_UNIFORM); }
+static void StakeTick100kSkewed(benchmark::State& state) { StakeTick(state, 100000, STAKE_VALUES_SKEWED); }
+static void StakeSimulation1k(benchmark::State& state) { StakeSimulation(state, 1000, STAKE_VALUES_UNIFORM); }
+static void StakeSimulation10kSkewed(benchmark::State& state) { StakeSimulation(state, 10000, STAKE_VALUES_SKEWED); }
+
+BENCHMARK(StakeKernelHash, 500000);
+BENCHMARK(StakeKernelRound, 500000);
+BENCHMARK(StakeTick1k, 500);
+BENCHMARK(StakeTick100k, 5);
+BENCHMARK(StakeTick100kSkewed, 5);
+BENCHMARK(StakeTickCoinsView, 50);
+BENCHMARK(StakeSimulation1k, 5);
+BENCHMARK(StakeSimulation10kSkewed, 1);
+BENCHMARK(StakeCheckProofOfStake, 5000);
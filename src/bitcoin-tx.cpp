@@ -6,6 +6,8 @@
 #include <config/bitcoin-config.h>
 #endif
 
+#include <blind.h>
+#include <chainparams.h>
 #include <clientversion.h>
 #include <coins.h>
 #include <consensus/consensus.h>
@@ -15,6 +17,7 @@
 #include <policy/policy.h>
 #include <policy/rbf.h>
 #include <primitives/transaction.h>
+#include <random.h>
 #include <script/script.h>
 #include <script/sign.h>
 #include <univalue.h>
@@ -23,8 +26,12 @@
 #include <utilstrencodings.h>
 #include <key/stealth.h>
 
+#include <atomic>
+#include <fstream>
+#include <iostream>
 #include <memory>
 #include <stdio.h>
+#include <thread>
 
 #include <boost/algorithm/string.hpp>
 
@@ -32,12 +39,20 @@ static bool fCreateBlank;
 static std::map<std::string,UniValue> registers;
 static const int CONTINUE_EXECUTION=-1;
 
+//! Transactions of a -batch file read and proven together, bounds memory on large files
+static const size_t BATCH_CHUNK_SIZE = 1000;
+//! Maximum number of threads generating the range proofs of a -batch chunk
+static const int MAX_BATCH_THREADS = 16;
+
 static void SetupBitcoinTxArgs()
 {
     gArgs.AddArg("-?", "This help message", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-create", "Create new, empty TX.", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-json", "Select JSON output", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-txid", "Output only the hex-encoded transaction id of the resultant transaction.", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-batch=<file>", "Create a transaction for each line of <file> (\"-\" for stdin), a JSON object of createrawbctransaction arguments: "
+        "{\"inputs\":[...],\"outputs\":[...],\"locktime\":n,\"replaceable\":bool}. "
+        "Writes a line of {\"hex\",\"amounts\"} or {\"error\"} per transaction, in order. Range proofs are generated on all cores.", false, OptionsCategory::OPTIONS);
     SetupChainParamsBaseOptions();
 
     gArgs.AddArg("delin=N", "Delete input N from TX", false, OptionsCategory::COMMANDS);
@@ -108,6 +123,7 @@ static int AppInitRawTx(int argc, char* argv[])
         std::string strUsage = PACKAGE_NAME " bitcoinc-tx utility version " + FormatFullVersion() + "\n\n" +
             "Usage:  bitcoinc-tx [options] <hex-tx> [commands]  Update hex-encoded bitcoin transaction\n" +
             "or:     bitcoinc-tx [options] -create [commands]   Create hex-encoded bitcoin transaction\n" +
+            "or:     bitcoinc-tx [options] -batch=<file>        Create blinded transactions from a file of JSON specs\n" +
             "\n";
         strUsage += gArgs.GetHelpMessage();
 
@@ -217,7 +233,7 @@ static void MutateTxVersion(CMutableTransaction& tx, const std::string& cmdVal)
             if (!EvalScript(stack, txin.scriptSig, SCRIPT_VERIFY_P2SH, BaseSignatureChecker(), SigVersion::BASE, &serror))
                 throw std::runtime_error("EvalScript failed for input.");
 
-            txin.scriptWitness.stack = stack;
+            txin.scriptWitness.stack.assign(stack.begin(), stack.end());
             txin.scriptSig.clear();
         };
     } else
@@ -916,6 +932,317 @@ static std::string readStdin()
     return ret;
 }
 
+/** A blinded output of a -batch transaction waiting for its commitment and range proof */
+struct BatchCTOutput
+{
+    size_t nTx;
+    size_t nOut;
+    CAmount nValue;
+    uint8_t blind[32];
+    uint256 nonce;
+    CPubKey pkEphem;
+    std::string sNarration;
+};
+
+struct BatchTx
+{
+    CMutableTransaction tx;
+    UniValue amounts{UniValue::VOBJ};
+    std::string sError;
+};
+
+static CAmount BatchAmountFromValue(const UniValue& value)
+{
+    if (!value.isNum() && !value.isStr())
+        throw std::runtime_error("Amount is not a number or string");
+    CAmount amount;
+    if (!ParseFixedPoint(value.getValStr(), 8, &amount) || !MoneyRange(amount))
+        throw std::runtime_error("Invalid amount");
+    return amount;
+}
+
+static uint256 BatchHash32FromValue(const UniValue& value, const std::string& strName)
+{
+    const std::string& s = value.get_str();
+    if (!IsHex(s) || s.size() != 64)
+        throw std::runtime_error("\"" + strName + "\" must be 32 bytes and hex encoded");
+    uint256 hash;
+    hash.SetHex(s);
+    return hash;
+}
+
+// Build the txn of a createrawbctransaction style spec, blinded outputs are queued in vCTOutputs
+static void BatchParseTx(const std::string& strSpec, size_t nTx, BatchTx& btx, std::vector<BatchCTOutput>& vCTOutputs)
+{
+    UniValue spec;
+    if (!spec.read(strSpec) || !spec.isObject())
+        throw std::runtime_error("Cannot parse JSON object");
+    const UniValue& inputs = find_value(spec, "inputs");
+    const UniValue& outputs = find_value(spec, "outputs");
+    if (!inputs.isArray() || !outputs.isArray())
+        throw std::runtime_error("\"inputs\" and \"outputs\" must be arrays");
+
+    CMutableTransaction& tx = btx.tx;
+    tx.nVersion = BITCOINC_TXN_VERSION;
+
+    const UniValue& locktime = find_value(spec, "locktime");
+    if (!locktime.isNull()) {
+        int64_t nLockTime = locktime.get_int64();
+        if (nLockTime < 0 || nLockTime > std::numeric_limits<uint32_t>::max())
+            throw std::runtime_error("locktime out of range");
+        tx.nLockTime = nLockTime;
+    }
+    bool rbfOptIn = find_value(spec, "replaceable").isTrue();
+
+    for (size_t idx = 0; idx < inputs.size(); idx++) {
+        const UniValue& o = inputs[idx].get_obj();
+
+        uint256 txid = BatchHash32FromValue(find_value(o, "txid"), "txid");
+        const UniValue& vout_v = find_value(o, "vout");
+        if (!vout_v.isNum() || vout_v.get_int() < 0)
+            throw std::runtime_error("Invalid or missing vout");
+
+        uint32_t nSequence = rbfOptIn ? MAX_BIP125_RBF_SEQUENCE
+            : tx.nLockTime ? std::numeric_limits<uint32_t>::max() - 1 : std::numeric_limits<uint32_t>::max();
+        const UniValue& sequenceObj = find_value(o, "sequence");
+        if (sequenceObj.isNum()) {
+            int64_t seqNr64 = sequenceObj.get_int64();
+            if (seqNr64 < 0 || seqNr64 > std::numeric_limits<uint32_t>::max())
+                throw std::runtime_error("sequence number is out of range");
+            nSequence = (uint32_t)seqNr64;
+        }
+
+        tx.vin.push_back(CTxIn(COutPoint(txid, vout_v.get_int()), CScript(), nSequence));
+    }
+
+    for (size_t idx = 0; idx < outputs.size(); idx++) {
+        const UniValue& o = outputs[idx].get_obj();
+
+        std::string strType = o["type"].isStr() ? o["type"].get_str() : "staking";
+        std::string sNarration = o["narration"].isStr() ? o["narration"].get_str() : "";
+        if (o["address"].isStr() && o["script"].isStr())
+            throw std::runtime_error("Can't specify both \"address\" and \"script\"");
+        CTxDestination dest = CNoDestination();
+        if (o["address"].isStr()) {
+            dest = DecodeDestination(o["address"].get_str());
+            if (!IsValidDestination(dest))
+                throw std::runtime_error("Invalid address");
+            if (dest.type() == typeid(CExtKeyPair))
+                throw std::runtime_error("Extended key addresses need a wallet");
+        }
+
+        if (strType == "data") {
+            if (!o["data"].isStr() || !IsHex(o["data"].get_str()))
+                throw std::runtime_error("\"data\" must be hex encoded");
+            tx.vpout.push_back(MAKE_OUTPUT<CTxOutData>(ParseHex(o["data"].get_str())));
+            continue;
+        }
+
+        CAmount nAmount = BatchAmountFromValue(o["amount"]);
+        UniValue amount(UniValue::VOBJ);
+        amount.pushKV("value", ValueFromAmount(nAmount));
+
+        if (strType == "staking") {
+            CScript scriptPubKey;
+            std::vector<uint8_t> vData;
+            std::string sError;
+            if (o["script"].isStr()) {
+                scriptPubKey = ParseScript(o["script"].get_str());
+            } else
+            if (dest.type() == typeid(CStealthAddress)) {
+                if (0 != PrepareStealthOutput(boost::get<CStealthAddress>(dest), sNarration, scriptPubKey, vData, sError))
+                    throw std::runtime_error(sError);
+            } else {
+                scriptPubKey = GetScriptForDestination(dest);
+                if (scriptPubKey.size() < 1)
+                    throw std::runtime_error("Missing address or script");
+                if (sNarration.size() > 0) {
+                    vData.push_back(DO_NARR_PLAIN);
+                    vData.insert(vData.end(), sNarration.begin(), sNarration.end());
+                }
+            }
+
+            btx.amounts.pushKV(strprintf("%d", tx.vpout.size()), amount);
+            tx.vpout.push_back(MAKE_OUTPUT<CTxOutStandard>(nAmount, scriptPubKey));
+            if (vData.size() > 0)
+                tx.vpout.push_back(MAKE_OUTPUT<CTxOutData>(vData));
+            continue;
+        }
+        if (strType != "spending")
+            throw std::runtime_error("Unknown output type " + strType);
+
+        BatchCTOutput ct;
+        ct.nTx = nTx;
+        ct.nOut = tx.vpout.size();
+        ct.nValue = nAmount;
+        ct.sNarration = sNarration;
+
+        if (o["blindingfactor"].isStr()) {
+            uint256 blind = BatchHash32FromValue(o["blindingfactor"], "blindingfactor");
+            memcpy(ct.blind, blind.begin(), 32);
+        } else {
+            GetStrongRandBytes(ct.blind, 32);
+        }
+
+        if (dest.type() != typeid(CStealthAddress))
+            throw std::runtime_error("Only able to send to stealth address");
+        const CStealthAddress& sx = boost::get<CStealthAddress>(dest);
+
+        CKey sEphem;
+        if (o["ephemeral_key"].isStr()) {
+            const std::string& strKey = o["ephemeral_key"].get_str();
+            if (!IsHex(strKey) || strKey.size() != 64)
+                throw std::runtime_error("\"ephemeral_key\" must be 32 bytes and hex encoded");
+            std::vector<uint8_t> v = ParseHex(strKey);
+            sEphem.Set(v.begin(), v.end(), true);
+            if (!sEphem.IsValid())
+                throw std::runtime_error("Invalid ephemeral key");
+        } else {
+            sEphem.MakeNewKey(true);
+        }
+
+        CKey sShared;
+        ec_point pkSendTo;
+        int k, nTries = 24;
+        for (k = 0; k < nTries; ++k) {
+            if (StealthSecret(sEphem, sx.scan_pubkey, sx.spend_pubkey, sShared, pkSendTo) == 0)
+                break;
+            sEphem.MakeNewKey(true);
+        }
+        if (k >= nTries)
+            throw std::runtime_error("Could not generate receiving public key");
+
+        CPubKey pkTo(pkSendTo);
+        ct.pkEphem = sEphem.GetPubKey();
+        if (o["nonce"].isStr()) {
+            ct.nonce = BatchHash32FromValue(o["nonce"], "nonce");
+        } else {
+            ct.nonce = sEphem.ECDH(pkTo);
+            CSHA256().Write(ct.nonce.begin(), 32).Finalize(ct.nonce.begin());
+        }
+
+        OUTPUT_PTR<CTxOutRingCT> txout = MAKE_OUTPUT<CTxOutRingCT>();
+        txout->pk = pkTo;
+        uint32_t nStealthPrefix = sx.prefix.number_bits > 0 ? FillStealthPrefix(sx.prefix.number_bits, sx.prefix.bitfield) : 0;
+        txout->vData.resize(nStealthPrefix > 0 ? 38 : 33);
+        memcpy(&txout->vData[0], ct.pkEphem.begin(), 33);
+        if (nStealthPrefix > 0) {
+            txout->vData[33] = DO_STEALTH_PREFIX;
+            memcpy(&txout->vData[34], &nStealthPrefix, 4);
+        }
+
+        amount.pushKV("blind", uint256(std::vector<uint8_t>(ct.blind, ct.blind + 32)).ToString());
+        amount.pushKV("nonce", ct.nonce.ToString());
+        btx.amounts.pushKV(strprintf("%d", tx.vpout.size()), amount);
+        tx.vpout.push_back(txout);
+        vCTOutputs.push_back(ct);
+    }
+}
+
+// Commit to and prove the values of vCTOutputs, spread over the available cores
+static void BatchProveOutputs(std::vector<BatchTx>& vTxns, const std::vector<BatchCTOutput>& vCTOutputs)
+{
+    bool fBulletproof = GetTime() >= Params().GetConsensus().bulletproof_time;
+    std::vector<std::string> vErrors(vCTOutputs.size());
+    std::atomic<size_t> nNext(0);
+    auto worker = [&]() {
+        size_t i;
+        while ((i = nNext++) < vCTOutputs.size()) {
+            const BatchCTOutput& ct = vCTOutputs[i];
+            CTxOutBase* txout = vTxns[ct.nTx].tx.vpout[ct.nOut].get();
+            if (0 != CommitAndProveValue(*txout->GetPCommitment(), *txout->GetPRangeproof(), ct.nValue, ct.blind, ct.nonce,
+                    fBulletproof, fBulletproof ? "" : ct.sNarration, nullptr, vErrors[i])) {
+                continue;
+            }
+            if (fBulletproof && ct.sNarration.size() > 0)
+                AppendNarrationCrypt(*txout->GetPData(), ct.sNarration, ct.nonce.begin(), ct.pkEphem, vErrors[i]);
+        }
+    };
+
+    size_t nThreads = std::min((size_t)std::min(std::max(1, GetNumCores()), MAX_BATCH_THREADS), vCTOutputs.size());
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < nThreads; ++t)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+        thread.join();
+
+    for (size_t i = 0; i < vCTOutputs.size(); ++i) {
+        if (!vErrors[i].empty() && vTxns[vCTOutputs[i].nTx].sError.empty())
+            vTxns[vCTOutputs[i].nTx].sError = vErrors[i];
+    }
+}
+
+static void BatchWriteTxns(const std::vector<BatchTx>& vTxns)
+{
+    for (const auto& btx : vTxns) {
+        UniValue result(UniValue::VOBJ);
+        if (btx.sError.empty()) {
+            result.pushKV("hex", EncodeHexTx(btx.tx));
+            result.pushKV("amounts", btx.amounts);
+        } else {
+            result.pushKV("error", btx.sError);
+        }
+        fprintf(stdout, "%s\n", result.write().c_str());
+    }
+    fflush(stdout);
+}
+
+/**
+ * Offline bulk counterpart of createrawbctransaction. Specs are processed in chunks of
+ * BATCH_CHUNK_SIZE: the txns are built, the range proofs of all blinded outputs in the
+ * chunk made in parallel, then the results written in input order.
+ */
+static int BatchRawTx(const std::string& strFile)
+{
+    std::ifstream file;
+    if (strFile != "-") {
+        file.open(strFile);
+        if (!file.is_open()) {
+            fprintf(stderr, "error: Cannot open file %s\n", strFile.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+    std::istream& in = strFile == "-" ? std::cin : file;
+
+    // Blinding factors and ephemeral keys are drawn from GetStrongRandBytes
+    RandomInit();
+    Secp256k1Init ecc;
+    ECC_Start_Stealth();
+    ECC_Start_Blinding();
+
+    int nRet = EXIT_SUCCESS;
+    std::string strLine;
+    while (in.good()) {
+        std::vector<BatchTx> vTxns;
+        std::vector<BatchCTOutput> vCTOutputs;
+        while (vTxns.size() < BATCH_CHUNK_SIZE && std::getline(in, strLine)) {
+            boost::algorithm::trim(strLine);
+            if (strLine.empty())
+                continue;
+            vTxns.emplace_back();
+            size_t nCTOutputs = vCTOutputs.size();
+            try {
+                BatchParseTx(strLine, vTxns.size() - 1, vTxns.back(), vCTOutputs);
+            } catch (const std::exception& e) {
+                vTxns.back().sError = e.what();
+                vCTOutputs.resize(nCTOutputs);
+            }
+        }
+
+        BatchProveOutputs(vTxns, vCTOutputs);
+        for (const auto& btx : vTxns) {
+            if (!btx.sError.empty())
+                nRet = EXIT_FAILURE;
+        }
+        BatchWriteTxns(vTxns);
+    }
+
+    ECC_Stop_Blinding();
+    ECC_Stop_Stealth();
+    return nRet;
+}
+
 static int CommandLineRawTx(int argc, char* argv[])
 {
     std::string strPrint;
@@ -1008,7 +1335,10 @@ int main(int argc, char* argv[])
 
     int ret = EXIT_FAILURE;
     try {
-        ret = CommandLineRawTx(argc, argv);
+        if (gArgs.IsArgSet("-batch"))
+            ret = BatchRawTx(gArgs.GetArg("-batch", ""));
+        else
+            ret = CommandLineRawTx(argc, argv);
     }
     catch (const std::exception& e) {
         PrintExceptionContinue(&e, "CommandLineRawTx()");
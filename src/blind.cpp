@@ -8,14 +8,147 @@
 #include <secp256k1_rangeproof.h>
 
 #include <support/allocators/secure.h>
+#include <crypto/sha256.h>
+#include <cuckoocache.h>
+#include <perfstats.h>
 #include <random.h>
+#include <script/sigcache.h>
 #include <util.h>
 
+#include <algorithm>
+#include <map>
+
+#include <boost/thread.hpp>
+
 
 secp256k1_context *secp256k1_ctx_blind = nullptr;
-secp256k1_scratch_space *blind_scratch = nullptr;
 secp256k1_bulletproof_generators *blind_gens = nullptr;
 
+namespace {
+/** Scratch spaces returned by the CBlindScratch instances of one thread, freed when the thread exits */
+struct BlindScratchPool
+{
+    std::vector<secp256k1_scratch_space*> vFree;
+    ~BlindScratchPool()
+    {
+        for (auto *p : vFree)
+            secp256k1_scratch_space_destroy(p);
+    }
+};
+static thread_local BlindScratchPool blindScratchPool;
+} // namespace
+
+CBlindScratch::CBlindScratch()
+{
+    if (!blindScratchPool.vFree.empty()) {
+        scratch = blindScratchPool.vFree.back();
+        blindScratchPool.vFree.pop_back();
+        return;
+    }
+    scratch = secp256k1_scratch_space_create(secp256k1_ctx_blind, BLIND_SCRATCH_SIZE);
+    assert(scratch);
+}
+
+CBlindScratch::~CBlindScratch()
+{
+    blindScratchPool.vFree.push_back(scratch);
+}
+
+namespace {
+/**
+ * Valid proof cache, to avoid verifying the rangeproofs and ring signatures of a
+ * transaction twice (once when accepted into memory pool, and again when accepted
+ * into the block chain)
+ */
+class CCTVerificationCache
+{
+private:
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_ctcache;
+
+public:
+    CCTVerificationCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    CSHA256 &Salted(CSHA256 &hasher) const
+    {
+        return hasher.Write(nonce.begin(), 32);
+    }
+
+    bool Get(const uint256 &entry, const bool erase)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_ctcache);
+        return setValid.contains(entry, erase);
+    }
+
+    void Set(const uint256 &entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_ctcache);
+        setValid.insert(entry);
+    }
+
+    uint32_t setup_bytes(size_t n)
+    {
+        return setValid.setup_bytes(n);
+    }
+};
+
+static CCTVerificationCache rangeProofCache;
+static CCTVerificationCache mlsagCache;
+} // namespace
+
+void InitCTVerificationCache()
+{
+    // nMaxCacheSize is unsigned. If -maxctcachesize is set to zero,
+    // setup_bytes creates the minimum possible cache (2 elements).
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxctcachesize", DEFAULT_MAX_CT_CACHE_SIZE) / 2), MAX_MAX_CT_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElemsRP = rangeProofCache.setup_bytes(nMaxCacheSize);
+    size_t nElemsMLSAG = mlsagCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for rangeproof and ring signature caches, able to store %zu and %zu elements\n",
+            ((nElemsRP + nElemsMLSAG) * sizeof(uint256)) >> 20, (nMaxCacheSize*2)>>20, nElemsRP, nElemsMLSAG);
+}
+
+void ComputeRangeProofCacheEntry(uint256 &entry, const std::vector<uint8_t> &vRangeproof, const secp256k1_pedersen_commitment &commitment)
+{
+    CSHA256 hasher;
+    rangeProofCache.Salted(hasher).Write(commitment.data, 33).Write(vRangeproof.data(), vRangeproof.size()).Finalize(entry.begin());
+}
+
+bool GetRangeProofCacheEntry(const uint256 &entry, bool erase)
+{
+    return rangeProofCache.Get(entry, erase);
+}
+
+void SetRangeProofCacheEntry(const uint256 &entry)
+{
+    rangeProofCache.Set(entry);
+}
+
+void ComputeMLSAGCacheEntry(uint256 &entry, const uint256 &wtxid, unsigned int nIn,
+    const std::vector<uint8_t> &vM, const std::vector<secp256k1_pedersen_commitment> &vCommitments)
+{
+    // Commit to the resolved ring members as well, the rct index can change under a reorg
+    CSHA256 hasher;
+    mlsagCache.Salted(hasher).Write(wtxid.begin(), 32).Write((const unsigned char*)&nIn, sizeof(nIn)).Write(vM.data(), vM.size());
+    for (const auto &c : vCommitments)
+        hasher.Write(c.data, 33);
+    hasher.Finalize(entry.begin());
+}
+
+bool GetMLSAGCacheEntry(const uint256 &entry, bool erase)
+{
+    return mlsagCache.Get(entry, erase);
+}
+
+void SetMLSAGCacheEntry(const uint256 &entry)
+{
+    mlsagCache.Set(entry);
+}
+
 static int CountLeadingZeros(uint64_t nValueIn)
 {
     int nZeros = 0;
@@ -125,6 +258,130 @@ int GetRangeProofInfo(const std::vector<uint8_t> &vRangeproof, int &rexp, int &r
         &vRangeproof[0], vRangeproof.size()) == 1));
 };
 
+int CommitAndProveValue(secp256k1_pedersen_commitment &commitment, std::vector<uint8_t> &vRangeproof,
+    uint64_t nValue, const uint8_t *blind, const uint256 &nonce, bool fBulletproof,
+    const std::string &sMessage, const CRangeProofParams *pParams, std::string &sError)
+{
+    if (!secp256k1_pedersen_commit(secp256k1_ctx_blind, &commitment, blind,
+        nValue, &secp256k1_generator_const_h, &secp256k1_generator_const_g)) {
+        return errorN(1, sError, __func__, "secp256k1_pedersen_commit failed.");
+    }
+
+    size_t nRangeProofLen = 5134;
+    vRangeproof.resize(nRangeProofLen);
+
+    if (fBulletproof) {
+        const uint8_t *bp[1];
+        bp[0] = blind;
+
+        CBlindScratch scratch;
+        if (1 != secp256k1_bulletproof_rangeproof_prove(secp256k1_ctx_blind, scratch.get(), blind_gens,
+            vRangeproof.data(), &nRangeProofLen, &nValue, nullptr, bp, 1,
+            &secp256k1_generator_const_h, 64, nonce.begin(), nullptr, 0)) {
+            return errorN(1, sError, __func__, "secp256k1_bulletproof_rangeproof_prove failed.");
+        }
+
+        if (1 != secp256k1_bulletproof_rangeproof_verify(secp256k1_ctx_blind, scratch.get(), blind_gens,
+            vRangeproof.data(), nRangeProofLen, nullptr, &commitment, 1, 64, &secp256k1_generator_const_h, nullptr, 0)) {
+            return errorN(1, sError, __func__, "secp256k1_bulletproof_rangeproof_verify failed.");
+        }
+    } else {
+        CRangeProofParams params;
+        if (pParams) {
+            params = *pParams;
+        } else
+        if (0 != SelectRangeProofParameters(nValue, params.min_value, params.ct_exponent, params.ct_bits)) {
+            return errorN(1, sError, __func__, "SelectRangeProofParameters failed.");
+        }
+
+        if (1 != secp256k1_rangeproof_sign(secp256k1_ctx_blind,
+            vRangeproof.data(), &nRangeProofLen,
+            params.min_value, &commitment,
+            blind, nonce.begin(),
+            params.ct_exponent, params.ct_bits,
+            nValue,
+            (const unsigned char*) sMessage.c_str(), sMessage.size(),
+            nullptr, 0,
+            secp256k1_generator_h)) {
+            return errorN(1, sError, __func__, "secp256k1_rangeproof_sign failed.");
+        }
+    }
+
+    vRangeproof.resize(nRangeProofLen);
+
+    return 0;
+};
+
+void CBulletproofBatch::Add(const uint256 &txid, const std::vector<uint8_t> &vRangeproof, const secp256k1_pedersen_commitment &commitment)
+{
+    uint256 hashCacheEntry;
+    ComputeRangeProofCacheEntry(hashCacheEntry, vRangeproof, commitment);
+    if (GetRangeProofCacheEntry(hashCacheEntry, false))
+        return;
+    vProofs.push_back(Entry{txid, &vRangeproof, &commitment, hashCacheEntry});
+};
+
+bool CBulletproofBatch::Verify(uint256 &txidFailed) const
+{
+    CPerfTimer timer(PERF_HISTOGRAM("verify:rangeproofbatch"));
+    PERF_COUNTER("verify:rangeproofs") += vProofs.size();
+
+    // verify_multi requires all proofs in a call to have the same length
+    std::map<size_t, std::vector<const Entry*> > mapBySize;
+    for (const auto &e : vProofs)
+        mapBySize[e.pvRangeproof->size()].push_back(&e);
+
+    CBlindScratch scratch;
+    std::vector<const unsigned char*> vpProofs;
+    std::vector<const secp256k1_pedersen_commitment*> vpCommitments;
+    std::vector<secp256k1_generator> vValueGens;
+
+    for (const auto &mi : mapBySize)
+    {
+        const size_t nProofLen = mi.first;
+        const std::vector<const Entry*> &vEntries = mi.second;
+
+        for (size_t nStart = 0; nStart < vEntries.size(); nStart += MAX_BULLETPROOF_BATCH)
+        {
+            size_t nProofs = std::min(MAX_BULLETPROOF_BATCH, vEntries.size() - nStart);
+
+            vpProofs.resize(nProofs);
+            vpCommitments.resize(nProofs);
+            vValueGens.assign(nProofs, secp256k1_generator_const_h);
+            for (size_t k = 0; k < nProofs; ++k)
+            {
+                vpProofs[k] = vEntries[nStart + k]->pvRangeproof->data();
+                vpCommitments[k] = vEntries[nStart + k]->pCommitment;
+            };
+
+            if (1 == secp256k1_bulletproof_rangeproof_verify_multi(secp256k1_ctx_blind,
+                scratch.get(), blind_gens, vpProofs.data(), nProofs, nProofLen,
+                nullptr, vpCommitments.data(), 1, 64, vValueGens.data(), nullptr, nullptr))
+            {
+                if (fCacheStore)
+                    for (size_t k = 0; k < nProofs; ++k)
+                        SetRangeProofCacheEntry(vEntries[nStart + k]->hashCacheEntry);
+                continue;
+            };
+
+            // Batch failed, find the invalid proof
+            for (size_t k = 0; k < nProofs; ++k)
+            {
+                const Entry *e = vEntries[nStart + k];
+                if (1 != secp256k1_bulletproof_rangeproof_verify(secp256k1_ctx_blind,
+                    scratch.get(), blind_gens, e->pvRangeproof->data(), e->pvRangeproof->size(),
+                    nullptr, e->pCommitment, 1, 64, &secp256k1_generator_const_h, nullptr, 0))
+                {
+                    txidFailed = e->txid;
+                    return false;
+                };
+            };
+        };
+    };
+
+    return true;
+};
+
 void ECC_Start_Blinding()
 {
     assert(secp256k1_ctx_blind == nullptr);
@@ -140,10 +397,11 @@ void ECC_Start_Blinding()
         assert(ret);
     }
 
+    // Precompute the value generator table used when committing to amounts
+    secp256k1_pedersen_context_initialize(ctx);
+
     secp256k1_ctx_blind = ctx;
 
-    blind_scratch = secp256k1_scratch_space_create(secp256k1_ctx_blind, 1024 * 1024);
-    assert(blind_scratch);
     blind_gens = secp256k1_bulletproof_generators_create(secp256k1_ctx_blind, &secp256k1_generator_const_g, 128);
     assert(blind_gens);
 };
@@ -151,7 +409,7 @@ void ECC_Start_Blinding()
 void ECC_Stop_Blinding()
 {
     secp256k1_bulletproof_generators_destroy(secp256k1_ctx_blind, blind_gens);
-    secp256k1_scratch_space_destroy(blind_scratch);
+    blind_gens = nullptr;
 
     secp256k1_context *ctx = secp256k1_ctx_blind;
     secp256k1_ctx_blind = nullptr;
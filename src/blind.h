@@ -8,18 +8,123 @@
 #include <secp256k1.h>
 #include <secp256k1_bulletproofs.h>
 #include <inttypes.h>
+#include <string>
 #include <vector>
 
 #include <amount.h>
+#include <uint256.h>
 
+/** Context and bulletproof generators are read only once ECC_Start_Blinding returns, any thread may use them */
 extern secp256k1_context *secp256k1_ctx_blind;
-extern secp256k1_scratch_space *blind_scratch;
 extern secp256k1_bulletproof_generators *blind_gens;
 
+/**
+ * Size of each scratch space. The frames of a MAX_BULLETPROOF_BATCH proof verify_multi
+ * take a few KiB, the rest sets how many points a multi-exponentiation pass can take.
+ */
+static const size_t BLIND_SCRATCH_SIZE = 1024 * 1024;
+
+/**
+ * Borrows a scratch space from the calling thread's pool for its lifetime.
+ * Scratch spaces are not thread safe, this lets proofs be made and verified
+ * on several threads at once. Nested borrows on one thread get separate spaces.
+ */
+class CBlindScratch
+{
+public:
+    CBlindScratch();
+    ~CBlindScratch();
+    CBlindScratch(const CBlindScratch&) = delete;
+    CBlindScratch& operator=(const CBlindScratch&) = delete;
+
+    secp256k1_scratch_space *get() const { return scratch; };
+
+private:
+    secp256k1_scratch_space *scratch;
+};
+
 int SelectRangeProofParameters(uint64_t nValueIn, uint64_t &minValue, int &exponent, int &nBits);
 
 int GetRangeProofInfo(const std::vector<uint8_t> &vRangeproof, int &rexp, int &rmantissa, CAmount &min_value, CAmount &max_value);
 
+/** Borromean rangeproof parameters, see SelectRangeProofParameters */
+struct CRangeProofParams
+{
+    uint64_t min_value = 0;
+    int ct_exponent = 2;
+    int ct_bits = 32;
+};
+
+/**
+ * Commit to nValue under the 32 byte blinding factor and prove the range of the commitment.
+ * A bulletproof if fBulletproof, otherwise a borromean rangeproof carrying sMessage, made with
+ * pParams or, if null, the parameters SelectRangeProofParameters picks.
+ * May be called from several threads at once.
+ */
+int CommitAndProveValue(secp256k1_pedersen_commitment &commitment, std::vector<uint8_t> &vRangeproof,
+    uint64_t nValue, const uint8_t *blind, const uint256 &nonce, bool fBulletproof,
+    const std::string &sMessage, const CRangeProofParams *pParams, std::string &sError);
+
+/** -maxctcachesize default, limit sum of rangeproof and ring signature cache sizes (MiB) */
+static const unsigned int DEFAULT_MAX_CT_CACHE_SIZE = 16;
+/** Maximum ct cache size allowed */
+static const int64_t MAX_MAX_CT_CACHE_SIZE = 16384;
+
+/**
+ * Salted caches of successfully verified bulletproofs and MLSAG ring signatures, so
+ * transactions checked at mempool accept aren't fully verified again at block connect.
+ * Entries are SHA256(nonce || data), see script/sigcache.cpp.
+ */
+void InitCTVerificationCache();
+void ComputeRangeProofCacheEntry(uint256 &entry, const std::vector<uint8_t> &vRangeproof, const secp256k1_pedersen_commitment &commitment);
+bool GetRangeProofCacheEntry(const uint256 &entry, bool erase);
+void SetRangeProofCacheEntry(const uint256 &entry);
+void ComputeMLSAGCacheEntry(uint256 &entry, const uint256 &wtxid, unsigned int nIn,
+    const std::vector<uint8_t> &vM, const std::vector<secp256k1_pedersen_commitment> &vCommitments);
+bool GetMLSAGCacheEntry(const uint256 &entry, bool erase);
+void SetMLSAGCacheEntry(const uint256 &entry);
+
+/** Maximum number of bulletproofs passed to one secp256k1_bulletproof_rangeproof_verify_multi call */
+static const size_t MAX_BULLETPROOF_BATCH = 32;
+
+/**
+ * Collects bulletproof rangeproofs so they can share multi-exponentiations.
+ * The referenced proofs and commitments must outlive the batch.
+ */
+class CBulletproofBatch
+{
+public:
+    /** If fCacheStoreIn is set proofs found valid are added to the rangeproof cache */
+    explicit CBulletproofBatch(bool fCacheStoreIn = false) : fCacheStore(fCacheStoreIn) {};
+
+    /** Proofs already in the rangeproof cache are not collected */
+    void Add(const uint256 &txid, const std::vector<uint8_t> &vRangeproof, const secp256k1_pedersen_commitment &commitment);
+
+    /**
+     * Verify all collected proofs, in batches of proofs of equal length.
+     * When a batch fails each proof in it is verified individually to find the invalid one.
+     * @param[out] txidFailed Set to the txid of the first invalid proof found.
+     */
+    bool Verify(uint256 &txidFailed) const;
+
+    /** Take over the proofs collected by another batch, after those already collected */
+    void Append(const CBulletproofBatch &other) { vProofs.insert(vProofs.end(), other.vProofs.begin(), other.vProofs.end()); };
+
+    size_t Size() const { return vProofs.size(); };
+    void Clear() { vProofs.clear(); };
+
+private:
+    struct Entry
+    {
+        uint256 txid;
+        const std::vector<uint8_t> *pvRangeproof;
+        const secp256k1_pedersen_commitment *pCommitment;
+        uint256 hashCacheEntry;
+    };
+    std::vector<Entry> vProofs;
+    bool fCacheStore;
+};
+
 void ECC_Start_Blinding();
 void ECC_Stop_Blinding();
 
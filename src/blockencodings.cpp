@@ -15,16 +15,28 @@
 
 #include <unordered_map>
 
-CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID, const CTxMemPool* pool) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
-        shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block) {
+        prefilledtxn(1), header(block) {
     vchBlockSig = block.vchBlockSig;
     FillShortTxIDSelector();
-    //TODO: Use our mempool prior to block acceptance to predictively fill more than just the coinbase
     prefilledtxn[0] = {0, block.vtx[0]};
+    shorttxids.reserve(block.vtx.size() - 1);
+    size_t nPrefillSize = 0;
+    size_t nLastPrefilled = 0;
     for (size_t i = 1; i < block.vtx.size(); i++) {
         const CTransaction& tx = *block.vtx[i];
-        shorttxids[i - 1] = GetShortID(fUseWTXID ? tx.GetWitnessHash() : tx.GetHash());
+        if (pool && !pool->exists(tx.GetHash())) {
+            size_t nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+            if (nPrefillSize + nTxSize <= MAX_CMPCTBLOCK_PREFILL_SIZE) {
+                // Indexes are differentially encoded
+                prefilledtxn.push_back({(uint16_t)(i - nLastPrefilled - 1), block.vtx[i]});
+                nLastPrefilled = i;
+                nPrefillSize += nTxSize;
+                continue;
+            }
+        }
+        shorttxids.push_back(GetShortID(fUseWTXID ? tx.GetWitnessHash() : tx.GetHash()));
     }
 }
 
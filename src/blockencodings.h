@@ -119,6 +119,9 @@ struct PrefilledTransaction {
     }
 };
 
+/** Maximum serialized size of the transactions prefilled in a compact block beyond the coinbase */
+static const size_t MAX_CMPCTBLOCK_PREFILL_SIZE = 50000;
+
 typedef enum ReadStatus_t
 {
     READ_STATUS_OK,
@@ -149,7 +152,12 @@ public:
     // Dummy for deserialization
     CBlockHeaderAndShortTxIDs() {}
 
-    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
+    /**
+     * If pool is set, transactions missing from it are prefilled up to MAX_CMPCTBLOCK_PREFILL_SIZE.
+     * Transactions that did not reach our mempool by relay are likely missing at peers too,
+     * and large CT transactions would otherwise cost a getblocktxn round trip.
+     */
+    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID, const CTxMemPool* pool = nullptr);
 
     uint64_t GetShortID(const uint256& txhash) const;
 
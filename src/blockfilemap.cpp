@@ -0,0 +1,135 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilemap.h>
+
+#include <chain.h>
+#include <util.h>
+#include <validation.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CBlockFileMapCache g_block_file_maps;
+
+#ifdef WIN32
+CMappedBlockFile::~CMappedBlockFile()
+{
+};
+
+static const uint8_t *MapFile(const fs::path &path, size_t &nSize)
+{
+    return nullptr;
+};
+#else
+CMappedBlockFile::~CMappedBlockFile()
+{
+    if (pBase)
+        munmap((void*)pBase, nSize);
+};
+
+static const uint8_t *MapFile(const fs::path &path, size_t &nSize)
+{
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return nullptr;
+    };
+
+    void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // The mapping stays valid
+    if (p == MAP_FAILED)
+    {
+        LogPrintf("%s: mmap failed for %s.\n", __func__, path.string());
+        return nullptr;
+    };
+
+    nSize = (size_t)st.st_size;
+    return (const uint8_t*)p;
+};
+#endif
+
+void CBlockFileMapCache::SetEnabled(bool fEnabledIn)
+{
+#ifdef WIN32
+    if (fEnabledIn)
+        LogPrintf("%s: Memory-mapped block files are not supported on this platform.\n", __func__);
+    fEnabledIn = false;
+#endif
+    std::lock_guard<std::mutex> lock(cs);
+    fEnabled = fEnabledIn;
+    if (!fEnabled)
+    {
+        lMappings.clear();
+        mapMappings.clear();
+    };
+};
+
+std::shared_ptr<const CMappedBlockFile> CBlockFileMapCache::Get(const char *prefix, int nFile, uint64_t nEnd)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (!fEnabled)
+        return nullptr;
+
+    FileKey key(prefix, nFile);
+    auto mi = mapMappings.find(key);
+    if (mi != mapMappings.end())
+    {
+        lMappings.splice(lMappings.begin(), lMappings, mi->second);
+        if (mi->second->second->size() >= nEnd)
+            return mi->second->second;
+
+        // The file grew since it was mapped
+        lMappings.erase(mi->second);
+        mapMappings.erase(mi);
+    };
+
+    size_t nSize = 0;
+    const uint8_t *pBase = MapFile(GetBlockPosFilename(CDiskBlockPos(nFile, 0), prefix), nSize);
+    if (!pBase)
+        return nullptr;
+
+    std::shared_ptr<const CMappedBlockFile> file = std::make_shared<const CMappedBlockFile>(pBase, nSize);
+    if (nSize < nEnd)
+        return nullptr;
+
+    lMappings.emplace_front(key, file);
+    mapMappings[key] = lMappings.begin();
+    while (lMappings.size() > MAX_BLOCK_FILE_MAPPINGS)
+    {
+        mapMappings.erase(lMappings.back().first);
+        lMappings.pop_back();
+    };
+
+    return file;
+};
+
+void CBlockFileMapCache::Invalidate(int nFile)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    for (const char *prefix : {"blk", "rev"})
+    {
+        auto mi = mapMappings.find(FileKey(prefix, nFile));
+        if (mi == mapMappings.end())
+            continue;
+        lMappings.erase(mi->second);
+        mapMappings.erase(mi);
+    };
+};
+
+void CBlockFileMapCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    lMappings.clear();
+    mapMappings.clear();
+};
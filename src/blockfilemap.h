@@ -0,0 +1,69 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_BLOCKFILEMAP_H
+#define BITCOINC_BLOCKFILEMAP_H
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+static const bool DEFAULT_MMAPBLOCKS = false;
+
+//! Maximum number of blk/rev files kept mapped at once
+static const size_t MAX_BLOCK_FILE_MAPPINGS = 64;
+
+/** Read-only mapping of a whole blk or rev file, unmapped when the last reference goes */
+class CMappedBlockFile
+{
+public:
+    CMappedBlockFile(const uint8_t *pBaseIn, size_t nSizeIn) : pBase(pBaseIn), nSize(nSizeIn) {};
+    ~CMappedBlockFile();
+    CMappedBlockFile(const CMappedBlockFile&) = delete;
+    CMappedBlockFile& operator=(const CMappedBlockFile&) = delete;
+
+    const uint8_t *data() const { return pBase; };
+    size_t size() const { return nSize; };
+
+private:
+    const uint8_t *pBase;
+    size_t nSize;
+};
+
+/**
+ * Cache of read-only memory mappings of the blk and rev files.
+ *
+ * Files still being appended to are remapped when a read reaches past the
+ * mapped size. Mappings are shared, a reader keeps the one it got alive while
+ * deserializing even if it is evicted or invalidated meanwhile.
+ */
+class CBlockFileMapCache
+{
+public:
+    void SetEnabled(bool fEnabledIn);
+    bool IsEnabled() const { return fEnabled; };
+
+    /** Map file nFile of type prefix ("blk" or "rev") covering at least nEnd bytes, nullptr on failure */
+    std::shared_ptr<const CMappedBlockFile> Get(const char *prefix, int nFile, uint64_t nEnd);
+
+    /** Drop the mappings of a file that was truncated or deleted */
+    void Invalidate(int nFile);
+    void Clear();
+
+private:
+    typedef std::pair<std::string, int> FileKey;
+    typedef std::list<std::pair<FileKey, std::shared_ptr<const CMappedBlockFile> > > MappingList;
+
+    std::mutex cs;
+    bool fEnabled = false;
+    MappingList lMappings; // Most recently used first
+    std::map<FileKey, MappingList::iterator> mapMappings;
+};
+
+extern CBlockFileMapCache g_block_file_maps;
+
+#endif // BITCOINC_BLOCKFILEMAP_H
@@ -0,0 +1,145 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockreadahead.h>
+
+#include <chainparams.h>
+#include <crypto/common.h>
+#include <fs.h>
+#include <serialize.h>
+#include <util.h>
+#include <validation.h>
+
+#include <string.h>
+
+CBlockReadAhead g_block_read_ahead;
+
+void CBlockReadAhead::Start(int nThreads)
+{
+    Stop();
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = false;
+    }
+    for (int i = 0; i < nThreads; ++i)
+        vThreads.emplace_back(&TraceThread<std::function<void()> >, "blockread",
+                              std::function<void()>(std::bind(&CBlockReadAhead::ThreadRead, this)));
+};
+
+void CBlockReadAhead::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+    }
+    cond.notify_all();
+    for (auto &t : vThreads)
+        if (t.joinable())
+            t.join();
+    vThreads.clear();
+
+    std::lock_guard<std::mutex> lock(cs);
+    qQueued.clear();
+    qRecent.clear();
+    setSeen.clear();
+};
+
+void CBlockReadAhead::Block(const CDiskBlockPos &pos)
+{
+    Queue(false, pos);
+};
+
+void CBlockReadAhead::Undo(const CDiskBlockPos &pos)
+{
+    Queue(true, pos);
+};
+
+void CBlockReadAhead::Chain(const CBlockIndex *pindex, int nBlocks, bool fUndo)
+{
+    AssertLockHeld(cs_main);
+    if (!IsRunning())
+        return;
+
+    for (; pindex && nBlocks > 0; pindex = pindex->pprev, --nBlocks)
+    {
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+            break;
+        Block(pindex->GetBlockPos());
+        if (fUndo && (pindex->nStatus & BLOCK_HAVE_UNDO))
+            Undo(pindex->GetUndoPos());
+    };
+};
+
+void CBlockReadAhead::Queue(bool fUndo, const CDiskBlockPos &pos)
+{
+    if (pos.IsNull() || pos.nPos < 8)
+        return;
+
+    Key key(fUndo, pos.nFile, pos.nPos);
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (fStop || vThreads.empty()
+            || qQueued.size() >= MAX_BLOCK_READ_AHEAD_QUEUE
+            || !setSeen.insert(key).second)
+            return;
+        qQueued.push_back(key);
+    }
+    cond.notify_one();
+};
+
+/** Read the record at pos with its index header, and the checksum following undo data */
+static void ReadRecord(bool fUndo, const CDiskBlockPos &pos, std::vector<char> &vBuffer)
+{
+    FILE *file = fsbridge::fopen(GetBlockPosFilename(pos, fUndo ? "rev" : "blk"), "rb");
+    if (!file)
+        return;
+
+    unsigned char header[CMessageHeader::MESSAGE_START_SIZE + 4];
+    if (fseek(file, pos.nPos - sizeof(header), SEEK_SET) == 0
+        && fread(header, 1, sizeof(header), file) == sizeof(header)
+        && memcmp(header, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE) == 0)
+    {
+        size_t nLeft = ReadLE32(header + CMessageHeader::MESSAGE_START_SIZE);
+        if (nLeft <= MAX_SIZE)
+        {
+            if (fUndo)
+                nLeft += sizeof(uint256);
+            while (nLeft > 0)
+            {
+                size_t nRead = fread(vBuffer.data(), 1, std::min(nLeft, vBuffer.size()), file);
+                if (nRead == 0)
+                    break;
+                nLeft -= nRead;
+            };
+        };
+    };
+    fclose(file);
+};
+
+void CBlockReadAhead::ThreadRead()
+{
+    std::vector<char> vBuffer(1 << 16);
+    for (;;)
+    {
+        Key key;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            cond.wait(lock, [this] { return fStop || !qQueued.empty(); });
+            if (fStop)
+                return;
+            key = qQueued.front();
+            qQueued.pop_front();
+        }
+
+        ReadRecord(std::get<0>(key), CDiskBlockPos(std::get<1>(key), std::get<2>(key)), vBuffer);
+
+        std::lock_guard<std::mutex> lock(cs);
+        qRecent.push_back(key);
+        if (qRecent.size() > BLOCK_READ_AHEAD_RECENT)
+        {
+            setSeen.erase(qRecent.front());
+            qRecent.pop_front();
+        };
+    };
+};
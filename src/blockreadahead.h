@@ -0,0 +1,72 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_BLOCKREADAHEAD_H
+#define BITCOINC_BLOCKREADAHEAD_H
+
+#include <chain.h>
+#include <sync.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+//! Default for -blockreadthreads, 0 disables read-ahead
+static const int DEFAULT_BLOCK_READ_THREADS = 4;
+static const int MAX_BLOCK_READ_THREADS = 64;
+//! Reads waiting for a thread, further requests are dropped
+static const size_t MAX_BLOCK_READ_AHEAD_QUEUE = 256;
+//! Records remembered as read, they are not queued again
+static const size_t BLOCK_READ_AHEAD_RECENT = 1024;
+//! Blocks read ahead of a chain walk, a reorg or a peer's getdata queue
+static const int BLOCK_READ_AHEAD_DEPTH = 16;
+
+extern CCriticalSection cs_main;
+
+/**
+ * Reads blk and rev file records ahead of use on a pool of threads.
+ *
+ * ReadBlockFromDisk and UndoReadFromDisk block on a cold read, walking the
+ * chain with them keeps one read in flight. Records queued here are read
+ * in parallel into the page cache, so the device sees many outstanding reads
+ * and the reads that follow, through a FILE or a memory mapping, are served
+ * from memory. Requests are hints, they are dropped when the queue is full
+ * or the pool isn't running.
+ */
+class CBlockReadAhead
+{
+public:
+    void Start(int nThreads);
+    void Stop();
+    bool IsRunning() const { return !vThreads.empty(); };
+
+    void Block(const CDiskBlockPos &pos);
+    void Undo(const CDiskBlockPos &pos);
+
+    /** Queue pindex and up to nBlocks - 1 of its ancestors, the undo data too if fUndo */
+    void Chain(const CBlockIndex *pindex, int nBlocks, bool fUndo) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+private:
+    //! fUndo, nFile, nPos
+    typedef std::tuple<bool, int, unsigned int> Key;
+
+    void Queue(bool fUndo, const CDiskBlockPos &pos);
+    void ThreadRead();
+
+    std::mutex cs;
+    std::condition_variable cond;
+    bool fStop = false;
+    std::deque<Key> qQueued;
+    std::deque<Key> qRecent;
+    std::set<Key> setSeen;      //!< Queued or recent
+    std::vector<std::thread> vThreads;
+};
+
+extern CBlockReadAhead g_block_read_ahead;
+
+#endif // BITCOINC_BLOCKREADAHEAD_H
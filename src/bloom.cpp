@@ -4,6 +4,7 @@
 
 #include <bloom.h>
 
+#include <crypto/common.h>
 #include <primitives/transaction.h>
 #include <hash.h>
 #include <script/script.h>
@@ -13,6 +14,7 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 #define LN2SQUARED 0.4804530139182014246671025263266649717305529515945455
@@ -49,40 +51,45 @@ CBloomFilter::CBloomFilter(const unsigned int nElements, const double nFPRate, c
 {
 }
 
-inline unsigned int CBloomFilter::Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const
+inline unsigned int CBloomFilter::Hash(unsigned int nHashNum, const unsigned char *pDataToHash, size_t nDataLen) const
 {
     // 0xFBA4C795 chosen as it guarantees a reasonable bit difference between nHashNum values.
-    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, vDataToHash) % (vData.size() * 8);
+    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, pDataToHash, nDataLen) % (vData.size() * 8);
 }
 
-void CBloomFilter::insert(const std::vector<unsigned char>& vKey)
+void CBloomFilter::insert(const unsigned char *pKey, size_t nKeyLen)
 {
     if (isFull)
         return;
     for (unsigned int i = 0; i < nHashFuncs; i++)
     {
-        unsigned int nIndex = Hash(i, vKey);
+        unsigned int nIndex = Hash(i, pKey, nKeyLen);
         // Sets bit nIndex of vData
         vData[nIndex >> 3] |= (1 << (7 & nIndex));
     }
     isEmpty = false;
 }
 
+/** Serialize an outpoint as in the network format, without the allocations of a CDataStream */
+static inline void SerializeOutPoint(const COutPoint& outpoint, unsigned char (&data)[36])
+{
+    memcpy(data, outpoint.hash.begin(), 32);
+    WriteLE32(data + 32, outpoint.n);
+}
+
 void CBloomFilter::insert(const COutPoint& outpoint)
 {
-    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
-    stream << outpoint;
-    std::vector<unsigned char> data(stream.begin(), stream.end());
-    insert(data);
+    unsigned char data[36];
+    SerializeOutPoint(outpoint, data);
+    insert(data, sizeof(data));
 }
 
 void CBloomFilter::insert(const uint256& hash)
 {
-    std::vector<unsigned char> data(hash.begin(), hash.end());
-    insert(data);
+    insert(hash.begin(), hash.size());
 }
 
-bool CBloomFilter::contains(const std::vector<unsigned char>& vKey) const
+bool CBloomFilter::contains(const unsigned char *pKey, size_t nKeyLen) const
 {
     if (isFull)
         return true;
@@ -90,7 +97,7 @@ bool CBloomFilter::contains(const std::vector<unsigned char>& vKey) const
         return false;
     for (unsigned int i = 0; i < nHashFuncs; i++)
     {
-        unsigned int nIndex = Hash(i, vKey);
+        unsigned int nIndex = Hash(i, pKey, nKeyLen);
         // Checks bit nIndex of vData
         if (!(vData[nIndex >> 3] & (1 << (7 & nIndex))))
             return false;
@@ -100,16 +107,14 @@ bool CBloomFilter::contains(const std::vector<unsigned char>& vKey) const
 
 bool CBloomFilter::contains(const COutPoint& outpoint) const
 {
-    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
-    stream << outpoint;
-    std::vector<unsigned char> data(stream.begin(), stream.end());
-    return contains(data);
+    unsigned char data[36];
+    SerializeOutPoint(outpoint, data);
+    return contains(data, sizeof(data));
 }
 
 bool CBloomFilter::contains(const uint256& hash) const
 {
-    std::vector<unsigned char> data(hash.begin(), hash.end());
-    return contains(data);
+    return contains(hash.begin(), hash.size());
 }
 
 void CBloomFilter::clear()
@@ -213,10 +218,43 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
     if (fFound)
         return true;
 
+    // Match the parts of anon and stealth outputs a light wallet can look for: the anon output
+    // pubkeys and commitments, and the ephemeral pubkeys of stealth payments.
+    // Elements are hashed in place from the transaction, these outputs have no outpoint to add.
+    for (const auto& txout : tx.vpout)
+    {
+        if (txout->IsType(OUTPUT_RINGCT))
+        {
+            const CTxOutRingCT *rctout = (const CTxOutRingCT*)txout.get();
+            if (contains(rctout->pk.begin(), rctout->pk.size())
+                || contains(rctout->commitment.data, 33))
+                return true;
+            if (rctout->vData.size() >= 33 && contains(rctout->vData.data(), 33))
+                return true;
+        } else
+        if (txout->IsType(OUTPUT_DATA))
+        {
+            const std::vector<uint8_t> &vData = ((const CTxOutData*)txout.get())->vData;
+            if (vData.size() >= 34 && vData[0] == DO_STEALTH && contains(&vData[1], 33))
+                return true;
+        }
+    }
+
     for (const CTxIn& txin : tx.vin)
     {
         if (txin.IsAnonInput())
+        {
+            // Match if the filter contains a key image the input spends
+            if (txin.scriptData.stack.size() != 1)
+                continue;
+            const std::vector<uint8_t> &vKeyImages = txin.scriptData.stack[0];
+            for (size_t k = 0; k + 33 <= vKeyImages.size(); k += 33)
+            {
+                if (contains(&vKeyImages[k], 33))
+                    return true;
+            }
             continue;
+        }
         // Match if the filter contains an outpoint tx spends
         if (contains(txin.prevout))
             return true;
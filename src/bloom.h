@@ -51,7 +51,7 @@ private:
     unsigned int nTweak;
     unsigned char nFlags;
 
-    unsigned int Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const;
+    unsigned int Hash(unsigned int nHashNum, const unsigned char *pDataToHash, size_t nDataLen) const;
 
     // Private constructor for CRollingBloomFilter, no restrictions on size
     CBloomFilter(const unsigned int nElements, const double nFPRate, const unsigned int nTweak);
@@ -80,11 +80,13 @@ public:
         READWRITE(nFlags);
     }
 
-    void insert(const std::vector<unsigned char>& vKey);
+    void insert(const unsigned char *pKey, size_t nKeyLen);
+    void insert(const std::vector<unsigned char>& vKey) { insert(vKey.data(), vKey.size()); }
     void insert(const COutPoint& outpoint);
     void insert(const uint256& hash);
 
-    bool contains(const std::vector<unsigned char>& vKey) const;
+    bool contains(const unsigned char *pKey, size_t nKeyLen) const;
+    bool contains(const std::vector<unsigned char>& vKey) const { return contains(vKey.data(), vKey.size()); }
     bool contains(const COutPoint& outpoint) const;
     bool contains(const uint256& hash) const;
 
@@ -0,0 +1,140 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <cachebalancer.h>
+
+#include <util.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+CCacheBalancer g_cache_balancer;
+
+void CCacheBalancer::AddFixed(const std::string &sName, size_t nSize)
+{
+    Entry e;
+    e.info.sName = sName;
+    e.info.nSize = nSize;
+
+    LOCK(cs);
+    vEntries.push_back(e);
+};
+
+void CCacheBalancer::Add(const std::string &sName, size_t nSize, size_t nMinSize, unsigned int nMissCost,
+                         CountsFunction counts, ResizeFunction resize)
+{
+    Entry e;
+    e.info.sName = sName;
+    e.info.nSize = nSize;
+    e.info.fBalanced = true;
+    e.info.nMinSize = std::min(nMinSize, nSize);
+    e.nMissCost = nMissCost;
+    e.counts = counts;
+    e.resize = resize;
+    e.counts(e.info.nHits, e.info.nMisses);
+
+    LOCK(cs);
+    vEntries.push_back(e);
+};
+
+void CCacheBalancer::Rebalance()
+{
+    LOCK(cs);
+
+    size_t nBudget = 0, nSpare = 0;
+    double dTotalWeight = 0;
+    std::vector<Entry*> vBalanced;
+    for (auto &e : vEntries)
+    {
+        if (!e.info.fBalanced)
+            continue;
+
+        uint64_t nHits, nMisses;
+        e.counts(nHits, nMisses);
+        uint64_t nNewMisses = nMisses >= e.info.nMisses ? nMisses - e.info.nMisses : 0;
+        e.info.nHits = nHits;
+        e.info.nMisses = nMisses;
+        e.dWeight = (e.dWeight + (double)nNewMisses * e.nMissCost) / 2;
+
+        nBudget += e.info.nSize;
+        nSpare += e.info.nSize - e.info.nMinSize;
+        dTotalWeight += e.dWeight;
+        vBalanced.push_back(&e);
+    };
+
+    if (vBalanced.size() < 2 || dTotalWeight <= 0)
+        return;
+
+    // Step each cache towards its share, then scale down the side that moves
+    // more so the sizes still add up to the budget
+    const int64_t nMaxStep = std::max((int64_t)(nBudget / 8), (int64_t)CACHE_REBALANCE_MIN_CHANGE);
+    std::vector<int64_t> vChange(vBalanced.size());
+    int64_t nGrow = 0, nShrink = 0;
+    for (size_t i = 0; i < vBalanced.size(); ++i)
+    {
+        const Entry &e = *vBalanced[i];
+        int64_t nTarget = e.info.nMinSize + (int64_t)(nSpare * (e.dWeight / dTotalWeight));
+        vChange[i] = std::max(-nMaxStep, std::min(nMaxStep, nTarget - (int64_t)e.info.nSize));
+        if (std::abs(vChange[i]) < (int64_t)CACHE_REBALANCE_MIN_CHANGE)
+            vChange[i] = 0;
+        if (vChange[i] > 0)
+            nGrow += vChange[i];
+        else
+            nShrink -= vChange[i];
+    };
+
+    int64_t nMoved = std::min(nGrow, nShrink);
+    if (nMoved < (int64_t)CACHE_REBALANCE_MIN_CHANGE)
+        return;
+
+    int64_t nGrown = 0, nShrunk = 0;
+    for (size_t i = 0; i < vBalanced.size(); ++i)
+    {
+        if (vChange[i] > 0)
+        {
+            vChange[i] = vChange[i] * nMoved / nGrow;
+            nGrown += vChange[i];
+        } else
+        {
+            vChange[i] = vChange[i] * nMoved / nShrink;
+            nShrunk -= vChange[i];
+        };
+    };
+
+    // The heaviest cache takes the few bytes the scaling rounded off
+    size_t nHeaviest = 0;
+    for (size_t i = 1; i < vBalanced.size(); ++i)
+        if (vBalanced[i]->dWeight > vBalanced[nHeaviest]->dWeight)
+            nHeaviest = i;
+    vChange[nHeaviest] += nShrunk - nGrown;
+
+    // Shrink first so the total never exceeds the budget
+    for (int fGrow = 0; fGrow < 2; ++fGrow)
+    {
+        for (size_t i = 0; i < vBalanced.size(); ++i)
+        {
+            if (vChange[i] == 0 || (vChange[i] > 0) != (bool)fGrow)
+                continue;
+            Entry &e = *vBalanced[i];
+            e.info.nSize += vChange[i];
+            e.resize(e.info.nSize);
+            LogPrint(BCLog::DB, "%s: %s cache %.1fMiB\n", __func__, e.info.sName, e.info.nSize * (1.0 / 1024 / 1024));
+        };
+    };
+};
+
+std::vector<CCacheBalancerInfo> CCacheBalancer::GetInfo() const
+{
+    std::vector<CCacheBalancerInfo> vInfo;
+    LOCK(cs);
+    for (const auto &e : vEntries)
+        vInfo.push_back(e.info);
+    return vInfo;
+};
+
+void CCacheBalancer::Clear()
+{
+    LOCK(cs);
+    vEntries.clear();
+};
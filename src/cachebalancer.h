@@ -0,0 +1,86 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_CACHEBALANCER_H
+#define BITCOINC_CACHEBALANCER_H
+
+#include <sync.h>
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//! Default for -dbcachebalance
+static const bool DEFAULT_DBCACHE_BALANCE = true;
+//! Seconds between rebalances
+static const int64_t CACHE_REBALANCE_INTERVAL = 60;
+//! Smallest size change applied to a cache, smaller ones are skipped to avoid churn
+static const size_t CACHE_REBALANCE_MIN_CHANGE = 1 << 20;
+
+//! Relative cost of a miss: a coins or RCT output miss is one db read, a txn lookup miss reads a block
+static const unsigned int CACHE_MISS_COST_COINS = 1;
+static const unsigned int CACHE_MISS_COST_RCTOUTPUTS = 1;
+static const unsigned int CACHE_MISS_COST_TXLOOKUP = 4;
+
+/** Current size of a cache, see CCacheBalancer::GetInfo */
+struct CCacheBalancerInfo
+{
+    std::string sName;
+    size_t nSize = 0;
+    bool fBalanced = false;
+    // Balanced caches only
+    size_t nMinSize = 0;
+    uint64_t nHits = 0;         //!< At the last rebalance
+    uint64_t nMisses = 0;
+};
+
+/**
+ * Moves memory between in-memory caches within their combined budget.
+ *
+ * Every CACHE_REBALANCE_INTERVAL the misses each cache took since the last
+ * rebalance are weighted by its miss cost and smoothed. The budget above the
+ * minimum sizes is then split in proportion to those weights, each cache moving
+ * at most an eighth of the budget towards its share per rebalance.
+ *
+ * The leveldb block caches can't be resized once a db is open, they are only
+ * added to be reported.
+ */
+class CCacheBalancer
+{
+public:
+    //! Cumulative hit and miss counts of a cache
+    typedef std::function<void(uint64_t &nHits, uint64_t &nMisses)> CountsFunction;
+    typedef std::function<void(size_t nMaxSize)> ResizeFunction;
+
+    /** Add a cache that keeps its startup size */
+    void AddFixed(const std::string &sName, size_t nSize);
+
+    /** Add a cache to rebalance, nSize is its current limit, it never gets less than nMinSize */
+    void Add(const std::string &sName, size_t nSize, size_t nMinSize, unsigned int nMissCost,
+             CountsFunction counts, ResizeFunction resize);
+
+    void Rebalance();
+
+    std::vector<CCacheBalancerInfo> GetInfo() const;
+
+    void Clear();
+
+private:
+    struct Entry
+    {
+        CCacheBalancerInfo info;
+        unsigned int nMissCost = 1;
+        double dWeight = 0;     //!< Smoothed weighted misses per rebalance
+        CountsFunction counts;
+        ResizeFunction resize;
+    };
+
+    mutable CCriticalSection cs;
+    std::vector<Entry> vEntries GUARDED_BY(cs);
+};
+
+extern CCacheBalancer g_cache_balancer;
+
+#endif // BITCOINC_CACHEBALANCER_H
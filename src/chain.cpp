@@ -5,6 +5,23 @@
 
 #include <chain.h>
 
+const CBlockIndexColdData CBlockIndexColdRef::DEFAULT_DATA = CBlockIndexColdData();
+std::atomic<size_t> CBlockIndexColdRef::nResident{0};
+
+const CBlockIndexColdData &CBlockIndex::GetColdData() const
+{
+    if (!m_cold.get()) {
+        // Entries without a hash were never written
+        CBlockIndexColdData cold;
+        if (phashBlock && ReadBlockIndexColdData(this, cold)) {
+            m_cold.Set(cold);
+        } else {
+            m_cold.SetDefault();
+        }
+    }
+    return *m_cold.get();
+}
+
 /**
  * CChain implementation
  */
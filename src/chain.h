@@ -12,6 +12,8 @@
 #include <tinyformat.h>
 #include <uint256.h>
 
+#include <assert.h>
+#include <atomic>
 #include <vector>
 
 enum eBlockFlags
@@ -21,6 +23,7 @@ enum eBlockFlags
     BLOCK_DELAYED                   = (1 << 4),
     BLOCK_ACCEPTED                  = (1 << 5),
     BLOCK_STAKE_KERNEL_SPENT        = (1 << 6),
+    BLOCK_CHECKED                   = (1 << 7), // context free checks passed when accepted, not stored
 };
 
 /**
@@ -169,8 +172,86 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_OPT_WITNESS       =   128, //!< block data in blk*.data was received with a witness-enforcing client
+
+    BLOCK_HAVE_RCT_UNDO     =   256, //!< undo data in rev*.dat carries the RCT index range and key images
 };
 
+/** Proof-of-stake fields of a block index entry that are rarely needed away from the tip */
+struct CBlockIndexColdData
+{
+    COutPoint prevoutStake;
+    CAmount nMoneySupply = 0;
+};
+
+/**
+ * Owns the cold data of a block index entry. Null while it's paged out to the
+ * block tree db, entries with default data share one instance. Copies are deep.
+ */
+class CBlockIndexColdRef
+{
+public:
+    CBlockIndexColdRef() {};
+    CBlockIndexColdRef(const CBlockIndexColdRef &other) { *this = other; };
+    CBlockIndexColdRef &operator=(const CBlockIndexColdRef &other)
+    {
+        if (this != &other) {
+            if (other.IsOwned()) {
+                Set(*other.p);
+            } else {
+                Reset();
+                p = other.p;
+            }
+        }
+        return *this;
+    };
+    ~CBlockIndexColdRef() { Reset(); };
+
+    const CBlockIndexColdData *get() const { return p; };
+    bool IsOwned() const { return p && p != &DEFAULT_DATA; };
+
+    void SetDefault()
+    {
+        Reset();
+        p = &DEFAULT_DATA;
+    };
+    void Set(const CBlockIndexColdData &data)
+    {
+        if (IsOwned()) {
+            *const_cast<CBlockIndexColdData*>(p) = data;
+        } else {
+            p = new CBlockIndexColdData(data);
+            nResident++;
+        }
+    };
+    //! Unshares the default data, must not be paged out
+    CBlockIndexColdData &GetMutable()
+    {
+        assert(p);
+        if (!IsOwned())
+            Set(*p);
+        return *const_cast<CBlockIndexColdData*>(p);
+    };
+    void Reset()
+    {
+        if (IsOwned()) {
+            delete p;
+            nResident--;
+        }
+        p = nullptr;
+    };
+
+    //! Number of entries holding their own cold data in memory
+    static std::atomic<size_t> nResident;
+
+private:
+    static const CBlockIndexColdData DEFAULT_DATA;
+    const CBlockIndexColdData *p = nullptr;
+};
+
+class CBlockIndex;
+/** Read the cold data of a block index entry back from the block tree db, cs_main must be held */
+bool ReadBlockIndexColdData(const CBlockIndex *pindex, CBlockIndexColdData &cold);
+
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block. A blockindex may have multiple pprev pointing
@@ -216,9 +297,7 @@ public:
     // proof-of-stake specific fields
     unsigned int nFlags;  // pos: block index flags
     uint256 bnStakeModifier; // hash modifier for proof-of-stake
-    COutPoint prevoutStake;
     //uint256 hashProof;
-    CAmount nMoneySupply;
     int64_t nAnonOutputs; // last index
 
     //! Verification status of this block. See enum BlockStatus
@@ -256,10 +335,9 @@ public:
 
         nFlags = 0;
         bnStakeModifier = uint256();
-        prevoutStake.SetNull();
         //hashProof = uint256();
+        m_cold.Reset();
 
-        nMoneySupply = 0;
         nAnonOutputs = 0;
 
         nVersion                = 0;
@@ -278,6 +356,8 @@ public:
     explicit CBlockIndex(const CBlockHeader& block)
     {
         SetNull();
+        m_cold.SetDefault(); // New entry, nothing to page in
+
 
         nVersion                = block.nVersion;
         hashMerkleRoot          = block.hashMerkleRoot;
@@ -349,6 +429,40 @@ public:
         nFlags |= BLOCK_PROOF_OF_STAKE;
     }
 
+    const COutPoint &GetPrevoutStake() const
+    {
+        return GetColdData().prevoutStake;
+    }
+
+    void SetPrevoutStake(const COutPoint &prevout)
+    {
+        GetColdData();
+        m_cold.GetMutable().prevoutStake = prevout;
+    }
+
+    CAmount GetMoneySupply() const
+    {
+        return GetColdData().nMoneySupply;
+    }
+
+    void SetMoneySupply(CAmount nMoneySupplyIn)
+    {
+        GetColdData();
+        m_cold.GetMutable().nMoneySupply = nMoneySupplyIn;
+    }
+
+    //! Whether the entry holds its own copy of the cold data in memory
+    bool HasColdData() const
+    {
+        return m_cold.IsOwned();
+    }
+
+    //! Free the cold data, it must match what the block tree db holds for this entry
+    void PageOutColdData()
+    {
+        m_cold.Reset();
+    }
+
     static constexpr int nMedianTimeSpan = 11;
 
     int64_t GetMedianTimePast() const
@@ -402,6 +516,12 @@ public:
     //! Efficiently find an ancestor of this block.
     CBlockIndex* GetAncestor(int height);
     const CBlockIndex* GetAncestor(int height) const;
+
+private:
+    //! Stake prevout and money supply, paged in from the block tree db on first use
+    mutable CBlockIndexColdRef m_cold;
+
+    const CBlockIndexColdData &GetColdData() const;
 };
 
 arith_uint256 GetBlockProof(const CBlockIndex& block);
@@ -416,13 +536,18 @@ class CDiskBlockIndex : public CBlockIndex
 {
 public:
     uint256 hashPrev;
+    COutPoint prevoutStake;
+    CAmount nMoneySupply;
 
     CDiskBlockIndex() {
         hashPrev = uint256();
+        nMoneySupply = 0;
     }
 
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
+        prevoutStake = pindex->GetPrevoutStake();
+        nMoneySupply = pindex->GetMoneySupply();
     }
 
     ADD_SERIALIZE_METHODS;
@@ -444,7 +569,11 @@ public:
             READWRITE(VARINT(nUndoPos));
 
 
-        READWRITE(nFlags);
+        // Checks are redone after a restart
+        unsigned int nDiskFlags = nFlags & ~BLOCK_CHECKED;
+        READWRITE(nDiskFlags);
+        if (ser_action.ForRead())
+            nFlags = nDiskFlags;
         READWRITE(bnStakeModifier);
         READWRITE(prevoutStake);
         //READWRITE(hashProof);
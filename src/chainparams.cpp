@@ -41,16 +41,23 @@ int64_t CChainParams::GetCoinYearReward(int64_t nTime) const
     return nCoinYearReward;
 }
 
-int64_t CChainParams::GetProofOfStakeReward(const CBlockIndex *pindexPrev, int64_t nFees) const
+int64_t CChainParams::GetProofOfStakeSubsidy(const CBlockIndex *pindexPrev) const
 {
     int64_t nSubsidy;
 
-    nSubsidy = (pindexPrev->nMoneySupply / COIN) * GetCoinYearReward(pindexPrev->nTime) / (365 * 24 * (60 * 60 / nTargetSpacing));
+    nSubsidy = (pindexPrev->GetMoneySupply() / COIN) * GetCoinYearReward(pindexPrev->nTime) / (365 * 24 * (60 * 60 / nTargetSpacing));
 
     if( pindexPrev->nHeight < Params().GetLaunchPhaseEndHeight() ){
         nSubsidy *= Params().GetLaunchPhaseRewardRatio();
     }
 
+    return nSubsidy;
+};
+
+int64_t CChainParams::GetProofOfStakeReward(const CBlockIndex *pindexPrev, int64_t nFees) const
+{
+    int64_t nSubsidy = GetProofOfStakeSubsidy(pindexPrev);
+
     if (LogAcceptCategory(BCLog::POS) && gArgs.GetBoolArg("-printcreation", false))
         LogPrintf("GetProofOfStakeReward(): create=%s\n", FormatMoney(nSubsidy).c_str());
 
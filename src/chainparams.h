@@ -108,6 +108,8 @@ public:
     const DevFundSettings *GetDevFundSettings(int64_t nTime) const;
     const std::vector<std::pair<int64_t, DevFundSettings> > &GetDevFundSettings() const {return vDevFundSettings;};
 
+    /** Newly minted coin of the block following pindexPrev */
+    int64_t GetProofOfStakeSubsidy(const CBlockIndex *pindexPrev) const;
     int64_t GetProofOfStakeReward(const CBlockIndex *pindexPrev, int64_t nFees) const;
 
     int GetLaunchPhaseEndHeight() const { return nLaunchPhaseEndHeight; }
@@ -135,6 +137,8 @@ public:
     const std::string& Bech32HRP() const { return bech32_hrp; }
     const std::vector<SeedSpec6>& FixedSeeds() const { return vFixedSeeds; }
     const CCheckpointData& Checkpoints() const { return checkpointData; }
+    /** Hashes of UTXO snapshots written by dumptxoutset that are trusted, by base block height */
+    const std::map<int, uint256>& TxOutSetSnapshotHashes() const { return mapTxOutSetSnapshotHashes; }
     const ChainTxData& TxData() const { return chainTxData; }
 
     bool IsBech32Prefix(const std::vector<unsigned char> &vchPrefixIn) const;
@@ -194,6 +198,7 @@ protected:
     bool fRequireStandard;
     bool fMineBlocksOnDemand;
     CCheckpointData checkpointData;
+    std::map<int, uint256> mapTxOutSetSnapshotHashes;
     ChainTxData chainTxData;
     bool m_fallback_fee_enabled;
 };
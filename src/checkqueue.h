@@ -8,6 +8,10 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <stdint.h>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -16,6 +20,17 @@
 template <typename T>
 class CCheckQueueControl;
 
+/**
+ * Relative cost of running a check, in units of about one signature check.
+ * Used to size the batches workers take, check types whose cost varies
+ * widely overload this next to their definition.
+ */
+template <typename T>
+inline unsigned int GetCheckCost(const T& check)
+{
+    return 1;
+}
+
 /**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -25,12 +40,37 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Each worker has its own deque of checks. Add spreads the checks over the
+  * workers' deques by cost, a worker takes batches from the back of its own
+  * deque and when that is empty steals from the front of another's. The
+  * deques have their own locks, the shared mutex is only taken to sleep or
+  * wake workers and the master.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! Most workers (including the master) with a deque, later ones only steal
+    static const size_t MAX_WORKER_QUEUES = 128;
+    static const size_t NO_QUEUE = MAX_WORKER_QUEUES;
+
+    struct Item
+    {
+        T check;
+        unsigned int nCost;
+    };
+
+    //! Checks waiting for one worker, the owner takes from the back and thieves from the front
+    struct WorkerQueue
+    {
+        boost::mutex mutex;
+        std::deque<Item> items;
+        //! Cost of the items, read without the lock to choose a victim
+        std::atomic<int64_t> nCost{0};
+    };
+
+    //! Mutex to protect sleeping and waking the workers and master
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,87 +79,143 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The deque of each worker, the master's is at 0. Entries below nQueues are never reset.
+    std::unique_ptr<WorkerQueue> vQueues[MAX_WORKER_QUEUES];
+    std::atomic<size_t> nQueues;
+
+    //! Deque the next Add starts at, only used by the master
+    size_t nNextQueue;
+
+    //! Number and cost of the checks in the deques
+    std::atomic<int64_t> nQueued;
+    std::atomic<int64_t> nQueuedCost;
 
     //! The number of workers (including the master) that are idle.
-    int nIdle;
+    std::atomic<int> nIdle;
 
     //! The total number of workers (including the master).
-    int nTotal;
+    std::atomic<int> nTotal;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
 
-    //! The maximum number of elements to be processed in one batch
+    //! The maximum cost of the checks processed in one batch
     unsigned int nBatchSize;
 
+    //! Give a new worker its own deque
+    size_t RegisterWorker()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        size_t n = nQueues;
+        if (n == MAX_WORKER_QUEUES)
+            return NO_QUEUE;
+        vQueues[n].reset(new WorkerQueue);
+        nQueues = n + 1;
+        return n;
+    }
+
+    //! Move checks worth up to nTarget, and at least one, from the deque to vChecks
+    size_t TakeFrom(WorkerQueue& q, bool fBack, int64_t nTarget, std::vector<T>& vChecks)
+    {
+        boost::unique_lock<boost::mutex> lock(q.mutex);
+        int64_t nCost = 0;
+        while (!q.items.empty() && (nCost == 0 || nCost < nTarget)) {
+            Item& item = fBack ? q.items.back() : q.items.front();
+            nCost += item.nCost;
+            // Swap jobs out of the deque instead of copying
+            vChecks.emplace_back();
+            vChecks.back().swap(item.check);
+            if (fBack)
+                q.items.pop_back();
+            else
+                q.items.pop_front();
+        }
+        q.nCost -= nCost;
+        return nCost;
+    }
+
+    /**
+     * Take a batch of checks from the own deque, or steal one from another worker.
+     * Returns false if there were none.
+     */
+    bool TakeBatch(size_t nQueue, std::vector<T>& vChecks)
+    {
+        // Decide how much work to process now.
+        // * Do not try to do everything at once, but aim for increasingly smaller batches so
+        //   all workers finish approximately simultaneously.
+        // * Try to account for idle jobs which will instantly start helping.
+        // * Don't do batches cheaper than one check, or more costly than nBatchSize.
+        int64_t nTarget = std::max((int64_t)1, std::min((int64_t)nBatchSize, nQueuedCost / (nTotal + nIdle + 1)));
+
+        int64_t nCost = 0;
+        if (nQueue != NO_QUEUE && vQueues[nQueue]->nCost > 0)
+            nCost = TakeFrom(*vQueues[nQueue], true, nTarget, vChecks);
+
+        // Steal at most half the work of the victim, leaving it the checks it will reach soonest
+        size_t n = nQueues;
+        for (size_t k = 1; vChecks.empty() && k <= n; ++k) {
+            WorkerQueue& q = *vQueues[((nQueue == NO_QUEUE ? 0 : nQueue) + k) % n];
+            int64_t nVictimCost = q.nCost;
+            if (nVictimCost > 0)
+                nCost = TakeFrom(q, false, std::min(nTarget, (nVictimCost + 1) / 2), vChecks);
+        }
+
+        nQueued -= vChecks.size();
+        nQueuedCost -= nCost;
+        return !vChecks.empty();
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
         boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        size_t nQueue = fMaster ? 0 : RegisterWorker();
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
+        nTotal++;
         do {
-            {
+            if (!TakeBatch(nQueue, vChecks)) {
                 boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                // Checks added since the deques were looked at are counted before they are pushed
+                if (nQueued > 0)
+                    continue;
+                if (fMaster && nTodo == 0) {
+                    nTotal--;
+                    bool fRet = fAllOk;
+                    // reset the status for new work later
+                    fAllOk = true;
+                    // return the current status
+                    return fRet;
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                nIdle++;
+                cond.wait(lock); // wait
+                nIdle--;
+                continue;
             }
+
+            // Check whether we need to do work at all
+            bool fOk = fAllOk;
             // execute work
             for (T& check : vChecks)
                 if (fOk)
                     fOk = check();
+            unsigned int nNow = vChecks.size();
+            // Checks are destroyed before they are counted as done
             vChecks.clear();
+            if (!fOk)
+                fAllOk = false;
+            if ((nTodo -= nNow) == 0 && !fMaster) {
+                // We processed the last element; inform the master it can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
         } while (true);
     }
 
@@ -128,7 +224,11 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : nQueues(1), nNextQueue(0), nQueued(0), nQueuedCost(0),
+        nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn)
+    {
+        vQueues[0].reset(new WorkerQueue);
+    }
 
     //! Worker thread
     void Thread()
@@ -145,15 +245,41 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
+
+        std::vector<unsigned int> vCosts(vChecks.size());
+        int64_t nCost = 0;
+        for (size_t i = 0; i < vChecks.size(); i++)
+            nCost += (vCosts[i] = std::max(1U, GetCheckCost(vChecks[i])));
+
         nTodo += vChecks.size();
+        nQueued += vChecks.size();
+        nQueuedCost += nCost;
+
+        // Give each worker an even share of the cost, the master's deque is only used without workers
+        size_t n = nQueues;
+        size_t nWorkers = n > 1 ? n - 1 : 1;
+        int64_t nShare = (nCost + nWorkers - 1) / nWorkers;
+        size_t i = 0;
+        while (i < vChecks.size()) {
+            nNextQueue = n > 1 ? 1 + nNextQueue % (n - 1) : 0;
+            WorkerQueue& q = *vQueues[nNextQueue];
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            int64_t nQueueCost = 0;
+            while (i < vChecks.size() && (nQueueCost == 0 || nQueueCost < nShare)) {
+                q.items.emplace_back();
+                q.items.back().check.swap(vChecks[i]);
+                q.items.back().nCost = vCosts[i];
+                nQueueCost += vCosts[i++];
+            }
+            q.nCost += nQueueCost;
+        }
+
+        boost::unique_lock<boost::mutex> lock(mutex);
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -40,8 +40,11 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
 
 CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        nCacheHits++;
         return it;
+    }
+    nCacheMisses++;
     Coin tmp;
     if (!base->GetCoin(outpoint, tmp))
         return cacheCoins.end();
@@ -95,18 +98,12 @@ void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, bool
         for (size_t i = 0; i < tx.vpout.size(); ++i)
         {
             const CTxOutBase *out = tx.vpout[i].get();
-            bool overwrite = check ? cache.HaveCoin(COutPoint(txid, i)) : fCoinbase;
-            Coin coin;
-            if (out->IsType(OUTPUT_STANDARD))
-            {
-                CTxOut txout(out->GetValue(), *out->GetPScriptPubKey());
-                coin = Coin(txout, nHeight, fCoinbase);
-            } else
-            {
+            if (!out->IsType(OUTPUT_STANDARD))
                 continue; // Data or anon
-            };
 
-            cache.AddCoin(COutPoint(txid, i), std::move(coin), overwrite);
+            bool overwrite = check ? cache.HaveCoin(COutPoint(txid, i)) : fCoinbase;
+            CTxOut txout(out->GetValue(), *out->GetPScriptPubKey());
+            cache.AddCoin(COutPoint(txid, i), Coin(txout, nHeight, fCoinbase), overwrite);
         };
         return;
     };
@@ -24,12 +24,20 @@
 
 extern bool fBitcoinCMode;
 
+class CBlockIndex;
+
 /**
  * A UTXO entry.
  *
+ * Only OUTPUT_STANDARD outputs enter the UTXO set (see AddCoins), RingCT outputs are spent
+ * through the anon index, so a coin carries no value commitment. nType is kept for the
+ * serialized format and to reject spends of other types.
+ *
  * Serialized format:
  * - VARINT((coinbase ? 1 : 0) | (height << 1))
- * - the non-spent CTxOut (via CTxOutCompressor)
+ * - the non-spent CTxOut (via CTxOutCompressor, with the extended script
+ *   compression in the coins db)
+ * - nType, in BitcoinC mode
  */
 class Coin
 {
@@ -44,7 +52,6 @@ public:
     uint32_t nHeight : 31;
 
     uint8_t nType = OUTPUT_STANDARD;
-    secp256k1_pedersen_commitment commitment;
 
     //! construct a Coin from a CTxOut and height/coinbase information.
     Coin(CTxOut&& outIn, int nHeightIn, bool fCoinBaseIn) : out(std::move(outIn)), fCoinBase(fCoinBaseIn), nHeight(nHeightIn) {}
@@ -80,21 +87,31 @@ public:
 
     template<typename Stream>
     void Serialize(Stream &s) const {
+        Serialize(s, false);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        Unserialize(s, false);
+    }
+
+    template<typename Stream>
+    void Serialize(Stream &s, bool fExtendedScripts) const {
         assert(!IsSpent());
         uint32_t code = nHeight * 2 + fCoinBase;
         ::Serialize(s, VARINT(code));
-        ::Serialize(s, CTxOutCompressor(REF(out)));
+        ::Serialize(s, CTxOutCompressor(REF(out), fExtendedScripts));
         if (!fBitcoinCMode) return;
         ::Serialize(s, nType);
     }
 
     template<typename Stream>
-    void Unserialize(Stream &s) {
+    void Unserialize(Stream &s, bool fExtendedScripts) {
         uint32_t code = 0;
         ::Unserialize(s, VARINT(code));
         nHeight = code >> 1;
         fCoinBase = code & 1;
-        ::Unserialize(s, CTxOutCompressor(out));
+        ::Unserialize(s, CTxOutCompressor(out, fExtendedScripts));
         if (!fBitcoinCMode) return;
         ::Unserialize(s, nType);
     }
@@ -241,9 +258,15 @@ public:
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Lookups found in the cache and ones read from the base view */
+    mutable uint64_t nCacheHits = 0;
+    mutable uint64_t nCacheMisses = 0;
+
     mutable std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
     mutable std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
     mutable std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    //! Block to add to the timestamp index when the view is flushed
+    mutable const CBlockIndex *pindexTimestamp = nullptr;
 
     mutable bool fForceDisconnect = false; // disconnect even if rct mismatch
     mutable int64_t nLastRCTOutput = 0;
@@ -331,6 +354,9 @@ public:
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
+    //! Lookups found in the cache and ones read from the base view since it was created
+    void GetCacheCounts(uint64_t &nHits, uint64_t &nMisses) const { nHits = nCacheHits; nMisses = nCacheMisses; }
+
     /**
      * Amount of bitcoins coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
@@ -55,9 +55,17 @@
 #include <ifaddrs.h>
 #include <limits.h>
 #include <netdb.h>
+#include <poll.h>
 #include <unistd.h>
 #endif
 
+// Readiness backend of the socket handler, others fall back to select()
+#if defined(__linux__)
+#define USE_EPOLL
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
+#define USE_KQUEUE
+#endif
+
 #ifndef WIN32
 typedef unsigned int SOCKET;
 #include <errno.h>
@@ -103,7 +111,7 @@ typedef char* sockopt_arg_type;
 #endif
 
 bool static inline IsSelectableSocket(const SOCKET& s) {
-#ifdef WIN32
+#if defined(WIN32) || defined(USE_EPOLL) || defined(USE_KQUEUE)
     return true;
 #else
     return (s < FD_SETSIZE);
@@ -53,7 +53,54 @@ static bool IsToPubKey(const CScript& script, CPubKey &pubkey)
     return false;
 }
 
-bool CompressScript(const CScript& script, std::vector<unsigned char> &out)
+/*
+ * OP_ISCOINSTAKE OP_IF <P2PKH> OP_ELSE <spend script> OP_ENDIF, returns the
+ * special script code of the spend script and the offset of its hash.
+ */
+static bool IsColdStake(const CScript& script, unsigned int &nSpendCode, size_t &nSpendHashOfs)
+{
+    if (script.size() < 25 + 23 + 4
+        || script[0] != OP_ISCOINSTAKE
+        || script[1] != OP_IF
+        || !script.MatchPayToPublicKeyHash(2)
+        || script[27] != OP_ELSE
+        || script[script.size() - 1] != OP_ENDIF) {
+        return false;
+    }
+    size_t nSpendSize = script.size() - 29;
+    if (nSpendSize == 25 && script.MatchPayToPublicKeyHash(28)) {
+        nSpendCode = 0x00;
+        nSpendHashOfs = 31;
+    } else
+    if (nSpendSize == 23 && script.MatchPayToScriptHash(28)) {
+        nSpendCode = 0x01;
+        nSpendHashOfs = 30;
+    } else
+    if (nSpendSize == 37 && script.MatchPayToPublicKeyHash256(28)) {
+        nSpendCode = 0x06;
+        nSpendHashOfs = 31;
+    } else
+    if (nSpendSize == 35 && script.MatchPayToScriptHash256(28)) {
+        nSpendCode = 0x07;
+        nSpendHashOfs = 30;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+//! Cold stake codes in spend script order: P2PKH, P2SH, P2PKH256, P2SH256
+static unsigned int ColdStakeCode(unsigned int nSpendCode)
+{
+    return nSpendCode < 2 ? 0x08 + nSpendCode : 0x0a + nSpendCode - 6;
+}
+
+static unsigned int ColdStakeSpendCode(unsigned int nCode)
+{
+    return nCode < 0x0a ? nCode - 0x08 : nCode - 0x0a + 6;
+}
+
+bool CompressScript(const CScript& script, std::vector<unsigned char> &out, bool fExtended)
 {
     CKeyID keyID;
     if (IsToKeyID(script, keyID)) {
@@ -81,15 +128,92 @@ bool CompressScript(const CScript& script, std::vector<unsigned char> &out)
             return true;
         }
     }
+    if (!fExtended) {
+        return false;
+    }
+    if (script.IsPayToPublicKeyHash256()) {
+        out.resize(33);
+        out[0] = 0x06;
+        memcpy(&out[1], &script[3], 32);
+        return true;
+    }
+    if (script.IsPayToScriptHash256()) {
+        out.resize(33);
+        out[0] = 0x07;
+        memcpy(&out[1], &script[2], 32);
+        return true;
+    }
+    unsigned int nSpendCode;
+    size_t nSpendHashOfs;
+    if (IsColdStake(script, nSpendCode, nSpendHashOfs)) {
+        unsigned int nSpendHashLen = GetSpecialScriptSize(nSpendCode);
+        out.resize(1 + 20 + nSpendHashLen);
+        out[0] = ColdStakeCode(nSpendCode);
+        memcpy(&out[1], &script[5], 20);
+        memcpy(&out[21], &script[nSpendHashOfs], nSpendHashLen);
+        return true;
+    }
     return false;
 }
 
+bool CompressScriptTimeLock(const CScript& script, unsigned int &nCode, uint64_t &nLock, CScript &tail)
+{
+    CScript::const_iterator pc = script.begin();
+    opcodetype opcode, opcodeLock, opcodeDrop;
+    std::vector<unsigned char> vch;
+    if (!script.GetOp(pc, opcode, vch)
+        || !script.GetOp(pc, opcodeLock)
+        || (opcodeLock != OP_CHECKLOCKTIMEVERIFY && opcodeLock != OP_CHECKSEQUENCEVERIFY)
+        || !script.GetOp(pc, opcodeDrop)
+        || opcodeDrop != OP_DROP) {
+        return false;
+    }
+
+    int64_t n;
+    if (opcode == OP_0 || (opcode >= OP_1 && opcode <= OP_16)) {
+        n = CScript::DecodeOP_N(opcode);
+    } else
+    if (opcode >= 1 && opcode <= 5) {
+        n = CScriptNum(vch, false, 5).getint64();
+    } else {
+        return false;
+    }
+    if (n < 0) {
+        return false;
+    }
+
+    // Only a lock pushed the way DecompressScriptTimeLock pushes it is reproduced exactly
+    nCode = opcodeLock == OP_CHECKLOCKTIMEVERIFY ? SCRIPT_COMPRESS_CLTV : SCRIPT_COMPRESS_CSV;
+    nLock = n;
+    CScript prefix;
+    DecompressScriptTimeLock(prefix, nCode, nLock, CScript());
+    if (prefix.size() != (size_t)(pc - script.begin())
+        || !std::equal(prefix.begin(), prefix.end(), script.begin())) {
+        return false;
+    }
+    tail = CScript(pc, script.end());
+    return true;
+}
+
+void DecompressScriptTimeLock(CScript& script, unsigned int nCode, uint64_t nLock, const CScript &tail)
+{
+    script.clear();
+    script << (int64_t)nLock << (nCode == SCRIPT_COMPRESS_CLTV ? OP_CHECKLOCKTIMEVERIFY : OP_CHECKSEQUENCEVERIFY) << OP_DROP;
+    script.insert(script.end(), tail.begin(), tail.end());
+}
+
 unsigned int GetSpecialScriptSize(unsigned int nSize)
 {
     if (nSize == 0 || nSize == 1)
         return 20;
     if (nSize == 2 || nSize == 3 || nSize == 4 || nSize == 5)
         return 32;
+    if (nSize == 6 || nSize == 7)
+        return 32;
+    if (nSize == 8 || nSize == 9)
+        return 20 + 20;
+    if (nSize == 10 || nSize == 11)
+        return 20 + 32;
     return 0;
 }
 
@@ -135,6 +259,42 @@ bool DecompressScript(CScript& script, unsigned int nSize, const std::vector<uns
         script[66] = OP_CHECKSIG;
         return true;
     }
+    switch(nSize) {
+    case 0x06:
+        script.resize(37);
+        script[0] = OP_DUP;
+        script[1] = OP_SHA256;
+        script[2] = 32;
+        memcpy(&script[3], in.data(), 32);
+        script[35] = OP_EQUALVERIFY;
+        script[36] = OP_CHECKSIG;
+        return true;
+    case 0x07:
+        script.resize(35);
+        script[0] = OP_SHA256;
+        script[1] = 32;
+        memcpy(&script[2], in.data(), 32);
+        script[34] = OP_EQUAL;
+        return true;
+    case 0x08:
+    case 0x09:
+    case 0x0a:
+    case 0x0b: {
+        CScript stake, spend;
+        unsigned int nSpendCode = ColdStakeSpendCode(nSize);
+        if (!DecompressScript(stake, 0x00, std::vector<unsigned char>(in.begin(), in.begin() + 20))
+            || !DecompressScript(spend, nSpendCode, std::vector<unsigned char>(in.begin() + 20, in.end()))) {
+            return false;
+        }
+        script.clear();
+        script << OP_ISCOINSTAKE << OP_IF;
+        script.insert(script.end(), stake.begin(), stake.end());
+        script << OP_ELSE;
+        script.insert(script.end(), spend.begin(), spend.end());
+        script << OP_ENDIF;
+        return true;
+    }
+    }
     return false;
 }
 
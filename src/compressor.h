@@ -16,10 +16,18 @@ class CKeyID;
 class CPubKey;
 class CScriptID;
 
-bool CompressScript(const CScript& script, std::vector<unsigned char> &out);
+bool CompressScript(const CScript& script, std::vector<unsigned char> &out, bool fExtended = false);
 unsigned int GetSpecialScriptSize(unsigned int nSize);
 bool DecompressScript(CScript& script, unsigned int nSize, const std::vector<unsigned char> &out);
 
+//! Special scripts of the extended compression, nSize codes 0x0c and 0x0d
+static const unsigned int SCRIPT_COMPRESS_CLTV = 0x0c;
+static const unsigned int SCRIPT_COMPRESS_CSV = 0x0d;
+
+/** Split a timelocked script into its lock and the locked script, false if the lock push can't be reproduced from nLock */
+bool CompressScriptTimeLock(const CScript& script, unsigned int &nCode, uint64_t &nLock, CScript &tail);
+void DecompressScriptTimeLock(CScript& script, unsigned int nCode, uint64_t nLock, const CScript &tail);
+
 uint64_t CompressAmount(uint64_t nAmount);
 uint64_t DecompressAmount(uint64_t nAmount);
 
@@ -33,6 +41,15 @@ uint64_t DecompressAmount(uint64_t nAmount);
  *
  *  Other scripts up to 121 bytes require 1 byte + script length. Above
  *  that, scripts up to 16505 bytes require 2 bytes + script length.
+ *
+ *  The extended compression of the chainstate (see CCoinsViewDB) adds the
+ *  script templates of this chain, other scripts up to 111 bytes then take
+ *  1 byte + script length:
+ *  * Pay to pubkey hash 256 and script hash 256 (encoded as 33 bytes)
+ *  * Cold stake scripts, staking to a pubkey hash and spending to a pubkey hash,
+ *    pubkey hash 256, script hash or script hash 256 (encoded as 41 or 53 bytes)
+ *  * Any of the above locked by OP_CHECKLOCKTIMEVERIFY or OP_CHECKSEQUENCEVERIFY
+ *    (encoded as 1 byte + VARINT(lock) + the compressed locked script)
  */
 class CScriptCompressor
 {
@@ -44,19 +61,33 @@ private:
      * and nHeight of the enclosing transaction.
      */
     static const unsigned int nSpecialScripts = 6;
+    //! Codes 0x0e and 0x0f are reserved
+    static const unsigned int nSpecialScriptsExt = 16;
 
     CScript &script;
+    bool fExtended;
+    bool fTimeLocks; //!< Unset for the locked script of a timelocked one, locks don't nest
 public:
-    explicit CScriptCompressor(CScript &scriptIn) : script(scriptIn) { }
+    explicit CScriptCompressor(CScript &scriptIn, bool fExtendedIn = false, bool fTimeLocksIn = true)
+        : script(scriptIn), fExtended(fExtendedIn), fTimeLocks(fTimeLocksIn) { }
 
     template<typename Stream>
     void Serialize(Stream &s) const {
         std::vector<unsigned char> compr;
-        if (CompressScript(script, compr)) {
+        if (CompressScript(script, compr, fExtended)) {
             s << MakeSpan(compr);
             return;
         }
-        unsigned int nSize = script.size() + nSpecialScripts;
+        unsigned int nCode;
+        uint64_t nLock;
+        CScript tail;
+        if (fExtended && fTimeLocks && CompressScriptTimeLock(script, nCode, nLock, tail)) {
+            s << VARINT(nCode);
+            s << VARINT(nLock);
+            s << CScriptCompressor(tail, true, false);
+            return;
+        }
+        unsigned int nSize = script.size() + (fExtended ? nSpecialScriptsExt : nSpecialScripts);
         s << VARINT(nSize);
         s << MakeSpan(script);
     }
@@ -65,13 +96,29 @@ public:
     void Unserialize(Stream &s) {
         unsigned int nSize = 0;
         s >> VARINT(nSize);
-        if (nSize < nSpecialScripts) {
-            std::vector<unsigned char> vch(GetSpecialScriptSize(nSize), 0x00);
+        if (nSize < (fExtended ? nSpecialScriptsExt : nSpecialScripts)) {
+            if (nSize == SCRIPT_COMPRESS_CLTV || nSize == SCRIPT_COMPRESS_CSV) {
+                if (!fTimeLocks) {
+                    throw std::ios_base::failure("Nested script timelock");
+                }
+                uint64_t nLock = 0;
+                s >> VARINT(nLock);
+                CScript tail;
+                CScriptCompressor ctail(tail, true, false);
+                s >> ctail;
+                DecompressScriptTimeLock(script, nSize, nLock, tail);
+                return;
+            }
+            unsigned int nSpecialSize = GetSpecialScriptSize(nSize);
+            if (nSpecialSize == 0) {
+                throw std::ios_base::failure("Unknown special script");
+            }
+            std::vector<unsigned char> vch(nSpecialSize, 0x00);
             s >> MakeSpan(vch);
             DecompressScript(script, nSize, vch);
             return;
         }
-        nSize -= nSpecialScripts;
+        nSize -= fExtended ? nSpecialScriptsExt : nSpecialScripts;
         if (nSize > MAX_SCRIPT_SIZE) {
             // Overly long script, replace with a short invalid one
             script << OP_RETURN;
@@ -89,9 +136,10 @@ class CTxOutCompressor
 {
 private:
     CTxOut &txout;
+    bool fExtended;
 
 public:
-    explicit CTxOutCompressor(CTxOut &txoutIn) : txout(txoutIn) { }
+    explicit CTxOutCompressor(CTxOut &txoutIn, bool fExtendedIn = false) : txout(txoutIn), fExtended(fExtendedIn) { }
 
     ADD_SERIALIZE_METHODS;
 
@@ -105,7 +153,7 @@ public:
             READWRITE(VARINT(nVal));
             txout.nValue = DecompressAmount(nVal);
         }
-        CScriptCompressor cscript(REF(txout.scriptPubKey));
+        CScriptCompressor cscript(REF(txout.scriptPubKey), fExtended);
         READWRITE(cscript);
     }
 };
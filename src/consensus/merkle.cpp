@@ -62,6 +62,33 @@ uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated) {
     return hashes[0];
 }
 
+std::vector<uint256> ComputeMerkleBranch(std::vector<uint256> hashes, uint32_t position) {
+    std::vector<uint256> branch;
+    while (hashes.size() > 1) {
+        if (hashes.size() & 1) {
+            hashes.push_back(hashes.back());
+        }
+        branch.push_back(hashes[position ^ 1]);
+        SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+        hashes.resize(hashes.size() / 2);
+        position >>= 1;
+    }
+    return branch;
+}
+
+uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint256>& branch, uint32_t position) {
+    uint256 hash = leaf;
+    for (const uint256& sibling : branch) {
+        if (position & 1) {
+            hash = Hash(sibling.begin(), sibling.end(), hash.begin(), hash.end());
+        } else {
+            hash = Hash(hash.begin(), hash.end(), sibling.begin(), sibling.end());
+        }
+        position >>= 1;
+    }
+    return hash;
+}
+
 
 uint256 BlockMerkleRoot(const CBlock& block, bool* mutated)
 {
@@ -78,11 +105,14 @@ uint256 BlockWitnessMerkleRoot(const CBlock& block, bool* mutated)
     std::vector<uint256> leaves;
     leaves.resize(block.vtx.size());
 
+    // Leaves are the wtxids cached when each txn was deserialized or constructed,
+    // so large CT txns aren't reserialized here. The leaves are moved into
+    // ComputeMerkleRoot, which hashes the tree in place with SHA256D64.
     if (block.nVersion == BITCOINC_BLOCK_VERSION)
     {
         for (size_t s = 0; s < block.vtx.size(); s++)
             leaves[s] = block.vtx[s]->GetWitnessHash();
-        return ComputeMerkleRoot(leaves, mutated);
+        return ComputeMerkleRoot(std::move(leaves), mutated);
     };
 
     leaves[0].SetNull(); // The witness hash of the coinbase is 0.
@@ -14,6 +14,17 @@
 
 uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated = nullptr);
 
+/*
+ * Compute the hashes needed to recompute the root when the leaf at position changes.
+ * The leaf at position 0 never contributes, so it may be a placeholder.
+ */
+std::vector<uint256> ComputeMerkleBranch(std::vector<uint256> hashes, uint32_t position);
+
+/*
+ * Compute the Merkle root from a leaf and the branch returned by ComputeMerkleBranch.
+ */
+uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint256>& branch, uint32_t position);
+
 /*
  * Compute the Merkle root of the transactions in a block.
  * *mutated is set to true if a duplicated subtree was found.
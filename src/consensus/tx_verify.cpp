@@ -25,6 +25,8 @@
 
 #include <policy/policy.h>
 #include <smsg/smessage.h>
+#include <perfstats.h>
+#include <pos/reward.h>
 
 
 extern bool fBusyImporting;
@@ -200,7 +202,15 @@ bool CheckValue(CValidationState &state, CAmount nValue, CAmount &nValueOut)
     return true;
 }
 
-bool CheckStandardOutput(CValidationState &state, const Consensus::Params& consensusParams, int nTime, const CTransaction &tx, const CTxOutStandard *p, CAmount &nValueOut)
+/** Serialize the prevouts of tx on first use, they are shared by the signature hashes of all its outputs */
+static const std::vector<uint8_t> &GetPrevouts(const CTransaction &tx, std::vector<uint8_t> &vPrevouts)
+{
+    if (vPrevouts.empty())
+        vPrevouts = SerializeSignatureHashPrevouts(tx.vin);
+    return vPrevouts;
+}
+
+bool CheckStandardOutput(CValidationState &state, const Consensus::Params& consensusParams, int nTime, const CTransaction &tx, const CTxOutStandard *p, CAmount &nValueOut, std::vector<uint8_t> &vPrevouts)
 {
     if (!CheckValue(state, p->nValue, nValueOut))
         return false;
@@ -243,19 +253,16 @@ bool CheckStandardOutput(CValidationState &state, const Consensus::Params& conse
                 return state.DoS(100, false, REJECT_INVALID, "bad-staking-out-script-coinstake-dest2");
             }
 
-            nSigHash1 = SignatureHashStakingOutput(keyId1, p->nValue, tx.vin);
-            nSigHash2 = SignatureHashStakingOutput(keyId2, p->nValue, tx.vin);
+            nSigHash1 = SignatureHashStakingOutput(keyId1, p->nValue, GetPrevouts(tx, vPrevouts));
+            nSigHash2 = SignatureHashStakingOutput(keyId2, p->nValue, GetPrevouts(tx, vPrevouts));
 
         }else if(ExtractStakingKeyID(*p->GetPScriptPubKey(), keyId1)){
 
-            const DevFundSettings *pDevFundSettings = Params().GetDevFundSettings(nTime);
-            CKeyID keyIdDev;
-            if(CBitcoinAddress(pDevFundSettings->sDevFundAddresses).GetKeyID(keyIdDev) &&
-               keyId1 == keyIdDev){
-                return true;;
+            if(g_stake_reward_cache.IsDevFundKey(nTime, keyId1)){
+                return true;
             }
 
-            nSigHash1 = SignatureHashStakingOutput(keyId1, p->nValue, tx.vin);
+            nSigHash1 = SignatureHashStakingOutput(keyId1, p->nValue, GetPrevouts(tx, vPrevouts));
         }else{
             return state.DoS(100, false, REJECT_INVALID, "bad-staking-out-script-dest");
         }
@@ -275,7 +282,7 @@ bool CheckStandardOutput(CValidationState &state, const Consensus::Params& conse
     return true;
 }
 
-bool CheckAnonOutput(CValidationState &state, const CTxOutRingCT *p, const CTransaction &tx, bool fIsConvertOutput)
+bool CheckAnonOutput(CValidationState &state, const CTxOutRingCT *p, const CTransaction &tx, bool fIsConvertOutput, CBulletproofBatch *pBatch, std::vector<uint8_t> &vPrevouts)
 {
     if (p->vData.size() < 33 || p->vData.size() > 33 + 5)
         return state.DoS(100, false, REJECT_INVALID, "bad-rctout-ephem-size");
@@ -292,22 +299,28 @@ bool CheckAnonOutput(CValidationState &state, const CTxOutRingCT *p, const CTran
     int rv = 0;
 
     if (state.fBulletproofsActive) {
-        rv = secp256k1_bulletproof_rangeproof_verify(secp256k1_ctx_blind,
-            blind_scratch, blind_gens, p->vRangeproof.data(), p->vRangeproof.size(),
-            nullptr, &p->commitment, 1, 64, &secp256k1_generator_const_h, nullptr, 0);
+        // Bulletproofs are only ever checked through verify_multi
+        CBulletproofBatch batchOut(true);
+        (pBatch ? pBatch : &batchOut)->Add(tx.GetHash(), p->vRangeproof, p->commitment);
+
+        uint256 txidFailed;
+        if (batchOut.Size() > 0 && !batchOut.Verify(txidFailed))
+            return state.DoS(100, false, REJECT_INVALID, "bad-rctout-rangeproof-verify");
     } else {
+        CPerfTimer timer(PERF_HISTOGRAM("verify:rangeproof"));
+        PERF_COUNTER("verify:rangeproofs")++;
         rv = secp256k1_rangeproof_verify(secp256k1_ctx_blind, &min_value, &max_value,
             &p->commitment, p->vRangeproof.data(), p->vRangeproof.size(),
             nullptr, 0,
             secp256k1_generator_h);
-    }
 
-    if (LogAcceptCategory(BCLog::RINGCT)) {
-        LogPrintf("%s: rv, min_value, max_value %d, %s, %s\n", __func__,
-            rv, FormatMoney((CAmount)min_value), FormatMoney((CAmount)max_value));
+        if (LogAcceptCategory(BCLog::RINGCT)) {
+            LogPrintf("%s: rv, min_value, max_value %d, %s, %s\n", __func__,
+                rv, FormatMoney((CAmount)min_value), FormatMoney((CAmount)max_value));
+        }
+        if (rv != 1)
+            return state.DoS(100, false, REJECT_INVALID, "bad-rctout-rangeproof-verify");
     }
-    if (rv != 1)
-        return state.DoS(100, false, REJECT_INVALID, "bad-rctout-rangeproof-verify");
 
     // Check for max signature size and only allow signature data size if its an actual
     // conversion transaction
@@ -323,7 +336,7 @@ bool CheckAnonOutput(CValidationState &state, const CTxOutRingCT *p, const CTran
             return state.DoS(100, false, REJECT_INVALID, "bad-spending-out-signature-missing");
         }
 
-        uint256 nSigHash = SignatureHashSpendingOutput(p->pk.GetID(), p->vRangeproof, tx.vin);
+        uint256 nSigHash = SignatureHashSpendingOutput(p->pk.GetID(), p->vRangeproof, GetPrevouts(tx, vPrevouts));
         CPubKey pubKey;
 
         if ( !pubKey.RecoverCompact(nSigHash, p->vecSignature) ) {
@@ -350,7 +363,7 @@ bool CheckDataOutput(CValidationState &state, const CTxOutData *p)
     return true;
 }
 
-bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fCheckDuplicateInputs)
+bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fCheckDuplicateInputs, CBulletproofBatch *pBatch)
 {
     // Basic checks that don't depend on any context
     if (tx.vin.empty())
@@ -383,21 +396,27 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fChe
             }
         }
 
+        // Verify the bulletproofs of this transaction together if the caller isn't collecting them
+        CBulletproofBatch batchTx(true);
+        if (!pBatch)
+            pBatch = &batchTx;
+
         size_t nStandardOutputs = 0;
         CAmount nValueOut = 0;
         size_t nDataOutputs = 0;
         int nTime = GetAdjustedTime();
+        std::vector<uint8_t> vPrevouts;
         for (const auto &txout : tx.vpout)
         {
             switch (txout->nVersion)
             {
                 case OUTPUT_STANDARD:
-                    if (!CheckStandardOutput(state, consensusParams, nTime, tx, (CTxOutStandard*) txout.get(), nValueOut))
+                    if (!CheckStandardOutput(state, consensusParams, nTime, tx, (CTxOutStandard*) txout.get(), nValueOut, vPrevouts))
                         return false;
                     nStandardOutputs++;
                     break;
                 case OUTPUT_RINGCT:
-                    if (!CheckAnonOutput(state, (CTxOutRingCT*) txout.get(), tx, fHasStandardInput || fHasStandardOutput))
+                    if (!CheckAnonOutput(state, (CTxOutRingCT*) txout.get(), tx, fHasStandardInput || fHasStandardOutput, pBatch, vPrevouts))
                         return false;
                     break;
                 case OUTPUT_DATA:
@@ -415,6 +434,10 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fChe
 
         if (nDataOutputs > 1 + nStandardOutputs) // extra 1 for ct fee output
             return state.DoS(100, false, REJECT_INVALID, "too-many-data-outputs");
+
+        uint256 txidFailed;
+        if (batchTx.Size() > 0 && !batchTx.Verify(txidFailed))
+            return state.DoS(100, false, REJECT_INVALID, "bad-rctout-rangeproof-verify");
     } else
     {
         if (fBitcoinCMode)
@@ -599,10 +622,29 @@ bool Consensus::CheckTxInputs(const CTransaction& tx, CValidationState& state, c
     return true;
 }
 
-uint256 SignatureHashStakingOutput(const CKeyID& keyId, const CAmount nAmount, const std::vector<CTxIn>& vin)
+std::vector<uint8_t> SerializeSignatureHashPrevouts(const std::vector<CTxIn>& vin)
 {
     assert(vin.size());
 
+    std::vector<uint8_t> vPrevouts;
+    vPrevouts.reserve(vin.size() * (sizeof(uint256) + sizeof(uint32_t)));
+    CVectorWriter ss(SER_GETHASH, 0, vPrevouts, 0);
+    for (const auto &txin : vin) {
+        ss << txin.prevout;
+    }
+
+    return vPrevouts;
+}
+
+uint256 SignatureHashStakingOutput(const CKeyID& keyId, const CAmount nAmount, const std::vector<CTxIn>& vin)
+{
+    return SignatureHashStakingOutput(keyId, nAmount, SerializeSignatureHashPrevouts(vin));
+}
+
+uint256 SignatureHashStakingOutput(const CKeyID& keyId, const CAmount nAmount, const std::vector<uint8_t>& vPrevouts)
+{
+    assert(vPrevouts.size());
+
     CHashWriter ss(SER_GETHASH, 0);
     // Address of the convert output
     ss << keyId;
@@ -610,16 +652,19 @@ uint256 SignatureHashStakingOutput(const CKeyID& keyId, const CAmount nAmount, c
     // Amount of the convert output
     ss << nAmount;
 
-    for( auto txin : vin ){
-        ss << txin.prevout;
-    }
+    ss.write((const char*)vPrevouts.data(), vPrevouts.size());
 
     return ss.GetHash();
 }
 
 uint256 SignatureHashSpendingOutput(const CKeyID& keyId, const std::vector<uint8_t> &vRangeproof, const std::vector<CTxIn>& vin)
 {
-    assert(vin.size());
+    return SignatureHashSpendingOutput(keyId, vRangeproof, SerializeSignatureHashPrevouts(vin));
+}
+
+uint256 SignatureHashSpendingOutput(const CKeyID& keyId, const std::vector<uint8_t> &vRangeproof, const std::vector<uint8_t>& vPrevouts)
+{
+    assert(vPrevouts.size());
 
     CHashWriter ss(SER_GETHASH, 0);
 
@@ -629,9 +674,7 @@ uint256 SignatureHashSpendingOutput(const CKeyID& keyId, const std::vector<uint8
     // Rangeproof of the convert output
     ss << vRangeproof;
 
-    for( auto txin : vin ){
-        ss << txin.prevout;
-    }
+    ss.write((const char*)vPrevouts.data(), vPrevouts.size());
 
     return ss.GetHash();
 }
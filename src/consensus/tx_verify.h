@@ -17,11 +17,15 @@ class CBlockIndex;
 class CCoinsViewCache;
 class CTransaction;
 class CValidationState;
+class CBulletproofBatch;
 
 /** Transaction validation functions */
 
-/** Context-independent validity checks */
-bool CheckTransaction(const CTransaction& tx, CValidationState& state, bool fCheckDuplicateInputs=true);
+/** Context-independent validity checks
+ * If pBatch is not nullptr bulletproofs are added to it instead of being verified,
+ * otherwise the bulletproofs of the transaction are verified together.
+ */
+bool CheckTransaction(const CTransaction& tx, CValidationState& state, bool fCheckDuplicateInputs=true, CBulletproofBatch *pBatch=nullptr);
 
 namespace Consensus {
 /**
@@ -81,8 +85,16 @@ bool EvaluateSequenceLocks(const CBlockIndex& block, std::pair<int, int64_t> loc
  */
 bool SequenceLocks(const CTransaction &tx, int flags, std::vector<int>* prevHeights, const CBlockIndex& block);
 
+/**
+ * The prevouts of all inputs as committed to by the staking and spending output signature hashes.
+ * Serialize once and pass to the overloads below when signing or verifying several outputs of a transaction.
+ */
+std::vector<uint8_t> SerializeSignatureHashPrevouts(const std::vector<CTxIn>& vin);
+
 uint256 SignatureHashStakingOutput(const CKeyID& keyId, const CAmount nAmount, const std::vector<CTxIn>& vin);
+uint256 SignatureHashStakingOutput(const CKeyID& keyId, const CAmount nAmount, const std::vector<uint8_t>& vPrevouts);
 
 uint256 SignatureHashSpendingOutput(const CKeyID& keyId, const std::vector<uint8_t> &vRangeproof, const std::vector<CTxIn>& vin);
+uint256 SignatureHashSpendingOutput(const CKeyID& keyId, const std::vector<uint8_t> &vRangeproof, const std::vector<uint8_t>& vPrevouts);
 
 #endif // BITCOIN_CONSENSUS_TX_VERIFY_H
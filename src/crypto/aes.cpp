@@ -8,10 +8,51 @@
 #include <assert.h>
 #include <string.h>
 
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
 extern "C" {
 #include <crypto/ctaes/ctaes.c>
 }
 
+#if defined(ENABLE_AESNI) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace aes256_aesni
+{
+void ExpandKey(unsigned char* roundkeys, const unsigned char key[32]);
+void InvertKey(unsigned char* roundkeys);
+void CBCEncrypt(const unsigned char* roundkeys, const unsigned char iv[16], const unsigned char* data, size_t blocks, unsigned char* out);
+void CBCDecrypt(const unsigned char* roundkeys, const unsigned char iv[16], const unsigned char* data, size_t blocks, unsigned char* out);
+}
+
+namespace
+{
+/** Round keys of the AES-NI implementation, selects its overloads of the CBC helpers below. */
+struct AESNIKey
+{
+    const unsigned char* roundkeys;
+};
+} // namespace
+#endif
+
+namespace
+{
+bool use_aesni = false;
+
+/** Block interface of the CBC helpers below over a ctaes key schedule. */
+struct CTAES256Encrypt
+{
+    const AES256_ctx* ctx;
+    void Encrypt(unsigned char ciphertext[16], const unsigned char plaintext[16]) const { AES256_encrypt(ctx, 1, ciphertext, plaintext); }
+};
+
+struct CTAES256Decrypt
+{
+    const AES256_ctx* ctx;
+    void Decrypt(unsigned char plaintext[16], const unsigned char ciphertext[16]) const { AES256_decrypt(ctx, 1, plaintext, ciphertext); }
+};
+} // namespace
+
 AES128Encrypt::AES128Encrypt(const unsigned char key[16])
 {
     AES128_init(&ctx, key);
@@ -73,6 +114,50 @@ void AES256Decrypt::Decrypt(unsigned char plaintext[16], const unsigned char cip
 }
 
 
+/** Encrypt whole blocks, chaining from mixed and leaving the last ciphertext block in it. */
+template <typename T>
+static void CBCEncryptBlocks(const T& enc, unsigned char mixed[AES_BLOCKSIZE], const unsigned char* data, int blocks, unsigned char* out)
+{
+    for (int b = 0; b != blocks; b++) {
+        for (int i = 0; i != AES_BLOCKSIZE; i++)
+            mixed[i] ^= *data++;
+        enc.Encrypt(out, mixed);
+        memcpy(mixed, out, AES_BLOCKSIZE);
+        out += AES_BLOCKSIZE;
+    }
+}
+
+#if defined(ENABLE_AESNI) && !defined(BUILD_BITCOIN_INTERNAL)
+static void CBCEncryptBlocks(const AESNIKey& key, unsigned char mixed[AES_BLOCKSIZE], const unsigned char* data, int blocks, unsigned char* out)
+{
+    if (blocks == 0)
+        return;
+    aes256_aesni::CBCEncrypt(key.roundkeys, mixed, data, blocks, out);
+    memcpy(mixed, out + (blocks - 1) * AES_BLOCKSIZE, AES_BLOCKSIZE);
+}
+#endif
+
+/** Decrypt whole blocks. Padding is left to the caller. */
+template <typename T>
+static void CBCDecryptBlocks(const T& dec, const unsigned char iv[AES_BLOCKSIZE], const unsigned char* data, int blocks, unsigned char* out)
+{
+    const unsigned char* prev = iv;
+    for (int b = 0; b != blocks; b++) {
+        dec.Decrypt(out, data);
+        for (int i = 0; i != AES_BLOCKSIZE; i++)
+            *out++ ^= prev[i];
+        prev = data;
+        data += AES_BLOCKSIZE;
+    }
+}
+
+#if defined(ENABLE_AESNI) && !defined(BUILD_BITCOIN_INTERNAL)
+static void CBCDecryptBlocks(const AESNIKey& key, const unsigned char iv[AES_BLOCKSIZE], const unsigned char* data, int blocks, unsigned char* out)
+{
+    aes256_aesni::CBCDecrypt(key.roundkeys, iv, data, blocks, out);
+}
+#endif
+
 template <typename T>
 static int CBCEncrypt(const T& enc, const unsigned char iv[AES_BLOCKSIZE], const unsigned char* data, int size, bool pad, unsigned char* out)
 {
@@ -88,22 +173,17 @@ static int CBCEncrypt(const T& enc, const unsigned char iv[AES_BLOCKSIZE], const
 
     memcpy(mixed, iv, AES_BLOCKSIZE);
 
-    // Write all but the last block
-    while (written + AES_BLOCKSIZE <= size) {
-        for (int i = 0; i != AES_BLOCKSIZE; i++)
-            mixed[i] ^= *data++;
-        enc.Encrypt(out + written, mixed);
-        memcpy(mixed, out + written, AES_BLOCKSIZE);
-        written += AES_BLOCKSIZE;
-    }
+    // Write all whole blocks
+    CBCEncryptBlocks(enc, mixed, data, size / AES_BLOCKSIZE, out);
+    written = size - padsize;
+    data += written;
     if (pad) {
         // For all that remains, pad each byte with the value of the remaining
         // space. If there is none, pad by a full block.
-        for (int i = 0; i != padsize; i++)
-            mixed[i] ^= *data++;
-        for (int i = padsize; i != AES_BLOCKSIZE; i++)
-            mixed[i] ^= AES_BLOCKSIZE - padsize;
-        enc.Encrypt(out + written, mixed);
+        unsigned char last[AES_BLOCKSIZE];
+        memcpy(last, data, padsize);
+        memset(last + padsize, AES_BLOCKSIZE - padsize, AES_BLOCKSIZE - padsize);
+        CBCEncryptBlocks(enc, mixed, last, 1, out + written);
         written += AES_BLOCKSIZE;
     }
     return written;
@@ -114,7 +194,6 @@ static int CBCDecrypt(const T& dec, const unsigned char iv[AES_BLOCKSIZE], const
 {
     int written = 0;
     bool fail = false;
-    const unsigned char* prev = iv;
 
     if (!data || !size || !out)
         return 0;
@@ -123,13 +202,9 @@ static int CBCDecrypt(const T& dec, const unsigned char iv[AES_BLOCKSIZE], const
         return 0;
 
     // Decrypt all data. Padding will be checked in the output.
-    while (written != size) {
-        dec.Decrypt(out, data + written);
-        for (int i = 0; i != AES_BLOCKSIZE; i++)
-            *out++ ^= prev[i];
-        prev = data + written;
-        written += AES_BLOCKSIZE;
-    }
+    CBCDecryptBlocks(dec, iv, data, size / AES_BLOCKSIZE, out);
+    out += size;
+    written = size;
 
     // When decrypting padding, attempt to run in constant-time
     if (pad) {
@@ -151,35 +226,60 @@ static int CBCDecrypt(const T& dec, const unsigned char iv[AES_BLOCKSIZE], const
 }
 
 AES256CBCEncrypt::AES256CBCEncrypt(const unsigned char key[AES256_KEYSIZE], const unsigned char ivIn[AES_BLOCKSIZE], bool padIn)
-    : enc(key), pad(padIn)
+    : hardware(use_aesni), pad(padIn)
 {
+#if defined(ENABLE_AESNI) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (hardware) {
+        aes256_aesni::ExpandKey(roundkeys, key);
+    } else
+#endif
+    AES256_init(&ctx, key);
     memcpy(iv, ivIn, AES_BLOCKSIZE);
 }
 
 int AES256CBCEncrypt::Encrypt(const unsigned char* data, int size, unsigned char* out) const
 {
-    return CBCEncrypt(enc, iv, data, size, pad, out);
+#if defined(ENABLE_AESNI) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (hardware) {
+        return CBCEncrypt(AESNIKey{roundkeys}, iv, data, size, pad, out);
+    }
+#endif
+    return CBCEncrypt(CTAES256Encrypt{&ctx}, iv, data, size, pad, out);
 }
 
 AES256CBCEncrypt::~AES256CBCEncrypt()
 {
+    memset(&ctx, 0, sizeof(ctx));
     memset(iv, 0, sizeof(iv));
 }
 
 AES256CBCDecrypt::AES256CBCDecrypt(const unsigned char key[AES256_KEYSIZE], const unsigned char ivIn[AES_BLOCKSIZE], bool padIn)
-    : dec(key), pad(padIn)
+    : hardware(use_aesni), pad(padIn)
 {
+#if defined(ENABLE_AESNI) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (hardware) {
+        aes256_aesni::ExpandKey(roundkeys, key);
+        aes256_aesni::InvertKey(roundkeys);
+    } else
+#endif
+    AES256_init(&ctx, key);
     memcpy(iv, ivIn, AES_BLOCKSIZE);
 }
 
 
 int AES256CBCDecrypt::Decrypt(const unsigned char* data, int size, unsigned char* out) const
 {
-    return CBCDecrypt(dec, iv, data, size, pad, out);
+#if defined(ENABLE_AESNI) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (hardware) {
+        return CBCDecrypt(AESNIKey{roundkeys}, iv, data, size, pad, out);
+    }
+#endif
+    return CBCDecrypt(CTAES256Decrypt{&ctx}, iv, data, size, pad, out);
 }
 
 AES256CBCDecrypt::~AES256CBCDecrypt()
 {
+    memset(&ctx, 0, sizeof(ctx));
     memset(iv, 0, sizeof(iv));
 }
 
@@ -214,3 +314,63 @@ int AES128CBCDecrypt::Decrypt(const unsigned char* data, int size, unsigned char
 {
     return CBCDecrypt(dec, iv, data, size, pad, out);
 }
+
+namespace
+{
+bool SelfTest()
+{
+    // NIST SP 800-38A, F.2.5 CBC-AES256.Encrypt, with a padded copy of the second block
+    // appended so the remainder of an 8 block batch is covered as well.
+    static const unsigned char key[32] = {
+        0x60, 0x3d, 0xeb, 0x10, 0x15, 0xca, 0x71, 0xbe, 0x2b, 0x73, 0xae, 0xf0, 0x85, 0x7d, 0x77, 0x81,
+        0x1f, 0x35, 0x2c, 0x07, 0x3b, 0x61, 0x08, 0xd7, 0x2d, 0x98, 0x10, 0xa3, 0x09, 0x14, 0xdf, 0xf4};
+    static const unsigned char iv[16] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+    static const unsigned char plain[64] = {
+        0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+        0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+        0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+        0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10};
+    static const unsigned char cipher[64] = {
+        0xf5, 0x8c, 0x4c, 0x04, 0xd6, 0xe5, 0xf1, 0xba, 0x77, 0x9e, 0xab, 0xfb, 0x5f, 0x7b, 0xfb, 0xd6,
+        0x9c, 0xfc, 0x4e, 0x96, 0x7e, 0xdb, 0x80, 0x8d, 0x67, 0x9f, 0x77, 0x7b, 0xc6, 0x70, 0x2c, 0x7d,
+        0x39, 0xf2, 0x33, 0x69, 0xa9, 0xd9, 0xba, 0xcf, 0xa5, 0x30, 0xe2, 0x63, 0x04, 0x23, 0x14, 0x61,
+        0xb2, 0xeb, 0x05, 0xe2, 0xc3, 0x9b, 0xe9, 0xfc, 0xda, 0x6c, 0x19, 0x07, 0x8c, 0x6a, 0x9d, 0x1b};
+
+    unsigned char out[64];
+    if (AES256CBCEncrypt(key, iv, false).Encrypt(plain, 64, out) != 64 || memcmp(out, cipher, 64) != 0)
+        return false;
+    if (AES256CBCDecrypt(key, iv, false).Decrypt(cipher, 64, out) != 64 || memcmp(out, plain, 64) != 0)
+        return false;
+
+    // Round trip enough padded data to take the batched decryption path
+    unsigned char data[200], enc[208], dec[208];
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = plain[i % 64] ^ i;
+    int size = AES256CBCEncrypt(key, iv, true).Encrypt(data, sizeof(data), enc);
+    if (size != 208)
+        return false;
+    if (AES256CBCDecrypt(key, iv, true).Decrypt(enc, size, dec) != 200 || memcmp(dec, data, 200) != 0)
+        return false;
+    return true;
+}
+} // namespace
+
+std::string AES256AutoDetect(bool allow_hardware)
+{
+    std::string ret = "standard";
+    use_aesni = false;
+#if defined(ENABLE_AESNI) && !defined(BUILD_BITCOIN_INTERNAL)
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+    uint32_t eax, ebx, ecx, edx;
+    if (allow_hardware && __get_cpuid(1, &eax, &ebx, &ecx, &edx) && ((ecx >> 25) & 1)) {
+        use_aesni = true;
+        ret = "aesni(8way)";
+    }
+#endif
+#endif
+    (void)allow_hardware;
+
+    assert(SelfTest());
+    return ret;
+}
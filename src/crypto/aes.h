@@ -11,6 +11,8 @@ extern "C" {
 #include <crypto/ctaes/ctaes.h>
 }
 
+#include <string>
+
 static const int AES_BLOCKSIZE = 16;
 static const int AES128_KEYSIZE = 16;
 static const int AES256_KEYSIZE = 32;
@@ -63,6 +65,7 @@ public:
     void Decrypt(unsigned char plaintext[16], const unsigned char ciphertext[16]) const;
 };
 
+/** AES-256 in CBC mode, using AES-NI when AES256AutoDetect() found it. */
 class AES256CBCEncrypt
 {
 public:
@@ -71,11 +74,18 @@ public:
     int Encrypt(const unsigned char* data, int size, unsigned char* out) const;
 
 private:
-    const AES256Encrypt enc;
+    //! Whether the AES-NI implementation was selected when constructed
+    const bool hardware;
+    union {
+        AES256_ctx ctx;
+        //! Round keys of the AES-NI implementation
+        unsigned char roundkeys[15 * AES_BLOCKSIZE];
+    };
     const bool pad;
     unsigned char iv[AES_BLOCKSIZE];
 };
 
+/** AES-256 in CBC mode, using AES-NI when AES256AutoDetect() found it. */
 class AES256CBCDecrypt
 {
 public:
@@ -84,7 +94,13 @@ public:
     int Decrypt(const unsigned char* data, int size, unsigned char* out) const;
 
 private:
-    const AES256Decrypt dec;
+    //! Whether the AES-NI implementation was selected when constructed
+    const bool hardware;
+    union {
+        AES256_ctx ctx;
+        //! Round keys of the AES-NI implementation
+        unsigned char roundkeys[15 * AES_BLOCKSIZE];
+    };
     const bool pad;
     unsigned char iv[AES_BLOCKSIZE];
 };
@@ -115,4 +131,10 @@ private:
     unsigned char iv[AES_BLOCKSIZE];
 };
 
+/** Autodetect the best available AES-256-CBC implementation, or select the
+ *  constant-time software one if allow_hardware is false (for tests and benchmarks).
+ *  Returns the name of the implementation.
+ */
+std::string AES256AutoDetect(bool allow_hardware = true);
+
 #endif // BITCOIN_CRYPTO_AES_H
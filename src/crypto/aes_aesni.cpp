@@ -0,0 +1,136 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// AES-256 using the AES-NI instructions.
+
+#ifdef ENABLE_AESNI
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wmmintrin.h>
+
+namespace aes256_aesni {
+namespace {
+
+__m128i inline Load(const unsigned char* in) { return _mm_loadu_si128((const __m128i*)in); }
+void inline Store(unsigned char* out, __m128i x) { _mm_storeu_si128((__m128i*)out, x); }
+
+/** XOR each 32-bit word of a with all words below it. */
+__m128i inline Prefix(__m128i a)
+{
+    a = _mm_xor_si128(a, _mm_slli_si128(a, 4));
+    a = _mm_xor_si128(a, _mm_slli_si128(a, 4));
+    return _mm_xor_si128(a, _mm_slli_si128(a, 4));
+}
+
+/** Next even round key, from the keygenassist output of the previous odd one. */
+__m128i inline ExpandEven(__m128i a, __m128i assist) { return _mm_xor_si128(Prefix(a), _mm_shuffle_epi32(assist, 0xff)); }
+
+/** Next odd round key, SubWord without rotation or round constant. */
+__m128i inline ExpandOdd(__m128i a, __m128i b) { return _mm_xor_si128(Prefix(a), _mm_shuffle_epi32(_mm_aeskeygenassist_si128(b, 0x00), 0xaa)); }
+
+void inline LoadKeys(__m128i rk[15], const unsigned char* roundkeys)
+{
+    for (int i = 0; i < 15; ++i) {
+        rk[i] = Load(roundkeys + 16 * i);
+    }
+}
+
+} // namespace
+
+void ExpandKey(unsigned char* roundkeys, const unsigned char key[32])
+{
+    __m128i rk[15];
+    rk[0] = Load(key);
+    rk[1] = Load(key + 16);
+    rk[2] = ExpandEven(rk[0], _mm_aeskeygenassist_si128(rk[1], 0x01));
+    rk[3] = ExpandOdd(rk[1], rk[2]);
+    rk[4] = ExpandEven(rk[2], _mm_aeskeygenassist_si128(rk[3], 0x02));
+    rk[5] = ExpandOdd(rk[3], rk[4]);
+    rk[6] = ExpandEven(rk[4], _mm_aeskeygenassist_si128(rk[5], 0x04));
+    rk[7] = ExpandOdd(rk[5], rk[6]);
+    rk[8] = ExpandEven(rk[6], _mm_aeskeygenassist_si128(rk[7], 0x08));
+    rk[9] = ExpandOdd(rk[7], rk[8]);
+    rk[10] = ExpandEven(rk[8], _mm_aeskeygenassist_si128(rk[9], 0x10));
+    rk[11] = ExpandOdd(rk[9], rk[10]);
+    rk[12] = ExpandEven(rk[10], _mm_aeskeygenassist_si128(rk[11], 0x20));
+    rk[13] = ExpandOdd(rk[11], rk[12]);
+    rk[14] = ExpandEven(rk[12], _mm_aeskeygenassist_si128(rk[13], 0x40));
+    for (int i = 0; i < 15; ++i) {
+        Store(roundkeys + 16 * i, rk[i]);
+    }
+}
+
+void InvertKey(unsigned char* roundkeys)
+{
+    __m128i rk[15];
+    LoadKeys(rk, roundkeys);
+    Store(roundkeys, rk[14]);
+    for (int i = 1; i < 14; ++i) {
+        Store(roundkeys + 16 * i, _mm_aesimc_si128(rk[14 - i]));
+    }
+    Store(roundkeys + 16 * 14, rk[0]);
+}
+
+void CBCEncrypt(const unsigned char* roundkeys, const unsigned char iv[16], const unsigned char* data, size_t blocks, unsigned char* out)
+{
+    __m128i rk[15];
+    LoadKeys(rk, roundkeys);
+
+    // Each block depends on the previous one, so there is nothing to interleave
+    __m128i x = Load(iv);
+    for (size_t b = 0; b < blocks; ++b) {
+        x = _mm_xor_si128(x, _mm_xor_si128(Load(data + 16 * b), rk[0]));
+        for (int r = 1; r < 14; ++r) {
+            x = _mm_aesenc_si128(x, rk[r]);
+        }
+        x = _mm_aesenclast_si128(x, rk[14]);
+        Store(out + 16 * b, x);
+    }
+}
+
+void CBCDecrypt(const unsigned char* roundkeys, const unsigned char iv[16], const unsigned char* data, size_t blocks, unsigned char* out)
+{
+    __m128i rk[15];
+    LoadKeys(rk, roundkeys);
+
+    // Blocks decrypt independently, run 8 at once to hide the latency of aesdec
+    __m128i prev = Load(iv);
+    while (blocks >= 8) {
+        __m128i in[8], x[8];
+        for (int i = 0; i < 8; ++i) {
+            in[i] = Load(data + 16 * i);
+            x[i] = _mm_xor_si128(in[i], rk[0]);
+        }
+        for (int r = 1; r < 14; ++r) {
+            for (int i = 0; i < 8; ++i) {
+                x[i] = _mm_aesdec_si128(x[i], rk[r]);
+            }
+        }
+        for (int i = 0; i < 8; ++i) {
+            x[i] = _mm_aesdeclast_si128(x[i], rk[14]);
+            Store(out + 16 * i, _mm_xor_si128(x[i], i == 0 ? prev : in[i - 1]));
+        }
+        prev = in[7];
+        data += 8 * 16;
+        out += 8 * 16;
+        blocks -= 8;
+    }
+    for (; blocks > 0; --blocks) {
+        __m128i in = Load(data);
+        __m128i x = _mm_xor_si128(in, rk[0]);
+        for (int r = 1; r < 14; ++r) {
+            x = _mm_aesdec_si128(x, rk[r]);
+        }
+        x = _mm_aesdeclast_si128(x, rk[14]);
+        Store(out, _mm_xor_si128(x, prev));
+        prev = in;
+        data += 16;
+        out += 16;
+    }
+}
+
+} // namespace aes256_aesni
+
+#endif
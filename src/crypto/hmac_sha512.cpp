@@ -5,6 +5,7 @@
 #include <crypto/hmac_sha512.h>
 
 #include <string.h>
+#include <vector>
 
 CHMAC_SHA512::CHMAC_SHA512(const unsigned char* key, size_t keylen)
 {
@@ -32,3 +33,67 @@ void CHMAC_SHA512::Finalize(unsigned char hash[OUTPUT_SIZE])
     inner.Finalize(temp);
     outer.Write(temp, 64).Finalize(hash);
 }
+
+/** The states after the outer and inner key blocks of a HMAC. */
+static void KeyMidstates(uint64_t* outer, uint64_t* inner, const unsigned char* key, size_t keylen)
+{
+    unsigned char rkey[128];
+    if (keylen <= 128) {
+        memcpy(rkey, key, keylen);
+        memset(rkey + keylen, 0, 128 - keylen);
+    } else {
+        CSHA512().Write(key, keylen).Finalize(rkey);
+        memset(rkey + 64, 0, 64);
+    }
+
+    for (int n = 0; n < 128; n++)
+        rkey[n] ^= 0x5c;
+    SHA512Midstate128(outer, rkey);
+
+    for (int n = 0; n < 128; n++)
+        rkey[n] ^= 0x5c ^ 0x36;
+    SHA512Midstate128(inner, rkey);
+}
+
+void HMAC_SHA512_Multi(unsigned char* output, const unsigned char* key, size_t keylen,
+    const unsigned char* input, size_t len, size_t blocks)
+{
+    uint64_t outer_key[8], inner_key[8];
+    KeyMidstates(outer_key, inner_key, key, keylen);
+
+    std::vector<uint64_t> inner(blocks * 8), outer(blocks * 8);
+    for (size_t b = 0; b < blocks; ++b) {
+        memcpy(&inner[b * 8], inner_key, sizeof(inner_key));
+        memcpy(&outer[b * 8], outer_key, sizeof(outer_key));
+    }
+
+    std::vector<unsigned char> temp(blocks * 64);
+    SHA512Midstate(temp.data(), inner.data(), input, len, blocks);
+    SHA512Midstate(output, outer.data(), temp.data(), 64, blocks);
+}
+
+void PBKDF2_HMAC_SHA512_64(unsigned char* output, const unsigned char* const* keys, const size_t* keylens,
+    const unsigned char* const* salts, const size_t* saltlens, size_t iterations, size_t blocks)
+{
+    // The inner and outer key block states of each HMAC, every iteration continues from them
+    std::vector<uint64_t> inner(blocks * 8), outer(blocks * 8);
+    std::vector<unsigned char> u(blocks * 64), temp(blocks * 64);
+
+    static const unsigned char one[4] = {0, 0, 0, 1};
+    for (size_t b = 0; b < blocks; ++b) {
+        KeyMidstates(&outer[b * 8], &inner[b * 8], keys[b], keylens[b]);
+
+        // U_1 = PRF(P, S || INT(1))
+        CHMAC_SHA512(keys[b], keylens[b]).Write(salts[b], saltlens[b]).Write(one, 4).Finalize(&u[b * 64]);
+    }
+    memcpy(output, u.data(), blocks * 64);
+
+    // U_c = PRF(P, U_{c-1})
+    for (size_t k = 1; k < iterations; ++k) {
+        SHA512Midstate(temp.data(), inner.data(), u.data(), 64, blocks);
+        SHA512Midstate(u.data(), outer.data(), temp.data(), 64, blocks);
+        for (size_t i = 0; i < blocks * 64; ++i) {
+            output[i] ^= u[i];
+        }
+    }
+}
@@ -29,4 +29,22 @@ public:
     void Finalize(unsigned char hash[OUTPUT_SIZE]);
 };
 
+/** Compute multiple HMAC-SHA512's of short messages under a single key, through SHA512Midstate.
+ *  output:     pointer to a blocks*64 byte output buffer
+ *  input:      pointer to a blocks*len byte input buffer
+ *  len:        the length of each message, at most 111 bytes
+ */
+void HMAC_SHA512_Multi(unsigned char* output, const unsigned char* key, size_t keylen,
+    const unsigned char* input, size_t len, size_t blocks);
+
+/** Compute multiple single block (64 byte) PBKDF2-HMAC-SHA512's (RFC 2898).
+ *  The iterations of all blocks are interleaved through SHA512Midstate.
+ *  output:     pointer to a blocks*64 byte output buffer
+ *  keys:       blocks pointers to the passwords, of keylens bytes
+ *  salts:      blocks pointers to the salts, of saltlens bytes
+ *  iterations: the iteration count, at least 1
+ */
+void PBKDF2_HMAC_SHA512_64(unsigned char* output, const unsigned char* const* keys, const size_t* keylens,
+    const unsigned char* const* salts, const size_t* saltlens, size_t iterations, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_HMAC_SHA512_H
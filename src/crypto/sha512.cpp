@@ -6,8 +6,25 @@
 
 #include <crypto/common.h>
 
+#include <assert.h>
 #include <string.h>
 
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#if defined(USE_ASM)
+#include <cpuid.h>
+#endif
+#endif
+
+namespace sha512_sse41
+{
+void Transform_2way(uint64_t* s, const unsigned char* chunk);
+}
+
+namespace sha512_avx2
+{
+void Transform_4way(uint64_t* s, const unsigned char* chunk);
+}
+
 // Internal implementation code.
 namespace
 {
@@ -146,9 +163,123 @@ void Transform(uint64_t* s, const unsigned char* chunk)
 
 } // namespace sha512
 
+typedef void (*TransformTypeMultiWay)(uint64_t*, const unsigned char*);
+
+TransformTypeMultiWay Transform_2way = nullptr;
+TransformTypeMultiWay Transform_4way = nullptr;
+
+/** Pad the last len bytes of a 128 + len byte message into its final block. */
+void inline PadMidstate(unsigned char* chunk, const unsigned char* in, size_t len)
+{
+    memcpy(chunk, in, len);
+    chunk[len] = 0x80;
+    memset(chunk + len + 1, 0, 119 - len);
+    WriteBE64(chunk + 120, (128 + len) << 3);
+}
+
+bool SelfTest()
+{
+    // Input state (equal to the state after the first 128 byte block of 0x36 bytes)
+    uint64_t init[8];
+    unsigned char block[128];
+    memset(block, 0x36, 128);
+    sha512::Initialize(init);
+    sha512::Transform(init, block);
+
+    // Some extra input to test the midstate hashes, read as 37 byte BIP32 messages and as 64 byte blocks
+    static const unsigned char data[4 * 64] = {
+        "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore et dolore magna aliqua. Et m"
+        "olestie ac feugiat sed lectus vestibulum mattis ullamcorper. Morbi blandit cursus risus at ultrices mi tempus imperdiet nulla."
+    };
+    uint64_t states[4 * 8];
+    for (int i = 0; i < 4; ++i) {
+        memcpy(states + 8 * i, init, sizeof(init));
+    }
+
+    // Test SHA512Midstate with the multi-way transforms, if available, and with the remainder of 3 blocks.
+    for (size_t len : {37, 64}) {
+        for (size_t blocks : {4, 3}) {
+            unsigned char expected[4 * 64], out[4 * 64];
+            for (size_t i = 0; i < blocks; ++i) {
+                CSHA512().Write(block, 128).Write(data + len * i, len).Finalize(expected + 64 * i);
+            }
+            SHA512Midstate(out, states, data, len, blocks);
+            if (memcmp(out, expected, 64 * blocks) != 0) return false;
+        }
+    }
+    return true;
+}
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+// We can't use cpuid.h's __get_cpuid as it does not support subleafs.
+void inline cpuid(uint32_t leaf, uint32_t subleaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+{
+#ifdef __GNUC__
+    __cpuid_count(leaf, subleaf, a, b, c, d);
+#else
+  __asm__ ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "0"(leaf), "2"(subleaf));
+#endif
+}
+
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
 } // namespace
 
 
+std::string SHA512AutoDetect()
+{
+    std::string ret = "standard";
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+    bool have_sse4 = false;
+    bool have_xsave = false;
+    bool have_avx = false;
+    bool have_avx2 = false;
+    bool enabled_avx = false;
+
+    (void)AVXEnabled;
+    (void)have_sse4;
+    (void)have_avx2;
+
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, 0, eax, ebx, ecx, edx);
+    have_sse4 = (ecx >> 19) & 1;
+    have_xsave = (ecx >> 27) & 1;
+    have_avx = (ecx >> 28) & 1;
+    if (have_xsave && have_avx) {
+        enabled_avx = AVXEnabled();
+    }
+    cpuid(0, 0, eax, ebx, ecx, edx);
+    if (eax >= 7) {
+        cpuid(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = (ebx >> 5) & 1;
+    }
+
+#if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_sse4) {
+        Transform_2way = sha512_sse41::Transform_2way;
+        ret += ",sse41(2way)";
+    }
+#endif
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx2 && have_avx && enabled_avx) {
+        Transform_4way = sha512_avx2::Transform_4way;
+        ret += ",avx2(4way)";
+    }
+#endif
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
+
+
 ////// SHA-512
 
 CSHA512::CSHA512() : bytes(0)
@@ -205,3 +336,38 @@ CSHA512& CSHA512::Reset()
     sha512::Initialize(s);
     return *this;
 }
+
+void SHA512Midstate128(uint64_t* state, const unsigned char* input)
+{
+    sha512::Initialize(state);
+    sha512::Transform(state, input);
+}
+
+void SHA512Midstate(unsigned char* output, const uint64_t* states, const unsigned char* input, size_t len, size_t blocks)
+{
+    assert(len <= 111);
+    unsigned char chunks[4 * 128];
+    uint64_t s[4 * 8];
+    while (blocks) {
+        size_t n = (Transform_4way && blocks >= 4) ? 4 : (Transform_2way && blocks >= 2) ? 2 : 1;
+        memcpy(s, states, n * 8 * sizeof(uint64_t));
+        for (size_t i = 0; i < n; ++i) {
+            PadMidstate(chunks + 128 * i, input + len * i, len);
+        }
+        if (n == 4) {
+            Transform_4way(s, chunks);
+        } else
+        if (n == 2) {
+            Transform_2way(s, chunks);
+        } else {
+            sha512::Transform(s, chunks);
+        }
+        for (size_t i = 0; i < n * 8; ++i) {
+            WriteBE64(output + 8 * i, s[i]);
+        }
+        output += 64 * n;
+        states += 8 * n;
+        input += len * n;
+        blocks -= n;
+    }
+}
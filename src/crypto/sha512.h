@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-512. */
 class CSHA512
@@ -25,4 +26,24 @@ public:
     CSHA512& Reset();
 };
 
+/** Autodetect the best available SHA512 multi-buffer implementation.
+ *  Returns the name of the implementation.
+ */
+std::string SHA512AutoDetect();
+
+/** Compute the SHA-512 state after a single 128-byte block, as HMAC does for its key blocks.
+ *  state:   pointer to an 8 word output state
+ *  input:   pointer to a 128 byte input block
+ */
+void SHA512Midstate128(uint64_t* state, const unsigned char* input);
+
+/** Compute multiple SHA-512's of short messages, given the states after their first 128 bytes.
+ *  output:  pointer to a blocks*64 byte output buffer
+ *  states:  pointer to blocks*8 words of states, as returned by SHA512Midstate128
+ *  input:   pointer to a blocks*len byte input buffer, the bytes of each message after the first 128
+ *  len:     the number of bytes of each message after the first 128, at most 111
+ *  blocks:  the number of hashes to compute.
+ */
+void SHA512Midstate(unsigned char* output, const uint64_t* states, const unsigned char* input, size_t len, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA512_H
@@ -0,0 +1,124 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_SSE41
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include <crypto/sha512.h>
+#include <crypto/common.h>
+
+namespace sha512_sse41 {
+namespace {
+
+const uint64_t k[80] = {
+    0x428a2f98d728ae22ull, 0x7137449123ef65cdull, 0xb5c0fbcfec4d3b2full, 0xe9b5dba58189dbbcull,
+    0x3956c25bf348b538ull, 0x59f111f1b605d019ull, 0x923f82a4af194f9bull, 0xab1c5ed5da6d8118ull,
+    0xd807aa98a3030242ull, 0x12835b0145706fbeull, 0x243185be4ee4b28cull, 0x550c7dc3d5ffb4e2ull,
+    0x72be5d74f27b896full, 0x80deb1fe3b1696b1ull, 0x9bdc06a725c71235ull, 0xc19bf174cf692694ull,
+    0xe49b69c19ef14ad2ull, 0xefbe4786384f25e3ull, 0x0fc19dc68b8cd5b5ull, 0x240ca1cc77ac9c65ull,
+    0x2de92c6f592b0275ull, 0x4a7484aa6ea6e483ull, 0x5cb0a9dcbd41fbd4ull, 0x76f988da831153b5ull,
+    0x983e5152ee66dfabull, 0xa831c66d2db43210ull, 0xb00327c898fb213full, 0xbf597fc7beef0ee4ull,
+    0xc6e00bf33da88fc2ull, 0xd5a79147930aa725ull, 0x06ca6351e003826full, 0x142929670a0e6e70ull,
+    0x27b70a8546d22ffcull, 0x2e1b21385c26c926ull, 0x4d2c6dfc5ac42aedull, 0x53380d139d95b3dfull,
+    0x650a73548baf63deull, 0x766a0abb3c77b2a8ull, 0x81c2c92e47edaee6ull, 0x92722c851482353bull,
+    0xa2bfe8a14cf10364ull, 0xa81a664bbc423001ull, 0xc24b8b70d0f89791ull, 0xc76c51a30654be30ull,
+    0xd192e819d6ef5218ull, 0xd69906245565a910ull, 0xf40e35855771202aull, 0x106aa07032bbd1b8ull,
+    0x19a4c116b8d2d0c8ull, 0x1e376c085141ab53ull, 0x2748774cdf8eeb99ull, 0x34b0bcb5e19b48a8ull,
+    0x391c0cb3c5c95a63ull, 0x4ed8aa4ae3418acbull, 0x5b9cca4f7763e373ull, 0x682e6ff3d6b2b8a3ull,
+    0x748f82ee5defb2fcull, 0x78a5636f43172f60ull, 0x84c87814a1f0ab72ull, 0x8cc702081a6439ecull,
+    0x90befffa23631e28ull, 0xa4506cebde82bde9ull, 0xbef9a3f7b2c67915ull, 0xc67178f2e372532bull,
+    0xca273eceea26619cull, 0xd186b8c721c0c207ull, 0xeada7dd6cde0eb1eull, 0xf57d4f7fee6ed178ull,
+    0x06f067aa72176fbaull, 0x0a637dc5a2c898a6ull, 0x113f9804bef90daeull, 0x1b710b35131c471bull,
+    0x28db77f523047d84ull, 0x32caab7b40c72493ull, 0x3c9ebe0a15c9bebcull, 0x431d67c49c100d4cull,
+    0x4cc5d4becb3e42b6ull, 0x597f299cfc657e2aull, 0x5fcb6fab3ad6faecull, 0x6c44198c4a475817ull,
+};
+
+__m128i inline K(uint64_t x) { return _mm_set1_epi64x(x); }
+
+__m128i inline Add(__m128i x, __m128i y) { return _mm_add_epi64(x, y); }
+__m128i inline Add(__m128i x, __m128i y, __m128i z) { return Add(Add(x, y), z); }
+__m128i inline Add(__m128i x, __m128i y, __m128i z, __m128i w) { return Add(Add(x, y), Add(z, w)); }
+__m128i inline Add(__m128i x, __m128i y, __m128i z, __m128i w, __m128i v) { return Add(Add(x, y, z), Add(w, v)); }
+__m128i inline Xor(__m128i x, __m128i y) { return _mm_xor_si128(x, y); }
+__m128i inline Xor(__m128i x, __m128i y, __m128i z) { return Xor(Xor(x, y), z); }
+__m128i inline Or(__m128i x, __m128i y) { return _mm_or_si128(x, y); }
+__m128i inline And(__m128i x, __m128i y) { return _mm_and_si128(x, y); }
+__m128i inline ShR(__m128i x, int n) { return _mm_srli_epi64(x, n); }
+__m128i inline ShL(__m128i x, int n) { return _mm_slli_epi64(x, n); }
+
+__m128i inline Ch(__m128i x, __m128i y, __m128i z) { return Xor(z, And(x, Xor(y, z))); }
+__m128i inline Maj(__m128i x, __m128i y, __m128i z) { return Or(And(x, y), And(z, Or(x, y))); }
+__m128i inline Sigma0(__m128i x) { return Xor(Or(ShR(x, 28), ShL(x, 36)), Or(ShR(x, 34), ShL(x, 30)), Or(ShR(x, 39), ShL(x, 25))); }
+__m128i inline Sigma1(__m128i x) { return Xor(Or(ShR(x, 14), ShL(x, 50)), Or(ShR(x, 18), ShL(x, 46)), Or(ShR(x, 41), ShL(x, 23))); }
+__m128i inline sigma0(__m128i x) { return Xor(Or(ShR(x, 1), ShL(x, 63)), Or(ShR(x, 8), ShL(x, 56)), ShR(x, 7)); }
+__m128i inline sigma1(__m128i x) { return Xor(Or(ShR(x, 19), ShL(x, 45)), Or(ShR(x, 61), ShL(x, 3)), ShR(x, 6)); }
+
+/** One round of SHA-512. */
+void inline __attribute__((always_inline)) Round(__m128i a, __m128i b, __m128i c, __m128i& d, __m128i e, __m128i f, __m128i g, __m128i& h, __m128i k)
+{
+    __m128i t1 = Add(h, Sigma1(e), Ch(e, f, g), k);
+    __m128i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** Message word i plus its round constant, extending the schedule in place from round 16 on. */
+__m128i inline __attribute__((always_inline)) W(__m128i* w, int i)
+{
+    if (i >= 16) {
+        w[i & 15] = Add(w[i & 15], sigma1(w[(i - 2) & 15]), w[(i - 7) & 15], sigma0(w[(i - 15) & 15]));
+    }
+    return Add(w[i & 15], K(k[i]));
+}
+
+__m128i inline Read2(const unsigned char* chunk, int offset) {
+    return _mm_set_epi64x(ReadBE64(chunk + 128 + offset), ReadBE64(chunk + 0 + offset));
+}
+
+__m128i inline Load2(const uint64_t* s, int i) {
+    return _mm_set_epi64x(s[8 + i], s[0 + i]);
+}
+
+void inline Store2(uint64_t* s, int i, __m128i v) {
+    s[0 + i] = _mm_extract_epi64(v, 0);
+    s[8 + i] = _mm_extract_epi64(v, 1);
+}
+
+}
+
+void Transform_2way(uint64_t* s, const unsigned char* chunk)
+{
+    __m128i a = Load2(s, 0), b = Load2(s, 1), c = Load2(s, 2), d = Load2(s, 3);
+    __m128i e = Load2(s, 4), f = Load2(s, 5), g = Load2(s, 6), h = Load2(s, 7);
+    __m128i w[16];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = Read2(chunk, 8 * i);
+    }
+
+    for (int i = 0; i < 80; i += 8) {
+        Round(a, b, c, d, e, f, g, h, W(w, i + 0));
+        Round(h, a, b, c, d, e, f, g, W(w, i + 1));
+        Round(g, h, a, b, c, d, e, f, W(w, i + 2));
+        Round(f, g, h, a, b, c, d, e, W(w, i + 3));
+        Round(e, f, g, h, a, b, c, d, W(w, i + 4));
+        Round(d, e, f, g, h, a, b, c, W(w, i + 5));
+        Round(c, d, e, f, g, h, a, b, W(w, i + 6));
+        Round(b, c, d, e, f, g, h, a, W(w, i + 7));
+    }
+
+    Store2(s, 0, Add(a, Load2(s, 0)));
+    Store2(s, 1, Add(b, Load2(s, 1)));
+    Store2(s, 2, Add(c, Load2(s, 2)));
+    Store2(s, 3, Add(d, Load2(s, 3)));
+    Store2(s, 4, Add(e, Load2(s, 4)));
+    Store2(s, 5, Add(f, Load2(s, 5)));
+    Store2(s, 6, Add(g, Load2(s, 6)));
+    Store2(s, 7, Add(h, Load2(s, 7)));
+}
+
+}
+
+#endif
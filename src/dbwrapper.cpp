@@ -97,12 +97,88 @@ static void SetMaxOpenFiles(leveldb::Options *options) {
              options->max_open_files, default_open_files);
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize, bool compression, int maxOpenFiles)
+static bool ParseDBProfileOption(const std::string& option, std::string& name, std::string& key, int64_t& value)
+{
+    size_t nColon = option.find(':');
+    size_t nEquals = option.find('=', nColon);
+    if (nColon == std::string::npos || nColon == 0 || nEquals == std::string::npos) {
+        return false;
+    }
+    name = option.substr(0, nColon);
+    key = option.substr(nColon + 1, nEquals - nColon - 1);
+    return ParseInt64(option.substr(nEquals + 1), &value);
+}
+
+bool ReadDBProfile(const std::string& name, DBProfile& profile, std::string& error)
+{
+    for (const std::string& option : gArgs.GetArgs("-dbprofile")) {
+        std::string optionName, key;
+        int64_t value;
+        if (!ParseDBProfileOption(option, optionName, key, value)) {
+            error = strprintf("Malformed -dbprofile option '%s', expected <db>:<option>=<n>", option);
+            return false;
+        }
+        if (optionName != name) {
+            continue;
+        }
+        if (key == "bloombits" && value >= 0 && value <= 64) {
+            profile.nBloomBits = value;
+        } else
+        if (key == "blocksize" && value >= 1024 && value <= 1024 * 1024) {
+            profile.nBlockSize = value;
+        } else
+        if (key == "blockcache" && value >= 0 && value <= 100) {
+            profile.nBlockCachePercent = value;
+        } else
+        if (key == "compression" && (value == 0 || value == 1)) {
+            profile.nCompression = value;
+        } else {
+            error = strprintf("Unknown option or value out of range in -dbprofile '%s'", option);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CheckDBProfiles(std::string& error)
+{
+    for (const std::string& option : gArgs.GetArgs("-dbprofile")) {
+        std::string name, key;
+        int64_t value;
+        if (!ParseDBProfileOption(option, name, key, value)) {
+            error = strprintf("Malformed -dbprofile option '%s', expected <db>:<option>=<n>", option);
+            return false;
+        }
+        DBProfile profile;
+        if (!ReadDBProfile(name, profile, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string DescribeDBFilter(const std::string& name)
+{
+    DBProfile profile;
+    std::string strError;
+    if (!ReadDBProfile(name, profile, strError) || profile.nBloomBits == 0) {
+        return "no bloom filter";
+    }
+    return strprintf("%d bit bloom filter, %.1fMiB per million keys in open tables",
+        profile.nBloomBits, profile.nBloomBits * 1000000.0 / 8 / 1024 / 1024);
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, bool compression, int maxOpenFiles, const DBProfile& profile)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    size_t nBlockCacheSize = nCacheSize * profile.nBlockCachePercent / 100;
+    options.block_cache = leveldb::NewLRUCache(nBlockCacheSize);
+    options.write_buffer_size = std::max((nCacheSize - nBlockCacheSize) / 2, (size_t)64 << 10); // up to two write buffers may be held in memory simultaneously
+    options.block_size = profile.nBlockSize;
+    options.filter_policy = profile.nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(profile.nBloomBits) : nullptr;
+    if (profile.nCompression != -1) {
+        compression = profile.nCompression == 1;
+    }
     options.compression = compression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
     options.max_open_files = maxOpenFiles;
     options.info_log = new CBitcoinLevelDBLogger();
@@ -123,7 +199,16 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize, compression, maxOpenFiles);
+    DBProfile profile;
+    std::string strError;
+    if (!ReadDBProfile(m_name, profile, strError)) {
+        throw dbwrapper_error(strError);
+    }
+    if (gArgs.IsArgSet("-dbprofile")) {
+        LogPrintf("LevelDB profile for %s: bloombits=%d blocksize=%u blockcache=%d%% compression=%d\n", m_name,
+            profile.nBloomBits, profile.nBlockSize, profile.nBlockCachePercent, profile.nCompression);
+    }
+    options = GetOptions(nCacheSize, compression, maxOpenFiles, profile);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -234,9 +319,19 @@ bool CDBWrapper::IsEmpty()
     return !(it->Valid());
 }
 
+CDBSnapshot::CDBSnapshot(const CDBWrapper &db) : pdb(db.pdb), psnapshot(db.pdb->GetSnapshot())
+{
+}
+
+CDBSnapshot::~CDBSnapshot()
+{
+    pdb->ReleaseSnapshot(psnapshot);
+}
+
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() const { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
+void CDBIterator::SeekToLast() { piter->SeekToLast(); }
 void CDBIterator::Next() { piter->Next(); }
 
 namespace dbwrapper_private {
@@ -13,6 +13,9 @@
 #include <utilstrencodings.h>
 #include <version.h>
 
+#include <algorithm>
+#include <memory>
+
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
@@ -27,6 +30,38 @@ public:
 
 class CDBWrapper;
 
+/**
+ * LevelDB tuning of one database, overridden per database name (the directory
+ * name: chainstate, index, txindex) with -dbprofile=<name>:<option>=<value>.
+ */
+struct DBProfile
+{
+    //! Bits per key of the bloom filter, 0 for no filter
+    int nBloomBits = 10;
+    //! Approximate size of the uncompressed data in a table block
+    size_t nBlockSize = 4 * 1024;
+    //! Percent of the database's cache size used as block cache, half the rest goes to each write buffer
+    int nBlockCachePercent = 50;
+    //! -1 to use the compression passed to the CDBWrapper, else 0 or 1
+    int nCompression = -1;
+};
+
+/**
+ * Apply the -dbprofile options for database name to profile.
+ * Returns false and sets error if one of them is malformed.
+ */
+bool ReadDBProfile(const std::string& name, DBProfile& profile, std::string& error);
+
+/** Check that all -dbprofile options parse */
+bool CheckDBProfiles(std::string& error);
+
+/**
+ * Describe the bloom filter of database name and its memory cost, for the cache
+ * sizing log. Filters of the tables leveldb keeps open stay in memory, their size
+ * grows with the number of keys in those tables rather than with the cache size.
+ */
+std::string DescribeDBFilter(const std::string& name);
+
 /** These should be considered an implementation detail of the specific database.
  */
 namespace dbwrapper_private {
@@ -111,9 +146,45 @@ public:
         ssKey.clear();
     }
 
+    /** Queue a key and value serialized by the caller, the value must already be obfuscated */
+    void WriteSerialized(const std::vector<unsigned char>& key, const std::vector<unsigned char>& value)
+    {
+        leveldb::Slice slKey((const char*)key.data(), key.size());
+        leveldb::Slice slValue((const char*)value.data(), value.size());
+        batch.Put(slKey, slValue);
+        size_estimate += 3 + (slKey.size() > 127) + slKey.size() + (slValue.size() > 127) + slValue.size();
+    }
+
+    void EraseSerialized(const std::vector<unsigned char>& key)
+    {
+        leveldb::Slice slKey((const char*)key.data(), key.size());
+        batch.Delete(slKey);
+        size_estimate += 2 + (slKey.size() > 127) + slKey.size();
+    }
+
     size_t SizeEstimate() const { return size_estimate; }
 };
 
+/**
+ * A consistent view of a CDBWrapper as it was when constructed, reads through
+ * it don't see later writes. Must not outlive the database.
+ */
+class CDBSnapshot
+{
+private:
+    leveldb::DB *pdb;
+    const leveldb::Snapshot *psnapshot;
+
+public:
+    explicit CDBSnapshot(const CDBWrapper &db);
+    ~CDBSnapshot();
+
+    CDBSnapshot(const CDBSnapshot&) = delete;
+    CDBSnapshot& operator=(const CDBSnapshot&) = delete;
+
+    const leveldb::Snapshot *Get() const { return psnapshot; }
+};
+
 class CDBIterator
 {
 private:
@@ -133,6 +204,7 @@ public:
     bool Valid() const;
 
     void SeekToFirst();
+    void SeekToLast();
 
     template<typename K> void Seek(const K& key) {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
@@ -177,6 +249,7 @@ public:
 class CDBWrapper
 {
     friend const std::vector<unsigned char>& dbwrapper_private::GetObfuscateKey(const CDBWrapper &w);
+    friend class CDBSnapshot;
 private:
     //! custom environment this database is using (may be nullptr in case of default environment)
     leveldb::Env* penv;
@@ -213,6 +286,15 @@ private:
 
     std::vector<unsigned char> CreateObfuscateKey() const;
 
+    //! options reading through snapshot, or the latest state if null
+    static leveldb::ReadOptions WithSnapshot(leveldb::ReadOptions options, const CDBSnapshot *snapshot)
+    {
+        if (snapshot) {
+            options.snapshot = snapshot->Get();
+        }
+        return options;
+    }
+
 public:
     /**
      * @param[in] path          Location in the filesystem where leveldb data will be stored.
@@ -232,7 +314,7 @@ public:
     CDBWrapper& operator=(const CDBWrapper&) = delete;
 
     template <typename K, typename V>
-    bool Read(const K& key, V& value) const
+    bool Read(const K& key, V& value, const CDBSnapshot *snapshot = nullptr) const
     {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
@@ -240,7 +322,7 @@ public:
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(WithSnapshot(readoptions, snapshot), slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -257,6 +339,51 @@ public:
         return true;
     }
 
+    /**
+     * Read the values for many keys with a single iterator.
+     * Keys are visited in db order, so runs of adjacent keys cost one step each.
+     * values is filled in the order of keys, returns false if any key is missing.
+     */
+    template <typename K, typename V>
+    bool ReadMany(const std::vector<K>& keys, std::vector<V>& values, const CDBSnapshot *snapshot = nullptr) const
+    {
+        std::vector<std::pair<std::string, size_t> > vKeys;
+        vKeys.reserve(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+            ssKey << keys[i];
+            vKeys.emplace_back(ssKey.str(), i);
+        }
+        // std::string compares as unsigned bytes, matching leveldb's default comparator
+        std::sort(vKeys.begin(), vKeys.end());
+
+        values.resize(keys.size());
+        std::unique_ptr<leveldb::Iterator> piter(pdb->NewIterator(WithSnapshot(readoptions, snapshot)));
+        for (const auto &k : vKeys) {
+            leveldb::Slice slKey(k.first);
+            if (!piter->Valid() || piter->key().compare(slKey) != 0) {
+                if (piter->Valid() && piter->key().compare(slKey) < 0)
+                    piter->Next();
+                if (!piter->Valid() || piter->key().compare(slKey) < 0)
+                    piter->Seek(slKey);
+                if (!piter->Valid() || piter->key().compare(slKey) != 0) {
+                    dbwrapper_private::HandleError(piter->status());
+                    return false;
+                }
+            }
+            try {
+                leveldb::Slice slValue = piter->value();
+                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                ssValue.Xor(obfuscate_key);
+                ssValue >> values[k.second];
+            } catch (const std::exception&) {
+                return false;
+            }
+        }
+        return true;
+    }
+
     template <typename K, typename V>
     bool Write(const K& key, const V& value, bool fSync = false)
     {
@@ -309,9 +436,9 @@ public:
         return WriteBatch(batch, true);
     }
 
-    CDBIterator *NewIterator()
+    CDBIterator *NewIterator(const CDBSnapshot *snapshot = nullptr)
     {
-        return new CDBIterator(*this, pdb->NewIterator(iteroptions));
+        return new CDBIterator(*this, pdb->NewIterator(WithSnapshot(iteroptions, snapshot)));
     }
 
     /**
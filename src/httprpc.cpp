@@ -7,6 +7,7 @@
 #include <chainparams.h>
 #include <httpserver.h>
 #include <key_io.h>
+#include <rpc/jsonstream.h>
 #include <rpc/protocol.h>
 #include <rpc/server.h>
 #include <random.h>
@@ -65,6 +66,8 @@ private:
 static std::string strRPCUserColonPass;
 /* Stored RPC timer interface (for unregistration) */
 static std::unique_ptr<HTTPRPCTimerInterface> httpRPCTimerInterface;
+/* Requests of one batch executed in parallel */
+static int nRPCBatchThreads = DEFAULT_RPC_BATCH_THREADS;
 
 static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const UniValue& id)
 {
@@ -183,6 +186,19 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         return false;
     }
 
+    // Singleton results can be streamed as a chunked reply, the reply object is
+    // opened with the first chunk and closed after the handler returns
+    bool fStreamStarted = false;
+    CJSONStreamWriter stream([req, &fStreamStarted](const std::string& strChunk) {
+        if (!fStreamStarted) {
+            fStreamStarted = true;
+            req->WriteHeader("Content-Type", "application/json");
+            req->StartReplyChunked(HTTP_OK);
+            req->WriteReplyChunk("{\"result\":");
+        }
+        req->WriteReplyChunk(strChunk);
+    });
+
     try {
         // Parse request
         UniValue valRequest;
@@ -197,23 +213,45 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
+            jreq.stream = &stream;
             UniValue result = tableRPC.execute(jreq);
 
             // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            if (stream.IsStarted()) {
+                stream.Flush();
+                req->WriteReplyChunk(",\"error\":null,\"id\":" + jreq.id.write() + "}\n");
+                req->EndReplyChunked();
+                return true;
+            }
+            if (stream.HasOutput()) {
+                strReply = "{\"result\":" + stream.TakeBuffer() + ",\"error\":null,\"id\":" + jreq.id.write() + "}\n";
+            } else {
+                strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            }
 
         // array of requests
         } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(jreq, valRequest.get_array());
+            strReply = JSONRPCExecBatch(jreq, valRequest.get_array(), EnqueueHTTPTask, nRPCBatchThreads);
         else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strReply);
     } catch (const UniValue& objError) {
+        if (stream.IsStarted()) {
+            // Too late for an error reply, end the reply early and leave the json unterminated
+            LogPrintf("%s: %s failed after streaming began: %s\n", __func__, jreq.strMethod, objError.write());
+            req->EndReplyChunked();
+            return false;
+        }
         JSONErrorReply(req, objError, jreq.id);
         return false;
     } catch (const std::exception& e) {
+        if (stream.IsStarted()) {
+            LogPrintf("%s: %s failed after streaming began: %s\n", __func__, jreq.strMethod, e.what());
+            req->EndReplyChunked();
+            return false;
+        }
         JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
         return false;
     }
@@ -248,6 +286,8 @@ bool StartHTTPRPC()
     if (!InitRPCAuthentication())
         return false;
 
+    nRPCBatchThreads = std::max((int)gArgs.GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), 1);
+
     RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
 #ifdef ENABLE_WALLET
     // ifdef can be removed once we switch to better endpoint support and API versioning
@@ -8,6 +8,9 @@
 #include <string>
 #include <map>
 
+/** Maximum number of requests of one batch executed in parallel, 1 keeps batches in request order */
+static const int DEFAULT_RPC_BATCH_THREADS = 1;
+
 /** Start HTTP RPC subsystem.
  * Precondition; HTTP and RPC has been started.
  */
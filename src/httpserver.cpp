@@ -85,11 +85,11 @@ public:
     ~WorkQueue()
     {
     }
-    /** Enqueue a work item */
-    bool Enqueue(WorkItem* item)
+    /** Enqueue a work item, leaving at least nKeepFree slots of the queue empty */
+    bool Enqueue(WorkItem* item, size_t nKeepFree = 0)
     {
         std::unique_lock<std::mutex> lock(cs);
-        if (queue.size() >= maxDepth) {
+        if (queue.size() + nKeepFree >= maxDepth) {
             return false;
         }
         queue.emplace_back(std::unique_ptr<WorkItem>(item));
@@ -113,6 +113,10 @@ public:
             (*i)();
         }
     }
+    size_t MaxDepth() const
+    {
+        return maxDepth;
+    }
     /** Interrupt and exit loops */
     void Interrupt()
     {
@@ -122,6 +126,22 @@ public:
     }
 };
 
+/** Task work item, for work split off a request */
+class HTTPTaskItem final : public HTTPClosure
+{
+public:
+    explicit HTTPTaskItem(const std::function<void()>& _task) : task(_task)
+    {
+    }
+    void operator()() override
+    {
+        task();
+    }
+
+private:
+    std::function<void()> task;
+};
+
 struct HTTPPathHandler
 {
     HTTPPathHandler() {}
@@ -442,6 +462,20 @@ void StartHTTPServer()
     }
 }
 
+bool EnqueueHTTPTask(const std::function<void()>& task)
+{
+    if (!workQueue) {
+        return false;
+    }
+    // Leave half the queue to incoming requests
+    std::unique_ptr<HTTPTaskItem> item(new HTTPTaskItem(task));
+    if (workQueue->Enqueue(item.get(), workQueue->MaxDepth() / 2)) {
+        item.release();
+        return true;
+    }
+    return false;
+}
+
 void InterruptHTTPServer()
 {
     LogPrint(BCLog::HTTP, "Interrupting HTTP server\n");
@@ -528,11 +562,15 @@ void HTTPEvent::trigger(struct timeval* tv)
         evtimer_add(ev, tv); // trigger after timeval passed
 }
 HTTPRequest::HTTPRequest(struct evhttp_request* _req) : req(_req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       replyChunked(false)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
+    if (!replySent && replyChunked) {
+        EndReplyChunked();
+    }
     if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
@@ -584,9 +622,24 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  * Replies must be sent in the main loop in the main http thread,
  * this cannot be done from worker threads.
  */
+/** Re-enable reading from the socket. This is the second part of the libevent
+ * workaround above. */
+static void ReenableRequestRead(struct evhttp_request* req)
+{
+    if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
+        evhttp_connection* conn = evhttp_request_get_connection(req);
+        if (conn) {
+            bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+            if (bev) {
+                bufferevent_enable(bev, EV_READ | EV_WRITE);
+            }
+        }
+    }
+}
+
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
-    assert(!replySent && req);
+    assert(!replySent && !replyChunked && req);
     // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
@@ -594,17 +647,51 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     auto req_copy = req;
     HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
         evhttp_send_reply(req_copy, nStatus, nullptr, nullptr);
-        // Re-enable reading from the socket. This is the second part of the libevent
-        // workaround above.
-        if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
-            evhttp_connection* conn = evhttp_request_get_connection(req_copy);
-            if (conn) {
-                bufferevent* bev = evhttp_connection_get_bufferevent(conn);
-                if (bev) {
-                    bufferevent_enable(bev, EV_READ | EV_WRITE);
-                }
-            }
+        ReenableRequestRead(req_copy);
+    });
+    ev->trigger(nullptr);
+    replySent = true;
+    req = nullptr; // transferred back to main thread
+}
+
+void HTTPRequest::StartReplyChunked(int nStatus)
+{
+    assert(!replySent && !replyChunked && req);
+    // Events are run in the order triggered, chunks follow the start of the reply
+    auto req_copy = req;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
+        evhttp_send_reply_start(req_copy, nStatus, nullptr);
+    });
+    ev->trigger(nullptr);
+    replyChunked = true;
+}
+
+void HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(!replySent && replyChunked && req);
+    if (strChunk.empty()) {
+        return; // An empty chunk would end the reply
+    }
+    auto req_copy = req;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, strChunk]{
+        struct evbuffer* evb = evbuffer_new();
+        if (!evb) {
+            return;
         }
+        evbuffer_add(evb, strChunk.data(), strChunk.size());
+        evhttp_send_reply_chunk(req_copy, evb);
+        evbuffer_free(evb);
+    });
+    ev->trigger(nullptr);
+}
+
+void HTTPRequest::EndReplyChunked()
+{
+    assert(!replySent && replyChunked && req);
+    auto req_copy = req;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy]{
+        evhttp_send_reply_end(req_copy);
+        ReenableRequestRead(req_copy);
     });
     ev->trigger(nullptr);
     replySent = true;
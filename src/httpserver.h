@@ -32,6 +32,11 @@ void InterruptHTTPServer();
 /** Stop HTTP server */
 void StopHTTPServer();
 
+/** Run a task on the HTTP worker threads.
+ * Returns false if the server is not running or the work queue is more than half full.
+ */
+bool EnqueueHTTPTask(const std::function<void()>& task);
+
 /** Change logging level for libevent. Removes BCLog::LIBEVENT from log categories if
  * libevent doesn't support debug logging.*/
 bool UpdateHTTPServerLogging(bool enable);
@@ -59,6 +64,7 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    bool replyChunked;
 
 public:
     explicit HTTPRequest(struct evhttp_request* req);
@@ -115,6 +121,17 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a chunked HTTP reply, for bodies produced incrementally.
+     * The body is passed in WriteReplyChunk calls and closed by EndReplyChunked.
+     *
+     * @note Write all headers before calling this. Like WriteReply, EndReplyChunked
+     * gives the request back to the main thread.
+     */
+    void StartReplyChunked(int nStatus);
+    void WriteReplyChunk(const std::string& strChunk);
+    void EndReplyChunked();
 };
 
 /** Event handler closure.
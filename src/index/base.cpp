@@ -15,6 +15,7 @@ constexpr char DB_BEST_BLOCK = 'B';
 
 constexpr int64_t SYNC_LOG_INTERVAL = 30; // seconds
 constexpr int64_t SYNC_LOCATOR_WRITE_INTERVAL = 30; // seconds
+constexpr int64_t SYNC_POLL_INTERVAL = 500; // milliseconds, while SyncCompleted defers
 
 template<typename... Args>
 static void FatalError(const char* fmt, const Args&... args)
@@ -95,16 +96,25 @@ void BaseIndex::ThreadSync()
                 return;
             }
 
+            const CBlockIndex* pindex_next;
             {
                 LOCK(cs_main);
-                const CBlockIndex* pindex_next = NextSyncBlock(pindex);
+                pindex_next = NextSyncBlock(pindex);
                 if (!pindex_next) {
-                    WriteBestBlock(pindex);
-                    m_best_block_index = pindex;
-                    m_synced = true;
-                    break;
+                    if (SyncCompleted()) {
+                        WriteBestBlock(pindex);
+                        m_best_block_index = pindex;
+                        m_synced = true;
+                        break;
+                    }
+                } else {
+                    pindex = pindex_next;
                 }
-                pindex = pindex_next;
+            }
+
+            if (!pindex_next) {
+                m_interrupt.sleep_for(std::chrono::milliseconds(SYNC_POLL_INTERVAL));
+                continue;
             }
 
             int64_t current_time = GetTime();
@@ -74,6 +74,11 @@ protected:
     /// Undo update index entries for a newly connected block.
     virtual bool EraseBlock(const CBlock& block) { return true; }
 
+    /// Called with cs_main held once the sync thread reached the chain tip,
+    /// before m_synced is set. Returning false keeps the sync thread polling
+    /// for new blocks instead.
+    virtual bool SyncCompleted() { return true; }
+
     virtual DB& GetDB() const = 0;
 
     /// Get the name of the index for display in logs.
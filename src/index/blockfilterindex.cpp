@@ -0,0 +1,253 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/blockfilterindex.h>
+#include <util.h>
+#include <validation.h>
+
+/* The index database stores two items for each block, keyed by height:
+ * - A value holding the block hash, the filter hash and the filter header.
+ * - The encoded filter.
+ * Both are overwritten when a block at the same height is connected after a reorg, lookups
+ * check the stored block hash against the requested block.
+ *
+ * The height keys are serialized big-endian, so the rows of a range are adjacent and a
+ * cursor visits them in height order.
+ */
+constexpr char DB_BLOCK_HEIGHT = 't';
+constexpr char DB_FILTER = 'f';
+
+std::unique_ptr<BlockFilterIndex> g_blockfilterindex;
+
+namespace {
+
+struct DBVal {
+    uint256 hash;
+    uint256 filter_hash;
+    uint256 header;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hash);
+        READWRITE(filter_hash);
+        READWRITE(header);
+    }
+};
+
+template <char prefix>
+struct DBHeightKey {
+    int height;
+
+    DBHeightKey() : height(0) {}
+    explicit DBHeightKey(int height_in) : height(height_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, prefix);
+        ser_writedata32be(s, height);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix_in = ser_readdata8(s);
+        if (prefix_in != prefix) {
+            throw std::ios_base::failure("Invalid format for block filter index DB height key");
+        }
+        height = ser_readdata32be(s);
+    }
+};
+
+typedef DBHeightKey<DB_BLOCK_HEIGHT> DBValKey;
+typedef DBHeightKey<DB_FILTER> DBFilterKey;
+
+} // namespace
+
+BlockFilterIndex::BlockFilterIndex(BlockFilterType filter_type,
+                                   size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_filter_type(filter_type)
+{
+    const std::string& filter_name = BlockFilterTypeName(filter_type);
+    if (filter_name.empty()) throw std::invalid_argument("unknown filter_type");
+
+    m_name = filter_name + " block filter index";
+    m_db = MakeUnique<BaseIndex::DB>(GetDataDir() / "indexes" / "blockfilter" / filter_name,
+                                     n_cache_size, f_memory, f_wipe);
+}
+
+bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo block_undo;
+    uint256 prev_header;
+
+    if (pindex->nHeight > 0) {
+        if (!UndoReadFromDisk(block_undo, pindex)) {
+            return false;
+        }
+
+        DBVal prev_val;
+        if (!m_db->Read(DBValKey(pindex->nHeight - 1), prev_val)) {
+            return error("%s: previous filter header of block %s not found", __func__,
+                         pindex->GetBlockHash().ToString());
+        }
+        if (prev_val.hash != pindex->pprev->GetBlockHash()) {
+            return error("%s: previous filter header of block %s is for block %s", __func__,
+                         pindex->GetBlockHash().ToString(), prev_val.hash.ToString());
+        }
+        prev_header = prev_val.header;
+    }
+
+    BlockFilter filter(m_filter_type, block, block_undo);
+
+    DBVal value;
+    value.hash = pindex->GetBlockHash();
+    value.filter_hash = filter.GetHash();
+    value.header = filter.ComputeHeader(prev_header);
+
+    CDBBatch batch(*m_db);
+    batch.Write(DBValKey(pindex->nHeight), value);
+    batch.Write(DBFilterKey(pindex->nHeight), filter.GetEncodedFilter());
+    return m_db->WriteBatch(batch);
+}
+
+bool BlockFilterIndex::EraseBlock(const CBlock& block)
+{
+    int height;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = LookupBlockIndex(block.GetHash());
+        if (!pindex) {
+            return error("%s: Block %s not found.", __func__, block.GetHash().ToString());
+        }
+        height = pindex->nHeight;
+    }
+
+    CDBBatch batch(*m_db);
+    batch.Erase(DBValKey(height));
+    batch.Erase(DBFilterKey(height));
+    return m_db->WriteBatch(batch);
+}
+
+bool BlockFilterIndex::LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out) const
+{
+    DBVal value;
+    std::vector<unsigned char> encoded_filter;
+    if (!m_db->Read(DBValKey(block_index->nHeight), value)
+        || value.hash != block_index->GetBlockHash()
+        || !m_db->Read(DBFilterKey(block_index->nHeight), encoded_filter)) {
+        return false;
+    }
+
+    try {
+        filter_out = BlockFilter(m_filter_type, block_index->GetBlockHash(), std::move(encoded_filter));
+    } catch (const std::exception& e) {
+        return error("%s: Failed to decode filter of block %s: %s", __func__,
+                     block_index->GetBlockHash().ToString(), e.what());
+    }
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out) const
+{
+    DBVal value;
+    if (!m_db->Read(DBValKey(block_index->nHeight), value)
+        || value.hash != block_index->GetBlockHash()) {
+        return false;
+    }
+
+    header_out = value.header;
+    return true;
+}
+
+/** Read the DBVal rows from start_height to the height of stop_index, checking each belongs
+ *  to the chain ending at stop_index. */
+static bool LookupRange(CDBWrapper& db, int start_height, const CBlockIndex* stop_index,
+                        std::vector<DBVal>& results)
+{
+    if (start_height < 0) {
+        return error("%s: start height (%d) is negative", __func__, start_height);
+    }
+    if (start_height > stop_index->nHeight) {
+        return error("%s: start height (%d) is greater than stop height (%d)",
+                     __func__, start_height, stop_index->nHeight);
+    }
+
+    size_t results_size = static_cast<size_t>(stop_index->nHeight - start_height + 1);
+    results.clear();
+    results.reserve(results_size);
+
+    std::unique_ptr<CDBIterator> db_it(db.NewIterator());
+    db_it->Seek(DBValKey(start_height));
+    for (int height = start_height; height <= stop_index->nHeight; ++height) {
+        DBValKey key;
+        if (!db_it->Valid() || !db_it->GetKey(key) || key.height != height) {
+            return false;
+        }
+
+        results.emplace_back();
+        if (!db_it->GetValue(results.back())) {
+            return error("%s: unable to read value in %s at key (%c, %d)",
+                         __func__, "block filter index", DB_BLOCK_HEIGHT, height);
+        }
+
+        db_it->Next();
+    }
+
+    // Check the rows are for the blocks of the requested chain, they may belong to a chain
+    // the index has not caught up from yet.
+    const CBlockIndex* pindex = stop_index;
+    for (size_t i = results.size(); i-- > 0; pindex = pindex->pprev) {
+        if (results[i].hash != pindex->GetBlockHash()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterRange(int start_height, const CBlockIndex* stop_index,
+                                         std::vector<BlockFilter>& filters_out) const
+{
+    std::vector<DBVal> entries;
+    if (!LookupRange(*m_db, start_height, stop_index, entries)) {
+        return false;
+    }
+
+    filters_out.clear();
+    filters_out.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        std::vector<unsigned char> encoded_filter;
+        if (!m_db->Read(DBFilterKey(start_height + (int)i), encoded_filter)) {
+            return false;
+        }
+        try {
+            filters_out.emplace_back(m_filter_type, entries[i].hash, std::move(encoded_filter));
+        } catch (const std::exception& e) {
+            return error("%s: Failed to decode filter of block %s: %s", __func__,
+                         entries[i].hash.ToString(), e.what());
+        }
+    }
+
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterHashRange(int start_height, const CBlockIndex* stop_index,
+                                             std::vector<uint256>& hashes_out) const
+{
+    std::vector<DBVal> entries;
+    if (!LookupRange(*m_db, start_height, stop_index, entries)) {
+        return false;
+    }
+
+    hashes_out.clear();
+    hashes_out.reserve(entries.size());
+    for (const DBVal& entry : entries) {
+        hashes_out.push_back(entry.filter_hash);
+    }
+    return true;
+}
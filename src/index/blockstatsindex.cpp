@@ -0,0 +1,342 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/blockstatsindex.h>
+#include <coins.h>
+#include <consensus/validation.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+#include <algorithm>
+
+/* The index database stores the hash and stats of each block, keyed by height like the
+ * block filter index. A row is overwritten when a block at the same height is connected
+ * after a reorg, lookups check the stored block hash against the requested block.
+ */
+constexpr char DB_BLOCK_STATS = 's';
+
+std::unique_ptr<BlockStatsIndex> g_blockstatsindex;
+
+// outpoint (needed for the utxo index) + nHeight + fCoinBase
+static constexpr size_t PER_UTXO_OVERHEAD = sizeof(COutPoint) + sizeof(uint32_t) + sizeof(bool);
+
+template<typename T>
+static T CalculateTruncatedMedian(std::vector<T>& scores)
+{
+    size_t size = scores.size();
+    if (size == 0) {
+        return 0;
+    }
+
+    std::sort(scores.begin(), scores.end());
+    if (size % 2 == 0) {
+        return (scores[size / 2 - 1] + scores[size / 2]) / 2;
+    } else {
+        return scores[size / 2];
+    }
+}
+
+bool ComputeBlockStats(const CBlock& block, const SpentOutputFunction* get_spent, CBlockStats& stats, std::string& error)
+{
+    stats = CBlockStats();
+    stats.fHaveFees = get_spent != nullptr;
+    stats.txs = block.vtx.size();
+
+    CAmount minfee = MAX_MONEY;
+    CAmount minfeerate = MAX_MONEY;
+    int64_t mintxsize = MAX_BLOCK_SERIALIZED_SIZE;
+    std::vector<CAmount> fee_array;
+    std::vector<std::pair<CAmount, int64_t>> feerate_array;
+    std::vector<int64_t> txsize_array;
+
+    for (size_t nTx = 0; nTx < block.vtx.size(); ++nTx) {
+        const CTransaction& tx = *block.vtx[nTx];
+        stats.outs += tx.vout.size() + tx.vpout.size();
+
+        CAmount tx_total_out = 0;
+        for (const CTxOut& out : tx.vout) {
+            tx_total_out += out.nValue;
+            stats.utxo_size_inc += GetSerializeSize(out, SER_NETWORK, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
+        }
+        for (const auto& out : tx.vpout) {
+            if (out->IsStandardOutput()) {
+                tx_total_out += out->GetValue();
+            } else
+            if (out->IsType(OUTPUT_RINGCT)) {
+                stats.anon_outs++;
+            } else
+            if (out->IsType(OUTPUT_DATA)) {
+                stats.data_outs++;
+            }
+            stats.utxo_size_inc += GetSerializeSize(*out, SER_NETWORK, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD + 1;
+        }
+
+        if (tx.IsCoinBase()) {
+            continue;
+        }
+
+        stats.ins += tx.vin.size(); // Don't count coinbase's fake input
+        stats.total_out += tx_total_out; // Don't count coinbase reward
+
+        int64_t tx_size = tx.GetTotalSize();
+        txsize_array.push_back(tx_size);
+        stats.maxtxsize = std::max(stats.maxtxsize, tx_size);
+        mintxsize = std::min(mintxsize, tx_size);
+        stats.total_size += tx_size;
+
+        int64_t weight = GetTransactionWeight(tx);
+        stats.total_weight += weight;
+
+        if (tx.HasWitness()) {
+            ++stats.swtxs;
+            stats.swtotal_size += tx_size;
+            stats.swtotal_weight += weight;
+        }
+
+        for (const CTxIn& in : tx.vin) {
+            uint32_t nInputs, nRingSize;
+            if (!in.IsAnonInput() || !in.GetAnonInfo(nInputs, nRingSize)) {
+                continue;
+            }
+            if (stats.anon_ins == 0 || nRingSize < stats.min_ringsize) {
+                stats.min_ringsize = nRingSize;
+            }
+            stats.max_ringsize = std::max(stats.max_ringsize, (int64_t)nRingSize);
+            stats.total_ringsize += nRingSize;
+            stats.key_images += nInputs;
+            stats.anon_ins++;
+        }
+
+        if (!get_spent) {
+            continue;
+        }
+
+        CAmount tx_total_in = 0;
+        for (size_t nIn = 0; nIn < tx.vin.size(); ++nIn) {
+            if (tx.vin[nIn].IsAnonInput()) {
+                continue;
+            }
+            CAmount nValue;
+            int64_t nSize;
+            if (!(*get_spent)(nTx, nIn, nValue, nSize)) {
+                error = strprintf("Spent output of input %d of txn %s not found", nIn, tx.GetHash().ToString());
+                return false;
+            }
+            tx_total_in += nValue;
+            stats.utxo_size_inc -= nSize + PER_UTXO_OVERHEAD;
+        }
+
+        CAmount txfee;
+        if (tx.IsCoinStake()) {
+            txfee = 0;
+        } else
+        if (!tx.GetCTFee(txfee)) {
+            txfee = tx_total_in - tx_total_out;
+        }
+
+        if (!MoneyRange(txfee)) {
+            error = strprintf("Fee of txn %s out of range", tx.GetHash().ToString());
+            return false;
+        }
+        fee_array.push_back(txfee);
+        stats.maxfee = std::max(stats.maxfee, txfee);
+        minfee = std::min(minfee, txfee);
+        stats.totalfee += txfee;
+
+        // New feerate uses satoshis per virtual byte instead of per serialized byte
+        CAmount feerate = weight ? (txfee * WITNESS_SCALE_FACTOR) / weight : 0;
+        feerate_array.emplace_back(std::make_pair(feerate, weight));
+        stats.maxfeerate = std::max(stats.maxfeerate, feerate);
+        minfeerate = std::min(minfeerate, feerate);
+    }
+
+    stats.mintxsize = mintxsize == MAX_BLOCK_SERIALIZED_SIZE ? 0 : mintxsize;
+    stats.mediantxsize = CalculateTruncatedMedian(txsize_array);
+    stats.minfee = minfee == MAX_MONEY ? 0 : minfee;
+    stats.minfeerate = minfeerate == MAX_MONEY ? 0 : minfeerate;
+    stats.medianfee = CalculateTruncatedMedian(fee_array);
+    CalculatePercentilesByWeight(stats.feerate_percentiles, feerate_array, stats.total_weight);
+
+    return true;
+}
+
+SpentOutputFunction SpentOutputsFromUndo(const CBlock& block, const CBlockUndo& block_undo)
+{
+    // Same pairing of txns and undo records as DisconnectBlock
+    std::vector<int> undo_pos(block.vtx.size(), -1);
+    int n = 0;
+    for (size_t i = fBitcoinCMode ? 0 : 1; i < block.vtx.size(); ++i) {
+        if (!fBitcoinCMode || !block.vtx[i]->IsCoinBase()) {
+            undo_pos[i] = n++;
+        }
+    }
+    if (n != (int)block_undo.vtxundo.size()) {
+        undo_pos.assign(block.vtx.size(), -1);
+    }
+
+    return [&block, &block_undo, undo_pos](size_t nTx, size_t nIn, CAmount& nValue, int64_t& nSize) {
+        if (nTx >= undo_pos.size() || undo_pos[nTx] < 0) {
+            return false;
+        }
+
+        // Undo records skip the anon inputs
+        const CTransaction& tx = *block.vtx[nTx];
+        size_t nCoin = 0;
+        for (size_t k = 0; k < nIn; ++k) {
+            if (!tx.vin[k].IsAnonInput()) {
+                nCoin++;
+            }
+        }
+
+        const CTxUndo& txundo = block_undo.vtxundo[undo_pos[nTx]];
+        if (nCoin >= txundo.vprevout.size()) {
+            return false;
+        }
+
+        // Spent outputs are plain, the size matches their CTxOut and CTxOutStandard serialization
+        const Coin& coin = txundo.vprevout[nCoin];
+        nValue = coin.nType == OUTPUT_STANDARD ? coin.out.nValue : 0;
+        nSize = GetSerializeSize(coin.out, SER_NETWORK, PROTOCOL_VERSION);
+        return true;
+    };
+}
+
+namespace {
+
+struct DBVal {
+    uint256 hash;
+    CBlockStats stats;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hash);
+        READWRITE(stats);
+    }
+};
+
+struct DBHeightKey {
+    int height;
+
+    DBHeightKey() : height(0) {}
+    explicit DBHeightKey(int height_in) : height(height_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_BLOCK_STATS);
+        ser_writedata32be(s, height);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix_in = ser_readdata8(s);
+        if (prefix_in != DB_BLOCK_STATS) {
+            throw std::ios_base::failure("Invalid format for block stats index DB height key");
+        }
+        height = ser_readdata32be(s);
+    }
+};
+
+} // namespace
+
+BlockStatsIndex::BlockStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+{
+    m_db = MakeUnique<BaseIndex::DB>(GetDataDir() / "indexes" / "blockstats", n_cache_size, f_memory, f_wipe);
+}
+
+bool BlockStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo block_undo;
+    if (pindex->nHeight > 0 && !UndoReadFromDisk(block_undo, pindex)) {
+        return false;
+    }
+
+    DBVal value;
+    value.hash = pindex->GetBlockHash();
+
+    // The genesis block has no undo data and spends nothing
+    std::string strError;
+    SpentOutputFunction get_spent = SpentOutputsFromUndo(block, block_undo);
+    if (!ComputeBlockStats(block, pindex->nHeight > 0 ? &get_spent : nullptr, value.stats, strError)) {
+        return error("%s: block %s: %s", __func__, value.hash.ToString(), strError);
+    }
+    value.stats.fHaveFees = true;
+
+    return m_db->Write(DBHeightKey(pindex->nHeight), value);
+}
+
+bool BlockStatsIndex::EraseBlock(const CBlock& block)
+{
+    int height;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = LookupBlockIndex(block.GetHash());
+        if (!pindex) {
+            return error("%s: Block %s not found.", __func__, block.GetHash().ToString());
+        }
+        height = pindex->nHeight;
+    }
+
+    return m_db->Erase(DBHeightKey(height));
+}
+
+bool BlockStatsIndex::LookupStats(const CBlockIndex* block_index, CBlockStats& stats_out) const
+{
+    DBVal value;
+    if (!m_db->Read(DBHeightKey(block_index->nHeight), value)
+        || value.hash != block_index->GetBlockHash()) {
+        return false;
+    }
+
+    stats_out = value.stats;
+    return true;
+}
+
+bool BlockStatsIndex::LookupStatsRange(int start_height, const CBlockIndex* stop_index,
+                                       std::vector<CBlockStats>& stats_out) const
+{
+    if (start_height < 0 || start_height > stop_index->nHeight) {
+        return error("%s: start height (%d) outside 0 to stop height (%d)",
+                     __func__, start_height, stop_index->nHeight);
+    }
+
+    std::vector<DBVal> results;
+    results.reserve(stop_index->nHeight - start_height + 1);
+
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+    db_it->Seek(DBHeightKey(start_height));
+    for (int height = start_height; height <= stop_index->nHeight; ++height) {
+        DBHeightKey key;
+        if (!db_it->Valid() || !db_it->GetKey(key) || key.height != height) {
+            return false;
+        }
+
+        results.emplace_back();
+        if (!db_it->GetValue(results.back())) {
+            return error("%s: unable to read value in %s at key (%c, %d)",
+                         __func__, GetName(), DB_BLOCK_STATS, height);
+        }
+
+        db_it->Next();
+    }
+
+    // Rows may belong to a chain the index has not caught up from yet
+    const CBlockIndex* pindex = stop_index;
+    for (size_t i = results.size(); i-- > 0; pindex = pindex->pprev) {
+        if (results[i].hash != pindex->GetBlockHash()) {
+            return false;
+        }
+    }
+
+    stats_out.clear();
+    stats_out.reserve(results.size());
+    for (const DBVal& entry : results) {
+        stats_out.push_back(entry.stats);
+    }
+    return true;
+}
@@ -0,0 +1,138 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_BLOCKSTATSINDEX_H
+#define BITCOIN_INDEX_BLOCKSTATSINDEX_H
+
+#include <amount.h>
+#include <chain.h>
+#include <index/base.h>
+#include <rpc/blockchain.h>
+#include <serialize.h>
+
+#include <functional>
+
+class CBlockUndo;
+
+/** Per block statistics of getblockstats, the averages are derived when reported */
+struct CBlockStats
+{
+    int64_t txs = 0;            //!< Including the coinbase or coinstake
+    int64_t ins = 0;            //!< Excluding the coinbase input
+    int64_t outs = 0;
+    CAmount total_out = 0;      //!< Plain outputs of the non-coinbase txns
+    int64_t total_size = 0;
+    int64_t total_weight = 0;
+    int64_t mintxsize = 0;
+    int64_t maxtxsize = 0;
+    int64_t mediantxsize = 0;
+    int64_t swtxs = 0;
+    int64_t swtotal_size = 0;
+    int64_t swtotal_weight = 0;
+
+    // Set when the spent outputs were available
+    bool fHaveFees = false;
+    CAmount totalfee = 0;
+    CAmount minfee = 0;
+    CAmount maxfee = 0;
+    CAmount medianfee = 0;
+    CAmount minfeerate = 0;
+    CAmount maxfeerate = 0;
+    CAmount feerate_percentiles[NUM_GETBLOCKSTATS_PERCENTILES] = { 0 };
+    int64_t utxo_size_inc = 0;
+
+    // Confidential transactions
+    int64_t anon_ins = 0;       //!< RingCT inputs, each spending one or more ring members
+    int64_t anon_outs = 0;      //!< RingCT outputs, value blinded by a commitment
+    int64_t data_outs = 0;
+    int64_t key_images = 0;
+    int64_t min_ringsize = 0;
+    int64_t max_ringsize = 0;
+    int64_t total_ringsize = 0;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txs);
+        READWRITE(ins);
+        READWRITE(outs);
+        READWRITE(total_out);
+        READWRITE(total_size);
+        READWRITE(total_weight);
+        READWRITE(mintxsize);
+        READWRITE(maxtxsize);
+        READWRITE(mediantxsize);
+        READWRITE(swtxs);
+        READWRITE(swtotal_size);
+        READWRITE(swtotal_weight);
+        READWRITE(fHaveFees);
+        READWRITE(totalfee);
+        READWRITE(minfee);
+        READWRITE(maxfee);
+        READWRITE(medianfee);
+        READWRITE(minfeerate);
+        READWRITE(maxfeerate);
+        for (int i = 0; i < NUM_GETBLOCKSTATS_PERCENTILES; ++i) {
+            READWRITE(feerate_percentiles[i]);
+        }
+        READWRITE(utxo_size_inc);
+        READWRITE(anon_ins);
+        READWRITE(anon_outs);
+        READWRITE(data_outs);
+        READWRITE(key_images);
+        READWRITE(min_ringsize);
+        READWRITE(max_ringsize);
+        READWRITE(total_ringsize);
+    }
+};
+
+/**
+ * Get the plain value and serialized size of the output spent by input nIn of the
+ * txn at nTx in the block. nValue is 0 for a blinded output. False if not found.
+ */
+typedef std::function<bool(size_t nTx, size_t nIn, CAmount& nValue, int64_t& nSize)> SpentOutputFunction;
+
+/**
+ * Compute the statistics of block. The fee and utxo size stats are only
+ * computed if get_spent is set, anon inputs don't spend a looked up output.
+ */
+bool ComputeBlockStats(const CBlock& block, const SpentOutputFunction* get_spent, CBlockStats& stats, std::string& error);
+
+/** Spent outputs of block from its undo data, the undo data must outlive the function */
+SpentOutputFunction SpentOutputsFromUndo(const CBlock& block, const CBlockUndo& block_undo);
+
+/**
+ * BlockStatsIndex keeps the getblockstats statistics of each block by height, so
+ * repeated and range queries are answered without reading the block, its undo data
+ * or the spent txns. Fees are taken from the undo data, -txindex is not required.
+ */
+class BlockStatsIndex final : public BaseIndex
+{
+private:
+    std::unique_ptr<BaseIndex::DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+    bool EraseBlock(const CBlock& block) override;
+
+    BaseIndex::DB& GetDB() const override { return *m_db; }
+
+    const char* GetName() const override { return "blockstatsindex"; }
+
+public:
+    explicit BlockStatsIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /** Get the stats of a single block. */
+    bool LookupStats(const CBlockIndex* block_index, CBlockStats& stats_out) const;
+
+    /** Get the stats of the blocks between start_height and stop_index. */
+    bool LookupStatsRange(int start_height, const CBlockIndex* stop_index,
+                          std::vector<CBlockStats>& stats_out) const;
+};
+
+/// The global block stats index. May be null.
+extern std::unique_ptr<BlockStatsIndex> g_blockstatsindex;
+
+#endif // BITCOIN_INDEX_BLOCKSTATSINDEX_H
@@ -29,12 +29,43 @@ struct CDiskTxPos : public CDiskBlockPos
 {
     unsigned int nTxOffset; // after header
 
-    ADD_SERIALIZE_METHODS;
+    // Layout of the tx, missing from entries written by older versions and for non BitcoinC txns.
+    // Lets a single output be read without reading and deserializing the whole tx.
+    unsigned int nTxSize = 0;
+    unsigned int nOutputsOffset = 0; // Offset of the first output's type byte in the tx, 0 if no layout
+    std::vector<unsigned int> vOutputSizes; // Serialized size of each output, type byte included
+
+    template <typename Stream>
+    void Serialize(Stream& s) const {
+        s << static_cast<const CDiskBlockPos&>(*this);
+        s << VARINT(nTxOffset);
+        if (nOutputsOffset == 0) {
+            return;
+        }
+        s << VARINT(nTxSize);
+        s << VARINT(nOutputsOffset);
+        WriteCompactSize(s, vOutputSizes.size());
+        for (const auto n : vOutputSizes) {
+            s << VARINT(n);
+        }
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITEAS(CDiskBlockPos, *this);
-        READWRITE(VARINT(nTxOffset));
+    template <typename Stream>
+    void Unserialize(Stream& s) {
+        s >> static_cast<CDiskBlockPos&>(*this);
+        s >> VARINT(nTxOffset);
+        nTxSize = 0;
+        nOutputsOffset = 0;
+        vOutputSizes.clear();
+        if (s.empty()) {
+            return;
+        }
+        s >> VARINT(nTxSize);
+        s >> VARINT(nOutputsOffset);
+        vOutputSizes.resize(ReadCompactSize(s));
+        for (auto& n : vOutputSizes) {
+            s >> VARINT(n);
+        }
     }
 
     CDiskTxPos(const CDiskBlockPos &blockIn, unsigned int nTxOffsetIn) : CDiskBlockPos(blockIn.nFile, blockIn.nPos), nTxOffset(nTxOffsetIn) {
@@ -47,6 +78,26 @@ struct CDiskTxPos : public CDiskBlockPos
     void SetNull() {
         CDiskBlockPos::SetNull();
         nTxOffset = 0;
+        nTxSize = 0;
+        nOutputsOffset = 0;
+        vOutputSizes.clear();
+    }
+
+    /** Record the layout of tx, nTxOffset must be set */
+    void SetLayout(const CTransaction& tx) {
+        nTxSize = ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+        nOutputsOffset = 0;
+        vOutputSizes.clear();
+        if (!tx.IsBitcoinCVersion()) {
+            return;
+        }
+        // Version, type and locktime, see SerializeTransaction
+        nOutputsOffset = 2 + 4 + ::GetSerializeSize(tx.vin, SER_DISK, CLIENT_VERSION)
+            + GetSizeOfCompactSize(tx.vpout.size());
+        vOutputSizes.reserve(tx.vpout.size());
+        for (const auto& out : tx.vpout) {
+            vOutputSizes.push_back(1 + ::GetSerializeSize(*out, SER_DISK, CLIENT_VERSION));
+        }
     }
 };
 
@@ -256,6 +307,14 @@ bool TxIndex::Init()
     // Set m_best_block_index to the last cs_indexed block if lower
     if (m_cs_index) {
         CBlockLocator locator;
+        int cs_version = 0;
+        if (!GetDB().Read(DB_TXINDEX_CSVERSION, cs_version) || cs_version < CSINDEX_VERSION) {
+            // Older rows lack the links the weights are kept by, index the cold staked outputs again
+            if (GetDB().Exists(DB_TXINDEX_CSBESTBLOCK)) {
+                LogPrintf("Upgrading csindex to version %d.\n", CSINDEX_VERSION);
+            }
+            locator.SetNull();
+        } else
         if (!GetDB().Read(DB_TXINDEX_CSBESTBLOCK, locator)) {
             locator.SetNull();
         }
@@ -282,8 +341,9 @@ bool TxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
     std::vector<std::pair<uint256, CDiskTxPos>> vPos;
     vPos.reserve(block.vtx.size());
     for (const auto& tx : block.vtx) {
+        pos.SetLayout(*tx);
         vPos.emplace_back(tx->GetHash(), pos);
-        pos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+        pos.nTxOffset += pos.nTxSize;
     }
     return m_db->WriteTxs(vPos);
 }
@@ -294,8 +354,31 @@ bool TxIndex::EraseBlock(const CBlock& block)
         return true;
     }
 
-    std::set<COutPoint> erasedCSOuts;
+    int height;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = LookupBlockIndex(block.GetHash());
+        if (!pindex) {
+            return error("%s: Block %s not found.", __func__, block.GetHash().ToString());
+        }
+        height = pindex->nHeight;
+    }
+
     CDBBatch batch(*m_db);
+    std::set<COutPoint> erasedCSOuts;
+    std::set<ColdStakeIndexWeightKey> erasedWeights;
+    auto erase_weights = [&](const ColdStakeIndexLinkKey& lk) {
+        if (lk.m_stake_type == TX_NONSTANDARD) {
+            return;
+        }
+        for (bool total : {false, true}) {
+            ColdStakeIndexWeightKey wk(lk, total);
+            wk.m_height = height;
+            if (erasedWeights.insert(wk).second) {
+                batch.Erase(std::make_pair(DB_TXINDEX_CSWEIGHT, wk));
+            }
+        }
+    };
     for (const auto& tx : block.vtx) {
         int n = -1;
         for (const auto &o : tx->vpout) {
@@ -309,6 +392,10 @@ bool TxIndex::EraseBlock(const CBlock& block)
             }
 
             ColdStakeIndexOutputKey ok(tx->GetHash(), n);
+            ColdStakeIndexOutputValue ov;
+            if (m_db->Read(std::make_pair(DB_TXINDEX_CSOUTPUT, ok), ov)) {
+                erase_weights(ov.m_link);
+            }
             batch.Erase(std::make_pair(DB_TXINDEX_CSOUTPUT, ok));
             erasedCSOuts.insert(COutPoint(ok.m_txnid, ok.m_n));
         }
@@ -323,6 +410,7 @@ bool TxIndex::EraseBlock(const CBlock& block)
                 ov.m_spend_height = -1;
                 ov.m_spend_txid.SetNull();
                 batch.Write(std::make_pair(DB_TXINDEX_CSOUTPUT, ok), ov);
+                erase_weights(ov.m_link);
             }
         }
     }
@@ -339,6 +427,7 @@ bool TxIndex::IndexCSOutputs(const CBlock& block, const CBlockIndex* pindex)
     CDBBatch batch(*m_db);
     std::map<ColdStakeIndexOutputKey, ColdStakeIndexOutputValue> newCSOuts;
     std::map<ColdStakeIndexLinkKey, std::vector<ColdStakeIndexOutputKey> > newCSLinks;
+    std::map<ColdStakeIndexWeightKey, CAmount> weightDeltas;
 
     for (const auto& tx : block.vtx) {
         int n = -1;
@@ -408,8 +497,11 @@ bool TxIndex::IndexCSOutputs(const CBlock& block, const CBlockIndex* pindex)
                 ov.m_flags |= CSI_FROM_STAKE;
             }
 
+            ov.m_link = lk;
+
             newCSOuts[ok] = ov;
             newCSLinks[lk].push_back(ok);
+            weightDeltas[ColdStakeIndexWeightKey(lk, false)] += ov.m_value;
         }
 
         for (const auto &in : tx->vin) {
@@ -423,15 +515,21 @@ bool TxIndex::IndexCSOutputs(const CBlock& block, const CBlockIndex* pindex)
             if (it != newCSOuts.end()) {
                 it->second.m_spend_height = pindex->nHeight;
                 it->second.m_spend_txid = tx->GetHash();
+                weightDeltas[ColdStakeIndexWeightKey(it->second.m_link, false)] -= it->second.m_value;
             } else
             if (m_db->Read(std::make_pair(DB_TXINDEX_CSOUTPUT, ok), ov)) {
                 ov.m_spend_height = pindex->nHeight;
                 ov.m_spend_txid = tx->GetHash();
                 batch.Write(std::make_pair(DB_TXINDEX_CSOUTPUT, ok), ov);
+                if (ov.m_link.m_stake_type != TX_NONSTANDARD) {
+                    weightDeltas[ColdStakeIndexWeightKey(ov.m_link, false)] -= ov.m_value;
+                }
             }
         }
     }
 
+    WriteCSWeights(batch, weightDeltas, pindex->nHeight);
+
     for (const auto &it : newCSOuts) {
         batch.Write(std::make_pair(DB_TXINDEX_CSOUTPUT, it.first), it.second);
     }
@@ -440,6 +538,7 @@ bool TxIndex::IndexCSOutputs(const CBlock& block, const CBlockIndex* pindex)
     }
 
     batch.Write(DB_TXINDEX_CSBESTBLOCK, chainActive.GetLocator(pindex));
+    batch.Write(DB_TXINDEX_CSVERSION, CSINDEX_VERSION);
 
     if (!m_db->WriteBatch(batch)) {
         return error("%s: WriteBatch failed.", __func__);
@@ -448,6 +547,89 @@ bool TxIndex::IndexCSOutputs(const CBlock& block, const CBlockIndex* pindex)
     return true;
 }
 
+/** The value of the weight row of key's link in effect at height, 0 if none */
+static CAmount ReadCSWeight(CDBIterator& it, ColdStakeIndexWeightKey key, int height)
+{
+    if (height < 0) {
+        return 0;
+    }
+    key.m_height = height;
+    it.Seek(std::make_pair(DB_TXINDEX_CSWEIGHT, key));
+
+    std::pair<char, ColdStakeIndexWeightKey> found;
+    CAmount value;
+    if (it.Valid() && it.GetKey(found)
+        && found.first == DB_TXINDEX_CSWEIGHT
+        && found.second.SameLink(key)
+        && it.GetValue(value)) {
+        return value;
+    }
+    return 0;
+}
+
+void TxIndex::WriteCSWeights(CDBBatch& batch, const std::map<ColdStakeIndexWeightKey, CAmount>& deltas, int height) const
+{
+    std::map<ColdStakeIndexWeightKey, CAmount> all_deltas(deltas);
+    for (const auto &it : deltas) {
+        ColdStakeIndexWeightKey total_key = it.first;
+        total_key.m_spend_type = TX_NONSTANDARD;
+        total_key.m_spend_id.SetNull();
+        all_deltas[total_key] += it.second;
+    }
+
+    // Add to the value before this block so a block indexed again isn't counted twice
+    std::unique_ptr<CDBIterator> it(m_db->NewIterator());
+    for (const auto &delta : all_deltas) {
+        if (delta.second == 0) {
+            continue;
+        }
+        ColdStakeIndexWeightKey key = delta.first;
+        CAmount value = ReadCSWeight(*it, key, height - 1) + delta.second;
+        key.m_height = height;
+        batch.Write(std::make_pair(DB_TXINDEX_CSWEIGHT, key), value);
+    }
+}
+
+bool TxIndex::GetCSWeights(const ColdStakeIndexWeightKey& stake_key, int height, CAmount& total,
+                           std::vector<std::pair<ColdStakeIndexWeightKey, CAmount> >& spend_weights) const
+{
+    total = 0;
+    std::unique_ptr<CDBIterator> it(m_db->NewIterator());
+
+    // The total row sorts first, then one run of rows per spend address, each is skipped with a seek
+    ColdStakeIndexWeightKey key = stake_key;
+    key.m_spend_type = TX_NONSTANDARD;
+    key.m_spend_id.SetNull();
+    key.m_height = std::numeric_limits<unsigned int>::max();
+    it->Seek(std::make_pair(DB_TXINDEX_CSWEIGHT, key));
+
+    std::pair<char, ColdStakeIndexWeightKey> found;
+    while (it->Valid() && it->GetKey(found)) {
+        if (found.first != DB_TXINDEX_CSWEIGHT
+            || found.second.m_stake_type != stake_key.m_stake_type
+            || found.second.m_stake_id != stake_key.m_stake_id) {
+            break;
+        }
+
+        ColdStakeIndexWeightKey link = found.second;
+        CAmount value = ReadCSWeight(*it, link, height);
+        if (link.m_spend_type == TX_NONSTANDARD) {
+            total = value;
+        } else
+        if (value != 0) {
+            spend_weights.emplace_back(link, value);
+        }
+
+        link.m_height = 0;
+        it->Seek(std::make_pair(DB_TXINDEX_CSWEIGHT, link));
+        if (it->Valid() && it->GetKey(found) && found.first == DB_TXINDEX_CSWEIGHT && found.second.SameLink(link)) {
+            it->Next();
+        }
+    }
+
+    return true;
+}
+
 BaseIndex::DB& TxIndex::GetDB() const { return *m_db; }
 
 bool TxIndex::FindTx(const uint256& tx_hash, uint256& block_hash, CTransactionRef& tx) const
@@ -504,6 +686,57 @@ bool TxIndex::FindTx(const uint256& tx_hash, CBlockHeader& header, CTransactionR
     return true;
 }
 
+bool TxIndex::FindTxOutput(const uint256& tx_hash, uint32_t n, CBlockHeader& header, CTxOutBaseRef& out) const
+{
+    CDiskTxPos postx;
+    if (!m_db->ReadTxPos(tx_hash, postx)
+        || postx.nOutputsOffset == 0 || n >= postx.vOutputSizes.size()) {
+        return false;
+    }
+
+    unsigned int nOffset = postx.nTxOffset + postx.nOutputsOffset;
+    for (uint32_t k = 0; k < n; ++k) {
+        nOffset += postx.vOutputSizes[k];
+    }
+
+    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return error("%s: OpenBlockFile failed", __func__);
+    }
+    try {
+        file >> header;
+        if (fseek(file.Get(), nOffset, SEEK_CUR)) {
+            return error("%s: fseek(...) failed", __func__);
+        }
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss.resize(postx.vOutputSizes[n]);
+        file.read(ss.data(), ss.size());
+
+        uint8_t type;
+        ss >> type;
+        switch (type) {
+            case OUTPUT_STANDARD:
+                out = MAKE_OUTPUT<CTxOutStandard>();
+                break;
+            case OUTPUT_RINGCT:
+                out = MAKE_OUTPUT<CTxOutRingCT>();
+                break;
+            case OUTPUT_DATA:
+                out = MAKE_OUTPUT<CTxOutData>();
+                break;
+            default:
+                return error("%s: Unknown output type %d", __func__, type);
+        }
+        ss >> *out;
+        if (!ss.empty()) {
+            return error("%s: Output size mismatch", __func__);
+        }
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    return true;
+}
+
 bool TxIndex::AppendCSAddress(std::string addr)
 {
     CTxDestination dest = DecodeDestination(addr);
@@ -10,6 +10,7 @@
 #include <txdb.h>
 
 class CBlockHeader;
+class ColdStakeIndexWeightKey;
 
 /**
  * TxIndex is used to look up transactions included in the blockchain by hash.
@@ -38,6 +39,9 @@ protected:
 
     bool IndexCSOutputs(const CBlock& block, const CBlockIndex* pindex);
 
+    /// Write the running totals of the links changed by deltas at height.
+    void WriteCSWeights(CDBBatch& batch, const std::map<ColdStakeIndexWeightKey, CAmount>& deltas, int height) const;
+
 public:
     BaseIndex::DB& GetDB() const override;
 
@@ -56,8 +60,23 @@ public:
     bool FindTx(const uint256& tx_hash, uint256& block_hash, CTransactionRef& tx) const;
     bool FindTx(const uint256& tx_hash, CBlockHeader& header, CTransactionRef& tx) const;
 
+    /// Look up a single output of a transaction, reading only the bytes of the output.
+    ///
+    /// @param[in]   tx_hash  The hash of the transaction containing the output.
+    /// @param[in]   n  The index of the output.
+    /// @param[out]  header  The header of the block the transaction is found in.
+    /// @param[out]  out  The output.
+    /// @return  false if the output is not found or the index holds no layout for the
+    ///          transaction (older entries, non BitcoinC transactions), FindTx must be used then.
+    bool FindTxOutput(const uint256& tx_hash, uint32_t n, CBlockHeader& header, CTxOutBaseRef& out) const;
+
     bool AppendCSAddress(std::string addr);
 
+    /// Unspent value cold staked to the stake address of stake_key at height,
+    /// in total and per spend address. Spend addresses with nothing unspent are left out.
+    bool GetCSWeights(const ColdStakeIndexWeightKey& stake_key, int height, CAmount& total,
+                      std::vector<std::pair<ColdStakeIndexWeightKey, CAmount> >& spend_weights) const;
+
     bool m_cs_index = false;
     std::set<std::vector<uint8_t> > m_cs_index_whitelist;
 };
@@ -11,15 +11,23 @@
 
 #include <addrman.h>
 #include <amount.h>
+#include <backgroundverify.h>
 #include <blind.h>
+#include <blockfilemap.h>
+#include <blockreadahead.h>
+#include <cachebalancer.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <compat/sanity.h>
+#include <crypto/aes.h>
+#include <crypto/sha512.h>
 #include <consensus/validation.h>
 #include <fs.h>
 #include <httpserver.h>
 #include <httprpc.h>
+#include <index/blockfilterindex.h>
+#include <index/blockstatsindex.h>
 #include <index/txindex.h>
 #include <key.h>
 #include <validation.h>
@@ -39,6 +47,7 @@
 #include <shutdown.h>
 #include <timedata.h>
 #include <txdb.h>
+#include <txlookupcache.h>
 #include <txmempool.h>
 #include <torcontrol.h>
 #include <ui_interface.h>
@@ -77,10 +86,12 @@
 
 #if ENABLE_ZMQ
 #include <zmq/zmqnotificationinterface.h>
+#include <zmq/zmqpublisher.h>
 #include <zmq/zmqrpc.h>
 #endif
 
 #include <insight/insight.h>
+#include <insight/insightindex.h>
 
 bool fFeeEstimatesInitialized = false;
 static const bool DEFAULT_PROXYRANDOMIZE = true;
@@ -280,6 +291,15 @@ void Interrupt()
     if (g_txindex) {
         g_txindex->Interrupt();
     }
+    if (g_blockfilterindex) {
+        g_blockfilterindex->Interrupt();
+    }
+    if (g_blockstatsindex) {
+        g_blockstatsindex->Interrupt();
+    }
+    if (g_insightindex) {
+        g_insightindex->Interrupt();
+    }
 }
 
 void Shutdown()
@@ -312,8 +332,14 @@ void Shutdown()
     // Because these depend on each-other, we make sure that neither can be
     // using the other before destroying them.
     if (peerLogic) UnregisterValidationInterface(peerLogic.get());
+    if (peerLogic) peerLogic->StopMessageWorkers();
     if (g_connman) g_connman->Stop();
+    g_background_verifier.Stop();
+    g_block_read_ahead.Stop();
     if (g_txindex) g_txindex->Stop();
+    if (g_blockfilterindex) g_blockfilterindex->Stop();
+    if (g_blockstatsindex) g_blockstatsindex->Stop();
+    if (g_insightindex) g_insightindex->Stop();
 
     StopTorControl();
 
@@ -327,6 +353,9 @@ void Shutdown()
     peerLogic.reset();
     g_connman.reset();
     g_txindex.reset();
+    g_blockfilterindex.reset();
+    g_blockstatsindex.reset();
+    g_insightindex.reset();
 
     if (g_is_mempool_loaded && gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
         DumpMempool();
@@ -401,6 +430,7 @@ void Shutdown()
     ECC_Stop_Stealth();
     ECC_Stop_Blinding();
     LogPrintf("%s: done\n", __func__);
+    g_logger->StopWriter();
 }
 
 /**
@@ -478,6 +508,7 @@ void SetupServerArgs()
     gArgs.AddArg("-datadir=<dir>", "Specify data directory", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbcache=<n>", strprintf("Set database cache size in megabytes (%d to %d, default: %d)", nMinDbCache, nMaxDbCache, nDefaultDbCache), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-dbcachebalance", strprintf("Move memory between the in-memory UTXO set, RCT output and txn lookup caches by their miss rates, within their combined size. Caches sized by -rctcachesize or -txlookupcachesize are left as set (default: %u)", DEFAULT_DBCACHE_BALANCE), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-debuglogfile=<file>", strprintf("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (-nodebuglogfile to disable; default: %s)", DEFAULT_DEBUGLOGFILE), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-includeconf=<file>", "Specify additional configuration file, relative to the -datadir path (only useable from configuration file, not command line)", false, OptionsCategory::OPTIONS);
@@ -489,31 +520,51 @@ void SetupServerArgs()
     gArgs.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-trustmempooldump", strprintf("Skip the context-free checks, including CT rangeproofs, of transactions loaded from a mempool.dat written by this node. Ring signatures are always verified (default: %u)", DEFAULT_TRUST_MEMPOOL_DUMP), false, OptionsCategory::OPTIONS);
 #ifndef WIN32
     gArgs.AddArg("-pid=<file>", strprintf("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)", BITCOIN_PID_FILENAME), false, OptionsCategory::OPTIONS);
 #else
     hidden_args.emplace_back("-pid");
 #endif
     gArgs.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
+            "The RCT output index, key images and insight indexes are kept, see doc/pruning.md. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >=%u = automatically prune block files to stay under the specified target size in MiB)", MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-reindex", "Rebuild chain state and block index from the blk*.dat files on disk", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-reindex-chainstate", "Rebuild chain state from the currently indexed blocks", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-schedulerthreads=<n>", strprintf("Set the number of threads running background tasks and validation notifications (1 to %d, default: %d)", MAX_SCHEDULER_THREADS, DEFAULT_SCHEDULER_THREADS), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-skiprangeproofverify", "Skip verifying rangeproofs when reindexing or importing.", false, OptionsCategory::OPTIONS);
 #ifndef WIN32
     gArgs.AddArg("-sysperms", "Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)", false, OptionsCategory::OPTIONS);
 #else
     hidden_args.emplace_back("-sysperms");
 #endif
+    gArgs.AddArg("-threadaffinity=<groups>", "Pin thread groups to CPUs, e.g. validation:0-7,staking:8-9. "
+            "Groups: validation, staking, smsg, rpc, net, scheduler, index and wallet. "
+            "Pinned threads allocate memory on their own NUMA node (Linux only)", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockfilterindex", strprintf("Maintain an index of compact filters by block, matching scripts and stealth prefixes (default: %u)", DEFAULT_BLOCKFILTERINDEX), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockstatsindex", strprintf("Maintain an index of the getblockstats statistics of each block, including the confidential transaction counts (default: %u)", DEFAULT_BLOCKSTATSINDEX), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-txindex", strprintf("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)", DEFAULT_TXINDEX), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-addressindex", strprintf("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)", DEFAULT_ADDRESSINDEX), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-addressbalanceindex", strprintf("Maintain the balance, amount received and txn count of each address next to the address index, getaddressbalance reads them instead of summing the index, requires -addressindex (default: %u)", DEFAULT_ADDRESSBALANCEINDEX), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-timestampindex", strprintf("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)", DEFAULT_TIMESTAMPINDEX), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-spentindex", strprintf("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)", DEFAULT_SPENTINDEX), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-insightindexthreads=<n>", strprintf("Set the number of threads extracting rows while insight indexes are built in the background or by -reindex (0 to %d, 0 = auto, 1 = none, default: %d)", MAX_INSIGHT_INDEX_THREADS, DEFAULT_INSIGHT_INDEX_THREADS), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockreadthreads=<n>", strprintf("Set the number of threads reading blocks and undo data ahead of reorgs, rescans, -checkblocks and peers' block requests (0 to %d, 0 = off, default: %d)", MAX_BLOCK_READ_THREADS, DEFAULT_BLOCK_READ_THREADS), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-mmapblocks", strprintf("Read blocks and undo data through read-only memory mappings of the blk and rev files (default: %u)", DEFAULT_MMAPBLOCKS), false, OptionsCategory::OPTIONS);
+#if ENABLE_USBDEVICE
+    gArgs.AddArg("-usbdevicetimeout=<n>", strprintf("Seconds a hardware wallet stays open after its last use, 0 closes it after each operation (default: %d)", usb_device::DEFAULT_USB_SESSION_TIMEOUT), false, OptionsCategory::OPTIONS);
+#endif
+    gArgs.AddArg("-rctoutputfile", strprintf("Keep a memory-mapped copy of the RCT output index in blocks/rctoutputs.dat for faster ring member lookups (default: %u)", DEFAULT_RCTOUTPUTFILE), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-rctcachesize=<n>", strprintf("Maximum size of the in-memory cache of recently read RCT outputs in megabytes (0 to %d, default: %d)", MAX_RCTCACHESIZE, DEFAULT_RCTCACHESIZE), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-txlookupcachesize=<n>", strprintf("Maximum size of the in-memory cache of confirmed transactions returned by txindex or block lookups in megabytes (0 to %d, default: %d)", MAX_TXLOOKUPCACHESIZE, DEFAULT_TXLOOKUPCACHESIZE), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-keyimagefilter", strprintf("Keep an in-memory filter of spent key images to skip most key image db lookups (default: %u)", DEFAULT_KEYIMAGEFILTER), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-csindex", strprintf("Maintain an index of outputs by coldstaking address (default: %u)", DEFAULT_CSINDEX), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-cswhitelist", strprintf("Only index coldstaked outputs with matching stake address. Can be specified multiple times."), false, OptionsCategory::OPTIONS);
 
     gArgs.AddArg("-dbmaxopenfiles", strprintf("Maximum number of open files parameter passed to level-db (default: %u)", DEFAULT_DB_MAX_OPEN_FILES), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbcompression", strprintf("Database compression parameter passed to level-db (default: %s)", DEFAULT_DB_COMPRESSION ? "true" : "false"), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-dbprofile=<db>:<option>=<n>", "Tune one level-db database (chainstate, index or txindex). Options: bloombits (bloom filter bits per key, 0 = none, default: 10), blocksize (bytes, default: 4096), blockcache (percent of the database cache used as block cache, default: 50), compression (0 or 1, overrides -dbcompression). Can be specified multiple times.", false, OptionsCategory::OPTIONS);
 
     gArgs.AddArg("-findpeers", "Node will search for peers (default: 1)", false, OptionsCategory::CONNECTION);
 
@@ -537,7 +588,9 @@ void SetupServerArgs()
     gArgs.AddArg("-maxuploadtarget=<n>", strprintf("Tries to keep outbound traffic under the given target (in MiB per 24h), 0 = no limit (default: %d)", DEFAULT_MAX_UPLOAD_TARGET), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-onion=<ip:port>", "Use separate SOCKS5 proxy to reach peers via Tor hidden services, set -noonion to disable (default: -proxy)", false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-onlynet=<net>", "Make outgoing connections only through network <net> (ipv4, ipv6 or onion). Incoming connections are not affected by this option. This option can be specified multiple times to allow multiple networks.", false, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-peerblockfilters", strprintf("Serve compact block filters to peers per BIP 157 (default: %u)", DEFAULT_PEERBLOCKFILTERS), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-peerbloomfilters", strprintf("Support filtering of blocks and transaction with bloom filters (default: %u)", DEFAULT_PEERBLOOMFILTERS), false, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-peermsgthreads=<n>", strprintf("Number of threads handling peer messages that don't need the chain state (secure messaging), each peer is bound to one thread, 0 to handle them on the message handler thread (default: %d)", DEFAULT_PEER_MSG_THREADS), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-permitbaremultisig", strprintf("Relay non-P2SH multisig (default: %u)", DEFAULT_PERMIT_BAREMULTISIG), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-port=<port>", strprintf("Listen for connections on <port> (default: %u or testnet: %u)", defaultChainParams->GetDefaultPort(), testnetChainParams->GetDefaultPort()), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-proxy=<ip:port>", "Connect through SOCKS5 proxy, set -noproxy to disable (default: disabled)", false, OptionsCategory::CONNECTION);
@@ -577,9 +630,13 @@ void SetupServerArgs()
 
     gArgs.AddArg("-zmqpubhashwtx=<address>", "Enable publish hash transaction received by wallets in <address>", false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubsmsg=<address>", "Enable publish secure message in <address>", false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubrawsmsg=<address>", "Enable publish raw secure message in <address>", false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubrawanonoutputs=<address>", "Enable publish anon outputs of connected and disconnected blocks in <address>", false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubkeyimages=<address>", "Enable publish key images spent by connected and disconnected blocks in <address>", false, OptionsCategory::ZMQ);
     gArgs.AddArg("-serverkeyzmq=<secret_key>", "Base64 encoded string of the z85 encoded secret key for CurveZMQ.", false, OptionsCategory::ZMQ);
     gArgs.AddArg("-newserverkeypairzmq", "Generate new key pair for CurveZMQ, print and exit.", false, OptionsCategory::ZMQ);
     gArgs.AddArg("-whitelistzmq=<IP address or network>", "Whitelist peers connecting from the given IP address (e.g. 1.2.3.4) or CIDR notated network (e.g. 1.2.3.0/24). Can be specified multiple times.", false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqqueuesize=<n>", strprintf("Maximum messages waiting to be published per notifier, more are dropped leaving a gap in the sequence numbers (default: %d)", DEFAULT_ZMQ_QUEUE_SIZE), false, OptionsCategory::ZMQ);
 #else
     hidden_args.emplace_back("-zmqpubhashblock=<address>");
     hidden_args.emplace_back("-zmqpubhashtx=<address>");
@@ -588,13 +645,19 @@ void SetupServerArgs()
 
     hidden_args.emplace_back("-zmqpubhashwtx=<address>");
     hidden_args.emplace_back("-zmqpubsmsg=<address>");
+    hidden_args.emplace_back("-zmqpubrawsmsg=<address>");
+    hidden_args.emplace_back("-zmqpubrawanonoutputs=<address>");
+    hidden_args.emplace_back("-zmqpubkeyimages=<address>");
     hidden_args.emplace_back("-serverkeyzmq=<secret_key>");
     hidden_args.emplace_back("-newserverkeypairzmq");
     hidden_args.emplace_back("-whitelistzmq=<IP address or network>");
+    hidden_args.emplace_back("-zmqqueuesize=<n>");
 #endif
 
     gArgs.AddArg("-checkblocks=<n>", strprintf("How many blocks to check at startup (default: %u, 0 = all)", DEFAULT_CHECKBLOCKS), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checklevel=<n>", strprintf("How thorough the block verification of -checkblocks is (0-4, default: %u)", DEFAULT_CHECKLEVEL), true, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-backgroundcheckblocks=<n>", strprintf("How many blocks to check in the background after startup, see verifychainbackground (default: %u, 0 = none, -1 = all)", DEFAULT_BACKGROUND_CHECKBLOCKS), true, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-backgroundchecklevel=<n>", strprintf("How thorough the block verification of -backgroundcheckblocks is (0-4, default: %u)", DEFAULT_BACKGROUND_CHECKLEVEL), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. (default: %u)", defaultChainParams->DefaultConsistencyChecks()), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", defaultChainParams->DefaultConsistencyChecks()), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED), true, OptionsCategory::DEBUG_TEST);
@@ -612,11 +675,14 @@ void SetupServerArgs()
         "If <category> is not supplied or if <category> = 1, output all debugging information. <category> can be: " + ListLogCategories() + ".", false, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-debugexclude=<category>", strprintf("Exclude debugging information for a category. Can be used in conjunction with -debug=1 to output debug logs for all categories except one or more specified categories."), false, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-help-debug", "Show all debugging options (usage: --help -help-debug)", false, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-logbuffer=<n>", strprintf("Queue up to <n> KiB of log messages for a background writer thread, 0 to write them on the logging thread. Queued messages are lost if the process crashes or aborts (default: %u)", DEFAULT_LOGBUFFER), true, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-logdropoverflow", strprintf("Drop log messages while the log buffer is full instead of waiting for space (default: %u)", DEFAULT_LOGDROPOVERFLOW), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-logips", strprintf("Include IP addresses in debug output (default: %u)", DEFAULT_LOGIPS), false, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-logtimestamps", strprintf("Prepend debug output with timestamp (default: %u)", DEFAULT_LOGTIMESTAMPS), false, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)", true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE), true, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-maxctcachesize=<n>", strprintf("Limit sum of rangeproof cache and ring signature cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_CT_CACHE_SIZE), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-maxtxfee=<amt>", strprintf("Maximum total fees (in %s) to use in a single wallet transaction or raw transaction; setting this too low may abort large transactions (default: %s)",
         CURRENCY_UNIT, FormatMoney(DEFAULT_TRANSACTION_MAXFEE)), false, OptionsCategory::DEBUG_TEST);
@@ -647,6 +713,7 @@ void SetupServerArgs()
     gArgs.AddArg("-rest", strprintf("Accept public REST requests (default: %u)", DEFAULT_REST_ENABLE), false, OptionsCategory::RPC);
     gArgs.AddArg("-rpcallowip=<ip>", "Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times", false, OptionsCategory::RPC);
     gArgs.AddArg("-rpcauth=<userpw>", "Username and hashed password for JSON-RPC connections. The field <userpw> comes in the format: <USERNAME>:<SALT>$<HASH>. A canonical python script is included in share/rpcauth. The client then connects normally using the rpcuser=<USERNAME>/rpcpassword=<PASSWORD> pair of arguments. This option can be specified multiple times", false, OptionsCategory::RPC);
+    gArgs.AddArg("-rpcbatchthreads=<n>", strprintf("Set the maximum number of requests of one JSON-RPC batch executed in parallel, up to -rpcthreads. Above 1 the requests of a batch may run in any order, batches relying on earlier requests (walletpassphrase then sendtoaddress, getnewaddress then a use of the address) must then be split (default: %d)", DEFAULT_RPC_BATCH_THREADS), false, OptionsCategory::RPC);
     gArgs.AddArg("-rpcbind=<addr>[:port]", "Bind to given address to listen for JSON-RPC connections. This option is ignored unless -rpcallowip is also passed. Port is optional and overrides -rpcport. Use [host]:port notation for IPv6. This option can be specified multiple times (default: 127.0.0.1 and ::1 i.e., localhost, or if -rpcallowip has been specified, 0.0.0.0 and :: i.e., all addresses)", false, OptionsCategory::RPC);
     gArgs.AddArg("-rpccookiefile=<loc>", "Location of the auth cookie. Relative paths will be prefixed by a net-specific datadir location. (default: data dir)", false, OptionsCategory::RPC);
     gArgs.AddArg("-rpcpassword=<pw>", "Password for JSON-RPC connections", false, OptionsCategory::RPC);
@@ -791,18 +858,7 @@ static void ThreadImport(std::vector<fs::path> vImportFiles)
 
     // -reindex
     if (fReindex) {
-        int nFile = 0;
-        while (true) {
-            CDiskBlockPos pos(nFile, 0);
-            if (!fs::exists(GetBlockPosFilename(pos, "blk")))
-                break; // No block files left to reindex
-            FILE *file = OpenBlockFile(pos, true);
-            if (!file)
-                break; // This error is logged in OpenBlockFile
-            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(chainparams, file, &pos);
-            nFile++;
-        }
+        ReindexBlockFiles(chainparams);
         pblocktree->WriteReindexing(false);
         fReindex = false;
         LogPrintf("Reindexing finished\n");
@@ -1097,8 +1153,16 @@ bool AppInitParameterInteraction()
     if (gArgs.GetArg("-prune", 0)) {
         if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(_("Prune mode is incompatible with -blockfilterindex."));
+        if (gArgs.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX))
+            return InitError(_("Prune mode is incompatible with -blockstatsindex."));
     }
 
+    if (gArgs.GetBoolArg("-addressbalanceindex", DEFAULT_ADDRESSBALANCEINDEX)
+        && !gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+        return InitError(_("-addressbalanceindex requires -addressindex."));
+
     // -bind and -whitebind can't be set when not listening
     size_t nUserBind = gArgs.GetArgs("-bind").size() + gArgs.GetArgs("-whitebind").size();
     if (nUserBind != 0 && !gArgs.GetBoolArg("-listen", DEFAULT_LISTEN)) {
@@ -1194,6 +1258,10 @@ bool AppInitParameterInteraction()
         LogPrintf("Warning: nMinimumChainWork set below default value of %s\n", chainparams.GetConsensus().nMinimumChainWork.GetHex());
     }
 
+    std::string strDBProfileError;
+    if (!CheckDBProfiles(strDBProfileError))
+        return InitError(strDBProfileError);
+
     // mempool limits
     int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     int64_t nMempoolSizeMin = gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000 * 40;
@@ -1218,6 +1286,16 @@ bool AppInitParameterInteraction()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    if (gArgs.IsArgSet("-threadaffinity")) {
+        std::string strError;
+        if (!ThreadAffinitySupported()) {
+            InitWarning(_("-threadaffinity is not supported on this platform and is ignored."));
+        } else
+        if (!SetThreadAffinity(gArgs.GetArg("-threadaffinity", ""), strError)) {
+            return InitError(strprintf(_("Invalid -threadaffinity: %s"), strError));
+        }
+    }
+
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
     int64_t nPruneArg = gArgs.GetArg("-prune", 0);
     if (nPruneArg < 0) {
@@ -1296,6 +1374,13 @@ bool AppInitParameterInteraction()
     if (gArgs.GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
 
+    // Signal NODE_COMPACT_FILTERS if peerblockfilters and the filter index are enabled
+    if (gArgs.GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS)) {
+        if (!gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(_("Cannot set -peerblockfilters without -blockfilterindex."));
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_FILTERS);
+    }
+
     if (gArgs.GetArg("-rpcserialversion", DEFAULT_RPC_SERIALIZE_VERSION) < 0)
         return InitError("rpcserialversion must be non-negative.");
 
@@ -1369,6 +1454,10 @@ bool AppInitSanityChecks()
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string sha512_algo = SHA512AutoDetect();
+    LogPrintf("Using the '%s' SHA512 implementation\n", sha512_algo);
+    std::string aes_algo = AES256AutoDetect();
+    LogPrintf("Using the '%s' AES256 implementation\n", aes_algo);
     RandomInit();
     ECC_Start();
     ECC_Start_Stealth();
@@ -1419,6 +1508,10 @@ bool AppInitMain()
                                        g_logger->m_file_path.string()));
         }
     }
+    int64_t nLogBuffer = gArgs.GetArg("-logbuffer", DEFAULT_LOGBUFFER);
+    if (nLogBuffer > 0) {
+        g_logger->StartWriter(nLogBuffer << 10, gArgs.GetBoolArg("-logdropoverflow", DEFAULT_LOGDROPOVERFLOW));
+    }
 
     if (!g_logger->m_log_timestamps)
         LogPrintf("Startup time: %s\n", FormatISO8601DateTime(GetTime()));
@@ -1438,16 +1531,28 @@ bool AppInitMain()
 
     InitSignatureCache();
     InitScriptExecutionCache();
+    InitCTVerificationCache();
+    g_block_file_maps.SetEnabled(gArgs.GetBoolArg("-mmapblocks", DEFAULT_MMAPBLOCKS));
+    g_block_read_ahead.Start(std::max(0, std::min((int)gArgs.GetArg("-blockreadthreads", DEFAULT_BLOCK_READ_THREADS), MAX_BLOCK_READ_THREADS)));
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
+        {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadMLSAGCheck);
+            threadGroup.create_thread(&ThreadTxCheck);
+        }
     }
 
-    // Start the lightweight task scheduler thread
+    // Start the lightweight task scheduler threads, notifications to different
+    // validation interface subscribers run on them in parallel
+    int nSchedulerThreads = std::max(1, std::min((int)gArgs.GetArg("-schedulerthreads", DEFAULT_SCHEDULER_THREADS), MAX_SCHEDULER_THREADS));
+    LogPrintf("Using %d scheduler threads\n", nSchedulerThreads);
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
-    threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    for (int i = 0; i < nSchedulerThreads; ++i) {
+        threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    }
 
     GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
     GetMainSignals().RegisterWithMempoolSignals(mempool);
@@ -1462,6 +1567,9 @@ bool AppInitMain()
 #endif
 #if ENABLE_USBDEVICE
     RegisterUSBDeviceRPC(tableRPC);
+    usb_device::g_device_sessions.SetTimeout(gArgs.GetArg("-usbdevicetimeout", usb_device::DEFAULT_USB_SESSION_TIMEOUT));
+    scheduler.scheduleEvery(std::bind(&usb_device::CDeviceSessionManager::CloseIdle, &usb_device::g_device_sessions),
+        usb_device::USB_SESSION_CHECK_INTERVAL * 1000, CScheduler::Priority::LOW);
 #endif
     g_wallet_init_interface.RegisterRPC(tableRPC);
 #if ENABLE_ZMQ
@@ -1664,6 +1772,10 @@ bool AppInitMain()
     nTotalCache -= nBlockTreeDBCache;
     int64_t nTxIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxTxIndexCache << 20 : 0);
     nTotalCache -= nTxIndexCache;
+    int64_t nFilterIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX) ? nMaxFilterIndexCache << 20 : 0);
+    nTotalCache -= nFilterIndexCache;
+    int64_t nBlockStatsIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX) ? nMaxBlockStatsIndexCache << 20 : 0);
+    nTotalCache -= nBlockStatsIndexCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1671,11 +1783,17 @@ bool AppInitMain()
     int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Max cache setting possible %.1fMiB\n", nMaxDbCache);
-    LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for block index database (%s)\n", nBlockTreeDBCache * (1.0 / 1024 / 1024), DescribeDBFilter("index"));
     if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
-        LogPrintf("* Using %.1fMiB for transaction index database\n", nTxIndexCache * (1.0 / 1024 / 1024));
+        LogPrintf("* Using %.1fMiB for transaction index database (%s)\n", nTxIndexCache * (1.0 / 1024 / 1024), DescribeDBFilter("txindex"));
+    }
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+        LogPrintf("* Using %.1fMiB for block filter index database\n", nFilterIndexCache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX)) {
+        LogPrintf("* Using %.1fMiB for block stats index database\n", nBlockStatsIndexCache * (1.0 / 1024 / 1024));
     }
-    LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for chain state database (%s)\n", nCoinDBCache * (1.0 / 1024 / 1024), DescribeDBFilter("chainstate"));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
 
@@ -1710,11 +1828,27 @@ bool AppInitMain()
 
                 if (fReset) {
                     pblocktree->WriteReindexing(true);
+                    // A partial insight index build refers to rows of the wiped block tree db
+                    fs::remove_all(GetInsightIndexDir());
                     //If we're reindexing in prune mode, wipe away unusable block files and all undo data files
                     if (fPruneMode)
                         CleanupBlockRevFiles();
                 }
 
+                if (gArgs.GetBoolArg("-rctoutputfile", DEFAULT_RCTOUTPUTFILE)
+                    && !pblocktree->OpenRCTOutputFile(GetDataDir() / "blocks" / "rctoutputs.dat", fReset)) {
+                    LogPrintf("Warning: Could not open rctoutputs.dat, reading RCT outputs from the block index db.\n");
+                }
+                int64_t nRCTCacheSize = std::max((int64_t)0, std::min(MAX_RCTCACHESIZE, gArgs.GetArg("-rctcachesize", DEFAULT_RCTCACHESIZE)));
+                pblocktree->GetRCTOutputCache().SetMaxSize(nRCTCacheSize << 20);
+                int64_t nTxLookupCacheSize = std::max((int64_t)0, std::min(MAX_TXLOOKUPCACHESIZE, gArgs.GetArg("-txlookupcachesize", DEFAULT_TXLOOKUPCACHESIZE)));
+                g_tx_lookup_cache.SetMaxSize(nTxLookupCacheSize << 20);
+                g_tx_lookup_cache.Clear();
+                if (gArgs.GetBoolArg("-keyimagefilter", DEFAULT_KEYIMAGEFILTER)) {
+                    uiInterface.InitMessage(_("Loading key image filter..."));
+                    pblocktree->LoadKeyImageFilter();
+                }
+
                 if (ShutdownRequestedMainThread()) break;
 
                 // LoadBlockIndex will load fHavePruned if we've ever removed a
@@ -1732,24 +1866,47 @@ bool AppInitMain()
                     return InitError(_("Incorrect or no genesis block found. Wrong datadir for network?"));
                 }
 
-                // Check for changed -addressindex state
-                if (fAddressIndex != gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+                // Check for disabled -addressindex state, enabled indexes are built by InsightIndex
+                if (fAddressIndex && !gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
                     strLoadError = _("You need to rebuild the database using -reindex to change -addressindex");
                     break;
                 }
 
-                // Check for changed -spentindex state
-                if (fSpentIndex != gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+                // Check the address index was built with the compact keys
+                bool fCompactAddressIndex = false;
+                if (fAddressIndex && (!pblocktree->ReadFlag("compactaddressindex", fCompactAddressIndex) || !fCompactAddressIndex)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to upgrade the address index");
+                    break;
+                }
+
+                // Check for changed -addressbalanceindex state, it can only be built along with the address index
+                if (fAddressBalanceIndex != gArgs.GetBoolArg("-addressbalanceindex", DEFAULT_ADDRESSBALANCEINDEX)
+                    && (fAddressIndex || fAddressBalanceIndex)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -addressbalanceindex");
+                    break;
+                }
+
+                // Check for disabled -spentindex state
+                if (fSpentIndex && !gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
                     strLoadError = _("You need to rebuild the database using -reindex to change -spentindex");
                     break;
                 }
 
-                // Check for changed -timestampindex state
-                if (fTimestampIndex != gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)) {
+                // Check for disabled -timestampindex state
+                if (fTimestampIndex && !gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)) {
                     strLoadError = _("You need to rebuild the database using -reindex to change -timestampindex");
                     break;
                 }
 
+                // Indexes enabled after the fact are built from the block and undo files
+                if (fPruneMode
+                    && ((!fAddressIndex && gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+                        || (!fSpentIndex && gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX))
+                        || (!fTimestampIndex && gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)))) {
+                    strLoadError = _("You need to rebuild the database using -reindex to enable insight indexes in prune mode");
+                    break;
+                }
+
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
                 // in the past, but is now trying to run unpruned.
                 if (fHavePruned && !fPruneMode) {
@@ -1872,6 +2029,52 @@ bool AppInitMain()
         return false;
     }
 
+    // The leveldb caches keep their size, the in-memory caches share theirs
+    g_cache_balancer.Clear();
+    g_cache_balancer.AddFixed("blocktree_db", nBlockTreeDBCache);
+    g_cache_balancer.AddFixed("chainstate_db", nCoinDBCache);
+    if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
+        g_cache_balancer.AddFixed("txindex_db", nTxIndexCache);
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+        g_cache_balancer.AddFixed("blockfilterindex_db", nFilterIndexCache);
+    if (gArgs.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX))
+        g_cache_balancer.AddFixed("blockstatsindex_db", nBlockStatsIndexCache);
+    {
+        const bool fBalance = gArgs.GetBoolArg("-dbcachebalance", DEFAULT_DBCACHE_BALANCE);
+        CRCTOutputCache &rctcache = pblocktree->GetRCTOutputCache();
+        if (fBalance) {
+            g_cache_balancer.Add("coins", nCoinCacheUsage, nCoinCacheUsage / 4, CACHE_MISS_COST_COINS,
+                [](uint64_t &nHits, uint64_t &nMisses) {
+                    LOCK(cs_main);
+                    nHits = nMisses = 0;
+                    if (pcoinsTip)
+                        pcoinsTip->GetCacheCounts(nHits, nMisses);
+                },
+                [](size_t nMaxSize) { LOCK(cs_main); nCoinCacheUsage = nMaxSize; });
+        } else {
+            g_cache_balancer.AddFixed("coins", nCoinCacheUsage);
+        }
+        // Caches sized by their own option are left as set
+        if (fBalance && !gArgs.IsArgSet("-rctcachesize")) {
+            g_cache_balancer.Add("rctoutputs", rctcache.GetMaxSize(), rctcache.GetMaxSize() / 4, CACHE_MISS_COST_RCTOUTPUTS,
+                [&rctcache](uint64_t &nHits, uint64_t &nMisses) { nHits = rctcache.GetHits(); nMisses = rctcache.GetMisses(); },
+                [&rctcache](size_t nMaxSize) { rctcache.SetMaxSize(nMaxSize); });
+        } else {
+            g_cache_balancer.AddFixed("rctoutputs", rctcache.GetMaxSize());
+        }
+        if (fBalance && !gArgs.IsArgSet("-txlookupcachesize")) {
+            g_cache_balancer.Add("txlookup", g_tx_lookup_cache.GetMaxSize(), g_tx_lookup_cache.GetMaxSize() / 4, CACHE_MISS_COST_TXLOOKUP,
+                [](uint64_t &nHits, uint64_t &nMisses) { nHits = g_tx_lookup_cache.GetHits(); nMisses = g_tx_lookup_cache.GetMisses(); },
+                [](size_t nMaxSize) { g_tx_lookup_cache.SetMaxSize(nMaxSize); });
+        } else {
+            g_cache_balancer.AddFixed("txlookup", g_tx_lookup_cache.GetMaxSize());
+        }
+        if (fBalance) {
+            scheduler.scheduleEvery(std::bind(&CCacheBalancer::Rebalance, &g_cache_balancer),
+                CACHE_REBALANCE_INTERVAL * 1000, CScheduler::Priority::LOW);
+        }
+    }
+
     fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fsbridge::fopen(est_path, "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1894,6 +2097,45 @@ bool AppInitMain()
         g_txindex->Start();
     }
 
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+        g_blockfilterindex = MakeUnique<BlockFilterIndex>(BlockFilterType::STEALTH, nFilterIndexCache, false, fReindex);
+        g_blockfilterindex->Start();
+    }
+
+    if (gArgs.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX)) {
+        g_blockstatsindex = MakeUnique<BlockStatsIndex>(nBlockStatsIndexCache, false, fReindex);
+        g_blockstatsindex->Start();
+    }
+
+    int nBackgroundCheckBlocks = gArgs.GetArg("-backgroundcheckblocks", DEFAULT_BACKGROUND_CHECKBLOCKS);
+    if (nBackgroundCheckBlocks != 0 && !fReindex) {
+        std::string sError;
+        if (!g_background_verifier.Start(chainparams, gArgs.GetArg("-backgroundchecklevel", DEFAULT_BACKGROUND_CHECKLEVEL),
+                std::max(0, nBackgroundCheckBlocks), DEFAULT_BACKGROUND_CHECKTHREADS, (uint64_t)DEFAULT_BACKGROUND_CHECKRATE << 20, sError)) {
+            LogPrintf("Background verification not started: %s\n", sError);
+        }
+    }
+
+    // Insight indexes enabled on an existing database or rebuilt by -reindex are built in the background
+    uint8_t nInsightBuild = 0;
+    if (!fAddressIndex && gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        nInsightBuild |= InsightIndex::BUILD_ADDRESS;
+        if (gArgs.GetBoolArg("-addressbalanceindex", DEFAULT_ADDRESSBALANCEINDEX))
+            nInsightBuild |= InsightIndex::BUILD_ADDRESS_BALANCE;
+    }
+    if (!fSpentIndex && gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX))
+        nInsightBuild |= InsightIndex::BUILD_SPENT;
+    if (!fTimestampIndex && gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX))
+        nInsightBuild |= InsightIndex::BUILD_TIMESTAMP;
+    if (nInsightBuild) {
+        int nInsightThreads = gArgs.GetArg("-insightindexthreads", DEFAULT_INSIGHT_INDEX_THREADS);
+        if (nInsightThreads <= 0)
+            nInsightThreads = GetNumCores();
+        nInsightThreads = std::min(nInsightThreads, MAX_INSIGHT_INDEX_THREADS);
+        g_insightindex = MakeUnique<InsightIndex>(DEFAULT_INSIGHT_INDEX_CACHE, nInsightBuild, nInsightThreads);
+        g_insightindex->Start();
+    }
+
     // ********************************************************* Step 9: load wallet
     if (!g_wallet_init_interface.Open()) return false;
 
@@ -18,6 +18,26 @@ enum AddressIndexType {
     ADDR_INDT_SCRIPT_ADDRESS_256     = 4,
 };
 
+/**
+ * The address index db keys are compact: the address hash is stored at the width of its type,
+ * entries refer to their txn by (height, txindex) and the txid is kept once per txn, see
+ * CAddressIndexTxPosKey. Heights and txindices stay fixed width big-endian to keep the key order.
+ */
+inline size_t AddressIndexHashSize(unsigned int type) {
+    return (type == ADDR_INDT_PUBKEY_ADDRESS_256 || type == ADDR_INDT_SCRIPT_ADDRESS_256) ? 32 : 20;
+}
+
+template<typename Stream>
+inline void SerializeAddressIndexHash(Stream& s, unsigned int type, const uint256& hashBytes) {
+    s.write((const char*)hashBytes.begin(), AddressIndexHashSize(type));
+}
+
+template<typename Stream>
+inline void UnserializeAddressIndexHash(Stream& s, unsigned int type, uint256& hashBytes) {
+    hashBytes.SetNull();
+    s.read((char*)hashBytes.begin(), AddressIndexHashSize(type));
+}
+
 struct CAddressUnspentKey {
     unsigned int type;
     uint256 hashBytes;
@@ -25,21 +45,21 @@ struct CAddressUnspentKey {
     size_t index;
 
     size_t GetSerializeSize() const {
-        return 1  + 32 + 32 + 4;
+        return 1 + AddressIndexHashSize(type) + 32 + GetSizeOfVarInt<VarIntMode::DEFAULT, uint32_t>(index);
     }
     template<typename Stream>
     void Serialize(Stream& s) const {
         ser_writedata8(s, type);
-        hashBytes.Serialize(s);
+        SerializeAddressIndexHash(s, type, hashBytes);
         txhash.Serialize(s);
-        ser_writedata32(s, index);
+        WriteVarInt<Stream, VarIntMode::DEFAULT, uint32_t>(s, index);
     }
     template<typename Stream>
     void Unserialize(Stream& s) {
         type = ser_readdata8(s);
-        hashBytes.Unserialize(s);
+        UnserializeAddressIndexHash(s, type, hashBytes);
         txhash.Unserialize(s);
-        index = ser_readdata32(s);
+        index = ReadVarInt<Stream, VarIntMode::DEFAULT, uint32_t>(s);
     }
 
     CAddressUnspentKey(unsigned int addressType, uint256 addressHash, uint256 txid, size_t indexValue) {
@@ -105,31 +125,33 @@ struct CAddressIndexKey {
     size_t index;
     bool spending;
 
+    uint64_t GetIndexAndFlag() const {
+        return ((uint64_t)index << 1) | (spending ? 1 : 0);
+    }
+
     size_t GetSerializeSize() const {
-        return 66;
+        return 1 + AddressIndexHashSize(type) + 8 + GetSizeOfVarInt<VarIntMode::DEFAULT, uint64_t>(GetIndexAndFlag());
     }
+    // The txhash is not part of the key, CBlockTreeDB fills it in from the txn position
     template<typename Stream>
     void Serialize(Stream& s) const {
         ser_writedata8(s, type);
-        hashBytes.Serialize(s);
+        SerializeAddressIndexHash(s, type, hashBytes);
         // Heights are stored big-endian for key sorting in LevelDB
         ser_writedata32be(s, blockHeight);
         ser_writedata32be(s, txindex);
-        txhash.Serialize(s);
-        ser_writedata32(s, index);
-        char f = spending;
-        ser_writedata8(s, f);
+        WriteVarInt<Stream, VarIntMode::DEFAULT, uint64_t>(s, GetIndexAndFlag());
     }
     template<typename Stream>
     void Unserialize(Stream& s) {
         type = ser_readdata8(s);
-        hashBytes.Unserialize(s);
+        UnserializeAddressIndexHash(s, type, hashBytes);
         blockHeight = ser_readdata32be(s);
         txindex = ser_readdata32be(s);
-        txhash.Unserialize(s);
-        index = ser_readdata32(s);
-        char f = ser_readdata8(s);
-        spending = f;
+        txhash.SetNull();
+        uint64_t n = ReadVarInt<Stream, VarIntMode::DEFAULT, uint64_t>(s);
+        index = n >> 1;
+        spending = n & 1;
     }
 
     CAddressIndexKey(unsigned int addressType, uint256 addressHash, int height, int blockindex,
@@ -163,17 +185,17 @@ struct CAddressIndexIteratorKey {
     uint256 hashBytes;
 
     size_t GetSerializeSize() const {
-        return 21;
+        return 1 + AddressIndexHashSize(type);
     }
     template<typename Stream>
     void Serialize(Stream& s) const {
         ser_writedata8(s, type);
-        hashBytes.Serialize(s);
+        SerializeAddressIndexHash(s, type, hashBytes);
     }
     template<typename Stream>
     void Unserialize(Stream& s) {
         type = ser_readdata8(s);
-        hashBytes.Unserialize(s);
+        UnserializeAddressIndexHash(s, type, hashBytes);
     }
 
     CAddressIndexIteratorKey(unsigned int addressType, uint256 addressHash) {
@@ -197,18 +219,18 @@ struct CAddressIndexIteratorHeightKey {
     int blockHeight;
 
     size_t GetSerializeSize() const {
-        return 25;
+        return 1 + AddressIndexHashSize(type) + 4;
     }
     template<typename Stream>
     void Serialize(Stream& s) const {
         ser_writedata8(s, type);
-        hashBytes.Serialize(s);
+        SerializeAddressIndexHash(s, type, hashBytes);
         ser_writedata32be(s, blockHeight);
     }
     template<typename Stream>
     void Unserialize(Stream& s) {
         type = ser_readdata8(s);
-        hashBytes.Unserialize(s);
+        UnserializeAddressIndexHash(s, type, hashBytes);
         blockHeight = ser_readdata32be(s);
     }
 
@@ -229,6 +251,112 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+struct CAddressIndexIteratorTxKey {
+    unsigned int type;
+    uint256 hashBytes;
+    int blockHeight;
+    unsigned int txindex;
+
+    size_t GetSerializeSize() const {
+        return 1 + AddressIndexHashSize(type) + 8;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata8(s, type);
+        SerializeAddressIndexHash(s, type, hashBytes);
+        ser_writedata32be(s, blockHeight);
+        ser_writedata32be(s, txindex);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        type = ser_readdata8(s);
+        UnserializeAddressIndexHash(s, type, hashBytes);
+        blockHeight = ser_readdata32be(s);
+        txindex = ser_readdata32be(s);
+    }
+
+    CAddressIndexIteratorTxKey(unsigned int addressType, uint256 addressHash, int height, unsigned int txIndex) {
+        type = addressType;
+        hashBytes = addressHash;
+        blockHeight = height;
+        txindex = txIndex;
+    }
+
+    CAddressIndexIteratorTxKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        type = ADDR_INDT_UNKNOWN;
+        hashBytes.SetNull();
+        blockHeight = 0;
+        txindex = 0;
+    }
+};
+
+/** Position of a txn with address index entries, maps to its txid */
+struct CAddressIndexTxPosKey {
+    int blockHeight;
+    unsigned int txindex;
+
+    size_t GetSerializeSize() const {
+        return 8;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata32be(s, blockHeight);
+        ser_writedata32be(s, txindex);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        blockHeight = ser_readdata32be(s);
+        txindex = ser_readdata32be(s);
+    }
+
+    CAddressIndexTxPosKey(int height, unsigned int txIndex) {
+        blockHeight = height;
+        txindex = txIndex;
+    }
+
+    CAddressIndexTxPosKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        blockHeight = 0;
+        txindex = 0;
+    }
+};
+
+/** Running totals of an address, kept next to the address index with -addressbalanceindex */
+struct CAddressBalanceValue {
+    CAmount balance;
+    CAmount received;
+    uint32_t nTxCount;
+    int nLastHeight; // height of the last block applied
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(nTxCount);
+        READWRITE(nLastHeight);
+    }
+
+    CAddressBalanceValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+        nTxCount = 0;
+        nLastHeight = 0;
+    }
+};
+
 struct CMempoolAddressDelta
 {
     int64_t time;
@@ -10,6 +10,11 @@
 constexpr char DB_TXINDEX_CSOUTPUT = 'O';
 constexpr char DB_TXINDEX_CSLINK = 'L';
 constexpr char DB_TXINDEX_CSBESTBLOCK = 'C';
+constexpr char DB_TXINDEX_CSWEIGHT = 'W';
+constexpr char DB_TXINDEX_CSVERSION = 'V';
+
+/** Output rows record their link and weight rows are kept from version 1 */
+static const int CSINDEX_VERSION = 1;
 
 enum CSIndexFlags
 {
@@ -42,6 +47,43 @@ public:
     }
 };
 
+class ColdStakeIndexLinkKey
+{
+public:
+    txnouttype m_stake_type = TX_NONSTANDARD, m_spend_type = TX_NONSTANDARD;
+    CKeyID256 m_stake_id, m_spend_id;
+    unsigned int m_height = 0;
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata8(s, m_stake_type);
+        s.write((char*)m_stake_id.begin(), (m_stake_type == TX_PUBKEYHASH256) ? 32 : 20);
+        ser_writedata32be(s, m_height);
+        ser_writedata8(s, m_spend_type);
+        s.write((char*)m_spend_id.begin(), (m_spend_type == TX_PUBKEYHASH256 || m_spend_type == TX_SCRIPTHASH256) ? 32 : 20);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        m_stake_type = (txnouttype) ser_readdata8(s);
+        m_stake_id.SetNull();
+        s.read((char*)m_stake_id.begin(), (m_stake_type == TX_PUBKEYHASH256) ? 32 : 20);
+        m_height = ser_readdata32be(s);
+        m_spend_type = (txnouttype) ser_readdata8(s);
+        m_spend_id.SetNull();
+        s.read((char*)m_spend_id.begin(), (m_spend_type == TX_PUBKEYHASH256 || m_spend_type == TX_SCRIPTHASH256) ? 32 : 20);
+    }
+
+    friend bool operator<(const ColdStakeIndexLinkKey& a, const ColdStakeIndexLinkKey& b) {
+        int cmp = a.m_stake_id.Compare(b.m_stake_id);
+        if (cmp < 0) return true;
+        if (cmp > 0) return false;
+        cmp = a.m_spend_id.Compare(b.m_spend_id);
+        if (cmp < 0) return true;
+        if (cmp > 0) return false;
+        return a.m_height < b.m_height;
+    }
+};
+
 class ColdStakeIndexOutputValue
 {
 public:
@@ -49,52 +91,92 @@ public:
     uint8_t m_flags = 0; // Mark outputs resulting from coldstaking
     int m_spend_height = -1;
     uint256 m_spend_txid;
+    ColdStakeIndexLinkKey m_link; // Unset in rows written before CSINDEX_VERSION 1
 
-    ADD_SERIALIZE_METHODS;
-
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITE(m_value);
-        READWRITE(m_flags);
-        READWRITE(m_spend_height);
-        READWRITE(m_spend_txid);
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        s << m_value;
+        s << m_flags;
+        s << m_spend_height;
+        s << m_spend_txid;
+        if (m_link.m_stake_type != TX_NONSTANDARD) {
+            s << m_link;
+        }
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> m_value;
+        s >> m_flags;
+        s >> m_spend_height;
+        s >> m_spend_txid;
+        m_link = ColdStakeIndexLinkKey();
+        if (!s.empty()) {
+            s >> m_link;
+        }
     }
 };
 
-class ColdStakeIndexLinkKey
+/**
+ * Unspent value cold staked to a stake address, per spend address and in
+ * total with m_spend_type TX_NONSTANDARD.
+ * A row is written at each height the value changes, heights are stored
+ * inverted so a seek to a height finds the value in effect there.
+ */
+class ColdStakeIndexWeightKey
 {
 public:
     txnouttype m_stake_type = TX_NONSTANDARD, m_spend_type = TX_NONSTANDARD;
     CKeyID256 m_stake_id, m_spend_id;
     unsigned int m_height = 0;
 
+    ColdStakeIndexWeightKey() {};
+    ColdStakeIndexWeightKey(const ColdStakeIndexLinkKey& lk, bool total)
+        : m_stake_type(lk.m_stake_type), m_stake_id(lk.m_stake_id)
+    {
+        if (!total) {
+            m_spend_type = lk.m_spend_type;
+            m_spend_id = lk.m_spend_id;
+        }
+    };
+
     template<typename Stream>
     void Serialize(Stream& s) const {
         ser_writedata8(s, m_stake_type);
         s.write((char*)m_stake_id.begin(), (m_stake_type == TX_PUBKEYHASH256) ? 32 : 20);
-        ser_writedata32be(s, m_height);
         ser_writedata8(s, m_spend_type);
-        s.write((char*)m_spend_id.begin(), (m_spend_type == TX_PUBKEYHASH256 || m_spend_type == TX_SCRIPTHASH256) ? 32 : 20);
+        if (m_spend_type != TX_NONSTANDARD) {
+            s.write((char*)m_spend_id.begin(), (m_spend_type == TX_PUBKEYHASH256 || m_spend_type == TX_SCRIPTHASH256) ? 32 : 20);
+        }
+        ser_writedata32be(s, ~m_height);
     }
     template<typename Stream>
     void Unserialize(Stream& s) {
         m_stake_type = (txnouttype) ser_readdata8(s);
         m_stake_id.SetNull();
         s.read((char*)m_stake_id.begin(), (m_stake_type == TX_PUBKEYHASH256) ? 32 : 20);
-        m_height = ser_readdata32be(s);
         m_spend_type = (txnouttype) ser_readdata8(s);
         m_spend_id.SetNull();
-        s.read((char*)m_spend_id.begin(), (m_spend_type == TX_PUBKEYHASH256 || m_spend_type == TX_SCRIPTHASH256) ? 32 : 20);
+        if (m_spend_type != TX_NONSTANDARD) {
+            s.read((char*)m_spend_id.begin(), (m_spend_type == TX_PUBKEYHASH256 || m_spend_type == TX_SCRIPTHASH256) ? 32 : 20);
+        }
+        m_height = ~ser_readdata32be(s);
     }
 
-    friend bool operator<(const ColdStakeIndexLinkKey& a, const ColdStakeIndexLinkKey& b) {
+    /** Same stake and spend address, ignores the height */
+    bool SameLink(const ColdStakeIndexWeightKey& b) const {
+        return m_stake_type == b.m_stake_type && m_stake_id == b.m_stake_id
+            && m_spend_type == b.m_spend_type && m_spend_id == b.m_spend_id;
+    }
+
+    friend bool operator<(const ColdStakeIndexWeightKey& a, const ColdStakeIndexWeightKey& b) {
         int cmp = a.m_stake_id.Compare(b.m_stake_id);
         if (cmp < 0) return true;
         if (cmp > 0) return false;
+        if (a.m_spend_type != b.m_spend_type) return a.m_spend_type < b.m_spend_type;
         cmp = a.m_spend_id.Compare(b.m_spend_id);
         if (cmp < 0) return true;
         if (cmp > 0) return false;
-        return a.m_height < b.m_height;
+        return a.m_height > b.m_height;
     }
 };
 
@@ -12,6 +12,9 @@
 #include <script/interpreter.h>
 #include <util.h>
 
+#include <algorithm>
+#include <thread>
+
 bool ExtractIndexInfo(const CScript *pScript, int &scriptType, std::vector<uint8_t> &hashBytes)
 {
     CScript tmpScript;
@@ -54,13 +57,77 @@ bool ExtractIndexInfo(const CTxOutBase *out, int &scriptType, std::vector<uint8_
     return true;
 };
 
-bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes)
+/**
+ * Logical timestamps of the active chain by height.
+ * Each is above the one before, so a time range is found by binary search.
+ */
+static CCriticalSection cs_chainTimes;
+static std::vector<std::pair<unsigned int, const CBlockIndex*> > vChainTimes;
+
+void TimestampIndexSetTip(const CBlockIndex *pindex)
+{
+    AssertLockHeld(cs_main);
+    LOCK(cs_chainTimes);
+
+    while (!vChainTimes.empty()
+        && (!pindex
+            || vChainTimes.size() > (size_t)pindex->nHeight + 1
+            || pindex->GetAncestor(vChainTimes.size() - 1) != vChainTimes.back().second)) {
+        vChainTimes.pop_back();
+    }
+    if (!pindex) {
+        return;
+    }
+
+    size_t nFrom = vChainTimes.size();
+    vChainTimes.resize(pindex->nHeight + 1);
+    for (const CBlockIndex *p = pindex; p && (size_t)p->nHeight >= nFrom; p = p->pprev) {
+        vChainTimes[p->nHeight].second = p;
+    }
+    // As ConnectBlock assigns the logical timestamps
+    for (size_t i = nFrom; i < vChainTimes.size(); ++i) {
+        unsigned int logicalTS = vChainTimes[i].second->nTime;
+        if (i > 0 && logicalTS <= vChainTimes[i - 1].first) {
+            logicalTS = vChainTimes[i - 1].first + 1;
+        }
+        vChainTimes[i].first = logicalTS;
+    }
+};
+
+std::unique_ptr<CDBSnapshot> GetIndexSnapshot()
+{
+    return pblocktree->GetIndexSnapshot();
+};
+
+bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes,
+                       const CDBSnapshot *snapshot)
 {
     if (!fTimestampIndex) {
         return error("Timestamp index not enabled");
     }
 
-    if (!pblocktree->ReadTimestampIndex(high, low, fActiveOnly, hashes)) {
+    if (fActiveOnly) {
+        bool fEmpty;
+        {
+            LOCK(cs_chainTimes);
+            fEmpty = vChainTimes.empty();
+        }
+        if (fEmpty) {
+            // Not followed since the index was enabled
+            LOCK(cs_main);
+            TimestampIndexSetTip(chainActive.Tip());
+        }
+
+        LOCK(cs_chainTimes);
+        auto it = std::lower_bound(vChainTimes.begin(), vChainTimes.end(), low,
+            [](const std::pair<unsigned int, const CBlockIndex*> &a, unsigned int t) { return a.first < t; });
+        for (; it != vChainTimes.end() && it->first < high; ++it) {
+            hashes.push_back(std::make_pair(it->second->GetBlockHash(), it->first));
+        }
+        return true;
+    }
+
+    if (!pblocktree->ReadTimestampIndex(high, low, hashes, snapshot)) {
         return error("Unable to get hashes for timestamps");
     }
 
@@ -68,6 +135,11 @@ bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const
 };
 
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
+{
+    return GetSpentIndex(key, value, nullptr);
+};
+
+bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value, const CDBSnapshot *snapshot)
 {
     if (!fSpentIndex) {
         return false;
@@ -77,7 +149,7 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
         return true;
     }
 
-    if (!pblocktree->ReadSpentIndex(key, value)) {
+    if (!pblocktree->ReadSpentIndex(key, value, snapshot)) {
         return false;
     }
 
@@ -96,13 +168,30 @@ bool HashOnchainActive(const uint256 &hash)
 };
 
 bool GetAddressIndex(uint256 addressHash, int type,
-                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end)
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end,
+                     const CDBSnapshot *snapshot)
+{
+    if (!fAddressIndex) {
+        return error("Address index not enabled");
+    }
+
+    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end, snapshot)) {
+        return error("Unable to get txids for address");
+    }
+
+    return true;
+};
+
+bool GetAddressIndexPage(uint256 addressHash, int type,
+                         std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                         int nFromHeight, unsigned int nFromTxIndex, int end, size_t nMaxTxns,
+                         const CDBSnapshot *snapshot)
 {
     if (!fAddressIndex) {
         return error("Address index not enabled");
     }
 
-    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end)) {
+    if (!pblocktree->ReadAddressIndexPage(addressHash, type, addressIndex, nFromHeight, nFromTxIndex, end, nMaxTxns, snapshot)) {
         return error("Unable to get txids for address");
     }
 
@@ -110,16 +199,214 @@ bool GetAddressIndex(uint256 addressHash, int type,
 };
 
 bool GetAddressUnspent(uint256 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       const CDBSnapshot *snapshot)
 {
     if (!fAddressIndex) {
         return error("Address index not enabled");
     }
 
-    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs)) {
+    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs, snapshot)) {
         return error("Unable to get txids for address");
     }
 
     return true;
 };
 
+bool GetAddressBalance(uint256 addressHash, int type, CAddressBalanceValue &value, const CDBSnapshot *snapshot)
+{
+    if (!fAddressBalanceIndex) {
+        return error("Address balance index not enabled");
+    }
+
+    if (!pblocktree->ReadAddressBalance(addressHash, type, value, snapshot)) {
+        return error("Unable to get balance for address");
+    }
+
+    return true;
+};
+
+
+/**
+ * Read each address of addresses into its own run with fRead.
+ * Addresses are sorted into key order and deduplicated, then split into
+ * contiguous slices read concurrently, so each reader walks a nearby range of
+ * the db.
+ */
+template <typename T>
+static bool ReadAddressRuns(const std::vector<std::pair<uint256, int> > &addresses, std::vector<std::vector<T> > &runs,
+                            const std::function<bool(const std::pair<uint256, int>&, std::vector<T>&)> &fRead)
+{
+    std::vector<std::pair<uint256, int> > sorted(addresses);
+    std::sort(sorted.begin(), sorted.end(),
+        [](const std::pair<uint256, int> &a, const std::pair<uint256, int> &b) {
+            return a.second != b.second ? a.second < b.second : a.first < b.first;
+        });
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    runs.clear();
+    runs.resize(sorted.size());
+
+    size_t nReaders = std::min(MAX_ADDRESS_READERS, sorted.size() / MIN_ADDRESSES_PER_READER);
+    if (nReaders < 2) {
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            if (!fRead(sorted[i], runs[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<char> vOk(nReaders, 1);
+    std::vector<std::thread> readers;
+    size_t nPerReader = (sorted.size() + nReaders - 1) / nReaders;
+    for (size_t r = 0; r < nReaders; ++r) {
+        size_t nBegin = r * nPerReader, nEnd = std::min(sorted.size(), nBegin + nPerReader);
+        readers.emplace_back([&, r, nBegin, nEnd]() {
+            try {
+                for (size_t i = nBegin; i < nEnd; ++i) {
+                    if (!fRead(sorted[i], runs[i])) {
+                        vOk[r] = 0;
+                        return;
+                    }
+                }
+            } catch (const std::exception &e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+                vOk[r] = 0;
+            }
+        });
+    }
+    for (auto &reader : readers) {
+        reader.join();
+    }
+
+    return std::find(vOk.begin(), vOk.end(), 0) == vOk.end();
+};
+
+/** snapshot, or a new one owned by local if null */
+static const CDBSnapshot *UseSnapshot(const CDBSnapshot *snapshot, std::unique_ptr<CDBSnapshot> &local)
+{
+    if (!snapshot) {
+        local = pblocktree->GetIndexSnapshot();
+        snapshot = local.get();
+    }
+    return snapshot;
+};
+
+/** Merge runs each sorted by fLess into out, pairwise so each entry moves log(runs) times */
+template <typename T, typename Less>
+static void MergeAddressRuns(std::vector<std::vector<T> > &runs, std::vector<T> &out, Less fLess)
+{
+    std::vector<size_t> bounds{out.size()};
+    for (auto &run : runs) {
+        out.insert(out.end(), std::make_move_iterator(run.begin()), std::make_move_iterator(run.end()));
+        std::vector<T>().swap(run);
+        if (out.size() > bounds.back()) {
+            bounds.push_back(out.size());
+        }
+    }
+
+    while (bounds.size() > 2) {
+        std::vector<size_t> merged{bounds[0]};
+        for (size_t i = 0; i + 2 < bounds.size(); i += 2) {
+            std::inplace_merge(out.begin() + bounds[i], out.begin() + bounds[i + 1], out.begin() + bounds[i + 2], fLess);
+            merged.push_back(bounds[i + 2]);
+        }
+        if (bounds.size() % 2 == 0) {
+            merged.push_back(bounds.back());
+        }
+        bounds.swap(merged);
+    }
+};
+
+bool GetAddressIndex(const std::vector<std::pair<uint256, int> > &addresses,
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end,
+                     const CDBSnapshot *snapshot)
+{
+    if (!fAddressIndex) {
+        return error("Address index not enabled");
+    }
+
+    std::unique_ptr<CDBSnapshot> local;
+    snapshot = UseSnapshot(snapshot, local);
+
+    typedef std::pair<CAddressIndexKey, CAmount> Entry;
+    std::vector<std::vector<Entry> > runs;
+    if (!ReadAddressRuns<Entry>(addresses, runs,
+        [start, end, snapshot](const std::pair<uint256, int> &address, std::vector<Entry> &run) {
+            return pblocktree->ReadAddressIndex(address.first, address.second, run, start, end, snapshot);
+        })) {
+        return error("Unable to get txids for address");
+    }
+
+    // Each run is in key order, (height, txindex) leads the key after the address
+    MergeAddressRuns(runs, addressIndex, [](const Entry &a, const Entry &b) {
+        return std::make_pair(a.first.blockHeight, a.first.txindex) < std::make_pair(b.first.blockHeight, b.first.txindex);
+    });
+
+    return true;
+};
+
+bool GetAddressUnspent(const std::vector<std::pair<uint256, int> > &addresses,
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       const CDBSnapshot *snapshot)
+{
+    if (!fAddressIndex) {
+        return error("Address index not enabled");
+    }
+
+    std::unique_ptr<CDBSnapshot> local;
+    snapshot = UseSnapshot(snapshot, local);
+
+    typedef std::pair<CAddressUnspentKey, CAddressUnspentValue> Entry;
+    auto fLess = [](const Entry &a, const Entry &b) {
+        return a.second.blockHeight < b.second.blockHeight;
+    };
+
+    std::vector<std::vector<Entry> > runs;
+    if (!ReadAddressRuns<Entry>(addresses, runs,
+        [&fLess, snapshot](const std::pair<uint256, int> &address, std::vector<Entry> &run) {
+            if (!pblocktree->ReadAddressUnspentIndex(address.first, address.second, run, snapshot)) {
+                return false;
+            }
+            // Unspent keys are ordered by txid, not height
+            std::stable_sort(run.begin(), run.end(), fLess);
+            return true;
+        })) {
+        return error("Unable to get txids for address");
+    }
+
+    MergeAddressRuns(runs, unspentOutputs, fLess);
+
+    return true;
+};
+
+bool GetAddressBalance(const std::vector<std::pair<uint256, int> > &addresses, CAddressBalanceValue &value,
+                       const CDBSnapshot *snapshot)
+{
+    if (!fAddressBalanceIndex) {
+        return error("Address balance index not enabled");
+    }
+
+    std::unique_ptr<CDBSnapshot> local;
+    snapshot = UseSnapshot(snapshot, local);
+
+    std::vector<std::vector<CAddressBalanceValue> > runs;
+    if (!ReadAddressRuns<CAddressBalanceValue>(addresses, runs,
+        [snapshot](const std::pair<uint256, int> &address, std::vector<CAddressBalanceValue> &run) {
+            run.resize(1);
+            return pblocktree->ReadAddressBalance(address.first, address.second, run[0], snapshot);
+        })) {
+        return error("Unable to get balance for address");
+    }
+
+    value.SetNull();
+    for (const auto &run : runs) {
+        value.balance += run[0].balance;
+        value.received += run[0].received;
+        value.nTxCount += run[0].nTxCount;
+        value.nLastHeight = std::max(value.nLastHeight, run[0].nLastHeight);
+    }
+
+    return true;
+};
@@ -14,20 +14,57 @@
 #include <insight/spentindex.h>
 #include <insight/timestampindex.h>
 
+#include <memory>
+
+class CBlockIndex;
+class CDBSnapshot;
 class CTxOutBase;
 
 bool ExtractIndexInfo(const CScript *pScript, int &scriptType, std::vector<uint8_t> &hashBytes);
 bool ExtractIndexInfo(const CTxOutBase *out, int &scriptType, std::vector<uint8_t> &hashBytes, CAmount &nValue, const CScript *&pScript);
 
-/** Functions for insight block explorer */
-bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes);
+/**
+ * Functions for insight block explorer.
+ * Reads passed the same snapshot see the same state of the index, without cs_main.
+ */
+std::unique_ptr<CDBSnapshot> GetIndexSnapshot();
+bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes,
+                       const CDBSnapshot *snapshot = nullptr);
+/** Follow the active chain to pindex in the in memory timestamp index, cs_main must be held */
+void TimestampIndexSetTip(const CBlockIndex *pindex);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
+bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value, const CDBSnapshot *snapshot);
 bool HashOnchainActive(const uint256 &hash);
 bool GetAddressIndex(uint256 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                     int start = 0, int end = 0);
+                     int start = 0, int end = 0, const CDBSnapshot *snapshot = nullptr);
 bool GetAddressUnspent(uint256 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       const CDBSnapshot *snapshot = nullptr);
+bool GetAddressIndexPage(uint256 addressHash, int type,
+                         std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                         int nFromHeight, unsigned int nFromTxIndex, int end, size_t nMaxTxns,
+                         const CDBSnapshot *snapshot = nullptr);
+bool GetAddressBalance(uint256 addressHash, int type, CAddressBalanceValue &value, const CDBSnapshot *snapshot = nullptr);
+
+/**
+ * Bulk reads for many addresses, the addresses are read in key order by up to MAX_ADDRESS_READERS threads.
+ * All addresses are read from one snapshot, a new one if none is passed.
+ */
+static const size_t MAX_ADDRESS_READERS = 4;
+static const size_t MIN_ADDRESSES_PER_READER = 8;
+
+/** Entries of all addresses ordered by (height, txindex) */
+bool GetAddressIndex(const std::vector<std::pair<uint256, int> > &addresses,
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                     int start = 0, int end = 0, const CDBSnapshot *snapshot = nullptr);
+/** Unspent outputs of all addresses ordered by height */
+bool GetAddressUnspent(const std::vector<std::pair<uint256, int> > &addresses,
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       const CDBSnapshot *snapshot = nullptr);
+/** Balances of all addresses summed, nLastHeight is the highest */
+bool GetAddressBalance(const std::vector<std::pair<uint256, int> > &addresses, CAddressBalanceValue &value,
+                       const CDBSnapshot *snapshot = nullptr);
 
 
 #endif // BITCOIN_INSIGHT_INSIGHT_H
@@ -0,0 +1,475 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <insight/insightindex.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <insight/insight.h>
+#include <shutdown.h>
+#include <txdb.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+constexpr char DB_BUILD_FLAGS = 'F';
+
+std::unique_ptr<InsightIndex> g_insightindex;
+
+/** Rows of a block as ConnectBlock writes them */
+struct InsightBlockRows
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    // Unspent rows per txn, replayed in reverse when disconnecting like DisconnectBlock
+    std::vector<std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > > vSpentUnspent;
+    std::vector<std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > > vCreatedUnspent;
+};
+
+struct InsightIndex::Job
+{
+    explicit Job(const CBlockIndex* pindexIn) : pindex(pindexIn) {}
+
+    const CBlockIndex* pindex;
+    bool fStarted = false;
+    bool fCancelled = false;
+    bool fDone = false;
+    bool fOk = false;
+    InsightBlockRows rows;
+};
+
+fs::path GetInsightIndexDir()
+{
+    return GetDataDir() / "indexes" / "insight";
+}
+
+InsightIndex::InsightIndex(size_t n_cache_size, uint8_t build, int threads, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<BaseIndex::DB>(GetInsightIndexDir(), n_cache_size, f_memory, f_wipe)), m_build(build), m_threads(threads)
+{}
+
+InsightIndex::~InsightIndex()
+{
+    // The sync thread may wait on the workers, stop it first
+    Interrupt();
+    Stop();
+    StopWorkers();
+}
+
+bool InsightIndex::Init()
+{
+    // Rows were built for another set of indexes, start over. Rows are keyed
+    // by block, writing them again is harmless.
+    uint8_t build = 0;
+    if (!m_db->Read(DB_BUILD_FLAGS, build) || build != m_build) {
+        if (!m_db->WriteBestBlock(CBlockLocator())
+            || !m_db->Write(DB_BUILD_FLAGS, m_build)) {
+            return error("%s: Failed to reset %s", __func__, GetName());
+        }
+    }
+
+    CBlockLocator locator;
+    if (m_db->ReadBestBlock(locator) && !locator.IsNull()) {
+        LOCK(cs_main);
+        m_last_block = LookupBlockIndex(locator.vHave.front());
+    }
+
+    if (!BaseIndex::Init()) {
+        return false;
+    }
+
+    // The genesis block has spendable outputs, a new build starts before it
+    if (locator.IsNull()) {
+        m_best_block_index = nullptr;
+    }
+
+    // The locator may be on a branch reorged away while the node was down
+    if (!Rewind(m_best_block_index.load())) {
+        return false;
+    }
+
+    // The sync thread hands over to ConnectBlock, even when already at the tip
+    m_synced = false;
+
+    for (int i = 0; m_threads > 1 && i < m_threads; ++i) {
+        m_workers.emplace_back(&TraceThread<std::function<void()> >, "insightidx",
+                               std::bind(&InsightIndex::ThreadExtract, this));
+    }
+    return true;
+}
+
+bool InsightIndex::ExtractRows(const CBlock& block, const CBlockIndex* pindex, InsightBlockRows& rows) const
+{
+    const bool fAddress = m_build & BUILD_ADDRESS;
+    const bool fSpent = m_build & BUILD_SPENT;
+
+    // Spent outputs come from the undo data, the genesis block spends nothing
+    CBlockUndo blockundo;
+    if ((fAddress || fSpent) && pindex->pprev && !UndoReadFromDisk(blockundo, pindex)) {
+        return error("%s: Failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    rows.vSpentUnspent.resize(block.vtx.size());
+    rows.vCreatedUnspent.resize(block.vtx.size());
+
+    size_t nTxUndo = 0;
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+    {
+        const CTransaction &tx = *(block.vtx[i]);
+        const uint256 txhash = tx.GetHash();
+
+        if (!tx.IsCoinBase() && (fAddress || fSpent))
+        {
+            if (nTxUndo >= blockundo.vtxundo.size()) {
+                return error("%s: Undo data of block %s is inconsistent", __func__, pindex->GetBlockHash().ToString());
+            }
+            const CTxUndo &txundo = blockundo.vtxundo[nTxUndo++];
+
+            size_t nPrevout = 0;
+            for (size_t j = 0; tx.IsBitcoinCVersion() && j < tx.vin.size(); j++)
+            {
+                const CTxIn &input = tx.vin[j];
+                if (input.IsAnonInput())
+                    continue;
+
+                if (nPrevout >= txundo.vprevout.size()) {
+                    return error("%s: Undo data of txn %s is inconsistent", __func__, txhash.ToString());
+                }
+                const Coin &coin = txundo.vprevout[nPrevout++];
+                const CScript *pScript = &coin.out.scriptPubKey;
+
+                CAmount nValue = coin.out.nValue;
+                std::vector<uint8_t> hashBytes;
+                int scriptType = 0;
+                if (!ExtractIndexInfo(pScript, scriptType, hashBytes)
+                    || scriptType == 0)
+                    continue;
+
+                uint256 hashAddress = uint256(hashBytes.data(), hashBytes.size());
+                if (fAddress)
+                {
+                    rows.addressIndex.push_back(std::make_pair(CAddressIndexKey(scriptType, hashAddress, pindex->nHeight, i, txhash, j, true), nValue * -1));
+                    rows.vSpentUnspent[i].push_back(std::make_pair(CAddressUnspentKey(scriptType, hashAddress, input.prevout.hash, input.prevout.n), CAddressUnspentValue(nValue, *pScript, coin.nHeight)));
+                };
+
+                if (fSpent)
+                    rows.spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, nValue, scriptType, hashAddress)));
+            };
+        };
+
+        if (!fAddress)
+            continue;
+
+        for (unsigned int k = 0; k < tx.vpout.size(); k++)
+        {
+            const CTxOutBase *out = tx.vpout[k].get();
+
+            if (!out->IsType(OUTPUT_STANDARD))
+                continue;
+
+            const CScript *pScript;
+            std::vector<unsigned char> hashBytes;
+            int scriptType = 0;
+            CAmount nValue;
+            if (!ExtractIndexInfo(out, scriptType, hashBytes, nValue, pScript)
+                || scriptType == 0)
+                continue;
+
+            uint256 hashAddress = uint256(hashBytes.data(), hashBytes.size());
+            rows.addressIndex.push_back(std::make_pair(CAddressIndexKey(scriptType, hashAddress, pindex->nHeight, i, txhash, k, false), nValue));
+            rows.vCreatedUnspent[i].push_back(std::make_pair(CAddressUnspentKey(scriptType, hashAddress, txhash, k), CAddressUnspentValue(nValue, *pScript, pindex->nHeight)));
+        };
+    };
+
+    return true;
+}
+
+bool InsightIndex::WriteRows(const InsightBlockRows& rows, const CBlockIndex* pindex, bool fDisconnect)
+{
+    if (m_build & BUILD_ADDRESS)
+    {
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+        size_t nTxns = rows.vCreatedUnspent.size();
+        for (size_t n = 0; n < nTxns; n++)
+        {
+            if (fDisconnect)
+            {
+                size_t i = nTxns - 1 - n;
+                for (const auto &it : rows.vCreatedUnspent[i])
+                    addressUnspentIndex.push_back(std::make_pair(it.first, CAddressUnspentValue()));
+                for (const auto &it : rows.vSpentUnspent[i])
+                    addressUnspentIndex.push_back(it);
+            } else
+            {
+                for (const auto &it : rows.vSpentUnspent[n])
+                    addressUnspentIndex.push_back(std::make_pair(it.first, CAddressUnspentValue()));
+                for (const auto &it : rows.vCreatedUnspent[n])
+                    addressUnspentIndex.push_back(it);
+            };
+        };
+
+        if (fDisconnect ? !pblocktree->EraseAddressIndex(rows.addressIndex) : !pblocktree->WriteAddressIndex(rows.addressIndex))
+            return error("%s: Failed to write address index", __func__);
+        if ((m_build & BUILD_ADDRESS_BALANCE)
+            && !pblocktree->UpdateAddressBalanceIndex(rows.addressIndex, fDisconnect))
+            return error("%s: Failed to write address balance index", __func__);
+        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex))
+            return error("%s: Failed to write address unspent index", __func__);
+    };
+
+    if (m_build & BUILD_SPENT)
+    {
+        if (fDisconnect)
+        {
+            std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+            for (const auto &it : rows.spentIndex)
+                spentIndex.push_back(std::make_pair(it.first, CSpentIndexValue()));
+            if (!pblocktree->UpdateSpentIndex(spentIndex))
+                return error("%s: Failed to write transaction index", __func__);
+        } else
+        if (!pblocktree->UpdateSpentIndex(rows.spentIndex))
+            return error("%s: Failed to write transaction index", __func__);
+    };
+
+    // DisconnectBlock leaves the timestamp index, reads filter on the active chain
+    if ((m_build & BUILD_TIMESTAMP) && !fDisconnect)
+    {
+        unsigned int logicalTS = pindex->nTime;
+        unsigned int prevLogicalTS = 0;
+
+        if (pindex->pprev)
+            if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
+                LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
+
+        if (logicalTS <= prevLogicalTS)
+            logicalTS = prevLogicalTS + 1;
+
+        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
+            return error("%s: Failed to write timestamp index", __func__);
+
+        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
+            return error("%s: Failed to write blockhash index", __func__);
+    };
+
+    return true;
+}
+
+bool InsightIndex::Rewind(const CBlockIndex* pindex_to)
+{
+    const Consensus::Params& consensus_params = Params().GetConsensus();
+    while (m_last_block && m_last_block != pindex_to)
+    {
+        if (pindex_to && m_last_block->nHeight <= pindex_to->nHeight) {
+            return error("%s: Block %s is not an ancestor of the last block built", __func__, pindex_to->GetBlockHash().ToString());
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, m_last_block, consensus_params)) {
+            return error("%s: Failed to read block %s from disk", __func__, m_last_block->GetBlockHash().ToString());
+        }
+        InsightBlockRows rows;
+        if (!ExtractRows(block, m_last_block, rows)
+            || !WriteRows(rows, m_last_block, true)) {
+            return false;
+        }
+        m_last_block = m_last_block->pprev;
+    };
+    return true;
+}
+
+void InsightIndex::ThreadExtract()
+{
+    const Consensus::Params& consensus_params = Params().GetConsensus();
+    while (true)
+    {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(m_cs_jobs);
+            m_cv_queued.wait(lock, [this] { return m_stop_workers || !m_queue.empty(); });
+            if (m_stop_workers)
+                return;
+            job = m_queue.front();
+            m_queue.pop_front();
+            if (job->fCancelled)
+                continue;
+            job->fStarted = true;
+        }
+
+        CBlock block;
+        bool fOk = ReadBlockFromDisk(block, job->pindex, consensus_params)
+            && ExtractRows(block, job->pindex, job->rows);
+
+        {
+            std::lock_guard<std::mutex> lock(m_cs_jobs);
+            job->fOk = fOk;
+            job->fDone = true;
+        }
+        m_cv_done.notify_all();
+    };
+}
+
+void InsightIndex::StopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_cs_jobs);
+        m_stop_workers = true;
+    }
+    m_cv_queued.notify_all();
+    for (auto &worker : m_workers) {
+        if (worker.joinable())
+            worker.join();
+    }
+    m_workers.clear();
+}
+
+std::shared_ptr<InsightIndex::Job> InsightIndex::TakeJob(const CBlockIndex* pindex)
+{
+    std::lock_guard<std::mutex> lock(m_cs_jobs);
+    // Jobs before pindex are left over from a branch reorged away
+    while (!m_jobs.empty() && m_jobs.front()->pindex->nHeight <= pindex->nHeight)
+    {
+        std::shared_ptr<Job> job = m_jobs.front();
+        m_jobs.pop_front();
+        if (job->pindex == pindex && !job->fCancelled)
+            return job;
+        job->fCancelled = true;
+    };
+    return nullptr;
+}
+
+void InsightIndex::Prefetch(const CBlockIndex* pindex)
+{
+    if (m_workers.empty())
+        return;
+
+    LOCK(cs_main);
+    std::lock_guard<std::mutex> lock(m_cs_jobs);
+    const CBlockIndex *pindex_next = m_jobs.empty() ? pindex : m_jobs.back()->pindex;
+    if (!chainActive.Contains(pindex_next))
+    {
+        for (auto &job : m_jobs)
+            job->fCancelled = true;
+        m_jobs.clear();
+        pindex_next = pindex;
+    };
+
+    size_t nMaxJobs = m_workers.size() * INSIGHT_INDEX_PREFETCH_PER_THREAD;
+    while (m_jobs.size() < nMaxJobs
+        && (pindex_next = chainActive.Next(pindex_next)))
+    {
+        std::shared_ptr<Job> job = std::make_shared<Job>(pindex_next);
+        m_jobs.push_back(job);
+        m_queue.push_back(job);
+    };
+    m_cv_queued.notify_all();
+}
+
+bool InsightIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // After a reorg the sync thread continues from the fork point
+    if (m_last_block != pindex->pprev && !Rewind(pindex->pprev)) {
+        return false;
+    }
+
+    std::shared_ptr<Job> job = TakeJob(pindex);
+    Prefetch(pindex);
+
+    InsightBlockRows rows;
+    bool fHaveRows = false;
+    if (job)
+    {
+        std::unique_lock<std::mutex> lock(m_cs_jobs);
+        if (job->fStarted)
+        {
+            m_cv_done.wait(lock, [&job] { return job->fDone; });
+            if (!job->fOk)
+                return false;
+            rows = std::move(job->rows);
+            fHaveRows = true;
+        } else
+        {
+            // Not picked up yet, the block is already in hand
+            job->fCancelled = true;
+        };
+    };
+
+    if (!fHaveRows && !ExtractRows(block, pindex, rows)) {
+        return false;
+    }
+    if (!WriteRows(rows, pindex, false)) {
+        return false;
+    }
+    m_last_block = pindex;
+    return true;
+}
+
+bool InsightIndex::SyncCompleted()
+{
+    AssertLockHeld(cs_main);
+
+    // Keep following the tip until block import is done, ConnectBlock would
+    // otherwise take the row extraction back on the validation thread.
+    if (fReindex || fImporting) {
+        return false;
+    }
+
+    // Every block up to the tip has rows, the next is written by ConnectBlock
+    bool fOk = true;
+    if (m_build & BUILD_ADDRESS) {
+        fOk = fOk && pblocktree->WriteFlag("compactaddressindex", true) && pblocktree->WriteFlag("addressindex", true);
+    }
+    if (m_build & BUILD_ADDRESS_BALANCE) {
+        fOk = fOk && pblocktree->WriteFlag("addressbalanceindex", true);
+    }
+    if (m_build & BUILD_SPENT) {
+        fOk = fOk && pblocktree->WriteFlag("spentindex", true);
+    }
+    if (m_build & BUILD_TIMESTAMP) {
+        fOk = fOk && pblocktree->WriteFlag("timestampindex", true);
+    }
+    if (!fOk) {
+        error("%s: Failed to enable the indexes built by %s", __func__, GetName());
+        StartShutdown();
+        return false;
+    }
+
+    fAddressIndex |= (bool)(m_build & BUILD_ADDRESS);
+    fAddressBalanceIndex |= (bool)(m_build & BUILD_ADDRESS_BALANCE);
+    fSpentIndex |= (bool)(m_build & BUILD_SPENT);
+    fTimestampIndex |= (bool)(m_build & BUILD_TIMESTAMP);
+
+    // Forget the build, enabling another index later starts from genesis
+    if (!m_db->Erase(DB_BUILD_FLAGS)) {
+        error("%s: Failed to reset %s", __func__, GetName());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_cs_jobs);
+        for (auto &job : m_jobs)
+            job->fCancelled = true;
+        m_jobs.clear();
+        m_queue.clear();
+        m_stop_workers = true;
+    }
+    m_cv_queued.notify_all();
+
+    LogPrintf("%s: insight indexes built up to height %d, maintained by block validation from now on\n",
+        __func__, chainActive.Height());
+    return true;
+}
+
+void InsightIndex::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex,
+                                  const std::vector<CTransactionRef>& txn_conflicted)
+{
+    // Blocks connected once synced are indexed by ConnectBlock
+}
+
+void InsightIndex::BlockDisconnected(const std::shared_ptr<const CBlock> &pblock)
+{
+    // Blocks disconnected once synced are unindexed by DisconnectBlock
+}
+
+void InsightIndex::ChainStateFlushed(const CBlockLocator& locator)
+{
+    // Synced means handed over, the locator is unused from then on
+}
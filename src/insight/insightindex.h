@@ -0,0 +1,105 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_INSIGHT_INSIGHTINDEX_H
+#define BITCOINC_INSIGHT_INSIGHTINDEX_H
+
+#include <index/base.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+static const size_t DEFAULT_INSIGHT_INDEX_CACHE = 1 << 20; // the index db only holds the locator
+static const int DEFAULT_INSIGHT_INDEX_THREADS = 0; // 0 = one per core
+static const int MAX_INSIGHT_INDEX_THREADS = 16;
+static const size_t INSIGHT_INDEX_PREFETCH_PER_THREAD = 4; // blocks extracted ahead of the writer
+
+struct InsightBlockRows;
+
+/**
+ * InsightIndex builds the insight indexes enabled on an existing database
+ * (-addressindex, -spentindex, -timestampindex), or rebuilt by -reindex, from
+ * the block and undo files while the node runs.
+ * Worker threads read blocks ahead of the sync thread and extract their rows,
+ * the sync thread writes them to the block tree db in chain order, one batch
+ * per index per block, exactly as ConnectBlock would.
+ * The locator of the last block built is kept in indexes/insight so a restart
+ * resumes where the build stopped.
+ * Once the build reaches the tip outside of a reindex or import, the indexes
+ * are flagged enabled and ConnectBlock maintains them from the next block on,
+ * the index goes idle.
+ */
+class InsightIndex final : public BaseIndex
+{
+public:
+    enum BuildFlags : uint8_t {
+        BUILD_ADDRESS           = (1 << 0),
+        BUILD_ADDRESS_BALANCE   = (1 << 1),
+        BUILD_SPENT             = (1 << 2),
+        BUILD_TIMESTAMP         = (1 << 3),
+    };
+
+private:
+    struct Job;
+
+    const std::unique_ptr<BaseIndex::DB> m_db;
+    const uint8_t m_build;
+    const int m_threads;
+
+    /// Last block with rows written, blocks of a stale branch are rewound from here.
+    const CBlockIndex* m_last_block = nullptr;
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_cs_jobs;
+    std::condition_variable m_cv_queued;
+    std::condition_variable m_cv_done;
+    bool m_stop_workers = false;
+    /// Blocks scheduled after the block being written, in chain order.
+    std::deque<std::shared_ptr<Job> > m_jobs;
+    /// Jobs not yet taken by a worker.
+    std::deque<std::shared_ptr<Job> > m_queue;
+
+    bool ExtractRows(const CBlock& block, const CBlockIndex* pindex, InsightBlockRows& rows) const;
+    bool WriteRows(const InsightBlockRows& rows, const CBlockIndex* pindex, bool fDisconnect);
+    bool Rewind(const CBlockIndex* pindex_to);
+
+    void ThreadExtract();
+    void StopWorkers();
+    std::shared_ptr<Job> TakeJob(const CBlockIndex* pindex);
+    void Prefetch(const CBlockIndex* pindex);
+
+protected:
+    bool Init() override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool SyncCompleted() override;
+
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex,
+                        const std::vector<CTransactionRef>& txn_conflicted) override;
+
+    void BlockDisconnected(const std::shared_ptr<const CBlock> &pblock) override;
+
+    void ChainStateFlushed(const CBlockLocator& locator) override;
+
+    BaseIndex::DB& GetDB() const override { return *m_db; }
+
+    const char* GetName() const override { return "insightindex"; }
+
+public:
+    /// threads <= 1 extracts rows on the sync thread.
+    InsightIndex(size_t n_cache_size, uint8_t build, int threads, bool f_memory = false, bool f_wipe = false);
+
+    ~InsightIndex();
+};
+
+/// Directory of the index db, a partial build is discarded with it on -reindex.
+fs::path GetInsightIndexDir();
+
+/// Runs while insight indexes enabled after the database was created are built. May be null.
+extern std::unique_ptr<InsightIndex> g_insightindex;
+
+#endif // BITCOINC_INSIGHT_INSIGHTINDEX_H
@@ -5,13 +5,17 @@
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <rpc/blockchain.h>
+#include <rpc/jsonstream.h>
 
 #include <utilstrencodings.h>
 #include <insight/insight.h>
 #include <insight/csindex.h>
+#include <pos/reward.h>
 #include <index/txindex.h>
+#include <dbwrapper.h>
 #include <validation.h>
 #include <txmempool.h>
+#include <txdb.h>
 #include <key_io.h>
 #include <core_io.h>
 
@@ -52,6 +56,29 @@ bool getAddressFromIndex(const int &type, const uint256 &hash, std::string &addr
     return true;
 }
 
+/** Encodes the addresses of index rows, each distinct address once, the rows of a query share few addresses */
+class AddressEncodeCache
+{
+public:
+    bool Get(int type, const uint256 &hash, std::string &address)
+    {
+        std::pair<int, uint256> key(type, hash);
+        auto it = m_cache.find(key);
+        if (it == m_cache.end()) {
+            std::string encoded;
+            if (!getAddressFromIndex(type, hash, encoded)) {
+                return false;
+            }
+            it = m_cache.emplace(key, std::move(encoded)).first;
+        }
+        address = it->second;
+        return true;
+    }
+
+private:
+    std::map<std::pair<int, uint256>, std::string> m_cache;
+};
+
 bool getAddressesFromParams(const UniValue& params, std::vector<std::pair<uint256, int> > &addresses)
 {
     if (params[0].isStr()) {
@@ -88,18 +115,120 @@ bool getAddressesFromParams(const UniValue& params, std::vector<std::pair<uint25
     return true;
 }
 
-bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
-                std::pair<CAddressUnspentKey, CAddressUnspentValue> b)
-{
-    return a.second.blockHeight < b.second.blockHeight;
-}
-
 bool timestampSort(std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> a,
                    std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> b)
 {
     return a.second.time < b.second.time;
 }
 
+/** A page of txns from the address index, txns are ordered by (height, txindex) */
+struct AddressIndexPage
+{
+    size_t nLimit = 0;
+    size_t nOffset = 0;
+    int nAfterHeight = -1;
+    unsigned int nAfterTxIndex = 0;
+};
+
+static const std::string addressIndexPageHelp =
+    "  \"limit\" (number, optional) Return at most this many transactions and the cursor of the next page\n"
+    "  \"offset\" (number, optional) Skip this many transactions, only applies if limit specified\n"
+    "  \"after\" (string, optional) The cursor returned by the previous page, \"height:blockindex\"\n";
+
+static bool getAddressIndexPageFromParams(const UniValue& params, AddressIndexPage &page)
+{
+    if (!params[0].isObject()) {
+        return false;
+    }
+
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    if (limitValue.isNull()) {
+        return false;
+    }
+    int64_t nLimit = limitValue.get_int64();
+    if (nLimit <= 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be greater than zero");
+    }
+    page.nLimit = nLimit;
+
+    UniValue offsetValue = find_value(params[0].get_obj(), "offset");
+    if (!offsetValue.isNull()) {
+        int64_t nOffset = offsetValue.get_int64();
+        if (nOffset < 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Offset is expected to be zero or greater");
+        }
+        page.nOffset = nOffset;
+    }
+
+    UniValue afterValue = find_value(params[0].get_obj(), "after");
+    if (!afterValue.isNull()) {
+        const std::string &sAfter = afterValue.get_str();
+        size_t nSep = sAfter.find(':');
+        int32_t nHeight;
+        uint32_t nTxIndex;
+        if (nSep == std::string::npos
+            || !ParseInt32(sAfter.substr(0, nSep), &nHeight) || nHeight < 0
+            || !ParseUInt32(sAfter.substr(nSep + 1), &nTxIndex)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+        page.nAfterHeight = nHeight;
+        page.nAfterTxIndex = nTxIndex;
+    }
+
+    return true;
+}
+
+/**
+ * Read a page of txns of addresses from the address index.
+ * Each address is read only as far as the page needs.
+ * Returns the cursor of the next page, or an empty string if this is the last.
+ */
+static std::string readAddressIndexPage(const std::vector<std::pair<uint256, int> > &addresses, const AddressIndexPage &page,
+                                        int start, int end, std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex)
+{
+    int nFromHeight = std::max(start, 0);
+    unsigned int nFromTxIndex = 0;
+    if (page.nAfterHeight >= nFromHeight) {
+        nFromHeight = page.nAfterHeight;
+        nFromTxIndex = page.nAfterTxIndex + 1;
+        if (nFromTxIndex == 0) {
+            nFromHeight++;
+        }
+    }
+
+    // One txn more than the page to tell if there is a next page, all addresses as of one block
+    std::unique_ptr<CDBSnapshot> snapshot = GetIndexSnapshot();
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    for (const auto &address : addresses) {
+        if (!GetAddressIndexPage(address.first, address.second, vEntries, nFromHeight, nFromTxIndex, end, page.nOffset + page.nLimit + 1, snapshot.get())) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+    }
+    std::stable_sort(vEntries.begin(), vEntries.end(),
+        [](const std::pair<CAddressIndexKey, CAmount> &a, const std::pair<CAddressIndexKey, CAmount> &b) {
+            return std::make_pair(a.first.blockHeight, a.first.txindex) < std::make_pair(b.first.blockHeight, b.first.txindex);
+        });
+
+    size_t nTxns = 0;
+    int lastHeight = -1;
+    unsigned int lastTxIndex = 0;
+    for (const auto &entry : vEntries) {
+        if (entry.first.blockHeight != lastHeight || entry.first.txindex != lastTxIndex) {
+            if (nTxns >= page.nOffset + page.nLimit) {
+                return strprintf("%d:%u", lastHeight, lastTxIndex);
+            }
+            nTxns++;
+            lastHeight = entry.first.blockHeight;
+            lastTxIndex = entry.first.txindex;
+        }
+        if (nTxns > page.nOffset) {
+            addressIndex.push_back(entry);
+        }
+    }
+
+    return "";
+}
+
 UniValue getaddressmempool(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -150,26 +279,28 @@ UniValue getaddressmempool(const JSONRPCRequest& request)
     std::sort(indexes.begin(), indexes.end(), timestampSort);
 
     UniValue result(UniValue::VARR);
+    result.reserve(indexes.size());
 
+    AddressEncodeCache addressCache;
     for (std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> >::iterator it = indexes.begin();
          it != indexes.end(); it++) {
 
         std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.addressBytes, address)) {
+        if (!addressCache.Get(it->first.type, it->first.addressBytes, address)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
         }
 
         UniValue delta(UniValue::VOBJ);
-        delta.pushKV("address", address);
-        delta.pushKV("txid", it->first.txhash.GetHex());
-        delta.pushKV("index", (int)it->first.index);
-        delta.pushKV("satoshis", it->second.amount);
-        delta.pushKV("timestamp", it->second.time);
+        delta.pushKVEnd("address", address);
+        delta.pushKVEnd("txid", it->first.txhash.GetHex());
+        delta.pushKVEnd("index", (int)it->first.index);
+        delta.pushKVEnd("satoshis", it->second.amount);
+        delta.pushKVEnd("timestamp", it->second.time);
         if (it->second.amount < 0) {
-            delta.pushKV("prevtxid", it->second.prevhash.GetHex());
-            delta.pushKV("prevout", (int)it->second.prevout);
+            delta.pushKVEnd("prevtxid", it->second.prevhash.GetHex());
+            delta.pushKVEnd("prevout", (int)it->second.prevout);
         }
-        result.push_back(delta);
+        result.push_back(std::move(delta));
     }
 
     return result;
@@ -226,30 +357,28 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
 
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 
-    for (std::vector<std::pair<uint256, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressUnspent(it->first, it->second, unspentOutputs)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-        }
+    if (!GetAddressUnspent(addresses, unspentOutputs)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
     }
 
-    std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
-
     UniValue utxos(UniValue::VARR);
+    utxos.reserve(unspentOutputs.size());
 
+    AddressEncodeCache addressCache;
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++) {
         UniValue output(UniValue::VOBJ);
         std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
+        if (!addressCache.Get(it->first.type, it->first.hashBytes, address)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
         }
 
-        output.pushKV("address", address);
-        output.pushKV("txid", it->first.txhash.GetHex());
-        output.pushKV("outputIndex", (int)it->first.index);
-        output.pushKV("script", HexStr(it->second.script.begin(), it->second.script.end()));
-        output.pushKV("satoshis", it->second.satoshis);
-        output.pushKV("height", it->second.blockHeight);
-        utxos.push_back(output);
+        output.pushKVEnd("address", address);
+        output.pushKVEnd("txid", it->first.txhash.GetHex());
+        output.pushKVEnd("outputIndex", (int)it->first.index);
+        output.pushKVEnd("script", HexStr(it->second.script.begin(), it->second.script.end()));
+        output.pushKVEnd("satoshis", it->second.satoshis);
+        output.pushKVEnd("height", it->second.blockHeight);
+        utxos.push_back(std::move(output));
     }
 
     if (includeChainInfo) {
@@ -281,6 +410,7 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
             "  \"chainInfo\" (boolean) Include chain info in results, only applies if start and end specified\n"
+            + addressIndexPageHelp +
             "}\n"
             "\nResult:\n"
             "[\n"
@@ -292,8 +422,14 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
             "    \"address\"  (string) The base58check encoded address\n"
             "  }\n"
             "]\n"
+            "\nResult (with limit):\n"
+            "{\n"
+            "  \"deltas\"  (array) As above\n"
+            "  \"next\"  (string) The cursor of the next page, null after the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\"]}'")
+            + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\"], \"limit\": 100, \"after\": \"1234:5\"}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\"]}")
         );
 
@@ -330,36 +466,53 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    AddressIndexPage page;
+    bool fPaged = getAddressIndexPageFromParams(request.params, page);
+    std::string sNext;
+
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
-    for (std::vector<std::pair<uint256, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex(it->first, it->second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex(it->first, it->second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
+    if (fPaged) {
+        sNext = readAddressIndexPage(addresses, page, start, end, addressIndex);
+    } else {
+        bool fRange = start > 0 && end > 0;
+        if (!GetAddressIndex(addresses, addressIndex, fRange ? start : 0, fRange ? end : 0)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
     }
 
     UniValue deltas(UniValue::VARR);
 
+    // The plain array of deltas can be streamed
+    CJSONStreamWriter *stream = !fPaged && !(includeChainInfo && start > 0 && end > 0) ? request.stream : nullptr;
+    if (stream) {
+        stream->BeginArray();
+    }
+
+    AddressEncodeCache addressCache;
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
         std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
+        if (!addressCache.Get(it->first.type, it->first.hashBytes, address)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
         }
 
         UniValue delta(UniValue::VOBJ);
-        delta.pushKV("satoshis", it->second);
-        delta.pushKV("txid", it->first.txhash.GetHex());
-        delta.pushKV("index", (int)it->first.index);
-        delta.pushKV("blockindex", (int)it->first.txindex);
-        delta.pushKV("height", it->first.blockHeight);
-        delta.pushKV("address", address);
-        deltas.push_back(delta);
+        delta.pushKVEnd("satoshis", it->second);
+        delta.pushKVEnd("txid", it->first.txhash.GetHex());
+        delta.pushKVEnd("index", (int)it->first.index);
+        delta.pushKVEnd("blockindex", (int)it->first.txindex);
+        delta.pushKVEnd("height", it->first.blockHeight);
+        delta.pushKVEnd("address", address);
+        if (stream) {
+            stream->Value(delta);
+        } else {
+            deltas.push_back(std::move(delta));
+        }
+    }
+
+    if (stream) {
+        stream->EndArray();
+        return NullUniValue;
     }
 
     UniValue result(UniValue::VOBJ);
@@ -386,6 +539,14 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
         result.pushKV("deltas", deltas);
         result.pushKV("start", startInfo);
         result.pushKV("end", endInfo);
+        if (fPaged) {
+            result.pushKV("next", sNext.empty() ? NullUniValue : UniValue(sNext));
+        }
+
+        return result;
+    } else if (fPaged) {
+        result.pushKV("deltas", deltas);
+        result.pushKV("next", sNext.empty() ? NullUniValue : UniValue(sNext));
 
         return result;
     } else {
@@ -411,6 +572,8 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
             "{\n"
             "  \"balance\"  (string) The current balance in satoshis\n"
             "  \"received\"  (string) The total number of satoshis received (including change)\n"
+            "  \"txcount\"  (numeric) The number of transactions per address summed, with -addressbalanceindex\n"
+            "  \"lastheight\"  (numeric) The height of the last block to change an address, with -addressbalanceindex\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\"]}'")
@@ -427,12 +590,25 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint256, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressIndex(it->first, it->second, addressIndex)) {
+    if (fAddressBalanceIndex) {
+        CAddressBalanceValue value;
+        if (!GetAddressBalance(addresses, value)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
+
+        UniValue result(UniValue::VOBJ);
+        result.pushKV("balance", value.balance);
+        result.pushKV("received", value.received);
+        result.pushKV("txcount", (int64_t)value.nTxCount);
+        result.pushKV("lastheight", value.nLastHeight);
+
+        return result;
+    }
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+
+    if (!GetAddressIndex(addresses, addressIndex)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
     }
 
     CAmount balance = 0;
@@ -467,14 +643,21 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            + addressIndexPageHelp +
             "}\n"
             "\nResult:\n"
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nResult (with limit):\n"
+            "{\n"
+            "  \"txids\"  (array) As above, ordered by height and position in the block\n"
+            "  \"next\"  (string) The cursor of the next page, null after the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\"]}'")
+            + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\"], \"limit\": 100}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\"]}")
         );
 
@@ -499,18 +682,34 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
         }
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    AddressIndexPage page;
+    if (getAddressIndexPageFromParams(request.params, page)) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        bool fRange = start > 0 && end > 0;
+        std::string sNext = readAddressIndexPage(addresses, page, fRange ? start : 0, fRange ? end : 0, addressIndex);
 
-    for (std::vector<std::pair<uint256, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex(it->first, it->second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex(it->first, it->second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        UniValue txids(UniValue::VARR);
+        const CAddressIndexKey *pLast = nullptr;
+        for (const auto &entry : addressIndex) {
+            if (pLast && pLast->blockHeight == entry.first.blockHeight && pLast->txindex == entry.first.txindex) {
+                continue;
             }
+            txids.push_back(entry.first.txhash.GetHex());
+            pLast = &entry.first;
         }
+
+        UniValue result(UniValue::VOBJ);
+        result.pushKV("txids", txids);
+        result.pushKV("next", sNext.empty() ? NullUniValue : UniValue(sNext));
+
+        return result;
+    }
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+
+    bool fRange = start > 0 && end > 0;
+    if (!GetAddressIndex(addresses, addressIndex, fRange ? start : 0, fRange ? end : 0)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
     }
 
     std::set<std::pair<int, std::string> > txids;
@@ -625,6 +824,12 @@ static UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blocki
 
     UniValue deltas(UniValue::VARR);
 
+    // Inputs of the block are looked up from one state of the spent index
+    std::unique_ptr<CDBSnapshot> snapshot;
+    if (fSpentIndex) {
+        snapshot = GetIndexSnapshot();
+    }
+
     for (unsigned int i = 0; i < block.vtx.size(); i++) {
         const CTransaction &tx = *(block.vtx[i]);
         const uint256 txhash = tx.GetHash();
@@ -645,7 +850,7 @@ static UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blocki
                 CSpentIndexValue spentInfo;
                 CSpentIndexKey spentKey(input.prevout.hash, input.prevout.n);
 
-                if (GetSpentIndex(spentKey, spentInfo)) {
+                if (GetSpentIndex(spentKey, spentInfo, snapshot.get())) {
                     if (spentInfo.addressType == ADDR_INDT_PUBKEY_ADDRESS) {
                         delta.pushKV("address", EncodeDestination(CKeyID(uint160(spentInfo.addressHash.begin(), 20))));
                     } else if (spentInfo.addressType == ADDR_INDT_SCRIPT_ADDRESS)  {
@@ -804,10 +1009,6 @@ static UniValue getblockhashes(const JSONRPCRequest& request)
 
     std::vector<std::pair<uint256, unsigned int> > blockHashes;
 
-    if (fActiveOnly) {
-        LOCK(cs_main);
-    }
-
     if (!GetTimestampIndex(high, low, fActiveOnly, blockHashes)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for block hashes");
     }
@@ -828,13 +1029,40 @@ static UniValue getblockhashes(const JSONRPCRequest& request)
     return result;
 }
 
+namespace {
+struct PerScriptTypeStats
+{
+    int64_t nPlain = 0;
+    int64_t nPlainValue = 0;
+
+    void Add(const PerScriptTypeStats &b)
+    {
+        nPlain += b.nPlain;
+        nPlainValue += b.nPlainValue;
+    }
+
+    UniValue ToUV() const
+    {
+        UniValue ret(UniValue::VOBJ);
+        ret.pushKV("num_plain", nPlain);
+        ret.pushKV("total_amount", ValueFromAmount(nPlainValue));
+        return ret;
+    }
+};
+
+enum ScriptStatsType { STATS_PKH, STATS_SH, STATS_CSPKH, STATS_CSSH, STATS_OTHER, STATS_MAX };
+} // namespace
+
 UniValue gettxoutsetinfobyscript(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw std::runtime_error(
-            "gettxoutsetinfobyscript\n"
+            "gettxoutsetinfobyscript ( flush )\n"
             "\nReturns statistics about the unspent transaction output set per script type.\n"
             "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. flush        (boolean, optional, default=true) Flush the coins cache first, else the state of the last\n"
+            "                flush is reported without writing to the chainstate database.\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
@@ -850,69 +1078,61 @@ UniValue gettxoutsetinfobyscript(const JSONRPCRequest& request)
     int nHeight;
     uint256 hashBlock;
 
-    FlushStateToDisk();
-    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
-
-    hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        nHeight = mapBlockIndex.find(hashBlock)->second->nHeight;
+    if (request.params[0].isNull() || request.params[0].get_bool()) {
+        FlushStateToDisk();
     }
 
-    class PerScriptTypeStats {
-    public:
-        int64_t nPlain = 0;
-        int64_t nPlainValue = 0;
-
-        UniValue ToUV()
-        {
-            UniValue ret(UniValue::VOBJ);
-            ret.pushKV("num_plain", nPlain);
-            ret.pushKV("total_amount", ValueFromAmount(nPlainValue));
-            return ret;
-        }
-    };
-
-    PerScriptTypeStats statsPKH;
-    PerScriptTypeStats statsSH;
-    PerScriptTypeStats statsCSPKH;
-    PerScriptTypeStats statsCSSH;
-    PerScriptTypeStats statsOther;
-
-    uint256 prevkey;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        COutPoint key;
-        Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            PerScriptTypeStats *ps = &statsOther;
+    // The key ranges are scanned in parallel and summed
+    std::mutex cs_stats;
+    PerScriptTypeStats stats[STATS_MAX];
+    auto scan = [&](int nPart, CCoinsViewCursor &cursor) {
+        PerScriptTypeStats partStats[STATS_MAX];
+        while (cursor.Valid()) {
+            COutPoint key;
+            Coin coin;
+            if (!cursor.GetKey(key) || !cursor.GetValue(coin)) {
+                return false;
+            }
+            int nType = STATS_OTHER;
             if (coin.out.scriptPubKey.IsPayToPublicKeyHash())
-                ps = &statsPKH;
+                nType = STATS_PKH;
             else if (coin.out.scriptPubKey.IsPayToScriptHash())
-                ps = &statsSH;
+                nType = STATS_SH;
             else if (coin.out.scriptPubKey.IsPayToPublicKeyHash256_CS())
-                ps = &statsCSPKH;
+                nType = STATS_CSPKH;
             else if (coin.out.scriptPubKey.IsPayToScriptHash256_CS() || coin.out.scriptPubKey.IsPayToScriptHash_CS() )
-                ps = &statsCSSH;
+                nType = STATS_CSSH;
 
             if (coin.nType == OUTPUT_STANDARD)
             {
-                ps->nPlain++;
-                ps->nPlainValue += coin.out.nValue;
+                partStats[nType].nPlain++;
+                partStats[nType].nPlainValue += coin.out.nValue;
             }
-        } else {
-            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+            cursor.Next();
+        }
+
+        std::lock_guard<std::mutex> lock(cs_stats);
+        for (int i = 0; i < STATS_MAX; ++i) {
+            stats[i].Add(partStats[i]);
         }
-        pcursor->Next();
+        return true;
+    };
+
+    if (!pcoinsdbview->ScanCoins(GetNumCores(), hashBlock, scan)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+    }
+    {
+        LOCK(cs_main);
+        nHeight = mapBlockIndex.find(hashBlock)->second->nHeight;
     }
 
     ret.pushKV("height", (int64_t)nHeight);
     ret.pushKV("bestblock", hashBlock.GetHex());
-    ret.pushKV("paytopubkeyhash", statsPKH.ToUV());
-    ret.pushKV("paytoscripthash", statsSH.ToUV());
-    ret.pushKV("coldstake_paytopubkeyhash", statsCSPKH.ToUV());
-    ret.pushKV("coldstake_paytoscripthash", statsCSSH.ToUV());
-    ret.pushKV("other", statsOther.ToUV());
+    ret.pushKV("paytopubkeyhash", stats[STATS_PKH].ToUV());
+    ret.pushKV("paytoscripthash", stats[STATS_SH].ToUV());
+    ret.pushKV("coldstake_paytopubkeyhash", stats[STATS_CSPKH].ToUV());
+    ret.pushKV("coldstake_paytoscripthash", stats[STATS_CSSH].ToUV());
+    ret.pushKV("other", stats[STATS_OTHER].ToUV());
 
     return ret;
 }
@@ -1006,12 +1226,9 @@ UniValue getblockreward(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
     }
 
-    const DevFundSettings *devfundconf = Params().GetDevFundSettings(pblockindex->GetBlockTime());
-    CScript devFundScriptPubKey;
-    if (devfundconf) {
-        CTxDestination dest = DecodeDestination(devfundconf->sDevFundAddresses);
-        devFundScriptPubKey = GetScriptForDestination(dest);
-    }
+    CDevFundPayee devFund;
+    bool devfundconf = g_stake_reward_cache.GetDevFund(pblockindex->GetBlockTime(), devFund);
+    const CScript &devFundScriptPubKey = devFund.scriptPubKey;
 
     const auto &tx = block.vtx[0];
 
@@ -1085,6 +1302,63 @@ UniValue getblockreward(const JSONRPCRequest& request)
     return rv;
 }
 
+UniValue getblockrewards(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 2)
+        throw std::runtime_error(
+            "getblockrewards from to\n"
+            "\nReturns the scheduled stake and foundation rewards of the blocks in a given range.\n"
+            "Computed from the block index, blocks are not read from disk.\n"
+            "\nArguments:\n"
+            "1. from              (numeric, required) The first block height.\n"
+            "2. to                (numeric, required) The last block height.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"height\" : n,             (numeric) The block height.\n"
+            "    \"blockhash\" : \"id\",       (id) The hash of the block.\n"
+            "    \"stakereward\" : n,        (numeric) The newly minted coin, including the foundation share.\n"
+            "    \"foundationreward\" : n,   (numeric) The accumulated foundation payout, if the block pays one.\n"
+            "  }\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockrewards", "1000 2000")
+            + HelpExampleRpc("getblockrewards", "1000, 2000")
+        );
+
+    RPCTypeCheck(request.params, {UniValue::VNUM, UniValue::VNUM});
+
+    LOCK(cs_main);
+
+    auto range = GetBlockRange(request.params);
+    if (range.first < 0 || range.second > chainActive.Height() || range.first > range.second) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+    }
+
+    UniValue result(UniValue::VARR);
+    for (int64_t h = range.first; h <= range.second; ++h) {
+        const CBlockIndex *pblockindex = chainActive[h];
+
+        UniValue rv(UniValue::VOBJ);
+        rv.pushKV("height", h);
+        rv.pushKV("blockhash", pblockindex->GetBlockHash().ToString());
+        if (pblockindex->pprev) {
+            rv.pushKV("stakereward", ValueFromAmount(Params().GetProofOfStakeSubsidy(pblockindex->pprev)));
+
+            CDevFundPayee devFund;
+            if (g_stake_reward_cache.GetDevFund(pblockindex->GetBlockTime(), devFund)
+                && devFund.pSettings->nMinDevStakePercent > 0
+                && h % devFund.pSettings->nDevOutputPeriod == 0) {
+                CAmount nDevReward = g_stake_reward_cache.GetDevFundReward(pblockindex->pprev, h, *devFund.pSettings);
+                rv.pushKV("foundationreward", ValueFromAmount(nDevReward));
+            }
+        }
+        result.push_back(rv);
+    }
+
+    return result;
+}
+
 UniValue getblocktimes(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 2)
@@ -1146,6 +1420,48 @@ UniValue getblocktimes(const JSONRPCRequest& request)
     return obj;
 }
 
+static std::string EncodeSpendAddress(txnouttype spend_type, const CKeyID256 &spend_id)
+{
+    switch (spend_type) {
+        case TX_PUBKEYHASH: {
+            CKeyID idk;
+            memcpy(idk.begin(), spend_id.begin(), 20);
+            return EncodeDestination(idk);
+            }
+        case TX_PUBKEYHASH256:
+            return EncodeDestination(spend_id);
+        case TX_SCRIPTHASH: {
+            CScriptID ids;
+            memcpy(ids.begin(), spend_id.begin(), 20);
+            return EncodeDestination(ids);
+            }
+        case TX_SCRIPTHASH256: {
+            CScriptID256 ids;
+            memcpy(ids.begin(), spend_id.begin(), 32);
+            return EncodeDestination(ids);
+            }
+        default:
+            break;
+    }
+    return "unknown_type";
+}
+
+static void DecodeStakeAddress(const std::string &address, txnouttype &stake_type, CKeyID256 &stake_id)
+{
+    CTxDestination stake_dest = DecodeDestination(address, true);
+    if (stake_dest.type() == typeid(CKeyID)) {
+        stake_type = TX_PUBKEYHASH;
+        CKeyID id = boost::get<CKeyID>(stake_dest);
+        memcpy(stake_id.begin(), id.begin(), 20);
+    } else
+    if (stake_dest.type() == typeid(CKeyID256)) {
+        stake_type = TX_PUBKEYHASH256;
+        stake_id = boost::get<CKeyID256>(stake_dest);
+    } else {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unrecognised stake address type.");
+    }
+}
+
 UniValue listcoldstakeunspent(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
@@ -1184,18 +1500,7 @@ UniValue listcoldstakeunspent(const JSONRPCRequest& request)
     }
 
     ColdStakeIndexLinkKey seek_key;
-    CTxDestination stake_dest = DecodeDestination(request.params[0].get_str(), true);
-    if (stake_dest.type() == typeid(CKeyID)) {
-        seek_key.m_stake_type = TX_PUBKEYHASH;
-        CKeyID id = boost::get<CKeyID>(stake_dest);
-        memcpy(seek_key.m_stake_id.begin(), id.begin(), 20);
-    } else
-    if (stake_dest.type() == typeid(CKeyID256)) {
-        seek_key.m_stake_type = TX_PUBKEYHASH256;
-        seek_key.m_stake_id = boost::get<CKeyID256>(stake_dest);
-    } else {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unrecognised stake address type.");
-    }
+    DecodeStakeAddress(request.params[0].get_str(), seek_key.m_stake_type, seek_key.m_stake_id);
 
     CDBWrapper &db = g_txindex->GetDB();
 
@@ -1265,32 +1570,7 @@ UniValue listcoldstakeunspent(const JSONRPCRequest& request)
                         output.pushKV("n", ok.m_n);
                     }
 
-                    switch (lk.m_spend_type) {
-                        case TX_PUBKEYHASH: {
-                            CKeyID idk;
-                            memcpy(idk.begin(), lk.m_spend_id.begin(), 20);
-                            output.pushKV("addrspend", EncodeDestination(idk));
-                            }
-                            break;
-                        case TX_PUBKEYHASH256:
-                            output.pushKV("addrspend", EncodeDestination(lk.m_spend_id));
-                            break;
-                        case TX_SCRIPTHASH: {
-                            CScriptID ids;
-                            memcpy(ids.begin(), lk.m_spend_id.begin(), 20);
-                            output.pushKV("addrspend", EncodeDestination(ids));
-                            }
-                            break;
-                        case TX_SCRIPTHASH256: {
-                            CScriptID256 ids;
-                            memcpy(ids.begin(), lk.m_spend_id.begin(), 32);
-                            output.pushKV("addrspend", EncodeDestination(ids));
-                            }
-                            break;
-                        default:
-                            output.pushKV("addrspend", "unknown_type");
-                            break;
-                    }
+                    output.pushKV("addrspend", EncodeSpendAddress(lk.m_spend_type, lk.m_spend_id));
 
                     rv.push_back(output);
                 }
@@ -1303,6 +1583,77 @@ UniValue listcoldstakeunspent(const JSONRPCRequest& request)
 }
 
 
+UniValue getcoldstakeweights(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getcoldstakeweights \"stakeaddress\" (height)\n"
+            "\nReturns the value of the unspent outputs cold staked to \"stakeaddress\" at height, in total and per spending address.\n"
+            "The sums are kept as blocks are indexed, maturity is not taken into account.\n"
+            "\nArguments:\n"
+            "1. \"stakeaddress\"        (string, required) The stakeaddress to sum outputs of.\n"
+            "2. height                (numeric, optional) The block height to sum outputs at, -1 for current height.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\" : n,           (numeric) The block height summed at.\n"
+            "  \"weight\" : n,           (numeric) The value of all unspent outputs.\n"
+            "  \"addrspend\" : [\n"
+            "    {\n"
+            "      \"addrspend\" : \"addr\", (string) The spending address.\n"
+            "      \"weight\" : n,         (numeric) The value of the unspent outputs with this spending address.\n"
+            "    } ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcoldstakeweights", "\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\" 1000")
+            + HelpExampleRpc("getcoldstakeweights", "\"Pb7FLL3DyaAVP2eGfRiEkj4U8ZJ3RHLY9g\", 1000")
+        );
+
+    RPCTypeCheck(request.params, {UniValue::VSTR, UniValue::VNUM}, true);
+
+    if (!g_txindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Requires -txindex enabled");
+    }
+    if (!g_txindex->m_cs_index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Requires -csindex enabled");
+    }
+
+    ColdStakeIndexLinkKey link;
+    DecodeStakeAddress(request.params[0].get_str(), link.m_stake_type, link.m_stake_id);
+    ColdStakeIndexWeightKey stake_key(link, true);
+
+    LOCK(cs_main);
+
+    int height = !request.params[1].isNull() ? request.params[1].get_int() : -1;
+    if (height == -1) {
+        height = chainActive.Tip()->nHeight;
+    }
+    if (height < 0 || height > chainActive.Tip()->nHeight) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+    }
+
+    CAmount total;
+    std::vector<std::pair<ColdStakeIndexWeightKey, CAmount> > spend_weights;
+    if (!g_txindex->GetCSWeights(stake_key, height, total, spend_weights)) {
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read cold stake weights");
+    }
+
+    UniValue spends(UniValue::VARR);
+    for (const auto &spend : spend_weights) {
+        UniValue output(UniValue::VOBJ);
+        output.pushKV("addrspend", EncodeSpendAddress(spend.first.m_spend_type, spend.first.m_spend_id));
+        output.pushKV("weight", spend.second);
+        spends.push_back(output);
+    }
+
+    UniValue rv(UniValue::VOBJ);
+    rv.pushKV("height", height);
+    rv.pushKV("weight", total);
+    rv.pushKV("addrspend", spends);
+
+    return rv;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
@@ -1317,12 +1668,14 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getspentinfo",           &getspentinfo,            {"inputs"} },
     { "blockchain",         "getblockdeltas",         &getblockdeltas,          {} },
     { "blockchain",         "getblockhashes",         &getblockhashes,          {"high","low","options"} },
-    { "blockchain",         "gettxoutsetinfobyscript",&gettxoutsetinfobyscript, {} },
+    { "blockchain",         "gettxoutsetinfobyscript",&gettxoutsetinfobyscript, {"flush"} },
     { "blockchain",         "getblockreward",         &getblockreward,          {"height"} },
+    { "blockchain",         "getblockrewards",        &getblockrewards,         {"from","to"} },
     { "blockchain",         "getblocktimes",          &getblocktimes,           {"min", "low"} },
 
 
     { "csindex",            "listcoldstakeunspent",   &listcoldstakeunspent,   {"stakeaddress","height","options"} },
+    { "csindex",            "getcoldstakeweights",    &getcoldstakeweights,    {"stakeaddress","height"} },
 };
 
 void RegisterInsightRPCCommands(CRPCTable &tableRPC)
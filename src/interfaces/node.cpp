@@ -152,35 +152,31 @@ class NodeImpl : public Node
     size_t getMempoolDynamicUsage() override { return ::mempool.DynamicMemoryUsage(); }
     bool getHeaderTip(int& height, int64_t& block_time) override
     {
-        LOCK(::cs_main);
-        if (::pindexBestHeader) {
-            height = ::pindexBestHeader->nHeight;
-            block_time = ::pindexBestHeader->GetBlockTime();
+        std::shared_ptr<const CChainStatus> status = GetChainStatus();
+        if (status && status->nHeaderHeight >= 0) {
+            height = status->nHeaderHeight;
+            block_time = status->nHeaderTime;
             return true;
         }
         return false;
     }
     int getNumBlocks() override
     {
-        LOCK(::cs_main);
-        return ::chainActive.Height();
+        std::shared_ptr<const CChainStatus> status = GetChainStatus();
+        return status ? status->nHeight : -1;
     }
     int64_t getLastBlockTime() override
     {
-        LOCK(::cs_main);
-        if (::chainActive.Tip()) {
-            return ::chainActive.Tip()->GetBlockTime();
+        std::shared_ptr<const CChainStatus> status = GetChainStatus();
+        if (status && status->pindex) {
+            return status->nTime;
         }
         return Params().GenesisBlock().GetBlockTime(); // Genesis block's time of current network
     }
     double getVerificationProgress() override
     {
-        const CBlockIndex* tip;
-        {
-            LOCK(::cs_main);
-            tip = ::chainActive.Tip();
-        }
-        return GuessVerificationProgress(Params().TxData(), tip);
+        std::shared_ptr<const CChainStatus> status = GetChainStatus();
+        return GuessVerificationProgress(Params().TxData(), status ? status->pindex : nullptr);
     }
     bool isInitialBlockDownload() override { return IsInitialBlockDownload(); }
     bool getReindex() override { return ::fReindex; }
@@ -395,6 +395,55 @@ public:
 
         return result;
     }
+    std::vector<WalletTx> getWalletTxsPage(WalletTxPagePos& pos, bool coinstake, size_t max_count) override
+    {
+        LOCK2(::cs_main, m_wallet.cs_wallet);
+        std::vector<WalletTx> result;
+        if (pos.at_end) {
+            return result;
+        }
+
+        // Walk the transaction index, keyed by nOrderPos, and the record index, keyed by time,
+        // backwards together, taking the newer of the two at each step.
+        CWallet::TxItems::const_reverse_iterator it_wtx(m_wallet.wtxOrdered.lower_bound(pos.order_pos));
+        const CWallet::TxItems::const_reverse_iterator end_wtx = m_wallet.wtxOrdered.crend();
+
+        const RtxOrdered_t empty_records;
+        const RtxOrdered_t& records = m_wallet_part ? m_wallet_part->rtxOrdered : empty_records;
+        auto range = records.equal_range(pos.record_time);
+        RtxOrdered_t::const_reverse_iterator it_rtx(range.second);
+        const RtxOrdered_t::const_reverse_iterator end_rtx = records.crend();
+        // Records sharing a time are walked in reverse insertion order, skip those already returned
+        for (RtxOrdered_t::const_reverse_iterator it = it_rtx; it != RtxOrdered_t::const_reverse_iterator(range.first); ++it) {
+            if (it->second->first == pos.record_hash) {
+                it_rtx = std::next(it);
+                break;
+            }
+        }
+
+        while (result.size() < max_count && (it_wtx != end_wtx || it_rtx != end_rtx)) {
+            const CWalletTx* wtx = it_wtx != end_wtx ? it_wtx->second.first : nullptr;
+            if (it_wtx != end_wtx && (it_rtx == end_rtx || !wtx || wtx->GetTxTime() >= it_rtx->first)) {
+                pos.order_pos = it_wtx->first;
+                ++it_wtx;
+                // Accounting entries have no transaction
+                if (wtx && wtx->IsCoinStake() == coinstake) {
+                    result.emplace_back(MakeWalletTx(m_wallet, *wtx));
+                }
+            } else {
+                MapRecords_t::const_iterator mri = it_rtx->second;
+                pos.record_time = it_rtx->first;
+                pos.record_hash = mri->first;
+                ++it_rtx;
+                if (!coinstake) {
+                    result.emplace_back(MakeWalletTx(*m_wallet_part, mri));
+                }
+            }
+        }
+        pos.at_end = it_wtx == end_wtx && it_rtx == end_rtx;
+
+        return result;
+    }
     bool tryGetTxStatus(const uint256& txid,
         interfaces::WalletTxStatus& tx_status,
         int& num_blocks,
@@ -628,6 +677,11 @@ public:
         return MakeHandler(m_wallet.NotifyTransactionChanged.connect(
             [fn](CWallet*, const uint256& txid, ChangeType status) { fn(txid, status); }));
     }
+    std::unique_ptr<Handler> handleTransactionsChanged(TransactionsChangedFn fn) override
+    {
+        return MakeHandler(m_wallet.NotifyTransactionsChanged.connect(
+            [fn](CWallet*, const WalletChanges_t& changes) { fn(changes); }));
+    }
     std::unique_ptr<Handler> handleWatchOnlyChanged(WatchOnlyChangedFn fn) override
     {
         return MakeHandler(m_wallet.NotifyWatchonlyChanged.connect(fn));
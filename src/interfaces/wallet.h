@@ -13,6 +13,7 @@
 #include <ui_interface.h>              // For ChangeType
 
 #include <functional>
+#include <limits>
 #include <map>
 #include <memory>
 #include <stdint.h>
@@ -44,6 +45,7 @@ struct WalletAddress;
 struct WalletBalances;
 struct WalletTx;
 struct WalletTxOut;
+struct WalletTxPagePos;
 struct WalletTxStatus;
 
 using WalletOrderForm = std::vector<std::pair<std::string, std::string>>;
@@ -182,6 +184,10 @@ public:
     //! Get list of all wallet transactions.
     virtual std::vector<WalletTx> getWalletTxs() = 0;
 
+    //! Get up to max_count wallet transactions older than pos, newest first, and advance pos.
+    //! Only coinstakes, or only other transactions, are returned.
+    virtual std::vector<WalletTx> getWalletTxsPage(WalletTxPagePos& pos, bool coinstake, size_t max_count) = 0;
+
     //! Try to get updated status for a particular transaction, if possible without blocking.
     virtual bool tryGetTxStatus(const uint256& txid,
         WalletTxStatus& tx_status,
@@ -276,6 +282,10 @@ public:
     using TransactionChangedFn = std::function<void(const uint256& txid, ChangeType status)>;
     virtual std::unique_ptr<Handler> handleTransactionChanged(TransactionChangedFn fn) = 0;
 
+    //! Register handler for coalesced transaction changed messages, sent from the notifier thread.
+    using TransactionsChangedFn = std::function<void(const std::vector<std::pair<uint256, ChangeType>>& changes)>;
+    virtual std::unique_ptr<Handler> handleTransactionsChanged(TransactionsChangedFn fn) = 0;
+
     //! Register handler for watchonly changed messages.
     using WatchOnlyChangedFn = std::function<void(bool have_watch_only)>;
     virtual std::unique_ptr<Handler> handleWatchOnlyChanged(WatchOnlyChangedFn fn) = 0;
@@ -419,6 +429,16 @@ struct WalletTxOut
     bool is_coinstake = false;
 };
 
+//! Position in the wallet's ordered transaction and record indexes, for paging through them
+//! newest first. A default constructed position is before the newest transaction.
+struct WalletTxPagePos
+{
+    int64_t order_pos = std::numeric_limits<int64_t>::max();   //!< nOrderPos of the last transaction returned
+    int64_t record_time = std::numeric_limits<int64_t>::max(); //!< Index time of the last record returned
+    uint256 record_hash;                                       //!< Hash of the last record returned
+    bool at_end = false;                                       //!< All transactions have been returned
+};
+
 //! Return implementation of Wallet interface. This function will be undefined
 //! in builds where ENABLE_WALLET is false.
 std::unique_ptr<Wallet> MakeWallet(const std::shared_ptr<CWallet>& wallet);
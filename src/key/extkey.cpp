@@ -8,8 +8,12 @@
 #include <key_io.h>
 #include <crypto/hmac_sha512.h>
 
+#include <secp256k1.h>
+
 #include <stdint.h>
 
+extern secp256k1_context* secp256k1_context_verify; // pubkey.cpp
+
 CCriticalSection cs_extKey;
 
 const char *ExtKeyGetString(int ind)
@@ -478,6 +482,52 @@ bool CExtKeyPair::Derive(CPubKey &out, unsigned int nChild) const
     return true;
 };
 
+bool CExtKeyPair::DerivePubKeys(std::vector<CPubKey> &vOut, uint32_t nChild, uint32_t nKeys) const
+{
+    vOut.clear();
+    if (nKeys == 0) {
+        return true;
+    }
+    if (((uint64_t)nChild + nKeys - 1) >> 31 != 0) {
+        return false;
+    }
+    assert(pubkey.size() == CPubKey::COMPRESSED_PUBLIC_KEY_SIZE);
+
+    secp256k1_pubkey parent;
+    if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &parent, pubkey.begin(), pubkey.size())) {
+        return false;
+    }
+
+    // As BIP32Hash(chaincode, nChild, pubkey[0], pubkey+1), for all children at once
+    static const size_t MSG_SIZE = CPubKey::COMPRESSED_PUBLIC_KEY_SIZE + 4;
+    std::vector<unsigned char> vMsgs(nKeys * MSG_SIZE), vOuts(nKeys * 64);
+    for (uint32_t k = 0; k < nKeys; ++k) {
+        uint32_t n = nChild + k;
+        unsigned char *num = &vMsgs[k * MSG_SIZE + CPubKey::COMPRESSED_PUBLIC_KEY_SIZE];
+        memcpy(&vMsgs[k * MSG_SIZE], pubkey.begin(), CPubKey::COMPRESSED_PUBLIC_KEY_SIZE);
+        num[0] = (n >> 24) & 0xFF;
+        num[1] = (n >> 16) & 0xFF;
+        num[2] = (n >>  8) & 0xFF;
+        num[3] = (n >>  0) & 0xFF;
+    }
+    HMAC_SHA512_Multi(vOuts.data(), chaincode, 32, vMsgs.data(), MSG_SIZE, nKeys);
+
+    vOut.resize(nKeys);
+    for (uint32_t k = 0; k < nKeys; ++k) {
+        const unsigned char *out = &vOuts[k * 64];
+
+        secp256k1_pubkey child = parent;
+        if (!secp256k1_ec_pubkey_tweak_add(secp256k1_context_verify, &child, out)) {
+            continue;
+        }
+        unsigned char pub[CPubKey::COMPRESSED_PUBLIC_KEY_SIZE];
+        size_t publen = sizeof(pub);
+        secp256k1_ec_pubkey_serialize(secp256k1_context_verify, pub, &publen, &child, SECP256K1_EC_COMPRESSED);
+        vOut[k].Set(pub, pub + publen);
+    }
+    return true;
+};
+
 CExtPubKey CExtKeyPair::GetExtPubKey() const
 {
     CExtPubKey ret;
@@ -781,6 +831,7 @@ bool CExtKeyAccount::SaveKey(const CKeyID &id, const CEKAKey &keyIn)
 
     if (mapLookAhead.erase(id) != 1) {
         LogPrintf("Warning: SaveKey %s key not found in look ahead %s.\n", GetIDString58(), CBitcoinAddress(id).ToString());
+        vNewKeys.push_back(id);
     }
 
     mapKeys[id] = keyIn;
@@ -863,6 +914,7 @@ bool CExtKeyAccount::SaveKey(const CKeyID &id, const CEKASCKey &keyIn)
     }
 
     mapStealthChildKeys[id] = keyIn;
+    vNewKeys.push_back(id);
 
     if (LogAcceptCategory(BCLog::HDWALLET)) {
         LogPrintf("SaveKey(): CEKASCKey %s, %s.\n", GetIDString58(), CBitcoinAddress(id).ToString());
@@ -940,6 +992,7 @@ int CExtKeyAccount::AddLookBehind(uint32_t nChain, uint32_t nKeys)
         }
 
         mapLookAhead[keyId] = CEKAKey(nChain, nChildOut);
+        vNewKeys.push_back(keyId);
 
         if (LogAcceptCategory(BCLog::HDWALLET)) {
             LogPrintf("%s: Added %s, look-ahead size %u.\n", __func__, CBitcoinAddress(keyId).ToString(), mapLookAhead.size());
@@ -966,18 +1019,31 @@ int CExtKeyAccount::AddLookAhead(uint32_t nChain, uint32_t nKeys)
     }
 
     CKeyID keyId;
-    CPubKey pk;
+    std::vector<CPubKey> vPubKeys; // children from nBatchFirst, derived together
+    uint32_t nBatchFirst = nChild;
     for (uint32_t k = 0; k < nKeys; ++k) {
         bool fGotKey = false;
 
         uint32_t nMaxTries = 1000; // TODO: link to lookahead size
         for (uint32_t i = 0; i < nMaxTries; ++i) { // nMaxTries > lookahead pool
-            if (pc->DeriveKey(pk, nChild, nChildOut, false) != 0) {
-                LogPrintf("Error: %s - DeriveKey failed, chain %d, child %d.\n", __func__, nChain, nChild);
-                nChild = nChildOut+1;
+            if (nChild - nBatchFirst >= vPubKeys.size()) {
+                if ((nChild >> 31) != 0) {
+                    LogPrintf("Error: %s - No more keys can be derived, chain %d.\n", __func__, nChain);
+                    break;
+                }
+                nBatchFirst = nChild;
+                uint32_t nBatch = std::min(nKeys - k, ((uint32_t)1 << 31) - nChild);
+                if (!pc->kp.DerivePubKeys(vPubKeys, nChild, nBatch)) {
+                    LogPrintf("Error: %s - DerivePubKeys failed, chain %d, child %d.\n", __func__, nChain, nChild);
+                    vPubKeys.clear();
+                    break;
+                }
+            }
+            const CPubKey &pk = vPubKeys[nChild - nBatchFirst];
+            nChildOut = nChild++;
+            if (!pk.IsValid()) {
                 continue;
             }
-            nChild = nChildOut+1;
 
             keyId = pk.GetID();
             if ((mi = mapKeys.find(keyId)) != mapKeys.end()) {
@@ -1001,6 +1067,7 @@ int CExtKeyAccount::AddLookAhead(uint32_t nChain, uint32_t nKeys)
         }
 
         mapLookAhead[keyId] = CEKAKey(nChain, nChildOut);
+        vNewKeys.push_back(keyId);
         pc->nLastLookAhead = nChildOut;
 
         if (LogAcceptCategory(BCLog::HDWALLET)) {
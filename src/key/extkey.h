@@ -242,6 +242,12 @@ public:
     bool Derive(CExtPubKey &out, unsigned int nChild) const;
     bool Derive(CKey &out, unsigned int nChild) const;
     bool Derive(CPubKey &out, unsigned int nChild) const;
+    /**
+     * Derive the non hardened public children nChild to nChild+nKeys-1 into vOut.
+     * The parent pubkey is parsed once and the HMACs of all children run together
+     * through HMAC_SHA512_Multi. Children invalid under BIP32 are left invalid.
+     */
+    bool DerivePubKeys(std::vector<CPubKey> &vOut, uint32_t nChild, uint32_t nKeys) const;
 
     CExtPubKey GetExtPubKey() const;
     CExtKeyPair Neutered() const;
@@ -825,6 +831,7 @@ public:
     AccKeyMap mapLookAhead;
 
     AccKeySCMap mapStealthChildKeys; // keys derived from stealth addresses
+    std::vector<CKeyID> vNewKeys; // added to the maps above since the wallet's key table took them
 
     AccStealthKeyMap mapStealthKeys;
     AccStealthKeyMap mapLookAheadStealth;
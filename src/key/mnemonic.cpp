@@ -9,6 +9,10 @@
 #include <crypto/hmac_sha512.h>
 #include <crypto/sha256.h>
 
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
 #include <unilib/uninorms.h>
 #include <unilib/utf8.h>
 
@@ -74,8 +78,85 @@ const char *mnLanguagesTag[WLL_MAX] =
     "korean",
 };
 
+/**
+ * Word number to word and word to number tables over one compiled in word list,
+ * built on first use. Words point into the list, lookups are a binary search.
+ */
+class CWordListIndex
+{
+public:
+    void Build(const char *pwl, int max)
+    {
+        const char *pEnd = pwl + max;
+        const char *pt = pwl;
+        while (pt < pEnd) {
+            const char *pNl = (const char*)memchr(pt, '\n', pEnd - pt);
+            if (!pNl) {
+                break; // List must end with \n
+            }
+            vWords.push_back(Entry{pt, (uint32_t)(pNl - pt), (uint32_t)vWords.size()});
+            pt = pNl + 1;
+        }
+        vSorted = vWords;
+        std::sort(vSorted.begin(), vSorted.end());
+    };
+
+    bool Word(int o, std::string &sWord) const
+    {
+        if (o < 0 || o >= (int)vWords.size()) {
+            return false;
+        }
+        sWord.assign(vWords[o].p, vWords[o].nLen);
+        return true;
+    };
+
+    bool Find(const char *p, size_t l, int &o) const
+    {
+        Entry key{p, (uint32_t)l, 0};
+        auto it = std::lower_bound(vSorted.begin(), vSorted.end(), key);
+        if (it == vSorted.end() || key < *it) {
+            return false;
+        }
+        o = it->nWord;
+        return true;
+    };
+
+private:
+    struct Entry
+    {
+        const char *p;
+        uint32_t nLen;
+        uint32_t nWord;
+
+        bool operator<(const Entry &b) const
+        {
+            int c = memcmp(p, b.p, std::min(nLen, b.nLen));
+            return c < 0 || (c == 0 && nLen < b.nLen);
+        };
+    };
+
+    std::vector<Entry> vWords;  //!< By word number
+    std::vector<Entry> vSorted; //!< By bytes
+};
+
+static CWordListIndex mnIndexes[WLL_MAX];
+static std::once_flag mnIndexesBuilt[WLL_MAX];
+
+static const CWordListIndex &GetWordListIndex(int nLanguage)
+{
+    std::call_once(mnIndexesBuilt[nLanguage], [nLanguage]() {
+        mnIndexes[nLanguage].Build((const char*)mnLanguages[nLanguage], mnLanguageLens[nLanguage]);
+    });
+    return mnIndexes[nLanguage];
+};
+
 static void NormaliseUnicode(std::string &str)
 {
+    // NFKD leaves ASCII unchanged, skip the decode and re-encode for plain English phrases
+    if (std::all_of(str.begin(), str.end(), [](char c) { return (uint8_t)c < 0x80; })) {
+        return;
+    }
+
     std::u32string u32;
     ufal::unilib::utf8::decode(str, u32);
     ufal::unilib::uninorms::nfkd(u32);
@@ -157,8 +238,7 @@ int MnemonicDetectLanguage(const std::string &sWordList)
     for (int l = 1; l < WLL_MAX; ++l) {
         strcpy(tmp, sWordList.c_str());
 
-        char *pwl = (char*) mnLanguages[l];
-        int m = mnLanguageLens[l];
+        const CWordListIndex &index = GetWordListIndex(l);
 
         // The chinese dialects have many words in common, match full phrase
         int maxTries = (l == WLL_CHINESE_S || l == WLL_CHINESE_T) ? 24 : 8;
@@ -169,7 +249,7 @@ int MnemonicDetectLanguage(const std::string &sWordList)
         p = strtok(tmp, " ");
         while (p != nullptr) {
             int ofs;
-            if (0 == GetWordOffset(p, pwl, m, ofs)) {
+            if (index.Find(p, strlen(p), ofs)) {
                 nHit++;
             } else {
                 nMiss++;
@@ -259,14 +339,13 @@ int MnemonicEncode(int nLanguage, const std::vector<uint8_t> &vEntropy, std::str
         i += 11;
     }
 
-    char *pwl = (char*) mnLanguages[nLanguage];
-    int m = mnLanguageLens[nLanguage];
+    const CWordListIndex &index = GetWordListIndex(nLanguage);
 
     for (size_t k = 0; k < vWord.size(); ++k) {
         int o = vWord[k];
 
         std::string sWord;
-        if (0 != GetWord(o, pwl, m, sWord)) {
+        if (!index.Word(o, sWord)) {
             sError = strprintf("Word extract failed %d, language %d.", o, nLanguage);
             return errorN(3, "%s: %s", __func__, sError.c_str());
         }
@@ -284,59 +363,51 @@ int MnemonicEncode(int nLanguage, const std::vector<uint8_t> &vEntropy, std::str
     return 0;
 };
 
-int MnemonicDecode(int &nLanguage, const std::string &sWordListIn, std::vector<uint8_t> &vEntropy, std::string &sError, bool fIgnoreChecksum)
+// Decode a normalised word list, does not log so it can be used on many candidates
+static int DecodeWordList(int nLanguage, const std::string &sWordList, std::vector<uint8_t> &vEntropy, std::string &sError, bool fIgnoreChecksum)
 {
-    LogPrint(BCLog::HDWALLET, "%s: Language %d.\n", __func__, nLanguage);
-
-    std::string sWordList = sWordListIn;
-    NormaliseInput(sWordList);
-
-    if (nLanguage == -1) {
-        nLanguage = MnemonicDetectLanguage(sWordList);
-    }
-
-    if (nLanguage < 1 || nLanguage >= WLL_MAX) {
-        sError = "Unknown language";
-        return errorN(1, "%s: %s", __func__, sError.c_str());
-    }
-
-    LogPrint(BCLog::HDWALLET, "%s: Detected language %d.\n", __func__, nLanguage);
-
     char tmp[2048];
     if (sWordList.size() >= 2048) {
         sError = "Word List too long.";
-        return errorN(2, "%s: %s", __func__, sError.c_str());
+        return 2;
     }
 
     if (strstr(sWordList.c_str(), "  ") != NULL) {
         sError = "Multiple spaces between words";
-        return errorN(4, "%s: %s", __func__, sError.c_str());
+        return 4;
     }
 
     strcpy(tmp, sWordList.c_str());
 
-    char *pwl = (char*) mnLanguages[nLanguage];
-    int m = mnLanguageLens[nLanguage];
+    const CWordListIndex &index = GetWordListIndex(nLanguage);
 
     std::vector<int> vWordInts;
 
-    char *p;
-    p = strtok(tmp, " ");
-    while (p != nullptr) {
+    // Split in place, strtok is not thread safe
+    char *p = tmp;
+    while (*p) {
+        char *pEnd = strchr(p, ' ');
+        if (pEnd) {
+            *pEnd = '\0';
+        }
+
         int ofs;
-        if (0 != GetWordOffset(p, pwl, m, ofs)) {
+        if (!index.Find(p, pEnd ? pEnd - p : strlen(p), ofs)) {
             sError = strprintf("Unknown word: %s", p);
-            return errorN(3, "%s: %s", __func__, sError.c_str());
+            return 3;
         }
-
         vWordInts.push_back(ofs);
-        p = strtok(nullptr, " ");
+
+        if (!pEnd) {
+            break;
+        }
+        p = pEnd + 1;
     }
 
     if (!fIgnoreChecksum
         && vWordInts.size() % 3 != 0) {
         sError = "No. of words must be divisible by 3";
-        return errorN(4, "%s: %s", __func__, sError.c_str());
+        return 4;
     }
 
     int nBits = vWordInts.size() * 11;
@@ -403,51 +474,33 @@ int MnemonicDecode(int &nLanguage, const std::string &sWordListIn, std::vector<u
 
     if (vCSTest != vCS) {
         sError = "Checksum mismatch.";
-        return errorN(5, "%s: %s", __func__, sError.c_str());
+        return 5;
     }
 
     return 0;
 };
 
-static int mnemonicKdf(const uint8_t *password, size_t lenPassword,
-    const uint8_t *salt, size_t lenSalt, size_t nIterations, uint8_t *out)
+int MnemonicDecode(int &nLanguage, const std::string &sWordListIn, std::vector<uint8_t> &vEntropy, std::string &sError, bool fIgnoreChecksum)
 {
-    /*
-    https://tools.ietf.org/html/rfc2898
-    5.2 PBKDF2
-
-    F (P, S, c, i) = U_1 \xor U_2 \xor ... \xor U_c
-    where
-        U_1 = PRF (P, S || INT (i)) ,
-        U_2 = PRF (P, U_1) ,
-        ...
-        U_c = PRF (P, U_{c-1}) .
-    */
+    LogPrint(BCLog::HDWALLET, "%s: Language %d.\n", __func__, nLanguage);
 
-    // Output length is always 64bytes, only 1 block
+    std::string sWordList = sWordListIn;
+    NormaliseInput(sWordList);
 
-    if (nIterations < 1) {
-        return 1;
+    if (nLanguage == -1) {
+        nLanguage = MnemonicDetectLanguage(sWordList);
     }
 
-    uint8_t r[64];
-
-    int one = 0x01000000;
-    CHMAC_SHA512 ctx(password, lenPassword);
-    CHMAC_SHA512 ctx_state = ctx;
-    ctx.Write(salt, lenSalt);
-    ctx.Write((uint8_t*)&one, 4);
-    ctx.Finalize(r);
-    memcpy(out, r, 64);
+    if (nLanguage < 1 || nLanguage >= WLL_MAX) {
+        sError = "Unknown language";
+        return errorN(1, "%s: %s", __func__, sError.c_str());
+    }
 
-    for (size_t k = 1; k < nIterations; ++k) {
-        ctx= ctx_state;
-        ctx.Write(r, 64);
-        ctx.Finalize(r);
+    LogPrint(BCLog::HDWALLET, "%s: Detected language %d.\n", __func__, nLanguage);
 
-        for (size_t i = 0; i < 64; ++i) {
-            out[i] ^= r[i];
-        }
+    int rv;
+    if (0 != (rv = DecodeWordList(nLanguage, sWordList, vEntropy, sError, fIgnoreChecksum))) {
+        return errorN(rv, "%s: %s", __func__, sError.c_str());
     }
 
     return 0;
@@ -469,18 +522,98 @@ int MnemonicToSeed(const std::string &sMnemonic, const std::string &sPasswordIn,
         return errorN(1, "%s: Multiple spaces between words.", __func__);
     }
 
-    int nIterations = 2048;
-
     std::string sSalt = std::string("mnemonic") + sPassword;
 
-    if (0 != mnemonicKdf((uint8_t*)sWordList.data(), sWordList.size(),
-        (uint8_t*)sSalt.data(), sSalt.size(), nIterations, &vSeed[0])) {
-        return errorN(1, "%s: mnemonicKdf failed.", __func__);
-    }
+    const uint8_t *pKey = (const uint8_t*)sWordList.data(), *pSalt = (const uint8_t*)sSalt.data();
+    size_t nKeyLen = sWordList.size(), nSaltLen = sSalt.size();
+    PBKDF2_HMAC_SHA512_64(&vSeed[0], &pKey, &nKeyLen, &pSalt, &nSaltLen, MNEMONIC_KDF_ITERATIONS, 1);
 
     return 0;
 };
 
+size_t MnemonicToSeeds(int nLanguage, const std::vector<MnemonicCandidate> &vCandidates, std::vector<std::vector<uint8_t> > &vSeeds, int nThreads)
+{
+    vSeeds.assign(vCandidates.size(), std::vector<uint8_t>());
+    if (vCandidates.empty()) {
+        return 0;
+    }
+
+    if (nLanguage == -1) {
+        std::string sWordList = vCandidates[0].sMnemonic;
+        NormaliseInput(sWordList);
+        nLanguage = MnemonicDetectLanguage(sWordList);
+    }
+    if (nLanguage < 1 || nLanguage >= WLL_MAX) {
+        return vCandidates.size();
+    }
+
+    if (nThreads < 1) {
+        nThreads = GetNumCores();
+    }
+    size_t nSlices = std::min(std::min((size_t)MAX_MNEMONIC_THREADS, (size_t)std::max(1, nThreads)), vCandidates.size());
+
+    std::vector<size_t> vRejected(nSlices, 0);
+    auto f = [&](size_t nSlice, size_t nBegin, size_t nEnd) {
+        std::vector<size_t> vValid;
+        std::vector<std::string> vWordLists, vSalts;
+        std::vector<uint8_t> vEntropy;
+        std::string sError;
+        for (size_t i = nBegin; i < nEnd; ++i) {
+            std::string sWordList = vCandidates[i].sMnemonic;
+            NormaliseInput(sWordList);
+
+            // Reject before the expensive part
+            if (0 != DecodeWordList(nLanguage, sWordList, vEntropy, sError, false)) {
+                vRejected[nSlice]++;
+                continue;
+            }
+
+            std::string sPassword = vCandidates[i].sPassword;
+            NormaliseInput(sPassword);
+            vValid.push_back(i);
+            vWordLists.push_back(sWordList);
+            vSalts.push_back(std::string("mnemonic") + sPassword);
+        }
+
+        size_t n = vValid.size();
+        std::vector<const uint8_t*> vpKeys(n), vpSalts(n);
+        std::vector<size_t> vKeyLens(n), vSaltLens(n);
+        for (size_t k = 0; k < n; ++k) {
+            vpKeys[k] = (const uint8_t*)vWordLists[k].data();
+            vKeyLens[k] = vWordLists[k].size();
+            vpSalts[k] = (const uint8_t*)vSalts[k].data();
+            vSaltLens[k] = vSalts[k].size();
+        }
+        std::vector<uint8_t> vOut(n * 64);
+        if (n > 0) {
+            PBKDF2_HMAC_SHA512_64(vOut.data(), vpKeys.data(), vKeyLens.data(), vpSalts.data(), vSaltLens.data(), MNEMONIC_KDF_ITERATIONS, n);
+        }
+        for (size_t k = 0; k < n; ++k) {
+            vSeeds[vValid[k]].assign(vOut.begin() + k * 64, vOut.begin() + (k + 1) * 64);
+        }
+    };
+
+    if (nSlices < 2) {
+        f(0, 0, vCandidates.size());
+    } else {
+        std::vector<std::thread> threads;
+        size_t nPerThread = (vCandidates.size() + nSlices - 1) / nSlices;
+        for (size_t t = 0; t < nSlices; ++t) {
+            size_t nBegin = t * nPerThread, nEnd = std::min(vCandidates.size(), nBegin + nPerThread);
+            threads.emplace_back(f, t, nBegin, nEnd);
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    size_t nRejected = 0;
+    for (auto n : vRejected) {
+        nRejected += n;
+    }
+    return nRejected;
+};
+
 int MnemonicAddChecksum(int nLanguageIn, const std::string &sWordListIn, std::string &sWordListOut, std::string &sError)
 {
     std::string sWordList = sWordListIn;
@@ -516,10 +649,7 @@ int MnemonicGetWord(int nLanguage, int nWord, std::string &sWord, std::string &s
         return errorN(1, "%s: %s", __func__, sError.c_str());
     }
 
-    char *pwl = (char*) mnLanguages[nLanguage];
-    int m = mnLanguageLens[nLanguage];
-
-    if (0 != GetWord(nWord, pwl, m, sWord)) {
+    if (!GetWordListIndex(nLanguage).Word(nWord, sWord)) {
         sError = strprintf("Word extract failed %d, language %d.", nWord, nLanguage);
         return errorN(3, "%s: %s", __func__, sError.c_str());
     }
@@ -527,6 +657,19 @@ int MnemonicGetWord(int nLanguage, int nWord, std::string &sWord, std::string &s
     return 0;
 };
 
+int MnemonicFindWord(int nLanguage, const std::string &sWord)
+{
+    if (nLanguage < 1 || nLanguage >= WLL_MAX) {
+        return -1;
+    }
+
+    int o;
+    if (!GetWordListIndex(nLanguage).Find(sWord.data(), sWord.size(), o)) {
+        return -1;
+    }
+    return o;
+};
+
 std::string MnemonicGetLanguage(int nLanguage)
 {
     if (nLanguage < 1 || nLanguage >= WLL_MAX) {
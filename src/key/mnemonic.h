@@ -23,6 +23,16 @@ enum WordListLanguages
     WLL_MAX
 };
 
+static const size_t MNEMONIC_KDF_ITERATIONS = 2048;
+static const int MAX_MNEMONIC_THREADS = 16;
+
+/** A mnemonic and password pair, as tried when recovering a seed. */
+struct MnemonicCandidate
+{
+    std::string sMnemonic;
+    std::string sPassword;
+};
+
 extern const char *mnLanguagesDesc[WLL_MAX];
 extern const char *mnLanguagesTag[WLL_MAX];
 
@@ -33,8 +43,16 @@ int MnemonicDetectLanguage(const std::string &sWordList);
 int MnemonicEncode(int nLanguage, const std::vector<uint8_t> &vEntropy, std::string &sWordList, std::string &sError);
 int MnemonicDecode(int &nLanguage, const std::string &sWordListIn, std::vector<uint8_t> &vEntropy, std::string &sError, bool fIgnoreChecksum=false);
 int MnemonicToSeed(const std::string &sMnemonic, const std::string &sPasswordIn, std::vector<uint8_t> &vSeed);
+/**
+ * Derive the seeds of many candidates over nThreads threads (< 1 for one per core), all in nLanguage
+ * (-1 to detect from the first). Candidates failing to decode or failing the checksum are rejected before
+ * any KDF work and left with an empty seed. Returns the number of candidates rejected.
+ */
+size_t MnemonicToSeeds(int nLanguage, const std::vector<MnemonicCandidate> &vCandidates, std::vector<std::vector<uint8_t> > &vSeeds, int nThreads=0);
 int MnemonicAddChecksum(int nLanguageIn, const std::string &sWordListIn, std::string &sWordListOut, std::string &sError);
 int MnemonicGetWord(int nLanguage, int nWord, std::string &sWord, std::string &sError);
+/** Number of a normalised word in nLanguage's list, -1 if not found */
+int MnemonicFindWord(int nLanguage, const std::string &sWord);
 std::string MnemonicGetLanguage(int nLanguage);
 
 
@@ -412,6 +412,28 @@ int MakeStealthData(const std::string &sNarration, stealth_prefix prefix, const
     return 0;
 };
 
+int AppendNarrationCrypt(std::vector<uint8_t> &vData, const std::string &sNarration, const uint8_t *key,
+    const CPubKey &pkEphem, std::string &sError)
+{
+    std::vector<uint8_t> vchNarr;
+    SecMsgCrypter crypter;
+    crypter.SetKey(key, pkEphem.begin());
+
+    if (!crypter.Encrypt((uint8_t*)sNarration.data(), sNarration.length(), vchNarr)) {
+        return errorN(1, sError, __func__, "Narration encryption failed.");
+    }
+    if (vchNarr.size() > MAX_STEALTH_NARRATION_SIZE) {
+        return errorN(1, sError, __func__, "Encrypted narration is too long.");
+    }
+
+    size_t o = vData.size();
+    vData.resize(o + vchNarr.size() + 1);
+    vData[o++] = DO_NARR_CRYPT;
+    memcpy(&vData[o], vchNarr.data(), vchNarr.size());
+
+    return 0;
+};
+
 int PrepareStealthOutput(const CStealthAddress &sx, const std::string &sNarration,
     CScript &scriptPubKey, std::vector<uint8_t> &vData, std::string &sError)
 {
@@ -149,6 +149,10 @@ int MakeStealthData(const std::string &sNarration, stealth_prefix prefix, const
 int PrepareStealthOutput(const CStealthAddress &sx, const std::string &sNarration,
     CScript &scriptPubKey, std::vector<uint8_t> &vData, std::string &sError);
 
+/** Append sNarration encrypted with the 32 byte key of a blinded output to its data, see AddCTData */
+int AppendNarrationCrypt(std::vector<uint8_t> &vData, const std::string &sNarration, const uint8_t *key,
+    const CPubKey &pkEphem, std::string &sError);
+
 void ECC_Start_Stealth();
 void ECC_Stop_Stealth();
 
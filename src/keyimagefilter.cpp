@@ -0,0 +1,113 @@
+// Copyright (c) 2018 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <keyimagefilter.h>
+
+#include <hash.h>
+#include <memusage.h>
+#include <random.h>
+
+#include <algorithm>
+#include <limits>
+
+CKeyImageFilter::CKeyImageFilter()
+{
+    k0 = GetRand(std::numeric_limits<uint64_t>::max());
+    k1 = GetRand(std::numeric_limits<uint64_t>::max());
+};
+
+void CKeyImageFilter::Reset(size_t nElements)
+{
+    LOCK(cs_filter);
+    nCapacity = std::max(nElements, KEYIMAGE_FILTER_MIN_ELEMENTS);
+    nBits = (uint64_t)nCapacity * KEYIMAGE_FILTER_BITS_PER_ELEMENT;
+    vData.assign((nBits + 63) / 64, 0);
+    nBits = vData.size() * 64;
+    nInserted = 0;
+    fEnabled = true;
+};
+
+void CKeyImageFilter::Disable()
+{
+    LOCK(cs_filter);
+    fEnabled = false;
+    vData.clear();
+    vData.shrink_to_fit();
+    nBits = 0;
+    nCapacity = 0;
+    nInserted = 0;
+};
+
+bool CKeyImageFilter::IsEnabled() const
+{
+    LOCK(cs_filter);
+    return fEnabled;
+};
+
+void CKeyImageFilter::GetBits(const CCmpPubKey &ki, uint64_t &h1, uint64_t &h2) const
+{
+    // Double hashing, derive all probes from two independent 64 bit hashes
+    h1 = CSipHasher(k0, k1).Write(ki.begin(), 33).Finalize();
+    h2 = CSipHasher(k1, k0).Write(ki.begin(), 33).Finalize() | 1;
+};
+
+void CKeyImageFilter::Insert(const CCmpPubKey &ki)
+{
+    LOCK(cs_filter);
+    if (!fEnabled)
+        return;
+
+    uint64_t h1, h2;
+    GetBits(ki, h1, h2);
+    for (unsigned int i = 0; i < KEYIMAGE_FILTER_HASH_FUNCS; ++i)
+    {
+        uint64_t nBit = (h1 + i * h2) % nBits;
+        vData[nBit >> 6] |= ((uint64_t)1) << (nBit & 63);
+    };
+    nInserted++;
+};
+
+bool CKeyImageFilter::MaybeContains(const CCmpPubKey &ki) const
+{
+    LOCK(cs_filter);
+    if (!fEnabled)
+        return true;
+
+    uint64_t h1, h2;
+    GetBits(ki, h1, h2);
+    for (unsigned int i = 0; i < KEYIMAGE_FILTER_HASH_FUNCS; ++i)
+    {
+        uint64_t nBit = (h1 + i * h2) % nBits;
+        if (!(vData[nBit >> 6] & (((uint64_t)1) << (nBit & 63))))
+        {
+            nSkipped++;
+            return false;
+        };
+    };
+    return true;
+};
+
+bool CKeyImageFilter::NeedsResize() const
+{
+    LOCK(cs_filter);
+    return fEnabled && nInserted > nCapacity;
+};
+
+size_t CKeyImageFilter::GetCapacity() const
+{
+    LOCK(cs_filter);
+    return nCapacity;
+};
+
+size_t CKeyImageFilter::GetInserted() const
+{
+    LOCK(cs_filter);
+    return nInserted;
+};
+
+size_t CKeyImageFilter::DynamicMemoryUsage() const
+{
+    LOCK(cs_filter);
+    return memusage::DynamicUsage(vData);
+};
@@ -0,0 +1,65 @@
+// Copyright (c) 2018 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_KEYIMAGEFILTER_H
+#define BITCOINC_KEYIMAGEFILTER_H
+
+#include <pubkey.h>
+#include <sync.h>
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+static const bool DEFAULT_KEYIMAGEFILTER = true;
+
+static const size_t KEYIMAGE_FILTER_BITS_PER_ELEMENT = 12;
+static const unsigned int KEYIMAGE_FILTER_HASH_FUNCS = 8;
+static const size_t KEYIMAGE_FILTER_MIN_ELEMENTS = 1 << 16;
+
+/**
+ * Bloom filter over every key image in the block tree db (DB_RCTKEYIMAGE).
+ *
+ * Nearly all key image lookups miss, as a key image being spent is new.
+ * A negative MaybeContains() is definite and the db lookup can be skipped.
+ * Key images are never removed, those erased on disconnect only cost some
+ * false positives until the next rebuild.
+ */
+class CKeyImageFilter
+{
+public:
+    CKeyImageFilter();
+
+    //! Clear and size for nElements, enables the filter
+    void Reset(size_t nElements);
+    void Disable();
+    bool IsEnabled() const;
+
+    void Insert(const CCmpPubKey &ki);
+    //! Always true while the filter is disabled
+    bool MaybeContains(const CCmpPubKey &ki) const;
+
+    //! Set once more elements were inserted than the filter was sized for
+    bool NeedsResize() const;
+
+    size_t GetCapacity() const;
+    size_t GetInserted() const;
+    size_t DynamicMemoryUsage() const;
+    uint64_t GetSkipped() const { return nSkipped; };
+
+private:
+    void GetBits(const CCmpPubKey &ki, uint64_t &h1, uint64_t &h2) const;
+
+    mutable CCriticalSection cs_filter;
+    std::vector<uint64_t> vData;
+    uint64_t nBits = 0;
+    size_t nCapacity = 0;
+    size_t nInserted = 0;
+    bool fEnabled = false;
+    uint64_t k0, k1;
+
+    mutable std::atomic<uint64_t> nSkipped{0};
+};
+
+#endif // BITCOINC_KEYIMAGEFILTER_H
@@ -30,6 +30,14 @@ static int FileWriteStr(const std::string &str, FILE *fp)
     return fwrite(str.data(), 1, str.size(), fp);
 }
 
+BCLog::Logger::~Logger()
+{
+    StopWriter();
+    if (m_fileout) {
+        fclose(m_fileout);
+    }
+}
+
 bool BCLog::Logger::OpenDebugLog()
 {
     std::lock_guard<std::mutex> scoped_lock(m_file_mutex);
@@ -208,6 +216,32 @@ void BCLog::Logger::LogPrintStr(const std::string &str)
 {
     std::string strTimestamped = LogTimestampStr(str);
 
+    {
+        std::unique_lock<std::mutex> lock(m_buffer_mutex);
+        if (m_writer_running) {
+            // A message larger than the buffer is let in once the buffer is empty
+            auto fits = [&] { return m_buffer.empty() || m_buffer_bytes + strTimestamped.size() <= m_buffer_max_bytes; };
+            if (!fits()) {
+                if (m_drop_overflow) {
+                    m_dropped++;
+                    return;
+                }
+                m_buffer_cv.wait(lock, [&] { return !m_writer_running || fits(); });
+            }
+            if (m_writer_running) {
+                m_buffer_bytes += strTimestamped.size();
+                m_buffer.push_back(std::move(strTimestamped));
+                m_buffer_cv.notify_all();
+                return;
+            }
+        }
+    }
+
+    WriteStr(strTimestamped);
+}
+
+void BCLog::Logger::WriteStr(const std::string &strTimestamped)
+{
     if (m_print_to_console) {
         // print to console
         fwrite(strTimestamped.data(), 1, strTimestamped.size(), stdout);
@@ -237,6 +271,63 @@ void BCLog::Logger::LogPrintStr(const std::string &str)
     }
 }
 
+void BCLog::Logger::ThreadWriter()
+{
+    std::vector<std::string> msgs;
+    std::unique_lock<std::mutex> lock(m_buffer_mutex);
+    while (true) {
+        m_buffer_cv.wait(lock, [this] { return m_writer_stop || !m_buffer.empty(); });
+        if (m_buffer.empty()) {
+            // Stopping and drained, later messages are written by their thread
+            m_writer_running = false;
+            m_buffer_cv.notify_all();
+            break;
+        }
+        msgs.swap(m_buffer);
+        m_buffer_bytes = 0;
+        uint64_t dropped = m_dropped;
+        m_dropped = 0;
+        lock.unlock();
+        m_buffer_cv.notify_all();
+
+        for (const auto& msg : msgs) {
+            WriteStr(msg);
+        }
+        msgs.clear();
+        if (dropped > 0) {
+            WriteStr(strprintf("Dropped %u log messages, the log buffer was full\n", dropped));
+        }
+
+        lock.lock();
+    }
+}
+
+void BCLog::Logger::StartWriter(size_t max_bytes, bool drop_overflow)
+{
+    std::lock_guard<std::mutex> lock(m_buffer_mutex);
+    if (m_writer.joinable()) {
+        return;
+    }
+    m_buffer_max_bytes = max_bytes;
+    m_drop_overflow = drop_overflow;
+    m_writer_stop = false;
+    m_writer_running = true;
+    m_writer = std::thread(&BCLog::Logger::ThreadWriter, this);
+}
+
+void BCLog::Logger::StopWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_buffer_mutex);
+        if (!m_writer.joinable()) {
+            return;
+        }
+        m_writer_stop = true;
+    }
+    m_buffer_cv.notify_all();
+    m_writer.join();
+}
+
 void BCLog::Logger::ShrinkDebugFile()
 {
     // Amount of debug.log to save at end when shrinking (must fit in memory)
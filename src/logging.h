@@ -10,15 +10,20 @@
 #include <tinyformat.h>
 
 #include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <list>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 static const bool DEFAULT_LOGTIMEMICROS = false;
 static const bool DEFAULT_LOGIPS        = false;
 static const bool DEFAULT_LOGTIMESTAMPS = true;
+//! -logbuffer default (KiB), 0 writes log messages on the logging thread
+static const unsigned int DEFAULT_LOGBUFFER = 0;
+static const bool DEFAULT_LOGDROPOVERFLOW = false;
 extern const char * const DEFAULT_DEBUGLOGFILE;
 
 extern bool fLogIPs;
@@ -79,7 +84,26 @@ namespace BCLog {
         /** Log categories bitfield. */
         std::atomic<uint32_t> m_categories{0};
 
+        /**
+         * Messages queued for the writer thread. Producers only append to the
+         * buffer, all console and file output happens on the writer.
+         */
+        std::mutex m_buffer_mutex;
+        std::condition_variable m_buffer_cv;
+        std::vector<std::string> m_buffer;
+        size_t m_buffer_bytes = 0;
+        size_t m_buffer_max_bytes = 0;
+        //! Drop messages when the buffer is full instead of waiting for space
+        bool m_drop_overflow = false;
+        uint64_t m_dropped = 0;
+        bool m_writer_running = false;
+        bool m_writer_stop = false;
+        std::thread m_writer;
+
         std::string LogTimestampStr(const std::string& str);
+        /** Write a formatted message to the console and file */
+        void WriteStr(const std::string& str);
+        void ThreadWriter();
 
     public:
         bool m_print_to_console = false;
@@ -91,9 +115,19 @@ namespace BCLog {
         fs::path m_file_path;
         std::atomic<bool> m_reopen_file{false};
 
+        ~Logger();
+
         /** Send a string to the log output */
         void LogPrintStr(const std::string &str);
 
+        /**
+         * Hand log output to a writer thread, buffering up to max_bytes of messages.
+         * When the buffer is full producers wait, or drop their message if drop_overflow.
+         */
+        void StartWriter(size_t max_bytes, bool drop_overflow);
+        /** Write out all buffered messages and go back to writing on the logging thread */
+        void StopWriter();
+
         /** Returns whether logs will be written to any output */
         bool Enabled() const { return m_print_to_console || m_print_to_file; }
 
@@ -6,7 +6,9 @@
 #define BITCOIN_MEMUSAGE_H
 
 #include <indirectmap.h>
+#include <prevector.h>
 
+#include <assert.h>
 #include <stdlib.h>
 
 #include <map>
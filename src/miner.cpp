@@ -40,6 +40,33 @@ uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 uint64_t nLastBlockWeight = 0;
 
+/**
+ * Transactions chosen by the last package selection. While the tip, the
+ * mempool and the selection parameters are unchanged a new template reuses
+ * them instead of walking the mempool again.
+ */
+struct CachedPackageSelection
+{
+    bool fValid = false;
+    uint256 hashPrevBlock;
+    int nHeight = 0;
+    unsigned int nTransactionsUpdated = 0;
+    int64_t nLockTimeCutoff = 0;
+    unsigned int nBlockMaxWeight = 0;
+    CFeeRate blockMinFeeRate;
+    bool fIncludeWitness = false;
+
+    std::vector<CTransactionRef> vtx;
+    std::vector<CAmount> vTxFees;
+    std::vector<int64_t> vTxSigOpsCost;
+    uint64_t nBlockWeight = 0;
+    uint64_t nBlockSize = 0;
+    uint64_t nBlockTx = 0;
+    uint64_t nBlockSigOpsCost = 0;
+    CAmount nFees = 0;
+};
+static CachedPackageSelection g_last_selection; // guarded by cs_main
+
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
 {
     int64_t nOldTime = pblock->nTime;
@@ -147,7 +174,10 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    if (!ReuseLastSelection(pindexPrev)) {
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+        StoreLastSelection(pindexPrev);
+    }
 
     int64_t nTime1 = GetTimeMicros();
 
@@ -236,6 +266,56 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& packa
     return true;
 }
 
+bool BlockAssembler::ReuseLastSelection(const CBlockIndex *pindexPrev)
+{
+    AssertLockHeld(cs_main);
+    const CachedPackageSelection &c = g_last_selection;
+    if (!c.fValid
+        || c.hashPrevBlock != pindexPrev->GetBlockHash()
+        || c.nHeight != nHeight
+        || c.nTransactionsUpdated != mempool.GetTransactionsUpdated()
+        || c.nLockTimeCutoff != nLockTimeCutoff
+        || c.nBlockMaxWeight != nBlockMaxWeight
+        || c.blockMinFeeRate != blockMinFeeRate
+        || c.fIncludeWitness != fIncludeWitness) {
+        return false;
+    }
+
+    pblock->vtx.insert(pblock->vtx.end(), c.vtx.begin(), c.vtx.end());
+    pblocktemplate->vTxFees.insert(pblocktemplate->vTxFees.end(), c.vTxFees.begin(), c.vTxFees.end());
+    pblocktemplate->vTxSigOpsCost.insert(pblocktemplate->vTxSigOpsCost.end(), c.vTxSigOpsCost.begin(), c.vTxSigOpsCost.end());
+    nBlockWeight = c.nBlockWeight;
+    nBlockSize = c.nBlockSize;
+    nBlockTx = c.nBlockTx;
+    nBlockSigOpsCost = c.nBlockSigOpsCost;
+    nFees = c.nFees;
+    return true;
+}
+
+void BlockAssembler::StoreLastSelection(const CBlockIndex *pindexPrev)
+{
+    AssertLockHeld(cs_main);
+    CachedPackageSelection &c = g_last_selection;
+    c.fValid = true;
+    c.hashPrevBlock = pindexPrev->GetBlockHash();
+    c.nHeight = nHeight;
+    c.nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    c.nLockTimeCutoff = nLockTimeCutoff;
+    c.nBlockMaxWeight = nBlockMaxWeight;
+    c.blockMinFeeRate = blockMinFeeRate;
+    c.fIncludeWitness = fIncludeWitness;
+
+    // Skip the coinbase placeholder
+    c.vtx.assign(pblock->vtx.begin() + 1, pblock->vtx.end());
+    c.vTxFees.assign(pblocktemplate->vTxFees.begin() + 1, pblocktemplate->vTxFees.end());
+    c.vTxSigOpsCost.assign(pblocktemplate->vTxSigOpsCost.begin() + 1, pblocktemplate->vTxSigOpsCost.end());
+    c.nBlockWeight = nBlockWeight;
+    c.nBlockSize = nBlockSize;
+    c.nBlockTx = nBlockTx;
+    c.nBlockSigOpsCost = nBlockSigOpsCost;
+    c.nFees = nFees;
+}
+
 void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
 {
     pblock->vtx.emplace_back(iter->GetSharedTx());
@@ -247,7 +327,7 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     nFees += iter->GetFee();
     inBlock.insert(iter);
 
-    nBlockSize += ::GetSerializeSize(iter->GetTx(), SER_NETWORK, PROTOCOL_VERSION);
+    nBlockSize += iter->GetTxSerializeSize();
     bool fPrintPriority = gArgs.GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
     if (fPrintPriority) {
         LogPrintf("fee %s txid %s\n",
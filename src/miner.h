@@ -29,6 +29,12 @@ struct CBlockTemplate
     std::vector<CAmount> vTxFees;
     std::vector<int64_t> vTxSigOpsCost;
     std::vector<unsigned char> vchCoinbaseCommitment;
+
+    // Branches of txn 0 in the txid and witness merkle trees, lets a staker
+    // swap in the coinstake without rehashing the other txns
+    bool fHasMerkleBranches = false;
+    std::vector<uint256> vMerkleBranch;
+    std::vector<uint256> vWitnessMerkleBranch;
 };
 
 // Container for tracking updates to ancestor feerate as we include (parent)
@@ -166,6 +172,10 @@ private:
     void resetBlock();
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
+    /** Fill the block from the last package selection if the tip and mempool haven't changed since */
+    bool ReuseLastSelection(const CBlockIndex *pindexPrev) EXCLUSIVE_LOCKS_REQUIRED(cs_main, mempool.cs);
+    /** Remember the transactions just selected for ReuseLastSelection */
+    void StoreLastSelection(const CBlockIndex *pindexPrev) EXCLUSIVE_LOCKS_REQUIRED(cs_main, mempool.cs);
 
     // Methods for how to add transactions to a block.
     /** Add transactions based on feerate including unconfirmed ancestors
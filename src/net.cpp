@@ -75,6 +75,9 @@ const static std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
 static const uint64_t RANDOMIZER_ID_LOCALHOSTNONCE = 0xd93e69e2bbfa5735ULL; // SHA256("localhostnonce")[0:8]
+
+/** How long the socket handler waits for readiness, also the frequency pnode->vSend is polled */
+static const int SOCKET_HANDLER_TIMEOUT_MS = 50;
 //
 // Global state variables
 //
@@ -758,7 +761,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
             vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+            vRecvMsg.emplace_back(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
 
         CNetMessage& msg = vRecvMsg.back();
 
@@ -850,6 +853,9 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
     if (hdr.nMessageSize > MAX_SIZE)
         return -1;
 
+    // Start from a recycled buffer, it grows as the payload arrives
+    g_net_message_buffers.Get(std::min(hdr.nMessageSize, (uint32_t)CNetMessageBufferPool::MAX_POOLED_SIZE), vRecv);
+
     // switch state to reading message data
     in_data = true;
 
@@ -861,18 +867,74 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+    if (vRecv.capacity() < nDataPos + nCopy) {
+        // Grow geometrically to keep reallocation linear, but allocate at most
+        // 256 KiB ahead of what was received and never more than the total
+        // message size, the header alone can't make us allocate much.
+        size_t nNew = std::max((size_t)vRecv.capacity() * 2, (size_t)(nDataPos + nCopy));
+        nNew = std::min(nNew, (size_t)(nDataPos + nCopy + 256 * 1024));
+        nNew = std::min(nNew, (size_t)hdr.nMessageSize);
+        vRecv.reserve(nNew);
     }
 
     hasher.Write((const unsigned char*)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    vRecv.write(pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
 }
 
+CNetMessageBufferPool g_net_message_buffers;
+
+size_t CNetMessageBufferPool::SizeClass(size_t nSize)
+{
+    size_t c = 0;
+    while (c < 31 && ((size_t)1 << (c + 1)) <= nSize) {
+        c++;
+    }
+    return c;
+}
+
+void CNetMessageBufferPool::Get(size_t nSize, CDataStream& vRecv)
+{
+    if (nSize < MIN_POOLED_SIZE || nSize > MAX_POOLED_SIZE) {
+        return;
+    }
+    // Buffers in class c have capacity in [2^c, 2^(c+1)), so look from the
+    // class of nSize up and skip any in its own class that are too small.
+    std::lock_guard<std::mutex> lock(m_cs);
+    for (size_t c = SizeClass(nSize); c <= SizeClass(MAX_POOLED_SIZE); ++c) {
+        std::vector<CSerializeData>& vFree = m_free[c];
+        for (size_t i = vFree.size(); i-- > 0; ) {
+            if (vFree[i].capacity() < nSize) {
+                continue;
+            }
+            m_pooled_bytes -= vFree[i].capacity();
+            vRecv.clear();
+            vRecv.swap(vFree[i]);
+            vFree.erase(vFree.begin() + i);
+            return;
+        }
+    }
+}
+
+void CNetMessageBufferPool::Put(CDataStream& vRecv)
+{
+    CSerializeData buf;
+    vRecv.swap(buf);
+    if (buf.capacity() < MIN_POOLED_SIZE || buf.capacity() > MAX_POOLED_SIZE) {
+        return;
+    }
+    buf.clear();
+
+    std::lock_guard<std::mutex> lock(m_cs);
+    if (m_pooled_bytes + buf.capacity() > MAX_POOL_BYTES) {
+        return; // buf is freed
+    }
+    m_pooled_bytes += buf.capacity();
+    m_free[SizeClass(buf.capacity())].push_back(std::move(buf));
+}
+
 const uint256& CNetMessage::GetMessageHash() const
 {
     assert(complete());
@@ -1158,6 +1220,165 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        UpdateNodeCounts();
+    }
+}
+
+void CConnman::GenerateSocketInterest(std::map<SOCKET, std::pair<NodeId, int> > &mapInterest)
+{
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        mapInterest[hListenSocket.socket] = std::make_pair(NodeId(-1), int(CSocketPoller::POLL_RECV));
+    }
+
+    LOCK(cs_vNodes);
+    for (CNode* pnode : vNodes)
+    {
+        // Implement the following logic:
+        // * If there is data to send, select() for sending data. As this only
+        //   happens when optimistic write failed, we choose to first drain the
+        //   write buffer in this case before receiving more. This avoids
+        //   needlessly queueing received data, if the remote peer is not themselves
+        //   receiving data. This means properly utilizing TCP flow control signalling.
+        // * Otherwise, if there is space left in the receive buffer, select() for
+        //   receiving data.
+        // * Hand off all complete messages to the processor, to be handled without
+        //   blocking here.
+
+        bool select_recv = !pnode->fPauseRecv;
+        bool select_send;
+        {
+            LOCK(pnode->cs_vSend);
+            select_send = !pnode->vSendMsg.empty();
+        }
+
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+
+        int nEvents = 0;
+        if (select_send) {
+            nEvents = CSocketPoller::POLL_SEND;
+        } else
+        if (select_recv) {
+            nEvents = CSocketPoller::POLL_RECV;
+        }
+        mapInterest[pnode->hSocket] = std::make_pair(pnode->GetId(), nEvents);
+    }
+}
+
+void CConnman::SocketEventsSelect(const std::map<SOCKET, std::pair<NodeId, int> > &mapInterest, std::map<SOCKET, int> &mapReady)
+{
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = SOCKET_HANDLER_TIMEOUT_MS * 1000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    for (const auto &si : mapInterest) {
+        if (si.second.first >= 0) {
+            FD_SET(si.first, &fdsetError);
+        }
+        if (si.second.second & CSocketPoller::POLL_RECV) {
+            FD_SET(si.first, &fdsetRecv);
+        }
+        if (si.second.second & CSocketPoller::POLL_SEND) {
+            FD_SET(si.first, &fdsetSend);
+        }
+        hSocketMax = std::max(hSocketMax, si.first);
+        have_fds = true;
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet)
+        return;
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (const auto &si : mapInterest)
+                mapReady[si.first] = CSocketPoller::POLL_RECV;
+        }
+        interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_HANDLER_TIMEOUT_MS));
+        return;
+    }
+
+    for (const auto &si : mapInterest) {
+        int nEvents = 0;
+        if (FD_ISSET(si.first, &fdsetRecv)) {
+            nEvents |= CSocketPoller::POLL_RECV;
+        }
+        if (FD_ISSET(si.first, &fdsetSend)) {
+            nEvents |= CSocketPoller::POLL_SEND;
+        }
+        if (FD_ISSET(si.first, &fdsetError)) {
+            nEvents |= CSocketPoller::POLL_ERROR;
+        }
+        if (nEvents) {
+            mapReady[si.first] = nEvents;
+        }
+    }
+}
+
+void CConnman::SocketEventsPoller(const std::map<SOCKET, std::pair<NodeId, int> > &mapInterest, std::map<SOCKET, int> &mapReady)
+{
+    // Drop sockets that went away or now belong to another node first, a
+    // closed socket is removed by the kernel and its number can be reused.
+    for (auto it = m_poll_registered.begin(); it != m_poll_registered.end(); ) {
+        auto mi = mapInterest.find(it->first);
+        if (mi == mapInterest.end() || mi->second.first != it->second.first) {
+            m_poller.Remove(it->first, it->second.second);
+            it = m_poll_registered.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (const auto &si : mapInterest) {
+        auto it = m_poll_registered.find(si.first);
+        bool fOk = it == m_poll_registered.end()
+            ? m_poller.Add(si.first, si.second.second)
+            : m_poller.Modify(si.first, it->second.second, si.second.second);
+        if (fOk) {
+            m_poll_registered[si.first] = si.second;
+        } else {
+            LogPrint(BCLog::NET, "socket poller register error %s\n", NetworkErrorString(WSAGetLastError()));
+            if (it != m_poll_registered.end()) {
+                m_poller.Remove(it->first, it->second.second);
+                m_poll_registered.erase(it);
+            }
+        }
+    }
+
+    std::vector<std::pair<SOCKET, int> > vReady;
+    if (!m_poller.Wait(SOCKET_HANDLER_TIMEOUT_MS, vReady)) {
+        LogPrintf("socket poller error %s\n", NetworkErrorString(WSAGetLastError()));
+        interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_HANDLER_TIMEOUT_MS));
+        return;
+    }
+    for (const auto &r : vReady) {
+        mapReady[r.first] |= r.second;
+    }
+}
+
+void CConnman::SocketEvents(std::map<SOCKET, int> &mapReady)
+{
+    std::map<SOCKET, std::pair<NodeId, int> > mapInterest;
+    GenerateSocketInterest(mapInterest);
+
+    if (m_poller.IsValid()) {
+        SocketEventsPoller(mapInterest, mapReady);
+    } else {
+        SocketEventsSelect(mapInterest, mapReady);
     }
 }
 
@@ -1190,6 +1411,7 @@ void CConnman::ThreadSocketHandler()
                 {
                     // remove from vNodes
                     vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                    UpdateNodeCounts();
 
                     // release outbound grant (if any)
                     pnode->grantOutbound.Release();
@@ -1238,94 +1460,17 @@ void CConnman::ThreadSocketHandler()
                 clientInterface->NotifyNumConnectionsChanged(nPrevNodeCount);
         }
 
-        //
-        // Find which sockets have data to receive
-        //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            for (CNode* pnode : vNodes)
-            {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
-
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        std::map<SOCKET, int> mapReady;
+        SocketEvents(mapReady);
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
-        }
-
         //
         // Accept new connections
         //
         for (const ListenSocket& hListenSocket : vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (hListenSocket.socket != INVALID_SOCKET && mapReady.count(hListenSocket.socket))
             {
                 AcceptConnection(hListenSocket);
             }
@@ -1356,9 +1501,12 @@ void CConnman::ThreadSocketHandler()
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                auto mi = mapReady.find(pnode->hSocket);
+                if (mi != mapReady.end()) {
+                    recvSet = mi->second & CSocketPoller::POLL_RECV;
+                    sendSet = mi->second & CSocketPoller::POLL_SEND;
+                    errorSet = mi->second & CSocketPoller::POLL_ERROR;
+                }
             }
             if (recvSet || errorSet)
             {
@@ -2036,6 +2184,7 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        UpdateNodeCounts();
     }
 }
 
@@ -2057,6 +2206,8 @@ void CConnman::ThreadMessageHandler()
 
         bool fMoreWork = false;
 
+        m_msgproc->PrepareMessages(vNodesCopy);
+
         for (CNode* pnode : vNodesCopy)
         {
             if (pnode->fDisconnect)
@@ -2409,7 +2560,7 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
 
     // Dump network addresses
-    scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000);
+    scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000, CScheduler::Priority::LOW);
 
     return true;
 }
@@ -2488,6 +2639,8 @@ void CConnman::Stop()
         DeleteNode(pnode);
     }
     vNodes.clear();
+    nNodesInbound = 0;
+    nNodesOutbound = 0;
     vNodesDisconnected.clear();
     vhListenSocket.clear();
     semOutbound.reset();
@@ -2559,19 +2712,29 @@ bool CConnman::RemoveAddedNode(const std::string& strNode)
     return false;
 }
 
-size_t CConnman::GetNodeCount(NumConnections flags)
+void CConnman::UpdateNodeCounts()
 {
-    LOCK(cs_vNodes);
-    if (flags == CConnman::CONNECTIONS_ALL) // Shortcut if we want total
-        return vNodes.size();
-
-    int nNum = 0;
+    AssertLockHeld(cs_vNodes);
+    int nInbound = 0;
     for (const auto& pnode : vNodes) {
-        if (flags & (pnode->fInbound ? CONNECTIONS_IN : CONNECTIONS_OUT)) {
-            nNum++;
+        if (pnode->fInbound) {
+            nInbound++;
         }
     }
+    nNodesInbound = nInbound;
+    nNodesOutbound = (int)vNodes.size() - nInbound;
+}
 
+size_t CConnman::GetNodeCount(NumConnections flags)
+{
+    // Polled by the GUI and RPC, read without cs_vNodes
+    int nNum = 0;
+    if (flags & CONNECTIONS_IN) {
+        nNum += nNodesInbound;
+    }
+    if (flags & CONNECTIONS_OUT) {
+        nNum += nNodesOutbound;
+    }
     return nNum;
 }
 
@@ -17,6 +17,7 @@
 #include <policy/feerate.h>
 #include <protocol.h>
 #include <random.h>
+#include <sockpoller.h>
 #include <streams.h>
 #include <sync.h>
 #include <uint256.h>
@@ -342,6 +343,12 @@ public:
     void ThreadOpenConnections(std::vector<std::string> connect);
     void ThreadMessageHandler();
     void AcceptConnection(const ListenSocket& hListenSocket);
+    /** The events each socket should be watched for, keyed by socket with the owning node, -1 for listening sockets */
+    void GenerateSocketInterest(std::map<SOCKET, std::pair<NodeId, int> > &mapInterest);
+    /** Wait for socket readiness, fills mapReady with the CSocketPoller events of each ready socket */
+    void SocketEvents(std::map<SOCKET, int> &mapReady);
+    void SocketEventsSelect(const std::map<SOCKET, std::pair<NodeId, int> > &mapInterest, std::map<SOCKET, int> &mapReady);
+    void SocketEventsPoller(const std::map<SOCKET, std::pair<NodeId, int> > &mapInterest, std::map<SOCKET, int> &mapReady);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -357,6 +364,8 @@ public:
     bool IsWhitelistedRange(const CNetAddr &addr);
 
     void DeleteNode(CNode* pnode);
+    //! Recount nNodesInbound and nNodesOutbound after vNodes changed
+    void UpdateNodeCounts() EXCLUSIVE_LOCKS_REQUIRED(cs_vNodes);
 
     NodeId GetNewNodeId();
 
@@ -398,6 +407,9 @@ public:
     unsigned int nReceiveFloodSize;
 
     std::vector<ListenSocket> vhListenSocket;
+    //! Only used by the socket handler thread
+    CSocketPoller m_poller;
+    std::map<SOCKET, std::pair<NodeId, int> > m_poll_registered;
     std::atomic<bool> fNetworkActive;
     banmap_t setBanned;
     CCriticalSection cs_setBanned;
@@ -411,6 +423,9 @@ public:
     std::vector<CNode*> vNodes;
     std::list<CNode*> vNodesDisconnected;
     mutable CCriticalSection cs_vNodes;
+    //! Inbound and outbound nodes in vNodes, so GetNodeCount doesn't take cs_vNodes
+    std::atomic<int> nNodesInbound{0};
+    std::atomic<int> nNodesOutbound{0};
     std::atomic<NodeId> nLastNodeId;
     CMedianFilter<int> cPeerBlockCounts;
 
@@ -483,6 +498,8 @@ struct CombinerAll
 class NetEventsInterface
 {
 public:
+    /** Look ahead at the messages queued on all nodes before a round of ProcessMessages */
+    virtual void PrepareMessages(const std::vector<CNode*>& nodes) = 0;
     virtual bool ProcessMessages(CNode* pnode, std::atomic<bool>& interrupt) = 0;
     virtual bool SendMessages(CNode* pnode) = 0;
     virtual void InitializeNode(CNode* pnode) = 0;
@@ -577,6 +594,35 @@ public:
 
 
 
+/**
+ * Recycled receive buffers for message payloads, binned by power of two
+ * capacity, so large messages don't page fault fresh allocations in.
+ */
+class CNetMessageBufferPool
+{
+public:
+    //! Smaller buffers are left to the allocator
+    static const size_t MIN_POOLED_SIZE = 64 * 1024;
+    //! Larger buffers are freed, they're rare and would pin a lot of memory
+    static const size_t MAX_POOLED_SIZE = 4 * 1024 * 1024;
+    //! Most memory kept in free buffers
+    static const size_t MAX_POOL_BYTES = 32 * 1024 * 1024;
+
+    /** Swap a free buffer with capacity of at least nSize into vRecv, if one is pooled */
+    void Get(size_t nSize, CDataStream& vRecv);
+    /** Take the buffer of vRecv for reuse */
+    void Put(CDataStream& vRecv);
+
+private:
+    static size_t SizeClass(size_t nSize);
+
+    std::mutex m_cs;
+    std::vector<CSerializeData> m_free[32];
+    size_t m_pooled_bytes = 0;
+};
+
+extern CNetMessageBufferPool g_net_message_buffers;
+
 class CNetMessage {
 private:
     mutable CHash256 hasher;
@@ -592,6 +638,7 @@ public:
     unsigned int nDataPos;
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
+    bool fPrechecked;               // payload already passed to PrepareMessages
 
     CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
         hdrbuf.resize(24);
@@ -599,6 +646,12 @@ public:
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
+        fPrechecked = false;
+    }
+
+    ~CNetMessage()
+    {
+        g_net_message_buffers.Put(vRecv);
     }
 
     bool complete() const
@@ -8,9 +8,11 @@
 #include <addrman.h>
 #include <arith_uint256.h>
 #include <blockencodings.h>
+#include <blockreadahead.h>
 #include <chainparams.h>
 #include <consensus/validation.h>
 #include <hash.h>
+#include <index/blockfilterindex.h>
 #include <validation.h>
 #include <merkleblock.h>
 #include <netmessagemaker.h>
@@ -30,7 +32,11 @@
 #include <utilstrencodings.h>
 #include <smsg/smessage.h>
 
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 #if defined(NDEBUG)
 # error "Bitcoin cannot be compiled without assertions."
@@ -58,6 +64,8 @@ static constexpr int64_t EXTRA_PEER_CHECK_INTERVAL = 45;
 static constexpr int64_t MINIMUM_CONNECT_TIME = 30;
 /** SHA256("main address relay")[0:8] */
 static constexpr uint64_t RANDOMIZER_ID_ADDRESS_RELAY = 0x3cac0035b5866b90ULL;
+/** Most queued transactions PrepareMessages checks in one batch */
+static constexpr size_t MAX_TX_PRECHECK_BATCH = 1000;
 /// Age after which a stale block will no longer be served if requested as
 /// protection against fingerprinting. Set to one month, denominated in seconds.
 static constexpr int STALE_RELAY_AGE_LIMIT = 30 * 24 * 60 * 60;
@@ -934,9 +942,157 @@ static bool BlockRequestAllowed(const CBlockIndex* pindex, const Consensus::Para
         (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, consensusParams) < STALE_RELAY_AGE_LIMIT);
 }
 
+/**
+ * Threads handling the peer messages that don't touch the chain state, each
+ * peer is bound to one thread so its messages are handled in order.
+ *
+ * Queued messages stay counted in the peer's process queue size so the
+ * receive flood limit still applies.
+ */
+class CPeerMessageWorkers
+{
+public:
+    CPeerMessageWorkers(CConnman *connmanIn, int nThreads);
+    ~CPeerMessageWorkers() { Stop(); };
+
+    /** False if stopped, the caller should handle the message itself */
+    bool Push(CNode *pnode, const std::string &strCommand, CDataStream &vRecv);
+    void Stop();
+
+private:
+    struct Job
+    {
+        Job(CNode *pnodeIn, const std::string &strCommandIn, CDataStream &vRecvIn)
+            : pnode(pnodeIn), strCommand(strCommandIn), vRecv(std::move(vRecvIn)) {};
+        CNode *pnode;
+        std::string strCommand;
+        CDataStream vRecv;
+    };
+
+    struct Worker
+    {
+        std::mutex cs;
+        std::condition_variable cond;
+        std::deque<Job> queue;
+        bool fStop = false;
+        std::thread thread;
+    };
+
+    void ThreadWork(Worker *w);
+    void Handle(Job &job);
+
+    CConnman *connman;
+    std::vector<std::unique_ptr<Worker> > m_workers;
+};
+
+CPeerMessageWorkers::CPeerMessageWorkers(CConnman *connmanIn, int nThreads) : connman(connmanIn)
+{
+    for (int i = 0; i < nThreads; ++i) {
+        m_workers.emplace_back(new Worker());
+        Worker *w = m_workers.back().get();
+        w->thread = std::thread(&TraceThread<std::function<void()> >, "peermsg",
+                                std::function<void()>(std::bind(&CPeerMessageWorkers::ThreadWork, this, w)));
+    }
+}
+
+bool CPeerMessageWorkers::Push(CNode *pnode, const std::string &strCommand, CDataStream &vRecv)
+{
+    if (m_workers.empty()) {
+        return false;
+    }
+    Worker *w = m_workers[pnode->GetId() % m_workers.size()].get();
+
+    size_t nSize = vRecv.size() + CMessageHeader::HEADER_SIZE;
+    {
+        std::lock_guard<std::mutex> lock(w->cs);
+        if (w->fStop) {
+            return false;
+        }
+        pnode->AddRef();
+        w->queue.emplace_back(pnode, strCommand, vRecv);
+    }
+    {
+        LOCK(pnode->cs_vProcessMsg);
+        pnode->nProcessQueueSize += nSize;
+        pnode->fPauseRecv = pnode->nProcessQueueSize > connman->GetReceiveFloodSize();
+    }
+    w->cond.notify_one();
+    return true;
+}
+
+void CPeerMessageWorkers::Stop()
+{
+    for (auto &w : m_workers) {
+        {
+            std::lock_guard<std::mutex> lock(w->cs);
+            w->fStop = true;
+        }
+        w->cond.notify_all();
+    }
+    for (auto &w : m_workers) {
+        if (w->thread.joinable()) {
+            w->thread.join();
+        }
+    }
+}
+
+void CPeerMessageWorkers::Handle(Job &job)
+{
+    CNode *pnode = job.pnode;
+    size_t nSize = job.vRecv.size() + CMessageHeader::HEADER_SIZE;
+
+    if (!pnode->fDisconnect) {
+        try {
+            if (smsg::SMSG_UNKNOWN_MESSAGE == smsgModule.ReceiveData(pnode, job.strCommand, job.vRecv)) {
+                LogPrint(BCLog::NET, "Unknown command \"%s\" from peer=%d\n", SanitizeString(job.strCommand), pnode->GetId());
+            }
+        } catch (const std::ios_base::failure& e) {
+            LogPrint(BCLog::NET, "%s(%s, %u bytes): Exception '%s' caught\n", __func__, SanitizeString(job.strCommand), nSize, e.what());
+        } catch (const std::exception& e) {
+            PrintExceptionContinue(&e, "CPeerMessageWorkers::Handle()");
+        }
+    }
+
+    {
+        LOCK(pnode->cs_vProcessMsg);
+        pnode->nProcessQueueSize -= nSize;
+        pnode->fPauseRecv = pnode->nProcessQueueSize > connman->GetReceiveFloodSize();
+    }
+    pnode->Release();
+}
+
+void CPeerMessageWorkers::ThreadWork(Worker *w)
+{
+    std::unique_lock<std::mutex> lock(w->cs);
+    for (;;) {
+        w->cond.wait(lock, [w] { return w->fStop || !w->queue.empty(); });
+        if (w->queue.empty()) {
+            return; // Stopping, the queue is drained first
+        }
+        Job job(std::move(w->queue.front()));
+        w->queue.pop_front();
+
+        lock.unlock();
+        Handle(job);
+        lock.lock();
+    }
+}
+
+/** Messages handled by CPeerMessageWorkers */
+static bool IsPeerWorkerCommand(const std::string &strCommand)
+{
+    // Secure messaging traffic only takes cs_main briefly, if at all
+    return strCommand.compare(0, 4, "smsg") == 0;
+}
+
 PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, CScheduler &scheduler, bool enable_bip61)
     : connman(connmanIn), m_stale_tip_check_time(0), m_enable_bip61(enable_bip61) {
 
+    int nMsgThreads = std::max(0, (int)gArgs.GetArg("-peermsgthreads", DEFAULT_PEER_MSG_THREADS));
+    if (nMsgThreads > 0) {
+        m_msg_workers.reset(new CPeerMessageWorkers(connman, nMsgThreads));
+    }
+
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
 
@@ -949,6 +1105,18 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, CScheduler &schedu
     scheduler.scheduleEvery(std::bind(&PeerLogicValidation::CheckForStaleTipAndEvictPeers, this, consensusParams), EXTRA_PEER_CHECK_INTERVAL * 1000);
 }
 
+PeerLogicValidation::~PeerLogicValidation()
+{
+    StopMessageWorkers();
+}
+
+void PeerLogicValidation::StopMessageWorkers()
+{
+    if (m_msg_workers) {
+        m_msg_workers->Stop();
+    }
+}
+
 /**
  * Evict orphan txn pool entries (EraseOrphanTx) based on a newly connected
  * block. Also save the time of the last tip update.
@@ -999,7 +1167,7 @@ static bool fWitnessesPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_
  * to compatible peers.
  */
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
-    std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
+    std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true, &mempool);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
 
     LOCK(cs_main);
@@ -1312,17 +1480,24 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
     // it's available before trying to send.
     if (send && (pindex->nStatus & BLOCK_HAVE_DATA))
     {
+        // Old blocks asked for as compact blocks are sent in full, see below
+        bool fOldCmpctBlockWithWitness = inv.type == MSG_CMPCT_BLOCK
+            && State(pfrom->GetId())->fWantsCmpctWitness
+            && !(CanDirectFetch(consensusParams) && pindex->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH);
+
         std::shared_ptr<const CBlock> pblock;
         if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
             pblock = a_recent_block;
-        } else if (inv.type == MSG_WITNESS_BLOCK) {
+        } else if (inv.type == MSG_WITNESS_BLOCK || fOldCmpctBlockWithWitness) {
             // Fast-path: in this case it is possible to serve the block directly from disk,
-            // as the network format matches the format on disk
-            std::vector<uint8_t> block_data;
-            if (!ReadRawBlockFromDisk(block_data, pindex, chainparams.MessageStart())) {
+            // as the network format matches the format on disk.
+            // Read straight into the message to skip a copy of the block.
+            CSerializedNetMsg msg;
+            msg.command = NetMsgType::BLOCK;
+            if (!ReadRawBlockFromDisk(msg.data, pindex, chainparams.MessageStart())) {
                 assert(!"cannot load block from disk");
             }
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
+            connman->PushMessage(pfrom, std::move(msg));
             // Don't set pblock as we've sent the block
         } else {
             // Send block from disk
@@ -1437,6 +1612,21 @@ void static ProcessGetData(CNode* pfrom, const CChainParams& chainparams, CConnm
                 vNotFound.push_back(inv);
             }
         }
+
+        // Blocks are served one per call, read the ones queued behind this one ahead
+        if (g_block_read_ahead.IsRunning()) {
+            int nReadAhead = 0;
+            for (auto itAhead = it; itAhead != pfrom->vRecvGetData.end() && nReadAhead < BLOCK_READ_AHEAD_DEPTH; ++itAhead) {
+                if (itAhead->type != MSG_BLOCK && itAhead->type != MSG_FILTERED_BLOCK && itAhead->type != MSG_CMPCT_BLOCK && itAhead->type != MSG_WITNESS_BLOCK) {
+                    break;
+                }
+                const CBlockIndex* pindex = LookupBlockIndex(itAhead->hash);
+                if (pindex && (pindex->nStatus & BLOCK_HAVE_DATA)) {
+                    g_block_read_ahead.Block(pindex->GetBlockPos());
+                }
+                nReadAhead++;
+            }
+        }
     } // release cs_main
 
     if (it != pfrom->vRecvGetData.end() && !pfrom->fPauseSend) {
@@ -1708,6 +1898,197 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
     return true;
 }
 
+/** Maximum number of compact filters that may be requested with one getcfilters. See BIP 157. */
+static constexpr uint32_t MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of cf hashes that may be requested with one getcfheaders. See BIP 157. */
+static constexpr uint32_t MAX_GETCFHEADERS_SIZE = 2000;
+
+/**
+ * Validation logic for compact filters request handling.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   filter_type     The filter type the request is for. Must be supported.
+ * @param[in]   start_height    The start height for the request
+ * @param[in]   stop_hash       The stop_hash for the request
+ * @param[in]   max_height_diff The maximum number of items permitted to request, as specified in BIP 157
+ * @param[out]  stop_index      The CBlockIndex for the stop_hash block, if the request can be serviced.
+ * @return                      True if the request can be serviced.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, BlockFilterType filter_type, uint32_t start_height,
+                                      const uint256& stop_hash, uint32_t max_height_diff,
+                                      const CBlockIndex*& stop_index)
+{
+    bool supported_filter_type =
+        (pfrom->GetLocalServices() & NODE_COMPACT_FILTERS)
+        && g_blockfilterindex
+        && filter_type == g_blockfilterindex->GetFilterType();
+    if (!supported_filter_type) {
+        LogPrint(BCLog::NET, "peer %d requested unsupported block filter type: %d\n",
+                 pfrom->GetId(), static_cast<uint8_t>(filter_type));
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        stop_index = LookupBlockIndex(stop_hash);
+
+        // Check that the stop block exists and is in the active chain.
+        if (!stop_index || !chainActive.Contains(stop_index)) {
+            LogPrint(BCLog::NET, "peer %d requested invalid block hash: %s\n",
+                     pfrom->GetId(), stop_hash.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+    }
+
+    uint32_t stop_height = stop_index->nHeight;
+    if (start_height > stop_height) {
+        LogPrint(BCLog::NET, "peer %d sent invalid getcfilters/getcfheaders with " /* Continued */
+                 "start height %d and stop height %d\n",
+                 pfrom->GetId(), start_height, stop_height);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (stop_height - start_height >= max_height_diff) {
+        LogPrint(BCLog::NET, "peer %d requested too many cfilters/cfheaders: %d / %d\n",
+                 pfrom->GetId(), stop_height - start_height + 1, max_height_diff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Handle a cfilters request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ */
+static void ProcessGetCFilters(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, start_height, stop_hash,
+                                   MAX_GETCFILTERS_SIZE, stop_index)) {
+        return;
+    }
+
+    std::vector<BlockFilter> filters;
+    if (!g_blockfilterindex->LookupFilterRange(start_height, stop_index, filters)) {
+        LogPrint(BCLog::NET, "Failed to find block filter in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    for (const auto& filter : filters) {
+        CSerializedNetMsg msg = CNetMsgMaker(pfrom->GetSendVersion())
+            .Make(NetMsgType::CFILTER, filter);
+        connman->PushMessage(pfrom, std::move(msg));
+    }
+}
+
+/**
+ * Handle a cfheaders request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ */
+static void ProcessGetCFHeaders(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, start_height, stop_hash,
+                                   MAX_GETCFHEADERS_SIZE, stop_index)) {
+        return;
+    }
+
+    uint256 prev_header;
+    if (start_height > 0) {
+        const CBlockIndex* const prev_block =
+            stop_index->GetAncestor(static_cast<int>(start_height - 1));
+        if (!g_blockfilterindex->LookupFilterHeader(prev_block, prev_header)) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type), prev_block->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    std::vector<uint256> filter_hashes;
+    if (!g_blockfilterindex->LookupFilterHashRange(start_height, stop_index, filter_hashes)) {
+        LogPrint(BCLog::NET, "Failed to find block filter hashes in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    CSerializedNetMsg msg = CNetMsgMaker(pfrom->GetSendVersion())
+        .Make(NetMsgType::CFHEADERS,
+              filter_type_ser,
+              stop_index->GetBlockHash(),
+              prev_header,
+              filter_hashes);
+    connman->PushMessage(pfrom, std::move(msg));
+}
+
+/**
+ * Handle a getcfcheckpt request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ */
+static void ProcessGetCFCheckPt(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, /*start_height=*/0, stop_hash,
+                                   /*max_height_diff=*/std::numeric_limits<uint32_t>::max(),
+                                   stop_index)) {
+        return;
+    }
+
+    std::vector<uint256> headers(stop_index->nHeight / CFCHECKPT_INTERVAL);
+
+    // Populate headers.
+    const CBlockIndex* block_index = stop_index;
+    for (int i = headers.size() - 1; i >= 0; i--) {
+        int height = (i + 1) * CFCHECKPT_INTERVAL;
+        block_index = block_index->GetAncestor(height);
+
+        if (!g_blockfilterindex->LookupFilterHeader(block_index, headers[i])) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type), block_index->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    CSerializedNetMsg msg = CNetMsgMaker(pfrom->GetSendVersion())
+        .Make(NetMsgType::CFCHECKPT,
+              filter_type_ser,
+              stop_index->GetBlockHash(),
+              headers);
+    connman->PushMessage(pfrom, std::move(msg));
+}
+
 bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc, bool enable_bip61)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->GetId());
@@ -2235,6 +2616,19 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     }
 
 
+    else if (strCommand == NetMsgType::GETCFILTERS) {
+        ProcessGetCFilters(pfrom, vRecv, connman);
+    }
+
+    else if (strCommand == NetMsgType::GETCFHEADERS) {
+        ProcessGetCFHeaders(pfrom, vRecv, connman);
+    }
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT) {
+        ProcessGetCFCheckPt(pfrom, vRecv, connman);
+    }
+
+
     else if (strCommand == NetMsgType::GETBLOCKTXN)
     {
         BlockTransactionsRequest req;
@@ -2377,6 +2771,11 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
+        // Verify the rangeproofs before taking cs_main
+        if (!mempool.exists(inv.hash)) {
+            PreCheckTransaction(ptx, GetTime());
+        }
+
         LOCK2(cs_main, g_cs_orphans);
 
         bool fMissingInputs = false;
@@ -3152,6 +3551,45 @@ static bool SendRejectsAndCheckIfBanned(CNode* pnode, CConnman* connman, bool en
     return false;
 }
 
+void PeerLogicValidation::PrepareMessages(const std::vector<CNode*>& nodes)
+{
+    if (!fRelayTxes) {
+        return;
+    }
+
+    std::vector<CTransactionRef> vtx;
+    std::set<uint256> setSeen;
+    for (CNode *pnode : nodes) {
+        if (pnode->fDisconnect) {
+            continue;
+        }
+        LOCK(pnode->cs_vProcessMsg);
+        for (CNetMessage &msg : pnode->vProcessMsg) {
+            if (vtx.size() >= MAX_TX_PRECHECK_BATCH) {
+                break;
+            }
+            if (msg.fPrechecked || msg.hdr.GetCommand() != NetMsgType::TX) {
+                continue;
+            }
+            msg.fPrechecked = true;
+            try {
+                CDataStream vRecv(msg.vRecv); // Leave the queued message untouched
+                CTransactionRef ptx;
+                vRecv >> ptx;
+                if (setSeen.insert(ptx->GetHash()).second && !mempool.exists(ptx->GetHash())) {
+                    vtx.push_back(std::move(ptx));
+                }
+            } catch (const std::exception &) {
+                // Malformed, ProcessMessages deals with the peer
+            }
+        }
+    }
+
+    if (!vtx.empty()) {
+        PreCheckTransactions(vtx, GetTime());
+    }
+}
+
 bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgProc)
 {
     const CChainParams& chainparams = Params();
@@ -3223,6 +3661,13 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         return fMoreWork;
     }
 
+    // Hand messages that don't need cs_main to the worker bound to this peer,
+    // so a slow one doesn't hold up block relay for every other peer.
+    if (m_msg_workers && pfrom->fSuccessfullyConnected && IsPeerWorkerCommand(strCommand)
+        && m_msg_workers->Push(pfrom, strCommand, vRecv)) {
+        return fMoreWork;
+    }
+
     // Process message
     bool fRet = false;
     try
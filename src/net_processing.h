@@ -16,6 +16,10 @@ static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 /** Default for BIP61 (sending reject messages) */
 static constexpr bool DEFAULT_ENABLE_BIP61 = true;
+/** Default for -peermsgthreads, threads handling peer messages that don't need cs_main */
+static const int DEFAULT_PEER_MSG_THREADS = 2;
+
+class CPeerMessageWorkers;
 
 class PeerLogicValidation final : public CValidationInterface, public NetEventsInterface {
 private:
@@ -23,6 +27,10 @@ private:
 
 public:
     explicit PeerLogicValidation(CConnman* connman, CScheduler &scheduler, bool enable_bip61);
+    ~PeerLogicValidation();
+
+    /** Finish the messages queued to the peer message workers and stop them, must run before the nodes are deleted */
+    void StopMessageWorkers();
 
     /**
      * Overridden from CValidationInterface.
@@ -46,6 +54,13 @@ public:
     /** Handle removal of a peer by updating various state and removing it from mapNodeState */
     void FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime) override;
     /**
+    * Verify the proofs of the transactions queued on all peers together, so the tx
+    * messages are admitted with only the chain state checks left under cs_main.
+    *
+    * @param[in]   nodes           The nodes about to be processed.
+    */
+    void PrepareMessages(const std::vector<CNode*>& nodes) override;
+    /**
     * Process protocol messages received from a given node
     *
     * @param[in]   pfrom           The node which we have received messages from.
@@ -72,6 +87,8 @@ private:
 
     /** Enable BIP61 (sending reject messages) */
     const bool m_enable_bip61;
+
+    std::unique_ptr<CPeerMessageWorkers> m_msg_workers;
 };
 
 struct CNodeStateStats {
@@ -0,0 +1,140 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <perfstats.h>
+
+#include <tinyformat.h>
+
+#include <ctype.h>
+
+CPerfStats g_perf_stats;
+
+CPerfHistogram::CPerfHistogram() : m_count(0), m_sum(0), m_max(0)
+{
+    for (auto &b : m_buckets) {
+        b = 0;
+    }
+}
+
+void CPerfHistogram::Record(int64_t nMicros)
+{
+    uint64_t n = nMicros > 0 ? nMicros : 0;
+    int b = 0;
+    for (uint64_t v = n; v > 0 && b < PERF_HISTOGRAM_BUCKETS - 1; v >>= 1) {
+        b++;
+    }
+    m_buckets[b].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(n, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t nMax = m_max.load(std::memory_order_relaxed);
+    while (n > nMax && !m_max.compare_exchange_weak(nMax, n, std::memory_order_relaxed)) {
+    }
+}
+
+CPerfHistogram::Snapshot CPerfHistogram::GetSnapshot() const
+{
+    // Fields are read one at a time, concurrent records may be partially included
+    Snapshot s;
+    s.nCount = m_count.load(std::memory_order_relaxed);
+    s.nSumMicros = m_sum.load(std::memory_order_relaxed);
+    s.nMaxMicros = m_max.load(std::memory_order_relaxed);
+    for (int b = 0; b < PERF_HISTOGRAM_BUCKETS; ++b) {
+        s.vBuckets[b] = m_buckets[b].load(std::memory_order_relaxed);
+    }
+    return s;
+}
+
+CPerfHistogram &CPerfStats::Histogram(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(m_cs);
+    std::unique_ptr<CPerfHistogram> &p = m_histograms[name];
+    if (!p) {
+        p.reset(new CPerfHistogram());
+    }
+    return *p;
+}
+
+std::atomic<uint64_t> &CPerfStats::Counter(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(m_cs);
+    std::unique_ptr<std::atomic<uint64_t> > &p = m_counters[name];
+    if (!p) {
+        p.reset(new std::atomic<uint64_t>(0));
+    }
+    return *p;
+}
+
+std::vector<std::pair<std::string, CPerfHistogram::Snapshot> > CPerfStats::GetHistograms()
+{
+    std::vector<std::pair<std::string, CPerfHistogram::Snapshot> > v;
+    std::lock_guard<std::mutex> lock(m_cs);
+    for (const auto &h : m_histograms) {
+        v.emplace_back(h.first, h.second->GetSnapshot());
+    }
+    return v;
+}
+
+std::vector<std::pair<std::string, uint64_t> > CPerfStats::GetCounters()
+{
+    std::vector<std::pair<std::string, uint64_t> > v;
+    std::lock_guard<std::mutex> lock(m_cs);
+    for (const auto &c : m_counters) {
+        v.emplace_back(c.first, c.second->load(std::memory_order_relaxed));
+    }
+    return v;
+}
+
+/** Split "<group>:<name>" into a metric name and label value */
+static void SplitPerfName(const std::string &name, std::string &metric, std::string &label)
+{
+    size_t p = name.find(':');
+    metric = "bitcoinc_" + name.substr(0, p);
+    label = p == std::string::npos ? "" : name.substr(p + 1);
+    for (auto &c : metric) {
+        if (!isalnum((unsigned char)c)) {
+            c = '_';
+        }
+    }
+    for (auto &c : label) {
+        if (c == '"' || c == '\\' || c == '\n') {
+            c = '_';
+        }
+    }
+}
+
+std::string PerfStatsToPrometheus()
+{
+    std::string s, sLast;
+    for (const auto &h : g_perf_stats.GetHistograms()) {
+        std::string metric, label;
+        SplitPerfName(h.first, metric, label);
+        metric += "_seconds";
+        if (metric != sLast) {
+            s += strprintf("# TYPE %s histogram\n", metric);
+            sLast = metric;
+        }
+        const CPerfHistogram::Snapshot &snap = h.second;
+        uint64_t nCumulative = 0;
+        for (int b = 0; b < PERF_HISTOGRAM_BUCKETS - 1; ++b) {
+            nCumulative += snap.vBuckets[b];
+            s += strprintf("%s_bucket{name=\"%s\",le=\"%.6f\"} %u\n", metric, label, CPerfHistogram::BucketBound(b) / 1e6, nCumulative);
+        }
+        nCumulative += snap.vBuckets[PERF_HISTOGRAM_BUCKETS - 1];
+        s += strprintf("%s_bucket{name=\"%s\",le=\"+Inf\"} %u\n", metric, label, nCumulative);
+        s += strprintf("%s_sum{name=\"%s\"} %.6f\n", metric, label, snap.nSumMicros / 1e6);
+        s += strprintf("%s_count{name=\"%s\"} %u\n", metric, label, snap.nCount);
+    }
+    for (const auto &c : g_perf_stats.GetCounters()) {
+        std::string metric, label;
+        SplitPerfName(c.first, metric, label);
+        metric += "_total";
+        if (metric != sLast) {
+            s += strprintf("# TYPE %s counter\n", metric);
+            sLast = metric;
+        }
+        s += strprintf("%s{name=\"%s\"} %u\n", metric, label, c.second);
+    }
+    return s;
+}
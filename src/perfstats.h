@@ -0,0 +1,93 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_PERFSTATS_H
+#define BITCOINC_PERFSTATS_H
+
+#include <utiltime.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+//! Bucket b counts durations in [2^(b-1), 2^b) microseconds, the last bucket is open
+static const int PERF_HISTOGRAM_BUCKETS = 32;
+
+/** Latency histogram, recording is lock-free */
+class CPerfHistogram
+{
+public:
+    struct Snapshot
+    {
+        uint64_t nCount = 0;
+        uint64_t nSumMicros = 0;
+        uint64_t nMaxMicros = 0;
+        uint64_t vBuckets[PERF_HISTOGRAM_BUCKETS] = {};
+    };
+
+    CPerfHistogram();
+
+    void Record(int64_t nMicros);
+    Snapshot GetSnapshot() const;
+
+    //! Upper bound of bucket b in microseconds
+    static uint64_t BucketBound(int b) { return (uint64_t)1 << b; };
+
+private:
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_max;
+    std::atomic<uint64_t> m_buckets[PERF_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * Named latency histograms and event counters.
+ *
+ * Names are "<group>:<name>", e.g. "rpc:getblock". Lookups take a lock, hot
+ * paths should keep the reference, see PERF_HISTOGRAM and PERF_COUNTER.
+ * Entries are never removed, references stay valid.
+ */
+class CPerfStats
+{
+public:
+    CPerfHistogram &Histogram(const std::string &name);
+    std::atomic<uint64_t> &Counter(const std::string &name);
+
+    std::vector<std::pair<std::string, CPerfHistogram::Snapshot> > GetHistograms();
+    std::vector<std::pair<std::string, uint64_t> > GetCounters();
+
+private:
+    std::mutex m_cs;
+    std::map<std::string, std::unique_ptr<CPerfHistogram> > m_histograms;
+    std::map<std::string, std::unique_ptr<std::atomic<uint64_t> > > m_counters;
+};
+
+extern CPerfStats g_perf_stats;
+
+//! Histogram of a constant name, looked up once per call site
+#define PERF_HISTOGRAM(name) ([]() -> CPerfHistogram& { static CPerfHistogram &h = g_perf_stats.Histogram(name); return h; }())
+//! Counter of a constant name, looked up once per call site
+#define PERF_COUNTER(name) ([]() -> std::atomic<uint64_t>& { static std::atomic<uint64_t> &c = g_perf_stats.Counter(name); return c; }())
+
+/** Records the time from construction to destruction */
+class CPerfTimer
+{
+public:
+    explicit CPerfTimer(CPerfHistogram &hist) : m_hist(hist), m_start(GetTimeMicros()) {};
+    ~CPerfTimer() { m_hist.Record(GetTimeMicros() - m_start); };
+
+private:
+    CPerfHistogram &m_hist;
+    int64_t m_start;
+};
+
+/** All histograms and counters in the Prometheus text format */
+std::string PerfStatsToPrometheus();
+
+#endif // BITCOINC_PERFSTATS_H
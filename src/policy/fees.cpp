@@ -61,6 +61,59 @@ bool FeeModeFromString(const std::string& mode_string, FeeEstimateMode& fee_esti
     return true;
 }
 
+bool FeeEstimateClassFromString(const std::string& class_string, FeeEstimateClass& fee_class) {
+    static const std::map<std::string, FeeEstimateClass> fee_classes = {
+        {"all", FeeEstimateClass::ALL},
+        {"plain", FeeEstimateClass::PLAIN},
+        {"blinded", FeeEstimateClass::BLINDED},
+        {"anon", FeeEstimateClass::ANON},
+        {"anon_large_ring", FeeEstimateClass::ANON_LARGE_RING},
+    };
+    auto it = fee_classes.find(class_string);
+
+    if (it == fee_classes.end()) return false;
+
+    fee_class = it->second;
+    return true;
+}
+
+std::string StringForFeeEstimateClass(FeeEstimateClass fee_class) {
+    switch (fee_class) {
+        case FeeEstimateClass::ALL: return "all";
+        case FeeEstimateClass::PLAIN: return "plain";
+        case FeeEstimateClass::BLINDED: return "blinded";
+        case FeeEstimateClass::ANON: return "anon";
+        case FeeEstimateClass::ANON_LARGE_RING: return "anon_large_ring";
+    }
+    return "unknown";
+}
+
+FeeEstimateClass GetFeeEstimateClass(const CTransaction& tx) {
+    bool fAnon = false, fBlinded = false;
+    uint32_t nMaxRingSize = 0;
+    for (const auto& txin : tx.vin) {
+        if (!txin.IsAnonInput()) {
+            continue;
+        }
+        fAnon = true;
+        uint32_t nInputs, nRingSize;
+        txin.GetAnonInfo(nInputs, nRingSize);
+        nMaxRingSize = std::max(nMaxRingSize, nRingSize);
+    }
+    for (const auto& txout : tx.vpout) {
+        if (txout->IsType(OUTPUT_RINGCT)) {
+            fAnon = true;
+        } else if (txout->IsType(OUTPUT_CT)) {
+            fBlinded = true;
+        }
+    }
+
+    if (fAnon) {
+        return nMaxRingSize > FEE_CLASS_LARGE_RING_SIZE ? FeeEstimateClass::ANON_LARGE_RING : FeeEstimateClass::ANON;
+    }
+    return fBlinded ? FeeEstimateClass::BLINDED : FeeEstimateClass::PLAIN;
+}
+
 bool StringFromFeeMode(FeeEstimateMode fee_estimate_mode, std::string& mode_string) {
     switch(fee_estimate_mode)
     {
@@ -535,6 +588,9 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
         feeStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
+        if (!classEstimators.empty()) {
+            classEstimators[(size_t)pos->second.feeClass]->removeTx(hash, inBlock);
+        }
         mapMemPoolTxs.erase(hash);
         return true;
     } else {
@@ -542,7 +598,7 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
     }
 }
 
-CBlockPolicyEstimator::CBlockPolicyEstimator()
+CBlockPolicyEstimator::CBlockPolicyEstimator(FeeEstimateClass feeClass)
     : nBestSeenHeight(0), firstRecordedHeight(0), historicalFirst(0), historicalBest(0), trackedTxs(0), untrackedTxs(0)
 {
     static_assert(MIN_BUCKET_FEERATE > 0, "Min feerate must be nonzero");
@@ -558,6 +614,13 @@ CBlockPolicyEstimator::CBlockPolicyEstimator()
     feeStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
     shortStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
     longStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
+
+    if (feeClass == FeeEstimateClass::ALL) {
+        classEstimators.resize(NUM_FEE_ESTIMATE_CLASSES);
+        for (size_t i = 1; i < NUM_FEE_ESTIMATE_CLASSES; i++) {
+            classEstimators[i].reset(new CBlockPolicyEstimator((FeeEstimateClass)i));
+        }
+    }
 }
 
 CBlockPolicyEstimator::~CBlockPolicyEstimator()
@@ -601,6 +664,12 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
     assert(bucketIndex == bucketIndex2);
     unsigned int bucketIndex3 = longStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
     assert(bucketIndex == bucketIndex3);
+
+    if (!classEstimators.empty()) {
+        FeeEstimateClass feeClass = GetFeeEstimateClass(entry.GetTx());
+        mapMemPoolTxs[hash].feeClass = feeClass;
+        classEstimators[(size_t)feeClass]->processTransaction(entry, validFeeEstimate);
+    }
 }
 
 bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry)
@@ -643,6 +712,21 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
         return;
     }
 
+    // Class estimators record their share of the block before removeTx
+    // below takes the same transactions out of them
+    if (!classEstimators.empty()) {
+        std::vector<std::vector<const CTxMemPoolEntry*>> classEntries(NUM_FEE_ESTIMATE_CLASSES);
+        for (const auto& entry : entries) {
+            auto pos = mapMemPoolTxs.find(entry->GetTx().GetHash());
+            if (pos != mapMemPoolTxs.end()) {
+                classEntries[(size_t)pos->second.feeClass].push_back(entry);
+            }
+        }
+        for (size_t i = 1; i < NUM_FEE_ESTIMATE_CLASSES; i++) {
+            classEstimators[i]->processBlock(nBlockHeight, classEntries[i]);
+        }
+    }
+
     // Must update nBestSeenHeight in sync with ClearCurrent so that
     // calls to removeTx (via processBlockTx) correctly calculate age
     // of unconfirmed txs to remove from tracking.
@@ -835,8 +919,12 @@ double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget,
  * estimates, however, required the 95% threshold at 2 * target be met for any
  * longer time horizons also.
  */
-CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
+CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative, FeeEstimateClass feeClass) const
 {
+    if (feeClass != FeeEstimateClass::ALL && !classEstimators.empty()) {
+        return classEstimators[(size_t)feeClass]->estimateSmartFee(confTarget, feeCalc, conservative);
+    }
+
     LOCK(cs_feeEstimator);
 
     if (feeCalc) {
@@ -931,6 +1019,14 @@ bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
         feeStats->Write(fileout);
         shortStats->Write(fileout);
         longStats->Write(fileout);
+
+        // Per class estimates follow, older versions stop reading before them
+        fileout << (uint32_t)classEstimators.size();
+        for (size_t i = 1; i < classEstimators.size(); i++) {
+            if (!classEstimators[i]->Write(fileout)) {
+                return false;
+            }
+        }
     }
     catch (const std::exception&) {
         LogPrintf("CBlockPolicyEstimator::Write(): unable to write policy estimator data (non-fatal)\n");
@@ -990,6 +1086,21 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
             historicalBest = nFileHistoricalBest;
+
+            // Files written before classes were tracked end here
+            uint32_t nFileClasses = 0;
+            try {
+                filein >> nFileClasses;
+            } catch (const std::exception&) {
+                nFileClasses = 0;
+            }
+            if (nFileClasses == classEstimators.size()) {
+                for (size_t i = 1; i < classEstimators.size(); i++) {
+                    if (!classEstimators[i]->Read(filein)) {
+                        break;
+                    }
+                }
+            }
         }
     }
     catch (const std::exception& e) {
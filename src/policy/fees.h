@@ -18,6 +18,7 @@
 
 class CAutoFile;
 class CFeeRate;
+class CTransaction;
 class CTxMemPoolEntry;
 class CTxMemPool;
 class TxConfirmStats;
@@ -103,6 +104,24 @@ enum class FeeEstimateMode {
 bool FeeModeFromString(const std::string& mode_string, FeeEstimateMode& fee_estimate_mode);
 bool StringFromFeeMode(FeeEstimateMode fee_estimate_mode, std::string& mode_string);
 
+/* Population of transactions a fee estimate is based on, confidential
+ * transactions differ in size and confirm differently from plain ones */
+enum class FeeEstimateClass {
+    ALL = 0,         //! Every transaction
+    PLAIN,           //! No blinded or anon outputs, no anon inputs
+    BLINDED,         //! Blinded outputs, nothing anon
+    ANON,            //! Anon outputs or inputs with rings up to FEE_CLASS_LARGE_RING_SIZE
+    ANON_LARGE_RING, //! Anon inputs with larger rings
+};
+static const size_t NUM_FEE_ESTIMATE_CLASSES = 5;
+
+/* Rings above this size put a transaction in FeeEstimateClass::ANON_LARGE_RING */
+static const uint32_t FEE_CLASS_LARGE_RING_SIZE = 8;
+
+bool FeeEstimateClassFromString(const std::string& class_string, FeeEstimateClass& fee_class);
+std::string StringForFeeEstimateClass(FeeEstimateClass fee_class);
+FeeEstimateClass GetFeeEstimateClass(const CTransaction& tx);
+
 /* Used to return detailed information about a feerate bucket */
 struct EstimatorBucket
 {
@@ -188,8 +207,9 @@ private:
     static constexpr double FEE_SPACING = 1.05;
 
 public:
-    /** Create new BlockPolicyEstimator and initialize stats tracking classes with default values */
-    CBlockPolicyEstimator();
+    /** Create new BlockPolicyEstimator and initialize stats tracking classes with default values,
+     *  an estimator for all transactions also tracks each FeeEstimateClass separately */
+    explicit CBlockPolicyEstimator(FeeEstimateClass feeClass = FeeEstimateClass::ALL);
     ~CBlockPolicyEstimator();
 
     /** Process all the transactions that have been included in a block */
@@ -210,7 +230,8 @@ public:
      *  the closest target where one can be given.  'conservative' estimates are
      *  valid over longer time horizons also.
      */
-    CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
+    CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative,
+                              FeeEstimateClass feeClass = FeeEstimateClass::ALL) const;
 
     /** Return a specific fee estimate calculation with a given success
      * threshold and time horizon, and optionally return detailed data about
@@ -240,7 +261,8 @@ private:
     {
         unsigned int blockHeight;
         unsigned int bucketIndex;
-        TxStatsInfo() : blockHeight(0), bucketIndex(0) {}
+        FeeEstimateClass feeClass;
+        TxStatsInfo() : blockHeight(0), bucketIndex(0), feeClass(FeeEstimateClass::ALL) {}
     };
 
     // map of txids to information about that transaction
@@ -254,6 +276,9 @@ private:
     unsigned int trackedTxs;
     unsigned int untrackedTxs;
 
+    /** Estimators for each FeeEstimateClass, indexed by class, empty in a class estimator */
+    std::vector<std::unique_ptr<CBlockPolicyEstimator>> classEstimators;
+
     std::vector<double> buckets;              // The upper-bound of the range for the bucket (inclusive)
     std::map<double, unsigned int> bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
 
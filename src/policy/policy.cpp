@@ -356,7 +356,7 @@ bool IsWitnessStandard(const CTransaction& tx, const CCoinsViewCache& mapInputs)
                     return false;
             } else
             {
-                stack = tx.vin[i].scriptWitness.stack;
+                stack.assign(tx.vin[i].scriptWitness.stack.begin(), tx.vin[i].scriptWitness.stack.end());
             };
 
             if (stack.empty())
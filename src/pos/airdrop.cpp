@@ -0,0 +1,429 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pos/airdrop.h>
+
+#include <chainparams.h>
+#include <clientversion.h>
+#include <hash.h>
+#include <key_io.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <streams.h>
+#include <util.h>
+#include <utilstrencodings.h>
+
+#include <algorithm>
+#include <ctype.h>
+#include <errno.h>
+#include <string.h>
+#include <thread>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//! Bumped when the cache layout or the parsing changes
+static const uint32_t AIRDROP_CACHE_VERSION = 1;
+
+//! Line buffer size of the original fgets reader, longer lines were read in pieces
+static const size_t AIRDROP_LINE_BUFFER = 512;
+
+namespace {
+
+/** airdrop.txt mapped read-only, or read into memory where mapping is not available */
+class CAirdropText
+{
+public:
+    ~CAirdropText()
+    {
+#ifndef WIN32
+        if (pMapped) {
+            munmap(pMapped, nSize);
+        }
+#endif
+    };
+
+    bool Open(const fs::path &path)
+    {
+#ifndef WIN32
+        int fd = open(path.string().c_str(), O_RDONLY);
+        if (fd >= 0) {
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                    pMapped = p;
+                    nSize = (size_t)st.st_size;
+                }
+            }
+            close(fd);
+            if (pMapped) {
+                return true;
+            }
+        }
+#endif
+        FILE *fp = fsbridge::fopen(path, "rb");
+        if (!fp) {
+            return false;
+        }
+        char buf[1 << 16];
+        size_t nRead;
+        while ((nRead = fread(buf, 1, sizeof(buf), fp)) > 0) {
+            vData.insert(vData.end(), buf, buf + nRead);
+        }
+        bool fError = ferror(fp);
+        fclose(fp);
+        nSize = vData.size();
+        return !fError;
+    };
+
+    const uint8_t *data() const { return pMapped ? (const uint8_t*)pMapped : vData.data(); };
+    size_t size() const { return nSize; };
+
+private:
+    void *pMapped = nullptr;
+    size_t nSize = 0;
+    std::vector<uint8_t> vData;
+};
+
+/** Result of parsing a run of whole lines */
+struct CAirdropChunk
+{
+    uint64_t nLines = 0; //!< Lines with an address and amount field
+    std::vector<CAirdropOutput> vOutputs;
+};
+
+/** Next strtok(",") token in [p, pEnd), empty if there is none */
+static const char *NextToken(const char *&p, const char *pEnd, size_t &nLen)
+{
+    while (p < pEnd && *p == ',') {
+        p++;
+    }
+    const char *pToken = p;
+    while (p < pEnd && *p != ',') {
+        p++;
+    }
+    nLen = p - pToken;
+    return pToken;
+};
+
+/** Parse one fgets read, the piece may end in a newline */
+static void ParsePiece(const char *p, size_t n, CAirdropChunk &chunk)
+{
+    // strlen stopped at an embedded nul, trailing whitespace was cut
+    const char *pNul = (const char*)memchr(p, '\0', n);
+    size_t nLen = pNul ? pNul - p : n;
+    while (nLen > 0 && isspace((unsigned char)p[nLen-1])) {
+        nLen--;
+    }
+
+    const char *pEnd = p + nLen;
+    size_t nAddress, nAmount;
+    const char *pAddress = NextToken(p, pEnd, nAddress);
+    if (nAddress == 0) {
+        return;
+    }
+    const char *pAmount = NextToken(p, pEnd, nAmount);
+    if (nAmount == 0) {
+        return;
+    }
+
+    uint64_t nLine = chunk.nLines++;
+
+    uint64_t amount;
+    if (!ParseUInt64(std::string(pAmount, nAmount), &amount) || !MoneyRange(amount)) {
+        LogPrint(BCLog::POS, "Warning: %s - Skipping invalid amount: %s\n", __func__, std::string(pAmount, nAmount));
+        return;
+    }
+
+    CSmartCashAddress addr(std::string(pAddress, nAddress));
+    if (!addr.IsValid()) {
+        LogPrint(BCLog::POS, "Warning: %s - Skipping invalid address: %s\n", __func__, std::string(pAddress, nAddress));
+        return;
+    }
+
+    CAirdropOutput out;
+    out.nLine = nLine;
+    out.nValue = amount;
+    CTxDestination dest = addr.Get();
+    if (dest.type() == typeid(CKeyID)) {
+        out.nType = CAirdropOutput::P2PKH;
+        out.hash = boost::get<CKeyID>(dest);
+    } else
+    if (dest.type() == typeid(CScriptID)) {
+        out.nType = CAirdropOutput::P2SH;
+        out.hash = boost::get<CScriptID>(dest);
+    } else {
+        LogPrint(BCLog::POS, "Warning: %s - Skipping invalid address type: %s\n", __func__, std::string(pAddress, nAddress));
+        return;
+    }
+    chunk.vOutputs.push_back(out);
+};
+
+/** Parse the lines in [p, pEnd), p must be at the start of a line */
+static void ParseLines(const char *p, const char *pEnd, CAirdropChunk &chunk)
+{
+    while (p < pEnd) {
+        size_t nMax = std::min((size_t)(pEnd - p), AIRDROP_LINE_BUFFER - 1);
+        const char *pNewline = (const char*)memchr(p, '\n', nMax);
+        size_t n = pNewline ? pNewline - p + 1 : nMax;
+        ParsePiece(p, n, chunk);
+        p += n;
+    }
+};
+
+static CTransactionRef MakeImportTxn(std::vector<CAirdropOutput>::const_iterator itBegin, std::vector<CAirdropOutput>::const_iterator itEnd)
+{
+    CMutableTransaction txn;
+    txn.nVersion = BITCOINC_TXN_VERSION;
+    txn.SetType(TXN_COINBASE);
+    txn.nLockTime = 0;
+    txn.vin.push_back(CTxIn()); // null prevout
+
+    // scriptsig len must be > 2
+    const char *s = "smartcash_airdrop";
+    txn.vin[0].scriptSig = CScript() << std::vector<unsigned char>((const unsigned char*)s, (const unsigned char*)s + strlen(s));
+
+    txn.vpout.reserve(itEnd - itBegin);
+    for (auto it = itBegin; it != itEnd; ++it) {
+        OUTPUT_PTR<CTxOutStandard> txout = MAKE_OUTPUT<CTxOutStandard>();
+        txout->nValue = it->nValue;
+        if (it->nType == CAirdropOutput::P2PKH) {
+            txout->scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(it->hash) << OP_EQUALVERIFY << OP_CHECKSIG;
+        } else {
+            txout->scriptPubKey = CScript() << OP_HASH160 << ToByteVector(it->hash) << OP_EQUAL;
+        }
+        txn.vpout.push_back(txout);
+    }
+
+    // The txid is computed here, on the building thread
+    return MakeTransactionRef(std::move(txn));
+};
+
+} // namespace
+
+bool CAirdropImport::ParseText(const uint8_t *pBegin, size_t nSize)
+{
+    const char *pText = (const char*)pBegin;
+
+    size_t nThreads = std::min(std::min(MAX_AIRDROP_PARSE_THREADS, (size_t)std::max(1, GetNumCores())), nSize / MIN_AIRDROP_BYTES_PER_THREAD);
+    nThreads = std::max(nThreads, (size_t)1);
+
+    // Chunks begin at the start of a line, the first newline at or after the byte before the even split
+    std::vector<const char*> vBounds(nThreads + 1, pText + nSize);
+    vBounds[0] = pText;
+    for (size_t i = 1; i < nThreads; ++i) {
+        const char *p = std::max(vBounds[i-1], pText + nSize * i / nThreads);
+        const char *pNewline = (const char*)memchr(p - 1, '\n', pText + nSize - (p - 1));
+        vBounds[i] = pNewline ? pNewline + 1 : pText + nSize;
+    }
+
+    std::vector<CAirdropChunk> vChunks(nThreads);
+    if (nThreads < 2) {
+        ParseLines(vBounds[0], vBounds[1], vChunks[0]);
+    } else {
+        std::vector<std::thread> vThreads;
+        for (size_t i = 0; i < nThreads; ++i) {
+            vThreads.emplace_back([&vBounds, &vChunks, i]() { ParseLines(vBounds[i], vBounds[i+1], vChunks[i]); });
+        }
+        for (auto &t : vThreads) {
+            t.join();
+        }
+    }
+
+    size_t nOutputs = 0;
+    for (const auto &chunk : vChunks) {
+        nOutputs += chunk.vOutputs.size();
+    }
+    vOutputs.clear();
+    vOutputs.reserve(nOutputs);
+    uint64_t nLineOffset = 0;
+    for (const auto &chunk : vChunks) {
+        for (const auto &out : chunk.vOutputs) {
+            vOutputs.push_back(out);
+            vOutputs.back().nLine += nLineOffset;
+        }
+        nLineOffset += chunk.nLines;
+    }
+
+    LogPrintf("%s: Parsed %d outputs from %d lines with %d threads.\n", __func__, vOutputs.size(), nLineOffset, nThreads);
+    return true;
+};
+
+bool CAirdropImport::ReadCache(const fs::path &pathCache)
+{
+    FILE *file = fsbridge::fopen(pathCache, "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        return false;
+    }
+
+    try {
+        CHashVerifier<CAutoFile> verifier(&filein);
+        uint32_t nVersion;
+        verifier >> nVersion;
+        if (nVersion != AIRDROP_CACHE_VERSION) {
+            return false;
+        }
+        verifier >> nTextSize >> nTextTime >> vOutputs;
+
+        uint256 hashTmp;
+        filein >> hashTmp;
+        if (hashTmp != verifier.GetHash()) {
+            vOutputs.clear();
+            return error("%s: Checksum mismatch, data corrupted", __func__);
+        }
+    } catch (const std::exception &e) {
+        vOutputs.clear();
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+
+    return true;
+};
+
+bool CAirdropImport::WriteCache(const fs::path &pathCache) const
+{
+    unsigned short randv = 0;
+    GetRandBytes((unsigned char*)&randv, sizeof(randv));
+    fs::path pathTmp = pathCache;
+    pathTmp += strprintf(".%04x", randv);
+
+    FILE *file = fsbridge::fopen(pathTmp, "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        return error("%s: Failed to open file %s", __func__, pathTmp.string());
+    }
+
+    try {
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        fileout << AIRDROP_CACHE_VERSION << nTextSize << nTextTime << vOutputs;
+        hasher << AIRDROP_CACHE_VERSION << nTextSize << nTextTime << vOutputs;
+        fileout << hasher.GetHash();
+    } catch (const std::exception &e) {
+        return error("%s: Serialize or I/O error - %s", __func__, e.what());
+    }
+    if (!FileCommit(fileout.Get())) {
+        return error("%s: Failed to flush file %s", __func__, pathTmp.string());
+    }
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, pathCache)) {
+        return error("%s: Rename-into-place failed", __func__);
+    }
+    return true;
+};
+
+bool CAirdropImport::IsCurrent(const fs::path &pathText) const
+{
+    if (!fLoaded) {
+        return false;
+    }
+    try {
+        if (!fs::exists(pathText)) {
+            return true; // Loaded from the cache alone
+        }
+        return nTextSize == (uint64_t)fs::file_size(pathText)
+            && nTextTime == (int64_t)fs::last_write_time(pathText);
+    } catch (const fs::filesystem_error&) {
+        return false;
+    }
+};
+
+bool CAirdropImport::Load(const fs::path &pathText, const fs::path &pathCache)
+{
+    int64_t nTimeStart = GetTimeMillis();
+    fLoaded = false;
+    vOutputs.clear();
+
+    bool fHaveText;
+    uint64_t nSize = 0;
+    int64_t nTime = 0;
+    try {
+        fHaveText = fs::exists(pathText);
+        if (fHaveText) {
+            nSize = fs::file_size(pathText);
+            nTime = fs::last_write_time(pathText);
+        }
+    } catch (const fs::filesystem_error &e) {
+        return error("%s: %s", __func__, e.what());
+    }
+
+    if (ReadCache(pathCache)
+        && (!fHaveText || (nTextSize == nSize && nTextTime == nTime))) {
+        LogPrintf("%s: Loaded %d outputs from %s in %dms.\n", __func__, vOutputs.size(), pathCache.filename().string(), GetTimeMillis() - nTimeStart);
+        fLoaded = true;
+        return true;
+    }
+
+    if (!fHaveText) {
+        return error("%s: File not found '%s'.", __func__, pathText.filename().string());
+    }
+
+    CAirdropText text;
+    if (!text.Open(pathText)) {
+        return error("%s - Can't open file, strerror: %s.", __func__, strerror(errno));
+    }
+    nTextSize = nSize;
+    nTextTime = nTime;
+    if (!ParseText(text.data(), text.size())) {
+        return false;
+    }
+    fLoaded = true;
+
+    if (!WriteCache(pathCache)) {
+        LogPrintf("%s: Writing %s failed, airdrop.txt will be parsed again on restart.\n", __func__, pathCache.filename().string());
+    }
+    LogPrintf("%s: Loaded %d outputs from %s in %dms.\n", __func__, vOutputs.size(), pathText.filename().string(), GetTimeMillis() - nTimeStart);
+    return true;
+};
+
+bool CAirdropImport::FillBlock(CBlock &block, int nHeight) const
+{
+    size_t nSlots = block.vtx.size() < AIRDROP_MAX_TXNS_PER_BLOCK ? AIRDROP_MAX_TXNS_PER_BLOCK - block.vtx.size() : 0;
+    if (nSlots == 0 || nHeight < 1) {
+        return false;
+    }
+
+    // Block nHeight starts after the first AIRDROP_OUTPUTS_PER_TXN * (nHeight-1) lines
+    uint64_t nSkip = AIRDROP_OUTPUTS_PER_TXN * (uint64_t)(nHeight - 1);
+    auto itFirst = std::lower_bound(vOutputs.begin(), vOutputs.end(), nSkip,
+        [](const CAirdropOutput &out, uint64_t nLine) { return out.nLine < nLine; });
+    size_t nAvailable = vOutputs.end() - itFirst;
+    size_t nTxns = std::min(nSlots, (nAvailable + AIRDROP_OUTPUTS_PER_TXN - 1) / AIRDROP_OUTPUTS_PER_TXN);
+
+    std::vector<CTransactionRef> vtxImport(nTxns);
+    auto buildTxns = [&](size_t nBegin, size_t nEnd) {
+        for (size_t k = nBegin; k < nEnd; ++k) {
+            auto itBegin = itFirst + k * AIRDROP_OUTPUTS_PER_TXN;
+            auto itEnd = itFirst + std::min(nAvailable, (k + 1) * AIRDROP_OUTPUTS_PER_TXN);
+            vtxImport[k] = MakeImportTxn(itBegin, itEnd);
+        }
+    };
+
+    size_t nThreads = std::min(std::min(MAX_AIRDROP_BUILD_THREADS, (size_t)std::max(1, GetNumCores())), nTxns / MIN_AIRDROP_TXNS_PER_THREAD);
+    if (nThreads < 2) {
+        buildTxns(0, nTxns);
+    } else {
+        std::vector<std::thread> vThreads;
+        for (size_t i = 0; i < nThreads; ++i) {
+            vThreads.emplace_back(buildTxns, nTxns * i / nThreads, nTxns * (i + 1) / nThreads);
+        }
+        for (auto &t : vThreads) {
+            t.join();
+        }
+    }
+
+    for (const auto &tx : vtxImport) {
+        LogPrint(BCLog::POS, "%s - Add tx: %s\n", __func__, tx->GetHash().ToString());
+    }
+
+    // Each txn was inserted directly after the coinbase, the last one ends up first
+    block.vtx.insert(block.vtx.begin() + 1, vtxImport.rbegin(), vtxImport.rend());
+
+    return nTxns == nSlots;
+};
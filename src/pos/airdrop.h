@@ -0,0 +1,88 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_POS_AIRDROP_H
+#define BITCOINC_POS_AIRDROP_H
+
+#include <amount.h>
+#include <fs.h>
+#include <serialize.h>
+#include <uint256.h>
+
+#include <stdint.h>
+#include <vector>
+
+class CBlock;
+
+//! Outputs per import txn and txns per import block, the txids are fixed by vImportedCoinbaseTxns
+static const size_t AIRDROP_OUTPUTS_PER_TXN = 1000;
+static const size_t AIRDROP_MAX_TXNS_PER_BLOCK = 60;
+
+//! Threads parsing airdrop.txt, and the minimum file size each thread gets
+static const size_t MAX_AIRDROP_PARSE_THREADS = 8;
+static const size_t MIN_AIRDROP_BYTES_PER_THREAD = 1 << 20;
+
+//! Threads building the txns of an import block, and the minimum txns each thread gets
+static const size_t MAX_AIRDROP_BUILD_THREADS = 8;
+static const size_t MIN_AIRDROP_TXNS_PER_THREAD = 4;
+
+/** A valid output line of airdrop.txt */
+struct CAirdropOutput
+{
+    enum Type : uint8_t { P2PKH = 0, P2SH = 1 };
+
+    uint64_t nLine;     //!< Index among the lines with an address and amount field, valid or not
+    CAmount nValue;
+    uint8_t nType;
+    uint160 hash;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(VARINT(nLine));
+        READWRITE(VARINT(nValue, VarIntMode::NONNEGATIVE_SIGNED));
+        READWRITE(nType);
+        READWRITE(hash);
+    };
+};
+
+/**
+ * The outputs of airdrop.txt, parsed once and shared by the import block templates.
+ *
+ * The text file is memory mapped and parsed in parallel chunks, the result is kept in a
+ * binary cache next to it that is used while the text file is unchanged (or missing).
+ * Parsing follows the original fgets/strtok reader exactly, the import txids are consensus.
+ */
+class CAirdropImport
+{
+public:
+    /** Load the outputs from pathCache if it matches pathText, else parse pathText and rewrite pathCache */
+    bool Load(const fs::path &pathText, const fs::path &pathCache);
+
+    /** True if the outputs were loaded from pathText in its current state */
+    bool IsCurrent(const fs::path &pathText) const;
+
+    /**
+     * Insert the import txns of nHeight after the coinbase of block, up to
+     * AIRDROP_MAX_TXNS_PER_BLOCK txns in the block.
+     * Returns true if the block was filled with nonempty import txns.
+     */
+    bool FillBlock(CBlock &block, int nHeight) const;
+
+    size_t size() const { return vOutputs.size(); };
+
+private:
+    bool ParseText(const uint8_t *pBegin, size_t nSize);
+    bool ReadCache(const fs::path &pathCache);
+    bool WriteCache(const fs::path &pathCache) const;
+
+    bool fLoaded = false;
+    uint64_t nTextSize = 0;
+    int64_t nTextTime = 0;
+    std::vector<CAirdropOutput> vOutputs; //!< Ordered by nLine
+};
+
+#endif // BITCOINC_POS_AIRDROP_H
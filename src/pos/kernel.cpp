@@ -7,17 +7,21 @@
 
 #include <pos/kernel.h>
 
+#include <pos/stakeindex.h>
+
 #include <txdb.h>
 #include <chainparams.h>
 #include <serialize.h>
 #include <streams.h>
 #include <hash.h>
+#include <crypto/common.h>
 #include <script/interpreter.h>
 #include <script/script.h>
 #include <script/ismine.h> // valtype
 #include <policy/policy.h>
 #include <consensus/validation.h>
 #include <coins.h>
+#include <index/txindex.h>
 
 /**
  * Stake Modifier (hash modifier of proof-of-stake):
@@ -89,10 +93,13 @@ bool CheckStakeKernelHash(const CBlockIndex *pindexPrev,
     int nStakeModifierHeight = pindexPrev->nHeight;
     int64_t nStakeModifierTime = pindexPrev->nTime;
 
-    CDataStream ss(SER_GETHASH, 0);
-    ss << bnStakeModifier;
-    ss << nBlockFromTime << prevout.hash << prevout.n << nTime;
-    hashProofOfStake = Hash(ss.begin(), ss.end());
+    uint8_t vchKernel[STAKE_KERNEL_SIZE];
+    memcpy(vchKernel, bnStakeModifier.begin(), 32);
+    WriteLE32(vchKernel + 32, nBlockFromTime);
+    memcpy(vchKernel + 36, prevout.hash.begin(), 32);
+    WriteLE32(vchKernel + 68, prevout.n);
+    WriteLE32(vchKernel + 72, nTime);
+    CHash256().Write(vchKernel, STAKE_KERNEL_SIZE).Finalize(hashProofOfStake.begin());
 
     if (fPrintProofOfStake)
     {
@@ -123,6 +130,39 @@ bool CheckStakeKernelHash(const CBlockIndex *pindexPrev,
     return true;
 }
 
+CStakeKernelRound::CStakeKernelRound(const CBlockIndex *pindexPrevIn, uint32_t nBits, uint32_t nTimeIn)
+    : pindexPrev(pindexPrevIn), nTime(nTimeIn)
+{
+    bool fNegative;
+    bool fOverflow;
+    bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
+    fValid = pindexPrev && !fNegative && !fOverflow && bnTarget != 0;
+
+    memset(vchKernel, 0, STAKE_KERNEL_SIZE);
+    if (pindexPrev)
+        memcpy(vchKernel, pindexPrev->bnStakeModifier.begin(), 32);
+    WriteLE32(vchKernel + 72, nTime);
+}
+
+bool CStakeKernelRound::Check(uint32_t nBlockFromTime, CAmount prevOutAmount, const COutPoint &prevout,
+    uint256 &hashProofOfStake, uint256 &targetProofOfStake) const
+{
+    if (!fValid || nTime < nBlockFromTime)
+        return false;
+
+    arith_uint256 bnWeightedTarget = bnTarget * arith_uint256(prevOutAmount);
+    targetProofOfStake = ArithToUint256(bnWeightedTarget);
+
+    uint8_t vchCandidate[STAKE_KERNEL_SIZE];
+    memcpy(vchCandidate, vchKernel, STAKE_KERNEL_SIZE);
+    WriteLE32(vchCandidate + 32, nBlockFromTime);
+    memcpy(vchCandidate + 36, prevout.hash.begin(), 32);
+    WriteLE32(vchCandidate + 68, prevout.n);
+    CHash256().Write(vchCandidate, STAKE_KERNEL_SIZE).Finalize(hashProofOfStake.begin());
+
+    return UintToArith256(hashProofOfStake) <= bnWeightedTarget;
+}
+
 bool IsConfirmedInNPrevBlocks(const uint256 &hashBlock, const CBlockIndex *pindexFrom, int nMaxDepth, int &nActualDepth)
 {
     for (const CBlockIndex *pindex = pindexFrom; pindex && pindexFrom->nHeight - pindex->nHeight < nMaxDepth; pindex = pindex->pprev)
@@ -148,6 +188,34 @@ static bool CheckAge(const CBlockIndex *pindexTip, const uint256 &hashKernelBloc
     return true;
 }
 
+/** Look up a spent output in the stake input index, valid only while its block is in the active chain */
+static bool GetSpentStakeInput(const COutPoint &prevout, CStakeInput &input) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (!g_stake_input_index.Get(prevout, input)) {
+        return false;
+    }
+    const CBlockIndex *pindex = chainActive[input.nHeight];
+    return pindex && pindex->GetBlockHash() == input.hashBlock;
+}
+
+/** Read a spent prevout, only the output's bytes when the txindex holds the layout of its txn */
+static bool GetSpentPrevout(const COutPoint &prevout, CBlockHeader &header, CTxOutBaseRef &out)
+{
+    if (g_txindex && g_txindex->FindTxOutput(prevout.hash, prevout.n, header, out)) {
+        return true;
+    }
+
+    CTransactionRef txPrev;
+    CBlock block; // GetTransaction should only fill the header.
+    if (!GetTransaction(prevout.hash, txPrev, Params().GetConsensus(), block, true)
+        || prevout.n >= txPrev->vpout.size()) {
+        return false;
+    }
+    header = block.GetBlockHeader();
+    out = txPrev->vpout[prevout.n];
+    return true;
+}
+
 // Check kernel hash target and coinstake signature
 bool CheckProofOfStake(CValidationState &state, const CBlockIndex *pindexPrev, const CTransaction &tx, int64_t nTime, unsigned int nBits, uint256 &hashProofOfStake, uint256 &targetProofOfStake)
 {
@@ -160,7 +228,6 @@ bool CheckProofOfStake(CValidationState &state, const CBlockIndex *pindexPrev, c
     }
 
     uint256 hashBlock;
-    CTransactionRef txPrev;
 
     // Kernel (input 0) must match the stake hash target per coin age (nBits)
     const CTxIn &txin = tx.vin[0];
@@ -171,16 +238,31 @@ bool CheckProofOfStake(CValidationState &state, const CBlockIndex *pindexPrev, c
     CAmount amount;
 
     Coin coin;
-    if (!pcoinsTip->GetCoin(txin.prevout, coin) || coin.IsSpent()) {
+    CStakeInput spent;
+    bool fKernelSpent = !pcoinsTip->GetCoin(txin.prevout, coin) || coin.IsSpent();
+    if (fKernelSpent && GetSpentStakeInput(txin.prevout, spent)) {
+        // Spent recently in the active chain, no need to read the prevout tx
+        int nRequiredDepth = std::min((int)(Params().GetStakeMinConfirmations()-1), (int)(pindexPrev->nHeight / 2));
+        const CBlockIndex *pindexKernel = pindexPrev->GetAncestor(spent.nHeight);
+        if (pindexKernel && pindexKernel->GetBlockHash() == spent.hashBlock
+            && pindexPrev->nHeight - spent.nHeight < nRequiredDepth) {
+            nDepth = pindexPrev->nHeight - spent.nHeight + 1;
+            return state.DoS(100, error("%s: Tried to stake at depth %d", __func__, nDepth), REJECT_INVALID, "invalid-stake-depth");
+        }
+
+        kernelPubKey = spent.scriptPubKey;
+        amount = spent.nValue;
+        nBlockFromTime = chainActive[spent.nHeight]->GetBlockTime();
+        state.nFlags |= BLOCK_STAKE_KERNEL_SPENT;
+    } else if (fKernelSpent) {
         // Find the prevout in the txdb / blocks
 
-        CBlock blockKernel; // block containing stake kernel, GetTransaction should only fill the header.
-        if (!GetTransaction(txin.prevout.hash, txPrev, Params().GetConsensus(), blockKernel, true)
-            || txin.prevout.n >= txPrev->vpout.size()) {
+        CBlockHeader blockKernel; // block containing stake kernel
+        CTxOutBaseRef outPrev;
+        if (!GetSpentPrevout(txin.prevout, blockKernel, outPrev)) {
             return state.DoS(20, error("%s: prevout-not-in-chain", __func__), REJECT_INVALID, "prevout-not-in-chain");
         }
 
-        const CTxOutBase *outPrev = txPrev->vpout[txin.prevout.n].get();
         if (!outPrev->IsStandardOutput()) {
             return state.DoS(100, error("%s: invalid-prevout", __func__), REJECT_INVALID, "invalid-prevout");
         }
@@ -249,12 +331,21 @@ bool CheckProofOfStake(CValidationState &state, const CBlockIndex *pindexPrev, c
             const CTxIn &txin = tx.vin[k];
             Coin coin;
             if (!pcoinsTip->GetCoin(txin.prevout, coin) || coin.IsSpent()) {
-                if (!GetTransaction(txin.prevout.hash, txPrev, Params().GetConsensus(), hashBlock, true)
-                    || txin.prevout.n >= txPrev->vpout.size()) {
+                if (GetSpentStakeInput(txin.prevout, spent)) {
+                    if (kernelPubKey != spent.scriptPubKey) {
+                        return state.DoS(100, error("%s: mixed-prevout-scripts %d", __func__, k), REJECT_INVALID, "mixed-prevout-scripts");
+                    }
+                    amount += spent.nValue;
+
+                    LogPrint(BCLog::POS, "%s: Input %d of coinstake %s is spent.\n", __func__, k, tx.GetHash().ToString());
+                    continue;
+                }
+                CBlockHeader header;
+                CTxOutBaseRef outPrev;
+                if (!GetSpentPrevout(txin.prevout, header, outPrev)) {
                     return state.DoS(1, error("%s: prevout-not-in-chain %d", __func__, k), REJECT_INVALID, "prevout-not-in-chain");
                 }
 
-                const CTxOutBase *outPrev = txPrev->vpout[txin.prevout.n].get();
                 if (!outPrev->IsStandardOutput()) {
                     return state.DoS(100, error("%s: invalid-prevout %d", __func__, k), REJECT_INVALID, "invalid-prevout");
                 }
@@ -309,7 +400,13 @@ bool CheckCoinStakeTimestamp(int nHeight, int64_t nTimeBlock)
 
 bool CheckKernel(const CBlockIndex *pindexPrev, unsigned int nBits, int64_t nTime, const COutPoint &prevout, int64_t *pBlockTime)
 {
-    uint256 hashProofOfStake, targetProofOfStake;
+    return CheckKernel(CStakeKernelRound(pindexPrev, nBits, nTime), prevout, pBlockTime);
+}
+
+bool CheckKernel(const CStakeKernelRound &round, const COutPoint &prevout, int64_t *pBlockTime)
+{
+    if (!round.IsValid())
+        return false;
 
     Coin coin;
     if (!pcoinsTip->GetCoin(prevout, coin))
@@ -319,21 +416,75 @@ bool CheckKernel(const CBlockIndex *pindexPrev, unsigned int nBits, int64_t nTim
     if (coin.IsSpent())
         return error("%s: prevout is spent", __func__);
 
-    CBlockIndex *pindex = chainActive[coin.nHeight];
+    return CheckKernel(round, prevout, coin.out.nValue, coin.nHeight, pBlockTime);
+}
+
+bool CheckKernel(const CStakeKernelRound &round, const COutPoint &prevout, CAmount nValue, int nCoinHeight, int64_t *pBlockTime)
+{
+    const CBlockIndex *pindexPrev = round.GetPrev();
+    uint256 hashProofOfStake, targetProofOfStake;
+
+    if (!round.IsValid() || nCoinHeight < 0)
+        return false;
+
+    const CBlockIndex *pindex = pindexPrev->GetAncestor(nCoinHeight);
     if (!pindex)
         return false;
 
     int nRequiredDepth = std::min((int)(Params().GetStakeMinConfirmations()-1), (int)(pindexPrev->nHeight / 2));
-    int nDepth = pindexPrev->nHeight - coin.nHeight + 1;
+    int nDepth = pindexPrev->nHeight - nCoinHeight + 1;
 
     if (nRequiredDepth > nDepth)
         return false;
 
+    int64_t nBlockTime = pindex->GetBlockTime();
     if (pBlockTime)
-        *pBlockTime = pindex->GetBlockTime();
+        *pBlockTime = nBlockTime;
+
+    if (!round.Check(nBlockTime, nValue, prevout, hashProofOfStake, targetProofOfStake))
+        return false;
+
+    if (LogAcceptCategory(BCLog::POS))
+        LogPrintf("%s: pass modifier=%s nTimeKernel=%u nPrevout=%u nTime=%u hashProof=%s\n",
+            __func__, pindexPrev->bnStakeModifier.ToString(),
+            nBlockTime, prevout.n, round.GetTime(), hashProofOfStake.ToString());
+    return true;
+}
+
+static std::shared_ptr<const CStakeTipSnapshot> stakeTipSnapshot; // std::atomic_load/atomic_store
 
-    CAmount amount = coin.out.nValue;
-    return CheckStakeKernelHash(pindexPrev, nBits, *pBlockTime,
-        amount, prevout, nTime, hashProofOfStake, targetProofOfStake);
+void PublishStakeTip(const CBlockIndex *pindex)
+{
+    AssertLockHeld(cs_main);
+    if (!pindex) {
+        std::atomic_store(&stakeTipSnapshot, std::shared_ptr<const CStakeTipSnapshot>());
+        return;
+    }
+
+    std::shared_ptr<CStakeTipSnapshot> snapshot = std::make_shared<CStakeTipSnapshot>();
+    snapshot->pindex = pindex;
+    snapshot->hashBlock = pindex->GetBlockHash();
+    snapshot->nHeight = pindex->nHeight;
+    snapshot->nTime = pindex->GetBlockTime();
+    snapshot->nPastTimeLimit = pindex->GetPastTimeLimit();
+    snapshot->nBitsNext = GetNextTargetRequired(pindex);
+    snapshot->nRequiredDepth = std::min((int)(Params().GetStakeMinConfirmations()-1), (int)(pindex->nHeight / 2));
+    std::atomic_store(&stakeTipSnapshot, std::shared_ptr<const CStakeTipSnapshot>(snapshot));
 }
 
+std::shared_ptr<const CStakeTipSnapshot> GetStakeTipSnapshot()
+{
+    std::shared_ptr<const CStakeTipSnapshot> snapshot = std::atomic_load(&stakeTipSnapshot);
+    if (snapshot) {
+        return snapshot;
+    }
+
+    // Nothing connected since startup
+    LOCK(cs_main);
+    snapshot = std::atomic_load(&stakeTipSnapshot);
+    if (!snapshot && chainActive.Tip()) {
+        PublishStakeTip(chainActive.Tip());
+        snapshot = std::atomic_load(&stakeTipSnapshot);
+    }
+    return snapshot;
+}
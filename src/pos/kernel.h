@@ -6,8 +6,11 @@
 #ifndef BITCOINC_POS_KERNEL_H
 #define BITCOINC_POS_KERNEL_H
 
+#include <arith_uint256.h>
 #include <validation.h>
 
+#include <memory>
+
 
 // Compute the hash modifier for proof-of-stake
 uint256 ComputeStakeModifierV2(const CBlockIndex *pindexPrev, const uint256 &kernel);
@@ -23,6 +26,35 @@ bool CheckStakeKernelHash(const CBlockIndex *pindexPrev,
     bool fPrintProofOfStake=false);
 
 
+//! Serialized size of the kernel hashed by CheckStakeKernelHash
+static const size_t STAKE_KERNEL_SIZE = 32 + 4 + 32 + 4 + 4;
+
+/**
+ * Kernel hash state for one staking attempt at (pindexPrev, nBits, nTime).
+ * The target is decoded once and the stake modifier and timestamp are laid
+ * out in a fixed buffer, each candidate only fills in its own fields.
+ */
+class CStakeKernelRound
+{
+public:
+    CStakeKernelRound(const CBlockIndex *pindexPrevIn, uint32_t nBits, uint32_t nTimeIn);
+
+    bool IsValid() const { return fValid; };
+    const CBlockIndex *GetPrev() const { return pindexPrev; };
+    uint32_t GetTime() const { return nTime; };
+
+    /** Same result as CheckStakeKernelHash, without the logging */
+    bool Check(uint32_t nBlockFromTime, CAmount prevOutAmount, const COutPoint &prevout,
+        uint256 &hashProofOfStake, uint256 &targetProofOfStake) const;
+
+private:
+    const CBlockIndex *pindexPrev;
+    uint32_t nTime;
+    arith_uint256 bnTarget;
+    bool fValid;
+    uint8_t vchKernel[STAKE_KERNEL_SIZE];
+};
+
 /**
  * Check kernel hash target and coinstake signature
  * Sets hashProofOfStake on success return
@@ -40,5 +72,33 @@ bool CheckCoinStakeTimestamp(int nHeight, int64_t nTimeBlock);
  * Convenient for searching a kernel
  */
 bool CheckKernel(const CBlockIndex *pindexPrev, unsigned int nBits, int64_t nTime, const COutPoint &prevout, int64_t* pBlockTime = nullptr);
+bool CheckKernel(const CStakeKernelRound &round, const COutPoint &prevout, int64_t* pBlockTime = nullptr);
+
+/**
+ * As above with the value and height of prevout supplied by the caller, the
+ * coin is not looked up and cs_main is not needed.
+ * The ancestor of the round's pindexPrev at nCoinHeight gives the kernel block time.
+ */
+bool CheckKernel(const CStakeKernelRound &round, const COutPoint &prevout, CAmount nValue, int nCoinHeight, int64_t* pBlockTime = nullptr);
+
+/**
+ * Chain tip state for staking, republished on every tip change.
+ * Never modified once published, the staking threads read it instead of taking cs_main.
+ */
+struct CStakeTipSnapshot
+{
+    const CBlockIndex *pindex = nullptr; // Only immutable fields and ancestors are read
+    uint256 hashBlock;
+    int nHeight = 0;
+    int64_t nTime = 0;
+    int64_t nPastTimeLimit = 0;
+    uint32_t nBitsNext = 0; // nBits of a block on top of pindex
+    int nRequiredDepth = 0; // Depth a kernel needs in a block on top of pindex
+};
+
+/** Publish pindex as the staking tip, nullptr clears it. */
+void PublishStakeTip(const CBlockIndex *pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+/** The last published staking tip, takes cs_main to publish the first one. */
+std::shared_ptr<const CStakeTipSnapshot> GetStakeTipSnapshot();
 
 #endif // BITCOINC_POS_KERNEL_H
@@ -5,6 +5,7 @@
 
 #include <pos/miner.h>
 
+#include <pos/airdrop.h>
 #include <pos/kernel.h>
 #include <miner.h>
 #include <chainparams.h>
@@ -13,7 +14,9 @@
 #include <fs.h>
 #include <sync.h>
 #include <net.h>
+#include <perfstats.h>
 #include <validation.h>
+#include <consensus/merkle.h>
 #include <consensus/validation.h>
 #include <base58.h>
 #include <crypto/sha256.h>
@@ -26,46 +29,135 @@
 typedef CWallet* CWalletRef;
 std::vector<StakeThread*> vStakeThreads;
 
+std::atomic<bool> fStopMinerProc(false);
+std::atomic<bool> fTryToSync(false);
+std::atomic<bool> fIsStaking(false);
+
+/** Search of all pool wallets at one search time on top of one tip */
+struct StakeRound
+{
+    int nHeight = 0;
+    int64_t nSearchTime = 0;
+    uint256 hashPrevBlock;
+    std::shared_ptr<const CBlockTemplate> pblocktemplate;
+    std::mutex mtxFound;
+    std::atomic<bool> fFound{false};
+};
+
+static std::mutex mtxStakeSchedule;
+static int nStakeBestHeight = 0; // guarded by mtxStakeSchedule
+static std::atomic<size_t> nStakeTasksQueued(0);
+
+/** Candidate block kept ready between rounds, guarded by mtxStakeSchedule */
+struct StakeTemplate
+{
+    uint256 hashPrevBlock;
+    unsigned int nTransactionsUpdated = 0;
+    int64_t nTimeCreated = 0;
+    std::shared_ptr<const CBlockTemplate> pblocktemplate;
+};
+static StakeTemplate stakeTemplate;
+static const int64_t STAKE_TEMPLATE_REFRESH = 5; // seconds a template is kept while the mempool changes
+
 void StakeThread::condWaitFor(int ms)
 {
     std::unique_lock<std::mutex> lock(mtxMinerProc);
     fWakeMinerProc = false;
-    condMinerProc.wait_for(lock, std::chrono::milliseconds(ms), [this] { return this->fWakeMinerProc; });
+    condMinerProc.wait_for(lock, std::chrono::milliseconds(ms), [this] { return this->fWakeMinerProc || nStakeTasksQueued > 0; });
 };
 
-std::atomic<bool> fStopMinerProc(false);
-std::atomic<bool> fTryToSync(false);
-std::atomic<bool> fIsStaking(false);
-
 int nMinStakeInterval = 0;  // min stake interval in seconds
 int nMinerSleep = 500;
 std::atomic<int64_t> nTimeLastStake(0);
 
 extern double GetDifficulty(const CBlockIndex* blockindex = nullptr);
 
+/** Recent proof-of-stake blocks of the active chain, newest at the back */
+class CRecentStakeBlocks
+{
+public:
+    struct Entry
+    {
+        uint32_t nTime;
+        double dDifficulty;
+    };
+
+    explicit CRecentStakeBlocks(size_t nMaxEntries) : nMaxEntries(nMaxEntries) {};
+
+    /** Bring the buffer in line with pindexTip, only new blocks are visited unless the chain reorganised */
+    void Sync(const CBlockIndex *pindexTip) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        if (!pindexTip || pindexTip->GetBlockHash() == hashTip) {
+            return;
+        }
+
+        const CBlockIndex *pindexFork = nullptr;
+        if (nTipHeight >= 0 && nTipHeight < pindexTip->nHeight) {
+            pindexFork = pindexTip->GetAncestor(nTipHeight);
+        }
+        if (!pindexFork || pindexFork->GetBlockHash() != hashTip) {
+            dqBlocks.clear();
+            pindexFork = nullptr;
+        }
+
+        std::vector<const CBlockIndex*> vNew;
+        for (const CBlockIndex *pindex = pindexTip; pindex && pindex != pindexFork; pindex = pindex->pprev) {
+            if (!pindex->IsProofOfStake()) {
+                continue;
+            }
+            vNew.push_back(pindex);
+            if (vNew.size() >= nMaxEntries) {
+                break;
+            }
+        }
+        for (auto it = vNew.rbegin(); it != vNew.rend(); ++it) {
+            dqBlocks.push_back(Entry{(*it)->nTime, GetDifficulty(*it)});
+        }
+        while (dqBlocks.size() > nMaxEntries) {
+            dqBlocks.pop_front();
+        }
+
+        hashTip = pindexTip->GetBlockHash();
+        nTipHeight = pindexTip->nHeight;
+    };
+
+    const std::deque<Entry> &Blocks() const { return dqBlocks; };
+
+private:
+    size_t nMaxEntries;
+    uint256 hashTip;
+    int nTipHeight = -1;
+    std::deque<Entry> dqBlocks;
+};
+
+static const int POS_KERNELPS_INTERVAL = 72; // stake blocks sampled
+static CRecentStakeBlocks recentStakeBlocks(POS_KERNELPS_INTERVAL + 1); // guarded by cs_main
+static uint256 hashKernelPSTip; // guarded by cs_main
+static double dKernelPSCached = 0; // guarded by cs_main
+
 double GetPoSKernelPS()
 {
     LOCK(cs_main);
 
-    CBlockIndex *pindex = chainActive.Tip();
-    CBlockIndex *pindexPrevStake = nullptr;
+    CBlockIndex *pindexTip = chainActive.Tip();
+    if (!pindexTip) {
+        return 0;
+    }
+    if (pindexTip->GetBlockHash() == hashKernelPSTip) {
+        return dKernelPSCached;
+    }
 
-    int nBestHeight = pindex->nHeight;
+    recentStakeBlocks.Sync(pindexTip);
 
-    int nPoSInterval = 72; // blocks sampled
+    // Each stake block but the oldest contributes its difficulty and the time since the one before it
+    const std::deque<CRecentStakeBlocks::Entry> &blocks = recentStakeBlocks.Blocks();
     double dStakeKernelsTriedAvg = 0;
-    int nStakesHandled = 0, nStakesTime = 0;
-
-    while (pindex && nStakesHandled < nPoSInterval) {
-        if (pindex->IsProofOfStake()) {
-            if (pindexPrevStake) {
-                dStakeKernelsTriedAvg += GetDifficulty(pindexPrevStake) * 4294967296.0;
-                nStakesTime += pindexPrevStake->nTime - pindex->nTime;
-                nStakesHandled++;
-            }
-            pindexPrevStake = pindex;
+    int nStakesTime = 0;
+    if (blocks.size() > 1) {
+        for (size_t i = 1; i < blocks.size(); ++i) {
+            dStakeKernelsTriedAvg += blocks[i].dDifficulty * 4294967296.0;
         }
-        pindex = pindex->pprev;
+        nStakesTime = blocks.back().nTime - blocks.front().nTime;
     }
 
     double result = 0;
@@ -75,8 +167,10 @@ double GetPoSKernelPS()
     }
 
     //if (IsProtocolV2(nBestHeight))
-        result *= Params().GetStakeTimestampMask(nBestHeight) + 1;
+        result *= Params().GetStakeTimestampMask(pindexTip->nHeight) + 1;
 
+    hashKernelPSTip = pindexTip->GetBlockHash();
+    dKernelPSCached = result;
     return result;
 }
 
@@ -93,18 +187,18 @@ bool CheckStake(CBlock *pblock)
         return error("%s: %s CheckStakeUnique failed.", __func__, hashBlock.GetHex());
     }
 
-    BlockMap::const_iterator mi = mapBlockIndex.find(pblock->hashPrevBlock);
-    if (mi == mapBlockIndex.end()) {
-        return error("%s: %s prev block not found: %s.", __func__, hashBlock.GetHex(), pblock->hashPrevBlock.GetHex());
-    }
-
-    if (!chainActive.Contains(mi->second)) {
-        return error("%s: %s prev block in active chain: %s.", __func__, hashBlock.GetHex(), pblock->hashPrevBlock.GetHex());
-    }
-
-    // Verify hash target and signature of coinstake tx
+    // Verify hash target and signature of coinstake tx, the staking path takes cs_main only from here
     {
         LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(pblock->hashPrevBlock);
+        if (mi == mapBlockIndex.end()) {
+            return error("%s: %s prev block not found: %s.", __func__, hashBlock.GetHex(), pblock->hashPrevBlock.GetHex());
+        }
+
+        if (!chainActive.Contains(mi->second)) {
+            return error("%s: %s prev block in active chain: %s.", __func__, hashBlock.GetHex(), pblock->hashPrevBlock.GetHex());
+        }
+
         CValidationState state;
         if (!CheckProofOfStake(state, mi->second, *pblock->vtx[0], pblock->nTime, pblock->nBits, proofHash, hashTarget)) {
             return error("%s: proof-of-stake checking failed.", __func__);
@@ -129,135 +223,60 @@ bool CheckStake(CBlock *pblock)
     return true;
 };
 
+static std::mutex mtxAirdrop;
+static CAirdropImport airdropImport; // guarded by mtxAirdrop
+
 bool ImportAirdropOutputs(CBlockTemplate *pblocktemplate, int nHeight, bool fGenerateHashFile)
 {
     CBlock *pblock = &pblocktemplate->block;
 
     if (pblock->vtx.size() < 1)
         return error("%s: Malformed block.", __func__);
-    CMutableTransaction txn;
 
     fs::path fPath = GetDataDir() / "airdrop.txt";
+    fs::path fPathCache = GetDataDir() / "airdrop.dat";
     fs::path fPathOut = GetDataDir() / strprintf("airdrop_hashes_%d.txt", nHeight);
 
-    if (!fs::exists(fPath))
-        return error("%s: File not found 'airdrop.txt'.", __func__);
-
-    const int nMaxOutputsPerTxn = 1000;
-    const int nMaxTxnPerBlock = 60;
-
-    FILE *fp;
-    errno = 0;
-    if (!(fp = fopen(fPath.string().c_str(), "rb")))
-        return error("%s - Can't open file, strerror: %s.", __func__, strerror(errno));
-
-    char *pRead;
-    int nOutput = 0;
-
-    while( pblock->vtx.size() < nMaxTxnPerBlock ){
-
-        LogPrint(BCLog::POS, "%s, nHeight %d\n", __func__, nHeight);
-
-        txn = CMutableTransaction();
-        txn.nVersion = BITCOINC_TXN_VERSION;
-        txn.SetType(TXN_COINBASE);
-        txn.nLockTime = 0;
-        txn.vin.push_back(CTxIn()); // null prevout
-
-        // scriptsig len must be > 2
-        const char *s = "smartcash_airdrop";
-        txn.vin[0].scriptSig = CScript() << std::vector<unsigned char>((const unsigned char*)s, (const unsigned char*)s + strlen(s));
-
-        int nAdded = 0;
-        char cLine[512];
-        char *pAddress, *pAmount;
-
-        while ( (pRead = fgets(cLine, 512, fp)) )
-        {
-            cLine[511] = '\0'; // safety
-            size_t len = strlen(cLine);
-            while (isspace(cLine[len-1]) && len>0)
-                cLine[len-1] = '\0', len--;
-
-            if (!(pAddress = strtok(cLine, ","))
-                || !(pAmount = strtok(nullptr, ",")))
-                continue;
-
-            nOutput++;
-            if (nOutput <= nMaxOutputsPerTxn * (nHeight-1))
-                continue;
-
-            uint64_t amount;
-            if (!ParseUInt64(std::string(pAmount), &amount) || !MoneyRange(amount))
-            {
-                LogPrint(BCLog::POS, "Warning: %s - Skipping invalid amount: %s, %s\n", __func__, pAmount, strerror(errno));
-                continue;
-            };
+    LogPrint(BCLog::POS, "%s, nHeight %d\n", __func__, nHeight);
 
-            std::string addrStr(pAddress);
-            CSmartCashAddress addr(addrStr);
-
-            CTxDestination dest = addr.Get();
-            CScript script;
-
-            if (!addr.IsValid())
-            {
-                LogPrint(BCLog::POS, "Warning: %s - Skipping invalid address: %s\n", __func__, pAddress);
-                continue;
-            };
-
-            if( dest.type() == typeid(CKeyID) ){
-                script = CScript() << OP_DUP << OP_HASH160 << ToByteVector(boost::get<CKeyID>(dest)) << OP_EQUALVERIFY << OP_CHECKSIG;
-            }else if( dest.type() == typeid(CScriptID) ){
-                script = CScript() << OP_HASH160 << ToByteVector(boost::get<CScriptID>(dest)) << OP_EQUAL;
-            }else{
-                LogPrint(BCLog::POS, "Warning: %s - Skipping invalid address type: %s\n", __func__, pAddress);
-                continue;
-            }
-
-            OUTPUT_PTR<CTxOutStandard> txout = MAKE_OUTPUT<CTxOutStandard>();
-            txout->nValue = amount;
-            txout->scriptPubKey = script;
-            txn.vpout.push_back(txout);
-
-            nAdded++;
-            if (nAdded >= nMaxOutputsPerTxn)
-                break;
-        };
-
-        if( txn.vpout.size() ){
-            LogPrint(BCLog::POS, "%s - Add tx: %s\n", __func__, txn.GetHash().ToString());
-            pblock->vtx.insert(pblock->vtx.begin()+1, MakeTransactionRef(txn));
-        }else{
-            break;
-        }
+    bool fFilled;
+    {
+        std::lock_guard<std::mutex> lock(mtxAirdrop);
+        if (!airdropImport.IsCurrent(fPath)
+            && !airdropImport.Load(fPath, fPathCache))
+            return false;
+        fFilled = airdropImport.FillBlock(*pblock, nHeight);
     }
 
-    fclose(fp);
-
     if( fGenerateHashFile ){
         LogPrintf("%s - Generated transactions: %d\n", __func__, pblock->vtx.size());
 
         if( pblock->vtx.size() ){
-
+            FILE *fp;
+            errno = 0;
             if (!(fp = fopen(fPathOut.string().c_str(), "w"))){
                 return error("%s - Can't create file, strerror: %s.", __func__, strerror(errno));
             }
 
+            std::string strOut;
             for( size_t i=1; i<pblock->vtx.size(); i++ ){
-                std::string strOut = strprintf("vImportedCoinbaseTxns.push_back(CImportedCoinbaseTxn(%d,  uint256S(\"%s\")));\n", nHeight, pblock->vtx[i].get()->GetHash().ToString());
-                fwrite(strOut.c_str(), 1, strOut.length(), fp);
+                strOut += strprintf("vImportedCoinbaseTxns.push_back(CImportedCoinbaseTxn(%d,  uint256S(\"%s\")));\n", nHeight, pblock->vtx[i].get()->GetHash().ToString());
             }
+            fwrite(strOut.c_str(), 1, strOut.length(), fp);
 
             fclose(fp);
         }
     }
 
-    return fGenerateHashFile ? txn.vpout.size() > 0 : true;
+    return fGenerateHashFile ? fFilled : true;
 }
 
 void StartThreadStakeMiner()
 {
+    if (!vStakeThreads.empty()) {
+        StopThreadStakeMiner(); // the pool is shared, restart it with the new set of wallets
+    }
+
     nMinStakeInterval = gArgs.GetArg("-minstakeinterval", 0);
     nMinerSleep = gArgs.GetArg("-minersleep", 500);
 
@@ -272,27 +291,36 @@ void StartThreadStakeMiner()
 
     UniValue rv(UniValue::VOBJ);
 
-    size_t nThreads = std::min(nWallets, (size_t)gArgs.GetArg("-stakingthreads", 1));
-    size_t nPerThread = nWallets / nThreads;
-
-    for (size_t i = 0; i < nThreads; ++i) {
-        size_t nStart = nPerThread * i;
-        size_t nEnd = (i == nThreads-1) ? nWallets : nPerThread * (i+1);
-
+    std::vector<std::shared_ptr<CWallet>> vpStakingWallets;
+    for (size_t i = 0; i < nWallets; ++i) {
         CHDWallet *pwallet = GetBitcoinCWallet(vpwallets[i].get());
         if( gArgs.GetBoolArg("-staking", true) && pwallet->GetSetting("stakingstatus", rv) && rv.isObject() && rv.exists("enabled") && rv["enabled"].getBool()){
-            StakeThread *t = new StakeThread();
             pwallet->nIsStaking = CHDWallet::NOT_STAKING_INIT;
-            vStakeThreads.push_back(t);
-            pwallet->nStakeThread = i;
-            t->sName = strprintf("miner%d", i);
-            t->thread = std::thread(&TraceThread<std::function<void()> >, t->sName.c_str(), std::function<void()>(std::bind(&ThreadStakeMiner, i, vpwallets, nStart, nEnd)));
+            pwallet->nStakeThread = 0; // any thread of the pool
+            vpStakingWallets.push_back(vpwallets[i]);
         }else if(!gArgs.GetBoolArg("-staking", true)){
             pwallet->nIsStaking = CHDWallet::NOT_STAKING_DISABLED;
         }else{
             pwallet->nIsStaking = CHDWallet::NOT_STAKING_STOPPED;
         }
     }
+
+    if (vpStakingWallets.empty()) {
+        return;
+    }
+
+    size_t nThreads = std::max((int64_t)1, gArgs.GetArg("-stakingthreads", 1));
+
+    // Create all threads before starting any, vStakeThreads is read without a lock
+    for (size_t i = 0; i < nThreads; ++i) {
+        StakeThread *t = new StakeThread();
+        t->sName = strprintf("miner%d", i);
+        vStakeThreads.push_back(t);
+    }
+    for (size_t i = 0; i < nThreads; ++i) {
+        StakeThread *t = vStakeThreads[i];
+        t->thread = std::thread(&TraceThread<std::function<void()> >, t->sName.c_str(), std::function<void()>(std::bind(&ThreadStakeMiner, i, vpStakingWallets)));
+    }
 }
 
 void StopThreadStakeMiner()
@@ -312,11 +340,27 @@ void StopThreadStakeMiner()
             t->fWakeMinerProc = true;
         }
         t->condMinerProc.notify_all();
+    };
 
+    for (auto t : vStakeThreads)
+    {
         t->thread.join();
         delete t;
     };
     vStakeThreads.clear();
+    nStakeTasksQueued = 0;
+};
+
+static void WakeStakeThreads()
+{
+    for (auto t : vStakeThreads)
+    {
+        {
+            std::lock_guard<std::mutex> lock(t->mtxMinerProc);
+            t->fWakeMinerProc = true;
+        }
+        t->condMinerProc.notify_all();
+    };
 };
 
 void WakeThreadStakeMiner(CHDWallet *pwallet)
@@ -326,14 +370,9 @@ void WakeThreadStakeMiner(CHDWallet *pwallet)
 
     if (pwallet->nStakeThread >= vStakeThreads.size())
         return; // stake unit test
-    StakeThread *t = vStakeThreads[pwallet->nStakeThread];
     pwallet->nLastCoinStakeSearchTime = 0;
-    {
-        std::lock_guard<std::mutex> lock(t->mtxMinerProc);
-        t->fWakeMinerProc = true;
-    }
 
-    t->condMinerProc.notify_all();
+    WakeStakeThreads();
 };
 
 bool ThreadStakeMinerStopped()
@@ -348,195 +387,356 @@ static inline void condWaitFor(size_t nThreadID, int ms)
     t->condWaitFor(ms);
 };
 
-void ThreadStakeMiner(size_t nThreadID, std::vector<std::shared_ptr<CWallet>> &vpwallets, size_t nStart, size_t nEnd)
+/**
+ * Take the next task from the front of this thread's queue, or steal from
+ * the back of another thread's queue.
+ */
+static bool PopStakeTask(size_t nThreadID, StakeTask &task)
 {
-    LogPrintf("Starting staking thread %d, %d wallet%s.\n", nThreadID, nEnd - nStart, (nEnd - nStart) > 1 ? "s" : "");
+    if (nStakeTasksQueued < 1)
+        return false;
 
-    int nBestHeight; // TODO: set from new block signal?
-    int64_t nBestTime;
+    size_t nThreads = vStakeThreads.size();
+    for (size_t k = 0; k < nThreads; ++k)
+    {
+        StakeThread *t = vStakeThreads[(nThreadID + k) % nThreads];
+        std::lock_guard<std::mutex> lock(t->mtxMinerProc);
+        if (t->dqTasks.empty())
+            continue;
 
-    int nLastImportHeight = Params().GetLastImportHeight();
+        if (k == 0)
+        {
+            task = std::move(t->dqTasks.front());
+            t->dqTasks.pop_front();
+        } else
+        {
+            task = std::move(t->dqTasks.back());
+            t->dqTasks.pop_back();
+        };
+        nStakeTasksQueued--;
+        return true;
+    };
+    return false;
+};
 
-    if (!gArgs.GetBoolArg("-staking", true))
+static void RunStakeTask(const StakeTask &task)
+{
+    StakeRound &round = *task.round;
+    CHDWallet *pwallet = task.pwallet;
+
+    if (round.fFound || fStopMinerProc)
+        return;
+
+    std::shared_ptr<const CStakeTipSnapshot> tip = GetStakeTipSnapshot();
+    if (!tip || tip->hashBlock != round.hashPrevBlock)
+        return; // A new block arrived since the task was queued
+
+    // SignBlock replaces the coinbase, each slice works on its own copy
+    CBlockTemplate blocktemplate(*round.pblocktemplate);
+    bool fSigned;
     {
-        LogPrint(BCLog::POS, "%s: -staking is false.\n", __func__);
+        CPerfTimer timer(PERF_HISTOGRAM("stake:sign"));
+        fSigned = pwallet->SignBlock(&blocktemplate, round.nHeight, round.nSearchTime, task.nSlice, task.nSlices);
+    }
+    if (fSigned)
+    {
+        std::lock_guard<std::mutex> lock(round.mtxFound);
+        CPerfTimer timer(PERF_HISTOGRAM("stake:check"));
+        if (!round.fFound && CheckStake(&blocktemplate.block))
+        {
+            PERF_COUNTER("stake:found")++;
+            round.fFound = true;
+            nTimeLastStake = GetTime();
+        };
+        return;
+    };
+
+    if (task.nSlice != 0) // Per wallet state is only updated from the first slice
         return;
+
+    int nBestHeight = round.nHeight - 1;
+    int nRequiredDepth = std::min((int)(Params().GetStakeMinConfirmations()-1), (int)(nBestHeight / 2));
+    if (pwallet->m_greatest_txn_depth < nRequiredDepth-4)
+    {
+        pwallet->nIsStaking = CHDWallet::NOT_STAKING_DEPTH;
+        size_t nSleep = (nRequiredDepth - pwallet->m_greatest_txn_depth) / 4;
+        pwallet->nLastCoinStakeSearchTime = round.nSearchTime + nSleep;
+        LogPrint(BCLog::POS, "%s: Wallet %s, no outputs with required depth, sleeping for %ds.\n", __func__, pwallet->GetDisplayName(), nSleep);
     };
+};
+
+static void SetStakingStatus(std::vector<std::shared_ptr<CWallet>> &vpwallets, CHDWallet::eStakingState nState)
+{
+    for (auto &pw : vpwallets)
+        GetBitcoinCWallet(pw.get())->nIsStaking = nState;
+};
+
+/**
+ * Make sure stakeTemplate holds a candidate block on top of hashPrevBlock.
+ * The template is rebuilt when the tip changes, or when the mempool changed and it is
+ * older than STAKE_TEMPLATE_REFRESH, so finding a kernel only needs the coinstake and signature.
+ * Requires mtxStakeSchedule.
+ */
+static bool UpdateStakeTemplate(const uint256 &hashPrevBlock, int nHeight, size_t &nWaitFor)
+{
+    if (stakeTemplate.pblocktemplate
+        && stakeTemplate.hashPrevBlock == hashPrevBlock
+        && (stakeTemplate.nTransactionsUpdated == mempool.GetTransactionsUpdated()
+            || GetTime() - stakeTemplate.nTimeCreated < STAKE_TEMPLATE_REFRESH))
+        return true;
+
+    unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    int64_t nTimeCreated = GetTime();
 
     CScript coinbaseScript;
-    while (!fStopMinerProc)
+    int64_t nCreateStart = GetTimeMicros();
+    std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(Params()).CreateNewBlock(coinbaseScript, true, false);
+    PERF_HISTOGRAM("stake:createblock").Record(GetTimeMicros() - nCreateStart);
+    if (!pblocktemplate.get())
+    {
+        LogPrint(BCLog::POS, "%s: Couldn't create new block.\n", __func__);
+        nWaitFor = nMinerSleep;
+        return false;
+    };
+
+    if (pblocktemplate->block.hashPrevBlock != hashPrevBlock)
+    {
+        LogPrint(BCLog::POS, "%s: Tip changed.\n", __func__);
+        nWaitFor = nMinerSleep;
+        return false;
+    };
+
+    int nLastImportHeight = Params().GetLastImportHeight();
+    if (nHeight <= nLastImportHeight
+        && !ImportAirdropOutputs(pblocktemplate.get(), nHeight, false))
+    {
+        LogPrint(BCLog::POS, "%s: ImportOutputs failed.\n", __func__);
+        nWaitFor = 30000;
+        return false;
+    };
+
+    // Txn 0 is replaced by the coinstake, only its siblings are needed to complete the merkle roots
+    const CBlock &block = pblocktemplate->block;
+    std::vector<uint256> vLeaves(block.vtx.size()), vWitnessLeaves(block.vtx.size());
+    for (size_t i = 1; i < block.vtx.size(); ++i)
     {
-        if (fReindex || fImporting || fBusyImporting)
+        vLeaves[i] = block.vtx[i]->GetHash();
+        vWitnessLeaves[i] = block.vtx[i]->GetWitnessHash();
+    };
+    pblocktemplate->vMerkleBranch = ComputeMerkleBranch(std::move(vLeaves), 0);
+    pblocktemplate->vWitnessMerkleBranch = ComputeMerkleBranch(std::move(vWitnessLeaves), 0);
+    pblocktemplate->fHasMerkleBranches = true;
+
+    stakeTemplate.hashPrevBlock = hashPrevBlock;
+    stakeTemplate.nTransactionsUpdated = nTransactionsUpdated;
+    stakeTemplate.nTimeCreated = nTimeCreated;
+    stakeTemplate.pblocktemplate = std::move(pblocktemplate);
+    return true;
+};
+
+/**
+ * Queue the kernel search of every wallet ready to stake at the current search time.
+ * Returns the time to wait in milliseconds, 0 if tasks were queued.
+ * Requires mtxStakeSchedule.
+ */
+static size_t ScheduleStakeRound(std::vector<std::shared_ptr<CWallet>> &vpwallets)
+{
+    int64_t nBestTime;
+
+    if (fReindex || fImporting || fBusyImporting)
+    {
+        fIsStaking = false;
+        LogPrint(BCLog::POS, "%s: Block import/reindex.\n", __func__);
+        return 30000;
+    };
+
+    if (fTryToSync)
+    {
+        fTryToSync = false;
+
+        if (g_connman->vNodes.size() < 3 || nStakeBestHeight < GetNumBlocksOfPeers())
         {
             fIsStaking = false;
-            LogPrint(BCLog::POS, "%s: Block import/reindex.\n", __func__);
-            condWaitFor(nThreadID, 30000);
-            continue;
+            LogPrint(BCLog::POS, "%s: TryToSync\n", __func__);
+            return 2000;
         };
+    };
 
-        if (fTryToSync)
-        {
-            fTryToSync = false;
+    if (g_connman->vNodes.empty() || IsInitialBlockDownload())
+    {
+        SetStakingStatus(vpwallets, CHDWallet::NOT_STAKING_NOT_SYCNED);
 
-            if (g_connman->vNodes.size() < 3 || nBestHeight < GetNumBlocksOfPeers())
-            {
-                fIsStaking = false;
-                LogPrint(BCLog::POS, "%s: TryToSync\n", __func__);
-                condWaitFor(nThreadID, 2000);
-                continue;
-            };
-        };
+        fIsStaking = false;
+        fTryToSync = true;
+        LogPrint(BCLog::POS, "%s: IsInitialBlockDownload\n", __func__);
+        return 2000;
+    };
+
+    std::shared_ptr<const CStakeTipSnapshot> tip = GetStakeTipSnapshot();
+    if (!tip)
+        return nMinerSleep;
+    nStakeBestHeight = tip->nHeight;
+    nBestTime = tip->nTime;
+    uint256 hashPrevBlock = tip->hashBlock;
+    int nBestHeight = nStakeBestHeight;
+
+    if (nBestHeight < GetNumBlocksOfPeers()-1)
+    {
+        SetStakingStatus(vpwallets, CHDWallet::NOT_STAKING_NOT_SYCNED);
+
+        fIsStaking = false;
+        LogPrint(BCLog::POS, "%s: nBestHeight < GetNumBlocksOfPeers(), %d, %d\n", __func__, nBestHeight, GetNumBlocksOfPeers());
+        return nMinerSleep * 4;
+    };
+
+    if (nMinStakeInterval > 0 && nTimeLastStake + (int64_t)nMinStakeInterval > GetTime())
+    {
+        LogPrint(BCLog::POS, "%s: Rate limited to 1 / %d seconds.\n", __func__, nMinStakeInterval);
+        return nMinStakeInterval * 500; // nMinStakeInterval / 2 seconds
+    };
 
-        if (g_connman->vNodes.empty() || IsInitialBlockDownload())
+    int64_t nTime = GetAdjustedTime();
+    int64_t nMask = Params().GetStakeTimestampMask(nBestHeight+1);
+    int64_t nSearchTime = nTime & ~nMask;
+    if (nSearchTime <= nBestTime)
+    {
+        if (nTime < nBestTime)
         {
-            for (size_t i = nStart; i < nEnd; ++i)
-            {
-                auto pwallet = GetBitcoinCWallet(vpwallets[i].get());
-                pwallet->nIsStaking = CHDWallet::NOT_STAKING_NOT_SYCNED;
-            }
+            LogPrint(BCLog::POS, "%s: Can't stake before last block time.\n", __func__);
+            return std::min(1000 + (nBestTime - nTime) * 1000, (int64_t)30000);
+        };
 
-            fIsStaking = false;
-            fTryToSync = true;
-            LogPrint(BCLog::POS, "%s: IsInitialBlockDownload\n", __func__);
-            condWaitFor(nThreadID, 2000);
+        // Have the candidate block ready when the next search time comes
+        size_t nWaitTemplate = 0;
+        if (fIsStaking)
+            UpdateStakeTemplate(hashPrevBlock, nBestHeight+1, nWaitTemplate);
+
+        int64_t nNextSearch = nSearchTime + nMask;
+        return std::min(nMinerSleep + (nNextSearch - nTime) * 1000, (int64_t)10000);
+    };
+
+    std::shared_ptr<StakeRound> round;
+    std::vector<StakeTask> vTasks;
+
+    size_t nThreads = vStakeThreads.size();
+    size_t nWaitFor = 60000;
+    for (size_t i = 0; i < vpwallets.size(); ++i)
+    {
+        auto pwallet = GetBitcoinCWallet(vpwallets[i].get());
+
+        if (!pwallet->fStakingEnabled)
+        {
+            pwallet->nIsStaking = CHDWallet::NOT_STAKING_DISABLED;
             continue;
         };
 
-
+        if (nSearchTime <= pwallet->nLastCoinStakeSearchTime)
         {
-            LOCK(cs_main);
-            nBestHeight = chainActive.Height();
-            nBestTime = chainActive.Tip()->nTime;
-        }
+            nWaitFor = std::min(nWaitFor, (size_t)nMinerSleep);
+            continue;
+        };
 
-        if (nBestHeight < GetNumBlocksOfPeers()-1)
+        if (pwallet->nStakeLimitHeight && nBestHeight >= pwallet->nStakeLimitHeight)
         {
-            for (size_t i = nStart; i < nEnd; ++i)
-            {
-                auto pwallet = GetBitcoinCWallet(vpwallets[i].get());
-                pwallet->nIsStaking = CHDWallet::NOT_STAKING_NOT_SYCNED;
-            }
+            pwallet->nIsStaking = CHDWallet::NOT_STAKING_LIMITED;
+            nWaitFor = std::min(nWaitFor, (size_t)30000);
+            continue;
+        };
 
-            fIsStaking = false;
-            LogPrint(BCLog::POS, "%s: nBestHeight < GetNumBlocksOfPeers(), %d, %d\n", __func__, nBestHeight, GetNumBlocksOfPeers());
-            condWaitFor(nThreadID, nMinerSleep * 4);
+        if (pwallet->IsLocked())
+        {
+            pwallet->nIsStaking = CHDWallet::NOT_STAKING_LOCKED;
+            nWaitFor = std::min(nWaitFor, (size_t)30000);
             continue;
         };
 
-        if (nMinStakeInterval > 0 && nTimeLastStake + (int64_t)nMinStakeInterval > GetTime())
+        if (pwallet->GetSpendableBalance() <= pwallet->nReserveBalance)
         {
-            LogPrint(BCLog::POS, "%s: Rate limited to 1 / %d seconds.\n", __func__, nMinStakeInterval);
-            condWaitFor(nThreadID, nMinStakeInterval * 500); // nMinStakeInterval / 2 seconds
+            pwallet->nIsStaking = CHDWallet::NOT_STAKING_BALANCE;
+            nWaitFor = std::min(nWaitFor, (size_t)60000);
+            pwallet->nLastCoinStakeSearchTime = nSearchTime + 60;
+            LogPrint(BCLog::POS, "%s: Wallet %d, low balance.\n", __func__, i);
             continue;
         };
 
-        int64_t nTime = GetAdjustedTime();
-        int64_t nMask = Params().GetStakeTimestampMask(nBestHeight+1);
-        int64_t nSearchTime = nTime & ~nMask;
-        if (nSearchTime <= nBestTime)
+        if (!round)
         {
-            if (nTime < nBestTime)
+            size_t nWaitTemplate = 0;
+            if (!UpdateStakeTemplate(hashPrevBlock, nBestHeight+1, nWaitTemplate))
             {
-                LogPrint(BCLog::POS, "%s: Can't stake before last block time.\n", __func__);
-                condWaitFor(nThreadID, std::min(1000 + (nBestTime - nTime) * 1000, (int64_t)30000));
-                continue;
+                fIsStaking = false;
+                return nWaitTemplate;
             };
 
-            int64_t nNextSearch = nSearchTime + nMask;
-            condWaitFor(nThreadID, std::min(nMinerSleep + (nNextSearch - nTime) * 1000, (int64_t)10000));
-            continue;
+            round = std::make_shared<StakeRound>();
+            round->nHeight = nBestHeight+1;
+            round->nSearchTime = nSearchTime;
+            round->hashPrevBlock = hashPrevBlock;
+            round->pblocktemplate = stakeTemplate.pblocktemplate;
         };
 
-        std::unique_ptr<CBlockTemplate> pblocktemplate;
+        pwallet->nIsStaking = CHDWallet::IS_STAKING;
+        pwallet->nLastCoinStakeSearchTime = nSearchTime; // Searched by the queued tasks
+        fIsStaking = true;
 
-        size_t nWaitFor = 60000;
-        for (size_t i = nStart; i < nEnd; ++i)
+        // Split large wallets so their search can run on every thread of the pool
+        size_t nSlices = std::max((size_t)1, std::min(nThreads, pwallet->CountStakeableOutputs() / STAKE_TASK_MIN_OUTPUTS));
+        for (size_t k = 0; k < nSlices; ++k)
         {
-            auto pwallet = GetBitcoinCWallet(vpwallets[i].get());
-
-            if (!pwallet->fStakingEnabled)
-            {
-                pwallet->nIsStaking = CHDWallet::NOT_STAKING_DISABLED;
-                continue;
-            };
+            StakeTask task;
+            task.pwallet = pwallet;
+            task.nSlice = k;
+            task.nSlices = nSlices;
+            task.round = round;
+            vTasks.push_back(task);
+        };
+    };
 
-            if (nSearchTime <= pwallet->nLastCoinStakeSearchTime)
-            {
-                nWaitFor = std::min(nWaitFor, (size_t)nMinerSleep);
-                continue;
-            };
+    if (vTasks.empty())
+        return nWaitFor;
 
-            if (pwallet->nStakeLimitHeight && nBestHeight >= pwallet->nStakeLimitHeight)
-            {
-                pwallet->nIsStaking = CHDWallet::NOT_STAKING_LIMITED;
-                nWaitFor = std::min(nWaitFor, (size_t)30000);
-                continue;
-            };
+    // Deal the tasks out over the pool, idle threads steal from the busy ones
+    for (size_t i = 0; i < vTasks.size(); ++i)
+    {
+        StakeThread *t = vStakeThreads[i % nThreads];
+        std::lock_guard<std::mutex> lock(t->mtxMinerProc);
+        t->dqTasks.push_back(std::move(vTasks[i]));
+        nStakeTasksQueued++;
+    };
+    WakeStakeThreads();
 
-            if (pwallet->IsLocked())
-            {
-                pwallet->nIsStaking = CHDWallet::NOT_STAKING_LOCKED;
-                nWaitFor = std::min(nWaitFor, (size_t)30000);
-                continue;
-            };
+    return 0;
+};
 
-            if (pwallet->GetSpendableBalance() <= pwallet->nReserveBalance)
-            {
-                pwallet->nIsStaking = CHDWallet::NOT_STAKING_BALANCE;
-                nWaitFor = std::min(nWaitFor, (size_t)60000);
-                pwallet->nLastCoinStakeSearchTime = nSearchTime + 60;
-                LogPrint(BCLog::POS, "%s: Wallet %d, low balance.\n", __func__, i);
-                continue;
-            };
+void ThreadStakeMiner(size_t nThreadID, std::vector<std::shared_ptr<CWallet>> &vpwallets)
+{
+    LogPrintf("Starting staking thread %d, %d wallet%s.\n", nThreadID, vpwallets.size(), vpwallets.size() > 1 ? "s" : "");
 
-            if (!pblocktemplate.get())
-            {
-                pblocktemplate = BlockAssembler(Params()).CreateNewBlock(coinbaseScript, true, false);
-                if (!pblocktemplate.get())
-                {
-                    fIsStaking = false;
-                    nWaitFor = std::min(nWaitFor, (size_t)nMinerSleep);
-                    LogPrint(BCLog::POS, "%s: Couldn't create new block.\n", __func__);
-                    continue;
-                };
-
-                if (nBestHeight+1 <= nLastImportHeight
-                    && !ImportAirdropOutputs(pblocktemplate.get(), nBestHeight+1, false))
-                {
-                    fIsStaking = false;
-                    nWaitFor = std::min(nWaitFor, (size_t)30000);
-                    LogPrint(BCLog::POS, "%s: ImportOutputs failed.\n", __func__);
-                    continue;
-                };
-            };
+    if (!gArgs.GetBoolArg("-staking", true))
+    {
+        LogPrint(BCLog::POS, "%s: -staking is false.\n", __func__);
+        return;
+    };
 
-            pwallet->nIsStaking = CHDWallet::IS_STAKING;
-            nWaitFor = nMinerSleep;
-            fIsStaking = true;
-            if (pwallet->SignBlock(pblocktemplate.get(), nBestHeight+1, nSearchTime))
-            {
-                CBlock *pblock = &pblocktemplate->block;
-                if (CheckStake(pblock))
-                {
-                     nTimeLastStake = GetTime();
-                     break;
-                };
-            } else
-            {
-                int nRequiredDepth = std::min((int)(Params().GetStakeMinConfirmations()-1), (int)(nBestHeight / 2));
-                if (pwallet->m_greatest_txn_depth < nRequiredDepth-4)
-                {
-                    pwallet->nIsStaking = CHDWallet::NOT_STAKING_DEPTH;
-                    size_t nSleep = (nRequiredDepth - pwallet->m_greatest_txn_depth) / 4;
-                    nWaitFor = std::min(nWaitFor, (size_t)(nSleep * 1000));
-                    pwallet->nLastCoinStakeSearchTime = nSearchTime + nSleep;
-                    LogPrint(BCLog::POS, "%s: Wallet %d, no outputs with required depth, sleeping for %ds.\n", __func__, i, nSleep);
-                    continue;
-                };
-            };
+    while (!fStopMinerProc)
+    {
+        StakeTask task;
+        if (PopStakeTask(nThreadID, task))
+        {
+            RunStakeTask(task);
+            continue;
         };
 
-        condWaitFor(nThreadID, nWaitFor);
+        // Any idle thread may schedule the next round
+        size_t nWaitFor = nMinerSleep;
+        {
+            std::unique_lock<std::mutex> lock(mtxStakeSchedule, std::try_to_lock);
+            if (lock.owns_lock())
+                nWaitFor = ScheduleStakeRound(vpwallets);
+        }
+
+        if (nWaitFor > 0)
+            condWaitFor(nThreadID, nWaitFor);
     };
 };
 
@@ -9,11 +9,29 @@
 #include <thread>
 #include <condition_variable>
 #include <atomic>
+#include <deque>
+#include <memory>
 #include <vector>
 
 struct CBlockTemplate;
 class CHDWallet;
 class CWallet;
+struct StakeRound;
+
+//! Min. stakeable outputs per task before a wallet is split over more threads
+static const size_t STAKE_TASK_MIN_OUTPUTS = 1000;
+
+/**
+ * One slice of the kernel search of a wallet at a search time.
+ * Outputs are assigned to slices by GetStakeSlice().
+ */
+struct StakeTask
+{
+    CHDWallet *pwallet = nullptr;
+    size_t nSlice = 0;
+    size_t nSlices = 1;
+    std::shared_ptr<StakeRound> round;
+};
 
 class StakeThread
 {
@@ -26,6 +44,7 @@ public:
     std::mutex mtxMinerProc;
     std::string sName;
     bool fWakeMinerProc = false;
+    std::deque<StakeTask> dqTasks; // guarded by mtxMinerProc, popped from the front, stolen from the back
 };
 
 extern std::vector<StakeThread*> vStakeThreads;
@@ -47,7 +66,13 @@ void StopThreadStakeMiner();
 void WakeThreadStakeMiner(CHDWallet *pwallet);
 bool ThreadStakeMinerStopped(); // replace interruption_point
 
-void ThreadStakeMiner(size_t nThreadID, std::vector<std::shared_ptr<CWallet>> &vpwallets, size_t nStart, size_t nEnd);
+//! Slice of nSlices the kernel search for prevout runs in
+inline size_t GetStakeSlice(const COutPoint &prevout, size_t nSlices)
+{
+    return (prevout.hash.GetCheapHash() + prevout.n) % nSlices;
+};
+
+void ThreadStakeMiner(size_t nThreadID, std::vector<std::shared_ptr<CWallet>> &vpwallets);
 
 #endif // BITCOINC_POS_MINER_H
 
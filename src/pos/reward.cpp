@@ -0,0 +1,122 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pos/reward.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <key_io.h>
+
+#include <tuple>
+
+CStakeRewardCache g_stake_reward_cache;
+
+bool CStakeRewardCache::DevRewardKey::operator<(const DevRewardKey &b) const
+{
+    return std::tie(nHeight, hashPrev, nPercent, nPeriod, nCoinYearReward)
+        < std::tie(b.nHeight, b.hashPrev, b.nPercent, b.nPeriod, b.nCoinYearReward);
+};
+
+void CStakeRewardCache::LoadPayees()
+{
+    // Params can be reselected by the tests
+    const CChainParams *params = &Params();
+    if (m_params == params) {
+        return;
+    }
+
+    m_params = params;
+    m_payees.clear();
+    m_dev_rewards.clear();
+
+    for (const auto &settings : params->GetDevFundSettings()) {
+        CDevFundPayee payee;
+        payee.pSettings = &settings.second;
+
+        CBitcoinAddress addr(settings.second.sDevFundAddresses);
+        payee.dest = addr.Get();
+        if (payee.dest.type() != typeid(CNoDestination)) {
+            payee.scriptPubKey = GetScriptForDestination(payee.dest);
+        }
+        payee.fHaveKeyId = addr.GetKeyID(payee.keyId);
+
+        m_payees.emplace_back(settings.first, payee);
+    }
+};
+
+bool CStakeRewardCache::GetDevFund(int64_t nTime, CDevFundPayee &payee)
+{
+    LOCK(cs);
+    LoadPayees();
+
+    // Same search as CChainParams::GetDevFundSettings
+    for (size_t i = m_payees.size(); i-- > 0; ) {
+        if (nTime > m_payees[i].first) {
+            payee = m_payees[i].second;
+            return true;
+        }
+    }
+
+    return false;
+};
+
+bool CStakeRewardCache::IsDevFundKey(int64_t nTime, const CKeyID &keyId)
+{
+    LOCK(cs);
+    LoadPayees();
+
+    for (size_t i = m_payees.size(); i-- > 0; ) {
+        if (nTime > m_payees[i].first) {
+            return m_payees[i].second.fHaveKeyId && m_payees[i].second.keyId == keyId;
+        }
+    }
+
+    return false;
+};
+
+CAmount CStakeRewardCache::GetDevFundReward(const CBlockIndex *pindexPrev, int nHeight, const DevFundSettings &settings)
+{
+    if (!pindexPrev) {
+        return 0;
+    }
+
+    DevRewardKey key;
+    key.nHeight = nHeight;
+    key.hashPrev = pindexPrev->GetBlockHash();
+    key.nPercent = settings.nMinDevStakePercent;
+    key.nPeriod = settings.nDevOutputPeriod;
+    key.nCoinYearReward = Params().GetCoinYearReward(pindexPrev->nTime); // Settable in regtest
+
+    {
+        LOCK(cs);
+        LoadPayees();
+        auto mi = m_dev_rewards.find(key);
+        if (mi != m_dev_rewards.end()) {
+            return mi->second;
+        }
+    }
+
+    CAmount nDevReward = 0;
+    for (const CBlockIndex *pIndexDev = pindexPrev;
+        pIndexDev && pIndexDev->nHeight >= nHeight - settings.nDevOutputPeriod;
+        pIndexDev = pIndexDev->pprev) {
+        nDevReward += (Params().GetProofOfStakeSubsidy(pIndexDev) * settings.nMinDevStakePercent) / 100;
+    }
+
+    LOCK(cs);
+    m_dev_rewards.emplace(key, nDevReward);
+    if (m_dev_rewards.size() > DEV_REWARD_CACHE_SIZE) {
+        m_dev_rewards.erase(m_dev_rewards.begin()); // Lowest height
+    }
+
+    return nDevReward;
+};
+
+void CStakeRewardCache::Clear()
+{
+    LOCK(cs);
+    m_params = nullptr;
+    m_payees.clear();
+    m_dev_rewards.clear();
+};
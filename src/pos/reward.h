@@ -0,0 +1,86 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_POS_REWARD_H
+#define BITCOINC_POS_REWARD_H
+
+#include <amount.h>
+#include <key/extkey.h>                // For CTxDestination
+#include <key/stealth.h>               // For CTxDestination
+#include <pubkey.h>
+#include <script/script.h>
+#include <script/standard.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+class CBlockIndex;
+class CChainParams;
+class DevFundSettings;
+
+/** Number of dev fund payouts kept by the reward cache, the payout heights of competing tips */
+static const size_t DEV_REWARD_CACHE_SIZE = 64;
+
+/** Dev fund settings in effect from a time, with the fund address decoded once */
+struct CDevFundPayee
+{
+    const DevFundSettings *pSettings = nullptr;
+    CTxDestination dest;
+    CScript scriptPubKey;
+    CKeyID keyId;
+    bool fHaveKeyId = false;
+};
+
+/**
+ * Reward parameters of the staking, validation and RPC code.
+ *
+ * The dev fund payees are decoded once per chain params instance. The payout of a
+ * dev fund period sums the shares of all blocks in the period, the result is kept
+ * by payout height and previous block so repeated coinstake attempts and the
+ * validation of the staked block don't walk the period again.
+ */
+class CStakeRewardCache
+{
+public:
+    /** Get the dev fund in effect at nTime, false if there is none */
+    bool GetDevFund(int64_t nTime, CDevFundPayee &payee);
+
+    /** True if keyId is the dev fund address in effect at nTime */
+    bool IsDevFundKey(int64_t nTime, const CKeyID &keyId);
+
+    /**
+     * Get the dev fund payout of the block at nHeight following pindexPrev:
+     * the settings' share of the stake rewards of the nDevOutputPeriod blocks up to pindexPrev.
+     * cs_main must be held or pindexPrev must not be pruned from the block index.
+     */
+    CAmount GetDevFundReward(const CBlockIndex *pindexPrev, int nHeight, const DevFundSettings &settings);
+
+    void Clear();
+
+private:
+    struct DevRewardKey
+    {
+        int nHeight;
+        uint256 hashPrev;
+        int nPercent;
+        int nPeriod;
+        int64_t nCoinYearReward;
+
+        bool operator<(const DevRewardKey &b) const;
+    };
+
+    void LoadPayees() EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    CCriticalSection cs;
+    const CChainParams *m_params GUARDED_BY(cs) = nullptr;
+    std::vector<std::pair<int64_t, CDevFundPayee> > m_payees GUARDED_BY(cs);
+    std::map<DevRewardKey, CAmount> m_dev_rewards GUARDED_BY(cs);
+};
+
+extern CStakeRewardCache g_stake_reward_cache;
+
+#endif // BITCOINC_POS_REWARD_H
@@ -0,0 +1,94 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pos/stakeindex.h>
+
+#include <chain.h>
+#include <primitives/block.h>
+#include <undo.h>
+
+CStakeInputIndex g_stake_input_index;
+
+void CStakeInputIndex::AddBlock(const CBlock &block, const CBlockUndo &blockundo, const CBlockIndex *pindex)
+{
+    AssertLockHeld(cs_main);
+
+    size_t nUndo = 0;
+    for (const auto &tx : block.vtx) {
+        if (tx->IsCoinBase()) {
+            continue;
+        }
+        if (nUndo >= blockundo.vtxundo.size()) {
+            break;
+        }
+        const CTxUndo &txundo = blockundo.vtxundo[nUndo++];
+
+        // UpdateCoins writes no undo coin for anon inputs
+        size_t nPrevout = 0;
+        for (const auto &txin : tx->vin) {
+            if (txin.IsAnonInput()) {
+                continue;
+            }
+            if (nPrevout >= txundo.vprevout.size()) {
+                break;
+            }
+            const Coin &coin = txundo.vprevout[nPrevout++];
+            if (coin.nType != OUTPUT_STANDARD) {
+                continue;
+            }
+            const CBlockIndex *pindexFrom = pindex->GetAncestor(coin.nHeight);
+            if (!pindexFrom) {
+                continue;
+            }
+
+            CStakeInput &input = m_inputs[txin.prevout];
+            input.nValue = coin.out.nValue;
+            input.nHeight = coin.nHeight;
+            input.hashBlock = pindexFrom->GetBlockHash();
+            input.scriptPubKey = coin.out.scriptPubKey;
+            input.nSpendHeight = pindex->nHeight;
+            m_spent_order.emplace_back(pindex->nHeight, txin.prevout);
+        }
+    }
+
+    Prune(pindex->nHeight);
+}
+
+bool CStakeInputIndex::Get(const COutPoint &prevout, CStakeInput &input) const
+{
+    AssertLockHeld(cs_main);
+
+    const auto mi = m_inputs.find(prevout);
+    if (mi == m_inputs.end()) {
+        return false;
+    }
+    input = mi->second;
+    return true;
+}
+
+void CStakeInputIndex::Prune(int nTipHeight, int nDepth)
+{
+    AssertLockHeld(cs_main);
+
+    while (!m_spent_order.empty()) {
+        const auto &front = m_spent_order.front();
+        if (front.first > nTipHeight - nDepth) {
+            break;
+        }
+        const auto mi = m_inputs.find(front.second);
+        // The outpoint may have been spent again at a later height after a reorg
+        if (mi != m_inputs.end() && mi->second.nSpendHeight == front.first) {
+            m_inputs.erase(mi);
+        }
+        m_spent_order.pop_front();
+    }
+}
+
+void CStakeInputIndex::Clear()
+{
+    AssertLockHeld(cs_main);
+
+    m_inputs.clear();
+    m_spent_order.clear();
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_POS_STAKEINDEX_H
+#define BITCOINC_POS_STAKEINDEX_H
+
+#include <amount.h>
+#include <coins.h>
+#include <primitives/transaction.h>
+#include <script/script.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <deque>
+#include <unordered_map>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+
+extern CCriticalSection cs_main;
+
+/** Number of blocks a spent output stays in the stake input index */
+static const int STAKE_INPUT_INDEX_DEPTH = 1000;
+
+/** What CheckProofOfStake needs to know about a spent standard output */
+struct CStakeInput
+{
+    CAmount nValue;
+    int nHeight;        // Height of the block the output was created in
+    uint256 hashBlock;  // Hash of the block the output was created in
+    CScript scriptPubKey;
+    int nSpendHeight;
+};
+
+/**
+ * Recently spent standard outputs, keyed by outpoint.
+ * Coinstakes on competing branches commonly spend outputs already spent in
+ * the active chain, the index lets the kernel check resolve them without
+ * reading the prevout tx and walking the chain to check its age.
+ * Entries are only hints, the caller must check hashBlock is in the active chain.
+ */
+class CStakeInputIndex
+{
+public:
+    /** Record the standard outputs spent by block, pindex must be connected */
+    void AddBlock(const CBlock &block, const CBlockUndo &blockundo, const CBlockIndex *pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    bool Get(const COutPoint &prevout, CStakeInput &input) const EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    /** Drop entries spent more than nDepth blocks below nTipHeight */
+    void Prune(int nTipHeight, int nDepth = STAKE_INPUT_INDEX_DEPTH) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    void Clear() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    size_t Size() const EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return m_inputs.size(); }
+
+private:
+    std::unordered_map<COutPoint, CStakeInput, SaltedOutpointHasher> m_inputs;
+    std::deque<std::pair<int, COutPoint> > m_spent_order;
+};
+
+extern CStakeInputIndex g_stake_input_index;
+
+#endif // BITCOINC_POS_STAKEINDEX_H
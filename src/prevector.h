@@ -13,6 +13,7 @@
 #include <cstddef>
 #include <iterator>
 #include <type_traits>
+#include <utility>
 
 #include <compat.h>
 
@@ -148,7 +149,8 @@ public:
     };
 
 private:
-    size_type _size;
+    // The union comes first so that inline elements start at the beginning
+    // of the object, types wider than a char stay aligned with it.
     union direct_or_indirect {
         char direct[sizeof(T) * N];
         struct {
@@ -156,6 +158,7 @@ private:
             char* indirect;
         };
     } _union;
+    size_type _size;
 
     T* direct_ptr(difference_type pos) { return reinterpret_cast<T*>(_union.direct) + pos; }
     const T* direct_ptr(difference_type pos) const { return reinterpret_cast<const T*>(_union.direct) + pos; }
@@ -169,7 +172,7 @@ private:
                 T* indirect = indirect_ptr(0);
                 T* src = indirect;
                 T* dst = direct_ptr(0);
-                memcpy(dst, src, size() * sizeof(T));
+                memcpy(static_cast<void*>(dst), src, size() * sizeof(T));
                 free(indirect);
                 _size -= N + 1;
             }
@@ -186,7 +189,7 @@ private:
                 assert(new_indirect);
                 T* src = direct_ptr(0);
                 T* dst = reinterpret_cast<T*>(new_indirect);
-                memcpy(dst, src, size() * sizeof(T));
+                memcpy(static_cast<void*>(dst), src, size() * sizeof(T));
                 _union.indirect = new_indirect;
                 _union.capacity = new_capacity;
                 _size += N + 1;
@@ -202,7 +205,7 @@ private:
             // The most common use of prevector is where T=unsigned char. For
             // trivially constructible types, we can use memset() to avoid
             // looping.
-            ::memset(dst, 0, count * sizeof(T));
+            ::memset(static_cast<void*>(dst), 0, count * sizeof(T));
         } else {
             for (auto i = 0; i < count; ++i) {
                 new(static_cast<void*>(dst + i)) T();
@@ -246,7 +249,7 @@ public:
         fill(item_ptr(0), first, last);
     }
 
-    prevector() : _size(0), _union{{}} {}
+    prevector() : _union{{}}, _size(0) {}
 
     explicit prevector(size_type n) : _size(0) {
         resize(n);
@@ -362,7 +365,7 @@ public:
             change_capacity(new_size + (new_size >> 1));
         }
         T* ptr = item_ptr(p);
-        memmove(ptr + 1, ptr, (size() - p) * sizeof(T));
+        memmove(static_cast<void*>(ptr + 1), ptr, (size() - p) * sizeof(T));
         _size++;
         new(static_cast<void*>(ptr)) T(value);
         return iterator(ptr);
@@ -375,7 +378,7 @@ public:
             change_capacity(new_size + (new_size >> 1));
         }
         T* ptr = item_ptr(p);
-        memmove(ptr + count, ptr, (size() - p) * sizeof(T));
+        memmove(static_cast<void*>(ptr + count), ptr, (size() - p) * sizeof(T));
         _size += count;
         fill(item_ptr(p), count, value);
     }
@@ -389,7 +392,7 @@ public:
             change_capacity(new_size + (new_size >> 1));
         }
         T* ptr = item_ptr(p);
-        memmove(ptr + count, ptr, (size() - p) * sizeof(T));
+        memmove(static_cast<void*>(ptr + count), ptr, (size() - p) * sizeof(T));
         _size += count;
         fill(ptr, first, last);
     }
@@ -416,19 +419,28 @@ public:
         } else {
             _size -= last - p;
         }
-        memmove(&(*first), &(*last), endp - ((char*)(&(*last))));
+        memmove(static_cast<void*>(&(*first)), &(*last), endp - ((char*)(&(*last))));
         return first;
     }
 
-    void push_back(const T& value) {
+    template<typename... Args>
+    void emplace_back(Args&&... args) {
         size_type new_size = size() + 1;
         if (capacity() < new_size) {
             change_capacity(new_size + (new_size >> 1));
         }
-        new(item_ptr(size())) T(value);
+        new(item_ptr(size())) T(std::forward<Args>(args)...);
         _size++;
     }
 
+    void push_back(const T& value) {
+        emplace_back(value);
+    }
+
+    void push_back(T&& value) {
+        emplace_back(std::move(value));
+    }
+
     void pop_back() {
         erase(end() - 1, end());
     }
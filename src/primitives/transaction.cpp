@@ -54,6 +54,31 @@ std::string CTxOut::ToString() const
     return strprintf("CTxOut(nValue=%d.%08d, scriptPubKey=%s)", nValue / COIN, nValue % COIN, HexStr(scriptPubKey).substr(0, 30));
 }
 
+// A hostile output count can't reserve more than this many outputs up front
+static const size_t MAX_TXOUT_ARENA_RESERVE = 256;
+// The shared_ptr control block holding the allocator, placed with each output
+static const size_t TXOUT_ARENA_NODE_OVERHEAD = 48;
+
+std::shared_ptr<CTxOutArena> CTxOutArena::Make(size_t nOutputs)
+{
+    size_t nNodeSize = std::max(sizeof(CTxOutStandard), std::max(sizeof(CTxOutRingCT), sizeof(CTxOutData))) + TXOUT_ARENA_NODE_OVERHEAD;
+    return std::make_shared<CTxOutArena>(std::min(nOutputs, MAX_TXOUT_ARENA_RESERVE) * nNodeSize);
+}
+
+void *CTxOutArena::Allocate(size_t nBytes, size_t nAlign)
+{
+    uintptr_t pos = ((uintptr_t)m_pos + nAlign - 1) & ~(uintptr_t)(nAlign - 1);
+    if (!m_pos || pos + nBytes > (uintptr_t)m_end) {
+        size_t nChunk = std::max(m_chunk_size, nBytes + nAlign);
+        m_chunks.emplace_back(new char[nChunk]);
+        m_pos = m_chunks.back().get();
+        m_end = m_pos + nChunk;
+        pos = ((uintptr_t)m_pos + nAlign - 1) & ~(uintptr_t)(nAlign - 1);
+    }
+    m_pos = (char*)(pos + nBytes);
+    return (void*)pos;
+}
+
 void CTxOutBase::SetValue(int64_t value)
 {
     // convenience function intended for use with CTxOutStandard only
@@ -151,6 +176,25 @@ uint256 CMutableTransaction::GetHash() const
     return SerializeHash(*this, SER_GETHASH, SERIALIZE_TRANSACTION_NO_WITNESS);
 }
 
+CTxHasher::CTxHasher(const CMutableTransaction &tx) : CTxHasher(0)
+{
+    if (IsBitcoinCTxVersion(tx.nVersion))
+        SerializeTransaction(tx, *this);
+}
+
+uint256 CTxHasher::GetWitnessHash(const std::vector<CTxIn> &vin)
+{
+    // Read without witness, the wtxid is of the transaction with empty witness stacks
+    if (nVersion & SERIALIZE_TRANSACTION_NO_WITNESS)
+    {
+        BeginWitnessData();
+        for (const auto &txin : vin)
+            *this << txin.scriptWitness.stack;
+        EndWitnessData(false);
+    };
+    return m_wtxid.GetHash();
+}
+
 uint256 CTransaction::ComputeHash() const
 {
     return SerializeHash(*this, SER_GETHASH, SERIALIZE_TRANSACTION_NO_WITNESS);
@@ -168,8 +212,14 @@ uint256 CTransaction::ComputeWitnessHash() const
 
 /* For backward compatibility, the hash is initialized to 0. TODO: remove the need for this default constructor entirely. */
 CTransaction::CTransaction() : vin(), vout(), vpout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), hash{}, m_witness_hash{} {}
-CTransaction::CTransaction(const CMutableTransaction &tx) : vin(tx.vin), vout(tx.vout), vpout{DeepCopy(tx.vpout)}, nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
-CTransaction::CTransaction(CMutableTransaction &&tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), vpout(std::move(tx.vpout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
+CTransaction::CTransaction(const CMutableTransaction &tx) : CTransaction(tx, CTxHasher(tx)) {}
+CTransaction::CTransaction(CMutableTransaction &&tx) : CTransaction(std::move(tx), CTxHasher(tx)) {}
+CTransaction::CTransaction(const CMutableTransaction &tx, CTxHasher &&hasher) : vin(tx.vin), vout(tx.vout), vpout{DeepCopy(tx.vpout)}, nVersion(tx.nVersion), nLockTime(tx.nLockTime),
+    hash{IsBitcoinCTxVersion(nVersion) ? hasher.GetTxid() : ComputeHash()},
+    m_witness_hash{IsBitcoinCTxVersion(nVersion) ? hasher.GetWitnessHash(vin) : ComputeWitnessHash()} {}
+CTransaction::CTransaction(CMutableTransaction &&tx, CTxHasher &&hasher) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), vpout(std::move(tx.vpout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime),
+    hash{IsBitcoinCTxVersion(nVersion) ? hasher.GetTxid() : ComputeHash()},
+    m_witness_hash{IsBitcoinCTxVersion(nVersion) ? hasher.GetWitnessHash(vin) : ComputeWitnessHash()} {}
 
 CAmount CTransaction::GetValueOut() const
 {
@@ -7,7 +7,10 @@
 #define BITCOIN_PRIMITIVES_TRANSACTION_H
 
 #include <stdint.h>
+#include <memory>
+#include <vector>
 #include <amount.h>
+#include <hash.h>
 #include <script/script.h>
 #include <serialize.h>
 #include <uint256.h>
@@ -198,6 +201,95 @@ public:
     std::string ToString() const;
 };
 
+struct CMutableTransaction;
+
+/**
+ * Hashes the serialization of a BitcoinC transaction into its txid and wtxid in
+ * one pass. The txid covers the serialization without witness data, so the bytes
+ * marked with BeginTxWitnessData/EndTxWitnessData only go to the wtxid.
+ */
+class CTxHasher
+{
+private:
+    CHashWriter m_txid;
+    CHashWriter m_wtxid;
+    const int nVersion;
+    bool m_witness_data = false;
+
+public:
+    explicit CTxHasher(int nVersionIn) : m_txid(SER_GETHASH, SERIALIZE_TRANSACTION_NO_WITNESS), m_wtxid(SER_GETHASH, 0), nVersion(nVersionIn) {}
+    explicit CTxHasher(const CMutableTransaction &tx);
+
+    int GetType() const { return SER_GETHASH; }
+    int GetVersion() const { return nVersion; }
+
+    void write(const char *pch, size_t nSize)
+    {
+        if (!m_witness_data)
+            m_txid.write(pch, nSize);
+        m_wtxid.write(pch, nSize);
+    }
+
+    template<typename T>
+    CTxHasher& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj);
+        return (*this);
+    }
+
+    void BeginWitnessData() { m_witness_data = true; }
+
+    //! Witness data serialized as a vector is an empty vector without witness
+    void EndWitnessData(bool fAsEmptyVector)
+    {
+        m_witness_data = false;
+        if (fAsEmptyVector)
+            WriteCompactSize(m_txid, 0);
+    }
+
+    // Each invalidates its hasher
+    uint256 GetTxid() { return m_txid.GetHash(); }
+    uint256 GetWitnessHash(const std::vector<CTxIn> &vin);
+};
+
+/** Reads from a stream, hashing the bytes read into a CTxHasher. */
+template<typename Source>
+class CTxHashReader
+{
+private:
+    Source &m_source;
+    CTxHasher m_hasher;
+
+public:
+    explicit CTxHashReader(Source &source) : m_source(source), m_hasher(source.GetVersion()) {}
+
+    int GetType() const { return m_source.GetType(); }
+    int GetVersion() const { return m_source.GetVersion(); }
+
+    void read(char *pch, size_t nSize)
+    {
+        m_source.read(pch, nSize);
+        m_hasher.write(pch, nSize);
+    }
+
+    template<typename T>
+    CTxHashReader<Source>& operator>>(T&& obj)
+    {
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+
+    CTxHasher &GetHasher() { return m_hasher; }
+};
+
+/** Mark serialized transaction data left out of the txid, only a CTxHasher acts on it. */
+template<typename Stream> inline void BeginTxWitnessData(Stream &s) {}
+template<typename Stream> inline void EndTxWitnessData(Stream &s, bool fAsEmptyVector) {}
+inline void BeginTxWitnessData(CTxHasher &s) { s.BeginWitnessData(); }
+inline void EndTxWitnessData(CTxHasher &s, bool fAsEmptyVector) { s.EndWitnessData(fAsEmptyVector); }
+template<typename Source> inline void BeginTxWitnessData(CTxHashReader<Source> &s) { s.GetHasher().BeginWitnessData(); }
+template<typename Source> inline void EndTxWitnessData(CTxHashReader<Source> &s, bool fAsEmptyVector) { s.GetHasher().EndWitnessData(fAsEmptyVector); }
+
 class CTxOutStandard;
 class CTxOutRingCT;
 class CTxOutData;
@@ -291,6 +383,58 @@ public:
 typedef OUTPUT_PTR<CTxOutBase> CTxOutBaseRef;
 #define MAKE_OUTPUT std::make_shared
 
+/**
+ * Bump allocator for the outputs of one deserialized transaction, their objects and shared_ptr
+ * control blocks are placed contiguously in a few chunks instead of one heap allocation each.
+ * Memory is only returned when the arena is destroyed, which is once every output allocated
+ * from it is released, as each control block holds a reference.
+ * Not thread safe, allocate only while deserializing.
+ */
+class CTxOutArena
+{
+public:
+    /** Arena sized for nOutputs outputs, larger transactions grow it in chunks */
+    static std::shared_ptr<CTxOutArena> Make(size_t nOutputs);
+
+    explicit CTxOutArena(size_t nChunkSize) : m_chunk_size(nChunkSize) {};
+
+    void *Allocate(size_t nBytes, size_t nAlign);
+
+private:
+    size_t m_chunk_size;
+    std::vector<std::unique_ptr<char[]> > m_chunks;
+    char *m_pos = nullptr;
+    char *m_end = nullptr;
+};
+
+template<typename T>
+class CTxOutArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    std::shared_ptr<CTxOutArena> m_arena;
+
+    explicit CTxOutArenaAllocator(std::shared_ptr<CTxOutArena> arena) : m_arena(std::move(arena)) {};
+    template<typename U>
+    CTxOutArenaAllocator(const CTxOutArenaAllocator<U> &other) : m_arena(other.m_arena) {};
+
+    T *allocate(size_t n) { return static_cast<T*>(m_arena->Allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *p, size_t n) {} // Freed with the arena
+
+    template<typename U>
+    bool operator==(const CTxOutArenaAllocator<U> &other) const { return m_arena == other.m_arena; }
+    template<typename U>
+    bool operator!=(const CTxOutArenaAllocator<U> &other) const { return m_arena != other.m_arena; }
+};
+
+/** Construct an output of type T in arena */
+template<typename T>
+OUTPUT_PTR<T> MakeArenaOutput(const std::shared_ptr<CTxOutArena> &arena)
+{
+    return std::allocate_shared<T>(CTxOutArenaAllocator<T>(arena));
+}
+
 class CTxOutStandard : public CTxOutBase
 {
 public:
@@ -372,7 +516,9 @@ public:
 
         if (fAllowWitness)
         {
+            BeginTxWitnessData(s);
             s << vRangeproof;
+            EndTxWitnessData(s, true);
         } else
         {
             WriteCompactSize(s, 0);
@@ -386,7 +532,9 @@ public:
         s.read((char*)&commitment.data[0], 33);
         s >> vData;
         s >> vecSignature;
+        BeginTxWitnessData(s);
         s >> vRangeproof;
+        EndTxWitnessData(s, true);
     };
 
     bool PutValue(std::vector<uint8_t> &vchAmount) const override
@@ -500,8 +648,6 @@ public:
     std::string ToString() const;
 };
 
-struct CMutableTransaction;
-
 /**
  * Basic transaction serialization format:
  * - int32_t nVersion
@@ -541,6 +687,10 @@ inline void UnserializeTransaction(TxType& tx, Stream& s) {
 
         size_t nOutputs = ReadCompactSize(s);
         tx.vpout.resize(nOutputs);
+        std::shared_ptr<CTxOutArena> arena;
+        if (nOutputs > 0) {
+            arena = CTxOutArena::Make(nOutputs);
+        }
         for (size_t k = 0; k < tx.vpout.size(); ++k)
         {
             s >> bv;
@@ -548,13 +698,13 @@ inline void UnserializeTransaction(TxType& tx, Stream& s) {
             switch (bv)
             {
                 case OUTPUT_STANDARD:
-                    tx.vpout[k] = MAKE_OUTPUT<CTxOutStandard>();
+                    tx.vpout[k] = MakeArenaOutput<CTxOutStandard>(arena);
                     break;
                 case OUTPUT_RINGCT:
-                    tx.vpout[k] = MAKE_OUTPUT<CTxOutRingCT>();
+                    tx.vpout[k] = MakeArenaOutput<CTxOutRingCT>(arena);
                     break;
                 case OUTPUT_DATA:
-                    tx.vpout[k] = MAKE_OUTPUT<CTxOutData>();
+                    tx.vpout[k] = MakeArenaOutput<CTxOutData>(arena);
                     break;
                 default:
                     return;
@@ -566,8 +716,10 @@ inline void UnserializeTransaction(TxType& tx, Stream& s) {
 
         if (fAllowWitness)
         {
+            BeginTxWitnessData(s);
             for (auto &txin : tx.vin)
                 s >> txin.scriptWitness.stack;
+            EndTxWitnessData(s, false);
         };
         return;
     };
@@ -635,8 +787,10 @@ inline void SerializeTransaction(const TxType& tx, Stream& s) {
 
         if (fAllowWitness)
         {
+            BeginTxWitnessData(s);
             for (auto &txin : tx.vin)
                 s << txin.scriptWitness.stack;
+            EndTxWitnessData(s, false);
         };
         return;
     };
@@ -704,6 +858,13 @@ private:
     uint256 ComputeHash() const;
     uint256 ComputeWitnessHash() const;
 
+    // BitcoinC transactions take both hashes from the hasher, others compute them
+    CTransaction(const CMutableTransaction &tx, CTxHasher &&hasher);
+    CTransaction(CMutableTransaction &&tx, CTxHasher &&hasher);
+
+    template <typename Source>
+    explicit CTransaction(CTxHashReader<Source> &&reader) : CTransaction(CMutableTransaction(deserialize, reader), std::move(reader.GetHasher())) {}
+
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
     CTransaction();
@@ -719,9 +880,10 @@ public:
     }
 
     /** This deserializing constructor is provided instead of an Unserialize method.
-     *  Unserialize is not possible, since it would require overwriting const fields. */
+     *  Unserialize is not possible, since it would require overwriting const fields.
+     *  The hashes are computed from the bytes as they are read. */
     template <typename Stream>
-    CTransaction(deserialize_type, Stream& s) : CTransaction(CMutableTransaction(deserialize, s)) {}
+    CTransaction(deserialize_type, Stream& s) : CTransaction(CTxHashReader<Stream>(s)) {}
 
     bool IsNull() const {
         return vin.empty() && vout.empty() && vpout.empty();
@@ -836,6 +836,9 @@ QString formatServicesStr(quint64 mask)
             case NODE_SMSG:
                 strList.append("SMSG");
                 break;
+            case NODE_COMPACT_FILTERS:
+                strList.append("COMPACT_FILTERS");
+                break;
             default:
                 strList.append(QString("%1[%2]").arg("UNKNOWN").arg(check));
             }
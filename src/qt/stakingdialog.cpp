@@ -173,7 +173,7 @@ void StakingDialog::updateStakingUI(bool fForce)
         }
     }
 
-    ui->lblTotalSupply->setText(BitcoinUnits::formatWithUnit(nDisplayUnit, chainActive.Tip()->nMoneySupply));
+    ui->lblTotalSupply->setText(BitcoinUnits::formatWithUnit(nDisplayUnit, chainActive.Tip()->GetMoneySupply()));
 
     sCommand = QString("getblockreward %1").arg(chainActive.Tip()->nHeight);
     if (model->tryCallRpc(sCommand, rv)) {
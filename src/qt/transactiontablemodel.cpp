@@ -28,6 +28,8 @@
 #include <QIcon>
 #include <QList>
 
+#include <set>
+
 // Amount columns are right-aligned
 static int column_alignments[] = {
         Qt::AlignLeft|Qt::AlignVCenter, /* status */
@@ -40,22 +42,8 @@ static int column_alignments[] = {
         Qt::AlignRight|Qt::AlignVCenter, /* amount */
     };
 
-// Comparison operator for sort/binary search of model tx list
-struct TxLessThan
-{
-    bool operator()(const TransactionRecord &a, const TransactionRecord &b) const
-    {
-        return a.hash < b.hash;
-    }
-    bool operator()(const TransactionRecord &a, const uint256 &b) const
-    {
-        return a.hash < b;
-    }
-    bool operator()(const uint256 &a, const TransactionRecord &b) const
-    {
-        return a < b.hash;
-    }
-};
+// Number of wallet transactions decomposed for each page the views fetch
+static const size_t TX_PAGE_SIZE = 500;
 
 // Private implementation
 class TransactionTablePriv
@@ -69,26 +57,78 @@ public:
     TransactionTableModel *parent;
     bool fStaking;
 
-    /* Local cache of wallet.
-     * As it is in the same order as the CWallet, by definition
-     * this is sorted by sha256.
+    /* Local cache of the wallet transactions fetched so far.
+     * Pages are appended newest first in the order of the wallet's transaction indexes,
+     * transactions the core notifies about are added at the top.
+     * The records of a transaction are adjacent.
      */
     QList<TransactionRecord> cachedWallet;
 
-    /* Query entire wallet anew from core.
+    /* Transactions in cachedWallet, to skip them when a page overlaps the notified transactions. */
+    std::set<uint256> cachedTxs;
+
+    /* Position of the next page in the wallet's transaction indexes. */
+    interfaces::WalletTxPagePos pagePos;
+
+    /* Query the first page of the wallet anew from core.
      */
     void refreshWallet(interfaces::Wallet& wallet)
     {
         qDebug() << "TransactionTablePriv::refreshWallet";
         cachedWallet.clear();
-        {
-            for (const auto& wtx : wallet.getWalletTxs()) {
-                if (TransactionRecord::showTransaction()) {
+        cachedTxs.clear();
+        pagePos = interfaces::WalletTxPagePos();
+        fetchPage(wallet, false);
+    }
+
+    bool canFetchMore() const
+    {
+        return !pagePos.at_end;
+    }
+
+    /* Decompose the next page of wallet transactions and append their records.
+     */
+    void fetchPage(interfaces::Wallet& wallet, bool fNotify)
+    {
+        QList<TransactionRecord> toInsert;
+        for (const auto& wtx : wallet.getWalletTxsPage(pagePos, fStaking, TX_PAGE_SIZE)) {
+            const uint256 &hash = wtx.is_record ? wtx.irtx->first : wtx.tx->GetHash();
+            if (!cachedTxs.insert(hash).second) {
+                continue; // Already added when the core notified about it
+            }
+            if (TransactionRecord::showTransaction()) {
+                toInsert.append(TransactionRecord::decomposeTransaction(wtx));
+            }
+        }
+        qDebug() << "TransactionTablePriv::fetchPage: " + QString::number(toInsert.size()) + " records";
+
+        if (toInsert.isEmpty()) {
+            return;
+        }
+        if (fNotify) {
+            parent->beginInsertRows(QModelIndex(), cachedWallet.size(), cachedWallet.size()+toInsert.size()-1);
+        }
+        cachedWallet.append(toInsert);
+        if (fNotify) {
+            parent->endInsertRows();
+        }
+    }
 
-                    if( (fStaking && wtx.is_coinstake ) ||
-                        (!fStaking && !wtx.is_coinstake ) )
-                        cachedWallet.append(TransactionRecord::decomposeTransaction(wtx));
+    /* Find the bounds of the records of a transaction in the model, [0, 0) if not present.
+     */
+    void findTransaction(const uint256 &hash, int &lowerIndex, int &upperIndex) const
+    {
+        lowerIndex = upperIndex = 0;
+        if (!cachedTxs.count(hash)) {
+            return;
+        }
+        for (int i = 0; i < cachedWallet.size(); i++) {
+            if (cachedWallet[i].hash == hash) {
+                lowerIndex = upperIndex = i;
+                while (upperIndex < cachedWallet.size() && cachedWallet[upperIndex].hash == hash) {
+                    upperIndex++;
                 }
+                return;
             }
         }
     }
@@ -103,16 +143,14 @@ public:
         qDebug() << "TransactionTablePriv::updateWallet: " + QString::fromStdString(hash.ToString()) + " " + QString::number(status);
 
         // Find bounds of this transaction in model
-        QList<TransactionRecord>::iterator lower = qLowerBound(
-            cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
-        QList<TransactionRecord>::iterator upper = qUpperBound(
-            cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
-        int lowerIndex = (lower - cachedWallet.begin());
-        int upperIndex = (upper - cachedWallet.begin());
-        bool inModel = (lower != upper);
+        int lowerIndex, upperIndex;
+        findTransaction(hash, lowerIndex, upperIndex);
+        bool inModel = (lowerIndex != upperIndex);
 
         if(status == CT_UPDATED)
         {
+            if(!inModel && !cachedTxs.count(hash) && canFetchMore())
+                return; /* Not fetched yet, the page it is in will be read with the update */
             if(showTransaction && !inModel)
                 status = CT_NEW; /* Not in model, but want to show, treat as new */
             if(!showTransaction && inModel)
@@ -128,18 +166,14 @@ public:
         case CT_REPLACE:
             if(inModel)
             {
-            // remove entire transaction from table
+            // remove entire transaction from table, the replacement is inserted in its place
                 parent->beginRemoveRows(QModelIndex(), lowerIndex, upperIndex-1);
-                cachedWallet.erase(lower, upper);
+                cachedWallet.erase(cachedWallet.begin()+lowerIndex, cachedWallet.begin()+upperIndex);
                 parent->endRemoveRows();
 
-                lower = qLowerBound(
-                    cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
-                upper = qUpperBound(
-                    cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
-                lowerIndex = (lower - cachedWallet.begin());
-                upperIndex = (upper - cachedWallet.begin());
-                inModel = (lower != upper);
+                cachedTxs.erase(hash);
+                upperIndex = lowerIndex;
+                inModel = false;
             }
             // drop through
         case CT_NEW:
@@ -162,7 +196,8 @@ public:
                     qWarning() << "TransactionTablePriv::updateWallet: Warning: Got CT_NEW, but transaction is not in wallet";
                     break;
                 }
-                // Added -- insert at the right position
+                cachedTxs.insert(hash);
+                // Added -- insert at the top, or where the replaced transaction was
                 QList<TransactionRecord> toInsert =
                         TransactionRecord::decomposeTransaction(wtx);
                 if(!toInsert.isEmpty()) /* only if something to insert */
@@ -186,8 +221,9 @@ public:
             }
             // Removed -- remove entire transaction from table
             parent->beginRemoveRows(QModelIndex(), lowerIndex, upperIndex-1);
-            cachedWallet.erase(lower, upper);
+            cachedWallet.erase(cachedWallet.begin()+lowerIndex, cachedWallet.begin()+upperIndex);
             parent->endRemoveRows();
+            cachedTxs.erase(hash);
             break;
         case CT_UPDATED:
             // Miscellaneous updates -- nothing to do, status update will take care of this, and is only computed for
@@ -321,6 +357,21 @@ int TransactionTableModel::rowCount(const QModelIndex &parent) const
     return priv->size();
 }
 
+bool TransactionTableModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && priv->canFetchMore();
+}
+
+void TransactionTableModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid()) {
+        return;
+    }
+    priv->fetchPage(walletModel->wallet(), true);
+
+    Q_EMIT transactionsChanged();
+}
+
 int TransactionTableModel::columnCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
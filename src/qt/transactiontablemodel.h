@@ -97,6 +97,9 @@ public:
     QVariant data(const QModelIndex &index, int role) const;
     QVariant headerData(int section, Qt::Orientation orientation, int role) const;
     QModelIndex index(int row, int column, const QModelIndex & parent = QModelIndex()) const;
+    /** Transactions are read from the wallet in pages as the views scroll to them */
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
     bool processingQueuedTransactions() const { return fProcessingQueuedTransactions; }
 
     void getSelected();
@@ -403,6 +403,11 @@ void TransactionView::exportClicked()
     if (filename.isNull())
         return;
 
+    // Export the whole history, not only the pages fetched so far
+    while (transactionProxyModel->canFetchMore(QModelIndex())) {
+        transactionProxyModel->fetchMore(QModelIndex());
+    }
+
     CSVModelWriter writer(filename);
 
     // name, column, role
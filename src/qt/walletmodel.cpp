@@ -470,10 +470,9 @@ static void NotifyAddressBookChanged(WalletModel *walletmodel,
                               Q_ARG(int, status));
 }
 
-static void NotifyTransactionChanged(WalletModel *walletmodel, const uint256 &hash, ChangeType status)
+static void NotifyTransactionsChanged(WalletModel *walletmodel, const std::vector<std::pair<uint256, ChangeType>> &changes)
 {
-    Q_UNUSED(hash);
-    Q_UNUSED(status);
+    Q_UNUSED(changes);
     QMetaObject::invokeMethod(walletmodel, "updateTransaction", Qt::QueuedConnection);
 }
 
@@ -503,7 +502,7 @@ void WalletModel::subscribeToCoreSignals()
     m_handler_unload = m_wallet->handleUnload(boost::bind(&NotifyUnload, this));
     m_handler_status_changed = m_wallet->handleStatusChanged(boost::bind(&NotifyKeyStoreStatusChanged, this));
     m_handler_address_book_changed = m_wallet->handleAddressBookChanged(boost::bind(NotifyAddressBookChanged, this, _1, _2, _3, _4, _5));
-    m_handler_transaction_changed = m_wallet->handleTransactionChanged(boost::bind(NotifyTransactionChanged, this, _1, _2));
+    m_handler_transaction_changed = m_wallet->handleTransactionsChanged(boost::bind(NotifyTransactionsChanged, this, _1));
     m_handler_show_progress = m_wallet->handleShowProgress(boost::bind(ShowProgress, this, _1, _2));
     m_handler_watch_only_changed = m_wallet->handleWatchOnlyChanged(boost::bind(NotifyWatchonlyChanged, this, _1));
 
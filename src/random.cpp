@@ -373,6 +373,56 @@ void GetStrongRandBytes2(unsigned char* out, int num)
     memory_cleanse(buf, 64);
 }
 
+namespace {
+struct FastRandState
+{
+    ChaCha20 rng;
+    uint64_t nOutput = FAST_RAND_RESEED_BYTES; // Seeded on first use
+};
+} // namespace
+
+static thread_local FastRandState g_fast_rand_state;
+
+void GetFastRandBytes(unsigned char* buf, size_t num)
+{
+    FastRandState &state = g_fast_rand_state;
+    unsigned char key[32];
+    if (state.nOutput >= FAST_RAND_RESEED_BYTES) {
+        GetStrongRandBytes(key, 32);
+        state.rng.SetKey(key, 32);
+        state.nOutput = 0;
+    }
+
+    if (num > 0) {
+        state.rng.Output(buf, num);
+    }
+    state.nOutput += num;
+
+    // Fast key erasure, the next key is drawn from the stream
+    state.rng.Output(key, 32);
+    state.rng.SetKey(key, 32);
+    memory_cleanse(key, 32);
+}
+
+uint64_t GetFastRand(uint64_t nMax)
+{
+    if (nMax == 0)
+        return 0;
+
+    // Same rejection sampling as GetRand
+    uint64_t nRange = (std::numeric_limits<uint64_t>::max() / nMax) * nMax;
+    uint64_t nRand = 0;
+    do {
+        GetFastRandBytes((unsigned char*)&nRand, sizeof(nRand));
+    } while (nRand >= nRange);
+    return (nRand % nMax);
+}
+
+int GetFastRandInt(int nMax)
+{
+    return GetFastRand(nMax);
+}
+
 uint64_t GetRand(uint64_t nMax)
 {
     if (nMax == 0)
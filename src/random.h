@@ -40,6 +40,17 @@ void RandAddSeedSleep();
 void GetStrongRandBytes(unsigned char* buf, int num);
 void GetStrongRandBytes2(unsigned char* buf, int num);
 
+/**
+ * Per-thread ChaCha20 stream keyed from GetStrongRandBytes, for high volume randomness
+ * that doesn't protect long term secrets: blinding factors, nonces, IVs and decoy picks.
+ * Takes no lock. The stream key is replaced after every call from the stream itself, so
+ * earlier output can't be recovered from the thread's state, and is reseeded from the
+ * strong RNG after FAST_RAND_RESEED_BYTES of output.
+ */
+void GetFastRandBytes(unsigned char* buf, size_t num);
+uint64_t GetFastRand(uint64_t nMax);
+int GetFastRandInt(int nMax);
+
 /**
  * Fast randomness source. This is seeded once with secure random data, but
  * is completely deterministic and insecure after that.
@@ -133,6 +144,9 @@ public:
     inline uint64_t operator()() { return rand64(); }
 };
 
+/** Output of a thread's GetFastRandBytes stream before it is seeded again from GetStrongRandBytes */
+static const uint64_t FAST_RAND_RESEED_BYTES = 1 << 20;
+
 /* Number of random bytes returned by GetOSRand.
  * When changing this constant make sure to change all call sites, and make
  * sure that the underlying OS APIs for all platforms support the number.
@@ -0,0 +1,40 @@
+// Copyright (c) 2018 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_RCTOUTPUTCACHE_H
+#define BITCOINC_RCTOUTPUTCACHE_H
+
+#include <rctindex.h>
+#include <shardedcache.h>
+
+#include <stdint.h>
+
+//! -rctcachesize default (MiB)
+static const int64_t DEFAULT_RCTCACHESIZE = 4;
+//! max. -rctcachesize (MiB)
+static const int64_t MAX_RCTCACHESIZE = 1024;
+static const size_t RCT_OUTPUT_CACHE_SHARDS = 16;
+
+//! Output indices are spread over the shards by their low bits
+struct RCTIndexHasher
+{
+    size_t operator()(int64_t i) const { return (uint64_t)i; };
+};
+
+/**
+ * Bounded LRU cache of recently read RCT outputs, in front of the block tree db.
+ *
+ * Consecutive indices map to different shards, so threads resolving rings
+ * drawn from the same recent range rarely contend on one lock.
+ */
+class CRCTOutputCache : public CShardedCache<int64_t, CAnonOutput, RCTIndexHasher>
+{
+public:
+    explicit CRCTOutputCache(size_t nMaxBytes)
+        : CShardedCache(nMaxBytes, RCT_OUTPUT_CACHE_SHARDS) {};
+
+    static size_t EntryUsage() { return EntryOverhead(); };
+};
+
+#endif // BITCOINC_RCTOUTPUTCACHE_H
@@ -0,0 +1,248 @@
+// Copyright (c) 2018 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rctoutputfile.h>
+
+#include <crypto/common.h>
+#include <util.h>
+
+#include <algorithm>
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const uint8_t RCT_OUTPUT_FILE_MAGIC[4] = {'R', 'C', 'T', 'O'};
+static const uint32_t RCT_OUTPUT_FILE_VERSION = 1;
+
+static_assert(RCT_OUTPUT_RECORD_SIZE >= 16, "Header must fit in slot 0");
+
+CRCTOutputFile::CRCTOutputFile(const fs::path &pathIn) : path(pathIn)
+{
+};
+
+CRCTOutputFile::~CRCTOutputFile()
+{
+    Close();
+};
+
+#ifdef WIN32
+bool CRCTOutputFile::Open(bool fWipe)
+{
+    LogPrintf("%s: Memory-mapped RCT output file is not supported on this platform.\n", __func__);
+    return false;
+};
+
+void CRCTOutputFile::Close()
+{
+};
+
+bool CRCTOutputFile::Reserve(int64_t i)
+{
+    return false;
+};
+
+bool CRCTOutputFile::Flush()
+{
+    return false;
+};
+#else
+bool CRCTOutputFile::Open(bool fWipe)
+{
+    boost::unique_lock<boost::shared_mutex> lock(cs_file);
+
+    fd = open(path.string().c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return error("%s: Failed to open %s.", __func__, path.string());
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        fd = -1;
+        return error("%s: fstat failed.", __func__);
+    };
+
+    bool fInit = fWipe || (size_t)st.st_size < RCT_OUTPUT_RECORD_SIZE;
+    if (fWipe && ftruncate(fd, 0) != 0)
+    {
+        close(fd);
+        fd = -1;
+        return error("%s: Failed to truncate %s.", __func__, path.string());
+    };
+
+    nMapped = fInit ? 0 : (size_t)st.st_size - ((size_t)st.st_size % RCT_OUTPUT_RECORD_SIZE);
+    if (!fInit && nMapped > 0)
+    {
+        void *p = mmap(nullptr, nMapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            close(fd);
+            fd = -1;
+            nMapped = 0;
+            return error("%s: mmap failed.", __func__);
+        };
+        pBase = (uint8_t*)p;
+
+        if (memcmp(pBase, RCT_OUTPUT_FILE_MAGIC, 4) != 0
+            || ReadLE32(pBase + 4) != RCT_OUTPUT_FILE_VERSION)
+        {
+            LogPrintf("%s: Unknown header in %s, resetting.\n", __func__, path.string());
+            fInit = true;
+        };
+    };
+
+    if (!Reserve(0))
+    {
+        Close();
+        return error("%s: Failed to map %s.", __func__, path.string());
+    };
+
+    if (fInit)
+    {
+        memset(pBase, 0, RCT_OUTPUT_RECORD_SIZE);
+        memcpy(pBase, RCT_OUTPUT_FILE_MAGIC, 4);
+        WriteLE32(pBase + 4, RCT_OUTPUT_FILE_VERSION);
+        SetLastValid(0);
+    } else
+    {
+        // Never trust a header pointing past the end of the file
+        int64_t nStored = (int64_t)ReadLE64(pBase + 8);
+        int64_t nCapacity = (int64_t)(nMapped / RCT_OUTPUT_RECORD_SIZE) - 1;
+        SetLastValid(std::max((int64_t)0, std::min(nStored, nCapacity)));
+    };
+
+    LogPrintf("%s: Opened %s, %d outputs.\n", __func__, path.string(), nLastValid);
+    return true;
+};
+
+void CRCTOutputFile::Close()
+{
+    if (pBase)
+    {
+        msync(pBase, nMapped, MS_SYNC);
+        munmap(pBase, nMapped);
+        pBase = nullptr;
+    };
+    nMapped = 0;
+    nLastValid = 0;
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    };
+};
+
+bool CRCTOutputFile::Reserve(int64_t i)
+{
+    // cs_file must be held exclusively
+    size_t nRequired = (size_t)(i + 1) * RCT_OUTPUT_RECORD_SIZE;
+    if (pBase && nRequired <= nMapped)
+        return true;
+
+    size_t nNewSize = (size_t)((i / RCT_OUTPUT_FILE_CHUNK) + 1) * RCT_OUTPUT_FILE_CHUNK * RCT_OUTPUT_RECORD_SIZE;
+    if (ftruncate(fd, nNewSize) != 0)
+        return error("%s: ftruncate failed.", __func__);
+
+    if (pBase)
+        munmap(pBase, nMapped);
+    pBase = nullptr;
+
+    void *p = mmap(nullptr, nNewSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        nMapped = 0;
+        return error("%s: mmap failed.", __func__);
+    };
+    pBase = (uint8_t*)p;
+    nMapped = nNewSize;
+
+    return true;
+};
+
+bool CRCTOutputFile::Flush()
+{
+    boost::shared_lock<boost::shared_mutex> lock(cs_file);
+    if (!pBase)
+        return false;
+    return msync(pBase, nMapped, MS_SYNC) == 0;
+};
+#endif
+
+void CRCTOutputFile::SetLastValid(int64_t i)
+{
+    nLastValid = i;
+    WriteLE64(pBase + 8, (uint64_t)i);
+};
+
+int64_t CRCTOutputFile::GetLastValid() const
+{
+    boost::shared_lock<boost::shared_mutex> lock(cs_file);
+    return nLastValid;
+};
+
+bool CRCTOutputFile::Read(int64_t i, CAnonOutput &ao) const
+{
+    boost::shared_lock<boost::shared_mutex> lock(cs_file);
+    if (!pBase || i < 1 || i > nLastValid)
+        return false;
+
+    const uint8_t *p = pBase + i * RCT_OUTPUT_RECORD_SIZE;
+    if (p[0] != 1)
+        return false;
+
+    Decode(p, ao);
+    return true;
+};
+
+bool CRCTOutputFile::Write(int64_t i, const CAnonOutput &ao)
+{
+    boost::unique_lock<boost::shared_mutex> lock(cs_file);
+    if (!pBase || i < 1 || i > nLastValid + 1)
+        return false;
+
+    if (!Reserve(i))
+        return false;
+
+    Encode(ao, pBase + i * RCT_OUTPUT_RECORD_SIZE);
+    if (i > nLastValid)
+        SetLastValid(i);
+
+    return true;
+};
+
+void CRCTOutputFile::Erase(int64_t i)
+{
+    boost::unique_lock<boost::shared_mutex> lock(cs_file);
+    if (!pBase || i < 1 || i > nLastValid)
+        return;
+
+    pBase[i * RCT_OUTPUT_RECORD_SIZE] = 0;
+    SetLastValid(i - 1);
+};
+
+void CRCTOutputFile::Encode(const CAnonOutput &ao, uint8_t *p)
+{
+    p[0] = 1;
+    memcpy(p + 1, ao.pubkey.begin(), 33);
+    memcpy(p + 34, &ao.commitment.data[0], 33);
+    memcpy(p + 67, ao.outpoint.hash.begin(), 32);
+    WriteLE32(p + 99, ao.outpoint.n);
+    WriteLE32(p + 103, (uint32_t)ao.nBlockHeight);
+    p[107] = ao.nCompromised;
+};
+
+void CRCTOutputFile::Decode(const uint8_t *p, CAnonOutput &ao)
+{
+    ao.pubkey.Set(p + 1, p + 34);
+    memcpy(&ao.commitment.data[0], p + 34, 33);
+    memcpy(ao.outpoint.hash.begin(), p + 67, 32);
+    ao.outpoint.n = ReadLE32(p + 99);
+    ao.nBlockHeight = (int)ReadLE32(p + 103);
+    ao.nCompromised = p[107];
+};
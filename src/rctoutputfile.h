@@ -0,0 +1,67 @@
+// Copyright (c) 2018 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_RCTOUTPUTFILE_H
+#define BITCOINC_RCTOUTPUTFILE_H
+
+#include <fs.h>
+#include <rctindex.h>
+
+#include <stdint.h>
+
+#include <boost/thread/shared_mutex.hpp>
+
+static const bool DEFAULT_RCTOUTPUTFILE = false;
+
+//! Width of one record in rctoutputs.dat: flag, pubkey, commitment, outpoint, height, compromised
+static const size_t RCT_OUTPUT_RECORD_SIZE = 1 + 33 + 33 + 32 + 4 + 4 + 1;
+//! The file is grown in steps of this many records
+static const int64_t RCT_OUTPUT_FILE_CHUNK = 1 << 16;
+//! Number of trailing records checked against the db at startup
+static const int64_t RCT_OUTPUT_FILE_CHECK = 1000;
+
+/**
+ * Append-only, memory-mapped copy of the RCT output index (DB_RCTOUTPUT).
+ *
+ * Output i lives at offset i * RCT_OUTPUT_RECORD_SIZE, slot 0 holds the header.
+ * Only the contiguous range [1, GetLastValid()] is served, everything else
+ * must be read from the block tree db, which remains authoritative.
+ */
+class CRCTOutputFile
+{
+public:
+    explicit CRCTOutputFile(const fs::path &pathIn);
+    ~CRCTOutputFile();
+
+    bool Open(bool fWipe);
+    void Close();
+    bool IsOpen() const { return pBase != nullptr; };
+
+    //! Returns false if i is not held in the file
+    bool Read(int64_t i, CAnonOutput &ao) const;
+    //! Only extends the valid range if i is the next index, returns false otherwise
+    bool Write(int64_t i, const CAnonOutput &ao);
+    //! Truncates the valid range to below i
+    void Erase(int64_t i);
+    bool Flush();
+
+    int64_t GetLastValid() const;
+
+    static void Encode(const CAnonOutput &ao, uint8_t *p);
+    static void Decode(const uint8_t *p, CAnonOutput &ao);
+
+private:
+    bool Reserve(int64_t i);
+    void SetLastValid(int64_t i);
+
+    fs::path path;
+    int fd = -1;
+    uint8_t *pBase = nullptr;
+    size_t nMapped = 0;
+    int64_t nLastValid = 0;
+
+    mutable boost::shared_mutex cs_file;
+};
+
+#endif // BITCOINC_RCTOUTPUTFILE_H
@@ -6,7 +6,11 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <core_io.h>
+#include <index/blockfilterindex.h>
 #include <index/txindex.h>
+#include <insight/insight.h>
+#include <key_io.h>
+#include <perfstats.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <validation.h>
@@ -15,6 +19,7 @@
 #include <rpc/server.h>
 #include <streams.h>
 #include <sync.h>
+#include <txdb.h>
 #include <txmempool.h>
 #include <utilstrencodings.h>
 #include <version.h>
@@ -26,6 +31,9 @@
 extern bool fBitcoinCMode;
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const size_t MAX_REST_ANON_OUTPUTS = 10000;
+static const size_t MAX_REST_KEYIMAGES = 1000;
+static const size_t MAX_REST_ADDRESS_TXNS = 1000;
 
 enum class RetFormat {
     UNDEF,
@@ -342,6 +350,14 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
     }
 }
 
+static bool rest_perfstats(HTTPRequest* req, const std::string& strURIPart)
+{
+    // Prometheus text format, the scrape target is /rest/perfstats
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, PerfStatsToPrometheus());
+    return true;
+}
+
 static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -579,6 +595,451 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     }
 }
 
+static bool WriteSerializedReply(HTTPRequest* req, const RetFormat rf, const CDataStream& ss)
+{
+    switch (rf) {
+    case RetFormat::BINARY: {
+        std::string strBinary = ss.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, strBinary);
+        return true;
+    }
+    case RetFormat::HEX: {
+        std::string strHex = HexStr(ss.begin(), ss.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+static bool rest_anonoutputs(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Use /rest/anonoutputs/<start>/<count>.<ext>.");
+
+    int64_t nStart, nCount;
+    if (!ParseInt64(path[0], &nStart) || nStart < 1)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid start index: " + path[0]);
+    if (!ParseInt64(path[1], &nCount) || nCount < 1 || nCount > (int64_t)MAX_REST_ANON_OUTPUTS)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Output count out of range: " + path[1]);
+
+    // Outputs are erased under cs_main when blocks are disconnected
+    std::vector<int64_t> vIndices;
+    std::vector<CAnonOutput> vao;
+    {
+        LOCK(cs_main);
+        int64_t nLast = chainActive.Tip() ? chainActive.Tip()->nAnonOutputs : 0;
+        for (int64_t i = nStart; i <= nLast && i < nStart + nCount; ++i)
+            vIndices.push_back(i);
+        if (!pblocktree->ReadRCTOutputs(vIndices, vao))
+            return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Failed to read anon outputs");
+    }
+
+    switch (rf) {
+    case RetFormat::BINARY:
+    case RetFormat::HEX: {
+        // The first index is known to the caller, the rest follow it
+        CDataStream ssOutputs(SER_NETWORK, PROTOCOL_VERSION);
+        ssOutputs << vao;
+        return WriteSerializedReply(req, rf, ssOutputs);
+    }
+    case RetFormat::JSON: {
+        UniValue result(UniValue::VARR);
+        for (size_t k = 0; k < vao.size(); ++k) {
+            const CAnonOutput &ao = vao[k];
+            UniValue obj(UniValue::VOBJ);
+            obj.pushKV("index", vIndices[k]);
+            obj.pushKV("publickey", HexStr(ao.pubkey.begin(), ao.pubkey.end()));
+            obj.pushKV("commitment", HexStr(&ao.commitment.data[0], &ao.commitment.data[0] + 33));
+            obj.pushKV("txnhash", ao.outpoint.hash.ToString());
+            obj.pushKV("n", (int)ao.outpoint.n);
+            obj.pushKV("blockheight", ao.nBlockHeight);
+            result.push_back(obj);
+        }
+        std::string strJSON = result.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+}
+
+/** Spend status of a key image, the txid is null if unspent */
+struct CKeyImageStatus {
+    uint8_t nStatus = 0; // 0: unspent, 1: spent in chain, 2: spent in mempool
+    uint256 txid;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nStatus);
+        READWRITE(txid);
+    }
+};
+
+static bool rest_keyimages(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    std::vector<std::string> uriParts;
+    if (param.length() > 1) {
+        std::string strUriParams = param.substr(1);
+        boost::split(uriParts, strUriParams, boost::is_any_of("/"));
+    }
+
+    // Key images as hex in the uri, or concatenated in the posted body for .bin and .hex
+    std::vector<CCmpPubKey> vKeyImages;
+    for (const auto &part : uriParts) {
+        std::vector<uint8_t> vKi = ParseHex(part);
+        if (!IsHex(part) || vKi.size() != 33)
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid key image: " + part);
+        vKeyImages.emplace_back(vKi.begin(), vKi.end());
+    }
+
+    std::string strRequestMutable = req->ReadBody();
+    if (!strRequestMutable.empty()) {
+        if (!uriParts.empty())
+            return RESTERR(req, HTTP_BAD_REQUEST, "Combination of URI scheme inputs and raw post data is not allowed");
+        std::vector<uint8_t> vData;
+        if (rf == RetFormat::HEX) {
+            if (!IsHex(strRequestMutable))
+                return RESTERR(req, HTTP_BAD_REQUEST, "Parse error");
+            vData = ParseHex(strRequestMutable);
+        } else if (rf == RetFormat::BINARY) {
+            vData.assign(strRequestMutable.begin(), strRequestMutable.end());
+        } else {
+            return RESTERR(req, HTTP_BAD_REQUEST, "Posted key images require .bin or .hex");
+        }
+        if (vData.size() % 33 != 0)
+            return RESTERR(req, HTTP_BAD_REQUEST, "Parse error");
+        for (size_t i = 0; i < vData.size(); i += 33)
+            vKeyImages.emplace_back(vData.begin() + i, vData.begin() + i + 33);
+    }
+
+    if (vKeyImages.empty())
+        return RESTERR(req, HTTP_BAD_REQUEST, "Error: empty request");
+    if (vKeyImages.size() > MAX_REST_KEYIMAGES)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Error: max key images exceeded (max: %d, tried: %d)", MAX_REST_KEYIMAGES, vKeyImages.size()));
+
+    std::vector<CKeyImageStatus> vStatus(vKeyImages.size());
+    {
+        LOCK(cs_main);
+        for (size_t k = 0; k < vKeyImages.size(); ++k) {
+            if (pblocktree->ReadRCTKeyImage(vKeyImages[k], vStatus[k].txid))
+                vStatus[k].nStatus = 1;
+            else
+            if (mempool.HaveKeyImage(vKeyImages[k], vStatus[k].txid))
+                vStatus[k].nStatus = 2;
+        }
+    }
+
+    switch (rf) {
+    case RetFormat::BINARY:
+    case RetFormat::HEX: {
+        CDataStream ssStatus(SER_NETWORK, PROTOCOL_VERSION);
+        ssStatus << vStatus;
+        return WriteSerializedReply(req, rf, ssStatus);
+    }
+    case RetFormat::JSON: {
+        UniValue result(UniValue::VARR);
+        for (size_t k = 0; k < vKeyImages.size(); ++k) {
+            UniValue obj(UniValue::VOBJ);
+            obj.pushKV("keyimage", HexStr(vKeyImages[k].begin(), vKeyImages[k].end()));
+            obj.pushKV("spent", vStatus[k].nStatus != 0);
+            if (vStatus[k].nStatus != 0) {
+                obj.pushKV("txid", vStatus[k].txid.ToString());
+                obj.pushKV("mempool", vStatus[k].nStatus == 2);
+            }
+            result.push_back(obj);
+        }
+        std::string strJSON = result.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+}
+
+/** An address index entry in the order of the index keys */
+struct CAddressDelta {
+    uint256 txid;
+    int32_t nHeight;
+    uint32_t nTxIndex;
+    uint32_t nIndex;
+    uint8_t fSpending;
+    int64_t nValue;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(txid);
+        READWRITE(nHeight);
+        READWRITE(nTxIndex);
+        READWRITE(nIndex);
+        READWRITE(fSpending);
+        READWRITE(nValue);
+    }
+};
+
+static bool rest_addressdeltas(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 4)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Use /rest/addressdeltas/<address>/<height>/<txindex>/<count>.<ext>.");
+
+    if (!fAddressIndex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Address index not enabled");
+
+    CBitcoinAddress address(path[0]);
+    uint256 hashBytes;
+    int type = 0;
+    if (!address.GetIndexKey(hashBytes, type))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address: " + path[0]);
+
+    // Pages start at (height, txindex), the next page from the last entry returned plus one txn
+    int32_t nFromHeight, nFromTxIndex;
+    int64_t nCount;
+    if (!ParseInt32(path[1], &nFromHeight) || nFromHeight < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + path[1]);
+    if (!ParseInt32(path[2], &nFromTxIndex) || nFromTxIndex < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid txindex: " + path[2]);
+    if (!ParseInt64(path[3], &nCount) || nCount < 1 || nCount > (int64_t)MAX_REST_ADDRESS_TXNS)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Transaction count out of range: " + path[3]);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    if (!GetAddressIndexPage(hashBytes, type, addressIndex, nFromHeight, nFromTxIndex, 0, nCount))
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Failed to read address index");
+
+    std::vector<CAddressDelta> vDeltas(addressIndex.size());
+    for (size_t k = 0; k < addressIndex.size(); ++k) {
+        const CAddressIndexKey &key = addressIndex[k].first;
+        CAddressDelta &delta = vDeltas[k];
+        delta.txid = key.txhash;
+        delta.nHeight = key.blockHeight;
+        delta.nTxIndex = key.txindex;
+        delta.nIndex = key.index;
+        delta.fSpending = key.spending;
+        delta.nValue = addressIndex[k].second;
+    }
+
+    switch (rf) {
+    case RetFormat::BINARY:
+    case RetFormat::HEX: {
+        CDataStream ssDeltas(SER_NETWORK, PROTOCOL_VERSION);
+        ssDeltas << vDeltas;
+        return WriteSerializedReply(req, rf, ssDeltas);
+    }
+    case RetFormat::JSON: {
+        UniValue result(UniValue::VARR);
+        for (const auto &delta : vDeltas) {
+            UniValue obj(UniValue::VOBJ);
+            obj.pushKV("txid", delta.txid.GetHex());
+            obj.pushKV("height", delta.nHeight);
+            obj.pushKV("blockindex", (int)delta.nTxIndex);
+            obj.pushKV("index", (int)delta.nIndex);
+            obj.pushKV("spending", (bool)delta.fSpending);
+            obj.pushKV("satoshis", delta.nValue);
+            result.push_back(obj);
+        }
+        std::string strJSON = result.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+}
+
+static bool rest_block_filter(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    // request is sent over URI scheme /rest/blockfilter/filtertype/blockhash
+    std::vector<std::string> uri_parts;
+    boost::split(uri_parts, param, boost::is_any_of("/"));
+    if (uri_parts.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/blockfilter/<filtertype>/<blockhash>.<ext>");
+
+    uint256 block_hash;
+    if (!ParseHashStr(uri_parts[1], block_hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + uri_parts[1]);
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(uri_parts[0], filtertype))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Unknown filtertype " + uri_parts[0]);
+
+    if (!g_blockfilterindex || g_blockfilterindex->GetFilterType() != filtertype)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Index is not enabled for filtertype " + uri_parts[0]);
+
+    const CBlockIndex* block_index;
+    bool block_was_connected;
+    {
+        LOCK(cs_main);
+        block_index = LookupBlockIndex(block_hash);
+        if (!block_index)
+            return RESTERR(req, HTTP_NOT_FOUND, uri_parts[1] + " not found");
+        block_was_connected = block_index->IsValid(BLOCK_VALID_SCRIPTS);
+    }
+
+    bool index_ready = g_blockfilterindex->BlockUntilSyncedToCurrentChain();
+
+    BlockFilter filter;
+    if (!g_blockfilterindex->LookupFilter(block_index, filter)) {
+        std::string errmsg = "Filter not found.";
+
+        if (!block_was_connected) {
+            errmsg += " Block was not connected to active chain.";
+        } else if (!index_ready) {
+            errmsg += " Block filters are still in the process of being indexed.";
+        } else {
+            errmsg += " This error is unexpected and indicates index corruption.";
+        }
+
+        return RESTERR(req, HTTP_NOT_FOUND, errmsg);
+    }
+
+    CDataStream ssFilter(SER_NETWORK, PROTOCOL_VERSION);
+    ssFilter << filter;
+
+    switch (rf) {
+    case RetFormat::BINARY:
+    case RetFormat::HEX:
+        return WriteSerializedReply(req, rf, ssFilter);
+    case RetFormat::JSON: {
+        UniValue ret(UniValue::VOBJ);
+        ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+        std::string strJSON = ret.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+}
+
+static bool rest_filter_header(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    // request is sent over URI scheme /rest/blockfilterheaders/filtertype/count/blockhash
+    std::vector<std::string> uri_parts;
+    boost::split(uri_parts, param, boost::is_any_of("/"));
+    if (uri_parts.size() != 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/blockfilterheaders/<filtertype>/<count>/<blockhash>.<ext>");
+
+    long count = strtol(uri_parts[1].c_str(), nullptr, 10);
+    if (count < 1 || count > 2000)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Header count out of range: " + uri_parts[1]);
+
+    uint256 block_hash;
+    if (!ParseHashStr(uri_parts[2], block_hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + uri_parts[2]);
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(uri_parts[0], filtertype))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Unknown filtertype " + uri_parts[0]);
+
+    if (!g_blockfilterindex || g_blockfilterindex->GetFilterType() != filtertype)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Index is not enabled for filtertype " + uri_parts[0]);
+
+    std::vector<const CBlockIndex*> headers;
+    headers.reserve(count);
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = LookupBlockIndex(block_hash);
+        while (pindex != nullptr && chainActive.Contains(pindex)) {
+            headers.push_back(pindex);
+            if (headers.size() == (unsigned long)count)
+                break;
+            pindex = chainActive.Next(pindex);
+        }
+    }
+
+    bool index_ready = g_blockfilterindex->BlockUntilSyncedToCurrentChain();
+
+    std::vector<uint256> filter_headers;
+    filter_headers.reserve(count);
+    for (const CBlockIndex* pindex : headers) {
+        uint256 filter_header;
+        if (!g_blockfilterindex->LookupFilterHeader(pindex, filter_header)) {
+            std::string errmsg = "Filter not found.";
+
+            if (!index_ready) {
+                errmsg += " Block filters are still in the process of being indexed.";
+            } else {
+                errmsg += " This error is unexpected and indicates index corruption.";
+            }
+
+            return RESTERR(req, HTTP_NOT_FOUND, errmsg);
+        }
+        filter_headers.push_back(filter_header);
+    }
+
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    for (const uint256& header : filter_headers) {
+        ssHeader << header;
+    }
+
+    switch (rf) {
+    case RetFormat::BINARY:
+    case RetFormat::HEX:
+        return WriteSerializedReply(req, rf, ssHeader);
+    case RetFormat::JSON: {
+        UniValue jsonHeaders(UniValue::VARR);
+        for (const uint256& header : filter_headers) {
+            jsonHeaders.push_back(header.GetHex());
+        }
+
+        std::string strJSON = jsonHeaders.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -590,7 +1051,13 @@ static const struct {
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
+      {"/rest/blockfilter/", rest_block_filter},
+      {"/rest/blockfilterheaders/", rest_filter_header},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/anonoutputs/", rest_anonoutputs},
+      {"/rest/keyimages", rest_keyimages},
+      {"/rest/addressdeltas/", rest_addressdeltas},
+      {"/rest/perfstats", rest_perfstats},
 };
 
 void StartREST()
@@ -6,6 +6,16 @@
 
 #include <validation.h>
 #include <txdb.h>
+#include <rctoutputfile.h>
+#include <crypto/common.h>
+#include <fs.h>
+#include <util.h>
+#include <utilstrencodings.h>
+
+//! Most outputs anonoutput returns in range mode
+static const int64_t MAX_ANON_OUTPUT_RANGE = 10000;
+//! Outputs read per cs_main lock by exportanonoutputs
+static const size_t ANON_EXPORT_CHUNK = 4096;
 
 
 static bool IsDigits(const std::string &str)
@@ -13,12 +23,36 @@ static bool IsDigits(const std::string &str)
     return str.length() && std::all_of(str.begin(), str.end(), ::isdigit);
 };
 
+static UniValue AnonOutputToJSON(int64_t nIndex, const CAnonOutput &ao)
+{
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("index", nIndex);
+    result.pushKV("publickey", HexStr(ao.pubkey.begin(), ao.pubkey.end()));
+    result.pushKV("txnhash", ao.outpoint.hash.ToString());
+    result.pushKV("n", (int)ao.outpoint.n);
+    result.pushKV("blockheight", ao.nBlockHeight);
+    return result;
+};
+
 UniValue anonoutput(const JSONRPCRequest &request)
 {
-    if (request.fHelp || request.params.size() > 1)
+    if (request.fHelp || request.params.size() > 2)
         throw std::runtime_error(
-            "anonoutput [index/hex]\n"
-            "\n");
+            "anonoutput ( \"output\" count )\n"
+            "\nReturns an anon output by index or public key, or count outputs from an index.\n"
+            "Without arguments returns the last output index.\n"
+            "\nArguments:\n"
+            "1. \"output\"     (string, optional) Index or hex encoded public key of the output.\n"
+            "2. count        (numeric, optional) List count outputs from the index in output, at most "+std::to_string(MAX_ANON_OUTPUT_RANGE)+".\n"
+            "\nResult (range mode):\n"
+            "{\n"
+            "  \"lastindex\": n,    (numeric) The last output index\n"
+            "  \"outputs\": [...]   (array) Outputs in index order, up to lastindex\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("anonoutput", "\"1\"")
+            + HelpExampleCli("anonoutput", "\"1\" 1000")
+            + HelpExampleRpc("anonoutput", "\"1\", 1000"));
 
     UniValue result(UniValue::VOBJ);
 
@@ -29,6 +63,33 @@ UniValue anonoutput(const JSONRPCRequest &request)
         return result;
     };
 
+    if (!request.params[1].isNull())
+    {
+        int64_t nStart, nCount = request.params[1].get_int64();
+        if (!IsDigits(request.params[0].get_str()) || !ParseInt64(request.params[0].get_str(), &nStart) || nStart < 1)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid index");
+        if (nCount < 0 || nCount > MAX_ANON_OUTPUT_RANGE)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("count must be between 0 and %d", MAX_ANON_OUTPUT_RANGE));
+
+        int64_t nLast;
+        std::vector<CAnonOutput> vao;
+        {
+            LOCK(cs_main);
+            nLast = chainActive.Tip()->nAnonOutputs;
+            nCount = std::max((int64_t)0, std::min(nCount, nLast - nStart + 1));
+            if (!pblocktree->ReadRCTOutputRange(nStart, nCount, vao))
+                throw JSONRPCError(RPC_DATABASE_ERROR, "Read outputs failed.");
+        }
+
+        UniValue outputs(UniValue::VARR);
+        for (size_t k = 0; k < vao.size(); ++k)
+            outputs.push_back(AnonOutputToJSON(nStart + k, vao[k]));
+
+        result.pushKV("lastindex", nLast);
+        result.pushKV("outputs", outputs);
+        return result;
+    };
+
     std::string sIn = request.params[0].get_str();
 
     int64_t nIndex;
@@ -52,14 +113,171 @@ UniValue anonoutput(const JSONRPCRequest &request)
     };
 
     CAnonOutput ao;
-    if (!pblocktree->ReadRCTOutput(nIndex, ao))
-        throw JSONRPCError(RPC_MISC_ERROR, "Unknown index.");
+    {
+        LOCK(cs_main);
+        if (!pblocktree->ReadRCTOutput(nIndex, ao))
+            throw JSONRPCError(RPC_MISC_ERROR, "Unknown index.");
+    }
 
-    result.pushKV("index", (int)nIndex);
-    result.pushKV("publickey", HexStr(ao.pubkey.begin(), ao.pubkey.end()));
-    result.pushKV("txnhash", ao.outpoint.hash.ToString());
-    result.pushKV("n", (int)ao.outpoint.n);
-    result.pushKV("blockheight", ao.nBlockHeight);
+    return AnonOutputToJSON(nIndex, ao);
+};
+
+UniValue exportanonoutputs(const JSONRPCRequest &request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "exportanonoutputs \"path\" ( start count )\n"
+            "\nWrite the anon output index to a binary file, in index order.\n"
+            "The file begins with a 16 byte header: \"rctx\", the record size and the first index as\n"
+            "little endian uint32 and int64. Each record is "+std::to_string(RCT_OUTPUT_RECORD_SIZE)+" bytes:\n"
+            "flag, public key (33), commitment (33), txid (32), n (uint32 le), block height (uint32 le), compromised.\n"
+            "\nArguments:\n"
+            "1. \"path\"       (string, required) The file to write, must not exist.\n"
+            "2. start        (numeric, optional, default=1) First output index to write.\n"
+            "3. count        (numeric, optional) Number of outputs to write, default all up to the last index.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"start\": n,        (numeric) The first index written\n"
+            "  \"count\": n,        (numeric) Number of outputs written\n"
+            "  \"lastindex\": n,    (numeric) The last output index when the export started\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("exportanonoutputs", "\"/tmp/rct.bin\"")
+            + HelpExampleRpc("exportanonoutputs", "\"/tmp/rct.bin\", 1, 100000"));
+
+    fs::path path = fs::absolute(request.params[0].get_str());
+    if (fs::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists.");
+
+    int64_t nStart = request.params[1].isNull() ? 1 : request.params[1].get_int64();
+    if (nStart < 1)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid start index");
+
+    int64_t nLast;
+    {
+        LOCK(cs_main);
+        nLast = chainActive.Tip()->nAnonOutputs;
+    }
+    int64_t nCount = std::max((int64_t)0, nLast - nStart + 1);
+    if (!request.params[2].isNull())
+    {
+        if (request.params[2].get_int64() < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid count");
+        nCount = std::min(nCount, request.params[2].get_int64());
+    };
+
+    FILE *fp = fsbridge::fopen(path, "wb");
+    if (!fp)
+        throw JSONRPCError(RPC_MISC_ERROR, "Could not open " + path.string());
+
+    uint8_t header[16];
+    memcpy(header, "rctx", 4);
+    WriteLE32(header + 4, RCT_OUTPUT_RECORD_SIZE);
+    WriteLE64(header + 8, nStart);
+    bool fOk = fwrite(header, 1, sizeof(header), fp) == sizeof(header);
+
+    // Released between chunks, a reorg below the exported range stops the export
+    std::vector<CAnonOutput> vao;
+    std::vector<uint8_t> vRecords;
+    int64_t nWritten = 0;
+    std::string sError;
+    while (fOk && nWritten < nCount)
+    {
+        size_t nChunk = std::min((int64_t)ANON_EXPORT_CHUNK, nCount - nWritten);
+        {
+            LOCK(cs_main);
+            if (chainActive.Tip()->nAnonOutputs < nStart + nWritten + (int64_t)nChunk - 1)
+            {
+                sError = "Outputs were disconnected during the export.";
+                break;
+            };
+            if (!pblocktree->ReadRCTOutputRange(nStart + nWritten, nChunk, vao))
+            {
+                sError = "Read outputs failed.";
+                break;
+            };
+        }
+
+        vRecords.resize(nChunk * RCT_OUTPUT_RECORD_SIZE);
+        for (size_t k = 0; k < nChunk; ++k)
+            CRCTOutputFile::Encode(vao[k], &vRecords[k * RCT_OUTPUT_RECORD_SIZE]);
+        fOk = fwrite(vRecords.data(), 1, vRecords.size(), fp) == vRecords.size();
+        nWritten += nChunk;
+    };
+
+    if (fclose(fp) != 0)
+        fOk = false;
+    if (!fOk && sError.empty())
+        sError = "Write to " + path.string() + " failed.";
+    if (!sError.empty())
+    {
+        fs::remove(path);
+        throw JSONRPCError(RPC_MISC_ERROR, sError);
+    };
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("start", nStart);
+    result.pushKV("count", nWritten);
+    result.pushKV("lastindex", nLast);
+    return result;
+};
+
+UniValue getrctcacheinfo(const JSONRPCRequest &request)
+{
+    if (request.fHelp || request.params.size() > 0)
+        throw std::runtime_error(
+            "getrctcacheinfo\n"
+            "\nReturns details on the caches in front of the RCT output index.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"size\": xxxxx,           (numeric) Number of cached outputs\n"
+            "  \"usage\": xxxxx,          (numeric) Total memory usage for the cache\n"
+            "  \"maxusage\": xxxxx,       (numeric) Maximum memory usage for the cache (-rctcachesize)\n"
+            "  \"hits\": xxxxx,           (numeric) Lookups served from the cache\n"
+            "  \"misses\": xxxxx,         (numeric) Lookups passed through to the file or db\n"
+            "  \"inserts\": xxxxx,        (numeric) Outputs added to the cache\n"
+            "  \"evictions\": xxxxx,      (numeric) Outputs dropped to stay within maxusage\n"
+            "  \"outputfile\": true|false, (boolean) Whether rctoutputs.dat is in use (-rctoutputfile)\n"
+            "  \"outputfilelast\": xxxxx, (numeric) Last output index held in rctoutputs.dat\n"
+            "  \"keyimagefilter\": {      (json object) Filter of spent key images (-keyimagefilter)\n"
+            "    \"enabled\": true|false, (boolean) Whether the filter is in use\n"
+            "    \"elements\": xxxxx,     (numeric) Key images inserted since the last rebuild\n"
+            "    \"capacity\": xxxxx,     (numeric) Key images the filter is sized for\n"
+            "    \"usage\": xxxxx,        (numeric) Memory usage of the filter\n"
+            "    \"skipped\": xxxxx,      (numeric) Db lookups avoided\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrctcacheinfo", "")
+            + HelpExampleRpc("getrctcacheinfo", ""));
+
+    LOCK(cs_main);
+    CRCTOutputCache &cache = pblocktree->GetRCTOutputCache();
+
+    CacheStats stats = cache.GetStats();
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("size", (uint64_t)stats.nSize);
+    result.pushKV("usage", (uint64_t)stats.nUsage);
+    result.pushKV("maxusage", (uint64_t)stats.nMaxUsage);
+    result.pushKV("hits", stats.nHits);
+    result.pushKV("misses", stats.nMisses);
+    result.pushKV("inserts", stats.nInserts);
+    result.pushKV("evictions", stats.nEvictions);
+
+    const CRCTOutputFile *file = pblocktree->GetRCTOutputFile();
+    result.pushKV("outputfile", file != nullptr);
+    if (file)
+        result.pushKV("outputfilelast", file->GetLastValid());
+
+    const CKeyImageFilter &filter = pblocktree->GetKeyImageFilter();
+    UniValue kifilter(UniValue::VOBJ);
+    kifilter.pushKV("enabled", filter.IsEnabled());
+    kifilter.pushKV("elements", (uint64_t)filter.GetInserted());
+    kifilter.pushKV("capacity", (uint64_t)filter.GetCapacity());
+    kifilter.pushKV("usage", (uint64_t)filter.DynamicMemoryUsage());
+    kifilter.pushKV("skipped", filter.GetSkipped());
+    result.pushKV("keyimagefilter", kifilter);
 
     return result;
 };
@@ -67,7 +285,9 @@ UniValue anonoutput(const JSONRPCRequest &request)
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
-    { "anon",               "anonoutput",             &anonoutput,             {} },
+    { "anon",               "anonoutput",             &anonoutput,             {"output","count"} },
+    { "anon",               "exportanonoutputs",      &exportanonoutputs,      {"path","start","count"} },
+    { "anon",               "getrctcacheinfo",        &getrctcacheinfo,        {} },
 };
 
 void RegisterAnonRPCCommands(CRPCTable &tableRPC)
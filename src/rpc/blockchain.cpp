@@ -6,6 +6,7 @@
 #include <rpc/blockchain.h>
 
 #include <amount.h>
+#include <backgroundverify.h>
 #include <base58.h>
 #include <chain.h>
 #include <chainparams.h>
@@ -14,13 +15,19 @@
 #include <consensus/validation.h>
 #include <validation.h>
 #include <core_io.h>
+#include <index/blockfilterindex.h>
+#include <index/blockstatsindex.h>
 #include <index/txindex.h>
 #include <key_io.h>
 #include <policy/feerate.h>
+#include <perfstats.h>
 #include <policy/policy.h>
 #include <primitives/transaction.h>
+#include <rpc/jsonstream.h>
 #include <rpc/server.h>
 #include <script/descriptor.h>
+#include <shutdown.h>
+#include <snapshot.h>
 #include <streams.h>
 #include <sync.h>
 #include <txdb.h>
@@ -158,6 +165,30 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     return result;
 }
 
+void blockToJSON(CJSONStreamWriter& stream, const CBlock& block, const CBlockIndex* blockindex)
+{
+    // Fields as in the summary, with the txids replaced by the txns one at a time
+    UniValue summary = blockToJSON(block, blockindex, false);
+    const std::vector<std::string>& keys = summary.getKeys();
+    const std::vector<UniValue>& values = summary.getValues();
+    stream.BeginObject();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (keys[i] != "tx") {
+            stream.KeyValue(keys[i], values[i]);
+            continue;
+        }
+        stream.Key("tx");
+        stream.BeginArray();
+        for (const auto& tx : block.vtx) {
+            UniValue objTx(UniValue::VOBJ);
+            TxToUniv(*tx, uint256(), objTx, true, RPCSerializationFlags());
+            stream.Value(objTx);
+        }
+        stream.EndArray();
+    }
+    stream.EndObject();
+}
+
 static UniValue getblockcount(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -171,8 +202,8 @@ static UniValue getblockcount(const JSONRPCRequest& request)
             + HelpExampleRpc("getblockcount", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Height();
+    std::shared_ptr<const CChainStatus> status = GetChainStatus();
+    return status ? status->nHeight : -1;
 }
 
 static UniValue getbestblockhash(const JSONRPCRequest& request)
@@ -188,8 +219,11 @@ static UniValue getbestblockhash(const JSONRPCRequest& request)
             + HelpExampleRpc("getbestblockhash", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    std::shared_ptr<const CChainStatus> status = GetChainStatus();
+    if (!status || !status->pindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "No blocks connected");
+    }
+    return status->hashBlock.GetHex();
 }
 
 void RPCNotifyBlockChange(bool ibd, const CBlockIndex * pindex)
@@ -433,6 +467,19 @@ static void entryToJSON(UniValue &info, const CTxMemPoolEntry &e) EXCLUSIVE_LOCK
     info.pushKV("spentby", spent);
 }
 
+void mempoolToJSON(CJSONStreamWriter& stream)
+{
+    LOCK(mempool.cs);
+    stream.BeginObject();
+    for (const CTxMemPoolEntry& e : mempool.mapTx)
+    {
+        UniValue info(UniValue::VOBJ);
+        entryToJSON(info, e);
+        stream.KeyValue(e.GetTx().GetHash().ToString(), info);
+    }
+    stream.EndObject();
+}
+
 UniValue mempoolToJSON(bool fVerbose)
 {
     if (fVerbose)
@@ -490,6 +537,11 @@ static UniValue getrawmempool(const JSONRPCRequest& request)
     if (!request.params[0].isNull())
         fVerbose = request.params[0].get_bool();
 
+    if (fVerbose && request.stream) {
+        mempoolToJSON(*request.stream);
+        return NullUniValue;
+    }
+
     return mempoolToJSON(fVerbose);
 }
 
@@ -840,6 +892,11 @@ static UniValue getblock(const JSONRPCRequest& request)
         return strHex;
     }
 
+    if (verbosity >= 2 && request.stream) {
+        blockToJSON(*request.stream, block, pblockindex);
+        return NullUniValue;
+    }
+
     return blockToJSON(block, pblockindex, verbosity >= 2);
 }
 
@@ -857,7 +914,8 @@ struct CCoinsStats
     CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
 };
 
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+template <typename Stream>
+static void ApplyStats(CCoinsStats &stats, Stream& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
 {
     assert(!outputs.empty());
     ss << hash;
@@ -881,38 +939,67 @@ static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash,
 }
 
 //! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+static bool GetUTXOStats(CCoinsViewDB *view, CCoinsStats &stats)
 {
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-    assert(pcursor);
-
+    // The key ranges are scanned in parallel, the hash covers the txns in key order so
+    // the serialized txns of each range are kept until the ranges before it are hashed.
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        stats.nHeight = LookupBlockIndex(stats.hashBlock)->nHeight;
-    }
-    ss << stats.hashBlock;
-    uint256 prevkey;
-    std::map<uint32_t, Coin> outputs;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        COutPoint key;
-        Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+    bool fHashedBlock = false;
+    std::mutex cs_stats;
+    std::map<int, std::vector<unsigned char> > mapPending;
+    int nNextPart = 0;
+
+    auto scan = [&](int nPart, CCoinsViewCursor &cursor) {
+        CCoinsStats partStats;
+        std::vector<unsigned char> vch;
+        CVectorWriter ssPart(SER_GETHASH, PROTOCOL_VERSION, vch, 0);
+        uint256 prevkey;
+        std::map<uint32_t, Coin> outputs;
+        while (cursor.Valid()) {
+            COutPoint key;
+            Coin coin;
+            if (!cursor.GetKey(key) || !cursor.GetValue(coin)) {
+                return error("%s: unable to read value", __func__);
+            }
             if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
+                if (ShutdownRequested()) {
+                    return false;
+                }
+                ApplyStats(partStats, ssPart, prevkey, outputs);
                 outputs.clear();
             }
             prevkey = key.hash;
             outputs[key.n] = std::move(coin);
-        } else {
-            return error("%s: unable to read value", __func__);
+            cursor.Next();
+        }
+        if (!outputs.empty()) {
+            ApplyStats(partStats, ssPart, prevkey, outputs);
+        }
+
+        std::lock_guard<std::mutex> lock(cs_stats);
+        if (!fHashedBlock) {
+            ss << cursor.GetBestBlock();
+            fHashedBlock = true;
         }
-        pcursor->Next();
+        stats.nTransactions += partStats.nTransactions;
+        stats.nTransactionOutputs += partStats.nTransactionOutputs;
+        stats.nBogoSize += partStats.nBogoSize;
+        stats.nTotalAmount += partStats.nTotalAmount;
+        mapPending[nPart].swap(vch);
+        for (auto it = mapPending.begin(); it != mapPending.end() && it->first == nNextPart; it = mapPending.erase(it)) {
+            ss.write((const char*)it->second.data(), it->second.size());
+            nNextPart++;
+        }
+        return true;
+    };
+
+    if (!view->ScanCoins(GetNumCores(), stats.hashBlock, scan)) {
+        return false;
     }
-    if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
+    assert(mapPending.empty() && nNextPart == COINS_SCAN_PARTS);
+    {
+        LOCK(cs_main);
+        stats.nHeight = LookupBlockIndex(stats.hashBlock)->nHeight;
     }
     stats.hashSerialized = ss.GetHash();
     stats.nDiskSize = view->EstimateSize();
@@ -970,11 +1057,14 @@ static UniValue pruneblockchain(const JSONRPCRequest& request)
 
 static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( flush )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
             "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. flush        (boolean, optional, default=true) Flush the coins cache first, else the state of the last\n"
+            "                flush is reported without writing to the chainstate database.\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
@@ -988,13 +1078,16 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "false")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
-    FlushStateToDisk();
+    if (request.params[0].isNull() || request.params[0].get_bool()) {
+        FlushStateToDisk();
+    }
     if (GetUTXOStats(pcoinsdbview.get(), stats)) {
         ret.pushKV("height", (int64_t)stats.nHeight);
         ret.pushKV("bestblock", stats.hashBlock.GetHex());
@@ -1010,6 +1103,97 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+static UniValue SnapshotToJSON(const CTxOutSetSnapshotMetadata &metadata, const uint256 &hashSnapshot, const fs::path &path)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("base_hash", metadata.hashBaseBlock.GetHex());
+    ret.pushKV("base_height", metadata.nHeight);
+    ret.pushKV("coins", (int64_t)metadata.nCoins);
+    ret.pushKV("anon_outputs", (int64_t)metadata.nAnonOutputs);
+    ret.pushKV("key_images", (int64_t)metadata.nKeyImages);
+    ret.pushKV("hash", hashSnapshot.GetHex());
+    ret.pushKV("path", path.string());
+    return ret;
+}
+
+static UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite the unspent transaction output set, anon output index and key images to a snapshot file.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"      (string, required) Path to the output file, relative paths are resolved against the data directory\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"base_hash\": \"hex\",   (string) The hash of the block the snapshot was taken at\n"
+            "  \"base_height\": n,     (numeric) The height of the block the snapshot was taken at\n"
+            "  \"coins\": n,           (numeric) The number of unspent outputs written\n"
+            "  \"anon_outputs\": n,    (numeric) The number of anon outputs written\n"
+            "  \"key_images\": n,      (numeric) The number of key images written\n"
+            "  \"hash\": \"hex\",        (string) The snapshot hash\n"
+            "  \"path\": \"path\"        (string) The absolute path of the snapshot file\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+    }
+
+    CTxOutSetSnapshotMetadata metadata;
+    uint256 hashSnapshot;
+    std::string strError;
+    if (!DumpTxOutSetSnapshot(path, metadata, hashSnapshot, strError)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
+    }
+
+    return SnapshotToJSON(metadata, hashSnapshot, path);
+}
+
+static UniValue verifytxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "verifytxoutset \"path\"\n"
+            "\nCheck a snapshot file written by dumptxoutset.\n"
+            "\nArguments:\n"
+            "1. \"path\"      (string, required) Path to the snapshot file, relative paths are resolved against the data directory\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"base_hash\": \"hex\",   (string) The hash of the block the snapshot was taken at\n"
+            "  \"base_height\": n,     (numeric) The height of the block the snapshot was taken at\n"
+            "  \"coins\": n,           (numeric) The number of unspent outputs\n"
+            "  \"anon_outputs\": n,    (numeric) The number of anon outputs\n"
+            "  \"key_images\": n,      (numeric) The number of key images\n"
+            "  \"hash\": \"hex\",        (string) The snapshot hash\n"
+            "  \"path\": \"path\",       (string) The absolute path of the snapshot file\n"
+            "  \"committed\": true|false (boolean) If the hash matches the one in the chain parameters for the base height\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("verifytxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("verifytxoutset", "\"utxo.dat\"")
+        );
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+
+    CTxOutSetSnapshotMetadata metadata;
+    uint256 hashSnapshot;
+    bool fCommitted;
+    std::string strError;
+    if (!VerifyTxOutSetSnapshot(path, metadata, hashSnapshot, fCommitted, strError)) {
+        throw JSONRPCError(RPC_VERIFY_ERROR, strError);
+    }
+
+    UniValue ret = SnapshotToJSON(metadata, hashSnapshot, path);
+    ret.pushKV("committed", fCommitted);
+    return ret;
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -1117,6 +1301,217 @@ static UniValue verifychain(const JSONRPCRequest& request)
     return CVerifyDB().VerifyDB(Params(), pcoinsTip.get(), nCheckLevel, nCheckDepth);
 }
 
+static UniValue VerifyStatusToJSON(const CVerifyStatus &status)
+{
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("running", status.fRunning);
+    result.pushKV("aborted", status.fAborted);
+    result.pushKV("checklevel", status.nCheckLevel);
+    result.pushKV("threads", status.nThreads);
+    result.pushKV("start_height", status.nStartHeight);
+    result.pushKV("end_height", status.nEndHeight);
+    result.pushKV("blocks", status.nBlocks);
+    result.pushKV("checked", status.nChecked);
+    result.pushKV("skipped", status.nSkipped);
+    result.pushKV("failed", status.nFailed);
+    result.pushKV("progress", status.nBlocks > 0
+        ? (double)(status.nChecked + status.nSkipped + status.nFailed) * 100.0 / status.nBlocks : 0.0);
+    result.pushKV("bytes_read", status.nBytesRead);
+    int64_t nEndTime = status.fRunning ? GetTimeMicros() : status.nEndTime;
+    result.pushKV("elapsed_us", status.nStartTime > 0 ? nEndTime - status.nStartTime : 0);
+
+    UniValue failures(UniValue::VARR);
+    for (const auto &failure : status.vFailures) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("height", failure.nHeight);
+        entry.pushKV("hash", failure.hashBlock.GetHex());
+        entry.pushKV("check", failure.sCheck);
+        entry.pushKV("message", failure.sMessage);
+        failures.push_back(entry);
+    }
+    result.pushKV("failures", failures);
+    return result;
+}
+
+static UniValue verifychainbackground(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 4)
+        throw std::runtime_error(
+            "verifychainbackground \"action\" ( checklevel nblocks options )\n"
+            "\nVerifies active chain blocks across worker threads without blocking the node.\n"
+            "Block and undo reads are throttled, the coins database is not disconnected and reconnected as verifychain does.\n"
+            "\nArguments:\n"
+            "1. \"action\"      (string, required) \"start\" to start a verification, \"abort\" to stop it, \"status\" for its progress.\n"
+            "2. checklevel    (numeric, optional, 0-4, default=" + strprintf("%d", DEFAULT_BACKGROUND_CHECKLEVEL) + ") For \"start\", each level includes the ones below it:\n"
+            "                   0. read the blocks\n"
+            "                   1. check the blocks\n"
+            "                   2. check the undo data against the blocks\n"
+            "                   3. check the RCT output index and key images of the blocks\n"
+            "                   4. spot check the enabled insight indexes\n"
+            "3. nblocks       (numeric, optional, default=0=all) For \"start\", the number of blocks to check down from the tip.\n"
+            "4. options       (json, optional)\n"
+            "   {\n"
+            "     \"threads\": n,   (numeric, optional, default=" + strprintf("%d", DEFAULT_BACKGROUND_CHECKTHREADS) + ") Worker threads, up to " + strprintf("%d", MAX_BACKGROUND_CHECKTHREADS) + ".\n"
+            "     \"maxrate\": n,   (numeric, optional, default=" + strprintf("%d", DEFAULT_BACKGROUND_CHECKRATE) + ") MiB of block and undo data read per second, 0 for no limit.\n"
+            "   }\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"running\": true|false,  (boolean) If the verification is still running\n"
+            "  \"aborted\": true|false,  (boolean) If the verification was stopped before checking all blocks\n"
+            "  \"checklevel\": n,        (numeric) Level of the checks\n"
+            "  \"threads\": n,           (numeric) Worker threads\n"
+            "  \"start_height\": n,      (numeric) Lowest height checked\n"
+            "  \"end_height\": n,        (numeric) Tip when the verification started\n"
+            "  \"blocks\": n,            (numeric) Blocks to check\n"
+            "  \"checked\": n,           (numeric) Blocks that passed all checks\n"
+            "  \"skipped\": n,           (numeric) Blocks pruned or disconnected while checking\n"
+            "  \"failed\": n,            (numeric) Blocks that failed a check\n"
+            "  \"progress\": x.xxx,      (numeric) Percentage of the blocks done\n"
+            "  \"bytes_read\": n,        (numeric) Block and undo data read\n"
+            "  \"elapsed_us\": n,        (numeric) Time spent\n"
+            "  \"failures\": [           (array) Up to " + strprintf("%d", MAX_BACKGROUND_VERIFY_FAILURES) + " failed checks\n"
+            "    {\n"
+            "      \"height\": n,        (numeric) Block height\n"
+            "      \"hash\": \"hex\",      (string) Block hash\n"
+            "      \"check\": \"str\",     (string) read, block, undo, rct or insight\n"
+            "      \"message\": \"str\",   (string) What failed\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("verifychainbackground", "start 4 10000")
+            + HelpExampleCli("verifychainbackground", "status")
+            + HelpExampleRpc("verifychainbackground", "\"start\", 4, 10000, {\"threads\":4}")
+        );
+
+    const std::string action = request.params[0].get_str();
+    if (action == "status") {
+        return VerifyStatusToJSON(g_background_verifier.GetStatus());
+    }
+    if (action == "abort") {
+        g_background_verifier.Stop();
+        return VerifyStatusToJSON(g_background_verifier.GetStatus());
+    }
+    if (action != "start") {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid action '" + action + "'");
+    }
+
+    int nCheckLevel = request.params[1].isNull() ? DEFAULT_BACKGROUND_CHECKLEVEL : request.params[1].get_int();
+    int nBlocks = request.params[2].isNull() ? 0 : request.params[2].get_int();
+    int nThreads = DEFAULT_BACKGROUND_CHECKTHREADS;
+    int64_t nMaxRate = DEFAULT_BACKGROUND_CHECKRATE;
+    if (!request.params[3].isNull()) {
+        const UniValue &options = request.params[3].get_obj();
+        RPCTypeCheckObj(options,
+            {
+                {"threads", UniValueType(UniValue::VNUM)},
+                {"maxrate", UniValueType(UniValue::VNUM)},
+            }, true, true);
+        if (options.exists("threads")) {
+            nThreads = options["threads"].get_int();
+        }
+        if (options.exists("maxrate")) {
+            nMaxRate = options["maxrate"].get_int64();
+        }
+    }
+    if (nCheckLevel < 0 || nCheckLevel > 4) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "checklevel out of range");
+    }
+    if (nThreads < 1 || nThreads > MAX_BACKGROUND_CHECKTHREADS) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "threads out of range");
+    }
+    if (nMaxRate < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "maxrate must not be negative");
+    }
+
+    std::string sError;
+    if (!g_background_verifier.Start(Params(), nCheckLevel, nBlocks, nThreads, nMaxRate << 20, sError)) {
+        throw JSONRPCError(RPC_MISC_ERROR, sError);
+    }
+    return VerifyStatusToJSON(g_background_verifier.GetStatus());
+}
+
+static UniValue replayblocks(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "replayblocks start_height ( end_height )\n"
+            "\nConnects a range of active chain blocks again on a copy of the chainstate rolled back in memory,\n"
+            "and reports the time spent in each phase of block validation. The chainstate and indexes are not changed.\n"
+            "The blocks after start_height must fit in the coins cache, see -dbcache.\n"
+            "Phases are taken from the performance histograms, so include work done by other threads during the replay.\n"
+            "\nArguments:\n"
+            "1. start_height   (numeric, required) The first block to connect.\n"
+            "2. end_height     (numeric, optional, default=start_height) The last block to connect.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"start_height\": n,      (numeric) The first block connected\n"
+            "  \"end_height\": n,        (numeric) The last block connected\n"
+            "  \"transactions\": n,      (numeric) Number of transactions connected\n"
+            "  \"insight_rows\": n,      (numeric) Insight index rows produced, not written\n"
+            "  \"total_us\": n,          (numeric) Time to roll back and connect the blocks\n"
+            "  \"phases\": {             (json object) Per phase\n"
+            "    \"name\": {             (json object) connectblock:, verify: or replay: histogram name\n"
+            "      \"count\": n,         (numeric) Times the phase ran\n"
+            "      \"total_us\": n,      (numeric) Time spent\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("replayblocks", "1000 2000")
+            + HelpExampleRpc("replayblocks", "1000, 2000")
+        );
+
+    int nStartHeight = request.params[0].get_int();
+    int nEndHeight = request.params[1].isNull() ? nStartHeight : request.params[1].get_int();
+
+    std::map<std::string, CPerfHistogram::Snapshot> mapBefore;
+    for (const auto &h : g_perf_stats.GetHistograms()) {
+        mapBefore[h.first] = h.second;
+    }
+
+    LOCK(cs_main);
+    int64_t nTimeStart = GetTimeMicros();
+    size_t nInsightRows;
+    std::string sError;
+    if (!ReplayBlockRange(Params(), nStartHeight, nEndHeight, nInsightRows, sError)) {
+        throw JSONRPCError(RPC_MISC_ERROR, sError);
+    }
+    int64_t nTimeTotal = GetTimeMicros() - nTimeStart;
+
+    UniValue phases(UniValue::VOBJ);
+    for (const auto &h : g_perf_stats.GetHistograms()) {
+        if (h.first.compare(0, 13, "connectblock:") != 0
+            && h.first.compare(0, 7, "verify:") != 0
+            && h.first.compare(0, 7, "replay:") != 0) {
+            continue;
+        }
+        const CPerfHistogram::Snapshot &before = mapBefore[h.first];
+        uint64_t nCount = h.second.nCount - before.nCount;
+        if (nCount == 0) {
+            continue;
+        }
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("count", nCount);
+        obj.pushKV("total_us", h.second.nSumMicros - before.nSumMicros);
+        phases.pushKV(h.first, obj);
+    }
+
+    uint64_t nTransactions = 0;
+    for (int nHeight = nStartHeight; nHeight <= nEndHeight; ++nHeight) {
+        nTransactions += chainActive[nHeight]->nTx;
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("start_height", nStartHeight);
+    result.pushKV("end_height", nEndHeight);
+    result.pushKV("transactions", nTransactions);
+    result.pushKV("insight_rows", (uint64_t)nInsightRows);
+    result.pushKV("total_us", nTimeTotal);
+    result.pushKV("phases", phases);
+    return result;
+}
+
 /** Implementation of IsSuperMajority with better feedback */
 static UniValue SoftForkMajorityDesc(int version, CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
@@ -1253,7 +1648,7 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
     obj.pushKV("headers",               pindexBestHeader ? pindexBestHeader->nHeight : -1);
     obj.pushKV("bestblockhash",         chainActive.Tip()->GetBlockHash().GetHex());
     if (fBitcoinCMode) {
-        obj.pushKV("moneysupply",           ValueFromAmount(chainActive.Tip()->nMoneySupply));
+        obj.pushKV("moneysupply",           ValueFromAmount(chainActive.Tip()->GetMoneySupply()));
         obj.pushKV("blockindexsize",        (int)mapBlockIndex.size());
         obj.pushKV("delayedblocks",         (int)CountDelayedBlocks());
     }
@@ -1644,22 +2039,6 @@ static UniValue getchaintxstats(const JSONRPCRequest& request)
     return ret;
 }
 
-template<typename T>
-static T CalculateTruncatedMedian(std::vector<T>& scores)
-{
-    size_t size = scores.size();
-    if (size == 0) {
-        return 0;
-    }
-
-    std::sort(scores.begin(), scores.end());
-    if (size % 2 == 0) {
-        return (scores[size / 2 - 1] + scores[size / 2]) / 2;
-    } else {
-        return scores[size / 2];
-    }
-}
-
 void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight)
 {
     if (scores.empty()) {
@@ -1697,8 +2076,132 @@ static inline bool SetHasKeys(const std::set<T>& set, const Tk& key, const Args&
     return (set.count(key) != 0) || SetHasKeys(set, args...);
 }
 
-// outpoint (needed for the utxo index) + nHeight + fCoinBase
-static constexpr size_t PER_UTXO_OVERHEAD = sizeof(COutPoint) + sizeof(uint32_t) + sizeof(bool);
+//! Blocks getblockstatsrange reports per call
+static const int MAX_GETBLOCKSTATSRANGE_BLOCKS = 1000;
+
+/** Stats of a block from the block stats index, or computed from the block. fFees requires the txindex without the block stats index */
+static CBlockStats GetBlockStats(const CBlockIndex* pindex, bool fFees)
+{
+    CBlockStats stats;
+    if (g_blockstatsindex && g_blockstatsindex->LookupStats(pindex, stats)) {
+        return stats;
+    }
+
+    if (fFees && !g_txindex) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "One or more of the selected stats requires -txindex enabled");
+    }
+
+    const CBlock block = GetBlockChecked(pindex);
+
+    SpentOutputFunction get_spent = [&block](size_t nTx, size_t nIn, CAmount& nValue, int64_t& nSize) {
+        const CTxIn& in = block.vtx[nTx]->vin[nIn];
+        CTransactionRef tx_in;
+        uint256 hashBlock;
+        if (!GetTransaction(in.prevout.hash, tx_in, Params().GetConsensus(), hashBlock, false)) {
+            return false;
+        }
+
+        if (block.vtx[nTx]->IsBitcoinCVersion()) {
+            if (in.prevout.n >= tx_in->vpout.size()) {
+                return false;
+            }
+            const auto& prevoutput = tx_in->vpout[in.prevout.n];
+            nValue = prevoutput->IsStandardOutput() ? prevoutput->GetValue() : 0;
+            nSize = GetSerializeSize(*prevoutput, SER_NETWORK, PROTOCOL_VERSION);
+        } else {
+            if (in.prevout.n >= tx_in->vout.size()) {
+                return false;
+            }
+            const CTxOut& prevoutput = tx_in->vout[in.prevout.n];
+            nValue = prevoutput.nValue;
+            nSize = GetSerializeSize(prevoutput, SER_NETWORK, PROTOCOL_VERSION);
+        }
+        return true;
+    };
+
+    std::string strError;
+    if (!ComputeBlockStats(block, fFees ? &get_spent : nullptr, stats, strError)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unexpected internal error (tx index seems corrupt): " + strError);
+    }
+    return stats;
+}
+
+/** Block stats to JSON, only the selected stats if any */
+static UniValue BlockStatsToJSON(const CBlockIndex* pindex, const CBlockStats& stats, const std::set<std::string>& selected)
+{
+    UniValue feerates_res(UniValue::VARR);
+    for (int64_t i = 0; i < NUM_GETBLOCKSTATS_PERCENTILES; i++) {
+        feerates_res.push_back(stats.feerate_percentiles[i]);
+    }
+
+    const int64_t txs_nocoinbase = stats.txs - 1;
+    UniValue ret_all(UniValue::VOBJ);
+    ret_all.pushKV("anon_ins", stats.anon_ins);
+    ret_all.pushKV("anon_outs", stats.anon_outs);
+    ret_all.pushKV("avgfee", txs_nocoinbase > 0 ? stats.totalfee / txs_nocoinbase : 0);
+    ret_all.pushKV("avgfeerate", stats.total_weight ? (stats.totalfee * WITNESS_SCALE_FACTOR) / stats.total_weight : 0); // Unit: sat/vbyte
+    ret_all.pushKV("avgringsize", stats.anon_ins ? stats.total_ringsize / stats.anon_ins : 0);
+    ret_all.pushKV("avgtxsize", txs_nocoinbase > 0 ? stats.total_size / txs_nocoinbase : 0);
+    ret_all.pushKV("blockhash", pindex->GetBlockHash().GetHex());
+    ret_all.pushKV("data_outs", stats.data_outs);
+    ret_all.pushKV("feerate_percentiles", feerates_res);
+    ret_all.pushKV("height", (int64_t)pindex->nHeight);
+    ret_all.pushKV("ins", stats.ins);
+    ret_all.pushKV("key_images", stats.key_images);
+    ret_all.pushKV("maxfee", stats.maxfee);
+    ret_all.pushKV("maxfeerate", stats.maxfeerate);
+    ret_all.pushKV("maxringsize", stats.max_ringsize);
+    ret_all.pushKV("maxtxsize", stats.maxtxsize);
+    ret_all.pushKV("medianfee", stats.medianfee);
+    ret_all.pushKV("mediantime", pindex->GetMedianTimePast());
+    ret_all.pushKV("mediantxsize", stats.mediantxsize);
+    ret_all.pushKV("minfee", stats.minfee);
+    ret_all.pushKV("minfeerate", stats.minfeerate);
+    ret_all.pushKV("minringsize", stats.min_ringsize);
+    ret_all.pushKV("mintxsize", stats.mintxsize);
+    ret_all.pushKV("outs", stats.outs);
+    ret_all.pushKV("subsidy", GetBlockSubsidy(pindex->nHeight, Params().GetConsensus()));
+    ret_all.pushKV("swtotal_size", stats.swtotal_size);
+    ret_all.pushKV("swtotal_weight", stats.swtotal_weight);
+    ret_all.pushKV("swtxs", stats.swtxs);
+    ret_all.pushKV("time", pindex->GetBlockTime());
+    ret_all.pushKV("total_out", stats.total_out);
+    ret_all.pushKV("total_size", stats.total_size);
+    ret_all.pushKV("total_weight", stats.total_weight);
+    ret_all.pushKV("totalfee", stats.totalfee);
+    ret_all.pushKV("txs", stats.txs);
+    ret_all.pushKV("utxo_increase", stats.outs - stats.ins);
+    ret_all.pushKV("utxo_size_inc", stats.utxo_size_inc);
+
+    if (selected.empty()) {
+        return ret_all;
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    for (const std::string& stat : selected) {
+        const UniValue& value = ret_all[stat];
+        if (value.isNull()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid selected statistic %s", stat));
+        }
+        ret.pushKV(stat, value);
+    }
+    return ret;
+}
+
+/** Parse the stats argument of getblockstats, true if a selected stat requires the spent outputs */
+static bool ParseSelectedStats(const UniValue& param, std::set<std::string>& stats)
+{
+    if (!param.isNull()) {
+        const UniValue stats_univalue = param.get_array();
+        for (unsigned int i = 0; i < stats_univalue.size(); i++) {
+            const std::string stat = stats_univalue[i].get_str();
+            stats.insert(stat);
+        }
+    }
+
+    return stats.empty() || SetHasKeys(stats, "utxo_size_inc", "totalfee", "avgfee", "avgfeerate", "minfee", "maxfee",
+        "minfeerate", "maxfeerate", "medianfee", "feerate_percentiles");
+}
 
 static UniValue getblockstats(const JSONRPCRequest& request)
 {
@@ -1707,7 +2210,8 @@ static UniValue getblockstats(const JSONRPCRequest& request)
             "getblockstats hash_or_height ( stats )\n"
             "\nCompute per block statistics for a given window. All amounts are in satoshis.\n"
             "It won't work for some heights with pruning.\n"
-            "It won't work without -txindex for utxo_size_inc, *fee or *feerate stats.\n"
+            "It won't work without -txindex or -blockstatsindex for utxo_size_inc, *fee or *feerate stats.\n"
+            "Blocks indexed by -blockstatsindex are served without reading the block.\n"
             "\nArguments:\n"
             "1. \"hash_or_height\"     (string or numeric, required) The block hash or height of the target block\n"
             "2. \"stats\"              (array,  optional) Values to plot, by default all values (see result below)\n"
@@ -1718,10 +2222,14 @@ static UniValue getblockstats(const JSONRPCRequest& request)
             "    ]\n"
             "\nResult:\n"
             "{                           (json object)\n"
+            "  \"anon_ins\": xxxxx,        (numeric) The number of anon inputs\n"
+            "  \"anon_outs\": xxxxx,       (numeric) The number of anon (RingCT) outputs, their values are blinded\n"
             "  \"avgfee\": xxxxx,          (numeric) Average fee in the block\n"
             "  \"avgfeerate\": xxxxx,      (numeric) Average feerate (in satoshis per virtual byte)\n"
+            "  \"avgringsize\": xxxxx,     (numeric) Truncated average ring size of the anon inputs\n"
             "  \"avgtxsize\": xxxxx,       (numeric) Average transaction size\n"
             "  \"blockhash\": xxxxx,       (string) The block hash (to check for potential reorgs)\n"
+            "  \"data_outs\": xxxxx,       (numeric) The number of data outputs\n"
             "  \"feerate_percentiles\": [  (array of numeric) Feerates at the 10th, 25th, 50th, 75th, and 90th percentile weight unit (in satoshis per virtual byte)\n"
             "      \"10th_percentile_feerate\",      (numeric) The 10th percentile feerate\n"
             "      \"25th_percentile_feerate\",      (numeric) The 25th percentile feerate\n"
@@ -1731,14 +2239,17 @@ static UniValue getblockstats(const JSONRPCRequest& request)
             "  ],\n"
             "  \"height\": xxxxx,          (numeric) The height of the block\n"
             "  \"ins\": xxxxx,             (numeric) The number of inputs (excluding coinbase)\n"
+            "  \"key_images\": xxxxx,      (numeric) The number of key images spent by the anon inputs\n"
             "  \"maxfee\": xxxxx,          (numeric) Maximum fee in the block\n"
             "  \"maxfeerate\": xxxxx,      (numeric) Maximum feerate (in satoshis per virtual byte)\n"
+            "  \"maxringsize\": xxxxx,     (numeric) Maximum ring size of the anon inputs\n"
             "  \"maxtxsize\": xxxxx,       (numeric) Maximum transaction size\n"
             "  \"medianfee\": xxxxx,       (numeric) Truncated median fee in the block\n"
             "  \"mediantime\": xxxxx,      (numeric) The block median time past\n"
             "  \"mediantxsize\": xxxxx,    (numeric) Truncated median transaction size\n"
             "  \"minfee\": xxxxx,          (numeric) Minimum fee in the block\n"
             "  \"minfeerate\": xxxxx,      (numeric) Minimum feerate (in satoshis per virtual byte)\n"
+            "  \"minringsize\": xxxxx,     (numeric) Minimum ring size of the anon inputs\n"
             "  \"mintxsize\": xxxxx,       (numeric) Minimum transaction size\n"
             "  \"outs\": xxxxx,            (numeric) The number of outputs\n"
             "  \"subsidy\": xxxxx,         (numeric) The block subsidy\n"
@@ -1760,6 +2271,10 @@ static UniValue getblockstats(const JSONRPCRequest& request)
         );
     }
 
+    if (g_blockstatsindex) {
+        g_blockstatsindex->BlockUntilSyncedToCurrentChain();
+    }
+
     LOCK(cs_main);
 
     CBlockIndex* pindex;
@@ -1789,199 +2304,70 @@ static UniValue getblockstats(const JSONRPCRequest& request)
     assert(pindex != nullptr);
 
     std::set<std::string> stats;
-    if (!request.params[1].isNull()) {
-        const UniValue stats_univalue = request.params[1].get_array();
-        for (unsigned int i = 0; i < stats_univalue.size(); i++) {
-            const std::string stat = stats_univalue[i].get_str();
-            stats.insert(stat);
-        }
-    }
-
-    const CBlock block = GetBlockChecked(pindex);
-
-    const bool do_all = stats.size() == 0; // Calculate everything if nothing selected (default)
-    const bool do_mediantxsize = do_all || stats.count("mediantxsize") != 0;
-    const bool do_medianfee = do_all || stats.count("medianfee") != 0;
-    const bool do_feerate_percentiles = do_all || stats.count("feerate_percentiles") != 0;
-    const bool loop_inputs = do_all || do_medianfee || do_feerate_percentiles ||
-        SetHasKeys(stats, "utxo_size_inc", "totalfee", "avgfee", "avgfeerate", "minfee", "maxfee", "minfeerate", "maxfeerate");
-    const bool loop_outputs = do_all || loop_inputs || stats.count("total_out");
-    const bool do_calculate_size = do_mediantxsize ||
-        SetHasKeys(stats, "total_size", "avgtxsize", "mintxsize", "maxtxsize", "swtotal_size");
-    const bool do_calculate_weight = do_all || SetHasKeys(stats, "total_weight", "avgfeerate", "swtotal_weight", "avgfeerate", "feerate_percentiles", "minfeerate", "maxfeerate");
-    const bool do_calculate_sw = do_all || SetHasKeys(stats, "swtxs", "swtotal_size", "swtotal_weight");
-
-    CAmount maxfee = 0;
-    CAmount maxfeerate = 0;
-    CAmount minfee = MAX_MONEY;
-    CAmount minfeerate = MAX_MONEY;
-    CAmount total_out = 0;
-    CAmount totalfee = 0;
-    int64_t inputs = 0;
-    int64_t maxtxsize = 0;
-    int64_t mintxsize = MAX_BLOCK_SERIALIZED_SIZE;
-    int64_t outputs = 0;
-    int64_t swtotal_size = 0;
-    int64_t swtotal_weight = 0;
-    int64_t swtxs = 0;
-    int64_t total_size = 0;
-    int64_t total_weight = 0;
-    int64_t utxo_size_inc = 0;
-    std::vector<CAmount> fee_array;
-    std::vector<std::pair<CAmount, int64_t>> feerate_array;
-    std::vector<int64_t> txsize_array;
-
-    for (const auto& tx : block.vtx) {
-        outputs += tx->vout.size();
-
-        CAmount tx_total_out = 0;
-        if (loop_outputs) {
-            for (const CTxOut& out : tx->vout) {
-                tx_total_out += out.nValue;
-                utxo_size_inc += GetSerializeSize(out, SER_NETWORK, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
-            }
-            for (const auto& out : tx->vpout) {
-                if (out->IsStandardOutput())
-                    tx_total_out += out->GetValue();
-                utxo_size_inc += GetSerializeSize(*out, SER_NETWORK, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD + 1;
-            }
-        }
-
-        if (tx->IsCoinBase()) {
-            continue;
-        }
-
-        inputs += tx->vin.size(); // Don't count coinbase's fake input
-        total_out += tx_total_out; // Don't count coinbase reward
-
-        int64_t tx_size = 0;
-        if (do_calculate_size) {
+    const bool fFees = ParseSelectedStats(request.params[1], stats);
 
-            tx_size = tx->GetTotalSize();
-            if (do_mediantxsize) {
-                txsize_array.push_back(tx_size);
-            }
-            maxtxsize = std::max(maxtxsize, tx_size);
-            mintxsize = std::min(mintxsize, tx_size);
-            total_size += tx_size;
-        }
-
-        int64_t weight = 0;
-        if (do_calculate_weight) {
-            weight = GetTransactionWeight(*tx);
-            total_weight += weight;
-        }
-
-        if (do_calculate_sw && tx->HasWitness()) {
-            ++swtxs;
-            swtotal_size += tx_size;
-            swtotal_weight += weight;
-        }
-
-        if (loop_inputs) {
-
-            if (!g_txindex) {
-                throw JSONRPCError(RPC_INVALID_PARAMETER, "One or more of the selected stats requires -txindex enabled");
-            }
-            CAmount tx_total_in = 0;
-            for (const CTxIn& in : tx->vin) {
-                CTransactionRef tx_in;
-                uint256 hashBlock;
-                if (!GetTransaction(in.prevout.hash, tx_in, Params().GetConsensus(), hashBlock, false)) {
-                    throw JSONRPCError(RPC_INTERNAL_ERROR, std::string("Unexpected internal error (tx index seems corrupt)"));
-                }
-
-                if (tx->IsBitcoinCVersion()) {
-                    const auto& prevoutput = tx_in->vpout[in.prevout.n];
-
-                    if (prevoutput->IsStandardOutput())
-                        tx_total_in += prevoutput->GetValue();
-                    utxo_size_inc -= GetSerializeSize(*prevoutput, SER_NETWORK, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
-                } else
-                {
-                CTxOut prevoutput = tx_in->vout[in.prevout.n];
-
-                tx_total_in += prevoutput.nValue;
-                utxo_size_inc -= GetSerializeSize(prevoutput, SER_NETWORK, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
-                }
-            }
+    return BlockStatsToJSON(pindex, GetBlockStats(pindex, fFees), stats);
+}
 
-            CAmount txfee;
-            if (tx->IsCoinStake()) {
-                 txfee = 0;
-            } else
-            if (!tx->GetCTFee(txfee)) {
-                txfee = tx_total_in - tx_total_out;
-            }
+static UniValue getblockstatsrange(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 2 || request.params.size() > 3) {
+        throw std::runtime_error(
+            "getblockstatsrange start_height end_height ( stats )\n"
+            "\nCompute per block statistics for the active chain blocks from start_height to end_height.\n"
+            "Served from -blockstatsindex when it has the range, otherwise each block is read as by getblockstats.\n"
+            "\nArguments:\n"
+            "1. start_height           (numeric, required) The height of the first block\n"
+            "2. end_height             (numeric, required) The height of the last block, at most " + std::to_string(MAX_GETBLOCKSTATSRANGE_BLOCKS) + " blocks after start_height\n"
+            "3. \"stats\"              (array,  optional) Values to plot, by default all values (see getblockstats)\n"
+            "\nResult:\n"
+            "[                           (json array) getblockstats results, lowest height first\n"
+            "  {...},\n"
+            "  ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockstatsrange", "1000 1100 '[\"anon_outs\",\"avgfeerate\"]'")
+            + HelpExampleRpc("getblockstatsrange", "1000, 1100, [\"anon_outs\",\"avgfeerate\"]")
+        );
+    }
 
-            assert(MoneyRange(txfee));
-            if (do_medianfee) {
-                fee_array.push_back(txfee);
-            }
-            maxfee = std::max(maxfee, txfee);
-            minfee = std::min(minfee, txfee);
-            totalfee += txfee;
-
-            // New feerate uses satoshis per virtual byte instead of per serialized byte
-            CAmount feerate = weight ? (txfee * WITNESS_SCALE_FACTOR) / weight : 0;
-            if (do_feerate_percentiles) {
-                feerate_array.emplace_back(std::make_pair(feerate, weight));
-            }
-            maxfeerate = std::max(maxfeerate, feerate);
-            minfeerate = std::min(minfeerate, feerate);
-        }
+    if (g_blockstatsindex) {
+        g_blockstatsindex->BlockUntilSyncedToCurrentChain();
     }
 
-    CAmount feerate_percentiles[NUM_GETBLOCKSTATS_PERCENTILES] = { 0 };
-    CalculatePercentilesByWeight(feerate_percentiles, feerate_array, total_weight);
+    LOCK(cs_main);
 
-    UniValue feerates_res(UniValue::VARR);
-    for (int64_t i = 0; i < NUM_GETBLOCKSTATS_PERCENTILES; i++) {
-        feerates_res.push_back(feerate_percentiles[i]);
+    const int start_height = request.params[0].get_int();
+    const int end_height = request.params[1].get_int();
+    const int current_tip = chainActive.Height();
+    if (start_height < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Start height %d is negative", start_height));
     }
-
-    UniValue ret_all(UniValue::VOBJ);
-    ret_all.pushKV("avgfee", (block.vtx.size() > 1) ? totalfee / (block.vtx.size() - 1) : 0);
-    ret_all.pushKV("avgfeerate", total_weight ? (totalfee * WITNESS_SCALE_FACTOR) / total_weight : 0); // Unit: sat/vbyte
-    ret_all.pushKV("avgtxsize", (block.vtx.size() > 1) ? total_size / (block.vtx.size() - 1) : 0);
-    ret_all.pushKV("blockhash", pindex->GetBlockHash().GetHex());
-    ret_all.pushKV("feerate_percentiles", feerates_res);
-    ret_all.pushKV("height", (int64_t)pindex->nHeight);
-    ret_all.pushKV("ins", inputs);
-    ret_all.pushKV("maxfee", maxfee);
-    ret_all.pushKV("maxfeerate", maxfeerate);
-    ret_all.pushKV("maxtxsize", maxtxsize);
-    ret_all.pushKV("medianfee", CalculateTruncatedMedian(fee_array));
-    ret_all.pushKV("mediantime", pindex->GetMedianTimePast());
-    ret_all.pushKV("mediantxsize", CalculateTruncatedMedian(txsize_array));
-    ret_all.pushKV("minfee", (minfee == MAX_MONEY) ? 0 : minfee);
-    ret_all.pushKV("minfeerate", (minfeerate == MAX_MONEY) ? 0 : minfeerate);
-    ret_all.pushKV("mintxsize", mintxsize == MAX_BLOCK_SERIALIZED_SIZE ? 0 : mintxsize);
-    ret_all.pushKV("outs", outputs);
-    ret_all.pushKV("subsidy", GetBlockSubsidy(pindex->nHeight, Params().GetConsensus()));
-    ret_all.pushKV("swtotal_size", swtotal_size);
-    ret_all.pushKV("swtotal_weight", swtotal_weight);
-    ret_all.pushKV("swtxs", swtxs);
-    ret_all.pushKV("time", pindex->GetBlockTime());
-    ret_all.pushKV("total_out", total_out);
-    ret_all.pushKV("total_size", total_size);
-    ret_all.pushKV("total_weight", total_weight);
-    ret_all.pushKV("totalfee", totalfee);
-    ret_all.pushKV("txs", (int64_t)block.vtx.size());
-    ret_all.pushKV("utxo_increase", outputs - inputs);
-    ret_all.pushKV("utxo_size_inc", utxo_size_inc);
-
-    if (do_all) {
-        return ret_all;
+    if (end_height < start_height) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("End height %d below start height %d", end_height, start_height));
+    }
+    if (end_height > current_tip) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("End height %d after current tip %d", end_height, current_tip));
+    }
+    if (end_height - start_height >= MAX_GETBLOCKSTATSRANGE_BLOCKS) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Range exceeds %d blocks", MAX_GETBLOCKSTATSRANGE_BLOCKS));
     }
 
-    UniValue ret(UniValue::VOBJ);
-    for (const std::string& stat : stats) {
-        const UniValue& value = ret_all[stat];
-        if (value.isNull()) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid selected statistic %s", stat));
+    std::set<std::string> stats;
+    const bool fFees = ParseSelectedStats(request.params[2], stats);
+
+    const CBlockIndex* stop_index = chainActive[end_height];
+    std::vector<CBlockStats> vStats;
+    if (!g_blockstatsindex || !g_blockstatsindex->LookupStatsRange(start_height, stop_index, vStats)) {
+        vStats.clear();
+        for (int height = start_height; height <= end_height; ++height) {
+            vStats.push_back(GetBlockStats(chainActive[height], fFees));
         }
-        ret.pushKV(stat, value);
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (int height = start_height; height <= end_height; ++height) {
+        ret.push_back(BlockStatsToJSON(chainActive[height], vStats[height - start_height], stats));
     }
     return ret;
 }
@@ -2220,12 +2606,88 @@ UniValue scantxoutset(const JSONRPCRequest& request)
     return result;
 }
 
+static UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2) {
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a BIP 157 content filter for a particular block.\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"    (string, required) The hash of the block\n"
+            "2. \"filtertype\"   (string, optional, default=stealth) The type name of the filter\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : (string) the hex-encoded filter data\n"
+            "  \"header\" : (string) the hex-encoded filter header\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"stealth\"")
+            + HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"stealth\"")
+        );
+    }
+
+    uint256 block_hash = ParseHashV(request.params[0], "blockhash");
+    std::string filtertype_name = "stealth";
+    if (!request.params[1].isNull()) {
+        filtertype_name = request.params[1].get_str();
+    }
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(filtertype_name, filtertype)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    if (!g_blockfilterindex || g_blockfilterindex->GetFilterType() != filtertype) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + filtertype_name);
+    }
+
+    const CBlockIndex* block_index;
+    bool block_was_connected;
+    {
+        LOCK(cs_main);
+        block_index = LookupBlockIndex(block_hash);
+        if (!block_index) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        block_was_connected = block_index->IsValid(BLOCK_VALID_SCRIPTS);
+    }
+
+    bool index_ready = g_blockfilterindex->BlockUntilSyncedToCurrentChain();
+
+    BlockFilter filter;
+    uint256 filter_header;
+    if (!g_blockfilterindex->LookupFilter(block_index, filter) ||
+        !g_blockfilterindex->LookupFilterHeader(block_index, filter_header)) {
+        int err_code;
+        std::string errmsg = "Filter not found.";
+
+        if (!block_was_connected) {
+            err_code = RPC_INVALID_ADDRESS_OR_KEY;
+            errmsg += " Block was not connected to active chain.";
+        } else if (!index_ready) {
+            err_code = RPC_MISC_ERROR;
+            errmsg += " Block filters are still in the process of being indexed.";
+        } else {
+            err_code = RPC_INTERNAL_ERROR;
+            errmsg += " This error is unexpected and indicates index corruption.";
+        }
+
+        throw JSONRPCError(err_code, errmsg);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+    ret.pushKV("header", filter_header.GetHex());
+    return ret;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      {} },
     { "blockchain",         "getchaintxstats",        &getchaintxstats,        {"nblocks", "blockhash"} },
     { "blockchain",         "getblockstats",          &getblockstats,          {"hash_or_height", "stats"} },
+    { "blockchain",         "getblockstatsrange",     &getblockstatsrange,     {"start_height", "end_height", "stats"} },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       {} },
     { "blockchain",         "getblockcount",          &getblockcount,          {} },
     { "blockchain",         "getblock",               &getblock,               {"blockhash","verbosity"} },
@@ -2239,13 +2701,17 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"flush"} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           {"path"} },
+    { "blockchain",         "verifytxoutset",         &verifytxoutset,         {"path"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
+    { "blockchain",         "verifychainbackground",  &verifychainbackground,  {"action","checklevel","nblocks","options"} },
 
     { "blockchain",         "preciousblock",          &preciousblock,          {"blockhash"} },
     { "blockchain",         "scantxoutset",           &scantxoutset,           {"action", "scanobjects"} },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         {"blockhash", "filtertype"} },
 
     /* Not shown in help */
     { "hidden",             "invalidateblock",        &invalidateblock,        {"blockhash"} },
@@ -2254,6 +2720,7 @@ static const CRPCCommand commands[] =
     { "hidden",             "waitforblock",           &waitforblock,           {"blockhash","timeout"} },
     { "hidden",             "waitforblockheight",     &waitforblockheight,     {"height","timeout"} },
     { "hidden",             "syncwithvalidationinterfacequeue", &syncwithvalidationinterfacequeue, {} },
+    { "hidden",             "replayblocks",           &replayblocks,           {"start_height","end_height"} },
 };
 
 void RegisterBlockchainRPCCommands(CRPCTable &t)
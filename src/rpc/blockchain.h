@@ -11,6 +11,7 @@
 
 class CBlock;
 class CBlockIndex;
+class CJSONStreamWriter;
 class UniValue;
 
 static constexpr int NUM_GETBLOCKSTATS_PERCENTILES = 5;
@@ -29,12 +30,16 @@ void RPCNotifyBlockChange(bool ibd, const CBlockIndex *);
 
 /** Block description to JSON */
 UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+/** Block description with txn details, written to stream */
+void blockToJSON(CJSONStreamWriter& stream, const CBlock& block, const CBlockIndex* blockindex);
 
 /** Mempool information to JSON */
 UniValue mempoolInfoToJSON();
 
 /** Mempool to JSON */
 UniValue mempoolToJSON(bool fVerbose = false);
+/** Verbose mempool, written to stream */
+void mempoolToJSON(CJSONStreamWriter& stream);
 
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* blockindex);
@@ -132,6 +132,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "converttopsbt", 2, "iswitness"},
     { "gettxout", 1, "n" },
     { "gettxout", 2, "include_mempool" },
+    { "gettxoutsetinfo", 0, "flush" },
     { "gettxoutproof", 0, "txids" },
     { "lockunspent", 0, "unlock" },
     { "lockunspent", 1, "transactions" },
@@ -144,8 +145,16 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "importmulti", 1, "options" },
     { "verifychain", 0, "checklevel" },
     { "verifychain", 1, "nblocks" },
+    { "verifychainbackground", 1, "checklevel" },
+    { "verifychainbackground", 2, "nblocks" },
+    { "verifychainbackground", 3, "options" },
+    { "replayblocks", 0, "start_height" },
+    { "replayblocks", 1, "end_height" },
     { "getblockstats", 0, "hash_or_height" },
     { "getblockstats", 1, "stats" },
+    { "getblockstatsrange", 0, "start_height" },
+    { "getblockstatsrange", 1, "end_height" },
+    { "getblockstatsrange", 2, "stats" },
     { "pruneblockchain", 0, "height" },
     { "keypoolrefill", 0, "newsize" },
     { "getrawmempool", 0, "verbose" },
@@ -162,6 +171,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getblockhashes", 0 , "high"},
     { "getblockhashes", 1, "low"},
     { "getblockhashes", 2, "options" },
+    { "gettxoutsetinfobyscript", 0, "flush" },
     { "getspentinfo", 0, "inputs"},
     { "getaddresstxids", 0, "addresses"},
     { "getaddressbalance", 0, "addresses"},
@@ -170,7 +180,10 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getaddressmempool", 0, "addresses"},
     { "listcoldstakeunspent", 1, "height"},
     { "listcoldstakeunspent", 2, "options"},
+    { "getcoldstakeweights", 1, "height"},
     { "getblockreward", 0, "height"},
+    { "getblockrewards", 0, "from"},
+    { "getblockrewards", 1, "to"},
     { "getblocktimes", 0, "from"},
     { "getblocktimes", 1, "to"},
     { "bumpfee", 1, "options" },
@@ -180,6 +193,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "scanchain", 0, "from_height" },
     { "deriverangekeys", 0, "start" },
     { "deriverangekeys", 1, "end" },
+    { "compactwallet", 0, "stake_depth" },
+    { "compactwallet", 1, "trim_depth" },
     { "filtertransactions", 0, "options" },
     { "filteraddresses", 0, "offset" },
     { "filteraddresses", 1, "count" },
@@ -202,6 +217,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "sendtypeto", 6, "inputs_per_sig" },
     { "sendtypeto", 7, "test_fee" },
     { "sendtypeto", 8, "coincontrol" },
+    { "sendtypetomany", 2, "outputs" },
+    { "sendtypetomany", 3, "options" },
 
     { "buildscript", 0, "json" },
     { "createsignaturewithwallet", 1, "prevtx" },
@@ -241,6 +258,11 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "smsgsend", 6, "fromfile" },
     { "smsgsend", 7, "decodehex" },
     { "smsg", 1, "options" },
+    { "smsginbox", 2, "options" },
+    { "smsgoutbox", 2, "options" },
+    { "anonoutput", 1, "count" },
+    { "exportanonoutputs", 1, "start" },
+    { "exportanonoutputs", 2, "count" },
 
     { "devicesignrawtransaction", 1, "prevtxs" },
     { "devicesignrawtransaction", 2, "privkeypaths" },
@@ -251,6 +273,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
 
     { "logging", 0, "include" },
     { "logging", 1, "exclude" },
+    { "getlockprofile", 1, "reset" },
     { "disconnectnode", 1, "nodeid" },
     { "addwitnessaddress", 1, "p2sh" },
     // Echo with conversion (For testing only)
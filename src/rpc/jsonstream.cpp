@@ -0,0 +1,91 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/jsonstream.h>
+
+#include <univalue.h>
+
+#include <assert.h>
+
+void CJSONStreamWriter::BeginElement()
+{
+    if (m_after_key) {
+        m_after_key = false;
+        return;
+    }
+    if (!m_has_elements.empty()) {
+        if (m_has_elements.back()) {
+            m_buffer += ',';
+        }
+        m_has_elements.back() = true;
+    }
+}
+
+void CJSONStreamWriter::Append(const std::string &s)
+{
+    m_buffer += s;
+    if (m_buffer.size() >= m_chunk_size) {
+        Flush();
+    }
+}
+
+void CJSONStreamWriter::BeginObject()
+{
+    BeginElement();
+    m_has_elements.push_back(false);
+    Append("{");
+}
+
+void CJSONStreamWriter::EndObject()
+{
+    assert(!m_has_elements.empty() && !m_after_key);
+    m_has_elements.pop_back();
+    Append("}");
+}
+
+void CJSONStreamWriter::BeginArray()
+{
+    BeginElement();
+    m_has_elements.push_back(false);
+    Append("[");
+}
+
+void CJSONStreamWriter::EndArray()
+{
+    assert(!m_has_elements.empty() && !m_after_key);
+    m_has_elements.pop_back();
+    Append("]");
+}
+
+void CJSONStreamWriter::Key(const std::string &key)
+{
+    assert(!m_has_elements.empty() && !m_after_key);
+    BeginElement();
+    m_after_key = true;
+    // UniValue does the escaping
+    Append(UniValue(key).write() + ":");
+}
+
+void CJSONStreamWriter::Value(const UniValue &value)
+{
+    BeginElement();
+    Append(value.write());
+}
+
+void CJSONStreamWriter::Flush()
+{
+    if (m_buffer.empty()) {
+        return;
+    }
+    m_started = true;
+    m_sink(m_buffer);
+    m_buffer.clear();
+}
+
+std::string CJSONStreamWriter::TakeBuffer()
+{
+    std::string s;
+    s.swap(m_buffer);
+    return s;
+}
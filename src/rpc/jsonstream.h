@@ -0,0 +1,68 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_RPC_JSONSTREAM_H
+#define BITCOINC_RPC_JSONSTREAM_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class UniValue;
+
+//! Output is passed to the sink in pieces of at least this size
+static const size_t JSON_STREAM_CHUNK_SIZE = 64 * 1024;
+
+typedef std::function<void(const std::string&)> JSONStreamSink;
+
+/**
+ * Incremental JSON emitter for RPC results too large to build as one UniValue.
+ *
+ * Containers are opened and closed explicitly, elements are written as
+ * UniValue subtrees, so memory is bounded by the largest element plus the
+ * chunk size. Nothing reaches the sink before JSON_STREAM_CHUNK_SIZE bytes
+ * are buffered, output that stays below that can still be discarded.
+ */
+class CJSONStreamWriter
+{
+public:
+    explicit CJSONStreamWriter(const JSONStreamSink &sink, size_t nChunkSize = JSON_STREAM_CHUNK_SIZE)
+        : m_sink(sink), m_chunk_size(nChunkSize) {};
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    //! Key of the next value, only within objects
+    void Key(const std::string &key);
+    void Value(const UniValue &value);
+    void KeyValue(const std::string &key, const UniValue &value)
+    {
+        Key(key);
+        Value(value);
+    };
+
+    //! Pass everything buffered to the sink
+    void Flush();
+    //! Whether anything was written, to the sink or the buffer
+    bool HasOutput() const { return m_started || !m_buffer.empty(); };
+    //! Whether output was passed to the sink and can no longer be withdrawn
+    bool IsStarted() const { return m_started; };
+    //! Take the buffered output, for writers that never reached the sink
+    std::string TakeBuffer();
+
+private:
+    JSONStreamSink m_sink;
+    size_t m_chunk_size;
+    std::string m_buffer;
+    bool m_started = false;
+    //! Per open container, whether an element was written to it
+    std::vector<bool> m_has_elements;
+    bool m_after_key = false;
+
+    void BeginElement();
+    void Append(const std::string &s);
+};
+
+#endif // BITCOINC_RPC_JSONSTREAM_H
@@ -771,9 +771,9 @@ static UniValue estimatefee(const JSONRPCRequest& request)
 
 static UniValue estimatesmartfee(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
         throw std::runtime_error(
-            "estimatesmartfee conf_target (\"estimate_mode\")\n"
+            "estimatesmartfee conf_target (\"estimate_mode\" \"tx_class\")\n"
             "\nEstimates the approximate fee per kilobyte needed for a transaction to begin\n"
             "confirmation within conf_target blocks if possible and return the number of blocks\n"
             "for which the estimate is valid. Uses virtual transaction size as defined\n"
@@ -789,6 +789,13 @@ static UniValue estimatesmartfee(const JSONRPCRequest& request)
             "       \"UNSET\" (defaults to CONSERVATIVE)\n"
             "       \"ECONOMICAL\"\n"
             "       \"CONSERVATIVE\"\n"
+            "3. \"tx_class\"      (string, optional, default=all) Estimate only from transactions of this kind.\n"
+            "                   Blinded and anon transactions are larger and may confirm differently.  Must be one of:\n"
+            "       \"all\"\n"
+            "       \"plain\"           (no blinded or anon outputs)\n"
+            "       \"blinded\"         (blinded outputs, nothing anon)\n"
+            "       \"anon\"            (anon outputs or inputs, rings up to " + std::to_string(FEE_CLASS_LARGE_RING_SIZE) + ")\n"
+            "       \"anon_large_ring\" (anon inputs with larger rings)\n"
             "\nResult:\n"
             "{\n"
             "  \"feerate\" : x.x,     (numeric, optional) estimate fee rate in " + CURRENCY_UNIT + "/kB\n"
@@ -802,9 +809,10 @@ static UniValue estimatesmartfee(const JSONRPCRequest& request)
             "have been observed to make an estimate for any number of blocks.\n"
             "\nExample:\n"
             + HelpExampleCli("estimatesmartfee", "6")
+            + HelpExampleCli("estimatesmartfee", "6 CONSERVATIVE anon")
             );
 
-    RPCTypeCheck(request.params, {UniValue::VNUM, UniValue::VSTR});
+    RPCTypeCheck(request.params, {UniValue::VNUM, UniValue::VSTR, UniValue::VSTR});
     RPCTypeCheckArgument(request.params[0], UniValue::VNUM);
     unsigned int conf_target = ParseConfirmTarget(request.params[0]);
     bool conservative = true;
@@ -815,11 +823,17 @@ static UniValue estimatesmartfee(const JSONRPCRequest& request)
         }
         if (fee_mode == FeeEstimateMode::ECONOMICAL) conservative = false;
     }
+    FeeEstimateClass fee_class = FeeEstimateClass::ALL;
+    if (!request.params[2].isNull()) {
+        if (!FeeEstimateClassFromString(request.params[2].get_str(), fee_class)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid tx_class parameter");
+        }
+    }
 
     UniValue result(UniValue::VOBJ);
     UniValue errors(UniValue::VARR);
     FeeCalculation feeCalc;
-    CFeeRate feeRate = ::feeEstimator.estimateSmartFee(conf_target, &feeCalc, conservative);
+    CFeeRate feeRate = ::feeEstimator.estimateSmartFee(conf_target, &feeCalc, conservative, fee_class);
     if (feeRate != CFeeRate(0)) {
         result.pushKV("feerate", ValueFromAmount(feeRate.GetFeePerK()));
     } else {
@@ -945,7 +959,7 @@ static const CRPCCommand commands[] =
     { "generating",         "generatetoaddress",      &generatetoaddress,      {"nblocks","address","maxtries"} },
 
     { "hidden",             "estimatefee",            &estimatefee,            {} },
-    { "util",               "estimatesmartfee",       &estimatesmartfee,       {"conf_target", "estimate_mode"} },
+    { "util",               "estimatesmartfee",       &estimatesmartfee,       {"conf_target", "estimate_mode", "tx_class"} },
 
     { "hidden",             "estimaterawfee",         &estimaterawfee,         {"conf_target", "threshold"} },
 };
@@ -3,6 +3,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <cachebalancer.h>
 #include <chain.h>
 #include <clientversion.h>
 #include <core_io.h>
@@ -13,6 +14,7 @@
 #include <net.h>
 #include <netbase.h>
 #include <outputtype.h>
+#include <perfstats.h>
 #include <rpc/blockchain.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
@@ -350,6 +352,23 @@ static std::string RPCMallocInfo()
 }
 #endif
 
+static UniValue RPCCacheInfo()
+{
+    UniValue obj(UniValue::VOBJ);
+    for (const auto &info : g_cache_balancer.GetInfo()) {
+        UniValue cache(UniValue::VOBJ);
+        cache.pushKV("size", (uint64_t)info.nSize);
+        cache.pushKV("balanced", info.fBalanced);
+        if (info.fBalanced) {
+            cache.pushKV("min_size", (uint64_t)info.nMinSize);
+            cache.pushKV("hits", info.nHits);
+            cache.pushKV("misses", info.nMisses);
+        }
+        obj.pushKV(info.sName, cache);
+    }
+    return obj;
+}
+
 static UniValue getmemoryinfo(const JSONRPCRequest& request)
 {
     /* Please, avoid using the word "pool" here in the RPC interface or help,
@@ -372,6 +391,15 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"caches\": {               (json object) Split of -dbcache and the in-memory caches, see -dbcachebalance\n"
+            "    \"name\": {\n"
+            "      \"size\": xxxxx,        (numeric) Current limit in bytes\n"
+            "      \"balanced\": true|false, (boolean) If the limit is moved by the cache miss rates\n"
+            "      \"min_size\": xxxxx,    (numeric) Least the limit is lowered to, balanced caches only\n"
+            "      \"hits\": xxxxx,        (numeric) Hits at the last rebalance, balanced caches only\n"
+            "      \"misses\": xxxxx,      (numeric) Misses at the last rebalance, balanced caches only\n"
+            "    }, ...\n"
             "  }\n"
             "}\n"
             "\nResult (mode \"mallocinfo\"):\n"
@@ -385,6 +413,7 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.pushKV("locked", RPCLockedMemoryInfo());
+        obj.pushKV("caches", RPCCacheInfo());
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
@@ -397,6 +426,140 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
     }
 }
 
+static UniValue getperformancestats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "getperformancestats (\"format\")\n"
+            "Returns latency histograms and event counters of RPC methods, block connection, verification, secure messaging and staking.\n"
+            "Histograms are named \"<group>:<name>\", e.g. \"rpc:getblock\" or \"connectblock:inputs\".\n"
+            "\nArguments:\n"
+            "1. \"format\"   (string, optional, default=\"json\") \"json\" or \"prometheus\" for the Prometheus text format.\n"
+            "\nResult (format \"json\"):\n"
+            "{\n"
+            "  \"histograms\": {\n"
+            "    \"name\": {\n"
+            "      \"count\": xxxxx,       (numeric) Number of recorded durations\n"
+            "      \"total_us\": xxxxx,    (numeric) Sum of the durations in microseconds\n"
+            "      \"max_us\": xxxxx,      (numeric) Longest duration in microseconds\n"
+            "      \"buckets\": [          (array) [upper bound in microseconds, count] of non-empty buckets, the last bound is open\n"
+            "        [xxxxx, xxxxx], ...\n"
+            "      ]\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"counters\": {\n"
+            "    \"name\": xxxxx,         (numeric) Number of events\n"
+            "    ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getperformancestats", "")
+            + HelpExampleCli("getperformancestats", "\"prometheus\"")
+            + HelpExampleRpc("getperformancestats", "")
+        );
+
+    std::string format = request.params[0].isNull() ? "json" : request.params[0].get_str();
+    if (format == "prometheus") {
+        return PerfStatsToPrometheus();
+    }
+    if (format != "json") {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "unknown format " + format);
+    }
+
+    UniValue histograms(UniValue::VOBJ);
+    for (const auto &h : g_perf_stats.GetHistograms()) {
+        const CPerfHistogram::Snapshot &snap = h.second;
+        UniValue buckets(UniValue::VARR);
+        for (int b = 0; b < PERF_HISTOGRAM_BUCKETS; ++b) {
+            if (snap.vBuckets[b] == 0) {
+                continue;
+            }
+            UniValue bucket(UniValue::VARR);
+            bucket.push_back(b == PERF_HISTOGRAM_BUCKETS - 1 ? NullUniValue : UniValue(CPerfHistogram::BucketBound(b)));
+            bucket.push_back(snap.vBuckets[b]);
+            buckets.push_back(bucket);
+        }
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("count", snap.nCount);
+        obj.pushKV("total_us", snap.nSumMicros);
+        obj.pushKV("max_us", snap.nMaxMicros);
+        obj.pushKV("buckets", buckets);
+        histograms.pushKV(h.first, obj);
+    }
+    UniValue counters(UniValue::VOBJ);
+    for (const auto &c : g_perf_stats.GetCounters()) {
+        counters.pushKV(c.first, c.second);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("histograms", histograms);
+    result.pushKV("counters", counters);
+    return result;
+}
+
+static UniValue getlockprofile(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 2)
+        throw std::runtime_error(
+            "getlockprofile (\"lock\" reset)\n"
+            "Returns wait and hold times of locks per callsite, most held first.\n"
+            "Only available if built with --enable-lock-profile.\n"
+            "\nArguments:\n"
+            "1. \"lock\"     (string, optional) Only callsites where the locked expression contains this, e.g. \"cs_main\" or \"cs_wallet\".\n"
+            "2. reset      (boolean, optional, default=false) Clear the counters after reading them.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"lock\": \"str\",         (string) The locked expression, e.g. \"mempool.cs\"\n"
+            "    \"callsite\": \"str\",     (string) file:line of the LOCK\n"
+            "    \"count\": xxxxx,        (numeric) Times the lock was taken\n"
+            "    \"contended\": xxxxx,    (numeric) Times another thread held the lock\n"
+            "    \"wait_us\": xxxxx,      (numeric) Total time spent waiting in microseconds\n"
+            "    \"max_wait_us\": xxxxx,  (numeric) Longest wait in microseconds\n"
+            "    \"hold_us\": xxxxx,      (numeric) Total time held in microseconds\n"
+            "    \"max_hold_us\": xxxxx,  (numeric) Longest hold in microseconds\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlockprofile", "")
+            + HelpExampleCli("getlockprofile", "\"cs_main\" true")
+            + HelpExampleRpc("getlockprofile", "\"cs_wallet\"")
+        );
+
+    RPCTypeCheck(request.params, {UniValue::VSTR, UniValue::VBOOL}, true);
+    std::string filter = request.params[0].isNull() ? "" : request.params[0].get_str();
+    bool reset = request.params[1].isNull() ? false : request.params[1].get_bool();
+
+    std::vector<LockProfileStats> stats;
+    if (!GetLockProfile(stats)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Lock profiling is not enabled, build with --enable-lock-profile");
+    }
+    if (reset) {
+        ResetLockProfile();
+    }
+    std::sort(stats.begin(), stats.end(), [](const LockProfileStats& a, const LockProfileStats& b) {
+        return a.hold_us > b.hold_us;
+    });
+
+    UniValue result(UniValue::VARR);
+    for (const auto& s : stats) {
+        if (!filter.empty() && s.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("lock", s.name);
+        obj.pushKV("callsite", strprintf("%s:%d", s.file, s.line));
+        obj.pushKV("count", s.count);
+        obj.pushKV("contended", s.contended);
+        obj.pushKV("wait_us", s.wait_us);
+        obj.pushKV("max_wait_us", s.max_wait_us);
+        obj.pushKV("hold_us", s.hold_us);
+        obj.pushKV("max_hold_us", s.max_hold_us);
+        result.push_back(obj);
+    }
+    return result;
+}
+
 static void EnableOrDisableLogCategories(UniValue cats, bool enable) {
     cats = cats.get_array();
     for (unsigned int i = 0; i < cats.size(); ++i) {
@@ -558,6 +721,8 @@ static const CRPCCommand commands[] =
   //  --------------------- ------------------------  -----------------------  ----------
     { "control",            "getmemoryinfo",          &getmemoryinfo,          {"mode"} },
     { "control",            "logging",                &logging,                {"include", "exclude"}},
+    { "control",            "getperformancestats",    &getperformancestats,    {"format"} },
+    { "control",            "getlockprofile",         &getlockprofile,         {"lock","reset"} },
     { "util",               "validateaddress",        &validateaddress,        {"address","showaltversions"} }, /* uses wallet if enabled */
     { "util",               "createmultisig",         &createmultisig,         {"nrequired","keys"} },
     { "util",               "verifymessage",          &verifymessage,          {"address","signature","message"} },
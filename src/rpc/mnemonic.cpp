@@ -15,10 +15,14 @@
 #include <chainparams.h>
 #include <support/cleanse.h>
 #include <key/mnemonic.h>
+#include <shutdown.h>
 
 #include <string>
 #include <univalue.h>
 
+static const size_t MAX_RECOVER_CANDIDATES = 1 << 22;
+static const size_t RECOVER_CHUNK_SIZE = 4096;
+
 //typedef std::basic_string<char, std::char_traits<char>, secure_allocator<char> > SecureString;
 
 int GetLanguageOffset(std::string sIn)
@@ -44,7 +48,7 @@ int GetLanguageOffset(std::string sIn)
 UniValue mnemonic(const JSONRPCRequest &request)
 {
     static const char *help = ""
-        "mnemonic new|decode|addchecksum|dumpwords|listlanguages\n"
+        "mnemonic new|decode|addchecksum|recover|dumpwords|listlanguages\n"
         "mnemonic new ( \"password\" language nBytesEntropy bip44 )\n"
         "    Generate a new extended key and mnemonic\n"
         "    password, can be blank "", default blank\n"
@@ -57,6 +61,13 @@ UniValue mnemonic(const JSONRPCRequest &request)
         "mnemonic addchecksum \"mnemonic\"\n"
         "    Add checksum words to mnemonic.\n"
         "    Final no of words in mnemonic must be divisible by three.\n"
+        "mnemonic recover \"mnemonic\" \"passwords\" \"target\" ( threads )\n"
+        "    Search for the mnemonic and password of a known key.\n"
+        "    mnemonic, words missing from it may be given as ?\n"
+        "    passwords, a password or a json array of passwords to try\n"
+        "    target, master or derived extended key, secret or public, as output by decode\n"
+        "    threads, default one per core\n"
+        "    Candidates failing the checksum are rejected without deriving their seed.\n"
         "mnemonic dumpwords ( \"language\" )\n"
         "    Print list of words.\n"
         "    language, default english\n"
@@ -74,7 +85,7 @@ UniValue mnemonic(const JSONRPCRequest &request)
         std::string s = request.params[0].get_str();
         std::string st = " " + s + " "; // Note the spaces
         std::transform(st.begin(), st.end(), st.begin(), ::tolower);
-        static const char *pmodes = " new decode addchecksum dumpwords listlanguages ";
+        static const char *pmodes = " new decode addchecksum recover dumpwords listlanguages ";
         if (strstr(pmodes, st.c_str()) != nullptr) {
             st.erase(std::remove(st.begin(), st.end(), ' '), st.end());
             mode = st;
@@ -246,6 +257,144 @@ UniValue mnemonic(const JSONRPCRequest &request)
         }
         result.pushKV("result", sMnemonicOut);
     } else
+    if (mode == "recover") {
+        if (request.params.size() < 4) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Must provide mnemonic, passwords and target.");
+        }
+        if (request.params.size() > 5) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Too many parameters");
+        }
+
+        std::vector<std::string> vWords;
+        std::string sKnown, sWord, sError;
+        std::stringstream sstrWords(request.params[1].get_str());
+        while (sstrWords >> sWord) {
+            vWords.push_back(sWord);
+            if (sWord != "?") {
+                sKnown += (sKnown.empty() ? "" : " ") + sWord;
+            }
+        }
+
+        UniValue passwords(UniValue::VARR);
+        if (request.params[2].isArray()) {
+            passwords = request.params[2].get_array();
+        } else
+        if (!passwords.read(request.params[2].get_str()) || !passwords.isArray()) {
+            passwords = UniValue(UniValue::VARR);
+            passwords.push_back(request.params[2].get_str());
+        }
+        if (passwords.size() < 1) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Must provide a password.");
+        }
+
+        CExtKey58 eKey58;
+        CExtPubKey ekTarget;
+        if (0 != eKey58.Set58(request.params[3].get_str().c_str())
+            || !eKey58.GetPubKey(ekTarget, &Params())) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid target key.");
+        }
+
+        int nThreads = 0;
+        if (request.params.size() > 4) {
+            std::stringstream sstr(request.params[4].get_str());
+            sstr >> nThreads;
+            if (!sstr) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid num threads");
+            }
+        }
+
+        int nLanguage = MnemonicDetectLanguage(sKnown);
+        if (nLanguage < 1 || nLanguage >= WLL_MAX) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown language.");
+        }
+
+        std::vector<std::string> vWordList;
+        while (0 == MnemonicGetWord(nLanguage, vWordList.size(), sWord, sError)) {
+            vWordList.push_back(sWord);
+        }
+
+        std::vector<size_t> vMissing;
+        for (size_t k = 0; k < vWords.size(); ++k) {
+            if (vWords[k] == "?") {
+                vMissing.push_back(k);
+            }
+        }
+
+        size_t nCandidates = passwords.size();
+        for (size_t k = 0; k < vMissing.size(); ++k) {
+            if (nCandidates > MAX_RECOVER_CANDIDATES / vWordList.size()) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Too many candidates, max %u.", MAX_RECOVER_CANDIDATES));
+            }
+            nCandidates *= vWordList.size();
+        }
+
+        // Missing words vary fastest, candidates are tested in chunks until a match
+        size_t nTested = 0, nRejected = 0;
+        bool fFound = false;
+        std::string sFoundMnemonic, sFoundPassword;
+        std::vector<MnemonicCandidate> vCandidates;
+        std::vector<std::vector<uint8_t> > vSeeds;
+        for (size_t c = 0; c < nCandidates && !fFound; c += RECOVER_CHUNK_SIZE) {
+            if (ShutdownRequested()) {
+                throw JSONRPCError(RPC_MISC_ERROR, "Shutdown requested.");
+            }
+
+            vCandidates.clear();
+            for (size_t i = c; i < std::min(nCandidates, c + RECOVER_CHUNK_SIZE); ++i) {
+                size_t n = i;
+                for (auto k : vMissing) {
+                    vWords[k] = vWordList[n % vWordList.size()];
+                    n /= vWordList.size();
+                }
+                MnemonicCandidate candidate;
+                for (const auto &w : vWords) {
+                    candidate.sMnemonic += (candidate.sMnemonic.empty() ? "" : " ") + w;
+                }
+                candidate.sPassword = passwords[n].get_str();
+                vCandidates.push_back(candidate);
+            }
+
+            nRejected += MnemonicToSeeds(nLanguage, vCandidates, vSeeds, nThreads);
+            nTested += vCandidates.size();
+
+            for (size_t i = 0; i < vSeeds.size(); ++i) {
+                if (vSeeds[i].empty()) {
+                    continue;
+                }
+                CExtKey ekMaster, ekDerived;
+                ekMaster.SetSeed(&vSeeds[i][0], vSeeds[i].size());
+                if (!ekMaster.IsValid()) {
+                    continue;
+                }
+                // m / purpose' / coin_type'
+                if (memcmp(ekMaster.chaincode, ekTarget.chaincode, 32) != 0
+                    && !(ekMaster.Derive(ekDerived, BIP44_PURPOSE)
+                        && ekDerived.Derive(ekDerived, Params().BIP44ID())
+                        && memcmp(ekDerived.chaincode, ekTarget.chaincode, 32) == 0)) {
+                    continue;
+                }
+                fFound = true;
+                sFoundMnemonic = vCandidates[i].sMnemonic;
+                sFoundPassword = vCandidates[i].sPassword;
+                break;
+            }
+
+            for (auto &candidate : vCandidates) {
+                if (candidate.sMnemonic.size() > 0) {
+                    memory_cleanse(&candidate.sMnemonic[0], candidate.sMnemonic.size());
+                }
+            }
+        }
+
+        result.pushKV("found", fFound);
+        if (fFound) {
+            result.pushKV("mnemonic", sFoundMnemonic);
+            result.pushKV("password", sFoundPassword);
+        }
+        result.pushKV("language", MnemonicGetLanguage(nLanguage));
+        result.pushKV("tested", (uint64_t)nTested);
+        result.pushKV("rejected", (uint64_t)nRejected);
+    } else
     if (mode == "dumpwords") {
         int nLanguage = WLL_ENGLISH;
 
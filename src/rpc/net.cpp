@@ -81,6 +81,8 @@ static std::string ServicesToString(ServiceFlags nSerivces)
         rv += std::string(rv.length() > 0 ? " | " : "") + "XTHIN";
     if (nSerivces & NODE_SMSG)
         rv += std::string(rv.length() > 0 ? " | " : "") + "SMSG";
+    if (nSerivces & NODE_COMPACT_FILTERS)
+        rv += std::string(rv.length() > 0 ? " | " : "") + "COMPACT_FILTERS";
 
     return rv;
 };
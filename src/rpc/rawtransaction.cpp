@@ -1322,6 +1322,10 @@ static UniValue sendrawtransaction(const JSONRPCRequest& request)
     if (!request.params[1].isNull() && request.params[1].get_bool())
         nMaxRawTxFee = 0;
 
+    if (!mempool.exists(hashTx)) {
+        PreCheckTransaction(tx, GetTime());
+    }
+
     { // cs_main scope
     LOCK(cs_main);
     CCoinsViewCache &view = *pcoinsTip;
@@ -7,6 +7,7 @@
 
 #include <fs.h>
 #include <key_io.h>
+#include <perfstats.h>
 #include <random.h>
 #include <shutdown.h>
 #include <sync.h>
@@ -20,7 +21,9 @@
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 
+#include <condition_variable>
 #include <memory> // for unique_ptr
+#include <mutex>
 #include <unordered_map>
 #include <time.h>
 
@@ -414,11 +417,70 @@ static UniValue JSONRPCExecOne(JSONRPCRequest jreq, const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq)
+/** Requests of a batch shared with its helpers, which may outlive the call */
+struct BatchState
+{
+    BatchState(const JSONRPCRequest& jreqIn, const UniValue& vReqIn) : jreq(jreqIn), vReq(vReqIn), vResults(vReqIn.size()) {}
+
+    const JSONRPCRequest jreq;
+    const UniValue vReq;
+    std::mutex cs;
+    std::condition_variable cond;
+    size_t nNext = 0;
+    size_t nDone = 0;
+    std::vector<UniValue> vResults;
+
+    /** Execute requests until none are left to claim */
+    void Work()
+    {
+        while (true) {
+            size_t reqIdx;
+            {
+                std::lock_guard<std::mutex> lock(cs);
+                if (nNext >= vReq.size()) {
+                    return;
+                }
+                reqIdx = nNext++;
+            }
+            UniValue result = JSONRPCExecOne(jreq, vReq[reqIdx]);
+            {
+                std::lock_guard<std::mutex> lock(cs);
+                vResults[reqIdx] = std::move(result);
+                nDone++;
+            }
+            cond.notify_all();
+        }
+    }
+};
+
+std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq, const RPCTaskDispatcher& dispatch, int nMaxParallel)
 {
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(jreq, vReq[reqIdx]));
+    if (!dispatch || nMaxParallel <= 1 || vReq.size() < 2) {
+        for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
+            ret.push_back(JSONRPCExecOne(jreq, vReq[reqIdx]));
+
+        return ret.write() + "\n";
+    }
+
+    std::shared_ptr<BatchState> state = std::make_shared<BatchState>(jreq, vReq);
+    size_t nHelpers = std::min((size_t)nMaxParallel - 1, vReq.size() - 1);
+    for (size_t i = 0; i < nHelpers; ++i) {
+        if (!dispatch([state]() { state->Work(); })) {
+            break;
+        }
+    }
+    state->Work();
+
+    // Wait for requests claimed by helpers
+    std::vector<UniValue> vResults;
+    {
+        std::unique_lock<std::mutex> lock(state->cs);
+        state->cond.wait(lock, [&state] { return state->nDone == state->vReq.size(); });
+        vResults.swap(state->vResults);
+    }
+    for (auto& result : vResults)
+        ret.push_back(std::move(result));
 
     return ret.write() + "\n";
 }
@@ -489,6 +551,7 @@ UniValue CRPCTable::execute(const JSONRPCRequest &request) const
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    CPerfTimer timer(g_perf_stats.Histogram("rpc:" + request.strMethod));
     try
     {
         // Execute, convert arguments to array if necessary
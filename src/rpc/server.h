@@ -10,6 +10,7 @@
 #include <rpc/protocol.h>
 #include <uint256.h>
 
+#include <functional>
 #include <list>
 #include <map>
 #include <stdint.h>
@@ -19,6 +20,7 @@
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
 
+class CJSONStreamWriter;
 class CRPCCommand;
 
 namespace RPCServer
@@ -47,6 +49,9 @@ public:
     std::string URI;
     std::string authUser;
     std::string peerAddr;
+    /** Set when the transport can stream the result. Handlers with large results may
+     * write the result to it instead of returning it, and then return NullUniValue. */
+    CJSONStreamWriter *stream = nullptr;
 
     JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false) {}
     void parse(const UniValue& valRequest);
@@ -203,7 +208,15 @@ extern std::string HelpExampleRpc(const std::string& methodname, const std::stri
 void StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq);
+/** Queue a task to run on another thread, returns false if it was not queued */
+typedef std::function<bool(const std::function<void()>&)> RPCTaskDispatcher;
+/**
+ * Execute a batch of requests, results are in the order of the requests.
+ * Up to nMaxParallel - 1 helpers are queued with dispatch, the calling thread
+ * executes requests too, so the batch completes even if no helper ever runs.
+ */
+std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq,
+                             const RPCTaskDispatcher& dispatch = nullptr, int nMaxParallel = 1);
 
 // Retrieves any serialization flags requested in command line argument
 int RPCSerializationFlags();
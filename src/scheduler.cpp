@@ -9,6 +9,7 @@
 
 #include <assert.h>
 #include <boost/bind.hpp>
+#include <iterator>
 #include <utility>
 
 CScheduler::CScheduler() : nThreadsServicingQueue(0), stopRequested(false), stopWhenEmpty(false)
@@ -30,6 +31,23 @@ static boost::system_time toPosixTime(const boost::chrono::system_clock::time_po
 }
 #endif
 
+bool CScheduler::empty() const
+{
+    for (const auto &queue : taskQueue) {
+        if (!queue.empty()) return false;
+    }
+    return true;
+}
+
+boost::chrono::system_clock::time_point CScheduler::nextTaskTime() const
+{
+    boost::chrono::system_clock::time_point t = boost::chrono::system_clock::time_point::max();
+    for (const auto &queue : taskQueue) {
+        if (!queue.empty() && queue.begin()->first < t) t = queue.begin()->first;
+    }
+    return t;
+}
+
 void CScheduler::serviceQueue()
 {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
@@ -40,12 +58,12 @@ void CScheduler::serviceQueue()
     // is called.
     while (!shouldStop()) {
         try {
-            if (!shouldStop() && taskQueue.empty()) {
+            if (!shouldStop() && empty()) {
                 reverse_lock<boost::unique_lock<boost::mutex> > rlock(lock);
                 // Use this chance to get a tiny bit more entropy
                 RandAddSeedSleep();
             }
-            while (!shouldStop() && taskQueue.empty()) {
+            while (!shouldStop() && empty()) {
                 // Wait until there is something to do.
                 newTaskScheduled.wait(lock);
             }
@@ -55,26 +73,35 @@ void CScheduler::serviceQueue()
 
 // wait_until needs boost 1.50 or later; older versions have timed_wait:
 #if BOOST_VERSION < 105000
-            while (!shouldStop() && !taskQueue.empty() &&
-                   newTaskScheduled.timed_wait(lock, toPosixTime(taskQueue.begin()->first))) {
+            while (!shouldStop() && !empty() &&
+                   newTaskScheduled.timed_wait(lock, toPosixTime(nextTaskTime()))) {
                 // Keep waiting until timeout
             }
 #else
             // Some boost versions have a conflicting overload of wait_until that returns void.
             // Explicitly use a template here to avoid hitting that overload.
-            while (!shouldStop() && !taskQueue.empty()) {
-                boost::chrono::system_clock::time_point timeToWaitFor = taskQueue.begin()->first;
+            while (!shouldStop() && !empty()) {
+                boost::chrono::system_clock::time_point timeToWaitFor = nextTaskTime();
                 if (newTaskScheduled.wait_until<>(lock, timeToWaitFor) == boost::cv_status::timeout)
                     break; // Exit loop after timeout, it means we reached the time of the event
             }
 #endif
             // If there are multiple threads, the queue can empty while we're waiting (another
             // thread may service the task we were waiting on).
-            if (shouldStop() || taskQueue.empty())
+            if (shouldStop() || empty())
+                continue;
+
+            // Take the highest priority task that is due
+            boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+            auto *queue = std::begin(taskQueue);
+            while (queue != std::end(taskQueue) && (queue->empty() || queue->begin()->first > now)) {
+                ++queue;
+            }
+            if (queue == std::end(taskQueue))
                 continue;
 
-            Function f = taskQueue.begin()->second;
-            taskQueue.erase(taskQueue.begin());
+            Function f = queue->begin()->second;
+            queue->erase(queue->begin());
 
             {
                 // Unlock before calling f, so it can reschedule itself or another task
@@ -103,39 +130,41 @@ void CScheduler::stop(bool drain)
     newTaskScheduled.notify_all();
 }
 
-void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t)
+void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t, Priority priority)
 {
     {
         boost::unique_lock<boost::mutex> lock(newTaskMutex);
-        taskQueue.insert(std::make_pair(t, f));
+        taskQueue[static_cast<int>(priority)].insert(std::make_pair(t, f));
     }
     newTaskScheduled.notify_one();
 }
 
-void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaMilliSeconds)
+void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaMilliSeconds, Priority priority)
 {
-    schedule(f, boost::chrono::system_clock::now() + boost::chrono::milliseconds(deltaMilliSeconds));
+    schedule(f, boost::chrono::system_clock::now() + boost::chrono::milliseconds(deltaMilliSeconds), priority);
 }
 
-static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaMilliSeconds)
+static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaMilliSeconds, CScheduler::Priority priority)
 {
     f();
-    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaMilliSeconds), deltaMilliSeconds);
+    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaMilliSeconds, priority), deltaMilliSeconds, priority);
 }
 
-void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaMilliSeconds)
+void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaMilliSeconds, Priority priority)
 {
-    scheduleFromNow(boost::bind(&Repeat, this, f, deltaMilliSeconds), deltaMilliSeconds);
+    scheduleFromNow(boost::bind(&Repeat, this, f, deltaMilliSeconds, priority), deltaMilliSeconds, priority);
 }
 
 size_t CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
                              boost::chrono::system_clock::time_point &last) const
 {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
-    size_t result = taskQueue.size();
-    if (!taskQueue.empty()) {
-        first = taskQueue.begin()->first;
-        last = taskQueue.rbegin()->first;
+    size_t result = 0;
+    for (const auto &queue : taskQueue) {
+        if (queue.empty()) continue;
+        if (result == 0 || queue.begin()->first < first) first = queue.begin()->first;
+        if (result == 0 || queue.rbegin()->first > last) last = queue.rbegin()->first;
+        result += queue.size();
     }
     return result;
 }
@@ -155,7 +184,7 @@ void SingleThreadedSchedulerClient::MaybeScheduleProcessQueue() {
         if (m_are_callbacks_running) return;
         if (m_callbacks_pending.empty()) return;
     }
-    m_pscheduler->schedule(std::bind(&SingleThreadedSchedulerClient::ProcessQueue, this));
+    m_pscheduler->schedule(std::bind(&SingleThreadedSchedulerClient::ProcessQueue, this), boost::chrono::system_clock::now(), m_priority);
 }
 
 void SingleThreadedSchedulerClient::ProcessQueue() {
@@ -16,6 +16,11 @@
 
 #include <sync.h>
 
+/** Default number of threads servicing the node's scheduler */
+static const int DEFAULT_SCHEDULER_THREADS = 4;
+/** Maximum number of threads servicing the node's scheduler */
+static const int MAX_SCHEDULER_THREADS = 16;
+
 //
 // Simple class for background tasks that should be run
 // periodically or once "after a while"
@@ -42,23 +47,32 @@ public:
 
     typedef std::function<void(void)> Function;
 
+    // Of the tasks that are due, those of a higher priority run first.
+    // Tasks of the same priority run in time order.
+    enum class Priority {
+        HIGH,   // Validation interface callbacks
+        NORMAL,
+        LOW,    // Periodic maintenance, such as writing peers.dat
+    };
+
     // Call func at/after time t
-    void schedule(Function f, boost::chrono::system_clock::time_point t=boost::chrono::system_clock::now());
+    void schedule(Function f, boost::chrono::system_clock::time_point t=boost::chrono::system_clock::now(), Priority priority=Priority::NORMAL);
 
     // Convenience method: call f once deltaSeconds from now
-    void scheduleFromNow(Function f, int64_t deltaMilliSeconds);
+    void scheduleFromNow(Function f, int64_t deltaMilliSeconds, Priority priority=Priority::NORMAL);
 
     // Another convenience method: call f approximately
     // every deltaSeconds forever, starting deltaSeconds from now.
     // To be more precise: every time f is finished, it
     // is rescheduled to run deltaSeconds later. If you
     // need more accurate scheduling, don't use this method.
-    void scheduleEvery(Function f, int64_t deltaMilliSeconds);
+    void scheduleEvery(Function f, int64_t deltaMilliSeconds, Priority priority=Priority::NORMAL);
 
     // To keep things as simple as possible, there is no unschedule.
 
     // Services the queue 'forever'. Should be run in a thread,
-    // and interrupted using boost::interrupt_thread
+    // and interrupted using boost::interrupt_thread. Any number of
+    // threads may service the queue at once.
     void serviceQueue();
 
     // Tell any threads running serviceQueue to stop as soon as they're
@@ -75,28 +89,35 @@ public:
     bool AreThreadsServicingQueue() const;
 
 private:
-    std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue;
+    static const int NUM_PRIORITIES = 3;
+
+    // One queue per priority, indexed by Priority
+    std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue[NUM_PRIORITIES];
     boost::condition_variable newTaskScheduled;
     mutable boost::mutex newTaskMutex;
     int nThreadsServicingQueue;
     bool stopRequested;
     bool stopWhenEmpty;
-    bool shouldStop() const { return stopRequested || (stopWhenEmpty && taskQueue.empty()); }
+    bool empty() const;
+    boost::chrono::system_clock::time_point nextTaskTime() const;
+    bool shouldStop() const { return stopRequested || (stopWhenEmpty && empty()); }
 };
 
 /**
  * Class used by CScheduler clients which may schedule multiple jobs
  * which are required to be run serially. Jobs may not be run on the
- * same thread, but no two jobs will be executed
+ * same thread, but no two jobs of one client will be executed
  * at the same time and memory will be release-acquire consistent
  * (the scheduler will internally do an acquire before invoking a callback
  * as well as a release at the end). In practice this means that a callback
  * B() will be able to observe all of the effects of callback A() which executed
- * before it.
+ * before it. Jobs of different clients may run in parallel when several
+ * threads service the scheduler.
  */
 class SingleThreadedSchedulerClient {
 private:
     CScheduler *m_pscheduler;
+    CScheduler::Priority m_priority;
 
     CCriticalSection m_cs_callbacks_pending;
     std::list<std::function<void (void)>> m_callbacks_pending GUARDED_BY(m_cs_callbacks_pending);
@@ -106,7 +127,8 @@ private:
     void ProcessQueue();
 
 public:
-    explicit SingleThreadedSchedulerClient(CScheduler *pschedulerIn) : m_pscheduler(pschedulerIn) {}
+    explicit SingleThreadedSchedulerClient(CScheduler *pschedulerIn, CScheduler::Priority priority = CScheduler::Priority::NORMAL)
+        : m_pscheduler(pschedulerIn), m_priority(priority) {}
 
     /**
      * Add a callback to be executed. Callbacks are executed serially
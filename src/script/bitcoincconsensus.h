@@ -33,7 +33,7 @@
 extern "C" {
 #endif
 
-#define BITCOINCONSENSUS_API_VER 1
+#define BITCOINCONSENSUS_API_VER 2
 
 typedef enum bitcoinconsensus_error_t
 {
@@ -43,6 +43,8 @@ typedef enum bitcoinconsensus_error_t
     bitcoinconsensus_ERR_TX_DESERIALIZE,
     bitcoinconsensus_ERR_AMOUNT_REQUIRED,
     bitcoinconsensus_ERR_INVALID_FLAGS,
+    bitcoinconsensus_ERR_TX_NOT_RINGCT,
+    bitcoinconsensus_ERR_RING_MEMBERS,
 } bitcoinconsensus_error;
 
 /** Script verification flags */
@@ -72,6 +74,65 @@ EXPORT_SYMBOL int bitcoinconsensus_verify_script_with_amount(const unsigned char
                                     const unsigned char *txTo        , unsigned int txToLen,
                                     unsigned int nIn, unsigned int flags, bitcoinconsensus_error* err);
 
+/** Confidential transaction verification flags */
+enum
+{
+    bitcoinconsensus_CT_FLAGS_VERIFY_NONE                    = 0,
+    bitcoinconsensus_CT_FLAGS_VERIFY_BULLETPROOFS            = (1U << 0), // rangeproofs are bulletproofs, as after the bulletproof fork
+    bitcoinconsensus_CT_FLAGS_VERIFY_ALL                     = bitcoinconsensus_CT_FLAGS_VERIFY_BULLETPROOFS
+};
+
+/// Job callback of a caller supplied thread pool, nJob is the index of the job to run.
+typedef void (*bitcoinconsensus_job)(void *jobCtx, unsigned int nJob);
+
+/// Runs job(jobCtx, i) for every i below nJobs, in any order and on any threads,
+/// and returns once all of them have finished. pool is passed through unchanged.
+/// Batch calls given a null run_jobs run every job on the calling thread.
+typedef void (*bitcoinconsensus_run_jobs)(void *pool, bitcoinconsensus_job job, void *jobCtx, unsigned int nJobs);
+
+/// Returns 1 if the rangeproof of every RingCT output of the serialized transaction
+/// pointed to by txTo is valid for its commitment.
+/// If not nullptr, err will contain an error/success code for the operation
+EXPORT_SYMBOL int bitcoinconsensus_verify_rangeproofs(const unsigned char *txTo, unsigned int txToLen,
+                                                      unsigned int flags, bitcoinconsensus_error* err);
+
+/// bitcoinconsensus_verify_rangeproofs for nTxs transactions. The bulletproofs of the
+/// transactions of a job are verified together. results[i] and, if not nullptr,
+/// errs[i] are set for transaction i. Returns 1 if all transactions are valid.
+EXPORT_SYMBOL int bitcoinconsensus_verify_rangeproofs_batch(const unsigned char * const *txTos, const unsigned int *txToLens, unsigned int nTxs,
+                                                            unsigned int flags, int *results, bitcoinconsensus_error *errs,
+                                                            bitcoinconsensus_run_jobs run_jobs, void *pool);
+
+/// Returns 1 if the MLSAG ring signature of every input of the serialized RingCT
+/// transaction pointed to by txTo is valid, and for transactions of several inputs if
+/// the input commitments balance the outputs, plain outputs and fee. The balance of a
+/// single input is part of its signature.
+/// ringPubkeys and ringCommitments hold the 33 byte pubkey and commitment of each of the
+/// nRingMembers ring members, in input order and within an input in the order of its
+/// anon output indices.
+/// Key images are not checked against the chain or the mempool, that is up to the caller.
+/// If not nullptr, err will contain an error/success code for the operation
+EXPORT_SYMBOL int bitcoinconsensus_verify_ringct(const unsigned char *txTo, unsigned int txToLen,
+                                                 const unsigned char *ringPubkeys, const unsigned char *ringCommitments,
+                                                 unsigned int nRingMembers, bitcoinconsensus_error* err);
+
+/** A transaction and its ring members, see bitcoinconsensus_verify_ringct */
+typedef struct bitcoinconsensus_ringct_tx_t
+{
+    const unsigned char *txTo;
+    unsigned int txToLen;
+    const unsigned char *ringPubkeys;
+    const unsigned char *ringCommitments;
+    unsigned int nRingMembers;
+} bitcoinconsensus_ringct_tx;
+
+/// bitcoinconsensus_verify_ringct for nTxs transactions. The ring signatures of the
+/// transactions of a job are verified together. results[i] and, if not nullptr,
+/// errs[i] are set for transaction i. Returns 1 if all transactions are valid.
+EXPORT_SYMBOL int bitcoinconsensus_verify_ringct_batch(const bitcoinconsensus_ringct_tx *txs, unsigned int nTxs,
+                                                       int *results, bitcoinconsensus_error *errs,
+                                                       bitcoinconsensus_run_jobs run_jobs, void *pool);
+
 EXPORT_SYMBOL unsigned int bitcoinconsensus_version();
 
 #ifdef __cplusplus
@@ -5,11 +5,21 @@
 
 #include <script/bitcoincconsensus.h>
 
+#include <anon.h>
 #include <primitives/transaction.h>
 #include <pubkey.h>
 #include <script/interpreter.h>
 #include <version.h>
 
+#include <secp256k1.h>
+#include <secp256k1_bulletproofs.h>
+#include <secp256k1_mlsag.h>
+#include <secp256k1_rangeproof.h>
+
+#include <functional>
+#include <map>
+#include <set>
+
 namespace {
 
 /** A class that deserializes a single CTransaction one time. */
@@ -68,6 +78,384 @@ struct ECCryptoClosure
 };
 
 ECCryptoClosure instance_of_eccryptoclosure;
+
+//! Transactions verified by one job of a batch call
+const size_t CT_BATCH_JOB_TXS = 16;
+//! Maximum number of bulletproofs passed to one verify_multi call, as MAX_BULLETPROOF_BATCH
+const size_t CT_BULLETPROOF_BATCH = 32;
+const size_t CT_SCRATCH_SIZE = 1024 * 1024;
+const size_t CT_MAX_RANGEPROOF_SIZE = 5134;
+
+/** Verify only context and bulletproof generators of the CT checks, created on first use */
+struct BlindContext
+{
+    secp256k1_context *ctx;
+    secp256k1_bulletproof_generators *gens;
+
+    BlindContext()
+    {
+        // Committing to the plain value out needs the signing tables
+        ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
+        secp256k1_pedersen_context_initialize(ctx);
+        gens = secp256k1_bulletproof_generators_create(ctx, &secp256k1_generator_const_g, 128);
+    }
+
+    ~BlindContext()
+    {
+        secp256k1_bulletproof_generators_destroy(ctx, gens);
+        secp256k1_context_destroy(ctx);
+    }
+};
+
+const BlindContext& GetBlindContext()
+{
+    static BlindContext blind;
+    return blind;
+}
+
+/** Scratch space of one job */
+class ScratchSpace
+{
+public:
+    ScratchSpace() : scratch(secp256k1_scratch_space_create(GetBlindContext().ctx, CT_SCRATCH_SIZE)) {}
+    ~ScratchSpace() { secp256k1_scratch_space_destroy(scratch); }
+    secp256k1_scratch_space* get() { return scratch; }
+private:
+    secp256k1_scratch_space *scratch;
+};
+
+typedef std::function<void(size_t nBegin, size_t nEnd)> BatchJob;
+
+void RunBatchJob(void *jobCtx, unsigned int nJob)
+{
+    (*(const std::function<void(unsigned int)>*)jobCtx)(nJob);
+}
+
+/** Split nTxs transactions into jobs of CT_BATCH_JOB_TXS and run them on the caller's pool */
+void RunBatch(size_t nTxs, bitcoinconsensus_run_jobs run_jobs, void *pool, const BatchJob& job)
+{
+    const std::function<void(unsigned int)> run_one = [nTxs, &job](unsigned int nJob) {
+        size_t nBegin = nJob * CT_BATCH_JOB_TXS;
+        job(nBegin, std::min(nTxs, nBegin + CT_BATCH_JOB_TXS));
+    };
+
+    unsigned int nJobs = (nTxs + CT_BATCH_JOB_TXS - 1) / CT_BATCH_JOB_TXS;
+    if (!run_jobs) {
+        for (unsigned int i = 0; i < nJobs; ++i)
+            run_one(i);
+        return;
+    }
+    run_jobs(pool, RunBatchJob, (void*)&run_one, nJobs);
+}
+
+/** Deserialize the transaction at txTo, which must span txToLen. Sets err and returns nullptr on failure */
+std::unique_ptr<CTransaction> DeserializeTx(const unsigned char *txTo, unsigned int txToLen, bitcoinconsensus_error &err)
+{
+    try {
+        TxInputStream stream(SER_NETWORK, PROTOCOL_VERSION, txTo, txToLen);
+        std::unique_ptr<CTransaction> ptx(new CTransaction(deserialize, stream));
+        if (GetSerializeSize(*ptx, SER_NETWORK, PROTOCOL_VERSION) != txToLen) {
+            err = bitcoinconsensus_ERR_TX_SIZE_MISMATCH;
+            return nullptr;
+        }
+        err = bitcoinconsensus_ERR_OK;
+        return ptx;
+    } catch (const std::exception&) {
+        err = bitcoinconsensus_ERR_TX_DESERIALIZE;
+        return nullptr;
+    }
+}
+
+struct BulletproofEntry
+{
+    size_t nTx;
+    const std::vector<uint8_t> *pvRangeproof;
+    const secp256k1_pedersen_commitment *pCommitment;
+};
+
+/** Verify the rangeproofs of the transactions in [nBegin, nEnd), same checks as CheckAnonOutput */
+void VerifyRangeproofsJob(const unsigned char * const *txTos, const unsigned int *txToLens, size_t nBegin, size_t nEnd,
+                          unsigned int flags, int *results, bitcoinconsensus_error *errs)
+{
+    const BlindContext &blind = GetBlindContext();
+    std::vector<std::unique_ptr<CTransaction> > vTxs(nEnd - nBegin);
+    std::map<size_t, std::vector<BulletproofEntry> > mapBySize; // verify_multi requires all proofs in a call to have the same length
+
+    for (size_t i = nBegin; i < nEnd; ++i) {
+        results[i] = 0;
+        if (!(vTxs[i - nBegin] = DeserializeTx(txTos[i], txToLens[i], errs[i])))
+            continue;
+
+        results[i] = 1;
+        for (const auto &txout : vTxs[i - nBegin]->vpout) {
+            if (!txout->IsType(OUTPUT_RINGCT))
+                continue;
+            const CTxOutRingCT *p = (const CTxOutRingCT*) txout.get();
+            if (p->vRangeproof.size() > CT_MAX_RANGEPROOF_SIZE) {
+                results[i] = 0;
+                break;
+            }
+
+            if (flags & bitcoinconsensus_CT_FLAGS_VERIFY_BULLETPROOFS) {
+                mapBySize[p->vRangeproof.size()].push_back(BulletproofEntry{i, &p->vRangeproof, &p->commitment});
+                continue;
+            }
+
+            uint64_t min_value = 0, max_value = 0;
+            if (1 != secp256k1_rangeproof_verify(blind.ctx, &min_value, &max_value,
+                &p->commitment, p->vRangeproof.data(), p->vRangeproof.size(),
+                nullptr, 0, secp256k1_generator_h)) {
+                results[i] = 0;
+                break;
+            }
+        }
+    }
+
+    if (mapBySize.empty())
+        return;
+
+    ScratchSpace scratch;
+    std::vector<const unsigned char*> vpProofs;
+    std::vector<const secp256k1_pedersen_commitment*> vpCommitments;
+    std::vector<secp256k1_generator> vValueGens;
+    for (const auto &mi : mapBySize) {
+        const std::vector<BulletproofEntry> &vEntries = mi.second;
+        for (size_t nStart = 0; nStart < vEntries.size(); nStart += CT_BULLETPROOF_BATCH) {
+            size_t nProofs = std::min(CT_BULLETPROOF_BATCH, vEntries.size() - nStart);
+
+            vpProofs.resize(nProofs);
+            vpCommitments.resize(nProofs);
+            vValueGens.assign(nProofs, secp256k1_generator_const_h);
+            for (size_t k = 0; k < nProofs; ++k) {
+                vpProofs[k] = vEntries[nStart + k].pvRangeproof->data();
+                vpCommitments[k] = vEntries[nStart + k].pCommitment;
+            }
+
+            if (1 == secp256k1_bulletproof_rangeproof_verify_multi(blind.ctx,
+                scratch.get(), blind.gens, vpProofs.data(), nProofs, mi.first,
+                nullptr, vpCommitments.data(), 1, 64, vValueGens.data(), nullptr, nullptr))
+                continue;
+
+            // Batch failed, find the transactions with an invalid proof
+            for (size_t k = 0; k < nProofs; ++k) {
+                const BulletproofEntry &e = vEntries[nStart + k];
+                if (results[e.nTx] && 1 != secp256k1_bulletproof_rangeproof_verify(blind.ctx,
+                    scratch.get(), blind.gens, e.pvRangeproof->data(), e.pvRangeproof->size(),
+                    nullptr, e.pCommitment, 1, 64, &secp256k1_generator_const_h, nullptr, 0))
+                    results[e.nTx] = 0;
+            }
+        }
+    }
+}
+
+/** Ring signature of one anon input, prepared for secp256k1_verify_mlsag_batch */
+struct MLSAGRing
+{
+    size_t nTx;
+    size_t nCols;
+    size_t nRows;
+    std::vector<uint8_t> vM;
+    const uint8_t *pPreimage;
+    const uint8_t *pKeyImages;
+    const uint8_t *pC;
+    const uint8_t *pS;
+};
+
+/**
+ * Check the anon inputs of tx against the ring members, add their rings to vRings and
+ * verify the commitment tally of split commitments, same checks as VerifyMLSAG.
+ * Returns false if tx is invalid, err is only set if tx can't be checked.
+ */
+bool PrepareRingCT(const CTransaction &tx, size_t nTx, const unsigned char *ringPubkeys, const unsigned char *ringCommitments,
+                   unsigned int nRingMembers, std::vector<MLSAGRing> &vRings, bitcoinconsensus_error &err)
+{
+    const secp256k1_context *ctx = GetBlindContext().ctx;
+    err = bitcoinconsensus_ERR_OK;
+
+    if (tx.vin.empty())
+        return set_error(&err, bitcoinconsensus_ERR_TX_NOT_RINGCT);
+    for (const auto &txin : tx.vin) {
+        if (!txin.IsAnonInput())
+            return set_error(&err, bitcoinconsensus_ERR_TX_NOT_RINGCT);
+    }
+
+    std::set<int64_t> setHaveI; // Anon prev-outputs can only be used once per transaction.
+    std::set<CCmpPubKey> setHaveKI;
+    bool fSplitCommitments = tx.vin.size() > 1;
+
+    size_t nStandard = 0, nRingCT = 0;
+    CAmount nPlainValueOut = 0, nTxFee = 0;
+    try {
+        nPlainValueOut = tx.GetPlainValueOut(nStandard, nRingCT);
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (!tx.GetCTFee(nTxFee) || !MoneyRange(nTxFee))
+        return false;
+    nPlainValueOut += nTxFee;
+
+    // Commitment to the unblinded amount
+    uint8_t zeroBlind[32];
+    memset(zeroBlind, 0, 32);
+    secp256k1_pedersen_commitment plainCommitment;
+    if (nPlainValueOut > 0 && !secp256k1_pedersen_commit(ctx, &plainCommitment, zeroBlind, (uint64_t) nPlainValueOut,
+        &secp256k1_generator_const_h, &secp256k1_generator_const_g))
+        return false;
+
+    std::vector<const uint8_t*> vpOutCommits;
+    if (nPlainValueOut > 0)
+        vpOutCommits.push_back(plainCommitment.data);
+    for (const auto &txout : tx.vpout) {
+        secp256k1_pedersen_commitment *pc = txout->GetPCommitment();
+        if (pc)
+            vpOutCommits.push_back(pc->data);
+    }
+
+    std::vector<const uint8_t*> vpInputSplitCommits;
+    size_t nMember = 0;
+    for (size_t nIn = 0; nIn < tx.vin.size(); ++nIn) {
+        const CTxIn &txin = tx.vin[nIn];
+        uint32_t nInputs, nRingSize;
+        txin.GetAnonInfo(nInputs, nRingSize);
+
+        if (nInputs < 1 || nInputs > MAX_ANON_INPUTS
+            || nRingSize < MIN_RINGSIZE || nRingSize > MAX_RINGSIZE)
+            return false;
+        if (txin.scriptData.stack.size() != 1 || txin.scriptWitness.stack.size() != 2)
+            return false;
+
+        size_t nCols = nRingSize;
+        size_t nRows = nInputs + 1;
+        const std::vector<uint8_t> &vKeyImages = txin.scriptData.stack[0];
+        const std::vector<uint8_t> &vMI = txin.scriptWitness.stack[0];
+        const std::vector<uint8_t> &vDL = txin.scriptWitness.stack[1];
+
+        if (vKeyImages.size() != nInputs * 33)
+            return false;
+        if (vDL.size() != (1 + nRows * nCols) * 32 + (fSplitCommitments ? 33 : 0))
+            return false;
+
+        size_t nMembers = nCols * nInputs;
+        if (nMember + nMembers > nRingMembers)
+            return set_error(&err, bitcoinconsensus_ERR_RING_MEMBERS);
+
+        size_t ofs = 0, nB = 0;
+        for (size_t k = 0; k < nMembers; ++k) {
+            uint64_t nIndex;
+            if (0 != GetVarInt(vMI, ofs, nIndex, nB))
+                return false;
+            ofs += nB;
+            if (!setHaveI.insert((int64_t)nIndex).second)
+                return false;
+        }
+
+        for (size_t k = 0; k < nInputs; ++k) {
+            if (!setHaveKI.insert(*((const CCmpPubKey*)&vKeyImages[k * 33])).second)
+                return false;
+        }
+
+        MLSAGRing ring;
+        ring.nTx = nTx;
+        ring.nCols = nCols;
+        ring.nRows = nRows;
+        ring.vM.resize(nCols * nRows * 33);
+        memcpy(ring.vM.data(), &ringPubkeys[nMember * 33], nMembers * 33);
+
+        std::vector<const uint8_t*> vpInCommits(nMembers);
+        for (size_t k = 0; k < nMembers; ++k)
+            vpInCommits[k] = &ringCommitments[(nMember + k) * 33];
+        nMember += nMembers;
+
+        std::vector<const uint8_t*> vpSplitCommit;
+        if (fSplitCommitments) {
+            vpInputSplitCommits.push_back(&vDL[(1 + nRows * nCols) * 32]);
+            vpSplitCommit.push_back(vpInputSplitCommits.back());
+        }
+        std::vector<const uint8_t*> &vpRowOutCommits = fSplitCommitments ? vpSplitCommit : vpOutCommits;
+
+        // Sum the commitments into the last row of vM
+        if (0 != secp256k1_prepare_mlsag(ring.vM.data(), nullptr,
+            vpRowOutCommits.size(), vpRowOutCommits.size(), nCols, nRows,
+            vpInCommits.data(), vpRowOutCommits.data(), nullptr))
+            return false;
+
+        ring.pPreimage = tx.GetHash().begin();
+        ring.pKeyImages = vKeyImages.data();
+        ring.pC = &vDL[0];
+        ring.pS = &vDL[32];
+        vRings.push_back(std::move(ring));
+    }
+
+    if (nMember != nRingMembers)
+        return set_error(&err, bitcoinconsensus_ERR_RING_MEMBERS);
+
+    // Verify commitment sums match
+    if (fSplitCommitments && 1 != secp256k1_pedersen_verify_tally(ctx,
+        (const secp256k1_pedersen_commitment* const*)vpInputSplitCommits.data(), vpInputSplitCommits.size(),
+        (const secp256k1_pedersen_commitment* const*)vpOutCommits.data(), vpOutCommits.size()))
+        return false;
+
+    return true;
+}
+
+/** Verify the RingCT transactions in [nBegin, nEnd), the ring signatures of all are verified together */
+void VerifyRingCTJob(const bitcoinconsensus_ringct_tx *txs, size_t nBegin, size_t nEnd, int *results, bitcoinconsensus_error *errs)
+{
+    std::vector<std::unique_ptr<CTransaction> > vTxs(nEnd - nBegin);
+    std::vector<MLSAGRing> vRings;
+
+    for (size_t i = nBegin; i < nEnd; ++i) {
+        const bitcoinconsensus_ringct_tx &tx = txs[i];
+        results[i] = 0;
+        if (!(vTxs[i - nBegin] = DeserializeTx(tx.txTo, tx.txToLen, errs[i])))
+            continue;
+
+        size_t nRings = vRings.size();
+        if (!PrepareRingCT(*vTxs[i - nBegin], i, tx.ringPubkeys, tx.ringCommitments, tx.nRingMembers, vRings, errs[i])) {
+            vRings.resize(nRings);
+            continue;
+        }
+        results[i] = 1;
+    }
+
+    size_t nRings = vRings.size();
+    if (nRings == 0)
+        return;
+
+    std::vector<const uint8_t*> vpPreimages(nRings), vpM(nRings), vpKeyImages(nRings), vpC(nRings), vpS(nRings);
+    std::vector<size_t> vCols(nRings), vRows(nRings);
+    std::vector<int> vResults(nRings);
+    for (size_t i = 0; i < nRings; ++i) {
+        const MLSAGRing &ring = vRings[i];
+        vpPreimages[i] = ring.pPreimage;
+        vCols[i] = ring.nCols;
+        vRows[i] = ring.nRows;
+        vpM[i] = ring.vM.data();
+        vpKeyImages[i] = ring.pKeyImages;
+        vpC[i] = ring.pC;
+        vpS[i] = ring.pS;
+    }
+
+    ScratchSpace scratch;
+    secp256k1_verify_mlsag_batch(GetBlindContext().ctx, scratch.get(), nRings,
+        vpPreimages.data(), vCols.data(), vRows.data(),
+        vpM.data(), vpKeyImages.data(), vpC.data(), vpS.data(), vResults.data());
+
+    for (size_t i = 0; i < nRings; ++i) {
+        if (vResults[i] != 0)
+            results[vRings[i].nTx] = 0;
+    }
+}
+
+/** Fold per transaction results into the return value of a batch call */
+int AllValid(const int *results, unsigned int nTxs)
+{
+    for (unsigned int i = 0; i < nTxs; ++i) {
+        if (!results[i])
+            return 0;
+    }
+    return 1;
+}
 } // namespace
 
 /** Check that all specified flags are part of the libconsensus interface. */
@@ -123,6 +511,57 @@ int bitcoinconsensus_verify_script(const unsigned char *scriptPubKey, unsigned i
     return ::verify_script(scriptPubKey, scriptPubKeyLen, am, txTo, txToLen, nIn, flags, err);
 }
 
+int bitcoinconsensus_verify_rangeproofs_batch(const unsigned char * const *txTos, const unsigned int *txToLens, unsigned int nTxs,
+                                              unsigned int flags, int *results, bitcoinconsensus_error *errs,
+                                              bitcoinconsensus_run_jobs run_jobs, void *pool)
+{
+    std::vector<bitcoinconsensus_error> vErrs(errs ? 0 : nTxs);
+    if (!errs)
+        errs = vErrs.data();
+    if ((flags & ~(bitcoinconsensus_CT_FLAGS_VERIFY_ALL)) != 0) {
+        for (unsigned int i = 0; i < nTxs; ++i) {
+            results[i] = 0;
+            errs[i] = bitcoinconsensus_ERR_INVALID_FLAGS;
+        }
+        return 0;
+    }
+
+    RunBatch(nTxs, run_jobs, pool, [&](size_t nBegin, size_t nEnd) {
+        VerifyRangeproofsJob(txTos, txToLens, nBegin, nEnd, flags, results, errs);
+    });
+    return AllValid(results, nTxs);
+}
+
+int bitcoinconsensus_verify_rangeproofs(const unsigned char *txTo, unsigned int txToLen,
+                                        unsigned int flags, bitcoinconsensus_error* err)
+{
+    int result;
+    return bitcoinconsensus_verify_rangeproofs_batch(&txTo, &txToLen, 1, flags, &result, err, nullptr, nullptr);
+}
+
+int bitcoinconsensus_verify_ringct_batch(const bitcoinconsensus_ringct_tx *txs, unsigned int nTxs,
+                                         int *results, bitcoinconsensus_error *errs,
+                                         bitcoinconsensus_run_jobs run_jobs, void *pool)
+{
+    std::vector<bitcoinconsensus_error> vErrs(errs ? 0 : nTxs);
+    if (!errs)
+        errs = vErrs.data();
+
+    RunBatch(nTxs, run_jobs, pool, [&](size_t nBegin, size_t nEnd) {
+        VerifyRingCTJob(txs, nBegin, nEnd, results, errs);
+    });
+    return AllValid(results, nTxs);
+}
+
+int bitcoinconsensus_verify_ringct(const unsigned char *txTo, unsigned int txToLen,
+                                   const unsigned char *ringPubkeys, const unsigned char *ringCommitments,
+                                   unsigned int nRingMembers, bitcoinconsensus_error* err)
+{
+    bitcoinconsensus_ringct_tx tx{txTo, txToLen, ringPubkeys, ringCommitments, nRingMembers};
+    int result;
+    return bitcoinconsensus_verify_ringct_batch(&tx, 1, &result, err, nullptr, nullptr);
+}
+
 unsigned int bitcoinconsensus_version()
 {
     // Just use the API version for now
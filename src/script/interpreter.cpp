@@ -1243,8 +1243,9 @@ uint256 GetOutputsHash(const T& txTo)
 template <class T>
 PrecomputedTransactionData::PrecomputedTransactionData(const T& txTo)
 {
-    // Cache is calculated only for transactions with witness
-    if (txTo.HasWitness()) {
+    // Cache is calculated only for transactions with witness, BitcoinC
+    // transactions always use the witness style signature hash
+    if (txTo.HasWitness() || txTo.IsBitcoinCVersion()) {
         hashPrevouts = GetPrevoutHash(txTo);
         hashSequence = GetSequenceHash(txTo);
         hashOutputs = GetOutputsHash(txTo);
@@ -1474,7 +1475,7 @@ static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion,
                 return set_error(serror, SCRIPT_ERR_WITNESS_PROGRAM_MISMATCH); // 2 items in witness
             }
             scriptPubKey << OP_DUP << OP_HASH160 << program << OP_EQUALVERIFY << OP_CHECKSIG;
-            stack = witness.stack;
+            stack.assign(witness.stack.begin(), witness.stack.end());
         } else {
             return set_error(serror, SCRIPT_ERR_WITNESS_PROGRAM_WRONG_LENGTH);
         }
@@ -1503,6 +1504,69 @@ static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion,
     return true;
 }
 
+/**
+ * Spend of a P2PKH or P2PKH256 script, or a cold stake script of those, with only the
+ * signature and pubkey in the witness. The result is decided by the one signature check,
+ * done here without running the script. Returns false to leave any other shape, and
+ * the pubkey hash mismatch, to EvalScript. Otherwise fRet and serror are set as
+ * VerifyScript would set them.
+ */
+static bool VerifyKeyHashSpend(const CScriptWitness& witness, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror, bool& fRet)
+{
+    if (witness.stack.size() != 2)
+        return false;
+
+    const unsigned char *pHash;
+    size_t nHashLen;
+    Span<const unsigned char> stake_hash, spend_hash;
+    if (scriptPubKey.IsPayToPublicKeyHash()) {
+        pHash = &scriptPubKey[3];
+        nHashLen = 20;
+    } else
+    if (scriptPubKey.IsPayToPublicKeyHash256()) {
+        pHash = &scriptPubKey[3];
+        nHashLen = 32;
+    } else
+    if (scriptPubKey.MatchColdStakeKeyHashes(stake_hash, spend_hash)) {
+        // OP_ISCOINSTAKE OP_IF selects the branch
+        const Span<const unsigned char>& hash = checker.IsCoinStake() ? stake_hash : spend_hash;
+        pHash = hash.data();
+        nHashLen = hash.size();
+    } else {
+        return false;
+    }
+
+    const valtype& vchSig = witness.stack[0];
+    const valtype& vchPubKey = witness.stack[1];
+
+    // FindAndDelete could only match a signature pushed like one of the hashes in the script
+    if (vchSig.size() == 20 || vchSig.size() == 32)
+        return false;
+
+    unsigned char vchHash[CSHA256::OUTPUT_SIZE];
+    if (nHashLen == CHash160::OUTPUT_SIZE)
+        CHash160().Write(vchPubKey.data(), vchPubKey.size()).Finalize(vchHash);
+    else
+        CSHA256().Write(vchPubKey.data(), vchPubKey.size()).Finalize(vchHash);
+    if (memcmp(vchHash, pHash, nHashLen) != 0)
+        return false;
+
+    if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, SigVersion::BASE, serror)) {
+        fRet = false;
+        return true;
+    }
+
+    // The script code is the whole script, it has no OP_CODESEPARATOR
+    if (!checker.CheckSig(vchSig, vchPubKey, scriptPubKey, SigVersion::BASE)) {
+        fRet = set_error(serror, (flags & SCRIPT_VERIFY_NULLFAIL) && vchSig.size() ? SCRIPT_ERR_SIG_NULLFAIL : SCRIPT_ERR_EVAL_FALSE);
+        return true;
+    }
+
+    // The stack ends with just the result, which passes CLEANSTACK
+    fRet = set_success(serror);
+    return true;
+}
+
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     static const CScriptWitness emptyWitness;
@@ -1525,7 +1589,10 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
             // The scriptSig must be _exactly_ CScript(), otherwise we reintroduce malleability.
             return set_error(serror, SCRIPT_ERR_WITNESS_MALLEATED);
         }
-        stack = witness->stack;
+        bool fRet;
+        if (VerifyKeyHashSpend(*witness, scriptPubKey, flags, checker, serror, fRet))
+            return fRet;
+        stack.assign(witness->stack.begin(), witness->stack.end());
     } else
     {
         if (!EvalScript(stack, scriptSig, flags, checker, SigVersion::BASE, serror))
@@ -57,8 +57,52 @@ bool PermitsUncompressed(IsMineSigVersion sigversion)
     return sigversion == IsMineSigVersion::TOP || sigversion == IsMineSigVersion::P2SH;
 }
 
+isminetype IsMinePubKeyHash(const CKeyStore& keystore, const CKeyID& keyID, bool& isInvalid, IsMineSigVersion sigversion)
+{
+    if (!PermitsUncompressed(sigversion)) {
+        CPubKey pubkey;
+        if (keystore.GetPubKey(keyID, pubkey) && !pubkey.IsCompressed()) {
+            isInvalid = true;
+            return ISMINE_NO;
+        }
+    }
+    return keystore.IsMine(keyID);
+}
+
+/**
+ * Classify a key hash branch of a cold staking script matched by MatchColdStakeKeyHashes
+ * as IsMineInner would the branch script. The branch runs from the OP_DUP 3 bytes before
+ * the hash to the OP_CHECKSIG after its OP_EQUALVERIFY, it's only copied out when the
+ * keystore holds watch-only scripts.
+ */
+isminetype IsMineColdStakeBranch(const CKeyStore& keystore, Span<const unsigned char> hash, bool& isInvalid, IsMineSigVersion sigversion)
+{
+    isInvalid = false;
+    CKeyID keyID = hash.size() == 20 ? CKeyID(uint160(hash.data(), 20)) : CKeyID(uint256(hash.data(), 32));
+    isminetype mine = IsMinePubKeyHash(keystore, keyID, isInvalid, sigversion);
+    if (mine || isInvalid)
+        return mine;
+    if (keystore.HaveWatchOnly() && keystore.HaveWatchOnly(CScript(hash.begin() - 3, hash.end() + 2)))
+        return ISMINE_WATCH_ONLY_;
+    return ISMINE_NO;
+}
+
 isminetype IsMineInner(const CKeyStore& keystore, const CScript& scriptPubKey, bool& isInvalid, IsMineSigVersion sigversion)
 {
+    Span<const unsigned char> stake_hash, spend_hash;
+    if (scriptPubKey.MatchColdStakeKeyHashes(stake_hash, spend_hash))
+    {
+        isminetype typeB = IsMineColdStakeBranch(keystore, spend_hash, isInvalid, sigversion);
+        if (typeB & ISMINE_SPENDABLE)
+            return typeB;
+
+        isminetype typeA = IsMineColdStakeBranch(keystore, stake_hash, isInvalid, sigversion);
+        if (typeA & ISMINE_SPENDABLE)
+            typeA = (isminetype)(((int)typeA & ~ISMINE_SPENDABLE) | ISMINE_WATCH_COLDSTAKE);
+
+        return (isminetype)((int)typeA | (int)typeB);
+    };
+
     if (HasIsCoinstakeOp(scriptPubKey))
     {
         CScript scriptA, scriptB;
@@ -139,17 +183,9 @@ isminetype IsMineInner(const CKeyStore& keystore, const CScript& scriptPubKey, b
             keyID = CKeyID(uint256(vSolutions[0]));
         else
             return ISMINE_NO;
-        if (!PermitsUncompressed(sigversion)) {
-            CPubKey pubkey;
-            if (keystore.GetPubKey(keyID, pubkey) && !pubkey.IsCompressed()) {
-                isInvalid = true;
-                return ISMINE_NO;
-            }
-        }
-        if ((mine = keystore.IsMine(keyID)))
+        mine = IsMinePubKeyHash(keystore, keyID, isInvalid, sigversion);
+        if (mine || isInvalid)
             return mine;
-        //if (keystore.HaveKey(keyID))
-        //    return ISMINE_SPENDABLE;
         break;
     case TX_SCRIPTHASH:
     case TX_TIMELOCKED_SCRIPTHASH:
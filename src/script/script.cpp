@@ -350,6 +350,30 @@ bool CScript::StartsWithICS() const
         && (*this)[0] == OP_ISCOINSTAKE;
 };
 
+bool CScript::MatchColdStakeKeyHashes(Span<const unsigned char> &stake_hash, Span<const unsigned char> &spend_hash) const
+{
+    // OP_ISCOINSTAKE OP_IF <P2PKH> OP_ELSE <P2PKH or P2PKH256> OP_ENDIF
+    size_t nSpendHashLen;
+    if (this->size() == 25 + 25 + 4 && MatchPayToPublicKeyHash(28))
+        nSpendHashLen = 20;
+    else
+    if (this->size() == 25 + 37 + 4 && MatchPayToPublicKeyHash256(28))
+        nSpendHashLen = 32;
+    else
+        return false;
+
+    if ((*this)[0] != OP_ISCOINSTAKE
+        || (*this)[1] != OP_IF
+        || !MatchPayToPublicKeyHash(2)
+        || (*this)[27] != OP_ELSE
+        || (*this)[this->size() - 1] != OP_ENDIF)
+        return false;
+
+    stake_hash = Span<const unsigned char>(this->data() + 5, 20);
+    spend_hash = Span<const unsigned char>(this->data() + 31, nSpendHashLen);
+    return true;
+};
+
 
 bool CScript::IsPushOnly(const_iterator pc) const
 {
@@ -9,6 +9,7 @@
 #include <crypto/common.h>
 #include <prevector.h>
 #include <serialize.h>
+#include <span.h>
 
 #include <assert.h>
 #include <climits>
@@ -554,6 +555,12 @@ public:
     bool IsPayToScriptHash_CS() const;
     bool StartsWithICS() const;
 
+    /**
+     * Match the common cold staking layouts in place, a P2PKH coinstake branch with a P2PKH
+     * or P2PKH256 spend branch. The spans are set to the key hashes within the script.
+     */
+    bool MatchColdStakeKeyHashes(Span<const unsigned char> &stake_hash, Span<const unsigned char> &spend_hash) const;
+
     /** Called by IsStandardTx and P2SH/BIP62 VerifyScript (which makes it consensus-critical). */
     bool IsPushOnly(const_iterator pc) const;
     bool IsPushOnly() const;
@@ -581,9 +588,15 @@ public:
 
 struct CScriptWitness
 {
+    // Witness stacks rarely hold more than two items: a signature and a
+    // pubkey, or the key images and the ring and signature of an anon input.
+    // Keep those inline so deserializing an input doesn't allocate the stack.
+    // prevector is packed, align the inline items where the stack is placed.
+    typedef prevector<2, std::vector<unsigned char> > stack_type;
+
     // Note that this encodes the data elements being pushed, rather than
     // encoding them as a CScript that pushes them.
-    std::vector<std::vector<unsigned char> > stack;
+    alignas(std::vector<unsigned char>) stack_type stack;
 
     // Some compilers complain without a default constructor
     CScriptWitness() { }
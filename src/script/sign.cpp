@@ -243,7 +243,7 @@ bool ProduceSignature(const SigningProvider& provider, const BaseSignatureCreato
         witnessscript << OP_DUP << OP_HASH160 << ToByteVector(result[0]) << OP_EQUALVERIFY << OP_CHECKSIG;
         txnouttype subType;
         solved = solved && SignStep(provider, creator, witnessscript, result, subType, SigVersion::WITNESS_V0, sigdata);
-        sigdata.scriptWitness.stack = result;
+        sigdata.scriptWitness.stack.assign(result.begin(), result.end());
         sigdata.witness = true;
         result.clear();
     }
@@ -256,7 +256,7 @@ bool ProduceSignature(const SigningProvider& provider, const BaseSignatureCreato
         txnouttype subType;
         solved = solved && SignStep(provider, creator, witnessscript, result, subType, SigVersion::WITNESS_V0, sigdata) && subType != TX_SCRIPTHASH && subType != TX_WITNESS_V0_SCRIPTHASH && subType != TX_WITNESS_V0_KEYHASH;
         result.push_back(std::vector<unsigned char>(witnessscript.begin(), witnessscript.end()));
-        sigdata.scriptWitness.stack = result;
+        sigdata.scriptWitness.stack.assign(result.begin(), result.end());
         sigdata.witness = true;
         result.clear();
     } else if (solved && whichType == TX_WITNESS_UNKNOWN) {
@@ -268,7 +268,7 @@ bool ProduceSignature(const SigningProvider& provider, const BaseSignatureCreato
     }
 
     if (creator.IsBitcoinCVersion()) {
-        sigdata.scriptWitness.stack = result;
+        sigdata.scriptWitness.stack.assign(result.begin(), result.end());
     } else  {
         sigdata.scriptSig = PushAll(result);
     }
@@ -354,7 +354,7 @@ struct Stacks
 
     Stacks() = delete;
     Stacks(const Stacks&) = delete;
-    explicit Stacks(const SignatureData& data) : witness(data.scriptWitness.stack) {
+    explicit Stacks(const SignatureData& data) : witness(data.scriptWitness.stack.begin(), data.scriptWitness.stack.end()) {
         EvalScript(script, data.scriptSig, SCRIPT_VERIFY_STRICTENC, BaseSignatureChecker(), SigVersion::BASE);
     }
 };
@@ -55,8 +55,13 @@ SECP256K1_API int secp256k1_pedersen_commitment_serialize(
     const secp256k1_pedersen_commitment* commit
 ) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3);
 
-/** Initialize a context for usage with Pedersen commitments. */
-void secp256k1_pedersen_context_initialize(secp256k1_context* ctx);
+/** Initialize a context for usage with Pedersen commitments.
+ *  Precomputes a table for committing to values with secp256k1_generator_const_h, used by
+ *  secp256k1_pedersen_commit, secp256k1_rangeproof_sign and secp256k1_bulletproof_rangeproof_prove.
+ *  Must not be called while other threads use the context.
+ *  Args:   ctx:        pointer to a context object (cannot be NULL)
+ */
+SECP256K1_API void secp256k1_pedersen_context_initialize(secp256k1_context* ctx) SECP256K1_ARG_NONNULL(1);
 
 /** Generate a Pedersen commitment.
  *  Returns 1: Commitment successfully created.
@@ -24,6 +24,17 @@ int secp256k1_verify_mlsag(const secp256k1_context *ctx, const uint8_t *preimage
     size_t nCols, size_t nRows,
     const uint8_t *pk, const uint8_t *ki, const uint8_t *pc, const uint8_t *ps);
 
+/** Verify n independent MLSAG signatures together.
+ *  Returns: 0 if all signatures are valid, otherwise the first non-zero result.
+ *  results: if not NULL receives the result of each signature, as secp256k1_verify_mlsag would return.
+ *  scratch: used for the R point multiplications (cannot be NULL).
+ *  The parameters for signature j are preimage[j], nCols[j], nRows[j], pk[j], ki[j], pc[j] and ps[j].
+ */
+int secp256k1_verify_mlsag_batch(const secp256k1_context *ctx, secp256k1_scratch_space *scratch,
+    size_t n, const uint8_t * const *preimage, const size_t *nCols, const size_t *nRows,
+    const uint8_t * const *pk, const uint8_t * const *ki, const uint8_t * const *pc, const uint8_t * const *ps,
+    int *results);
+
 #ifdef __cplusplus
 }
 #endif
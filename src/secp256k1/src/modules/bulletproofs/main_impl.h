@@ -232,7 +232,7 @@ int secp256k1_bulletproof_rangeproof_prove(const secp256k1_context* ctx, secp256
         if (overflow || secp256k1_scalar_is_zero(&blinds[i])) {
             return 0;
         }
-        secp256k1_pedersen_ecmult(&commitj, &blinds[i], value[i], &value_genp, &gens->blinding_gen[0]);
+        secp256k1_pedersen_ecmult_prec(&ctx->ecmult_gen_ctx, &ctx->pedersen_gen_ctx, &commitj, &blinds[i], value[i], &value_genp, &gens->blinding_gen[0]);
         secp256k1_ge_set_gej(&commitp[i], &commitj);
     }
 
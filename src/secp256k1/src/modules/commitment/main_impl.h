@@ -77,6 +77,13 @@ int secp256k1_pedersen_commitment_serialize(const secp256k1_context* ctx, unsign
     return 1;
 }
 
+void secp256k1_pedersen_context_initialize(secp256k1_context* ctx) {
+    secp256k1_ge h;
+    VERIFY_CHECK(ctx != NULL);
+    secp256k1_generator_load(&h, &secp256k1_generator_const_h);
+    secp256k1_pedersen_gen_context_build(&ctx->pedersen_gen_ctx, &h, &ctx->error_callback);
+}
+
 /* Generates a pedersen commitment: *commit = blind * G + value * G2. The blinding factor is 32 bytes.*/
 int secp256k1_pedersen_commit(const secp256k1_context* ctx, secp256k1_pedersen_commitment *commit, const unsigned char *blind, uint64_t value, const secp256k1_generator* value_gen, const secp256k1_generator* blind_gen) {
     secp256k1_ge value_genp;
@@ -95,7 +102,7 @@ int secp256k1_pedersen_commit(const secp256k1_context* ctx, secp256k1_pedersen_c
     secp256k1_generator_load(&blind_genp, blind_gen);
     secp256k1_scalar_set_b32(&sec, blind, &overflow);
     if (!overflow) {
-        secp256k1_pedersen_ecmult(&rj, &sec, value, &value_genp, &blind_genp);
+        secp256k1_pedersen_ecmult_prec(&ctx->ecmult_gen_ctx, &ctx->pedersen_gen_ctx, &rj, &sec, value, &value_genp, &blind_genp);
         if (!secp256k1_gej_is_infinity(&rj)) {
             secp256k1_ge_set_gej(&r, &rj);
             secp256k1_pedersen_commitment_save(commit, &r);
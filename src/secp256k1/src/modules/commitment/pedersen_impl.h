@@ -10,9 +10,132 @@
 #include <string.h>
 
 #include "ecmult_const.h"
+#include "ecmult_gen.h"
 #include "group.h"
 #include "scalar.h"
 
+/* For accelerating v*H for 64 bit values v and a fixed value generator H, in constant time.
+ * Uses the same construction as secp256k1_ecmult_gen_context with 16 groups of 4 bits:
+ * prec[j][i] = 16^j * i * H + U_j, where U_j = U * 2^j (for j=0..14) and U_15 = U * (1-2^15)
+ * for a point U with no known corresponding scalar.
+ */
+typedef struct {
+    secp256k1_ge_storage (*prec)[16][16];
+    secp256k1_ge gen;
+} secp256k1_pedersen_gen_context;
+
+static void secp256k1_pedersen_gen_context_init(secp256k1_pedersen_gen_context *ctx) {
+    ctx->prec = NULL;
+}
+
+static void secp256k1_pedersen_gen_context_build(secp256k1_pedersen_gen_context *ctx, const secp256k1_ge *gen, const secp256k1_callback* cb) {
+    secp256k1_ge prec[256];
+    secp256k1_gej precj[256];
+    secp256k1_gej gbase;
+    secp256k1_gej numsbase;
+    secp256k1_gej nums_gej;
+    int i, j;
+
+    if (ctx->prec != NULL) {
+        return;
+    }
+    ctx->prec = (secp256k1_ge_storage (*)[16][16])checked_malloc(cb, sizeof(*ctx->prec));
+    ctx->gen = *gen;
+
+    /* Construct a group element with no known corresponding scalar (nothing up my sleeve). */
+    {
+        static const unsigned char nums_b32[33] = "The scalar for this x is unknown";
+        secp256k1_fe nums_x;
+        secp256k1_ge nums_ge;
+        int r;
+        r = secp256k1_fe_set_b32(&nums_x, nums_b32);
+        (void)r;
+        VERIFY_CHECK(r);
+        r = secp256k1_ge_set_xo_var(&nums_ge, &nums_x, 0);
+        (void)r;
+        VERIFY_CHECK(r);
+        secp256k1_gej_set_ge(&nums_gej, &nums_ge);
+        /* Add the generator to make the bits in x uniformly distributed. */
+        secp256k1_gej_add_ge_var(&nums_gej, &nums_gej, gen, NULL);
+    }
+
+    secp256k1_gej_set_ge(&gbase, gen); /* 16^j * H */
+    numsbase = nums_gej; /* 2^j * nums. */
+    for (j = 0; j < 16; j++) {
+        precj[j*16] = numsbase;
+        for (i = 1; i < 16; i++) {
+            secp256k1_gej_add_var(&precj[j*16 + i], &precj[j*16 + i - 1], &gbase, NULL);
+        }
+        for (i = 0; i < 4; i++) {
+            secp256k1_gej_double_var(&gbase, &gbase, NULL);
+        }
+        secp256k1_gej_double_var(&numsbase, &numsbase, NULL);
+        if (j == 14) {
+            /* In the last iteration, numsbase is (1 - 2^j) * nums instead. */
+            secp256k1_gej_neg(&numsbase, &numsbase);
+            secp256k1_gej_add_var(&numsbase, &numsbase, &nums_gej, NULL);
+        }
+    }
+    secp256k1_ge_set_all_gej_var(prec, precj, 256, cb);
+    for (j = 0; j < 16; j++) {
+        for (i = 0; i < 16; i++) {
+            secp256k1_ge_to_storage(&(*ctx->prec)[j][i], &prec[j*16 + i]);
+        }
+    }
+}
+
+static int secp256k1_pedersen_gen_context_is_built(const secp256k1_pedersen_gen_context* ctx) {
+    return ctx->prec != NULL;
+}
+
+static void secp256k1_pedersen_gen_context_clone(secp256k1_pedersen_gen_context *dst,
+                                                 const secp256k1_pedersen_gen_context *src, const secp256k1_callback* cb) {
+    if (src->prec == NULL) {
+        dst->prec = NULL;
+    } else {
+        dst->prec = (secp256k1_ge_storage (*)[16][16])checked_malloc(cb, sizeof(*dst->prec));
+        memcpy(dst->prec, src->prec, sizeof(*dst->prec));
+        dst->gen = src->gen;
+    }
+}
+
+static void secp256k1_pedersen_gen_context_clear(secp256k1_pedersen_gen_context *ctx) {
+    free(ctx->prec);
+    ctx->prec = NULL;
+}
+
+/* r = value * H, where H is the generator ctx was built for. */
+static void secp256k1_pedersen_gen(const secp256k1_pedersen_gen_context *ctx, secp256k1_gej *r, uint64_t value) {
+    secp256k1_ge add;
+    secp256k1_ge_storage adds;
+    int bits;
+    int i, j;
+    memset(&adds, 0, sizeof(adds));
+    secp256k1_gej_set_infinity(r);
+    add.infinity = 0;
+    for (j = 0; j < 16; j++) {
+        bits = (int)((value >> (j * 4)) & 15);
+        for (i = 0; i < 16; i++) {
+            /* Conditional move so the value isn't used as an array index, see secp256k1_ecmult_gen. */
+            secp256k1_ge_storage_cmov(&adds, &(*ctx->prec)[j][i], i == bits);
+        }
+        secp256k1_ge_from_storage(&add, &adds);
+        secp256k1_gej_add_ge(r, r, &add);
+    }
+    bits = 0;
+    secp256k1_ge_clear(&add);
+}
+
+static int secp256k1_pedersen_ge_eq_var(const secp256k1_ge *a, const secp256k1_ge *b) {
+    secp256k1_fe ax = a->x, ay = a->y;
+    if (a->infinity || b->infinity) {
+        return a->infinity && b->infinity;
+    }
+    secp256k1_fe_normalize_var(&ax);
+    secp256k1_fe_normalize_var(&ay);
+    return secp256k1_fe_equal_var(&ax, &b->x) && secp256k1_fe_equal_var(&ay, &b->y);
+}
+
 /* sec * G + value * G2. */
 SECP256K1_INLINE static void secp256k1_pedersen_ecmult(secp256k1_gej *rj, const secp256k1_scalar *sec, uint64_t value, const secp256k1_ge* value_gen, const secp256k1_ge* blind_gen) {
     secp256k1_scalar vs;
@@ -35,4 +158,40 @@ SECP256K1_INLINE static void secp256k1_pedersen_ecmult(secp256k1_gej *rj, const
     secp256k1_scalar_clear(&vs);
 }
 
+/* sec * G + value * G2, using the precomputed tables of whichever contexts are built and match the generators. */
+static void secp256k1_pedersen_ecmult_prec(const secp256k1_ecmult_gen_context *gen_ctx, const secp256k1_pedersen_gen_context *pedersen_ctx,
+    secp256k1_gej *rj, const secp256k1_scalar *sec, uint64_t value, const secp256k1_ge* value_gen, const secp256k1_ge* blind_gen) {
+    secp256k1_scalar vs;
+    secp256k1_gej bj;
+    secp256k1_ge bp;
+
+    if (pedersen_ctx != NULL && secp256k1_pedersen_gen_context_is_built(pedersen_ctx)
+        && secp256k1_pedersen_ge_eq_var(value_gen, &pedersen_ctx->gen)) {
+        secp256k1_pedersen_gen(pedersen_ctx, rj, value);
+    } else {
+        secp256k1_scalar_set_u64(&vs, value);
+        secp256k1_ecmult_const(rj, value_gen, &vs, 64);
+        secp256k1_scalar_clear(&vs);
+    }
+
+    /* zero blinding factor indicates that we are not trying to be zero-knowledge,
+     * so not being constant-time in this case is OK. */
+    if (secp256k1_scalar_is_zero(sec)) {
+        return;
+    }
+    if (gen_ctx != NULL && secp256k1_ecmult_gen_context_is_built(gen_ctx)
+        && secp256k1_pedersen_ge_eq_var(blind_gen, &secp256k1_ge_const_g)) {
+        secp256k1_ecmult_gen(gen_ctx, &bj, sec);
+    } else {
+        secp256k1_ecmult_const(&bj, blind_gen, sec, 256);
+    }
+    if (!secp256k1_gej_is_infinity(&bj)) {
+        secp256k1_ge_set_gej(&bp, &bj);
+        secp256k1_gej_add_ge(rj, rj, &bp);
+    }
+
+    secp256k1_gej_clear(&bj);
+    secp256k1_ge_clear(&bp);
+}
+
 #endif
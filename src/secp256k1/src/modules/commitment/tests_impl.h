@@ -218,6 +218,47 @@ void test_multiple_generators(void) {
 }
 #undef MAX_N_GENS
 
+static void test_pedersen_precomputed(void) {
+    /* Commitments made with the precomputed tables must match the generic ones */
+    secp256k1_context *ctx_prec = secp256k1_context_clone(ctx);
+    secp256k1_context *ctx_copy;
+    secp256k1_pedersen_commitment commit, commit_prec;
+    secp256k1_scalar s;
+    unsigned char blind[32];
+    uint64_t value;
+    int i;
+
+    secp256k1_pedersen_context_initialize(ctx_prec);
+    CHECK(secp256k1_pedersen_gen_context_is_built(&ctx_prec->pedersen_gen_ctx));
+    ctx_copy = secp256k1_context_clone(ctx_prec);
+    CHECK(secp256k1_pedersen_gen_context_is_built(&ctx_copy->pedersen_gen_ctx));
+
+    for (i = 0; i < 32 * count; i++) {
+        random_scalar_order(&s);
+        secp256k1_scalar_get_b32(blind, &s);
+        if (i % 8 == 1) {
+            memset(blind, 0, 32);
+        }
+        value = i == 0 ? 0 : i == 2 ? UINT64_MAX : (uint64_t)secp256k1_rands64(0, UINT64_MAX);
+        if (!secp256k1_pedersen_commit(ctx, &commit, blind, value, &secp256k1_generator_const_h, &secp256k1_generator_const_g)) {
+            CHECK(value == 0 && i % 8 == 1);
+            continue;
+        }
+        CHECK(secp256k1_pedersen_commit(ctx_prec, &commit_prec, blind, value, &secp256k1_generator_const_h, &secp256k1_generator_const_g));
+        CHECK(memcmp(commit.data, commit_prec.data, 33) == 0);
+        CHECK(secp256k1_pedersen_commit(ctx_copy, &commit_prec, blind, value, &secp256k1_generator_const_h, &secp256k1_generator_const_g));
+        CHECK(memcmp(commit.data, commit_prec.data, 33) == 0);
+
+        /* Generators other than H and G don't use the tables */
+        CHECK(secp256k1_pedersen_commit(ctx, &commit, blind, value, &secp256k1_generator_const_g, &secp256k1_generator_const_h));
+        CHECK(secp256k1_pedersen_commit(ctx_prec, &commit_prec, blind, value, &secp256k1_generator_const_g, &secp256k1_generator_const_h));
+        CHECK(memcmp(commit.data, commit_prec.data, 33) == 0);
+    }
+
+    secp256k1_context_destroy(ctx_copy);
+    secp256k1_context_destroy(ctx_prec);
+}
+
 void run_commitment_tests(void) {
     int i;
     test_commitment_api();
@@ -225,6 +266,7 @@ void run_commitment_tests(void) {
         test_pedersen();
     }
     test_multiple_generators();
+    test_pedersen_precomputed();
 }
 
 #endif
@@ -486,4 +486,214 @@ int secp256k1_verify_mlsag(const secp256k1_context *ctx,
     return secp256k1_scalar_is_zero(&zero) ? 0 : 2; /* return 0 on success, 2 on failure */
 }
 
+typedef struct {
+    secp256k1_scalar sc[2];
+    secp256k1_ge pt[2];
+} secp256k1_mlsag_ecmult_data;
+
+static int secp256k1_mlsag_ecmult_callback(secp256k1_scalar *sc, secp256k1_ge *pt, size_t idx, void *cbdata) {
+    secp256k1_mlsag_ecmult_data *data = (secp256k1_mlsag_ecmult_data*) cbdata;
+    *sc = data->sc[idx];
+    *pt = data->pt[idx];
+    return 1;
+}
+
+typedef struct {
+    secp256k1_sha256 sha256_pre;
+    secp256k1_scalar clast, cSig;
+    secp256k1_ge *ki;
+    uint8_t tmp[33];
+    size_t nPoints; /* L and R points of the ring in the current step */
+    int result; /* -1 while the ring is being verified */
+} secp256k1_mlsag_vfy_state;
+
+int secp256k1_verify_mlsag_batch(const secp256k1_context *ctx, secp256k1_scratch_space *scratch,
+    size_t n, const uint8_t * const *preimage, const size_t *nCols, const size_t *nRows,
+    const uint8_t * const *pk, const uint8_t * const *ki, const uint8_t * const *pc, const uint8_t * const *ps,
+    int *results)
+{
+    /*
+        Same checks as secp256k1_verify_mlsag, the rings are advanced a column at a time together so
+        the L and R points of all rings in a step share one field inversion when made affine.
+        R = H(pk[k][i]) * ss + ki[k] * clast is computed as a single two point multiplication.
+    */
+    secp256k1_mlsag_vfy_state *states;
+    secp256k1_mlsag_vfy_state *st;
+    secp256k1_mlsag_ecmult_data ecmult_data;
+    secp256k1_ge *kis, *ges;
+    secp256k1_gej *gejs, gej1;
+    secp256k1_scalar zero, ss;
+    size_t nKeyImages = 0, nMaxPoints = 0, nMaxCols = 0;
+    size_t i, j, k, dsRows, ofs, np, clen;
+    int overflow, rv = 0;
+
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(scratch != NULL);
+
+    if (n == 0)
+        return 0;
+
+    for (j = 0; j < n; ++j)
+    {
+        if (nRows[j] < 1)
+            return 1;
+        nKeyImages += nRows[j] - 1;
+        nMaxPoints += 2 * nRows[j] - 1;
+        if (nCols[j] > nMaxCols)
+            nMaxCols = nCols[j];
+    };
+
+    states = (secp256k1_mlsag_vfy_state*)checked_malloc(&ctx->error_callback, n * sizeof(*states));
+    kis = (secp256k1_ge*)checked_malloc(&ctx->error_callback, (nKeyImages > 0 ? nKeyImages : 1) * sizeof(*kis));
+    gejs = (secp256k1_gej*)checked_malloc(&ctx->error_callback, nMaxPoints * sizeof(*gejs));
+    ges = (secp256k1_ge*)checked_malloc(&ctx->error_callback, nMaxPoints * sizeof(*ges));
+
+    secp256k1_scalar_set_int(&zero, 0);
+
+    ofs = 0;
+    for (j = 0; j < n; ++j)
+    {
+        st = &states[j];
+        st->ki = &kis[ofs];
+        st->result = -1;
+        memset(st->tmp, 0, sizeof(st->tmp));
+        dsRows = nRows[j] - 1;
+        ofs += dsRows;
+
+        secp256k1_scalar_set_b32(&st->clast, pc[j], &overflow);
+        if (overflow || secp256k1_scalar_is_zero(&st->clast))
+        {
+            st->result = 1;
+            continue;
+        };
+        st->cSig = st->clast;
+        if (nCols[j] == 0)
+        {
+            st->result = 0;
+            continue;
+        };
+
+        for (k = 0; k < dsRows; ++k)
+        {
+            if (!secp256k1_eckey_pubkey_parse(&st->ki[k], &ki[j][k * 33], 33))
+            {
+                st->result = 1;
+                break;
+            };
+        };
+
+        secp256k1_sha256_initialize(&st->sha256_pre);
+        secp256k1_sha256_write(&st->sha256_pre, preimage[j], 32);
+    };
+
+    for (i = 0; i < nMaxCols; ++i)
+    {
+        np = 0;
+        for (j = 0; j < n; ++j)
+        {
+            st = &states[j];
+            st->nPoints = 0;
+            if (st->result != -1 || i >= nCols[j])
+                continue;
+            dsRows = nRows[j] - 1;
+
+            for (k = 0; k < nRows[j]; ++k)
+            {
+                /* L = G * ss + pk[k][i] * clast */
+                secp256k1_scalar_set_b32(&ss, &ps[j][(i + k*nCols[j])*32], &overflow);
+                if (overflow || secp256k1_scalar_is_zero(&ss)
+                    || !secp256k1_eckey_pubkey_parse(&ecmult_data.pt[0], &pk[j][(i + k*nCols[j])*33], 33))
+                {
+                    st->result = 1;
+                    break;
+                };
+                secp256k1_gej_set_ge(&gej1, &ecmult_data.pt[0]);
+                secp256k1_ecmult(&ctx->ecmult_ctx, &gejs[np + st->nPoints++], &gej1, &st->clast, &ss);
+
+                if (k >= dsRows)
+                    continue;
+
+                /* R = H(pk[k][i]) * ss + ki[k] * clast */
+                if (0 != hash_to_curve(&ecmult_data.pt[0], &pk[j][(i + k*nCols[j])*33], 33))
+                {
+                    st->result = 1;
+                    break;
+                };
+                ecmult_data.sc[0] = ss;
+                ecmult_data.sc[1] = st->clast;
+                ecmult_data.pt[1] = st->ki[k];
+                if (!secp256k1_ecmult_multi_var(&ctx->ecmult_ctx, scratch, &gejs[np + st->nPoints],
+                    NULL, secp256k1_mlsag_ecmult_callback, &ecmult_data, 2))
+                {
+                    /* Scratch space too small */
+                    secp256k1_gej_set_ge(&gej1, &ecmult_data.pt[0]);
+                    secp256k1_ecmult(&ctx->ecmult_ctx, &gej1, &gej1, &ss, &zero);
+                    secp256k1_gej_set_ge(&gejs[np + st->nPoints], &st->ki[k]);
+                    secp256k1_ecmult(&ctx->ecmult_ctx, &gejs[np + st->nPoints], &gejs[np + st->nPoints], &st->clast, &zero);
+                    secp256k1_gej_add_var(&gejs[np + st->nPoints], &gej1, &gejs[np + st->nPoints], NULL);
+                };
+                st->nPoints++;
+            };
+
+            if (st->result != -1)
+            {
+                st->nPoints = 0;
+                continue;
+            };
+            np += st->nPoints;
+        };
+
+        secp256k1_ge_set_all_gej_var(ges, gejs, np, &ctx->error_callback);
+
+        np = 0;
+        for (j = 0; j < n; ++j)
+        {
+            secp256k1_sha256 sha256_m;
+            st = &states[j];
+            if (st->result != -1 || i >= nCols[j])
+                continue;
+            dsRows = nRows[j] - 1;
+
+            sha256_m = st->sha256_pre;
+            for (k = 0; k < nRows[j]; ++k)
+            {
+                secp256k1_sha256_write(&sha256_m, &pk[j][(i + k*nCols[j])*33], 33); /* pk[k][i] */
+                secp256k1_eckey_pubkey_serialize(&ges[np++], st->tmp, &clen, 1);
+                secp256k1_sha256_write(&sha256_m, st->tmp, 33); /* L */
+                if (k < dsRows)
+                {
+                    secp256k1_eckey_pubkey_serialize(&ges[np++], st->tmp, &clen, 1);
+                    secp256k1_sha256_write(&sha256_m, st->tmp, 33); /* R */
+                };
+            };
+
+            secp256k1_sha256_finalize(&sha256_m, st->tmp);
+            secp256k1_scalar_set_b32(&st->clast, st->tmp, &overflow);
+            if (overflow || secp256k1_scalar_is_zero(&st->clast))
+            {
+                st->result = 1;
+                continue;
+            };
+
+            if (i + 1 == nCols[j])
+                st->result = secp256k1_scalar_eq(&st->clast, &st->cSig) ? 0 : 2;
+        };
+    };
+
+    for (j = 0; j < n; ++j)
+    {
+        if (results)
+            results[j] = states[j].result;
+        if (rv == 0)
+            rv = states[j].result;
+    };
+
+    free(ges);
+    free(gejs);
+    free(kis);
+    free(states);
+
+    return rv;
+}
+
 #endif
@@ -14,6 +14,45 @@ static int mlsag_count = 32;
 #define MAX_N_INPUTS  32
 #define MAX_N_OUTPUTS 32
 #define MAX_N_COLUMNS 32
+/* Verify the signature alone and next to a copy with a bad preimage, with and without enough scratch space */
+static void check_mlsag_batch(int expected, const uint8_t *preimage, size_t n_columns, size_t n_rows,
+    const uint8_t *m, const uint8_t *ki, const uint8_t *pc, const uint8_t *ss)
+{
+    secp256k1_scratch_space *scratch = secp256k1_scratch_space_create(ctx, 1024 * 1024);
+    secp256k1_scratch_space *scratch_small = secp256k1_scratch_space_create(ctx, 0);
+    uint8_t bad_preimage[32];
+    const uint8_t *preimages[2], *pks[2], *kis[2], *pcs[2], *pss[2];
+    size_t cols[2], rows[2];
+    int results[2] = {0, 0}, i;
+
+    memcpy(bad_preimage, preimage, 32);
+    bad_preimage[0] ^= 1;
+
+    for (i = 0; i < 2; ++i)
+    {
+        preimages[i] = i == 0 ? preimage : bad_preimage;
+        cols[i] = n_columns;
+        rows[i] = n_rows;
+        pks[i] = m;
+        kis[i] = ki;
+        pcs[i] = pc;
+        pss[i] = ss;
+    }
+
+    CHECK(expected == secp256k1_verify_mlsag_batch(ctx, scratch, 1, preimages, cols, rows, pks, kis, pcs, pss, NULL));
+    CHECK(expected == secp256k1_verify_mlsag_batch(ctx, scratch_small, 1, preimages, cols, rows, pks, kis, pcs, pss, results));
+    CHECK(expected == results[0]);
+
+    CHECK((expected ? expected : 2) == secp256k1_verify_mlsag_batch(ctx, scratch, 2, preimages, cols, rows, pks, kis, pcs, pss, results));
+    CHECK(expected == results[0]);
+    CHECK(2 == results[1]);
+
+    CHECK(0 == secp256k1_verify_mlsag_batch(ctx, scratch, 0, preimages, cols, rows, pks, kis, pcs, pss, NULL));
+
+    secp256k1_scratch_space_destroy(scratch_small);
+    secp256k1_scratch_space_destroy(scratch);
+}
+
 void test_mlsag(void)
 {
     const size_t n_inputs = (secp256k1_rand32() % (MAX_N_INPUTS))+1;
@@ -125,6 +164,7 @@ void test_mlsag(void)
     CHECK(0 == secp256k1_verify_mlsag(ctx,
         preimage, n_columns, n_rows,
         m, ki, pc, ss));
+    check_mlsag_batch(0, preimage, n_columns, n_rows, m, ki, pc, ss);
 
 
     /* --- Test for failure --- */
@@ -153,6 +193,7 @@ void test_mlsag(void)
     CHECK(2 == secp256k1_verify_mlsag(ctx,
         preimage, n_columns, n_rows,
         m, ki, pc, ss));
+    check_mlsag_batch(2, preimage, n_columns, n_rows, m, ki, pc, ss);
 
     /* Pass repaired bad sum */
     value[0] += 1;
@@ -178,6 +219,7 @@ void test_mlsag(void)
     CHECK(2 == secp256k1_verify_mlsag(ctx,
         preimage, n_columns, n_rows,
         m, ki, pc, ss));
+    check_mlsag_batch(2, preimage, n_columns, n_rows, m, ki, pc, ss);
 }
 
 
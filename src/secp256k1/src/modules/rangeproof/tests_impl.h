@@ -520,6 +520,11 @@ void run_rangeproof_tests(void) {
         test_borromean();
     }
     test_rangeproof();
+    /* Again with the precomputed value generator table, later tests keep using it */
+    secp256k1_pedersen_context_initialize(ctx);
+    test_rangeproof_fixed_vectors();
+    test_pedersen_commitment_fixed_vector();
+    test_rangeproof();
 }
 
 #endif
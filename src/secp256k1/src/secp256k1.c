@@ -25,6 +25,7 @@
 
 #ifdef ENABLE_MODULE_COMMITMENT
 # include "include/secp256k1_commitment.h"
+# include "modules/commitment/pedersen_impl.h"
 #endif
 
 #ifdef ENABLE_MODULE_RANGEPROOF
@@ -68,6 +69,9 @@ static const secp256k1_callback default_error_callback = {
 struct secp256k1_context_struct {
     secp256k1_ecmult_context ecmult_ctx;
     secp256k1_ecmult_gen_context ecmult_gen_ctx;
+#ifdef ENABLE_MODULE_COMMITMENT
+    secp256k1_pedersen_gen_context pedersen_gen_ctx;
+#endif
     secp256k1_callback illegal_callback;
     secp256k1_callback error_callback;
 };
@@ -86,6 +90,9 @@ secp256k1_context* secp256k1_context_create(unsigned int flags) {
 
     secp256k1_ecmult_context_init(&ret->ecmult_ctx);
     secp256k1_ecmult_gen_context_init(&ret->ecmult_gen_ctx);
+#ifdef ENABLE_MODULE_COMMITMENT
+    secp256k1_pedersen_gen_context_init(&ret->pedersen_gen_ctx);
+#endif
 
     if (flags & SECP256K1_FLAGS_BIT_CONTEXT_SIGN) {
         secp256k1_ecmult_gen_context_build(&ret->ecmult_gen_ctx, &ret->error_callback);
@@ -103,6 +110,9 @@ secp256k1_context* secp256k1_context_clone(const secp256k1_context* ctx) {
     ret->error_callback = ctx->error_callback;
     secp256k1_ecmult_context_clone(&ret->ecmult_ctx, &ctx->ecmult_ctx, &ctx->error_callback);
     secp256k1_ecmult_gen_context_clone(&ret->ecmult_gen_ctx, &ctx->ecmult_gen_ctx, &ctx->error_callback);
+#ifdef ENABLE_MODULE_COMMITMENT
+    secp256k1_pedersen_gen_context_clone(&ret->pedersen_gen_ctx, &ctx->pedersen_gen_ctx, &ctx->error_callback);
+#endif
     return ret;
 }
 
@@ -110,6 +120,9 @@ void secp256k1_context_destroy(secp256k1_context* ctx) {
     if (ctx != NULL) {
         secp256k1_ecmult_context_clear(&ctx->ecmult_ctx);
         secp256k1_ecmult_gen_context_clear(&ctx->ecmult_gen_ctx);
+#ifdef ENABLE_MODULE_COMMITMENT
+        secp256k1_pedersen_gen_context_clear(&ctx->pedersen_gen_ctx);
+#endif
 
         free(ctx);
     }
@@ -0,0 +1,262 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_SHARDEDCACHE_H
+#define BITCOINC_SHARDEDCACHE_H
+
+#include <memusage.h>
+#include <sync.h>
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <stdint.h>
+#include <unordered_map>
+
+//! Entry order a sharded cache evicts by
+enum class CacheEviction
+{
+    LRU,    //!< Least recently used first, hits move an entry to the front
+    FIFO,   //!< Oldest insertion first, hits don't reorder, cheaper under contention
+};
+
+//! Counters of a sharded cache, see CShardedCache::GetStats
+struct CacheStats
+{
+    uint64_t nHits = 0;
+    uint64_t nMisses = 0;
+    uint64_t nInserts = 0;
+    uint64_t nEvictions = 0;    //!< Entries dropped to stay within the size limit
+    size_t nSize = 0;           //!< Entries held
+    size_t nUsage = 0;          //!< Memory usage of the entries and maps
+    size_t nMaxUsage = 0;
+};
+
+//! Default value sizer of CShardedCache, for values without owned heap memory
+template <typename V>
+struct CacheNoDynamicUsage
+{
+    size_t operator()(const V &v) const { return 0; };
+};
+
+/**
+ * Bounded key->value cache split into nShards independently locked shards.
+ *
+ * A key's shard is Hasher(key) % nShards, so a hasher that spreads consecutive
+ * keys also spreads threads reading neighbouring keys over different locks.
+ * Memory is accounted per entry with memusage: the list and map nodes plus
+ * Usage(value) for heap owned by the value. Each shard evicts by the eviction
+ * order once its share of the limit is exceeded, and a value larger than a
+ * shard's share is not cached at all.
+ */
+template <typename K, typename V, typename Hasher = std::hash<K>, typename Usage = CacheNoDynamicUsage<V> >
+class CShardedCache
+{
+public:
+    //! Called with the shard lock held for every entry evicted to stay within the limit
+    typedef std::function<void(const K&, const V&)> EvictHandler;
+
+    CShardedCache(size_t nMaxBytes, size_t nShardsIn, CacheEviction evictionIn = CacheEviction::LRU)
+        : nShards(nShardsIn), vShards(new Shard[nShardsIn]), eviction(evictionIn)
+    {
+        SetMaxSize(nMaxBytes);
+    };
+
+    bool Get(const K &key, V &value)
+    {
+        Shard &shard = GetShard(key);
+        LOCK(shard.cs);
+
+        auto mi = shard.map.find(key);
+        if (mi == shard.map.end())
+        {
+            nMisses++;
+            return false;
+        };
+
+        if (eviction == CacheEviction::LRU)
+            shard.lru.splice(shard.lru.begin(), shard.lru, mi->second);
+        value = mi->second->value;
+        nHits++;
+        return true;
+    };
+
+    //! Insert or replace the value of key
+    void Insert(const K &key, const V &value)
+    {
+        if (nMaxBytesPerShard == 0)
+            return;
+
+        size_t nUsage = EntryUsage(value);
+        if (nUsage > nMaxBytesPerShard)
+            return;
+
+        Shard &shard = GetShard(key);
+        LOCK(shard.cs);
+
+        auto mi = shard.map.find(key);
+        if (mi != shard.map.end())
+        {
+            Entry &e = *mi->second;
+            shard.nUsage += nUsage - e.nUsage;
+            e.value = value;
+            e.nUsage = nUsage;
+            if (eviction == CacheEviction::LRU)
+                shard.lru.splice(shard.lru.begin(), shard.lru, mi->second);
+            TrimShard(shard);
+            return;
+        };
+
+        shard.lru.push_front(Entry{key, value, nUsage});
+        shard.map.emplace(key, shard.lru.begin());
+        shard.nUsage += nUsage;
+        nInserts++;
+        TrimShard(shard);
+    };
+
+    void Erase(const K &key)
+    {
+        Shard &shard = GetShard(key);
+        LOCK(shard.cs);
+
+        auto mi = shard.map.find(key);
+        if (mi == shard.map.end())
+            return;
+
+        shard.nUsage -= mi->second->nUsage;
+        shard.lru.erase(mi->second);
+        shard.map.erase(mi);
+    };
+
+    void Clear()
+    {
+        for (size_t i = 0; i < nShards; ++i)
+        {
+            Shard &shard = vShards[i];
+            LOCK(shard.cs);
+            shard.lru.clear();
+            shard.map.clear();
+            shard.nUsage = 0;
+        };
+    };
+
+    //! Setting 0 disables the cache
+    void SetMaxSize(size_t nMaxBytes)
+    {
+        nMaxBytesPerShard = nMaxBytes / nShards;
+        for (size_t i = 0; i < nShards; ++i)
+        {
+            Shard &shard = vShards[i];
+            LOCK(shard.cs);
+            TrimShard(shard);
+        };
+    };
+
+    size_t GetMaxSize() const { return nMaxBytesPerShard * nShards; };
+
+    //! Set before the cache is shared between threads
+    void SetEvictHandler(EvictHandler handler) { onEvict = handler; };
+
+    size_t Size() const
+    {
+        size_t nSize = 0;
+        for (size_t i = 0; i < nShards; ++i)
+        {
+            LOCK(vShards[i].cs);
+            nSize += vShards[i].lru.size();
+        };
+        return nSize;
+    };
+
+    size_t DynamicMemoryUsage() const
+    {
+        size_t nUsage = 0;
+        for (size_t i = 0; i < nShards; ++i)
+        {
+            const Shard &shard = vShards[i];
+            LOCK(shard.cs);
+            nUsage += shard.nUsage
+                + memusage::MallocUsage(sizeof(void*) * shard.map.bucket_count());
+        };
+        return nUsage;
+    };
+
+    uint64_t GetHits() const { return nHits; };
+    uint64_t GetMisses() const { return nMisses; };
+
+    CacheStats GetStats() const
+    {
+        CacheStats stats;
+        stats.nHits = nHits;
+        stats.nMisses = nMisses;
+        stats.nInserts = nInserts;
+        stats.nEvictions = nEvictions;
+        stats.nSize = Size();
+        stats.nUsage = DynamicMemoryUsage();
+        stats.nMaxUsage = GetMaxSize();
+        return stats;
+    };
+
+    //! Memory charged for an entry holding value
+    static size_t EntryUsage(const V &value)
+    {
+        return EntryOverhead() + Usage()(value);
+    };
+
+    //! Memory charged for an entry besides the heap owned by its value: the list and map nodes
+    static size_t EntryOverhead()
+    {
+        return memusage::MallocUsage(sizeof(Entry) + 2 * sizeof(void*))
+            + memusage::MallocUsage(sizeof(memusage::unordered_node<std::pair<const K, typename EntryList::iterator> >));
+    };
+
+    size_t GetShardCount() const { return nShards; };
+
+private:
+    struct Entry
+    {
+        K key;
+        V value;
+        size_t nUsage;
+    };
+    typedef std::list<Entry> EntryList;
+
+    struct Shard
+    {
+        mutable CCriticalSection cs;
+        EntryList lru; // Next to evict at the back
+        std::unordered_map<K, typename EntryList::iterator, Hasher> map;
+        size_t nUsage = 0;
+    };
+
+    Shard &GetShard(const K &key) { return vShards[Hasher()(key) % nShards]; };
+
+    void TrimShard(Shard &shard)
+    {
+        AssertLockHeld(shard.cs);
+        while (shard.nUsage > nMaxBytesPerShard)
+        {
+            const Entry &e = shard.lru.back();
+            if (onEvict)
+                onEvict(e.key, e.value);
+            shard.nUsage -= e.nUsage;
+            shard.map.erase(e.key);
+            shard.lru.pop_back();
+            nEvictions++;
+        };
+    };
+
+    const size_t nShards;
+    std::unique_ptr<Shard[]> vShards;
+    const CacheEviction eviction;
+    EvictHandler onEvict;
+    std::atomic<size_t> nMaxBytesPerShard{0};
+    std::atomic<uint64_t> nHits{0};
+    std::atomic<uint64_t> nMisses{0};
+    std::atomic<uint64_t> nInserts{0};
+    std::atomic<uint64_t> nEvictions{0};
+};
+
+#endif // BITCOINC_SHARDEDCACHE_H
@@ -0,0 +1,102 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <smsg/compress.h>
+
+#include <lz4/lz4.h>
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+namespace smsg {
+namespace {
+
+/**
+ * Tokens common in the small structured messages services exchange.
+ * Matches closer to the input are cheaper, the most frequent tokens go last.
+ * This is part of the message format: never change it, a new dictionary needs a new flag.
+ */
+const char DICTIONARY[] =
+    "\"description\":\"\",\"signature\":\"\",\"reference\":\"\",\"currency\":\"BTC\",\"quantity\":"
+    "\"location\":\"\",\"category\":\"\",\"request\":\"\",\"response\":\"\",\"confirmations\":"
+    "\"blockhash\":\"\",\"height\":\"expires\":\"created\":\"updated\":\"order\":\"items\":[{"
+    "\"pubkey\":\"\",\"price\":\"fee\":\"total\":\"txid\":\"\",\"vout\":\"amount\":"
+    "\"address\":\"\",\"from\":\"\",\"to\":\"\",\"subject\":\"\",\"text\":\"\",\"name\":\"\","
+    "\"status\":\"ok\",\"error\":null,\"result\":true,false,\"value\":\"data\":{\"id\":\""
+    "\"time\":\"timestamp\":\"version\":\"method\":\"params\":[\"message\":\"\",\"type\":\"";
+
+const int DICTIONARY_SIZE = sizeof(DICTIONARY) - 1;
+
+//! Window LZ4 matches may reach back into
+const int PREFIX_SIZE = 64 * 1024;
+
+struct CompressState
+{
+    std::vector<uint32_t> vState; // LZ4 state, must be 4 byte aligned
+    std::vector<uint8_t> vInput; // dictionary followed by the input
+    std::vector<uint8_t> vScratch; // output for the dictionary
+    std::vector<uint8_t> vOutput; // zeros and the dictionary in the prefix window, then the output
+
+    void *State()
+    {
+        if (vState.empty()) {
+            vState.resize((std::max(LZ4_sizeofState(), LZ4_sizeofStreamState()) + 3) / 4);
+        }
+        return vState.data();
+    }
+};
+thread_local CompressState compressState;
+
+} // namespace
+
+int CompressPayload(const uint8_t *pIn, int nIn, uint8_t *pOut, int nOutMax, bool fDictionary)
+{
+    CompressState &cs = compressState;
+    void *state = cs.State();
+
+    if (!fDictionary) {
+        return LZ4_compress_limitedOutput_withState(state, (const char*)pIn, (char*)pOut, nIn, nOutMax);
+    }
+
+    // Blocks of a stream may match into the blocks before them, compress the
+    // dictionary as the first block and discard its output.
+    cs.vInput.resize(DICTIONARY_SIZE + nIn);
+    memcpy(cs.vInput.data(), DICTIONARY, DICTIONARY_SIZE);
+    memcpy(cs.vInput.data() + DICTIONARY_SIZE, pIn, nIn);
+    cs.vScratch.resize(LZ4_compressBound(DICTIONARY_SIZE));
+
+    const char *pBuffer = (const char*)cs.vInput.data();
+    if (LZ4_resetStreamState(state, pBuffer) != 0
+        || LZ4_compress_continue(state, pBuffer, (char*)cs.vScratch.data(), DICTIONARY_SIZE) < 1) {
+        return 0;
+    }
+    return LZ4_compress_limitedOutput_continue(state, pBuffer + DICTIONARY_SIZE, (char*)pOut, nIn, nOutMax);
+}
+
+bool DecompressPayload(const uint8_t *pIn, int nIn, uint8_t *pOut, int nOut, bool fDictionary)
+{
+    if (!fDictionary) {
+        return LZ4_decompress_safe((const char*)pIn, (char*)pOut, nIn, nOut) == nOut;
+    }
+
+    // The prefix decoder doesn't check how far back a match reaches, keep a
+    // full window in front of the output so a malformed input can't read
+    // outside the buffer. Decoding only writes after the window.
+    CompressState &cs = compressState;
+    if (cs.vOutput.size() < (size_t)PREFIX_SIZE) {
+        cs.vOutput.assign(PREFIX_SIZE, 0);
+        memcpy(cs.vOutput.data() + PREFIX_SIZE - DICTIONARY_SIZE, DICTIONARY, DICTIONARY_SIZE);
+    }
+    cs.vOutput.resize(PREFIX_SIZE + nOut);
+
+    char *pDest = (char*)cs.vOutput.data() + PREFIX_SIZE;
+    if (LZ4_decompress_safe_withPrefix64k((const char*)pIn, pDest, nIn, nOut) != nOut) {
+        return false;
+    }
+    memcpy(pOut, pDest, nOut);
+    return true;
+}
+
+} // namespace smsg
@@ -0,0 +1,30 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_SMSG_COMPRESS_H
+#define BITCOINC_SMSG_COMPRESS_H
+
+#include <stdint.h>
+
+namespace smsg {
+
+//! Set in the plain text length of a payload compressed against the built-in dictionary
+const uint32_t SMSG_PL_DICT_FLAG = 0x80000000;
+
+/**
+ * Compress nIn bytes to pOut, using a compression state reused by the calling thread.
+ * With fDictionary the input is compressed as if it followed the built-in dictionary.
+ * Returns the compressed length, 0 if it does not fit in nOutMax bytes.
+ */
+int CompressPayload(const uint8_t *pIn, int nIn, uint8_t *pOut, int nOutMax, bool fDictionary);
+
+/**
+ * Decompress to exactly nOut bytes at pOut.
+ * Returns false if the input is invalid or does not decompress to nOut bytes.
+ */
+bool DecompressPayload(const uint8_t *pIn, int nIn, uint8_t *pOut, int nOut, bool fDictionary);
+
+} // namespace smsg
+
+#endif // BITCOINC_SMSG_COMPRESS_H
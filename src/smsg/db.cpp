@@ -8,6 +8,9 @@
 #include <serialize.h>
 #include <clientversion.h>
 
+#include <leveldb/cache.h>
+#include <leveldb/filter_policy.h>
+
 namespace smsg {
 
 /*
@@ -21,10 +24,32 @@ prefixes
     sm      - sent message
     qm      - queued message
     pm      - purged message token
+
+    iu      - unread inbox message index, msgid
+    ia      - inbox message index by address to, addr + msgid
+    sa      - sent message index by address to, addr + msgid
+    ix      - version of the message indexes
 */
 
+//! Version of the iu, ia and sa indexes, they are rebuilt if the stored version differs
+static const int SMSG_DB_INDEX_VERSION = 1;
+
 CCriticalSection cs_smsgDB;
 leveldb::DB *smsgDB = nullptr;
+static leveldb::Cache *smsgDBCache = nullptr;
+static const leveldb::FilterPolicy *smsgDBFilter = nullptr;
+
+void CloseSecMsgDB()
+{
+    AssertLockHeld(cs_smsgDB);
+
+    delete smsgDB;
+    smsgDB = nullptr;
+    delete smsgDBCache;
+    smsgDBCache = nullptr;
+    delete smsgDBFilter;
+    smsgDBFilter = nullptr;
+};
 
 bool SecMsgDB::Open(const char *pszMode)
 {
@@ -46,74 +71,198 @@ bool SecMsgDB::Open(const char *pszMode)
         return false;
     };
 
+    // Sized as CDBWrapper does, the bloom filter saves the disk reads of lookups
+    // for absent keys, most pk lookups when scanning and pm lookups when receiving.
+    int64_t nCacheSize = gArgs.GetArg("-smsgdbcache", DEFAULT_SMSGDB_CACHE);
+    nCacheSize = std::max((int64_t)1, std::min(nCacheSize, MAX_SMSGDB_CACHE)) << 20;
+
+    delete smsgDBCache;
+    delete smsgDBFilter;
+    smsgDBCache = leveldb::NewLRUCache(nCacheSize / 2);
+    smsgDBFilter = leveldb::NewBloomFilterPolicy(10);
+
     leveldb::Options options;
     options.create_if_missing = fCreate;
+    options.block_cache = smsgDBCache;
+    options.write_buffer_size = nCacheSize / 4;
+    options.filter_policy = smsgDBFilter;
+    options.max_open_files = 64;
     leveldb::Status s = leveldb::DB::Open(options, fullpath.string(), &smsgDB);
 
     if (!s.ok())
     {
         LogPrintf("%s: Error opening db: %s.\n", __func__, s.ToString());
+        smsgDB = nullptr;
         return false;
     };
 
     pdb = smsgDB;
 
+    if (!BuildIndexes())
+        LogPrintf("%s: Error indexing db, retrying on the next start.\n", __func__);
+
     return true;
 };
 
-
-class SecMsgBatchScanner : public leveldb::WriteBatch::Handler
+bool SecMsgDB::BuildIndexes()
 {
-public:
-    std::string needle;
-    bool *deleted;
-    std::string* foundValue;
-    bool foundEntry;
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey << 'i';
+    ssKey << 'x';
+    std::string strValue;
+    int nVersion = 0;
+    if (pdb->Get(leveldb::ReadOptions(), ssKey.str(), &strValue).ok())
+    {
+        CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+        try { ssValue >> nVersion; } catch (std::exception &e) { nVersion = 0; };
+    };
+    if (nVersion == SMSG_DB_INDEX_VERSION)
+        return true;
 
-    SecMsgBatchScanner() : foundEntry(false) {}
+    LogPrintf("Indexing stored messages.\n");
+
+    if (!TxnBegin())
+        return false;
 
-    virtual void Put(const leveldb::Slice &key, const leveldb::Slice &value)
+    size_t nIndexed = 0;
+    uint8_t chKey[30];
+    SecMsgStored smsgStored;
+    for (const std::string sPrefix : {"im", "sm"})
     {
-        if (key.ToString() == needle)
+        leveldb::Iterator *it = pdb->NewIterator(leveldb::ReadOptions());
+        while (NextSmesg(it, sPrefix, chKey, smsgStored))
         {
-            foundEntry = true;
-            *deleted = false;
-            *foundValue = value.ToString();
+            WriteIndexes(chKey, smsgStored);
+            nIndexed++;
         };
+        delete it;
     };
 
-    virtual void Delete(const leveldb::Slice &key)
+    CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+    ssValue << SMSG_DB_INDEX_VERSION;
+    Put(ssKey, ssValue);
+
+    if (!TxnCommit())
+        return false;
+
+    LogPrintf("Indexed %u stored messages.\n", nIndexed);
+
+    return true;
+};
+
+static void IndexKey(CDataStream &ssKey, char c0, char c1, const CKeyID *pAddr, const uint8_t *chKey)
+{
+    ssKey << c0;
+    ssKey << c1;
+    if (pAddr)
+        ssKey << *pAddr;
+    ssKey.write((const char*)chKey + 2, 28);
+};
+
+bool SecMsgDB::WriteIndexes(const uint8_t *chKey, const SecMsgStored &smsgStored)
+{
+    CDataStream ssEmpty(SER_DISK, CLIENT_VERSION);
+
+    if (chKey[0] == 'i' && chKey[1] == 'm')
     {
-        if (key.ToString() == needle)
-        {
-            foundEntry = true;
-            *deleted = true;
-        };
+        CDataStream ssUnread(SER_DISK, CLIENT_VERSION);
+        IndexKey(ssUnread, 'i', 'u', nullptr, chKey);
+        if (!(smsgStored.status & SMSG_MASK_UNREAD ? Put(ssUnread, ssEmpty) : Delete(ssUnread)))
+            return false;
+
+        CDataStream ssAddr(SER_DISK, CLIENT_VERSION);
+        IndexKey(ssAddr, 'i', 'a', &smsgStored.addrTo, chKey);
+        return Put(ssAddr, ssEmpty);
     };
+
+    if (chKey[0] == 's' && chKey[1] == 'm')
+    {
+        CDataStream ssAddr(SER_DISK, CLIENT_VERSION);
+        IndexKey(ssAddr, 's', 'a', &smsgStored.addrTo, chKey);
+        return Put(ssAddr, ssEmpty);
+    };
+
+    return true;
+};
+
+bool SecMsgDB::EraseIndexes(const uint8_t *chKey)
+{
+    if (!((chKey[0] == 'i' || chKey[0] == 's') && chKey[1] == 'm'))
+        return true;
+
+    if (chKey[0] == 'i')
+    {
+        CDataStream ssUnread(SER_DISK, CLIENT_VERSION);
+        IndexKey(ssUnread, 'i', 'u', nullptr, chKey);
+        if (!Delete(ssUnread))
+            return false;
+    };
+
+    SecMsgStored smsgStored;
+    if (!ReadSmesg(chKey, smsgStored))
+        return true;
+
+    CDataStream ssAddr(SER_DISK, CLIENT_VERSION);
+    IndexKey(ssAddr, chKey[0], 'a', &smsgStored.addrTo, chKey);
+    return Delete(ssAddr);
 };
 
+
 // When performing a read, if we have an active batch we need to check it first
 // before reading from the database, as the rest of the code assumes that once
-// a database transaction begins reads are consistent with it. It would be good
-// to change that assumption in future and avoid the performance hit, though in
-// practice it does not appear to be large.
+// a database transaction begins reads are consistent with it.
 bool SecMsgDB::ScanBatch(const CDataStream &key, std::string *value, bool *deleted) const
 {
     if (!activeBatch)
         return false;
 
-    *deleted = false;
-    SecMsgBatchScanner scanner;
-    scanner.needle = key.str();
-    scanner.deleted = deleted;
-    scanner.foundValue = value;
-    leveldb::Status s = activeBatch->Iterate(&scanner);
-    if (!s.ok())
-        return error("SecMsgDB ScanBatch error: %s\n", s.ToString());
+    auto mi = mapBatch.find(key.str());
+    if (mi == mapBatch.end())
+        return false;
+
+    *deleted = mi->second.first;
+    if (!*deleted)
+        *value = mi->second.second;
 
-    return scanner.foundEntry;
+    return true;
 }
 
+bool SecMsgDB::Put(const CDataStream &key, const CDataStream &value)
+{
+    if (activeBatch)
+    {
+        activeBatch->Put(key.str(), value.str());
+        mapBatch[key.str()] = std::make_pair(false, value.str());
+        return true;
+    };
+
+    leveldb::WriteOptions writeOptions;
+    writeOptions.sync = true;
+    leveldb::Status s = pdb->Put(writeOptions, key.str(), value.str());
+    if (!s.ok())
+        return error("SecMsgDB write failure: %s\n", s.ToString());
+
+    return true;
+};
+
+bool SecMsgDB::Delete(const CDataStream &key)
+{
+    if (activeBatch)
+    {
+        activeBatch->Delete(key.str());
+        mapBatch[key.str()] = std::make_pair(true, std::string());
+        return true;
+    };
+
+    leveldb::WriteOptions writeOptions;
+    writeOptions.sync = true;
+    leveldb::Status s = pdb->Delete(writeOptions, key.str());
+
+    if (s.ok() || s.IsNotFound())
+        return true;
+    return error("SecMsgDB erase failed: %s\n", s.ToString());
+};
+
 bool SecMsgDB::TxnBegin()
 {
     if (activeBatch)
@@ -132,6 +281,7 @@ bool SecMsgDB::TxnCommit()
     leveldb::Status status = pdb->Write(writeOptions, activeBatch);
     delete activeBatch;
     activeBatch = nullptr;
+    mapBatch.clear();
 
     if (!status.ok())
         return error("SecMsgDB batch commit failure: %s\n", status.ToString());
@@ -143,6 +293,7 @@ bool SecMsgDB::TxnAbort()
 {
     delete activeBatch;
     activeBatch = nullptr;
+    mapBatch.clear();
     return true;
 };
 
@@ -204,19 +355,7 @@ bool SecMsgDB::WritePK(const CKeyID &addr, CPubKey &pubkey)
     ssValue.reserve(sizeof(pubkey));
     ssValue << pubkey;
 
-    if (activeBatch)
-    {
-        activeBatch->Put(ssKey.str(), ssValue.str());
-        return true;
-    };
-
-    leveldb::WriteOptions writeOptions;
-    writeOptions.sync = true;
-    leveldb::Status s = pdb->Put(writeOptions, ssKey.str(), ssValue.str());
-    if (!s.ok())
-        return error("SecMsgDB write failure: %s\n", s.ToString());
-
-    return true;
+    return Put(ssKey, ssValue);
 };
 
 bool SecMsgDB::ExistsPK(const CKeyID &addr)
@@ -300,19 +439,7 @@ bool SecMsgDB::WriteKey(const CKeyID &idk, const SecMsgKey &key)
     ssValue.reserve(sizeof(key));
     ssValue << key;
 
-    if (activeBatch)
-    {
-        activeBatch->Put(ssKey.str(), ssValue.str());
-        return true;
-    };
-
-    leveldb::WriteOptions writeOptions;
-    writeOptions.sync = true;
-    leveldb::Status s = pdb->Put(writeOptions, ssKey.str(), ssValue.str());
-    if (!s.ok())
-        return error("%s failed: %s\n", __func__, s.ToString());
-
-    return true;
+    return Put(ssKey, ssValue);
 };
 
 
@@ -415,19 +542,20 @@ bool SecMsgDB::WriteSmesg(const uint8_t *chKey, SecMsgStored &smsgStored)
     CDataStream ssValue(SER_DISK, CLIENT_VERSION);
     ssValue << smsgStored;
 
-    if (activeBatch)
+    // The message and its index entries are written together
+    bool fOwnTxn = !activeBatch;
+    if (fOwnTxn)
+        TxnBegin();
+
+    if (!Put(ssKey, ssValue)
+        || !WriteIndexes(chKey, smsgStored))
     {
-        activeBatch->Put(ssKey.str(), ssValue.str());
-        return true;
+        if (fOwnTxn)
+            TxnAbort();
+        return false;
     };
 
-    leveldb::WriteOptions writeOptions;
-    writeOptions.sync = true;
-    leveldb::Status s = pdb->Put(writeOptions, ssKey.str(), ssValue.str());
-    if (!s.ok())
-        return error("SecMsgDB write failed: %s\n", s.ToString());
-
-    return true;
+    return fOwnTxn ? TxnCommit() : true;
 };
 
 bool SecMsgDB::ExistsSmesg(const uint8_t *chKey)
@@ -456,19 +584,34 @@ bool SecMsgDB::EraseSmesg(const uint8_t *chKey)
     CDataStream ssKey(SER_DISK, CLIENT_VERSION);
     ssKey.write((const char*)chKey, 30);
 
-    if (activeBatch)
+    bool fOwnTxn = !activeBatch;
+    if (fOwnTxn)
+        TxnBegin();
+
+    if (!EraseIndexes(chKey)
+        || !Delete(ssKey))
     {
-        activeBatch->Delete(ssKey.str());
-        return true;
+        if (fOwnTxn)
+            TxnAbort();
+        return false;
     };
 
-    leveldb::WriteOptions writeOptions;
-    writeOptions.sync = true;
-    leveldb::Status s = pdb->Delete(writeOptions, ssKey.str());
+    return fOwnTxn ? TxnCommit() : true;
+};
 
-    if (s.ok() || s.IsNotFound())
-        return true;
-    return error("SecMsgDB erase failed: %s\n", s.ToString());
+bool SecMsgDB::NextIndexed(leveldb::Iterator *it, const std::string &prefix, uint8_t *chKey)
+{
+    if (!it->Valid()
+        || !it->key().starts_with(prefix)
+        || it->key().size() != prefix.size() + 28)
+        return false;
+
+    chKey[0] = prefix[0] == 's' ? 's' : 'i';
+    chKey[1] = 'm';
+    memcpy(chKey + 2, it->key().data() + prefix.size(), 28);
+    it->Next();
+
+    return true;
 };
 
 bool SecMsgDB::ReadPurged(const uint8_t *chKey, SecMsgPurged &smsgPurged)
@@ -522,19 +665,7 @@ bool SecMsgDB::WritePurged(const uint8_t *chKey, SecMsgPurged &smsgPurged)
     CDataStream ssValue(SER_DISK, CLIENT_VERSION);
     ssValue << smsgPurged;
 
-    if (activeBatch)
-    {
-        activeBatch->Put(ssKey.str(), ssValue.str());
-        return true;
-    };
-
-    leveldb::WriteOptions writeOptions;
-    writeOptions.sync = true;
-    leveldb::Status s = pdb->Put(writeOptions, ssKey.str(), ssValue.str());
-    if (!s.ok())
-        return error("SecMsgDB write failed: %s\n", s.ToString());
-
-    return true;
+    return Put(ssKey, ssValue);
 };
 
 bool SecMsgDB::ErasePurged(const uint8_t *chKey)
@@ -12,10 +12,19 @@
 #include <sync.h>
 #include <smsg/keystore.h>
 
+#include <map>
+#include <string>
+#include <utility>
+
 class CDataStream;
 
 namespace smsg {
 
+//! -smsgdbcache default (MiB)
+static const int64_t DEFAULT_SMSGDB_CACHE = 8;
+//! -smsgdbcache maximum (MiB)
+static const int64_t MAX_SMSGDB_CACHE = 1024;
+
 class SecMsgStored;
 
 class SecMsgPurged;
@@ -23,6 +32,9 @@ class SecMsgPurged;
 extern CCriticalSection cs_smsgDB;
 extern leveldb::DB *smsgDB;
 
+/** Close smsgDB and free its block cache and filter policy, cs_smsgDB must be held */
+void CloseSecMsgDB();
+
 class SecMsgDB
 {
 public:
@@ -60,6 +72,12 @@ public:
     bool ExistsSmesg(const uint8_t *chKey);
     bool EraseSmesg(const uint8_t *chKey);
 
+    /**
+     * Walk an index of inbox or outbox messages, prefix is iu, ia + address or sa + address.
+     * The caller positions it, sets chKey to the im or sm key of the entry and advances it.
+     */
+    bool NextIndexed(leveldb::Iterator *it, const std::string &prefix, uint8_t *chKey);
+
 
     bool ReadPurged(const uint8_t *chKey, SecMsgPurged &smsgPurged);
     bool WritePurged(const uint8_t *chKey, SecMsgPurged &smsgPurged);
@@ -70,6 +88,19 @@ public:
 
     leveldb::DB *pdb; // points to the global instance
     leveldb::WriteBatch *activeBatch;
+
+private:
+    //! Index a new db, or reindex a db written by an older version
+    bool BuildIndexes();
+    bool WriteIndexes(const uint8_t *chKey, const SecMsgStored &smsgStored);
+    bool EraseIndexes(const uint8_t *chKey);
+
+    //! Write to activeBatch if a transaction is open, else sync to pdb
+    bool Put(const CDataStream &key, const CDataStream &value);
+    bool Delete(const CDataStream &key);
+
+    //! The writes in activeBatch by key, the deleted flag and value, so reads don't iterate the batch
+    std::map<std::string, std::pair<bool, std::string> > mapBatch;
 };
 
 } // namespace smsg
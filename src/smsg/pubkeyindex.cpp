@@ -0,0 +1,32 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <smsg/pubkeyindex.h>
+
+#include <chain.h>
+#include <smsg/smessage.h>
+#include <util.h>
+
+namespace smsg {
+
+std::unique_ptr<SecMsgPubKeyIndex> g_pubkeyindex;
+
+SecMsgPubKeyIndex::SecMsgPubKeyIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<BaseIndex::DB>(GetDataDir() / "indexes" / "smsgpubkey", n_cache_size, f_memory, f_wipe))
+{}
+
+bool SecMsgPubKeyIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // Keys are written to smsgdb before the locator is advanced, rescanning a
+    // block after an unclean shutdown only finds duplicates.
+    return smsgModule.ScanBlock(block);
+}
+
+int SecMsgPubKeyIndex::GetBestHeight() const
+{
+    const CBlockIndex *pindex = m_best_block_index.load();
+    return pindex ? pindex->nHeight : -1;
+}
+
+} // namespace smsg
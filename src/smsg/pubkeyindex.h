@@ -0,0 +1,48 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_SMSG_PUBKEYINDEX_H
+#define BITCOINC_SMSG_PUBKEYINDEX_H
+
+#include <index/base.h>
+
+namespace smsg {
+
+static const size_t DEFAULT_SMSG_PUBKEY_INDEX_CACHE = 1 << 20; // the index db only holds the locator
+
+/**
+ * SecMsgPubKeyIndex harvests the public keys revealed by spending inputs into
+ * the smsg address database (smsgdb).
+ * Blocks are scanned in chain order as they connect, one smsgdb transaction
+ * per block, and the locator of the last scanned block is kept in
+ * indexes/smsgpubkey so a restart resumes where the scan stopped.
+ */
+class SecMsgPubKeyIndex final : public BaseIndex
+{
+private:
+    const std::unique_ptr<BaseIndex::DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override { return *m_db; }
+
+    const char* GetName() const override { return "smsgpubkeyindex"; }
+
+public:
+    explicit SecMsgPubKeyIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /// Height of the last block scanned, -1 if none.
+    int GetBestHeight() const;
+
+    /// True once the initial catch-up has reached the chain tip.
+    bool IsSynced() const { return m_synced; }
+};
+
+/// Runs while -smsgscanincoming is set and secure messaging is enabled. May be null.
+extern std::unique_ptr<SecMsgPubKeyIndex> g_pubkeyindex;
+
+} // namespace smsg
+
+#endif // BITCOINC_SMSG_PUBKEYINDEX_H
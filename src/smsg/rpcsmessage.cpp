@@ -10,6 +10,7 @@
 
 #include <smsg/smessage.h>
 #include <smsg/db.h>
+#include <smsg/pubkeyindex.h>
 #include <script/ismine.h>
 #include <utilstrencodings.h>
 #include <core_io.h>
@@ -136,7 +137,7 @@ static UniValue smsgoptions(const JSONRPCRequest &request)
         option.pushKV("name", "scanIncoming");
         option.pushKV("value", smsgModule.options.fScanIncoming);
         if (fDescriptions)
-            option.pushKV("description", "Scan incoming blocks for public keys, -smsgscanincoming must also be set");
+            option.pushKV("description", "Scan incoming blocks for public keys, -smsgscanincoming must also be set. Blocks connected while off are not scanned.");
         options.push_back(option);
 
         result.pushKV("options", options);
@@ -436,11 +437,25 @@ static UniValue smsgscanchain(const JSONRPCRequest &request)
     if (request.fHelp || request.params.size() != 0)
         throw std::runtime_error(
             "smsgscanchain\n"
-            "Look for public keys in the block chain.");
+            "Look for public keys in the block chain.\n"
+            "With -smsgscanincoming set this waits for the public key index to reach the chain tip instead of rescanning.");
 
     EnsureSMSGIsEnabled();
 
     UniValue result(UniValue::VOBJ);
+    if (smsg::g_pubkeyindex)
+    {
+        if (!smsg::g_pubkeyindex->BlockUntilSyncedToCurrentChain())
+        {
+            result.pushKV("result", "Index is catching up.");
+        } else
+        {
+            result.pushKV("result", "Scan Chain Completed.");
+        };
+        result.pushKV("height", smsg::g_pubkeyindex->GetBestHeight());
+        return result;
+    };
+
     if (!smsgModule.ScanBlockChain())
     {
         result.pushKV("result", "Scan Chain Failed.");
@@ -766,16 +781,155 @@ static UniValue smsgsendanon(const JSONRPCRequest &request)
     return result;
 }
 
+//! List options of smsginbox and smsgoutbox
+struct SmsgListOptions
+{
+    CKeyID addrTo;
+    bool fHaveAddress = false;
+    std::vector<uint8_t> vCursor;   // msgid to continue after
+    size_t nCount = 0;              // 0 for no limit
+    bool fHeadersOnly = false;
+};
+
+static void ParseListOptions(const UniValue &options, SmsgListOptions &opts)
+{
+    if (!options.isObject())
+        return;
+
+    RPCTypeCheckObj(options,
+        {
+            {"address",           UniValueType(UniValue::VSTR)},
+            {"cursor",            UniValueType(UniValue::VSTR)},
+            {"count",             UniValueType(UniValue::VNUM)},
+            {"headersonly",       UniValueType(UniValue::VBOOL)},
+        }, true, false);
+
+    if (options["address"].isStr())
+    {
+        CBitcoinAddress coinAddress(options["address"].get_str());
+        if (!coinAddress.IsValid() || !coinAddress.GetKeyID(opts.addrTo))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address.");
+        opts.fHaveAddress = true;
+    };
+    if (options["cursor"].isStr())
+    {
+        std::string sCursor = options["cursor"].get_str();
+        if (!IsHex(sCursor) || sCursor.size() != 56)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "cursor must be a 28 byte msgid in hex string.");
+        opts.vCursor = ParseHex(sCursor);
+    };
+    if (options["count"].isNum())
+    {
+        int nCount = options["count"].get_int();
+        if (nCount < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "count must be positive.");
+        opts.nCount = nCount;
+    };
+    if (options["headersonly"].isBool())
+        opts.fHeadersOnly = options["headersonly"].get_bool();
+};
+
+//! Position it at the first entry of index sIndex after the cursor
+static void SeekListIndex(leveldb::Iterator *it, const std::string &sIndex, const SmsgListOptions &opts)
+{
+    std::string sSeek = sIndex + std::string(opts.vCursor.begin(), opts.vCursor.end());
+    it->Seek(sSeek);
+    if (!opts.vCursor.empty() && it->Valid() && it->key().ToString() == sSeek)
+        it->Next();
+};
+
+static std::string ListIndexPrefix(char c0, char c1, const SmsgListOptions &opts)
+{
+    std::string sIndex{c0, c1};
+    if (opts.fHaveAddress)
+        sIndex.append((const char*)opts.addrTo.begin(), 20);
+    return sIndex;
+};
+
+/**
+ * Describe a stored inbox or outbox message in objM.
+ * Returns false if the message doesn't pass filter, rv is the result of the decryption.
+ */
+static bool StoredMessageToJSON(const uint8_t *chKey, const smsg::SecMsgStored &smsgStored, bool fInbox,
+    const SmsgListOptions &opts, const std::string &filter, UniValue &objM, int &rv)
+{
+    const uint8_t *pHeader = &smsgStored.vchMessage[0];
+    const smsg::SecureMessage *psmsg = (smsg::SecureMessage*) pHeader;
+    uint32_t nPayload = smsgStored.vchMessage.size() - smsg::SMSG_HDR_LEN;
+    std::string sAddrTo = CBitcoinAddress(smsgStored.addrTo).ToString();
+
+    objM.pushKV("msgid", HexStr(&chKey[2], &chKey[2] + 28)); // timestamp+hash
+    objM.pushKV("version", strprintf("%02x%02x", psmsg->version[0], psmsg->version[1]));
+
+    smsg::MessageData msg;
+    rv = -1;
+    if (!opts.fHeadersOnly)
+    {
+        rv = smsgModule.Decrypt(false, fInbox ? smsgStored.addrTo : smsgStored.addrOutbox, pHeader, pHeader + smsg::SMSG_HDR_LEN, nPayload, msg);
+        if (rv != 0)
+        {
+            if (filter.size() > 0)
+                return false;
+
+            objM.pushKV("status", "Decrypt failed");
+            objM.pushKV("error", smsg::GetString(rv));
+            return true;
+        };
+    };
+
+    std::string sText;
+    if (rv == 0)
+        sText = std::string((char*)msg.vchMessage.data());
+    if (filter.size() > 0
+        && !((rv == 0 && part::stringsMatchI(msg.sFromAddress, filter, 3)) ||
+            part::stringsMatchI(sAddrTo, filter, 3) ||
+            (rv == 0 && part::stringsMatchI(sText, filter, 3))))
+        return false;
+
+    if (fInbox)
+        PushTime(objM, "received", smsgStored.timeReceived);
+    PushTime(objM, "sent", rv == 0 ? msg.timestamp : psmsg->timestamp);
+    objM.pushKV("paid", UniValue(psmsg->IsPaidVersion()));
+
+    uint32_t nDaysRetention = psmsg->IsPaidVersion() ? psmsg->nonce[0] : 2;
+    int64_t ttl = smsg::SMSGGetSecondsInDay() * nDaysRetention;
+    objM.pushKV("daysretention", (int)nDaysRetention);
+    PushTime(objM, "expiration", psmsg->timestamp + ttl);
+
+    objM.pushKV("payloadsize", (int)nPayload);
+
+    if (rv == 0)
+        objM.pushKV("from", msg.sFromAddress);
+    objM.pushKV("to", sAddrTo);
+    if (fInbox)
+        objM.pushKV("read", UniValue(bool(!(smsgStored.status & SMSG_MASK_UNREAD))));
+    if (rv == 0)
+        objM.pushKV("text", sText);
+
+    return true;
+};
+
+static const std::string SMSG_LIST_OPTIONS_HELP =
+    "3. options       (json, optional) Options object:\n"
+    "   {\n"
+    "     \"address\": \"str\",       (string, optional) Only list messages sent to address, uses an index.\n"
+    "     \"cursor\": \"str\",        (string, optional) Continue after this msgid, the \"cursor\" of the previous result.\n"
+    "     \"count\": n,             (numeric, optional) Maximum number of messages to list, 0 for no limit.\n"
+    "     \"headersonly\": bool,    (boolean, optional, default=false) Don't decrypt the messages, \"from\" and \"text\" are omitted,\n"
+    "                             filter applies to the to field only and unread messages stay unread.\n"
+    "   }\n";
+
 static UniValue smsginbox(const JSONRPCRequest &request)
 {
-    if (request.fHelp || request.params.size() > 2)
+    if (request.fHelp || request.params.size() > 3)
         throw std::runtime_error(
-            "smsginbox ( \"mode\" \"filter\" )\n"
-            "Decrypt and display received messages.\n"
+            "smsginbox ( \"mode\" \"filter\" options )\n"
+            "Decrypt and display received messages, oldest first.\n"
             "Warning: clear will delete all messages.\n"
             "\nArguments:\n"
             "1. \"mode\"    (string, optional, default=\"unread\") \"all|unread|clear\" List all messages, unread messages or clear all messages.\n"
             "2. \"filter\"  (string, optional) Filter messages when in list mode. Applied to from, to and text fields.\n"
+            + SMSG_LIST_OPTIONS_HELP +
             "\nResult:\n"
             "{\n"
             "  \"msgid\": \"str\"                    (string) The message identifier\n"
@@ -785,15 +939,22 @@ static UniValue smsginbox(const JSONRPCRequest &request)
             "  \"daysretention\": int              (int) Number of days message will stay in the network for\n"
             "  \"from\": \"str\"                     (string) Address the message was sent from\n"
             "  \"to\": \"str\"                       (string) Address the message was sent to\n"
+            "  \"read\": bool                      (bool) Read status before this call\n"
             "  \"text\": \"str\"                     (string) Message text\n"
-            "}\n");
+            "}\n"
+            "\"cursor\": \"str\"                     (string) The last msgid listed, if count was reached\n"
+            "\nExamples:\n"
+            + HelpExampleCli("smsginbox", "\"unread\" \"\" \"{\\\"count\\\":10}\"")
+            + HelpExampleRpc("smsginbox", "\"all\", \"\", {\"headersonly\":true}"));
 
     EnsureSMSGIsEnabled();
 
-    RPCTypeCheck(request.params, {UniValue::VSTR, UniValue::VSTR}, true);
+    RPCTypeCheck(request.params, {UniValue::VSTR, UniValue::VSTR, UniValue::VOBJ}, true);
 
     std::string mode = request.params[0].isStr() ? request.params[0].get_str() : "unread";
     std::string filter = request.params[1].isStr() ? request.params[1].get_str() : "";
+    SmsgListOptions opts;
+    ParseListOptions(request.params[2], opts);
 
     UniValue result(UniValue::VOBJ);
 
@@ -828,61 +989,36 @@ static UniValue smsginbox(const JSONRPCRequest &request)
         {
             int fCheckReadStatus = mode == "unread" ? 1 : 0;
 
+            // Walk the unread index, the address index or all messages
+            std::string sIndex = opts.fHaveAddress ? ListIndexPrefix('i', 'a', opts)
+                : fCheckReadStatus ? std::string("iu") : sPrefix;
+
             smsg::SecMsgStored smsgStored;
-            smsg::MessageData msg;
 
             dbInbox.TxnBegin();
 
             leveldb::Iterator *it = dbInbox.pdb->NewIterator(leveldb::ReadOptions());
+            SeekListIndex(it, sIndex, opts);
             UniValue messageList(UniValue::VARR);
 
-            while (dbInbox.NextSmesg(it, sPrefix, chKey, smsgStored))
+            while (dbInbox.NextIndexed(it, sIndex, chKey))
             {
+                if (opts.nCount && nMessages >= opts.nCount)
+                {
+                    result.pushKV("cursor", messageList[messageList.size()-1]["msgid"].get_str());
+                    break;
+                };
+
+                if (!dbInbox.ReadSmesg(chKey, smsgStored))
+                    continue;
                 if (fCheckReadStatus
                     && !(smsgStored.status & SMSG_MASK_UNREAD))
                     continue;
-                uint8_t *pHeader = &smsgStored.vchMessage[0];
-                const smsg::SecureMessage *psmsg = (smsg::SecureMessage*) pHeader;
 
                 UniValue objM(UniValue::VOBJ);
-                objM.pushKV("msgid", HexStr(&chKey[2], &chKey[2] + 28)); // timestamp+hash
-                objM.pushKV("version", strprintf("%02x%02x", psmsg->version[0], psmsg->version[1]));
-
-                uint32_t nPayload = smsgStored.vchMessage.size() - smsg::SMSG_HDR_LEN;
-                int rv = smsgModule.Decrypt(false, smsgStored.addrTo, pHeader, pHeader + smsg::SMSG_HDR_LEN, nPayload, msg);
-                if (rv == 0)
-                {
-                    std::string sAddrTo = CBitcoinAddress(smsgStored.addrTo).ToString();
-                    std::string sText = std::string((char*)msg.vchMessage.data());
-                    if (filter.size() > 0
-                        && !(part::stringsMatchI(msg.sFromAddress, filter, 3) ||
-                            part::stringsMatchI(sAddrTo, filter, 3) ||
-                            part::stringsMatchI(sText, filter, 3)))
-                        continue;
-
-                    PushTime(objM, "received", smsgStored.timeReceived);
-                    PushTime(objM, "sent", msg.timestamp);
-                    objM.pushKV("paid", UniValue(psmsg->IsPaidVersion()));
-
-                    uint32_t nDaysRetention = psmsg->IsPaidVersion() ? psmsg->nonce[0] : 2;
-                    int64_t ttl = smsg::SMSGGetSecondsInDay() * nDaysRetention;
-                    objM.pushKV("daysretention", (int)nDaysRetention);
-                    PushTime(objM, "expiration", psmsg->timestamp + ttl);
-
-                    uint32_t nPayload = smsgStored.vchMessage.size() - smsg::SMSG_HDR_LEN;
-                    objM.pushKV("payloadsize", (int)nPayload);
-
-                    objM.pushKV("from", msg.sFromAddress);
-                    objM.pushKV("to", sAddrTo);
-                    objM.pushKV("text", sText);
-                } else
-                {
-                    if (filter.size() > 0)
-                        continue;
-
-                    objM.pushKV("status", "Decrypt failed");
-                    objM.pushKV("error", smsg::GetString(rv));
-                };
+                int rv;
+                if (!StoredMessageToJSON(chKey, smsgStored, true, opts, filter, objM, rv))
+                    continue;
 
                 messageList.push_back(objM);
 
@@ -911,14 +1047,15 @@ static UniValue smsginbox(const JSONRPCRequest &request)
 
 static UniValue smsgoutbox(const JSONRPCRequest &request)
 {
-    if (request.fHelp || request.params.size() > 2)
+    if (request.fHelp || request.params.size() > 3)
         throw std::runtime_error(
-            "smsgoutbox ( \"mode\" \"filter\" )\n"
-            "Decrypt and display all sent messages.\n"
+            "smsgoutbox ( \"mode\" \"filter\" options )\n"
+            "Decrypt and display all sent messages, oldest first.\n"
             "Warning: \"mode\"=\"clear\" will delete all sent messages.\n"
             "\nArguments:\n"
             "1. \"mode\"    (string, optional, default=\"all\") \"all|clear\" List or clear messages.\n"
             "2. \"filter\"  (string, optional) Filter messages when in list mode. Applied to from, to and text fields.\n"
+            + SMSG_LIST_OPTIONS_HELP +
             "\nResult:\n"
             "{\n"
             "  \"msgid\": \"str\"                    (string) The message identifier\n"
@@ -927,14 +1064,20 @@ static UniValue smsgoutbox(const JSONRPCRequest &request)
             "  \"from\": \"str\"                     (string) Address the message was sent from\n"
             "  \"to\": \"str\"                       (string) Address the message was sent to\n"
             "  \"text\": \"str\"                     (string) Message text\n"
-            "}\n");
+            "}\n"
+            "\"cursor\": \"str\"                     (string) The last msgid listed, if count was reached\n"
+            "\nExamples:\n"
+            + HelpExampleCli("smsgoutbox", "\"all\" \"\" \"{\\\"count\\\":10}\"")
+            + HelpExampleRpc("smsgoutbox", "\"all\", \"\", {\"headersonly\":true}"));
 
     EnsureSMSGIsEnabled();
 
-    RPCTypeCheck(request.params, {UniValue::VSTR, UniValue::VSTR}, true);
+    RPCTypeCheck(request.params, {UniValue::VSTR, UniValue::VSTR, UniValue::VOBJ}, true);
 
     std::string mode = request.params[0].isStr() ? request.params[0].get_str() : "all";
     std::string filter = request.params[1].isStr() ? request.params[1].get_str() : "";
+    SmsgListOptions opts;
+    ParseListOptions(request.params[2], opts);
 
 
     UniValue result(UniValue::VOBJ);
@@ -969,55 +1112,30 @@ static UniValue smsgoutbox(const JSONRPCRequest &request)
         } else
         if (mode == "all")
         {
+            std::string sIndex = opts.fHaveAddress ? ListIndexPrefix('s', 'a', opts) : sPrefix;
+
             smsg::SecMsgStored smsgStored;
-            smsg::MessageData msg;
             leveldb::Iterator *it = dbOutbox.pdb->NewIterator(leveldb::ReadOptions());
+            SeekListIndex(it, sIndex, opts);
 
             UniValue messageList(UniValue::VARR);
 
-            while (dbOutbox.NextSmesg(it, sPrefix, chKey, smsgStored))
+            while (dbOutbox.NextIndexed(it, sIndex, chKey))
             {
-                uint8_t *pHeader = &smsgStored.vchMessage[0];
-                const smsg::SecureMessage *psmsg = (smsg::SecureMessage*) pHeader;
-
-                UniValue objM(UniValue::VOBJ);
-                objM.pushKV("msgid", HexStr(&chKey[2], &chKey[2] + 28)); // timestamp+hash
-                objM.pushKV("version", strprintf("%02x%02x", psmsg->version[0], psmsg->version[1]));
-
-                uint32_t nPayload = smsgStored.vchMessage.size() - smsg::SMSG_HDR_LEN;
-                int rv = smsgModule.Decrypt(false, smsgStored.addrOutbox, pHeader, pHeader + smsg::SMSG_HDR_LEN, nPayload, msg);
-                if (rv == 0)
+                if (opts.nCount && nMessages >= opts.nCount)
                 {
-                    std::string sAddrTo = CBitcoinAddress(smsgStored.addrTo).ToString();
-                    std::string sText = std::string((char*)msg.vchMessage.data());
-                    if (filter.size() > 0
-                        && !(part::stringsMatchI(msg.sFromAddress, filter, 3) ||
-                            part::stringsMatchI(sAddrTo, filter, 3) ||
-                            part::stringsMatchI(sText, filter, 3)))
-                        continue;
-
-                    PushTime(objM, "sent", msg.timestamp);
-                    objM.pushKV("paid", UniValue(psmsg->IsPaidVersion()));
-
-                    uint32_t nDaysRetention = psmsg->IsPaidVersion() ? psmsg->nonce[0] : 2;
-                    int64_t ttl = smsg::SMSGGetSecondsInDay() * nDaysRetention;
-                    objM.pushKV("daysretention", (int)nDaysRetention);
-                    PushTime(objM, "expiration", psmsg->timestamp + ttl);
+                    result.pushKV("cursor", messageList[messageList.size()-1]["msgid"].get_str());
+                    break;
+                };
 
-                    uint32_t nPayload = smsgStored.vchMessage.size() - smsg::SMSG_HDR_LEN;
-                    objM.pushKV("payloadsize", (int)nPayload);
+                if (!dbOutbox.ReadSmesg(chKey, smsgStored))
+                    continue;
 
-                    objM.pushKV("from", msg.sFromAddress);
-                    objM.pushKV("to", sAddrTo);
-                    objM.pushKV("text", sText);
-                } else
-                {
-                    if (filter.size() > 0)
-                        continue;
+                UniValue objM(UniValue::VOBJ);
+                int rv;
+                if (!StoredMessageToJSON(chKey, smsgStored, false, opts, filter, objM, rv))
+                    continue;
 
-                    objM.pushKV("status", "Decrypt failed");
-                    objM.pushKV("error", smsg::GetString(rv));
-                };
                 messageList.push_back(objM);
                 nMessages++;
             };
@@ -1035,7 +1153,6 @@ static UniValue smsgoutbox(const JSONRPCRequest &request)
     return result;
 };
 
-
 static UniValue smsgbuckets(const JSONRPCRequest &request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -1061,13 +1178,14 @@ static UniValue smsgbuckets(const JSONRPCRequest &request)
         uint32_t nMessages = 0;
         uint64_t nBytes = 0;
         {
-            LOCK(smsgModule.cs_smsg);
+            boost::shared_lock<boost::shared_mutex> lock(smsgModule.cs_buckets);
             std::map<int64_t, smsg::SecMsgBucket>::iterator it;
             it = smsgModule.buckets.begin();
 
             for (it = smsgModule.buckets.begin(); it != smsgModule.buckets.end(); ++it)
             {
-                std::set<smsg::SecMsgToken> &tokenSet = it->second.setTokens;
+                LOCK(it->second.cs_bucket);
+                smsg::SecMsgTokenSet &tokenSet = it->second.setTokens;
 
                 std::string sBucket = std::to_string(it->first);
                 std::string sFile = sBucket + "_01.dat";
@@ -1109,11 +1227,14 @@ static UniValue smsgbuckets(const JSONRPCRequest &request)
 
                 arrBuckets.push_back(objM);
             };
-        }; // cs_smsg
+        }; // cs_buckets
 
         UniValue objM(UniValue::VOBJ);
         objM.pushKV("numbuckets", (int)nBuckets);
-        objM.pushKV("numpurged", (int)smsgModule.setPurged.size());
+        {
+            LOCK(smsgModule.cs_smsg);
+            objM.pushKV("numpurged", (int)smsgModule.setPurged.size());
+        }
         objM.pushKV("messages", (int)nMessages);
         objM.pushKV("size", part::BytesReadable(nBytes));
         result.pushKV("buckets", arrBuckets);
@@ -1123,17 +1244,19 @@ static UniValue smsgbuckets(const JSONRPCRequest &request)
     if (mode == "dump")
     {
         {
-            LOCK(smsgModule.cs_smsg);
+            boost::unique_lock<boost::shared_mutex> lock(smsgModule.cs_buckets);
             std::map<int64_t, smsg::SecMsgBucket>::iterator it;
             it = smsgModule.buckets.begin();
 
             for (it = smsgModule.buckets.begin(); it != smsgModule.buckets.end(); ++it)
             {
                 std::string sFile = std::to_string(it->first) + "_01.dat";
+                std::string sIndexFile = std::to_string(it->first) + "_01.idx";
 
                 try {
                     boost::filesystem::path fullPath = GetDataDir() / "smsgstore" / sFile;
                     boost::filesystem::remove(fullPath);
+                    boost::filesystem::remove(GetDataDir() / "smsgstore" / sIndexFile);
                 } catch (const boost::filesystem::filesystem_error& ex)
                 {
                     //objM.push_back(Pair("file size, error", ex.what()));
@@ -1141,7 +1264,7 @@ static UniValue smsgbuckets(const JSONRPCRequest &request)
                 };
             };
             smsgModule.buckets.clear();
-        }; // cs_smsg
+        }; // cs_buckets
 
         result.pushKV("result", "Removed all buckets.");
     } else
@@ -1654,8 +1777,8 @@ static const CRPCCommand commands[] =
     { "smsg",               "smsggetpubkey",          &smsggetpubkey,          {"address"} },
     { "smsg",               "smsgsend",               &smsgsend,               {"address_from","address_to","message","paid_msg","days_retention","testfee","fromfile","decodehex"} },
     { "smsg",               "smsgsendanon",           &smsgsendanon,           {"address_to","message"} },
-    { "smsg",               "smsginbox",              &smsginbox,              {"mode","filter"} },
-    { "smsg",               "smsgoutbox",             &smsgoutbox,             {"mode","filter"} },
+    { "smsg",               "smsginbox",              &smsginbox,              {"mode","filter","options"} },
+    { "smsg",               "smsgoutbox",             &smsgoutbox,             {"mode","filter","options"} },
     { "smsg",               "smsgbuckets",            &smsgbuckets,            {"mode"} },
     { "smsg",               "smsgview",               &smsgview,               {}},
     { "smsg",               "smsg",                   &smsgone,                {"msgid","options"}},
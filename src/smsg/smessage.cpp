@@ -18,6 +18,11 @@ Notes:
         Saved to smsg.ini
         Modify options using the smsglocalkeys rpc command or edit the smsg.ini file (with client closed)
 
+    Locking
+        cs_smsg guards the addresses, keystore and purged sets.
+        The buckets map is guarded by the shared cs_buckets, each bucket and its files by the bucket's cs_bucket.
+        Peers syncing different buckets only share cs_buckets, which is held exclusively just to add or erase buckets.
+
     TODO:
         For buckets older than current, only need to store no. messages and hash in memory
 
@@ -30,7 +35,14 @@ Notes:
 #include <map>
 #include <stdexcept>
 #include <errno.h>
+#include <algorithm>
+#include <iterator>
 #include <limits>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <compat/byteswap.h>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -56,6 +68,7 @@ Notes:
 #include <chain.h>
 #include <netmessagemaker.h>
 #include <fs.h>
+#include <perfstats.h>
 
 #ifdef ENABLE_WALLET
 #include <wallet/coincontrol.h>
@@ -67,8 +80,10 @@ Notes:
 
 #include <xxhash/xxhash.h>
 
+#include <smsg/compress.h>
 #include <smsg/crypter.h>
 #include <smsg/db.h>
+#include <smsg/pubkeyindex.h>
 
 extern void Misbehaving(NodeId nodeid, int howmuch, const std::string& message="");
 extern CChain &chainActive;
@@ -99,26 +114,79 @@ std::string SecMsgToken::ToString() const
     return strprintf("%d-%08x", timestamp, *((uint64_t*)sample));
 }
 
-void SecMsgBucket::hashBucket()
+SecMsgTokenSet::const_iterator SecMsgTokenSet::find(const SecMsgToken &token) const
+{
+    auto it = std::lower_bound(vTokens.begin(), vTokens.end(), token);
+    if (it != vTokens.end() && !(token < *it))
+        return it;
+    return vTokens.end();
+};
+
+std::pair<SecMsgTokenSet::const_iterator, bool> SecMsgTokenSet::insert(const SecMsgToken &token)
+{
+    auto it = std::lower_bound(vTokens.begin(), vTokens.end(), token);
+    if (it != vTokens.end() && !(token < *it))
+        return std::make_pair(SecMsgTokenSet::const_iterator(it), false);
+
+    nChanges++;
+    return std::make_pair(SecMsgTokenSet::const_iterator(vTokens.insert(it, token)), true);
+};
+
+void SecMsgTokenSet::insert(std::vector<SecMsgToken> &vInsert)
+{
+    if (vInsert.empty())
+        return;
+
+    // Stable, so the first of any duplicates is kept as std::set would
+    std::stable_sort(vInsert.begin(), vInsert.end());
+
+    std::vector<SecMsgToken> vMerged;
+    vMerged.reserve(vTokens.size() + vInsert.size());
+    std::merge(vTokens.begin(), vTokens.end(), vInsert.begin(), vInsert.end(), std::back_inserter(vMerged));
+    vMerged.erase(std::unique(vMerged.begin(), vMerged.end(),
+        [](const SecMsgToken &a, const SecMsgToken &b) { return !(a < b) && !(b < a); }), vMerged.end());
+
+    vTokens.swap(vMerged);
+    vInsert.clear();
+    nChanges++;
+};
+
+void SecMsgTokenSet::clear()
 {
-    void *state = XXH32_init(1);
+    vTokens.clear();
+    nChanges++;
+};
 
+void SecMsgBucket::hashBucket()
+{
     int64_t now = GetAdjustedTime();
 
-    nActive = 0;
-    nLeastTTL = 0;
-    for (auto it = setTokens.begin(); it != setTokens.end(); ++it)
+    if (nHashedChanges != setTokens.GetChanges()
+        || now > nNextExpiry)
     {
-        if (it->timestamp + it->ttl * SMSGGetSecondsInDay() < now)
-            continue;
+        XXH32_resetState(&hashState, 1);
 
-        XXH32_update(state, it->sample, 8);
-        if (it->ttl > 0 && (nLeastTTL == 0 || it->ttl < nLeastTTL))
-            nLeastTTL = it->ttl;
-        nActive++;
+        nActive = 0;
+        nLeastTTL = 0;
+        nNextExpiry = std::numeric_limits<int64_t>::max();
+        for (auto it = setTokens.begin(); it != setTokens.end(); ++it)
+        {
+            int64_t nExpiry = it->timestamp + it->ttl * SMSGGetSecondsInDay();
+            if (nExpiry < now)
+                continue;
+
+            XXH32_update(&hashState, it->sample, 8);
+            if (it->ttl > 0 && (nLeastTTL == 0 || it->ttl < nLeastTTL))
+                nLeastTTL = it->ttl;
+            nNextExpiry = std::min(nNextExpiry, nExpiry);
+            nActive++;
+        };
+        nHashedChanges = setTokens.GetChanges();
+
+        LogPrint(BCLog::SMSG, "Hashed %u messages\n", nActive);
     };
 
-    uint32_t hash_new = XXH32_digest(state);
+    uint32_t hash_new = XXH32_intermediateDigest(&hashState);
 
     if (hash != hash_new)
     {
@@ -128,10 +196,50 @@ void SecMsgBucket::hashBucket()
         timeChanged = GetAdjustedTime();
     };
 
-    LogPrint(BCLog::SMSG, "Hashed %u messages, hash %u\n", nActive, hash_new);
     return;
 };
 
+bool SecMsgBucket::AddToken(const SecMsgToken &token)
+{
+    bool fAppend = setTokens.empty() || setTokens.back() < token;
+    bool fHashed = nHashedChanges == setTokens.GetChanges();
+
+    if (!setTokens.insert(token).second)
+        return false;
+
+    if (!fAppend || !fHashed)
+        return true; // Rehashed in full by the next hashBucket()
+
+    // Sorts last, continue the running hash
+    int64_t nExpiry = token.timestamp + token.ttl * SMSGGetSecondsInDay();
+    if (nExpiry >= GetAdjustedTime())
+    {
+        XXH32_update(&hashState, token.sample, 8);
+        if (token.ttl > 0 && (nLeastTTL == 0 || token.ttl < nLeastTTL))
+            nLeastTTL = token.ttl;
+        nNextExpiry = std::min(nNextExpiry, nExpiry);
+        nActive++;
+    };
+    nHashedChanges = setTokens.GetChanges();
+
+    return true;
+};
+
+void SecMsgBucket::AddTokens(std::vector<SecMsgToken> &vTokens)
+{
+    setTokens.insert(vTokens);
+};
+
+bool SecMsgBucket::SetTokenTTL(SecMsgTokenSet::const_iterator it, uint8_t ttl)
+{
+    if (it == setTokens.end())
+        return false;
+
+    it->ttl = ttl;
+    setTokens.nChanges++;
+    return true;
+};
+
 size_t SecMsgBucket::CountActive()
 {
     size_t nMessages = 0;
@@ -147,12 +255,419 @@ size_t SecMsgBucket::CountActive()
     return nMessages;
 };
 
+int64_t SecMsgBucket::GetNextEvent(int64_t bucketTime) const
+{
+    // Past the retention cutoff, see IsBucketExpired
+    int64_t nEvent = bucketTime + SMSG_RETENTION + 1;
+
+    if (!setTokens.empty())
+    {
+        // A token expires no earlier than nLeastTTL days after the bucket time, a current hash knows the first expiry
+        int64_t nExpiry = nHashedChanges == setTokens.GetChanges() && nActive > 0
+            ? nNextExpiry : bucketTime + nLeastTTL * SMSGGetSecondsInDay();
+        nEvent = std::min(nEvent, nExpiry + 1);
+    };
+
+    if (nLockCount > 0)
+        nEvent = std::min(nEvent, nLockTimeout);
+
+    return nEvent;
+};
+
+SecMsgIBLT::SecMsgIBLT(uint32_t nCells)
+{
+    vCells.resize(nCells);
+};
+
+uint32_t SecMsgIBLT::GetCellsFor(size_t nDiff)
+{
+    // About 1.5 cells per difference decodes with 3 hash functions, more for small tables
+    uint64_t nCells = (uint64_t)nDiff + nDiff / 2 + SMSG_IBLT_HASH_FUNCS * 4;
+    nCells += (SMSG_IBLT_HASH_FUNCS - nCells % SMSG_IBLT_HASH_FUNCS) % SMSG_IBLT_HASH_FUNCS;
+    nCells = std::max(nCells, (uint64_t)SMSG_IBLT_MIN_CELLS);
+    return nCells > SMSG_IBLT_MAX_CELLS ? 0 : nCells;
+};
+
+bool SecMsgIBLT::IsValidSize(uint32_t nCells)
+{
+    return nCells >= SMSG_IBLT_MIN_CELLS
+        && nCells <= SMSG_IBLT_MAX_CELLS
+        && nCells % SMSG_IBLT_HASH_FUNCS == 0;
+};
+
+void SecMsgIBLT::Update(std::vector<Cell> &vUpdate, const uint8_t *key, int32_t nCount) const
+{
+    uint32_t nSub = vUpdate.size() / SMSG_IBLT_HASH_FUNCS;
+    uint32_t check = XXH32(key, 16, 0);
+    for (uint32_t i = 0; i < SMSG_IBLT_HASH_FUNCS; ++i)
+    {
+        Cell &cell = vUpdate[i * nSub + XXH32(key, 16, i + 1) % nSub];
+        cell.count += nCount;
+        for (size_t k = 0; k < 16; ++k)
+            cell.key[k] ^= key[k];
+        cell.check ^= check;
+    };
+};
+
+bool SecMsgIBLT::IsPure(const Cell &cell) const
+{
+    return (cell.count == 1 || cell.count == -1)
+        && cell.check == XXH32(cell.key, 16, 0);
+};
+
+void SecMsgIBLT::Insert(const SecMsgToken &token)
+{
+    if (vCells.size() < SMSG_IBLT_HASH_FUNCS)
+        return;
+
+    uint8_t key[16];
+    memcpy(key, &token.timestamp, 8);
+    memcpy(key+8, token.sample, 8);
+    Update(vCells, key, 1);
+};
+
+bool SecMsgIBLT::Subtract(const SecMsgIBLT &other)
+{
+    if (other.vCells.size() != vCells.size())
+        return false;
+
+    for (size_t i = 0; i < vCells.size(); ++i)
+    {
+        Cell &cell = vCells[i];
+        const Cell &cellOther = other.vCells[i];
+        cell.count -= cellOther.count;
+        for (size_t k = 0; k < 16; ++k)
+            cell.key[k] ^= cellOther.key[k];
+        cell.check ^= cellOther.check;
+    };
+    return true;
+};
+
+bool SecMsgIBLT::Decode(std::vector<SecMsgToken> &vHave, std::vector<SecMsgToken> &vLack) const
+{
+    if (vCells.size() < SMSG_IBLT_HASH_FUNCS)
+        return false;
+
+    std::vector<Cell> vPeel = vCells;
+    std::vector<uint32_t> vPure;
+    for (uint32_t i = 0; i < vPeel.size(); ++i)
+        if (IsPure(vPeel[i]))
+            vPure.push_back(i);
+
+    // Bound the work on a crafted table that never empties
+    size_t nMaxPeeled = vPeel.size() * 2, nPeeled = 0;
+    while (!vPure.empty())
+    {
+        uint32_t i = vPure.back();
+        vPure.pop_back();
+        if (!IsPure(vPeel[i]))
+            continue;
+        if (++nPeeled > nMaxPeeled)
+            return false;
+
+        Cell cell = vPeel[i];
+        SecMsgToken token;
+        memcpy(&token.timestamp, cell.key, 8);
+        memcpy(token.sample, cell.key+8, 8);
+        token.offset = 0;
+        token.ttl = 0;
+        (cell.count > 0 ? vHave : vLack).push_back(token);
+
+        Update(vPeel, cell.key, -cell.count);
+
+        uint32_t nSub = vPeel.size() / SMSG_IBLT_HASH_FUNCS;
+        for (uint32_t f = 0; f < SMSG_IBLT_HASH_FUNCS; ++f)
+        {
+            uint32_t k = f * nSub + XXH32(cell.key, 16, f + 1) % nSub;
+            if (IsPure(vPeel[k]))
+                vPure.push_back(k);
+        };
+    };
+
+    for (const auto &cell : vPeel)
+    {
+        if (cell.count != 0 || cell.check != 0)
+            return false;
+        for (size_t k = 0; k < 16; ++k)
+            if (cell.key[k] != 0)
+                return false;
+    };
+    return true;
+};
+
+void SecMsgIBLT::Serialize(std::vector<uint8_t> &vchData) const
+{
+    size_t nOfs = vchData.size();
+    vchData.resize(nOfs + vCells.size() * SMSG_IBLT_CELL_LEN);
+    uint8_t *p = &vchData[nOfs];
+    for (const auto &cell : vCells)
+    {
+        memcpy(p, &cell.count, 4);
+        memcpy(p+4, cell.key, 16);
+        memcpy(p+20, &cell.check, 4);
+        p += SMSG_IBLT_CELL_LEN;
+    };
+};
+
+bool SecMsgIBLT::Unserialize(const uint8_t *p, size_t nBytes)
+{
+    if (nBytes != vCells.size() * SMSG_IBLT_CELL_LEN)
+        return false;
+
+    for (auto &cell : vCells)
+    {
+        memcpy(&cell.count, p, 4);
+        memcpy(cell.key, p+4, 16);
+        memcpy(&cell.check, p+20, 4);
+        p += SMSG_IBLT_CELL_LEN;
+    };
+    return true;
+};
+
+static void InsertActiveTokens(SecMsgIBLT &iblt, const SecMsgBucket &bucket, int64_t now)
+{
+    for (const auto &token : bucket.setTokens)
+    {
+        if (token.timestamp + token.ttl * SMSGGetSecondsInDay() < now)
+            continue;
+        iblt.Insert(token);
+    };
+};
+
+static fs::path GetBucketIndexPath(int64_t bucketTime)
+{
+    return GetDataDir() / "smsgstore" / (std::to_string(bucketTime) + "_01.idx");
+};
+
+static void EncodeIndexRecord(const SecMsgToken &token, uint32_t nPayload, uint8_t *p)
+{
+    memcpy(p, &token.timestamp, 8);
+    memcpy(p+8, token.sample, 8);
+    memcpy(p+16, &token.offset, 8);
+    memcpy(p+24, &nPayload, 4);
+    p[28] = token.ttl;
+};
+
+static void DecodeIndexRecord(const uint8_t *p, SecMsgToken &token, uint32_t &nPayload)
+{
+    memcpy(&token.timestamp, p, 8);
+    memcpy(token.sample, p+8, 8);
+    memcpy(&token.offset, p+16, 8);
+    memcpy(&nPayload, p+24, 4);
+    token.ttl = p[28];
+};
+
+static bool AppendBucketIndex(int64_t bucketTime, const SecMsgToken &token, uint32_t nPayload)
+{
+    fs::path fullpath = GetBucketIndexPath(bucketTime);
+
+    // A new bucket file invalidates any stale index left behind
+    FILE *fp;
+    errno = 0;
+    if (!(fp = fopen(fullpath.string().c_str(), token.offset == 0 ? "wb" : "ab")))
+        return error("%s - Can't open file: %s.", __func__, strerror(errno));
+
+    uint8_t record[SMSG_IDX_RECORD_LEN];
+    EncodeIndexRecord(token, nPayload, record);
+    if (fwrite(record, 1, SMSG_IDX_RECORD_LEN, fp) != SMSG_IDX_RECORD_LEN)
+    {
+        fclose(fp);
+        return error("%s - fwrite failed: %s.", __func__, strerror(errno));
+    };
+
+    fclose(fp);
+    return true;
+};
+
+static bool AppendBucketIndex(int64_t bucketTime, bool fNewFile, const std::vector<uint8_t> &vData)
+{
+    fs::path fullpath = GetBucketIndexPath(bucketTime);
+
+    FILE *fp;
+    errno = 0;
+    if (!(fp = fopen(fullpath.string().c_str(), fNewFile ? "wb" : "ab")))
+        return error("%s - Can't open file: %s.", __func__, strerror(errno));
+
+    if (fwrite(vData.data(), 1, vData.size(), fp) != vData.size())
+    {
+        fclose(fp);
+        return error("%s - fwrite failed: %s.", __func__, strerror(errno));
+    };
+
+    fclose(fp);
+    return true;
+};
+
+static bool WriteBucketIndex(int64_t bucketTime, const std::vector<std::pair<SecMsgToken, uint32_t> > &vRecords)
+{
+    fs::path fullpath = GetBucketIndexPath(bucketTime);
+
+    FILE *fp;
+    errno = 0;
+    if (!(fp = fopen(fullpath.string().c_str(), "wb")))
+        return error("%s - Can't open file: %s.", __func__, strerror(errno));
+
+    std::vector<uint8_t> vData(vRecords.size() * SMSG_IDX_RECORD_LEN);
+    for (size_t i = 0; i < vRecords.size(); ++i)
+        EncodeIndexRecord(vRecords[i].first, vRecords[i].second, &vData[i * SMSG_IDX_RECORD_LEN]);
+
+    if (fwrite(vData.data(), 1, vData.size(), fp) != vData.size())
+    {
+        fclose(fp);
+        return error("%s - fwrite failed: %s.", __func__, strerror(errno));
+    };
+
+    fclose(fp);
+    return true;
+};
+
+/**
+ * Read the index of a bucket file.
+ * Fails if the index is missing or does not end where the bucket file ends.
+ */
+static bool ReadBucketIndex(int64_t bucketTime, const fs::path &pathDat, std::vector<std::pair<SecMsgToken, uint32_t> > &vRecords)
+{
+    vRecords.clear();
+
+    fs::path fullpath = GetBucketIndexPath(bucketTime);
+
+    FILE *fp;
+    if (!(fp = fopen(fullpath.string().c_str(), "rb")))
+        return false;
+
+    std::vector<uint8_t> vData;
+    uint8_t buf[SMSG_IDX_RECORD_LEN * 256];
+    size_t nRead;
+    while ((nRead = fread(buf, 1, sizeof(buf), fp)) > 0)
+        vData.insert(vData.end(), buf, buf + nRead);
+    bool fError = ferror(fp);
+    fclose(fp);
+
+    if (fError || vData.size() % SMSG_IDX_RECORD_LEN != 0)
+        return false;
+
+    int64_t nEnd = 0;
+    vRecords.resize(vData.size() / SMSG_IDX_RECORD_LEN);
+    for (size_t i = 0; i < vRecords.size(); ++i)
+    {
+        DecodeIndexRecord(&vData[i * SMSG_IDX_RECORD_LEN], vRecords[i].first, vRecords[i].second);
+        if (vRecords[i].first.offset != nEnd)
+            return false;
+        nEnd += SMSG_HDR_LEN + vRecords[i].second;
+    };
+
+    boost::system::error_code ec;
+    uintmax_t nFileSize = fs::file_size(pathDat, ec);
+    return !ec && (int64_t)nFileSize == nEnd;
+};
+
+/** Set the ttl of the record for the message at offset in a bucket index */
+static bool SetBucketIndexTTL(int64_t bucketTime, int64_t offset, uint8_t ttl)
+{
+    fs::path fullpath = GetBucketIndexPath(bucketTime);
+
+    FILE *fp;
+    if (!(fp = fopen(fullpath.string().c_str(), "rb+")))
+        return false;
+
+    // Offsets increase through the file, binary search for the record
+    uint8_t record[SMSG_IDX_RECORD_LEN];
+    long int nLow = 0, nHigh = -1;
+    if (fseek(fp, 0, SEEK_END) == 0)
+        nHigh = ftell(fp) / SMSG_IDX_RECORD_LEN - 1;
+
+    while (nLow <= nHigh)
+    {
+        long int nMid = nLow + (nHigh - nLow) / 2;
+        if (fseek(fp, nMid * SMSG_IDX_RECORD_LEN, SEEK_SET) != 0
+            || fread(record, 1, SMSG_IDX_RECORD_LEN, fp) != SMSG_IDX_RECORD_LEN)
+            break;
+
+        int64_t nOffset;
+        memcpy(&nOffset, record+16, 8);
+        if (nOffset < offset)
+        {
+            nLow = nMid + 1;
+        } else
+        if (nOffset > offset)
+        {
+            nHigh = nMid - 1;
+        } else
+        {
+            bool fOk = fseek(fp, nMid * SMSG_IDX_RECORD_LEN + 28, SEEK_SET) == 0
+                && fwrite(&ttl, 1, 1, fp) == 1;
+            fclose(fp);
+            return fOk;
+        };
+    };
+
+    fclose(fp);
+    return false;
+};
+
+static bool IsBucketExpired(int64_t bucketTime, SecMsgBucket &bucket, int64_t cutoffTime, int64_t now)
+{
+    AssertLockHeld(bucket.cs_bucket);
+    if (bucketTime < cutoffTime)
+        return true;
+    if (bucketTime + bucket.nLeastTTL * SMSGGetSecondsInDay() >= now)
+        return false;
+
+    bucket.hashBucket();
+
+    // TODO: periodically prune files
+    // An empty bucket was just added by Store or for a smsgWant, keep it until the retention cutoff
+    return bucket.nActive < 1 && !bucket.setTokens.empty();
+};
+
+static void RemoveBucketFiles(int64_t bucketTime)
+{
+    LogPrint(BCLog::SMSG, "Removing bucket %d \n", bucketTime);
+
+    std::string fileName = std::to_string(bucketTime);
+
+    fs::path fullPath = GetDataDir() / "smsgstore" / (fileName + "_01.dat");
+    if (fs::exists(fullPath))
+    {
+        try { fs::remove(fullPath);
+        } catch (const fs::filesystem_error &ex)
+        {
+            LogPrintf("Error removing bucket file %s.\n", ex.what());
+        };
+    } else
+    {
+        LogPrintf("Path %s does not exist \n", fullPath.string());
+    };
+
+    fullPath = GetBucketIndexPath(bucketTime);
+    if (fs::exists(fullPath))
+    {
+        try { fs::remove(fullPath);
+        } catch (const fs::filesystem_error &ex)
+        {
+            LogPrintf("Error removing bucket index file %s.\n", ex.what());
+        };
+    };
+
+    // Look for a wl file, it stores incoming messages when wallet is locked
+    fullPath = GetDataDir() / "smsgstore" / (fileName + "_01_wl.dat");
+    if (fs::exists(fullPath))
+    {
+        try { fs::remove(fullPath);
+        } catch (const fs::filesystem_error &ex)
+        {
+            LogPrintf("Error removing wallet locked file %s.\n", ex.what());
+        };
+    };
+};
+
 void ThreadSecureMsg()
 {
-    // Bucket management thread
+    // Bucket management thread, only buckets with a due event in setBucketEvents are visited
 
     uint32_t nLoop = 0;
     std::vector<std::pair<int64_t, NodeId> > vTimedOutLocks;
+    std::vector<int64_t> vDue;
     while (fSecMsgEnabled)
     {
         nLoop++;
@@ -162,72 +677,88 @@ void ThreadSecureMsg()
             LogPrintf("SecureMsgThread %d \n", now);
 
         vTimedOutLocks.resize(0);
-        int64_t cutoffTime = now - SMSG_RETENTION;
+        vDue.resize(0);
         {
-            LOCK(smsgModule.cs_smsg);
-            for (std::map<int64_t, SecMsgBucket>::iterator it(smsgModule.buckets.begin()); it != smsgModule.buckets.end(); )
+            LOCK(smsgModule.cs_bucket_events);
+            auto &setEvents = smsgModule.setBucketEvents;
+            while (!setEvents.empty() && setEvents.begin()->first <= now)
             {
-                bool fErase = it->first < cutoffTime;
+                vDue.push_back(setEvents.begin()->second);
+                setEvents.erase(setEvents.begin());
+            };
+        } // cs_bucket_events
+        std::sort(vDue.begin(), vDue.end());
+        vDue.erase(std::unique(vDue.begin(), vDue.end()), vDue.end());
 
-                if (!fErase
-                    && it->first + it->second.nLeastTTL * SMSGGetSecondsInDay() < now)
+        int64_t cutoffTime = now - SMSG_RETENTION;
+        std::vector<int64_t> vExpired;
+        if (!vDue.empty())
+        {
+            boost::shared_lock<boost::shared_mutex> lock(smsgModule.cs_buckets);
+            for (auto bucketTime : vDue)
+            {
+                auto itb = smsgModule.buckets.find(bucketTime);
+                if (itb == smsgModule.buckets.end())
+                    continue;
+                SecMsgBucket &bucket = itb->second;
+                LOCK(bucket.cs_bucket);
+                bucket.nEventTime = 0; // Events of a bucket are only ever queued earlier, this was the first
+                if (IsBucketExpired(bucketTime, bucket, cutoffTime, now))
                 {
-                    it->second.hashBucket();
-
-                    // TODO: periodically prune files
-                    if (it->second.nActive < 1)
-                        fErase = true;
+                    vExpired.push_back(bucketTime);
+                    continue;
                 };
 
-                if (fErase)
+                if (bucket.nLockCount > 0 // Expire the lock if peer never sends data
+                    && bucket.nLockTimeout <= now)
                 {
-                    LogPrint(BCLog::SMSG, "Removing bucket %d \n", it->first);
+                    vTimedOutLocks.push_back(std::make_pair(bucketTime, bucket.nLockPeerId)); // g_connman->cs_vNodes
 
-                    std::string fileName = std::to_string(it->first);
-
-                    fs::path fullPath = GetDataDir() / "smsgstore" / (fileName + "_01.dat");
-                    if (fs::exists(fullPath))
-                    {
-                        try { fs::remove(fullPath);
-                        } catch (const fs::filesystem_error &ex)
-                        {
-                            LogPrintf("Error removing bucket file %s.\n", ex.what());
-                        };
-                    } else
-                    {
-                        LogPrintf("Path %s does not exist \n", fullPath.string());
-                    };
+                    bucket.nLockCount = 0;
+                    bucket.nLockPeerId = 0;
+                };
 
-                    // Look for a wl file, it stores incoming messages when wallet is locked
-                    fullPath = GetDataDir() / "smsgstore" / (fileName + "_01_wl.dat");
-                    if (fs::exists(fullPath))
-                    {
-                        try { fs::remove(fullPath);
-                        } catch (const fs::filesystem_error &ex)
-                        {
-                            LogPrintf("Error removing wallet locked file %s.\n", ex.what());
-                        };
-                    };
+                smsgModule.ScheduleBucket(bucketTime, bucket);
+            };
+        } // cs_buckets
 
-                    smsgModule.buckets.erase(it++);
-                } else
+        if (!vExpired.empty())
+        {
+            std::vector<int64_t> vRemoved;
+            {
+                boost::unique_lock<boost::shared_mutex> lock(smsgModule.cs_buckets);
+                for (auto bucketTime : vExpired)
                 {
-                    if (it->second.nLockCount > 0) // Tick down nLockCount, to eventually expire if peer never sends data
+                    auto it = smsgModule.buckets.find(bucketTime);
+                    if (it == smsgModule.buckets.end())
+                        continue;
                     {
-                        it->second.nLockCount--;
-
-                        if (it->second.nLockCount == 0) // lock timed out
+                        LOCK(it->second.cs_bucket);
+                        if (!IsBucketExpired(bucketTime, it->second, cutoffTime, now)) // Message added since
                         {
-                            vTimedOutLocks.push_back(std::make_pair(it->first, it->second.nLockPeerId)); // g_connman->cs_vNodes
-
-                            it->second.nLockPeerId = 0;
+                            smsgModule.ScheduleBucket(bucketTime, it->second);
+                            continue;
                         };
-                    };
-
-                    ++it;
+                    }
+                    smsgModule.buckets.erase(it);
+                    smsgModule.setBucketsRemoving.insert(bucketTime);
+                    vRemoved.push_back(bucketTime);
                 };
-            };
+            } // cs_buckets
+
+            // Store refuses buckets in setBucketsRemoving, the files can be deleted without holding a lock
+            for (auto bucketTime : vRemoved)
+                RemoveBucketFiles(bucketTime);
 
+            {
+                boost::unique_lock<boost::shared_mutex> lock(smsgModule.cs_buckets);
+                for (auto bucketTime : vRemoved)
+                    smsgModule.setBucketsRemoving.erase(bucketTime);
+            } // cs_buckets
+        };
+
+        {
+            LOCK(smsgModule.cs_smsg);
             if (smsgModule.nLastProcessedPurged + SMSGGetSecondsInDay() < now)
             {
                 smsgModule.BuildPurgedSets();
@@ -276,16 +807,214 @@ void ThreadSecureMsg()
     return;
 };
 
-void ThreadSecureMsgPow()
+enum SecMsgPowResult
 {
-    // Proof of work thread
+    SMSG_POW_KEEP,  // leave in the outbox, try again later
+    SMSG_POW_ERASE, // drop from the outbox
+    SMSG_POW_STORE, // move from the outbox to the message store
+};
 
-    int rv;
-    std::vector<uint8_t> vchKey;
+struct SecMsgPowItem
+{
+    uint8_t chKey[30];
     SecMsgStored smsgStored;
+    SecMsgPowResult result = SMSG_POW_KEEP;
+};
+
+/**
+ * Outbox messages in flight between the reading, proof of work and storing
+ * stages of ThreadSecureMsgPow.
+ */
+class SecMsgPowQueue
+{
+public:
+    explicit SecMsgPowQueue(size_t nWorkersIn) : nWorkers(nWorkersIn)
+    {
+        for (size_t i = 0; i < nWorkers; ++i)
+            vThreads.emplace_back(&SecMsgPowQueue::Worker, this);
+    };
+
+    ~SecMsgPowQueue()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            fStop = true;
+        }
+        condWork.notify_all();
+        for (auto &t : vThreads)
+            t.join();
+    };
+
+    //! Messages queued or in progress
+    size_t Pending()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return dqTodo.size() + nBusy;
+    };
+
+    void Push(SecMsgPowItem &&item)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            dqTodo.push_back(std::move(item));
+        }
+        condWork.notify_one();
+    };
+
+    //! Wait for the next processed message, false once nothing is pending
+    bool WaitDone(SecMsgPowItem &item)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        condDone.wait(lock, [this] { return !dqDone.empty() || (dqTodo.empty() && nBusy == 0); });
+        if (dqDone.empty())
+            return false;
+        item = std::move(dqDone.front());
+        dqDone.pop_front();
+        return true;
+    };
+
+    size_t GetWorkers() const { return nWorkers; };
+
+private:
+    void Worker()
+    {
+        for (;;)
+        {
+            SecMsgPowItem item;
+            size_t nThreads;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                condWork.wait(lock, [this] { return fStop || !dqTodo.empty(); });
+                if (fStop)
+                    return;
+                item = std::move(dqTodo.front());
+                dqTodo.pop_front();
+                nBusy++;
+                // A message alone in the queue gets the whole pool
+                nThreads = std::max(nWorkers / nBusy, (size_t)1);
+            }
+
+            item.result = fSecMsgEnabled ? ProcessOutboxMessage(item.smsgStored, nThreads) : SMSG_POW_KEEP;
+
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                dqDone.push_back(std::move(item));
+                nBusy--;
+            }
+            condDone.notify_all();
+        };
+    };
+
+    static SecMsgPowResult ProcessOutboxMessage(SecMsgStored &smsgStored, size_t nThreads);
+
+    const size_t nWorkers;
+    std::vector<std::thread> vThreads;
+
+    std::mutex mtx;
+    std::condition_variable condWork;
+    std::condition_variable condDone;
+    std::deque<SecMsgPowItem> dqTodo;
+    std::deque<SecMsgPowItem> dqDone;
+    size_t nBusy = 0;
+    bool fStop = false;
+};
+
+SecMsgPowResult SecMsgPowQueue::ProcessOutboxMessage(SecMsgStored &smsgStored, size_t nThreads)
+{
+    uint8_t *pHeader = &smsgStored.vchMessage[0];
+    uint8_t *pPayload = &smsgStored.vchMessage[SMSG_HDR_LEN];
+    SecureMessage *psmsg = (SecureMessage*) pHeader;
+
+    const int64_t FUND_TXN_TIMEOUT = 3600 * 48;
+    int64_t now = GetTime();
+
+    if (psmsg->version[0] == 3)
+    {
+        uint256 txid;
+        uint160 msgId;
+        if (0 != smsgModule.HashMsg(*psmsg, pPayload, psmsg->nPayload-32, msgId)
+            || !GetFundingTxid(pPayload, psmsg->nPayload, txid))
+        {
+            LogPrintf("%s: Get msgID or Txn Hash failed.\n", __func__);
+            return SMSG_POW_ERASE;
+        };
+
+        bool fCoinStake;
+        int blockDepth = -1;
+        {
+            LOCK(cs_main);
+            if (!smsgModule.GetFundingTxnDepth(txid, blockDepth, fCoinStake))
+                blockDepth = -1;
+        }
+
+        if (blockDepth > 0)
+        {
+            LogPrintf("Found txn %s at depth %d\n", txid.ToString(), blockDepth);
+            return SMSG_POW_STORE;
+        };
+
+        // Failure
+        if (psmsg->timestamp > now + FUND_TXN_TIMEOUT)
+        {
+            LogPrintf("%s: Funding txn timeout, dropping message %s\n", __func__, msgId.ToString());
+            return SMSG_POW_ERASE;
+        };
+        return SMSG_POW_KEEP;
+    };
+
+    // Do proof of work
+    int rv = smsgModule.SetHash(pHeader, pPayload, psmsg->nPayload, nThreads);
+    if (rv == SMSG_SHUTDOWN_DETECTED)
+        return SMSG_POW_KEEP; // leave message in db, if terminated due to shutdown
+    if (rv != 0)
+    {
+        LogPrintf("SecMsgPow: Could not get proof of work hash, message removed.\n");
+        return SMSG_POW_ERASE;
+    };
+    return SMSG_POW_STORE;
+};
+
+static void StoreOutboxMessage(SecMsgDB &dbOutbox, SecMsgPowItem &item)
+{
+    if (item.result == SMSG_POW_KEEP)
+        return;
+
+    // Remove message from queue
+    {
+        LOCK(cs_smsgDB);
+        dbOutbox.EraseSmesg(item.chKey);
+    }
+
+    if (item.result != SMSG_POW_STORE)
+        return;
+
+    uint8_t *pHeader = &item.smsgStored.vchMessage[0];
+    uint8_t *pPayload = &item.smsgStored.vchMessage[SMSG_HDR_LEN];
+    SecureMessage *psmsg = (SecureMessage*) pHeader;
+
+    // Add to message store
+    if (smsgModule.Store(pHeader, pPayload, psmsg->nPayload, true) != 0)
+    {
+        LogPrintf("SecMsgPow: Could not place message in buckets, message removed.\n");
+        return;
+    };
+
+    // Test if message was sent to self
+    if (smsgModule.ScanMessage(pHeader, pPayload, psmsg->nPayload, true) != 0)
+    {
+        // Message recipient is not this node (or failed)
+    };
+};
+
+void ThreadSecureMsgPow()
+{
+    // Proof of work thread
+    // Reads the outbox, hands messages to a pool of workers for the funding
+    // check or proof of work, then stores them in the order they finish.
 
     std::string sPrefix("qm");
-    uint8_t chKey[30];
+
+    SecMsgPowQueue queue(std::max(smsgModule.nPowThreads, (size_t)1));
 
     while (fSecMsgEnabled)
     {
@@ -303,111 +1032,25 @@ void ThreadSecureMsgPow()
         }
         // Break up lock, SecureMsgSetHash will take long
 
+        bool fMore = true;
         for (;;)
         {
-            if (!fSecMsgEnabled)
-                break;
-            {
-                LOCK(cs_smsgDB);
-                if (!dbOutbox.NextSmesg(it, sPrefix, chKey, smsgStored))
-                    break;
-            }
-
-            uint8_t *pHeader = &smsgStored.vchMessage[0];
-            uint8_t *pPayload = &smsgStored.vchMessage[SMSG_HDR_LEN];
-            SecureMessage *psmsg = (SecureMessage*) pHeader;
-
-            const int64_t FUND_TXN_TIMEOUT = 3600 * 48;
-            int64_t now = GetTime();
-
-            if (psmsg->version[0] == 3)
+            // Keep every worker busy, with a message waiting behind it
+            while (fMore && fSecMsgEnabled && queue.Pending() < queue.GetWorkers() * 2)
             {
-                uint256 txid;
-                uint160 msgId;
-                if (0 != smsgModule.HashMsg(*psmsg, pPayload, psmsg->nPayload-32, msgId)
-                    || !GetFundingTxid(pPayload, psmsg->nPayload, txid))
+                SecMsgPowItem item;
                 {
-                    LogPrintf("%s: Get msgID or Txn Hash failed.\n", __func__);
                     LOCK(cs_smsgDB);
-                    dbOutbox.EraseSmesg(chKey);
-                    continue;
-                };
-
-
-                CTransactionRef txOut;
-                uint256 hashBlock;
-                {
-                    LOCK(cs_main);
-                    if (!GetTransaction(txid, txOut, Params().GetConsensus(), hashBlock))
-                    {
-                        // drop through
-                    }
+                    fMore = dbOutbox.NextSmesg(it, sPrefix, item.chKey, item.smsgStored);
                 }
-
-                int blockDepth = -1;
-                if (!hashBlock.IsNull())
-                {
-                    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-                    if (mi != mapBlockIndex.end())
-                    {
-                        CBlockIndex *pindex = mi->second;
-                        if (pindex && chainActive.Contains(pindex))
-                            blockDepth = chainActive.Height() - pindex->nHeight + 1;
-                    };
-                };
-
-                if (blockDepth > 0)
-                {
-
-                    LogPrintf("Found txn %s at depth %d\n", txid.ToString(), blockDepth);
-                } else
-                {
-                    // Failure
-                    if (psmsg->timestamp > now + FUND_TXN_TIMEOUT)
-                    {
-                        LogPrintf("%s: Funding txn timeout, dropping message %s\n", __func__, msgId.ToString());
-                        LOCK(cs_smsgDB);
-                        dbOutbox.EraseSmesg(chKey);
-                    }
-                    continue;
-                }
-            } else
-            {
-                // Do proof of work
-                rv = smsgModule.SetHash(pHeader, pPayload, psmsg->nPayload);
-                if (rv == SMSG_SHUTDOWN_DETECTED)
-                    break; // leave message in db, if terminated due to shutdown
-                if (rv != 0)
-                {
-                    LogPrintf("SecMsgPow: Could not get proof of work hash, message removed.\n");
-                    LOCK(cs_smsgDB);
-                    dbOutbox.EraseSmesg(chKey);
-                    continue;
-                };
+                if (fMore)
+                    queue.Push(std::move(item));
             };
 
-
-            // Remove message from queue
-            {
-                LOCK(cs_smsgDB);
-                dbOutbox.EraseSmesg(chKey);
-            }
-
-            // Add to message store
-            {
-                LOCK(smsgModule.cs_smsg);
-                if (smsgModule.Store(pHeader, pPayload, psmsg->nPayload, true) != 0)
-                {
-                    LogPrintf("SecMsgPow: Could not place message in buckets, message removed.\n");
-                    continue;
-                };
-            }
-
-            // Test if message was sent to self
-            if (smsgModule.ScanMessage(pHeader, pPayload, psmsg->nPayload, true) != 0)
-            {
-                // Message recipient is not this node (or failed)
-            };
+            SecMsgPowItem item;
+            if (!queue.WaitDone(item))
+                break;
+            StoreOutboxMessage(dbOutbox, item);
         };
 
         delete it;
@@ -421,10 +1064,14 @@ void ThreadSecureMsgPow()
 void AddOptions()
 {
     gArgs.AddArg("-smsg", _("Enable secure messaging. (default: true)"), false, OptionsCategory::SMSG);
-    gArgs.AddArg("-smsgscanchain", _("Scan the block chain for public key addresses on startup. (default: false)"), false, OptionsCategory::SMSG);
-    gArgs.AddArg("-smsgscanincoming", _("Scan incoming blocks for public key addresses. (default: false)"), false, OptionsCategory::SMSG);
+    gArgs.AddArg("-smsgscanchain", _("Scan the block chain for public key addresses on startup, not needed with -smsgscanincoming. (default: false)"), false, OptionsCategory::SMSG);
+    gArgs.AddArg("-smsgscanincoming", _("Maintain an index of public key addresses, catching up from the last scanned block and following incoming blocks. (default: false)"), false, OptionsCategory::SMSG);
     gArgs.AddArg("-smsgnotify=<cmd>", _("Execute command when a message is received. (%s in cmd is replaced by receiving address)"), false, OptionsCategory::SMSG);
     gArgs.AddArg("-smsgsaddnewkeys", _("Scan for incoming messages on new wallet keys. (default: false)"), false, OptionsCategory::SMSG);
+    gArgs.AddArg("-smsgpowthreads=<n>", strprintf(_("Number of threads to process outgoing messages and search for their proof of work, 0 for one per core. (default: %d)"), DEFAULT_SMSG_POW_THREADS), false, OptionsCategory::SMSG);
+    gArgs.AddArg("-smsgscanthreads=<n>", strprintf(_("Number of threads to trial decrypt incoming messages with, 0 for one per core. (default: %d)"), DEFAULT_SMSG_SCAN_THREADS), false, OptionsCategory::SMSG);
+    gArgs.AddArg("-smsgdbcache=<n>", strprintf(_("Set the secure message database cache size in megabytes (%d to %d, default: %d)"), 1, MAX_SMSGDB_CACHE, DEFAULT_SMSGDB_CACHE), false, OptionsCategory::SMSG);
+    gArgs.AddArg("-smsgcompressdict", strprintf(_("Compress sent messages against a built-in dictionary of common JSON tokens, shrinks small structured messages. Nodes without dictionary support can't read them. (default: %u)"), DEFAULT_SMSG_COMPRESS_DICT), false, OptionsCategory::SMSG);
 
     return;
 };
@@ -478,7 +1125,8 @@ static void NotifyUnload(CSMSG *ps)
 int CSMSG::BuildBucketSet()
 {
     /*
-        Build the bucket set by scanning the files in the smsgstore dir.
+        Build the bucket set from the files in the smsgstore dir.
+        Bucket files are only scanned if their index is missing or stale.
         buckets should be empty
     */
 
@@ -486,6 +1134,7 @@ int CSMSG::BuildBucketSet()
 
     int64_t  now            = GetAdjustedTime();
     uint32_t nFiles         = 0;
+    uint32_t nScanned       = 0;
     uint32_t nMessages      = 0;
 
     fs::path pathSmsgDir = GetDataDir() / "smsgstore";
@@ -505,6 +1154,22 @@ int CSMSG::BuildBucketSet()
 
         std::string fileType = itd->path().extension().string();
 
+        if (fileType.compare(".idx") == 0)
+        {
+            // Drop indices left behind by removed bucket files
+            fs::path pathDat = itd->path();
+            pathDat.replace_extension(".dat");
+            if (!fs::exists(pathDat))
+            {
+                try { fs::remove(itd->path());
+                } catch (const fs::filesystem_error &ex)
+                {
+                    LogPrintf("Error removing index file %s, %s.\n", itd->path().string(), ex.what());
+                };
+            };
+            continue;
+        };
+
         if (fileType.compare(".dat") != 0)
             continue;
 
@@ -532,6 +1197,7 @@ int CSMSG::BuildBucketSet()
             LogPrintf("Dropping file %s, expired.\n", fileName);
             try {
                 fs::remove(itd->path());
+                fs::remove(GetBucketIndexPath(fileTime));
             } catch (const fs::filesystem_error &ex) {
                 LogPrintf("Error removing bucket file %s, %s.\n", fileName, ex.what());
             };
@@ -547,74 +1213,109 @@ int CSMSG::BuildBucketSet()
         size_t nTokenSetSize = 0;
         SecureMessage smsg;
         {
-            LOCK(cs_smsg);
+            boost::unique_lock<boost::shared_mutex> lock(cs_buckets);
 
             SecMsgBucket &bucket = buckets[fileTime];
-            std::set<SecMsgToken> &tokenSet = bucket.setTokens;
-
-            FILE *fp;
-            if (!(fp = fopen(itd->path().string().c_str(), "rb")))
-            {
-                LogPrintf("Error opening file: %s\n", strerror(errno));
-                continue;
-            };
+            LOCK(bucket.cs_bucket);
+            std::vector<SecMsgToken> vTokens;
 
-            for (;;)
+            std::vector<std::pair<SecMsgToken, uint32_t> > vRecords;
+            if (ReadBucketIndex(fileTime, itd->path(), vRecords))
             {
-                long int ofs = ftell(fp);
-                SecMsgToken token;
-                token.offset = ofs;
-                errno = 0;
-                if (fread(smsg.data(), sizeof(uint8_t), SMSG_HDR_LEN, fp) != (size_t)SMSG_HDR_LEN)
+                for (const auto &record : vRecords)
                 {
-                    if (errno != 0)
-                    {
-                        LogPrintf("fread header failed: %s\n", strerror(errno));
-                    } else
+                    const SecMsgToken &token = record.first;
+                    if (token.ttl > 0 && (bucket.nLeastTTL == 0 || token.ttl < bucket.nLeastTTL))
+                        bucket.nLeastTTL = token.ttl;
+                    if (record.second < 8)
+                        continue;
+                    vTokens.push_back(token);
+                };
+            } else
+            {
+                nScanned++;
+                vRecords.clear();
+
+                FILE *fp;
+                if (!(fp = fopen(itd->path().string().c_str(), "rb")))
+                {
+                    LogPrintf("Error opening file: %s\n", strerror(errno));
+                    continue;
+                };
+
+                bool fComplete = false;
+                for (;;)
+                {
+                    long int ofs = ftell(fp);
+                    SecMsgToken token;
+                    token.offset = ofs;
+                    errno = 0;
+                    if (fread(smsg.data(), sizeof(uint8_t), SMSG_HDR_LEN, fp) != (size_t)SMSG_HDR_LEN)
                     {
-                        //LogPrintf("End of file.\n");
+                        if (errno != 0)
+                        {
+                            LogPrintf("fread header failed: %s\n", strerror(errno));
+                        } else
+                        {
+                            //LogPrintf("End of file.\n");
+                            fComplete = feof(fp) && ftell(fp) == ofs;
+                        };
+                        break;
                     };
-                    break;
-                };
-                token.timestamp = smsg.timestamp;
+                    token.timestamp = smsg.timestamp;
 
-                uint32_t nDaysToLive = smsg.version[0] == 0 && smsg.version[1] == 0 ? 0  // Purged message header
-                    : smsg.version[0] < 3 ? 2 : smsg.nonce[0];
+                    uint32_t nDaysToLive = smsg.version[0] == 0 && smsg.version[1] == 0 ? 0  // Purged message header
+                        : smsg.version[0] < 3 ? 2 : smsg.nonce[0];
 
-                token.ttl = nDaysToLive;
-                if (nDaysToLive > 0 && (bucket.nLeastTTL == 0 || nDaysToLive < bucket.nLeastTTL))
-                    bucket.nLeastTTL = nDaysToLive;
+                    token.ttl = nDaysToLive;
+                    if (nDaysToLive > 0 && (bucket.nLeastTTL == 0 || nDaysToLive < bucket.nLeastTTL))
+                        bucket.nLeastTTL = nDaysToLive;
 
-                if (smsg.nPayload < 8)
-                    continue;
+                    memset(token.sample, 0, 8);
+                    if (smsg.nPayload >= 8
+                        && fread(token.sample, sizeof(uint8_t), 8, fp) != 8)
+                    {
+                        LogPrintf("fread failed: %s\n", strerror(errno));
+                        break;
+                    };
 
-                if (fread(token.sample, sizeof(uint8_t), 8, fp) != 8)
-                {
-                    LogPrintf("fread failed: %s\n", strerror(errno));
-                    break;
-                };
+                    if (fseek(fp, smsg.nPayload - std::min(smsg.nPayload, (uint32_t)8), SEEK_CUR) != 0)
+                    {
+                        LogPrintf("fseek failed: %s.\n", strerror(errno));
+                        break;
+                    };
 
-                if (fseek(fp, smsg.nPayload-8, SEEK_CUR) != 0)
-                {
-                    LogPrintf("fseek failed: %s.\n", strerror(errno));
-                    break;
+                    vRecords.emplace_back(token, smsg.nPayload);
+                    if (smsg.nPayload < 8)
+                        continue;
+
+                    vTokens.push_back(token);
                 };
 
-                tokenSet.insert(token);
-            };
+                fclose(fp);
 
-            fclose(fp);
+                // Only index a file that could be read to the end
+                if (fComplete && !WriteBucketIndex(fileTime, vRecords))
+                    LogPrintf("Error writing index for bucket %d.\n", fileTime);
+            };
 
-            buckets[fileTime].hashBucket();
+            bucket.AddTokens(vTokens);
+            bucket.hashBucket();
+            ScheduleBucket(fileTime, bucket);
 
-            nTokenSetSize = tokenSet.size();
-        } // cs_smsg
+            nTokenSetSize = bucket.setTokens.size();
+        } // cs_buckets
 
         nMessages += nTokenSetSize;
         LogPrint(BCLog::SMSG, "Bucket %d contains %u messages.\n", fileTime, nTokenSetSize);
     };
 
-    LogPrintf("Processed %u files, loaded %u buckets containing %u messages.\n", nFiles, buckets.size(), nMessages);
+    size_t nBuckets;
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_buckets);
+        nBuckets = buckets.size();
+    }
+    LogPrintf("Processed %u files (%u scanned), loaded %u buckets containing %u messages.\n", nFiles, nScanned, nBuckets, nMessages);
     return SMSG_NO_ERROR;
 };
 
@@ -625,6 +1326,7 @@ int CSMSG::BuildPurgedSets()
 
     setPurged.clear();
     setPurgedTimestamps.clear();
+    mapPurgedIds.clear();
 
     SecMsgDB db;
     if (!db.Open("cr+"))
@@ -645,6 +1347,7 @@ int CSMSG::BuildPurgedSets()
         };
         setPurged.insert(purged);
         setPurgedTimestamps.insert(purged.timestamp);
+        mapPurgedIds[uint160(std::vector<uint8_t>(chKey + 10, chKey + 30))] = purged.timepurged;
         nPurged++;
     };
     delete it;
@@ -899,6 +1602,12 @@ bool CSMSG::Start(std::shared_ptr<CWallet> pwalletIn, bool fDontStart, bool fSca
     m_handler_unload = interfaces::MakeHandler(pwallet->NotifyUnload.connect(boost::bind(&NotifyUnload, this)));
 #endif
 
+    int nThreads = gArgs.GetArg("-smsgpowthreads", DEFAULT_SMSG_POW_THREADS);
+    nPowThreads = nThreads > 0 ? nThreads : std::max(GetNumCores(), 1);
+    nThreads = gArgs.GetArg("-smsgscanthreads", DEFAULT_SMSG_SCAN_THREADS);
+    nScanThreads = nThreads > 0 ? nThreads : std::max(GetNumCores(), 1);
+    fCompressDict = gArgs.GetBoolArg("-smsgcompressdict", DEFAULT_SMSG_COMPRESS_DICT);
+
     fSecMsgEnabled = true;
     g_connman->SetLocalServices(ServiceFlags(g_connman->GetLocalServices() | NODE_SMSG));
 
@@ -934,6 +1643,11 @@ bool CSMSG::Start(std::shared_ptr<CWallet> pwalletIn, bool fDontStart, bool fSca
         assert(ret);
     }
 
+    if (gArgs.GetBoolArg("-smsgscanincoming", false))
+    {
+        g_pubkeyindex = MakeUnique<SecMsgPubKeyIndex>(DEFAULT_SMSG_PUBKEY_INDEX_CACHE);
+        g_pubkeyindex->Start();
+    } else
     if (fScanChain)
     {
         ScanBlockChain();
@@ -973,11 +1687,17 @@ bool CSMSG::Shutdown()
     threadGroupSmsg.interrupt_all();
     threadGroupSmsg.join_all();
 
+    if (g_pubkeyindex)
+    {
+        g_pubkeyindex->Interrupt();
+        g_pubkeyindex->Stop();
+        g_pubkeyindex.reset();
+    };
+
     if (smsgDB)
     {
         LOCK(cs_smsgDB);
-        delete smsgDB;
-        smsgDB = nullptr;
+        CloseSecMsgDB();
     };
 
     keyStore.Clear();
@@ -1006,7 +1726,10 @@ bool CSMSG::Enable(std::shared_ptr<CWallet> pwallet)
         LOCK(cs_smsg);
 
         addresses.clear(); // should be empty already
-        buckets.clear(); // should be empty already
+        {
+            boost::unique_lock<boost::shared_mutex> lock(cs_buckets);
+            buckets.clear(); // should be empty already
+        }
 
         if (!Start(pwallet, false, false))
             return error("%s: SecureMsgStart failed.\n", __func__);
@@ -1043,11 +1766,14 @@ bool CSMSG::Disable()
             return error("%s: SecureMsgShutdown failed.\n", __func__);
 
         // Clear buckets
-        std::map<int64_t, SecMsgBucket>::iterator it;
-        it = buckets.begin();
-        for (it = buckets.begin(); it != buckets.end(); ++it)
-            it->second.setTokens.clear();
-        buckets.clear();
+        {
+            boost::unique_lock<boost::shared_mutex> lock(cs_buckets);
+            buckets.clear();
+        }
+        {
+            LOCK(cs_bucket_events);
+            setBucketEvents.clear();
+        }
         addresses.clear();
     } // cs_smsg
 
@@ -1101,6 +1827,12 @@ int CSMSG::ReceiveData(CNode *pfrom, const std::string &strCommand, CDataStream
             (1) A list of all the message hashes which a node has in response to smsgShow.
         + smsgWant =
             (1) A list of the message hashes that a node does not have and wants to retrieve from the node which sent smsgHave
+        + smsgReconReq =
+            (1) Sent instead of smsgShow to peers from SMSG_RECON_PROTO_VERSION, a list of buckets and table sizes.
+            (2) respond with smsgRecon - an IBLT of the tokens in each requested bucket.
+        + smsgRecon =
+            (1) Subtract this node's IBLT of the bucket, the decoded difference is sifted as smsgHave.
+            (2) If the difference did not decode, ask again with a larger table or fall back to smsgShow.
         + smsgMsg =
             (1) In response to
         + smsgPing = ping request
@@ -1152,7 +1884,11 @@ int CSMSG::ReceiveData(CNode *pfrom, const std::string &strCommand, CDataStream
             };
         }
 
-        uint32_t nBuckets = buckets.size();
+        uint32_t nBuckets;
+        {
+            boost::shared_lock<boost::shared_mutex> lock(cs_buckets);
+            nBuckets = buckets.size();
+        }
         uint32_t nLocked = 0;           // no. of locked buckets on this node
         uint32_t nInvBuckets;           // no. of bucket headers sent by peer in smsgInv
         memcpy(&nInvBuckets, &vchData[0], 4);
@@ -1179,6 +1915,11 @@ int CSMSG::ReceiveData(CNode *pfrom, const std::string &strCommand, CDataStream
         vchDataOut.resize(4);
         uint32_t nShowBuckets = 0;
 
+        bool fRecon = pfrom->nVersion >= SMSG_RECON_PROTO_VERSION;
+        std::vector<uint8_t> vchReconOut;
+        vchReconOut.resize(4);
+        uint32_t nReconBuckets = 0;
+
         uint8_t *p = &vchData[4];
         for (uint32_t i = 0; i < nInvBuckets; ++i)
         {
@@ -1212,43 +1953,80 @@ int CSMSG::ReceiveData(CNode *pfrom, const std::string &strCommand, CDataStream
                 continue;
             };
 
+            size_t nHave = 0;
+            uint32_t nHash = 0;
+            {
+                boost::shared_lock<boost::shared_mutex> lock(cs_buckets);
+                auto itb = buckets.find(time);
+                if (itb != buckets.end())
+                {
+                    SecMsgBucket &bucket = itb->second;
+                    LOCK(bucket.cs_bucket);
+                    if (bucket.nLockCount > 0)
+                    {
+                        LogPrint(BCLog::SMSG, "Bucket is locked %u, waiting for peer %u to send data.\n", bucket.nLockCount, bucket.nLockPeerId);
+                        nLocked++;
+                        continue;
+                    };
+                    nHave = bucket.setTokens.size();
+                    nHash = bucket.hash;
+                };
+            } // cs_buckets
+
             if (LogAcceptCategory(BCLog::SMSG))
             {
                 LogPrintf("Peer bucket %d %u %u.\n", time, ncontent, hash);
-                LogPrintf("This bucket %d %u %u.\n", time, buckets[time].setTokens.size(), buckets[time].hash);
+                LogPrintf("This bucket %d %u %u.\n", time, nHave, nHash);
             };
+
+            // If this node has more than the peer node, peer node will pull from this
+            //  if then peer node has more this node will pull fom peer
+            if (nHave < ncontent
+                || (nHave == ncontent
+                    && nHash != hash)) // if same amount in buckets check hash
             {
-                LOCK(cs_smsg);
-                if (buckets[time].nLockCount > 0)
+                uint32_t nCells = 0;
+                if (fRecon)
                 {
-                    LogPrint(BCLog::SMSG, "Bucket is locked %u, waiting for peer %u to send data.\n", buckets[time].nLockCount, buckets[time].nLockPeerId);
-                    nLocked++;
-                    continue;
+                    nCells = SecMsgIBLT::GetCellsFor(ncontent - nHave + SMSG_RECON_SLACK);
+                    if ((uint64_t)nCells * SMSG_IBLT_CELL_LEN >= (uint64_t)ncontent * 16) // Token list is smaller
+                        nCells = 0;
                 };
 
-                // If this node has more than the peer node, peer node will pull from this
-                //  if then peer node has more this node will pull fom peer
-                if (buckets[time].setTokens.size() < ncontent
-                    || (buckets[time].setTokens.size() == ncontent
-                        && buckets[time].hash != hash)) // if same amount in buckets check hash
+                if (nCells > 0)
                 {
-                    LogPrint(BCLog::SMSG, "Requesting contents of bucket %d.\n", time);
+                    LogPrint(BCLog::SMSG, "Reconciling bucket %d with %u cells.\n", time, nCells);
 
-                    uint32_t sz = vchDataOut.size();
-                    vchDataOut.resize(sz + 8);
-                    memcpy(&vchDataOut[sz], &time, 8);
+                    uint32_t sz = vchReconOut.size();
+                    vchReconOut.resize(sz + 12);
+                    memcpy(&vchReconOut[sz], &time, 8);
+                    memcpy(&vchReconOut[sz+8], &nCells, 4);
 
-                    nShowBuckets++;
+                    nReconBuckets++;
+                    continue;
                 };
-            } // cs_smsg
+
+                LogPrint(BCLog::SMSG, "Requesting contents of bucket %d.\n", time);
+
+                uint32_t sz = vchDataOut.size();
+                vchDataOut.resize(sz + 8);
+                memcpy(&vchDataOut[sz], &time, 8);
+
+                nShowBuckets++;
+            };
         };
 
         // TODO: should include hash?
         memcpy(&vchDataOut[0], &nShowBuckets, 4);
-        if (vchDataOut.size() > 4)
+        memcpy(&vchReconOut[0], &nReconBuckets, 4);
+        if (nShowBuckets > 0 || nReconBuckets > 0)
         {
-            g_connman->PushMessage(pfrom,
-                CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgShow", vchDataOut));
+            if (nShowBuckets > 0)
+                g_connman->PushMessage(pfrom,
+                    CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgShow", vchDataOut));
+            if (nReconBuckets > 0)
+                g_connman->PushMessage(pfrom,
+                    CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgReconReq", vchReconOut));
         } else
         if (nLocked < 1) // Don't report buckets as matched if any are locked
         {
@@ -1282,7 +2060,7 @@ int CSMSG::ReceiveData(CNode *pfrom, const std::string &strCommand, CDataStream
         LogPrint(BCLog::SMSG, "smsgShow: peer wants to see content of %u buckets.\n", nBuckets);
 
         std::map<int64_t, SecMsgBucket>::iterator itb;
-        std::set<SecMsgToken>::iterator it;
+        SecMsgTokenSet::const_iterator it;
 
         std::vector<uint8_t> vchDataOut;
         int64_t time;
@@ -1292,7 +2070,7 @@ int CSMSG::ReceiveData(CNode *pfrom, const std::string &strCommand, CDataStream
             memcpy(&time, pIn, 8);
 
             {
-                LOCK(cs_smsg);
+                boost::shared_lock<boost::shared_mutex> lock(cs_buckets);
                 itb = buckets.find(time);
                 if (itb == buckets.end())
                 {
@@ -1300,7 +2078,8 @@ int CSMSG::ReceiveData(CNode *pfrom, const std::string &strCommand, CDataStream
                     continue;
                 };
 
-                std::set<SecMsgToken> &tokenSet = itb->second.setTokens;
+                LOCK(itb->second.cs_bucket);
+                SecMsgTokenSet &tokenSet = itb->second.setTokens;
 
                 try { vchDataOut.resize(8 + 16 * tokenSet.size());
                 } catch (std::exception &e) {
@@ -1363,73 +2142,15 @@ int CSMSG::ReceiveData(CNode *pfrom, const std::string &strCommand, CDataStream
             return SMSG_GENERAL_ERROR;
         };
 
-        std::vector<uint8_t> vchDataOut;
-
-        {
-            LOCK(cs_smsg);
-            if (buckets[time].nLockCount > 0)
-            {
-                LogPrint(BCLog::SMSG, "Bucket %d lock count %u, waiting for message data from peer %u.\n", time, buckets[time].nLockCount, buckets[time].nLockPeerId);
-                return SMSG_GENERAL_ERROR;
-            };
-
-            LogPrint(BCLog::SMSG, "Sifting through bucket %d.\n", time);
-
-            vchDataOut.resize(8);
-            memcpy(&vchDataOut[0], &vchData[0], 8);
-
-            std::set<SecMsgToken> &tokenSet = buckets[time].setTokens;
-            std::set<SecMsgToken>::iterator it;
-            SecMsgToken token;
-            SecMsgPurged purgedToken;
-            uint8_t *p = &vchData[8];
-
-            for (int i = 0; i < n; ++i, p += 16)
-            {
-                memcpy(&token.timestamp, p, 8);
-                memcpy(&token.sample, p+8, 8);
-
-                if (setPurgedTimestamps.find(token.timestamp) != setPurgedTimestamps.end())
-                {
-                    memcpy(&purgedToken.timestamp, p, 8);
-                    memcpy(&purgedToken.sample, p+8, 8);
-                    if (setPurged.find(purgedToken) != setPurged.end())
-                    {
-                        continue;
-                    };
-                };
-
-                it = tokenSet.find(token);
-                if (it == tokenSet.end())
-                {
-                    int nd = vchDataOut.size();
-                    try {
-                        vchDataOut.resize(nd + 16);
-                    } catch (std::exception &e) {
-                        LogPrintf("vchDataOut.resize %d threw: %s.\n", nd + 16, e.what());
-                        continue;
-                    };
-
-                    memcpy(&vchDataOut[nd], p, 16);
-                };
-            };
-        } // cs_smsg
-
-        if (vchDataOut.size() > 8)
+        std::vector<SecMsgToken> vOffered(n);
+        uint8_t *p = &vchData[8];
+        for (int i = 0; i < n; ++i, p += 16)
         {
-            if (LogAcceptCategory(BCLog::SMSG))
-            {
-                LogPrintf("Asking peer for %u messages.\n", (vchDataOut.size() - 8) / 16);
-                LogPrintf("Locking bucket %u for peer %d.\n", time, pfrom->GetId());
-            };
-            {
-                LOCK(cs_smsg);
-                buckets[time].nLockCount   = 3; // lock this bucket for at most 3 * SMSG_THREAD_DELAY seconds, unset when peer sends smsgMsg
-                buckets[time].nLockPeerId  = pfrom->GetId();
-            }
-            g_connman->PushMessage(pfrom,
-                CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgWant", vchDataOut));
+            memcpy(&vOffered[i].timestamp, p, 8);
+            memcpy(&vOffered[i].sample, p+8, 8);
         };
+
+        return RequestTokens(pfrom, time, vOffered);
     } else
     if (strCommand == "smsgWant")
     {
@@ -1450,7 +2171,7 @@ int CSMSG::ReceiveData(CNode *pfrom, const std::string &strCommand, CDataStream
         memcpy(&time, &vchData[0], 8);
 
         {
-            LOCK(cs_smsg);
+            boost::shared_lock<boost::shared_mutex> lock(cs_buckets);
             auto itb = buckets.find(time);
             if (itb == buckets.end())
             {
@@ -1458,8 +2179,9 @@ int CSMSG::ReceiveData(CNode *pfrom, const std::string &strCommand, CDataStream
                 return SMSG_GENERAL_ERROR;
             };
 
-            std::set<SecMsgToken> &tokenSet = itb->second.setTokens;
-            std::set<SecMsgToken>::iterator it;
+            LOCK(itb->second.cs_bucket);
+            SecMsgTokenSet &tokenSet = itb->second.setTokens;
+            SecMsgTokenSet::const_iterator it;
             SecMsgToken token;
             uint8_t *p = &vchData[8];
             for (int i = 0; i < n; ++i)
@@ -1495,7 +2217,7 @@ int CSMSG::ReceiveData(CNode *pfrom, const std::string &strCommand, CDataStream
                 };
                 p += 16;
             };
-        } // cs_smsg
+        } // cs_buckets
 
         if (nBunch > 0)
         {
@@ -1507,14 +2229,168 @@ int CSMSG::ReceiveData(CNode *pfrom, const std::string &strCommand, CDataStream
                 CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgMsg", vchBunch));
         };
     } else
-    if (strCommand == "smsgMsg")
+    if (strCommand == "smsgReconReq")
+    {
+        std::vector<uint8_t> vchData;
+        vRecv >> vchData;
+
+        if (vchData.size() < 4)
+            return SMSG_GENERAL_ERROR;
+
+        uint32_t nBuckets;
+        memcpy(&nBuckets, &vchData[0], 4);
+
+        if (nBuckets > (SMSG_RETENTION / SMSG_BUCKET_LEN) + 1
+            || vchData.size() < 4 + nBuckets * 12)
+        {
+            Misbehaving(pfrom->GetId(), 1);
+            return SMSG_GENERAL_ERROR;
+        };
+
+        LogPrint(BCLog::SMSG, "smsgReconReq: peer wants to reconcile %u buckets.\n", nBuckets);
+
+        uint8_t *pIn = &vchData[4];
+        for (uint32_t i = 0; i < nBuckets; ++i, pIn += 12)
+        {
+            int64_t time;
+            uint32_t nCells;
+            memcpy(&time, pIn, 8);
+            memcpy(&nCells, pIn+8, 4);
+
+            if (!SecMsgIBLT::IsValidSize(nCells))
+            {
+                LogPrint(BCLog::SMSG, "Invalid table size %u for bucket %d.\n", nCells, time);
+                Misbehaving(pfrom->GetId(), 1);
+                continue;
+            };
+
+            SecMsgIBLT iblt(nCells);
+            {
+                boost::shared_lock<boost::shared_mutex> lock(cs_buckets);
+                auto itb = buckets.find(time);
+                if (itb == buckets.end())
+                {
+                    LogPrint(BCLog::SMSG, "Don't have bucket %d.\n", time);
+                    continue;
+                };
+                LOCK(itb->second.cs_bucket);
+                InsertActiveTokens(iblt, itb->second, GetAdjustedTime());
+            }
+
+            std::vector<uint8_t> vchDataOut(12);
+            memcpy(&vchDataOut[0], &time, 8);
+            memcpy(&vchDataOut[8], &nCells, 4);
+            iblt.Serialize(vchDataOut);
+
+            g_connman->PushMessage(pfrom,
+                CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgRecon", vchDataOut));
+        };
+    } else
+    if (strCommand == "smsgRecon")
     {
         std::vector<uint8_t> vchData;
         vRecv >> vchData;
 
-        LogPrint(BCLog::SMSG, "smsgMsg vchData.size() %u.\n", vchData.size());
+        if (vchData.size() < 12)
+        {
+            Misbehaving(pfrom->GetId(), 1);
+            return SMSG_GENERAL_ERROR;
+        };
+
+        int64_t time;
+        uint32_t nCells;
+        memcpy(&time, &vchData[0], 8);
+        memcpy(&nCells, &vchData[8], 4);
+
+        // Check time valid:
+        int64_t now = GetAdjustedTime();
+        if (time < now - SMSG_RETENTION)
+        {
+            LogPrint(BCLog::SMSG, "Not interested in peer bucket %d, has expired.\n", time);
+            return SMSG_GENERAL_ERROR;
+        };
+        if (time > now + SMSG_TIME_LEEWAY)
+        {
+            LogPrint(BCLog::SMSG, "Not interested in peer bucket %d, in the future.\n", time);
+            Misbehaving(pfrom->GetId(), 1);
+            return SMSG_GENERAL_ERROR;
+        };
+
+        if (!SecMsgIBLT::IsValidSize(nCells))
+        {
+            Misbehaving(pfrom->GetId(), 1);
+            return SMSG_GENERAL_ERROR;
+        };
+        SecMsgIBLT iblt(nCells);
+        if (!iblt.Unserialize(&vchData[12], vchData.size() - 12))
+        {
+            LogPrintf("smsgRecon, bad table size %u.\n", vchData.size());
+            Misbehaving(pfrom->GetId(), 1);
+            return SMSG_GENERAL_ERROR;
+        };
+
+        std::vector<SecMsgToken> vHave, vLack;
+        SecMsgIBLT ibltOwn(nCells);
+        {
+            boost::shared_lock<boost::shared_mutex> lock(cs_buckets);
+            auto itb = buckets.find(time);
+            if (itb != buckets.end())
+            {
+                SecMsgBucket &bucket = itb->second;
+                LOCK(bucket.cs_bucket);
+                if (bucket.nLockCount > 0)
+                {
+                    LogPrint(BCLog::SMSG, "Bucket %d lock count %u, waiting for message data from peer %u.\n", time, bucket.nLockCount, bucket.nLockPeerId);
+                    return SMSG_GENERAL_ERROR;
+                };
+
+                InsertActiveTokens(ibltOwn, bucket, now);
+            };
+        } // cs_buckets
+        iblt.Subtract(ibltOwn);
+
+        if (!iblt.Decode(vHave, vLack))
+        {
+            // Too many differences for the table, try a larger one once before listing all tokens
+            std::vector<uint8_t> vchDataOut(4 + 8);
+            uint32_t nBuckets = 1;
+            memcpy(&vchDataOut[0], &nBuckets, 4);
+            memcpy(&vchDataOut[4], &time, 8);
+            if (nCells < SMSG_IBLT_MAX_CELLS)
+            {
+                nCells = std::min(nCells * 4, SMSG_IBLT_MAX_CELLS);
+                LogPrint(BCLog::SMSG, "Bucket %d did not decode, reconciling with %u cells.\n", time, nCells);
+                vchDataOut.resize(4 + 12);
+                memcpy(&vchDataOut[12], &nCells, 4);
+                g_connman->PushMessage(pfrom,
+                    CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgReconReq", vchDataOut));
+            } else
+            {
+                LogPrint(BCLog::SMSG, "Bucket %d did not decode, requesting contents.\n", time);
+                g_connman->PushMessage(pfrom,
+                    CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgShow", vchDataOut));
+            };
+            return SMSG_NO_ERROR;
+        };
+
+        LogPrint(BCLog::SMSG, "Reconciled bucket %d, peer has %u messages this node doesn't, lacks %u.\n",
+            time, vHave.size(), vLack.size());
+
+        if (vHave.empty())
+            return SMSG_NO_ERROR;
+        return RequestTokens(pfrom, time, vHave);
+    } else
+    if (strCommand == "smsgMsg")
+    {
+        // Read the serialised vector in place
+        uint64_t nData = ReadCompactSize(vRecv);
+        if (nData > vRecv.size())
+            throw std::ios_base::failure("smsgMsg: end of data");
+
+        LogPrint(BCLog::SMSG, "smsgMsg vchData.size() %u.\n", nData);
 
-        Receive(pfrom, vchData);
+        Receive(pfrom, Span<const uint8_t>((const uint8_t*)vRecv.data(), nData));
+        vRecv.ignore(nData);
     } else
     if (strCommand == "smsgMatch")
     {
@@ -1596,10 +2472,100 @@ int CSMSG::ReceiveData(CNode *pfrom, const std::string &strCommand, CDataStream
             pfrom->smsgData.ignoreUntil = time;
         }
 
-        LogPrint(BCLog::SMSG, "Peer %d is ignoring this node until %d, ignore peer too.\n", pfrom->GetId(), time);
-    } else
+        LogPrint(BCLog::SMSG, "Peer %d is ignoring this node until %d, ignore peer too.\n", pfrom->GetId(), time);
+    } else
+    {
+        return SMSG_UNKNOWN_MESSAGE;
+    };
+
+    return SMSG_NO_ERROR;
+};
+
+int CSMSG::RequestTokens(CNode *pfrom, int64_t time, const std::vector<SecMsgToken> &vOffered)
+{
+    std::vector<SecMsgToken> vNotPurged;
+    vNotPurged.reserve(vOffered.size());
+    {
+        LOCK(cs_smsg);
+        SecMsgPurged purgedToken;
+        for (const auto &token : vOffered)
+        {
+            if (setPurgedTimestamps.find(token.timestamp) != setPurgedTimestamps.end())
+            {
+                purgedToken.timestamp = token.timestamp;
+                memcpy(&purgedToken.sample, token.sample, 8);
+                if (setPurged.find(purgedToken) != setPurged.end())
+                {
+                    continue;
+                };
+            };
+            vNotPurged.push_back(token);
+        };
+    } // cs_smsg
+
+    // The bucket is locked for the peer even if this node has no messages in it yet
+    if (!CreateBucket(time))
+    {
+        LogPrint(BCLog::SMSG, "Bucket %d is being removed.\n", time);
+        return SMSG_GENERAL_ERROR;
+    };
+
+    std::vector<uint8_t> vchDataOut;
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_buckets);
+        auto itb = buckets.find(time);
+        if (itb == buckets.end())
+            return SMSG_GENERAL_ERROR;
+
+        SecMsgBucket &bucket = itb->second;
+        LOCK(bucket.cs_bucket);
+        if (bucket.nLockCount > 0)
+        {
+            LogPrint(BCLog::SMSG, "Bucket %d lock count %u, waiting for message data from peer %u.\n", time, bucket.nLockCount, bucket.nLockPeerId);
+            return SMSG_GENERAL_ERROR;
+        };
+
+        LogPrint(BCLog::SMSG, "Sifting through bucket %d.\n", time);
+
+        vchDataOut.resize(8);
+        memcpy(&vchDataOut[0], &time, 8);
+
+        SecMsgTokenSet &tokenSet = bucket.setTokens;
+        for (const auto &token : vNotPurged)
+        {
+            if (tokenSet.find(token) == tokenSet.end())
+            {
+                int nd = vchDataOut.size();
+                try {
+                    vchDataOut.resize(nd + 16);
+                } catch (std::exception &e) {
+                    LogPrintf("vchDataOut.resize %d threw: %s.\n", nd + 16, e.what());
+                    continue;
+                };
+
+                memcpy(&vchDataOut[nd], &token.timestamp, 8);
+                memcpy(&vchDataOut[nd+8], token.sample, 8);
+            };
+        };
+
+        if (vchDataOut.size() > 8)
+        {
+            if (LogAcceptCategory(BCLog::SMSG))
+            {
+                LogPrintf("Asking peer for %u messages.\n", (vchDataOut.size() - 8) / 16);
+                LogPrintf("Locking bucket %u for peer %d.\n", time, pfrom->GetId());
+            };
+            bucket.nLockCount   = 3; // lock this bucket for at most 3 * SMSG_THREAD_DELAY seconds, unset when peer sends smsgMsg
+            bucket.nLockPeerId  = pfrom->GetId();
+            bucket.nLockTimeout = GetAdjustedTime() + bucket.nLockCount * SMSG_THREAD_DELAY;
+            ScheduleBucket(time, bucket);
+        };
+    } // cs_buckets
+
+    if (vchDataOut.size() > 8)
     {
-        return SMSG_UNKNOWN_MESSAGE;
+        g_connman->PushMessage(pfrom,
+            CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgWant", vchDataOut));
     };
 
     return SMSG_NO_ERROR;
@@ -1648,7 +2614,7 @@ bool CSMSG::SendData(CNode *pto, bool fSendTrickle)
     };
 
     {
-        LOCK(cs_smsg);
+        boost::shared_lock<boost::shared_mutex> lock(cs_buckets);
         std::map<int64_t, SecMsgBucket>::iterator it;
 
         uint32_t nBuckets = buckets.size();
@@ -1686,6 +2652,7 @@ bool CSMSG::SendData(CNode *pto, bool fSendTrickle)
             for (it = buckets.begin(); it != buckets.end(); ++it)
             {
                 SecMsgBucket &bkt = it->second;
+                LOCK(bkt.cs_bucket);
 
                 uint32_t nMessages = bkt.setTokens.size();
 
@@ -1724,7 +2691,7 @@ bool CSMSG::SendData(CNode *pto, bool fSendTrickle)
                     CNetMsgMaker(INIT_PROTO_VERSION).Make("smsgInv", vchData));
             };
         };
-    } // cs_smsg
+    } // cs_buckets
 
     pto->smsgData.lastSeen = now;
     pto->smsgData.lastMatched = now; //bug fix smsg 3
@@ -1901,6 +2868,11 @@ bool CSMSG::ScanChainForPublicKeys(CBlockIndex *pindexStart)
                 smsg::ScanBlock(*this, block, addrpkdb,
                     nTransactions, nInputs, nPubkeys, nDuplicates);
 
+            // Bound the memory of the pending batch
+            if (nBlocks % SMSG_SCAN_CHAIN_COMMIT == 0
+                && (!addrpkdb.TxnCommit() || !addrpkdb.TxnBegin()))
+                return false;
+
             pindex = chainActive.Next(pindex);
         };
 
@@ -1938,6 +2910,54 @@ bool CSMSG::ScanBlockChain()
     return true;
 };
 
+static bool ReadMessageBatch(FILE *fp, std::vector<uint8_t> &vchBatch, std::vector<SecMsgScanItem> &vItems)
+{
+    // Read up to SMSG_SCAN_BATCH messages into vchBatch, returns false at the end of the file or on error
+    vchBatch.clear();
+    std::vector<size_t> vOffsets;
+    bool fMore = true;
+    while (vOffsets.size() < SMSG_SCAN_BATCH)
+    {
+        SecureMessage smsg;
+        errno = 0;
+        if (fread(smsg.data(), sizeof(uint8_t), SMSG_HDR_LEN, fp) != (size_t)SMSG_HDR_LEN)
+        {
+            if (errno != 0)
+                LogPrintf("fread header failed: %s\n", strerror(errno));
+            fMore = false;
+            break;
+        };
+
+        size_t nOfs = vchBatch.size();
+        try { vchBatch.resize(nOfs + SMSG_HDR_LEN + smsg.nPayload); } catch (std::exception &e)
+        {
+            LogPrintf("%s: Could not resize vchBatch, %u, %s\n", __func__, smsg.nPayload, e.what());
+            vchBatch.resize(nOfs);
+            fMore = false;
+            break;
+        };
+
+        memcpy(&vchBatch[nOfs], smsg.data(), SMSG_HDR_LEN);
+        if (fread(&vchBatch[nOfs + SMSG_HDR_LEN], sizeof(uint8_t), smsg.nPayload, fp) != smsg.nPayload)
+        {
+            LogPrintf("fread data failed: %s\n", strerror(errno));
+            vchBatch.resize(nOfs);
+            fMore = false;
+            break;
+        };
+        vOffsets.push_back(nOfs);
+    };
+
+    // vchBatch is complete, point into it
+    vItems.clear();
+    for (auto nOfs : vOffsets)
+    {
+        const SecureMessage *psmsg = (const SecureMessage*) &vchBatch[nOfs];
+        vItems.push_back(SecMsgScanItem{&vchBatch[nOfs], &vchBatch[nOfs + SMSG_HDR_LEN], psmsg->nPayload});
+    };
+    return fMore;
+};
+
 bool CSMSG::ScanBuckets()
 {
     LogPrint(BCLog::SMSG, "%s\n", __func__);
@@ -1967,8 +2987,8 @@ bool CSMSG::ScanBuckets()
         return true; // not an error
     };
 
-    SecureMessage smsg;
-    std::vector<uint8_t> vchData;
+    std::vector<uint8_t> vchBatch;
+    std::vector<SecMsgScanItem> vItems;
 
     for (fs::directory_iterator itd(pathSmsgDir); itd != itend; ++itd)
     {
@@ -2023,60 +3043,25 @@ bool CSMSG::ScanBuckets()
             continue;
         };
 
+        FILE *fp;
+        errno = 0;
+        if (!(fp = fopen(itd->path().string().c_str(), "rb")))
         {
-            LOCK(cs_smsg);
-            FILE *fp;
-            errno = 0;
-            if (!(fp = fopen(itd->path().string().c_str(), "rb")))
-            {
-                LogPrintf("Error opening file: %s\n", strerror(errno));
-                continue;
-            };
-
-            for (;;)
-            {
-                errno = 0;
-                if (fread(smsg.data(), sizeof(uint8_t), SMSG_HDR_LEN, fp) != (size_t)SMSG_HDR_LEN)
-                {
-                    if (errno != 0)
-                    {
-                        LogPrintf("fread header failed: %s\n", strerror(errno));
-                    } else
-                    {
-                        //LogPrintf("End of file.\n");
-                    };
-                    break;
-                };
-
-                try { vchData.resize(smsg.nPayload); } catch (std::exception &e)
-                {
-                    LogPrintf("SecureMsgWalletUnlocked(): Could not resize vchData, %u, %s\n", smsg.nPayload, e.what());
-                    fclose(fp);
-                    return false;
-                };
-
-                if (fread(&vchData[0], sizeof(uint8_t), smsg.nPayload, fp) != smsg.nPayload)
-                {
-                    LogPrintf("fread data failed: %s\n", strerror(errno));
-                    break;
-                };
-
-                // Don't report to gui,
-                int rv = ScanMessage(smsg.data(), &vchData[0], smsg.nPayload, false);
+            LogPrintf("Error opening file: %s\n", strerror(errno));
+            continue;
+        };
 
-                if (rv == SMSG_NO_ERROR)
-                {
-                    nFoundMessages++;
-                } else
-                {
-                    // SecureMsgScanMessage failed
-                };
+        bool fMore;
+        do
+        {
+            fMore = ReadMessageBatch(fp, vchBatch, vItems);
+            nMessages += vItems.size();
 
-                nMessages++;
-            };
+            // Don't report to gui
+            ScanMessages(vItems, false, nFoundMessages);
+        } while (fMore);
 
-            fclose(fp);
-        } // cs_smsg
+        fclose(fp);
     };
 
     LogPrintf("Processed %u files, scanned %u messages, received %u messages.\n", nFiles, nMessages, nFoundMessages);
@@ -2159,8 +3144,8 @@ int CSMSG::WalletUnlocked()
         return SMSG_NO_ERROR; // not an error
     };
 
-    SecureMessage smsg;
-    std::vector<uint8_t> vchData;
+    std::vector<uint8_t> vchBatch;
+    std::vector<SecMsgScanItem> vItems;
 
     for (fs::directory_iterator itd(pathSmsgDir); itd != itend; ++itd)
     {
@@ -2202,69 +3187,33 @@ int CSMSG::WalletUnlocked()
             continue;
         };
 
+        FILE *fp;
+        errno = 0;
+        if (!(fp = fopen(itd->path().string().c_str(), "rb")))
         {
-            LOCK(cs_smsg);
-            FILE *fp;
-            errno = 0;
-            if (!(fp = fopen(itd->path().string().c_str(), "rb")))
-            {
-                LogPrintf("Error opening file: %s\n", strerror(errno));
-                continue;
-            };
-
-            for (;;)
-            {
-                errno = 0;
-                if (fread(smsg.data(), sizeof(uint8_t), SMSG_HDR_LEN, fp) != (size_t)SMSG_HDR_LEN)
-                {
-                    if (errno != 0)
-                    {
-                        LogPrintf("fread header failed: %s\n", strerror(errno));
-                    } else
-                    {
-                        //LogPrintf("End of file.\n");
-                    };
-                    break;
-                };
-
-                try { vchData.resize(smsg.nPayload); } catch (std::exception &e)
-                {
-                    LogPrintf("%s: Could not resize vchData, %u, %s\n", __func__, smsg.nPayload, e.what());
-                    fclose(fp);
-                    return SMSG_GENERAL_ERROR;
-                };
-
-                if (fread(&vchData[0], sizeof(uint8_t), smsg.nPayload, fp) != smsg.nPayload)
-                {
-                    LogPrintf("fread data failed: %s\n", strerror(errno));
-                    break;
-                };
-
-                // Don't report to gui,
-                int rv = ScanMessage(smsg.data(), &vchData[0], smsg.nPayload, false);
+            LogPrintf("Error opening file: %s\n", strerror(errno));
+            continue;
+        };
 
-                if (rv == 0)
-                {
-                    nFoundMessages++;
-                } else
-                if (rv != 0)
-                {
-                    // SecureMsgScanMessage failed
-                };
+        bool fMore;
+        do
+        {
+            fMore = ReadMessageBatch(fp, vchBatch, vItems);
+            nMessages += vItems.size();
 
-                nMessages++;
-            };
+            // Don't report to gui
+            ScanMessages(vItems, false, nFoundMessages);
+        } while (fMore);
 
-            fclose(fp);
+        fclose(fp);
 
-            // Remove wl file when scanned
-            try {
-                fs::remove(itd->path());
-            } catch (const fs::filesystem_error &ex)
-            {
-                return errorN(SMSG_GENERAL_ERROR, "%s: Could not remove file %s - %s.", __func__, fileName, ex.what());
-            };
-        } // cs_smsg
+        // Remove wl file when scanned
+        try {
+            fs::remove(itd->path());
+        } catch (const fs::filesystem_error &ex)
+        {
+            return errorN(SMSG_GENERAL_ERROR, "%s: Could not remove file %s - %s.", __func__, fileName, ex.what());
+        };
     };
 
     LogPrintf("Processed %u files, scanned %u messages, received %u messages.\n", nFiles, nMessages, nFoundMessages);
@@ -2300,9 +3249,181 @@ int CSMSG::WalletKeyChanged(CKeyID &keyId, const std::string &sLabel, ChangeType
     return ManageLocalKey(keyId, mode);
 };
 
+int CSMSG::GetScanKeys(std::vector<SecMsgScanKey> &vKeys)
+{
+    LOCK(cs_smsg);
+
+    vKeys.clear();
+    for (auto &p : keyStore.mapKeys)
+    {
+        auto &key = p.second;
+        if (!(key.nFlags & SMK_RECEIVE_ON))
+            continue;
+        vKeys.push_back(SecMsgScanKey{p.first, key.key, !(key.nFlags & SMK_RECEIVE_ANON)});
+    };
+
+#ifdef ENABLE_WALLET
+    if (!pwallet)
+        return SMSG_NO_ERROR;
+
+    if (pwallet->IsLocked())
+        return SMSG_WALLET_LOCKED;
+
+    for (const auto &address : addresses)
+    {
+        if (!address.fReceiveEnabled)
+            continue;
+
+        CKey keyDest;
+        if (!pwallet->GetKey(address.address, keyDest))
+            continue;
+        vKeys.push_back(SecMsgScanKey{address.address, keyDest, !address.fReceiveAnon});
+    };
+#endif
+
+    return SMSG_NO_ERROR;
+};
+
+void CSMSG::FindFirstKeys(const std::vector<SecMsgScanItem> &vItems, const std::vector<SecMsgScanKey> &vKeys,
+    std::vector<int> &vFirst, size_t nThreadsIn)
+{
+    vFirst.assign(vItems.size(), -1);
+
+    size_t nKeys = vKeys.size();
+    size_t nTrials = vItems.size() * nKeys;
+    if (nTrials == 0)
+        return;
+
+    // Trials are numbered message by message, a thread takes SMSG_SCAN_CHUNK at a time.
+    // Once a message matched a key, the trials with its later keys are skipped.
+    std::unique_ptr<std::atomic<size_t>[]> aFirst(new std::atomic<size_t>[vItems.size()]);
+    for (size_t i = 0; i < vItems.size(); ++i)
+        aFirst[i] = nKeys;
+    std::atomic<size_t> nNext{0};
+
+    auto TrialDecrypt = [&]() {
+        MessageData msg; // placeholder
+        for (;;)
+        {
+            size_t nBegin = nNext.fetch_add(SMSG_SCAN_CHUNK);
+            if (nBegin >= nTrials)
+                return;
+            size_t nEnd = std::min(nBegin + SMSG_SCAN_CHUNK, nTrials);
+            for (size_t t = nBegin; t < nEnd; ++t)
+            {
+                size_t m = t / nKeys, k = t % nKeys;
+                if (aFirst[m] <= k)
+                    continue;
+
+                const SecMsgScanItem &item = vItems[m];
+                const SecMsgScanKey &key = vKeys[k];
+                if (Decrypt(true, key.key, key.address, item.pHeader, item.pPayload, item.nPayload, msg) != SMSG_NO_ERROR)
+                    continue;
+
+                size_t nPrev = aFirst[m];
+                while (k < nPrev && !aFirst[m].compare_exchange_weak(nPrev, k));
+            };
+        };
+    };
+
+    size_t nThreads = std::min(std::max(nThreadsIn, (size_t)1), (nTrials + SMSG_SCAN_CHUNK - 1) / SMSG_SCAN_CHUNK);
+    std::vector<std::thread> vThreads;
+    for (size_t i = 1; i < nThreads; ++i)
+        vThreads.emplace_back(TrialDecrypt);
+    TrialDecrypt();
+    for (auto &t : vThreads)
+        t.join();
+
+    for (size_t i = 0; i < vItems.size(); ++i)
+        if (aFirst[i] < nKeys)
+            vFirst[i] = aFirst[i];
+};
+
+int CSMSG::ScanMessages(const std::vector<SecMsgScanItem> &vItems, bool reportToGui, uint32_t &nFound)
+{
+    if (vItems.empty())
+        return SMSG_NO_ERROR;
+
+    std::vector<SecMsgScanKey> vKeys;
+    int rvKeys = GetScanKeys(vKeys);
+
+    std::vector<int> vFirst;
+    FindFirstKeys(vItems, vKeys, vFirst, nScanThreads);
+
+    // Received messages are written to the inbox in one transaction, and notified after it's committed
+    SecMsgDB dbInbox;
+    bool fBatch;
+    {
+        LOCK(cs_smsgDB);
+        fBatch = dbInbox.Open("cw") && dbInbox.TxnBegin();
+    }
+    std::vector<SecMsgInboxAdded> vAdded;
+
+    for (size_t i = 0; i < vItems.size(); ++i)
+    {
+        const SecMsgScanItem &item = vItems[i];
+        if (ScanMessage(item.pHeader, item.pPayload, item.nPayload, reportToGui, vKeys, vFirst[i], rvKeys,
+            fBatch ? &dbInbox : nullptr, &vAdded) == SMSG_NO_ERROR)
+            nFound++;
+    };
+
+    if (fBatch)
+    {
+        bool fCommitted;
+        {
+            LOCK(cs_smsgDB);
+            fCommitted = dbInbox.Open("cw") && dbInbox.TxnCommit();
+        }
+        if (!fCommitted)
+            return errorN(SMSG_GENERAL_ERROR, "%s: Failed to write %u messages to inbox.", __func__, vAdded.size());
+
+        for (auto &added : vAdded)
+            NotifyInboxAdded(added.smsgInbox, added.hash, reportToGui);
+    };
+
+    return SMSG_NO_ERROR;
+};
+
+void CSMSG::NotifyInboxAdded(SecMsgStored &smsgInbox, const uint160 &hash, bool reportToGui)
+{
+    if (reportToGui)
+    {
+        LOCK(cs_smsgDB);
+        NotifySecMsgInboxChanged(smsgInbox);
+    };
+
+    // notify an external script when a message comes in
+    std::string strCmd = gArgs.GetArg("-smsgnotify", "");
+
+    //TODO: Format message
+    if (!strCmd.empty())
+    {
+        boost::replace_all(strCmd, "%s", CBitcoinAddress(smsgInbox.addrTo).ToString());
+        std::thread t(runCommand, strCmd);
+        t.detach(); // thread runs free
+    };
+
+    GetMainSignals().NewSecureMessage((const SecureMessage*) &smsgInbox.vchMessage[0], hash);
+};
+
 int CSMSG::ScanMessage(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t nPayload, bool reportToGui)
 {
     LogPrint(BCLog::SMSG, "%s\n", __func__);
+
+    std::vector<SecMsgScanKey> vKeys;
+    int rvKeys = GetScanKeys(vKeys);
+
+    std::vector<int> vFirst;
+    FindFirstKeys(std::vector<SecMsgScanItem>{{pHeader, pPayload, nPayload}}, vKeys, vFirst, nScanThreads);
+
+    return ScanMessage(pHeader, pPayload, nPayload, reportToGui, vKeys, vFirst[0], rvKeys);
+};
+
+int CSMSG::ScanMessage(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t nPayload, bool reportToGui,
+    const std::vector<SecMsgScanKey> &vKeys, int nFirst, int rvKeys,
+    SecMsgDB *pdbInbox, std::vector<SecMsgInboxAdded> *pvAdded)
+{
+    CPerfTimer timer(PERF_HISTOGRAM("smsg:scan"));
     /*
     Check if message belongs to this node.
     If so add to inbox db.
@@ -2310,43 +3431,42 @@ int CSMSG::ScanMessage(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t
     if !reportToGui don't fire NotifySecMsgInboxChanged
      - loads messages received when wallet locked in bulk.
 
+    nFirst is the first key in vKeys the message passed the MAC check of, from FindFirstKeys.
+    rvKeys is the result of GetScanKeys.
+
+    If pdbInbox is set the message is written to its open transaction and appended
+    to pvAdded, the caller notifies it after committing.
+
     returns SecureMessageCodes
     */
 
     bool fOwnMessage = false;
     MessageData msg; // placeholder
     CKeyID addressTo;
-    for (auto &p : smsgModule.keyStore.mapKeys)
+    for (size_t i = nFirst < 0 ? vKeys.size() : nFirst; i < vKeys.size(); ++i)
     {
-        auto &address = p.first;
-        auto &key = p.second;
-
-        if (!(key.nFlags & SMK_RECEIVE_ON))
-            continue;
+        // Later keys are only tried if the full decrypt with the first key fails
+        const SecMsgScanKey &key = vKeys[i];
 
-        if (!(key.nFlags & SMK_RECEIVE_ANON))
+        if (key.fFullDecrypt)
         {
             // Have to do full decrypt to see address from
-            if (Decrypt(false, key.key, address, pHeader, pPayload, nPayload, msg) == 0)
-            {
-                if (LogAcceptCategory(BCLog::SMSG))
-                    LogPrintf("Decrypted message with %s.\n", CBitcoinAddress(addressTo).ToString());
-                if (msg.sFromAddress.compare("spending") != 0)
-                    fOwnMessage = true;
-                addressTo = address;
-                break;
-            };
+            if (Decrypt(false, key.key, key.address, pHeader, pPayload, nPayload, msg) != 0)
+                continue;
+            if (msg.sFromAddress.compare("spending") != 0)
+                fOwnMessage = true;
         } else
         {
-            if (Decrypt(true, key.key, address, pHeader, pPayload, nPayload, msg) == 0)
-            {
-                if (LogAcceptCategory(BCLog::SMSG))
-                    LogPrintf("Decrypted message with %s.\n", CBitcoinAddress(addressTo).ToString());
-                fOwnMessage = true;
-                addressTo = address;
-                break;
-            };
+            if (i != (size_t)nFirst
+                && Decrypt(true, key.key, key.address, pHeader, pPayload, nPayload, msg) != 0)
+                continue;
+            fOwnMessage = true;
         };
+
+        if (LogAcceptCategory(BCLog::SMSG))
+            LogPrintf("Decrypted message with %s.\n", CBitcoinAddress(key.address).ToString());
+        addressTo = key.address;
+        break;
     };
 
     if (!fOwnMessage)
@@ -2358,11 +3478,16 @@ int CSMSG::ScanMessage(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t
             return SMSG_NO_ERROR;
         };
 
-        if (pwallet->IsLocked())
+        if (rvKeys == SMSG_WALLET_LOCKED)
         {
             LogPrint(BCLog::SMSG, "%s: Wallet is locked, storing message to scan later.\n", __func__);
 
-            if (addresses.size() > 0) // Only save unscanned if there are addresses
+            bool fHaveAddresses;
+            {
+                LOCK(cs_smsg);
+                fHaveAddresses = addresses.size() > 0;
+            }
+            if (fHaveAddresses) // Only save unscanned if there are addresses
             {
                 int rv;
                 if ((rv = StoreUnscanned(pHeader, pPayload, nPayload)) != 0)
@@ -2371,40 +3496,6 @@ int CSMSG::ScanMessage(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t
 
             return SMSG_WALLET_LOCKED;
         };
-
-        for (std::vector<SecMsgAddress>::iterator it = addresses.begin(); it != addresses.end(); ++it)
-        {
-            if (!it->fReceiveEnabled)
-                continue;
-
-            addressTo = it->address;
-
-            CKey keyDest;
-            if (!pwallet->GetKey(addressTo, keyDest))
-                continue;
-
-            if (!it->fReceiveAnon)
-            {
-                // Have to do full decrypt to see address from
-                if (Decrypt(false, keyDest, addressTo, pHeader, pPayload, nPayload, msg) == 0)
-                {
-                    if (LogAcceptCategory(BCLog::SMSG))
-                        LogPrintf("Decrypted message with %s.\n", CBitcoinAddress(addressTo).ToString());
-                    if (msg.sFromAddress.compare("spending") != 0)
-                        fOwnMessage = true;
-                    break;
-                };
-            } else
-            {
-                if (Decrypt(true, keyDest, addressTo, pHeader, pPayload, nPayload, msg) == 0)
-                {
-                    if (LogAcceptCategory(BCLog::SMSG))
-                        LogPrintf("Decrypted message with %s.\n", CBitcoinAddress(addressTo).ToString());
-                    fOwnMessage = true;
-                    break;
-                };
-            };
-        };
 #endif
     };
 
@@ -2435,41 +3526,31 @@ int CSMSG::ScanMessage(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t
         memcpy(&smsgInbox.vchMessage[0], pHeader, SMSG_HDR_LEN);
         memcpy(&smsgInbox.vchMessage[SMSG_HDR_LEN], pPayload, nPayload);
 
-        bool fExisted = false;
+        bool fSaved = false;
         {
             LOCK(cs_smsgDB);
-            SecMsgDB dbInbox;
+            SecMsgDB dbSingle;
+            SecMsgDB &dbInbox = pdbInbox ? *pdbInbox : dbSingle;
 
             if (dbInbox.Open("cw"))
             {
                 if (dbInbox.ExistsSmesg(chKey))
                 {
-                    fExisted = true;
                     LogPrint(BCLog::SMSG, "Message already exists in inbox db.\n");
                 } else
                 {
-                    dbInbox.WriteSmesg(chKey, smsgInbox);
-                    if (reportToGui)
-                        NotifySecMsgInboxChanged(smsgInbox);
+                    fSaved = dbInbox.WriteSmesg(chKey, smsgInbox);
                     LogPrintf("SecureMsg saved to inbox, received with %s.\n", CBitcoinAddress(addressTo).ToString());
                 };
             };
         } // cs_smsgDB
 
-        if (!fExisted)
+        if (fSaved)
         {
-            // notify an external script when a message comes in
-            std::string strCmd = gArgs.GetArg("-smsgnotify", "");
-
-            //TODO: Format message
-            if (!strCmd.empty())
-            {
-                boost::replace_all(strCmd, "%s", CBitcoinAddress(addressTo).ToString());
-                std::thread t(runCommand, strCmd);
-                t.detach(); // thread runs free
-            };
-
-            GetMainSignals().NewSecureMessage(psmsg, hash);
+            if (pdbInbox)
+                pvAdded->push_back(SecMsgInboxAdded{std::move(smsgInbox), hash});
+            else
+                NotifyInboxAdded(smsgInbox, hash, reportToGui);
         };
     };
 
@@ -2714,7 +3795,6 @@ int CSMSG::ReadSmsgKey(const CKeyID &idk, CKey &key)
 int CSMSG::Retrieve(const SecMsgToken &token, std::vector<uint8_t> &vchData)
 {
     LogPrint(BCLog::SMSG, "%s: %d.\n", __func__, token.timestamp);
-    AssertLockHeld(cs_smsg);
 
     fs::path pathSmsgDir = GetDataDir() / "smsgstore";
 
@@ -2763,7 +3843,6 @@ int CSMSG::Retrieve(const SecMsgToken &token, std::vector<uint8_t> &vchData)
 int CSMSG::Remove(const SecMsgToken &token)
 {
     LogPrint(BCLog::SMSG, "%s: %d.\n", __func__, token.timestamp);
-    AssertLockHeld(cs_smsg);
 
     fs::path pathSmsgDir = GetDataDir() / "smsgstore";
 
@@ -2813,11 +3892,26 @@ int CSMSG::Remove(const SecMsgToken &token)
     };
 
     fclose(fp);
+
+    // Mark the record purged in place, the header read on a rescan has version 0
+    if (!SetBucketIndexTTL(bucket, token.offset, 0))
+    {
+        try { fs::remove(GetBucketIndexPath(bucket));
+        } catch (const fs::filesystem_error &ex)
+        {
+            LogPrintf("Error removing bucket index file %s.\n", ex.what());
+        };
+    };
+
     return SMSG_NO_ERROR;
 };
 
-int CSMSG::Receive(CNode *pfrom, std::vector<uint8_t> &vchData)
+int CSMSG::Receive(CNode *pfrom, Span<const uint8_t> vchData)
 {
+    CPerfTimer timer(PERF_HISTOGRAM("smsg:receive"));
+    /*
+    vchData points into the received network message, messages are validated, stored and scanned in place.
+    */
     LogPrint(BCLog::SMSG, "%s\n", __func__);
 
     if (vchData.size() < 12) // nBunch4 + timestamp8
@@ -2853,29 +3947,44 @@ int CSMSG::Receive(CNode *pfrom, std::vector<uint8_t> &vchData)
         Misbehaving(pfrom->GetId(), 1);
 
         {
-            LOCK(cs_smsg);
+            boost::shared_lock<boost::shared_mutex> lock(cs_buckets);
             // Release lock on bucket if it exists
             itb = buckets.find(bktTime);
             if (itb != buckets.end())
+            {
+                LOCK(itb->second.cs_bucket);
                 itb->second.nLockCount = 0;
-        } // cs_smsg
+            };
+        } // cs_buckets
         return SMSG_GENERAL_ERROR;
     };
 
-    uint32_t n = 12;
+    std::vector<SecMsgScanItem> vItems;
+    vItems.reserve(nBunch);
 
+    size_t n = 12;
     for (uint32_t i = 0; i < nBunch; ++i)
     {
-        if (vchData.size() - n < SMSG_HDR_LEN)
+        if ((size_t)vchData.size() - n < SMSG_HDR_LEN)
         {
             LogPrintf("Error: not enough data sent, n = %u.\n", n);
             break;
         };
 
-        SecureMessage *psmsg = (SecureMessage*) &vchData[n];
+        const SecureMessage *psmsg = (const SecureMessage*) &vchData[n];
+        if ((size_t)vchData.size() - n - SMSG_HDR_LEN < psmsg->nPayload)
+        {
+            LogPrintf("Error: not enough data sent for payload, n = %u.\n", n);
+            Misbehaving(pfrom->GetId(), 1);
+            break;
+        };
+
+        const uint8_t *pHeader = &vchData[n];
+        const uint8_t *pPayload = pHeader + SMSG_HDR_LEN;
+        n += SMSG_HDR_LEN + psmsg->nPayload;
 
         int rv;
-        if ((rv = Validate(&vchData[n], &vchData[n + SMSG_HDR_LEN], psmsg->nPayload)) != 0)
+        if ((rv = Validate(pHeader, pPayload, psmsg->nPayload)) != 0)
         {
             // Message dropped
             if (rv == SMSG_INVALID_HASH) // Invalid proof of work
@@ -2892,26 +4001,18 @@ int CSMSG::Receive(CNode *pfrom, std::vector<uint8_t> &vchData)
             continue;
         };
 
-        {
-            LOCK(cs_smsg);
-            // Store message, but don't hash bucket
-            if (Store(&vchData[n], &vchData[n + SMSG_HDR_LEN], psmsg->nPayload, false) != 0)
-            {
-                // Message dropped
-                break;
-            };
+        vItems.push_back({pHeader, pPayload, psmsg->nPayload});
+    };
 
-            if (ScanMessage(&vchData[n], &vchData[n + SMSG_HDR_LEN], psmsg->nPayload, true) != 0)
-            {
-                // message recipient is not this node (or failed)
-            };
-        } // cs_smsg
+    // Store messages, but don't hash bucket, vItems keeps only the new messages
+    if (Store(vItems) != 0)
+        LogPrintf("%s: Failed to store all messages.\n", __func__);
 
-        n += SMSG_HDR_LEN + psmsg->nPayload;
-    };
+    uint32_t nFound = 0;
+    ScanMessages(vItems, true, nFound);
 
     {
-        LOCK(cs_smsg);
+        boost::shared_lock<boost::shared_mutex> lock(cs_buckets);
         // If messages have been added, bucket must exist now
         itb = buckets.find(bktTime);
         if (itb == buckets.end())
@@ -2920,45 +4021,40 @@ int CSMSG::Receive(CNode *pfrom, std::vector<uint8_t> &vchData)
             return SMSG_GENERAL_ERROR;
         };
 
+        LOCK(itb->second.cs_bucket);
         itb->second.nLockCount  = 0; // This node has received data from peer, release lock
         itb->second.nLockPeerId = 0;
         itb->second.hashBucket();
-    } // cs_smsg
+    } // cs_buckets
 
     return SMSG_NO_ERROR;
 };
 
 int CSMSG::CheckPurged(const SecureMessage *psmsg, const uint8_t *pPayload)
 {
-    if (setPurgedTimestamps.find(psmsg->timestamp) != setPurgedTimestamps.end())
-        return SMSG_NO_ERROR;
-
-    std::vector<uint8_t> vMsgId = GetMsgID(psmsg, pPayload);
-
-    uint8_t chKey[30];
-    chKey[0] = 'p';
-    chKey[1] = 'm';
-    memcpy(chKey+2, vMsgId.data(), 28);
-
-    LOCK2(cs_smsg, cs_smsgDB);
+    // The purged ids are all in memory, most messages are passed on the timestamp alone
+    {
+        LOCK(cs_smsg);
+        if (setPurgedTimestamps.find(psmsg->timestamp) == setPurgedTimestamps.end())
+            return SMSG_NO_ERROR;
+    }
 
-    SecMsgDB db;
-    if (!db.Open("cr+"))
-        return SMSG_GENERAL_ERROR;
+    uint160 hash;
+    HashMsg(*psmsg, pPayload, psmsg->nPayload-(psmsg->IsPaidVersion() ? 32 : 0), hash);
 
-    SecMsgPurged purged;
-    if (db.ReadPurged(chKey, purged))
-    {
-        LogPrint(BCLog::SMSG, "%s Found purged %s\n", __func__, HexStr(vMsgId));
+    LOCK(cs_smsg);
+    auto mi = mapPurgedIds.find(hash);
+    if (mi == mapPurgedIds.end())
+        return SMSG_NO_ERROR;
 
-        // Add sample to purged token
-        memcpy(purged.sample, pPayload, 8);
-        setPurged.insert(purged);
+    LogPrint(BCLog::SMSG, "%s Found purged %s\n", __func__, HexStr(GetMsgID(psmsg, pPayload)));
 
-        return SMSG_PURGED_MSG;
-    };
+    // Add sample to purged token
+    SecMsgPurged purged(psmsg->timestamp, mi->second);
+    memcpy(purged.sample, pPayload, 8);
+    setPurged.insert(purged);
 
-    return SMSG_NO_ERROR;
+    return SMSG_PURGED_MSG;
 };
 
 int CSMSG::StoreUnscanned(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t nPayload)
@@ -3019,10 +4115,41 @@ int CSMSG::StoreUnscanned(const uint8_t *pHeader, const uint8_t *pPayload, uint3
 };
 
 
+bool CSMSG::CreateBucket(int64_t bucketTime)
+{
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_buckets);
+        if (buckets.count(bucketTime))
+            return true;
+    } // cs_buckets
+
+    boost::unique_lock<boost::shared_mutex> lock(cs_buckets);
+    if (setBucketsRemoving.count(bucketTime))
+        return false;
+    SecMsgBucket &bucket = buckets[bucketTime];
+    LOCK(bucket.cs_bucket);
+    ScheduleBucket(bucketTime, bucket);
+    return true;
+};
+
+void CSMSG::ScheduleBucket(int64_t bucketTime, SecMsgBucket &bucket)
+{
+    AssertLockHeld(bucket.cs_bucket);
+
+    int64_t nEvent = bucket.GetNextEvent(bucketTime);
+    if (bucket.nEventTime != 0 && bucket.nEventTime <= nEvent)
+        return;
+
+    // A later event left in the queue is harmless, the thread rechecks the bucket and queues the next event
+    bucket.nEventTime = nEvent;
+    LOCK(cs_bucket_events);
+    setBucketEvents.emplace(nEvent, bucketTime);
+};
+
 int CSMSG::Store(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t nPayload, bool fHashBucket)
 {
+    CPerfTimer timer(PERF_HISTOGRAM("smsg:store"));
     LogPrint(BCLog::SMSG, "%s\n", __func__);
-    AssertLockHeld(cs_smsg);
 
     if (!pHeader || !pPayload)
         return errorN(SMSG_GENERAL_ERROR, "Null pointer to header or payload.");
@@ -3053,9 +4180,18 @@ int CSMSG::Store(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t nPayl
     uint32_t nDaysToLive = psmsg->version[0] < 3 ? 2 : psmsg->nonce[0];
     SecMsgToken token(psmsg->timestamp, pPayload, nPayload, 0, nDaysToLive);
 
-    SecMsgBucket &bucket = buckets[bucketTime];
-    std::set<SecMsgToken> &tokenSet = bucket.setTokens;
-    std::set<SecMsgToken>::iterator it;
+    if (!CreateBucket(bucketTime))
+        return errorN(SMSG_GENERAL_ERROR, "%s: Bucket %d is being removed.", __func__, bucketTime);
+
+    boost::shared_lock<boost::shared_mutex> lock(cs_buckets);
+    auto itb = buckets.find(bucketTime);
+    if (itb == buckets.end())
+        return errorN(SMSG_GENERAL_ERROR, "%s: Bucket %d was removed.", __func__, bucketTime);
+
+    SecMsgBucket &bucket = itb->second;
+    LOCK(bucket.cs_bucket);
+    SecMsgTokenSet &tokenSet = bucket.setTokens;
+    SecMsgTokenSet::const_iterator it;
     it = tokenSet.find(token);
     if (it != tokenSet.end())
     {
@@ -3098,19 +4234,174 @@ int CSMSG::Store(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t nPayl
 
     token.offset = ofs;
 
-    tokenSet.insert(token);
+    if (!AppendBucketIndex(bucketTime, token, nPayload))
+    {
+        // Rebuilt from the bucket file on the next start
+        LogPrintf("%s: Failed to index message, removing index of bucket %d.\n", __func__, bucketTime);
+        try { fs::remove(GetBucketIndexPath(bucketTime));
+        } catch (const fs::filesystem_error &ex)
+        {
+            LogPrintf("Error removing bucket index file %s.\n", ex.what());
+        };
+    };
+
+    bucket.AddToken(token);
 
     if (nDaysToLive > 0 && (bucket.nLeastTTL == 0 || nDaysToLive < bucket.nLeastTTL))
         bucket.nLeastTTL = nDaysToLive;
 
     if (fHashBucket)
         bucket.hashBucket();
+    ScheduleBucket(bucketTime, bucket);
 
     LogPrint(BCLog::SMSG, "SecureMsg added to bucket %d.\n", bucketTime);
 
     return SMSG_NO_ERROR;
 };
 
+int CSMSG::Store(std::vector<SecMsgScanItem> &vItems)
+{
+    /*
+    Append a bunch of validated messages to their bucket files.
+    Messages are written from the caller's buffer, each bucket file and index is opened once.
+    vItems is reduced to the messages stored, buckets are not rehashed.
+
+    returns SecureMessageCodes
+    */
+
+    LogPrint(BCLog::SMSG, "%s %u\n", __func__, vItems.size());
+
+    int64_t now = GetAdjustedTime();
+    size_t nKeep = 0;
+    for (const auto &item : vItems)
+    {
+        const SecureMessage *psmsg = (const SecureMessage*) item.pHeader;
+        if (psmsg->timestamp > now + SMSG_TIME_LEEWAY
+            || psmsg->timestamp < now - SMSG_RETENTION)
+            continue;
+        if (SMSG_NO_ERROR != CheckPurged(psmsg, item.pPayload))
+            continue;
+        vItems[nKeep++] = item;
+    };
+    vItems.resize(nKeep);
+    if (vItems.empty())
+        return SMSG_NO_ERROR;
+
+    fs::path pathSmsgDir;
+    try {
+        pathSmsgDir = GetDataDir() / "smsgstore";
+        fs::create_directory(pathSmsgDir);
+    } catch (const fs::filesystem_error &ex)
+    {
+        return errorN(SMSG_GENERAL_ERROR, "Failed to create directory %s - %s.", pathSmsgDir.string(), ex.what());
+    };
+
+    auto BucketOf = [](const SecMsgScanItem &item) {
+        int64_t timestamp = ((const SecureMessage*) item.pHeader)->timestamp;
+        return timestamp - (timestamp % SMSG_BUCKET_LEN);
+    };
+    // A bunch is sent per bucket, only a misbehaving peer needs more than one pass
+    std::stable_sort(vItems.begin(), vItems.end(), [&BucketOf](const SecMsgScanItem &a, const SecMsgScanItem &b) {
+        return BucketOf(a) < BucketOf(b);
+    });
+
+    std::vector<uint8_t> vIndex;
+    nKeep = 0;
+    for (size_t b = 0, e; b < vItems.size(); b = e)
+    {
+        int64_t bucketTime = BucketOf(vItems[b]);
+        for (e = b + 1; e < vItems.size() && BucketOf(vItems[e]) == bucketTime; ++e);
+
+        if (!CreateBucket(bucketTime))
+        {
+            LogPrintf("%s: Bucket %d is being removed.\n", __func__, bucketTime);
+            continue;
+        };
+
+        boost::shared_lock<boost::shared_mutex> lock(cs_buckets);
+        auto itb = buckets.find(bucketTime);
+        if (itb == buckets.end())
+        {
+            LogPrintf("%s: Bucket %d was removed.\n", __func__, bucketTime);
+            continue;
+        };
+
+        SecMsgBucket &bucket = itb->second;
+        LOCK(bucket.cs_bucket);
+
+        fs::path fullpath = pathSmsgDir / (std::to_string(bucketTime) + "_01.dat");
+        FILE *fp;
+        errno = 0;
+        if (!(fp = fopen(fullpath.string().c_str(), "ab")))
+            return errorN(SMSG_GENERAL_ERROR, "fopen failed: %s.", strerror(errno));
+
+        // On windows ftell will always return 0 after fopen(ab), call fseek to set.
+        errno = 0;
+        if (fseek(fp, 0, SEEK_END) != 0)
+        {
+            fclose(fp);
+            return errorN(SMSG_GENERAL_ERROR, "fseek failed: %s.", strerror(errno));
+        };
+        long int ofsStart = ftell(fp), ofs = ofsStart;
+
+        vIndex.clear();
+        bool fWriteFailed = false;
+        for (size_t i = b; i < e; ++i)
+        {
+            const SecMsgScanItem &item = vItems[i];
+            const SecureMessage *psmsg = (const SecureMessage*) item.pHeader;
+
+            uint32_t nDaysToLive = psmsg->version[0] < 3 ? 2 : psmsg->nonce[0];
+            SecMsgToken token(psmsg->timestamp, item.pPayload, item.nPayload, ofs, nDaysToLive);
+            if (bucket.setTokens.find(token) != bucket.setTokens.end())
+            {
+                LogPrint(BCLog::SMSG, "Already have message %s.\n", token.ToString());
+                continue;
+            };
+
+            if (fwrite(item.pHeader,  sizeof(uint8_t), SMSG_HDR_LEN,  fp) != (size_t)SMSG_HDR_LEN
+             || fwrite(item.pPayload, sizeof(uint8_t), item.nPayload, fp) != item.nPayload)
+            {
+                fWriteFailed = true;
+                break;
+            };
+            ofs += SMSG_HDR_LEN + item.nPayload;
+
+            vIndex.resize(vIndex.size() + SMSG_IDX_RECORD_LEN);
+            EncodeIndexRecord(token, item.nPayload, &vIndex[vIndex.size() - SMSG_IDX_RECORD_LEN]);
+
+            bucket.AddToken(token);
+            if (nDaysToLive > 0 && (bucket.nLeastTTL == 0 || nDaysToLive < bucket.nLeastTTL))
+                bucket.nLeastTTL = nDaysToLive;
+            ScheduleBucket(bucketTime, bucket);
+
+            vItems[nKeep++] = item;
+        };
+
+        fclose(fp);
+        if (fWriteFailed)
+        {
+            vItems.resize(nKeep);
+            return errorN(SMSG_GENERAL_ERROR, "fwrite failed: %s.", strerror(errno));
+        };
+
+        if (!vIndex.empty()
+            && !AppendBucketIndex(bucketTime, ofsStart == 0, vIndex))
+        {
+            // Rebuilt from the bucket file on the next start
+            LogPrintf("%s: Failed to index messages, removing index of bucket %d.\n", __func__, bucketTime);
+            try { fs::remove(GetBucketIndexPath(bucketTime));
+            } catch (const fs::filesystem_error &ex)
+            {
+                LogPrintf("Error removing bucket index file %s.\n", ex.what());
+            };
+        };
+    };
+    vItems.resize(nKeep);
+
+    return SMSG_NO_ERROR;
+};
+
 int CSMSG::Store(const SecureMessage &smsg, bool fHashBucket)
 {
     return Store(smsg.data(), smsg.pPayload, smsg.nPayload, fHashBucket);
@@ -3140,50 +4431,122 @@ int CSMSG::Purge(std::vector<uint8_t> &vMsgId, std::string &sError)
     // Find in buckets
     int64_t bucketTime = msgtime - (msgtime % SMSG_BUCKET_LEN);
 
-    SecMsgBucket &bucket = buckets[bucketTime];
-    std::set<SecMsgToken> &tokenSet = bucket.setTokens;
-
-    std::vector<uint8_t> vchOne;
-    for (auto it = tokenSet.begin(); it != tokenSet.end(); ++it)
     {
-        if (it->timestamp != msgtime)
-            continue;
-
-        if (Retrieve(*it, vchOne) != SMSG_NO_ERROR)
+        boost::shared_lock<boost::shared_mutex> lock(cs_buckets);
+        auto itb = buckets.find(bucketTime);
+        if (itb != buckets.end())
         {
-            LogPrintf("%s: Retrieve failed, msgid: %s\n", __func__, HexStr(vMsgId));
-            continue;
-        };
+            SecMsgBucket &bucket = itb->second;
+            LOCK(bucket.cs_bucket);
+            SecMsgTokenSet &tokenSet = bucket.setTokens;
 
-        const SecureMessage *psmsg = (SecureMessage*) vchOne.data();
-        if (GetMsgID(psmsg, vchOne.data() + SMSG_HDR_LEN) != vMsgId)
-            continue;
+            std::vector<uint8_t> vchOne;
+            for (auto it = tokenSet.begin(); it != tokenSet.end(); ++it)
+            {
+                if (it->timestamp != msgtime)
+                    continue;
 
-        if (Remove(*it) != SMSG_NO_ERROR)
-        {
-            LogPrintf("%s: Remove failed, msgid: %s\n", __func__, HexStr(vMsgId));
-            break;
-        };
-        memcpy(purged.sample, vchOne.data() + SMSG_HDR_LEN, 8);
-        it->ttl = 0;
-        LogPrint(BCLog::SMSG, "Purged message %s in bucket %d\n", it->ToString(), bucketTime);
-        memcpy(purged.sample, it->sample, 8);
+                if (Retrieve(*it, vchOne) != SMSG_NO_ERROR)
+                {
+                    LogPrintf("%s: Retrieve failed, msgid: %s\n", __func__, HexStr(vMsgId));
+                    continue;
+                };
 
-        break;
-    };
+                const SecureMessage *psmsg = (SecureMessage*) vchOne.data();
+                if (GetMsgID(psmsg, vchOne.data() + SMSG_HDR_LEN) != vMsgId)
+                    continue;
+
+                if (Remove(*it) != SMSG_NO_ERROR)
+                {
+                    LogPrintf("%s: Remove failed, msgid: %s\n", __func__, HexStr(vMsgId));
+                    break;
+                };
+                memcpy(purged.sample, vchOne.data() + SMSG_HDR_LEN, 8);
+                bucket.SetTokenTTL(it, 0);
+                ScheduleBucket(bucketTime, bucket);
+                LogPrint(BCLog::SMSG, "Purged message %s in bucket %d\n", it->ToString(), bucketTime);
+                memcpy(purged.sample, it->sample, 8);
+
+                break;
+            };
+        };
+    } // cs_buckets
 
     chKey[0] = 'p';
     db.WritePurged(chKey, purged);
 
     setPurged.insert(purged);
-    setPurgedTimestamps.insert(purged.timestamp); // So network sync can prefilter on timestamp before checking for purged msgid in db
+    setPurgedTimestamps.insert(purged.timestamp); // So network sync can prefilter on timestamp before checking for purged msgid
+    mapPurgedIds[uint160(std::vector<uint8_t>(vMsgId.begin() + 8, vMsgId.begin() + 28))] = purged.timepurged;
 
 
     return SMSG_NO_ERROR;
 };
 
+bool CSMSG::GetFundingTxnDepth(const uint256 &txid, int &nDepth, bool &fCoinStake)
+{
+    AssertLockHeld(cs_main);
+
+    std::map<uint256, SecMsgFunding>::iterator it = mapFundingTxns.find(txid);
+    if (it != mapFundingTxns.end())
+    {
+        const CBlockIndex *pindex = chainActive[it->second.nHeight];
+        if (pindex && pindex->GetBlockHash() == it->second.hashBlock)
+        {
+            nDepth = chainActive.Height() - it->second.nHeight + 1;
+            fCoinStake = it->second.fCoinStake;
+            return true;
+        };
+        mapFundingTxns.erase(it); // Reorged out, the txn may be in another block now
+    };
+
+    // Nothing new can be found until the next block
+    const CBlockIndex *pindexTip = chainActive.Tip();
+    uint256 hashTip = pindexTip ? pindexTip->GetBlockHash() : uint256();
+    if (hashTip != hashFundingMissingTip)
+    {
+        setFundingMissing.clear();
+        hashFundingMissingTip = hashTip;
+    };
+    if (setFundingMissing.count(txid))
+        return false;
+
+    CTransactionRef txOut;
+    uint256 hashBlock;
+    BlockMap::iterator mi;
+    if (!GetTransaction(txid, txOut, Params().GetConsensus(), hashBlock)
+        || hashBlock.IsNull()
+        || (mi = mapBlockIndex.find(hashBlock)) == mapBlockIndex.end()
+        || !chainActive.Contains(mi->second))
+    {
+        if (setFundingMissing.size() >= SMSG_MAX_FUNDING_TXNS)
+            setFundingMissing.clear();
+        setFundingMissing.insert(txid);
+        return false;
+    };
+
+    SecMsgFunding funding;
+    funding.hashBlock = hashBlock;
+    funding.nHeight = mi->second->nHeight;
+    funding.fCoinStake = txOut->IsCoinStake();
+
+    nDepth = chainActive.Height() - funding.nHeight + 1;
+    fCoinStake = funding.fCoinStake;
+
+    if (mapFundingTxns.emplace(txid, funding).second)
+        listFundingTxns.push_back(txid);
+    while (listFundingTxns.size() > SMSG_MAX_FUNDING_TXNS)
+    {
+        mapFundingTxns.erase(listFundingTxns.front());
+        listFundingTxns.pop_front();
+    };
+    return true;
+};
+
 int CSMSG::Validate(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t nPayload)
 {
+    CPerfTimer timer(PERF_HISTOGRAM("smsg:validate"));
+    PERF_COUNTER("smsg:validated")++;
     // return SecureMessageCodes
     SecureMessage *psmsg = (SecureMessage*) pHeader;
 
@@ -3237,25 +4600,16 @@ int CSMSG::Validate(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t nP
             return SMSG_GENERAL_ERROR;
         };
 
-        CTransactionRef txOut;
-        uint256 hashBlock;
+        int blockDepth;
+        bool fCoinStake;
         {
             LOCK(cs_main);
-            if (!GetTransaction(txid, txOut, Params().GetConsensus(), hashBlock) || hashBlock.IsNull())
+            if (!GetFundingTxnDepth(txid, blockDepth, fCoinStake))
                 return errorN(SMSG_GENERAL_ERROR, "%s: Transaction %s not found for message %s.\n", __func__, txid.ToString(), msgId.ToString());
 
-            if (txOut->IsCoinStake())
+            if (fCoinStake)
                 return errorN(SMSG_GENERAL_ERROR, "%s: Transaction %s for message %s, is coinstake.\n", __func__, txid.ToString(), msgId.ToString());
 
-            int blockDepth = -1;
-            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-            if (mi != mapBlockIndex.end())
-            {
-                CBlockIndex *pindex = mi->second;
-                if (pindex && chainActive.Contains(pindex))
-                    blockDepth = chainActive.Height() - pindex->nHeight + 1;
-            };
-
             if (blockDepth < 1)
                 return errorN(SMSG_GENERAL_ERROR, "%s: Transaction %s for message %s, low depth %d.\n", __func__, txid.ToString(), msgId.ToString(), blockDepth);
 
@@ -3303,64 +4657,111 @@ int CSMSG::Validate(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t nP
     return rv;
 };
 
-int CSMSG::SetHash(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload)
+static bool IsValidPowHash(const uint8_t *sha256Hash)
 {
-    /*  proof of work and checksum
+    return sha256Hash[31] == 0
+        && sha256Hash[30] == 0
+        && (~(sha256Hash[29]) & ((1<<0) | (1<<1) | (1<<2)));
+};
 
-        May run in a thread, if shutdown detected, return.
+struct SecMsgPowSearch
+{
+    const uint8_t *pHeader;
+    const uint8_t *pPayload;
+    uint32_t nPayload;
 
-        returns SecureMessageCodes
-    */
+    std::atomic<bool> fDone{false};
+    std::mutex mtx;
+    bool fFound = false;
+    uint32_t nonce = 0;
+    uint8_t sha256Hash[32];
+};
 
-    SecureMessage *psmsg = (SecureMessage*) pHeader;
+static void SearchPowNonces(SecMsgPowSearch &search, uint32_t nFirst, uint32_t nStep)
+{
+    // Tries nFirst, nFirst + nStep, ... until a match, another thread finishes or shutdown
+    uint8_t header[SMSG_HDR_LEN];
+    memcpy(header, search.pHeader, SMSG_HDR_LEN);
+    SecureMessage *psmsg = (SecureMessage*) header;
 
-    int64_t nStart = GetTimeMillis();
     uint8_t civ[32];
     uint8_t sha256Hash[32];
 
-    bool found = false;
-
-    uint32_t nonce = 0;
-    memcpy(&nonce, &psmsg->nonce[0], 4);
-
-    //CBigNum bnTarget(2);
-    //bnTarget = bnTarget.pow(256 - 40);
-
-    // Break for HMAC_CTX_cleanup
-    for (;;)
+    for (uint64_t n = nFirst; n <= std::numeric_limits<uint32_t>::max(); n += nStep)
     {
-        if (!fSecMsgEnabled)
-           break;
+        if (search.fDone || !fSecMsgEnabled)
+            return;
 
-        //psmsg->timestamp = GetTime();
-        //memcpy(&psmsg->timestamp, &now, 8);
+        uint32_t nonce = n;
         memcpy(&psmsg->nonce[0], &nonce, 4);
 
         for (int i = 0; i < 32; i+=4)
             memcpy(civ+i, &nonce, 4);
 
         CHMAC_SHA256 ctx(&civ[0], 32);
-        ctx.Write((uint8_t*) pHeader+4, SMSG_HDR_LEN-4);
-        ctx.Write((uint8_t*) pPayload, nPayload);
+        ctx.Write(header+4, SMSG_HDR_LEN-4);
+        ctx.Write(search.pPayload, search.nPayload);
         ctx.Finalize(sha256Hash);
 
-        if (sha256Hash[31] == 0
-            && sha256Hash[30] == 0
-            && (~(sha256Hash[29]) & ((1<<0) | (1<<1) | (1<<2))))
-        //    && sha256Hash[29] == 0)
+        if (IsValidPowHash(sha256Hash))
         {
-            found = true;
-            //if (fDebugSmsg)
-            //    LogPrintf("Match %u\n", nonce);
-            break;
+            std::lock_guard<std::mutex> lock(search.mtx);
+            if (!search.fFound)
+            {
+                search.fFound = true;
+                search.nonce = nonce;
+                memcpy(search.sha256Hash, sha256Hash, 32);
+            };
+            search.fDone = true;
+            return;
         };
+    };
+};
+
+int CSMSG::SetHash(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload)
+{
+    return SetHash(pHeader, pPayload, nPayload, nPowThreads);
+};
+
+int CSMSG::SetHash(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload, size_t nThreadsIn)
+{
+    CPerfTimer timer(PERF_HISTOGRAM("smsg:pow"));
+    /*  proof of work and checksum
+
+        May run in a thread, if shutdown detected, return.
+        The nonce space is split over nThreadsIn threads.
+
+        returns SecureMessageCodes
+    */
+
+    SecureMessage *psmsg = (SecureMessage*) pHeader;
+
+    int64_t nStart = GetTimeMillis();
+
+    uint32_t nonce = 0;
+    memcpy(&nonce, &psmsg->nonce[0], 4);
 
-        if (nonce >= 4294967295U) // UINT32_MAX
+    SecMsgPowSearch search;
+    search.pHeader = pHeader;
+    search.pPayload = pPayload;
+    search.nPayload = nPayload;
+
+    uint32_t nThreads = std::max(nThreadsIn, (size_t)1);
+    if (nThreads == 1)
+    {
+        SearchPowNonces(search, nonce, 1);
+    } else
+    {
+        std::vector<std::thread> vThreads;
+        for (uint32_t i = 1; i < nThreads; ++i)
         {
-            LogPrint(BCLog::SMSG, "No match %u\n", nonce);
-            break;
+            if ((uint64_t)nonce + i > std::numeric_limits<uint32_t>::max())
+                break;
+            vThreads.emplace_back(SearchPowNonces, std::ref(search), nonce + i, nThreads);
         };
-        nonce++;
+        SearchPowNonces(search, nonce, nThreads);
+        for (auto &t : vThreads)
+            t.join();
     };
 
     if (!fSecMsgEnabled)
@@ -3369,15 +4770,16 @@ int CSMSG::SetHash(uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload)
         return SMSG_SHUTDOWN_DETECTED;
     };
 
-    if (!found)
+    if (!search.fFound)
     {
         LogPrint(BCLog::SMSG, "%s: Failed, took %d ms, nonce %u\n", __func__, GetTimeMillis() - nStart, nonce);
         return SMSG_GENERAL_ERROR;
     };
 
-    memcpy(psmsg->hash, sha256Hash, 4);
+    memcpy(&psmsg->nonce[0], &search.nonce, 4);
+    memcpy(psmsg->hash, search.sha256Hash, 4);
 
-    LogPrint(BCLog::SMSG, "%s: Took %d ms, nonce %u\n", __func__, GetTimeMillis() - nStart, nonce);
+    LogPrint(BCLog::SMSG, "%s: Took %d ms, nonce %u, %u thread%s\n", __func__, GetTimeMillis() - nStart, search.nonce, nThreads, nThreads > 1 ? "s" : "");
 
     return SMSG_NO_ERROR;
 };
@@ -3434,7 +4836,7 @@ int CSMSG::Encrypt(SecureMessage &smsg, const CKeyID &addressFrom, const CKeyID
     };
 
     // Generate 16 random bytes as IV.
-    GetStrongRandBytes(&smsg.iv[0], 16);
+    GetFastRandBytes(&smsg.iv[0], 16);
 
     // Generate a new random EC key pair with private key called r and public key called R.
     CKey keyR;
@@ -3465,53 +4867,59 @@ int CSMSG::Encrypt(SecureMessage &smsg, const CKeyID &addressFrom, const CKeyID
     std::vector<uint8_t> key_m(&vchHashed[32], &vchHashed[32]+32);
 
     std::vector<uint8_t> vchPayload;
-    std::vector<uint8_t> vchCompressed;
-    uint8_t *pMsgData;
-    uint32_t lenMsgData;
 
     uint32_t lenMsg = message.size();
+    uint32_t lenHdr = fSendAnonymous ? 9 : SMSG_PL_HDR_LEN;
+    uint32_t lenMsgData;
+    uint32_t nPlainLenField = lenMsg;
+
+    // Compress straight into the payload, after the header
+    int worstCase = LZ4_compressBound(lenMsg);
+    try { vchPayload.resize(lenHdr + worstCase); } catch (std::exception &e)
+    {
+        return errorN(SMSG_ALLOCATE_FAILED, "%s: vchPayload.resize %u threw: %s.", __func__, lenHdr + worstCase, e.what());
+    };
+
+    int lenComp = 0;
+    if (fCompressDict && lenMsg > 0)
+    {
+        // Compressing against the dictionary pays off for small messages too,
+        // use it when smaller or when the message must be compressed anyway.
+        lenComp = CompressPayload((const uint8_t*)message.data(), lenMsg, &vchPayload[lenHdr], worstCase, true);
+        if (lenComp > 0 && (lenMsg > 128 || (uint32_t)lenComp < lenMsg))
+            nPlainLenField |= SMSG_PL_DICT_FLAG;
+        else
+            lenComp = 0;
+    };
+
+    if (lenComp > 0)
+    {
+        lenMsgData = lenComp;
+    } else
     if (lenMsg > 128)
     {
         // Only compress if over 128 bytes
-        int worstCase = LZ4_compressBound(message.size());
-        try { vchCompressed.resize(worstCase); } catch (std::exception &e)
-        {
-            return errorN(SMSG_ALLOCATE_FAILED, "%s: vchCompressed.resize %u threw: %s.", __func__, worstCase, e.what());
-        };
-
-        int lenComp = LZ4_compress((char*)message.c_str(), (char*)vchCompressed.data(), lenMsg);
+        lenComp = CompressPayload((const uint8_t*)message.data(), lenMsg, &vchPayload[lenHdr], worstCase, false);
         if (lenComp < 1)
         {
             return errorN(SMSG_COMPRESS_FAILED, "%s: Could not compress message data.", __func__);
         };
-
-        pMsgData = vchCompressed.data();
         lenMsgData = lenComp;
     } else
     {
         // No compression
-        pMsgData = (uint8_t*)message.c_str();
+        memcpy(&vchPayload[lenHdr], message.data(), lenMsg);
         lenMsgData = lenMsg;
     };
+    vchPayload.resize(lenHdr + lenMsgData);
 
     if (fSendAnonymous)
     {
-        try { vchPayload.resize(9 + lenMsgData); } catch (std::exception &e) {
-            return errorN(SMSG_ALLOCATE_FAILED, "%s: vchPayload.resize %u threw: %s.", __func__, 9 + lenMsgData, e.what());
-        };
-
-        memcpy(&vchPayload[9], pMsgData, lenMsgData);
-
         vchPayload[0] = 250; // id as anonymous message
         // Next 4 bytes are unused - there to ensure encrypted payload always > 8 bytes
-        memcpy(&vchPayload[5], &lenMsg, 4); // length of uncompressed plain text
+        memcpy(&vchPayload[5], &nPlainLenField, 4); // length of uncompressed plain text
     } else
     {
-        try { vchPayload.resize(SMSG_PL_HDR_LEN + lenMsgData); } catch (std::exception &e) {
-            return errorN(SMSG_ALLOCATE_FAILED, "%s: vchPayload.resize %u threw: %s.", __func__, SMSG_PL_HDR_LEN + lenMsgData, e.what());
-        };
-
-        memcpy(&vchPayload[SMSG_PL_HDR_LEN], pMsgData, lenMsgData);
         // Compact signature proves ownership of from address and allows the public key to be recovered, recipient can always reply.
         if (!pwallet->GetKey(ckidFrom, keyFrom))
         {
@@ -3528,7 +4936,7 @@ int CSMSG::Encrypt(SecureMessage &smsg, const CKeyID &addressFrom, const CKeyID
         memcpy(&vchPayload[1], ckidFrom.begin(), 20); // memcpy(&vchPayload[1], ckidDest.pn, 20);
 
         memcpy(&vchPayload[1+20], &vchSignature[0], vchSignature.size());
-        memcpy(&vchPayload[1+20+65], &lenMsg, 4); // length of uncompressed plain text
+        memcpy(&vchPayload[1+20+65], &nPlainLenField, 4); // length of uncompressed plain text, and the dictionary flag
     };
 
     SecMsgCrypter crypter;
@@ -3901,16 +5309,21 @@ int CSMSG::Decrypt(bool fTestOnly, const CKey &keyDest, const CKeyID &address, c
         pMsgData = &vchPayload[SMSG_PL_HDR_LEN];
     };
 
+    bool fDictionary = lenPlain & SMSG_PL_DICT_FLAG;
+    lenPlain &= ~SMSG_PL_DICT_FLAG;
+    if (fDictionary && lenPlain > SMSG_MAX_MSG_BYTES_PAID)
+        return errorN(SMSG_GENERAL_ERROR, "%s: Message too large, %u.", __func__, lenPlain);
+
     try {
         msg.vchMessage.resize(lenPlain + 1);
     } catch (std::exception &e) {
         return errorN(SMSG_ALLOCATE_FAILED, "%s: msg.vchMessage.resize %u threw: %s.", __func__, lenPlain + 1, e.what());
     };
 
-    if (lenPlain > 128)
+    if (fDictionary || lenPlain > 128)
     {
         // Decompress
-        if (LZ4_decompress_safe((char*) pMsgData, (char*) &msg.vchMessage[0], lenData, lenPlain) != (int) lenPlain)
+        if (!DecompressPayload(pMsgData, lenData, &msg.vchMessage[0], lenPlain, fDictionary))
             return errorN(SMSG_GENERAL_ERROR, "%s: Could not decompress message data.", __func__);
     } else
     {
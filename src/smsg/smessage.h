@@ -10,10 +10,20 @@
 #include <key_io.h>
 #include <net.h>
 #include <serialize.h>
+#include <span.h>
 #include <ui_interface.h>
 #include <lz4/lz4.h>
 #include <smsg/keystore.h>
 #include <interfaces/handler.h>
+#include <xxhash/xxhash.h>
+
+#include <limits>
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <boost/thread/shared_mutex.hpp>
 
 
 class CWallet;
@@ -58,6 +68,7 @@ enum SecureMessageCodes {
 
 const unsigned int SMSG_HDR_LEN        = 104;               // length of unencrypted header, 4 + 2 + 1 + 8 + 16 + 33 + 32 + 4 + 4
 const unsigned int SMSG_PL_HDR_LEN     = 1+20+65+4;         // length of encrypted header in payload
+const unsigned int SMSG_IDX_RECORD_LEN = 8+8+8+4+1;         // bucket index record, timestamp, sample, offset, nPayload, ttl
 
 const unsigned int SMSG_BUCKET_LEN     = 60 * 60 * 1;       // seconds
 const unsigned int SMSG_RETENTION_OLD  = 60 * 60 * 48;      // seconds
@@ -72,6 +83,17 @@ const unsigned int SMSG_THREAD_LOG_GAP = 6;
 const unsigned int SMSG_TIME_LEEWAY    = 24;
 const unsigned int SMSG_TIME_IGNORE    = 90;                // seconds a peer is ignored for if they fail to deliver messages for a smsgWant
 
+const unsigned int SMSG_IBLT_HASH_FUNCS = 3;                // cells a token is added to, one in each third of the table
+const unsigned int SMSG_IBLT_CELL_LEN  = 4 + 16 + 4;        // count, xor of timestamp and sample, xor of checksum
+const unsigned int SMSG_IBLT_MIN_CELLS = SMSG_IBLT_HASH_FUNCS * 8;
+const unsigned int SMSG_IBLT_MAX_CELLS = SMSG_IBLT_HASH_FUNCS * 2048;
+const unsigned int SMSG_RECON_SLACK    = 16;                // differences expected beyond the difference in bucket sizes
+
+const unsigned int SMSG_SCAN_CHUNK     = 16;                // trial decryptions a scan thread takes at a time, fewer in total run on the calling thread
+const unsigned int SMSG_SCAN_BATCH     = 256;               // messages read from a bucket file and scanned together
+const unsigned int SMSG_SCAN_CHAIN_COMMIT = 10000;          // blocks per smsgdb transaction when scanning the chain
+const unsigned int SMSG_MAX_FUNDING_TXNS = 4096;            // confirmed funding txns remembered, oldest forgotten first, also the most missing txns remembered
+
 
 const unsigned int SMSG_MAX_MSG_BYTES  = 24000;             // the user input part
 const unsigned int SMSG_MAX_AMSG_BYTES = 512;               // the user input part (ANON)
@@ -82,6 +104,12 @@ const unsigned int SMSG_MAX_MSG_WORST = LZ4_COMPRESSBOUND(SMSG_MAX_MSG_BYTES+SMS
 const unsigned int SMSG_MAX_MSG_WORST_PAID = LZ4_COMPRESSBOUND(SMSG_MAX_MSG_BYTES_PAID+SMSG_PL_HDR_LEN);
 
 static const int MIN_SMSG_PROTO_VERSION = 90007;
+//! In this version, buckets may be reconciled with smsgReconReq/smsgRecon
+static const int SMSG_RECON_PROTO_VERSION = 100001;
+
+static const int DEFAULT_SMSG_POW_THREADS = 1;
+static const int DEFAULT_SMSG_SCAN_THREADS = 0;
+static const bool DEFAULT_SMSG_COMPRESS_DICT = false;
 
 
 const CAmount nFundingTxnFeePerK = 200000;
@@ -90,6 +118,7 @@ const CAmount nMsgFeePerKPerDay =   50000;
 #define SMSG_MASK_UNREAD (1 << 0)
 
 class SecMsgStored;
+class SecMsgDB;
 
 // Inbox db changed, called with lock cs_smsgDB held.
 extern boost::signals2::signal<void (SecMsgStored &inboxHdr)> NotifySecMsgInboxChanged;
@@ -185,6 +214,30 @@ public:
     std::vector<uint8_t>  vchMessage;         // null terminated plaintext
 };
 
+//! A message to scan, pointing into the caller's buffer
+struct SecMsgScanItem
+{
+    const uint8_t *pHeader;
+    const uint8_t *pPayload;
+    uint32_t nPayload;
+};
+
+//! Where a paid message funding txn confirmed
+struct SecMsgFunding
+{
+    uint256 hashBlock;
+    int nHeight = 0;
+    bool fCoinStake = false;
+};
+
+//! A key messages are trial decrypted with
+struct SecMsgScanKey
+{
+    CKeyID address;
+    CKey key;
+    bool fFullDecrypt;   // Have to do full decrypt to see address from
+};
+
 class SecMsgToken
 {
 public:
@@ -254,6 +307,37 @@ public:
     int64_t timepurged;
 };
 
+/**
+ * Tokens of a bucket in one sorted vector.
+ * Tokens mostly arrive in timestamp order, so insert is usually an append.
+ */
+class SecMsgTokenSet
+{
+public:
+    typedef std::vector<SecMsgToken>::const_iterator const_iterator;
+    typedef const_iterator iterator;
+
+    const_iterator begin() const { return vTokens.begin(); };
+    const_iterator end() const { return vTokens.end(); };
+    const SecMsgToken &back() const { return vTokens.back(); };
+    size_t size() const { return vTokens.size(); };
+    bool empty() const { return vTokens.empty(); };
+
+    const_iterator find(const SecMsgToken &token) const;
+    std::pair<const_iterator, bool> insert(const SecMsgToken &token);
+    //! Insert many tokens with one sort and merge, vInsert is consumed
+    void insert(std::vector<SecMsgToken> &vInsert);
+    void clear();
+
+    //! Counts changes to the set, a token's ttl is changed through SecMsgBucket::SetTokenTTL
+    uint64_t GetChanges() const { return nChanges; };
+
+private:
+    friend class SecMsgBucket;
+    std::vector<SecMsgToken> vTokens;
+    uint64_t nChanges = 0;
+};
+
 class SecMsgBucket
 {
 public:
@@ -267,16 +351,80 @@ public:
         nActive         = 0;
     };
 
+    /**
+     * Update hash, nActive and nLeastTTL.
+     * The hash is only recomputed over all tokens after a token was inserted
+     * out of order, expired or had its ttl changed.
+     */
     void hashBucket();
     size_t CountActive();
 
+    //! Insert a token, appends are added to the running hash state
+    bool AddToken(const SecMsgToken &token);
+    void AddTokens(std::vector<SecMsgToken> &vTokens);
+    bool SetTokenTTL(SecMsgTokenSet::const_iterator it, uint8_t ttl);
+
+    /**
+     * Earliest time ThreadSecureMsg needs to look at the bucket: the retention cutoff,
+     * the first token expiry or the lock timeout.
+     */
+    int64_t GetNextEvent(int64_t bucketTime) const;
+
     int64_t               timeChanged;
     uint32_t              hash;           // token set should get ordered the same on each node
-    uint32_t              nLockCount;     // set when smsgWant first sent, unset at end of smsgMsg, ticks down in ThreadSecureMsg()
+    uint32_t              nLockCount;     // set when smsgWant first sent, unset at end of smsgMsg, times out at nLockTimeout
+    int64_t               nLockTimeout = 0; // adjusted time the lock for nLockPeerId expires
+    int64_t               nEventTime = 0; // earliest event queued for the bucket in CSMSG::setBucketEvents, 0 if none
     uint32_t              nLeastTTL;      // lowest ttl in days of messages in bkt
     uint32_t              nActive;        // Number of untimedout messages in bucket
     NodeId                nLockPeerId;    // id of peer that bucket is locked for
-    std::set<SecMsgToken> setTokens;
+    SecMsgTokenSet        setTokens;
+
+    CCriticalSection      cs_bucket;      // all members and the bucket files, take with CSMSG::cs_buckets held
+
+private:
+    XXH32_stateSpace_t    hashState;      // Running hash over the samples of the active tokens
+    uint64_t              nHashedChanges = std::numeric_limits<uint64_t>::max(); // setTokens.GetChanges() covered by hashState
+    int64_t               nNextExpiry = 0; // First time an active token expires
+};
+
+/**
+ * Invertible bloom lookup table over the tokens of a bucket.
+ * Subtracting this node's table from a peer's leaves only the tokens held by
+ * one of the two, which can be listed while there are few enough of them.
+ */
+class SecMsgIBLT
+{
+public:
+    explicit SecMsgIBLT(uint32_t nCells);
+
+    //! Cells to expect to decode nDiff differences, 0 if more than SMSG_IBLT_MAX_CELLS
+    static uint32_t GetCellsFor(size_t nDiff);
+    static bool IsValidSize(uint32_t nCells);
+
+    uint32_t size() const { return vCells.size(); };
+
+    void Insert(const SecMsgToken &token);
+    bool Subtract(const SecMsgIBLT &other);
+
+    //! vHave receives tokens only in this table, vLack tokens only in the subtracted table
+    bool Decode(std::vector<SecMsgToken> &vHave, std::vector<SecMsgToken> &vLack) const;
+
+    void Serialize(std::vector<uint8_t> &vchData) const;
+    bool Unserialize(const uint8_t *p, size_t nBytes);
+
+private:
+    struct Cell
+    {
+        int32_t count = 0;
+        uint8_t key[16] = {0};
+        uint32_t check = 0;
+    };
+
+    void Update(std::vector<Cell> &vUpdate, const uint8_t *key, int32_t nCount) const;
+    bool IsPure(const Cell &cell) const;
+
+    std::vector<Cell> vCells;
 };
 
 class SecMsgAddress
@@ -367,6 +515,13 @@ public:
     };
 };
 
+//! A message a batched scan saved to the inbox, notified once the batch is committed
+struct SecMsgInboxAdded
+{
+    SecMsgStored smsgInbox;
+    uint160 hash;
+};
+
 void AddOptions();
 const char *GetString(size_t errorCode);
 
@@ -401,6 +556,22 @@ public:
     int WalletKeyChanged(CKeyID &keyId, const std::string &sLabel, ChangeType mode);
 
     int ScanMessage(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t nPayload, bool reportToGui);
+    int ScanMessage(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t nPayload, bool reportToGui,
+        const std::vector<SecMsgScanKey> &vKeys, int nFirst, int rvKeys,
+        SecMsgDB *pdbInbox = nullptr, std::vector<SecMsgInboxAdded> *pvAdded = nullptr);
+    //! Scan a batch of messages, nFound counts the messages ScanMessage would return SMSG_NO_ERROR for
+    int ScanMessages(const std::vector<SecMsgScanItem> &vItems, bool reportToGui, uint32_t &nFound);
+    //! Notify the gui, -smsgnotify and the validation interface of a message saved to the inbox
+    void NotifyInboxAdded(SecMsgStored &smsgInbox, const uint160 &hash, bool reportToGui);
+
+    //! Keys to scan with in the order they are tried, returns SMSG_WALLET_LOCKED if wallet keys were left out
+    int GetScanKeys(std::vector<SecMsgScanKey> &vKeys);
+    /**
+     * Set vFirst[i] to the index of the first key in vKeys message i passes the MAC check of, -1 if none.
+     * The trials are split over nThreads, secp256k1_context_smsg is only read.
+     */
+    void FindFirstKeys(const std::vector<SecMsgScanItem> &vItems, const std::vector<SecMsgScanKey> &vKeys,
+        std::vector<int> &vFirst, size_t nThreads);
 
     int GetStoredKey(const CKeyID &ckid, CPubKey &cpkOut);
     int GetLocalKey(const CKeyID &ckid, CPubKey &cpkOut);
@@ -415,16 +586,20 @@ public:
 
     int ReadSmsgKey(const CKeyID &idk, CKey &key);
 
+    //! Retrieve and Remove are called with the cs_bucket of the token's bucket held
     int Retrieve(const SecMsgToken &token, std::vector<uint8_t> &vchData);
     int Remove(const SecMsgToken &token);
 
-    int Receive(CNode *pfrom, std::vector<uint8_t> &vchData);
+    int Receive(CNode *pfrom, Span<const uint8_t> vchData);
+    //! Send smsgWant for the offered tokens of bucket time this node doesn't have
+    int RequestTokens(CNode *pfrom, int64_t time, const std::vector<SecMsgToken> &vOffered);
 
     int CheckPurged(const SecureMessage *psmsg, const uint8_t *pPayload);
 
     int StoreUnscanned(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t nPayload);
     int Store(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t nPayload, bool fHashBucket);
     int Store(const SecureMessage &smsg, bool fHashBucket);
+    int Store(std::vector<SecMsgScanItem> &vItems);
 
     int Purge(std::vector<uint8_t> &vMsgId, std::string &sError);
 
@@ -439,7 +614,14 @@ public:
     std::vector<uint8_t> GetMsgID(const SecureMessage &smsg);
 
     int Validate(const uint8_t *pHeader, const uint8_t *pPayload, uint32_t nPayload);
+    /**
+     * Get the depth of a paid message funding txn in the active chain, checking the remembered
+     * funding txns before GetTransaction. A txn that wasn't found is remembered until the tip
+     * changes, messages sharing a funding txn only look it up once. cs_main must be held.
+     */
+    bool GetFundingTxnDepth(const uint256 &txid, int &nDepth, bool &fCoinStake);
     int SetHash (uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload);
+    int SetHash (uint8_t *pHeader, uint8_t *pPayload, uint32_t nPayload, size_t nThreads);
 
     int Encrypt(SecureMessage &smsg, const CKeyID &addressFrom, const CKeyID &addressTo, const std::string &message);
 
@@ -449,18 +631,41 @@ public:
     int Decrypt(bool fTestOnly, const CKeyID &address, const uint8_t *pHeader, const uint8_t *pPayload, uint32_t nPayload, MessageData &msg);
     int Decrypt(bool fTestOnly, const CKeyID &address, const SecureMessage &smsg, MessageData &msg);
 
-    CCriticalSection cs_smsg; // all except inbox and outbox
+    //! Add an empty bucket if bucketTime has none, fails while the files of a removed bucket are deleted
+    bool CreateBucket(int64_t bucketTime);
+
+    //! Queue the next maintenance event of bucket, take with bucket.cs_bucket held
+    void ScheduleBucket(int64_t bucketTime, SecMsgBucket &bucket);
+
+    CCriticalSection cs_smsg; // all except inbox, outbox and buckets
+
+    /**
+     * Guards the buckets map, held shared while a bucket is used and exclusively to add or erase buckets.
+     * Not recursive, take after cs_smsg and cs_smsgDB and before SecMsgBucket::cs_bucket.
+     */
+    boost::shared_mutex cs_buckets;
 
     SecMsgKeyStore keyStore;
     std::map<int64_t, SecMsgBucket> buckets;
+    std::set<int64_t> setBucketsRemoving; // erased buckets whose files are being deleted, cs_buckets
+    std::set<std::pair<int64_t, int64_t> > setBucketEvents; // (event time, bucket time) ordered by time, cs_bucket_events
+    CCriticalSection cs_bucket_events; // setBucketEvents only, take last
     std::vector<SecMsgAddress> addresses;
     std::set<SecMsgPurged> setPurged;
     std::set<int64_t> setPurgedTimestamps;
+    std::map<uint160, int64_t> mapPurgedIds; // message hash part of the purged message ids -> time purged, cs_smsg
+    std::map<uint256, SecMsgFunding> mapFundingTxns; // txid -> where the txn confirmed, cs_main
+    std::list<uint256> listFundingTxns; // insertion order of mapFundingTxns
+    std::set<uint256> setFundingMissing; // txids GetTransaction didn't find at hashFundingMissingTip, cs_main
+    uint256 hashFundingMissingTip;
     SecMsgOptions options;
     std::shared_ptr<CWallet> pwallet;
     std::unique_ptr<interfaces::Handler> m_handler_unload;
 
     int64_t nLastProcessedPurged = 0;
+    size_t nPowThreads = DEFAULT_SMSG_POW_THREADS; // SetHash threads, also the size of the outbox worker pool
+    size_t nScanThreads = 1; // threads to trial decrypt incoming messages with
+    bool fCompressDict = DEFAULT_SMSG_COMPRESS_DICT; // compress sent messages against the built-in dictionary
 };
 
 } // namespace smsg
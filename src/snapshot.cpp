@@ -0,0 +1,193 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <snapshot.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <coins.h>
+#include <hash.h>
+#include <rctindex.h>
+#include <streams.h>
+#include <txdb.h>
+#include <util.h>
+#include <validation.h>
+
+#include <boost/thread.hpp>
+
+static uint256 GetSnapshotHash(const CTxOutSetSnapshotMetadata &metadata, const uint256 &hashRecords)
+{
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << metadata << hashRecords;
+    return ss.GetHash();
+}
+
+bool DumpTxOutSetSnapshot(const fs::path &path, CTxOutSetSnapshotMetadata &metadata, uint256 &hashSnapshot, std::string &strError)
+{
+    // No block may be connected while the coins and block tree dbs are read
+    LOCK(cs_main);
+    FlushStateToDisk();
+
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+    const CBlockIndex *pindex = LookupBlockIndex(pcursor->GetBestBlock());
+    if (!pindex) {
+        strError = "Best block of the coins db is not in the block index";
+        return false;
+    }
+
+    metadata = CTxOutSetSnapshotMetadata();
+    metadata.hashBaseBlock = pindex->GetBlockHash();
+    metadata.nHeight = pindex->nHeight;
+    metadata.bnStakeModifier = pindex->bnStakeModifier;
+    metadata.nMoneySupply = pindex->GetMoneySupply();
+    metadata.nAnonOutputs = pindex->nAnonOutputs;
+
+    fs::path pathTmp = path.string() + ".incomplete";
+    CAutoFile fileout(fsbridge::fopen(pathTmp, "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        strError = strprintf("Failed to open %s for writing", pathTmp.string());
+        return false;
+    }
+
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    try {
+        fileout << metadata; // Rewritten with the counts at the end
+
+        for (; pcursor->Valid(); pcursor->Next()) {
+            boost::this_thread::interruption_point();
+            COutPoint key;
+            Coin coin;
+            if (!pcursor->GetKey(key) || !pcursor->GetValue(coin)) {
+                strError = "Unable to read the coins db";
+                return false;
+            }
+            fileout << key << coin;
+            hasher << key << coin;
+            metadata.nCoins++;
+        }
+
+        for (int64_t i = 1; i <= (int64_t)metadata.nAnonOutputs; ++i) {
+            boost::this_thread::interruption_point();
+            CAnonOutput ao;
+            if (!pblocktree->ReadRCTOutput(i, ao)) {
+                strError = strprintf("Unable to read RCT output %d", i);
+                return false;
+            }
+            fileout << ao;
+            hasher << ao;
+        }
+
+        std::unique_ptr<CDBIterator> pdbcursor(pblocktree->NewIterator());
+        for (pdbcursor->Seek(DB_RCTKEYIMAGE); pdbcursor->Valid(); pdbcursor->Next()) {
+            boost::this_thread::interruption_point();
+            std::pair<char, CCmpPubKey> key;
+            uint256 txhash;
+            if (!pdbcursor->GetKey(key) || key.first != DB_RCTKEYIMAGE)
+                break;
+            if (!pdbcursor->GetValue(txhash)) {
+                strError = "Unable to read a key image";
+                return false;
+            }
+            fileout << key.second << txhash;
+            hasher << key.second << txhash;
+            metadata.nKeyImages++;
+        }
+
+        hashSnapshot = GetSnapshotHash(metadata, hasher.GetHash());
+        fileout << hashSnapshot;
+
+        if (fseek(fileout.Get(), 0, SEEK_SET) != 0) {
+            strError = "Failed to rewrite the snapshot header";
+            return false;
+        }
+        fileout << metadata;
+    } catch (const std::exception &e) {
+        strError = strprintf("Failed to write the snapshot: %s", e.what());
+        return false;
+    }
+
+    if (!FileCommit(fileout.Get())) {
+        strError = "Failed to flush the snapshot";
+        return false;
+    }
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, path)) {
+        strError = strprintf("Failed to rename %s", pathTmp.string());
+        return false;
+    }
+
+    return true;
+}
+
+bool VerifyTxOutSetSnapshot(const fs::path &path, CTxOutSetSnapshotMetadata &metadata, uint256 &hashSnapshot, bool &fCommitted, std::string &strError)
+{
+    fCommitted = false;
+
+    CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        strError = strprintf("Failed to open %s", path.string());
+        return false;
+    }
+
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    uint256 hashStored;
+    try {
+        filein >> metadata;
+        if (metadata.nVersion != CTxOutSetSnapshotMetadata::CURRENT_VERSION) {
+            strError = strprintf("Unknown snapshot version %d", metadata.nVersion);
+            return false;
+        }
+
+        for (uint64_t i = 0; i < metadata.nCoins; ++i) {
+            boost::this_thread::interruption_point();
+            COutPoint key;
+            Coin coin;
+            filein >> key >> coin;
+            hasher << key << coin;
+        }
+
+        for (uint64_t i = 0; i < metadata.nAnonOutputs; ++i) {
+            boost::this_thread::interruption_point();
+            CAnonOutput ao;
+            filein >> ao;
+            hasher << ao;
+        }
+
+        for (uint64_t i = 0; i < metadata.nKeyImages; ++i) {
+            boost::this_thread::interruption_point();
+            CCmpPubKey ki;
+            uint256 txhash;
+            filein >> ki >> txhash;
+            hasher << ki << txhash;
+        }
+
+        filein >> hashStored;
+    } catch (const std::exception &e) {
+        strError = strprintf("Failed to read the snapshot: %s", e.what());
+        return false;
+    }
+
+    hashSnapshot = GetSnapshotHash(metadata, hasher.GetHash());
+    if (hashSnapshot != hashStored) {
+        strError = "Snapshot hash mismatch";
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        const CBlockIndex *pindex = LookupBlockIndex(metadata.hashBaseBlock);
+        if (!pindex || pindex->nHeight != metadata.nHeight) {
+            strError = strprintf("Base block %s is not in the block index", metadata.hashBaseBlock.ToString());
+            return false;
+        }
+    }
+
+    const auto &mapHashes = Params().TxOutSetSnapshotHashes();
+    auto mi = mapHashes.find(metadata.nHeight);
+    fCommitted = mi != mapHashes.end() && mi->second == hashSnapshot;
+
+    return true;
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_SNAPSHOT_H
+#define BITCOINC_SNAPSHOT_H
+
+#include <amount.h>
+#include <fs.h>
+#include <serialize.h>
+#include <uint256.h>
+
+#include <ios>
+#include <string.h>
+#include <string>
+
+static const unsigned char TXOUTSET_SNAPSHOT_MAGIC[4] = {'u', 't', 'x', 'o'};
+
+/**
+ * Header of a UTXO snapshot file written by dumptxoutset.
+ *
+ * The header is followed by nCoins (COutPoint, Coin) pairs, nAnonOutputs
+ * CAnonOutput records for indices 1 to nAnonOutputs, nKeyImages
+ * (key image, txid) pairs and the snapshot hash.
+ */
+class CTxOutSetSnapshotMetadata
+{
+public:
+    static const uint32_t CURRENT_VERSION = 1;
+
+    uint32_t nVersion = CURRENT_VERSION;
+    uint256 hashBaseBlock;
+    int nHeight = 0;
+    uint256 bnStakeModifier;
+    CAmount nMoneySupply = 0;
+    uint64_t nCoins = 0;
+    uint64_t nAnonOutputs = 0;
+    uint64_t nKeyImages = 0;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        unsigned char magic[4];
+        memcpy(magic, TXOUTSET_SNAPSHOT_MAGIC, 4);
+        READWRITE(magic);
+        if (ser_action.ForRead() && memcmp(magic, TXOUTSET_SNAPSHOT_MAGIC, 4) != 0)
+            throw std::ios_base::failure("Not a UTXO snapshot file");
+        READWRITE(nVersion);
+        READWRITE(hashBaseBlock);
+        READWRITE(nHeight);
+        READWRITE(bnStakeModifier);
+        READWRITE(nMoneySupply);
+        READWRITE(nCoins);
+        READWRITE(nAnonOutputs);
+        READWRITE(nKeyImages);
+    };
+};
+
+/**
+ * Write the coins, the RCT output index and the key images at the chain tip to path.
+ * hashSnapshot commits to the header and all records, it is the value to list in chainparams.
+ */
+bool DumpTxOutSetSnapshot(const fs::path &path, CTxOutSetSnapshotMetadata &metadata, uint256 &hashSnapshot, std::string &strError);
+
+/**
+ * Read back a snapshot and recompute its hash, fails if the content doesn't match the stored hash
+ * or the base block is not in the block index. fCommitted is set if chainparams lists the hash.
+ */
+bool VerifyTxOutSetSnapshot(const fs::path &path, CTxOutSetSnapshotMetadata &metadata, uint256 &hashSnapshot, bool &fCommitted, std::string &strError);
+
+#endif // BITCOINC_SNAPSHOT_H
@@ -0,0 +1,171 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <sockpoller.h>
+
+#if defined(USE_EPOLL)
+#include <sys/epoll.h>
+#elif defined(USE_KQUEUE)
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+static const int MAX_POLL_EVENTS = 256;
+
+CSocketPoller::CSocketPoller()
+{
+#if defined(USE_EPOLL)
+    m_fd = epoll_create1(EPOLL_CLOEXEC);
+#elif defined(USE_KQUEUE)
+    m_fd = kqueue();
+#endif
+}
+
+CSocketPoller::~CSocketPoller()
+{
+#ifndef WIN32
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+#endif
+}
+
+#if defined(USE_EPOLL)
+static uint32_t ToEpollEvents(int nEvents)
+{
+    uint32_t events = 0;
+    if (nEvents & CSocketPoller::POLL_RECV) {
+        events |= EPOLLIN;
+    }
+    if (nEvents & CSocketPoller::POLL_SEND) {
+        events |= EPOLLOUT;
+    }
+    return events;
+};
+
+static bool EpollControl(int fd, int op, SOCKET hSocket, int nEvents)
+{
+    struct epoll_event ev = {};
+    ev.events = ToEpollEvents(nEvents);
+    ev.data.fd = hSocket;
+    return epoll_ctl(fd, op, hSocket, &ev) == 0;
+};
+#elif defined(USE_KQUEUE)
+static bool KqueueChange(int fd, SOCKET hSocket, int nPrevEvents, int nEvents)
+{
+    struct kevent changes[2];
+    int nChanges = 0;
+    if ((nPrevEvents ^ nEvents) & CSocketPoller::POLL_RECV) {
+        EV_SET(&changes[nChanges++], hSocket, EVFILT_READ, (nEvents & CSocketPoller::POLL_RECV) ? EV_ADD : EV_DELETE, 0, 0, nullptr);
+    }
+    if ((nPrevEvents ^ nEvents) & CSocketPoller::POLL_SEND) {
+        EV_SET(&changes[nChanges++], hSocket, EVFILT_WRITE, (nEvents & CSocketPoller::POLL_SEND) ? EV_ADD : EV_DELETE, 0, 0, nullptr);
+    }
+    if (nChanges == 0) {
+        return true;
+    }
+    return kevent(fd, changes, nChanges, nullptr, 0, nullptr) == 0;
+};
+#endif
+
+bool CSocketPoller::Add(SOCKET hSocket, int nEvents)
+{
+#if defined(USE_EPOLL)
+    if (EpollControl(m_fd, EPOLL_CTL_ADD, hSocket, nEvents)) {
+        return true;
+    }
+    return errno == EEXIST && EpollControl(m_fd, EPOLL_CTL_MOD, hSocket, nEvents);
+#elif defined(USE_KQUEUE)
+    return KqueueChange(m_fd, hSocket, 0, nEvents);
+#else
+    return false;
+#endif
+}
+
+bool CSocketPoller::Modify(SOCKET hSocket, int nPrevEvents, int nEvents)
+{
+#if defined(USE_EPOLL)
+    if (nPrevEvents == nEvents) {
+        return true;
+    }
+    if (EpollControl(m_fd, EPOLL_CTL_MOD, hSocket, nEvents)) {
+        return true;
+    }
+    return errno == ENOENT && EpollControl(m_fd, EPOLL_CTL_ADD, hSocket, nEvents);
+#elif defined(USE_KQUEUE)
+    return KqueueChange(m_fd, hSocket, nPrevEvents, nEvents);
+#else
+    return false;
+#endif
+}
+
+void CSocketPoller::Remove(SOCKET hSocket, int nPrevEvents)
+{
+#if defined(USE_EPOLL)
+    EpollControl(m_fd, EPOLL_CTL_DEL, hSocket, 0);
+#elif defined(USE_KQUEUE)
+    KqueueChange(m_fd, hSocket, nPrevEvents, 0);
+#endif
+}
+
+bool CSocketPoller::Wait(int nTimeoutMs, std::vector<std::pair<SOCKET, int> > &vReady)
+{
+    vReady.clear();
+#if defined(USE_EPOLL)
+    struct epoll_event events[MAX_POLL_EVENTS];
+    int n = epoll_wait(m_fd, events, MAX_POLL_EVENTS, nTimeoutMs);
+    if (n < 0) {
+        return errno == EINTR;
+    }
+    for (int i = 0; i < n; ++i) {
+        int nEvents = 0;
+        if (events[i].events & EPOLLIN) {
+            nEvents |= POLL_RECV;
+        }
+        if (events[i].events & EPOLLOUT) {
+            nEvents |= POLL_SEND;
+        }
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+            nEvents |= POLL_ERROR;
+        }
+        vReady.emplace_back((SOCKET)events[i].data.fd, nEvents);
+    }
+    return true;
+#elif defined(USE_KQUEUE)
+    struct kevent events[MAX_POLL_EVENTS];
+    struct timespec timeout;
+    timeout.tv_sec = nTimeoutMs / 1000;
+    timeout.tv_nsec = (nTimeoutMs % 1000) * 1000000;
+    int n = kevent(m_fd, nullptr, 0, events, MAX_POLL_EVENTS, &timeout);
+    if (n < 0) {
+        return errno == EINTR;
+    }
+    // Read and write readiness of a socket arrive as separate events
+    for (int i = 0; i < n; ++i) {
+        int nEvents = 0;
+        if (events[i].filter == EVFILT_READ) {
+            nEvents |= POLL_RECV;
+        } else
+        if (events[i].filter == EVFILT_WRITE) {
+            nEvents |= POLL_SEND;
+        }
+        if (events[i].flags & (EV_EOF | EV_ERROR)) {
+            nEvents |= POLL_ERROR;
+        }
+        SOCKET hSocket = (SOCKET)events[i].ident;
+        if (!vReady.empty() && vReady.back().first == hSocket) {
+            vReady.back().second |= nEvents;
+        } else {
+            vReady.emplace_back(hSocket, nEvents);
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,53 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_SOCKPOLLER_H
+#define BITCOINC_SOCKPOLLER_H
+
+#include <compat.h>
+
+#include <utility>
+#include <vector>
+
+/**
+ * Readiness notification for a set of sockets registered once, backed by
+ * epoll on Linux and kqueue on the BSDs and macOS.
+ *
+ * Interest is only passed to the kernel when it changes, and Wait returns
+ * just the sockets that are ready.
+ * Not thread safe, owned by the socket handler thread.
+ */
+class CSocketPoller
+{
+public:
+    enum
+    {
+        POLL_RECV   = (1 << 0),
+        POLL_SEND   = (1 << 1),
+        POLL_ERROR  = (1 << 2),
+    };
+
+    CSocketPoller();
+    ~CSocketPoller();
+    CSocketPoller(const CSocketPoller&) = delete;
+    CSocketPoller& operator=(const CSocketPoller&) = delete;
+
+    /** False if there is no backend on this platform or it could not be created */
+    bool IsValid() const { return m_fd >= 0; };
+
+    /** Register hSocket, nEvents of 0 only reports errors where the backend supports it */
+    bool Add(SOCKET hSocket, int nEvents);
+    /** Change the events hSocket is registered for, nPrevEvents must be what is registered */
+    bool Modify(SOCKET hSocket, int nPrevEvents, int nEvents);
+    /** Unregister hSocket, errors are ignored as a closed socket is dropped by the kernel */
+    void Remove(SOCKET hSocket, int nPrevEvents);
+
+    /** Wait up to nTimeoutMs, vReady is filled with (socket, events) pairs */
+    bool Wait(int nTimeoutMs, std::vector<std::pair<SOCKET, int> > &vReady);
+
+private:
+    int m_fd = -1;
+};
+
+#endif // BITCOINC_SOCKPOLLER_H
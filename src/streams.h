@@ -15,6 +15,7 @@
 #include <limits>
 #include <map>
 #include <set>
+#include <stdexcept>
 #include <stdint.h>
 #include <stdio.h>
 #include <string>
@@ -139,6 +140,174 @@ private:
     size_t nPos;
 };
 
+/** Minimal stream for deserializing straight from memory owned elsewhere, such as a mapped file.
+ *
+ * The referenced bytes must outlive the stream.
+ */
+class CSpanReader
+{
+public:
+/*
+ * @param[in]  nTypeIn Serialization Type
+ * @param[in]  nVersionIn Serialization Version (including any flags)
+ * @param[in]  pDataIn  Start of the bytes to read
+ * @param[in]  nSizeIn  Number of bytes available
+*/
+    CSpanReader(int nTypeIn, int nVersionIn, const unsigned char* pDataIn, size_t nSizeIn) : nType(nTypeIn), nVersion(nVersionIn), pData(pDataIn), nSize(nSizeIn), nPos(0) {}
+
+    void read(char* pch, size_t nRead)
+    {
+        if (nRead > nSize - nPos) {
+            throw std::ios_base::failure("CSpanReader::read(): end of data");
+        }
+        memcpy(pch, pData + nPos, nRead);
+        nPos += nRead;
+    }
+    void ignore(size_t nSkip)
+    {
+        if (nSkip > nSize - nPos) {
+            throw std::ios_base::failure("CSpanReader::ignore(): end of data");
+        }
+        nPos += nSkip;
+    }
+    template<typename T>
+    CSpanReader& operator>>(T&& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+    int GetVersion() const
+    {
+        return nVersion;
+    }
+    int GetType() const
+    {
+        return nType;
+    }
+    size_t size() const
+    {
+        return nSize - nPos;
+    }
+    bool empty() const
+    {
+        return nPos == nSize;
+    }
+private:
+    const int nType;
+    const int nVersion;
+    const unsigned char* pData;
+    const size_t nSize;
+    size_t nPos;
+};
+
+/** Writes the low bits of integers to a byte stream, most significant bit first.
+ *
+ * Partial bytes are padded with zeros when the writer is flushed or destroyed.
+ */
+template <typename OStream>
+class BitStreamWriter
+{
+private:
+    OStream& m_ostream;
+
+    /// Buffered byte waiting to be written to the output stream. The byte is
+    /// written once it's filled or Flush() is called.
+    uint8_t m_buffer{0};
+
+    /// Number of high order bits in m_buffer already written by previous
+    /// Write() calls and not yet flushed to the stream.
+    int m_offset{0};
+
+public:
+    explicit BitStreamWriter(OStream& ostream) : m_ostream(ostream) {}
+
+    ~BitStreamWriter()
+    {
+        Flush();
+    }
+
+    /** Write the nbits least significant bits of a 64-bit int to the output
+     * stream. Data is buffered until it completes an octet.
+     */
+    void Write(uint64_t data, int nbits)
+    {
+        if (nbits < 0 || nbits > 64) {
+            throw std::out_of_range("nbits must be between 0 and 64");
+        }
+
+        while (nbits > 0) {
+            int bits = std::min(8 - m_offset, nbits);
+            m_buffer |= (data << (64 - nbits)) >> (64 - 8 + m_offset);
+            m_offset += bits;
+            nbits -= bits;
+
+            if (m_offset == 8) {
+                Flush();
+            }
+        }
+    }
+
+    /** Flush any unwritten bits to the output stream, padding with 0's to the
+     * next byte boundary.
+     */
+    void Flush()
+    {
+        if (m_offset == 0) {
+            return;
+        }
+
+        m_ostream << m_buffer;
+        m_buffer = 0;
+        m_offset = 0;
+    }
+};
+
+/** Reads integers written by a BitStreamWriter from a byte stream. */
+template <typename IStream>
+class BitStreamReader
+{
+private:
+    IStream& m_istream;
+
+    /// Buffered byte read in from the input stream. A new byte is read into the
+    /// buffer when m_offset reaches 8.
+    uint8_t m_buffer{0};
+
+    /// Number of high order bits in m_buffer already returned by previous
+    /// Read() calls. The next bit to be returned is at this offset from the
+    /// most significant bit position.
+    int m_offset{8};
+
+public:
+    explicit BitStreamReader(IStream& istream) : m_istream(istream) {}
+
+    /** Read the specified number of bits from the stream. The data is returned
+     * in the nbits least significant bits of a 64-bit uint.
+     */
+    uint64_t Read(int nbits)
+    {
+        if (nbits < 0 || nbits > 64) {
+            throw std::out_of_range("nbits must be between 0 and 64");
+        }
+
+        uint64_t data = 0;
+        while (nbits > 0) {
+            if (m_offset == 8) {
+                m_istream >> m_buffer;
+                m_offset = 0;
+            }
+
+            int bits = std::min(8 - m_offset, nbits);
+            data <<= bits;
+            data |= static_cast<uint8_t>(m_buffer << m_offset) >> (8 - bits);
+            m_offset += bits;
+            nbits -= bits;
+        }
+        return data;
+    }
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -239,6 +408,9 @@ public:
     bool empty() const                               { return vch.size() == nReadPos; }
     void resize(size_type n, value_type c=0)         { vch.resize(n + nReadPos, c); }
     void reserve(size_type n)                        { vch.reserve(n + nReadPos); }
+    size_type capacity() const                       { return vch.capacity() - nReadPos; }
+    //! Exchange the underlying buffer with other, the read position is reset
+    void swap(vector_type& other)                    { vch.swap(other); nReadPos = 0; }
     const_reference operator[](size_type pos) const  { return vch[pos + nReadPos]; }
     reference operator[](size_type pos)              { return vch[pos + nReadPos]; }
     void clear()                                     { vch.clear(); nReadPos = 0; }
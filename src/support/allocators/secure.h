@@ -48,7 +48,7 @@ struct secure_allocator : public std::allocator<T> {
         if (p != nullptr) {
             memory_cleanse(p, sizeof(T) * n);
         }
-        LockedPoolManager::Instance().free(p);
+        LockedPoolManager::Instance().free(p, sizeof(T) * n);
     }
 };
 
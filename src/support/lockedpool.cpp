@@ -27,6 +27,8 @@
 #endif
 
 #include <algorithm>
+#include <stdexcept>
+#include <vector>
 
 LockedPoolManager* LockedPoolManager::_instance = nullptr;
 std::once_flag LockedPoolManager::init_flag;
@@ -285,10 +287,130 @@ LockedPool::LockedPool(std::unique_ptr<LockedPageAllocator> allocator_in, Lockin
 LockedPool::~LockedPool()
 {
 }
+/** Small chunks of a thread caching pool, freed and reused by one thread */
+class LockedPoolThreadCache
+{
+public:
+    ~LockedPoolThreadCache()
+    {
+        for (size_t c = 0; c < LockedPool::CACHE_SIZE_CLASSES; ++c) {
+            release(c, 0);
+        }
+    }
+
+    void* alloc(LockedPool *pool_in, size_t c)
+    {
+        if (!use(pool_in)) {
+            return nullptr;
+        }
+        std::vector<void*> &chunks = cache[c];
+        if (chunks.empty()) {
+            // Take a few chunks at once
+            std::lock_guard<std::mutex> lock(pool->mutex);
+            for (size_t i = 0; i < LockedPool::CACHE_CHUNKS / 4; ++i) {
+                void *addr = pool->alloc_locked(class_size(c));
+                if (!addr) {
+                    break;
+                }
+                chunks.push_back(addr);
+            }
+            if (chunks.empty()) {
+                return nullptr;
+            }
+            pool->cached_bytes += (chunks.size() - 1) * class_size(c);
+            pool->cached_chunks += chunks.size() - 1;
+        } else {
+            pool->cached_bytes -= class_size(c);
+            pool->cached_chunks--;
+        }
+        void *addr = chunks.back();
+        chunks.pop_back();
+        return addr;
+    }
+
+    bool free(LockedPool *pool_in, void *ptr, size_t c)
+    {
+        if (!use(pool_in)) {
+            return false;
+        }
+        std::vector<void*> &chunks = cache[c];
+        if (std::find(chunks.begin(), chunks.end(), ptr) != chunks.end()) {
+            throw std::runtime_error("LockedPool: double free");
+        }
+        if (chunks.size() >= LockedPool::CACHE_CHUNKS) {
+            release(c, LockedPool::CACHE_CHUNKS / 2);
+        }
+        chunks.push_back(ptr);
+        pool->cached_bytes += class_size(c);
+        pool->cached_chunks++;
+        return true;
+    }
+
+    static size_t class_size(size_t c) { return LockedPool::ARENA_ALIGN << c; }
+
+private:
+    //! The pool the cached chunks belong to, the first one used by this thread
+    LockedPool *pool = nullptr;
+    std::vector<void*> cache[LockedPool::CACHE_SIZE_CLASSES];
+
+    bool use(LockedPool *pool_in)
+    {
+        if (!pool) {
+            pool = pool_in;
+        }
+        return pool == pool_in;
+    }
+
+    /** Give all but the most recently freed keep chunks of class c back to the arenas */
+    void release(size_t c, size_t keep)
+    {
+        std::vector<void*> &chunks = cache[c];
+        if (chunks.size() <= keep) {
+            return;
+        }
+        size_t n = chunks.size() - keep;
+        {
+            std::lock_guard<std::mutex> lock(pool->mutex);
+            for (size_t i = 0; i < n; ++i) {
+                pool->free_locked(chunks[i]);
+            }
+        }
+        chunks.erase(chunks.begin(), chunks.begin() + n);
+        pool->cached_bytes -= n * class_size(c);
+        pool->cached_chunks -= n;
+    }
+};
+
+static thread_local LockedPoolThreadCache locked_pool_thread_cache;
+
+/** Size class of chunks up to CACHE_MAX_SIZE */
+static inline size_t cache_class(size_t size)
+{
+    size_t c = 0;
+    while ((LockedPool::ARENA_ALIGN << c) < size) {
+        ++c;
+    }
+    return c;
+}
+
 void* LockedPool::alloc(size_t size)
 {
+    if (thread_cache && size > 0 && size <= CACHE_MAX_SIZE) {
+        size_t c = cache_class(size);
+        void *addr = locked_pool_thread_cache.alloc(this, c);
+        if (addr) {
+            return addr;
+        }
+        // free(ptr, size) files the chunk under class c, so it must fit any size of the class
+        size = LockedPoolThreadCache::class_size(c);
+    }
+
     std::lock_guard<std::mutex> lock(mutex);
+    return alloc_locked(size);
+}
 
+void* LockedPool::alloc_locked(size_t size)
+{
     // Don't handle impossible sizes
     if (size == 0 || size > ARENA_SIZE)
         return nullptr;
@@ -310,6 +432,23 @@ void* LockedPool::alloc(size_t size)
 void LockedPool::free(void *ptr)
 {
     std::lock_guard<std::mutex> lock(mutex);
+    free_locked(ptr);
+}
+
+void LockedPool::free(void *ptr, size_t size)
+{
+    if (!ptr) {
+        return;
+    }
+    if (thread_cache && size > 0 && size <= CACHE_MAX_SIZE
+        && locked_pool_thread_cache.free(this, ptr, cache_class(size))) {
+        return;
+    }
+    free(ptr);
+}
+
+void LockedPool::free_locked(void *ptr)
+{
     // TODO we can do better than this linear search by keeping a map of arena
     // extents to arena, and looking up the address.
     for (auto &arena: arenas) {
@@ -333,6 +472,12 @@ LockedPool::Stats LockedPool::stats() const
         r.chunks_used += i.chunks_used;
         r.chunks_free += i.chunks_free;
     }
+    size_t cached = std::min(cached_bytes.load(), r.used);
+    size_t cached_n = std::min(cached_chunks.load(), r.chunks_used);
+    r.used -= cached;
+    r.free += cached;
+    r.chunks_used -= cached_n;
+    r.chunks_free += cached_n;
     return r;
 }
 
@@ -380,6 +525,7 @@ LockedPool::LockedPageArena::~LockedPageArena()
 LockedPoolManager::LockedPoolManager(std::unique_ptr<LockedPageAllocator> allocator_in):
     LockedPool(std::move(allocator_in), &LockedPoolManager::LockingFailed)
 {
+    thread_cache = true;
 }
 
 bool LockedPoolManager::LockingFailed()
@@ -6,6 +6,7 @@
 #define BITCOIN_SUPPORT_LOCKEDPOOL_H
 
 #include <stdint.h>
+#include <atomic>
 #include <list>
 #include <map>
 #include <mutex>
@@ -137,6 +138,16 @@ public:
      */
     static const size_t ARENA_ALIGN = 16;
 
+    /** Size classes of the per-thread chunk caches of the LockedPoolManager,
+     * ARENA_ALIGN doubled up to CACHE_MAX_SIZE. Larger chunks aren't cached.
+     */
+    static const size_t CACHE_SIZE_CLASSES = 5;
+    static const size_t CACHE_MAX_SIZE = ARENA_ALIGN << (CACHE_SIZE_CLASSES - 1);
+    /** Chunks a thread keeps per size class. A full cache gives half back to the
+     * arenas, an empty one takes a quarter of this from them, under one lock.
+     */
+    static const size_t CACHE_CHUNKS = 32;
+
     /** Callback when allocation succeeds but locking fails.
      */
     typedef bool (*LockingFailed_Callback)();
@@ -177,9 +188,28 @@ public:
      */
     void free(void *ptr);
 
-    /** Get pool usage statistics */
+    /** Free a chunk returned by alloc(size).
+     * If thread caching is on, chunks up to CACHE_MAX_SIZE go to the calling
+     * thread's cache and are reused without taking the pool mutex. The memory
+     * isn't cleared here, the caller must clear its contents first.
+     */
+    void free(void *ptr, size_t size);
+
+    /** Get pool usage statistics, chunks held in thread caches count as free */
     Stats stats() const;
+
+protected:
+    /** Serve small chunks from per-thread caches. Only set on a pool that
+     * outlives every thread using it, as the caches hold its chunks.
+     */
+    bool thread_cache = false;
+
 private:
+    friend class LockedPoolThreadCache;
+
+    void* alloc_locked(size_t size);
+    void free_locked(void *ptr);
+
     std::unique_ptr<LockedPageAllocator> allocator;
 
     /** Create an arena from locked pages */
@@ -199,6 +229,9 @@ private:
     std::list<LockedPageArena> arenas;
     LockingFailed_Callback lf_cb;
     size_t cumulative_bytes_locked;
+    //! Chunks in thread caches, counted as used by the arenas
+    std::atomic<size_t> cached_bytes{0};
+    std::atomic<size_t> cached_chunks{0};
     /** Mutex protects access to this pool's data structures, including arenas.
      */
     mutable std::mutex mutex;
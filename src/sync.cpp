@@ -9,9 +9,11 @@
 
 #include <stdio.h>
 
+#include <algorithm>
 #include <map>
 #include <memory>
 #include <set>
+#include <utility>
 
 #ifdef DEBUG_LOCKCONTENTION
 #if !defined(HAVE_THREAD_LOCAL)
@@ -24,6 +26,135 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+#ifdef DEBUG_LOCKPROFILE
+#if !defined(HAVE_THREAD_LOCAL)
+static_assert(false, "thread_local is not supported");
+#endif
+//
+// Lock profiling.
+// Each thread counts into its own table, keyed by the callsite's file and
+// line literals. The per thread mutex is only contended while an RPC call
+// sums the tables. A thread's counters move to the retired table when it exits.
+//
+
+typedef std::map<std::pair<std::string, int>, LockProfileStats> LockProfileMap;
+
+static void MergeLockProfileStats(LockProfileMap& merged, const LockProfileStats& s)
+{
+    LockProfileStats& m = merged[std::make_pair(s.file, s.line)];
+    if (m.count == 0) {
+        m.name = s.name;
+        m.file = s.file;
+        m.line = s.line;
+    }
+    m.count += s.count;
+    m.contended += s.contended;
+    m.wait_us += s.wait_us;
+    m.max_wait_us = std::max(m.max_wait_us, s.max_wait_us);
+    m.hold_us += s.hold_us;
+    m.max_hold_us = std::max(m.max_hold_us, s.max_hold_us);
+}
+
+struct ThreadLockProfile;
+
+struct LockProfileData {
+    std::mutex mutex;
+    std::set<ThreadLockProfile*> threads; // guarded by mutex
+    LockProfileMap retired;               // guarded by mutex
+};
+
+static LockProfileData& GetLockProfileData()
+{
+    // Never destroyed, locks are taken in static constructors and destructors
+    static LockProfileData* data = new LockProfileData();
+    return *data;
+}
+
+static thread_local bool g_thread_lock_profile_exited = false;
+
+struct ThreadLockProfile {
+    std::mutex mutex;
+    std::map<std::pair<const char*, int>, LockProfileStats> stats; // guarded by mutex
+
+    ThreadLockProfile()
+    {
+        LockProfileData& data = GetLockProfileData();
+        std::lock_guard<std::mutex> lock(data.mutex);
+        data.threads.insert(this);
+    }
+
+    ~ThreadLockProfile()
+    {
+        g_thread_lock_profile_exited = true;
+        LockProfileData& data = GetLockProfileData();
+        std::lock_guard<std::mutex> lock(data.mutex);
+        for (const auto& entry : stats) {
+            MergeLockProfileStats(data.retired, entry.second);
+        }
+        data.threads.erase(this);
+    }
+};
+
+static thread_local ThreadLockProfile g_thread_lock_profile;
+
+void RecordLockProfile(const char* pszName, const char* pszFile, int nLine, bool fContended, int64_t nWaitMicros, int64_t nHoldMicros)
+{
+    if (g_thread_lock_profile_exited) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(g_thread_lock_profile.mutex);
+    LockProfileStats& s = g_thread_lock_profile.stats[std::make_pair(pszFile, nLine)];
+    if (s.count == 0) {
+        s.name = pszName;
+        s.file = pszFile;
+        s.line = nLine;
+    }
+    s.count++;
+    s.contended += fContended ? 1 : 0;
+    s.wait_us += nWaitMicros;
+    s.max_wait_us = std::max(s.max_wait_us, nWaitMicros);
+    s.hold_us += nHoldMicros;
+    s.max_hold_us = std::max(s.max_hold_us, nHoldMicros);
+}
+
+bool GetLockProfile(std::vector<LockProfileStats>& stats)
+{
+    LockProfileData& data = GetLockProfileData();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    LockProfileMap merged = data.retired;
+    for (ThreadLockProfile* thread_profile : data.threads) {
+        std::lock_guard<std::mutex> thread_lock(thread_profile->mutex);
+        for (const auto& entry : thread_profile->stats) {
+            MergeLockProfileStats(merged, entry.second);
+        }
+    }
+    stats.clear();
+    for (const auto& entry : merged) {
+        stats.push_back(entry.second);
+    }
+    return true;
+}
+
+void ResetLockProfile()
+{
+    LockProfileData& data = GetLockProfileData();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    data.retired.clear();
+    for (ThreadLockProfile* thread_profile : data.threads) {
+        std::lock_guard<std::mutex> thread_lock(thread_profile->mutex);
+        thread_profile->stats.clear();
+    }
+}
+#else
+bool GetLockProfile(std::vector<LockProfileStats>& stats)
+{
+    stats.clear();
+    return false;
+}
+
+void ResetLockProfile() {}
+#endif /* DEBUG_LOCKPROFILE */
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
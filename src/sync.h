@@ -8,9 +8,12 @@
 
 #include <threadsafety.h>
 
+#include <chrono>
 #include <condition_variable>
+#include <string>
 #include <thread>
 #include <mutex>
+#include <vector>
 
 
 ////////////////////////////////////////////////
@@ -112,15 +115,83 @@ typedef std::unique_lock<std::mutex> WaitableLock;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/** Wait and hold times of the LOCKs taken at one callsite */
+struct LockProfileStats
+{
+    std::string name;
+    std::string file;
+    int line = 0;
+    uint64_t count = 0;     //! Times the lock was taken
+    uint64_t contended = 0; //! Times the lock was held by another thread
+    int64_t wait_us = 0;
+    int64_t max_wait_us = 0;
+    int64_t hold_us = 0;
+    int64_t max_hold_us = 0;
+};
+
+/** Summed over all threads, false if not built with DEBUG_LOCKPROFILE */
+bool GetLockProfile(std::vector<LockProfileStats>& stats);
+void ResetLockProfile();
+
+#ifdef DEBUG_LOCKPROFILE
+void RecordLockProfile(const char* pszName, const char* pszFile, int nLine, bool fContended, int64_t nWaitMicros, int64_t nHoldMicros);
+
+/** Times one CCriticalBlock, counted into the calling thread's counters on release */
+class LockProfileScope
+{
+private:
+    const char* m_name = nullptr;
+    const char* m_file = nullptr;
+    int m_line = 0;
+    bool m_contended = false;
+    int64_t m_start = 0;
+    int64_t m_acquired = 0;
+
+    static int64_t NowMicros()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+public:
+    void Start(const char* pszName, const char* pszFile, int nLine)
+    {
+        m_name = pszName;
+        m_file = pszFile;
+        m_line = nLine;
+        m_start = NowMicros();
+    }
+    void SetContended() { m_contended = true; }
+    void Acquired() { m_acquired = NowMicros(); }
+    void Release()
+    {
+        RecordLockProfile(m_name, m_file, m_line, m_contended, m_acquired - m_start, NowMicros() - m_acquired);
+    }
+};
+#endif
+
 /** Wrapper around std::unique_lock<CCriticalSection> */
 class SCOPED_LOCKABLE CCriticalBlock
 {
 private:
     std::unique_lock<CCriticalSection> lock;
+#ifdef DEBUG_LOCKPROFILE
+    LockProfileScope profile;
+#endif
 
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
+#ifdef DEBUG_LOCKPROFILE
+        profile.Start(pszName, pszFile, nLine);
+        if (!lock.try_lock()) {
+            profile.SetContended();
+#ifdef DEBUG_LOCKCONTENTION
+            PrintLockContention(pszName, pszFile, nLine);
+#endif
+            lock.lock();
+        }
+        profile.Acquired();
+#else
 #ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock()) {
             PrintLockContention(pszName, pszFile, nLine);
@@ -128,15 +199,23 @@ private:
             lock.lock();
 #ifdef DEBUG_LOCKCONTENTION
         }
+#endif
 #endif
     }
 
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()), true);
+#ifdef DEBUG_LOCKPROFILE
+        profile.Start(pszName, pszFile, nLine);
+#endif
         lock.try_lock();
         if (!lock.owns_lock())
             LeaveCritical();
+#ifdef DEBUG_LOCKPROFILE
+        else
+            profile.Acquired();
+#endif
         return lock.owns_lock();
     }
 
@@ -162,8 +241,12 @@ public:
 
     ~CCriticalBlock() UNLOCK_FUNCTION()
     {
-        if (lock.owns_lock())
+        if (lock.owns_lock()) {
+#ifdef DEBUG_LOCKPROFILE
+            profile.Release();
+#endif
             LeaveCritical();
+        }
     }
 
     operator bool()
@@ -354,6 +354,72 @@ BOOST_AUTO_TEST_CASE(addrman_delete)
     BOOST_CHECK(info2 == nullptr);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_reuse_ids)
+{
+    CAddrManTest addrman;
+
+    CAddress addr1 = CAddress(ResolveService("250.1.2.1", 8333), NODE_NONE);
+    CAddress addr2 = CAddress(ResolveService("250.1.2.2", 8333), NODE_NONE);
+    CAddress addr3 = CAddress(ResolveService("250.1.2.3", 8333), NODE_NONE);
+    CNetAddr source1 = ResolveIP("250.1.2.1");
+
+    int nId1, nId2, nId3;
+    addrman.Create(addr1, source1, &nId1);
+    addrman.Create(addr2, source1, &nId2);
+    BOOST_CHECK_EQUAL(nId1, 0);
+    BOOST_CHECK_EQUAL(nId2, 1);
+
+    // Test: The nId of a deleted entry is handed out again.
+    addrman.Delete(nId1);
+    addrman.Create(addr3, source1, &nId3);
+    BOOST_CHECK_EQUAL(nId3, nId1);
+    BOOST_CHECK_EQUAL(addrman.size(), 2U);
+
+    int nIdFound = -1;
+    BOOST_CHECK(addrman.Find(addr1) == nullptr);
+    CAddrInfo* info3 = addrman.Find(addr3, &nIdFound);
+    BOOST_REQUIRE(info3);
+    BOOST_CHECK_EQUAL(nIdFound, nId3);
+    BOOST_CHECK_EQUAL(info3->ToString(), "250.1.2.3:8333");
+    CAddrInfo* info2 = addrman.Find(addr2, &nIdFound);
+    BOOST_REQUIRE(info2);
+    BOOST_CHECK_EQUAL(nIdFound, nId2);
+}
+
+BOOST_AUTO_TEST_CASE(addrman_serialize)
+{
+    CAddrManTest addrman;
+
+    CNetAddr source1 = ResolveIP("252.2.2.2");
+    std::vector<CAddress> vAddr;
+    for (unsigned int i = 1; i < 64; i++) {
+        CAddress addr = CAddress(ResolveService("250.1.1." + std::to_string(i), 8333), NODE_NONE);
+        if (addrman.Add(addr, source1)) {
+            vAddr.push_back(addr);
+        }
+    }
+    BOOST_REQUIRE(vAddr.size() > 2);
+
+    // Move some to tried
+    addrman.Good(vAddr[0]);
+    addrman.Good(vAddr[1]);
+    BOOST_CHECK_EQUAL(addrman.size(), vAddr.size());
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << addrman;
+
+    CAddrManTest addrman2;
+    ss >> addrman2;
+
+    // Test: Every address survives the round trip.
+    BOOST_CHECK_EQUAL(addrman2.size(), addrman.size());
+    for (const CAddress& addr : vAddr) {
+        CAddrInfo* info = addrman2.Find(addr);
+        BOOST_REQUIRE(info);
+        BOOST_CHECK_EQUAL(info->ToString(), addr.ToString());
+    }
+}
+
 BOOST_AUTO_TEST_CASE(addrman_getaddr)
 {
     CAddrManTest addrman;
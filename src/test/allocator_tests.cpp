@@ -8,6 +8,7 @@
 #include <test/test_bitcoin.h>
 
 #include <memory>
+#include <thread>
 
 #include <boost/test/unit_test.hpp>
 
@@ -233,4 +234,105 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live)
     BOOST_CHECK(pool.stats().used == initial.used);
 }
 
+BOOST_AUTO_TEST_CASE(lockedpool_tests_thread_cache)
+{
+    LockedPoolManager &pool = LockedPoolManager::Instance();
+    LockedPool::Stats initial = pool.stats();
+
+    // A chunk freed with its size is reused by the next allocation of its size class
+    void *a0 = pool.alloc(20);
+    BOOST_CHECK(a0);
+    pool.free(a0, 20);
+    BOOST_CHECK(pool.stats().used == initial.used);
+    void *a1 = pool.alloc(32);
+    BOOST_CHECK(a1 == a0);
+    pool.free(a1, 32);
+    try { // Test exception on double-free
+        pool.free(a1, 32);
+        BOOST_CHECK(0);
+    } catch(std::runtime_error &)
+    {
+    }
+
+    // Chunks allocated by one thread are freed by another, larger ones bypass the caches
+    const int THREADS = 4;
+    const int CHUNKS = 500;
+    std::vector<std::vector<std::pair<void*, size_t>>> chunks(THREADS);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&chunks, &pool, t] {
+            for (int i = 0; i < CHUNKS; ++i) {
+                size_t size = 1 + (i * 37 + t) % (2 * LockedPool::CACHE_MAX_SIZE);
+                void *addr = pool.alloc(size);
+                if (addr) {
+                    memset(addr, t, size);
+                    chunks[t].emplace_back(addr, size);
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) thread.join();
+    threads.clear();
+    for (int t = 0; t < THREADS; ++t) {
+        BOOST_CHECK_EQUAL(chunks[t].size(), (size_t)CHUNKS);
+        threads.emplace_back([&chunks, &pool, t] {
+            for (const auto &chunk : chunks[(t + 1) % THREADS]) {
+                pool.free(chunk.first, chunk.second);
+            }
+        });
+    }
+    for (auto &thread : threads) thread.join();
+
+    // Exited threads return their cached chunks
+    BOOST_CHECK(pool.stats().used == initial.used);
+}
+
+class TestCachedLockedPool: public LockedPool
+{
+public:
+    explicit TestCachedLockedPool(std::unique_ptr<LockedPageAllocator> allocator_in): LockedPool(std::move(allocator_in))
+    {
+        thread_cache = true;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(lockedpool_tests_thread_cache_exhausted)
+{
+    // One virtual arena, used through the cache of a new thread
+    std::unique_ptr<LockedPageAllocator> x(new TestLockedPageAllocator(1, 0));
+    TestCachedLockedPool pool(std::move(x));
+
+    void *big = nullptr, *a = nullptr, *a_again = nullptr, *b = nullptr, *c = nullptr, *d = nullptr;
+    size_t used_before = 0, used_after = 0, used_freed = 0;
+    std::thread([&] {
+        // Leave 48 bytes, the 64 byte class can't be refilled
+        big = pool.alloc(LockedPool::ARENA_SIZE - 48);
+        // An exact 48 byte chunk would be freed into the 64 byte class and handed out as 64 bytes
+        b = pool.alloc(48);
+        // The 32 byte class takes the one chunk that fits, then is exhausted
+        a = pool.alloc(32);
+        c = pool.alloc(32);
+        pool.free(a, 32);
+        a_again = pool.alloc(32);
+        pool.free(a_again, 32);
+
+        pool.free(big);
+        used_before = pool.stats().used;
+        d = pool.alloc(48);
+        used_after = pool.stats().used;
+        pool.free(d, 48);
+        used_freed = pool.stats().used;
+    }).join();
+
+    BOOST_CHECK(big);
+    BOOST_CHECK(!b);
+    BOOST_CHECK(a);
+    BOOST_CHECK(!c);
+    BOOST_CHECK(a_again == a);
+    BOOST_CHECK(d);
+    BOOST_CHECK_EQUAL(used_after, used_before + 64);
+    BOOST_CHECK_EQUAL(used_freed, used_before);
+    BOOST_CHECK(pool.stats().used == 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
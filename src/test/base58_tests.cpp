@@ -66,5 +66,23 @@ BOOST_AUTO_TEST_CASE(base58_DecodeBase58)
     BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expected.begin(), expected.end());
 }
 
+// Goal: round trip every length across the chunk boundaries of the codec
+BOOST_AUTO_TEST_CASE(base58_random_encode_decode)
+{
+    for (int len = 0; len < 100; ++len) {
+        for (int zeroes = 0; zeroes < 3 && zeroes <= len; ++zeroes) {
+            std::vector<unsigned char> data(len, 0);
+            for (int i = zeroes; i < len; ++i) {
+                data[i] = InsecureRandBool() ? InsecureRandBits(8) : (InsecureRandBool() ? 0xff : 0);
+            }
+            std::string encoded = EncodeBase58(data);
+            std::vector<unsigned char> decoded;
+            BOOST_CHECK(DecodeBase58(encoded, decoded));
+            BOOST_CHECK(decoded == data);
+            BOOST_CHECK(encoded.size() >= (size_t)zeroes && encoded.find_first_not_of('1') >= (size_t)zeroes);
+        }
+    }
+}
+
 
 BOOST_AUTO_TEST_SUITE_END()
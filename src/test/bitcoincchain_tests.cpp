@@ -14,6 +14,9 @@
 #include <key/extkey.h>
 #include <pos/kernel.h>
 #include <chainparams.h>
+#include <txdb.h>
+#include <txlookupcache.h>
+#include <undo.h>
 
 #include <script/sign.h>
 #include <policy/policy.h>
@@ -190,14 +193,21 @@ BOOST_AUTO_TEST_CASE(opiscoinstake_test)
     BOOST_CHECK(scriptTest == scriptSignA);
     BOOST_CHECK(scriptTestB == scriptSignB);
 
+    Span<const unsigned char> stake_hash, spend_hash;
+    BOOST_CHECK(script.MatchColdStakeKeyHashes(stake_hash, spend_hash));
+    BOOST_CHECK(std::vector<unsigned char>(stake_hash.begin(), stake_hash.end()) == ToByteVector(idA));
+    BOOST_CHECK(std::vector<unsigned char>(spend_hash.begin(), spend_hash.end()) == ToByteVector(idB));
+    BOOST_CHECK(scriptFail1.MatchColdStakeKeyHashes(stake_hash, spend_hash));
+    BOOST_CHECK(spend_hash.size() == 20);
+
 
     txnouttype whichType;
     // IsStandard should fail until chain time is >= OpIsCoinstakeTime
     BOOST_CHECK(!IsStandard(script, whichType));
 
 
-    BOOST_CHECK(IsMine(keystoreB, script));
-    BOOST_CHECK(IsMine(keystoreA, script));
+    BOOST_CHECK(IsMine(keystoreB, script) == ISMINE_SPENDABLE);
+    BOOST_CHECK(IsMine(keystoreA, script) == ISMINE_WATCH_COLDSTAKE);
 
 
     CAmount nValue = 100000;
@@ -257,6 +267,7 @@ BOOST_AUTO_TEST_CASE(opiscoinstake_test)
         << OP_HASH160 << ToByteVector(idA) << OP_EQUAL
         << OP_ENDIF;
     BOOST_CHECK(script_h160.IsPayToScriptHash_CS());
+    BOOST_CHECK(!script_h160.MatchColdStakeKeyHashes(stake_hash, spend_hash));
 
 
     CScript script_h256 = CScript()
@@ -268,6 +279,111 @@ BOOST_AUTO_TEST_CASE(opiscoinstake_test)
     BOOST_CHECK(script_h256.IsPayToScriptHash256_CS());
 }
 
+//! VerifyScript of a BitcoinC txn input run through the interpreter only
+static bool VerifyScriptInterpreted(const CScriptWitness &witness, const CScript &scriptPubKey, unsigned int flags, const BaseSignatureChecker &checker, ScriptError *serror)
+{
+    std::vector<std::vector<unsigned char> > stack(witness.stack.begin(), witness.stack.end());
+    if (!EvalScript(stack, scriptPubKey, flags, checker, SigVersion::BASE, serror))
+        return false;
+    // The scripts tested end in OP_CHECKSIG, the result is empty or 1
+    if (stack.empty() || stack.back().empty())
+    {
+        *serror = SCRIPT_ERR_EVAL_FALSE;
+        return false;
+    };
+    if ((flags & SCRIPT_VERIFY_CLEANSTACK) && stack.size() != 1)
+    {
+        *serror = SCRIPT_ERR_CLEANSTACK;
+        return false;
+    };
+    *serror = SCRIPT_ERR_OK;
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(verifyscript_keyhash_fastpath)
+{
+    SeedInsecureRand();
+    CBasicKeyStore keystore;
+    CKey kA, kB;
+    InsecureNewKey(kA, true);
+    InsecureNewKey(kB, true);
+    keystore.AddKey(kA);
+    keystore.AddKey(kB);
+    CPubKey pkA = kA.GetPubKey();
+    CPubKey pkB = kB.GetPubKey();
+
+    std::vector<CScript> vScripts;
+    vScripts.push_back(CScript() << OP_DUP << OP_HASH160 << ToByteVector(pkA.GetID()) << OP_EQUALVERIFY << OP_CHECKSIG);
+    vScripts.push_back(CScript() << OP_DUP << OP_SHA256 << ToByteVector(pkB.GetID256()) << OP_EQUALVERIFY << OP_CHECKSIG);
+    vScripts.push_back(CScript() << OP_ISCOINSTAKE << OP_IF
+        << OP_DUP << OP_HASH160 << ToByteVector(pkA.GetID()) << OP_EQUALVERIFY << OP_CHECKSIG
+        << OP_ELSE
+        << OP_DUP << OP_SHA256 << ToByteVector(pkB.GetID256()) << OP_EQUALVERIFY << OP_CHECKSIG
+        << OP_ENDIF);
+    vScripts.push_back(CScript() << OP_ISCOINSTAKE << OP_IF
+        << OP_DUP << OP_HASH160 << ToByteVector(pkA.GetID()) << OP_EQUALVERIFY << OP_CHECKSIG
+        << OP_ELSE
+        << OP_DUP << OP_HASH160 << ToByteVector(pkB.GetID()) << OP_EQUALVERIFY << OP_CHECKSIG
+        << OP_ENDIF);
+
+    CAmount nValue = 100000;
+    std::vector<uint8_t> vchAmount(8);
+    memcpy(&vchAmount[0], &nValue, 8);
+
+    for (bool fCoinStake : {false, true})
+    {
+        CMutableTransaction txn;
+        txn.nVersion = BITCOINC_TXN_VERSION;
+        txn.SetType(fCoinStake ? TXN_COINSTAKE : TXN_STANDARD);
+        int nBlockHeight = 1;
+        OUTPUT_PTR<CTxOutData> outData = MAKE_OUTPUT<CTxOutData>();
+        outData->vData.resize(4);
+        memcpy(&outData->vData[0], &nBlockHeight, 4);
+        txn.vpout.push_back(outData);
+        OUTPUT_PTR<CTxOutStandard> out0 = MAKE_OUTPUT<CTxOutStandard>();
+        out0->nValue = nValue;
+        out0->scriptPubKey = vScripts[0];
+        txn.vpout.push_back(out0);
+        txn.vin.push_back(CTxIn(COutPoint(uint256S("d496208ea84193e0c5ed05ac708aec84dfd2474b529a7608b836e282958dc72b"), 0)));
+        BOOST_CHECK(txn.IsCoinStake() == fCoinStake);
+        MutableTransactionSignatureChecker checker(&txn, 0, vchAmount);
+
+        for (const auto &script : vScripts)
+        {
+            SignatureData sigdata;
+            BOOST_CHECK(ProduceSignature(keystore, MutableTransactionSignatureCreator(&txn, 0, vchAmount, SIGHASH_ALL), script, sigdata));
+            const CScriptWitness &good = sigdata.scriptWitness;
+            BOOST_REQUIRE(good.stack.size() == 2);
+
+            // The fast path takes the first ones, the rest must fall back to the interpreter
+            std::vector<CScriptWitness> vWitness(10, good);
+            vWitness[1].stack[0][10] ^= 1;
+            vWitness[2].stack[0].clear();
+            vWitness[3].stack[0].back() = 0x7f;
+            vWitness[4].stack[0].insert(vWitness[4].stack[0].begin() + 1, 0);
+            vWitness[5].stack[1] = ToByteVector(pkA == CPubKey(good.stack[1].begin(), good.stack[1].end()) ? pkB : pkA);
+            vWitness[6].stack[0] = ToByteVector(pkA.GetID());
+            vWitness[7].stack[0] = ToByteVector(pkB.GetID256());
+            vWitness[8].stack.insert(vWitness[8].stack.begin(), std::vector<uint8_t>(1, 1));
+            vWitness[9].stack.pop_back();
+
+            for (unsigned int nFlags : {(unsigned int)SCRIPT_VERIFY_NONE, (unsigned int)MANDATORY_SCRIPT_VERIFY_FLAGS, (unsigned int)STANDARD_SCRIPT_VERIFY_FLAGS})
+            {
+                for (size_t i = 0; i < vWitness.size(); ++i)
+                {
+                    ScriptError serror, serrorInterpreted;
+                    bool fRet = VerifyScript(CScript(), script, &vWitness[i], nFlags, checker, &serror);
+                    bool fRetInterpreted = VerifyScriptInterpreted(vWitness[i], script, nFlags, checker, &serrorInterpreted);
+                    BOOST_CHECK_MESSAGE(fRet == fRetInterpreted && serror == serrorInterpreted,
+                        strprintf("case %d flags %x: %s vs %s", i, nFlags, ScriptErrorString(serror), ScriptErrorString(serrorInterpreted)));
+                    if (i == 0)
+                        BOOST_CHECK(fRet);
+                };
+            };
+        };
+    };
+}
+
 BOOST_AUTO_TEST_CASE(varints)
 {
     // encode
@@ -309,6 +425,48 @@ BOOST_AUTO_TEST_CASE(varints)
     };
 }
 
+BOOST_AUTO_TEST_CASE(txn_hashes_one_pass)
+{
+    // Hashes taken while serializing or reading must match hashing each serialization
+    CMutableTransaction txn;
+    txn.nVersion = BITCOINC_TXN_VERSION;
+    txn.vin.push_back(CTxIn(InsecureRand256(), 1));
+    txn.vin.push_back(CTxIn(InsecureRand256(), 0));
+    txn.vin[0].scriptWitness.stack.emplace_back(72, 0x30);
+    txn.vin[0].scriptWitness.stack.emplace_back(33, 0x02);
+
+    txn.vpout.push_back(MAKE_OUTPUT<CTxOutData>(std::vector<uint8_t>(4, 0x01)));
+    txn.vpout.push_back(MAKE_OUTPUT<CTxOutStandard>(10000, CScript() << OP_TRUE));
+    OUTPUT_PTR<CTxOutRingCT> outCT = MAKE_OUTPUT<CTxOutRingCT>();
+    outCT->vData.resize(33, 0x03);
+    outCT->vRangeproof.resize(700, 0xAB);
+    txn.vpout.push_back(outCT);
+
+    uint256 txid = SerializeHash(txn, SER_GETHASH, SERIALIZE_TRANSACTION_NO_WITNESS);
+    uint256 wtxid = SerializeHash(txn, SER_GETHASH, 0);
+    BOOST_CHECK(txid == txn.GetHash());
+    BOOST_CHECK(txid != wtxid);
+
+    CTransaction tx(txn);
+    BOOST_CHECK(tx.GetHash() == txid);
+    BOOST_CHECK(tx.GetWitnessHash() == wtxid);
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << tx;
+    CTransactionRef txRead;
+    ss >> txRead;
+    BOOST_CHECK(txRead->GetHash() == txid);
+    BOOST_CHECK(txRead->GetWitnessHash() == wtxid);
+
+    // Read without witness, the rangeproof and witness stacks are empty
+    CDataStream ssNoWitness(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+    ssNoWitness << tx;
+    ssNoWitness >> txRead;
+    BOOST_CHECK(txRead->GetHash() == txid);
+    BOOST_CHECK(txRead->GetWitnessHash() == SerializeHash(*txRead, SER_GETHASH, 0));
+    BOOST_CHECK(txRead->GetWitnessHash() != wtxid);
+}
+
 BOOST_AUTO_TEST_CASE(mixed_input_types)
 {
     CMutableTransaction txn;
@@ -390,5 +548,222 @@ BOOST_AUTO_TEST_CASE(coin_year_reward)
     BOOST_CHECK(Params().GetCoinYearReward(1657976400) == 2 * CENT);
 }
 
+BOOST_AUTO_TEST_CASE(stake_kernel_round)
+{
+    CBlockIndex indexPrev;
+    indexPrev.nHeight = 100;
+    indexPrev.nTime = 1529700000;
+    indexPrev.bnStakeModifier = InsecureRand256();
+
+    uint32_t nTime = 1529700160, nBlockFromTime = 1529690000;
+
+    // CStakeKernelRound must agree with CheckStakeKernelHash, passing or not
+    for (uint32_t nBits : {0x1e00ffffU, 0x1d00ffffU, 0x03000001U})
+    {
+        CStakeKernelRound round(&indexPrev, nBits, nTime);
+        BOOST_CHECK(round.IsValid());
+
+        for (int i = 0; i < 20; ++i)
+        {
+            COutPoint prevout(InsecureRand256(), InsecureRandRange(10));
+            CAmount nAmount = (1 + InsecureRandRange(1000)) * COIN;
+
+            uint256 hashA, targetA, hashB, targetB;
+            bool fA = CheckStakeKernelHash(&indexPrev, nBits, nBlockFromTime, nAmount, prevout, nTime, hashA, targetA);
+            bool fB = round.Check(nBlockFromTime, nAmount, prevout, hashB, targetB);
+            BOOST_CHECK_EQUAL(fA, fB);
+            BOOST_CHECK(hashA == hashB);
+            BOOST_CHECK(targetA == targetB);
+            if (nBits == 0x03000001U)
+                BOOST_CHECK(!fA);
+        };
+
+        uint256 hash, target;
+        BOOST_CHECK(!round.Check(nTime + 1, COIN, COutPoint(InsecureRand256(), 0), hash, target));
+    };
+
+    BOOST_CHECK(!CStakeKernelRound(&indexPrev, 0, nTime).IsValid());
+}
+
+BOOST_AUTO_TEST_CASE(txlookupcache_lru)
+{
+    std::vector<CTransactionRef> vtx;
+    for (int i = 0; i < 20; ++i)
+    {
+        CMutableTransaction txn;
+        txn.nVersion = BITCOINC_TXN_VERSION;
+        txn.vin.push_back(CTxIn(InsecureRand256(), i));
+        txn.vpout.push_back(MAKE_OUTPUT<CTxOutStandard>(10000, CScript() << OP_TRUE));
+        vtx.push_back(MakeTransactionRef(txn));
+    };
+
+    // Room for one entry per shard
+    size_t nEntryUsage = CTxLookupCache::EntryUsage(*vtx[0]);
+    CTxLookupCache cache(nEntryUsage * TX_LOOKUP_CACHE_SHARDS);
+
+    CTransactionRef tx;
+    uint256 hashBlock, hashBlockIn = InsecureRand256();
+    for (const auto &ptx : vtx)
+    {
+        cache.Insert(ptx, hashBlockIn);
+        BOOST_CHECK(cache.Get(ptx->GetHash(), tx, hashBlock));
+        BOOST_CHECK(tx == ptx);
+        BOOST_CHECK(hashBlock == hashBlockIn);
+    };
+    BOOST_CHECK(cache.Size() <= TX_LOOKUP_CACHE_SHARDS);
+    BOOST_CHECK(cache.Size() < vtx.size());
+    BOOST_CHECK(cache.DynamicMemoryUsage() >= cache.Size() * nEntryUsage);
+
+    cache.Erase(vtx.back()->GetHash());
+    BOOST_CHECK(!cache.Get(vtx.back()->GetHash(), tx, hashBlock));
+    BOOST_CHECK_EQUAL(cache.GetHits(), vtx.size());
+    BOOST_CHECK_EQUAL(cache.GetMisses(), 1U);
+
+    cache.SetMaxSize(0);
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+    cache.Insert(vtx[0], hashBlockIn);
+    BOOST_CHECK(!cache.Get(vtx[0]->GetHash(), tx, hashBlock));
+}
+
+BOOST_AUTO_TEST_CASE(blockindex_cold_data)
+{
+    size_t nResident = CBlockIndexColdRef::nResident;
+
+    // New entries share the default cold data
+    CBlockIndex index{CBlockHeader()};
+    BOOST_CHECK(!index.HasColdData());
+    BOOST_CHECK(index.GetPrevoutStake().IsNull());
+    BOOST_CHECK_EQUAL(index.GetMoneySupply(), 0);
+
+    COutPoint prevout(InsecureRand256(), 1);
+    index.SetPrevoutStake(prevout);
+    index.SetMoneySupply(12 * COIN);
+    BOOST_CHECK(index.HasColdData());
+    BOOST_CHECK_EQUAL(CBlockIndexColdRef::nResident, nResident + 1);
+
+    // Copies are deep
+    CDiskBlockIndex diskindex(&index);
+    BOOST_CHECK(diskindex.prevoutStake == prevout);
+    BOOST_CHECK_EQUAL(diskindex.nMoneySupply, 12 * COIN);
+    BOOST_CHECK(diskindex.GetPrevoutStake() == prevout);
+    BOOST_CHECK_EQUAL(CBlockIndexColdRef::nResident, nResident + 2);
+    index.SetMoneySupply(13 * COIN);
+    BOOST_CHECK_EQUAL(diskindex.GetMoneySupply(), 12 * COIN);
+
+    // Without a hash there's nothing to page back in
+    index.PageOutColdData();
+    BOOST_CHECK(!index.HasColdData());
+    BOOST_CHECK_EQUAL(CBlockIndexColdRef::nResident, nResident + 1);
+    BOOST_CHECK(index.GetPrevoutStake().IsNull());
+}
+
+BOOST_AUTO_TEST_CASE(blockindex_load_parallel)
+{
+    CBlockTreeDB db(1 << 20, true);
+
+    // A branch off a parent that isn't in the db
+    const int nBlocks = 300;
+    std::vector<uint256> vHashes(nBlocks + 1);
+    std::vector<CBlockIndex> vBlocks(nBlocks + 1);
+    std::vector<const CBlockIndex*> vWrite;
+    vHashes[0] = InsecureRand256();
+    vBlocks[0].phashBlock = &vHashes[0];
+    for (int i = 1; i <= nBlocks; ++i)
+    {
+        CBlockHeader header;
+        header.nVersion = BITCOINC_BLOCK_VERSION;
+        header.hashPrevBlock = vHashes[i - 1];
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = 1529700000 + i;
+        header.nBits = 0x1e00ffff;
+        vHashes[i] = header.GetHash();
+
+        vBlocks[i] = CBlockIndex(header);
+        vBlocks[i].phashBlock = &vHashes[i];
+        vBlocks[i].pprev = &vBlocks[i - 1];
+        vBlocks[i].nHeight = i;
+        vBlocks[i].nTx = i;
+        vWrite.push_back(&vBlocks[i]);
+    };
+    BOOST_REQUIRE(db.WriteBatchSync({}, 0, vWrite));
+
+    std::map<uint256, CBlockIndex*> mapLoaded;
+    size_t nReserved = 0;
+    BOOST_REQUIRE(db.LoadBlockIndexGuts(Params().GetConsensus(),
+        [&mapLoaded](const uint256 &hash, CBlockIndex *pindexNew) -> CBlockIndex* {
+            if (hash.IsNull())
+            {
+                delete pindexNew;
+                return nullptr;
+            };
+            auto mi = mapLoaded.find(hash);
+            if (mi != mapLoaded.end())
+            {
+                delete pindexNew;
+                return mi->second;
+            };
+            mi = mapLoaded.emplace(hash, pindexNew ? pindexNew : new CBlockIndex()).first;
+            mi->second->phashBlock = &mi->first;
+            return mi->second;
+        },
+        [&nReserved](size_t nEntries) { nReserved = nEntries; }));
+
+    // Every entry read once whichever thread read it, plus the missing parent
+    BOOST_CHECK_EQUAL(nReserved, (size_t)nBlocks);
+    BOOST_CHECK_EQUAL(mapLoaded.size(), (size_t)nBlocks + 1);
+    for (int i = 1; i <= nBlocks; ++i)
+    {
+        auto mi = mapLoaded.find(vHashes[i]);
+        BOOST_REQUIRE(mi != mapLoaded.end());
+        const CBlockIndex *pindex = mi->second;
+        BOOST_CHECK_EQUAL(pindex->nHeight, i);
+        BOOST_CHECK_EQUAL(pindex->nTx, (unsigned int)i);
+        BOOST_CHECK_EQUAL(pindex->nTime, vBlocks[i].nTime);
+        BOOST_CHECK(pindex->pprev && pindex->pprev->GetBlockHash() == vHashes[i - 1]);
+    };
+    BOOST_CHECK(mapLoaded[vHashes[0]]->pprev == nullptr);
+
+    for (auto &item : mapLoaded)
+        delete item.second;
+}
+
+BOOST_AUTO_TEST_CASE(blockundo_rct)
+{
+    CBlockUndo undo;
+    undo.vtxundo.resize(2);
+    undo.vtxundo[0].vprevout.emplace_back(CTxOut(COIN, CScript() << OP_TRUE), 10, false);
+
+    // Records from older versions end after vtxundo
+    CDataStream ssLegacy(SER_DISK, CLIENT_VERSION);
+    ssLegacy << undo;
+
+    undo.fHaveRCT = true;
+    undo.nFirstRCTOutput = 101;
+    undo.nLastRCTOutput = 104;
+    CKey key;
+    key.MakeNewKey(true);
+    undo.vKeyImages.push_back(CCmpPubKey(key.GetPubKey()));
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << undo;
+    BOOST_CHECK(ss.size() > ssLegacy.size());
+
+    CBlockUndo undoRead;
+    undoRead.fHaveRCT = true;
+    ss >> undoRead;
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK_EQUAL(undoRead.vtxundo.size(), 2);
+    BOOST_CHECK_EQUAL(undoRead.nFirstRCTOutput, 101);
+    BOOST_CHECK_EQUAL(undoRead.nLastRCTOutput, 104);
+    BOOST_REQUIRE_EQUAL(undoRead.vKeyImages.size(), 1);
+    BOOST_CHECK(undoRead.vKeyImages[0] == undo.vKeyImages[0]);
+
+    CBlockUndo undoLegacy;
+    ssLegacy >> undoLegacy;
+    BOOST_CHECK(ssLegacy.empty());
+    BOOST_CHECK(!undoLegacy.fHaveRCT);
+    BOOST_CHECK_EQUAL(undoLegacy.vtxundo.size(), 2);
+    BOOST_CHECK(undoLegacy.vKeyImages.empty());
+}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,173 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test/test_bitcoin.h>
+
+#include <blockfilter.h>
+#include <crypto/common.h>
+#include <key/stealth.h>
+#include <script/standard.h>
+#include <streams.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockfilter_tests)
+
+BOOST_AUTO_TEST_CASE(bitstream_reader_writer)
+{
+    CDataStream stream(SER_NETWORK, INIT_PROTO_VERSION);
+
+    BitStreamWriter<CDataStream> bit_writer(stream);
+    bit_writer.Write(0, 1);
+    bit_writer.Write(2, 2);
+    bit_writer.Write(6, 3);
+    bit_writer.Write(11, 4);
+    bit_writer.Write(1, 5);
+    bit_writer.Write(32, 6);
+    bit_writer.Write(7, 7);
+    bit_writer.Write(30497, 16);
+    bit_writer.Flush();
+
+    CDataStream stream_copy(stream);
+    uint32_t serialized_int1;
+    stream >> serialized_int1;
+    BOOST_CHECK_EQUAL(serialized_int1, (uint32_t)0x7700C35A); // NOTE: Serialized as LE
+    uint16_t serialized_int2;
+    stream >> serialized_int2;
+    BOOST_CHECK_EQUAL(serialized_int2, (uint16_t)0x1072); // NOTE: Serialized as LE
+
+    BitStreamReader<CDataStream> bit_reader(stream_copy);
+    BOOST_CHECK_EQUAL(bit_reader.Read(1), 0);
+    BOOST_CHECK_EQUAL(bit_reader.Read(2), 2);
+    BOOST_CHECK_EQUAL(bit_reader.Read(3), 6);
+    BOOST_CHECK_EQUAL(bit_reader.Read(4), 11);
+    BOOST_CHECK_EQUAL(bit_reader.Read(5), 1);
+    BOOST_CHECK_EQUAL(bit_reader.Read(6), 32);
+    BOOST_CHECK_EQUAL(bit_reader.Read(7), 7);
+    BOOST_CHECK_EQUAL(bit_reader.Read(16), 30497);
+    BOOST_CHECK_THROW(bit_reader.Read(8), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_test)
+{
+    GCSFilter::ElementSet included_elements, excluded_elements;
+    for (int i = 0; i < 100; ++i) {
+        GCSFilter::Element element1(32);
+        element1[0] = i;
+        included_elements.insert(std::move(element1));
+
+        GCSFilter::Element element2(32);
+        element2[1] = i;
+        excluded_elements.insert(std::move(element2));
+    }
+
+    GCSFilter filter({0, 0, 10, 1 << 10}, included_elements);
+    for (const auto& element : included_elements) {
+        BOOST_CHECK(filter.Match(element));
+
+        auto insertion = excluded_elements.insert(element);
+        BOOST_CHECK(filter.MatchAny(excluded_elements));
+        excluded_elements.erase(insertion.first);
+    }
+
+    // Round trip through the encoding
+    GCSFilter decoded(filter.GetParams(), filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), filter.GetN());
+    for (const auto& element : included_elements) {
+        BOOST_CHECK(decoded.Match(element));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_default_constructor)
+{
+    GCSFilter filter;
+    BOOST_CHECK_EQUAL(filter.GetN(), 0);
+    BOOST_CHECK_EQUAL(filter.GetEncoded().size(), 1);
+
+    const GCSFilter::Params& params = filter.GetParams();
+    BOOST_CHECK_EQUAL(params.m_siphash_k0, 0);
+    BOOST_CHECK_EQUAL(params.m_siphash_k1, 0);
+    BOOST_CHECK_EQUAL(params.m_P, 0);
+    BOOST_CHECK_EQUAL(params.m_M, 1);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_stealth_test)
+{
+    std::vector<uint8_t> vEphem(33, 0x02), vPk(33, 0x03);
+    vEphem[1] = 0x01;
+    vPk[1] = 0x02;
+    uint32_t nPrefix = 0xA5C3E7F1;
+
+    CScript included_script, excluded_script, spent_script;
+    included_script << std::vector<unsigned char>(20, 1) << OP_CHECKSIG;
+    excluded_script << std::vector<unsigned char>(20, 2) << OP_CHECKSIG;
+    spent_script << std::vector<unsigned char>(20, 3) << OP_CHECKSIG;
+
+    CMutableTransaction txn;
+    txn.nVersion = BITCOINC_TXN_VERSION;
+
+    OUTPUT_PTR<CTxOutStandard> outStd = MAKE_OUTPUT<CTxOutStandard>();
+    outStd->nValue = 100;
+    outStd->scriptPubKey = included_script;
+    txn.vpout.push_back(outStd);
+
+    OUTPUT_PTR<CTxOutRingCT> outAnon = MAKE_OUTPUT<CTxOutRingCT>();
+    outAnon->pk = CCmpPubKey(vPk);
+    outAnon->vData = vEphem;
+    outAnon->vData.push_back(DO_STEALTH_PREFIX);
+    outAnon->vData.resize(38);
+    WriteLE32(&outAnon->vData[34], nPrefix);
+    txn.vpout.push_back(outAnon);
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(txn));
+
+    CBlockUndo block_undo;
+    block_undo.vtxundo.emplace_back();
+    block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(100, spent_script), 1000, true);
+
+    BlockFilter block_filter(BlockFilterType::STEALTH, block, block_undo);
+    const GCSFilter& filter = block_filter.GetFilter();
+
+    BOOST_CHECK(filter.Match(GCSFilter::Element(included_script.begin(), included_script.end())));
+    BOOST_CHECK(filter.Match(GCSFilter::Element(spent_script.begin(), spent_script.end())));
+    BOOST_CHECK(!filter.Match(GCSFilter::Element(excluded_script.begin(), excluded_script.end())));
+
+    BOOST_CHECK(filter.Match(AnonOutputFilterElement(CCmpPubKey(vPk))));
+    BOOST_CHECK(filter.Match(EphemeralPubKeyFilterElement(vEphem.data())));
+
+    // Any prefix length matches, rounded down to the step size
+    for (uint8_t nBits = 0; nBits <= 32; ++nBits) {
+        BOOST_CHECK(filter.Match(StealthPrefixFilterElement(nBits, nPrefix)));
+    }
+    BOOST_CHECK(filter.Match(StealthPrefixFilterElement(4, nPrefix ^ 0xFFFFFFF0)));
+    BOOST_CHECK(!filter.Match(StealthPrefixFilterElement(32, nPrefix ^ 1)));
+
+    // Round trip through the encoding
+    BlockFilter block_filter2(block_filter.GetFilterType(), block_filter.GetBlockHash(),
+                              block_filter.GetEncodedFilter());
+    BOOST_CHECK(block_filter2.GetHash() == block_filter.GetHash());
+    BOOST_CHECK(block_filter2.ComputeHeader(uint256()) == block_filter.ComputeHeader(uint256()));
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block_filter;
+    BlockFilter block_filter3;
+    ss >> block_filter3;
+    BOOST_CHECK(block_filter3.GetFilterType() == BlockFilterType::STEALTH);
+    BOOST_CHECK(block_filter3.GetEncodedFilter() == block_filter.GetEncodedFilter());
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_type_names)
+{
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(BlockFilterType::STEALTH), "stealth");
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(static_cast<BlockFilterType>(0)), "");
+
+    BlockFilterType filter_type;
+    BOOST_CHECK(BlockFilterTypeByName("stealth", filter_type));
+    BOOST_CHECK(filter_type == BlockFilterType::STEALTH);
+    BOOST_CHECK(!BlockFilterTypeByName("basic", filter_type));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
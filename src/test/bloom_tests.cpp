@@ -175,6 +175,49 @@ BOOST_AUTO_TEST_CASE(bloom_match)
     BOOST_CHECK_MESSAGE(!filter.IsRelevantAndUpdate(tx), "Simple Bloom filter matched COutPoint for an output we didn't care about");
 }
 
+BOOST_AUTO_TEST_CASE(bloom_match_anon)
+{
+    std::vector<unsigned char> vPk(33, 0x02), vEphem(33, 0x03), vCommitment(33, 0x08), vKeyImage(33, 0x02);
+    vPk[1] = 0x11;
+    vEphem[1] = 0x22;
+    vCommitment[1] = 0x33;
+    vKeyImage[1] = 0x44;
+
+    CMutableTransaction txn;
+    txn.nVersion = BITCOINC_TXN_VERSION;
+    txn.vin.resize(1);
+    txn.vin[0].prevout.n = COutPoint::ANON_MARKER;
+    txn.vin[0].scriptData.stack.emplace_back(std::vector<unsigned char>(33, 0x09));
+    txn.vin[0].scriptData.stack[0].insert(txn.vin[0].scriptData.stack[0].end(), vKeyImage.begin(), vKeyImage.end());
+
+    OUTPUT_PTR<CTxOutRingCT> outAnon = MAKE_OUTPUT<CTxOutRingCT>();
+    outAnon->pk = CCmpPubKey(vPk);
+    memcpy(outAnon->commitment.data, vCommitment.data(), 33);
+    outAnon->vData = vEphem;
+    txn.vpout.push_back(outAnon);
+
+    std::vector<unsigned char> vStealthEphem(33, 0x02);
+    vStealthEphem[1] = 0x55;
+    OUTPUT_PTR<CTxOutData> outData = MAKE_OUTPUT<CTxOutData>();
+    outData->vData.push_back(DO_STEALTH);
+    outData->vData.insert(outData->vData.end(), vStealthEphem.begin(), vStealthEphem.end());
+    txn.vpout.push_back(outData);
+
+    CTransaction tx(txn);
+
+    for (const auto& element : {vPk, vEphem, vCommitment, vKeyImage, vStealthEphem}) {
+        CBloomFilter filter(10, 0.000001, 0, BLOOM_UPDATE_ALL);
+        filter.insert(element);
+        BOOST_CHECK_MESSAGE(filter.IsRelevantAndUpdate(tx), "Bloom filter didn't match anon element " + HexStr(element));
+    }
+
+    CBloomFilter filter(10, 0.000001, 0, BLOOM_UPDATE_ALL);
+    std::vector<unsigned char> vOther(33, 0x02);
+    vOther[1] = 0x66;
+    filter.insert(vOther);
+    BOOST_CHECK_MESSAGE(!filter.IsRelevantAndUpdate(tx), "Bloom filter matched random anon element");
+}
+
 BOOST_AUTO_TEST_CASE(merkle_block_1)
 {
     CBlock block = getBlock13b8a();
@@ -0,0 +1,84 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <cachebalancer.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(cachebalancer_tests, BasicTestingSetup)
+
+struct TestCache
+{
+    uint64_t nHits = 0;
+    uint64_t nMisses = 0;
+    size_t nMaxSize = 0;
+};
+
+static void AddTestCache(CCacheBalancer &balancer, const std::string &sName, TestCache &cache, size_t nSize, unsigned int nMissCost)
+{
+    cache.nMaxSize = nSize;
+    balancer.Add(sName, nSize, nSize / 4, nMissCost,
+        [&cache](uint64_t &nHits, uint64_t &nMisses) { nHits = cache.nHits; nMisses = cache.nMisses; },
+        [&cache](size_t nMaxSize) { cache.nMaxSize = nMaxSize; });
+}
+
+BOOST_AUTO_TEST_CASE(cachebalancer_rebalance)
+{
+    const size_t MiB = 1 << 20;
+    CCacheBalancer balancer;
+    TestCache a, b, c;
+    AddTestCache(balancer, "a", a, 64 * MiB, 1);
+    AddTestCache(balancer, "b", b, 64 * MiB, 1);
+    AddTestCache(balancer, "c", c, 64 * MiB, 4);
+    balancer.AddFixed("db", 8 * MiB);
+
+    // No misses, nothing moves
+    balancer.Rebalance();
+    BOOST_CHECK_EQUAL(a.nMaxSize, 64 * MiB);
+    BOOST_CHECK_EQUAL(b.nMaxSize, 64 * MiB);
+
+    // Only a misses: it grows by at most an eighth of the budget per rebalance
+    // and never takes the others below their minimum
+    for (int i = 0; i < 50; ++i)
+    {
+        a.nMisses += 1000;
+        balancer.Rebalance();
+        BOOST_CHECK(a.nMaxSize - 64 * MiB <= (size_t)(i + 1) * 24 * MiB);
+        BOOST_CHECK_EQUAL(a.nMaxSize + b.nMaxSize + c.nMaxSize, 192 * MiB);
+    };
+    BOOST_CHECK(a.nMaxSize > 64 * MiB);
+    BOOST_CHECK(b.nMaxSize >= 16 * MiB && b.nMaxSize < 18 * MiB);
+    BOOST_CHECK(c.nMaxSize >= 16 * MiB && c.nMaxSize < 18 * MiB);
+
+    // c's misses cost more, equal miss counts give it the larger share
+    for (int i = 0; i < 50; ++i)
+    {
+        a.nMisses += 1000;
+        b.nMisses += 1000;
+        c.nMisses += 1000;
+        balancer.Rebalance();
+        BOOST_CHECK_EQUAL(a.nMaxSize + b.nMaxSize + c.nMaxSize, 192 * MiB);
+    };
+    BOOST_CHECK(c.nMaxSize > a.nMaxSize);
+    BOOST_CHECK(c.nMaxSize > b.nMaxSize);
+
+    // A counter going back, as when a cache is recreated, counts as no misses
+    a.nMisses = 0;
+    balancer.Rebalance();
+
+    std::vector<CCacheBalancerInfo> vInfo = balancer.GetInfo();
+    BOOST_CHECK_EQUAL(vInfo.size(), 4U);
+    BOOST_CHECK(vInfo[0].fBalanced && vInfo[0].sName == "a");
+    BOOST_CHECK_EQUAL(vInfo[0].nMinSize, 16 * MiB);
+    BOOST_CHECK_EQUAL(vInfo[0].nMisses, 0U);
+    BOOST_CHECK_EQUAL(vInfo[2].nSize, c.nMaxSize);
+    BOOST_CHECK(!vInfo[3].fBalanced && vInfo[3].nSize == 8 * MiB);
+
+    balancer.Clear();
+    BOOST_CHECK(balancer.GetInfo().empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -74,6 +74,30 @@ struct UniqueCheck {
 };
 
 
+struct CostlyCheck {
+    static std::atomic<size_t> nCostRun;
+    unsigned int nCost;
+    bool fails;
+    CostlyCheck(unsigned int nCostIn, bool failsIn) : nCost(nCostIn), fails(failsIn) {};
+    CostlyCheck() : nCost(0), fails(false) {};
+    bool operator()()
+    {
+        nCostRun.fetch_add(nCost, std::memory_order_relaxed);
+        return !fails;
+    }
+    void swap(CostlyCheck& x)
+    {
+        std::swap(nCost, x.nCost);
+        std::swap(fails, x.fails);
+    };
+};
+
+static unsigned int GetCheckCost(const CostlyCheck& check)
+{
+    return check.nCost;
+}
+
+
 struct MemoryCheck {
     static std::atomic<size_t> fake_allocated_memory;
     bool b {false};
@@ -133,12 +157,14 @@ std::mutex UniqueCheck::m;
 std::unordered_multiset<size_t> UniqueCheck::results;
 std::atomic<size_t> FakeCheckCheckCompletion::n_calls{0};
 std::atomic<size_t> MemoryCheck::fake_allocated_memory{0};
+std::atomic<size_t> CostlyCheck::nCostRun{0};
 
 // Queue Typedefs
 typedef CCheckQueue<FakeCheckCheckCompletion> Correct_Queue;
 typedef CCheckQueue<FakeCheck> Standard_Queue;
 typedef CCheckQueue<FailingCheck> Failing_Queue;
 typedef CCheckQueue<UniqueCheck> Unique_Queue;
+typedef CCheckQueue<CostlyCheck> Costly_Queue;
 typedef CCheckQueue<MemoryCheck> Memory_Queue;
 typedef CCheckQueue<FrozenCleanupCheck> FrozenCleanup_Queue;
 
@@ -303,6 +329,44 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_UniqueCheck)
 }
 
 
+// Test that checks of very different cost, some costing more than a whole batch,
+// are each run once and failures among them are caught
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Costly)
+{
+    auto queue = std::unique_ptr<Costly_Queue>(new Costly_Queue {QUEUE_BATCH_SIZE});
+    boost::thread_group tg;
+    for (auto x = 0; x < nScriptCheckThreads; ++x) {
+       tg.create_thread([&]{queue->Thread();});
+    }
+
+    for (size_t i = 0; i < 100; ++i) {
+        size_t nExpected = 0;
+        CostlyCheck::nCostRun = 0;
+        CCheckQueueControl<CostlyCheck> control(queue.get());
+        for (size_t k = 0; k < 20; ++k) {
+            std::vector<CostlyCheck> vChecks;
+            size_t r = InsecureRandRange(50);
+            for (size_t n = 0; n < r; ++n) {
+                unsigned int nCost = InsecureRandRange(10) == 0 ? QUEUE_BATCH_SIZE * 2 : 1 + InsecureRandRange(4);
+                nExpected += nCost;
+                vChecks.emplace_back(nCost, false);
+            }
+            control.Add(vChecks);
+        }
+        if (i % 2) {
+            std::vector<CostlyCheck> vChecks;
+            vChecks.emplace_back(1, true);
+            control.Add(vChecks);
+        }
+        BOOST_REQUIRE(control.Wait() == (i % 2 == 0));
+        if (i % 2 == 0) {
+            BOOST_REQUIRE_EQUAL(CostlyCheck::nCostRun, nExpected);
+        }
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
 // Test that blocks which might allocate lots of memory free their memory aggressively.
 //
 // This test attempts to catch a pathological case where by lazily freeing
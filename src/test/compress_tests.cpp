@@ -3,7 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <compressor.h>
+#include <streams.h>
 #include <util.h>
+#include <utilstrencodings.h>
 #include <test/test_bitcoin.h>
 
 #include <stdint.h>
@@ -62,4 +64,74 @@ BOOST_AUTO_TEST_CASE(compress_amounts)
         BOOST_CHECK(TestDecode(i));
 }
 
+static size_t TestScript(const CScript &script, bool fExtended)
+{
+    CDataStream ss(SER_DISK, 0);
+    CScript in(script), out;
+    ss << CScriptCompressor(in, fExtended);
+    size_t nSize = ss.size();
+    CScriptCompressor cout(out, fExtended);
+    ss >> cout;
+    BOOST_CHECK(out == script);
+    BOOST_CHECK(ss.empty());
+    return nSize;
+}
+
+BOOST_AUTO_TEST_CASE(compress_scripts_extended)
+{
+    std::vector<unsigned char> h160 = ParseHex("0102030405060708090a0b0c0d0e0f1011121314");
+    std::vector<unsigned char> h256 = ParseHex("0102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f20");
+    CScript p2pkh = CScript() << OP_DUP << OP_HASH160 << h160 << OP_EQUALVERIFY << OP_CHECKSIG;
+    CScript p2sh = CScript() << OP_HASH160 << h160 << OP_EQUAL;
+    CScript p2pkh256 = CScript() << OP_DUP << OP_SHA256 << h256 << OP_EQUALVERIFY << OP_CHECKSIG;
+    CScript p2sh256 = CScript() << OP_SHA256 << h256 << OP_EQUAL;
+
+    // The base compression, used by the undo data, doesn't change
+    BOOST_CHECK_EQUAL(TestScript(p2pkh, false), 21U);
+    BOOST_CHECK_EQUAL(TestScript(p2pkh256, false), 38U);
+    BOOST_CHECK_EQUAL(TestScript(p2sh256, false), 36U);
+
+    BOOST_CHECK_EQUAL(TestScript(p2pkh, true), 21U);
+    BOOST_CHECK_EQUAL(TestScript(p2sh, true), 21U);
+    BOOST_CHECK_EQUAL(TestScript(p2pkh256, true), 33U);
+    BOOST_CHECK_EQUAL(TestScript(p2sh256, true), 33U);
+
+    for (const CScript &spend : {p2pkh, p2sh, p2pkh256, p2sh256}) {
+        CScript cs = CScript() << OP_ISCOINSTAKE << OP_IF;
+        cs.insert(cs.end(), p2pkh.begin(), p2pkh.end());
+        cs << OP_ELSE;
+        cs.insert(cs.end(), spend.begin(), spend.end());
+        cs << OP_ENDIF;
+        BOOST_CHECK_EQUAL(TestScript(cs, true), spend.size() < 30 ? 41U : 53U);
+
+        // Locks on the cold stake and plain templates
+        for (const CScript &locked : {cs, spend}) {
+            for (int64_t nLock : {0, 16, 17, 500000, 1577836800}) {
+                CScript tl = CScript() << nLock << OP_CHECKLOCKTIMEVERIFY << OP_DROP;
+                tl.insert(tl.end(), locked.begin(), locked.end());
+                BOOST_CHECK(TestScript(tl, true) < tl.size());
+                tl[tl.size() - locked.size() - 2] = OP_CHECKSEQUENCEVERIFY;
+                TestScript(tl, true);
+            }
+        }
+    }
+
+    // Unknown templates and locks pushed unlike CScript::push_int64 are stored as they are
+    CScript other = CScript() << OP_RETURN << h256;
+    BOOST_CHECK_EQUAL(TestScript(other, true), 1 + other.size());
+    CScript nonminimal = CScript() << std::vector<unsigned char>{1} << OP_CHECKLOCKTIMEVERIFY << OP_DROP;
+    nonminimal.insert(nonminimal.end(), p2pkh.begin(), p2pkh.end());
+    BOOST_CHECK_EQUAL(TestScript(nonminimal, true), 1 + nonminimal.size());
+    CScript nested = CScript() << 1 << OP_CHECKLOCKTIMEVERIFY << OP_DROP;
+    nested.insert(nested.end(), nonminimal.begin(), nonminimal.end());
+    TestScript(nested, true);
+
+    // Reserved codes
+    CDataStream ss(SER_DISK, 0);
+    ss << VARINT(0x0eU);
+    CScript out;
+    CScriptCompressor cout(out, true);
+    BOOST_CHECK_THROW(ss >> cout, std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -494,6 +494,30 @@ BOOST_AUTO_TEST_CASE(aes_cbc_testvectors) {
 }
 
 
+BOOST_AUTO_TEST_CASE(aes256_cbc_implementations)
+{
+    // The autodetected implementation must match the constant-time one, on
+    // lengths around the batch size of the hardware implementation.
+    std::vector<unsigned char> key = insecure_rand_ctx.randbytes(AES256_KEYSIZE);
+    std::vector<unsigned char> iv = insecure_rand_ctx.randbytes(AES_BLOCKSIZE);
+    for (size_t len = 1; len <= 300; len += InsecureRandRange(7) + 1) {
+        std::vector<unsigned char> in = insecure_rand_ctx.randbytes(len);
+        std::vector<unsigned char> expected(len + AES_BLOCKSIZE), out(len + AES_BLOCKSIZE);
+        std::vector<unsigned char> expected_dec(len + AES_BLOCKSIZE), out_dec(len + AES_BLOCKSIZE);
+
+        AES256AutoDetect(false);
+        int size = AES256CBCEncrypt(key.data(), iv.data(), true).Encrypt(in.data(), len, expected.data());
+        BOOST_CHECK_EQUAL(AES256CBCDecrypt(key.data(), iv.data(), true).Decrypt(expected.data(), size, expected_dec.data()), (int)len);
+
+        AES256AutoDetect();
+        BOOST_CHECK_EQUAL(AES256CBCEncrypt(key.data(), iv.data(), true).Encrypt(in.data(), len, out.data()), size);
+        BOOST_CHECK(out == expected);
+        BOOST_CHECK_EQUAL(AES256CBCDecrypt(key.data(), iv.data(), true).Decrypt(expected.data(), size, out_dec.data()), (int)len);
+        BOOST_CHECK(out_dec == expected_dec);
+        BOOST_CHECK(std::equal(in.begin(), in.end(), out_dec.begin()));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(chacha20_testvector)
 {
     // Test vector from RFC 7539
@@ -562,4 +586,43 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+BOOST_AUTO_TEST_CASE(hmac_sha512_multi)
+{
+    unsigned char key[32];
+    for (int j = 0; j < 32; ++j) {
+        key[j] = InsecureRandBits(8);
+    }
+    for (size_t len : {0, 37, 64, 111}) {
+        for (int i = 0; i <= 9; ++i) {
+            unsigned char in[111 * 9];
+            unsigned char out1[64 * 9], out2[64 * 9];
+            for (size_t j = 0; j < len * i; ++j) {
+                in[j] = InsecureRandBits(8);
+            }
+            for (int j = 0; j < i; ++j) {
+                CHMAC_SHA512(key, sizeof(key)).Write(in + len * j, len).Finalize(out1 + 64 * j);
+            }
+            HMAC_SHA512_Multi(out2, key, sizeof(key), in, len, i);
+            BOOST_CHECK(memcmp(out1, out2, 64 * i) == 0);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(pbkdf2_hmac_sha512)
+{
+    // BIP39 test vector, the seed of "abandon ... about" with the passphrase TREZOR, repeated over multi-way lanes
+    std::string sMnemonic = "abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon about";
+    std::string sSalt = "mnemonicTREZOR";
+    std::vector<uint8_t> expect = ParseHex("c55257c360c07c72029aebc1b53c05ed0362ada38ead3e3e9efa3708e53495531f09a6987599d18264c1e1c92f2cf141630c7a3c4ab7c81b2f001698e7463b04");
+    for (size_t i = 1; i <= 5; ++i) {
+        std::vector<const unsigned char*> keys(i, (const unsigned char*)sMnemonic.data()), salts(i, (const unsigned char*)sSalt.data());
+        std::vector<size_t> keylens(i, sMnemonic.size()), saltlens(i, sSalt.size());
+        std::vector<unsigned char> out(64 * i);
+        PBKDF2_HMAC_SHA512_64(out.data(), keys.data(), keylens.data(), salts.data(), saltlens.data(), 2048, i);
+        for (size_t j = 0; j < i; ++j) {
+            BOOST_CHECK(std::equal(expect.begin(), expect.end(), out.begin() + 64 * j));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -11,10 +11,21 @@
 #include <secp256k1_rangeproof.h>
 #include <inttypes.h>
 #include <utilstrencodings.h>
+#include <arith_uint256.h>
+#include <random.h>
 
 #include <boost/test/unit_test.hpp>
 
 #include <blind.h>
+#include <primitives/transaction.h>
+#include <streams.h>
+#include <version.h>
+
+#if defined(HAVE_CONSENSUS_LIB)
+#include <script/bitcoincconsensus.h>
+#endif
+
+#include <thread>
 
 BOOST_FIXTURE_TEST_SUITE(ct_tests, BasicTestingSetup)
 
@@ -210,4 +221,201 @@ BOOST_AUTO_TEST_CASE(ct_commitment_test)
     secp256k1_context_destroy(ctx);
 }
 
+BOOST_AUTO_TEST_CASE(ct_bulletproof_batch_test)
+{
+    ECC_Start_Blinding();
+
+    const size_t nProofs = MAX_BULLETPROOF_BATCH + 3;
+    std::vector<secp256k1_pedersen_commitment> vCommitments(nProofs + 1);
+    std::vector<std::vector<uint8_t> > vRangeproofs(nProofs);
+    std::vector<uint8_t> vBlind(32);
+    uint256 nonce;
+
+    CBulletproofBatch batch;
+    for (size_t k = 0; k < nProofs; ++k)
+    {
+        uint64_t nValue = GetRand(MAX_MONEY);
+        GetStrongRandBytes(vBlind.data(), 32);
+        GetStrongRandBytes(nonce.begin(), 32);
+
+        BOOST_REQUIRE(secp256k1_pedersen_commit(secp256k1_ctx_blind, &vCommitments[k], vBlind.data(), nValue,
+            &secp256k1_generator_const_h, &secp256k1_generator_const_g));
+
+        const uint8_t *bp[1] = {vBlind.data()};
+        size_t nRangeProofLen = 5134;
+        vRangeproofs[k].resize(nRangeProofLen);
+        CBlindScratch scratch;
+        BOOST_REQUIRE(secp256k1_bulletproof_rangeproof_prove(secp256k1_ctx_blind, scratch.get(), blind_gens,
+            vRangeproofs[k].data(), &nRangeProofLen, &nValue, nullptr, bp, 1,
+            &secp256k1_generator_const_h, 64, nonce.begin(), nullptr, 0));
+        vRangeproofs[k].resize(nRangeProofLen);
+
+        batch.Add(ArithToUint256(k), vRangeproofs[k], vCommitments[k]);
+    };
+
+    uint256 txidFailed;
+    BOOST_CHECK(batch.Size() == nProofs);
+    BOOST_CHECK(batch.Verify(txidFailed));
+
+    // A proof over the wrong commitment must fail the batch and be identified
+    vCommitments[nProofs] = vCommitments[0];
+    batch.Add(ArithToUint256(nProofs + 7), vRangeproofs[1], vCommitments[nProofs]);
+    BOOST_CHECK(!batch.Verify(txidFailed));
+    BOOST_CHECK(txidFailed == ArithToUint256(nProofs + 7));
+
+    batch.Clear();
+    BOOST_CHECK(batch.Size() == 0);
+    BOOST_CHECK(batch.Verify(txidFailed));
+
+    // Proofs verified by a caching batch are skipped by later batches
+    CBulletproofBatch batchStore(true);
+    for (size_t k = 0; k < 4; ++k)
+        batchStore.Add(ArithToUint256(k), vRangeproofs[k], vCommitments[k]);
+    BOOST_CHECK(batchStore.Size() == 4);
+    BOOST_CHECK(batchStore.Verify(txidFailed));
+
+    for (size_t k = 0; k < 5; ++k)
+        batch.Add(ArithToUint256(k), vRangeproofs[k], vCommitments[k]);
+    BOOST_CHECK(batch.Size() == 1);
+
+    uint256 entry;
+    ComputeRangeProofCacheEntry(entry, vRangeproofs[1], vCommitments[nProofs]);
+    BOOST_CHECK(!GetRangeProofCacheEntry(entry, false));
+
+    ECC_Stop_Blinding();
+}
+
+BOOST_AUTO_TEST_CASE(ct_blind_scratch_test)
+{
+    ECC_Start_Blinding();
+
+    secp256k1_scratch_space *p1, *p2, *pOther = nullptr;
+    {
+        CBlindScratch scratch1;
+        CBlindScratch scratch2;
+        p1 = scratch1.get();
+        p2 = scratch2.get();
+        BOOST_CHECK(p1 && p2);
+        BOOST_CHECK(p1 != p2);
+    }
+
+    // Released spaces are reused by the same thread
+    {
+        CBlindScratch scratch;
+        BOOST_CHECK(scratch.get() == p1 || scratch.get() == p2);
+    }
+
+    // Other threads never share a space in use
+    {
+        CBlindScratch scratch;
+        std::thread t([&pOther] {
+            CBlindScratch scratchOther;
+            pOther = scratchOther.get();
+        });
+        t.join();
+        BOOST_CHECK(pOther && pOther != scratch.get());
+    }
+
+    ECC_Stop_Blinding();
+}
+
+#if defined(HAVE_CONSENSUS_LIB)
+/** Thread pool of the consensus library tests, a thread per job */
+static void RunJobsOnThreads(void *pool, bitcoinconsensus_job job, void *jobCtx, unsigned int nJobs)
+{
+    (*(unsigned int*)pool) += nJobs;
+    std::vector<std::thread> vThreads;
+    for (unsigned int i = 0; i < nJobs; ++i)
+        vThreads.emplace_back(job, jobCtx, i);
+    for (auto &t : vThreads)
+        t.join();
+}
+
+BOOST_AUTO_TEST_CASE(ct_consensus_lib_test)
+{
+    ECC_Start_Blinding();
+
+    const size_t nTxs = 20;
+    std::vector<std::vector<uint8_t> > vTxData(nTxs);
+    std::vector<secp256k1_pedersen_commitment> vCommitments(nTxs);
+    std::vector<uint8_t> vBlind(32);
+    uint256 nonce;
+    for (size_t k = 0; k < nTxs; ++k)
+    {
+        CMutableTransaction mtx;
+        mtx.nVersion = BITCOINC_TXN_VERSION;
+        mtx.vin.emplace_back(COutPoint(ArithToUint256(k + 1), 0));
+
+        OUTPUT_PTR<CTxOutRingCT> outAnon = MAKE_OUTPUT<CTxOutRingCT>();
+        uint64_t nValue = GetRand(MAX_MONEY);
+        GetStrongRandBytes(vBlind.data(), 32);
+        GetStrongRandBytes(nonce.begin(), 32);
+        BOOST_REQUIRE(secp256k1_pedersen_commit(secp256k1_ctx_blind, &outAnon->commitment, vBlind.data(), nValue,
+            &secp256k1_generator_const_h, &secp256k1_generator_const_g));
+        vCommitments[k] = outAnon->commitment;
+
+        const uint8_t *bp[1] = {vBlind.data()};
+        size_t nRangeProofLen = 5134;
+        outAnon->vRangeproof.resize(nRangeProofLen);
+        CBlindScratch scratch;
+        BOOST_REQUIRE(secp256k1_bulletproof_rangeproof_prove(secp256k1_ctx_blind, scratch.get(), blind_gens,
+            outAnon->vRangeproof.data(), &nRangeProofLen, &nValue, nullptr, bp, 1,
+            &secp256k1_generator_const_h, 64, nonce.begin(), nullptr, 0));
+        outAnon->vRangeproof.resize(nRangeProofLen);
+
+        // The last txn proves the value of another commitment
+        if (k == nTxs - 1)
+            outAnon->commitment = vCommitments[0];
+        mtx.vpout.push_back(outAnon);
+
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << mtx;
+        vTxData[k].assign(ss.begin(), ss.end());
+    };
+
+    std::vector<const unsigned char*> vpTxs(nTxs);
+    std::vector<unsigned int> vTxLens(nTxs);
+    for (size_t k = 0; k < nTxs; ++k)
+    {
+        vpTxs[k] = vTxData[k].data();
+        vTxLens[k] = vTxData[k].size();
+    };
+
+    bitcoinconsensus_error err;
+    BOOST_CHECK(bitcoinconsensus_verify_rangeproofs(vpTxs[0], vTxLens[0], bitcoinconsensus_CT_FLAGS_VERIFY_BULLETPROOFS, &err) == 1);
+    BOOST_CHECK(err == bitcoinconsensus_ERR_OK);
+    BOOST_CHECK(bitcoinconsensus_verify_rangeproofs(vpTxs[nTxs - 1], vTxLens[nTxs - 1], bitcoinconsensus_CT_FLAGS_VERIFY_BULLETPROOFS, &err) == 0);
+    BOOST_CHECK(err == bitcoinconsensus_ERR_OK);
+    BOOST_CHECK(bitcoinconsensus_verify_rangeproofs(vpTxs[0], vTxLens[0] - 1, bitcoinconsensus_CT_FLAGS_VERIFY_BULLETPROOFS, &err) == 0);
+    BOOST_CHECK(err == bitcoinconsensus_ERR_TX_DESERIALIZE);
+    BOOST_CHECK(bitcoinconsensus_verify_rangeproofs(vpTxs[0], vTxLens[0], 1U << 7, &err) == 0);
+    BOOST_CHECK(err == bitcoinconsensus_ERR_INVALID_FLAGS);
+
+    // The invalid txn fails the batch, jobs run on the caller's pool
+    unsigned int nJobs = 0;
+    std::vector<int> vResults(nTxs);
+    std::vector<bitcoinconsensus_error> vErrs(nTxs);
+    BOOST_CHECK(bitcoinconsensus_verify_rangeproofs_batch(vpTxs.data(), vTxLens.data(), nTxs,
+        bitcoinconsensus_CT_FLAGS_VERIFY_BULLETPROOFS, vResults.data(), vErrs.data(), RunJobsOnThreads, &nJobs) == 0);
+    BOOST_CHECK(nJobs == 2);
+    for (size_t k = 0; k < nTxs; ++k)
+    {
+        BOOST_CHECK(vResults[k] == (k == nTxs - 1 ? 0 : 1));
+        BOOST_CHECK(vErrs[k] == bitcoinconsensus_ERR_OK);
+    };
+
+    BOOST_CHECK(bitcoinconsensus_verify_rangeproofs_batch(vpTxs.data(), vTxLens.data(), nTxs - 1,
+        bitcoinconsensus_CT_FLAGS_VERIFY_BULLETPROOFS, vResults.data(), nullptr, nullptr, nullptr) == 1);
+
+    // Txns with plain inputs have no rings to verify
+    bitcoinconsensus_ringct_tx tx{vpTxs[0], vTxLens[0], nullptr, nullptr, 0};
+    BOOST_CHECK(bitcoinconsensus_verify_ringct(tx.txTo, tx.txToLen, nullptr, nullptr, 0, &err) == 0);
+    BOOST_CHECK(err == bitcoinconsensus_ERR_TX_NOT_RINGCT);
+    BOOST_CHECK(bitcoinconsensus_verify_ringct_batch(&tx, 1, vResults.data(), vErrs.data(), RunJobsOnThreads, &nJobs) == 0);
+    BOOST_CHECK(vErrs[0] == bitcoinconsensus_ERR_TX_NOT_RINGCT);
+
+    ECC_Stop_Blinding();
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,7 @@
 #include <random.h>
 #include <test/test_bitcoin.h>
 
+#include <map>
 #include <memory>
 
 #include <boost/test/unit_test.hpp>
@@ -85,6 +86,46 @@ BOOST_AUTO_TEST_CASE(dbwrapper_maxopenfiles_1000)
     BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_profile)
+{
+    std::string strError;
+    DBProfile profile;
+
+    gArgs.ForceSetArg("-dbprofile", "bloombits=0");
+    BOOST_CHECK(!CheckDBProfiles(strError));
+    BOOST_CHECK(!ReadDBProfile("dbprofile_test", profile, strError));
+
+    gArgs.ForceSetArg("-dbprofile", "dbprofile_test:blocksize=1");
+    BOOST_CHECK(!CheckDBProfiles(strError));
+
+    gArgs.ForceSetArg("-dbprofile", "dbprofile_test:cache=1");
+    BOOST_CHECK(!CheckDBProfiles(strError));
+
+    gArgs.ForceSetArg("-dbprofile", "dbprofile_test:blocksize=65536");
+    BOOST_CHECK(CheckDBProfiles(strError));
+    BOOST_CHECK(ReadDBProfile("chainstate", profile, strError));
+    BOOST_CHECK(profile.nBlockSize == 4 * 1024);
+    BOOST_CHECK(ReadDBProfile("dbprofile_test", profile, strError));
+    BOOST_CHECK(profile.nBlockSize == 64 * 1024);
+    BOOST_CHECK(profile.nBloomBits == 10);
+
+    // Extreme settings still give a working database
+    for (const char* option : {"dbprofile_test:bloombits=0", "dbprofile_test:blockcache=100", "dbprofile_test:compression=1"}) {
+        gArgs.ForceSetArg("-dbprofile", option);
+        fs::path ph = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path() / "dbprofile_test";
+        CDBWrapper dbw(ph, (1 << 20), true, false, false, false);
+        char key = 'k';
+        uint256 in = GetRandHash();
+        uint256 res;
+
+        BOOST_CHECK(dbw.Write(key, in));
+        BOOST_CHECK(dbw.Read(key, res));
+        BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+    }
+
+    gArgs.ForceSetArg("-dbprofile", "dbprofile_test:bloombits=10");
+}
+
 // Test batch operations
 BOOST_AUTO_TEST_CASE(dbwrapper_batch)
 {
@@ -162,6 +203,91 @@ BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_readmany)
+{
+    // Perform tests both obfuscated and non-obfuscated.
+    for (bool obfuscate : {false, true}) {
+        fs::path ph = SetDataDir(std::string("dbwrapper_readmany").append(obfuscate ? "_true" : "_false"));
+        CDBWrapper dbw(ph, (1 << 20), true, false, obfuscate);
+
+        // Little-endian keys, so db order differs from numeric order
+        std::map<int64_t, uint256> mapIn;
+        for (int64_t i = 1; i <= 300; ++i) {
+            mapIn[i] = InsecureRand256();
+            BOOST_CHECK(dbw.Write(std::make_pair('A', i), mapIn[i]));
+        }
+
+        std::vector<std::pair<char, int64_t> > vKeys;
+        for (int64_t i : {256, 3, 1, 255, 3, 300, 2, 257, 128}) {
+            vKeys.push_back(std::make_pair('A', i));
+        }
+
+        std::vector<uint256> vRes;
+        BOOST_CHECK(dbw.ReadMany(vKeys, vRes));
+        BOOST_CHECK_EQUAL(vRes.size(), vKeys.size());
+        for (size_t k = 0; k < vKeys.size(); ++k) {
+            BOOST_CHECK_EQUAL(vRes[k].ToString(), mapIn[vKeys[k].second].ToString());
+        }
+
+        // Any missing key fails the whole read
+        vKeys.push_back(std::make_pair('A', (int64_t)301));
+        BOOST_CHECK(!dbw.ReadMany(vKeys, vRes));
+        vKeys.back().second = 0;
+        BOOST_CHECK(!dbw.ReadMany(vKeys, vRes));
+
+        vKeys.clear();
+        BOOST_CHECK(dbw.ReadMany(vKeys, vRes));
+        BOOST_CHECK(vRes.empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_snapshot)
+{
+    fs::path ph = SetDataDir(std::string("dbwrapper_snapshot"));
+    CDBWrapper dbw(ph, (1 << 20), true, false, true);
+
+    uint256 in1 = InsecureRand256(), in2 = InsecureRand256(), in3 = InsecureRand256();
+    BOOST_CHECK(dbw.Write('a', in1));
+    BOOST_CHECK(dbw.Write('b', in2));
+
+    uint256 res;
+    {
+        CDBSnapshot snapshot(dbw);
+
+        // Writes after the snapshot was taken are only seen without it
+        BOOST_CHECK(dbw.Write('a', in3));
+        BOOST_CHECK(dbw.Erase('b'));
+        BOOST_CHECK(dbw.Write('c', in3));
+
+        BOOST_CHECK(dbw.Read('a', res, &snapshot));
+        BOOST_CHECK_EQUAL(res.ToString(), in1.ToString());
+        BOOST_CHECK(dbw.Read('b', res, &snapshot));
+        BOOST_CHECK_EQUAL(res.ToString(), in2.ToString());
+        BOOST_CHECK(!dbw.Read('c', res, &snapshot));
+
+        std::vector<uint256> vRes;
+        BOOST_CHECK(dbw.ReadMany(std::vector<char>{'b', 'a'}, vRes, &snapshot));
+        BOOST_CHECK_EQUAL(vRes[0].ToString(), in2.ToString());
+        BOOST_CHECK_EQUAL(vRes[1].ToString(), in1.ToString());
+
+        std::unique_ptr<CDBIterator> it(dbw.NewIterator(&snapshot));
+        char key;
+        size_t nKeys = 0;
+        for (it->Seek('a'); it->Valid() && it->GetKey(key) && key <= 'c'; it->Next()) {
+            BOOST_CHECK(key == 'a' || key == 'b');
+            nKeys++;
+        }
+        BOOST_CHECK_EQUAL(nKeys, 2U);
+
+        BOOST_CHECK(dbw.Read('a', res));
+        BOOST_CHECK_EQUAL(res.ToString(), in3.ToString());
+        BOOST_CHECK(!dbw.Read('b', res));
+    }
+
+    BOOST_CHECK(dbw.Read('c', res));
+    BOOST_CHECK_EQUAL(res.ToString(), in3.ToString());
+}
+
 // Test that we do not obfuscation if there is existing data.
 BOOST_AUTO_TEST_CASE(existing_data_no_obfuscate)
 {
@@ -549,6 +549,26 @@ BOOST_AUTO_TEST_CASE(extkey_regtest_keys)
     SelectParams(CBaseChainParams::MAIN);
 }
 
+BOOST_AUTO_TEST_CASE(extkey_derive_pubkeys)
+{
+    CExtKey evkey;
+    evkey.SetSeed(ParseHex("000102030405060708090a0b0c0d0e0f").data(), 16);
+    CExtKeyPair kp(evkey);
+
+    std::vector<CPubKey> vPubKeys;
+    BOOST_CHECK(kp.DerivePubKeys(vPubKeys, 5, 20));
+    BOOST_CHECK(vPubKeys.size() == 20);
+    for (uint32_t k = 0; k < 20; ++k)
+    {
+        CPubKey pk;
+        BOOST_CHECK(kp.Derive(pk, 5 + k));
+        BOOST_CHECK(pk == vPubKeys[k]);
+    };
+
+    // Hardened children can't be derived from the pubkey
+    BOOST_CHECK(!kp.DerivePubKeys(vPubKeys, (1u << 31) - 2, 4));
+}
+
 BOOST_AUTO_TEST_CASE(extkey_account)
 {
     CExtKeyAccount eka;
@@ -0,0 +1,85 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test/test_bitcoin.h>
+
+#include <chain.h>
+#include <random.h>
+#include <txdb.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(indexwrite_tests, BasicTestingSetup)
+
+static CIndexWriteJob MakeJob(const CBlockIndex *pindex, const uint256 &addressHash, const uint256 &txid, CAmount nValue, bool fDisconnecting)
+{
+    CIndexWriteJob job;
+    job.fDisconnecting = fDisconnecting;
+    job.fAddressBalanceIndex = true;
+    job.addressIndex.push_back(std::make_pair(
+        CAddressIndexKey(ADDR_INDT_PUBKEY_ADDRESS, addressHash, pindex->nHeight, 1, txid, 0, false), nValue));
+    job.addressUnspentIndex.push_back(std::make_pair(
+        CAddressUnspentKey(ADDR_INDT_PUBKEY_ADDRESS, addressHash, txid, 0),
+        fDisconnecting ? CAddressUnspentValue() : CAddressUnspentValue(nValue, CScript(), pindex->nHeight)));
+    if (!fDisconnecting) {
+        job.pindexTimestamp = pindex;
+    }
+    return job;
+}
+
+BOOST_AUTO_TEST_CASE(indexwrite_ordered)
+{
+    CBlockTreeDB db(1 << 20, true);
+
+    uint256 hashBlocks[3];
+    CBlockIndex blocks[3];
+    for (int i = 0; i < 3; ++i) {
+        hashBlocks[i] = InsecureRand256();
+        blocks[i].phashBlock = &hashBlocks[i];
+        blocks[i].pprev = i > 0 ? &blocks[i - 1] : nullptr;
+        blocks[i].nHeight = i + 1;
+        // Out of order times take the next logical timestamp
+        blocks[i].nTime = i == 1 ? 1000 : 1000 + i * 100;
+    }
+
+    uint256 addressHash = InsecureRand256();
+    std::vector<uint256> txids;
+    for (int i = 0; i < 3; ++i) {
+        txids.push_back(InsecureRand256());
+        BOOST_CHECK(db.QueueIndexWrite(MakeJob(&blocks[i], addressHash, txids[i], (i + 1) * COIN, false)));
+    }
+
+    // Reads wait for the queued blocks, the balance builds on each earlier block
+    CAddressBalanceValue balance;
+    BOOST_CHECK(db.ReadAddressBalance(addressHash, ADDR_INDT_PUBKEY_ADDRESS, balance));
+    BOOST_CHECK_EQUAL(balance.balance, 6 * COIN);
+    BOOST_CHECK_EQUAL(balance.nTxCount, 3U);
+    BOOST_CHECK_EQUAL(balance.nLastHeight, 3);
+
+    unsigned int logicalTS = 0;
+    BOOST_CHECK(db.ReadTimestampBlockIndex(hashBlocks[1], logicalTS));
+    BOOST_CHECK_EQUAL(logicalTS, 1001U);
+    BOOST_CHECK(db.ReadTimestampBlockIndex(hashBlocks[2], logicalTS));
+    BOOST_CHECK_EQUAL(logicalTS, 1200U);
+
+    // Disconnect the tip
+    BOOST_CHECK(db.QueueIndexWrite(MakeJob(&blocks[2], addressHash, txids[2], 3 * COIN, true)));
+    BOOST_CHECK(db.SyncIndexWrites());
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    BOOST_CHECK(db.ReadAddressIndex(addressHash, ADDR_INDT_PUBKEY_ADDRESS, addressIndex));
+    BOOST_REQUIRE_EQUAL(addressIndex.size(), 2U);
+    BOOST_CHECK(addressIndex[1].first.txhash == txids[1]);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspent;
+    BOOST_CHECK(db.ReadAddressUnspentIndex(addressHash, ADDR_INDT_PUBKEY_ADDRESS, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), 2U);
+
+    BOOST_CHECK(db.ReadAddressBalance(addressHash, ADDR_INDT_PUBKEY_ADDRESS, balance));
+    BOOST_CHECK_EQUAL(balance.balance, 3 * COIN);
+    BOOST_CHECK_EQUAL(balance.nTxCount, 2U);
+    BOOST_CHECK_EQUAL(balance.nLastHeight, 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
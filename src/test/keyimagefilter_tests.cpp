@@ -0,0 +1,81 @@
+// Copyright (c) 2018 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test/test_bitcoin.h>
+
+#include <key.h>
+#include <keyimagefilter.h>
+#include <txdb.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(keyimagefilter_tests, BasicTestingSetup)
+
+static CCmpPubKey MakeKeyImage()
+{
+    CKey key;
+    key.MakeNewKey(true);
+    return CCmpPubKey(key.GetPubKey());
+}
+
+BOOST_AUTO_TEST_CASE(keyimagefilter_basic)
+{
+    CKeyImageFilter filter;
+    CCmpPubKey ki = MakeKeyImage();
+
+    // A disabled filter can't rule anything out
+    BOOST_CHECK(!filter.IsEnabled());
+    BOOST_CHECK(filter.MaybeContains(ki));
+
+    filter.Reset(0);
+    BOOST_CHECK(filter.IsEnabled());
+    BOOST_CHECK_EQUAL(filter.GetCapacity(), KEYIMAGE_FILTER_MIN_ELEMENTS);
+
+    std::vector<CCmpPubKey> vki;
+    for (int i = 0; i < 1000; ++i)
+    {
+        vki.push_back(MakeKeyImage());
+        filter.Insert(vki.back());
+    };
+
+    for (const auto &k : vki)
+        BOOST_CHECK(filter.MaybeContains(k));
+
+    size_t nFalsePositives = 0;
+    for (int i = 0; i < 1000; ++i)
+        if (filter.MaybeContains(MakeKeyImage()))
+            nFalsePositives++;
+    BOOST_CHECK(nFalsePositives < 10);
+    BOOST_CHECK(filter.GetSkipped() >= 990U);
+    BOOST_CHECK(!filter.NeedsResize());
+
+    filter.Disable();
+    BOOST_CHECK(filter.MaybeContains(ki));
+}
+
+BOOST_AUTO_TEST_CASE(keyimagefilter_blocktree)
+{
+    CBlockTreeDB db(1 << 20, true);
+    CCmpPubKey kiOld = MakeKeyImage(), kiNew = MakeKeyImage();
+    uint256 txhash = GetRandHash(), txhashRead;
+
+    BOOST_CHECK(db.WriteRCTKeyImage(kiOld, txhash));
+    BOOST_CHECK(db.LoadKeyImageFilter());
+    BOOST_CHECK(db.GetKeyImageFilter().IsEnabled());
+    BOOST_CHECK_EQUAL(db.GetKeyImageFilter().GetInserted(), 1U);
+
+    // Loaded from the db
+    BOOST_CHECK(db.ReadRCTKeyImage(kiOld, txhashRead));
+    BOOST_CHECK(txhashRead == txhash);
+
+    // Written after the filter was loaded
+    BOOST_CHECK(!db.ReadRCTKeyImage(kiNew, txhashRead));
+    BOOST_CHECK(db.WriteRCTKeyImage(kiNew, txhash));
+    BOOST_CHECK(db.ReadRCTKeyImage(kiNew, txhashRead));
+
+    BOOST_CHECK(db.EraseRCTKeyImage(kiNew));
+    BOOST_CHECK(!db.ReadRCTKeyImage(kiNew, txhashRead));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
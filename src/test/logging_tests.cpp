@@ -0,0 +1,102 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <logging.h>
+#include <test/test_bitcoin.h>
+#include <util.h>
+
+#include <fstream>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(logging_tests, BasicTestingSetup)
+
+static std::vector<std::string> ReadLines(const fs::path &path)
+{
+    std::vector<std::string> lines;
+    std::ifstream file(path.string());
+    std::string line;
+    while (std::getline(file, line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+BOOST_AUTO_TEST_CASE(logging_writer)
+{
+    fs::path path = GetDataDir() / "logging_writer.log";
+    {
+        BCLog::Logger logger;
+        logger.m_print_to_file = true;
+        logger.m_log_timestamps = false;
+        logger.m_file_path = path;
+
+        // Buffered before the file is open, then written by the writer thread
+        logger.LogPrintStr("before open\n");
+        BOOST_REQUIRE(logger.OpenDebugLog());
+        logger.StartWriter(256, false);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&logger, t]() {
+                for (int i = 0; i < 500; ++i) {
+                    logger.LogPrintStr(strprintf("%d %d\n", t, i));
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        // Stopping writes out what is buffered, later messages are written directly
+        logger.StopWriter();
+        logger.LogPrintStr("after stop\n");
+    }
+
+    std::vector<std::string> lines = ReadLines(path);
+    BOOST_REQUIRE_EQUAL(lines.size(), 2002U);
+    BOOST_CHECK_EQUAL(lines.front(), "before open");
+    BOOST_CHECK_EQUAL(lines.back(), "after stop");
+
+    // Nothing is lost and the messages of each thread stay in order
+    std::vector<int> next(4, 0);
+    for (size_t i = 1; i + 1 < lines.size(); ++i) {
+        int t, n;
+        BOOST_REQUIRE(sscanf(lines[i].c_str(), "%d %d", &t, &n) == 2);
+        BOOST_REQUIRE(t >= 0 && t < 4);
+        BOOST_CHECK_EQUAL(n, next[t]++);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(logging_writer_drop)
+{
+    fs::path path = GetDataDir() / "logging_writer_drop.log";
+    {
+        BCLog::Logger logger;
+        logger.m_print_to_file = true;
+        logger.m_log_timestamps = false;
+        logger.m_file_path = path;
+        BOOST_REQUIRE(logger.OpenDebugLog());
+        logger.StartWriter(16, true);
+        for (int i = 0; i < 1000; ++i) {
+            logger.LogPrintStr(strprintf("%d\n", i));
+        }
+        logger.StopWriter();
+    }
+
+    // Each message is either written or counted as dropped
+    uint64_t nWritten = 0, nDropped = 0;
+    for (const auto &line : ReadLines(path)) {
+        unsigned int n;
+        if (sscanf(line.c_str(), "Dropped %u log messages", &n) == 1) {
+            nDropped += n;
+        } else {
+            nWritten++;
+        }
+    }
+    BOOST_CHECK_EQUAL(nWritten + nDropped, 1000U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
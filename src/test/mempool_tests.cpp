@@ -749,4 +749,43 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 6ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolKeyImageTest)
+{
+    CTxMemPool pool;
+    LOCK(pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction tx = CMutableTransaction();
+    tx.vin.resize(1);
+    tx.vin[0].prevout.n = COutPoint::ANON_MARKER;
+    tx.vin[0].SetAnonInfo(2, 3);
+    std::vector<uint8_t> vKeyImages(2 * 33);
+    for (size_t k = 0; k < 2; ++k) {
+        vKeyImages[k * 33] = 0x02;
+        vKeyImages[k * 33 + 1] = k + 1;
+    }
+    tx.vin[0].scriptData.stack.push_back(vKeyImages);
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx.vout[0].nValue = 10 * COIN;
+
+    // Key images are counted towards the mempool size
+    size_t nUsageEmpty = pool.DynamicMemoryUsage();
+    size_t nKeyImagesEmpty = memusage::DynamicUsage(pool.mapKeyImages);
+    pool.addUnchecked(tx.GetHash(), entry.Fee(10000LL).FromTx(tx));
+    BOOST_CHECK_EQUAL(pool.mapKeyImages.size(), 2U);
+    BOOST_CHECK(pool.DynamicMemoryUsage() - nUsageEmpty >= memusage::DynamicUsage(pool.mapKeyImages) - nKeyImagesEmpty);
+
+    uint256 txhash;
+    CCmpPubKey ki(vKeyImages.begin() + 33, vKeyImages.end());
+    BOOST_CHECK(pool.HaveKeyImage(ki, txhash));
+    BOOST_CHECK(txhash == tx.GetHash());
+
+    // Evicting the txn drops its key images
+    pool.TrimToSize(1);
+    BOOST_CHECK(!pool.exists(tx.GetHash()));
+    BOOST_CHECK(pool.mapKeyImages.empty());
+    BOOST_CHECK(!pool.HaveKeyImage(ki, txhash));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
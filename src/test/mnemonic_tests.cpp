@@ -49,6 +49,28 @@ BOOST_AUTO_TEST_CASE(mnemonic_test_fails)
     BOOST_CHECK_MESSAGE(5 == MnemonicDecode(nLanguage, sWords, vEntropy, sError), "MnemonicDecode: " << sError);
 }
 
+BOOST_AUTO_TEST_CASE(mnemonic_to_seeds)
+{
+    std::string words = "deer clever bitter bonus unable menu satoshi chaos dwarf inmate robot drama exist nuclear raise";
+    std::string words_bad_checksum = "winner legal thank year wave sausage worth useful legal winner thank yellow";
+
+    std::vector<MnemonicCandidate> vCandidates;
+    for (size_t k = 0; k < 9; ++k) {
+        vCandidates.push_back({k == 4 ? words_bad_checksum : words, strprintf("password%d", k)});
+    }
+
+    std::vector<std::vector<uint8_t> > vSeeds;
+    BOOST_CHECK(1 == MnemonicToSeeds(-1, vCandidates, vSeeds, 2));
+    BOOST_REQUIRE(vSeeds.size() == vCandidates.size());
+    for (size_t k = 0; k < vCandidates.size(); ++k) {
+        std::vector<uint8_t> vSeed;
+        if (k != 4) {
+            BOOST_CHECK(0 == MnemonicToSeed(vCandidates[k].sMnemonic, vCandidates[k].sPassword, vSeed));
+        }
+        BOOST_CHECK(vSeeds[k] == vSeed);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(mnemonic_addchecksum)
 {
     std::string sError;
@@ -71,10 +93,32 @@ BOOST_AUTO_TEST_CASE(mnemonic_addchecksum)
     BOOST_CHECK(sWordsOut == "zoologie ficeler xénon voyelle village viande vignette sécréter séduire torpille remède abolir");
 }
 
+BOOST_AUTO_TEST_CASE(mnemonic_wordlists)
+{
+    std::string sWord, sError;
+    for (int l = 1; l < WLL_MAX; ++l) {
+        int nWords = 0;
+        while (0 == MnemonicGetWord(l, nWords, sWord, sError)) {
+            BOOST_CHECK_MESSAGE(MnemonicFindWord(l, sWord) == nWords, "language " << l << " word " << nWords);
+            nWords++;
+        }
+        BOOST_CHECK(nWords == 2048);
+    }
+
+    BOOST_CHECK(MnemonicFindWord(WLL_ENGLISH, "abandon") == 0);
+    BOOST_CHECK(MnemonicFindWord(WLL_ENGLISH, "zoo") == 2047);
+    BOOST_CHECK(MnemonicFindWord(WLL_ENGLISH, "abando") == -1);
+    BOOST_CHECK(MnemonicFindWord(WLL_ENGLISH, "abandons") == -1);
+    BOOST_CHECK(MnemonicFindWord(WLL_ENGLISH, "") == -1);
+    BOOST_CHECK(MnemonicFindWord(WLL_FRENCH, "zoo") == -1);
+    BOOST_CHECK(MnemonicFindWord(0, "abandon") == -1);
+}
 
 void runTests(int nLanguage, UniValue &tests)
 {
     std::string sError;
+    std::vector<MnemonicCandidate> vCandidates;
+    std::vector<std::vector<uint8_t> > vExpectSeeds;
     for (unsigned int idx = 0; idx < tests.size(); idx++)
     {
         UniValue test = tests[idx];
@@ -113,6 +157,9 @@ void runTests(int nLanguage, UniValue &tests)
         BOOST_CHECK(0 == MnemonicToSeed(sWords, sPassphrase, vSeedTest));
         BOOST_CHECK(vSeed == vSeedTest);
 
+        vCandidates.push_back({sWords, sPassphrase});
+        vExpectSeeds.push_back(vSeed);
+
         if (test.size() > 4)
         {
             CExtKey58 eKey58;
@@ -125,6 +172,10 @@ void runTests(int nLanguage, UniValue &tests)
             BOOST_CHECK(eKey58.ToString() == sExtKey);
         };
     };
+
+    std::vector<std::vector<uint8_t> > vSeeds;
+    BOOST_CHECK(0 == MnemonicToSeeds(nLanguage, vCandidates, vSeeds, 3));
+    BOOST_CHECK(vSeeds == vExpectSeeds);
 };
 
 BOOST_AUTO_TEST_CASE(mnemonic_test_json)
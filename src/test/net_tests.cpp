@@ -190,4 +190,58 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(net_message_read_large)
+{
+    std::vector<unsigned char> payload(600 * 1000);
+    for (size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = (unsigned char)(i * 7);
+    }
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CMessageHeader(Params().MessageStart(), NetMsgType::BLOCK, payload.size());
+    ss.write((const char*)payload.data(), payload.size());
+
+    // Arrives in pieces, as from the socket
+    CNetMessage msg(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+    size_t nPos = 0;
+    while (nPos < ss.size()) {
+        unsigned int nBytes = std::min((size_t)1000, ss.size() - nPos);
+        int handled = msg.in_data ? msg.readData(ss.data() + nPos, nBytes) : msg.readHeader(ss.data() + nPos, nBytes);
+        BOOST_REQUIRE(handled > 0);
+        nPos += handled;
+    }
+    BOOST_CHECK(msg.complete());
+    BOOST_CHECK_EQUAL(msg.vRecv.size(), payload.size());
+    BOOST_CHECK(std::equal(payload.begin(), payload.end(), (const unsigned char*)msg.vRecv.data()));
+}
+
+BOOST_AUTO_TEST_CASE(net_message_buffer_pool)
+{
+    CNetMessageBufferPool pool;
+
+    CDataStream s1(SER_NETWORK, PROTOCOL_VERSION);
+    s1.reserve(100000);
+    s1 << 1;
+    const char* p = s1.data();
+    pool.Put(s1);
+    BOOST_CHECK_EQUAL(s1.capacity(), 0U);
+
+    // Too large for the pooled buffer
+    CDataStream s2(SER_NETWORK, PROTOCOL_VERSION);
+    pool.Get(200000, s2);
+    BOOST_CHECK_EQUAL(s2.capacity(), 0U);
+
+    pool.Get(90000, s2);
+    BOOST_CHECK(s2.capacity() >= 100000U);
+    BOOST_CHECK(s2.empty());
+    BOOST_CHECK(s2.data() == p);
+
+    // Small buffers are left to the allocator
+    CDataStream s3(SER_NETWORK, PROTOCOL_VERSION);
+    s3.reserve(1000);
+    pool.Put(s3);
+    CDataStream s4(SER_NETWORK, PROTOCOL_VERSION);
+    pool.Get(500, s4);
+    BOOST_CHECK_EQUAL(s4.capacity(), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
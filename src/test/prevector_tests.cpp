@@ -6,6 +6,7 @@
 #include <prevector.h>
 
 #include <reverse_iterator.h>
+#include <script/script.h>
 #include <serialize.h>
 #include <streams.h>
 
@@ -264,4 +265,47 @@ BOOST_AUTO_TEST_CASE(PrevectorTestInt)
     }
 }
 
+BOOST_AUTO_TEST_CASE(PrevectorTestWitnessStack)
+{
+    // Witness stacks hold vectors inline, check them against std::vector while
+    // they move between inline and heap storage.
+    for (int run = 0; run < 100; run++) {
+        CScriptWitness witness;
+        std::vector<std::vector<unsigned char> > real;
+        int nItems = InsecureRandRange(6);
+        for (int i = 0; i < nItems; i++) {
+            std::vector<unsigned char> item(InsecureRandRange(100), (unsigned char)i);
+            real.push_back(item);
+            if (InsecureRandBool()) {
+                witness.stack.push_back(item);
+            } else {
+                witness.stack.emplace_back(std::move(item));
+            }
+        }
+        BOOST_CHECK(std::equal(real.begin(), real.end(), witness.stack.begin()) && real.size() == witness.stack.size());
+
+        // Serialized the same as before, so the wire format is unchanged
+        CDataStream ssReal(SER_NETWORK, 0), ssWitness(SER_NETWORK, 0);
+        ssReal << real;
+        ssWitness << witness.stack;
+        BOOST_CHECK(ssReal.str() == ssWitness.str());
+
+        CScriptWitness read;
+        ssWitness >> read.stack;
+        BOOST_CHECK(read.stack == witness.stack);
+
+        CScriptWitness copy = witness;
+        CScriptWitness moved = std::move(copy);
+        BOOST_CHECK(moved.stack == witness.stack);
+        moved.stack.resize(std::min<size_t>(moved.stack.size(), 1));
+        moved.stack.shrink_to_fit();
+        BOOST_CHECK(moved.stack.size() == std::min<size_t>(real.size(), 1));
+        if (!real.empty()) {
+            BOOST_CHECK(moved.stack[0] == real[0]);
+        }
+        witness.SetNull();
+        BOOST_CHECK(witness.IsNull());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 
 #include <random>
 #include <algorithm>
+#include <thread>
 
 BOOST_FIXTURE_TEST_SUITE(random_tests, BasicTestingSetup)
 
@@ -60,6 +61,31 @@ BOOST_AUTO_TEST_CASE(fastrandom_randbits)
     }
 }
 
+BOOST_AUTO_TEST_CASE(fastrandbytes_tests)
+{
+    // Output differs between calls, across the reseed and between threads
+    uint256 a, b, c;
+    GetFastRandBytes(a.begin(), 32);
+    GetFastRandBytes(b.begin(), 32);
+    BOOST_CHECK(a != b);
+
+    std::vector<unsigned char> vBulk(FAST_RAND_RESEED_BYTES);
+    GetFastRandBytes(vBulk.data(), vBulk.size());
+    GetFastRandBytes(c.begin(), 32);
+    BOOST_CHECK(c != a && c != b);
+
+    std::thread t([&c]() { GetFastRandBytes(c.begin(), 32); });
+    t.join();
+    BOOST_CHECK(c != a && c != b);
+
+    GetFastRandBytes(nullptr, 0);
+    BOOST_CHECK_EQUAL(GetFastRand(0), 0U);
+    BOOST_CHECK_EQUAL(GetFastRandInt(1), 0);
+    for (int i = 0; i < 100; ++i) {
+        BOOST_CHECK(GetFastRandInt(7) < 7);
+    }
+}
+
 /** Does-it-compile test for compatibility with standard C++11 RNG interface. */
 BOOST_AUTO_TEST_CASE(stdrandom_test)
 {
@@ -0,0 +1,214 @@
+// Copyright (c) 2018 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test/test_bitcoin.h>
+
+#include <key.h>
+#include <random.h>
+#include <rctoutputcache.h>
+#include <rctoutputfile.h>
+#include <txdb.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rctoutputfile_tests, BasicTestingSetup)
+
+static CAnonOutput MakeAnonOutput(int nHeight)
+{
+    CKey key;
+    key.MakeNewKey(true);
+
+    CAnonOutput ao;
+    ao.pubkey = CCmpPubKey(key.GetPubKey());
+    GetRandBytes(&ao.commitment.data[0], 33);
+    ao.outpoint = COutPoint(GetRandHash(), nHeight % 7);
+    ao.nBlockHeight = nHeight;
+    ao.nCompromised = nHeight % 2;
+    return ao;
+}
+
+static bool SameAnonOutput(const CAnonOutput &a, const CAnonOutput &b)
+{
+    return a.pubkey == b.pubkey
+        && memcmp(&a.commitment.data[0], &b.commitment.data[0], 33) == 0
+        && a.outpoint == b.outpoint
+        && a.nBlockHeight == b.nBlockHeight
+        && a.nCompromised == b.nCompromised;
+}
+
+BOOST_AUTO_TEST_CASE(rctoutputfile_append_erase)
+{
+    fs::path path = SetDataDir("rctoutputfile") / "rctoutputs.dat";
+
+    std::vector<CAnonOutput> vao;
+    for (int i = 0; i < 10; ++i)
+        vao.push_back(MakeAnonOutput(i + 1));
+
+    CAnonOutput ao;
+    {
+        CRCTOutputFile file(path);
+        BOOST_REQUIRE(file.Open(false));
+        BOOST_CHECK_EQUAL(file.GetLastValid(), 0);
+
+        // Records must be appended in index order
+        BOOST_CHECK(!file.Write(2, vao[1]));
+        for (size_t i = 0; i < vao.size(); ++i)
+            BOOST_CHECK(file.Write(i + 1, vao[i]));
+        BOOST_CHECK_EQUAL(file.GetLastValid(), 10);
+
+        BOOST_CHECK(!file.Read(0, ao));
+        BOOST_CHECK(!file.Read(11, ao));
+        BOOST_CHECK(file.Read(4, ao));
+        BOOST_CHECK(SameAnonOutput(ao, vao[3]));
+
+        // Erasing truncates the valid range
+        file.Erase(8);
+        BOOST_CHECK_EQUAL(file.GetLastValid(), 7);
+        BOOST_CHECK(!file.Read(9, ao));
+    }
+
+    {
+        CRCTOutputFile file(path);
+        BOOST_REQUIRE(file.Open(false));
+        BOOST_CHECK_EQUAL(file.GetLastValid(), 7);
+        for (int64_t i = 1; i <= 7; ++i)
+        {
+            BOOST_CHECK(file.Read(i, ao));
+            BOOST_CHECK(SameAnonOutput(ao, vao[i-1]));
+        };
+    }
+
+    {
+        CRCTOutputFile file(path);
+        BOOST_REQUIRE(file.Open(true));
+        BOOST_CHECK_EQUAL(file.GetLastValid(), 0);
+        BOOST_CHECK(!file.Read(1, ao));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rctoutputfile_blocktree)
+{
+    fs::path path = SetDataDir("rctoutputfile_db") / "rctoutputs.dat";
+    CBlockTreeDB db(1 << 20, true);
+
+    std::vector<CAnonOutput> vao;
+    for (int i = 0; i < 5; ++i)
+    {
+        vao.push_back(MakeAnonOutput(i + 1));
+        BOOST_CHECK(db.WriteRCTOutput(i + 1, vao.back()));
+    };
+
+    // Outputs already in the db are copied on open
+    BOOST_REQUIRE(db.OpenRCTOutputFile(path, false));
+    CAnonOutput ao;
+    for (int64_t i = 1; i <= 5; ++i)
+    {
+        BOOST_CHECK(db.ReadRCTOutput(i, ao));
+        BOOST_CHECK(SameAnonOutput(ao, vao[i-1]));
+    };
+
+    std::vector<std::pair<int64_t, CAnonOutput> > vNew;
+    vNew.push_back(std::make_pair(6, MakeAnonOutput(6)));
+    vNew.push_back(std::make_pair(7, MakeAnonOutput(7)));
+    db.UpdateRCTOutputCaches(vNew);
+    BOOST_CHECK(db.ReadRCTOutput(7, ao));
+    BOOST_CHECK(SameAnonOutput(ao, vNew[1].second));
+
+    // An erased output must not be served from the file
+    BOOST_CHECK(db.EraseRCTOutput(5));
+    BOOST_CHECK(!db.ReadRCTOutput(5, ao));
+    BOOST_CHECK(db.ReadRCTOutput(4, ao));
+    BOOST_CHECK(SameAnonOutput(ao, vao[3]));
+}
+
+BOOST_AUTO_TEST_CASE(rctoutputs_readmany)
+{
+    CBlockTreeDB db(1 << 20, true);
+    db.GetRCTOutputCache().SetMaxSize(0);
+
+    std::vector<CAnonOutput> vao;
+    for (int i = 0; i < 20; ++i)
+    {
+        vao.push_back(MakeAnonOutput(i + 1));
+        BOOST_CHECK(db.WriteRCTOutput(i + 1, vao.back()));
+    };
+
+    std::vector<int64_t> vIndices{17, 2, 9, 1, 20};
+    std::vector<CAnonOutput> vRead;
+    BOOST_CHECK(db.ReadRCTOutputs(vIndices, vRead));
+    BOOST_REQUIRE_EQUAL(vRead.size(), vIndices.size());
+    for (size_t k = 0; k < vIndices.size(); ++k)
+        BOOST_CHECK(SameAnonOutput(vRead[k], vao[vIndices[k]-1]));
+
+    // Mixed cache hits and db reads
+    db.GetRCTOutputCache().SetMaxSize(1 << 20);
+    CAnonOutput ao;
+    BOOST_CHECK(db.ReadRCTOutput(9, ao));
+    BOOST_CHECK(db.ReadRCTOutputs(vIndices, vRead));
+    for (size_t k = 0; k < vIndices.size(); ++k)
+        BOOST_CHECK(SameAnonOutput(vRead[k], vao[vIndices[k]-1]));
+
+    vIndices.push_back(21);
+    BOOST_CHECK(!db.ReadRCTOutputs(vIndices, vRead));
+}
+
+BOOST_AUTO_TEST_CASE(rctoutputcache_lru)
+{
+    // Room for two entries per shard
+    CRCTOutputCache cache(CRCTOutputCache::EntryUsage() * RCT_OUTPUT_CACHE_SHARDS * 2);
+
+    std::vector<CAnonOutput> vao;
+    for (int i = 0; i < 4; ++i)
+        vao.push_back(MakeAnonOutput(i + 1));
+
+    // Indices 1, 1 + n, 1 + 2n share a shard
+    const int64_t n = RCT_OUTPUT_CACHE_SHARDS;
+    cache.Insert(1, vao[0]);
+    cache.Insert(1 + n, vao[1]);
+
+    CAnonOutput ao;
+    BOOST_CHECK(cache.Get(1, ao));
+    BOOST_CHECK(SameAnonOutput(ao, vao[0]));
+
+    // 1 + n is now the least recently used
+    cache.Insert(1 + 2 * n, vao[2]);
+    BOOST_CHECK(!cache.Get(1 + n, ao));
+    BOOST_CHECK(cache.Get(1, ao));
+    BOOST_CHECK(cache.Get(1 + 2 * n, ao));
+    BOOST_CHECK(SameAnonOutput(ao, vao[2]));
+    BOOST_CHECK_EQUAL(cache.Size(), 2U);
+
+    // Other shards are unaffected
+    cache.Insert(2, vao[3]);
+    BOOST_CHECK_EQUAL(cache.Size(), 3U);
+
+    cache.Erase(1);
+    BOOST_CHECK(!cache.Get(1, ao));
+    BOOST_CHECK_EQUAL(cache.GetHits(), 3U);
+    BOOST_CHECK_EQUAL(cache.GetMisses(), 2U);
+
+    cache.SetMaxSize(0);
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+    cache.Insert(3, vao[0]);
+    BOOST_CHECK(!cache.Get(3, ao));
+}
+
+BOOST_AUTO_TEST_CASE(rctoutputcache_blocktree)
+{
+    CBlockTreeDB db(1 << 20, true);
+    CAnonOutput ao, aoRead;
+    ao = MakeAnonOutput(1);
+    BOOST_CHECK(db.WriteRCTOutput(1, ao));
+
+    BOOST_CHECK(db.ReadRCTOutput(1, aoRead));
+    BOOST_CHECK(db.ReadRCTOutput(1, aoRead));
+    BOOST_CHECK_EQUAL(db.GetRCTOutputCache().GetHits(), 1U);
+    BOOST_CHECK(SameAnonOutput(ao, aoRead));
+
+    // Erasing must invalidate the cached copy
+    BOOST_CHECK(db.EraseRCTOutput(1));
+    BOOST_CHECK(!db.ReadRCTOutput(1, aoRead));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
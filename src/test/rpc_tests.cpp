@@ -7,11 +7,16 @@
 #include <rpc/rpcutil.h>
 
 #include <core_io.h>
+#include <httprpc.h>
 #include <key_io.h>
+#include <key/extkey.h>
+#include <key/mnemonic.h>
 #include <netbase.h>
 
 #include <test/test_bitcoin.h>
 
+#include <thread>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/test/unit_test.hpp>
 
@@ -395,4 +400,75 @@ BOOST_AUTO_TEST_CASE(rpc_getblockstats_calculate_percentiles_by_weight)
     }
 }
 
+static std::vector<int> vBatchOrder;
+
+static UniValue batchordertest(const JSONRPCRequest& request)
+{
+    vBatchOrder.push_back(request.params[0].get_int());
+    return (int)vBatchOrder.size();
+}
+
+BOOST_AUTO_TEST_CASE(rpc_batch_order)
+{
+    static const CRPCCommand command = {"test", "batchordertest", &batchordertest, {"n"}};
+    tableRPC.appendCommand("batchordertest", &command);
+
+    UniValue batch(UniValue::VARR);
+    for (int i = 0; i < 8; ++i) {
+        UniValue params(UniValue::VARR);
+        params.push_back(i);
+        batch.push_back(JSONRPCRequestObj("batchordertest", params, i));
+    }
+
+    // By default requests of a batch run one after the other, on the calling thread
+    bool fDispatched = false;
+    RPCTaskDispatcher dispatch = [&fDispatched](const std::function<void()>& task) {
+        fDispatched = true;
+        std::thread(task).detach();
+        return true;
+    };
+    JSONRPCRequest jreq;
+    UniValue ret;
+    BOOST_REQUIRE(ret.read(JSONRPCExecBatch(jreq, batch, dispatch, DEFAULT_RPC_BATCH_THREADS)));
+    BOOST_CHECK(!fDispatched);
+    BOOST_REQUIRE_EQUAL(ret.size(), 8U);
+    BOOST_REQUIRE_EQUAL(vBatchOrder.size(), 8U);
+    for (int i = 0; i < 8; ++i) {
+        BOOST_CHECK_EQUAL(vBatchOrder[i], i);
+        BOOST_CHECK_EQUAL(find_value(ret[i], "result").get_int(), i + 1);
+        BOOST_CHECK_EQUAL(find_value(ret[i], "id").get_int(), i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rpc_mnemonic_recover)
+{
+    std::string sWords = "abandon baby cabbage dad eager fabric gadget habit ice kangaroo lab absorb";
+    std::vector<uint8_t> vSeed;
+    BOOST_REQUIRE(0 == MnemonicToSeed(sWords, "pass2", vSeed));
+
+    CExtKey ekMaster, ekDerived;
+    ekMaster.SetSeed(&vSeed[0], vSeed.size());
+    BOOST_REQUIRE(ekMaster.Derive(ekDerived, BIP44_PURPOSE));
+    BOOST_REQUIRE(ekDerived.Derive(ekDerived, Params().BIP44ID()));
+
+    CExtKeyPair kpMaster(ekMaster), kpDerived(ekDerived);
+    std::string sMaster = CExtKey58(kpMaster, CChainParams::EXT_PUBLIC_KEY).ToString();
+    std::string sDerived = CExtKey58(kpDerived, CChainParams::EXT_PUBLIC_KEY).ToString();
+
+    // Recover a missing word at m and at m / 44' / coin'
+    std::string sMissing = "\"abandon baby cabbage dad eager fabric gadget ? ice kangaroo lab absorb\"";
+    UniValue r;
+    for (const auto &sTarget : {sMaster, sDerived}) {
+        BOOST_CHECK_NO_THROW(r = CallRPC("mnemonic recover " + sMissing + " pass2 " + sTarget + " 2"));
+        BOOST_CHECK(find_value(r.get_obj(), "found").get_bool());
+        BOOST_CHECK(find_value(r.get_obj(), "mnemonic").get_str() == sWords);
+        BOOST_CHECK(find_value(r.get_obj(), "password").get_str() == "pass2");
+    }
+
+    // Wrong password
+    BOOST_CHECK_NO_THROW(r = CallRPC("mnemonic recover " + sMissing + " pass1 " + sMaster + " 2"));
+    BOOST_CHECK(!find_value(r.get_obj(), "found").get_bool());
+    BOOST_CHECK(find_value(r.get_obj(), "tested").get_int64() == 2048);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
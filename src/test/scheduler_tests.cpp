@@ -11,6 +11,8 @@
 #include <boost/thread.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include <future>
+
 BOOST_AUTO_TEST_SUITE(scheduler_tests)
 
 static void microTask(CScheduler& s, boost::mutex& mutex, int& counter, int delta, boost::chrono::system_clock::time_point rescheduleTime)
@@ -154,4 +156,57 @@ BOOST_AUTO_TEST_CASE(singlethreadedscheduler_ordered)
     BOOST_CHECK_EQUAL(counter2, 100);
 }
 
+BOOST_AUTO_TEST_CASE(scheduler_priority)
+{
+    CScheduler scheduler;
+    std::vector<int> order;
+
+    // All tasks are due before the queue is serviced
+    boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+    scheduler.schedule([&order] { order.push_back(5); }, now - boost::chrono::seconds(2), CScheduler::Priority::LOW);
+    scheduler.schedule([&order] { order.push_back(3); }, now - boost::chrono::seconds(3), CScheduler::Priority::NORMAL);
+    scheduler.schedule([&order] { order.push_back(2); }, now - boost::chrono::seconds(1), CScheduler::Priority::HIGH);
+    scheduler.schedule([&order] { order.push_back(4); }, now - boost::chrono::seconds(1), CScheduler::Priority::NORMAL);
+    scheduler.schedule([&order] { order.push_back(1); }, now - boost::chrono::seconds(2), CScheduler::Priority::HIGH);
+
+    // A high priority task that isn't due yet doesn't hold up the others
+    scheduler.scheduleFromNow([&order] { order.push_back(6); }, 100, CScheduler::Priority::HIGH);
+
+    boost::chrono::system_clock::time_point first, last;
+    BOOST_CHECK_EQUAL(scheduler.getQueueInfo(first, last), 6U);
+    BOOST_CHECK(first == now - boost::chrono::seconds(3));
+
+    scheduler.stop(true);
+    scheduler.serviceQueue();
+    BOOST_CHECK(order == std::vector<int>({1, 2, 3, 4, 5, 6}));
+}
+
+BOOST_AUTO_TEST_CASE(singlethreadedscheduler_parallel)
+{
+    CScheduler scheduler;
+    SingleThreadedSchedulerClient queue1(&scheduler);
+    SingleThreadedSchedulerClient queue2(&scheduler);
+
+    boost::thread_group threads;
+    for (int i = 0; i < 2; ++i) {
+        threads.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+    }
+
+    // The callback of queue1 can only finish while queue2 runs next to it
+    std::promise<void> promise;
+    std::future<void> future = promise.get_future();
+    bool fRanInParallel = false;
+    queue1.AddToProcessQueue([&future, &fRanInParallel] {
+        fRanInParallel = future.wait_for(std::chrono::seconds(10)) == std::future_status::ready;
+    });
+    queue2.AddToProcessQueue([&promise] {
+        promise.set_value();
+    });
+
+    scheduler.stop(true);
+    threads.join_all();
+
+    BOOST_CHECK(fRanInParallel);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
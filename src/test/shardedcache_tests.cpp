@@ -0,0 +1,101 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <shardedcache.h>
+
+#include <test/test_bitcoin.h>
+
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(shardedcache_tests, BasicTestingSetup)
+
+struct IdentityHasher
+{
+    size_t operator()(int k) const { return (size_t)k; };
+};
+
+struct StringUsage
+{
+    size_t operator()(const std::string &s) const { return memusage::MallocUsage(s.capacity() + 1); };
+};
+
+typedef CShardedCache<int, int, IdentityHasher> IntCache;
+
+BOOST_AUTO_TEST_CASE(shardedcache_eviction)
+{
+    // Room for two entries in each of the 4 shards, keys 1, 5, 9 share a shard
+    IntCache lru(IntCache::EntryOverhead() * 4 * 2, 4);
+    IntCache fifo(IntCache::EntryOverhead() * 4 * 2, 4, CacheEviction::FIFO);
+    int v;
+
+    for (IntCache *cache : {&lru, &fifo})
+    {
+        cache->Insert(1, 10);
+        cache->Insert(5, 50);
+        BOOST_CHECK(cache->Get(1, v) && v == 10);
+        cache->Insert(9, 90);
+    };
+
+    // The hit on 1 kept it in the lru cache only
+    BOOST_CHECK(!lru.Get(5, v));
+    BOOST_CHECK(lru.Get(1, v));
+    BOOST_CHECK(!fifo.Get(1, v));
+    BOOST_CHECK(fifo.Get(5, v));
+
+    CacheStats stats = lru.GetStats();
+    BOOST_CHECK_EQUAL(stats.nHits, 2U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 1U);
+    BOOST_CHECK_EQUAL(stats.nInserts, 3U);
+    BOOST_CHECK_EQUAL(stats.nEvictions, 1U);
+    BOOST_CHECK_EQUAL(stats.nSize, 2U);
+    BOOST_CHECK(stats.nUsage >= 2 * IntCache::EntryOverhead());
+
+    // Other shards are unaffected, replacing doesn't add an entry
+    lru.Insert(2, 20);
+    lru.Insert(2, 21);
+    BOOST_CHECK(lru.Get(2, v) && v == 21);
+    BOOST_CHECK_EQUAL(lru.Size(), 3U);
+
+    std::vector<int> vEvicted;
+    lru.SetEvictHandler([&vEvicted](const int &k, const int &v) { vEvicted.push_back(k); });
+    lru.Insert(13, 130);
+    BOOST_CHECK(vEvicted.size() == 1 && vEvicted[0] == 9);
+
+    lru.SetMaxSize(0);
+    BOOST_CHECK_EQUAL(lru.Size(), 0U);
+    lru.Insert(3, 30);
+    BOOST_CHECK(!lru.Get(3, v));
+}
+
+BOOST_AUTO_TEST_CASE(shardedcache_usage)
+{
+    typedef CShardedCache<int, std::string, IdentityHasher, StringUsage> StringCache;
+
+    std::string sSmall(100, 'a'), sLarge(10000, 'b');
+    size_t nShare = StringCache::EntryUsage(sSmall) * 3;
+    StringCache cache(nShare * 2, 2);
+
+    // Entries are charged by the heap of their values
+    cache.Insert(0, sSmall);
+    cache.Insert(2, sSmall);
+    cache.Insert(4, sSmall);
+    BOOST_CHECK_EQUAL(cache.Size(), 3U);
+    cache.Insert(6, sSmall);
+    BOOST_CHECK_EQUAL(cache.Size(), 3U);
+
+    // A value larger than a shard's share isn't cached
+    BOOST_CHECK(StringCache::EntryUsage(sLarge) > nShare);
+    cache.Insert(1, sLarge);
+    std::string s;
+    BOOST_CHECK(!cache.Get(1, s));
+
+    cache.Erase(6);
+    BOOST_CHECK(!cache.Get(6, s));
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <smsg/smessage.h>
+#include <smsg/compress.h>
+#include <smsg/db.h>
 
 #include <test/test_bitcoin.h>
 #include <net.h>
@@ -75,6 +77,7 @@ BOOST_AUTO_TEST_CASE(smsg_test)
         std::string sAddrFail = addrFail.ToString();
 
         bool fSendAnonymous = rand() % 3 == 0;
+        smsgModule.fCompressDict = i % 2 == 0;
 
         BOOST_CHECK_MESSAGE(0 == (rv = smsgModule.Encrypt(smsg, fSendAnonymous ? idNull : kFrom, kTo, sTestMessage)), "SecureMsgEncrypt " << rv);
 
@@ -90,10 +93,415 @@ BOOST_AUTO_TEST_CASE(smsg_test)
         rv = smsgModule.Decrypt(false, kFail, smsg, msg);
         BOOST_CHECK_MESSAGE(smsg::SMSG_MAC_MISMATCH == rv, "SecureMsgDecrypt " << smsg::GetString(rv));
     };
+    smsgModule.fCompressDict = smsg::DEFAULT_SMSG_COMPRESS_DICT;
+
+    // Message i is sent to key i, message nKeys to none
+    std::vector<smsg::SecureMessage> vMessages(nKeys + 1);
+    std::vector<smsg::SecMsgScanItem> vItems;
+    std::vector<smsg::SecMsgScanKey> vKeys;
+    for (int i = 0; i <= nKeys; i++)
+    {
+        CKeyID kTo = i < nKeys ? keyRemote[i].GetPubKey().GetID() : keyOwn[0].GetPubKey().GetID();
+        BOOST_CHECK(0 == smsgModule.Encrypt(vMessages[i], keyOwn[0].GetPubKey().GetID(), kTo, sTestMessage));
+        vItems.push_back(smsg::SecMsgScanItem{vMessages[i].data(), vMessages[i].pPayload, vMessages[i].nPayload});
+        if (i < nKeys)
+            vKeys.push_back(smsg::SecMsgScanKey{kTo, keyRemote[i], false});
+    };
+    for (size_t nThreads : {1, 4})
+    {
+        std::vector<int> vFirst;
+        smsgModule.FindFirstKeys(vItems, vKeys, vFirst, nThreads);
+        BOOST_CHECK(vFirst.size() == vItems.size());
+        for (int i = 0; i < nKeys; i++)
+            BOOST_CHECK(vFirst[i] == i);
+        BOOST_CHECK(vFirst[nKeys] == -1);
+    };
 
     smsgModule.Shutdown();
 
 #endif
 }
 
+BOOST_AUTO_TEST_CASE(smsg_compress)
+{
+    const std::string sJson = "{\"type\":\"order\",\"id\":\"a81f\",\"timestamp\":1559390000,"
+        "\"data\":{\"address\":\"bc1q\",\"amount\":12.5,\"status\":\"ok\"},\"message\":\"\"}";
+
+    for (size_t nLen : {(size_t)1, sJson.size(), (size_t)5000, (size_t)200000})
+    {
+        std::vector<uint8_t> vIn(nLen);
+        for (size_t i = 0; i < nLen; ++i)
+            vIn[i] = i < sJson.size() ? sJson[i] : sJson[InsecureRandRange(sJson.size())];
+
+        for (bool fDictionary : {false, true})
+        {
+            std::vector<uint8_t> vOut(LZ4_compressBound(nLen)), vBack(nLen);
+            int nOut = smsg::CompressPayload(vIn.data(), nLen, vOut.data(), vOut.size(), fDictionary);
+            BOOST_REQUIRE(nOut > 0);
+            BOOST_CHECK(smsg::DecompressPayload(vOut.data(), nOut, vBack.data(), nLen, fDictionary));
+            BOOST_CHECK(vBack == vIn);
+
+            // Wrong length, or read without the dictionary
+            BOOST_CHECK(!smsg::DecompressPayload(vOut.data(), nOut, vBack.data(), nLen - 1, fDictionary));
+            if (fDictionary && nLen == sJson.size())
+                BOOST_CHECK(!smsg::DecompressPayload(vOut.data(), nOut, vBack.data(), nLen, !fDictionary) || vBack != vIn);
+        };
+    };
+
+    // The dictionary shrinks a small structured message
+    std::vector<uint8_t> vOut(LZ4_compressBound(sJson.size()));
+    int nPlain = smsg::CompressPayload((const uint8_t*)sJson.data(), sJson.size(), vOut.data(), vOut.size(), false);
+    int nDict = smsg::CompressPayload((const uint8_t*)sJson.data(), sJson.size(), vOut.data(), vOut.size(), true);
+    BOOST_CHECK(nDict * 3 < nPlain * 2);
+}
+
+BOOST_AUTO_TEST_CASE(smsg_sethash_threads)
+{
+    std::vector<uint8_t> vchPayload(100);
+    GetRandBytes(vchPayload.data(), vchPayload.size());
+
+    smsg::fSecMsgEnabled = true;
+    for (size_t nThreads : {1, 4})
+    {
+        smsg::SecureMessage smsg;
+        smsg.SetNull();
+        smsg.timestamp = GetTime();
+        smsg.nPayload = vchPayload.size();
+
+        smsgModule.nPowThreads = nThreads;
+        int rv = smsgModule.SetHash((uint8_t*)&smsg, vchPayload.data(), vchPayload.size());
+        BOOST_CHECK_MESSAGE(0 == rv, "SecureMsgSetHash " << rv);
+        rv = smsgModule.Validate((uint8_t*)&smsg, vchPayload.data(), vchPayload.size());
+        BOOST_CHECK_MESSAGE(0 == rv, "SecureMsgValidate " << rv);
+    };
+    smsgModule.nPowThreads = smsg::DEFAULT_SMSG_POW_THREADS;
+    smsg::fSecMsgEnabled = false;
+}
+
+BOOST_AUTO_TEST_CASE(smsg_bucket_index)
+{
+    smsg::SecureMessage smsg;
+    smsg.SetNull();
+    smsg.timestamp = GetTime();
+    std::vector<uint8_t> vchPayload(100);
+    GetRandBytes(vchPayload.data(), vchPayload.size());
+    smsg.nPayload = vchPayload.size();
+
+    int64_t bucketTime = smsg.timestamp - (smsg.timestamp % smsg::SMSG_BUCKET_LEN);
+    fs::path pathIndex = GetDataDir() / "smsgstore" / (std::to_string(bucketTime) + "_01.idx");
+
+    LOCK(smsgModule.cs_smsg);
+    smsgModule.buckets.clear();
+    BOOST_CHECK(0 == smsgModule.Store(smsg.data(), vchPayload.data(), vchPayload.size(), true));
+    BOOST_CHECK(fs::exists(pathIndex));
+    BOOST_CHECK_EQUAL(fs::file_size(pathIndex), smsg::SMSG_IDX_RECORD_LEN);
+    uint32_t hash = smsgModule.buckets[bucketTime].hash;
+
+    // Loaded from the index
+    smsgModule.buckets.clear();
+    BOOST_CHECK(0 == smsgModule.BuildBucketSet());
+    BOOST_CHECK_EQUAL(smsgModule.buckets[bucketTime].setTokens.size(), 1U);
+    BOOST_CHECK_EQUAL(smsgModule.buckets[bucketTime].hash, hash);
+
+    const smsg::SecMsgToken token = *smsgModule.buckets[bucketTime].setTokens.begin();
+    std::vector<uint8_t> vchData;
+    BOOST_CHECK(0 == smsgModule.Retrieve(token, vchData));
+    BOOST_CHECK(vchData.size() == smsg::SMSG_HDR_LEN + vchPayload.size());
+    BOOST_CHECK(0 == memcmp(&vchData[smsg::SMSG_HDR_LEN], vchPayload.data(), vchPayload.size()));
+
+    // Removal updates the ttl in place
+    BOOST_CHECK(0 == smsgModule.Remove(token));
+    smsgModule.buckets.clear();
+    BOOST_CHECK(0 == smsgModule.BuildBucketSet());
+    BOOST_CHECK_EQUAL(smsgModule.buckets[bucketTime].setTokens.begin()->ttl, 0);
+
+    // A missing index is rebuilt from the bucket file
+    fs::remove(pathIndex);
+    smsgModule.buckets.clear();
+    BOOST_CHECK(0 == smsgModule.BuildBucketSet());
+    BOOST_CHECK(fs::exists(pathIndex));
+    BOOST_CHECK_EQUAL(smsgModule.buckets[bucketTime].setTokens.size(), 1U);
+    BOOST_CHECK_EQUAL(smsgModule.buckets[bucketTime].setTokens.begin()->ttl, 0);
+    smsgModule.buckets.clear();
+}
+
+BOOST_AUTO_TEST_CASE(smsg_bucket_removing)
+{
+    smsg::SecureMessage smsg;
+    smsg.SetNull();
+    smsg.timestamp = GetTime();
+    std::vector<uint8_t> vchPayload(100);
+    GetRandBytes(vchPayload.data(), vchPayload.size());
+    smsg.nPayload = vchPayload.size();
+
+    int64_t bucketTime = smsg.timestamp - (smsg.timestamp % smsg::SMSG_BUCKET_LEN);
+
+    // Messages aren't stored while the files of the bucket are deleted
+    smsgModule.buckets.clear();
+    smsgModule.setBucketsRemoving.insert(bucketTime);
+    BOOST_CHECK(!smsgModule.CreateBucket(bucketTime));
+    BOOST_CHECK(0 != smsgModule.Store(smsg.data(), vchPayload.data(), vchPayload.size(), true));
+    BOOST_CHECK(smsgModule.buckets.count(bucketTime) == 0);
+
+    smsgModule.setBucketsRemoving.erase(bucketTime);
+    BOOST_CHECK(smsgModule.CreateBucket(bucketTime));
+    BOOST_CHECK(0 == smsgModule.Store(smsg.data(), vchPayload.data(), vchPayload.size(), true));
+    BOOST_CHECK_EQUAL(smsgModule.buckets[bucketTime].setTokens.size(), 1U);
+    smsgModule.buckets.clear();
+}
+
+BOOST_AUTO_TEST_CASE(smsg_bucket_events)
+{
+    int64_t now = GetAdjustedTime();
+    int64_t bucketTime = now - (now % smsg::SMSG_BUCKET_LEN);
+
+    // An empty bucket is kept until the retention cutoff
+    smsg::SecMsgBucket bucket;
+    BOOST_CHECK_EQUAL(bucket.GetNextEvent(bucketTime), bucketTime + smsg::SMSG_RETENTION + 1);
+
+    // Then the first token to expire
+    uint8_t sample[8];
+    GetStrongRandBytes(sample, 8);
+    smsg::SecMsgToken token(bucketTime + 10, sample, 8, 0, 2);
+    BOOST_CHECK(bucket.AddToken(token));
+    bucket.hashBucket();
+    int64_t nExpiry = token.timestamp + 2 * smsg::SMSGGetSecondsInDay();
+    BOOST_CHECK_EQUAL(bucket.GetNextEvent(bucketTime), nExpiry + 1);
+
+    // Then the lock timeout
+    bucket.nLockCount = 3;
+    bucket.nLockTimeout = now + 90;
+    BOOST_CHECK_EQUAL(bucket.GetNextEvent(bucketTime), now + 90);
+
+    // Creating a bucket queues its event
+    smsgModule.buckets.clear();
+    {
+        LOCK(smsgModule.cs_bucket_events);
+        smsgModule.setBucketEvents.clear();
+    }
+    BOOST_CHECK(smsgModule.CreateBucket(bucketTime));
+    {
+        LOCK(smsgModule.cs_bucket_events);
+        BOOST_CHECK_EQUAL(smsgModule.setBucketEvents.size(), 1U);
+        BOOST_CHECK(smsgModule.setBucketEvents.count(std::make_pair(bucketTime + smsg::SMSG_RETENTION + 1, bucketTime)));
+        smsgModule.setBucketEvents.clear();
+    }
+    smsgModule.buckets.clear();
+}
+
+BOOST_AUTO_TEST_CASE(smsg_bucket_tokens)
+{
+    int64_t now = GetAdjustedTime();
+    std::vector<smsg::SecMsgToken> vTokens;
+    for (int i = 0; i < 64; ++i)
+    {
+        uint8_t sample[8];
+        GetStrongRandBytes(sample, 8);
+        // Every 8th token has expired
+        vTokens.emplace_back(now - 128 + i, sample, 8, i * 100, i % 8 == 0 ? 0 : 2);
+    };
+
+    smsg::SecMsgBucket bucket;
+    for (int i = 16; i < 48; ++i) // Appended
+        bucket.AddToken(vTokens[i]);
+    bucket.hashBucket();
+    for (int i = 48; i < 56; ++i)
+        bucket.AddToken(vTokens[i]);
+    for (int i = 15; i >= 8; --i) // Out of order
+        bucket.AddToken(vTokens[i]);
+    BOOST_CHECK(!bucket.AddToken(vTokens[20]));
+
+    std::vector<smsg::SecMsgToken> vBatch(vTokens.begin(), vTokens.begin() + 8);
+    vBatch.insert(vBatch.end(), vTokens.begin() + 50, vTokens.end());
+    bucket.AddTokens(vBatch);
+    bucket.hashBucket();
+
+    BOOST_CHECK_EQUAL(bucket.setTokens.size(), vTokens.size());
+    BOOST_CHECK(std::is_sorted(bucket.setTokens.begin(), bucket.setTokens.end()));
+    for (const auto &token : vTokens)
+        BOOST_CHECK(bucket.setTokens.find(token) != bucket.setTokens.end());
+
+    // Must match a full hash over the active samples in order
+    XXH32_stateSpace_t state;
+    XXH32_resetState(&state, 1);
+    size_t nActive = 0;
+    for (const auto &token : vTokens)
+    {
+        if (token.ttl == 0)
+            continue;
+        XXH32_update(&state, token.sample, 8);
+        nActive++;
+    };
+    uint32_t nHash = XXH32_intermediateDigest(&state);
+    BOOST_CHECK_EQUAL(bucket.hash, nHash);
+    BOOST_CHECK_EQUAL(bucket.nActive, nActive);
+    BOOST_CHECK_EQUAL(bucket.nLeastTTL, 2);
+
+    // An append continues the running hash
+    uint8_t sample[8];
+    GetStrongRandBytes(sample, 8);
+    smsg::SecMsgToken tokenNew(now - 64, sample, 8, 0, 2);
+    BOOST_CHECK(bucket.AddToken(tokenNew));
+    bucket.hashBucket();
+    XXH32_update(&state, tokenNew.sample, 8);
+    BOOST_CHECK_EQUAL(bucket.hash, XXH32_intermediateDigest(&state));
+    BOOST_CHECK_EQUAL(bucket.nActive, nActive + 1);
+
+    // Clearing a ttl rehashes without the token
+    BOOST_CHECK(bucket.SetTokenTTL(bucket.setTokens.find(tokenNew), 0));
+    bucket.hashBucket();
+    BOOST_CHECK_EQUAL(bucket.hash, nHash);
+    BOOST_CHECK_EQUAL(bucket.nActive, nActive);
+}
+
+BOOST_AUTO_TEST_CASE(smsg_iblt)
+{
+    int64_t now = GetAdjustedTime();
+    std::vector<smsg::SecMsgToken> vTokens;
+    for (int i = 0; i < 1000; ++i)
+    {
+        uint8_t sample[8];
+        GetStrongRandBytes(sample, 8);
+        vTokens.emplace_back(now - i, sample, 8, 0, 2);
+    };
+
+    BOOST_CHECK(smsg::SecMsgIBLT::GetCellsFor(0) == smsg::SMSG_IBLT_MIN_CELLS);
+    BOOST_CHECK(smsg::SecMsgIBLT::GetCellsFor(smsg::SMSG_IBLT_MAX_CELLS) == 0);
+    BOOST_CHECK(!smsg::SecMsgIBLT::IsValidSize(smsg::SMSG_IBLT_MIN_CELLS + 1));
+
+    // Peer has tokens 0..989, this node has 10..999
+    uint32_t nCells = smsg::SecMsgIBLT::GetCellsFor(smsg::SMSG_RECON_SLACK);
+    BOOST_CHECK(smsg::SecMsgIBLT::IsValidSize(nCells));
+    smsg::SecMsgIBLT ibltPeer(nCells), ibltOwn(nCells);
+    for (size_t i = 0; i < vTokens.size(); ++i)
+    {
+        if (i < 990)
+            ibltPeer.Insert(vTokens[i]);
+        if (i >= 10)
+            ibltOwn.Insert(vTokens[i]);
+    };
+
+    std::vector<uint8_t> vchData;
+    ibltPeer.Serialize(vchData);
+    BOOST_CHECK(vchData.size() == nCells * smsg::SMSG_IBLT_CELL_LEN);
+    smsg::SecMsgIBLT iblt(nCells);
+    BOOST_CHECK(!iblt.Unserialize(vchData.data(), vchData.size() - 1));
+    BOOST_CHECK(iblt.Unserialize(vchData.data(), vchData.size()));
+
+    BOOST_CHECK(iblt.Subtract(ibltOwn));
+    std::vector<smsg::SecMsgToken> vHave, vLack;
+    BOOST_CHECK(iblt.Decode(vHave, vLack));
+    BOOST_CHECK(vHave.size() == 10);
+    BOOST_CHECK(vLack.size() == 10);
+    std::sort(vHave.begin(), vHave.end());
+    std::sort(vLack.begin(), vLack.end());
+    for (size_t i = 0; i < 10; ++i)
+    {
+        // Sorted by timestamp, vTokens is in descending order
+        BOOST_CHECK(!(vHave[i] < vTokens[9 - i]) && !(vTokens[9 - i] < vHave[i]));
+        BOOST_CHECK(!(vLack[i] < vTokens[999 - i]) && !(vTokens[999 - i] < vLack[i]));
+    };
+
+    // Too many differences for the table
+    smsg::SecMsgIBLT ibltSmall(smsg::SMSG_IBLT_MIN_CELLS), ibltEmpty(smsg::SMSG_IBLT_MIN_CELLS);
+    for (const auto &token : vTokens)
+        ibltSmall.Insert(token);
+    BOOST_CHECK(ibltSmall.Subtract(ibltEmpty));
+    BOOST_CHECK(!ibltSmall.Decode(vHave, vLack));
+    BOOST_CHECK(!ibltSmall.Subtract(iblt));
+}
+
+BOOST_AUTO_TEST_CASE(smsg_db_batch)
+{
+    LOCK(smsg::cs_smsgDB);
+    smsg::SecMsgDB db;
+    BOOST_REQUIRE(db.Open("cr+"));
+
+    CKey key;
+    InsecureNewKey(key, true);
+    CPubKey pubkey = key.GetPubKey(), pubkeyRead;
+    CKeyID idk = pubkey.GetID();
+
+    // Reads within a transaction see its pending writes
+    BOOST_CHECK(db.TxnBegin());
+    BOOST_CHECK(db.WritePK(idk, pubkey));
+    BOOST_CHECK(db.ExistsPK(idk));
+    BOOST_CHECK(db.ReadPK(idk, pubkeyRead) && pubkeyRead == pubkey);
+    BOOST_CHECK(db.TxnAbort());
+    BOOST_CHECK(!db.ExistsPK(idk));
+
+    uint8_t chKey[30] = {'i', 'm'};
+    memcpy(&chKey[10], idk.begin(), 20);
+    smsg::SecMsgStored smsgStored, smsgRead;
+    smsgStored.timeReceived = 1;
+    smsgStored.status = 0;
+    smsgStored.folderId = 0;
+    smsgStored.vchMessage.assign(10, 1);
+
+    BOOST_CHECK(db.TxnBegin());
+    BOOST_CHECK(db.WritePK(idk, pubkey));
+    BOOST_CHECK(db.WriteSmesg(chKey, smsgStored));
+    BOOST_CHECK(db.EraseSmesg(chKey));
+    BOOST_CHECK(!db.ExistsSmesg(chKey));
+    BOOST_CHECK(db.WriteSmesg(chKey, smsgStored));
+    BOOST_CHECK(db.TxnCommit());
+
+    BOOST_CHECK(db.ReadPK(idk, pubkeyRead) && pubkeyRead == pubkey);
+    BOOST_CHECK(db.ReadSmesg(chKey, smsgRead) && smsgRead.vchMessage == smsgStored.vchMessage);
+
+    BOOST_CHECK(db.EraseSmesg(chKey));
+    BOOST_CHECK(!db.ExistsSmesg(chKey));
+
+    smsg::CloseSecMsgDB();
+}
+
+BOOST_AUTO_TEST_CASE(smsg_db_indexes)
+{
+    LOCK(smsg::cs_smsgDB);
+    smsg::SecMsgDB db;
+    BOOST_REQUIRE(db.Open("cr+"));
+
+    CKey key;
+    InsecureNewKey(key, true);
+    CKeyID idk = key.GetPubKey().GetID();
+
+    uint8_t chKey[30] = {'i', 'm'}, chKeyRead[30];
+    memcpy(&chKey[10], idk.begin(), 20);
+    smsg::SecMsgStored smsgStored;
+    smsgStored.timeReceived = 1;
+    smsgStored.status = SMSG_MASK_UNREAD;
+    smsgStored.folderId = 0;
+    smsgStored.addrTo = idk;
+    smsgStored.vchMessage.assign(10, 1);
+
+    BOOST_CHECK(db.WriteSmesg(chKey, smsgStored));
+
+    std::string sUnread("iu"), sAddr("ia");
+    sAddr.append((const char*)idk.begin(), 20);
+
+    // Unread and address index entries resolve to the message key
+    std::unique_ptr<leveldb::Iterator> it(db.pdb->NewIterator(leveldb::ReadOptions()));
+    it->Seek(sUnread);
+    BOOST_CHECK(db.NextIndexed(it.get(), sUnread, chKeyRead) && memcmp(chKey, chKeyRead, 30) == 0);
+    it->Seek(sAddr);
+    BOOST_CHECK(db.NextIndexed(it.get(), sAddr, chKeyRead) && memcmp(chKey, chKeyRead, 30) == 0);
+    BOOST_CHECK(!db.NextIndexed(it.get(), sAddr, chKeyRead));
+
+    // Marking the message read drops it from the unread index
+    smsgStored.status = 0;
+    BOOST_CHECK(db.WriteSmesg(chKey, smsgStored));
+    it.reset(db.pdb->NewIterator(leveldb::ReadOptions()));
+    it->Seek(sUnread);
+    BOOST_CHECK(!db.NextIndexed(it.get(), sUnread, chKeyRead));
+
+    // Erasing the message drops its address index entry
+    BOOST_CHECK(db.EraseSmesg(chKey));
+    it.reset(db.pdb->NewIterator(leveldb::ReadOptions()));
+    it->Seek(sAddr);
+    BOOST_CHECK(!db.NextIndexed(it.get(), sAddr, chKeyRead));
+    it.reset();
+
+    smsg::CloseSecMsgDB();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -68,6 +68,48 @@ BOOST_AUTO_TEST_CASE(streams_vector_writer)
     vch.clear();
 }
 
+BOOST_AUTO_TEST_CASE(streams_span_reader)
+{
+    std::vector<unsigned char> vch = {1, 255, 3, 4, 5, 6};
+
+    CSpanReader reader(SER_NETWORK, INIT_PROTO_VERSION, vch.data(), vch.size());
+    BOOST_CHECK_EQUAL(reader.size(), 6);
+    BOOST_CHECK(!reader.empty());
+
+    unsigned char a;
+    reader >> a;
+    BOOST_CHECK_EQUAL(a, 1);
+    BOOST_CHECK_EQUAL(reader.size(), 5);
+
+    uint16_t b;
+    reader >> b;
+    BOOST_CHECK_EQUAL(b, 1023); // little endian
+    BOOST_CHECK_EQUAL(reader.size(), 3);
+
+    reader.ignore(1);
+    BOOST_CHECK_EQUAL(reader.size(), 2);
+
+    // Reading past the end throws and consumes nothing
+    uint32_t c;
+    BOOST_CHECK_THROW(reader >> c, std::ios_base::failure);
+    BOOST_CHECK_THROW(reader.ignore(3), std::ios_base::failure);
+    BOOST_CHECK_EQUAL(reader.size(), 2);
+
+    reader >> b;
+    BOOST_CHECK_EQUAL(b, 6 * 256 + 5);
+    BOOST_CHECK(reader.empty());
+
+    // Deserializing a vector reads its elements straight from the span
+    std::vector<unsigned char> vchIn = {7, 8, 9}, vchOut;
+    CDataStream ss(SER_NETWORK, INIT_PROTO_VERSION);
+    ss << vchIn;
+    std::vector<unsigned char> vchSer(ss.begin(), ss.end());
+    CSpanReader reader2(SER_NETWORK, INIT_PROTO_VERSION, vchSer.data(), vchSer.size());
+    reader2 >> vchOut;
+    BOOST_CHECK(vchOut == vchIn);
+    BOOST_CHECK(reader2.empty());
+}
+
 BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
 {
     std::vector<char> in;
@@ -7,7 +7,9 @@
 #include <chainparams.h>
 #include <consensus/consensus.h>
 #include <consensus/validation.h>
+#include <crypto/aes.h>
 #include <crypto/sha256.h>
+#include <crypto/sha512.h>
 #include <validation.h>
 #include <miner.h>
 #include <net_processing.h>
@@ -17,6 +19,7 @@
 #include <rpc/server.h>
 #include <rpc/register.h>
 #include <script/sigcache.h>
+#include <blind.h>
 
 void CConnmanTest::AddNode(CNode& node)
 {
@@ -51,12 +54,15 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName, bool fBitcoin
     fBitcoinCMode = fBitcoinCModeIn;
 
     SHA256AutoDetect();
+    SHA512AutoDetect();
+    AES256AutoDetect();
     RandomInit();
     ECC_Start();
     SetupEnvironment();
     SetupNetworking();
     InitSignatureCache();
     InitScriptExecutionCache();
+    InitCTVerificationCache();
     fCheckBlockIndex = true;
     SelectParams(chainName);
 
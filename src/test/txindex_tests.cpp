@@ -47,6 +47,27 @@ BOOST_FIXTURE_TEST_CASE(txindex_initial_sync, TestChain100Setup)
         }
     }
 
+    // Check that single outputs read from the recorded layout match the txs.
+    for (const auto& txn : m_coinbase_txns) {
+        CBlockHeader header;
+        CTxOutBaseRef out;
+        if (!txn->IsBitcoinCVersion()) {
+            BOOST_CHECK(!txindex.FindTxOutput(txn->GetHash(), 0, header, out));
+            continue;
+        }
+        for (uint32_t n = 0; n < txn->vpout.size(); ++n) {
+            if (!txindex.FindTxOutput(txn->GetHash(), n, header, out)) {
+                BOOST_ERROR("FindTxOutput failed");
+                continue;
+            }
+            CDataStream ss_disk(SER_DISK, CLIENT_VERSION), ss_txn(SER_DISK, CLIENT_VERSION);
+            ss_disk << out->nVersion << *out;
+            ss_txn << txn->vpout[n]->nVersion << *txn->vpout[n];
+            BOOST_CHECK(ss_disk.str() == ss_txn.str());
+        }
+        BOOST_CHECK(!txindex.FindTxOutput(txn->GetHash(), txn->vpout.size(), header, out));
+    }
+
     // Check that new transactions in new blocks make it into the index.
     for (int i = 0; i < 10; i++) {
         CScript coinbase_script_pub_key = GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
@@ -1218,4 +1218,31 @@ BOOST_AUTO_TEST_CASE(test_DirIsWritable)
     fs::remove(tmpdirname);
 }
 
+BOOST_AUTO_TEST_CASE(test_ThreadAffinity)
+{
+    std::map<std::string, std::vector<int> > mGroups;
+    std::string sError;
+    BOOST_CHECK(ParseThreadAffinity("validation:0-3,6,staking:8-9,net:5-5", mGroups, sError));
+    BOOST_CHECK_EQUAL(mGroups.size(), 3U);
+    BOOST_CHECK(mGroups["validation"] == std::vector<int>({0, 1, 2, 3, 6}));
+    BOOST_CHECK(mGroups["staking"] == std::vector<int>({8, 9}));
+    BOOST_CHECK(mGroups["net"] == std::vector<int>({5}));
+
+    BOOST_CHECK(ParseThreadAffinity("", mGroups, sError) && mGroups.empty());
+    BOOST_CHECK(!ParseThreadAffinity("0-3", mGroups, sError));
+    BOOST_CHECK(!ParseThreadAffinity("gpu:0", mGroups, sError));
+    BOOST_CHECK(!ParseThreadAffinity("rpc:0,rpc:1", mGroups, sError));
+    BOOST_CHECK(!ParseThreadAffinity("rpc:3-1", mGroups, sError));
+    BOOST_CHECK(!ParseThreadAffinity("rpc:0,", mGroups, sError));
+    BOOST_CHECK(!ParseThreadAffinity("rpc:-1", mGroups, sError));
+    BOOST_CHECK(!ParseThreadAffinity(strprintf("rpc:%d", MAX_AFFINITY_CPU + 1), mGroups, sError));
+
+    BOOST_CHECK_EQUAL(GetThreadGroup("bitcoinc-scriptch"), "validation");
+    BOOST_CHECK_EQUAL(GetThreadGroup("bitcoinc-miner2"), "staking");
+    BOOST_CHECK_EQUAL(GetThreadGroup("bitcoinc-httpworker"), "rpc");
+    BOOST_CHECK_EQUAL(GetThreadGroup("bitcoinc-txindex"), "index");
+    BOOST_CHECK_EQUAL(GetThreadGroup("bitcoinc-minerx"), "");
+    BOOST_CHECK_EQUAL(GetThreadGroup("bitcoinc-shutoff"), "");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -18,6 +18,12 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <thread>
+
 #include <boost/thread.hpp>
 
 static const char DB_COIN = 'C';
@@ -26,6 +32,8 @@ static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_ADDRESSINDEX = 'a';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_ADDRESSBALANCE = 'g';
+static const char DB_ADDRESSINDEX_TXID = 'x';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'p';
@@ -37,6 +45,8 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_COINS_VERSION = 'V';
+static const char DB_COINS_UPGRADE = 'U';
 
 /*
 static const char DB_RCTOUTPUT = 'A';
@@ -66,14 +76,48 @@ struct CoinEntry {
     }
 };
 
+/** Value of a DB_COIN key, scripts use the extended compression from COINS_DB_VERSION_EXT_SCRIPTS */
+struct CoinValue {
+    Coin* coin;
+    bool fExtendedScripts;
+    CoinValue(const Coin* ptr, bool fExtendedScriptsIn) : coin(const_cast<Coin*>(ptr)), fExtendedScripts(fExtendedScriptsIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        coin->Serialize(s, fExtendedScripts);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        coin->Unserialize(s, fExtendedScripts);
+    }
+};
+
 }
 
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, false, 64)
 {
+    int nVersion = 0;
+    if (db.Read(DB_COINS_VERSION, nVersion)) {
+        fExtendedScripts = nVersion >= COINS_DB_VERSION_EXT_SCRIPTS;
+    } else
+    if (!db.Exists(DB_BEST_BLOCK) && !db.Exists(DB_HEAD_BLOCKS)) {
+        // No chain state was ever flushed: a new or wiped db (IsEmpty is false, it holds
+        // the obfuscate key) starts in the current format, older ones are converted by Upgrade
+        std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+        pcursor->Seek(DB_COIN);
+        COutPoint outpoint;
+        CoinEntry entry(&outpoint);
+        if (!pcursor->Valid() || !pcursor->GetKey(entry) || entry.key != DB_COIN) {
+            db.Write(DB_COINS_VERSION, COINS_DB_VERSION_EXT_SCRIPTS);
+            fExtendedScripts = true;
+        }
+    }
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
-    return db.Read(CoinEntry(&outpoint), coin);
+    CoinValue value(&coin, fExtendedScripts);
+    return db.Read(CoinEntry(&outpoint), value);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
@@ -95,9 +139,50 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
+namespace {
+
+/** A dirty coin serialized for the coins db, an empty value erases the key */
+struct CSerializedCoin
+{
+    std::vector<unsigned char> key;
+    std::vector<unsigned char> value;
+
+    bool operator<(const CSerializedCoin &other) const
+    {
+        // Same order as the leveldb bytewise comparator
+        return key < other.key;
+    }
+};
+
+void SerializeCoins(const CDBWrapper &db, bool fExtendedScripts, std::vector<CCoinsMap::const_iterator>::const_iterator begin,
+    std::vector<CCoinsMap::const_iterator>::const_iterator end, std::vector<CSerializedCoin> &vOut)
+{
+    const std::vector<unsigned char> &obfuscate_key = dbwrapper_private::GetObfuscateKey(db);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    vOut.reserve(end - begin);
+    for (auto it = begin; it != end; ++it) {
+        vOut.emplace_back();
+        CSerializedCoin &sc = vOut.back();
+
+        ss << CoinEntry(&(*it)->first);
+        sc.key.assign((const unsigned char*)ss.data(), (const unsigned char*)ss.data() + ss.size());
+        ss.clear();
+
+        if (!(*it)->second.coin.IsSpent()) {
+            ss << CoinValue(&(*it)->second.coin, fExtendedScripts);
+            ss.Xor(obfuscate_key);
+            sc.value.assign((const unsigned char*)ss.data(), (const unsigned char*)ss.data() + ss.size());
+            ss.clear();
+        }
+    }
+    std::sort(vOut.begin(), vOut.end());
+}
+
+} // namespace
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     CDBBatch batch(db);
-    size_t count = 0;
+    size_t count = mapCoins.size();
     size_t changed = 0;
     size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
     int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
@@ -120,18 +205,55 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
 
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    std::vector<CCoinsMap::const_iterator> vDirty;
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); ++it) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            CoinEntry entry(&it->first);
-            if (it->second.coin.IsSpent())
-                batch.Erase(entry);
-            else
-                batch.Write(entry, it->second.coin);
-            changed++;
+            vDirty.push_back(it);
+        }
+    }
+    changed = vDirty.size();
+
+    // Serialize partitions of the dirty coins on worker threads, each sorted
+    // by key, and merge them so the batches are written in key order.
+    size_t nPartitions = 1;
+    if (changed >= MIN_COINSDB_PARALLEL_FLUSH) {
+        nPartitions = std::max(1, std::min(GetNumCores(), MAX_COINSDB_FLUSH_THREADS));
+    }
+    std::vector<std::vector<CSerializedCoin> > vPartitions(nPartitions);
+    std::vector<std::thread> vThreads;
+    for (size_t i = 0; i < nPartitions; ++i) {
+        auto begin = vDirty.cbegin() + (changed * i) / nPartitions;
+        auto end = vDirty.cbegin() + (changed * (i + 1)) / nPartitions;
+        if (i + 1 == nPartitions) {
+            SerializeCoins(db, fExtendedScripts, begin, end, vPartitions[i]);
+        } else {
+            vThreads.emplace_back(SerializeCoins, std::cref(db), fExtendedScripts, begin, end, std::ref(vPartitions[i]));
         }
-        count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+    }
+    for (auto &t : vThreads) {
+        t.join();
+    }
+    vDirty.clear();
+    mapCoins.clear();
+
+    std::vector<CSerializedCoin> vSorted;
+    if (nPartitions == 1) {
+        vSorted.swap(vPartitions[0]);
+    } else {
+        vSorted.reserve(changed);
+        for (auto &v : vPartitions) {
+            size_t nMid = vSorted.size();
+            std::move(v.begin(), v.end(), std::back_inserter(vSorted));
+            std::vector<CSerializedCoin>().swap(v);
+            std::inplace_merge(vSorted.begin(), vSorted.begin() + nMid, vSorted.end());
+        }
+    }
+
+    for (const auto &sc : vSorted) {
+        if (sc.value.empty())
+            batch.EraseSerialized(sc.key);
+        else
+            batch.WriteSerialized(sc.key, sc.value);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -165,10 +287,27 @@ CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, bool com
 {
 }
 
+CBlockTreeDB::~CBlockTreeDB()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        m_write_stop = true;
+    }
+    m_write_cv.notify_all();
+    // The thread drains the queue before exiting
+    if (m_write_thread.joinable()) {
+        m_write_thread.join();
+    }
+}
+
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
     return Read(std::make_pair(DB_BLOCK_FILES, nFile), info);
 }
 
+bool CBlockTreeDB::ReadBlockIndex(const uint256 &hash, CDiskBlockIndex &diskindex) {
+    return Read(std::make_pair(DB_BLOCK_INDEX, hash), diskindex);
+}
+
 bool CBlockTreeDB::WriteReindexing(bool fReindexing) {
     if (fReindexing)
         return Write(DB_REINDEX_FLAG, '1');
@@ -186,20 +325,67 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
-    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock(), fExtendedScripts);
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
     i->pcursor->Seek(DB_COIN);
     // Cache key of first record
-    if (i->pcursor->Valid()) {
-        CoinEntry entry(&i->keyTmp.second);
-        i->pcursor->GetKey(entry);
-        i->keyTmp.first = entry.key;
+    i->CacheKey();
+    return i;
+}
+
+bool CCoinsViewDB::ScanCoins(int nThreads, uint256 &hashBestBlock, const CoinsScanFunction &fn) const
+{
+    CDBSnapshot snapshot(db);
+    if (!db.Read(DB_BEST_BLOCK, hashBestBlock, &snapshot) || hashBestBlock.IsNull()) {
+        return error("%s: No best block in snapshot, flush in progress", __func__);
+    }
+
+    nThreads = std::max(1, std::min(MAX_COINS_SCAN_THREADS, nThreads));
+    std::atomic<int> nNextPart{0};
+    std::atomic<bool> fFailed{false};
+    auto worker = [&]() {
+        try {
+            int nPart;
+            while (!fFailed && (nPart = nNextPart++) < COINS_SCAN_PARTS) {
+                COutPoint start;
+                *start.hash.begin() = nPart;
+                start.n = 0;
+                CCoinsViewDBCursor cursor(const_cast<CDBWrapper&>(db).NewIterator(&snapshot), hashBestBlock, fExtendedScripts, nPart + 1);
+                cursor.pcursor->Seek(CoinEntry(&start));
+                cursor.CacheKey();
+                if (!fn(nPart, cursor)) {
+                    fFailed = true;
+                }
+            }
+        } catch (const std::exception &e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+            fFailed = true;
+        }
+    };
+
+    std::vector<std::thread> vThreads;
+    for (int i = 1; i < nThreads; ++i) {
+        vThreads.emplace_back(worker);
+    }
+    worker();
+    for (auto &t : vThreads) {
+        t.join();
+    }
+
+    return !fFailed;
+}
+
+void CCoinsViewDBCursor::CacheKey()
+{
+    CoinEntry entry(&keyTmp.second);
+    if (!pcursor->Valid() || !pcursor->GetKey(entry)
+        || (entry.key == DB_COIN && *keyTmp.second.hash.begin() >= nEndPart)) {
+        keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
     } else {
-        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
+        keyTmp.first = entry.key;
     }
-    return i;
 }
 
 bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
@@ -214,7 +400,8 @@ bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
 
 bool CCoinsViewDBCursor::GetValue(Coin &coin) const
 {
-    return pcursor->GetValue(coin);
+    CoinValue value(&coin, fExtendedScripts);
+    return pcursor->GetValue(value);
 }
 
 unsigned int CCoinsViewDBCursor::GetValueSize() const
@@ -230,12 +417,7 @@ bool CCoinsViewDBCursor::Valid() const
 void CCoinsViewDBCursor::Next()
 {
     pcursor->Next();
-    CoinEntry entry(&keyTmp.second);
-    if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
-        keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
-    } else {
-        keyTmp.first = entry.key;
-    }
+    CacheKey();
 }
 
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
@@ -247,15 +429,25 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
     }
+    if (m_rct_file)
+        m_rct_file->Flush();
     return WriteBatch(batch, true);
 }
 
-bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
-    return Read(std::make_pair(DB_SPENTINDEX, key), value);
+bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value, const CDBSnapshot *snapshot) {
+    if (!snapshot) {
+        SyncIndexWrites();
+    }
+    return Read(std::make_pair(DB_SPENTINDEX, key), value, snapshot);
 }
 
 bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
     CDBBatch batch(*this);
+    BatchSpentIndex(batch, vect);
+    return WriteBatch(batch);
+}
+
+void CBlockTreeDB::BatchSpentIndex(CDBBatch &batch, const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
     for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
             batch.Erase(std::make_pair(DB_SPENTINDEX, it->first));
@@ -263,11 +455,15 @@ bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey,
             batch.Write(std::make_pair(DB_SPENTINDEX, it->first), it->second);
         }
     }
-    return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
     CDBBatch batch(*this);
+    BatchAddressUnspentIndex(batch, vect);
+    return WriteBatch(batch);
+}
+
+void CBlockTreeDB::BatchAddressUnspentIndex(CDBBatch &batch, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
             batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
@@ -275,19 +471,23 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
             batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
         }
     }
-    return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadAddressUnspentIndex(uint256 addressHash, int type,
-                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
-    const std::unique_ptr<CDBIterator> pcursor(NewIterator());
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                                           const CDBSnapshot *snapshot) {
+    if (!snapshot) {
+        SyncIndexWrites();
+    }
+    const std::unique_ptr<CDBIterator> pcursor(NewIterator(snapshot));
 
     pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressUnspentKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash) {
+        if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX
+            && key.second.type == (unsigned int)type && key.second.hashBytes == addressHash) {
             CAddressUnspentValue nValue;
             if (pcursor->GetValue(nValue)) {
                 unspentOutputs.push_back(std::make_pair(key.second, nValue));
@@ -305,22 +505,64 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint256 addressHash, int type,
 
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(std::make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    BatchWriteAddressIndex(batch, vect);
     return WriteBatch(batch);
 }
 
+void CBlockTreeDB::BatchWriteAddressIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+    std::set<std::pair<int, unsigned int> > setTxns;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        batch.Write(std::make_pair(DB_ADDRESSINDEX, it->first), it->second);
+        if (setTxns.insert(std::make_pair(it->first.blockHeight, it->first.txindex)).second) {
+            batch.Write(std::make_pair(DB_ADDRESSINDEX_TXID, CAddressIndexTxPosKey(it->first.blockHeight, it->first.txindex)), it->first.txhash);
+        }
+    }
+}
+
 bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Erase(std::make_pair(DB_ADDRESSINDEX, it->first));
+    BatchEraseAddressIndex(batch, vect);
     return WriteBatch(batch);
 }
 
+void CBlockTreeDB::BatchEraseAddressIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+    std::set<std::pair<int, unsigned int> > setTxns;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        batch.Erase(std::make_pair(DB_ADDRESSINDEX, it->first));
+        if (setTxns.insert(std::make_pair(it->first.blockHeight, it->first.txindex)).second) {
+            batch.Erase(std::make_pair(DB_ADDRESSINDEX_TXID, CAddressIndexTxPosKey(it->first.blockHeight, it->first.txindex)));
+        }
+    }
+}
+
+/** Fill in the txhash of the address index entries from nFrom, the keys refer to their txn by position */
+static bool ReadAddressIndexTxids(CDBWrapper &db, std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, size_t nFrom,
+                                  const CDBSnapshot *snapshot)
+{
+    int lastHeight = -1;
+    unsigned int lastTxIndex = 0;
+    uint256 lastTxid;
+    for (size_t i = nFrom; i < addressIndex.size(); ++i) {
+        CAddressIndexKey &key = addressIndex[i].first;
+        if (key.blockHeight != lastHeight || key.txindex != lastTxIndex) {
+            if (!db.Read(std::make_pair(DB_ADDRESSINDEX_TXID, CAddressIndexTxPosKey(key.blockHeight, key.txindex)), lastTxid, snapshot)) {
+                return error("failed to get address index txid at %d:%u", key.blockHeight, key.txindex);
+            }
+            lastHeight = key.blockHeight;
+            lastTxIndex = key.txindex;
+        }
+        key.txhash = lastTxid;
+    }
+    return true;
+}
+
 bool CBlockTreeDB::ReadAddressIndex(uint256 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                                    int start, int end) {
-    const std::unique_ptr<CDBIterator> pcursor(NewIterator());
+                                    int start, int end, const CDBSnapshot *snapshot) {
+    if (!snapshot) {
+        SyncIndexWrites();
+    }
+    const std::unique_ptr<CDBIterator> pcursor(NewIterator(snapshot));
 
     if (start > 0 && end > 0) {
         pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
@@ -328,10 +570,12 @@ bool CBlockTreeDB::ReadAddressIndex(uint256 addressHash, int type,
         pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
     }
 
+    size_t nFrom = addressIndex.size();
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash) {
+        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX
+            && key.second.type == (unsigned int)type && key.second.hashBytes == addressHash) {
             if (end > 0 && key.second.blockHeight > end) {
                 break;
             }
@@ -347,6 +591,146 @@ bool CBlockTreeDB::ReadAddressIndex(uint256 addressHash, int type,
         }
     }
 
+    return ReadAddressIndexTxids(*this, addressIndex, nFrom, snapshot);
+}
+
+/**
+ * Read the entries of an address from (nFromHeight, nFromTxIndex) in key order, up to block end if > 0.
+ * Reading stops before the entries of txn nMaxTxns + 1, entries of a txn are never split.
+ */
+bool CBlockTreeDB::ReadAddressIndexPage(uint256 addressHash, int type,
+                                        std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                        int nFromHeight, unsigned int nFromTxIndex, int end, size_t nMaxTxns,
+                                        const CDBSnapshot *snapshot) {
+    if (!snapshot) {
+        SyncIndexWrites();
+    }
+    const std::unique_ptr<CDBIterator> pcursor(NewIterator(snapshot));
+
+    pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorTxKey(type, addressHash, nFromHeight, nFromTxIndex)));
+
+    size_t nFrom = addressIndex.size();
+    size_t nTxns = 0;
+    int lastHeight = -1;
+    unsigned int lastTxIndex = 0;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX
+            || key.second.type != (unsigned int)type || key.second.hashBytes != addressHash) {
+            break;
+        }
+        if (end > 0 && key.second.blockHeight > end) {
+            break;
+        }
+        if (key.second.blockHeight != lastHeight || key.second.txindex != lastTxIndex) {
+            if (nMaxTxns > 0 && nTxns >= nMaxTxns) {
+                break;
+            }
+            nTxns++;
+            lastHeight = key.second.blockHeight;
+            lastTxIndex = key.second.txindex;
+        }
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue)) {
+            return error("failed to get address index value");
+        }
+        addressIndex.push_back(std::make_pair(key.second, nValue));
+        pcursor->Next();
+    }
+
+    return ReadAddressIndexTxids(*this, addressIndex, nFrom, snapshot);
+}
+
+/** Height of the last address index entry of an address below nHeight, 0 if none */
+static int GetPrevAddressIndexHeight(CDBWrapper &db, unsigned int type, const uint256 &addressHash, int nHeight)
+{
+    const std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, nHeight)));
+    if (pcursor->Valid()) {
+        pcursor->Prev();
+    } else {
+        pcursor->SeekToLast();
+    }
+
+    std::pair<char,CAddressIndexKey> key;
+    if (pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX
+        && key.second.type == type && key.second.hashBytes == addressHash) {
+        return key.second.blockHeight;
+    }
+    return 0;
+}
+
+bool CBlockTreeDB::UpdateAddressBalanceIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fDisconnecting) {
+    CDBBatch batch(*this);
+    BatchAddressBalanceIndex(batch, vect, fDisconnecting);
+    return WriteBatch(batch);
+}
+
+void CBlockTreeDB::BatchAddressBalanceIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fDisconnecting) {
+    // vect holds the address index entries of one block, entries of a txn are adjacent per address.
+    struct Delta {
+        CAmount balance = 0;
+        CAmount received = 0;
+        uint32_t nTxCount = 0;
+        uint256 lastTx;
+    };
+    std::map<std::pair<unsigned int, uint256>, Delta> mapDeltas;
+    int nHeight = 0;
+    for (const auto &it : vect) {
+        Delta &delta = mapDeltas[std::make_pair(it.first.type, it.first.hashBytes)];
+        delta.balance += it.second;
+        if (it.second > 0) {
+            delta.received += it.second;
+        }
+        if (delta.nTxCount == 0 || delta.lastTx != it.first.txhash) {
+            delta.nTxCount++;
+            delta.lastTx = it.first.txhash;
+        }
+        nHeight = it.first.blockHeight;
+    }
+
+    for (const auto &it : mapDeltas) {
+        const auto key = std::make_pair(DB_ADDRESSBALANCE, CAddressIndexIteratorKey(it.first.first, it.first.second));
+        CAddressBalanceValue value;
+        bool fExists = Read(key, value);
+
+        // The address index is written ahead of the chainstate, blocks replayed
+        // after an unclean shutdown must not be counted twice.
+        if (fDisconnecting) {
+            if (!fExists || value.nLastHeight < nHeight) {
+                continue;
+            }
+            value.balance -= it.second.balance;
+            value.received -= it.second.received;
+            value.nTxCount -= std::min(value.nTxCount, it.second.nTxCount);
+            // Entries of the disconnected block are already erased
+            value.nLastHeight = GetPrevAddressIndexHeight(*this, it.first.first, it.first.second, nHeight);
+            if (value.nTxCount == 0) {
+                batch.Erase(key);
+                continue;
+            }
+        } else {
+            if (fExists && value.nLastHeight >= nHeight) {
+                continue;
+            }
+            value.balance += it.second.balance;
+            value.received += it.second.received;
+            value.nTxCount += it.second.nTxCount;
+            value.nLastHeight = nHeight;
+        }
+        batch.Write(key, value);
+    }
+}
+
+bool CBlockTreeDB::ReadAddressBalance(uint256 addressHash, int type, CAddressBalanceValue &value, const CDBSnapshot *snapshot) {
+    if (!snapshot) {
+        SyncIndexWrites();
+    }
+    if (!Read(std::make_pair(DB_ADDRESSBALANCE, CAddressIndexIteratorKey(type, addressHash)), value, snapshot)) {
+        value.SetNull();
+    }
     return true;
 }
 
@@ -357,9 +741,12 @@ bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex)
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes)
+bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<std::pair<uint256, unsigned int> > &hashes, const CDBSnapshot *snapshot)
 {
-    const std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    if (!snapshot) {
+        SyncIndexWrites();
+    }
+    const std::unique_ptr<CDBIterator> pcursor(NewIterator(snapshot));
 
     pcursor->Seek(std::make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
 
@@ -369,13 +756,7 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned i
         std::pair<char, CTimestampIndexKey> key;
         if (pcursor->GetKey(key) && key.first == DB_TIMESTAMPINDEX && key.second.timestamp < high)
         {
-            if (fActiveOnly) {
-                if (HashOnchainActive(key.second.blockHash)) {
-                    hashes.push_back(std::make_pair(key.second.blockHash, key.second.timestamp));
-                }
-            } else {
-                hashes.push_back(std::make_pair(key.second.blockHash, key.second.timestamp));
-            }
+            hashes.push_back(std::make_pair(key.second.blockHash, key.second.timestamp));
 
             pcursor->Next();
         } else {
@@ -392,16 +773,124 @@ bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &block
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) {
+bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp, const CDBSnapshot *snapshot) {
+    if (!snapshot) {
+        SyncIndexWrites();
+    }
 
     CTimestampBlockIndexValue lts;
-    if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
+    if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts, snapshot))
         return false;
 
     ltimestamp = lts.ltimestamp;
     return true;
 }
 
+void CBlockTreeDB::BatchTimestampIndex(CDBBatch &batch, const CBlockIndex *pindex) {
+    unsigned int logicalTS = pindex->nTime;
+    unsigned int prevLogicalTS = 0;
+
+    // Retrieve the logical timestamp of the previous block, written by an earlier job
+    CTimestampBlockIndexValue lts;
+    if (pindex->pprev) {
+        if (Read(std::make_pair(DB_BLOCKHASHINDEX, pindex->pprev->GetBlockHash()), lts)) {
+            prevLogicalTS = lts.ltimestamp;
+        } else {
+            LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
+        }
+    }
+
+    if (logicalTS <= prevLogicalTS) {
+        logicalTS = prevLogicalTS + 1;
+        LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
+    }
+
+    batch.Write(std::make_pair(DB_TIMESTAMPINDEX, CTimestampIndexKey(logicalTS, pindex->GetBlockHash())), 0);
+    batch.Write(std::make_pair(DB_BLOCKHASHINDEX, CTimestampBlockIndexKey(pindex->GetBlockHash())), CTimestampBlockIndexValue(logicalTS));
+}
+
+bool CBlockTreeDB::WriteIndexJob(const CIndexWriteJob &job) {
+    CDBBatch batch(*this);
+    if (job.fDisconnecting) {
+        BatchEraseAddressIndex(batch, job.addressIndex);
+    } else {
+        BatchWriteAddressIndex(batch, job.addressIndex);
+    }
+    if (job.fAddressBalanceIndex) {
+        BatchAddressBalanceIndex(batch, job.addressIndex, job.fDisconnecting);
+    }
+    BatchAddressUnspentIndex(batch, job.addressUnspentIndex);
+    BatchSpentIndex(batch, job.spentIndex);
+    if (job.pindexTimestamp) {
+        BatchTimestampIndex(batch, job.pindexTimestamp);
+    }
+    return WriteBatch(batch);
+}
+
+void CBlockTreeDB::ThreadIndexWrite() {
+    std::unique_lock<std::mutex> lock(m_write_mutex);
+    while (true) {
+        if (m_write_queue.empty()) {
+            if (m_write_stop) {
+                break;
+            }
+            m_write_cv.wait(lock);
+            continue;
+        }
+
+        CIndexWriteJob job = std::move(m_write_queue.front());
+        m_write_queue.pop_front();
+        m_write_busy = true;
+        bool fFailed = m_write_failed;
+        lock.unlock();
+
+        if (!fFailed) {
+            try {
+                fFailed = !WriteIndexJob(job);
+            } catch (const std::exception &e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+                fFailed = true;
+            }
+            if (fFailed) {
+                LogPrintf("ERROR: %s: Failed to write insight indices, dropping later blocks\n", __func__);
+            }
+        }
+
+        lock.lock();
+        m_write_busy = false;
+        m_write_failed = fFailed;
+        m_write_cv.notify_all();
+    }
+}
+
+bool CBlockTreeDB::QueueIndexWrite(CIndexWriteJob &&job) {
+    std::unique_lock<std::mutex> lock(m_write_mutex);
+    if (!m_write_thread.joinable()) {
+        m_write_thread = std::thread(&TraceThread<std::function<void()> >, "indexwrite",
+                                     std::function<void()>(std::bind(&CBlockTreeDB::ThreadIndexWrite, this)));
+    }
+
+    // Bound the rows held in memory when the writer falls behind
+    m_write_cv.wait(lock, [this] { return m_write_failed || m_write_queue.size() < MAX_INDEX_WRITE_QUEUE; });
+    if (m_write_failed) {
+        return false;
+    }
+    m_write_queue.push_back(std::move(job));
+    m_write_cv.notify_all();
+    return true;
+}
+
+bool CBlockTreeDB::SyncIndexWrites() {
+    std::unique_lock<std::mutex> lock(m_write_mutex);
+    m_write_cv.wait(lock, [this] { return m_write_failed || (m_write_queue.empty() && !m_write_busy); });
+    return !m_write_failed;
+}
+
+std::unique_ptr<CDBSnapshot> CBlockTreeDB::GetIndexSnapshot() {
+    SyncIndexWrites();
+    return MakeUnique<CDBSnapshot>(*this);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -414,67 +903,139 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+namespace {
+
+/** A block index entry read on a loader thread, linked to its parent once all are in mapBlockIndex */
+struct CLoadedBlockIndex
+{
+    uint256 hash;
+    uint256 hashPrev;
+    std::unique_ptr<CBlockIndex> pindex;
+    CBlockIndex *pindexInserted = nullptr;
+};
+
+/** Read the block index entries with the first byte of their hash in [nBegin, nEnd) */
+bool ReadBlockIndexRange(CBlockTreeDB &db, const Consensus::Params &consensusParams, int nBegin, int nEnd,
+    std::vector<CLoadedBlockIndex> &vOut)
 {
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    uint256 hashBegin;
+    *hashBegin.begin() = nBegin;
 
-    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, hashBegin));
 
-    // Load mapBlockIndex
     while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
         std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew  = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev                    = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight                  = diskindex.nHeight;
-                pindexNew->nFile                    = diskindex.nFile;
-                pindexNew->nDataPos                 = diskindex.nDataPos;
-                pindexNew->nUndoPos                 = diskindex.nUndoPos;
-                pindexNew->nVersion                 = diskindex.nVersion;
-                pindexNew->hashMerkleRoot           = diskindex.hashMerkleRoot;
-                pindexNew->hashWitnessMerkleRoot    = diskindex.hashWitnessMerkleRoot;
-                pindexNew->nTime                    = diskindex.nTime;
-                pindexNew->nBits                    = diskindex.nBits;
-                pindexNew->nNonce                   = diskindex.nNonce;
-                pindexNew->nStatus                  = diskindex.nStatus;
-                pindexNew->nTx                      = diskindex.nTx;
-
-                pindexNew->nFlags                   = diskindex.nFlags & ~BLOCK_DELAYED;
-                pindexNew->bnStakeModifier          = diskindex.bnStakeModifier;
-                pindexNew->prevoutStake             = diskindex.prevoutStake;
-                //pindexNew->hashProof                = diskindex.hashProof;
-
-                pindexNew->nMoneySupply             = diskindex.nMoneySupply;
-                pindexNew->nAnonOutputs             = diskindex.nAnonOutputs;
-
-
-                if (pindexNew->nHeight == 0
-                    && pindexNew->GetBlockHash() != Params().GetConsensus().hashGenesisBlock)
-                    return error("LoadBlockIndex(): Genesis block hash incorrect: %s", pindexNew->ToString());
-
-                if (fBitcoinCMode)
-                {
-                    // only CheckProofOfWork for genesis blocks
-                    if (diskindex.hashPrev.IsNull() && !CheckProofOfWork(pindexNew->GetBlockHash(),
-                        pindexNew->nBits, Params().GetConsensus(), 0, Params().GetLastImportHeight()))
-                        return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
-                } else
-                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, Params().GetConsensus()))
-                {
-                    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
-                };
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || *key.second.begin() >= nEnd) {
+            break;
+        }
+        CDiskBlockIndex diskindex;
+        if (!pcursor->GetValue(diskindex)) {
+            return error("%s: failed to read value", __func__);
+        }
 
-                pcursor->Next();
-            } else {
-                return error("%s: failed to read value", __func__);
-            }
+        vOut.emplace_back();
+        CLoadedBlockIndex &loaded = vOut.back();
+        loaded.hash = diskindex.GetBlockHash();
+        loaded.hashPrev = diskindex.hashPrev;
+        loaded.pindex.reset(new CBlockIndex());
+
+        // Construct block index object
+        CBlockIndex* pindexNew              = loaded.pindex.get();
+        pindexNew->nHeight                  = diskindex.nHeight;
+        pindexNew->nFile                    = diskindex.nFile;
+        pindexNew->nDataPos                 = diskindex.nDataPos;
+        pindexNew->nUndoPos                 = diskindex.nUndoPos;
+        pindexNew->nVersion                 = diskindex.nVersion;
+        pindexNew->hashMerkleRoot           = diskindex.hashMerkleRoot;
+        pindexNew->hashWitnessMerkleRoot    = diskindex.hashWitnessMerkleRoot;
+        pindexNew->nTime                    = diskindex.nTime;
+        pindexNew->nBits                    = diskindex.nBits;
+        pindexNew->nNonce                   = diskindex.nNonce;
+        pindexNew->nStatus                  = diskindex.nStatus;
+        pindexNew->nTx                      = diskindex.nTx;
+
+        pindexNew->nFlags                   = diskindex.nFlags & ~BLOCK_DELAYED;
+        pindexNew->bnStakeModifier          = diskindex.bnStakeModifier;
+        //pindexNew->hashProof                = diskindex.hashProof;
+        // prevoutStake and nMoneySupply are paged in when first used
+
+        pindexNew->nAnonOutputs             = diskindex.nAnonOutputs;
+
+
+        if (pindexNew->nHeight == 0
+            && loaded.hash != consensusParams.hashGenesisBlock)
+            return error("LoadBlockIndex(): Genesis block hash incorrect: %s", loaded.hash.ToString());
+
+        if (fBitcoinCMode)
+        {
+            // only CheckProofOfWork for genesis blocks
+            if (diskindex.hashPrev.IsNull() && !CheckProofOfWork(loaded.hash,
+                pindexNew->nBits, consensusParams, 0, Params().GetLastImportHeight()))
+                return error("%s: CheckProofOfWork failed: %s", __func__, loaded.hash.ToString());
+        } else
+        if (!CheckProofOfWork(loaded.hash, pindexNew->nBits, consensusParams))
+        {
+            return error("%s: CheckProofOfWork failed: %s", __func__, loaded.hash.ToString());
+        };
+
+        pcursor->Next();
+    }
+
+    return true;
+}
+
+} // namespace
+
+bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
+    std::function<CBlockIndex*(const uint256&, CBlockIndex*)> insertBlockIndex,
+    std::function<void(size_t)> reserveBlockIndex)
+{
+    // Hashes are uniformly distributed, split the key space by their first byte
+    int nPartitions = std::max(1, std::min(GetNumCores(), MAX_BLOCK_INDEX_LOAD_THREADS));
+    std::vector<std::vector<CLoadedBlockIndex> > vPartitions(nPartitions);
+    std::vector<char> vResults(nPartitions, false);
+    std::vector<std::thread> vThreads;
+    for (int i = 0; i < nPartitions; ++i) {
+        int nBegin = (256 * i) / nPartitions;
+        int nEnd = (256 * (i + 1)) / nPartitions;
+        auto read = [this, &consensusParams, nBegin, nEnd, &vPartitions, &vResults, i]() {
+            vResults[i] = ReadBlockIndexRange(*this, consensusParams, nBegin, nEnd, vPartitions[i]);
+        };
+        if (i + 1 == nPartitions) {
+            read();
         } else {
-            break;
+            vThreads.emplace_back(read);
+        }
+    }
+    for (auto &t : vThreads) {
+        t.join();
+    }
+    for (char fResult : vResults) {
+        if (!fResult) {
+            return false;
+        }
+    }
+
+    size_t nEntries = 0;
+    for (const auto &v : vPartitions) {
+        nEntries += v.size();
+    }
+    reserveBlockIndex(nEntries);
+
+    // Load mapBlockIndex, every entry must be in before parents are linked
+    for (auto &v : vPartitions) {
+        boost::this_thread::interruption_point();
+        for (auto &loaded : v) {
+            loaded.pindexInserted = insertBlockIndex(loaded.hash, loaded.pindex.release());
+        }
+    }
+    for (auto &v : vPartitions) {
+        boost::this_thread::interruption_point();
+        for (const auto &loaded : v) {
+            loaded.pindexInserted->pprev = insertBlockIndex(loaded.hashPrev, nullptr);
         }
+        std::vector<CLoadedBlockIndex>().swap(v);
     }
 
     return true;
@@ -482,23 +1043,175 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
 
 bool CBlockTreeDB::ReadRCTOutput(int64_t i, CAnonOutput &ao)
 {
-    return Read(std::make_pair(DB_RCTOUTPUT, i), ao);
+    if (m_rct_cache.Get(i, ao))
+        return true;
+    if ((m_rct_file && m_rct_file->Read(i, ao))
+        || Read(std::make_pair(DB_RCTOUTPUT, i), ao))
+    {
+        m_rct_cache.Insert(i, ao);
+        return true;
+    };
+    return false;
+};
+
+bool CBlockTreeDB::ReadRCTOutputs(const std::vector<int64_t> &vIndices, std::vector<CAnonOutput> &vao)
+{
+    vao.resize(vIndices.size());
+
+    std::vector<std::pair<char, int64_t> > vKeys;
+    std::vector<size_t> vPos;
+    for (size_t k = 0; k < vIndices.size(); ++k)
+    {
+        int64_t i = vIndices[k];
+        if (m_rct_cache.Get(i, vao[k]))
+            continue;
+        if (m_rct_file && m_rct_file->Read(i, vao[k]))
+        {
+            m_rct_cache.Insert(i, vao[k]);
+            continue;
+        };
+        vKeys.push_back(std::make_pair(DB_RCTOUTPUT, i));
+        vPos.push_back(k);
+    };
+
+    if (vKeys.empty())
+        return true;
+
+    std::vector<CAnonOutput> vaoDb;
+    if (!ReadMany(vKeys, vaoDb))
+        return false;
+
+    for (size_t k = 0; k < vPos.size(); ++k)
+    {
+        vao[vPos[k]] = vaoDb[k];
+        m_rct_cache.Insert(vKeys[k].second, vaoDb[k]);
+    };
+
+    return true;
+};
+
+bool CBlockTreeDB::ReadRCTOutputRange(int64_t nStart, size_t nCount, std::vector<CAnonOutput> &vao)
+{
+    vao.resize(nCount);
+
+    std::vector<std::pair<char, int64_t> > vKeys;
+    std::vector<size_t> vPos;
+    for (size_t k = 0; k < nCount; ++k)
+    {
+        int64_t i = nStart + (int64_t)k;
+        if (m_rct_file && m_rct_file->Read(i, vao[k]))
+            continue;
+        vKeys.push_back(std::make_pair(DB_RCTOUTPUT, i));
+        vPos.push_back(k);
+    };
+
+    if (vKeys.empty())
+        return true;
+
+    std::vector<CAnonOutput> vaoDb;
+    if (!ReadMany(vKeys, vaoDb))
+        return false;
+
+    for (size_t k = 0; k < vPos.size(); ++k)
+        vao[vPos[k]] = vaoDb[k];
+
+    return true;
 };
 
 bool CBlockTreeDB::WriteRCTOutput(int64_t i, const CAnonOutput &ao)
 {
     CDBBatch batch(*this);
     batch.Write(std::make_pair(DB_RCTOUTPUT, i), ao);
-    return WriteBatch(batch);
+    m_rct_cache.Erase(i);
+    if (!WriteBatch(batch))
+        return false;
+    if (m_rct_file)
+        m_rct_file->Write(i, ao);
+    return true;
 };
 
 bool CBlockTreeDB::EraseRCTOutput(int64_t i)
 {
+    // Drop from the file first, it must never hold an output the db doesn't
+    if (m_rct_file)
+        m_rct_file->Erase(i);
+    m_rct_cache.Erase(i);
     CDBBatch batch(*this);
     batch.Erase(std::make_pair(DB_RCTOUTPUT, i));
     return WriteBatch(batch);
 };
 
+bool CBlockTreeDB::EraseRCTOutputs(const std::vector<std::pair<int64_t, CCmpPubKey> > &vOutputs, const std::vector<CCmpPubKey> &vKeyImages)
+{
+    CDBBatch batch(*this);
+    int64_t nFirst = std::numeric_limits<int64_t>::max();
+    for (const auto &out : vOutputs)
+    {
+        nFirst = std::min(nFirst, out.first);
+        m_rct_cache.Erase(out.first);
+        batch.Erase(std::make_pair(DB_RCTOUTPUT, out.first));
+        batch.Erase(std::make_pair(DB_RCTOUTPUT_LINK, out.second));
+    };
+    for (const auto &ki : vKeyImages)
+        batch.Erase(std::make_pair(DB_RCTKEYIMAGE, ki));
+
+    // Drop from the file first, it must never hold an output the db doesn't
+    if (m_rct_file && !vOutputs.empty())
+        m_rct_file->Erase(nFirst);
+    return WriteBatch(batch);
+};
+
+bool CBlockTreeDB::OpenRCTOutputFile(const fs::path &path, bool fWipe)
+{
+    std::unique_ptr<CRCTOutputFile> file(new CRCTOutputFile(path));
+    if (!file->Open(fWipe))
+        return false;
+
+    // The file is flushed lazily, drop any trailing records the db doesn't match
+    int64_t nLast = file->GetLastValid();
+    uint8_t vchFile[RCT_OUTPUT_RECORD_SIZE], vchDb[RCT_OUTPUT_RECORD_SIZE];
+    CAnonOutput aoFile, aoDb;
+    for (int64_t i = nLast; i > 0 && i > nLast - RCT_OUTPUT_FILE_CHECK; --i)
+    {
+        if (file->Read(i, aoFile) && Read(std::make_pair(DB_RCTOUTPUT, i), aoDb))
+        {
+            CRCTOutputFile::Encode(aoFile, vchFile);
+            CRCTOutputFile::Encode(aoDb, vchDb);
+            if (memcmp(vchFile, vchDb, RCT_OUTPUT_RECORD_SIZE) == 0)
+                continue;
+        };
+        file->Erase(i);
+    };
+
+    // Catch up with outputs added while the file was disabled or stale
+    int64_t nAdded = 0;
+    for (int64_t i = file->GetLastValid() + 1; Read(std::make_pair(DB_RCTOUTPUT, i), aoDb); ++i)
+    {
+        if (!file->Write(i, aoDb))
+            return error("%s: Failed to write output %d.", __func__, i);
+        if (++nAdded % 100000 == 0)
+        {
+            LogPrintf("%s: Copied %d outputs.\n", __func__, nAdded);
+            if (ShutdownRequested())
+                return false;
+        };
+    };
+    file->Flush();
+
+    LogPrintf("%s: Serving %d RCT outputs from %s, %d copied from db.\n", __func__, file->GetLastValid(), path.string(), nAdded);
+    m_rct_file = std::move(file);
+    return true;
+};
+
+void CBlockTreeDB::UpdateRCTOutputCaches(const std::vector<std::pair<int64_t, CAnonOutput> > &vao)
+{
+    for (const auto &it : vao)
+    {
+        m_rct_cache.Erase(it.first);
+        if (m_rct_file)
+            m_rct_file->Write(it.first, it.second);
+    };
+};
 
 bool CBlockTreeDB::ReadRCTOutputLink(const CCmpPubKey &pk, int64_t &i)
 {
@@ -521,11 +1234,14 @@ bool CBlockTreeDB::EraseRCTOutputLink(const CCmpPubKey &pk)
 
 bool CBlockTreeDB::ReadRCTKeyImage(const CCmpPubKey &ki, uint256 &txhash)
 {
+    if (!m_ki_filter.MaybeContains(ki))
+        return false;
     return Read(std::make_pair(DB_RCTKEYIMAGE, ki), txhash);
 };
 
 bool CBlockTreeDB::WriteRCTKeyImage(const CCmpPubKey &ki, const uint256 &txhash)
 {
+    InsertKeyImageFilter(std::vector<std::pair<CCmpPubKey, uint256> >{std::make_pair(ki, txhash)});
     CDBBatch batch(*this);
     batch.Write(std::make_pair(DB_RCTKEYIMAGE, ki), txhash);
     return WriteBatch(batch);
@@ -538,9 +1254,129 @@ bool CBlockTreeDB::EraseRCTKeyImage(const CCmpPubKey &ki)
     return WriteBatch(batch);
 };
 
+bool CBlockTreeDB::LoadKeyImageFilter()
+{
+    // Count first so the filter can be sized with room to grow
+    size_t nCount = 0;
+    for (int nPass = 0; nPass < 2; ++nPass)
+    {
+        if (nPass == 1)
+            m_ki_filter.Reset(nCount * 2);
+
+        std::unique_ptr<CDBIterator> pcursor(NewIterator());
+        pcursor->Seek(DB_RCTKEYIMAGE);
+        while (pcursor->Valid())
+        {
+            std::pair<char, CCmpPubKey> key;
+            if (!pcursor->GetKey(key) || key.first != DB_RCTKEYIMAGE)
+                break;
+            if (nPass == 0)
+                nCount++;
+            else
+                m_ki_filter.Insert(key.second);
+            pcursor->Next();
+        };
+    };
+
+    LogPrintf("%s: Loaded %d key images, capacity %d, %d bytes.\n", __func__,
+        nCount, m_ki_filter.GetCapacity(), m_ki_filter.DynamicMemoryUsage());
+    return true;
+};
+
+void CBlockTreeDB::InsertKeyImageFilter(const std::vector<std::pair<CCmpPubKey, uint256> > &vki)
+{
+    if (!m_ki_filter.IsEnabled())
+        return;
+
+    // The db doesn't hold vki yet, so rebuild before inserting them
+    if (m_ki_filter.NeedsResize())
+        LoadKeyImageFilter();
+
+    for (const auto &it : vki)
+        m_ki_filter.Insert(it.first);
+};
+
 bool CCoinsViewDB::Upgrade()
 {
-    // TODO
+    if (fExtendedScripts) {
+        return true;
+    }
+
+    // Coins up to DB_COINS_UPGRADE were rewritten before an interruption
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    COutPoint outpoint, last;
+    bool fResume = db.Read(DB_COINS_UPGRADE, last);
+    if (fResume) {
+        pcursor->Seek(CoinEntry(&last));
+        CoinEntry entry(&outpoint);
+        if (pcursor->Valid() && pcursor->GetKey(entry) && entry.key == DB_COIN && outpoint == last) {
+            pcursor->Next();
+        }
+    } else {
+        pcursor->Seek(DB_COIN);
+    }
+
+    LogPrintf("Upgrading coin database scripts%s...\n", fResume ? " (resuming)" : "");
+    uiInterface.ShowProgress(_("Upgrading UTXO database"), 0, true);
+    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    CDBBatch batch(db);
+    int64_t count = 0;
+    int reportDone = 0;
+    bool fInterrupted = false;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested()) {
+            fInterrupted = true;
+            break;
+        }
+        CoinEntry entry(&outpoint);
+        if (!pcursor->GetKey(entry) || entry.key != DB_COIN) {
+            break;
+        }
+        Coin coin;
+        CoinValue value(&coin, false);
+        if (!pcursor->GetValue(value)) {
+            return error("%s: cannot parse coin %s", __func__, outpoint.ToString());
+        }
+        batch.Write(entry, CoinValue(&coin, true));
+        last = outpoint;
+
+        if (count++ % 256 == 0) {
+            int percentageDone = (int)(*outpoint.hash.begin() * 100.0 / 256.0 + 0.5);
+            uiInterface.ShowProgress(_("Upgrading UTXO database"), percentageDone, true);
+            if (reportDone < percentageDone/10) {
+                // report max. every 10% step
+                LogPrintf("[%d%%]...\n", percentageDone); /* Continued */
+                reportDone = percentageDone/10;
+            }
+        }
+        if (batch.SizeEstimate() > batch_size) {
+            batch.Write(DB_COINS_UPGRADE, last);
+            db.WriteBatch(batch);
+            batch.Clear();
+        }
+        pcursor->Next();
+    }
+
+    if (fInterrupted) {
+        if (count > 0) {
+            batch.Write(DB_COINS_UPGRADE, last);
+        }
+    } else {
+        batch.Erase(DB_COINS_UPGRADE);
+        batch.Write(DB_COINS_VERSION, COINS_DB_VERSION_EXT_SCRIPTS);
+    }
+    if (!db.WriteBatch(batch, true)) {
+        return error("%s: failed to write coin database", __func__);
+    }
+    uiInterface.ShowProgress("", 100, false);
+    LogPrintf("[%s].\n", fInterrupted ? "CANCELLED" : "DONE");
+    if (fInterrupted) {
+        return false;
+    }
+
+    fExtendedScripts = true;
+    db.CompactRange(DB_COIN, (char)(DB_COIN+1));
     return true;
 };
 
@@ -604,6 +1440,48 @@ Upgrade the database from older formats.
  *
  * Currently implemented: from the per-tx utxo model (0.8..0.14.x) to per-txout.
 
+bool CBlockTreeDB::LoadKeyImageFilter()
+{
+    // Count first so the filter can be sized with room to grow
+    size_t nCount = 0;
+    for (int nPass = 0; nPass < 2; ++nPass)
+    {
+        if (nPass == 1)
+            m_ki_filter.Reset(nCount * 2);
+
+        std::unique_ptr<CDBIterator> pcursor(NewIterator());
+        pcursor->Seek(DB_RCTKEYIMAGE);
+        while (pcursor->Valid())
+        {
+            std::pair<char, CCmpPubKey> key;
+            if (!pcursor->GetKey(key) || key.first != DB_RCTKEYIMAGE)
+                break;
+            if (nPass == 0)
+                nCount++;
+            else
+                m_ki_filter.Insert(key.second);
+            pcursor->Next();
+        };
+    };
+
+    LogPrintf("%s: Loaded %d key images, capacity %d, %d bytes.\n", __func__,
+        nCount, m_ki_filter.GetCapacity(), m_ki_filter.DynamicMemoryUsage());
+    return true;
+};
+
+void CBlockTreeDB::InsertKeyImageFilter(const std::vector<std::pair<CCmpPubKey, uint256> > &vki)
+{
+    if (!m_ki_filter.IsEnabled())
+        return;
+
+    // The db doesn't hold vki yet, so rebuild before inserting them
+    if (m_ki_filter.NeedsResize())
+        LoadKeyImageFilter();
+
+    for (const auto &it : vki)
+        m_ki_filter.Insert(it.first);
+};
+
 bool CCoinsViewDB::Upgrade() {
     std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
     pcursor->Seek(std::make_pair(DB_COINS, uint256()));
@@ -12,12 +12,20 @@
 #include <insight/addressindex.h>
 #include <insight/spentindex.h>
 #include <insight/timestampindex.h>
+#include <keyimagefilter.h>
 #include <rctindex.h>
+#include <rctoutputcache.h>
+#include <rctoutputfile.h>
 #include <primitives/block.h>
 
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -37,6 +45,14 @@ static constexpr int MAX_BLOCK_COINSDB_USAGE = 10;
 static const int64_t nDefaultDbCache = 450;
 //! -dbbatchsize default (bytes)
 static const int64_t nDefaultDbBatchSize = 16 << 20;
+//! Max threads serializing the dirty coins of a flush
+static const int MAX_COINSDB_FLUSH_THREADS = 8;
+//! Min dirty coins in a flush to serialize them in parallel
+static const size_t MIN_COINSDB_PARALLEL_FLUSH = 20000;
+//! Max threads reading the block index at startup
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 8;
+//! Max blocks of index rows waiting for the write-behind thread
+static const size_t MAX_INDEX_WRITE_QUEUE = 16;
 //! max. -dbcache (MiB)
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
@@ -47,14 +63,30 @@ static const int64_t nMaxBlockDBCache = 2;
 // Unlike for the UTXO database, for the txindex scenario the leveldb cache make
 // a meaningful difference: https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
 static const int64_t nMaxTxIndexCache = 1024;
+//! Max memory allocated to the block filter index DB specific cache, if -blockfilterindex (MiB)
+static const int64_t nMaxFilterIndexCache = 1024;
+//! Max memory allocated to the block stats index DB specific cache, if -blockstatsindex (MiB)
+static const int64_t nMaxBlockStatsIndexCache = 64;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
+//! Coins db version from which coin scripts use the extended compression
+static const int COINS_DB_VERSION_EXT_SCRIPTS = 1;
+
+//! Key ranges of a parallel coins scan, one per leading txid byte
+static const int COINS_SCAN_PARTS = 256;
+//! Max threads of a parallel coins scan
+static const int MAX_COINS_SCAN_THREADS = 8;
+
+/** Called by CCoinsViewDB::ScanCoins for each key range, return false to stop the scan */
+typedef std::function<bool(int nPart, CCoinsViewCursor &cursor)> CoinsScanFunction;
+
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB final : public CCoinsView
 {
 protected:
     CDBWrapper db;
+    bool fExtendedScripts = false; //!< Coin scripts use the extended compression, see CScriptCompressor
 public:
     explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
@@ -65,7 +97,16 @@ public:
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
 
+    /**
+     * Walk the coins in COINS_SCAN_PARTS txid ranges over nThreads threads, fn is called
+     * once per range with a cursor over it. All ranges are read from one snapshot of the
+     * database, hashBestBlock is set to the block the snapshot is at.
+     * Fails if fn fails or the snapshot was taken during a flush spanning several batches.
+     */
+    bool ScanCoins(int nThreads, uint256 &hashBestBlock, const CoinsScanFunction &fn) const;
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
+    //! Recompresses the coin scripts of a pre COINS_DB_VERSION_EXT_SCRIPTS db, resumes if interrupted.
     bool Upgrade();
     size_t EstimateSize() const override;
 };
@@ -84,49 +125,118 @@ public:
     void Next() override;
 
 private:
-    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn, bool fExtendedScriptsIn, int nEndPartIn = COINS_SCAN_PARTS):
+        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn), fExtendedScripts(fExtendedScriptsIn), nEndPart(nEndPartIn) {}
+    void CacheKey();
     std::unique_ptr<CDBIterator> pcursor;
     std::pair<char, COutPoint> keyTmp;
+    bool fExtendedScripts;
+    int nEndPart; // Leading txid byte the cursor stops at
 
     friend class CCoinsViewDB;
 };
 
+/** Insight index rows of one block, written as a single batch */
+struct CIndexWriteJob
+{
+    bool fDisconnecting = false;
+    bool fAddressBalanceIndex = false;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    //! Block to add to the timestamp index, if set
+    const CBlockIndex *pindexTimestamp = nullptr;
+
+    bool IsEmpty() const
+    {
+        return addressIndex.empty() && addressUnspentIndex.empty() && spentIndex.empty() && !pindexTimestamp;
+    }
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
 public:
     explicit CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool compression = true, int maxOpenFiles = 1000);
+    ~CBlockTreeDB();
 
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &info);
+    bool ReadBlockIndex(const uint256 &hash, CDiskBlockIndex &diskindex);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindexing);
     void ReadReindexing(bool &fReindexing);
 
-    bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
+    /**
+     * The insight index reads wait for queued index rows, unless reading
+     * through snapshot. Pass a snapshot to see one state across many reads.
+     */
+    bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value, const CDBSnapshot *snapshot = nullptr);
     bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint256 addressHash, int type,
-                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect,
+                                 const CDBSnapshot *snapshot = nullptr);
     bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool ReadAddressIndex(uint256 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                          int start = 0, int end = 0);
+                          int start = 0, int end = 0, const CDBSnapshot *snapshot = nullptr);
+    bool ReadAddressIndexPage(uint256 addressHash, int type,
+                              std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                              int nFromHeight, unsigned int nFromTxIndex, int end, size_t nMaxTxns,
+                              const CDBSnapshot *snapshot = nullptr);
+    bool UpdateAddressBalanceIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fDisconnecting);
+    bool ReadAddressBalance(uint256 addressHash, int type, CAddressBalanceValue &value, const CDBSnapshot *snapshot = nullptr);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
-    bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
+    bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<std::pair<uint256, unsigned int> > &vect, const CDBSnapshot *snapshot = nullptr);
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
-    bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS);
+    bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS, const CDBSnapshot *snapshot = nullptr);
+
+    /**
+     * Hand the insight index rows of a block to the write-behind thread, jobs are
+     * written in queue order. Returns false if an earlier job failed to write.
+     */
+    bool QueueIndexWrite(CIndexWriteJob &&job);
+    /** Wait for all queued index rows to be written, false if any failed */
+    bool SyncIndexWrites();
+    /** Snapshot of the db including all index rows queued so far */
+    std::unique_ptr<CDBSnapshot> GetIndexSnapshot();
 
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    /**
+     * Read the block index on up to MAX_BLOCK_INDEX_LOAD_THREADS threads, each taking a range of
+     * the key space. insertBlockIndex adds the passed entry, or an empty one if nullptr, and
+     * returns the entry for the hash. reserveBlockIndex is called with the number of entries read.
+     */
+    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams,
+        std::function<CBlockIndex*(const uint256&, CBlockIndex*)> insertBlockIndex,
+        std::function<void(size_t)> reserveBlockIndex);
 
 
     bool ReadRCTOutput(int64_t i, CAnonOutput &ao);
+    //! Fills vao in the order of vIndices, returns false if any output is missing
+    bool ReadRCTOutputs(const std::vector<int64_t> &vIndices, std::vector<CAnonOutput> &vao);
+    /**
+     * Fills vao with the nCount outputs from nStart, returns false if any output is missing.
+     * Bypasses the output cache, which keeps serving ring member lookups during bulk reads.
+     */
+    bool ReadRCTOutputRange(int64_t nStart, size_t nCount, std::vector<CAnonOutput> &vao);
     bool WriteRCTOutput(int64_t i, const CAnonOutput &ao);
     bool EraseRCTOutput(int64_t i);
+    /**
+     * Erase RCT outputs with their links, and key images, in one batch. Takes the
+     * pubkeys of the outputs rather than reading them. vOutputs must be the last outputs.
+     */
+    bool EraseRCTOutputs(const std::vector<std::pair<int64_t, CCmpPubKey> > &vOutputs, const std::vector<CCmpPubKey> &vKeyImages);
+
+    /** Serve RCT outputs from a memory-mapped flat file, the db remains the fallback */
+    bool OpenRCTOutputFile(const fs::path &path, bool fWipe);
+    const CRCTOutputFile *GetRCTOutputFile() const { return m_rct_file.get(); };
+    /** Bring the file and memory cache in line with outputs batch written to the db */
+    void UpdateRCTOutputCaches(const std::vector<std::pair<int64_t, CAnonOutput> > &vao);
+    CRCTOutputCache &GetRCTOutputCache() { return m_rct_cache; };
 
     bool ReadRCTOutputLink(const CCmpPubKey &pk, int64_t &i);
     bool WriteRCTOutputLink(const CCmpPubKey &pk, int64_t i);
@@ -136,7 +246,39 @@ public:
     bool WriteRCTKeyImage(const CCmpPubKey &ki, const uint256 &txhash);
     bool EraseRCTKeyImage(const CCmpPubKey &ki);
 
+    /** Rebuild the key image filter from the db, readers must be excluded by cs_main */
+    bool LoadKeyImageFilter();
+    /** Add key images about to be batch written to the db, resizing the filter if needed */
+    void InsertKeyImageFilter(const std::vector<std::pair<CCmpPubKey, uint256> > &vki);
+    const CKeyImageFilter &GetKeyImageFilter() const { return m_ki_filter; };
+
     //bool WriteRCTOutputBatch(std::vector<std::pair<int64_t, CAnonOutput> > &vao);
+
+private:
+    void BatchWriteAddressIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    void BatchEraseAddressIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    void BatchAddressBalanceIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fDisconnecting);
+    void BatchAddressUnspentIndex(CDBBatch &batch, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    void BatchSpentIndex(CDBBatch &batch, const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vect);
+    void BatchTimestampIndex(CDBBatch &batch, const CBlockIndex *pindex);
+    bool WriteIndexJob(const CIndexWriteJob &job);
+    void ThreadIndexWrite();
+
+    //! Guards the write-behind queue and its state
+    std::mutex m_write_mutex;
+    std::condition_variable m_write_cv;
+    std::deque<CIndexWriteJob> m_write_queue;
+    //! A job was taken from the queue and is being written
+    bool m_write_busy = false;
+    //! Once a job fails all later ones are dropped, they would build on missing rows
+    bool m_write_failed = false;
+    bool m_write_stop = false;
+    std::thread m_write_thread;
+
+    std::unique_ptr<CRCTOutputFile> m_rct_file;
+    //! Outputs are only erased under cs_main, readers racing an erase must hold it too
+    CRCTOutputCache m_rct_cache{DEFAULT_RCTCACHESIZE << 20};
+    CKeyImageFilter m_ki_filter;
 };
 
 #endif // BITCOIN_TXDB_H
@@ -0,0 +1,78 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_TXLOOKUPCACHE_H
+#define BITCOINC_TXLOOKUPCACHE_H
+
+#include <primitives/transaction.h>
+#include <shardedcache.h>
+#include <uint256.h>
+
+#include <stdint.h>
+
+//! -txlookupcachesize default (MiB)
+static const int64_t DEFAULT_TXLOOKUPCACHESIZE = 4;
+//! max. -txlookupcachesize (MiB)
+static const int64_t MAX_TXLOOKUPCACHESIZE = 1024;
+static const size_t TX_LOOKUP_CACHE_SHARDS = 8;
+
+//! A confirmed transaction and the block it was found in
+struct CTxLookupEntry
+{
+    CTransactionRef tx;
+    uint256 hashBlock;
+};
+
+struct CTxLookupEntryUsage
+{
+    //! The shared CTransaction and its serialized body
+    static size_t TxUsage(const CTransaction &tx)
+    {
+        return memusage::MallocUsage(sizeof(CTransaction) + 2 * sizeof(int)) + tx.GetTotalSize();
+    };
+    size_t operator()(const CTxLookupEntry &e) const { return TxUsage(*e.tx); };
+};
+
+struct CheapTxidHasher
+{
+    size_t operator()(const uint256 &txid) const { return txid.GetCheapHash(); };
+};
+
+/**
+ * Bounded LRU cache of confirmed transactions recently returned by GetTransaction,
+ * in front of the txindex and block files.
+ *
+ * Entries are charged by the serialized size of the transaction, a close
+ * enough proxy for the heap used by the outputs of any transaction type.
+ * Entries don't follow reorgs, callers must check hashBlock is still in the
+ * active chain on a hit.
+ */
+class CTxLookupCache : public CShardedCache<uint256, CTxLookupEntry, CheapTxidHasher, CTxLookupEntryUsage>
+{
+public:
+    explicit CTxLookupCache(size_t nMaxBytes)
+        : CShardedCache(nMaxBytes, TX_LOOKUP_CACHE_SHARDS) {};
+
+    bool Get(const uint256 &txid, CTransactionRef &tx, uint256 &hashBlock)
+    {
+        CTxLookupEntry e;
+        if (!CShardedCache::Get(txid, e))
+            return false;
+        tx = e.tx;
+        hashBlock = e.hashBlock;
+        return true;
+    };
+
+    void Insert(const CTransactionRef &tx, const uint256 &hashBlock)
+    {
+        CShardedCache::Insert(tx->GetHash(), CTxLookupEntry{tx, hashBlock});
+    };
+
+    static size_t EntryUsage(const CTransaction &tx)
+    {
+        return EntryOverhead() + CTxLookupEntryUsage::TxUsage(tx);
+    };
+};
+
+#endif // BITCOINC_TXLOOKUPCACHE_H
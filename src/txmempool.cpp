@@ -28,6 +28,7 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
     spendsCoinbase(_spendsCoinbase), sigOpCost(_sigOpsCost), lockPoints(lp)
 {
     nTxWeight = GetTransactionWeight(*tx);
+    nTxSerializeSize = ::GetSerializeSize(*tx, SER_NETWORK, PROTOCOL_VERSION);
     nUsageSize = RecursiveDynamicUsage(tx);
 
     nCountWithDescendants = 1;
@@ -390,7 +391,10 @@ void CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     std::set<uint256> setParentTransactions;
     for (unsigned int i = 0; i < tx.vin.size(); i++) {
         if (tx.vin[i].IsAnonInput())
+        {
+            AddKeyImagesToMempool(tx, tx.vin[i], *this);
             continue;
+        };
         mapNextTx.insert(std::make_pair(&tx.vin[i].prevout, &tx));
         setParentTransactions.insert(tx.vin[i].prevout.hash);
     }
@@ -427,7 +431,13 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
     if (!tx.IsBitcoinCVersion())
         return;
 
-    std::vector<CMempoolAddressDeltaKey> inserted;
+    std::vector<std::pair<uint256, int> > inserted;
+    auto insert = [&](const CMempoolAddressDeltaKey &key, const CMempoolAddressDelta &delta) {
+        std::pair<uint256, int> address(key.addressBytes, key.type);
+        mapAddress[address].emplace_back(key, delta);
+        if (std::find(inserted.begin(), inserted.end(), address) == inserted.end())
+            inserted.push_back(address);
+    };
 
     uint256 txhash = tx.GetHash();
     for (unsigned int j = 0; j < tx.vin.size(); j++)
@@ -453,8 +463,7 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
 
         CMempoolAddressDeltaKey key(scriptType, uint256(hashBytes.data(), hashBytes.size()), txhash, j, 1);
         CMempoolAddressDelta delta(entry.GetTime(), nValue * -1, input.prevout.hash, input.prevout.n);
-        mapAddress.insert(std::make_pair(key, delta));
-        inserted.push_back(key);
+        insert(key, delta);
     };
 
     for (unsigned int k = 0; k < tx.vpout.size(); k++)
@@ -479,8 +488,7 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
             continue;
 
         CMempoolAddressDeltaKey key(scriptType, uint256(hashBytes.data(), hashBytes.size()), txhash, k, 0);
-        mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), nValue)));
-        inserted.push_back(key);
+        insert(key, CMempoolAddressDelta(entry.GetTime(), nValue));
     };
 
     mapAddressInserted.insert(std::make_pair(txhash, inserted));
@@ -490,11 +498,10 @@ bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint256, int> > &addresse
                                  std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results)
 {
     LOCK(cs);
-    for (std::vector<std::pair<uint256, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        addressDeltaMap::iterator ait = mapAddress.lower_bound(CMempoolAddressDeltaKey((*it).second, (*it).first));
-        while (ait != mapAddress.end() && (*ait).first.addressBytes == (*it).first && (*ait).first.type == (*it).second) {
-            results.push_back(*ait);
-            ait++;
+    for (const auto &address : addresses) {
+        addressDeltaMap::const_iterator ait = mapAddress.find(address);
+        if (ait != mapAddress.end()) {
+            results.insert(results.end(), ait->second.begin(), ait->second.end());
         }
     }
     return true;
@@ -506,9 +513,24 @@ bool CTxMemPool::removeAddressIndex(const uint256 txhash)
     addressDeltaMapInserted::iterator it = mapAddressInserted.find(txhash);
 
     if (it != mapAddressInserted.end()) {
-        std::vector<CMempoolAddressDeltaKey> keys = (*it).second;
-        for (std::vector<CMempoolAddressDeltaKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
-            mapAddress.erase(*mit);
+        for (const auto &address : it->second) {
+            addressDeltaMap::iterator ait = mapAddress.find(address);
+            if (ait == mapAddress.end()) {
+                continue;
+            }
+            // Order within an address is not kept, swap the removed deltas out from the back
+            addressDeltaVector &deltas = ait->second;
+            for (size_t i = 0; i < deltas.size();) {
+                if (deltas[i].first.txhash == txhash) {
+                    deltas[i] = std::move(deltas.back());
+                    deltas.pop_back();
+                } else {
+                    ++i;
+                }
+            }
+            if (deltas.empty()) {
+                mapAddress.erase(ait);
+            }
         }
         mapAddressInserted.erase(it);
     }
@@ -807,6 +829,7 @@ void CTxMemPool::_clear()
     mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
+    mapKeyImages.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
@@ -863,7 +886,19 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         int64_t parentSigOpCost = 0;
         for (const CTxIn &txin : tx.vin) {
             if (txin.IsAnonInput())
+            {
+                // Check whether its key images are marked in mapKeyImages.
+                uint32_t nInputs, nRingSize;
+                txin.GetAnonInfo(nInputs, nRingSize);
+                const std::vector<uint8_t> &vKeyImages = txin.scriptData.stack[0];
+                for (size_t k = 0; k < nInputs; ++k)
+                {
+                    auto itKI = mapKeyImages.find(*((CCmpPubKey*)&vKeyImages[k*33]));
+                    assert(itKI != mapKeyImages.end());
+                    assert(itKI->second == &tx);
+                };
                 continue;
+            };
             // Check that every mempool transaction's inputs refer to available coins, or other mempool tx's.
             indexed_transaction_set::const_iterator it2 = mapTx.find(txin.prevout.hash);
             if (it2 != mapTx.end()) {
@@ -954,6 +989,9 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         assert(it2 != mapTx.end());
         assert(&tx == it->second);
     }
+    for (auto it = mapKeyImages.cbegin(); it != mapKeyImages.cend(); it++) {
+        assert(mapTx.count(it->second->GetHash()));
+    }
 
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
@@ -1103,12 +1141,11 @@ bool CTxMemPool::HaveKeyImage(const CCmpPubKey &ki, uint256 &hash) const
 {
     LOCK(cs);
 
-    std::map<CCmpPubKey, uint256>::const_iterator mi;
-    mi = mapKeyImages.find(ki);
+    auto mi = mapKeyImages.find(ki);
 
     if (mi != mapKeyImages.end())
     {
-        hash = mi->second;
+        hash = mi->second->GetHash();
         return true;
     };
 
@@ -1165,7 +1202,7 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapKeyImages) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
@@ -1347,3 +1384,9 @@ void CTxMemPool::GetTransactionAncestry(const uint256& txid, size_t& ancestors,
 }
 
 SaltedTxidHasher::SaltedTxidHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+SaltedKeyImageHasher::SaltedKeyImageHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+SaltedAddressHasher::SaltedAddressHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+SaltedSpentIndexKeyHasher::SaltedSpentIndexKeyHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
@@ -9,6 +9,7 @@
 #include <memory>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 #include <string>
@@ -18,9 +19,11 @@
 #include <insight/spentindex.h>
 #include <amount.h>
 #include <coins.h>
+#include <hash.h>
 #include <indirectmap.h>
 #include <policy/feerate.h>
 #include <primitives/transaction.h>
+#include <pubkey.h>
 #include <sync.h>
 #include <random.h>
 
@@ -77,6 +80,7 @@ private:
     CTransactionRef tx;
     CAmount nFee;              //!< Cached to avoid expensive parent-transaction lookups
     size_t nTxWeight;          //!< ... and avoid recomputing tx weight (also used for GetTxSize())
+    size_t nTxSerializeSize;   //!< ... and serialized size, large for confidential txns
     size_t nUsageSize;         //!< ... and total memory usage
     int64_t nTime;             //!< Local time when entering the mempool
     unsigned int entryHeight;  //!< Chain height when entering the mempool
@@ -109,6 +113,7 @@ public:
     const CAmount& GetFee() const { return nFee; }
     size_t GetTxSize() const;
     size_t GetTxWeight() const { return nTxWeight; }
+    size_t GetTxSerializeSize() const { return nTxSerializeSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return entryHeight; }
     int64_t GetSigOpCost() const { return sigOpCost; }
@@ -375,6 +380,49 @@ public:
     }
 };
 
+/** Hashes the (address hash, address type) keys of the mempool address index */
+class SaltedKeyImageHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedKeyImageHasher();
+
+    size_t operator()(const CCmpPubKey& ki) const {
+        return CSipHasher(k0, k1).Write(ki.begin(), ki.size()).Finalize();
+    }
+};
+
+class SaltedAddressHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedAddressHasher();
+
+    size_t operator()(const std::pair<uint256, int>& address) const {
+        return SipHashUint256Extra(k0, k1, address.first, address.second);
+    }
+};
+
+class SaltedSpentIndexKeyHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedSpentIndexKeyHasher();
+
+    size_t operator()(const CSpentIndexKey& key) const {
+        return SipHashUint256Extra(k0, k1, key.txid, key.outputIndex);
+    }
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain transactions
  * that may be included in the next block.
@@ -520,16 +568,19 @@ private:
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
     txlinksMap mapLinks;
 
-    typedef std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> addressDeltaMap;
+    //! Deltas grouped by (address hash, address type), in no particular order.
+    typedef std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > addressDeltaVector;
+    typedef std::unordered_map<std::pair<uint256, int>, addressDeltaVector, SaltedAddressHasher> addressDeltaMap;
     addressDeltaMap mapAddress;
 
-    typedef std::map<uint256, std::vector<CMempoolAddressDeltaKey> > addressDeltaMapInserted;
+    //! Addresses touched by each transaction, once each.
+    typedef std::unordered_map<uint256, std::vector<std::pair<uint256, int> >, SaltedTxidHasher> addressDeltaMapInserted;
     addressDeltaMapInserted mapAddressInserted;
 
-    typedef std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mapSpentIndex;
+    typedef std::unordered_map<CSpentIndexKey, CSpentIndexValue, SaltedSpentIndexKeyHasher> mapSpentIndex;
     mapSpentIndex mapSpent;
 
-    typedef std::map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
+    typedef std::unordered_map<uint256, std::vector<CSpentIndexKey>, SaltedTxidHasher> mapSpentIndexInserted;
     mapSpentIndexInserted mapSpentInserted;
 
     void UpdateParent(txiter entry, txiter parent, bool add);
@@ -541,7 +592,9 @@ public:
     indirectmap<COutPoint, const CTransaction*> mapNextTx GUARDED_BY(cs);
     std::map<uint256, CAmount> mapDeltas;
 
-    std::map<CCmpPubKey, uint256> mapKeyImages;
+    /** Key images spent by in-mempool anon inputs, pointing into mapTx like mapNextTx.
+     *  Counted in DynamicMemoryUsage so -maxmempool bounds it. */
+    std::unordered_map<CCmpPubKey, const CTransaction*, SaltedKeyImageHasher> mapKeyImages GUARDED_BY(cs);
 
 
     /** Create a new CTxMemPool.
@@ -103,11 +103,23 @@ class CBlockUndo
 public:
     std::vector<CTxUndo> vtxundo; // for all but the coinbase
 
+    /** RCT state added by the block, present when the block index has BLOCK_HAVE_RCT_UNDO.
+     *  Not serialized itself, records written by older versions end after vtxundo. */
+    bool fHaveRCT = false;
+    int64_t nFirstRCTOutput = 0;
+    int64_t nLastRCTOutput = 0; // nFirstRCTOutput - 1 if the block added no anon outputs
+    std::vector<CCmpPubKey> vKeyImages;
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action) {
         READWRITE(vtxundo);
+        if (fHaveRCT) {
+            READWRITE(nFirstRCTOutput);
+            READWRITE(nLastRCTOutput);
+            READWRITE(vKeyImages);
+        }
     }
 };
 
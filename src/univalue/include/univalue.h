@@ -26,6 +26,10 @@ public:
         typ = initialType;
         val = initialStr;
     }
+    UniValue(UniValue::VType initialType, std::string&& initialStr) {
+        typ = initialType;
+        val = std::move(initialStr);
+    }
     UniValue(uint64_t val_) {
         setInt(val_);
     }
@@ -44,10 +48,19 @@ public:
     UniValue(const std::string& val_) {
         setStr(val_);
     }
+    UniValue(std::string&& val_) {
+        setStr(std::move(val_));
+    }
     UniValue(const char *val_) {
         std::string s(val_);
         setStr(s);
     }
+    // Declared explicitly so the destructor doesn't suppress the moves,
+    // containers holding UniValues would otherwise deep copy on growth.
+    UniValue(const UniValue&) = default;
+    UniValue(UniValue&&) = default;
+    UniValue& operator=(const UniValue&) = default;
+    UniValue& operator=(UniValue&&) = default;
     ~UniValue() {}
 
     void clear();
@@ -60,6 +73,7 @@ public:
     bool setInt(int val_) { return setInt((int64_t)val_); }
     bool setFloat(double val);
     bool setStr(const std::string& val);
+    bool setStr(std::string&& val);
     bool setArray();
     bool setObject();
 
@@ -68,6 +82,8 @@ public:
     bool empty() const { return (values.size() == 0); }
 
     size_t size() const { return values.size(); }
+    // Preallocate room for n array values or object members
+    void reserve(size_t n);
 
     bool getBool() const { return isTrue(); }
     void getObjMap(std::map<std::string,UniValue>& kv) const;
@@ -90,64 +106,63 @@ public:
     bool isObject() const { return (typ == VOBJ); }
 
     bool push_back(const UniValue& val);
+    bool push_back(UniValue&& val);
     bool insert(size_t pos, const UniValue& val_);
     bool erase(size_t from, size_t to);
 
     bool push_back(const std::string& val_) {
-        UniValue tmpVal(VSTR, val_);
-        return push_back(tmpVal);
+        return push_back(UniValue(VSTR, val_));
+    }
+    bool push_back(std::string&& val_) {
+        return push_back(UniValue(VSTR, std::move(val_)));
     }
     bool push_back(const char *val_) {
-        std::string s(val_);
-        return push_back(s);
+        return push_back(UniValue(VSTR, std::string(val_)));
     }
     bool push_back(uint64_t val_) {
-        UniValue tmpVal(val_);
-        return push_back(tmpVal);
+        return push_back(UniValue(val_));
     }
     bool push_back(int64_t val_) {
-        UniValue tmpVal(val_);
-        return push_back(tmpVal);
+        return push_back(UniValue(val_));
     }
     bool push_back(int val_) {
-        UniValue tmpVal(val_);
-        return push_back(tmpVal);
+        return push_back(UniValue(val_));
     }
     bool push_back(double val_) {
-        UniValue tmpVal(val_);
-        return push_back(tmpVal);
+        return push_back(UniValue(val_));
     }
     bool push_backV(const std::vector<UniValue>& vec);
 
     void __pushKV(const std::string& key, const UniValue& val);
+    void __pushKV(std::string&& key, UniValue&& val);
+    // Append a member without looking for an existing one with the same key,
+    // for builders that know their keys are unique. Returns false if not an object.
+    bool pushKVEnd(std::string key, UniValue val);
     bool pushKV(const std::string& key, const UniValue& val);
+    bool pushKV(const std::string& key, UniValue&& val);
     bool pushKV(const std::string& key, const std::string& val_) {
-        UniValue tmpVal(VSTR, val_);
-        return pushKV(key, tmpVal);
+        return pushKV(key, UniValue(VSTR, val_));
+    }
+    bool pushKV(const std::string& key, std::string&& val_) {
+        return pushKV(key, UniValue(VSTR, std::move(val_)));
     }
     bool pushKV(const std::string& key, const char *val_) {
-        std::string _val(val_);
-        return pushKV(key, _val);
+        return pushKV(key, UniValue(VSTR, std::string(val_)));
     }
     bool pushKV(const std::string& key, int64_t val_) {
-        UniValue tmpVal(val_);
-        return pushKV(key, tmpVal);
+        return pushKV(key, UniValue(val_));
     }
     bool pushKV(const std::string& key, uint64_t val_) {
-        UniValue tmpVal(val_);
-        return pushKV(key, tmpVal);
+        return pushKV(key, UniValue(val_));
     }
     bool pushKV(const std::string& key, bool val_) {
-        UniValue tmpVal((bool)val_);
-        return pushKV(key, tmpVal);
+        return pushKV(key, UniValue((bool)val_));
     }
     bool pushKV(const std::string& key, int val_) {
-        UniValue tmpVal((int64_t)val_);
-        return pushKV(key, tmpVal);
+        return pushKV(key, UniValue((int64_t)val_));
     }
     bool pushKV(const std::string& key, double val_) {
-        UniValue tmpVal(val_);
-        return pushKV(key, tmpVal);
+        return pushKV(key, UniValue(val_));
     }
     bool pushKVs(const UniValue& obj);
 
@@ -167,6 +182,7 @@ private:
     std::vector<UniValue> values;
 
     bool findKey(const std::string& key, size_t& retIdx) const;
+    void write(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
     void writeArray(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
     void writeObject(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
 
@@ -185,7 +201,7 @@ public:
 
     enum VType type() const { return getType(); }
     bool push_back(std::pair<std::string,UniValue> pear) {
-        return pushKV(pear.first, pear.second);
+        return pushKV(pear.first, std::move(pear.second));
     }
     friend const UniValue& find_value( const UniValue& obj, const std::string& name);
 };
@@ -58,22 +58,21 @@ bool UniValue::setNumStr(const string& val_)
     return true;
 }
 
+// Formatted integers are always valid JSON numbers, skip the stream and the parser
 bool UniValue::setInt(uint64_t val_)
 {
-    ostringstream oss;
-
-    oss << val_;
-
-    return setNumStr(oss.str());
+    clear();
+    typ = VNUM;
+    val = std::to_string(val_);
+    return true;
 }
 
 bool UniValue::setInt(int64_t val_)
 {
-    ostringstream oss;
-
-    oss << val_;
-
-    return setNumStr(oss.str());
+    clear();
+    typ = VNUM;
+    val = std::to_string(val_);
+    return true;
 }
 
 bool UniValue::setFloat(double val_)
@@ -95,6 +94,14 @@ bool UniValue::setStr(const string& val_)
     return true;
 }
 
+bool UniValue::setStr(string&& val_)
+{
+    clear();
+    typ = VSTR;
+    val = std::move(val_);
+    return true;
+}
+
 bool UniValue::setArray()
 {
     clear();
@@ -118,6 +125,22 @@ bool UniValue::push_back(const UniValue& val_)
     return true;
 }
 
+bool UniValue::push_back(UniValue&& val_)
+{
+    if (typ != VARR)
+        return false;
+
+    values.push_back(std::move(val_));
+    return true;
+}
+
+void UniValue::reserve(size_t n)
+{
+    if (typ == VOBJ)
+        keys.reserve(n);
+    values.reserve(n);
+}
+
 bool UniValue::insert(size_t pos, const UniValue& val_)
 {
     if (typ != VARR)
@@ -159,6 +182,21 @@ void UniValue::__pushKV(const std::string& key, const UniValue& val_)
     values.push_back(val_);
 }
 
+void UniValue::__pushKV(std::string&& key, UniValue&& val_)
+{
+    keys.push_back(std::move(key));
+    values.push_back(std::move(val_));
+}
+
+bool UniValue::pushKVEnd(std::string key, UniValue val_)
+{
+    if (typ != VOBJ)
+        return false;
+
+    __pushKV(std::move(key), std::move(val_));
+    return true;
+}
+
 bool UniValue::pushKV(const std::string& key, const UniValue& val_)
 {
     if (typ != VOBJ)
@@ -172,11 +210,26 @@ bool UniValue::pushKV(const std::string& key, const UniValue& val_)
     return true;
 }
 
+bool UniValue::pushKV(const std::string& key, UniValue&& val_)
+{
+    if (typ != VOBJ)
+        return false;
+
+    size_t idx;
+    if (findKey(key, idx))
+        values[idx] = std::move(val_);
+    else
+        __pushKV(std::string(key), std::move(val_));
+    return true;
+}
+
 bool UniValue::pushKVs(const UniValue& obj)
 {
     if (typ != VOBJ || obj.typ != VOBJ)
         return false;
 
+    keys.reserve(keys.size() + obj.keys.size());
+    values.reserve(values.size() + obj.values.size());
     for (size_t i = 0; i < obj.keys.size(); i++)
         __pushKV(obj.keys[i], obj.values.at(i));
 
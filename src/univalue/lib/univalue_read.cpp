@@ -15,6 +15,58 @@ static bool json_isdigit(int ch)
     return ((ch >= '0') && (ch <= '9'));
 }
 
+// Read 8 bytes, for scanning a word at a time
+static inline uint64_t load64(const char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static const uint64_t ONES64 = 0x0101010101010101ULL;
+static const uint64_t HIGHS64 = 0x8080808080808080ULL;
+
+// Nonzero if any byte of v is below n, n <= 128
+static inline uint64_t hasless64(uint64_t v, unsigned char n)
+{
+    return (v - ONES64 * n) & ~v & HIGHS64;
+}
+
+// Nonzero if any byte of v equals ch
+static inline uint64_t hasbyte64(uint64_t v, unsigned char ch)
+{
+    return hasless64(v ^ (ONES64 * ch), 1);
+}
+
+// Skip the longest run of string characters that can be copied as is:
+// printable 7-bit ASCII other than '"' and '\\'
+static const char *skipPlainChars(const char *raw, const char *end)
+{
+    while (end - raw >= 8) {
+        uint64_t v = load64(raw);
+        if ((v & HIGHS64) || hasless64(v, 0x20) || hasbyte64(v, '"') || hasbyte64(v, '\\'))
+            break;
+        raw += 8;
+    }
+    while (raw < end) {
+        unsigned char ch = *raw;
+        if (ch >= 0x80 || ch < 0x20 || ch == '"' || ch == '\\')
+            break;
+        raw++;
+    }
+    return raw;
+}
+
+static const char *skipWhitespace(const char *raw, const char *end)
+{
+    // Indentation of pretty printed input comes in long runs of spaces
+    while (end - raw >= 8 && load64(raw) == ONES64 * ' ')
+        raw += 8;
+    while (raw < end && json_isspace(*raw))
+        raw++;
+    return raw;
+}
+
 // convert hexadecimal string to unsigned integer
 static const char *hatoui(const char *first, const char *last,
                           unsigned int& out)
@@ -50,8 +102,7 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
 
     const char *rawStart = raw;
 
-    while (raw < end && (json_isspace(*raw)))          // skip whitespace
-        raw++;
+    raw = skipWhitespace(raw, end);
 
     if (raw >= end)
         return JTOK_NONE;
@@ -114,8 +165,6 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
     case '8':
     case '9': {
         // part 1: int
-        string numStr;
-
         const char *first = raw;
 
         const char *firstDigit = first;
@@ -124,49 +173,38 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
         if ((*firstDigit == '0') && json_isdigit(firstDigit[1]))
             return JTOK_ERR;
 
-        numStr += *raw;                       // copy first char
-        raw++;
+        raw++;                                // skip first char
 
         if ((*first == '-') && (raw < end) && (!json_isdigit(*raw)))
             return JTOK_ERR;
 
-        while (raw < end && json_isdigit(*raw)) {  // copy digits
-            numStr += *raw;
+        while (raw < end && json_isdigit(*raw))    // skip digits
             raw++;
-        }
 
         // part 2: frac
         if (raw < end && *raw == '.') {
-            numStr += *raw;                   // copy .
-            raw++;
+            raw++;                            // skip .
 
             if (raw >= end || !json_isdigit(*raw))
                 return JTOK_ERR;
-            while (raw < end && json_isdigit(*raw)) { // copy digits
-                numStr += *raw;
+            while (raw < end && json_isdigit(*raw)) // skip digits
                 raw++;
-            }
         }
 
         // part 3: exp
         if (raw < end && (*raw == 'e' || *raw == 'E')) {
-            numStr += *raw;                   // copy E
-            raw++;
+            raw++;                            // skip E
 
-            if (raw < end && (*raw == '-' || *raw == '+')) { // copy +/-
-                numStr += *raw;
+            if (raw < end && (*raw == '-' || *raw == '+')) // skip +/-
                 raw++;
-            }
 
             if (raw >= end || !json_isdigit(*raw))
                 return JTOK_ERR;
-            while (raw < end && json_isdigit(*raw)) { // copy digits
-                numStr += *raw;
+            while (raw < end && json_isdigit(*raw)) // skip digits
                 raw++;
-            }
         }
 
-        tokenVal = numStr;
+        tokenVal.assign(first, raw - first);  // copy the number at once
         consumed = (raw - rawStart);
         return JTOK_NUMBER;
         }
@@ -174,10 +212,14 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
     case '"': {
         raw++;                                // skip "
 
-        string valStr;
-        JSONUTF8StringFilter writer(valStr);
+        JSONUTF8StringFilter writer(tokenVal);
 
         while (true) {
+            const char *run = raw;
+            raw = skipPlainChars(raw, end);
+            if (raw != run)
+                writer.append_ascii(run, raw - run);
+
             if (raw >= end || (unsigned char)*raw < 0x20)
                 return JTOK_ERR;
 
@@ -228,7 +270,6 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
 
         if (!writer.finalize())
             return JTOK_ERR;
-        tokenVal = valStr;
         consumed = (raw - rawStart);
         return JTOK_STRING;
         }
@@ -317,9 +358,8 @@ bool UniValue::read(const char *raw, size_t size)
                     setArray();
                 stack.push_back(this);
             } else {
-                UniValue tmpVal(utyp);
                 UniValue *top = stack.back();
-                top->values.push_back(tmpVal);
+                top->values.emplace_back(utyp);
 
                 UniValue *newTop = &(top->values.back());
                 stack.push_back(newTop);
@@ -391,26 +431,26 @@ bool UniValue::read(const char *raw, size_t size)
             }
 
             if (!stack.size()) {
-                *this = tmpVal;
+                *this = std::move(tmpVal);
                 break;
             }
 
             UniValue *top = stack.back();
-            top->values.push_back(tmpVal);
+            top->values.push_back(std::move(tmpVal));
 
             setExpect(NOT_VALUE);
             break;
             }
 
         case JTOK_NUMBER: {
-            UniValue tmpVal(VNUM, tokenVal);
+            UniValue tmpVal(VNUM, std::move(tokenVal));
             if (!stack.size()) {
-                *this = tmpVal;
+                *this = std::move(tmpVal);
                 break;
             }
 
             UniValue *top = stack.back();
-            top->values.push_back(tmpVal);
+            top->values.push_back(std::move(tmpVal));
 
             setExpect(NOT_VALUE);
             break;
@@ -419,17 +459,17 @@ bool UniValue::read(const char *raw, size_t size)
         case JTOK_STRING: {
             if (expect(OBJ_NAME)) {
                 UniValue *top = stack.back();
-                top->keys.push_back(tokenVal);
+                top->keys.push_back(std::move(tokenVal));
                 clearExpect(OBJ_NAME);
                 setExpect(COLON);
             } else {
-                UniValue tmpVal(VSTR, tokenVal);
+                UniValue tmpVal(VSTR, std::move(tokenVal));
                 if (!stack.size()) {
-                    *this = tmpVal;
+                    *this = std::move(tmpVal);
                     break;
                 }
                 UniValue *top = stack.back();
-                top->values.push_back(tmpVal);
+                top->values.push_back(std::move(tmpVal));
             }
 
             setExpect(NOT_VALUE);
@@ -17,6 +17,14 @@ public:
         str(s), is_valid(true), codepoint(0), state(0), surpair(0)
     {
     }
+    // Write a run of 7-bit ASCII chars
+    void append_ascii(const char *s, size_t n)
+    {
+        if (state == 0)
+            str.append(s, n);
+        else // Not a continuation, invalid
+            is_valid = false;
+    }
     // Write single 8-bit char (may be part of UTF-8 sequence)
     void push_back(unsigned char ch)
     {
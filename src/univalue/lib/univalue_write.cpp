@@ -10,22 +10,19 @@
 
 using namespace std;
 
-static string json_escape(const string& inS)
+static void json_escape(const string& inS, string& outS)
 {
-    string outS;
-    outS.reserve(inS.size() * 2);
-
-    for (unsigned int i = 0; i < inS.size(); i++) {
-        unsigned char ch = inS[i];
-        const char *escStr = escapes[ch];
-
-        if (escStr)
-            outS += escStr;
-        else
-            outS += ch;
+    // Append runs of characters that need no escaping in one go
+    const char *p = inS.data(), *end = p + inS.size(), *run = p;
+    for (; p < end; p++) {
+        const char *escStr = escapes[(unsigned char)*p];
+        if (!escStr)
+            continue;
+        outS.append(run, p - run);
+        outS += escStr;
+        run = p + 1;
     }
-
-    return outS;
+    outS.append(run, p - run);
 }
 
 string UniValue::write(unsigned int prettyIndent,
@@ -33,7 +30,13 @@ string UniValue::write(unsigned int prettyIndent,
 {
     string s;
     s.reserve(1024);
+    write(prettyIndent, indentLevel, s);
+    return s;
+}
 
+void UniValue::write(unsigned int prettyIndent,
+                     unsigned int indentLevel, string& s) const
+{
     unsigned int modIndent = indentLevel;
     if (modIndent == 0)
         modIndent = 1;
@@ -49,7 +52,9 @@ string UniValue::write(unsigned int prettyIndent,
         writeArray(prettyIndent, modIndent, s);
         break;
     case VSTR:
-        s += "\"" + json_escape(val) + "\"";
+        s += '"';
+        json_escape(val, s);
+        s += '"';
         break;
     case VNUM:
         s += val;
@@ -58,8 +63,6 @@ string UniValue::write(unsigned int prettyIndent,
         s += (val == "1" ? "true" : "false");
         break;
     }
-
-    return s;
 }
 
 static void indentStr(unsigned int prettyIndent, unsigned int indentLevel, string& s)
@@ -76,7 +79,7 @@ void UniValue::writeArray(unsigned int prettyIndent, unsigned int indentLevel, s
     for (unsigned int i = 0; i < values.size(); i++) {
         if (prettyIndent)
             indentStr(prettyIndent, indentLevel, s);
-        s += values[i].write(prettyIndent, indentLevel + 1);
+        values[i].write(prettyIndent, indentLevel + 1, s);
         if (i != (values.size() - 1)) {
             s += ",";
         }
@@ -98,10 +101,12 @@ void UniValue::writeObject(unsigned int prettyIndent, unsigned int indentLevel,
     for (unsigned int i = 0; i < keys.size(); i++) {
         if (prettyIndent)
             indentStr(prettyIndent, indentLevel, s);
-        s += "\"" + json_escape(keys[i]) + "\":";
+        s += '"';
+        json_escape(keys[i], s);
+        s += "\":";
         if (prettyIndent)
             s += " ";
-        s += values.at(i).write(prettyIndent, indentLevel + 1);
+        values.at(i).write(prettyIndent, indentLevel + 1, s);
         if (i != (values.size() - 1))
             s += ",";
         if (prettyIndent)
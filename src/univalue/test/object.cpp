@@ -393,6 +393,75 @@ BOOST_AUTO_TEST_CASE(univalue_readwrite)
     BOOST_CHECK(!v.read("{} 42"));
 }
 
+BOOST_AUTO_TEST_CASE(univalue_pushkvend)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.reserve(4);
+    BOOST_CHECK(obj.pushKVEnd("age", 100));
+    BOOST_CHECK(obj.pushKVEnd("first", "John"));
+
+    UniValue arr(UniValue::VARR);
+    arr.reserve(2);
+    BOOST_CHECK(arr.push_back(std::string("a")));
+    BOOST_CHECK(arr.push_back(UniValue(UniValue::VOBJ)));
+    BOOST_CHECK(obj.pushKVEnd("list", std::move(arr)));
+
+    // Unchecked, the key is appended a second time
+    BOOST_CHECK(obj.pushKVEnd("age", 101));
+    BOOST_CHECK_EQUAL(obj.size(), 4);
+    BOOST_CHECK_EQUAL(obj.write(), "{\"age\":100,\"first\":\"John\",\"list\":[\"a\",{}],\"age\":101}");
+
+    // pushKV still replaces
+    UniValue str(UniValue::VSTR, std::string("Smith"));
+    BOOST_CHECK(obj.pushKV("first", std::move(str)));
+    BOOST_CHECK_EQUAL(obj["first"].getValStr(), "Smith");
+    BOOST_CHECK_EQUAL(obj.size(), 4);
+
+    UniValue notObj(UniValue::VARR);
+    BOOST_CHECK(!notObj.pushKVEnd("key", 1));
+    BOOST_CHECK(!notObj.pushKV("key", UniValue(1)));
+    BOOST_CHECK(!obj.push_back(UniValue(1)));
+}
+
+BOOST_AUTO_TEST_CASE(univalue_readwrite_long)
+{
+    // Plain runs of varying length around escapes and multibyte chars
+    std::string s;
+    for (int i = 0; i < 40; i++) {
+        s += std::string(i, 'x');
+        switch (i % 4) {
+        case 0: s += '"'; break;
+        case 1: s += '\\'; break;
+        case 2: s += '\n'; break;
+        case 3: s += "\xc3\xa9"; break;
+        }
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV(s, s);
+    obj.pushKV("n", (int64_t)-12345678901234LL);
+    obj.pushKV("arr", UniValue(UniValue::VARR));
+
+    for (unsigned int indent = 0; indent < 3; indent++) {
+        std::string json = obj.write(indent);
+        UniValue v;
+        BOOST_CHECK(v.read(json));
+        BOOST_CHECK_EQUAL(v[s].getValStr(), s);
+        BOOST_CHECK_EQUAL(v["n"].getValStr(), "-12345678901234");
+        BOOST_CHECK_EQUAL(v.write(indent), json);
+    }
+
+    UniValue v;
+    BOOST_CHECK(v.read("                    [                  1e+5 ,\"abcdefghijklmnop\\u00e9\"]"));
+    BOOST_CHECK_EQUAL(v[0].getValStr(), "1e+5");
+    BOOST_CHECK_EQUAL(v[1].getValStr(), "abcdefghijklmnop\xc3\xa9");
+
+    // Control chars and broken UTF-8 inside a long plain run still fail
+    BOOST_CHECK(!v.read("[\"abcdefghijkl\x01mnopqrstuv\"]"));
+    BOOST_CHECK(!v.read("[\"abcdefghijkl\xc3mnopqrstuv\"]"));
+    BOOST_CHECK(!v.read("[\"abcdefghijklmnopqrstuv"));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 int main (int argc, char *argv[])
@@ -403,6 +472,8 @@ int main (int argc, char *argv[])
     univalue_array();
     univalue_object();
     univalue_readwrite();
+    univalue_pushkvend();
+    univalue_readwrite_long();
     return 0;
 }
 
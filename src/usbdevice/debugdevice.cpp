@@ -135,4 +135,55 @@ int CDebugDevice::SignTransaction(const std::vector<uint32_t> &vPath, const std:
     return 0;
 };
 
+int CDebugDevice::SignTransactionBatch(const CMutableTransaction *tx, std::vector<CDeviceSignRequest> &vRequests, std::string &sError)
+{
+    // Hash the prevouts, sequences and outputs once for all inputs
+    PrecomputedTransactionData txdata(*tx);
+
+    // Inputs of a batch mostly share a chain, keep the last parent derived
+    std::vector<uint32_t> vParentPath;
+    CExtKey ekParent;
+    bool fHaveParent = false;
+
+    for (auto &r : vRequests) {
+        if (r.vPath.empty()) {
+            return errorN(1, sError, __func__, "Empty path");
+        }
+        std::vector<uint32_t> vPathParent(r.vPath.begin(), r.vPath.end() - 1);
+        if (!fHaveParent || vPathParent != vParentPath) {
+            CExtKey vkOut, vkWork = ekv;
+            for (auto it = vPathParent.begin(); it != vPathParent.end(); ++it) {
+                if (!vkWork.Derive(vkOut, *it)) {
+                    return errorN(1, sError, __func__, "CExtKey Derive failed");
+                }
+                vkWork = vkOut;
+            }
+            ekParent = vkWork;
+            vParentPath = std::move(vPathParent);
+            fHaveParent = true;
+        }
+
+        CExtKey vkOut;
+        if (!ekParent.Derive(vkOut, r.vPath.back())) {
+            return errorN(1, sError, __func__, "CExtKey Derive failed");
+        }
+
+        CKey key = vkOut.key;
+        if (r.vSharedSecret.size() == 32) {
+            key = key.Add(r.vSharedSecret.data());
+            if (!key.IsValid()) {
+                return errorN(1, sError, __func__, "Add failed");
+            }
+        }
+
+        uint256 hash = SignatureHash(r.scriptCode, *tx, r.nIn, r.hashType, r.amount, r.sigversion, &txdata);
+        if (!key.Sign(hash, r.vchSig)) {
+            return errorN(1, sError, __func__, "Sign failed");
+        }
+        r.vchSig.push_back((unsigned char)r.hashType);
+    }
+
+    return 0;
+};
+
 } // usb_device
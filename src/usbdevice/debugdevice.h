@@ -31,6 +31,8 @@ public:
         int nIn, const CScript &scriptCode, int hashType, const std::vector<uint8_t> &amount, SigVersion sigversion,
         std::vector<uint8_t> &vchSig, std::string &sError) override;
 
+    int SignTransactionBatch(const CMutableTransaction *tx, std::vector<CDeviceSignRequest> &vRequests, std::string &sError) override;
+
     CExtKey ekv;
 };
 
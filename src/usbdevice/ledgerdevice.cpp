@@ -95,27 +95,12 @@ int CLedgerDevice::Open()
         return 1;
     }
 
-    if (hid_init()) {
-        return 1;
-    }
-
-    if (!(handle = hid_open_path(cPath))) {
-        hid_exit();
-        return 1;
-    }
-
-    return 0;
+    return OpenHID();
 };
 
 int CLedgerDevice::Close()
 {
-    if (handle) {
-        hid_close(handle);
-    }
-    handle = nullptr;
-
-    hid_exit();
-    return 0;
+    return CloseHID();
 };
 
 int CLedgerDevice::GetFirmwareVersion(std::string &sFirmware, std::string &sError)
@@ -618,132 +603,154 @@ int CLedgerDevice::PrepareTransaction(const CMutableTransaction *tx, const CCoin
     return 0;
 };
 
-int CLedgerDevice::SignTransaction(const std::vector<uint32_t> &vPath, const std::vector<uint8_t> &vSharedSecret, const CMutableTransaction *tx,
-    int nIn, const CScript &scriptCode, int hashType, const std::vector<uint8_t>& amount, SigVersion sigversion,
-    std::vector<uint8_t> &vchSig, std::string &sError)
-{
-    if (!handle) {
-        return errorN(1, sError, __func__, "Device not open.");
-    }
-    int result, sw;
-    uint8_t in[260];
-    uint8_t out[260];
-    size_t apduSize = 0;
-
-    const auto &txin = tx->vin[nIn];
+typedef std::vector<uint8_t> Apdu;
 
-    // startUntrustedTransaction
-    apduSize = 0;
-    in[apduSize++] = BTCHIP_CLA;
-    in[apduSize++] = BTCHIP_INS_HASH_INPUT_START;
-    in[apduSize++] = 0x00;
-    in[apduSize++] = 0x80; // !newTransaction
-    in[apduSize++] = 4 + 1; // GetSizeOfVarInt(1);
+static Apdu &NewApdu(std::vector<Apdu> &vApdus, uint8_t ins, uint8_t p1, uint8_t p2)
+{
+    vApdus.emplace_back();
+    Apdu &apdu = vApdus.back();
+    apdu.reserve(260);
+    apdu.push_back(BTCHIP_CLA);
+    apdu.push_back(ins);
+    apdu.push_back(p1);
+    apdu.push_back(p2);
+    apdu.push_back(0x00); // length, set by EndApdu
+    return apdu;
+}
 
-    in[apduSize++] = tx->nVersion;
-    in[apduSize++] = 0x00;
-    in[apduSize++] = 0x00;
-    in[apduSize++] = 0x00;
-    apduSize += PutVarInt(&in[apduSize], 1);
+static void EndApdu(Apdu &apdu)
+{
+    apdu[4] = apdu.size() - 5;
+}
 
-    result = sendApduHidHidapi(handle, 1, in, apduSize, out, sizeof(out), &sw);
-    if (sw != SW_OK) {
-        return errorN(1, sError, __func__, "Dongle error: %.4x %s", sw, GetLedgerString(sw));
+/**
+ * Append the exchange signing one input: startUntrustedTransaction with the single input and its
+ * scriptCode, then untrustedHashSign, whose response is the signature.
+ */
+static int AppendSignApdus(std::vector<Apdu> &vApdus, const CMutableTransaction *tx, const CDeviceSignRequest &r, std::string &sError)
+{
+    if (r.nIn < 0 || r.nIn >= (int)tx->vin.size()) {
+        return errorN(1, sError, __func__, "Input %d out of range.", r.nIn);
     }
-
-    apduSize = 0;
-    in[apduSize++] = BTCHIP_CLA;
-    in[apduSize++] = BTCHIP_INS_HASH_INPUT_START;
-    in[apduSize++] = 0x80;
-    in[apduSize++] = 0x00;
-    size_t ofslen = apduSize++;
-
-    in[apduSize++] = 0x02; // segwit
-    if (amount.size() != 8) {
+    if (r.amount.size() != 8) {
         return errorN(1, sError, __func__, "amount must be 8 bytes.");
     }
+    const auto &txin = tx->vin[r.nIn];
+    uint8_t tmp[9];
 
-    memcpy(&in[apduSize], txin.prevout.hash.begin(), 32);
-    apduSize += 32;
-    memcpy(&in[apduSize], &txin.prevout.n, 4);
-    apduSize += 4;
-    memcpy(&in[apduSize], amount.data(), amount.size());
-    apduSize += amount.size();
-
-    apduSize += PutVarInt(&in[apduSize], scriptCode.size());
-
-    in[ofslen] = apduSize - (ofslen+1);
-
-    result = sendApduHidHidapi(handle, 1, in, apduSize, out, sizeof(out), &sw);
-    if (sw != SW_OK) {
-        return errorN(1, sError, __func__, "Dongle error: %.4x %s", sw, GetLedgerString(sw));
-    }
+    // startUntrustedTransaction
+    Apdu *apdu = &NewApdu(vApdus, BTCHIP_INS_HASH_INPUT_START, 0x00, 0x80); // !newTransaction
+    apdu->push_back(tx->nVersion);
+    apdu->push_back(0x00);
+    apdu->push_back(0x00);
+    apdu->push_back(0x00);
+    apdu->insert(apdu->end(), tmp, tmp + PutVarInt(tmp, 1));
+    EndApdu(*apdu);
+
+    apdu = &NewApdu(vApdus, BTCHIP_INS_HASH_INPUT_START, 0x80, 0x00);
+    apdu->push_back(0x02); // segwit
+    apdu->insert(apdu->end(), txin.prevout.hash.begin(), txin.prevout.hash.end());
+    apdu->insert(apdu->end(), (const uint8_t*)&txin.prevout.n, (const uint8_t*)&txin.prevout.n + 4);
+    apdu->insert(apdu->end(), r.amount.begin(), r.amount.end());
+    apdu->insert(apdu->end(), tmp, tmp + PutVarInt(tmp, r.scriptCode.size()));
+    EndApdu(*apdu);
 
     size_t offset = 0;
     const size_t blockLength = 255;
-    while(offset < scriptCode.size()) {
-        size_t dataLength = (offset + blockLength) < scriptCode.size()
-            ? blockLength : scriptCode.size() - offset;
+    while (offset < r.scriptCode.size()) {
+        size_t dataLength = (offset + blockLength) < r.scriptCode.size()
+            ? blockLength : r.scriptCode.size() - offset;
 
-        apduSize = 0;
-        in[apduSize++] = BTCHIP_CLA;
-        in[apduSize++] = BTCHIP_INS_HASH_INPUT_START;
-        in[apduSize++] = 0x80;
-        in[apduSize++] = 0x00;
-        size_t ofslen = apduSize++;
-        memcpy(&in[apduSize], &scriptCode[offset], dataLength);
-        apduSize += dataLength;
+        apdu = &NewApdu(vApdus, BTCHIP_INS_HASH_INPUT_START, 0x80, 0x00);
+        apdu->insert(apdu->end(), r.scriptCode.begin() + offset, r.scriptCode.begin() + offset + dataLength);
 
-        if ((offset + dataLength) == scriptCode.size()) {
-            memcpy(&in[apduSize], &txin.nSequence, 4);
-            apduSize += 4;
-        }
-
-        in[ofslen] = apduSize - (ofslen+1);
-
-        result = sendApduHidHidapi(handle, 1, in, apduSize, out, sizeof(out), &sw);
-        if (sw != SW_OK) {
-            return errorN(1, sError, __func__, "Dongle error: %.4x %s", sw, GetLedgerString(sw));
+        if ((offset + dataLength) == r.scriptCode.size()) {
+            apdu->insert(apdu->end(), (const uint8_t*)&txin.nSequence, (const uint8_t*)&txin.nSequence + 4);
         }
+        EndApdu(*apdu);
         offset += dataLength;
     }
 
     // untrustedHashSign
-
-    apduSize = 0;
-    in[apduSize++] = BTCHIP_CLA;
-    in[apduSize++] = BTCHIP_INS_HASH_SIGN;
-    in[apduSize++] = 0x00;
-    in[apduSize++] = 0x00;
-    ofslen = apduSize++;
-    in[apduSize++] = vPath.size();
-    for (size_t k = 0; k < vPath.size(); k++, apduSize+=4) {
-        WriteBE32(&in[apduSize], vPath[k]);
+    apdu = &NewApdu(vApdus, BTCHIP_INS_HASH_SIGN, 0x00, 0x00);
+    apdu->push_back(r.vPath.size());
+    for (size_t k = 0; k < r.vPath.size(); k++) {
+        WriteBE32(tmp, r.vPath[k]);
+        apdu->insert(apdu->end(), tmp, tmp + 4);
     }
 
-    in[apduSize++] = 0x00; // len(pin)
+    apdu->push_back(0x00); // len(pin)
 
-    WriteBE32(&in[apduSize], tx->nLockTime);
-    apduSize += 4;
-    in[apduSize++] = hashType;
-    in[apduSize++] = vSharedSecret.size();
-    if (vSharedSecret.size() > 0) {
-        memcpy(&in[apduSize], vSharedSecret.data(), vSharedSecret.size());
-        apduSize += vSharedSecret.size();
+    WriteBE32(tmp, tx->nLockTime);
+    apdu->insert(apdu->end(), tmp, tmp + 4);
+    apdu->push_back(r.hashType);
+    apdu->push_back(r.vSharedSecret.size());
+    apdu->insert(apdu->end(), r.vSharedSecret.begin(), r.vSharedSecret.end());
+    EndApdu(*apdu);
+
+    return 0;
+}
+
+int CLedgerDevice::SignTransaction(const std::vector<uint32_t> &vPath, const std::vector<uint8_t> &vSharedSecret, const CMutableTransaction *tx,
+    int nIn, const CScript &scriptCode, int hashType, const std::vector<uint8_t>& amount, SigVersion sigversion,
+    std::vector<uint8_t> &vchSig, std::string &sError)
+{
+    std::vector<CDeviceSignRequest> vRequests(1);
+    CDeviceSignRequest &r = vRequests[0];
+    r.nIn = nIn;
+    r.vPath = vPath;
+    r.vSharedSecret = vSharedSecret;
+    r.scriptCode = scriptCode;
+    r.amount = amount;
+    r.hashType = hashType;
+    r.sigversion = sigversion;
+
+    if (0 != SignTransactionBatch(tx, vRequests, sError)) {
+        return 1;
     }
+    vchSig = std::move(r.vchSig);
 
-    in[ofslen] = apduSize - (ofslen+1);
-    result = sendApduHidHidapi(handle, 1, in, apduSize, out, sizeof(out), &sw);
-    if (sw != SW_OK) {
-        return errorN(1, sError, __func__, "Dongle error: %.4x %s", sw, GetLedgerString(sw));
+    return 0;
+};
+
+int CLedgerDevice::SignTransactionBatch(const CMutableTransaction *tx, std::vector<CDeviceSignRequest> &vRequests, std::string &sError)
+{
+    if (!handle) {
+        return errorN(1, sError, __func__, "Device not open.");
     }
-    if (result < 70) {
-        return errorN(1, sError, __func__, "Bad read length: %d", result);
+
+    // The HID transport is strictly request/response, serialise every exchange up front so the
+    // device never waits on the host between inputs.
+    std::vector<Apdu> vApdus;
+    std::vector<size_t> vSignApdu; // Index of the untrustedHashSign of each request
+    vApdus.reserve(vRequests.size() * 4);
+    vSignApdu.reserve(vRequests.size());
+    for (const auto &r : vRequests) {
+        if (0 != AppendSignApdus(vApdus, tx, r, sError)) {
+            return 1;
+        }
+        vSignApdu.push_back(vApdus.size() - 1);
     }
 
-    out[0] = 0x30; // ?
-    vchSig.resize(result);
-    memcpy(vchSig.data(), out, result);
+    int result, sw;
+    uint8_t out[260];
+    size_t nRequest = 0;
+    for (size_t i = 0; i < vApdus.size(); ++i) {
+        result = sendApduHidHidapi(handle, 1, vApdus[i].data(), vApdus[i].size(), out, sizeof(out), &sw);
+        if (sw != SW_OK) {
+            return errorN(1, sError, __func__, "Dongle error: %.4x %s", sw, GetLedgerString(sw));
+        }
+        if (i != vSignApdu[nRequest]) {
+            continue;
+        }
+        if (result < 70) {
+            return errorN(1, sError, __func__, "Bad read length: %d", result);
+        }
+
+        out[0] = 0x30; // ?
+        vRequests[nRequest].vchSig.assign(out, out + result);
+        nRequest++;
+    }
 
     return 0;
 };
@@ -31,6 +31,8 @@ public:
     int SignTransaction(const std::vector<uint32_t> &vPath, const std::vector<uint8_t> &vSharedSecret, const CMutableTransaction *tx,
         int nIn, const CScript &scriptCode, int hashType, const std::vector<uint8_t> &amount, SigVersion sigversion,
         std::vector<uint8_t> &vchSig, std::string &sError) override;
+
+    int SignTransactionBatch(const CMutableTransaction *tx, std::vector<CDeviceSignRequest> &vRequests, std::string &sError) override;
 };
 
 } // usb_device
@@ -64,6 +64,28 @@ static std::vector<uint32_t> GetPath(std::vector<uint32_t> &vPath, const UniValu
     return vPath;
 };
 
+#ifdef ENABLE_WALLET
+/** Keeps the extended public keys received from devices in the wallet db. */
+class CWalletXPubStore : public usb_device::CDeviceXPubStore
+{
+    CHDWallet *pwallet;
+public:
+    explicit CWalletXPubStore(CHDWallet *pwalletIn) : pwallet(pwalletIn) {};
+
+    bool ReadDeviceXPub(const CKeyID &idDevice, const std::vector<uint32_t> &vPath, CExtPubKey &ekp) override
+    {
+        CHDWalletDB wdb(pwallet->GetDBHandle(), "r");
+        return wdb.ReadDeviceXPub(idDevice, vPath, ekp);
+    };
+
+    bool WriteDeviceXPub(const CKeyID &idDevice, const std::vector<uint32_t> &vPath, const CExtPubKey &ekp) override
+    {
+        CHDWalletDB wdb(pwallet->GetDBHandle(), "r+");
+        return wdb.WriteDeviceXPub(idDevice, vPath, ekp);
+    };
+};
+#endif
+
 static usb_device::CUSBDevice *SelectDevice(std::vector<std::unique_ptr<usb_device::CUSBDevice> > &vDevices)
 {
     std::string sError;
@@ -169,9 +191,18 @@ static UniValue getdevicepublickey(const JSONRPCRequest &request)
     std::vector<std::unique_ptr<usb_device::CUSBDevice> > vDevices;
     usb_device::CUSBDevice *pDevice = SelectDevice(vDevices);
 
+#ifdef ENABLE_WALLET
+    std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
+    CHDWallet *const pwallet = GetBitcoinCWallet(wallet.get());
+    CWalletXPubStore xpubStore(pwallet);
+    if (pwallet) {
+        pDevice->pXPubStore = &xpubStore;
+    }
+#endif
+
     std::string sError;
     CPubKey pk;
-    if (0 != pDevice->GetPubKey(vPath, pk, sError)) {
+    if (0 != pDevice->GetCachedPubKey(vPath, pk, sError)) {
         throw JSONRPCError(RPC_INTERNAL_ERROR, strprintf("GetPubKey failed %s.", sError));
     }
 
@@ -207,9 +238,18 @@ static UniValue getdevicexpub(const JSONRPCRequest &request)
     std::vector<std::unique_ptr<usb_device::CUSBDevice> > vDevices;
     usb_device::CUSBDevice *pDevice = SelectDevice(vDevices);
 
+#ifdef ENABLE_WALLET
+    std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
+    CHDWallet *const pwallet = GetBitcoinCWallet(wallet.get());
+    CWalletXPubStore xpubStore(pwallet);
+    if (pwallet) {
+        pDevice->pXPubStore = &xpubStore;
+    }
+#endif
+
     std::string sError;
     CExtPubKey ekp;
-    if (0 != pDevice->GetXPub(vPath, ekp, sError)) {
+    if (0 != pDevice->GetCachedXPub(vPath, ekp, sError)) {
         throw JSONRPCError(RPC_INTERNAL_ERROR, strprintf("GetXPub failed %s.", sError));
     }
 
@@ -333,6 +373,13 @@ static UniValue devicesignrawtransaction(const JSONRPCRequest &request)
 
     // TODO check root id on wallet and device match
 
+#ifdef ENABLE_WALLET
+    CWalletXPubStore xpubStore(pwallet);
+    if (pwallet) {
+        pDevice->pXPubStore = &xpubStore;
+    }
+#endif
+
 
     // Fetch previous transactions (inputs):
     CCoinsView viewDummy;
@@ -361,7 +408,7 @@ static UniValue devicesignrawtransaction(const JSONRPCRequest &request)
             GetPath(pathkey.vPath, paths[idx], request.params[4]);
 
             std::string sError;
-            if (0 != pDevice->GetPubKey(pathkey.vPath, pathkey.pk, sError)) {
+            if (0 != pDevice->GetCachedPubKey(pathkey.vPath, pathkey.pk, sError)) {
                 throw JSONRPCError(RPC_INTERNAL_ERROR, strprintf("Device GetPubKey failed %s.", sError));
             }
 
@@ -493,7 +540,30 @@ static UniValue devicesignrawtransaction(const JSONRPCRequest &request)
     }
 
 
-    // Sign what we can:
+    // Collect what we can sign, the device signs all inputs in one session
+    std::vector<usb_device::CDeviceSignRequest> vRequests;
+    for (unsigned int i = 0; i < mtx.vin.size(); i++) {
+        const Coin& coin = view.AccessCoin(mtx.vin[i].prevout);
+        if (coin.IsSpent() || coin.nType != OUTPUT_STANDARD
+            || (fHashSingle && i >= mtx.GetNumVOuts())) {
+            continue;
+        }
+
+        std::vector<uint8_t> vchAmount(8);
+        memcpy(vchAmount.data(), &coin.out.nValue, 8);
+        SignatureData sigdata = DataFromTransaction(mtx, i, vchAmount, coin.out.scriptPubKey);
+        ProduceSignature(keystore, usb_device::DeviceSignatureCreator(pDevice, &mtx, i, vchAmount, nHashType, &vRequests), coin.out.scriptPubKey, sigdata);
+    }
+
+    pDevice->sError.clear();
+    if (0 != pDevice->SignTransactionBatch(&mtx, vRequests, pDevice->sError)) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("error", pDevice->sError);
+        vErrors.push_back(entry);
+        vRequests.clear();
+    }
+
+    PrecomputedTransactionData txdata(txConst);
     for (unsigned int i = 0; i < mtx.vin.size(); i++) {
         CTxIn& txin = mtx.vin[i];
         const Coin& coin = view.AccessCoin(txin.prevout);
@@ -514,21 +584,14 @@ static UniValue devicesignrawtransaction(const JSONRPCRequest &request)
 
         // Only sign SIGHASH_SINGLE if there's a corresponding output:
         if (!fHashSingle || (i < mtx.GetNumVOuts())) {
-            pDevice->sError.clear();
-            ProduceSignature(keystore, usb_device::DeviceSignatureCreator(pDevice, &mtx, i, vchAmount, nHashType), prevPubKey, sigdata);
-
-            if (!pDevice->sError.empty()) {
-                UniValue entry(UniValue::VOBJ);
-                entry.pushKV("error", pDevice->sError);
-                vErrors.push_back(entry);
-            }
+            ProduceSignature(keystore, usb_device::DeviceSignatureCreator(pDevice, &mtx, i, vchAmount, nHashType, &vRequests), prevPubKey, sigdata);
         }
 
         //sigdata = CombineSignatures(prevPubKey, TransactionSignatureChecker(&txConst, i, vchAmount), sigdata, DataFromTransaction(mtx, i));
         UpdateInput(txin, sigdata);
 
         ScriptError serror = SCRIPT_ERR_OK;
-        if (!VerifyScript(txin.scriptSig, prevPubKey, &txin.scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&txConst, i, vchAmount), &serror)) {
+        if (!VerifyScript(txin.scriptSig, prevPubKey, &txin.scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&txConst, i, vchAmount, txdata), &serror)) {
             if (serror == SCRIPT_ERR_INVALID_STACK_OPERATION) {
                 // Unable to sign input and verification failed (possible attempt to partially sign).
                 TxInErrorToJSON(txin, vErrors, "Unable to sign input, invalid stack size (possibly missing key)");
@@ -619,9 +682,12 @@ static UniValue initaccountfromdevice(const JSONRPCRequest &request)
         throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
     }
 
+    CWalletXPubStore xpubStore(pwallet);
+    pDevice->pXPubStore = &xpubStore;
+
     std::string sError;
     CExtPubKey ekp;
-    if (0 != pDevice->GetXPub(vPath, ekp, sError)) {
+    if (0 != pDevice->GetCachedXPub(vPath, ekp, sError)) {
         throw JSONRPCError(RPC_INTERNAL_ERROR, strprintf("GetXPub failed %s.", sError));
     }
 
@@ -724,7 +790,7 @@ static UniValue initaccountfromdevice(const JSONRPCRequest &request)
             CExtPubKey epStealthSpend;
             uint32_t nStealthSpend = WithHardenedBit(CHAIN_NO_STEALTH_SPEND);
             vPath.push_back(nStealthSpend);
-            if (0 != pDevice->GetXPub(vPath, epStealthSpend, sError)) {
+            if (0 != pDevice->GetCachedXPub(vPath, epStealthSpend, sError)) {
                 sea->FreeChains();
                 throw JSONRPCError(RPC_INTERNAL_ERROR, strprintf("GetXPub failed %s.", sError));
             }
@@ -33,27 +33,12 @@ int CTrezorDevice::Open()
         return 1;
     }
 
-    if (hid_init()) {
-        return 1;
-    }
-
-    if (!(handle = hid_open_path(cPath))) {
-        hid_exit();
-        return 1;
-    }
-
-    return 0;
+    return OpenHID();
 };
 
 int CTrezorDevice::Close()
 {
-    if (handle) {
-        hid_close(handle);
-    }
-    handle = nullptr;
-
-    hid_exit();
-    return 0;
+    return CloseHID();
 };
 
 static int WriteV1(hid_device *handle, uint16_t msg_type, std::vector<uint8_t> &vec)
@@ -13,6 +13,7 @@
 #include <inttypes.h>
 #include <univalue.h>
 #include <chainparams.h>
+#include <utiltime.h>
 
 #ifdef ENABLE_WALLET
 #include <wallet/hdwallet.h>
@@ -28,12 +29,49 @@ const DeviceType usbDeviceTypes[] = {
     DeviceType(0x534c, 0x0001, "Trezor", "One", USBDEVICE_TREZOR_ONE),
 };
 
+CDeviceSessionManager g_device_sessions;
+
 void ShutdownHardwareIntegration()
 {
+    g_device_sessions.Shutdown();
+
     // Safe to call ShutdownProtobufLibrary multiple times
     google::protobuf::ShutdownProtobufLibrary();
 }
 
+CUSBDevice::~CUSBDevice()
+{
+    if (nOpen > 0) {
+        nOpen = 1;
+        CloseHID();
+    }
+};
+
+int CUSBDevice::OpenHID()
+{
+    if (nOpen > 0) {
+        nOpen++;
+        return 0;
+    }
+
+    if (!(handle = g_device_sessions.Acquire(cPath))) {
+        return 1;
+    }
+    nOpen = 1;
+    return 0;
+};
+
+int CUSBDevice::CloseHID()
+{
+    if (nOpen == 0 || --nOpen > 0) {
+        return 0;
+    }
+
+    g_device_sessions.Release(cPath);
+    handle = nullptr;
+    return 0;
+};
+
 int CUSBDevice::GetFirmwareVersion(std::string &sFirmware, std::string &sError)
 {
     sFirmware = "no_device";
@@ -68,19 +106,38 @@ static bool MatchTrezorInterface(struct hid_device_info *cur_dev)
     return cur_dev->interface_number == 0;
 }
 
-void ListDevices(std::vector<std::unique_ptr<CUSBDevice> > &vDevices)
+bool CDeviceSessionManager::Init()
 {
-    if (Params().NetworkIDString() == "regtest") {
-        vDevices.push_back(std::unique_ptr<CUSBDevice>(new CDebugDevice()));
-        return;
+    if (!fInit) {
+        fInit = hid_init() == 0;
     }
+    return fInit;
+};
 
-    struct hid_device_info *devs, *cur_dev;
+void CDeviceSessionManager::CloseSession(std::map<std::string, Session>::iterator it)
+{
+    hid_close(it->second.handle);
+    mapSessions.erase(it);
+};
+
+void CDeviceSessionManager::Enumerate(std::vector<CDeviceInfo> &vInfo)
+{
+    LOCK(cs);
 
-    if (hid_init()) {
+    int64_t nNow = GetTime();
+    if (fHaveDevices && nNow - nEnumerateTime < USB_ENUMERATE_CACHE_SECONDS) {
+        vInfo = vDevices;
         return;
     }
 
+    vDevices.clear();
+    fHaveDevices = false;
+    if (!Init()) {
+        vInfo.clear();
+        return;
+    }
+
+    struct hid_device_info *devs, *cur_dev;
     devs = hid_enumerate(0x0, 0x0);
     cur_dev = devs;
     while (cur_dev) {
@@ -90,22 +147,150 @@ void ListDevices(std::vector<std::unique_ptr<CUSBDevice> > &vDevices)
                 continue;
             }
 
-            if (type.type == USBDEVICE_LEDGER_NANO_S
-                && MatchLedgerInterface(cur_dev)) {
-                std::unique_ptr<CUSBDevice> device(new CLedgerDevice(&type, cur_dev->path, (char*)cur_dev->serial_number, cur_dev->interface_number));
-                vDevices.push_back(std::move(device));
-            } else
-            if (type.type == USBDEVICE_TREZOR_ONE
-                && MatchTrezorInterface(cur_dev)) {
-                std::unique_ptr<CUSBDevice> device(new CTrezorDevice(&type, cur_dev->path, (char*)cur_dev->serial_number, cur_dev->interface_number));
-                vDevices.push_back(std::move(device));
+            if ((type.type == USBDEVICE_LEDGER_NANO_S && MatchLedgerInterface(cur_dev))
+                || (type.type == USBDEVICE_TREZOR_ONE && MatchTrezorInterface(cur_dev))) {
+                CDeviceInfo info;
+                info.pType = &type;
+                info.sPath = cur_dev->path;
+                info.sSerialNo = cur_dev->serial_number ? (char*)cur_dev->serial_number : "";
+                info.nInterface = cur_dev->interface_number;
+                vDevices.push_back(info);
             }
         }
         cur_dev = cur_dev->next;
     }
     hid_free_enumeration(devs);
 
-    hid_exit();
+    fHaveDevices = true;
+    nEnumerateTime = nNow;
+
+    // Close the idle sessions of unplugged devices
+    for (auto it = mapSessions.begin(); it != mapSessions.end(); ) {
+        bool fFound = false;
+        for (const auto &info : vDevices) {
+            if (info.sPath == it->first) {
+                fFound = true;
+                break;
+            }
+        }
+        if (!fFound && !it->second.fInUse) {
+            CloseSession(it++);
+        } else {
+            ++it;
+        }
+    }
+
+    vInfo = vDevices;
+};
+
+hid_device *CDeviceSessionManager::Acquire(const std::string &sPath)
+{
+    LOCK(cs);
+
+    if (!Init()) {
+        return nullptr;
+    }
+
+    auto it = mapSessions.find(sPath);
+    if (it != mapSessions.end()) {
+        if (it->second.fInUse) {
+            return nullptr;
+        }
+
+        // Responses are read right after each request, leftover input is stale.
+        // A read error means the device was unplugged, open it again.
+        unsigned char buf[64];
+        int nRead;
+        while ((nRead = hid_read_timeout(it->second.handle, buf, sizeof(buf), 0)) > 0);
+        if (nRead == 0) {
+            it->second.fInUse = true;
+            return it->second.handle;
+        }
+        CloseSession(it);
+    }
+
+    hid_device *handle = hid_open_path(sPath.c_str());
+    if (!handle) {
+        fHaveDevices = false; // Enumerate again, the device may be gone
+        return nullptr;
+    }
+
+    Session &session = mapSessions[sPath];
+    session.handle = handle;
+    session.fInUse = true;
+    return handle;
+};
+
+void CDeviceSessionManager::Release(const std::string &sPath)
+{
+    LOCK(cs);
+
+    auto it = mapSessions.find(sPath);
+    if (it == mapSessions.end()) {
+        return;
+    }
+    if (nTimeout <= 0) {
+        CloseSession(it);
+        return;
+    }
+    it->second.fInUse = false;
+    it->second.nLastUsed = GetTime();
+};
+
+void CDeviceSessionManager::CloseIdle()
+{
+    LOCK(cs);
+
+    int64_t nNow = GetTime();
+    for (auto it = mapSessions.begin(); it != mapSessions.end(); ) {
+        if (!it->second.fInUse && nNow - it->second.nLastUsed >= nTimeout) {
+            CloseSession(it++);
+        } else {
+            ++it;
+        }
+    }
+};
+
+void CDeviceSessionManager::SetTimeout(int64_t nSeconds)
+{
+    LOCK(cs);
+    nTimeout = nSeconds;
+};
+
+void CDeviceSessionManager::Shutdown()
+{
+    LOCK(cs);
+
+    for (auto &session : mapSessions) {
+        hid_close(session.second.handle);
+    }
+    mapSessions.clear();
+    vDevices.clear();
+    fHaveDevices = false;
+
+    if (fInit) {
+        hid_exit();
+        fInit = false;
+    }
+};
+
+void ListDevices(std::vector<std::unique_ptr<CUSBDevice> > &vDevices)
+{
+    if (Params().NetworkIDString() == "regtest") {
+        vDevices.push_back(std::unique_ptr<CUSBDevice>(new CDebugDevice()));
+        return;
+    }
+
+    std::vector<CDeviceInfo> vInfo;
+    g_device_sessions.Enumerate(vInfo);
+    for (const auto &info : vInfo) {
+        if (info.pType->type == USBDEVICE_LEDGER_NANO_S) {
+            vDevices.emplace_back(new CLedgerDevice(info.pType, info.sPath.c_str(), info.sSerialNo.c_str(), info.nInterface));
+        } else
+        if (info.pType->type == USBDEVICE_TREZOR_ONE) {
+            vDevices.emplace_back(new CTrezorDevice(info.pType, info.sPath.c_str(), info.sSerialNo.c_str(), info.nInterface));
+        }
+    }
     return;
 };
 
@@ -129,20 +314,97 @@ CUSBDevice *SelectDevice(std::vector<std::unique_ptr<CUSBDevice> > &vDevices, st
     return vDevices[0].get();
 };
 
-DeviceSignatureCreator::DeviceSignatureCreator(CUSBDevice *pDeviceIn, const CMutableTransaction *txToIn,
-    unsigned int nInIn, const std::vector<uint8_t> &amountIn, int nHashTypeIn)
-    : BaseSignatureCreator(), txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), amount(amountIn), checker(txTo, nIn, amountIn), pDevice(pDeviceIn)
+int CUSBDevice::GetFingerprint(CKeyID &id, std::string &sError)
 {
+    if (idFingerprint.IsNull()) {
+        CPubKey pk;
+        std::vector<uint32_t> vPath(1, WithHardenedBit(44));
+        if (0 != GetPubKey(vPath, pk, sError)) {
+            return 1;
+        }
+        idFingerprint = pk.GetID();
+    }
+    id = idFingerprint;
+    return 0;
 };
 
-bool DeviceSignatureCreator::CreateSig(const SigningProvider& provider, std::vector<unsigned char> &vchSig, const CKeyID &keyid, const CScript &scriptCode, SigVersion sigversion) const
+int CUSBDevice::GetCachedXPub(const std::vector<uint32_t> &vPath, CExtPubKey &ekp, std::string &sError)
 {
-    if (!pDevice) {
-        return false;
+    if (vPath.size() < 1) {
+        return errorN(1, sError, __func__, "Path depth out of range.");
     }
 
-    //uint256 hash = SignatureHash(scriptCode, *txTo, nIn, nHashType, amount, sigversion);
+    size_t nDevice = vPath.size();
+    while (nDevice > 1 && !IsHardened(vPath[nDevice-1])) {
+        nDevice--;
+    }
+    std::vector<uint32_t> vDevicePath(vPath.begin(), vPath.begin() + nDevice);
+
+    auto mi = mapXPubs.find(vDevicePath);
+    if (mi != mapXPubs.end()) {
+        ekp = mi->second;
+    } else {
+        CKeyID idDevice;
+        if (pXPubStore && 0 != GetFingerprint(idDevice, sError)) {
+            return 1;
+        }
+        if (!pXPubStore || !pXPubStore->ReadDeviceXPub(idDevice, vDevicePath, ekp)) {
+            if (0 != GetXPub(vDevicePath, ekp, sError)) {
+                return 1;
+            }
+            if (pXPubStore && !pXPubStore->WriteDeviceXPub(idDevice, vDevicePath, ekp)) {
+                LogPrintf("%s: WriteDeviceXPub failed.\n", __func__);
+            }
+        }
+        mapXPubs[vDevicePath] = ekp;
+    }
+
+    for (size_t i = nDevice; i < vPath.size(); ++i) {
+        CExtPubKey ekChild;
+        if (!ekp.Derive(ekChild, vPath[i])) {
+            return errorN(1, sError, __func__, "CExtPubKey Derive failed.");
+        }
+        ekp = ekChild;
+    }
+
+    return 0;
+};
+
+int CUSBDevice::GetCachedPubKey(const std::vector<uint32_t> &vPath, CPubKey &pk, std::string &sError)
+{
+    // A hardened key is one request either way, GetXPub would also fetch its parent
+    if (vPath.size() > 0 && IsHardened(vPath.back())
+        && !mapXPubs.count(vPath)) {
+        return GetPubKey(vPath, pk, sError);
+    }
 
+    CExtPubKey ekp;
+    if (0 != GetCachedXPub(vPath, ekp, sError)) {
+        return 1;
+    }
+    pk = ekp.pubkey;
+    return 0;
+};
+
+int CUSBDevice::SignTransactionBatch(const CMutableTransaction *tx, std::vector<CDeviceSignRequest> &vRequests, std::string &sError)
+{
+    for (auto &r : vRequests) {
+        if (0 != SignTransaction(r.vPath, r.vSharedSecret, tx, r.nIn, r.scriptCode, r.hashType, r.amount, r.sigversion, r.vchSig, sError)) {
+            return 1;
+        }
+    }
+    return 0;
+};
+
+DeviceSignatureCreator::DeviceSignatureCreator(CUSBDevice *pDeviceIn, const CMutableTransaction *txToIn,
+    unsigned int nInIn, const std::vector<uint8_t> &amountIn, int nHashTypeIn, std::vector<CDeviceSignRequest> *pRequestsIn)
+    : BaseSignatureCreator(), txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), amount(amountIn), checker(txTo, nIn, amountIn), pDevice(pDeviceIn), pRequests(pRequestsIn)
+{
+};
+
+/** Find the device path of keyid, returns false if provider doesn't know it as a hardware key. */
+static bool GetDevicePath(const SigningProvider &provider, const CKeyID &keyid, std::vector<uint32_t> &vPath, std::vector<uint8_t> &vSharedSecret)
+{
     const CHDWallet *pw = dynamic_cast<const CHDWallet*>(&provider);
     if (pw) {
         const CEKAKey *pak = nullptr;
@@ -152,8 +414,6 @@ bool DeviceSignatureCreator::CreateSig(const SigningProvider& provider, std::vec
             return false;
         }
 
-        std::vector<uint32_t> vPath;
-        std::vector<uint8_t> vSharedSecret;
         if (pak) {
             if (!pw->GetFullChainPath(pa, pak->nParent, vPath)) {
                 return error("%s: GetFullAccountPath failed.", __func__);
@@ -176,9 +436,6 @@ bool DeviceSignatureCreator::CreateSig(const SigningProvider& provider, std::vec
         } else {
             return error("%s: HaveKey error.", __func__);
         }
-        if (0 != pDevice->SignTransaction(vPath, vSharedSecret, txTo, nIn, scriptCode, nHashType, amount, sigversion, vchSig, pDevice->sError)) {
-            return error("%s: SignTransaction failed.", __func__);
-        }
         return true;
     }
 
@@ -188,15 +445,53 @@ bool DeviceSignatureCreator::CreateSig(const SigningProvider& provider, std::vec
         if (!pks->GetKey(keyid, pathkey)) {
             return false;
         }
-
-        std::vector<uint8_t> vSharedSecret;
-        if (0 != pDevice->SignTransaction(pathkey.vPath, vSharedSecret, txTo, nIn, scriptCode, nHashType, amount, sigversion, vchSig, pDevice->sError)) {
-            return error("%s: SignTransaction failed.", __func__);
-        }
+        vPath = pathkey.vPath;
         return true;
     }
 
     return false;
 };
 
+bool DeviceSignatureCreator::CreateSig(const SigningProvider& provider, std::vector<unsigned char> &vchSig, const CKeyID &keyid, const CScript &scriptCode, SigVersion sigversion) const
+{
+    if (!pDevice) {
+        return false;
+    }
+
+    if (pRequests) {
+        for (const auto &r : *pRequests) {
+            if (r.nIn == (int)nIn && r.keyid == keyid && r.sigversion == sigversion && r.scriptCode == scriptCode) {
+                if (r.vchSig.empty()) {
+                    return false;
+                }
+                vchSig = r.vchSig;
+                return true;
+            }
+        }
+
+        CDeviceSignRequest r;
+        if (!GetDevicePath(provider, keyid, r.vPath, r.vSharedSecret)) {
+            return false;
+        }
+        r.nIn = nIn;
+        r.keyid = keyid;
+        r.scriptCode = scriptCode;
+        r.amount = amount;
+        r.hashType = nHashType;
+        r.sigversion = sigversion;
+        pRequests->push_back(std::move(r));
+        return false;
+    }
+
+    std::vector<uint32_t> vPath;
+    std::vector<uint8_t> vSharedSecret;
+    if (!GetDevicePath(provider, keyid, vPath, vSharedSecret)) {
+        return false;
+    }
+    if (0 != pDevice->SignTransaction(vPath, vSharedSecret, txTo, nIn, scriptCode, nHashType, amount, sigversion, vchSig, pDevice->sError)) {
+        return error("%s: SignTransaction failed.", __func__);
+    }
+    return true;
+};
+
 } // usb_device
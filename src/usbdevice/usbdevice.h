@@ -13,6 +13,8 @@
 #include <key/extkey.h>
 #include <script/sign.h>
 #include <keystore.h>
+#include <sync.h>
+#include <map>
 #include <memory>
 
 
@@ -74,6 +76,22 @@ public:
     }
 };
 
+/** A signature for one input, requested from the device in a batch. */
+class CDeviceSignRequest
+{
+public:
+    int nIn = 0;
+    CKeyID keyid;
+    std::vector<uint32_t> vPath;
+    std::vector<uint8_t> vSharedSecret;
+    CScript scriptCode;
+    std::vector<uint8_t> amount;
+    int hashType = SIGHASH_ALL;
+    SigVersion sigversion = SigVersion::BASE;
+
+    std::vector<uint8_t> vchSig; // Set by SignTransactionBatch
+};
+
 class DeviceType
 {
 public:
@@ -94,6 +112,82 @@ public:
 
 extern const DeviceType usbDeviceTypes[];
 
+//! Seconds an enumeration of the USB devices is reused
+static const int64_t USB_ENUMERATE_CACHE_SECONDS = 5;
+//! Default seconds an idle device stays open, 0 closes devices after each use
+static const int64_t DEFAULT_USB_SESSION_TIMEOUT = 60;
+//! Seconds between checks for idle devices
+static const int64_t USB_SESSION_CHECK_INTERVAL = 10;
+
+/** A supported device found by CDeviceSessionManager::Enumerate */
+struct CDeviceInfo
+{
+    const DeviceType *pType = nullptr;
+    std::string sPath;
+    std::string sSerialNo;
+    int nInterface = 0;
+};
+
+/**
+ * Keeps hidapi initialised, caches the device enumeration and keeps devices
+ * open between operations.
+ *
+ * hidapi has no hotplug notifications. An enumeration is reused for
+ * USB_ENUMERATE_CACHE_SECONDS and dropped when opening a device fails, as it
+ * does after an unplug. A fresh enumeration closes the idle sessions of paths
+ * that are gone.
+ *
+ * A session is used by one CUSBDevice at a time, Acquire fails while it is in
+ * use. A released session stays open until it was idle for the timeout.
+ */
+class CDeviceSessionManager
+{
+public:
+    void Enumerate(std::vector<CDeviceInfo> &vInfo);
+
+    /** Open the device at path or reuse its session, nullptr if busy or failed */
+    hid_device *Acquire(const std::string &sPath);
+    void Release(const std::string &sPath);
+
+    /** Close the sessions idle for longer than the timeout, run by the scheduler */
+    void CloseIdle();
+
+    void SetTimeout(int64_t nSeconds);
+
+    /** Close all sessions and release hidapi */
+    void Shutdown();
+
+private:
+    struct Session
+    {
+        hid_device *handle = nullptr;
+        bool fInUse = false;
+        int64_t nLastUsed = 0;
+    };
+
+    bool Init() EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void CloseSession(std::map<std::string, Session>::iterator it) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    CCriticalSection cs;
+    bool fInit GUARDED_BY(cs) = false;
+    int64_t nTimeout GUARDED_BY(cs) = DEFAULT_USB_SESSION_TIMEOUT;
+    bool fHaveDevices GUARDED_BY(cs) = false;
+    int64_t nEnumerateTime GUARDED_BY(cs) = 0;
+    std::vector<CDeviceInfo> vDevices GUARDED_BY(cs);
+    std::map<std::string, Session> mapSessions GUARDED_BY(cs);
+};
+
+extern CDeviceSessionManager g_device_sessions;
+
+/** Persistent store for the extended public keys cached by CUSBDevice. */
+class CDeviceXPubStore
+{
+public:
+    virtual ~CDeviceXPubStore() {};
+    virtual bool ReadDeviceXPub(const CKeyID &idDevice, const std::vector<uint32_t> &vPath, CExtPubKey &ekp) = 0;
+    virtual bool WriteDeviceXPub(const CKeyID &idDevice, const std::vector<uint32_t> &vPath, const CExtPubKey &ekp) = 0;
+};
+
 class CUSBDevice
 {
 public:
@@ -109,6 +203,8 @@ public:
         nInterface = nInterface_;
     };
 
+    virtual ~CUSBDevice();
+
     virtual int Open() { return 0; };
     virtual int Close() { return 0; };
 
@@ -118,6 +214,17 @@ public:
     virtual int GetPubKey(const std::vector<uint32_t> &vPath, CPubKey &pk, std::string &sError) { return 0; };
     virtual int GetXPub(const std::vector<uint32_t> &vPath, CExtPubKey &ekp, std::string &sError) { return 0; };
 
+    /**
+     * GetXPub through a cache of the device's extended public keys.
+     * Only the key at the last hardened step of vPath is requested from the device, the
+     * non-hardened steps below it are derived on the host.
+     */
+    int GetCachedXPub(const std::vector<uint32_t> &vPath, CExtPubKey &ekp, std::string &sError);
+    int GetCachedPubKey(const std::vector<uint32_t> &vPath, CPubKey &pk, std::string &sError);
+
+    /** Id of the device's key at m/44', keys in pXPubStore are stored under it. */
+    int GetFingerprint(CKeyID &id, std::string &sError);
+
     virtual int SignMessage(const std::vector<uint32_t> &vPath, const std::string &sMessage, std::vector<uint8_t> &vchSig, std::string &sError) { return 0; };
 
     virtual int PrepareTransaction(const CMutableTransaction *tx, const CCoinsViewCache &view) { return 0; };
@@ -127,14 +234,32 @@ public:
         int nIn, const CScript &scriptCode, int hashType, const std::vector<uint8_t> &amount, SigVersion sigversion,
         std::vector<uint8_t> &vchSig, std::string &sError) { return 0; };
 
+    /**
+     * Sign all requests for tx in one session, after PrepareTransaction.
+     * The default signs each request in turn through SignTransaction, devices override it to
+     * avoid per input work where their protocol allows.
+     */
+    virtual int SignTransactionBatch(const CMutableTransaction *tx, std::vector<CDeviceSignRequest> &vRequests, std::string &sError);
+
     const DeviceType *pType = nullptr;
     char cPath[512];
     char cSerialNo[128];
     int nInterface;
     std::string sError;
 
+    CDeviceXPubStore *pXPubStore = nullptr;
+
 protected:
+    /** Open the HID session of cPath, nested calls reuse it */
+    int OpenHID();
+    /** Release the session after the outermost OpenHID, safe to call when not open */
+    int CloseHID();
+
     hid_device *handle = nullptr;
+    int nOpen = 0;
+
+    CKeyID idFingerprint;
+    std::map<std::vector<uint32_t>, CExtPubKey> mapXPubs; // Keys received from the device this session
 };
 
 void ListDevices(std::vector<std::unique_ptr<CUSBDevice> > &vDevices);
@@ -148,9 +273,16 @@ class DeviceSignatureCreator : public BaseSignatureCreator {
     std::vector<uint8_t> amount;
     const MutableTransactionSignatureChecker checker;
     CUSBDevice *pDevice;
+    std::vector<CDeviceSignRequest> *pRequests;
 
 public:
-    DeviceSignatureCreator(CUSBDevice *pDeviceIn, const CMutableTransaction *txToIn, unsigned int nInIn, const std::vector<uint8_t> &amountIn, int nHashTypeIn=SIGHASH_ALL);
+    /**
+     * With pRequestsIn set nothing is signed by CreateSig: a first ProduceSignature pass appends a request
+     * for each key needed and fails, once SignTransactionBatch has filled in the requests a second pass
+     * returns their signatures.
+     */
+    DeviceSignatureCreator(CUSBDevice *pDeviceIn, const CMutableTransaction *txToIn, unsigned int nInIn, const std::vector<uint8_t> &amountIn, int nHashTypeIn=SIGHASH_ALL,
+        std::vector<CDeviceSignRequest> *pRequestsIn=nullptr);
     const BaseSignatureChecker &Checker() const override { return checker; }
 
     bool IsBitcoinCVersion() const override { return txTo && txTo->IsBitcoinCVersion(); }
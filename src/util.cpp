@@ -1387,6 +1387,8 @@ void runCommand(const std::string& strCommand)
         LogPrintf("runCommand error: system(%s) returned %d\n", strCommand, nErr);
 }
 
+static void ApplyThreadAffinity(const char *name);
+
 void RenameThread(const char* name)
 {
 #if defined(PR_SET_NAME)
@@ -1401,6 +1403,7 @@ void RenameThread(const char* name)
     // Prevent warnings for unused parameters...
     (void)name;
 #endif
+    ApplyThreadAffinity(name);
 }
 
 void SetupEnvironment()
@@ -1492,3 +1495,196 @@ int ScheduleBatchPriority(void)
     return 1;
 #endif
 }
+
+namespace {
+
+struct ThreadGroupName
+{
+    const char *sName;
+    const char *sGroup;
+};
+
+// Thread names as passed to TraceThread, without the bitcoinc- prefix
+const ThreadGroupName THREAD_GROUP_NAMES[] = {
+    {"scriptch", "validation"},
+    {"mlsagch", "validation"},
+    {"txcheck", "validation"},
+    {"verify", "validation"},
+    {"loadblk", "validation"},
+    {"reindexread", "validation"},
+    {"blockread", "validation"},
+    {"smsg", "smsg"},
+    {"smsg-pow", "smsg"},
+    {"http", "rpc"},
+    {"httpworker", "rpc"},
+    {"net", "net"},
+    {"msghand", "net"},
+    {"peermsg", "net"},
+    {"opencon", "net"},
+    {"addcon", "net"},
+    {"dnsseed", "net"},
+    {"upnp", "net"},
+    {"torcontrol", "net"},
+    {"scheduler", "scheduler"},
+    {"indexwrite", "index"},
+    {"insightidx", "index"},
+    {"wallet", "wallet"},
+    {"rescanread", "wallet"},
+    {"lockedoutputs", "wallet"},
+    {"compactwallet", "wallet"},
+    {"walletnotify", "wallet"},
+};
+
+const char *const THREAD_GROUPS[] = {"validation", "staking", "smsg", "rpc", "net", "scheduler", "index", "wallet"};
+
+CCriticalSection cs_thread_affinity;
+std::map<std::string, std::vector<int> > g_thread_affinity GUARDED_BY(cs_thread_affinity);
+
+bool ParseCPU(const std::string &s, int &nCPU)
+{
+    return ParseInt32(s, &nCPU) && nCPU >= 0 && nCPU <= MAX_AFFINITY_CPU;
+};
+
+} // namespace
+
+std::string GetThreadGroup(const std::string &sThreadName)
+{
+    std::string sName = sThreadName;
+    if (sName.compare(0, 9, "bitcoinc-") == 0)
+        sName = sName.substr(9);
+
+    for (const auto &tg : THREAD_GROUP_NAMES)
+        if (sName == tg.sName)
+            return tg.sGroup;
+
+    // Staking threads are miner0, miner1, ..., the index sync threads are named after their index
+    if (sName.size() > 5 && sName.compare(0, 5, "miner") == 0
+        && sName.find_first_not_of("0123456789", 5) == std::string::npos)
+        return "staking";
+    if (sName.size() > 5 && sName.compare(sName.size() - 5, 5, "index") == 0)
+        return "index";
+    return "";
+};
+
+bool ParseThreadAffinity(const std::string &sArg, std::map<std::string, std::vector<int> > &mGroups, std::string &sError)
+{
+    mGroups.clear();
+    if (sArg.empty())
+        return true;
+
+    std::vector<int> *pCPUs = nullptr;
+    size_t nStart = 0;
+    while (nStart <= sArg.size())
+    {
+        size_t nEnd = sArg.find(',', nStart);
+        if (nEnd == std::string::npos)
+            nEnd = sArg.size();
+        std::string sItem = sArg.substr(nStart, nEnd - nStart);
+        nStart = nEnd + 1;
+
+        size_t nColon = sItem.find(':');
+        if (nColon != std::string::npos)
+        {
+            std::string sGroup = sItem.substr(0, nColon);
+            if (std::find_if(std::begin(THREAD_GROUPS), std::end(THREAD_GROUPS),
+                [&sGroup](const char *s) { return sGroup == s; }) == std::end(THREAD_GROUPS))
+            {
+                sError = strprintf("Unknown thread group \"%s\"", sGroup);
+                return false;
+            };
+            if (mGroups.count(sGroup))
+            {
+                sError = strprintf("Thread group \"%s\" is set more than once", sGroup);
+                return false;
+            };
+            pCPUs = &mGroups[sGroup];
+            sItem = sItem.substr(nColon + 1);
+        };
+
+        if (!pCPUs)
+        {
+            sError = strprintf("\"%s\" must follow a thread group name", sItem);
+            return false;
+        };
+
+        int nFirst, nLast;
+        size_t nDash = sItem.find('-');
+        if (nDash == std::string::npos)
+        {
+            if (!ParseCPU(sItem, nFirst))
+            {
+                sError = strprintf("Invalid CPU \"%s\"", sItem);
+                return false;
+            };
+            nLast = nFirst;
+        } else
+        if (!ParseCPU(sItem.substr(0, nDash), nFirst)
+            || !ParseCPU(sItem.substr(nDash + 1), nLast)
+            || nLast < nFirst)
+        {
+            sError = strprintf("Invalid CPU range \"%s\"", sItem);
+            return false;
+        };
+
+        for (int i = nFirst; i <= nLast; ++i)
+            pCPUs->push_back(i);
+    };
+
+    for (auto &mi : mGroups)
+    {
+        std::sort(mi.second.begin(), mi.second.end());
+        mi.second.erase(std::unique(mi.second.begin(), mi.second.end()), mi.second.end());
+    };
+    return true;
+};
+
+bool SetThreadAffinity(const std::string &sArg, std::string &sError)
+{
+    std::map<std::string, std::vector<int> > mGroups;
+    if (!ParseThreadAffinity(sArg, mGroups, sError))
+        return false;
+
+    for (const auto &mi : mGroups)
+        LogPrintf("Thread group %s pinned to %d CPU(s) from %d\n", mi.first, mi.second.size(), mi.second.front());
+
+    LOCK(cs_thread_affinity);
+    g_thread_affinity = mGroups;
+    return true;
+};
+
+bool ThreadAffinitySupported()
+{
+#if defined(__linux__) && defined(CPU_SET)
+    return true;
+#else
+    return false;
+#endif
+};
+
+static void ApplyThreadAffinity(const char *name)
+{
+    std::string sGroup = GetThreadGroup(name);
+    if (sGroup.empty())
+        return;
+
+    std::vector<int> vCPUs;
+    {
+        LOCK(cs_thread_affinity);
+        auto mi = g_thread_affinity.find(sGroup);
+        if (mi == g_thread_affinity.end())
+            return;
+        vCPUs = mi->second;
+    }
+
+#if defined(__linux__) && defined(CPU_SET)
+    // Memory is placed on the NUMA node of the CPU that first touches it, a pinned
+    // thread's malloc arena and stack stay local to its CPUs without libnuma
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (int n : vCPUs)
+        if (n < CPU_SETSIZE)
+            CPU_SET(n, &cpuset);
+    if (int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset))
+        LogPrintf("Failed to pin thread %s to the %s CPUs: %s\n", name, sGroup, strerror(ret));
+#endif
+};
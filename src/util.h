@@ -401,6 +401,28 @@ std::string CopyrightHolders(const std::string& strPrefix);
  */
 int ScheduleBatchPriority(void);
 
+//! Highest CPU number accepted by -threadaffinity
+static const int MAX_AFFINITY_CPU = 1023;
+
+/**
+ * Parse a -threadaffinity value like "validation:0-7,staking:8-9,12".
+ * A list of CPUs or ranges follows each group name, the groups are
+ * validation, staking, smsg, rpc, net, scheduler, index and wallet.
+ */
+bool ParseThreadAffinity(const std::string& sArg, std::map<std::string, std::vector<int> >& mGroups, std::string& sError);
+
+/** Set the CPUs of the thread groups, must be called before the threads are started */
+bool SetThreadAffinity(const std::string& sArg, std::string& sError);
+
+//! False if threads can't be pinned on this platform
+bool ThreadAffinitySupported();
+
+/**
+ * The thread group of a thread named by RenameThread, empty if it isn't in one.
+ * RenameThread pins a thread in a group to that group's CPUs if set.
+ */
+std::string GetThreadGroup(const std::string& sThreadName);
+
 namespace util {
 
 //! Simplification of std insertion
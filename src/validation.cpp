@@ -6,6 +6,8 @@
 #include <validation.h>
 
 #include <arith_uint256.h>
+#include <blockfilemap.h>
+#include <blockreadahead.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -14,6 +16,7 @@
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/hmac_sha256.h>
 #include <cuckoocache.h>
 #include <hash.h>
 #include <index/txindex.h>
@@ -33,6 +36,7 @@
 #include <timedata.h>
 #include <tinyformat.h>
 #include <txdb.h>
+#include <txlookupcache.h>
 #include <txmempool.h>
 #include <ui_interface.h>
 #include <undo.h>
@@ -43,15 +47,23 @@
 #include <warnings.h>
 #include <smsg/smessage.h>
 #include <pos/kernel.h>
+#include <pos/reward.h>
+#include <pos/stakeindex.h>
 #include <blind.h>
 #include <anon.h>
 #include <rctindex.h>
 #include <insight/insight.h>
+#include <perfstats.h>
 
 #include <secp256k1_rangeproof.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <future>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -172,8 +184,9 @@ public:
     /**
      * If a block header hasn't already been seen, call CheckBlockHeader on it, ensure
      * that it doesn't descend from an invalid block, and then add it to mapBlockIndex.
+     * pHashChecked is the hash of block if the caller has already run CheckBlockHeader on it.
      */
-    bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, const uint256 *pHashChecked = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Block (dis)connection on a given view:
@@ -203,7 +216,7 @@ public:
 
     CBlockIndex* AddToBlockIndex(const CBlockHeader& block) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     /** Create a new block index entry for a given block hash */
-    CBlockIndex* InsertBlockIndex(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    CBlockIndex* InsertBlockIndex(const uint256& hash, CBlockIndex* pindexNew = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     /**
      * Make various assertions about the state of the block index.
      *
@@ -244,6 +257,7 @@ bool fSkipRangeproof = false;
 bool fBusyImporting = false;        // covers ActivateBestChain too
 bool fTxIndex = true;
 bool fAddressIndex = false;
+bool fAddressBalanceIndex = false;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
 bool fHavePruned = false;
@@ -267,6 +281,7 @@ CAmount maxTxFee = DEFAULT_TRANSACTION_MAXFEE;
 CBlockPolicyEstimator feeEstimator;
 CTxMemPool mempool(&feeEstimator);
 std::atomic_bool g_is_mempool_loaded{false};
+CTxLookupCache g_tx_lookup_cache(DEFAULT_TXLOOKUPCACHESIZE << 20);
 
 /** Constant stuff for coinbase transactions we create: */
 CScript COINBASE_FLAGS;
@@ -339,7 +354,7 @@ std::unique_ptr<CBlockTreeDB> pblocktree;
 //static bool FlushStateToDisk(const CChainParams& chainParams, CValidationState &state, FlushStateMode mode, int nManualPruneHeight=0);
 static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight);
 static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight);
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr, bool fAnonChecks = true);
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr, bool fAnonChecks = true, std::vector<CMLSAGCheck> *pvAnonChecks = nullptr);
 static FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 
 bool CheckFinalTx(const CTransaction &tx, int flags)
@@ -605,6 +620,58 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
     return CheckInputs(tx, state, view, true, flags, cacheSigStore, true, txdata);
 }
 
+/** Witness hashes of txns that passed PreCheckTransaction, with the fBulletproofsActive they were checked under */
+static CCriticalSection cs_prechecked;
+static std::map<uint256, bool> mapPrechecked; // guarded by cs_prechecked
+static std::deque<uint256> dqPrechecked; // guarded by cs_prechecked, insertion order for eviction
+static const size_t MAX_PRECHECKED_TXNS = 1000;
+
+static bool IsPrechecked(const CTransaction &tx)
+{
+    LOCK(cs_prechecked);
+    return mapPrechecked.count(tx.GetWitnessHash());
+}
+
+static void SetPrechecked(const CTransaction &tx, bool fBulletproofsActive)
+{
+    LOCK(cs_prechecked);
+    if (mapPrechecked.emplace(tx.GetWitnessHash(), fBulletproofsActive).second) {
+        dqPrechecked.push_back(tx.GetWitnessHash());
+    }
+    while (dqPrechecked.size() > MAX_PRECHECKED_TXNS) {
+        mapPrechecked.erase(dqPrechecked.front());
+        dqPrechecked.pop_front();
+    }
+}
+
+bool PreCheckTransaction(const CTransactionRef &tx, int64_t nAcceptTime)
+{
+    if (IsPrechecked(*tx)) {
+        return true;
+    }
+
+    CValidationState state;
+    state.fBulletproofsActive = nAcceptTime >= Params().GetConsensus().bulletproof_time;
+    if (!CheckTransaction(*tx, state)) {
+        return false;
+    }
+    SetPrechecked(*tx, state.fBulletproofsActive);
+    return true;
+}
+
+/** Take tx out of the prechecked set, returns true if it passed CheckTransaction under the same rules */
+static bool TakePrechecked(const CTransaction &tx, bool fBulletproofsActive)
+{
+    LOCK(cs_prechecked);
+    auto mi = mapPrechecked.find(tx.GetWitnessHash());
+    if (mi == mapPrechecked.end()) {
+        return false;
+    }
+    bool fMatch = mi->second == fBulletproofsActive;
+    mapPrechecked.erase(mi); // dqPrechecked is trimmed lazily
+    return fMatch;
+}
+
 static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
                               bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache, bool test_accept, bool ignore_locks)
@@ -620,7 +687,8 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
     const Consensus::Params &consensus = Params().GetConsensus();
     state.fBulletproofsActive = nAcceptTime >= consensus.bulletproof_time;
 
-    if (!CheckTransaction(tx, state))
+    if (!TakePrechecked(tx, state.fBulletproofsActive)
+        && !CheckTransaction(tx, state))
         return false; // state filled in by CheckTransaction
 
     // Coinbase is only valid in a block, not as a loose transaction
@@ -1066,9 +1134,6 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         }
     }
 
-    if (!AddKeyImagesToMempool(tx, pool))
-        return state.DoS(100, error("%s: AddKeyImagesToMempool failed.", __func__), REJECT_MALFORMED, "bad-anonin-keyimages");
-
     GetMainSignals().TransactionAddedToMempool(ptx);
 
     return true;
@@ -1115,9 +1180,34 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
             txOut = ptx;
             return true;
         }
+    }
+
+    if (g_txindex || fAllowSlow || blockIndex) {
+        // Entries are only added from the active chain, drop those a reorg left behind
+        CTransactionRef ptx;
+        uint256 hashCached;
+        if (g_tx_lookup_cache.Get(hash, ptx, hashCached)) {
+            BlockMap::iterator mi = mapBlockIndex.find(hashCached);
+            if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second)) {
+                g_tx_lookup_cache.Erase(hash);
+            } else if (!blockIndex || blockIndex == mi->second) {
+                txOut = ptx;
+                hashBlock = hashCached;
+                return true;
+            }
+        }
+    }
 
+    if (!blockIndex) {
         if (g_txindex) {
-            return g_txindex->FindTx(hash, hashBlock, txOut);
+            if (!g_txindex->FindTx(hash, hashBlock, txOut)) {
+                return false;
+            }
+            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+            if (mi != mapBlockIndex.end() && chainActive.Contains(mi->second)) {
+                g_tx_lookup_cache.Insert(txOut, hashBlock);
+            }
+            return true;
         }
 
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
@@ -1133,6 +1223,9 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
                 if (tx->GetHash() == hash) {
                     txOut = tx;
                     hashBlock = pindexSlow->GetBlockHash();
+                    if (chainActive.Contains(pindexSlow)) {
+                        g_tx_lookup_cache.Insert(txOut, hashBlock);
+                    }
                     return true;
                 }
             }
@@ -1209,21 +1302,65 @@ static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMes
     return true;
 }
 
+/**
+ * Locate the record written at pos in a memory mapped blk or rev file, checking its index header.
+ * nTrailing bytes after the record must be mapped too. Returns false if the file can't be mapped.
+ */
+static bool GetMappedRecord(const char *prefix, const CDiskBlockPos& pos, size_t nTrailing,
+    std::shared_ptr<const CMappedBlockFile>& file, const uint8_t*& pData, unsigned int& nSize)
+{
+    if (!g_block_file_maps.IsEnabled() || pos.nPos < 8)
+        return false;
+
+    file = g_block_file_maps.Get(prefix, pos.nFile, pos.nPos);
+    if (!file)
+        return false;
+
+    const uint8_t *pHeader = file->data() + pos.nPos - 8;
+    if (memcmp(pHeader, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE) != 0)
+        return false;
+    nSize = ReadLE32(pHeader + CMessageHeader::MESSAGE_START_SIZE);
+    if (nSize > MAX_SIZE)
+        return false;
+
+    uint64_t nEnd = (uint64_t)pos.nPos + nSize + nTrailing;
+    if (nEnd > file->size()) {
+        file = g_block_file_maps.Get(prefix, pos.nFile, nEnd);
+        if (!file)
+            return false;
+    }
+    pData = file->data() + pos.nPos;
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    std::shared_ptr<const CMappedBlockFile> mapped;
+    const uint8_t *pData = nullptr;
+    unsigned int nSize = 0;
+    if (GetMappedRecord("blk", pos, 0, mapped, pData, nSize)) {
+        try {
+            CSpanReader reader(SER_DISK, CLIENT_VERSION, pData, nSize);
+            reader >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
     // Check the header
@@ -1258,30 +1395,48 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
-bool ReadTransactionFromDiskBlock(const CBlockIndex* pindex, int nIndex, CTransactionRef &txOut)
+template <typename Stream>
+static bool ReadTransactionFromBlockStream(Stream& s, const CBlockIndex* pindex, int nIndex, CBlockHeader& blockHeader, CTransactionRef &txOut)
 {
     const CDiskBlockPos &pos = pindex->GetBlockPos();
-
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
-
-    CBlockHeader blockHeader;
     try {
-        filein >> blockHeader;
+        s >> blockHeader;
 
-        int nTxns = ReadCompactSize(filein);
+        int nTxns = ReadCompactSize(s);
 
         if (nTxns <= nIndex || nIndex < 0)
             return error("%s: Block %s, txn %d not in available range %d.", __func__, pindex->GetBlockPos().ToString(), nIndex, nTxns);
 
         for (int k = 0; k <= nIndex; ++k)
-            filein >> txOut;
+            s >> txOut;
     } catch (const std::exception& e)
     {
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
     }
+    return true;
+}
+
+bool ReadTransactionFromDiskBlock(const CBlockIndex* pindex, int nIndex, CTransactionRef &txOut)
+{
+    const CDiskBlockPos &pos = pindex->GetBlockPos();
+
+    CBlockHeader blockHeader;
+    std::shared_ptr<const CMappedBlockFile> mapped;
+    const uint8_t *pData = nullptr;
+    unsigned int nSize = 0;
+    if (GetMappedRecord("blk", pos, 0, mapped, pData, nSize)) {
+        CSpanReader reader(SER_DISK, CLIENT_VERSION, pData, nSize);
+        if (!ReadTransactionFromBlockStream(reader, pindex, nIndex, blockHeader, txOut))
+            return false;
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+        if (!ReadTransactionFromBlockStream(filein, pindex, nIndex, blockHeader, txOut))
+            return false;
+    }
 
     if (blockHeader.GetHash() != pindex->GetBlockHash())
         return error("%s: Hash doesn't match index for %s at %s",
@@ -1292,6 +1447,15 @@ bool ReadTransactionFromDiskBlock(const CBlockIndex* pindex, int nIndex, CTransa
 
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start)
 {
+    std::shared_ptr<const CMappedBlockFile> mapped;
+    const uint8_t *pData = nullptr;
+    unsigned int nSize = 0;
+    if (memcmp(message_start, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE) == 0
+        && GetMappedRecord("blk", pos, 0, mapped, pData, nSize)) {
+        block.assign(pData, pData + nSize);
+        return true;
+    }
+
     CDiskBlockPos hpos = pos;
     hpos.nPos -= 8; // Seek back 8 bytes for meta header
     CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
@@ -1584,6 +1748,7 @@ void InitScriptExecutionCache() {
  * If pvChecks is not nullptr, script checks are pushed onto it instead of being performed inline. Any
  * script checks which are not necessary (eg due to script execution cache hits) are, obviously,
  * not pushed onto pvChecks/run.
+ * Likewise, if pvAnonChecks is not nullptr, the ring signature checks of anon inputs are pushed onto it.
  *
  * Setting cacheSigStore/cacheFullScriptStore to false will remove elements from the corresponding cache
  * which are matched. This is useful for checking blocks where we will likely never need the cache
@@ -1591,7 +1756,7 @@ void InitScriptExecutionCache() {
  *
  * Non-static (and re-declared) in src/test/txvalidationcache_tests.cpp
  */
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks, bool fAnonChecks)
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks, bool fAnonChecks, std::vector<CMLSAGCheck> *pvAnonChecks)
 {
     if (!tx.IsCoinBase())
     {
@@ -1682,10 +1847,10 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
             }
 
             if (fHasAnonInput && fAnonChecks
-                && !VerifyMLSAG(tx, state))
+                && !VerifyMLSAG(tx, state, pvAnonChecks, cacheSigStore))
                     return false;
 
-            if (cacheFullScriptStore && !pvChecks) {
+            if (cacheFullScriptStore && !pvChecks && !pvAnonChecks) {
                 // We executed all of the provided scripts, and were told to
                 // cache the result. Do so now.
                 scriptExecutionCache.insert(hashCacheEntry);
@@ -1725,12 +1890,54 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
-static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
+/** Abort with a message */
+static bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
+{
+    SetMiscWarning(strMessage);
+    LogPrintf("*** %s\n", strMessage);
+    uiInterface.ThreadSafeMessageBox(
+        userMessage.empty() ? _("Error: A fatal internal error occurred, see debug.log for details") : userMessage,
+        "", CClientUIInterface::MSG_ERROR);
+    StartShutdown();
+    return false;
+}
+
+static bool AbortNode(CValidationState& state, const std::string& strMessage, const std::string& userMessage="")
+{
+    AbortNode(strMessage, userMessage);
+    return state.Error(strMessage);
+}
+
+} // namespace
+
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
 {
     CDiskBlockPos pos = pindex->GetUndoPos();
     if (pos.IsNull()) {
         return error("%s: no undo data available", __func__);
     }
+    blockundo.fHaveRCT = pindex->nStatus & BLOCK_HAVE_RCT_UNDO;
+
+    std::shared_ptr<const CMappedBlockFile> mapped;
+    const uint8_t *pData = nullptr;
+    unsigned int nSize = 0;
+    if (GetMappedRecord("rev", pos, sizeof(uint256), mapped, pData, nSize)) {
+        // The checksum follows the undo data
+        CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+        hasher << pindex->pprev->GetBlockHash();
+        hasher.write((const char*)pData, nSize);
+        if (memcmp(pData + nSize, hasher.GetHash().begin(), sizeof(uint256)) != 0)
+            return error("%s: Checksum mismatch", __func__);
+
+        try {
+            CSpanReader reader(SER_DISK, CLIENT_VERSION, pData, nSize);
+            reader >> blockundo;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s", __func__, e.what());
+        }
+        return true;
+    }
 
     // Open history file to read
     CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
@@ -1756,26 +1963,6 @@ static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
     return true;
 }
 
-/** Abort with a message */
-static bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
-{
-    SetMiscWarning(strMessage);
-    LogPrintf("*** %s\n", strMessage);
-    uiInterface.ThreadSafeMessageBox(
-        userMessage.empty() ? _("Error: A fatal internal error occurred, see debug.log for details") : userMessage,
-        "", CClientUIInterface::MSG_ERROR);
-    StartShutdown();
-    return false;
-}
-
-static bool AbortNode(CValidationState& state, const std::string& strMessage, const std::string& userMessage="")
-{
-    AbortNode(strMessage, userMessage);
-    return state.Error(strMessage);
-}
-
-} // namespace
-
 /**
  * Restore the UTXO in a Coin at a given COutPoint
  * @param undo The Coin to be restored.
@@ -1849,6 +2036,21 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
         }
     }
 
+    if (blockUndo.fHaveRCT) {
+        // The undo record carries the RCT state of the block, no index reads are needed to find it
+        if (blockUndo.nLastRCTOutput != pindex->nAnonOutputs
+            || blockUndo.nLastRCTOutput < blockUndo.nFirstRCTOutput - 1) {
+            error("%s: RCT undo data inconsistent, range %d-%d, index %d.", __func__,
+                blockUndo.nFirstRCTOutput, blockUndo.nLastRCTOutput, pindex->nAnonOutputs);
+            if (!view.fForceDisconnect)
+                return DISCONNECT_FAILED;
+        }
+        for (const auto &ki : blockUndo.vKeyImages) {
+            view.keyImages.push_back(std::make_pair(ki, uint256())); // Spending txid is not needed to erase
+        }
+    }
+    int64_t nRCTOutputs = 0;
+
     int nVtxundo = blockUndo.vtxundo.size()-1;
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--)
@@ -1857,7 +2059,7 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
         uint256 hash = tx.GetHash();
 
         for (const auto &txin : tx.vin) {
-            if (txin.IsAnonInput()) {
+            if (txin.IsAnonInput() && !blockUndo.fHaveRCT) {
                 uint32_t nInputs, nRingSize;
                 txin.GetAnonInfo(nInputs, nRingSize);
                 if (txin.scriptData.stack.size() != 1
@@ -1885,6 +2087,11 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
             {
                 CTxOutRingCT *txout = (CTxOutRingCT*)out;
 
+                nRCTOutputs++;
+                if (view.nLastRCTOutput == 0 && blockUndo.fHaveRCT)
+                {
+                    view.nLastRCTOutput = blockUndo.nLastRCTOutput;
+                } else
                 if (view.nLastRCTOutput == 0)
                 {
                     view.nLastRCTOutput = pindex->nAnonOutputs;
@@ -2036,6 +2243,14 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
         }
     }
 
+    if (blockUndo.fHaveRCT
+        && nRCTOutputs != blockUndo.nLastRCTOutput - blockUndo.nFirstRCTOutput + 1) {
+        error("%s: RCT undo data and block inconsistent, %d outputs, range %d-%d.", __func__,
+            nRCTOutputs, blockUndo.nFirstRCTOutput, blockUndo.nLastRCTOutput);
+        if (!view.fForceDisconnect)
+            return DISCONNECT_FAILED;
+    }
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash(), pindex->pprev->nHeight);
 
@@ -2062,8 +2277,10 @@ void static FlushBlockFile(bool fFinalize = false)
 
     FILE *fileOld = OpenBlockFile(posOld);
     if (fileOld) {
-        if (fFinalize)
+        if (fFinalize) {
+            g_block_file_maps.Invalidate(nLastBlockFile);
             status &= TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+        }
         status &= FileCommit(fileOld);
         fclose(fileOld);
     }
@@ -2096,6 +2313,8 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, CValidationState&
         // update nUndoPos in block index
         pindex->nUndoPos = _pos.nPos;
         pindex->nStatus |= BLOCK_HAVE_UNDO;
+        if (blockundo.fHaveRCT)
+            pindex->nStatus |= BLOCK_HAVE_RCT_UNDO;
         setDirtyBlockIndex.insert(pindex);
     }
 
@@ -2109,6 +2328,138 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/** Batches are sized by cost, a ring signature check costs GetCheckCost(CMLSAGCheck) script checks */
+static CCheckQueue<CMLSAGCheck> mlsagcheckqueue(128);
+
+void ThreadMLSAGCheck() {
+    RenameThread("bitcoinc-mlsagch");
+    mlsagcheckqueue.Thread();
+}
+
+//! Check queue cost of verifying a non bulletproof rangeproof, in signature checks
+static const unsigned int RANGEPROOF_CHECK_COST = 50;
+
+/** Outcome of the context free checks on one transaction of a block */
+struct CTxCheckResult
+{
+    bool fChecked = false;
+    bool fValid = false;
+    CValidationState state;
+    CBulletproofBatch bulletproofBatch;
+};
+
+/**
+ * Closure running CheckTransaction on one transaction of a block.
+ * Results are written to a slot owned by CheckBlock, which reports the first
+ * failure in block order regardless of which thread found it.
+ */
+class CTxCheck
+{
+private:
+    const CTransaction *ptx;
+    CTxCheckResult *pResult;
+
+public:
+    CTxCheck() : ptx(nullptr), pResult(nullptr) {}
+    CTxCheck(const CTransaction &txIn, CTxCheckResult &resultIn) : ptx(&txIn), pResult(&resultIn) {}
+
+    bool operator()()
+    {
+        pResult->fChecked = true;
+        pResult->fValid = CheckTransaction(*ptx, pResult->state, true, &pResult->bulletproofBatch);
+        return pResult->fValid;
+    }
+
+    void swap(CTxCheck &check)
+    {
+        std::swap(ptx, check.ptx);
+        std::swap(pResult, check.pResult);
+    }
+
+    /** Bulletproofs are only collected into the batch of the result, older rangeproofs are verified here */
+    unsigned int GetCost() const
+    {
+        unsigned int nCost = 1 + ptx->vpout.size();
+        if (!pResult->state.fBulletproofsActive) {
+            for (const auto &txout : ptx->vpout) {
+                if (txout->IsType(OUTPUT_RINGCT))
+                    nCost += RANGEPROOF_CHECK_COST;
+            }
+        }
+        return nCost;
+    }
+};
+
+static unsigned int GetCheckCost(const CTxCheck &check)
+{
+    return check.GetCost();
+}
+
+/** Blocks with fewer transactions are checked on the calling thread */
+static const size_t MIN_PARALLEL_TXCHECK = 4;
+
+static CCheckQueue<CTxCheck> txcheckqueue(128);
+
+void ThreadTxCheck() {
+    RenameThread("bitcoinc-txcheck");
+    txcheckqueue.Thread();
+}
+
+void PreCheckTransactions(const std::vector<CTransactionRef> &vtx, int64_t nAcceptTime)
+{
+    std::vector<CTransactionRef> vCheck;
+    for (const auto &tx : vtx) {
+        if (!IsPrechecked(*tx)) {
+            vCheck.push_back(tx);
+        }
+    }
+    if (vCheck.empty()) {
+        return;
+    }
+
+    CValidationState stateInit;
+    stateInit.fBulletproofsActive = nAcceptTime >= Params().GetConsensus().bulletproof_time;
+    std::vector<CTxCheckResult> vResults(vCheck.size());
+    std::vector<CTxCheck> vChecks;
+    vChecks.reserve(vCheck.size());
+    for (size_t i = 0; i < vCheck.size(); i++) {
+        vResults[i].state = stateInit;
+        vChecks.emplace_back(*vCheck[i], vResults[i]);
+    }
+    if (nScriptCheckThreads && vCheck.size() >= MIN_PARALLEL_TXCHECK) {
+        // The queue stops at the first failure, the rest are checked below
+        CCheckQueueControl<CTxCheck> control(&txcheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    // Bulletproofs of all passing transactions are verified together,
+    // valid ones are added to the rangeproof cache even if the batch fails
+    CBulletproofBatch bulletproofBatch(true);
+    for (size_t i = 0; i < vCheck.size(); i++) {
+        CTxCheckResult &result = vResults[i];
+        if (!result.fChecked) {
+            CTxCheck check(*vCheck[i], result);
+            check();
+        }
+        if (result.fValid) {
+            bulletproofBatch.Append(result.bulletproofBatch);
+        }
+    }
+
+    uint256 txidFailed;
+    if (bulletproofBatch.Size() > 0 && !bulletproofBatch.Verify(txidFailed)) {
+        LogPrint(BCLog::MEMPOOL, "%s: Batch of %u txns failed rangeproof verification at %s\n", __func__, vCheck.size(), txidFailed.ToString());
+        return; // Left to AcceptToMemoryPool to find and reject the invalid ones
+    }
+
+    for (size_t i = 0; i < vCheck.size(); i++) {
+        if (vResults[i].fValid) {
+            SetPrechecked(*vCheck[i], stateInit.fBulletproofsActive);
+        }
+    }
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -2261,7 +2612,10 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     // is enforced in ContextualCheckBlockHeader(); we wouldn't want to
     // re-enforce that rule here (at least until we make it impossible for
     // GetAdjustedTime() to go backward).
-    if (!CheckBlock(block, state, chainparams.GetConsensus(), !fJustCheck, !fJustCheck)) {
+    // Blocks checked by AcceptBlock in this session skip the transaction checks,
+    // the block read back from disk is still matched against its header.
+    bool fCheckTransactions = fJustCheck || !fBitcoinCMode || !(pindex->nFlags & BLOCK_CHECKED);
+    if (!CheckBlock(block, state, chainparams.GetConsensus(), !fJustCheck, !fJustCheck, fCheckTransactions)) {
         if (state.CorruptionPossible()) {
             // We don't write down blocks to disk if they may have been
             // corrupted, so this should be impossible unless we're having hardware
@@ -2272,10 +2626,11 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     }
 
     if (block.IsProofOfStake()) {
-        pindex->bnStakeModifier = ComputeStakeModifierV2(pindex->pprev, pindex->prevoutStake.hash);
+        pindex->bnStakeModifier = ComputeStakeModifierV2(pindex->pprev, pindex->GetPrevoutStake().hash);
         setDirtyBlockIndex.insert(pindex);
 
         uint256 hashProof, targetProofOfStake;
+        CPerfTimer timer(PERF_HISTOGRAM("connectblock:pos"));
         if (!CheckProofOfStake(state, pindex->pprev, *block.vtx[0], block.nTime, block.nBits, hashProof, targetProofOfStake)) {
             return error("%s: Check proof of stake failed.", __func__);
         }
@@ -2325,6 +2680,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     }
 
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
+    PERF_HISTOGRAM("connectblock:checks").Record(nTime1 - nTimeStart);
     LogPrint(BCLog::BENCH, "    - Sanity checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime1 - nTimeStart), nTimeCheck * MICRO, nTimeCheck * MILLI / nBlocksTotal);
 
     bool fEnforceBIP30 = true;
@@ -2430,11 +2786,15 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     unsigned int flags = GetBlockScriptFlags(pindex, chainparams.GetConsensus());
 
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
+    PERF_HISTOGRAM("connectblock:forks").Record(nTime2 - nTime1);
     LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime2 - nTime1), nTimeForks * MICRO, nTimeForks * MILLI / nBlocksTotal);
 
     CBlockUndo blockundo;
+    blockundo.fHaveRCT = true;
+    blockundo.nFirstRCTOutput = (pindex->pprev ? pindex->pprev->nAnonOutputs : 0) + 1;
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    CCheckQueueControl<CMLSAGCheck> controlAnon(fScriptChecks && nScriptCheckThreads ? &mlsagcheckqueue : nullptr);
 
     std::vector<int> prevheights;
     CAmount nFees = 0;
@@ -2563,14 +2923,17 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         if (!tx.IsCoinBase())
         {
             std::vector<CScriptCheck> vChecks;
+            std::vector<CMLSAGCheck> vAnonChecks;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : nullptr)) {
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i],
+                nScriptCheckThreads ? &vChecks : nullptr, true, nScriptCheckThreads ? &vAnonChecks : nullptr)) {
                 control.Wait();
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     txhash.ToString(), FormatStateMessage(state));
             };
 
             control.Add(vChecks);
+            controlAnon.Add(vAnonChecks);
 
             blockundo.vtxundo.push_back(CTxUndo());
             UpdateCoins(tx, view, blockundo.vtxundo.back(), pindex->nHeight);
@@ -2606,6 +2969,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                         const CCmpPubKey &ki = *((CCmpPubKey*)&vKeyImages[k*33]);
 
                         view.keyImages.push_back(std::make_pair(ki, txhash));
+                        blockundo.vKeyImages.push_back(ki);
                     };
                 };
             };
@@ -2674,10 +3038,13 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     };
 
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
+    PERF_HISTOGRAM("connectblock:inputs").Record(nTime3 - nTime2);
     LogPrint(BCLog::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs (%.2fms/blk)]\n", (unsigned)block.vtx.size(), MILLI * (nTime3 - nTime2), MILLI * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : MILLI * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * MICRO, nTimeConnect * MILLI / nBlocksTotal);
 
     if (!control.Wait())
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
+    if (!controlAnon.Wait())
+        return state.DoS(100, error("%s: MLSAG CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
 
     if (fBitcoinCMode)
     {
@@ -2709,21 +3076,15 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
                 if (pindex->nHeight % pDevFundSettings->nDevOutputPeriod == 0)
                 {
-                    CBlockIndex *pIndexDev = pindex->pprev;
-
-                    while( pIndexDev && pIndexDev->nHeight >= pindex->nHeight - pDevFundSettings->nDevOutputPeriod){
-                        nDevReward += (Params().GetProofOfStakeReward(pIndexDev, 0) * pDevFundSettings->nMinDevStakePercent)  / 100;
-                        pIndexDev = pIndexDev->pprev;
-                        if( !pIndexDev ) break;
-                    }
+                    nDevReward = g_stake_reward_cache.GetDevFundReward(pindex->pprev, pindex->nHeight, *pDevFundSettings);
 
                     if (nStakeReward != nDevReward + nCalculatedStakeReward)
                         return state.DoS(100, error("%s: bad stake-reward-dev (actual=%d vs expected=%d)", __func__, nStakeReward, nDevReward + nCalculatedStakeReward), REJECT_INVALID, "bad-cs-amount");
 
-                    CTxDestination dfDest = CBitcoinAddress(pDevFundSettings->sDevFundAddresses).Get();
-                    if (dfDest.type() == typeid(CNoDestination))
+                    CDevFundPayee devFund;
+                    if (!g_stake_reward_cache.GetDevFund(block.nTime, devFund) || devFund.dest.type() == typeid(CNoDestination))
                         return error("%s: Failed to get foundation fund destination: %s.", __func__, pDevFundSettings->sDevFundAddresses);
-                    CScript devFundScriptPubKey = GetScriptForDestination(dfDest);
+                    const CScript &devFundScriptPubKey = devFund.scriptPubKey;
 
                     // output 1 must be to the dev fund
                     const CTxOutStandard *outputDF = txCoinstake->vpout[1]->GetStandardOutput();
@@ -2759,13 +3120,15 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     };
 
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
+    PERF_HISTOGRAM("connectblock:verify").Record(nTime4 - nTime2);
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs (%.2fms/blk)]\n", nInputs - 1, MILLI * (nTime4 - nTime2), nInputs <= 1 ? 0 : MILLI * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * MICRO, nTimeVerify * MILLI / nBlocksTotal);
 
     if (fJustCheck)
         return true;
 
-    pindex->nMoneySupply = (pindex->pprev ? pindex->pprev->nMoneySupply : 0) + nMoneyCreated;
+    pindex->SetMoneySupply((pindex->pprev ? pindex->pprev->GetMoneySupply() : 0) + nMoneyCreated);
     pindex->nAnonOutputs = view.nLastRCTOutput;
+    blockundo.nLastRCTOutput = view.nLastRCTOutput;
     setDirtyBlockIndex.insert(pindex); // pindex has changed, must save to disk
 
     if (!fIsGenesisBlock
@@ -2777,43 +3140,61 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         setDirtyBlockIndex.insert(pindex);
     }
 
+    if (fBitcoinCMode) {
+        g_stake_input_index.AddBlock(block, blockundo, pindex);
+    }
 
-    if (fTimestampIndex)
-    {
-        unsigned int logicalTS = pindex->nTime;
-        unsigned int prevLogicalTS = 0;
-
-        // retrieve logical timestamp of the previous block
-        if (pindex->pprev)
-            if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
-                LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
-
-        if (logicalTS <= prevLogicalTS)
-        {
-            logicalTS = prevLogicalTS + 1;
-            LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
-        }
-
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
-            return AbortNode(state, "Failed to write timestamp index");
 
-        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
-            return AbortNode(state, "Failed to write blockhash index");
-    };
+    // Written with the other index rows of the block when the view is flushed
+    if (fTimestampIndex)
+        view.pindexTimestamp = pindex;
 
     assert(pindex->phashBlock);
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash(), pindex->nHeight);
 
     int64_t nTime5 = GetTimeMicros(); nTimeIndex += nTime5 - nTime4;
+    PERF_HISTOGRAM("connectblock:index").Record(nTime5 - nTime4);
     LogPrint(BCLog::BENCH, "    - Index writing: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime5 - nTime4), nTimeIndex * MICRO, nTimeIndex * MILLI / nBlocksTotal);
 
     int64_t nTime6 = GetTimeMicros(); nTimeCallbacks += nTime6 - nTime5;
+    PERF_HISTOGRAM("connectblock:callbacks").Record(nTime6 - nTime5);
     LogPrint(BCLog::BENCH, "    - Callbacks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime6 - nTime5), nTimeCallbacks * MICRO, nTimeCallbacks * MILLI / nBlocksTotal);
 
     return true;
 }
 
+bool ReadBlockIndexColdData(const CBlockIndex *pindex, CBlockIndexColdData &cold)
+{
+    AssertLockHeld(cs_main);
+    CDiskBlockIndex diskindex;
+    if (!pblocktree || !pblocktree->ReadBlockIndex(pindex->GetBlockHash(), diskindex)) {
+        return error("%s: Failed to read block index %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    cold.prevoutStake = diskindex.prevoutStake;
+    cold.nMoneySupply = diskindex.nMoneySupply;
+    return true;
+}
+
+/** Free the cold data of written block index entries far enough below the tip */
+static void PageOutBlockIndexColdData() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    // Only walk the index once enough entries built up
+    if (CBlockIndexColdRef::nResident < 2 * (size_t)BLOCK_INDEX_COLD_DEPTH) {
+        return;
+    }
+    int nPageOutBelow = chainActive.Height() - BLOCK_INDEX_COLD_DEPTH;
+    for (const auto &item : mapBlockIndex) {
+        CBlockIndex *pindex = item.second;
+        if (pindex->nHeight < nPageOutBelow
+            && pindex->HasColdData()
+            && (pindex->nFlags & BLOCK_ACCEPTED)
+            && !setDirtyBlockIndex.count(pindex)) {
+            pindex->PageOutColdData();
+        }
+    }
+}
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed depending on the mode we're called with
@@ -2897,6 +3278,7 @@ bool FlushStateToDisk(const CChainParams& chainparams, CValidationState &state,
                 if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                     return AbortNode(state, "Failed to write to block index database");
                 }
+                PageOutBlockIndexColdData();
             }
             // Finally remove any pruned files
             if (fFlushForPrune)
@@ -2912,6 +3294,10 @@ bool FlushStateToDisk(const CChainParams& chainparams, CValidationState &state,
             // overwrite one. Still, use a conservative safety factor of 2.
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
+            // The insight indices must not fall behind the best block on disk,
+            // blocks after it are replayed on restart and rewrite their rows.
+            if (!pblocktree->SyncIndexWrites())
+                return AbortNode(state, "Failed to write insight indices");
             // Flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return AbortNode(state, "Failed to write to coin database");
@@ -2961,50 +3347,44 @@ bool FlushView(CCoinsViewCache *view, CValidationState& state, bool fDisconnecti
     if (!view->Flush())
         return false;
 
+    // The insight rows of the block are written as one batch by the write-behind
+    // thread, FlushStateToDisk waits for them before writing the best block.
+    CIndexWriteJob job;
+    job.fDisconnecting = fDisconnecting;
     if (fAddressIndex)
     {
-        if (fDisconnecting)
-        {
-            if (!pblocktree->EraseAddressIndex(view->addressIndex))
-                return AbortNode(state, "Failed to delete address index");
-        } else
-        {
-            if (!pblocktree->WriteAddressIndex(view->addressIndex))
-                return AbortNode(state, "Failed to write address index");
-        };
-
-        if (!pblocktree->UpdateAddressUnspentIndex(view->addressUnspentIndex))
-            return AbortNode(state, "Failed to write address unspent index");
+        job.fAddressBalanceIndex = fAddressBalanceIndex;
+        job.addressIndex.swap(view->addressIndex);
+        job.addressUnspentIndex.swap(view->addressUnspentIndex);
     };
-
     if (fSpentIndex)
-    {
-        if (!pblocktree->UpdateSpentIndex(view->spentIndex))
-            return AbortNode(state, "Failed to write transaction index");
-    };
+        job.spentIndex.swap(view->spentIndex);
+    job.pindexTimestamp = view->pindexTimestamp;
+
+    if (!job.IsEmpty() && !pblocktree->QueueIndexWrite(std::move(job)))
+        return AbortNode(state, "Failed to write insight indices");
 
     view->addressIndex.clear();
     view->addressUnspentIndex.clear();
     view->spentIndex.clear();
+    view->pindexTimestamp = nullptr;
 
     if (fDisconnecting)
     {
-        for (auto &it : view->keyImages)
-            if (!pblocktree->EraseRCTKeyImage(it.first))
-                return error("%s: EraseRCTKeyImage failed, txn %s.", __func__, it.second.ToString());
-
-        if (view->anonOutputLinks.size() > 0)
-        {
-            for (auto &it : view->anonOutputLinks)
-            {
-                if (!pblocktree->EraseRCTOutput(it.second))
-                    return error("%s: EraseRCTOutput failed.", __func__);
+        // The pubkeys and key images come from the disconnected txns, erase the block's RCT rows in one batch
+        std::vector<std::pair<int64_t, CCmpPubKey> > vOutputs;
+        vOutputs.reserve(view->anonOutputLinks.size());
+        for (auto &it : view->anonOutputLinks)
+            vOutputs.push_back(std::make_pair(it.second, it.first));
 
-                if (!pblocktree->EraseRCTOutputLink(it.first))
-                    return error("%s: EraseRCTOutput failed.", __func__);
-            };
+        std::vector<CCmpPubKey> vKeyImages;
+        vKeyImages.reserve(view->keyImages.size());
+        for (auto &it : view->keyImages)
+            vKeyImages.push_back(it.first);
 
-        };
+        if ((!vOutputs.empty() || !vKeyImages.empty())
+            && !pblocktree->EraseRCTOutputs(vOutputs, vKeyImages))
+            return error("%s: EraseRCTOutputs failed.", __func__);
     } else
     {
         CDBBatch batch(*pblocktree);
@@ -3018,8 +3398,11 @@ bool FlushView(CCoinsViewCache *view, CValidationState& state, bool fDisconnecti
         for (auto &it : view->anonOutputLinks)
             batch.Write(std::make_pair(DB_RCTOUTPUT_LINK, it.first), it.second);
 
+        pblocktree->InsertKeyImageFilter(view->keyImages);
         if (!pblocktree->WriteBatch(batch))
             return error("%s: Write RCT outputs failed.", __func__);
+
+        pblocktree->UpdateRCTOutputCaches(view->anonOutputs);
     };
 
     view->nLastRCTOutput = 0;
@@ -3037,6 +3420,49 @@ static void AppendWarning(std::string& res, const std::string& warn)
     res += warn;
 }
 
+static std::shared_ptr<const CChainStatus> chainStatus; // std::atomic_load/atomic_store
+
+void PublishChainStatus()
+{
+    AssertLockHeld(cs_main);
+    const CBlockIndex *pindex = chainActive.Tip();
+    if (!pindex && !pindexBestHeader) {
+        std::atomic_store(&chainStatus, std::shared_ptr<const CChainStatus>());
+        return;
+    }
+
+    std::shared_ptr<CChainStatus> status = std::make_shared<CChainStatus>();
+    if (pindex) {
+        status->pindex = pindex;
+        status->hashBlock = pindex->GetBlockHash();
+        status->nHeight = pindex->nHeight;
+        status->nTime = pindex->GetBlockTime();
+        status->nMoneySupply = pindex->GetMoneySupply();
+    }
+    if (pindexBestHeader) {
+        status->nHeaderHeight = pindexBestHeader->nHeight;
+        status->nHeaderTime = pindexBestHeader->GetBlockTime();
+    }
+    std::atomic_store(&chainStatus, std::shared_ptr<const CChainStatus>(status));
+}
+
+std::shared_ptr<const CChainStatus> GetChainStatus()
+{
+    std::shared_ptr<const CChainStatus> status = std::atomic_load(&chainStatus);
+    if (status) {
+        return status;
+    }
+
+    // Nothing connected since startup
+    LOCK(cs_main);
+    status = std::atomic_load(&chainStatus);
+    if (!status) {
+        PublishChainStatus();
+        status = std::atomic_load(&chainStatus);
+    }
+    return status;
+}
+
 /** Check warning conditions and do some notifications on new chain tip set. */
 void UpdateTip(const CBlockIndex *pindexNew, const CChainParams& chainParams) {
     // New best block
@@ -3048,6 +3474,15 @@ void UpdateTip(const CBlockIndex *pindexNew, const CChainParams& chainParams) {
         g_best_block_cv.notify_all();
     }
 
+    if (fTimestampIndex) {
+        TimestampIndexSetTip(pindexNew);
+    }
+
+    if (fBitcoinCMode) {
+        PublishStakeTip(pindexNew);
+    }
+    PublishChainStatus();
+
     std::string warningMessages;
     if (!IsInitialBlockDownload())
     {
@@ -3250,6 +3685,7 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     const CBlock& blockConnecting = *pthisBlock;
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
+    PERF_HISTOGRAM("connecttip:read").Record(nTime2 - nTime1);
     int64_t nTime3;
 
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
@@ -3268,11 +3704,13 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
             return error("ConnectTip(): ConnectBlock %s failed", pindexNew->GetBlockHash().ToString());
         }
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
+        PERF_HISTOGRAM("connecttip:connect").Record(nTime3 - nTime2);
         LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTime2) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
         bool flushed = FlushView(&view, state, false);
         assert(flushed);
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
+    PERF_HISTOGRAM("connecttip:flush").Record(nTime4 - nTime3);
     LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, nTimeFlush * MICRO, nTimeFlush * MILLI / nBlocksTotal);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(chainparams, state, FlushStateMode::IF_NEEDED))
@@ -3281,6 +3719,7 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
         return false;
     }
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
+    PERF_HISTOGRAM("connecttip:chainstate").Record(nTime5 - nTime4);
     LogPrint(BCLog::BENCH, "  - Writing chainstate: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime5 - nTime4) * MILLI, nTimeChainState * MICRO, nTimeChainState * MILLI / nBlocksTotal);
     // Remove conflicting transactions from the mempool.;
     mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
@@ -3290,6 +3729,8 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     UpdateTip(pindexNew, chainparams);
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
+    PERF_HISTOGRAM("connecttip:postprocess").Record(nTime6 - nTime5);
+    PERF_HISTOGRAM("connecttip:total").Record(nTime6 - nTime1);
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
     LogPrint(BCLog::BENCH, "- Connect block: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime1) * MILLI, nTimeTotal * MICRO, nTimeTotal * MILLI / nBlocksTotal);
 
@@ -3387,6 +3828,7 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
     bool fBlocksDisconnected = false;
     DisconnectedBlockTransactions disconnectpool;
     while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
+        g_block_read_ahead.Chain(chainActive.Tip(), std::min(BLOCK_READ_AHEAD_DEPTH, chainActive.Height() - (pindexFork ? pindexFork->nHeight : -1)), true);
         if (!DisconnectTip(state, chainparams, &disconnectpool)) {
             // This is likely a fatal error, but keep the mempool consistent,
             // just in case. Only remove from the mempool in this case.
@@ -3412,6 +3854,9 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
             pindexIter = pindexIter->pprev;
         }
         nHeight = nTargetHeight;
+        if (!vpindexToConnect.empty()) {
+            g_block_read_ahead.Chain(vpindexToConnect.front(), vpindexToConnect.size(), false);
+        }
 
         // Connect new blocks.
         for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
@@ -3473,6 +3918,7 @@ static void NotifyHeaderTip() LOCKS_EXCLUDED(cs_main) {
             fNotify = true;
             fInitialBlockDownload = IsInitialBlockDownload();
             pindexHeaderOld = pindexHeader;
+            PublishChainStatus();
         }
     }
     // Send block tip changed notifications without cs_main
@@ -3919,6 +4365,23 @@ static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state,
         && fCheckPOW && !CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
         return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
 
+    // Check the target is within the bounds GetNextTargetRequired can return,
+    // the exact target needs the previous headers
+    if (fBitcoinCMode
+        && !block.hashPrevBlock.IsNull()) {
+        bool fNegative, fOverflow;
+        arith_uint256 bnTarget;
+        bnTarget.SetCompact(block.nBits, &fNegative, &fOverflow);
+
+        arith_uint256 bnTargetLimit = UintToArith256(consensusParams.powLimit);
+        const arith_uint256 bnImportLimit("000000000008ffffffffffffffffffffffffffffffffffffffffffffffffffff");
+        if (bnImportLimit > bnTargetLimit)
+            bnTargetLimit = bnImportLimit;
+
+        if (fNegative || fOverflow || bnTarget == 0 || bnTarget > bnTargetLimit)
+            return state.DoS(100, false, REJECT_INVALID, "bad-proof-of-stake", false, "proof-of-stake target out of range");
+    }
+
     return true;
 }
 
@@ -3996,7 +4459,7 @@ bool CheckStakeUnique(const CBlock &block, bool fUpdate)
     return AddToMapStakeSeen(kernel, blockHash);
 };
 
-bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot)
+bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckTransactions)
 {
     // These are checks that are independent of context.
 
@@ -4084,12 +4547,57 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
     };
 
     // Check transactions
-    for (const auto& tx : block.vtx){
-        if (!CheckTransaction(*tx, state, true)) // Check for duplicate inputs, TODO: UpdateCoins should return a bool, db/coinsview txn should be undone
-            return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
-                                 strprintf("Transaction check failed (tx hash %s) %s", tx->GetHash().ToString(), state.GetDebugMessage()));
+    // Bulletproofs from all transactions in the block are verified together afterwards
+    CBulletproofBatch bulletproofBatch;
+    if (!fCheckTransactions) {
+        // Rangeproofs are witness data, not covered by hashMerkleRoot
+        bool malleated = false;
+        uint256 hashWitness = BlockWitnessMerkleRoot(block, &malleated);
+        if (hashWitness != block.hashWitnessMerkleRoot || malleated)
+            return state.DoS(100, false, REJECT_INVALID, "bad-witness-merkle-match", true, "witness merkle root mismatch");
+    } else if (nScriptCheckThreads && block.vtx.size() >= MIN_PARALLEL_TXCHECK) {
+        std::vector<CTxCheckResult> vResults(block.vtx.size());
+        {
+            std::vector<CTxCheck> vChecks;
+            vChecks.reserve(block.vtx.size());
+            for (size_t i = 0; i < block.vtx.size(); i++) {
+                vResults[i].state = state;
+                vChecks.emplace_back(*block.vtx[i], vResults[i]);
+            }
+            CCheckQueueControl<CTxCheck> control(&txcheckqueue);
+            control.Add(vChecks);
+            control.Wait();
+        }
+
+        // The queue stops early on a failure, finish the transactions before it
+        // in order so the same transaction is reported as when checking serially
+        for (size_t i = 0; i < vResults.size(); i++) {
+            CTxCheckResult &result = vResults[i];
+            if (!result.fChecked) {
+                CTxCheck check(*block.vtx[i], result);
+                check();
+            }
+            if (!result.fValid) {
+                state = result.state;
+                return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
+                                     strprintf("Transaction check failed (tx hash %s) %s", block.vtx[i]->GetHash().ToString(), state.GetDebugMessage()));
+            }
+            bulletproofBatch.Append(result.bulletproofBatch);
+        }
+        state = vResults.back().state;
+    } else {
+        for (const auto& tx : block.vtx){
+            if (!CheckTransaction(*tx, state, true, &bulletproofBatch)) // Check for duplicate inputs, TODO: UpdateCoins should return a bool, db/coinsview txn should be undone
+                return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
+                                     strprintf("Transaction check failed (tx hash %s) %s", tx->GetHash().ToString(), state.GetDebugMessage()));
+        }
     }
 
+    uint256 txidFailed;
+    if (bulletproofBatch.Size() > 0 && !bulletproofBatch.Verify(txidFailed))
+        return state.DoS(100, false, REJECT_INVALID, "bad-rctout-rangeproof-verify", false,
+                         strprintf("Transaction check failed (tx hash %s)", txidFailed.ToString()));
+
     unsigned int nSigOps = 0;
     for (size_t i = 0; i < block.vtx.size(); i++)
     {
@@ -4102,7 +4610,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
     if (nSigOps * WITNESS_SCALE_FACTOR > MAX_BLOCK_SIGOPS_COST)
         return state.DoS(100, false, REJECT_INVALID, "bad-blk-sigops", false, "out-of-bounds SigOpCount");
 
-    if (fCheckPOW && fCheckMerkleRoot)
+    if (fCheckPOW && fCheckMerkleRoot && fCheckTransactions)
         block.fChecked = true;
 
     return true;
@@ -4281,6 +4789,16 @@ static bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationSta
     if (block.GetBlockTime() <= pindexPrev->GetMedianTimePast())
         return state.Invalid(false, REJECT_INVALID, "time-too-old", "block's timestamp is too early");
 
+    // Coinstake timestamp rules of ContextualCheckBlock, every block after genesis is proof of stake
+    if (fBitcoinCMode && nHeight > 0)
+    {
+        if (!CheckCoinStakeTimestamp(nHeight, block.GetBlockTime()))
+            return state.DoS(50, false, REJECT_INVALID, "bad-coinstake-time", false, strprintf("%s: coinstake timestamp violation nTimeBlock=%d", __func__, block.GetBlockTime()));
+
+        if (block.GetBlockTime() <= pindexPrev->GetPastTimeLimit() || FutureDrift(block.GetBlockTime()) < pindexPrev->GetBlockTime())
+            return state.DoS(50, false, REJECT_INVALID, "bad-block-time", false, strprintf("%s: block's timestamp is too early", __func__));
+    };
+
     // Check timestamp
     if (nHeight > 0
         && block.GetBlockTime() > nAdjustedTime + MAX_FUTURE_BLOCK_TIME)
@@ -4524,9 +5042,9 @@ bool ProcessDuplicateStakeHeader(CBlockIndex *pindex, NodeId nodeId)
                     pindexPrev->nStatus &= (~BLOCK_FAILED_VALID);
                     setDirtyBlockIndex.insert(pindexPrev);
 
-                    if (!pindexPrev->prevoutStake.IsNull()) {
+                    if (!pindexPrev->GetPrevoutStake().IsNull()) {
                         uint256 prevhash = pindexPrev->GetBlockHash();
-                        AddToMapStakeSeen(pindexPrev->prevoutStake, prevhash);
+                        AddToMapStakeSeen(pindexPrev->GetPrevoutStake(), prevhash);
                     }
 
                     pindexPrev->nStatus &= (~BLOCK_FAILED_CHILD);
@@ -4538,8 +5056,8 @@ bool ProcessDuplicateStakeHeader(CBlockIndex *pindex, NodeId nodeId)
             pindex->nStatus &= (~BLOCK_FAILED_CHILD);
         //};
 
-        if (!pindex->prevoutStake.IsNull()) {
-            AddToMapStakeSeen(pindex->prevoutStake, hash);
+        if (!pindex->GetPrevoutStake().IsNull()) {
+            AddToMapStakeSeen(pindex->GetPrevoutStake(), hash);
         }
         return true;
     }
@@ -4637,11 +5155,11 @@ size_t CountDelayedBlocks() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 
 
 
-bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, const uint256 *pHashChecked)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
+    uint256 hash = pHashChecked ? *pHashChecked : block.GetHash();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
     CBlockIndex *pindex = nullptr;
     if (hash != chainparams.GetConsensus().hashGenesisBlock) {
@@ -4672,7 +5190,7 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!pHashChecked && !CheckBlockHeader(block, state, chainparams.GetConsensus()))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -4731,11 +5249,41 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid)
 {
     if (first_invalid != nullptr) first_invalid->SetNull();
+
+    // Run the context free checks over the whole message before taking cs_main,
+    // a flood of bad headers is rejected without touching the block index.
+    const uint256 &hashGenesis = chainparams.GetConsensus().hashGenesisBlock;
+    std::vector<uint256> vHashes;
+    vHashes.reserve(headers.size());
+    CValidationState stateChecked = state;
+    for (const CBlockHeader& header : headers) {
+        vHashes.push_back(header.GetHash());
+        if (vHashes.back() != hashGenesis
+            && !CheckBlockHeader(header, stateChecked, chainparams.GetConsensus())) {
+            break;
+        }
+    }
+    const size_t nChecked = stateChecked.IsValid() ? vHashes.size() : vHashes.size() - 1;
+
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); ++i) {
+            const CBlockHeader& header = headers[i];
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!g_chainstate.AcceptBlockHeader(header, state, chainparams, &pindex)) {
+
+            const uint256 *pHashChecked = nullptr;
+            if (i < nChecked) {
+                pHashChecked = &vHashes[i];
+            } else
+            if (i == nChecked && !mapBlockIndex.count(vHashes[i])) {
+                // Known headers skip the checks, as in AcceptBlockHeader
+                state = stateChecked;
+                error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, vHashes[i].ToString(), FormatStateMessage(state));
+                if (first_invalid) *first_invalid = header;
+                return false;
+            }
+
+            if (!g_chainstate.AcceptBlockHeader(header, state, chainparams, &pindex, pHashChecked)) {
                 if (first_invalid) *first_invalid = header;
                 return false;
             }
@@ -4819,7 +5367,7 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CVali
 
     if (block.IsProofOfStake()) {
         pindex->SetProofOfStake();
-        pindex->prevoutStake = pblock->vtx[0]->vin[0].prevout;
+        pindex->SetPrevoutStake(pblock->vtx[0]->vin[0].prevout);
         if (!pindex->pprev
             || (pindex->pprev->bnStakeModifier.IsNull()
                 && pindex->pprev->GetBlockHash() != chainparams.GetConsensus().hashGenesisBlock)) {
@@ -4834,7 +5382,7 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CVali
                 return DelayBlock(pblock, state);
             }
         } else {
-            pindex->bnStakeModifier = ComputeStakeModifierV2(pindex->pprev, pindex->prevoutStake.hash);
+            pindex->bnStakeModifier = ComputeStakeModifierV2(pindex->pprev, pindex->GetPrevoutStake().hash);
         }
         pindex->nFlags &= ~BLOCK_DELAYED;
         setDirtyBlockIndex.insert(pindex);
@@ -4879,6 +5427,9 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CVali
         return AbortNode(state, std::string("System error: ") + e.what());
     }
 
+    // ConnectBlock can skip the transaction checks done above while this block waits to be connected
+    pindex->nFlags |= BLOCK_CHECKED;
+
     FlushStateToDisk(chainparams, state, FlushStateMode::NONE);
 
     CheckBlockIndex(chainparams.GetConsensus());
@@ -4946,10 +5497,6 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
     if (!g_chainstate.ActivateBestChain(state, chainparams, pblock))
         return error("%s: ActivateBestChain failed (%s)", __func__, FormatStateMessage(state));
 
-    if (smsg::fSecMsgEnabled && gArgs.GetBoolArg("-smsgscanincoming", false)) {
-        smsgModule.ScanBlock(*pblock);
-    }
-
     {
         assert(pindex);
         CheckDelayedBlocks(chainparams, pindex->GetBlockHash());
@@ -5008,7 +5555,7 @@ void PruneOneBlockFile(const int fileNumber)
         CBlockIndex* pindex = entry.second;
         if (pindex->nFile == fileNumber) {
             pindex->nStatus &= ~BLOCK_HAVE_DATA;
-            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nStatus &= ~(BLOCK_HAVE_UNDO | BLOCK_HAVE_RCT_UNDO);
             pindex->nFile = 0;
             pindex->nDataPos = 0;
             pindex->nUndoPos = 0;
@@ -5038,6 +5585,7 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        g_block_file_maps.Invalidate(*it);
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -5195,20 +5743,25 @@ fs::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix)
     return GetBlocksDir() / strprintf("%s%05u.dat", prefix, pos.nFile);
 }
 
-CBlockIndex * CChainState::InsertBlockIndex(const uint256& hash)
+CBlockIndex * CChainState::InsertBlockIndex(const uint256& hash, CBlockIndex* pindexNew)
 {
     AssertLockHeld(cs_main);
 
-    if (hash.IsNull())
+    if (hash.IsNull()) {
+        delete pindexNew;
         return nullptr;
+    }
 
     // Return existing
     BlockMap::iterator mi = mapBlockIndex.find(hash);
-    if (mi != mapBlockIndex.end())
+    if (mi != mapBlockIndex.end()) {
+        delete pindexNew;
         return (*mi).second;
+    }
 
-    // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    // Create new, or take the passed entry
+    if (!pindexNew)
+        pindexNew = new CBlockIndex();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -5217,7 +5770,9 @@ CBlockIndex * CChainState::InsertBlockIndex(const uint256& hash)
 
 bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlockTreeDB& blocktree)
 {
-    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }))
+    if (!blocktree.LoadBlockIndexGuts(consensus_params,
+            [this](const uint256& hash, CBlockIndex* pindexNew) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash, pindexNew); },
+            [this](size_t nEntries) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { mapBlockIndex.reserve(mapBlockIndex.size() + nEntries); }))
         return false;
 
     boost::this_thread::interruption_point();
@@ -5231,10 +5786,36 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
         vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
     }
     sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight)
+
+    // The proof of each block depends only on its nBits, work it out on all
+    // cores and leave summing along the chain to the ordered pass
+    std::vector<arith_uint256> vProof(vSortedByHeight.size());
     {
-        CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+        size_t nEntries = vSortedByHeight.size();
+        int nPartitions = std::max(1, std::min(GetNumCores(), MAX_BLOCK_INDEX_LOAD_THREADS));
+        auto prove = [&vSortedByHeight, &vProof](size_t nBegin, size_t nEnd) {
+            for (size_t i = nBegin; i < nEnd; ++i)
+                vProof[i] = GetBlockProof(*vSortedByHeight[i].second);
+        };
+        std::vector<std::thread> vThreads;
+        for (int i = 0; i < nPartitions; ++i) {
+            size_t nBegin = (nEntries * i) / nPartitions;
+            size_t nEnd = (nEntries * (i + 1)) / nPartitions;
+            if (i + 1 == nPartitions) {
+                prove(nBegin, nEnd);
+            } else {
+                vThreads.emplace_back(prove, nBegin, nEnd);
+            }
+        }
+        for (auto &t : vThreads) {
+            t.join();
+        }
+    }
+
+    for (size_t i = 0; i < vSortedByHeight.size(); ++i)
+    {
+        CBlockIndex* pindex = vSortedByHeight[i].second;
+        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + vProof[i];
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
@@ -5325,6 +5906,10 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams) EXCLUSIVE_LOCKS_RE
     pblocktree->ReadFlag("addressindex", fAddressIndex);
     LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
 
+    // Check whether we have an address balance index
+    pblocktree->ReadFlag("addressbalanceindex", fAddressBalanceIndex);
+    LogPrintf("%s: address balance index %s\n", __func__, fAddressBalanceIndex ? "enabled" : "disabled");
+
     // Check whether we have a timestamp index
     pblocktree->ReadFlag("timestampindex", fTimestampIndex);
     LogPrintf("%s: timestamp index %s\n", __func__, fTimestampIndex ? "enabled" : "disabled");
@@ -5359,6 +5944,10 @@ bool LoadChainTip(const CChainParams& chainparams)
         return false;
     }
     chainActive.SetTip(pindex);
+    if (fTimestampIndex) {
+        TimestampIndexSetTip(pindex);
+    }
+    PublishChainStatus();
 
     g_chainstate.PruneBlockIndexCandidates();
 
@@ -5415,6 +6004,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
             LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
             break;
         }
+        g_block_read_ahead.Chain(pindex, std::min(BLOCK_READ_AHEAD_DEPTH, pindex->nHeight - (chainActive.Height() - nCheckDepth)), nCheckLevel >= 2);
         CBlock block;
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
@@ -5476,6 +6066,83 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     return true;
 }
 
+bool ReplayBlockRange(const CChainParams& chainparams, int nStartHeight, int nEndHeight, size_t &nInsightRows, std::string &sError)
+{
+    AssertLockHeld(cs_main);
+    nInsightRows = 0;
+    if (nStartHeight < 1 || nStartHeight > nEndHeight || nEndHeight > chainActive.Height()) {
+        sError = "Block range out of bounds";
+        return false;
+    }
+
+    // As for VerifyDB, the rct output links and key images of the blocks are already in the db
+    struct VerifyingDBScope {
+        VerifyingDBScope() { fVerifyingDB = true; }
+        ~VerifyingDBScope() { fVerifyingDB = false; }
+    } verifyingDBScope;
+
+    CCoinsViewCache coins(pcoinsTip.get());
+    for (CBlockIndex *pindex = chainActive.Tip(); pindex->nHeight >= nStartHeight; pindex = pindex->pprev) {
+        if (ShutdownRequested()) {
+            sError = "Shutdown requested";
+            return false;
+        }
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA) || !(pindex->nStatus & BLOCK_HAVE_UNDO)) {
+            sError = strprintf("No block or undo data at height %d", pindex->nHeight);
+            return false;
+        }
+        if (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage() > nCoinCacheUsage) {
+            sError = strprintf("Rolling back to height %d does not fit in the coins cache, raise -dbcache", nStartHeight);
+            return false;
+        }
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus())) {
+            sError = strprintf("ReadBlockFromDisk failed at height %d", pindex->nHeight);
+            return false;
+        }
+        if (g_chainstate.DisconnectBlock(block, pindex, coins) != DISCONNECT_OK) {
+            sError = strprintf("Failed to disconnect block at height %d", pindex->nHeight);
+            return false;
+        }
+    }
+
+    // Each block is connected to its own view and flushed as ConnectTip does, the
+    // insight rows are counted and dropped, the indexes already hold them.
+    for (int nHeight = nStartHeight; nHeight <= nEndHeight; ++nHeight) {
+        if (ShutdownRequested()) {
+            sError = "Shutdown requested";
+            return false;
+        }
+        CBlockIndex *pindex = chainActive[nHeight];
+        int64_t nTime1 = GetTimeMicros();
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus())) {
+            sError = strprintf("ReadBlockFromDisk failed at height %d", nHeight);
+            return false;
+        }
+        int64_t nTime2 = GetTimeMicros();
+        PERF_HISTOGRAM("replay:read").Record(nTime2 - nTime1);
+
+        CValidationState state;
+        CCoinsViewCache view(&coins);
+        if (!g_chainstate.ConnectBlock(block, state, pindex, view, chainparams)) {
+            sError = strprintf("Failed to connect block at height %d: %s", nHeight, FormatStateMessage(state));
+            return false;
+        }
+        int64_t nTime3 = GetTimeMicros();
+        PERF_HISTOGRAM("replay:connect").Record(nTime3 - nTime2);
+
+        nInsightRows += view.addressIndex.size() + view.addressUnspentIndex.size() + view.spentIndex.size();
+        if (!view.Flush()) {
+            sError = strprintf("Failed to flush the view at height %d", nHeight);
+            return false;
+        }
+        PERF_HISTOGRAM("replay:flush").Record(GetTimeMicros() - nTime3);
+    }
+
+    return true;
+}
+
 /** Apply the effects of a block on the utxo cache, ignoring that it may already have been applied. */
 bool CChainState::RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& inputs, const CChainParams& params)
 {
@@ -5620,7 +6287,7 @@ bool CChainState::RewindBlockIndex(const CChainParams& params)
             // Reduce validity
             pindexIter->nStatus = std::min<unsigned int>(pindexIter->nStatus & BLOCK_VALID_MASK, BLOCK_VALID_TREE) | (pindexIter->nStatus & ~BLOCK_VALID_MASK);
             // Remove have-data flags.
-            pindexIter->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO);
+            pindexIter->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO | BLOCK_HAVE_RCT_UNDO);
             // Remove storage location.
             pindexIter->nFile = 0;
             pindexIter->nDataPos = 0;
@@ -5689,8 +6356,11 @@ void UnloadBlockIndex()
 {
     LOCK(cs_main);
     chainActive.SetTip(nullptr);
+    TimestampIndexSetTip(nullptr);
+    PublishStakeTip(nullptr);
     pindexBestInvalid = nullptr;
     pindexBestHeader = nullptr;
+    PublishChainStatus();
     mempool.clear();
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
@@ -5743,18 +6413,29 @@ bool LoadBlockIndex(const CChainParams& chainparams)
         LogPrintf("Initializing databases...\n");
         pblocktree->WriteFlag("v1", true);
 
+        // On a reindex InsightIndex builds the insight indexes on worker threads
+        // behind the validation thread, see init. Pruned blocks can't be read
+        // back, prune mode writes the rows in ConnectBlock.
+        const bool fBuildInsight = fReindex && !fPruneMode;
+
         // Use the provided setting for -addressindex in the new database
-        fAddressIndex = gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+        fAddressIndex = !fBuildInsight && gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
         pblocktree->WriteFlag("addressindex", fAddressIndex);
+        pblocktree->WriteFlag("compactaddressindex", true);
         LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
 
+        // Use the provided setting for -addressbalanceindex in the new database
+        fAddressBalanceIndex = !fBuildInsight && gArgs.GetBoolArg("-addressbalanceindex", DEFAULT_ADDRESSBALANCEINDEX);
+        pblocktree->WriteFlag("addressbalanceindex", fAddressBalanceIndex);
+        LogPrintf("%s: address balance index %s\n", __func__, fAddressBalanceIndex ? "enabled" : "disabled");
+
         // Use the provided setting for -timestampindex in the new database
-        fTimestampIndex = gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
+        fTimestampIndex = !fBuildInsight && gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
         pblocktree->WriteFlag("timestampindex", fTimestampIndex);
         LogPrintf("%s: timestamp index %s\n", __func__, fTimestampIndex ? "enabled" : "disabled");
 
         // Use the provided setting for -spentindex in the new database
-        fSpentIndex = gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+        fSpentIndex = !fBuildInsight && gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
         pblocktree->WriteFlag("spentindex", fSpentIndex);
         LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
     }
@@ -5792,17 +6473,20 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return g_chainstate.LoadGenesisBlock(chainparams);
 }
 
-bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
+/** A block found in a block file, with its position when reindexing */
+struct CExternalBlock
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
-
-    fAddressIndex = gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
-    fTimestampIndex = gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
-    fSpentIndex = gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    std::shared_ptr<CBlock> pblock;
+    CDiskBlockPos pos;
+    unsigned int nSize;
+};
 
-    int nLoaded = 0;
+/**
+ * Scan a block file for blocks and pass each deserialized block to fn, stops early if fn returns false.
+ * Takes over fileIn. If dbp is set the positions returned are in file dbp->nFile.
+ */
+static void ScanExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp, const std::function<bool(CExternalBlock&)>& fn)
+{
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
@@ -5833,91 +6517,242 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
             try {
                 // read block
                 uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
+                CExternalBlock ext;
+                if (dbp) {
+                    ext.pos = *dbp;
+                    ext.pos.nPos = nBlockPos;
+                }
+                ext.nSize = nSize;
                 blkdat.SetLimit(nBlockPos + nSize);
                 blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
+                ext.pblock = std::make_shared<CBlock>();
+                blkdat >> *ext.pblock;
                 nRewind = blkdat.GetPos();
 
-                uint256 hash = block.GetHash();
-                {
-                    LOCK(cs_main);
-                    // detect out of order blocks, and store them for later
-                    if (hash != chainparams.GetConsensus().hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
-                        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                                block.hashPrevBlock.ToString());
-                        if (dbp)
-                            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                        continue;
-                    }
+                if (!fn(ext))
+                    break;
+            } catch (const std::exception& e) {
+                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+            }
+        }
+    } catch (const std::runtime_error& e) {
+        AbortNode(std::string("System error: ") + e.what());
+    }
+}
 
-                    // process in case the block isn't known yet
-                    CBlockIndex* pindex = LookupBlockIndex(hash);
-                    if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
-                      CValidationState state;
-                      if (g_chainstate.AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr)) {
-                          nLoaded++;
-                      }
-                      if (state.IsError()) {
-                          break;
-                      }
-                    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
-                      LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
-                    }
-                }
+/** Out of order blocks found while reindexing are kept in memory up to this many bytes, beyond that they are read again from disk */
+static const uint64_t MAX_UNKNOWN_PARENT_CACHE_SIZE = 256 * 1024 * 1024;
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
-                    }
+/** Blocks with unknown parent, by parent hash (only used for reindex) */
+static std::multimap<uint256, CExternalBlock> mapBlocksUnknownParent;
+static uint64_t nUnknownParentCacheSize = 0;
+
+/** Accept one block found in an external block file, returns false to stop the import */
+static bool ProcessExternalBlock(const CChainParams& chainparams, CExternalBlock& ext, bool fHavePos, int& nLoaded)
+{
+    std::shared_ptr<CBlock> pblock = ext.pblock;
+    CDiskBlockPos *dbp = fHavePos ? &ext.pos : nullptr;
+    const CBlock& block = *pblock;
+
+    uint256 hash = block.GetHash();
+    {
+        LOCK(cs_main);
+        // detect out of order blocks, and store them for later
+        if (hash != chainparams.GetConsensus().hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
+            LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                    block.hashPrevBlock.ToString());
+            if (dbp) {
+                if (nUnknownParentCacheSize + ext.nSize <= MAX_UNKNOWN_PARENT_CACHE_SIZE) {
+                    nUnknownParentCacheSize += ext.nSize;
+                } else {
+                    ext.pblock.reset();
                 }
+                mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, ext));
+            }
+            return true;
+        }
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (g_chainstate.AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
-                            {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
-                    }
+        // process in case the block isn't known yet
+        CBlockIndex* pindex = LookupBlockIndex(hash);
+        if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
+          CValidationState state;
+          if (g_chainstate.AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr)) {
+              nLoaded++;
+          }
+          if (state.IsError()) {
+              return false;
+          }
+        } else if (hash != chainparams.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
+          LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
+        }
+    }
+
+    // Activate the genesis block so normal node progress can continue
+    if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+        CValidationState state;
+        if (!ActivateBestChain(state, chainparams)) {
+            return false;
+        }
+    }
+
+    NotifyHeaderTip();
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CExternalBlock>::iterator, std::multimap<uint256, CExternalBlock>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, CExternalBlock>::iterator it = range.first;
+            std::shared_ptr<CBlock> pblockrecursive = it->second.pblock;
+            if (pblockrecursive) {
+                nUnknownParentCacheSize -= it->second.nSize;
+            } else {
+                pblockrecursive = std::make_shared<CBlock>();
+                if (!ReadBlockFromDisk(*pblockrecursive, it->second.pos, chainparams.GetConsensus()))
+                    pblockrecursive.reset();
+            }
+            if (pblockrecursive)
+            {
+                LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                        head.ToString());
+                LOCK(cs_main);
+                CValidationState dummy;
+                if (g_chainstate.AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second.pos, nullptr))
+                {
+                    nLoaded++;
+                    queue.push_back(pblockrecursive->GetHash());
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+            NotifyHeaderTip();
         }
-    } catch (const std::runtime_error& e) {
-        AbortNode(std::string("System error: ") + e.what());
     }
+
+    return true;
+}
+
+bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
+{
+    int64_t nStart = GetTimeMillis();
+
+    int nLoaded = 0;
+    ScanExternalBlockFile(chainparams, fileIn, dbp, [&](CExternalBlock& ext) {
+        return ProcessExternalBlock(chainparams, ext, dbp != nullptr, nLoaded);
+    });
     if (nLoaded > 0)
         LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
     return nLoaded > 0;
 }
 
+/** Threads deserializing block files ahead of the reindex */
+static const int REINDEX_READER_THREADS = 2;
+/** Files read ahead of the one being accepted, bounds the memory held by deserialized blocks */
+static const int REINDEX_READAHEAD_FILES = 2;
+
+void ReindexBlockFiles(const CChainParams& chainparams)
+{
+    int nFiles = 0;
+    while (fs::exists(GetBlockPosFilename(CDiskBlockPos(nFiles, 0), "blk")))
+        nFiles++;
+
+    // Reader threads deserialize the next files while the blocks of the current file are accepted
+    std::vector<std::vector<CExternalBlock> > vFileBlocks(nFiles);
+    std::vector<bool> vFileRead(nFiles, false);
+    std::mutex cs_files;
+    std::condition_variable cond_files;
+    int nNextFile = 0; // Next file to be read
+    int nCurrentFile = 0; // File being accepted
+    std::atomic<bool> fStop(false);
+
+    auto reader = [&]() {
+        std::unique_lock<std::mutex> lock(cs_files);
+        while (!fStop) {
+            if (nNextFile >= nFiles)
+                return;
+            if (nNextFile > nCurrentFile + REINDEX_READAHEAD_FILES) {
+                cond_files.wait(lock);
+                continue;
+            }
+            int nFile = nNextFile++;
+            lock.unlock();
+
+            std::vector<CExternalBlock> vBlocks;
+            CDiskBlockPos pos(nFile, 0);
+            FILE *file = OpenBlockFile(pos, true);
+            if (file) { // An error is logged in OpenBlockFile
+                ScanExternalBlockFile(chainparams, file, &pos, [&](CExternalBlock& ext) {
+                    vBlocks.push_back(std::move(ext));
+                    return !fStop && !ShutdownRequested();
+                });
+            }
+
+            lock.lock();
+            vFileBlocks[nFile].swap(vBlocks);
+            vFileRead[nFile] = true;
+            cond_files.notify_all();
+        }
+    };
+
+    std::vector<std::thread> vReaders;
+    for (int i = 0; i < std::min(REINDEX_READER_THREADS, nFiles); i++)
+        vReaders.emplace_back(&TraceThread<std::function<void()> >, "reindexread", std::function<void()>(reader));
+
+    auto stop_readers = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(cs_files);
+            fStop = true;
+        }
+        cond_files.notify_all();
+        for (auto &t : vReaders)
+            t.join();
+        vReaders.clear();
+    };
+
+    try {
+        for (; nCurrentFile < nFiles; ) {
+            std::vector<CExternalBlock> vBlocks;
+            {
+                std::unique_lock<std::mutex> lock(cs_files);
+                while (!vFileRead[nCurrentFile]) {
+                    cond_files.wait_for(lock, std::chrono::milliseconds(100));
+                    boost::this_thread::interruption_point();
+                }
+                vBlocks.swap(vFileBlocks[nCurrentFile]);
+            }
+
+            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nCurrentFile);
+            int64_t nStart = GetTimeMillis();
+            int nLoaded = 0;
+            for (auto &ext : vBlocks) {
+                boost::this_thread::interruption_point();
+                try {
+                    if (!ProcessExternalBlock(chainparams, ext, true, nLoaded))
+                        break;
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                }
+                ext.pblock.reset();
+            }
+            if (nLoaded > 0)
+                LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+
+            {
+                std::lock_guard<std::mutex> lock(cs_files);
+                nCurrentFile++;
+            }
+            cond_files.notify_all();
+        }
+    } catch (...) {
+        stop_readers();
+        throw;
+    }
+    stop_readers();
+}
+
 void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
 {
     if (!fCheckBlockIndex) {
@@ -6132,7 +6967,62 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/**
+ * Version 2 adds a MAC to each transaction, keyed with a secret kept in the data
+ * directory, attesting that it passed CheckTransaction in this node's mempool.
+ */
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_MAC = 1;
+//! Transactions read from mempool.dat before they are prechecked together and accepted
+static const size_t MEMPOOL_LOAD_BATCH = 256;
+static const size_t MEMPOOL_DUMP_KEY_SIZE = 32;
+
+/** Read the mempool.dat MAC key, if fCreate a new key is written when there's none */
+static bool GetMempoolDumpKey(std::vector<unsigned char> &vKey, bool fCreate)
+{
+    fs::path path = GetDataDir() / "mempool.key";
+    vKey.resize(MEMPOOL_DUMP_KEY_SIZE);
+
+    FILE *file = fsbridge::fopen(path, "rb");
+    if (file) {
+        bool fRead = fread(vKey.data(), 1, vKey.size(), file) == vKey.size();
+        fclose(file);
+        if (fRead) {
+            return true;
+        }
+        LogPrintf("%s: Ignoring truncated %s\n", __func__, path.string());
+    }
+    if (!fCreate) {
+        return false;
+    }
+
+    GetStrongRandBytes(vKey.data(), vKey.size());
+    file = fsbridge::fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    bool fWritten = fwrite(vKey.data(), 1, vKey.size(), file) == vKey.size();
+    fWritten = FileCommit(file) && fWritten;
+    fclose(file);
+    return fWritten;
+}
+
+/**
+ * MAC of a mempool transaction's CheckTransaction status. Commits to the rules it
+ * was checked under and the client version, a new release checks everything again.
+ */
+static uint256 GetMempoolDumpMAC(const std::vector<unsigned char> &vKey, const CTransaction &tx, bool fBulletproofsActive)
+{
+    uint256 mac;
+    const int nClientVersion = CLIENT_VERSION;
+    const unsigned char nFlags = fBulletproofsActive ? 1 : 0;
+    CHMAC_SHA256(vKey.data(), vKey.size())
+        .Write((const unsigned char*)&nClientVersion, sizeof(nClientVersion))
+        .Write(tx.GetWitnessHash().begin(), 32)
+        .Write(&nFlags, 1)
+        .Finalize(mac.begin());
+    return mac;
+}
 
 bool LoadMempool()
 {
@@ -6149,34 +7039,78 @@ bool LoadMempool()
     int64_t expired = 0;
     int64_t failed = 0;
     int64_t already_there = 0;
+    int64_t trusted = 0;
     int64_t nNow = GetTime();
+    const int64_t nBulletproofTime = chainparams.GetConsensus().bulletproof_time;
 
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != MEMPOOL_DUMP_VERSION && version != MEMPOOL_DUMP_VERSION_NO_MAC) {
             return false;
         }
-        uint64_t num;
-        file >> num;
-        while (num--) {
+
+        std::vector<unsigned char> vKey;
+        bool fTrustDump = version == MEMPOOL_DUMP_VERSION
+            && gArgs.GetBoolArg("-trustmempooldump", DEFAULT_TRUST_MEMPOOL_DUMP)
+            && GetMempoolDumpKey(vKey, false);
+
+        struct LoadedTx {
             CTransactionRef tx;
             int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+        };
+        std::vector<LoadedTx> vBatch;
+        uint64_t num;
+        file >> num;
+        while (num) {
+            // Read a batch, the transactions without a valid MAC have their context-free
+            // checks run together on the txcheck threads before they are accepted in order
+            vBatch.clear();
+            std::vector<CTransactionRef> vCheck[2];
+            while (num && vBatch.size() < MEMPOOL_LOAD_BATCH) {
+                num--;
+                CTransactionRef tx;
+                int64_t nTime;
+                int64_t nFeeDelta;
+                uint256 mac;
+                file >> tx;
+                file >> nTime;
+                file >> nFeeDelta;
+                if (version == MEMPOOL_DUMP_VERSION) {
+                    file >> mac;
+                }
+
+                CAmount amountdelta = nFeeDelta;
+                if (amountdelta) {
+                    mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+                }
+                if (nTime + nExpiryTimeout <= nNow) {
+                    ++expired;
+                    continue;
+                }
+
+                bool fBulletproofsActive = nTime >= nBulletproofTime;
+                if (fTrustDump && mac == GetMempoolDumpMAC(vKey, *tx, fBulletproofsActive)) {
+                    SetPrechecked(*tx, fBulletproofsActive);
+                    ++trusted;
+                } else {
+                    vCheck[fBulletproofsActive].push_back(tx);
+                }
+                vBatch.push_back(LoadedTx{tx, nTime});
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, nTime,
-                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
-                                           false /* test_accept */, false /* ignore_locks */);
+
+            PreCheckTransactions(vCheck[0], nBulletproofTime - 1);
+            PreCheckTransactions(vCheck[1], nBulletproofTime);
+
+            for (const auto &loaded : vBatch) {
+                const CTransactionRef &tx = loaded.tx;
+                CValidationState state;
+                {
+                    LOCK(cs_main);
+                    AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, loaded.nTime,
+                                               nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
+                                               false /* test_accept */, false /* ignore_locks */);
+                }
                 if (state.IsValid()) {
                     ++count;
                 } else {
@@ -6190,8 +7124,6 @@ bool LoadMempool()
                         ++failed;
                     }
                 }
-            } else {
-                ++expired;
             }
             if (ShutdownRequested())
                 return false;
@@ -6207,7 +7139,7 @@ bool LoadMempool()
         return false;
     }
 
-    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there\n", count, failed, expired, already_there);
+    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there, %i prechecked by MAC\n", count, failed, expired, already_there, trusted);
     return true;
 }
 
@@ -6229,6 +7161,11 @@ bool DumpMempool()
     int64_t mid = GetTimeMicros();
 
     try {
+        std::vector<unsigned char> vKey;
+        if (!GetMempoolDumpKey(vKey, true)) {
+            throw std::runtime_error("Unable to write mempool.key");
+        }
+
         FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat.new", "wb");
         if (!filestr) {
             return false;
@@ -6239,11 +7176,14 @@ bool DumpMempool()
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
 
+        // Everything in the mempool passed CheckTransaction under the rules of its accept time
+        const int64_t nBulletproofTime = Params().GetConsensus().bulletproof_time;
         file << (uint64_t)vinfo.size();
         for (const auto& i : vinfo) {
             file << *(i.tx);
             file << (int64_t)i.nTime;
             file << (int64_t)i.nFeeDelta;
+            file << GetMempoolDumpMAC(vKey, *i.tx, i.nTime >= nBulletproofTime);
             mapDeltas.erase(i.tx->GetHash());
         }
         file << mapDeltas;
@@ -32,6 +32,7 @@
 #include <atomic>
 
 class CBlockIndex;
+class CBlockUndo;
 class CBlockTreeDB;
 class CChainParams;
 class CCoinsViewDB;
@@ -39,6 +40,7 @@ class CInv;
 class CConnman;
 class CScriptCheck;
 class CBlockPolicyEstimator;
+class CTxLookupCache;
 class CTxMemPool;
 class CValidationState;
 struct ChainTxData;
@@ -122,7 +124,10 @@ static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX_ = true; // required for staking
 #define DEFAULT_TXINDEX (gArgs.GetBoolArg("-legacymode", false) ? false : DEFAULT_TXINDEX_)
 static const bool DEFAULT_CSINDEX = false;
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+static const bool DEFAULT_BLOCKSTATSINDEX = false;
 static const bool DEFAULT_ADDRESSINDEX = false;
+static const bool DEFAULT_ADDRESSBALANCEINDEX = false;
 static const bool DEFAULT_TIMESTAMPINDEX = false;
 static const bool DEFAULT_SPENTINDEX = false;
 static const unsigned int DEFAULT_DB_MAX_OPEN_FILES = 64; // set to 1000 for insight
@@ -130,6 +135,8 @@ static const bool DEFAULT_DB_COMPRESSION = false; // set to true for insight
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -trustmempooldump */
+static const bool DEFAULT_TRUST_MEMPOOL_DUMP = true;
 /** Default for -mempoolreplacement */
 static const bool DEFAULT_ENABLE_REPLACEMENT = true;
 /** Default for using fee filter */
@@ -142,8 +149,11 @@ static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
 static const int MAX_UNCONNECTING_HEADERS = 10;
 
 static const bool DEFAULT_PEERBLOOMFILTERS = true;
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
 
 static const size_t MAX_STAKE_SEEN_SIZE = 1000;
+/** Block index entries below the tip by more than this page out their stake prevout and money supply */
+static const int BLOCK_INDEX_COLD_DEPTH = 2000;
 
 inline int64_t FutureDrift(int64_t nTime) { return nTime + 15; } // FutureDriftV2
 
@@ -187,6 +197,8 @@ extern CCriticalSection cs_main;
 extern CBlockPolicyEstimator feeEstimator;
 extern CTxMemPool mempool;
 extern std::atomic_bool g_is_mempool_loaded;
+/** Confirmed transactions recently returned by GetTransaction, guarded by cs_main */
+extern CTxLookupCache g_tx_lookup_cache;
 typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap& mapBlockIndex;
 extern std::map<COutPoint, uint256> mapStakeSeen;
@@ -205,6 +217,7 @@ extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
 extern bool fAddressIndex;
+extern bool fAddressBalanceIndex;
 extern bool fSpentIndex;
 extern bool fTimestampIndex;
 extern bool fIsBareMultisigStd;
@@ -301,6 +314,8 @@ FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 fs::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = nullptr);
+/** Reindex from the blk files, deserializing upcoming files on reader threads while blocks are accepted */
+void ReindexBlockFiles(const CChainParams& chainparams);
 /** Ensures we have a genesis block in the block tree, possibly writing one to disk. */
 bool LoadGenesisBlock(const CChainParams& chainparams);
 /** Returns true if the block index needs to be reindexed. */
@@ -314,6 +329,10 @@ bool LoadChainTip(const CChainParams& chainparams);
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the ring signature checking thread */
+void ThreadMLSAGCheck();
+/** Run an instance of the block transaction checking thread */
+void ThreadTxCheck();
 /** Return the average number of blocks that other nodes claim to have */
 int GetNumBlocksOfPeers();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
@@ -359,9 +378,43 @@ bool FlushView(CCoinsViewCache *view, CValidationState& state, bool fDisconnecti
 /** Update chainActive and related internal data structures. */
 void UpdateTip(const CBlockIndex *pindexNew, const CChainParams& chainParams);
 
+/**
+ * Chain state polled by the GUI, interfaces::Node and RPC monitors, republished
+ * on every tip and header tip change. Never modified once published, pollers
+ * read it instead of taking cs_main.
+ */
+struct CChainStatus
+{
+    const CBlockIndex *pindex = nullptr; // Tip, only immutable fields are read
+    uint256 hashBlock;
+    int nHeight = -1;
+    int64_t nTime = 0;
+    CAmount nMoneySupply = 0;
+    int nHeaderHeight = -1; // pindexBestHeader, -1 if unset
+    int64_t nHeaderTime = 0;
+};
+
+/** Publish the status of chainActive and pindexBestHeader */
+void PublishChainStatus() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+/** The last published chain status, takes cs_main to publish the first one. Null before the block index is loaded. */
+std::shared_ptr<const CChainStatus> GetChainStatus();
+
 /** Prune block files up to a given height */
 void PruneBlockFilesManual(int nManualPruneHeight);
 
+/**
+ * Run the context-free checks of tx (CheckTransaction, including the CT rangeproofs) without cs_main.
+ * AcceptToMemoryPool skips them for a transaction that passed, so only the checks against
+ * the chain state run under the lock. Failures are not remembered, ATMP reports them.
+ */
+bool PreCheckTransaction(const CTransactionRef &tx, int64_t nAcceptTime);
+
+/**
+ * PreCheckTransaction for a group of transactions, checked on the txcheck threads
+ * with their bulletproofs verified in one batch.
+ */
+void PreCheckTransactions(const std::vector<CTransactionRef> &vtx, int64_t nAcceptTime);
+
 /** (try to) add transaction to memory pool
  * plTxnReplaced will be appended to with all transactions replaced from mempool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx,
@@ -486,6 +539,7 @@ bool ReadTransactionFromDiskBlock(const CBlockIndex *pindex, int nIndex, CTransa
 
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -493,8 +547,10 @@ bool AddToMapStakeSeen(const COutPoint &kernel, const uint256 &blockHash);
 bool CheckStakeUnused(const COutPoint &kernel);
 bool CheckStakeUnique(const CBlock &block, bool fUpdate=true);
 
-/** Context-independent validity checks */
-bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
+/** Context-independent validity checks
+ *  When fCheckTransactions is false the transactions must have been checked before,
+ *  only their witness data is matched against the header. */
+bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckTransactions = true);
 
 unsigned int GetNextTargetRequired(const CBlockIndex *pindexLast);
 
@@ -536,6 +592,15 @@ public:
     bool VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth);
 };
 
+/**
+ * Connect the active chain blocks from nStartHeight to nEndHeight again, on a copy of
+ * the chainstate rolled back in memory with the undo data, to time block validation.
+ * The chainstate and indexes are left as they are, each phase is recorded in the
+ * "connectblock:", "verify:" and "replay:" performance histograms.
+ * nInsightRows is set to the number of insight index rows the blocks produce.
+ */
+bool ReplayBlockRange(const CChainParams& chainparams, int nStartHeight, int nEndHeight, size_t &nInsightRows, std::string &sError) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /** Replay blocks that aren't fully applied to the database. */
 bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
 
@@ -602,7 +667,7 @@ CBlockFileInfo* GetBlockFileInfo(size_t n);
 /** Dump the mempool to disk. */
 bool DumpMempool();
 
-/** Load the mempool from disk. */
+/** Load the mempool from disk. Transactions with a valid MAC skip CheckTransaction, see -trustmempooldump */
 bool LoadMempool();
 
 //! Check whether the block associated with this index entry is pruned or not.
@@ -19,25 +19,132 @@
 
 #include <boost/signals2/signal.hpp>
 
+/**
+ * The background callbacks of one registered CValidationInterface. Each
+ * listener has its own queue so a slow listener, such as a wallet scanning
+ * a block, doesn't hold up the others while callbacks of a single listener
+ * still run in order.
+ */
+struct ValidationInterfaceQueue {
+    CValidationInterface *m_listener;
+    //! Cleared on unregistering, callbacks still queued are then dropped
+    std::atomic<bool> m_active{true};
+    SingleThreadedSchedulerClient m_schedulerClient;
+    //! Mempool additions of the last queued callback, more are added until any other callback is queued
+    std::shared_ptr<std::vector<CTransactionRef>> m_pending_txns; // Guarded by MainSignalsInstance::m_cs_queues
+
+    ValidationInterfaceQueue(CValidationInterface *listener, CScheduler *pscheduler)
+        : m_listener(listener), m_schedulerClient(pscheduler, CScheduler::Priority::HIGH) {}
+};
+
 struct MainSignalsInstance {
-    boost::signals2::signal<void (const CBlockIndex *, const CBlockIndex *, bool fInitialDownload)> UpdatedBlockTip;
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionAddedToMempool;
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex, const std::vector<CTransactionRef>&)> BlockConnected;
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &)> BlockDisconnected;
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionRemovedFromMempool;
-    boost::signals2::signal<void (const CBlockLocator &)> ChainStateFlushed;
     boost::signals2::signal<void (int64_t nBestBlockTime, CConnman* connman)> Broadcast;
     boost::signals2::signal<void (const CBlock&, const CValidationState&)> BlockChecked;
     boost::signals2::signal<void (const CBlockIndex *, const std::shared_ptr<const CBlock>&)> NewPoWValidBlock;
     boost::signals2::signal<void (const smsg::SecureMessage *psmsg, const uint160 &)> NewSecureMessage;
     boost::signals2::signal<void (const std::string &, const CTransactionRef &)> TransactionAddedToWallet;
 
+    CScheduler *m_pscheduler;
+
     // We are not allowed to assume the scheduler only runs in one thread,
     // but must ensure all callbacks happen in-order, so we end up creating
-    // our own queue here :(
+    // our own queues here :(
+    CCriticalSection m_cs_queues;
+    std::vector<std::unique_ptr<ValidationInterfaceQueue>> m_queues GUARDED_BY(m_cs_queues);
+    // Queues of unregistered listeners move here once their callbacks ran and are
+    // reused by the next listener registered. They are kept until the scheduler is
+    // unregistered as the scheduler may still hold tasks referring to them.
+    std::vector<std::unique_ptr<ValidationInterfaceQueue>> m_free_queues GUARDED_BY(m_cs_queues);
+
+    // Runs functions of CallFunctionInValidationInterfaceQueue when no
+    // listener is registered.
     SingleThreadedSchedulerClient m_schedulerClient;
 
-    explicit MainSignalsInstance(CScheduler *pscheduler) : m_schedulerClient(pscheduler) {}
+    explicit MainSignalsInstance(CScheduler *pscheduler) : m_pscheduler(pscheduler), m_schedulerClient(pscheduler, CScheduler::Priority::HIGH) {}
+
+    /** Queue func to be called for each registered listener */
+    void Enqueue(std::function<void (CValidationInterface *)> func)
+    {
+        LOCK(m_cs_queues);
+        for (const auto &queue : m_queues) {
+            if (!queue->m_active) continue;
+            queue->m_pending_txns.reset();
+            ValidationInterfaceQueue *pqueue = queue.get();
+            pqueue->m_schedulerClient.AddToProcessQueue([pqueue, func] {
+                if (pqueue->m_active) {
+                    func(pqueue->m_listener);
+                }
+            });
+        }
+    }
+
+    /**
+     * Queue func to be called with the mempool addition ptx for each registered listener,
+     * joining the additions of the last queued callback if it hasn't run yet
+     */
+    void EnqueueMempoolTx(const CTransactionRef &ptx, std::function<void (CValidationInterface *, const std::vector<CTransactionRef> &)> func)
+    {
+        LOCK(m_cs_queues);
+        for (const auto &queue : m_queues) {
+            if (!queue->m_active) continue;
+            if (queue->m_pending_txns && queue->m_pending_txns->size() < MAX_MEMPOOL_NOTIFY_BATCH) {
+                queue->m_pending_txns->push_back(ptx);
+                continue;
+            }
+            auto batch = std::make_shared<std::vector<CTransactionRef>>(1, ptx);
+            queue->m_pending_txns = batch;
+            ValidationInterfaceQueue *pqueue = queue.get();
+            pqueue->m_schedulerClient.AddToProcessQueue([this, pqueue, batch, func] {
+                {
+                    // Close the batch before reading it
+                    LOCK(m_cs_queues);
+                    if (pqueue->m_pending_txns == batch) {
+                        pqueue->m_pending_txns.reset();
+                    }
+                }
+                if (pqueue->m_active) {
+                    func(pqueue->m_listener, *batch);
+                }
+            });
+        }
+    }
+
+    /** Give the queue of an unregistered listener to m_free_queues after the callbacks queued before */
+    void RetireQueue(ValidationInterfaceQueue *pqueue) EXCLUSIVE_LOCKS_REQUIRED(m_cs_queues)
+    {
+        pqueue->m_active = false;
+        pqueue->m_schedulerClient.AddToProcessQueue([this, pqueue] {
+            LOCK(m_cs_queues);
+            for (auto it = m_queues.begin(); it != m_queues.end(); ++it) {
+                if (it->get() == pqueue) {
+                    pqueue->m_pending_txns.reset();
+                    m_free_queues.push_back(std::move(*it));
+                    m_queues.erase(it);
+                    return;
+                }
+            }
+        });
+    }
+
+    /** Call func once every queue has run the callbacks queued before it */
+    void CallAfterQueued(std::function<void ()> func)
+    {
+        LOCK(m_cs_queues);
+        // Unregistered listeners are waited for too, one may still be running a callback
+        std::vector<SingleThreadedSchedulerClient *> clients{&m_schedulerClient};
+        for (const auto &queue : m_queues) {
+            clients.push_back(&queue->m_schedulerClient);
+        }
+        auto remaining = std::make_shared<std::atomic<size_t>>(clients.size());
+        auto shared_func = std::make_shared<std::function<void ()>>(std::move(func));
+        for (SingleThreadedSchedulerClient *client : clients) {
+            client->AddToProcessQueue([remaining, shared_func] {
+                if (--*remaining == 0) {
+                    (*shared_func)();
+                }
+            });
+        }
+    }
 };
 
 static CMainSignals g_signals;
@@ -54,12 +161,31 @@ void CMainSignals::UnregisterBackgroundSignalScheduler() {
 void CMainSignals::FlushBackgroundCallbacks() {
     if (m_internals) {
         m_internals->m_schedulerClient.EmptyQueue();
+        // Retiring a queue moves it between the lists, they can't be iterated while callbacks run
+        std::vector<SingleThreadedSchedulerClient *> clients;
+        {
+            LOCK(m_internals->m_cs_queues);
+            for (const auto &queue : m_internals->m_queues) {
+                clients.push_back(&queue->m_schedulerClient);
+            }
+            for (const auto &queue : m_internals->m_free_queues) {
+                clients.push_back(&queue->m_schedulerClient);
+            }
+        }
+        for (SingleThreadedSchedulerClient *client : clients) {
+            client->EmptyQueue();
+        }
     }
 }
 
 size_t CMainSignals::CallbacksPending() {
     if (!m_internals) return 0;
-    return m_internals->m_schedulerClient.CallbacksPending();
+    size_t nPending = m_internals->m_schedulerClient.CallbacksPending();
+    LOCK(m_internals->m_cs_queues);
+    for (const auto &queue : m_internals->m_queues) {
+        nPending = std::max(nPending, queue->m_schedulerClient.CallbacksPending());
+    }
+    return nPending;
 }
 
 void CMainSignals::RegisterWithMempoolSignals(CTxMemPool& pool) {
@@ -76,12 +202,19 @@ CMainSignals& GetMainSignals()
 }
 
 void RegisterValidationInterface(CValidationInterface* pwalletIn) {
-    g_signals.m_internals->UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->TransactionAddedToMempool.connect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
-    g_signals.m_internals->BlockConnected.connect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->BlockDisconnected.connect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
-    g_signals.m_internals->TransactionRemovedFromMempool.connect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1));
-    g_signals.m_internals->ChainStateFlushed.connect(boost::bind(&CValidationInterface::ChainStateFlushed, pwalletIn, _1));
+    {
+        MainSignalsInstance &internals = *g_signals.m_internals;
+        LOCK(internals.m_cs_queues);
+        if (internals.m_free_queues.empty()) {
+            internals.m_queues.emplace_back(new ValidationInterfaceQueue(pwalletIn, internals.m_pscheduler));
+        } else {
+            std::unique_ptr<ValidationInterfaceQueue> queue = std::move(internals.m_free_queues.back());
+            internals.m_free_queues.pop_back();
+            queue->m_listener = pwalletIn;
+            queue->m_active = true;
+            internals.m_queues.push_back(std::move(queue));
+        }
+    }
     g_signals.m_internals->Broadcast.connect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
     g_signals.m_internals->BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
     g_signals.m_internals->NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
@@ -90,14 +223,16 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn) {
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
+    {
+        LOCK(g_signals.m_internals->m_cs_queues);
+        for (const auto &queue : g_signals.m_internals->m_queues) {
+            if (queue->m_listener == pwalletIn && queue->m_active) {
+                g_signals.m_internals->RetireQueue(queue.get());
+            }
+        }
+    }
     g_signals.m_internals->BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
     g_signals.m_internals->Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
-    g_signals.m_internals->ChainStateFlushed.disconnect(boost::bind(&CValidationInterface::ChainStateFlushed, pwalletIn, _1));
-    g_signals.m_internals->TransactionAddedToMempool.disconnect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
-    g_signals.m_internals->BlockConnected.disconnect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->BlockDisconnected.disconnect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
-    g_signals.m_internals->TransactionRemovedFromMempool.disconnect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1));
-    g_signals.m_internals->UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
     g_signals.m_internals->NewPoWValidBlock.disconnect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
     g_signals.m_internals->TransactionAddedToWallet.disconnect(boost::bind(&CValidationInterface::TransactionAddedToWallet, pwalletIn, _1, _2));
     g_signals.m_internals->NewSecureMessage.disconnect(boost::bind(&CValidationInterface::NewSecureMessage, pwalletIn, _1, _2));
@@ -107,20 +242,22 @@ void UnregisterAllValidationInterfaces() {
     if (!g_signals.m_internals) {
         return;
     }
+    {
+        LOCK(g_signals.m_internals->m_cs_queues);
+        for (const auto &queue : g_signals.m_internals->m_queues) {
+            if (queue->m_active) {
+                g_signals.m_internals->RetireQueue(queue.get());
+            }
+        }
+    }
     g_signals.m_internals->BlockChecked.disconnect_all_slots();
     g_signals.m_internals->Broadcast.disconnect_all_slots();
-    g_signals.m_internals->ChainStateFlushed.disconnect_all_slots();
-    g_signals.m_internals->TransactionAddedToMempool.disconnect_all_slots();
-    g_signals.m_internals->BlockConnected.disconnect_all_slots();
-    g_signals.m_internals->BlockDisconnected.disconnect_all_slots();
-    g_signals.m_internals->TransactionRemovedFromMempool.disconnect_all_slots();
-    g_signals.m_internals->UpdatedBlockTip.disconnect_all_slots();
     g_signals.m_internals->NewPoWValidBlock.disconnect_all_slots();
     g_signals.m_internals->NewSecureMessage.disconnect_all_slots();
 }
 
 void CallFunctionInValidationInterfaceQueue(std::function<void ()> func) {
-    g_signals.m_internals->m_schedulerClient.AddToProcessQueue(std::move(func));
+    g_signals.m_internals->CallAfterQueued(std::move(func));
 }
 
 void SyncWithValidationInterfaceQueue() {
@@ -135,8 +272,8 @@ void SyncWithValidationInterfaceQueue() {
 
 void CMainSignals::MempoolEntryRemoved(CTransactionRef ptx, MemPoolRemovalReason reason) {
     if (reason != MemPoolRemovalReason::BLOCK && reason != MemPoolRemovalReason::CONFLICT) {
-        m_internals->m_schedulerClient.AddToProcessQueue([ptx, this] {
-            m_internals->TransactionRemovedFromMempool(ptx);
+        m_internals->Enqueue([ptx](CValidationInterface *listener) {
+            listener->TransactionRemovedFromMempool(ptx);
         });
     }
 }
@@ -146,32 +283,32 @@ void CMainSignals::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockInd
     // the chain actually updates. One way to ensure this is for the caller to invoke this signal
     // in the same critical section where the chain is updated
 
-    m_internals->m_schedulerClient.AddToProcessQueue([pindexNew, pindexFork, fInitialDownload, this] {
-        m_internals->UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
+    m_internals->Enqueue([pindexNew, pindexFork, fInitialDownload](CValidationInterface *listener) {
+        listener->UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
     });
 }
 
 void CMainSignals::TransactionAddedToMempool(const CTransactionRef &ptx) {
-    m_internals->m_schedulerClient.AddToProcessQueue([ptx, this] {
-        m_internals->TransactionAddedToMempool(ptx);
+    m_internals->EnqueueMempoolTx(ptx, [](CValidationInterface *listener, const std::vector<CTransactionRef> &vtx) {
+        listener->TransactionsAddedToMempool(vtx);
     });
 }
 
 void CMainSignals::BlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex, const std::shared_ptr<const std::vector<CTransactionRef>>& pvtxConflicted) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pblock, pindex, pvtxConflicted, this] {
-        m_internals->BlockConnected(pblock, pindex, *pvtxConflicted);
+    m_internals->Enqueue([pblock, pindex, pvtxConflicted](CValidationInterface *listener) {
+        listener->BlockConnected(pblock, pindex, *pvtxConflicted);
     });
 }
 
 void CMainSignals::BlockDisconnected(const std::shared_ptr<const CBlock> &pblock) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pblock, this] {
-        m_internals->BlockDisconnected(pblock);
+    m_internals->Enqueue([pblock](CValidationInterface *listener) {
+        listener->BlockDisconnected(pblock);
     });
 }
 
 void CMainSignals::ChainStateFlushed(const CBlockLocator &locator) {
-    m_internals->m_schedulerClient.AddToProcessQueue([locator, this] {
-        m_internals->ChainStateFlushed(locator);
+    m_internals->Enqueue([locator](CValidationInterface *listener) {
+        listener->ChainStateFlushed(locator);
     });
 }
 
@@ -27,6 +27,9 @@ class SecureMessage;
 }
 enum class MemPoolRemovalReason;
 
+//! Most mempool additions delivered to a listener in one TransactionsAddedToMempool call
+static const size_t MAX_MEMPOOL_NOTIFY_BATCH = 100;
+
 // These functions dispatch to one or all registered wallets
 
 /** Register a wallet to receive updates from core */
@@ -69,7 +72,8 @@ void SyncWithValidationInterfaceQueue();
  * UpdatedBlockTip() callback may depend on an operation performed in
  * the BlockConnected() callback without worrying about explicit
  * synchronization. No ordering should be assumed across
- * ValidationInterface() subscribers.
+ * ValidationInterface() subscribers, the callbacks of different
+ * subscribers may run at the same time on different scheduler threads.
  */
 class CValidationInterface {
 protected:
@@ -94,6 +98,21 @@ protected:
      * Called on a background thread.
      */
     virtual void TransactionAddedToMempool(const CTransactionRef &ptxn) {}
+    /**
+     * Notifies listeners of transactions having been added to mempool, in the
+     * order they were added. Additions queued back to back, while the listener
+     * is busy, are delivered together, up to MAX_MEMPOOL_NOTIFY_BATCH. Other
+     * callbacks are never reordered around them. Implement this to handle a
+     * batch at once, the default calls TransactionAddedToMempool for each.
+     *
+     * Called on a background thread.
+     */
+    virtual void TransactionsAddedToMempool(const std::vector<CTransactionRef> &vtx)
+    {
+        for (const auto &ptx : vtx) {
+            TransactionAddedToMempool(ptx);
+        }
+    }
     /**
      * Notifies listeners of a transaction leaving mempool.
      *
@@ -151,6 +170,7 @@ protected:
     friend void ::RegisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
+    friend class CMainSignals;
 
     virtual void TransactionAddedToWallet(const std::string &sWalletName, const CTransactionRef& tx) {};
     virtual void NewSecureMessage(const smsg::SecureMessage *psmsg, const uint160 &hash) {};
@@ -176,6 +196,7 @@ public:
     /** Call any remaining callbacks on the calling thread */
     void FlushBackgroundCallbacks();
 
+    /** Number of callbacks waiting in the longest subscriber queue */
     size_t CallbacksPending();
 
     /** Register with mempool to call TransactionRemovedFromMempool callbacks */
@@ -9,7 +9,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 100000;
+static const int PROTOCOL_VERSION = 100001;
 static const int MIN_BITCOINC_VERSION = 100000;
 
 //! initial proto version, to be increased after version/verack negotiation
@@ -0,0 +1,85 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/accountkeytable.h>
+
+#include <crypto/common.h>
+#include <memusage.h>
+#include <random.h>
+
+#include <limits>
+
+CAccountKeyTable::CAccountKeyTable()
+{
+    k0 = GetRand(std::numeric_limits<uint64_t>::max());
+};
+
+void CAccountKeyTable::Clear()
+{
+    vSlots.clear();
+    vSlots.shrink_to_fit();
+    nSize = 0;
+};
+
+size_t CAccountKeyTable::Index(const CKeyID &id) const
+{
+    // Key ids are hash outputs, mixing in a salt is enough
+    uint64_t h = (ReadLE64(id.begin()) ^ k0) * 0x9E3779B97F4A7C15ULL;
+    return (size_t)(h >> 32) & (vSlots.size() - 1);
+};
+
+void CAccountKeyTable::Grow()
+{
+    std::vector<Slot> vOld;
+    vOld.swap(vSlots);
+    vSlots.resize(vOld.empty() ? ACCOUNT_KEY_TABLE_MIN_SLOTS : vOld.size() * 2);
+    nSize = 0;
+    for (const auto &slot : vOld) {
+        if (slot.pa) {
+            Insert(slot.id, slot.pa);
+        }
+    }
+};
+
+void CAccountKeyTable::Insert(const CKeyID &id, CExtKeyAccount *pa)
+{
+    if ((nSize + 1) * 2 > vSlots.size()) {
+        Grow();
+    }
+    size_t mask = vSlots.size() - 1;
+    for (size_t i = Index(id); ; i = (i + 1) & mask) {
+        Slot &slot = vSlots[i];
+        if (!slot.pa) {
+            slot.id = id;
+            slot.pa = pa;
+            nSize++;
+            return;
+        }
+        if (slot.id == id) {
+            return;
+        }
+    }
+};
+
+CExtKeyAccount *CAccountKeyTable::Find(const CKeyID &id) const
+{
+    if (vSlots.empty()) {
+        return nullptr;
+    }
+    size_t mask = vSlots.size() - 1;
+    for (size_t i = Index(id); ; i = (i + 1) & mask) {
+        const Slot &slot = vSlots[i];
+        if (!slot.pa) {
+            return nullptr;
+        }
+        if (slot.id == id) {
+            return slot.pa;
+        }
+    }
+};
+
+size_t CAccountKeyTable::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(vSlots);
+};
@@ -0,0 +1,55 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_WALLET_ACCOUNTKEYTABLE_H
+#define BITCOINC_WALLET_ACCOUNTKEYTABLE_H
+
+#include <pubkey.h>
+
+#include <stdint.h>
+#include <vector>
+
+class CExtKeyAccount;
+
+static const size_t ACCOUNT_KEY_TABLE_MIN_SLOTS = 1 << 10;
+
+/**
+ * Open addressing table from key id to the wallet account holding the key,
+ * over the saved, look-ahead and stealth child keys of every account.
+ *
+ * Nearly all outputs scanned are not the wallet's, a miss costs one probe
+ * where each account's ordered maps would be searched in turn.
+ * Ids are never removed, an entry whose key left its account is only a
+ * false positive, checked against the account.
+ */
+class CAccountKeyTable
+{
+public:
+    CAccountKeyTable();
+
+    void Clear();
+
+    //! The first account inserted for an id is kept
+    void Insert(const CKeyID &id, CExtKeyAccount *pa);
+    //! Account holding id, nullptr if none
+    CExtKeyAccount *Find(const CKeyID &id) const;
+
+    size_t Size() const { return nSize; };
+    size_t DynamicMemoryUsage() const;
+
+private:
+    struct Slot {
+        CKeyID id;
+        CExtKeyAccount *pa = nullptr; // nullptr marks an empty slot
+    };
+
+    size_t Index(const CKeyID &id) const;
+    void Grow();
+
+    std::vector<Slot> vSlots; // power of two sized, at most half full
+    size_t nSize = 0;
+    uint64_t k0;
+};
+
+#endif // BITCOINC_WALLET_ACCOUNTKEYTABLE_H
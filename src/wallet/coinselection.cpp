@@ -164,6 +164,99 @@ bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_v
     return true;
 }
 
+/*
+ * Branch and Bound as above over plain values for inputs that all cost the same to spend, as the
+ * RingCT inputs of one ring size. Sharing one input cost the candidates need not be grouped, and
+ * as the waste of each included input is the same, selections of fewer inputs win.
+ *
+ * @param const std::vector<CAmount>& effective_values The effective values of the candidates,
+ *        sorted in descending order and each above zero. Not resorted, callers may keep the
+ *        array across attempts.
+ * @param const CAmount& input_waste The waste of including one input, the difference between the
+ *        fee and the long term fee to spend it.
+ * @param std::vector<size_t>& selection_ret -> The indices into effective_values selected.
+ * @param CAmount& value_ret -> The sum of the effective values selected.
+ */
+bool SelectCoinsBnB(const std::vector<CAmount>& effective_values, const CAmount& input_waste, const CAmount& target_value, const CAmount& cost_of_change, std::vector<size_t>& selection_ret, CAmount& value_ret)
+{
+    selection_ret.clear();
+    CAmount curr_value = 0;
+
+    std::vector<bool> curr_selection; // select the value at this index
+    curr_selection.reserve(effective_values.size());
+
+    CAmount curr_available_value = 0;
+    for (const CAmount& value : effective_values) {
+        assert(value > 0);
+        curr_available_value += value;
+    }
+    if (curr_available_value < target_value) {
+        return false;
+    }
+
+    CAmount curr_waste = 0;
+    std::vector<bool> best_selection;
+    CAmount best_waste = MAX_MONEY;
+
+    for (size_t i = 0; i < TOTAL_TRIES; ++i) {
+        bool backtrack = false;
+        if (curr_value + curr_available_value < target_value ||
+            curr_value > target_value + cost_of_change ||
+            (curr_waste > best_waste && input_waste > 0)) {
+            backtrack = true;
+        } else if (curr_value >= target_value) {
+            if (curr_waste + (curr_value - target_value) <= best_waste) {
+                best_selection = curr_selection;
+                best_selection.resize(effective_values.size());
+                best_waste = curr_waste + (curr_value - target_value);
+            }
+            backtrack = true;
+        }
+
+        if (backtrack) {
+            while (!curr_selection.empty() && !curr_selection.back()) {
+                curr_selection.pop_back();
+                curr_available_value += effective_values[curr_selection.size()];
+            }
+
+            if (curr_selection.empty()) {
+                break;
+            }
+
+            curr_selection.back() = false;
+            curr_value -= effective_values[curr_selection.size() - 1];
+            curr_waste -= input_waste;
+        } else {
+            const CAmount& value = effective_values[curr_selection.size()];
+            curr_available_value -= value;
+
+            // Including this after an omitted predecessor of the same value tests an equivalent combination
+            if (!curr_selection.empty() && !curr_selection.back() &&
+                value == effective_values[curr_selection.size() - 1]) {
+                curr_selection.push_back(false);
+            } else {
+                curr_selection.push_back(true);
+                curr_value += value;
+                curr_waste += input_waste;
+            }
+        }
+    }
+
+    if (best_selection.empty()) {
+        return false;
+    }
+
+    value_ret = 0;
+    for (size_t i = 0; i < best_selection.size(); ++i) {
+        if (best_selection[i]) {
+            selection_ret.push_back(i);
+            value_ret += effective_values[i];
+        }
+    }
+
+    return true;
+}
+
 static void ApproximateBestSubset(const std::vector<OutputGroup>& groups, const CAmount& nTotalLower, const CAmount& nTargetValue,
                                   std::vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
 {
@@ -111,6 +111,9 @@ struct OutputGroup
 
 bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_value, const CAmount& cost_of_change, std::set<CInputCoin>& out_set, CAmount& value_ret, CAmount not_input_fees);
 
+// Branch and bound for candidates of equal input cost, effective_values sorted descending
+bool SelectCoinsBnB(const std::vector<CAmount>& effective_values, const CAmount& input_waste, const CAmount& target_value, const CAmount& cost_of_change, std::vector<size_t>& selection_ret, CAmount& value_ret);
+
 // Original coin selection algorithm as a fallback
 bool KnapsackSolver(const CAmount& nTargetValue, std::vector<OutputGroup>& groups, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet);
 
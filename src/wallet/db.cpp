@@ -247,6 +247,30 @@ BerkeleyEnvironment::VerifyResult BerkeleyEnvironment::Verify(const std::string&
     return (fRecovered ? VerifyResult::RECOVER_OK : VerifyResult::RECOVER_FAIL);
 }
 
+void BerkeleyEnvironment::RecoverRewrite(const std::string& strFile)
+{
+    LOCK(cs_db);
+    assert(mapFileUseCount.count(strFile) == 0);
+
+    fs::path pathFile = fs::path(strPath) / strFile;
+    std::string strFileRes = strFile + ".rewrite";
+    std::string strFileOld = strFile + ".rewrite.old";
+
+    if (fs::exists(fs::path(strPath) / strFileOld)) {
+        if (fs::exists(pathFile)) {
+            // Interrupted after the copy took the original's place
+            dbenv->dbremove(nullptr, strFileOld.c_str(), nullptr, 0);
+        } else {
+            // Interrupted between the renames, restore the original
+            LogPrintf("%s: Restoring %s from an interrupted rewrite\n", __func__, strFile);
+            dbenv->dbrename(nullptr, strFileOld.c_str(), nullptr, strFile.c_str(), 0);
+        }
+    }
+    if (fs::exists(fs::path(strPath) / strFileRes)) {
+        dbenv->dbremove(nullptr, strFileRes.c_str(), nullptr, 0);
+    }
+}
+
 bool BerkeleyBatch::Recover(const fs::path& file_path, void *callbackDataIn, bool (*recoverKVcallback)(void* callbackData, CDataStream &ssKey, CDataStream &ssValue), std::string& newFilename)
 {
     std::string filename;
@@ -357,6 +381,8 @@ bool BerkeleyBatch::VerifyDatabaseFile(const fs::path& file_path, std::string& w
     BerkeleyEnvironment* env = GetWalletEnv(file_path, walletFile);
     fs::path walletDir = env->Directory();
 
+    env->RecoverRewrite(walletFile);
+
     if (fs::exists(walletDir / walletFile))
     {
         std::string backup_filename;
@@ -602,6 +628,12 @@ bool BerkeleyBatch::Rewrite(BerkeleyDatabase& database, const char* pszSkip)
                 bool fSuccess = true;
                 LogPrintf("BerkeleyBatch::Rewrite: Rewriting %s...\n", strFile);
                 std::string strFileRes = strFile + ".rewrite";
+                std::string strFileOld = strFile + ".rewrite.old";
+                {
+                    // Left over from an interrupted rewrite, the copy may be partial
+                    Db dbR(env->dbenv.get(), 0);
+                    dbR.remove(strFileRes.c_str(), nullptr, 0);
+                }
                 { // surround usage of db with extra {}
                     BerkeleyBatch db(database, "r");
                     std::unique_ptr<Db> pdbCopy = MakeUnique<Db>(env->dbenv.get(), 0);
@@ -656,12 +688,22 @@ bool BerkeleyBatch::Rewrite(BerkeleyDatabase& database, const char* pszSkip)
                     }
                 }
                 if (fSuccess) {
+                    // Move the original aside before the copy takes its place, a complete
+                    // wallet file exists at every step, see RecoverRewrite
                     Db dbA(env->dbenv.get(), 0);
-                    if (dbA.remove(strFile.c_str(), nullptr, 0))
-                        fSuccess = false;
-                    Db dbB(env->dbenv.get(), 0);
-                    if (dbB.rename(strFileRes.c_str(), nullptr, strFile.c_str(), 0))
+                    if (dbA.rename(strFile.c_str(), nullptr, strFileOld.c_str(), 0)) {
                         fSuccess = false;
+                    } else {
+                        Db dbB(env->dbenv.get(), 0);
+                        if (dbB.rename(strFileRes.c_str(), nullptr, strFile.c_str(), 0)) {
+                            fSuccess = false;
+                            Db dbC(env->dbenv.get(), 0);
+                            dbC.rename(strFileOld.c_str(), nullptr, strFile.c_str(), 0);
+                        } else {
+                            Db dbC(env->dbenv.get(), 0);
+                            dbC.remove(strFileOld.c_str(), nullptr, 0);
+                        }
+                    }
                 }
                 if (!fSuccess)
                     LogPrintf("BerkeleyBatch::Rewrite: Failed to rewrite database file %s\n", strFileRes);
@@ -68,6 +68,8 @@ public:
      */
     typedef std::pair<std::vector<unsigned char>, std::vector<unsigned char> > KeyValPair;
     bool Salvage(const std::string& strFile, bool fAggressive, std::vector<KeyValPair>& vResult);
+    /** Clean up after a Rewrite of strFile that was interrupted, restoring the original if needed */
+    void RecoverRewrite(const std::string& strFile);
 
     bool Open(bool retry);
     void Close();
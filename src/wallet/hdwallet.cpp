@@ -18,6 +18,7 @@
 #include <smsg/crypter.h>
 #include <pos/kernel.h>
 #include <pos/miner.h>
+#include <pos/reward.h>
 #include <utilmoneystr.h>
 #include <script/script.h>
 #include <script/standard.h>
@@ -34,6 +35,7 @@
 #include <wallet/fees.h>
 #include <walletinitinterface.h>
 #include <wallet/walletutil.h>
+#include <wallet/scancache.h>
 
 
 #if ENABLE_USBDEVICE
@@ -52,63 +54,49 @@
 
 extern int ExtractExtKeyId(const std::string &sInKey, CKeyID &keyId, CChainParams::Base58Type prefix);
 
-int CTransactionRecord::InsertOutput(COutputRecord &r)
+static bool OutputRecordBefore(const COutputRecord &r, int n)
 {
-    for (size_t i = 0; i < vout.size(); ++i) {
-        if (vout[i].n == r.n) {
-            return 0; // duplicate
-        }
-
-        if (vout[i].n < r.n) {
-            continue;
-        }
+    return r.n < n;
+};
 
-        vout.insert(vout.begin() + i, r);
-        return 1;
+int CTransactionRecord::InsertOutput(COutputRecord &r)
+{
+    auto it = std::lower_bound(vout.begin(), vout.end(), r.n, OutputRecordBefore);
+    if (it != vout.end() && it->n == r.n) {
+        return 0; // duplicate
     }
-    vout.push_back(r);
+    vout.insert(it, r);
     return 1;
 };
 
 bool CTransactionRecord::EraseOutput(uint16_t n)
 {
-    for (size_t i = 0; i < vout.size(); ++i) {
-        if (vout[i].n != n) {
-            continue;
-        }
-
-        vout.erase(vout.begin() + i);
-        return true;
+    auto it = std::lower_bound(vout.begin(), vout.end(), n, OutputRecordBefore);
+    if (it == vout.end() || it->n != n) {
+        return false;
     }
-    return false;
+    vout.erase(it);
+    return true;
 };
 
 COutputRecord *CTransactionRecord::GetOutput(int n)
 {
     // vout is always in order by asc n
-    for (auto &r : vout) {
-        if (r.n > n) {
-            return nullptr;
-        }
-        if (r.n == n) {
-            return &r;
-        }
+    auto it = std::lower_bound(vout.begin(), vout.end(), n, OutputRecordBefore);
+    if (it == vout.end() || it->n != n) {
+        return nullptr;
     }
-    return nullptr;
+    return &(*it);
 };
 
 const COutputRecord *CTransactionRecord::GetOutput(int n) const
 {
     // vout is always in order by asc n
-    for (auto &r : vout) {
-        if (r.n > n) {
-            return nullptr;
-        }
-        if (r.n == n) {
-            return &r;
-        }
+    auto it = std::lower_bound(vout.begin(), vout.end(), n, OutputRecordBefore);
+    if (it == vout.end() || it->n != n) {
+        return nullptr;
     }
-    return nullptr;
+    return &(*it);
 };
 
 const COutputRecord *CTransactionRecord::GetChangeOutput() const
@@ -129,11 +117,6 @@ int CHDWallet::Finalise()
 
     FreeExtKeyMaps();
     mapAddressBook.clear();
-
-    if (m_blind_scratch) {
-        secp256k1_scratch_space_destroy(m_blind_scratch);
-        m_blind_scratch = nullptr;
-    }
     return 0;
 };
 
@@ -148,6 +131,8 @@ int CHDWallet::FreeExtKeyMaps()
         }
     }
     mapExtAccounts.clear();
+    m_stealth_table_built = false;
+    m_account_keys_built = false;
 
     ExtKeyMap::iterator itl = mapExtKeys.begin();
     for (itl = mapExtKeys.begin(); itl != mapExtKeys.end(); ++itl) {
@@ -164,10 +149,11 @@ void CHDWallet::AddOptions()
 {
     gArgs.AddArg("-defaultlookaheadsize=<n>", strprintf(_("Number of keys to load into the lookahead pool per chain. (default: %u)"), N_DEFAULT_LOOKAHEAD), false, OptionsCategory::BC_WALLET);
     gArgs.AddArg("-extkeysaveancestors", strprintf(_("On saving a key from the lookahead pool, save all unsaved keys leading up to it too. (default: %s)"), "true"), false, OptionsCategory::BC_WALLET);
+    gArgs.AddArg("-lazyrecords", strprintf(_("Load only transaction records with unspent outputs or spent less than %d blocks deep, older history is read when listed. (default: %u)"), MIN_ARCHIVE_RECORD_DEPTH, DEFAULT_LAZY_RECORDS), false, OptionsCategory::BC_WALLET);
     gArgs.AddArg("-createdefaultmasterkey", strprintf(_("Generate a random master key and main account if no master key exists. (default: %s)"), "false"), false, OptionsCategory::BC_WALLET);
 
     gArgs.AddArg("-staking", _("Stake your coins to support network and gain reward (default: true)"), false, OptionsCategory::BC_STAKING);
-    gArgs.AddArg("-stakingthreads", _("Number of threads to start for staking, max 1 per active wallet, will divide wallets evenly between threads (default: 1)"), false, OptionsCategory::BC_STAKING);
+    gArgs.AddArg("-stakingthreads", _("Number of threads to start for staking, large wallets are split over all threads (default: 1)"), false, OptionsCategory::BC_STAKING);
     gArgs.AddArg("-minstakeinterval=<n>", _("Minimum time in seconds between successful stakes (default: 0)"), false, OptionsCategory::BC_STAKING);
     gArgs.AddArg("-minersleep=<n>", _("Milliseconds between stake attempts. Lowering this param will not result in more stakes. (default: 500)"), false, OptionsCategory::BC_STAKING);
     gArgs.AddArg("-reservebalance=<amount>", _("Ensure available balance remains above reservebalance. (default: 0)"), false, OptionsCategory::BC_STAKING);
@@ -180,12 +166,10 @@ bool CHDWallet::Initialise()
 {
     fBitcoinCWallet = true;
 
-    m_blind_scratch = secp256k1_scratch_space_create(secp256k1_ctx_blind, 1024 * 1024);
-    assert(m_blind_scratch);
-
     if (!ParseMoney(gArgs.GetArg("-reservebalance", ""), nReserveBalance)) {
         return InitError(_("Invalid amount for -reservebalance=<amount>"));
     }
+    m_lazy_records = gArgs.GetBoolArg("-lazyrecords", DEFAULT_LAZY_RECORDS);
 
     std::string sError;
     ProcessStakingSettings(sError);
@@ -976,6 +960,48 @@ bool CHDWallet::LoadTxRecords(CHDWalletDB *pwdb)
         nCount++;
     };
 
+    // Archived records stay on disk with -lazyrecords, without it they are restored
+    std::vector<std::pair<uint256, CTransactionRecord> > vRestore;
+    sPrefix = "rtxa";
+    fFlags = DB_SET_RANGE;
+    ssKey.clear();
+    ssKey << sPrefix;
+    while (pwdb->ReadAtCursor(pcursor, ssKey, ssValue, fFlags) == 0)
+    {
+        fFlags = DB_NEXT;
+        ssKey >> strType;
+        if (strType != sPrefix)
+            break;
+
+        if (m_lazy_records)
+        {
+            m_have_archived_records = true;
+            break;
+        };
+
+        ssKey >> txhash;
+
+        CTransactionRecord data;
+        ssValue >> data;
+        vRestore.emplace_back(txhash, data);
+    };
+
+    pcursor->close();
+
+    for (const auto &ri : vRestore)
+    {
+        // A rescan may have written the record again
+        if (mapRecords.count(ri.first) == 0)
+        {
+            if (!pwdb->WriteTxRecord(ri.first, ri.second))
+                return werror("%s: WriteTxRecord failed.", __func__);
+            LoadToWallet(ri.first, ri.second);
+            nCount++;
+        };
+        if (!pwdb->EraseArchivedTxRecord(ri.first))
+            return werror("%s: EraseArchivedTxRecord failed.", __func__);
+    };
+
     // Must load all records before marking spent.
 
     {
@@ -1023,14 +1049,177 @@ bool CHDWallet::LoadTxRecords(CHDWalletDB *pwdb)
         };
     }
 
+    LogPrint(BCLog::HDWALLET, "Loaded %d records.\n", nCount);
 
-    pcursor->close();
+    if (m_lazy_records)
+        return ArchiveSpentRecords(pwdb);
 
-    LogPrint(BCLog::HDWALLET, "Loaded %d records.\n", nCount);
+    return true;
+};
+
+bool CHDWallet::ArchiveSpentRecords(CHDWalletDB *pwdb)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    auto GetTxDepth = [&](const uint256 &hash) -> int {
+        MapWallet_t::const_iterator mwi = mapWallet.find(hash);
+        if (mwi != mapWallet.end())
+            return mwi->second.GetDepthInMainChain();
+        MapRecords_t::const_iterator mri = mapRecords.find(hash);
+        if (mri != mapRecords.end())
+            return GetDepthInMainChain(mri->second.blockHash, mri->second.nIndex);
+        return 0;
+    };
+
+    // A record is archived when it and the spends of all its owned outputs are
+    // buried, and every wallet txn it spends from is archived too. The spends
+    // left in memory then only refer to outputs of records left in memory.
+    // Txns are visited in time order, a record spending a later one waits for
+    // the next load.
+    std::set<uint256> setArchive;
+    for (const auto &ro : rtxOrdered)
+    {
+        const uint256 &txhash = ro.second->first;
+        const CTransactionRecord &rtx = ro.second->second;
+
+        if (GetDepthInMainChain(rtx.blockHash, rtx.nIndex) < MIN_ARCHIVE_RECORD_DEPTH)
+            continue;
+
+        bool fArchive = true;
+        for (const auto &r : rtx.vout)
+        {
+            if (!(r.nFlags & ORF_OWN_ANY) || r.n == OR_PLACEHOLDER_N)
+                continue;
+
+            bool fBuried = false;
+            auto range = mapTxSpends.equal_range(COutPoint(txhash, r.n));
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                if (GetTxDepth(it->second) >= MIN_ARCHIVE_RECORD_DEPTH)
+                {
+                    fBuried = true;
+                    break;
+                };
+            };
+            if (!fBuried)
+            {
+                fArchive = false;
+                break;
+            };
+        };
+
+        for (const auto &prevout : rtx.vin)
+        {
+            if (!fArchive)
+                break;
+            COutPoint op = prevout;
+            if (rtx.nFlags & ORF_ANON_IN)
+            {
+                CCmpPubKey ki;
+                memcpy(ki.ncbegin(), prevout.hash.begin(), 32);
+                *(ki.ncbegin()+32) = prevout.n;
+                if (!pwdb->ReadAnonKeyImage(ki, op))
+                    continue;
+            };
+            if (mapWallet.count(op.hash)
+                || (mapRecords.count(op.hash) && !setArchive.count(op.hash)))
+                fArchive = false;
+        };
+
+        if (fArchive)
+            setArchive.insert(txhash);
+    };
+
+    if (setArchive.empty())
+        return true;
+
+    if (!pwdb->TxnBegin())
+        return werror("%s: TxnBegin failed.", __func__);
+    for (const auto &txhash : setArchive)
+    {
+        if (!pwdb->WriteArchivedTxRecord(txhash, mapRecords[txhash])
+            || !pwdb->EraseTxRecord(txhash))
+        {
+            pwdb->TxnAbort();
+            return werror("%s: Archiving record %s failed.", __func__, txhash.ToString());
+        };
+    };
+    if (!pwdb->TxnCommit())
+        return werror("%s: TxnCommit failed.", __func__);
+
+    for (auto it = rtxOrdered.begin(); it != rtxOrdered.end(); )
+    {
+        if (setArchive.count(it->second->first))
+        {
+            rtxOrdered.erase(it++);
+            continue;
+        };
+        ++it;
+    };
+    for (auto it = mapTxSpends.begin(); it != mapTxSpends.end(); )
+    {
+        if (setArchive.count(it->second))
+        {
+            mapTxSpends.erase(it++);
+            continue;
+        };
+        ++it;
+    };
+    for (const auto &txhash : setArchive)
+        mapRecords.erase(txhash);
+
+    m_have_archived_records = true;
+    WalletLogPrintf("Archived %d spent records.\n", setArchive.size());
 
     return true;
 };
 
+const RtxOrdered_t &CHDWallet::GetRecordsOrdered(MapRecords_t &mapArchived, RtxOrdered_t &rtxMerged) const
+{
+    AssertLockHeld(cs_wallet);
+
+    if (!m_have_archived_records)
+        return rtxOrdered;
+
+    CHDWalletDB wdb(*database, "r");
+    Dbc *pcursor;
+    if (!(pcursor = wdb.GetCursor()))
+        throw std::runtime_error(strprintf("%s: cannot create DB cursor", __func__).c_str());
+
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+
+    std::string sPrefix = "rtxa";
+    std::string strType;
+    uint256 txhash;
+
+    unsigned int fFlags = DB_SET_RANGE;
+    ssKey << sPrefix;
+    while (wdb.ReadAtCursor(pcursor, ssKey, ssValue, fFlags) == 0)
+    {
+        fFlags = DB_NEXT;
+        ssKey >> strType;
+        if (strType != sPrefix)
+            break;
+
+        ssKey >> txhash;
+        if (mapRecords.count(txhash))
+            continue;
+
+        CTransactionRecord data;
+        ssValue >> data;
+        mapArchived.insert(std::make_pair(txhash, data));
+    };
+    pcursor->close();
+
+    rtxMerged = rtxOrdered;
+    for (auto it = mapArchived.begin(); it != mapArchived.end(); ++it)
+        rtxMerged.insert(std::make_pair(it->second.GetTxTime(), it));
+
+    return rtxMerged;
+};
+
 bool CHDWallet::IsLocked() const
 {
     LOCK(cs_wallet); // Lock cs_wallet to ensure any CHDWallet::Unlock has completed
@@ -1154,10 +1343,9 @@ bool CHDWallet::Lock()
 
     WalletLogPrintf("Locking wallet.\n");
 
-    {
-        LOCK(cs_wallet);
-        ExtKeyLock();
-    }
+    // Under cs_wallet so the locked outputs task sees the ext keys and the keystore change together
+    LOCK(cs_wallet);
+    ExtKeyLock();
 
     return CCryptoKeyStore::Lock();
 };
@@ -1215,10 +1403,8 @@ bool CHDWallet::Unlock(const SecureString &strWalletPassphrase)
         if (fWasUnlocked) {
             return true;
         }
-
-        ProcessLockedStealthOutputs();
-        ProcessLockedBlindedOutputs();
     } // cs_main, cs_wallet
+    StartProcessLockedOutputs();
     smsgModule.WalletUnlocked();
 
     WakeThreadStakeMiner(this);
@@ -1263,29 +1449,64 @@ isminetype CHDWallet::HaveKey(const CKeyID &address, const CEKAKey *&pak, const
     pak = nullptr;
     pasc = nullptr;
     int rv;
-    ExtKeyAccountMap::const_iterator it;
-    for (it = mapExtAccounts.begin(); it != mapExtAccounts.end(); ++it) {
-        pa = it->second;
+    if ((pa = FindAccountKey(address))) {
         isminetype ismine = ISMINE_NO;
         rv = pa->HaveKey(address, true, pak, pasc, ismine);
-        if (rv == HK_NO) {
-            continue;
-        }
-
-        if (rv == HK_LOOKAHEAD_DO_UPDATE) {
-            CEKAKey ak = *pak; // Must copy CEKAKey, ExtKeySaveKey modifies CExtKeyAccount
-            if (0 != ExtKeySaveKey(pa, address, ak)) {
-                WalletLogPrintf("%s: ExtKeySaveKey failed.\n", __func__);
-                return ISMINE_NO;
+        if (rv != HK_NO) {
+            if (rv == HK_LOOKAHEAD_DO_UPDATE) {
+                CEKAKey ak = *pak; // Must copy CEKAKey, ExtKeySaveKey modifies CExtKeyAccount
+                if (0 != ExtKeySaveKey(pa, address, ak)) {
+                    WalletLogPrintf("%s: ExtKeySaveKey failed.\n", __func__);
+                    return ISMINE_NO;
+                }
             }
+            return ismine;
         }
-        return ismine;
     }
 
     pa = nullptr;
     return CCryptoKeyStore::IsMine(address);
 };
 
+CExtKeyAccount *CHDWallet::FindAccountKey(const CKeyID &id) const
+{
+    AssertLockHeld(cs_wallet);
+
+    // Accounts are only changed under cs_wallet
+    if (!m_account_keys_built) {
+        m_account_keys.Clear();
+        for (const auto &mi : mapExtAccounts) {
+            CExtKeyAccount *pa = mi.second;
+            LOCK(pa->cs_account);
+            for (const auto &ki : pa->mapKeys) {
+                m_account_keys.Insert(ki.first, pa);
+            }
+            for (const auto &ki : pa->mapLookAhead) {
+                m_account_keys.Insert(ki.first, pa);
+            }
+            for (const auto &ki : pa->mapStealthChildKeys) {
+                m_account_keys.Insert(ki.first, pa);
+            }
+            pa->vNewKeys.clear();
+        }
+        m_account_keys_built = true;
+    } else {
+        for (const auto &mi : mapExtAccounts) {
+            CExtKeyAccount *pa = mi.second;
+            if (pa->vNewKeys.empty()) {
+                continue;
+            }
+            LOCK(pa->cs_account);
+            for (const auto &idNew : pa->vNewKeys) {
+                m_account_keys.Insert(idNew, pa);
+            }
+            pa->vNewKeys.clear();
+        }
+    }
+
+    return m_account_keys.Find(id);
+};
+
 isminetype CHDWallet::IsMine(const CKeyID &address) const
 {
     LOCK(cs_wallet);
@@ -1492,6 +1713,7 @@ bool CHDWallet::ImportStealthAddress(const CStealthAddress &sxAddr, const CKey &
 
     // Must add before changing spend_secret
     stealthAddresses.insert(sxAddr);
+    m_stealth_table_built = false;
 
     bool fOwned = skSpend.IsValid();
 
@@ -1499,18 +1721,21 @@ bool CHDWallet::ImportStealthAddress(const CStealthAddress &sxAddr, const CKey &
         // Owned addresses can only be added when wallet is unlocked
         if (IsLocked()) {
             stealthAddresses.erase(sxAddr);
+            m_stealth_table_built = false;
             return werror("%s: Wallet must be unlocked.", __func__);
         }
 
         CPubKey pk = skSpend.GetPubKey();
         if (!AddKeyPubKey(skSpend, pk)) {
             stealthAddresses.erase(sxAddr);
+            m_stealth_table_built = false;
             return werror("%s: AddKeyPubKey failed.", __func__);
         }
     }
 
     if (!CHDWalletDB(*database).WriteStealthAddress(sxAddr)) {
         stealthAddresses.erase(sxAddr);
+        m_stealth_table_built = false;
         return werror("%s: WriteStealthAddress failed.", __func__);
     }
 
@@ -1658,6 +1883,7 @@ bool CHDWallet::DelAddressBook(const CTxDestination &address)
             {
                 //fOwned = si->scan_secret.size() < 32 ? false : true;
 
+                m_stealth_table_built = false;
                 if (stealthAddresses.erase(sxAddr) < 1
                     || !CHDWalletDB(*database).EraseStealthAddress(sxAddr))
                 {
@@ -1959,6 +2185,39 @@ isminetype CHDWallet::IsMine(const CTxIn& txin) const
 isminetype CHDWallet::IsMine(const CScript &scriptPubKey, CKeyID &keyID,
     const CEKAKey *&pak, const CEKASCKey *&pasc, CExtKeyAccount *&pa, bool &isInvalid, SigVersion sigversion) const
 {
+    Span<const unsigned char> stake_hash, spend_hash;
+    if (scriptPubKey.MatchColdStakeKeyHashes(stake_hash, spend_hash))
+    {
+        // Key hash branches are looked up in place, as the Solver path below would
+        auto is_mine_branch = [&](Span<const unsigned char> hash) -> isminetype {
+            keyID = hash.size() == 20 ? CKeyID(uint160(hash.data(), 20)) : CKeyID(uint256(hash.data(), 32));
+            if (sigversion != SigVersion::BASE) {
+                CPubKey pubkey;
+                if (GetPubKey(keyID, pubkey) && !pubkey.IsCompressed()) {
+                    isInvalid = true;
+                    return ISMINE_NO;
+                }
+            }
+            isminetype mine = HaveKey(keyID, pak, pasc, pa);
+            if (mine)
+                return mine;
+            // The branch script runs from the OP_DUP before the hash to the OP_CHECKSIG after it
+            if (HaveWatchOnly() && HaveWatchOnly(CScript(hash.begin() - 3, hash.end() + 2)))
+                return ISMINE_WATCH_ONLY_;
+            return ISMINE_NO;
+        };
+
+        isminetype typeB = is_mine_branch(spend_hash);
+        if (typeB & ISMINE_SPENDABLE)
+            return typeB;
+
+        isminetype typeA = is_mine_branch(stake_hash);
+        if (typeA & ISMINE_SPENDABLE)
+            typeA = (isminetype)(((int)typeA & ~ISMINE_SPENDABLE) | ISMINE_WATCH_COLDSTAKE);
+
+        return (isminetype)((int)typeA | (int)typeB);
+    };
+
     if (scriptPubKey.StartsWithICS())
     {
         CScript scriptA, scriptB;
@@ -2660,9 +2919,26 @@ CAmount CHDWallet::GetLegacyBalance(const isminefilter& filter, int minDepth, co
 
 bool CHDWallet::GetBalances(CHDWalletBalances &bal)
 {
-    bal.Clear();
+    bal = *GetBalancesSnapshot();
+    return true;
+};
+
+std::shared_ptr<const CHDWalletBalances> CHDWallet::GetBalancesSnapshot()
+{
+    // Polled far more often than the wallet changes, don't queue behind staking or block processing while nothing did
+    std::shared_ptr<const CHDWalletBalances> snapshot = std::atomic_load(&m_balances_snapshot);
+    if (snapshot) {
+        return snapshot;
+    }
 
     LOCK2(cs_main, cs_wallet);
+    snapshot = std::atomic_load(&m_balances_snapshot);
+    if (snapshot) {
+        return snapshot; // Built while waiting for the locks
+    }
+
+    std::shared_ptr<CHDWalletBalances> pbal = std::make_shared<CHDWalletBalances>();
+    CHDWalletBalances &bal = *pbal;
     for (const auto &item : mapWallet) {
         const CWalletTx &wtx = item.second;
 
@@ -2744,7 +3020,83 @@ bool CHDWallet::GetBalances(CHDWalletBalances &bal)
     //if (!MoneyRange(nBalance))
     //    throw std::runtime_error(std::string(__func__) + ": value out of range");
 
-    return true;
+    snapshot = pbal;
+    std::atomic_store(&m_balances_snapshot, snapshot);
+
+    return snapshot;
+};
+
+std::shared_ptr<const CHDWalletStakingSums> CHDWallet::GetStakingSumsSnapshot()
+{
+    // getstakinginfo is polled by staking dashboards, AvailableCoins walks the whole wallet under cs_main
+    std::shared_ptr<const CChainStatus> status = GetChainStatus();
+    int nTipHeight = status ? status->nHeight : -1;
+    std::shared_ptr<const CHDWalletStakingSums> snapshot = std::atomic_load(&m_staking_sums_snapshot);
+    if (snapshot && snapshot->nHeight == nTipHeight) {
+        return snapshot;
+    }
+
+    LOCK2(cs_main, cs_wallet);
+    snapshot = std::atomic_load(&m_staking_sums_snapshot);
+    int nHeight = chainActive.Height();
+    if (snapshot && snapshot->nHeight == nHeight) {
+        return snapshot; // Built while waiting for the locks
+    }
+
+    std::shared_ptr<CHDWalletStakingSums> psums = std::make_shared<CHDWalletStakingSums>();
+    CHDWalletStakingSums &sums = *psums;
+    sums.nHeight = nHeight;
+    int nRequiredDepth = std::min((int)(Params().GetStakeMinConfirmations()-1), (int)(nHeight / 2));
+
+    std::vector<COutput> vecOutputs;
+    bool include_unsafe = false;
+    bool fIncludeImmature = true;
+    AvailableCoins(vecOutputs, !include_unsafe, nullptr, 0, MAX_MONEY, MAX_MONEY, 0, 0, 0x7FFFFFFF, fIncludeImmature);
+
+    CKeyID keyID;
+    for (const auto &out : vecOutputs) {
+        const CScript *scriptPubKey = out.tx->tx->vpout[out.i]->GetPScriptPubKey();
+        CAmount nValue = out.tx->tx->vpout[out.i]->GetValue();
+
+        if (scriptPubKey->IsPayToPublicKeyHash() || scriptPubKey->IsPayToPublicKeyHash256()) {
+            if (!out.fSpendable) {
+                continue;
+            }
+            sums.nStakeable += nValue;
+        } else
+        if (scriptPubKey->IsPayToPublicKeyHash256_CS() || scriptPubKey->IsPayToScriptHash256_CS() || scriptPubKey->IsPayToScriptHash_CS()) {
+            // Show output on both the spending and staking wallets
+            if (!out.fSpendable) {
+                if (!ExtractStakingKeyID(*scriptPubKey, keyID)
+                    || !HaveKey(keyID)) {
+                    continue;
+                }
+            }
+            sums.nColdStakeable += nValue;
+        } else {
+            continue;
+        }
+
+        if (out.nDepth < nRequiredDepth) {
+            continue;
+        }
+
+        if (!ExtractStakingKeyID(*scriptPubKey, keyID)) {
+            continue;
+        }
+        if (HaveKey(keyID)) {
+            sums.nWalletStaking += nValue;
+        }
+
+        if (scriptPubKey->IsPayToPublicKeyHash256_CS() || scriptPubKey->IsPayToScriptHash256_CS() || scriptPubKey->IsPayToScriptHash_CS()) {
+            sums.nColdStakingWeight += nValue;
+        }
+    }
+
+    snapshot = psums;
+    std::atomic_store(&m_staking_sums_snapshot, snapshot);
+
+    return snapshot;
 };
 
 CAmount CHDWallet::GetAvailableBalance(const CCoinControl* coinControl) const
@@ -3103,13 +3455,6 @@ int CHDWallet::AddCTData(CTxOutBase *txout, CTempRecipient &r, std::string &sErr
         return wserrorN(1, sError, __func__, "Unable to get CT pointers for output type %d", txout->GetType());
     }
 
-    uint64_t nValue = r.nAmount;
-    if (!secp256k1_pedersen_commit(secp256k1_ctx_blind,
-        pCommitment, (uint8_t*)r.vBlind.data(),
-        nValue, &secp256k1_generator_const_h, &secp256k1_generator_const_g)) {
-        return wserrorN(1, sError, __func__, "secp256k1_pedersen_commit failed.");
-    }
-
     uint256 nonce;
     if (r.fNonceSet) {
         nonce = r.nonce;
@@ -3125,76 +3470,65 @@ int CHDWallet::AddCTData(CTxOutBase *txout, CTempRecipient &r, std::string &sErr
         r.nonce = nonce;
     }
 
-    size_t nRangeProofLen = 5134;
-    pvRangeproof->resize(nRangeProofLen);
-
-    if (GetTime() >= Params().GetConsensus().bulletproof_time) {
-        const uint8_t *bp[1];
-        bp[0] = r.vBlind.data();
-        assert(r.vBlind.size() == 32);
+    assert(r.vBlind.size() == 32);
+    bool fBulletproof = GetTime() >= Params().GetConsensus().bulletproof_time;
+    CRangeProofParams params;
+    params.min_value = r.min_value;
+    params.ct_exponent = r.ct_exponent;
+    params.ct_bits = r.ct_bits;
+    if (0 != CommitAndProveValue(*pCommitment, *pvRangeproof, r.nAmount, r.vBlind.data(), nonce, fBulletproof,
+        fBulletproof ? "" : r.sNarration, r.fOverwriteRangeProofParams ? &params : nullptr, sError)) {
+        return 1;
+    }
 
-        if (1 != secp256k1_bulletproof_rangeproof_prove(secp256k1_ctx_blind, m_blind_scratch, blind_gens,
-            pvRangeproof->data(), &nRangeProofLen, &nValue, nullptr, bp, 1,
-            &secp256k1_generator_const_h, 64, nonce.begin(), nullptr, 0)) {
-            return wserrorN(1, sError, __func__, "secp256k1_bulletproof_rangeproof_prove failed.");
-        }
+    if (fBulletproof && r.sNarration.size() > 0
+        && 0 != AppendNarrationCrypt(*txout->GetPData(), r.sNarration, r.nonce.begin(), r.sEphem.GetPubKey(), sError)) {
+        return 1;
+    }
 
-        if (1 != secp256k1_bulletproof_rangeproof_verify(secp256k1_ctx_blind, m_blind_scratch, blind_gens,
-            pvRangeproof->data(), nRangeProofLen, nullptr, pCommitment, 1, 64, &secp256k1_generator_const_h, nullptr, 0)) {
-            return wserrorN(1, sError, __func__, "secp256k1_bulletproof_rangeproof_verify failed.");
-        }
+    return 0;
+};
 
-        if (r.sNarration.size() > 0) {
-            std::vector<uint8_t> vchNarr, &vData = *txout->GetPData();
-            CPubKey pkEphem = r.sEphem.GetPubKey();
-            SecMsgCrypter crypter;
-            crypter.SetKey(r.nonce.begin(), pkEphem.begin());
+//! Range proofs and MLSAGs of a transaction are generated by up to MAX_SIGN_THREADS threads
+static const size_t MAX_SIGN_THREADS = 8;
 
-            if (!crypter.Encrypt((uint8_t*)r.sNarration.data(), r.sNarration.length(), vchNarr)) {
-                return errorN(1, sError, __func__, "Narration encryption failed.");
-            }
-            if (vchNarr.size() > MAX_STEALTH_NARRATION_SIZE) {
-                return errorN(1, sError, __func__, "Encrypted narration is too long.");
-            }
-
-            size_t o = vData.size();
-            vData.resize(o + vchNarr.size() + 1);
-            vData[o++] = DO_NARR_CRYPT;
-            memcpy(&vData[o], vchNarr.data(), vchNarr.size());
-        }
-    } else {
-        uint64_t min_value = 0;
-        int ct_exponent = 2;
-        int ct_bits = 32;
-
-        const char *message = r.sNarration.c_str();
-        size_t mlen = strlen(message);
-
-        if (0 != SelectRangeProofParameters(nValue, min_value, ct_exponent, ct_bits)) {
-            return wserrorN(1, sError, __func__, "SelectRangeProofParameters failed.");
-        }
+// Run f over [0, nJobs) in contiguous slices, one thread per slice
+template<typename F>
+static void RunSigningJobs(size_t nJobs, F f)
+{
+    size_t nThreads = std::min(std::min(MAX_SIGN_THREADS, (size_t)std::max(1, GetNumCores())), nJobs);
+    if (nThreads < 2) {
+        f(0, nJobs);
+        return;
+    }
+    std::vector<std::thread> threads;
+    size_t nPerThread = (nJobs + nThreads - 1) / nThreads;
+    for (size_t t = 0; t < nThreads; ++t) {
+        size_t nBegin = t * nPerThread, nEnd = std::min(nJobs, nBegin + nPerThread);
+        threads.emplace_back(f, nBegin, nEnd);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+};
 
-        if (r.fOverwriteRangeProofParams == true) {
-            min_value = r.min_value;
-            ct_exponent = r.ct_exponent;
-            ct_bits = r.ct_bits;
+int CHDWallet::AddCTData(std::vector<std::pair<CTxOutBase*, CTempRecipient*> > &vOutputs, std::string &sError)
+{
+    std::vector<int> vRv(vOutputs.size(), 0);
+    std::vector<std::string> vErrors(vOutputs.size());
+    RunSigningJobs(vOutputs.size(), [&](size_t nBegin, size_t nEnd) {
+        // Each job borrows scratch space from its own thread's pool
+        for (size_t i = nBegin; i < nEnd; ++i) {
+            vRv[i] = AddCTData(vOutputs[i].first, *vOutputs[i].second, vErrors[i]);
         }
+    });
 
-        if (1 != secp256k1_rangeproof_sign(secp256k1_ctx_blind,
-            &(*pvRangeproof)[0], &nRangeProofLen,
-            min_value, pCommitment,
-            &r.vBlind[0], nonce.begin(),
-            ct_exponent, ct_bits,
-            nValue,
-            (const unsigned char*) message, mlen,
-            nullptr, 0,
-            secp256k1_generator_h)) {
-            return wserrorN(1, sError, __func__, "secp256k1_rangeproof_sign failed.");
+    for (size_t i = 0; i < vOutputs.size(); ++i) {
+        if (vRv[i] != 0) {
+            sError = vErrors[i];
+            return vRv[i];
         }
     }
-
-    pvRangeproof->resize(nRangeProofLen);
-
     return 0;
 };
 
@@ -3742,22 +4076,24 @@ int CHDWallet::AddStandardInputs(CWalletTx &wtx, CTransactionRecord &rtx,
                 }
             }
 
+            std::vector<std::pair<CTxOutBase*, CTempRecipient*> > vCTOutputs;
             for (size_t i = 0; i < vecSend.size(); ++i) {
                 auto &r = vecSend[i];
 
                 if (r.nType == OUTPUT_RINGCT) {
                     if (r.vBlind.size() != 32) {
                         r.vBlind.resize(32);
-                        GetStrongRandBytes(&r.vBlind[0], 32);
+                        GetFastRandBytes(&r.vBlind[0], 32);
                     }
                     vpBlinds.push_back(&r.vBlind[0]);
 
                     assert(r.n < (int)txNew.vpout.size());
-                    if (0 != AddCTData(txNew.vpout[r.n].get(), r, sError)) {
-                        return 1; // sError will be set
-                    }
+                    vCTOutputs.emplace_back(txNew.vpout[r.n].get(), &r);
                 }
             }
+            if (0 != AddCTData(vCTOutputs, sError)) {
+                return 1; // sError will be set
+            }
 
             // Fill in dummy signatures for fee calculation.
             int nIn = 0;
@@ -3944,42 +4280,38 @@ int CHDWallet::AddStandardInputs(CWalletTx &wtx, CTransactionRecord &rtx,
                     return wserrorN(1, sError, __func__, _("PrepareTransaction for device failed: %s"), pDevice->sError);
                 }
 
-                int nIn = 0;
-                for (const auto &coin : setCoins) {
-                    const CScript& scriptPubKey = coin.txout.scriptPubKey;
+                // Collect the signature requests of all inputs, the device signs them in one session
+                std::vector<usb_device::CDeviceSignRequest> vRequests;
+                for (int pass = 0; pass < 2; ++pass) {
+                    int nIn = 0;
+                    for (const auto &coin : setCoins) {
+                        const CScript& scriptPubKey = coin.txout.scriptPubKey;
 
-                    if (!(::IsMine(*this, scriptPubKey) & ISMINE_HARDWARE_DEVICE)) {
-                        nIn++;
-                        continue;
-                    }
+                        if (!(::IsMine(*this, scriptPubKey) & ISMINE_HARDWARE_DEVICE)) {
+                            nIn++;
+                            continue;
+                        }
 
-                    std::vector<uint8_t> vchAmount(8);
-                    memcpy(vchAmount.data(), &coin.txout.nValue, 8);
+                        std::vector<uint8_t> vchAmount(8);
+                        memcpy(vchAmount.data(), &coin.txout.nValue, 8);
 
-                    pDevice->sError.clear();
-                    SignatureData sigdata;
-                    ProduceSignature(*this, usb_device::DeviceSignatureCreator(pDevice, &txNew, nIn, vchAmount, SIGHASH_ALL), scriptPubKey, sigdata);
+                        SignatureData sigdata;
+                        ProduceSignature(*this, usb_device::DeviceSignatureCreator(pDevice, &txNew, nIn, vchAmount, SIGHASH_ALL, &vRequests), scriptPubKey, sigdata);
+                        if (pass == 1) {
+                            UpdateInput(txNew.vin[nIn], sigdata);
+                        }
 
-                    if (!pDevice->sError.empty()) {
-                        pDevice->Close();
-                        uiInterface.NotifyWaitingForDevice(true);
-                        return wserrorN(1, sError, __func__, _("ProduceSignature from device failed: %s"), pDevice->sError);
+                        nIn++;
                     }
-                    UpdateInput(txNew.vin[nIn], sigdata);
-
-                    /*
-                    ScriptError serror = SCRIPT_ERR_OK;
-                    if (!VerifyScript(txin.scriptSig, prevPubKey, &txin.scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&txConst, i, vchAmount), &serror)) {
-                        if (serror == SCRIPT_ERR_INVALID_STACK_OPERATION) {
-                            // Unable to sign input and verification failed (possible attempt to partially sign).
-                            TxInErrorToJSON(txin, vErrors, "Unable to sign input, invalid stack size (possibly missing key)");
-                        } else {
-                            TxInErrorToJSON(txin, vErrors, ScriptErrorString(serror));
+
+                    if (pass == 0) {
+                        pDevice->sError.clear();
+                        if (0 != pDevice->SignTransactionBatch(&txNew, vRequests, pDevice->sError)) {
+                            pDevice->Close();
+                            uiInterface.NotifyWaitingForDevice(true);
+                            return wserrorN(1, sError, __func__, _("ProduceSignature from device failed: %s"), pDevice->sError);
                         }
                     }
-                    */
-
-                    nIn++;
                 }
 
                 pDevice->Close();
@@ -4116,7 +4448,7 @@ int CHDWallet::PlaceRealOutputs(std::vector<std::vector<int64_t> > &vMI, size_t
 
     //GetStrongRandBytes((unsigned char*)&nSecretColumn, sizeof(nSecretColumn));
     //nSecretColumn %= nRingSize;
-    nSecretColumn = GetRandInt(nRingSize);
+    nSecretColumn = GetFastRandInt(nRingSize);
 
     CHDWalletDB wdb(*database);
     vMI.resize(vCoins.size());
@@ -4162,6 +4494,32 @@ int CHDWallet::PlaceRealOutputs(std::vector<std::vector<int64_t> > &vMI, size_t
     return 0;
 };
 
+// Block indices hold the cumulative anon output count of the chain, a height to
+// RCT index map kept current as blocks connect, decoy ranges resolve against it
+// without reading outputs from the db. cs_main must be held.
+static int64_t LastRCTIndexAtHeight(int nHeight)
+{
+    if (nHeight < 0) {
+        return 0;
+    }
+    return chainActive[std::min(nHeight, chainActive.Height())]->nAnonOutputs;
+};
+
+// Height of the block which added anon output nIndex, cs_main must be held.
+static int RCTIndexHeight(int64_t nIndex)
+{
+    int nLow = 0, nHigh = chainActive.Height();
+    while (nLow < nHigh) {
+        int nMid = nLow + (nHigh - nLow) / 2;
+        if (chainActive[nMid]->nAnonOutputs < nIndex) {
+            nLow = nMid + 1;
+        } else {
+            nHigh = nMid;
+        }
+    }
+    return nLow;
+};
+
 int CHDWallet::PickHidingOutputs(std::vector<std::vector<int64_t> > &vMI, size_t nSecretColumn, size_t nRingSize, std::set<int64_t> &setHave,
     std::string &sError)
 {
@@ -4172,21 +4530,11 @@ int CHDWallet::PickHidingOutputs(std::vector<std::vector<int64_t> > &vMI, size_t
     int nBestHeight = chainActive.Tip()->nHeight;
     const Consensus::Params& consensusParams = Params().GetConsensus();
     size_t nInputs = vMI.size();
-    int64_t nLastRCTOutIndex = chainActive.Tip()->nAnonOutputs;
 
-    // Remove outputs without required depth
+    // Remove outputs without required depth, all outputs below that are usable as decoys as
+    // no spend can reveal one (see CAnonOutput::nCompromised)
     int nExtraDepth = gArgs.GetBoolArg("-regtest", false) ? -1 : 2; // if not on regtest pick outputs deeper than consensus checks to prevent banning
-    while (nLastRCTOutIndex > 1){
-        CAnonOutput ao;
-        if (!pblocktree->ReadRCTOutput(nLastRCTOutIndex, ao)) {
-            return wserrorN(1, sError, __func__, _("Anon output not found in db, %d"), nLastRCTOutIndex);
-        }
-        if (ao.nBlockHeight > nBestHeight - (consensusParams.nMinRCTOutputDepth + nExtraDepth)) {
-            nLastRCTOutIndex--;
-            continue;
-        }
-        break;
-    }
+    int64_t nLastRCTOutIndex = LastRCTIndexAtHeight(nBestHeight - (consensusParams.nMinRCTOutputDepth + nExtraDepth));
 
     if (LogAcceptCategory(BCLog::HDWALLET)) {
         WalletLogPrintf("%s: Last index %d, inputs %d, ring size %d, selection mode %d.\n", __func__, nLastRCTOutIndex, nInputs, nRingSize, m_mixin_selection_mode);
@@ -4215,12 +4563,8 @@ int CHDWallet::PickHidingOutputs(std::vector<std::vector<int64_t> > &vMI, size_t
             ranges[j] = expect_aos_per_period * range_periods[j];
 
             int64_t output_id = nLastRCTOutIndex - std::min(nLastRCTOutIndex-1, std::max(int64_t(1), ranges[j]));
-            CAnonOutput ao;
-            if (!pblocktree->ReadRCTOutput(output_id, ao)) {
-                return wserrorN(1, sError, __func__, _("Anon output not found in db, %d"), output_id);
-            }
 
-            int num_blocks = nBestHeight - ao.nBlockHeight;
+            int num_blocks = nBestHeight - RCTIndexHeight(output_id);
             if (num_blocks) {
                 double ratio = ((double) range_periods[j] / ((double) num_blocks / 720.0));
                 if (ratio > 1.0) {
@@ -4230,12 +4574,13 @@ int CHDWallet::PickHidingOutputs(std::vector<std::vector<int64_t> > &vMI, size_t
                     ranges[j] *= ratio;
                 }
             }
-            ranges[j] += (int64_t) GetRand((uint64_t)((double)ranges[j] * range_blur));
+            ranges[j] += (int64_t) GetFastRand((uint64_t)((double)ranges[j] * range_blur));
         }
     }
 
-    for (size_t k = 0; k < nInputs; ++k)
-    for (size_t i = 0; i < nRingSize; ++i) {
+    // The whole nInputs x nRingSize matrix in one pass, collisions are redrawn in memory
+    for (size_t n = 0; n < nInputs * nRingSize; ++n) {
+        size_t k = n / nRingSize, i = n % nRingSize;
         if (i == nSecretColumn) {
             continue;
         }
@@ -4248,7 +4593,7 @@ int CHDWallet::PickHidingOutputs(std::vector<std::vector<int64_t> > &vMI, size_t
 
             if (m_mixin_selection_mode == 1) {
                 static const int max_r = 1000;
-                int g_r = GetRandInt(max_r);
+                int g_r = GetFastRandInt(max_r);
                 for (int j = 0; j < max_groups; j++) {
                     if (g_r <= max_r * distribution[j]) {
                         select_min = nLastRCTOutIndex - ranges[j];
@@ -4265,13 +4610,13 @@ int CHDWallet::PickHidingOutputs(std::vector<std::vector<int64_t> > &vMI, size_t
             if (m_mixin_selection_mode == 2) {
                 int64_t select_range = 0;
                 int64_t select_near = 0;
-                if (GetRandInt(100) < 50) { // 50% chance of selecting within 5000 places of a random input
+                if (GetFastRandInt(100) < 50) { // 50% chance of selecting within 5000 places of a random input
                     select_range = nRCTOutSelectionGroup1;
-                    select_near = real_inputs[GetRandInt(real_inputs.size())];
+                    select_near = real_inputs[GetFastRandInt(real_inputs.size())];
                 } else
-                if (GetRandInt(100) < 40) { // Further 40% chance of selecting within 50000 places of a random input
+                if (GetFastRandInt(100) < 40) { // Further 40% chance of selecting within 50000 places of a random input
                     select_range = nRCTOutSelectionGroup2;
-                    select_near = real_inputs[GetRandInt(real_inputs.size())];
+                    select_near = real_inputs[GetFastRandInt(real_inputs.size())];
                 }
 
                 if (select_near) {
@@ -4281,15 +4626,8 @@ int CHDWallet::PickHidingOutputs(std::vector<std::vector<int64_t> > &vMI, size_t
                     select_min = std::min(nLastRCTOutIndex, std::max(int64_t(1), select_near - select_range));
                     select_max = std::min(nLastRCTOutIndex, select_near + select_range);
 
-                    int64_t num_blocks, num_aos = select_max - select_min;
-                    CAnonOutput ao_min, ao_max;
-                    if (!pblocktree->ReadRCTOutput(select_min, ao_min)) {
-                        return wserrorN(1, sError, __func__, _("Anon output not found in db, %d"), select_min);
-                    }
-                    if (!pblocktree->ReadRCTOutput(select_max, ao_max)) {
-                        return wserrorN(1, sError, __func__, _("Anon output not found in db, %d"), select_max);
-                    }
-                    num_blocks = ao_max.nBlockHeight - ao_min.nBlockHeight;
+                    int64_t num_aos = select_max - select_min;
+                    int64_t num_blocks = RCTIndexHeight(select_max) - RCTIndexHeight(select_min);
 
                     if (num_blocks) {
                         double ratio = ((double) num_aos * 2.0) / ((double) num_blocks);
@@ -4305,7 +4643,7 @@ int CHDWallet::PickHidingOutputs(std::vector<std::vector<int64_t> > &vMI, size_t
                 }
             }
 
-            int64_t nDecoy = select_min + GetRand(select_max-select_min);
+            int64_t nDecoy = select_min + GetFastRand(select_max-select_min);
             if (setHave.count(nDecoy) > 0) {
                 if (nDecoy == nLastRCTOutIndex) {
                     nLastRCTOutIndex--;
@@ -4330,6 +4668,19 @@ int CHDWallet::PickHidingOutputs(std::vector<std::vector<int64_t> > &vMI, size_t
     return 0;
 };
 
+// Fee passes of AddSpendingInputs that select by branch and bound before falling back to the knapsack selection
+static const size_t MAX_ANON_BNB_PASSES = 4;
+
+// Estimated virtual size of one RingCT input: its key image in scriptData, its ring member indices
+// and MLSAG row in the witness, and its share of the txin and the rows of its signature.
+static int64_t GetAnonInputVSize(size_t nRingSize, size_t nInputsPerSig)
+{
+    int64_t nWitness = nRingSize * (4 + 32);
+    nWitness += ((1 + nRingSize) * 32 + 33) / nInputsPerSig;
+    int64_t nBase = 33 + (32 + 4 + 4 + 2) / nInputsPerSig;
+    return nBase + (nWitness + WITNESS_SCALE_FACTOR - 1) / WITNESS_SCALE_FACTOR;
+}
+
 int CHDWallet::AddSpendingInputs(CWalletTx &wtx, CTransactionRecord &rtx,
     std::vector<CTempRecipient> &vecSend,
     CExtKeyAccount *sea, CStoredExtKey *pc,
@@ -4374,6 +4725,20 @@ int CHDWallet::AddSpendingInputs(CWalletTx &wtx, CTransactionRecord &rtx,
         std::vector<COutputR> vAvailableCoins;
         AvailableAnonCoins(vAvailableCoins, true, coinControl);
 
+        // The fee of a RingCT input grows with the ring size, select by branch and bound on values less
+        // that fee so fewer inputs, and smaller MLSAGs, are preferred.
+        // nNotInputFees is learnt from the size of each pass, excess up to nCostOfChange may go to fee.
+        CAmount nInputFee = GetMinimumFeeRate(*this, *coinControl, ::mempool, ::feeEstimator, &feeCalc).GetFee(GetAnonInputVSize(nRingSize, nInputsPerSig));
+        CAmount nCostOfChange = ::minRelayTxFee.GetFee(2048) + nInputFee;
+        CAmount nNotInputFees = 0;
+        size_t nBnBPasses = 0;
+        bool fUseBnB = nInputFee > 0 && !coinControl->HasSelected();
+        std::vector<CAmount> vEffectiveValues;
+        std::vector<std::pair<MapRecords_t::const_iterator, unsigned int> > vCandidates;
+        if (fUseBnB) {
+            GetAnonSelectionCandidates(vAvailableCoins, nInputFee, vEffectiveValues, vCandidates);
+        }
+
         CAmount nValueOutPlain = 0;
         int nChangePosInOut = -1;
 
@@ -4399,6 +4764,19 @@ int CHDWallet::AddSpendingInputs(CWalletTx &wtx, CTransactionRecord &rtx,
             if (pick_new_inputs) {
                 nValueIn = 0;
                 setCoins.clear();
+
+                std::vector<size_t> vSelection;
+                CAmount nEffectiveValue = 0;
+                if (fUseBnB && nSubtractFeeFromAmount == 0 && nBnBPasses++ < MAX_ANON_BNB_PASSES
+                    && SelectCoinsBnB(vEffectiveValues, nInputFee, nValue + nNotInputFees, nCostOfChange, vSelection, nEffectiveValue)) {
+                    for (size_t k : vSelection) {
+                        setCoins.push_back(vCandidates[k]);
+                    }
+                    random_shuffle(setCoins.begin(), setCoins.end(), GetRandInt);
+                    nValueIn = nEffectiveValue + nInputFee * (CAmount)setCoins.size();
+                    nFeeRet = nNotInputFees + nInputFee * (CAmount)setCoins.size();
+                    nValueToSelect = nValue + nFeeRet;
+                } else
                 if (!SelectBlindedCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, coinControl) || !setCoins.size()) {
                     return wserrorN(1, sError, __func__, _("Insufficient funds."));
                 }
@@ -4473,6 +4851,7 @@ int CHDWallet::AddSpendingInputs(CWalletTx &wtx, CTransactionRecord &rtx,
             txNew.vpout.push_back(outFee);
 
             bool fFirst = true;
+            std::vector<std::pair<CTxOutBase*, CTempRecipient*> > vCTOutputs;
             for (size_t i = 0; i < vecSend.size(); ++i) {
                 auto &r = vecSend[i];
 
@@ -4498,14 +4877,15 @@ int CHDWallet::AddSpendingInputs(CWalletTx &wtx, CTransactionRecord &rtx,
                 if (r.nType == OUTPUT_RINGCT) {
                     if (r.vBlind.size() != 32) {
                         r.vBlind.resize(32);
-                        GetStrongRandBytes(&r.vBlind[0], 32);
+                        GetFastRandBytes(&r.vBlind[0], 32);
                     }
 
-                    if (0 != AddCTData(txbout.get(), r, sError)) {
-                        return 1; // sError will be set
-                    }
+                    vCTOutputs.emplace_back(txbout.get(), &r);
                 }
             }
+            if (0 != AddCTData(vCTOutputs, sError)) {
+                return 1; // sError will be set
+            }
 
             std::set<int64_t> setHave; // Anon prev-outputs can only be used once per transaction.
             size_t nTotalInputs = 0;
@@ -4554,6 +4934,7 @@ int CHDWallet::AddSpendingInputs(CWalletTx &wtx, CTransactionRecord &rtx,
             nBytes = GetVirtualTransactionSize(txNew);
 
             nFeeNeeded = GetMinimumFee(*this, nBytes, *coinControl, ::mempool, ::feeEstimator, &feeCalc);
+            nNotInputFees = std::max(nNotInputFees, nFeeNeeded - nInputFee * (CAmount)setCoins.size());
 
             // If we made it here and we aren't even able to meet the relay fee on the next pass, give up
             // because we must be at the maximum allowed fee.
@@ -4656,7 +5037,7 @@ int CHDWallet::AddSpendingInputs(CWalletTx &wtx, CTransactionRecord &rtx,
 
                 if (r.vBlind.size() != 32) {
                     r.vBlind.resize(32);
-                    GetStrongRandBytes(&r.vBlind[0], 32);
+                    GetFastRandBytes(&r.vBlind[0], 32);
                 }
 
                 if (0 != AddCTData(txNew.vpout[r.n].get(), r, sError)) {
@@ -4701,14 +5082,17 @@ int CHDWallet::AddSpendingInputs(CWalletTx &wtx, CTransactionRecord &rtx,
                 std::vector<uint8_t> &vKeyImages = txin.scriptData.stack[0];
                 vKeyImages.resize(33 * nSigInputs);
 
+                std::vector<int64_t> vIndices(nSigInputs);
                 for (size_t k = 0; k < nSigInputs; ++k) {
-                    size_t i = vSecretColumns[l];
-                    int64_t nIndex = vMI[l][k][i];
+                    vIndices[k] = vMI[l][k][vSecretColumns[l]];
+                }
+                std::vector<CAnonOutput> vao;
+                if (!pblocktree->ReadRCTOutputs(vIndices, vao)) {
+                    return wserrorN(1, sError, __func__, _("Anon outputs not found in db"));
+                }
 
-                    CAnonOutput ao;
-                    if (!pblocktree->ReadRCTOutput(nIndex, ao)) {
-                        return wserrorN(1, sError, __func__, _("Anon output not found in db, %d"), nIndex);
-                    }
+                for (size_t k = 0; k < nSigInputs; ++k) {
+                    const CAnonOutput &ao = vao[k];
 
                     CKeyID idk = ao.pubkey.GetID();
                     CKey key;
@@ -4724,22 +5108,38 @@ int CHDWallet::AddSpendingInputs(CWalletTx &wtx, CTransactionRecord &rtx,
             }
 
 
+            // Signatures are independent once the commitments are split, they are
+            // prepared in input order then generated in parallel
+            struct MlsagJob {
+                size_t nCols, nRows;
+                uint8_t randSeed[32];
+                uint8_t blindSum[32];
+                std::vector<CKey> vsk;
+                std::vector<const uint8_t*> vpsk;
+                std::vector<uint8_t> vm;
+                int rv = 0;
+            };
+            std::vector<MlsagJob> vMlsag(txNew.vin.size());
+
             for (size_t l = 0; l < txNew.vin.size(); ++l) {
                 auto &txin = txNew.vin[l];
 
                 uint32_t nSigInputs, nSigRingSize;
                 txin.GetAnonInfo(nSigInputs, nSigRingSize);
 
-                size_t nCols = nSigRingSize;
-                size_t nRows = nSigInputs + 1;
+                MlsagJob &job = vMlsag[l];
+                size_t nCols = job.nCols = nSigRingSize;
+                size_t nRows = job.nRows = nSigInputs + 1;
 
-                uint8_t randSeed[32];
-                GetStrongRandBytes(randSeed, 32);
+                GetFastRandBytes(job.randSeed, 32);
 
-                std::vector<CKey> vsk(nSigInputs);
-                std::vector<const uint8_t*> vpsk(nRows);
+                std::vector<CKey> &vsk = job.vsk;
+                vsk.resize(nSigInputs);
+                std::vector<const uint8_t*> &vpsk = job.vpsk;
+                vpsk.resize(nRows);
 
-                std::vector<uint8_t> vm(nCols * nRows * 33);
+                std::vector<uint8_t> &vm = job.vm;
+                vm.resize(nCols * nRows * 33);
                 std::vector<secp256k1_pedersen_commitment> vCommitments;
                 vCommitments.reserve(nCols * nSigInputs);
                 std::vector<const uint8_t*> vpInCommits(nCols * nSigInputs);
@@ -4747,14 +5147,20 @@ int CHDWallet::AddSpendingInputs(CWalletTx &wtx, CTransactionRecord &rtx,
 
                 std::vector<uint8_t> &vKeyImages = txin.scriptData.stack[0];
 
+                // Fetch the ring matrix in one read
+                std::vector<int64_t> vIndices;
+                vIndices.reserve(nCols * nSigInputs);
+                for (size_t k = 0; k < nSigInputs; ++k) {
+                    vIndices.insert(vIndices.end(), vMI[l][k].begin(), vMI[l][k].begin() + nCols);
+                }
+                std::vector<CAnonOutput> vao;
+                if (!pblocktree->ReadRCTOutputs(vIndices, vao)) {
+                    return wserrorN(1, sError, __func__, _("Anon outputs not found in db"));
+                }
+
                 for (size_t k = 0; k < nSigInputs; ++k)
                 for (size_t i = 0; i < nCols; ++i) {
-                    int64_t nIndex = vMI[l][k][i];
-
-                    CAnonOutput ao;
-                    if (!pblocktree->ReadRCTOutput(nIndex, ao)) {
-                        return wserrorN(1, sError, __func__, _("Anon output not found in db, %d"), nIndex);
-                    }
+                    const CAnonOutput &ao = vao[i+k*nCols];
 
                     memcpy(&vm[(i+k*nCols)*33], ao.pubkey.begin(), 33);
                     vCommitments.push_back(ao.commitment);
@@ -4776,7 +5182,7 @@ int CHDWallet::AddSpendingInputs(CWalletTx &wtx, CTransactionRecord &rtx,
                 }
 
 
-                uint8_t blindSum[32];
+                uint8_t *blindSum = job.blindSum;
                 memset(blindSum, 0, 32);
                 vpsk[nRows-1] = blindSum;
 
@@ -4839,13 +5245,24 @@ int CHDWallet::AddSpendingInputs(CWalletTx &wtx, CTransactionRecord &rtx,
 
                     vpBlinds.pop_back();
                 }
+            }
 
+            // Key images are set and the signature data is witness, the hash is fixed
+            uint256 txhash = txNew.GetHash();
 
-                uint256 txhash = txNew.GetHash();
+            RunSigningJobs(vMlsag.size(), [&](size_t nBegin, size_t nEnd) {
+                for (size_t l = nBegin; l < nEnd; ++l) {
+                    MlsagJob &job = vMlsag[l];
+                    std::vector<uint8_t> &vKeyImages = txNew.vin[l].scriptData.stack[0];
+                    std::vector<uint8_t> &vDL = txNew.vin[l].scriptWitness.stack[1];
+                    job.rv = secp256k1_generate_mlsag(secp256k1_ctx_blind, &vKeyImages[0], &vDL[0], &vDL[32],
+                        job.randSeed, txhash.begin(), job.nCols, job.nRows, vSecretColumns[l],
+                        &job.vpsk[0], &job.vm[0]);
+                }
+            });
 
-                if (0 != (rv = secp256k1_generate_mlsag(secp256k1_ctx_blind, &vKeyImages[0], &vDL[0], &vDL[32],
-                    randSeed, txhash.begin(), nCols, nRows, vSecretColumns[l],
-                    &vpsk[0], &vm[0]))) {
+            for (size_t l = 0; l < vMlsag.size(); ++l) {
+                if (0 != (rv = vMlsag[l].rv)) {
                     return wserrorN(1, sError, __func__, _("secp256k1_generate_mlsag failed %d"), rv);
                 }
             }
@@ -4946,9 +5363,51 @@ void CHDWallet::ClearCachedBalances()
     // Clear cache when a new txn is added to the wallet or a block is added or removed from the chain.
     m_have_spendable_balance_cached = false;
     m_have_cached_stakeable_coins = false;
+    std::atomic_store(&m_balances_snapshot, std::shared_ptr<const CHDWalletBalances>());
+    std::atomic_store(&m_staking_sums_snapshot, std::shared_ptr<const CHDWalletStakingSums>());
+    return;
+}
+
+void CHDWallet::ClearCachedOutputs()
+{
+    // Keys were imported, a rescan started or txns were removed
+    InvalidateSpendableOutputs();
+    InvalidateColdStakeOutputs();
+    return;
+}
+
+void CHDWallet::BeginBlockBatch()
+{
+    AssertLockHeld(cs_wallet);
+    if (!m_block_batch) {
+        m_block_batch.reset(new CHDWalletDB(*database, "r+", false));
+        m_block_batch_flush = false;
+    }
+    return;
+}
+
+void CHDWallet::EndBlockBatch()
+{
+    AssertLockHeld(cs_wallet);
+    if (m_block_batch) {
+        if (m_block_batch_flush) {
+            m_block_batch->Flush();
+        }
+        m_block_batch.reset();
+    }
     return;
 }
 
+CHDWalletDB &CHDWallet::GetBatch(std::unique_ptr<CHDWalletDB> &own, bool fFlushOnClose) const
+{
+    if (m_block_batch) {
+        m_block_batch_flush |= fFlushOnClose;
+        return *m_block_batch;
+    }
+    own.reset(new CHDWalletDB(*database, "r+", fFlushOnClose));
+    return *own;
+}
+
 void CHDWallet::LoadToWallet(const CWalletTx& wtxIn)
 {
     uint256 hash = wtxIn.GetHash();
@@ -5053,6 +5512,9 @@ int CHDWallet::UnloadTransaction(const uint256 &hash)
         return 1;
     }
 
+    InvalidateSpendableOutputs();
+    InvalidateColdStakeOutputs();
+    ClearCachedBalances();
     NotifyTransactionChanged(this, hash, CT_DELETED);
     return 0;
 };
@@ -6028,23 +6490,58 @@ int CHDWallet::ExtKeyUnlock(CStoredExtKey *sek, const CKeyingMaterial &vMKey)
     return 0;
 };
 
+//! Ext keys are decrypted by up to MAX_UNLOCK_THREADS threads
+static const size_t MAX_UNLOCK_THREADS = 8;
+static const size_t MIN_UNLOCKS_PER_THREAD = 32;
+
 int CHDWallet::ExtKeyUnlock(const CKeyingMaterial &vMKey)
 {
     LogPrint(BCLog::HDWALLET, "ExtKeyUnlock.\n");
 
+    // Keys still unlocked, as when a wallet unlocked for staking is unlocked again, are skipped
+    std::vector<CStoredExtKey*> vLocked;
     if (pEKMaster
-        && pEKMaster->nFlags & EAF_IS_CRYPTED) {
-        if (ExtKeyUnlock(pEKMaster, vMKey) != 0) {
-            return 1;
-        }
+        && pEKMaster->nFlags & EAF_IS_CRYPTED
+        && pEKMaster->fLocked) {
+        vLocked.push_back(pEKMaster);
     }
-
     for (auto &mi : mapExtKeys) {
         CStoredExtKey *sek = mi.second;
-        if (0 != ExtKeyUnlock(sek, vMKey)) {
-            return werrorN(1, "ExtKeyUnlock failed.");
+        if (sek != pEKMaster
+            && sek->nFlags & EAF_IS_CRYPTED
+            && sek->fLocked) {
+            vLocked.push_back(sek);
+        }
+    }
+
+    // Each key is decrypted into its own CStoredExtKey, the threads share nothing else
+    std::atomic<bool> fFailed{false};
+    auto unlock = [&](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd && !fFailed; ++i) {
+            if (0 != ExtKeyUnlock(vLocked[i], vMKey)) {
+                fFailed = true;
+            }
+        }
+    };
+    size_t nThreads = std::min(std::min(MAX_UNLOCK_THREADS, (size_t)std::max(1, GetNumCores())), vLocked.size() / MIN_UNLOCKS_PER_THREAD);
+    if (nThreads < 2) {
+        unlock(0, vLocked.size());
+    } else {
+        std::vector<std::thread> threads;
+        size_t nPerThread = (vLocked.size() + nThreads - 1) / nThreads;
+        for (size_t t = 0; t < nThreads; ++t) {
+            size_t nBegin = t * nPerThread, nEnd = std::min(vLocked.size(), nBegin + nPerThread);
+            threads.emplace_back(unlock, nBegin, nEnd);
         }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    if (fFailed) {
+        return werrorN(1, "ExtKeyUnlock failed.");
     }
+    LogPrint(BCLog::HDWALLET, "%s %s: Unlocked %u ext key%s.\n", GetDisplayName(), __func__, vLocked.size(), vLocked.size() == 1 ? "" : "s");
 
     return 0;
 };
@@ -6335,6 +6832,8 @@ int CHDWallet::ExtKeyAddAccountToMaps(const CKeyID &idAccount, CExtKeyAccount *s
     }
 
     mapExtAccounts[idAccount] = sea;
+    m_stealth_table_built = false;
+    m_account_keys_built = false;
     return 0;
 };
 
@@ -6352,6 +6851,8 @@ int CHDWallet::ExtKeyRemoveAccountFromMapsAndFree(CExtKeyAccount *sea)
     }
 
     mapExtAccounts.erase(idAccount);
+    m_stealth_table_built = false;
+    m_account_keys_built = false;
     sea->FreeChains();
     delete sea;
     return 0;
@@ -6458,6 +6959,7 @@ int CHDWallet::ExtKeyLoadAccountPacks()
         for (it = aksPak.begin(); it != aksPak.end(); ++it) {
             nStealthKeys++;
             sea->mapStealthKeys[it->id] = it->aks;
+            m_stealth_table_built = false;
         }
     }
 
@@ -6503,6 +7005,7 @@ int CHDWallet::ExtKeyLoadAccountPacks()
     }
 
     pcursor->close();
+    m_account_keys_built = false;
 
     return 0;
 };
@@ -6563,6 +7066,45 @@ int CHDWallet::ExtKeyAppendToPack(CHDWalletDB *pwdb, CExtKeyAccount *sea, const
     return 0;
 };
 
+int CHDWallet::ExtKeyAppendToPack(CHDWalletDB *pwdb, CExtKeyAccount *sea, const std::vector<CEKAKeyPack> &vKeys, bool &fUpdateAcc) const
+{
+    // Must call WriteExtAccount after
+    // Each pack is read and written once, instead of once per key
+
+    fUpdateAcc = false;
+    if (vKeys.empty()) {
+        return 0;
+    }
+
+    CKeyID idAccount = sea->GetID();
+    std::vector<CEKAKeyPack> ekPak;
+    if (!pwdb->ReadExtKeyPack(idAccount, sea->nPack, ekPak)) {
+        // New pack
+        ekPak.clear();
+        if (LogAcceptCategory(BCLog::HDWALLET)) {
+            WalletLogPrintf("Account %s, starting new keypack %u.\n", idAccount.ToString(), sea->nPack);
+        }
+    }
+
+    for (size_t i = 0; i < vKeys.size(); ++i) {
+        ekPak.push_back(vKeys[i]);
+
+        bool fFull = (uint32_t)ekPak.size() >= MAX_KEY_PACK_SIZE-1;
+        if (!fFull && i + 1 < vKeys.size()) {
+            continue;
+        }
+        if (!pwdb->WriteExtKeyPack(idAccount, sea->nPack, ekPak)) {
+            return werrorN(1, "%s Save key pack %u failed.", __func__, sea->nPack);
+        }
+        if (fFull) {
+            fUpdateAcc = true;
+            sea->nPack++;
+            ekPak.clear();
+        }
+    }
+    return 0;
+};
+
 int CHDWallet::ExtKeyAppendToPack(CHDWalletDB *pwdb, CExtKeyAccount *sea, const CKeyID &idKey, const CEKASCKey &asck, bool &fUpdateAcc) const
 {
     // Must call WriteExtAccount after
@@ -6594,18 +7136,18 @@ int CHDWallet::ExtKeyAppendToPack(CHDWalletDB *pwdb, CExtKeyAccount *sea, const
     return 0;
 };
 
-int CHDWallet::ExtKeySaveKey(CHDWalletDB *pwdb, CExtKeyAccount *sea, const CKeyID &keyId, const CEKAKey &ak) const
+int CHDWallet::ExtKeyAddSavedKey(CExtKeyAccount *sea, const CKeyID &keyId, const CEKAKey &ak, std::vector<CEKAKeyPack> &vPack) const
 {
+    // Update sea and the chain in memory, the key pack entries to write are appended to vPack
     LogPrint(BCLog::HDWALLET, "%s %s %s.\n", __func__, sea->GetIDString58(), CBitcoinAddress(keyId).ToString());
     AssertLockHeld(cs_wallet);
 
     size_t nChain = ak.nParent;
-    bool fUpdateAccTmp, fUpdateAcc = false;
     if (gArgs.GetBoolArg("-extkeysaveancestors", true)) {
         LOCK(sea->cs_account);
         AccKeyMap::const_iterator mi = sea->mapKeys.find(keyId);
         if (mi != sea->mapKeys.end()) {
-            return false; // already saved
+            return 0; // already saved
         }
 
         if (sea->mapLookAhead.erase(keyId) != 1) {
@@ -6613,10 +7155,7 @@ int CHDWallet::ExtKeySaveKey(CHDWalletDB *pwdb, CExtKeyAccount *sea, const CKeyI
         }
 
         sea->mapKeys[keyId] = ak;
-        if (0 != ExtKeyAppendToPack(pwdb, sea, keyId, ak, fUpdateAccTmp)) {
-            return werrorN(1, "%s ExtKeyAppendToPack failed.", __func__);
-        }
-        fUpdateAcc = fUpdateAccTmp ? true : fUpdateAcc;
+        vPack.push_back(CEKAKeyPack(keyId, ak));
 
         CStoredExtKey *pc;
         if (!IsHardened(ak.nKey)
@@ -6643,10 +7182,7 @@ int CHDWallet::ExtKeySaveKey(CHDWalletDB *pwdb, CExtKeyAccount *sea, const CKeyI
 
                     CEKAKey akExtra(nChain, nChildOut);
                     sea->mapKeys[idkExtra] = akExtra;
-                    if (0 != ExtKeyAppendToPack(pwdb, sea, idkExtra, akExtra, fUpdateAccTmp)) {
-                        return werrorN(1, "%s ExtKeyAppendToPack failed.", __func__);
-                    }
-                    fUpdateAcc = fUpdateAccTmp ? true : fUpdateAcc;
+                    vPack.push_back(CEKAKeyPack(idkExtra, akExtra));
 
                     if (pc->nFlags & EAF_ACTIVE
                         && pc->nFlags & EAF_RECEIVE_ON) {
@@ -6670,14 +7206,29 @@ int CHDWallet::ExtKeySaveKey(CHDWalletDB *pwdb, CExtKeyAccount *sea, const CKeyI
         if (!sea->SaveKey(keyId, ak)) {
             return werrorN(1, "%s SaveKey failed.", __func__);
         }
+        vPack.push_back(CEKAKeyPack(keyId, ak));
+    }
 
-        if (0 != ExtKeyAppendToPack(pwdb, sea, keyId, ak, fUpdateAcc)) {
-            return werrorN(1, "%s ExtKeyAppendToPack failed.", __func__);
-        }
+    return 0;
+};
+
+int CHDWallet::ExtKeySaveKey(CHDWalletDB *pwdb, CExtKeyAccount *sea, const CKeyID &keyId, const CEKAKey &ak) const
+{
+    std::vector<CEKAKeyPack> vPack;
+    if (0 != ExtKeyAddSavedKey(sea, keyId, ak, vPack)) {
+        return 1;
+    }
+    if (vPack.empty()) {
+        return 0; // already saved
     }
 
+    bool fUpdateAcc;
+    if (0 != ExtKeyAppendToPack(pwdb, sea, vPack, fUpdateAcc)) {
+        return werrorN(1, "%s ExtKeyAppendToPack failed.", __func__);
+    }
 
     // Save chain, nGenerated changed
+    size_t nChain = ak.nParent;
     CStoredExtKey *pc = sea->GetChain(nChain);
     if (!pc) {
         return werrorN(1, "%s GetChain failed.", __func__);
@@ -6698,12 +7249,52 @@ int CHDWallet::ExtKeySaveKey(CHDWalletDB *pwdb, CExtKeyAccount *sea, const CKeyI
     return 0;
 };
 
+int CHDWallet::ExtKeySaveKeys(CHDWalletDB *pwdb, CExtKeyAccount *sea, const std::vector<std::pair<CKeyID, CEKAKey> > &vKeys) const
+{
+    AssertLockHeld(cs_wallet);
+
+    std::vector<CEKAKeyPack> vPack;
+    vPack.reserve(vKeys.size());
+    std::set<uint32_t> setChains;
+    for (const auto &k : vKeys) {
+        if (0 != ExtKeyAddSavedKey(sea, k.first, k.second, vPack)) {
+            return 1;
+        }
+        setChains.insert(k.second.nParent);
+    }
+
+    bool fUpdateAcc;
+    if (0 != ExtKeyAppendToPack(pwdb, sea, vPack, fUpdateAcc)) {
+        return werrorN(1, "%s ExtKeyAppendToPack failed.", __func__);
+    }
+
+    for (auto nChain : setChains) {
+        CStoredExtKey *pc = sea->GetChain(nChain);
+        if (!pc) {
+            return werrorN(1, "%s GetChain failed.", __func__);
+        }
+        if (!pwdb->WriteExtKey(sea->vExtKeyIDs[nChain], *pc)) {
+            return werrorN(1, "%s WriteExtKey failed.", __func__);
+        }
+    }
+
+    if (fUpdateAcc) {
+        CKeyID idAccount = sea->GetID();
+        if (!pwdb->WriteExtAccount(idAccount, *sea)) {
+            return werrorN(1, "%s WriteExtAccount failed.", __func__);
+        }
+    }
+
+    return 0;
+};
+
 int CHDWallet::ExtKeySaveKey(CExtKeyAccount *sea, const CKeyID &keyId, const CEKAKey &ak) const
 {
     //LOCK(cs_wallet);
     AssertLockHeld(cs_wallet);
 
-    CHDWalletDB wdb(*database, "r+", true); // FlushOnClose
+    std::unique_ptr<CHDWalletDB> pwdb;
+    CHDWalletDB &wdb = GetBatch(pwdb, true); // FlushOnClose
 
     if (!wdb.TxnBegin()) {
         return werrorN(1, "%s TxnBegin failed.", __func__);
@@ -6748,7 +7339,8 @@ int CHDWallet::ExtKeySaveKey(CExtKeyAccount *sea, const CKeyID &keyId, const CEK
 {
     AssertLockHeld(cs_wallet);
 
-    CHDWalletDB wdb(*database, "r+");
+    std::unique_ptr<CHDWalletDB> pwdb;
+    CHDWalletDB &wdb = GetBatch(pwdb, true);
 
     if (!wdb.TxnBegin()) {
         return werrorN(1, "%s TxnBegin failed.", __func__);
@@ -7084,6 +7676,7 @@ int CHDWallet::NewStealthKeyFromAccount(
 
     CKeyID idKey = aks.GetID();
     sea->mapStealthKeys[idKey] = aks;
+    m_stealth_table_built = false;
 
     if (!pwdb->ReadExtStealthKeyPack(idAccount, sea->nPackStealth, aksPak)) {
         // New pack
@@ -7097,12 +7690,14 @@ int CHDWallet::NewStealthKeyFromAccount(
 
     if (!pwdb->WriteExtStealthKeyPack(idAccount, sea->nPackStealth, aksPak)) {
         sea->mapStealthKeys.erase(idKey);
+        m_stealth_table_built = false;
         sek->SetCounter(nChildBkp, true);
         return werrorN(1, "%s Save key pack %u failed.", __func__, sea->nPackStealth);
     }
 
     if (!pwdb->WriteExtKey(sea->vExtKeyIDs[nChain], *sek)) {
         sea->mapStealthKeys.erase(idKey);
+        m_stealth_table_built = false;
         sek->SetCounter(nChildBkp, true);
         return werrorN(1, "%s Save account chain failed.", __func__);
     }
@@ -7240,6 +7835,7 @@ int CHDWallet::SaveStealthAddress(CHDWalletDB *pwdb, CExtKeyAccount *sea, const
     }
 
     sea->mapStealthKeys[idKey] = akStealth;
+    m_stealth_table_built = false;
 
     if (!pwdb->ReadExtStealthKeyPack(idAccount, sea->nPackStealth, aksPak)) {
         // New pack
@@ -7252,12 +7848,14 @@ int CHDWallet::SaveStealthAddress(CHDWalletDB *pwdb, CExtKeyAccount *sea, const
     aksPak.push_back(CEKAStealthKeyPack(idKey, akStealth));
     if (!pwdb->WriteExtStealthKeyPack(idAccount, sea->nPackStealth, aksPak)) {
         sea->mapStealthKeys.erase(idKey);
+        m_stealth_table_built = false;
         return werrorN(1, "WriteExtStealthKeyPack failed.");
     }
 
     if (!pwdb->WriteExtKey(sea->vExtKeyIDs[nScanChain], *sekScan)
         || !pwdb->WriteExtKey(sea->vExtKeyIDs[nSpendChain], *sekSpend)) {
         sea->mapStealthKeys.erase(idKey);
+        m_stealth_table_built = false;
         return werrorN(1, "WriteExtKey failed.");
     }
 
@@ -7901,6 +8499,8 @@ bool CHDWallet::CommitTransaction(CTransactionRef tx, mapValue_t mapValue, std::
             // otherwise just for transaction history.
 
             AddToWallet(wtxNew);
+            MarkSpendableDirty(*wtxNew.tx);
+            MarkColdStakeDirty(*wtxNew.tx);
 
             // Notify that old coins are spent
             for (const auto &txin : wtxNew.tx->vin)
@@ -7947,6 +8547,8 @@ bool CHDWallet::CommitTransaction(CWalletTx &wtxNew, CTransactionRecord &rtx,
         WalletLogPrintf("CommitTransaction:\n%s", wtxNew.tx->ToString()); /* Continued */
 
         AddToRecord(rtx, *wtxNew.tx, nullptr, -1);
+        MarkSpendableDirty(*wtxNew.tx);
+        MarkColdStakeDirty(*wtxNew.tx);
 
         if (fBroadcastTransactions)
         {
@@ -8058,14 +8660,50 @@ int CHDWallet::LoadStealthAddresses()
         }
 
         stealthAddresses.insert(sx);
+        m_stealth_table_built = false;
+    }
+
+    m_stealth_index.clear();
+    m_stealth_index_reverse.clear();
+
+    uint32_t id;
+    CStealthAddressIndexed sxi;
+    fFlags = DB_SET_RANGE;
+    ssKey.clear();
+    ssKey << std::string("ins");
+    while (wdb.ReadAtCursor(pcursor, ssKey, ssValue, fFlags) == 0) {
+        fFlags = DB_NEXT;
+
+        ssKey >> strType;
+        if (strType != "ins") {
+            break;
+        }
+
+        ssKey >> id;
+        ssValue >> sxi;
+        AddStealthIndex(id, Hash160(sxi.addrRaw.begin(), sxi.addrRaw.end()), sxi);
     }
     pcursor->close();
 
-    LogPrint(BCLog::HDWALLET, "Loaded %u stealth address.\n", stealthAddresses.size());
+    LogPrint(BCLog::HDWALLET, "Loaded %u stealth address, %u indexed.\n", stealthAddresses.size(), m_stealth_index_reverse.size());
 
     return 0;
 };
 
+void CHDWallet::AddStealthIndex(uint32_t id, const uint160 &hash, const CStealthAddressIndexed &sxi)
+{
+    AssertLockHeld(cs_wallet);
+
+    if (id == 0) {
+        return;
+    }
+    if (id > m_stealth_index.size()) {
+        m_stealth_index.resize(id);
+    }
+    m_stealth_index[id - 1] = sxi;
+    m_stealth_index_reverse[hash] = id;
+};
+
 bool CHDWallet::IndexStealthKey(CHDWalletDB *pwdb, uint160 &hash, const CStealthAddressIndexed &sxi, uint32_t &id)
 {
     AssertLockHeld(cs_wallet);
@@ -8095,6 +8733,7 @@ bool CHDWallet::IndexStealthKey(CHDWalletDB *pwdb, uint160 &hash, const CStealth
         || !pwdb->WriteFlag("sxLastI", (int32_t&)id)) {
         return werror("%s: Write failed.", __func__);
     }
+    AddStealthIndex(id, hash, sxi);
 
     return true;
 };
@@ -8104,11 +8743,13 @@ bool CHDWallet::GetStealthKeyIndex(const CStealthAddressIndexed &sxi, uint32_t &
     LOCK(cs_wallet);
     uint160 hash = Hash160(sxi.addrRaw.begin(), sxi.addrRaw.end());
 
-    CHDWalletDB wdb(*database, "r+");
-    if (wdb.ReadStealthAddressIndexReverse(hash, id)) {
+    auto mi = m_stealth_index_reverse.find(hash);
+    if (mi != m_stealth_index_reverse.end()) {
+        id = mi->second;
         return true;
     }
 
+    CHDWalletDB wdb(*database, "r+");
     return IndexStealthKey(&wdb, hash, sxi, id);
 };
 
@@ -8121,7 +8762,9 @@ bool CHDWallet::UpdateStealthAddressIndex(const CKeyID &idK, const CStealthAddre
 
     CHDWalletDB wdb(*database, "r+");
 
-    if (wdb.ReadStealthAddressIndexReverse(hash, id)) {
+    auto mi = m_stealth_index_reverse.find(hash);
+    if (mi != m_stealth_index_reverse.end()) {
+        id = mi->second;
         if (!wdb.WriteStealthAddressLink(idK, id)) {
             return werror("%s: WriteStealthAddressLink failed.\n", __func__);
         }
@@ -8143,12 +8786,12 @@ bool CHDWallet::GetStealthByIndex(uint32_t sxId, CStealthAddress &sx) const
 {
     LOCK(cs_wallet);
 
-    // TODO: cache stealth addresses
-
-    CHDWalletDB wdb(*database);
+    if (sxId == 0 || sxId > m_stealth_index.size()) {
+        return false;
+    }
 
-    CStealthAddressIndexed sxi;
-    if (!wdb.ReadStealthAddressIndex(sxId, sxi)) {
+    const CStealthAddressIndexed &sxi = m_stealth_index[sxId - 1];
+    if (sxi.addrRaw.empty()) {
         return false;
     }
 
@@ -8320,6 +8963,53 @@ bool CHDWallet::ProcessLockedStealthOutputs()
     return true;
 };
 
+//! Recover the amount, blinding factor and narration of an anon output owned by key, safe to call concurrently
+static bool RewindAnonOut(const CKey &key, const CTxOutRingCT *pout, CHDWallet::CAnonOutRewind &rewound)
+{
+    CPubKey pkEphem;
+    pkEphem.Set(pout->vData.begin(), pout->vData.begin() + 33);
+
+    // Regenerate nonce
+    uint256 nonce = key.ECDH(pkEphem);
+    CSHA256().Write(nonce.begin(), 32).Finalize(nonce.begin());
+
+    uint64_t min_value, max_value;
+    unsigned char msg[256]; // Currently narration is capped at 32 bytes
+    size_t mlen = sizeof(msg);
+    memset(msg, 0, mlen);
+
+    if (pout->vRangeproof.size() < 1000) {
+        if (1 != secp256k1_bulletproof_rangeproof_rewind(secp256k1_ctx_blind, blind_gens,
+            &rewound.nValue, rewound.blind, pout->vRangeproof.data(), pout->vRangeproof.size(),
+            0, &pout->commitment, &secp256k1_generator_const_h, nonce.begin(), nullptr, 0)) {
+            return error("%s: secp256k1_bulletproof_rangeproof_rewind failed.", __func__);
+        }
+
+        ExtractNarration(nonce, pout->vData, rewound.sNarration);
+    } else
+    if (1 != secp256k1_rangeproof_rewind(secp256k1_ctx_blind,
+        rewound.blind, &rewound.nValue, msg, &mlen, nonce.begin(),
+        &min_value, &max_value,
+        &pout->commitment, pout->vRangeproof.data(), pout->vRangeproof.size(),
+        nullptr, 0,
+        secp256k1_generator_h)) {
+        return error("%s: secp256k1_rangeproof_rewind failed.", __func__);
+    }
+
+    msg[mlen-1] = '\0';
+    size_t nNarr = strlen((const char*)msg);
+    if (nNarr > 0) {
+        rewound.sNarration.assign((const char*)msg, nNarr);
+    }
+
+    rewound.fOk = true;
+    return true;
+};
+
+//! Locked outputs are rewound by up to MAX_REWIND_THREADS threads
+static const size_t MAX_REWIND_THREADS = 8;
+static const size_t MIN_REWINDS_PER_THREAD = 16;
+
 bool CHDWallet::ProcessLockedBlindedOutputs()
 {
     LogPrint(BCLog::HDWALLET, "%s %s\n", GetDisplayName(), __func__);
@@ -8346,7 +9036,7 @@ bool CHDWallet::ProcessLockedBlindedOutputs()
     COutPoint op;
     std::string strType;
 
-    CStoredTransaction stx;
+    std::vector<COutPoint> vLocked;
     unsigned int fFlags = DB_SET_RANGE;
     ssKey << std::string("lao");
     while (wdb.ReadKeyAtCursor(pcursor, ssKey, fFlags) == 0) {
@@ -8364,13 +9054,72 @@ bool CHDWallet::ProcessLockedBlindedOutputs()
         if (rv != 0) {
             WalletLogPrintf("%s: Error: pcursor->del failed for %s, %d.\n", __func__, op.ToString(), rv);
         }
+        vLocked.push_back(op);
+    };
 
-        MapRecords_t::iterator mir;
+    pcursor->close();
 
-        mir = mapRecords.find(op.hash);
-        if (mir == mapRecords.end()
-            || !wdb.ReadStoredTx(op.hash, stx)) {
-            WalletLogPrintf("%s: Error: mapRecord not found for %s.\n", __func__, op.ToString());
+    // Keys are derived here, the range proofs of all outputs are then rewound in parallel
+    std::vector<CTransactionRef> vTxns(vLocked.size());
+    std::vector<CKey> vKeys(vLocked.size());
+    std::vector<CAnonOutRewind> vRewound(vLocked.size());
+    std::vector<size_t> vRewind;
+    CStoredTransaction stx;
+    for (size_t i = 0; i < vLocked.size(); ++i) {
+        op = vLocked[i];
+        if (mapRecords.count(op.hash) < 1
+            || !wdb.ReadStoredTx(op.hash, stx)
+            || stx.tx->vpout.size() <= op.n
+            || !stx.tx->vpout[op.n]->IsType(OUTPUT_RINGCT)) {
+            continue;
+        }
+        const CTxOutRingCT *txout = (CTxOutRingCT*)stx.tx->vpout[op.n].get();
+
+        CKeyID idStealth;
+        CExtKeyAccount *pa = nullptr;
+        CEKAKey ak;
+        if (txout->vData.size() < 33
+            || !GetKey(txout->pk.GetID(), vKeys[i], pa, ak, idStealth)) {
+            continue;
+        }
+        vTxns[i] = stx.tx;
+        vRewind.push_back(i);
+    }
+
+    size_t nThreads = std::min(std::min(MAX_REWIND_THREADS, (size_t)std::max(1, GetNumCores())), vRewind.size() / MIN_REWINDS_PER_THREAD);
+    auto rewind = [&](size_t nBegin, size_t nEnd) {
+        for (size_t k = nBegin; k < nEnd; ++k) {
+            size_t i = vRewind[k];
+            RewindAnonOut(vKeys[i], (CTxOutRingCT*)vTxns[i]->vpout[vLocked[i].n].get(), vRewound[i]);
+        }
+    };
+    if (nThreads < 2) {
+        rewind(0, vRewind.size());
+    } else {
+        std::vector<std::thread> threads;
+        size_t nPerThread = (vRewind.size() + nThreads - 1) / nThreads;
+        for (size_t t = 0; t < nThreads; ++t) {
+            size_t nBegin = t * nPerThread, nEnd = std::min(vRewind.size(), nBegin + nPerThread);
+            threads.emplace_back(rewind, nBegin, nEnd);
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    std::string sTitle = strprintf("%s " + _("Processing locked outputs..."), GetDisplayName());
+    for (size_t i = 0; i < vLocked.size(); ++i) {
+        op = vLocked[i];
+        if (i % 100 == 99) {
+            ShowProgress(sTitle, std::max(10, std::min(99, (int)(10 + i * 90 / vLocked.size()))));
+        }
+
+        MapRecords_t::iterator mir;
+
+        mir = mapRecords.find(op.hash);
+        if (mir == mapRecords.end()
+            || !wdb.ReadStoredTx(op.hash, stx)) {
+            WalletLogPrintf("%s: Error: mapRecord not found for %s.\n", __func__, op.ToString());
             continue;
         }
         CTransactionRecord &rtx = mir->second;
@@ -8397,7 +9146,7 @@ bool CHDWallet::ProcessLockedBlindedOutputs()
         pout->n = op.n;
         switch (txout->nVersion) {
             case OUTPUT_RINGCT:
-                if (OwnAnonOut(&wdb, op.hash, (CTxOutRingCT*)txout.get(), nullptr, n, *pout, stx, fUpdated)
+                if (OwnAnonOut(&wdb, op.hash, (CTxOutRingCT*)txout.get(), nullptr, n, *pout, stx, fUpdated, vTxns[i] ? &vRewound[i] : nullptr)
                     && !fHave) {
                     fUpdated = true;
                     rtx.InsertOutput(*pout);
@@ -8425,8 +9174,6 @@ bool CHDWallet::ProcessLockedBlindedOutputs()
         nExpanded++;
     };
 
-    pcursor->close();
-
     wdb.TxnCommit();
     }
     // Notify UI of updated transaction
@@ -8440,6 +9187,242 @@ bool CHDWallet::ProcessLockedBlindedOutputs()
     return true;
 };
 
+void CHDWallet::StartProcessLockedOutputs()
+{
+    std::lock_guard<std::mutex> lock(m_locked_outputs_mutex);
+    if (m_locked_outputs_stop) {
+        return;
+    }
+    m_locked_outputs_pending = true;
+    if (m_locked_outputs_running) {
+        return; // Picked up by the running task
+    }
+    if (m_locked_outputs_thread.joinable()) {
+        m_locked_outputs_thread.join(); // Returning, m_locked_outputs_running is cleared last
+    }
+    m_locked_outputs_running = true;
+    m_locked_outputs_thread = std::thread(&TraceThread<std::function<void()> >, "lockedoutputs",
+        std::function<void()>(std::bind(&CHDWallet::ThreadProcessLockedOutputs, this)));
+};
+
+void CHDWallet::StopProcessLockedOutputs()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_locked_outputs_mutex);
+        m_locked_outputs_stop = true;
+    }
+    if (m_locked_outputs_thread.joinable()) {
+        m_locked_outputs_thread.join();
+    }
+};
+
+void CHDWallet::ThreadProcessLockedOutputs()
+{
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(m_locked_outputs_mutex);
+            if (!m_locked_outputs_pending || m_locked_outputs_stop) {
+                m_locked_outputs_running = false;
+                return;
+            }
+            m_locked_outputs_pending = false;
+        }
+
+        int64_t nTimeStart = GetTimeMillis();
+        LOCK2(cs_main, cs_wallet);
+        if (IsLocked()) {
+            // Locked again before the task ran, the outputs stay recorded for the next unlock
+            continue;
+        }
+        std::string sTitle = strprintf("%s " + _("Processing locked outputs..."), GetDisplayName());
+        ShowProgress(sTitle, 0);
+        ProcessLockedStealthOutputs();
+        ShowProgress(sTitle, 10);
+        ProcessLockedBlindedOutputs();
+        ShowProgress(sTitle, 100); // Hide progress dialog in GUI
+        WalletLogPrintf("Processed locked outputs in %dms.\n", GetTimeMillis() - nTimeStart);
+    }
+};
+
+//! Transactions erased or trimmed per db transaction by ThreadCompactDB, cs_wallet is released between batches
+static const size_t COMPACT_DB_BATCH_SIZE = 1000;
+
+/** Strip the data only needed to validate or spend tx, the txid is unchanged. Returns false if there was nothing to strip */
+static bool TrimStoredTx(CStoredTransaction &stx)
+{
+    bool fTrim = !stx.vBlinds.empty();
+    CMutableTransaction mtx(*stx.tx);
+    for (auto &txin : mtx.vin) {
+        if (!txin.scriptWitness.IsNull()) {
+            txin.scriptWitness.SetNull();
+            fTrim = true;
+        }
+    }
+    // The outputs are shared with stx.tx, which is replaced below
+    for (auto &txout : mtx.vpout) {
+        std::vector<uint8_t> *pvRangeproof = txout->GetPRangeproof();
+        if (pvRangeproof && !pvRangeproof->empty()) {
+            std::vector<uint8_t>().swap(*pvRangeproof);
+            fTrim = true;
+        }
+    }
+    if (!fTrim) {
+        return false;
+    }
+
+    CTransactionRef txTrimmed = MakeTransactionRef(std::move(mtx));
+    if (txTrimmed->GetHash() != stx.tx->GetHash()) {
+        return false;
+    }
+    stx.tx = txTrimmed;
+    stx.vBlinds.clear();
+    return true;
+};
+
+bool CHDWallet::StartCompactDB(int nStakeDepth, int nTrimDepth)
+{
+    std::lock_guard<std::mutex> lock(m_compact_mutex);
+    if (m_compact_stop || m_compact_progress >= 0) {
+        return false;
+    }
+    if (m_compact_thread.joinable()) {
+        m_compact_thread.join(); // Returning, m_compact_progress is cleared last
+    }
+    m_compact_progress = 0;
+    m_compact_thread = std::thread(&TraceThread<std::function<void()> >, "compactwallet",
+        std::function<void()>(std::bind(&CHDWallet::ThreadCompactDB, this, nStakeDepth, nTrimDepth)));
+    return true;
+};
+
+void CHDWallet::StopCompactDB()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_compact_mutex);
+        m_compact_stop = true;
+    }
+    if (m_compact_thread.joinable()) {
+        m_compact_thread.join();
+    }
+};
+
+void CHDWallet::ThreadCompactDB(int nStakeDepth, int nTrimDepth)
+{
+    int64_t nTimeStart = GetTimeMillis();
+    std::string sTitle = strprintf("%s " + _("Compacting wallet..."), GetDisplayName());
+    auto progress = [&](int nProgress) {
+        m_compact_progress = nProgress;
+        ShowProgress(sTitle, nProgress);
+    };
+    progress(0);
+
+    std::vector<uint256> vStakes, vRecords;
+    {
+        LOCK2(cs_main, cs_wallet);
+        if (nStakeDepth >= 0) {
+            for (const auto &mi : mapWallet) {
+                const CWalletTx &wtx = mi.second;
+                if (!wtx.IsCoinStake() || wtx.GetDepthInMainChain() <= nStakeDepth) {
+                    continue;
+                }
+                bool fUnspent = false;
+                for (size_t i = 0; i < wtx.tx->vpout.size(); ++i) {
+                    if (IsMine(wtx.tx->vpout[i].get()) && !IsSpent(mi.first, i)) {
+                        fUnspent = true;
+                        break;
+                    }
+                }
+                if (!fUnspent) {
+                    vStakes.push_back(mi.first);
+                }
+            }
+        }
+        if (nTrimDepth >= 0) {
+            for (const auto &ri : mapRecords) {
+                const CTransactionRecord &rtx = ri.second;
+                if (GetDepthInMainChain(rtx.blockHash, rtx.nIndex) <= nTrimDepth) {
+                    continue;
+                }
+                bool fKeep = false;
+                for (const auto &r : rtx.vout) {
+                    if ((r.nFlags & ORF_LOCKED) // Still needs the range proof rewound
+                        || ((r.nFlags & ORF_OWN_ANY) && !IsSpent(ri.first, r.n))) {
+                        fKeep = true;
+                        break;
+                    }
+                }
+                if (!fKeep) {
+                    vRecords.push_back(ri.first);
+                }
+            }
+        }
+    }
+
+    size_t nTotal = vStakes.size() + vRecords.size(), nDone = 0;
+    size_t nStakesErased = 0, nTrimmed = 0;
+    bool fFailed = false;
+    for (size_t nBatch = 0; nBatch < nTotal && !m_compact_stop && !fFailed; nBatch += COMPACT_DB_BATCH_SIZE) {
+        LOCK2(cs_main, cs_wallet);
+        CHDWalletDB wdb(*database);
+        if (!wdb.TxnBegin()) {
+            WalletLogPrintf("%s: TxnBegin failed.\n", __func__);
+            fFailed = true;
+            break;
+        }
+        for (; nDone < std::min(nTotal, nBatch + COMPACT_DB_BATCH_SIZE); ++nDone) {
+            if (nDone < vStakes.size()) {
+                const uint256 &hash = vStakes[nDone];
+                if (mapWallet.count(hash) == 0) {
+                    continue;
+                }
+                UnloadTransaction(hash);
+                if (!wdb.EraseTx(hash)) {
+                    fFailed = true;
+                    break;
+                }
+                nStakesErased++;
+                continue;
+            }
+            const uint256 &hash = vRecords[nDone - vStakes.size()];
+            CStoredTransaction stx;
+            if (!wdb.ReadStoredTx(hash, stx)
+                || !TrimStoredTx(stx)) {
+                continue;
+            }
+            if (!wdb.WriteStoredTx(hash, stx)) {
+                fFailed = true;
+                break;
+            }
+            nTrimmed++;
+        }
+        if (fFailed) {
+            WalletLogPrintf("%s: Erasing or trimming a transaction failed.\n", __func__);
+            wdb.TxnAbort();
+            break;
+        }
+        if (!wdb.TxnCommit()) {
+            WalletLogPrintf("%s: TxnCommit failed.\n", __func__);
+            fFailed = true;
+            break;
+        }
+        progress(nDone * 80 / nTotal);
+    }
+
+    if (!m_compact_stop && !fFailed) {
+        progress(80);
+        // The rewrite waits until no batch is open, cs_wallet must not be held
+        if (!database->Rewrite()) {
+            WalletLogPrintf("%s: Rewrite failed.\n", __func__);
+            fFailed = true;
+        }
+    }
+
+    WalletLogPrintf("Compacted wallet db in %dms, erased %u stake%s, trimmed %u stored transaction%s%s.\n",
+        GetTimeMillis() - nTimeStart, nStakesErased, nStakesErased == 1 ? "" : "s", nTrimmed, nTrimmed == 1 ? "" : "s",
+        m_compact_stop ? ", interrupted" : fFailed ? ", failed" : "");
+    ShowProgress(sTitle, 100); // Hide progress dialog in GUI
+    m_compact_progress = -1;
+};
+
 bool CHDWallet::CountRecords(std::string sPrefix, int64_t rv)
 {
     rv = 0;
@@ -8490,8 +9473,55 @@ inline bool MatchPrefix(uint32_t nAddrBits, uint32_t addrPrefix, uint32_t output
     return (addrPrefix & mask) == (outputPrefix & mask);
 };
 
+void CHDWallet::GetStealthScanCandidates(uint32_t prefix, bool fHavePrefix, std::vector<const CStealthScanCandidate*> &vCandidates) const
+{
+    AssertLockHeld(cs_wallet);
+
+    if (!m_stealth_table_built) {
+        m_stealth_no_prefix.clear();
+        m_stealth_by_prefix.clear();
+
+        size_t nOrder = 0;
+        auto add = [this, &nOrder](uint8_t nBits, uint32_t nPrefix, const CStealthAddress *pLoose, CExtKeyAccount *pAccount, const CEKAStealthKey *pAks) {
+            CStealthScanCandidate c{nOrder++, pLoose, pAccount, pAks};
+            if (nBits < 1) { // addresses without prefixes scan all incoming stealth outputs
+                m_stealth_no_prefix.push_back(c);
+                return;
+            }
+            m_stealth_by_prefix[nBits].emplace(nPrefix & SetStealthMask(nBits), c);
+        };
+        for (const auto &sx : stealthAddresses) {
+            add(sx.prefix.number_bits, sx.prefix.bitfield, &sx, nullptr, nullptr);
+        }
+        for (const auto &mi : mapExtAccounts) {
+            for (const auto &it : mi.second->mapStealthKeys) {
+                add(it.second.nPrefixBits, it.second.nPrefix, nullptr, mi.second, &it.second);
+            }
+        }
+        m_stealth_table_built = true;
+    }
+
+    vCandidates.clear();
+    for (const auto &c : m_stealth_no_prefix) {
+        vCandidates.push_back(&c);
+    }
+
+    // Addresses with a prefix don't match outputs without one
+    if (!fHavePrefix) {
+        return;
+    }
+    for (const auto &bits : m_stealth_by_prefix) {
+        auto range = bits.second.equal_range(prefix & SetStealthMask(bits.first));
+        for (auto it = range.first; it != range.second; ++it) {
+            vCandidates.push_back(&it->second);
+        }
+    }
+    std::sort(vCandidates.begin(), vCandidates.end(),
+        [](const CStealthScanCandidate *a, const CStealthScanCandidate *b) { return a->nOrder < b->nOrder; });
+};
+
 bool CHDWallet::ProcessStealthOutput(const CTxDestination &address,
-    std::vector<uint8_t> &vchEphemPK, uint32_t prefix, bool fHavePrefix, CKey &sShared, bool fNeedShared)
+    const std::vector<uint8_t> &vchEphemPK, uint32_t prefix, bool fHavePrefix, CKey &sShared, bool fNeedShared)
 {
     LOCK(cs_wallet);
     ec_point pkExtracted;
@@ -8511,11 +9541,14 @@ bool CHDWallet::ProcessStealthOutput(const CTxDestination &address,
         return true;
     }
 
-    std::set<CStealthAddress>::iterator it;
-    for (it = stealthAddresses.begin(); it != stealthAddresses.end(); ++it) {
-        if (!MatchPrefix(it->prefix.number_bits, it->prefix.bitfield, prefix, fHavePrefix)) {
+    std::vector<const CStealthScanCandidate*> vCandidates;
+    GetStealthScanCandidates(prefix, fHavePrefix, vCandidates);
+
+    for (const auto *c : vCandidates) {
+        if (!c->pLoose) {
             continue;
         }
+        const CStealthAddress *it = c->pLoose;
 
         if (!it->scan_secret.IsValid()) {
             continue; // stealth address is not owned
@@ -8561,7 +9594,8 @@ bool CHDWallet::ProcessStealthOutput(const CTxDestination &address,
             CPubKey cpkScan(it->scan_pubkey);
             CStealthKeyMetadata lockedSkMeta(cpkEphem, cpkScan);
 
-            if (!CHDWalletDB(*database).WriteStealthKeyMeta(idExtracted, lockedSkMeta)) {
+            std::unique_ptr<CHDWalletDB> pwdb;
+            if (!GetBatch(pwdb, true).WriteStealthKeyMeta(idExtracted, lockedSkMeta)) {
                 WalletLogPrintf("WriteStealthKeyMeta failed for %s.\n", coinAddress.ToString());
             }
 
@@ -8608,85 +9642,86 @@ bool CHDWallet::ProcessStealthOutput(const CTxDestination &address,
     };
 
     // ext account stealth keys
-    ExtKeyAccountMap::const_iterator mi;
-    for (mi = mapExtAccounts.begin(); mi != mapExtAccounts.end(); ++mi) {
-        CExtKeyAccount *ea = mi->second;
-
-        for (AccStealthKeyMap::iterator it = ea->mapStealthKeys.begin(); it != ea->mapStealthKeys.end(); ++it) {
-            const CEKAStealthKey &aks = it->second;
-
-            if (!MatchPrefix(aks.nPrefixBits, aks.nPrefix, prefix, fHavePrefix)) {
-                continue;
-            }
-
-            if (!aks.skScan.IsValid()) {
-                continue;
-            }
+    for (const auto *c : vCandidates) {
+        if (!c->pAccount) {
+            continue;
+        }
+        CExtKeyAccount *ea = c->pAccount;
+        const CEKAStealthKey &aks = *c->pAks;
 
-            if (StealthSecret(aks.skScan, vchEphemPK, aks.pkSpend, sShared, pkExtracted) != 0) {
-                WalletLogPrintf("%s: StealthSecret failed.\n", __func__);
-                continue;
-            }
+        if (!aks.skScan.IsValid()) {
+            continue;
+        }
 
-            CPubKey pkE(pkExtracted);
-            if (!pkE.IsValid()) {
-                continue;
-            }
+        if (StealthSecret(aks.skScan, vchEphemPK, aks.pkSpend, sShared, pkExtracted) != 0) {
+            WalletLogPrintf("%s: StealthSecret failed.\n", __func__);
+            continue;
+        }
 
-            CKeyID idExtracted = pkE.GetID();
-            if (ckidMatch != idExtracted) {
-                continue;
-            }
+        CPubKey pkE(pkExtracted);
+        if (!pkE.IsValid()) {
+            continue;
+        }
 
-            if (LogAcceptCategory(BCLog::HDWALLET)) {
-                WalletLogPrintf("Found stealth txn to address %s\n", aks.ToStealthAddress());
+        CKeyID idExtracted = pkE.GetID();
+        if (ckidMatch != idExtracted) {
+            continue;
+        }
 
-                // Check key if not locked
-                if (!IsLocked() && !(ea->nFlags & EAF_HARDWARE_DEVICE)) {
-                    CKey kTest;
-                    if (0 != ea->ExpandStealthChildKey(&aks, sShared, kTest)) {
-                        WalletLogPrintf("%s: Error: ExpandStealthChildKey failed! %s.\n", __func__, aks.ToStealthAddress());
-                        continue;
-                    }
+        if (LogAcceptCategory(BCLog::HDWALLET)) {
+            WalletLogPrintf("Found stealth txn to address %s\n", aks.ToStealthAddress());
 
-                    CKeyID kTestId = kTest.GetPubKey().GetID();
-                    if (kTestId != ckidMatch) {
-                        WalletLogPrintf("%s: Error: Spend key mismatch!\n", __func__);
-                        continue;
-                    }
-                    CBitcoinAddress coinAddress(kTestId);
-                    WalletLogPrintf("Debug: ExpandStealthChildKey matches! %s, %s.\n", aks.ToStealthAddress(), coinAddress.ToString());
+            // Check key if not locked
+            if (!IsLocked() && !(ea->nFlags & EAF_HARDWARE_DEVICE)) {
+                CKey kTest;
+                if (0 != ea->ExpandStealthChildKey(&aks, sShared, kTest)) {
+                    WalletLogPrintf("%s: Error: ExpandStealthChildKey failed! %s.\n", __func__, aks.ToStealthAddress());
+                    continue;
                 }
-            }
 
-            // Don't need to extract key now, wallet may be locked
-            CKeyID idStealthKey = aks.GetID();
-            CEKASCKey kNew(idStealthKey, sShared);
-            if (0 != ExtKeySaveKey(ea, ckidMatch, kNew)) {
-                WalletLogPrintf("%s: Error: ExtKeySaveKey failed!\n", __func__);
-                continue;
+                CKeyID kTestId = kTest.GetPubKey().GetID();
+                if (kTestId != ckidMatch) {
+                    WalletLogPrintf("%s: Error: Spend key mismatch!\n", __func__);
+                    continue;
+                }
+                CBitcoinAddress coinAddress(kTestId);
+                WalletLogPrintf("Debug: ExpandStealthChildKey matches! %s, %s.\n", aks.ToStealthAddress(), coinAddress.ToString());
             }
+        }
 
-            CStealthAddressIndexed sxi;
-            aks.ToRaw(sxi.addrRaw);
-            uint32_t sxId;
-            if (!UpdateStealthAddressIndex(ckidMatch, sxi, sxId)) {
-                return werror("%s: UpdateStealthAddressIndex failed.\n", __func__);
-            }
+        // Don't need to extract key now, wallet may be locked
+        CKeyID idStealthKey = aks.GetID();
+        CEKASCKey kNew(idStealthKey, sShared);
+        if (0 != ExtKeySaveKey(ea, ckidMatch, kNew)) {
+            WalletLogPrintf("%s: Error: ExtKeySaveKey failed!\n", __func__);
+            continue;
+        }
 
-            return true;
+        CStealthAddressIndexed sxi;
+        aks.ToRaw(sxi.addrRaw);
+        uint32_t sxId;
+        if (!UpdateStealthAddressIndex(ckidMatch, sxi, sxId)) {
+            return werror("%s: UpdateStealthAddressIndex failed.\n", __func__);
         }
+
+        return true;
     }
 
     return false;
 };
 
 int CHDWallet::CheckForStealthAndNarration(const CTxOutBase *pb, const CTxOutData *pdata, std::string &sNarr)
+{
+    CScanOutput so;
+    FillScanOutput(pb, pdata, so);
+    return CheckForStealthAndNarration(so, pdata, sNarr);
+};
+
+int CHDWallet::CheckForStealthAndNarration(const CScanOutput &so, const CTxOutData *pdata, std::string &sNarr)
 {
     // returns: -1 error, 0 nothing found, 1 narration, 2 stealth
 
     CKey sShared;
-    std::vector<uint8_t> vchEphemPK;
     const std::vector<uint8_t> &vData = pdata->vData;
 
     if (vData.size() < 1) {
@@ -8703,32 +9738,17 @@ int CHDWallet::CheckForStealthAndNarration(const CTxOutBase *pb, const CTxOutDat
     }
 
     if (vData[0] == DO_STEALTH) {
-        if (vData.size() < 34
-            || !pb->IsStandardOutput()) {
+        if (!so.fStealth) {
             return -1; // error
         }
 
-        vchEphemPK.resize(33);
-        memcpy(&vchEphemPK[0], &vData[1], 33);
-
-        uint32_t prefix = 0;
-        bool fHavePrefix = false;
-
-        if (vData.size() >= 34 + 5
-            && vData[34] == DO_STEALTH_PREFIX) {
-            fHavePrefix = true;
-            memcpy(&prefix, &vData[35], 4);
-        }
-
-        const CTxOutStandard *so = (CTxOutStandard*)pb;
-        CTxDestination address;
-        if (!ExtractDestination(so->scriptPubKey, address)
-            || address.type() != typeid(CKeyID)) {
+        if (so.dest.type() != typeid(CKeyID)) {
             WalletLogPrintf("%s: ExtractDestination failed.\n",  __func__);
             return -1;
         }
 
-        if (!ProcessStealthOutput(address, vchEphemPK, prefix, fHavePrefix, sShared, true)) {
+        const std::vector<uint8_t> &vchEphemPK = so.vchEphemPK;
+        if (!ProcessStealthOutput(so.dest, vchEphemPK, so.nPrefix, so.fHavePrefix, sShared, true)) {
             // TODO: check all other outputs?
             return 0;
         }
@@ -8814,56 +9834,40 @@ bool CHDWallet::ScanForOwnedOutputs(const CTransaction &tx, size_t &nRingCT, map
     bool fIsMine = false;
     mapNarr.clear();
 
-    int32_t nOutputId = -1;
-    for (const auto &txout : tx.vpout) {
-        nOutputId++;
-        if (txout->IsType(OUTPUT_RINGCT)) {
-            nRingCT++;
-            const CTxOutRingCT *rctout = (CTxOutRingCT*) txout.get();
-
-            CKeyID idk = rctout->pk.GetID();
+    // Outputs are parsed and hashed once for all loaded wallets
+    std::shared_ptr<const CWalletScanTx> scan_tx = GetWalletScanTx(tx);
+    nRingCT += scan_tx->nRingCT;
 
-            // Uncover stealth
-            uint32_t prefix = 0;
-            bool fHavePrefix = false;
-            if (rctout->vData.size() != 33) {
-                if (rctout->vData.size() == 38 // Have prefix
-                    && rctout->vData[33] == DO_STEALTH_PREFIX) {
-                    fHavePrefix = true;
-                    memcpy(&prefix, &rctout->vData[34], 4);
-                } else {
-                    LogPrint(BCLog::HDWALLET, "Bad blind output data size.\n");
-                    continue;
-                }
+    for (const auto &so : scan_tx->vOutputs) {
+        if (so.nType == OUTPUT_RINGCT) {
+            if (!so.fStealth) {
+                LogPrint(BCLog::HDWALLET, "Bad blind output data size.\n");
+                continue;
             }
 
+            // Uncover stealth
             CKey sShared;
-            std::vector<uint8_t> vchEphemPK;
-            vchEphemPK.resize(33);
-            memcpy(&vchEphemPK[0], &rctout->vData[0], 33);
-
-            if (ProcessStealthOutput(idk, vchEphemPK, prefix, fHavePrefix, sShared)) {
+            if (ProcessStealthOutput(so.dest, so.vchEphemPK, so.nPrefix, so.fHavePrefix, sShared)) {
                 fIsMine = true;
             }
             continue;
         } else
-        if (txout->IsType(OUTPUT_STANDARD)) {
-            if (nOutputId < (int)tx.vpout.size()-1
-                && tx.vpout[nOutputId+1]->IsType(OUTPUT_DATA)) {
-                CTxOutData *txd = (CTxOutData*) tx.vpout[nOutputId+1].get();
+        if (so.nType == OUTPUT_STANDARD) {
+            if (so.nData > -1) {
+                const CTxOutData *txd = (const CTxOutData*) tx.vpout[so.nData].get();
 
                 std::string sNarr;
-                if (CheckForStealthAndNarration(txout.get(), txd, sNarr) < 0) {
-                    WalletLogPrintf("%s: txn %s, malformed data output %d.\n",  __func__, tx.GetHash().ToString(), nOutputId);
+                if (CheckForStealthAndNarration(so, txd, sNarr) < 0) {
+                    WalletLogPrintf("%s: txn %s, malformed data output %d.\n",  __func__, tx.GetHash().ToString(), so.n);
                 }
 
                 if (sNarr.length() > 0) {
-                    std::string sKey = strprintf("n%d", nOutputId);
+                    std::string sKey = strprintf("n%d", so.n);
                     mapNarr[sKey] = sNarr;
                 }
             }
 
-            if (IsMine(txout.get())) {
+            if (IsMine(tx.vpout[so.n].get())) {
                 fIsMine = true;
             }
         }
@@ -8878,6 +9882,9 @@ bool CHDWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CBloc
 
     {
         AssertLockHeld(cs_wallet);
+        MarkStakeableDirty(tx);
+        MarkSpendableDirty(tx);
+        MarkColdStakeDirty(tx);
         if (pIndex != nullptr)
         {
             for (const auto &txin : tx.vin)
@@ -9175,8 +10182,15 @@ void ExtractNarration(const uint256 &nonce, const std::vector<uint8_t> &vData, s
 }
 
 int CHDWallet::OwnAnonOut(CHDWalletDB *pwdb, const uint256 &txhash, const CTxOutRingCT *pout, const CStoredExtKey *pc, uint32_t &nLastChild,
-    COutputRecord &rout, CStoredTransaction &stx, bool &fUpdated)
+    COutputRecord &rout, CStoredTransaction &stx, bool &fUpdated, const CAnonOutRewind *pRewound)
 {
+    // Rewound before, the amount and blind are already in the record
+    uint8_t blindHave[32];
+    if ((rout.nFlags & ORF_OWNED) && !(rout.nFlags & ORF_LOCKED)
+        && stx.GetBlind(rout.n, blindHave)) {
+        return 1;
+    }
+
     CKeyID idk = pout->pk.GetID();
     CKey key;
     CKeyID idStealth;
@@ -9223,46 +10237,21 @@ int CHDWallet::OwnAnonOut(CHDWalletDB *pwdb, const uint256 &txhash, const CTxOut
         return werrorN(0, "%s: vData.size() < 33.", __func__);
     }
 
-    CPubKey pkEphem;
-    pkEphem.Set(pout->vData.begin(), pout->vData.begin() + 33);
-
-    // Regenerate nonce
-    uint256 nonce = key.ECDH(pkEphem);
-    CSHA256().Write(nonce.begin(), 32).Finalize(nonce.begin());
-
-    uint64_t min_value, max_value;
-    uint8_t blindOut[32];
-    unsigned char msg[256]; // Currently narration is capped at 32 bytes
-    size_t mlen = sizeof(msg);
-    memset(msg, 0, mlen);
-    uint64_t amountOut;
-
-    if (pout->vRangeproof.size() < 1000) {
-        if (1 != secp256k1_bulletproof_rangeproof_rewind(secp256k1_ctx_blind, blind_gens,
-            &amountOut, blindOut, pout->vRangeproof.data(), pout->vRangeproof.size(),
-            0, &pout->commitment, &secp256k1_generator_const_h, nonce.begin(), nullptr, 0)) {
-            return werrorN(0, "%s: secp256k1_bulletproof_rangeproof_rewind failed.", __func__);
-        }
-
-        ExtractNarration(nonce, pout->vData, rout.sNarration);
-    } else
-    if (1 != secp256k1_rangeproof_rewind(secp256k1_ctx_blind,
-        blindOut, &amountOut, msg, &mlen, nonce.begin(),
-        &min_value, &max_value,
-        &pout->commitment, pout->vRangeproof.data(), pout->vRangeproof.size(),
-        nullptr, 0,
-        secp256k1_generator_h)) {
-        return werrorN(0, "%s: secp256k1_rangeproof_rewind failed.", __func__);
+    CAnonOutRewind rewound;
+    if (!pRewound) {
+        RewindAnonOut(key, pout, rewound);
+        pRewound = &rewound;
+    }
+    if (!pRewound->fOk) {
+        return 0;
     }
 
-    msg[mlen-1] = '\0';
-    size_t nNarr = strlen((const char*)msg);
-    if (nNarr > 0) {
-        rout.sNarration.assign((const char*)msg, nNarr);
+    if (!pRewound->sNarration.empty()) {
+        rout.sNarration = pRewound->sNarration;
     }
 
     rout.nFlags |= ORF_OWNED;
-    rout.nValue = amountOut;
+    rout.nValue = pRewound->nValue;
 
 
     if (rout.vPath.size() == 0) {
@@ -9291,7 +10280,7 @@ int CHDWallet::OwnAnonOut(CHDWalletDB *pwdb, const uint256 &txhash, const CTxOut
     }
 
     rout.nFlags &= ~ORF_LOCKED;
-    stx.InsertBlind(rout.n, blindOut);
+    stx.InsertBlind(rout.n, pRewound->blind);
     fUpdated = true;
 
     return 1;
@@ -9320,6 +10309,7 @@ bool CHDWallet::AddTxinToSpends(const CTxIn &txin, const uint256 &txhash)
                 continue;
             }
             AddToSpends(prevout, txhash);
+            MarkSpendableDirty(prevout.hash);
         }
 
         return true;
@@ -9371,7 +10361,8 @@ bool CHDWallet::AddToRecord(CTransactionRecord &rtxIn, const CTransaction &tx,
     if (LogAcceptCategory(BCLog::HDWALLET)) WalletLogPrintf("%s: %s, %p, %d\n", __func__, tx.GetHash().ToString(), pIndex, posInBlock);
 
     AssertLockHeld(cs_wallet);
-    CHDWalletDB wdb(*database, "r+", fFlushOnClose);
+    std::unique_ptr<CHDWalletDB> pwdb;
+    CHDWalletDB &wdb = GetBatch(pwdb, fFlushOnClose);
 
     uint256 txhash = tx.GetHash();
 
@@ -9546,13 +10537,7 @@ bool CHDWallet::AddToRecord(CTransactionRecord &rtxIn, const CTransaction &tx,
     // Notify UI of new or updated transaction
     NotifyTransactionChanged(this, txhash, fInsertedNew ? CT_NEW : CT_UPDATED);
     // notify an external script when a wallet transaction comes in or is updated
-    std::string strCmd = gArgs.GetArg("-walletnotify", "");
-
-    if (!strCmd.empty()) {
-        boost::replace_all(strCmd, "%s", txhash.GetHex());
-        std::thread t(runCommand, strCmd);
-        t.detach(); // thread runs free
-    }
+    WalletNotifyCommand(txhash);
 
     std::string sName = GetName();
     GetMainSignals().TransactionAddedToWallet(sName, MakeTransactionRef(tx));
@@ -9627,6 +10612,121 @@ void CHDWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman *connm
     return;
 };
 
+//! Drop the spendable output index rather than queue more txns than this
+static const size_t MAX_SPENDABLE_DIRTY = 100000;
+
+void CHDWallet::MarkSpendableDirty(const CTransaction &tx) const
+{
+    AssertLockHeld(cs_wallet);
+    if (!m_spendable_index_loaded)
+        return;
+
+    MarkSpendableDirty(tx.GetHash());
+    for (const auto &txin : tx.vin)
+    {
+        // Anon prevouts are queued as their key images are matched in AddTxinToSpends
+        if (txin.IsAnonInput())
+            continue;
+        MarkSpendableDirty(txin.prevout.hash);
+    };
+};
+
+void CHDWallet::MarkSpendableDirty(const uint256 &txid) const
+{
+    AssertLockHeld(cs_wallet);
+    if (!m_spendable_index_loaded)
+        return;
+
+    if (m_spendable_dirty.size() > MAX_SPENDABLE_DIRTY)
+    {
+        InvalidateSpendableOutputs();
+        return;
+    };
+
+    m_spendable_dirty.insert(txid);
+};
+
+void CHDWallet::InvalidateSpendableOutputs() const
+{
+    m_spendable_index_loaded = false;
+    m_spendable_standard.clear();
+    m_spendable_anon.clear();
+    m_spendable_dirty.clear();
+};
+
+void CHDWallet::IndexSpendableOutputs(const uint256 &txid) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    m_spendable_standard.erase(txid);
+    m_spendable_anon.erase(txid);
+
+    MapWallet_t::const_iterator mi = mapWallet.find(txid);
+    if (mi != mapWallet.end())
+    {
+        const CTransactionRef &tx = mi->second.tx;
+        CSpendableTx standard{false, {}};
+        for (size_t i = 0; i < tx->vpout.size(); ++i)
+        {
+            const auto &txout = tx->vpout[i];
+            if (!txout->IsStandardOutput())
+                continue;
+            if (IsSpent(txid, i))
+                continue;
+            if (IsMine(txout.get()) == ISMINE_NO)
+                continue;
+            standard.vOutputs.push_back(i);
+        };
+        if (!standard.vOutputs.empty())
+            m_spendable_standard.emplace(txid, std::move(standard));
+        return;
+    };
+
+    MapRecords_t::const_iterator mri = mapRecords.find(txid);
+    if (mri == mapRecords.end())
+        return;
+
+    CSpendableTx standard{true, {}}, anon{true, {}};
+    for (const auto &r : mri->second.vout)
+    {
+        if (IsSpent(txid, r.n))
+            continue;
+        if (r.nType == OUTPUT_STANDARD && (r.nFlags & ORF_OWN_ANY))
+            standard.vOutputs.push_back(r.n);
+        else
+        if (r.nType == OUTPUT_RINGCT && (r.nFlags & ORF_OWNED))
+            anon.vOutputs.push_back(r.n);
+    };
+    if (!standard.vOutputs.empty())
+        m_spendable_standard.emplace(txid, std::move(standard));
+    if (!anon.vOutputs.empty())
+        m_spendable_anon.emplace(txid, std::move(anon));
+};
+
+void CHDWallet::UpdateSpendableOutputs() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (!m_spendable_index_loaded)
+    {
+        m_spendable_standard.clear();
+        m_spendable_anon.clear();
+        m_spendable_dirty.clear();
+        for (const auto &walletEntry : mapWallet)
+            IndexSpendableOutputs(walletEntry.first);
+        for (const auto &ri : mapRecords)
+            IndexSpendableOutputs(ri.first);
+        m_spendable_index_loaded = true;
+        return;
+    };
+
+    for (const auto &txid : m_spendable_dirty)
+        IndexSpendableOutputs(txid);
+    m_spendable_dirty.clear();
+};
+
 void CHDWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const CCoinControl *coinControl, const CAmount &nMinimumAmount, const CAmount &nMaximumAmount, const CAmount &nMinimumSumAmount, const uint64_t nMaximumCount, const int nMinDepth, const int nMaxDepth, bool fIncludeImmature) const
 {
     AssertLockHeld(cs_main);
@@ -9635,9 +10735,18 @@ void CHDWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, con
     vCoins.clear();
     CAmount nTotal = 0;
 
-    for (const auto& item : mapWallet) {
-        const uint256& wtxid = item.first;
-        const CWalletTx& wtx = item.second;
+    UpdateSpendableOutputs();
+
+    for (const auto &si : m_spendable_standard) {
+        if (si.second.fRecord) {
+            continue;
+        }
+        const uint256& wtxid = si.first;
+        MapWallet_t::const_iterator mi = mapWallet.find(wtxid);
+        if (mi == mapWallet.end()) {
+            continue;
+        }
+        const CWalletTx& wtx = mi->second;
 
         if (!CheckFinalTx(*wtx.tx)) {
             continue;
@@ -9700,11 +10809,7 @@ void CHDWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, con
             continue;
         }
 
-        for (unsigned int i = 0; i < wtx.tx->vpout.size(); i++) {
-            if (!wtx.tx->vpout[i]->IsStandardOutput()) {
-                continue;
-            }
-
+        for (uint32_t i : si.second.vOutputs) {
             const CTxOutStandard *txout = wtx.tx->vpout[i]->GetStandardOutput();
 
             if (txout->nValue < nMinimumAmount || txout->nValue > nMaximumAmount) {
@@ -9751,8 +10856,15 @@ void CHDWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, con
         }
     }
 
-    for (MapRecords_t::const_iterator it = mapRecords.begin(); it != mapRecords.end(); ++it) {
-        const uint256 &txid = it->first;
+    for (const auto &si : m_spendable_standard) {
+        if (!si.second.fRecord) {
+            continue;
+        }
+        const uint256 &txid = si.first;
+        MapRecords_t::const_iterator it = mapRecords.find(txid);
+        if (it == mapRecords.end()) {
+            continue;
+        }
         const CTransactionRecord &rtx = it->second;
 
         // TODO: implement when moving coinbase and coinstake txns to mapRecords
@@ -9788,14 +10900,12 @@ void CHDWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, con
         }
 
         MapWallet_t::const_iterator twi = mapTempWallet.find(txid);
-        for (const auto &r : rtx.vout) {
-            if (r.nType != OUTPUT_STANDARD) {
-                continue;
-            }
-
-            if (!(r.nFlags & ORF_OWN_ANY)) {
+        for (uint32_t n : si.second.vOutputs) {
+            const COutputRecord *pr = rtx.GetOutput(n);
+            if (!pr) {
                 continue;
             }
+            const COutputRecord &r = *pr;
 
             if (IsSpent(txid, r.n)) {
                 continue;
@@ -10020,6 +11130,36 @@ bool CHDWallet::SelectBlindedCoins(const std::vector<COutputR> &vAvailableCoins,
     return res;
 };
 
+void CHDWallet::GetAnonSelectionCandidates(const std::vector<COutputR> &vAvailableCoins, CAmount nInputFee,
+    std::vector<CAmount> &vEffectiveValues, std::vector<std::pair<MapRecords_t::const_iterator,unsigned int> > &vCandidates) const
+{
+    std::vector<std::pair<CAmount, std::pair<MapRecords_t::const_iterator,unsigned int> > > vSorted;
+    vSorted.reserve(vAvailableCoins.size());
+    for (const auto &r : vAvailableCoins) {
+        if (!r.fSpendable) {
+            continue;
+        }
+        const COutputRecord *oR = r.rtx->second.GetOutput(r.i);
+        if (!oR || oR->nValue <= nInputFee) {
+            continue; // Costs more to spend than it's worth
+        }
+        vSorted.emplace_back(oR->nValue - nInputFee, std::make_pair(r.rtx, r.i));
+    }
+    std::sort(vSorted.begin(), vSorted.end(), [](const std::pair<CAmount, std::pair<MapRecords_t::const_iterator,unsigned int> > &a,
+                                                 const std::pair<CAmount, std::pair<MapRecords_t::const_iterator,unsigned int> > &b) {
+        return a.first > b.first;
+    });
+
+    vEffectiveValues.clear();
+    vCandidates.clear();
+    vEffectiveValues.reserve(vSorted.size());
+    vCandidates.reserve(vSorted.size());
+    for (const auto &c : vSorted) {
+        vEffectiveValues.push_back(c.first);
+        vCandidates.push_back(c.second);
+    }
+};
+
 void CHDWallet::AvailableAnonCoins(std::vector<COutputR> &vCoins, bool fOnlySafe, const CCoinControl *coinControl, const CAmount& nMinimumAmount, const CAmount& nMaximumAmount, const CAmount& nMinimumSumAmount, const uint64_t& nMaximumCount, const int& nMinDepth, const int& nMaxDepth, bool fIncludeImmature) const
 {
     AssertLockHeld(cs_main);
@@ -10028,9 +11168,15 @@ void CHDWallet::AvailableAnonCoins(std::vector<COutputR> &vCoins, bool fOnlySafe
     vCoins.clear();
     CAmount nTotal = 0;
 
+    UpdateSpendableOutputs();
+
     const Consensus::Params& consensusParams = Params().GetConsensus();
-    for (MapRecords_t::const_iterator it = mapRecords.begin(); it != mapRecords.end(); ++it) {
-        const uint256 &txid = it->first;
+    for (const auto &si : m_spendable_anon) {
+        const uint256 &txid = si.first;
+        MapRecords_t::const_iterator it = mapRecords.find(txid);
+        if (it == mapRecords.end()) {
+            continue;
+        }
         const CTransactionRecord &rtx = it->second;
 
         // TODO: implement when moving coinbase and coinstake txns to mapRecords
@@ -10056,14 +11202,12 @@ void CHDWallet::AvailableAnonCoins(std::vector<COutputR> &vCoins, bool fOnlySafe
             continue;
         }
 
-        for (const auto &r : rtx.vout) {
-            if (r.nType != OUTPUT_RINGCT) {
-                continue;
-            }
-
-            if (!(r.nFlags & ORF_OWNED)) {
+        for (uint32_t n : si.second.vOutputs) {
+            const COutputRecord *pr = rtx.GetOutput(n);
+            if (!pr) {
                 continue;
             }
+            const COutputRecord &r = *pr;
 
             if (IsSpent(txid, r.n)) {
                 continue;
@@ -10530,6 +11674,10 @@ bool CHDWallet::TransactionCanBeAbandoned(const uint256 &hashTx) const
 bool CHDWallet::AbandonTransaction(const uint256 &hashTx)
 {
     LOCK2(cs_main, cs_wallet);
+    InvalidateStakeableOutputs();
+    InvalidateSpendableOutputs();
+    InvalidateColdStakeOutputs();
+    ClearCachedBalances();
 
     CHDWalletDB walletdb(*database, "r+");
 
@@ -10644,6 +11792,10 @@ bool CHDWallet::AbandonTransaction(const uint256 &hashTx)
 void CHDWallet::MarkConflicted(const uint256 &hashBlock, const uint256 &hashTx)
 {
     LOCK2(cs_main, cs_wallet);
+    InvalidateStakeableOutputs();
+    InvalidateSpendableOutputs();
+    InvalidateColdStakeOutputs();
+    ClearCachedBalances();
 
     int conflictconfirms = 0;
 
@@ -10871,27 +12023,216 @@ size_t CHDWallet::CountColdstakeOutputs()
 {
     LOCK2(cs_main, cs_wallet);
 
-    size_t nColdstakeOutputs = 0;
+    UpdateColdStakeOutputs();
+    return m_coldstake_all.nCount;
+};
 
-    CCoinControl coinControl;
-    std::vector<COutput> vAvailableCoins;
-    CAmount nMinimumAmount = 0, nMaximumAmount = MAX_MONEY, nMinimumSumAmount = 0;
-    uint64_t nMaximumCount = 0;
-    int nMinDepth = 0, nMaxDepth = 0x7FFFFFFF;
-    bool fIncludeImmature = true;
-    AvailableCoins(vAvailableCoins, false, &coinControl, nMinimumAmount, nMaximumAmount, nMinimumSumAmount, nMaximumCount, nMinDepth, nMaxDepth, fIncludeImmature);
-    for (auto &coin : vAvailableCoins) {
-        assert(coin.i < (int)coin.tx->tx->GetNumVOuts());
-        auto txoutBase = coin.tx->tx->vpout[coin.i];
-        if (!txoutBase->IsStandardOutput()) {
+void CHDWallet::GetColdStakeSums(CColdStakeSum &sumAll, CColdStakeSum &sumDelegated, CColdStakeSum &sumStaking)
+{
+    LOCK2(cs_main, cs_wallet);
+
+    UpdateColdStakeOutputs();
+    sumAll = m_coldstake_all;
+    sumDelegated = m_coldstake_delegated;
+    sumStaking = m_coldstake_staking;
+};
+
+CHDWallet::CColdStakeSum CHDWallet::GetColdStakeSumByStaker(const CKeyID &idStake)
+{
+    LOCK2(cs_main, cs_wallet);
+
+    UpdateColdStakeOutputs();
+    auto mi = m_coldstake_by_staker.find(idStake);
+    return mi == m_coldstake_by_staker.end() ? CColdStakeSum() : mi->second;
+};
+
+CHDWallet::CColdStakeSum CHDWallet::GetColdStakeSumBySpend(const CScript &scriptSpend)
+{
+    LOCK2(cs_main, cs_wallet);
+
+    UpdateColdStakeOutputs();
+    auto mi = m_coldstake_by_spend.find(scriptSpend);
+    return mi == m_coldstake_by_spend.end() ? CColdStakeSum() : mi->second;
+};
+
+void CHDWallet::GetColdStakeDelegations(std::map<CKeyID, CColdStakeSum> &mapByStaker, std::map<CScript, CColdStakeSum> &mapBySpend)
+{
+    LOCK2(cs_main, cs_wallet);
+
+    UpdateColdStakeOutputs();
+    mapByStaker.clear();
+    mapBySpend.clear();
+    for (const auto &co : m_coldstake_outputs) {
+        const CColdStakeOutput &out = co.second;
+        if (out.fOwnSpend) {
+            CColdStakeSum &sum = mapByStaker[out.idStake];
+            sum.nCount++;
+            sum.nValue += out.nValue;
+        }
+        if (out.fOwnStake) {
+            CColdStakeSum &sum = mapBySpend[out.scriptSpend];
+            sum.nCount++;
+            sum.nValue += out.nValue;
+        }
+    }
+};
+
+//! Drop the coldstake output index rather than queue more txns than this
+static const size_t MAX_COLDSTAKE_DIRTY = 100000;
+
+void CHDWallet::MarkColdStakeDirty(const CTransaction &tx) const
+{
+    AssertLockHeld(cs_wallet);
+    if (!m_coldstake_index_loaded) {
+        return;
+    }
+
+    if (m_coldstake_dirty.size() > MAX_COLDSTAKE_DIRTY) {
+        InvalidateColdStakeOutputs();
+        return;
+    }
+
+    m_coldstake_dirty.insert(tx.GetHash());
+    for (const auto &txin : tx.vin) {
+        if (txin.IsAnonInput()) {
+            continue;
+        }
+        m_coldstake_dirty.insert(txin.prevout.hash);
+    }
+};
+
+void CHDWallet::InvalidateColdStakeOutputs() const
+{
+    m_coldstake_index_loaded = false;
+    m_coldstake_outputs.clear();
+    m_coldstake_by_staker.clear();
+    m_coldstake_by_spend.clear();
+    m_coldstake_all = CColdStakeSum();
+    m_coldstake_delegated = CColdStakeSum();
+    m_coldstake_staking = CColdStakeSum();
+    m_coldstake_dirty.clear();
+};
+
+static void AddColdStakeSum(CHDWallet::CColdStakeSum &sum, CAmount nValue, int nSign)
+{
+    sum.nCount += nSign;
+    sum.nValue += nSign * nValue;
+};
+
+void CHDWallet::IndexColdStakeOutputs(const uint256 &txid) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    auto updateSums = [this](const CColdStakeOutput &out, int nSign) {
+        AddColdStakeSum(m_coldstake_all, out.nValue, nSign);
+        if (out.fOwnSpend) {
+            AddColdStakeSum(m_coldstake_delegated, out.nValue, nSign);
+        }
+        if (out.fOwnStake) {
+            AddColdStakeSum(m_coldstake_staking, out.nValue, nSign);
+        }
+
+        auto mi = m_coldstake_by_staker.emplace(out.idStake, CColdStakeSum()).first;
+        AddColdStakeSum(mi->second, out.nValue, nSign);
+        if (mi->second.nCount == 0) {
+            m_coldstake_by_staker.erase(mi);
+        }
+        auto ms = m_coldstake_by_spend.emplace(out.scriptSpend, CColdStakeSum()).first;
+        AddColdStakeSum(ms->second, out.nValue, nSign);
+        if (ms->second.nCount == 0) {
+            m_coldstake_by_spend.erase(ms);
+        }
+    };
+
+    auto it = m_coldstake_outputs.lower_bound(COutPoint(txid, 0));
+    while (it != m_coldstake_outputs.end() && it->first.hash == txid) {
+        updateSums(it->second, -1);
+        it = m_coldstake_outputs.erase(it);
+    }
+
+    auto indexOutput = [&](uint32_t n, const CScript &scriptPubKey, CAmount nValue) {
+        if (!scriptPubKey.StartsWithICS() || IsSpent(txid, n)) {
+            return;
+        }
+        CColdStakeOutput out;
+        CScript scriptStake;
+        if (!SplitConditionalCoinstakeScript(scriptPubKey, scriptStake, out.scriptSpend)
+            || !ExtractStakingKeyID(scriptPubKey, out.idStake)) {
+            return;
+        }
+
+        CKeyID keyID;
+        const CEKAKey *pak = nullptr;
+        const CEKASCKey *pasc = nullptr;
+        CExtKeyAccount *pa = nullptr;
+        bool isInvalid = false;
+        out.fOwnStake = IsMine(scriptStake, keyID, pak, pasc, pa, isInvalid) & ISMINE_SPENDABLE;
+        out.fOwnSpend = IsMine(out.scriptSpend, keyID, pak, pasc, pa, isInvalid) & ISMINE_SPENDABLE;
+        if (!out.fOwnStake && !out.fOwnSpend) {
+            return;
+        }
+        out.nValue = nValue;
+
+        updateSums(out, 1);
+        m_coldstake_outputs.emplace(COutPoint(txid, n), std::move(out));
+    };
+
+    MapWallet_t::const_iterator mi = mapWallet.find(txid);
+    if (mi != mapWallet.end()) {
+        const CWalletTx *pcoin = &mi->second;
+        if (pcoin->GetDepthInMainChainCached() < 0) {
+            return;
+        }
+        const CTransactionRef &tx = pcoin->tx;
+        for (size_t i = 0; i < tx->vpout.size(); ++i) {
+            const auto &txout = tx->vpout[i];
+            if (!txout->IsType(OUTPUT_STANDARD)) {
+                continue;
+            }
+            indexOutput(i, *txout->GetPScriptPubKey(), txout->GetValue());
+        }
+        return;
+    }
+
+    MapRecords_t::const_iterator mri = mapRecords.find(txid);
+    if (mri == mapRecords.end()) {
+        return;
+    }
+    const CTransactionRecord &rtx = mri->second;
+    if (GetDepthInMainChain(rtx.blockHash, rtx.nIndex) < 0) {
+        return;
+    }
+    for (const auto &r : rtx.vout) {
+        if (r.nType != OUTPUT_STANDARD
+            || !(r.nFlags & ORF_OWNED || r.nFlags & ORF_STAKEONLY)) {
             continue;
         }
-        if (HasIsCoinstakeOp(*txoutBase->GetPScriptPubKey())) {
-            nColdstakeOutputs++;
+        indexOutput(r.n, r.scriptPubKey, r.nValue);
+    }
+};
+
+void CHDWallet::UpdateColdStakeOutputs() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (!m_coldstake_index_loaded) {
+        InvalidateColdStakeOutputs();
+        for (const auto &walletEntry : mapWallet) {
+            IndexColdStakeOutputs(walletEntry.first);
+        }
+        for (const auto &ri : mapRecords) {
+            IndexColdStakeOutputs(ri.first);
         }
+        m_coldstake_index_loaded = true;
+        return;
     }
 
-    return nColdstakeOutputs;
+    for (const auto &txid : m_coldstake_dirty) {
+        IndexColdStakeOutputs(txid);
+    }
+    m_coldstake_dirty.clear();
 };
 
 bool CHDWallet::GetScriptForAddress(CScript &script, const CBitcoinAddress &addr, bool fUpdate, std::vector<uint8_t> *vData, bool allow_stakeonly)
@@ -10966,11 +12307,10 @@ uint64_t CHDWallet::GetStakeWeight() const
     if (nBalance <= nReserveBalance)
         return 0;
 
-    int nHeight;
-    {
-        LOCK(cs_main);
-        nHeight = chainActive.Height()+1;
-    }
+    std::shared_ptr<const CStakeTipSnapshot> tip = GetStakeTipSnapshot();
+    if (!tip)
+        return 0;
+    int nHeight = tip->nHeight+1;
 
     // Choose coins to use
     std::vector<const CWalletTx*> vwtxPrev;
@@ -10986,7 +12326,7 @@ uint64_t CHDWallet::GetStakeWeight() const
 
     uint64_t nWeight = 0;
 
-    LOCK2(cs_main, cs_wallet);
+    LOCK(cs_wallet);
     for (auto pcoin : setCoins) {
         nWeight += pcoin.first->tx->vpout[pcoin.second]->GetValue();
     }
@@ -10994,6 +12334,151 @@ uint64_t CHDWallet::GetStakeWeight() const
     return nWeight;
 };
 
+//! Drop the stakeable output index rather than queue more txns than this
+static const size_t MAX_STAKEABLE_DIRTY = 100000;
+
+void CHDWallet::MarkStakeableDirty(const CTransaction &tx) const
+{
+    AssertLockHeld(cs_wallet);
+    if (!m_stakeable_index_loaded)
+        return;
+
+    // Don't grow without bound while staking is paused
+    if (m_stakeable_dirty.size() > MAX_STAKEABLE_DIRTY)
+    {
+        InvalidateStakeableOutputs();
+        return;
+    };
+
+    m_stakeable_dirty.insert(tx.GetHash());
+    for (const auto &txin : tx.vin)
+    {
+        if (txin.IsAnonInput())
+            continue;
+        m_stakeable_dirty.insert(txin.prevout.hash);
+    };
+};
+
+void CHDWallet::InvalidateStakeableOutputs() const
+{
+    m_stakeable_index_loaded = false;
+    m_stakeable_outputs.clear();
+    m_stakeable_dirty.clear();
+    m_stakeable_lowest_height = std::numeric_limits<int>::max();
+    m_have_cached_stakeable_coins = false;
+};
+
+void CHDWallet::IndexStakeableOutputs(const uint256 &txid) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    auto it = m_stakeable_outputs.lower_bound(COutPoint(txid, 0));
+    while (it != m_stakeable_outputs.end() && it->first.hash == txid)
+        it = m_stakeable_outputs.erase(it);
+
+    int nTipHeight = chainActive.Height();
+
+    MapWallet_t::const_iterator mi = mapWallet.find(txid);
+    if (mi != mapWallet.end())
+    {
+        const CWalletTx *pcoin = &mi->second;
+        CTransactionRef tx = pcoin->tx;
+
+        int nDepth = pcoin->GetDepthInMainChainCached();
+        if (nDepth < 0)
+            return;
+        int nTxHeight = nDepth > 0 ? nTipHeight - nDepth + 1 : -1;
+        if (nTxHeight >= 0)
+            m_stakeable_lowest_height = std::min(m_stakeable_lowest_height, nTxHeight);
+
+        for (size_t i = 0; i < tx->vpout.size(); ++i)
+        {
+            const auto &txout = tx->vpout[i];
+            if (!txout->IsType(OUTPUT_STANDARD))
+                continue;
+            if (IsSpent(txid, i))
+                continue;
+
+            const CScript *pscriptPubKey = txout->GetPScriptPubKey();
+            CKeyID keyID;
+            if (!ExtractStakingKeyID(*pscriptPubKey, keyID))
+                continue;
+
+            isminetype mine = IsMine(keyID);
+            if (!(mine & ISMINE_SPENDABLE)
+                || (mine & ISMINE_HARDWARE_DEVICE))
+                continue;
+
+            m_stakeable_outputs[COutPoint(txid, i)] = CStakeableOutput{nTxHeight, txout->GetValue(), pcoin->IsCoinStake(), false};
+        };
+        return;
+    };
+
+    MapRecords_t::const_iterator mri = mapRecords.find(txid);
+    if (mri == mapRecords.end())
+        return;
+
+    const CTransactionRecord &rtx = mri->second;
+    int nDepth = GetDepthInMainChain(rtx.blockHash, rtx.nIndex);
+    if (nDepth < 0)
+        return;
+    int nTxHeight = nDepth > 0 ? nTipHeight - nDepth + 1 : -1;
+    if (nTxHeight >= 0)
+        m_stakeable_lowest_height = std::min(m_stakeable_lowest_height, nTxHeight);
+
+    for (const auto &r : rtx.vout)
+    {
+        if (r.nType != OUTPUT_STANDARD)
+            continue;
+        if (!(r.nFlags & ORF_OWNED || r.nFlags & ORF_STAKEONLY))
+            continue;
+        if (IsSpent(txid, r.n))
+            continue;
+
+        CKeyID keyID;
+        if (!ExtractStakingKeyID(r.scriptPubKey, keyID))
+            continue;
+
+        isminetype mine = IsMine(keyID);
+        if (!(mine & ISMINE_SPENDABLE)
+            || (mine & ISMINE_HARDWARE_DEVICE))
+            continue;
+
+        m_stakeable_outputs[COutPoint(txid, r.n)] = CStakeableOutput{nTxHeight, r.nValue, false, true};
+    };
+};
+
+void CHDWallet::UpdateStakeableOutputs() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (!m_stakeable_index_loaded)
+    {
+        m_stakeable_outputs.clear();
+        m_stakeable_dirty.clear();
+        m_stakeable_lowest_height = std::numeric_limits<int>::max();
+        for (const auto &walletEntry : mapWallet)
+            IndexStakeableOutputs(walletEntry.first);
+        for (const auto &ri : mapRecords)
+            IndexStakeableOutputs(ri.first);
+        m_stakeable_index_loaded = true;
+        return;
+    };
+
+    for (const auto &txid : m_stakeable_dirty)
+        IndexStakeableOutputs(txid);
+    m_stakeable_dirty.clear();
+};
+
+size_t CHDWallet::CountStakeableOutputs() const
+{
+    // Only sizes the search, the index is brought up to date by AvailableCoinsForStaking
+    LOCK(cs_wallet);
+    return m_stakeable_outputs.size();
+};
+
 void CHDWallet::AvailableCoinsForStaking(std::vector<COutput> &vCoins, int64_t nTime, int nHeight) const
 {
     vCoins.clear();
@@ -11003,133 +12488,81 @@ void CHDWallet::AvailableCoinsForStaking(std::vector<COutput> &vCoins, int64_t n
     {
         LOCK2(cs_main, cs_wallet);
 
+        UpdateStakeableOutputs();
+
         int nHeight = chainActive.Tip()->nHeight;
         int min_stake_confirmations = Params().GetStakeMinConfirmations();
         int nRequiredDepth = std::min(min_stake_confirmations-1, (int)(nHeight / 2));
 
-        for (const auto &walletEntry : mapWallet) {
-            const CWalletTx *pcoin = &walletEntry.second;
-            CTransactionRef tx = pcoin->tx;
-
-            int nDepth = pcoin->GetDepthInMainChainCached();
+        if (m_stakeable_lowest_height <= nHeight) {
+            m_greatest_txn_depth = nHeight - m_stakeable_lowest_height + 1;
+        }
 
-            if (nDepth > m_greatest_txn_depth) {
-                m_greatest_txn_depth = nDepth;
-            }
+        for (const auto &so : m_stakeable_outputs) {
+            const COutPoint &kernel = so.first;
+            const CStakeableOutput &out = so.second;
 
+            int nDepth = out.nHeight < 0 ? 0 : nHeight - out.nHeight + 1;
             if (nDepth < nRequiredDepth) {
                 continue;
             }
 
-            if (pcoin->IsCoinStake() && min_stake_confirmations < COINBASE_MATURITY) {
+            if (out.fCoinStake && min_stake_confirmations < COINBASE_MATURITY) {
                 // min_stake_confirmations is only  less than COINBASE_MATURITY in regtest mode
                 if (nDepth < std::min(COINBASE_MATURITY, (int)(nHeight / 2))) {
                     continue;
                 }
             }
 
-            const uint256 &wtxid = walletEntry.first;
-            for (size_t i = 0; i < tx->vpout.size(); ++i) {
-                const auto &txout = tx->vpout[i];
-                if (!txout->IsType(OUTPUT_STANDARD)) {
-                    continue;
-                }
-
-                COutPoint kernel(wtxid, i);
-
-                if (LogAcceptCategory(BCLog::POS)) {
-                    if (!CheckStakeUnused(kernel)){
-                        WalletLogPrintf("%s: Kernel used %s\n", __func__, kernel.ToString());
-                    }
-                    if(IsSpent(wtxid, i) ){
-                        WalletLogPrintf("%s: Coin spent %s - %d\n", __func__, wtxid.ToString(), i);
-                    }
-                    if(IsLockedCoin(wtxid, i)) {
-                        WalletLogPrintf("%s: Coin is locked %s - %d\n", __func__, wtxid.ToString(), i);
-                    }
+            if (LogAcceptCategory(BCLog::POS)) {
+                if (!CheckStakeUnused(kernel)){
+                    WalletLogPrintf("%s: Kernel used %s\n", __func__, kernel.ToString());
                 }
-
-                if (!CheckStakeUnused(kernel)
-                     || IsSpent(wtxid, i)
-                     || IsLockedCoin(wtxid, i)) {
-                    continue;
+                if(IsSpent(kernel.hash, kernel.n) ){
+                    WalletLogPrintf("%s: Coin spent %s - %d\n", __func__, kernel.hash.ToString(), kernel.n);
                 }
-
-                const CScript *pscriptPubKey = txout->GetPScriptPubKey();
-                CKeyID keyID;
-                if (!ExtractStakingKeyID(*pscriptPubKey, keyID)) {
-                    continue;
+                if(IsLockedCoin(kernel.hash, kernel.n)) {
+                    WalletLogPrintf("%s: Coin is locked %s - %d\n", __func__, kernel.hash.ToString(), kernel.n);
                 }
+            }
 
-                isminetype mine = IsMine(keyID);
-                if (!(mine & ISMINE_SPENDABLE)) {
-                    continue;
-                }
+            if (!CheckStakeUnused(kernel)
+                 || IsSpent(kernel.hash, kernel.n)
+                 || IsLockedCoin(kernel.hash, kernel.n)) {
+                continue;
+            }
 
-                bool fSpendableIn = true;
-                bool fSolvableIn = true;
-                bool fNeedHardwareKey = (mine & ISMINE_HARDWARE_DEVICE);
+            bool fSpendableIn = true;
+            bool fSolvableIn = true;
+            bool fNeedHardwareKey = false;
 
-                if (fNeedHardwareKey) {
+            if (!out.fRecord) {
+                MapWallet_t::const_iterator mi = mapWallet.find(kernel.hash);
+                if (mi == mapWallet.end()) {
                     continue;
                 }
-
-                vCoins.emplace_back(pcoin, i, nDepth, fSpendableIn, fSolvableIn, true, true, fNeedHardwareKey, false);
-            }
-        }
-
-        for (const auto &ri : mapRecords) {
-            const uint256 &txid = ri.first;
-            const CTransactionRecord &rtx = ri.second;
-
-            int nDepth = GetDepthInMainChain(rtx.blockHash, rtx.nIndex);
-            if (nDepth > m_greatest_txn_depth) {
-                m_greatest_txn_depth = nDepth;
+                vCoins.emplace_back(&mi->second, kernel.n, nDepth, fSpendableIn, fSolvableIn, true, true, fNeedHardwareKey, false);
+                continue;
             }
 
-            if (nDepth < nRequiredDepth) {
+            MapRecords_t::const_iterator mri = mapRecords.find(kernel.hash);
+            if (mri == mapRecords.end()) {
                 continue;
             }
 
-            MapWallet_t::const_iterator twi = mapTempWallet.end();
-            for (const auto &r : rtx.vout)
+            MapWallet_t::const_iterator twi = mapTempWallet.find(kernel.hash);
+            if (twi == mapTempWallet.end())
             {
-                if (r.nType != OUTPUT_STANDARD)
-                    continue;
-
-                if (!(r.nFlags & ORF_OWNED || r.nFlags & ORF_STAKEONLY))
-                    continue;
-
-                if (IsSpent(txid, r.n)
-                    || IsLockedCoin(txid, r.n))
-                    continue;
-
-                CKeyID keyID;
-                if (!ExtractStakingKeyID(r.scriptPubKey, keyID))
-                    continue;
-
-                isminetype mine = IsMine(keyID);
-                if (!(mine & ISMINE_SPENDABLE))
-                    continue;
-                if ((mine & ISMINE_HARDWARE_DEVICE))
-                    continue;
-
-                if (twi == mapTempWallet.end()
-                    && (twi = mapTempWallet.find(txid)) == mapTempWallet.end())
+                if (0 != InsertTempTxn(kernel.hash, &mri->second)
+                    || (twi = mapTempWallet.find(kernel.hash)) == mapTempWallet.end())
                 {
-                    if (0 != InsertTempTxn(txid, &rtx)
-                        || (twi = mapTempWallet.find(txid)) == mapTempWallet.end())
-                    {
-                        WalletLogPrintf("ERROR: %s - InsertTempTxn failed %s.\n", __func__, txid.ToString());
-                        return;
-                    };
+                    WalletLogPrintf("ERROR: %s - InsertTempTxn failed %s.\n", __func__, kernel.hash.ToString());
+                    return;
                 };
-
-                bool fSpendableIn = true;
-                bool fNeedHardwareKey = false;
-                vCoins.emplace_back(&twi->second, r.n, nDepth, fSpendableIn, true, true, true, fNeedHardwareKey, false);
             };
-        };
+
+            vCoins.emplace_back(&twi->second, kernel.n, nDepth, fSpendableIn, true, true, true, fNeedHardwareKey, false);
+        }
     }
 
     random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
@@ -11139,14 +12572,24 @@ void CHDWallet::AvailableCoinsForStaking(std::vector<COutput> &vCoins, int64_t n
 
 bool CHDWallet::SelectCoinsForStaking(int64_t nTargetValue, int64_t nTime, int nHeight, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64_t& nValueRet) const
 {
-
-    if (m_have_cached_stakeable_coins) {
-        random_shuffle(m_cached_stakeable_coins.begin(), m_cached_stakeable_coins.end(), GetRandInt);
-    } else {
-        m_cached_stakeable_coins.clear();
-        AvailableCoinsForStaking(m_cached_stakeable_coins, nTime, nHeight);
-        m_have_cached_stakeable_coins = true;
+    // Slices of the same wallet select concurrently from the staking threads
+    bool fHaveCached;
+    {
+        LOCK(cs_wallet);
+        fHaveCached = m_have_cached_stakeable_coins;
     }
+    if (!fHaveCached) {
+        // Rebuilding reads depths from the chain, once per block or wallet change
+        LOCK2(cs_main, cs_wallet);
+        if (!m_have_cached_stakeable_coins) {
+            m_cached_stakeable_coins.clear();
+            AvailableCoinsForStaking(m_cached_stakeable_coins, nTime, nHeight);
+            m_have_cached_stakeable_coins = true;
+        }
+    }
+
+    LOCK(cs_wallet);
+    random_shuffle(m_cached_stakeable_coins.begin(), m_cached_stakeable_coins.end(), GetRandInt);
 
     std::vector<COutput> &vCoins = m_cached_stakeable_coins;
 
@@ -11184,9 +12627,8 @@ bool CHDWallet::SelectCoinsForStaking(int64_t nTargetValue, int64_t nTime, int n
     return true;
 }
 
-bool CHDWallet::CreateCoinStake(unsigned int nBits, int64_t nTime, int nBlockHeight, int64_t nFees, CMutableTransaction &txNew, CKey &key)
+bool CHDWallet::CreateCoinStake(const CBlockIndex *pindexPrev, unsigned int nBits, int64_t nTime, int nBlockHeight, int64_t nFees, CMutableTransaction &txNew, CKey &key, size_t nSlice, size_t nSlices)
 {
-    CBlockIndex *pindexPrev = chainActive.Tip();
     arith_uint256 bnTargetPerCoinDay;
     bnTargetPerCoinDay.SetCompact(nBits);
 
@@ -11214,6 +12656,25 @@ bool CHDWallet::CreateCoinStake(unsigned int nBits, int64_t nTime, int nBlockHei
 
     std::set<std::pair<const CWalletTx*,unsigned int> >::iterator it = setCoins.begin();
 
+    // Decode the target and lay out the kernel once for all candidates
+    CStakeKernelRound kernelRound(pindexPrev, nBits, nTime);
+
+    // Heights of the candidates, the kernel checks then run without cs_main or cs_wallet
+    std::map<COutPoint, std::pair<CAmount, int>> mapKernelCoins;
+    {
+        LOCK(cs_wallet);
+        for (const auto &pcoin : setCoins) {
+            COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
+            if (nSlices > 1 && GetStakeSlice(prevoutStake, nSlices) != nSlice) {
+                continue; // Searched by another task
+            }
+            auto so = m_stakeable_outputs.find(prevoutStake);
+            if (so != m_stakeable_outputs.end() && so->second.nHeight >= 0) {
+                mapKernelCoins[prevoutStake] = std::make_pair(so->second.nValue, so->second.nHeight);
+            }
+        }
+    }
+
     for (; it != setCoins.end(); ++it) {
         auto pcoin = *it;
         if (ThreadStakeMinerStopped()) { // interruption_point
@@ -11221,9 +12682,13 @@ bool CHDWallet::CreateCoinStake(unsigned int nBits, int64_t nTime, int nBlockHei
         }
 
         COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
+        auto kc = mapKernelCoins.find(prevoutStake);
+        if (kc == mapKernelCoins.end()) {
+            continue; // Searched by another task, or unconfirmed
+        }
 
         int64_t nBlockTime;
-        if (CheckKernel(pindexPrev, nBits, nTime, prevoutStake, &nBlockTime)) {
+        if (CheckKernel(kernelRound, prevoutStake, kc->second.first, kc->second.second, &nBlockTime)) {
             LOCK(cs_wallet);
             // Found a kernel
             if (LogAcceptCategory(BCLog::POS)) {
@@ -11436,23 +12901,17 @@ bool CHDWallet::CreateCoinStake(unsigned int nBits, int64_t nTime, int nBlockHei
 
         if (nBlockHeight % pDevFundSettings->nDevOutputPeriod == 0) {
 
-            CBlockIndex *pIndexDev = pindexPrev;
-
-            while( pIndexDev && pIndexDev->nHeight >= nBlockHeight - pDevFundSettings->nDevOutputPeriod){
-                nDevReward += (Params().GetProofOfStakeReward(pIndexDev, 0) * pDevFundSettings->nMinDevStakePercent)  / 100;
-                pIndexDev = pIndexDev->pprev;
-                if( !pIndexDev ) break;
-            }
+            nDevReward = g_stake_reward_cache.GetDevFundReward(pindexPrev, nBlockHeight, *pDevFundSettings);
 
             // Place dev fund output
             OUTPUT_PTR<CTxOutStandard> outDevSplit = MAKE_OUTPUT<CTxOutStandard>();
             outDevSplit->nValue = nDevReward;
 
-            CTxDestination dfDest = CBitcoinAddress(pDevFundSettings->sDevFundAddresses).Get();
-            if (dfDest.type() == typeid(CNoDestination)) {
+            CDevFundPayee devFund;
+            if (!g_stake_reward_cache.GetDevFund(nTime, devFund) || devFund.dest.type() == typeid(CNoDestination)) {
                 return werror("%s: Failed to get foundation fund destination: %s.", __func__, pDevFundSettings->sDevFundAddresses);
             }
-            outDevSplit->scriptPubKey = GetScriptForDestination(dfDest);
+            outDevSplit->scriptPubKey = devFund.scriptPubKey;
 
             txNew.vpout.insert(txNew.vpout.begin()+1, outDevSplit);
         }
@@ -11535,7 +12994,7 @@ bool CHDWallet::CreateCoinStake(unsigned int nBits, int64_t nTime, int nBlockHei
     return true;
 };
 
-bool CHDWallet::SignBlock(CBlockTemplate *pblocktemplate, int nHeight, int64_t nSearchTime)
+bool CHDWallet::SignBlock(CBlockTemplate *pblocktemplate, int nHeight, int64_t nSearchTime, size_t nSlice, size_t nSlices)
 {
     if (LogAcceptCategory(BCLog::POS)) {
         WalletLogPrintf("%s, nHeight %d\n", __func__, nHeight);
@@ -11549,22 +13008,25 @@ bool CHDWallet::SignBlock(CBlockTemplate *pblocktemplate, int nHeight, int64_t n
     }
 
     int64_t nFees = -pblocktemplate->vTxFees[0];
-    CBlockIndex *pindexPrev = chainActive.Tip();
+    std::shared_ptr<const CStakeTipSnapshot> tip = GetStakeTipSnapshot();
+    if (!tip || tip->hashBlock != pblock->hashPrevBlock) {
+        return false; // Template is stale
+    }
 
     CKey key;
     pblock->nVersion = BITCOINC_BLOCK_VERSION;
-    pblock->nBits = GetNextTargetRequired(pindexPrev);
+    pblock->nBits = tip->nBitsNext;
     if (LogAcceptCategory(BCLog::POS)) {
         WalletLogPrintf("%s, nBits %d\n", __func__, pblock->nBits);
     }
 
     CMutableTransaction txCoinStake;
-    if (CreateCoinStake(pblock->nBits, nSearchTime, nHeight, nFees, txCoinStake, key)) {
+    if (CreateCoinStake(tip->pindex, pblock->nBits, nSearchTime, nHeight, nFees, txCoinStake, key, nSlice, nSlices)) {
         if (LogAcceptCategory(BCLog::POS)) {
             WalletLogPrintf("%s: Kernel found.\n", __func__);
         }
 
-        if (nSearchTime >= chainActive.Tip()->GetPastTimeLimit()+1) {
+        if (nSearchTime >= tip->nPastTimeLimit+1) {
             // make sure coinstake would meet timestamp protocol
             //    as it would be the same as the block timestamp
             pblock->nTime = nSearchTime;
@@ -11576,16 +13038,23 @@ bool CHDWallet::SignBlock(CBlockTemplate *pblocktemplate, int nHeight, int64_t n
             // Insert coinstake as txn0
             pblock->vtx.insert(pblock->vtx.begin(), MakeTransactionRef(txCoinStake));
 
-            bool mutated;
-            pblock->hashMerkleRoot = BlockMerkleRoot(*pblock, &mutated);
-            pblock->hashWitnessMerkleRoot = BlockWitnessMerkleRoot(*pblock, &mutated);
+            if (pblocktemplate->fHasMerkleBranches) {
+                pblock->hashMerkleRoot = ComputeMerkleRootFromBranch(pblock->vtx[0]->GetHash(), pblocktemplate->vMerkleBranch, 0);
+                pblock->hashWitnessMerkleRoot = ComputeMerkleRootFromBranch(pblock->vtx[0]->GetWitnessHash(), pblocktemplate->vWitnessMerkleBranch, 0);
+            } else {
+                bool mutated;
+                pblock->hashMerkleRoot = BlockMerkleRoot(*pblock, &mutated);
+                pblock->hashWitnessMerkleRoot = BlockWitnessMerkleRoot(*pblock, &mutated);
+            }
 
             // Append a signature to the block
             return key.Sign(pblock->GetHash(), pblock->vchBlockSig);
         }
     }
 
-    nLastCoinStakeSearchTime = nSearchTime;
+    if (nLastCoinStakeSearchTime < nSearchTime) {
+        nLastCoinStakeSearchTime = nSearchTime; // Don't undo a longer wait set by the miner
+    }
 
     return false;
 };
@@ -11594,6 +13063,7 @@ bool CHDWallet::SignBlock(CBlockTemplate *pblocktemplate, int nHeight, int64_t n
 bool CHDWallet::SignOutputs( CMutableTransaction &tx, int nTime, std::string &strError, bool fHasStandardInOut )
 {
     // Create the output signatures if needed
+    std::vector<uint8_t> vPrevouts; // Shared by the signature hashes of all outputs
     for( CTxOutBaseRef &out : tx.vpout ){
 
         if( out->nVersion == OUTPUT_STANDARD ){
@@ -11626,10 +13096,7 @@ bool CHDWallet::SignOutputs( CMutableTransaction &tx, int nTime, std::string &st
                 strError = "Failed to extract keyId";
                 return false;
             }else{
-                const DevFundSettings *pDevFundSettings = Params().GetDevFundSettings(nTime);
-                CKeyID keyIdDev;
-                if(CBitcoinAddress(pDevFundSettings->sDevFundAddresses).GetKeyID(keyIdDev) &&
-                   keyId1 == keyIdDev){
+                if(g_stake_reward_cache.IsDevFundKey(nTime, keyId1)){
                     continue;
                 }
             }
@@ -11658,7 +13125,9 @@ bool CHDWallet::SignOutputs( CMutableTransaction &tx, int nTime, std::string &st
                 return false;
             }
 
-            uint256 nOutSigHash = SignatureHashStakingOutput(*pKeyId, pout->GetValue(), tx.vin);
+            if (vPrevouts.empty())
+                vPrevouts = SerializeSignatureHashPrevouts(tx.vin);
+            uint256 nOutSigHash = SignatureHashStakingOutput(*pKeyId, pout->GetValue(), vPrevouts);
 
             if( !key.SignCompact(nOutSigHash, pout->vecSignature) ){
                 strError = "Staking output - Failed to sign";
@@ -11762,7 +13231,9 @@ bool CHDWallet::SignOutputs( CMutableTransaction &tx, int nTime, std::string &st
                 return false;
             }
 
-            uint256 nOutSigHash = SignatureHashSpendingOutput(pout->pk.GetID(), pout->vRangeproof, tx.vin);
+            if (vPrevouts.empty())
+                vPrevouts = SerializeSignatureHashPrevouts(tx.vin);
+            uint256 nOutSigHash = SignatureHashSpendingOutput(pout->pk.GetID(), pout->vRangeproof, vPrevouts);
 
             if( !actualSpendKey.SignCompact(nOutSigHash, pout->vecSignature) ){
                 strError = "Spending output - Failed to sign";
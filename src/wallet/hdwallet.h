@@ -9,6 +9,7 @@
 #include <wallet/wallet.h>
 #include <wallet/hdwalletdb.h>
 #include <wallet/rpchdwallet.h>
+#include <wallet/accountkeytable.h>
 
 #include <key_io.h>
 #include <key/extkey.h>
@@ -16,6 +17,12 @@
 
 #include <miner.h>
 
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
 typedef std::map<CKeyID, CStealthKeyMetadata> StealthKeyMetaMap;
 typedef std::map<CKeyID, CExtKeyAccount*> ExtKeyAccountMap;
 typedef std::map<CKeyID, CStoredExtKey*> ExtKeyMap;
@@ -26,8 +33,12 @@ typedef std::map<uint256, CTransactionRecord> MapRecords_t;
 typedef std::multimap<int64_t, std::map<uint256, CTransactionRecord>::iterator> RtxOrdered_t;
 
 class UniValue;
+struct CScanOutput;
 typedef struct secp256k1_scratch_space_struct secp256k1_scratch_space;
 
+static const bool DEFAULT_LAZY_RECORDS = false;
+static const int MIN_ARCHIVE_RECORD_DEPTH = 1000; // -lazyrecords leaves records spent less deep in memory
+
 const uint16_t OR_PLACEHOLDER_N = 0xFFFF; // index of a fake output to contain reconstructed amounts for txns with undecodeable outputs
 enum OutputRecordFlags
 {
@@ -76,7 +87,8 @@ public:
     vPath 0 - ORA_STANDARD
         [1, 34] pubkey
     */
-    std::vector<uint8_t> vPath; // index to m is stored in first entry
+    // Held inline up to the size of an ORA_EXTKEY path, saving an allocation per output
+    prevector<21, uint8_t> vPath; // index to m is stored in first entry
 
     ADD_SERIALIZE_METHODS;
     template <typename Stream, typename Operation>
@@ -366,6 +378,16 @@ public:
     CAmount nSpendingWatchOnlyLocked = 0;
 };
 
+/** getstakinginfo sums over the wallet's available coins at nHeight */
+struct CHDWalletStakingSums
+{
+    int nHeight = -1;
+    CAmount nStakeable = 0;
+    CAmount nColdStakeable = 0;
+    CAmount nWalletStaking = 0;
+    CAmount nColdStakingWeight = 0;
+};
+
 class CHDWallet : public CWallet
 {
 public:
@@ -373,6 +395,8 @@ public:
 
     ~CHDWallet()
     {
+        StopProcessLockedOutputs();
+        StopCompactDB();
         Finalise();
     }
 
@@ -394,6 +418,10 @@ public:
     bool LoadAddressBook(CHDWalletDB *pwdb);
 
     bool LoadTxRecords(CHDWalletDB *pwdb);
+    /** With -lazyrecords, move buried fully spent records out of memory to the rtxa prefix */
+    bool ArchiveSpentRecords(CHDWalletDB *pwdb);
+    /** rtxOrdered, or when records were archived, rtxOrdered merged into rtxMerged with the archived records read into mapArchived */
+    const RtxOrdered_t &GetRecordsOrdered(MapRecords_t &mapArchived, RtxOrdered_t &rtxMerged) const;
 
     bool IsLocked() const override;
     bool EncryptWallet(const SecureString &strWalletPassphrase) override;
@@ -477,6 +505,10 @@ public:
     CAmount GetLegacyBalance(const isminefilter& filter, int minDepth, const std::string* account) const override;
 
     bool GetBalances(CHDWalletBalances &bal);
+    /** Latest balances, lock free unless the wallet changed since they were last built */
+    std::shared_ptr<const CHDWalletBalances> GetBalancesSnapshot();
+    /** Staking sums at the current tip, lock free unless the wallet or the tip changed since they were last built */
+    std::shared_ptr<const CHDWalletStakingSums> GetStakingSumsSnapshot();
     CAmount GetAvailableBalance(const CCoinControl* coinControl = nullptr) const override;
     CAmount GetAvailableAnonBalance(const CCoinControl* coinControl = nullptr) const;
 
@@ -488,6 +520,8 @@ public:
     int ExpandTempRecipients(std::vector<CTempRecipient> &vecSend, CStoredExtKey *pc, std::string &sError);
 
     int AddCTData(CTxOutBase *txout, CTempRecipient &r, std::string &sError);
+    /** Add CT data to many outputs, range proofs are generated in parallel */
+    int AddCTData(std::vector<std::pair<CTxOutBase*, CTempRecipient*> > &vOutputs, std::string &sError);
 
     bool SetChangeDest(const CCoinControl *coinControl, CTempRecipient &r, std::string &sError);
 
@@ -515,6 +549,9 @@ public:
 
 
     void ClearCachedBalances() override;
+    void ClearCachedOutputs() override;
+    void BeginBlockBatch() override;
+    void EndBlockBatch() override;
     void LoadToWallet(const CWalletTx& wtxIn) override;
     void LoadToWallet(const uint256 &hash, const CTransactionRecord &rtx);
 
@@ -567,9 +604,12 @@ public:
 
     int ExtKeyAppendToPack(CHDWalletDB *pwdb, CExtKeyAccount *sea, const CKeyID &idKey, const CEKAKey &ak, bool &fUpdateAcc) const;
     int ExtKeyAppendToPack(CHDWalletDB *pwdb, CExtKeyAccount *sea, const CKeyID &idKey, const CEKASCKey &asck, bool &fUpdateAcc) const;
+    int ExtKeyAppendToPack(CHDWalletDB *pwdb, CExtKeyAccount *sea, const std::vector<CEKAKeyPack> &vKeys, bool &fUpdateAcc) const;
 
     int ExtKeySaveKey(CHDWalletDB *pwdb, CExtKeyAccount *sea, const CKeyID &keyId, const CEKAKey &ak) const;
     int ExtKeySaveKey(CExtKeyAccount *sea, const CKeyID &keyId, const CEKAKey &ak) const;
+    /** Save many keys of sea, the key packs, chains and account are written once */
+    int ExtKeySaveKeys(CHDWalletDB *pwdb, CExtKeyAccount *sea, const std::vector<std::pair<CKeyID, CEKAKey> > &vKeys) const;
 
     int ExtKeySaveKey(CHDWalletDB *pwdb, CExtKeyAccount *sea, const CKeyID &keyId, const CEKASCKey &asck) const;
     int ExtKeySaveKey(CExtKeyAccount *sea, const CKeyID &keyId, const CEKASCKey &asck) const;
@@ -632,11 +672,26 @@ public:
     bool GetStealthLinked(const CKeyID &idK, CStealthAddress &sx);
     bool ProcessLockedStealthOutputs();
     bool ProcessLockedBlindedOutputs();
+    /** Expand the outputs received while locked from a background thread, called once unlocked */
+    void StartProcessLockedOutputs();
+    void StopProcessLockedOutputs();
+    /**
+     * Compact the wallet db from a background thread. Erases coinstakes deeper than nStakeDepth
+     * with all owned outputs spent, strips the witness data and blinding factors from the stored
+     * transactions of records deeper than nTrimDepth with all owned outputs spent, then rewrites
+     * the db file in key order. A negative depth skips the step.
+     * Returns false if a compaction is already running.
+     */
+    bool StartCompactDB(int nStakeDepth, int nTrimDepth);
+    void StopCompactDB();
+    /** Percent done of the running compaction, -1 if none is running */
+    int GetCompactDBProgress() const { return m_compact_progress; }
     bool CountRecords(std::string sPrefix, int64_t rv);
     bool ProcessStealthOutput(const CTxDestination &address,
-        std::vector<uint8_t> &vchEphemPK, uint32_t prefix, bool fHavePrefix, CKey &sShared, bool fNeedShared=false);
+        const std::vector<uint8_t> &vchEphemPK, uint32_t prefix, bool fHavePrefix, CKey &sShared, bool fNeedShared=false);
 
     int CheckForStealthAndNarration(const CTxOutBase *pb, const CTxOutData *pdata, std::string &sNarr);
+    int CheckForStealthAndNarration(const CScanOutput &so, const CTxOutData *pdata, std::string &sNarr);
     bool FindStealthTransactions(const CTransaction &tx, mapValue_t &mapNarr);
 
     bool ScanForOwnedOutputs(const CTransaction &tx, size_t &nRingCT, mapValue_t &mapNarr);
@@ -650,8 +705,16 @@ public:
     int InsertTempTxn(const uint256 &txid, const CTransactionRecord *rtx) const;
 
     int OwnStandardOut(const CTxOutStandard *pout, const CTxOutData *pdata, COutputRecord &rout, bool &fUpdated);
+    /** Amount, blinding factor and narration recovered from the range proof of an owned anon output */
+    struct CAnonOutRewind
+    {
+        bool fOk = false;
+        uint64_t nValue = 0;
+        uint8_t blind[32];
+        std::string sNarration;
+    };
     int OwnAnonOut(CHDWalletDB *pwdb, const uint256 &txhash, const CTxOutRingCT *pout, const CStoredExtKey *pc, uint32_t &nLastChild,
-        COutputRecord &rout, CStoredTransaction &stx, bool &fUpdated);
+        COutputRecord &rout, CStoredTransaction &stx, bool &fUpdated, const CAnonOutRewind *pRewound = nullptr);
 
     bool AddTxinToSpends(const CTxIn &txin, const uint256 &txhash);
 
@@ -669,8 +732,22 @@ public:
     bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet,
         const CCoinControl& coin_control, CoinSelectionParams& coin_selection_params, bool& bnb_used) const override;
 
+    /** Queue tx and the txns it spends from for reindexing in m_spendable_standard and m_spendable_anon */
+    void MarkSpendableDirty(const CTransaction &tx) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    void MarkSpendableDirty(const uint256 &txid) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    void InvalidateSpendableOutputs() const;
+    void UpdateSpendableOutputs() const EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet);
+    void IndexSpendableOutputs(const uint256 &txid) const EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet);
+
     bool SelectBlindedCoins(const std::vector<COutputR>& vAvailableCoins, const CAmount& nTargetValue, std::vector<std::pair<MapRecords_t::const_iterator,unsigned int> > &setCoinsRet, CAmount &nValueRet, const CCoinControl *coinControl = nullptr) const;
 
+    /**
+     * Spendable coins of vAvailableCoins with their value less nInputFee, sorted by that effective value descending
+     * as SelectCoinsBnB expects. Built once per transaction and kept across the fee passes.
+     */
+    void GetAnonSelectionCandidates(const std::vector<COutputR> &vAvailableCoins, CAmount nInputFee,
+        std::vector<CAmount> &vEffectiveValues, std::vector<std::pair<MapRecords_t::const_iterator,unsigned int> > &vCandidates) const;
+
     void AvailableAnonCoins(std::vector<COutputR> &vCoins, bool fOnlySafe=true, const CCoinControl *coinControl = nullptr, const CAmount& nMinimumAmount = 1, const CAmount& nMaximumAmount = MAX_MONEY, const CAmount& nMinimumSumAmount = MAX_MONEY, const uint64_t& nMaximumCount = 0, const int& nMinDepth = 0, const int& nMaxDepth = 0x7FFFFFFF, bool fIncludeImmature=false) const EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet);
     //bool SelectAnonCoins(const std::vector<COutputR> &vAvailableCoins, const CAmount &nTargetValue, std::vector<std::pair<MapRecords_t::const_iterator,unsigned int> > &setCoinsRet, CAmount &nValueRet, const CCoinControl *coinControl = NULL) const;
 
@@ -705,20 +782,47 @@ public:
 
     size_t CountColdstakeOutputs();
 
+    struct CColdStakeSum
+    {
+        size_t nCount = 0;
+        CAmount nValue = 0;
+    };
+    /**
+     * Unspent coldstake outputs in the wallet: all of them, those delegated by this wallet
+     * (spend key owned) and those staked by this wallet (stake key owned).
+     */
+    void GetColdStakeSums(CColdStakeSum &sumAll, CColdStakeSum &sumDelegated, CColdStakeSum &sumStaking);
+    CColdStakeSum GetColdStakeSumByStaker(const CKeyID &idStake);
+    CColdStakeSum GetColdStakeSumBySpend(const CScript &scriptSpend);
+    /** Sums per stake key of the outputs delegated by this wallet and per spend script of the outputs staked by it */
+    void GetColdStakeDelegations(std::map<CKeyID, CColdStakeSum> &mapByStaker, std::map<CScript, CColdStakeSum> &mapBySpend);
+    /** Queue tx and the txns it spends from for reindexing in m_coldstake_outputs */
+    void MarkColdStakeDirty(const CTransaction &tx) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    void InvalidateColdStakeOutputs() const;
+    void UpdateColdStakeOutputs() const EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet);
+    void IndexColdStakeOutputs(const uint256 &txid) const EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet);
+
     /* Return a script for a simple address type (normal/extended) */
     bool GetScriptForAddress(CScript &script, const CBitcoinAddress &addr, bool fUpdate = false, std::vector<uint8_t> *vData = NULL, bool allow_stakeonly = false);
 
     bool SetReserveBalance(CAmount nNewReserveBalance);
     uint64_t GetStakeWeight() const;
+    /** Queue tx and the txns it spends from for reindexing in m_stakeable_outputs */
+    void MarkStakeableDirty(const CTransaction &tx) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    void InvalidateStakeableOutputs() const;
+    void UpdateStakeableOutputs() const EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet);
+    void IndexStakeableOutputs(const uint256 &txid) const EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet);
+    size_t CountStakeableOutputs() const;
     void AvailableCoinsForStaking(std::vector<COutput> &vCoins, int64_t nTime, int nHeight) const;
     bool SelectCoinsForStaking(int64_t nTargetValue, int64_t nTime, int nHeight, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64_t& nValueRet) const;
-    bool CreateCoinStake(unsigned int nBits, int64_t nTime, int nBlockHeight, int64_t nFees, CMutableTransaction &txNew, CKey &key);
-    bool SignBlock(CBlockTemplate *pblocktemplate, int nHeight, int64_t nSearchTime);
+    /** Only outputs in slice nSlice of nSlices (see GetStakeSlice) are tried as kernel, pindexPrev comes from GetStakeTipSnapshot */
+    bool CreateCoinStake(const CBlockIndex *pindexPrev, unsigned int nBits, int64_t nTime, int nBlockHeight, int64_t nFees, CMutableTransaction &txNew, CKey &key, size_t nSlice = 0, size_t nSlices = 1);
+    bool SignBlock(CBlockTemplate *pblocktemplate, int nHeight, int64_t nSearchTime, size_t nSlice = 0, size_t nSlices = 1);
     bool SignOutputs(CMutableTransaction &tx, int nTime, std::string &strError, bool fHasStandardInOut);
 
     boost::signals2::signal<void (CAmount nReservedBalance)> NotifyReservedBalanceChanged;
 
-    int64_t nLastCoinStakeSearchTime = 0;
+    std::atomic<int64_t> nLastCoinStakeSearchTime{0};
     uint32_t nStealth, nFoundStealth; // for reporting, zero before use
     int64_t nReserveBalance = 0;
     size_t nStakeThread = 9999999; // unset
@@ -731,6 +835,66 @@ public:
     mutable bool m_have_cached_stakeable_coins = false;
     mutable std::vector<COutput> m_cached_stakeable_coins;
 
+    /**
+     * GetBalances result until ClearCachedBalances, published and read with std::atomic_load/atomic_store.
+     * Never modified once published, readers copy out without cs_main or cs_wallet.
+     * Reset and rebuilt under cs_wallet, so a published snapshot is never older than the last change.
+     */
+    std::shared_ptr<const CHDWalletBalances> m_balances_snapshot;
+    //! GetStakingSumsSnapshot result, published like m_balances_snapshot and also rebuilt when the tip moves
+    std::shared_ptr<const CHDWalletStakingSums> m_staking_sums_snapshot;
+
+    struct CStakeableOutput
+    {
+        int nHeight; // -1 while unconfirmed
+        CAmount nValue;
+        bool fCoinStake;
+        bool fRecord;
+    };
+    /**
+     * Outputs that may be staked once mature, only the txns in m_stakeable_dirty
+     * are reevaluated per staking iteration instead of the whole wallet.
+     * Depth, spent, locked and used kernel checks are still made on selection.
+     */
+    mutable std::map<COutPoint, CStakeableOutput> m_stakeable_outputs;
+    mutable std::set<uint256> m_stakeable_dirty;
+    mutable bool m_stakeable_index_loaded = false;
+    mutable int m_stakeable_lowest_height = std::numeric_limits<int>::max();
+
+    struct CSpendableTx
+    {
+        bool fRecord;
+        std::vector<uint32_t> vOutputs;
+    };
+    /**
+     * Owned outputs per type of each txn that were unspent when the txn was last indexed,
+     * AvailableCoins and AvailableAnonCoins visit only these txns instead of the whole wallet.
+     * Depth, trust, value, spent and locked checks are still made on selection.
+     */
+    mutable std::map<uint256, CSpendableTx> m_spendable_standard;
+    mutable std::map<uint256, CSpendableTx> m_spendable_anon;
+    mutable std::set<uint256> m_spendable_dirty;
+    mutable bool m_spendable_index_loaded = false;
+
+    struct CColdStakeOutput
+    {
+        CAmount nValue;
+        CKeyID idStake;
+        CScript scriptSpend;
+        bool fOwnStake;
+        bool fOwnSpend;
+    };
+    /**
+     * Unspent coldstake outputs with the stake or spend key in the wallet, summed per stake key,
+     * per spend script and per role. Only the txns in m_coldstake_dirty are reindexed on a query.
+     */
+    mutable std::map<COutPoint, CColdStakeOutput> m_coldstake_outputs;
+    mutable std::map<CKeyID, CColdStakeSum> m_coldstake_by_staker;
+    mutable std::map<CScript, CColdStakeSum> m_coldstake_by_spend;
+    mutable CColdStakeSum m_coldstake_all, m_coldstake_delegated, m_coldstake_staking;
+    mutable std::set<uint256> m_coldstake_dirty;
+    mutable bool m_coldstake_index_loaded = false;
+
     enum eStakingState {
         IS_STAKING,
         NOT_STAKING_INIT,
@@ -745,6 +909,47 @@ public:
 
     std::set<CStealthAddress> stealthAddresses;
 
+    struct CStealthScanCandidate
+    {
+        size_t nOrder;
+        const CStealthAddress *pLoose; // Imported stealth address, or
+        CExtKeyAccount *pAccount;      // account of stealth key pAks
+        const CEKAStealthKey *pAks;
+    };
+    /**
+     * Stealth addresses and account stealth keys by prefix, rebuilt on use after
+     * stealthAddresses, mapExtAccounts or an account's mapStealthKeys change.
+     * Outputs with a prefix are only tried against the addresses they match.
+     */
+    mutable bool m_stealth_table_built = false;
+    mutable std::vector<CStealthScanCandidate> m_stealth_no_prefix;
+    mutable std::map<uint8_t, std::multimap<uint32_t, CStealthScanCandidate> > m_stealth_by_prefix;
+    /** Stealth addresses an output with prefix may pay to, in stealthAddresses then mapExtAccounts order */
+    void GetStealthScanCandidates(uint32_t prefix, bool fHavePrefix, std::vector<const CStealthScanCandidate*> &vCandidates) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
+    struct StealthIndexHasher
+    {
+        size_t operator()(const uint160 &hash) const { return ReadLE64(hash.begin()); };
+    };
+    /**
+     * All indexed stealth addresses, loaded by LoadStealthAddresses and extended by
+     * IndexStealthKey so GetStealthByIndex and GetStealthKeyIndex don't read the db.
+     * m_stealth_index[id - 1] is the raw address of id, empty for an unused id.
+     * m_stealth_index_reverse maps the Hash160 of a raw address to its id.
+     */
+    std::vector<CStealthAddressIndexed> m_stealth_index GUARDED_BY(cs_wallet);
+    std::unordered_map<uint160, uint32_t, StealthIndexHasher> m_stealth_index_reverse GUARDED_BY(cs_wallet);
+    void AddStealthIndex(uint32_t id, const uint160 &hash, const CStealthAddressIndexed &sxi) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
+    /**
+     * Keys of all accounts, rebuilt on use after mapExtAccounts changes or
+     * account key packs load, keys added since are taken from each account's vNewKeys.
+     */
+    mutable bool m_account_keys_built = false;
+    mutable CAccountKeyTable m_account_keys;
+    /** Account which may hold key id, nullptr if no account does */
+    CExtKeyAccount *FindAccountKey(const CKeyID &id) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
     CStoredExtKey *pEKMaster = nullptr;
     CKeyID idDefaultAccount;
     ExtKeyAccountMap mapExtAccounts;
@@ -754,6 +959,8 @@ public:
 
     MapRecords_t mapRecords;
     RtxOrdered_t rtxOrdered;
+    bool m_lazy_records = DEFAULT_LAZY_RECORDS;
+    bool m_have_archived_records = false; // records are in rtxa, only listings read them
     mutable MapRecords_t mapTempRecords; // Hack for sending unmined inputs through fundrawtransactionfrom
 
     // Staking Settings
@@ -774,7 +981,6 @@ public:
     int64_t nRCTOutSelectionGroup2 = 50000;
     size_t prefer_max_num_anon_inputs = 5; // if > x anon inputs are randomly selected attempt to reduce
     int m_mixin_selection_mode = 1;
-    secp256k1_scratch_space *m_blind_scratch = nullptr;
 
     int m_collapse_spent_mode = 0;
     int m_min_collapse_depth = 3;
@@ -788,6 +994,30 @@ public:
 private:
     void ParseAddressForMetaData(const CTxDestination &addr, COutputRecord &rec);
 
+    /** Open while a block is synced, writes of the block share it instead of opening a handle each */
+    std::unique_ptr<CHDWalletDB> m_block_batch;
+    /** A write through m_block_batch asked for a flush, done once in EndBlockBatch */
+    mutable bool m_block_batch_flush = false;
+    /** The block batch if one is open, else a new handle held by own */
+    CHDWalletDB &GetBatch(std::unique_ptr<CHDWalletDB> &own, bool fFlushOnClose) const;
+
+    /** Runs ProcessLockedStealthOutputs and ProcessLockedBlindedOutputs while m_locked_outputs_pending is set */
+    void ThreadProcessLockedOutputs();
+
+    int ExtKeyAddSavedKey(CExtKeyAccount *sea, const CKeyID &keyId, const CEKAKey &ak, std::vector<CEKAKeyPack> &vPack) const;
+    std::mutex m_locked_outputs_mutex;
+    std::thread m_locked_outputs_thread;
+    bool m_locked_outputs_pending = false; // Unlocked since the task last started
+    bool m_locked_outputs_running = false;
+    bool m_locked_outputs_stop = false;
+
+    void ThreadCompactDB(int nStakeDepth, int nTrimDepth);
+
+    std::mutex m_compact_mutex;
+    std::thread m_compact_thread;
+    std::atomic<int> m_compact_progress{-1};
+    std::atomic<bool> m_compact_stop{false};
+
     template<typename... Params>
     bool werror(std::string fmt, Params... parameters) const {
         return error(("%s " + fmt).c_str(), GetDisplayName(), parameters...);
@@ -132,6 +132,16 @@ bool CHDWalletDB::WriteFlag(const std::string &name, int32_t nValue)
     return WriteIC(std::make_pair(std::string("flag"), name), nValue, true);
 };
 
+bool CHDWalletDB::ReadDeviceXPub(const CKeyID &idDevice, const std::vector<uint32_t> &vPath, CExtPubKey &ekp, uint32_t nFlags)
+{
+    return m_batch.Read(std::make_pair(std::string("dxpc"), std::make_pair(idDevice, vPath)), ekp, nFlags);
+};
+
+bool CHDWalletDB::WriteDeviceXPub(const CKeyID &idDevice, const std::vector<uint32_t> &vPath, const CExtPubKey &ekp)
+{
+    return WriteIC(std::make_pair(std::string("dxpc"), std::make_pair(idDevice, vPath)), ekp, true);
+};
+
 
 bool CHDWalletDB::ReadExtKeyIndex(uint32_t id, CKeyID &identifier, uint32_t nFlags)
 {
@@ -198,6 +208,16 @@ bool CHDWalletDB::EraseTxRecord(const uint256 &hash)
     return EraseIC(std::make_pair(std::string("rtx"), hash));
 };
 
+bool CHDWalletDB::WriteArchivedTxRecord(const uint256 &hash, const CTransactionRecord &rtx)
+{
+    return WriteIC(std::make_pair(std::string("rtxa"), hash), rtx, true);
+};
+
+bool CHDWalletDB::EraseArchivedTxRecord(const uint256 &hash)
+{
+    return EraseIC(std::make_pair(std::string("rtxa"), hash));
+};
+
 
 bool CHDWalletDB::ReadStoredTx(const uint256 &hash, CStoredTransaction &stx, uint32_t nFlags)
 {
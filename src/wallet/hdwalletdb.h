@@ -38,6 +38,7 @@ prefixes
     cscript
 
     defaultkey
+    dxpc                - hardware device xpub cache, key: device fingerprint, path, value: CExtPubKey
 
     eacc                - extended account
     ecpk                - extended account stealth child key pack
@@ -71,6 +72,7 @@ prefixes
 
     ris                 - reverse stealth index key: hashed raw stealth address bytes, value: uint32_t
     rtx                 - CTransactionRecord
+    rtxa                - CTransactionRecord, spent history not loaded with -lazyrecords
 
     stx                 - CStoredTransaction
     sxad                - loose stealth address
@@ -240,6 +242,11 @@ public:
         return m_batch.GetCursor();
     };
 
+    void Flush()
+    {
+        m_batch.Flush();
+    };
+
     template< typename T>
     bool Replace(Dbc *pcursor, const T &value)
     {
@@ -372,6 +379,9 @@ public:
     bool ReadFlag(const std::string &name, int32_t &nValue, uint32_t nFlags=DB_READ_UNCOMMITTED);
     bool WriteFlag(const std::string &name, int32_t nValue);
 
+    bool ReadDeviceXPub(const CKeyID &idDevice, const std::vector<uint32_t> &vPath, CExtPubKey &ekp, uint32_t nFlags=DB_READ_UNCOMMITTED);
+    bool WriteDeviceXPub(const CKeyID &idDevice, const std::vector<uint32_t> &vPath, const CExtPubKey &ekp);
+
 
     bool ReadExtKeyIndex(uint32_t id, CKeyID &identifier, uint32_t nFlags=DB_READ_UNCOMMITTED);
     bool WriteExtKeyIndex(uint32_t id, const CKeyID &identifier);
@@ -397,6 +407,9 @@ public:
     bool WriteTxRecord(const uint256 &hash, const CTransactionRecord &rtx);
     bool EraseTxRecord(const uint256 &hash);
 
+    bool WriteArchivedTxRecord(const uint256 &hash, const CTransactionRecord &rtx);
+    bool EraseArchivedTxRecord(const uint256 &hash);
+
 
     bool ReadStoredTx(const uint256 &hash, CStoredTransaction &stx, uint32_t nFlags=DB_READ_UNCOMMITTED);
     bool WriteStoredTx(const uint256 &hash, const CStoredTransaction &stx);
@@ -77,6 +77,7 @@ void WalletInit::AddWalletOptions() const
     gArgs.AddArg("-walletbroadcast",  strprintf("Make the wallet broadcast transactions (default: %u)", DEFAULT_WALLETBROADCAST), false, OptionsCategory::WALLET);
     gArgs.AddArg("-walletdir=<dir>", "Specify directory to hold wallets (default: <datadir>/wallets if it exists, otherwise <datadir>)", false, OptionsCategory::WALLET);
     gArgs.AddArg("-walletnotify=<cmd>", "Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)", false, OptionsCategory::WALLET);
+    gArgs.AddArg("-walletnotifybatch=<ms>", strprintf("Run -walletnotify once for the transactions changed within <ms>, %%s in cmd is replaced by up to %u space separated TxIDs, 0 to run per transaction (default: %u)", MAX_WALLETNOTIFY_BATCH_TXIDS, DEFAULT_WALLETNOTIFY_BATCH), false, OptionsCategory::WALLET);
     gArgs.AddArg("-walletrbf", strprintf("Send transactions with full-RBF opt-in enabled (RPC only, default: %u)", DEFAULT_WALLET_RBF), false, OptionsCategory::WALLET);
     gArgs.AddArg("-zapwallettxes=<mode>", "Delete all wallet transactions and only recover those parts of the blockchain through -rescan on startup"
                                " (1 = keep tx meta data e.g. account owner and payment request information, 2 = drop tx meta data)", false, OptionsCategory::WALLET);
@@ -244,6 +245,10 @@ bool WalletInit::Open() const
 
 void WalletInit::Start(CScheduler& scheduler) const
 {
+    int64_t nBatch = gArgs.GetArg("-walletnotifybatch", DEFAULT_WALLETNOTIFY_BATCH);
+    g_wallet_notifier.Start(nBatch > 0 ? nBatch : DEFAULT_WALLETNOTIFY_WINDOW,
+                            nBatch > 0 ? gArgs.GetArg("-walletnotify", "") : "");
+
     for (const std::shared_ptr<CWallet>& pwallet : GetWallets()) {
         pwallet->postInitProcess();
     }
@@ -258,6 +263,7 @@ void WalletInit::Flush() const
 
 void WalletInit::Stop() const
 {
+    g_wallet_notifier.Stop();
     for (const std::shared_ptr<CWallet>& pwallet : GetWallets()) {
         pwallet->Flush(true);
     }
@@ -15,6 +15,7 @@
 #include <net.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
+#include <rpc/jsonstream.h>
 #include <rpc/server.h>
 #include <rpc/mining.h>
 #include <rpc/util.h>
@@ -38,6 +39,9 @@
 #include <univalue.h>
 #include <stdint.h>
 
+#include <atomic>
+#include <thread>
+
 
 extern std::string LabelFromValue(const UniValue& value);
 
@@ -2315,6 +2319,75 @@ static UniValue reservebalance(const JSONRPCRequest &request)
     return result;
 }
 
+//! Keys are derived by up to MAX_DERIVE_RANGE_THREADS threads
+static const size_t MAX_DERIVE_RANGE_THREADS = 8;
+static const size_t MIN_DERIVE_RANGE_KEYS_PER_THREAD = 256;
+//! Keys saved per wallet db transaction by deriverangekeys
+static const size_t DERIVE_RANGE_KEYS_PER_TXN = 5000;
+
+struct CDerivedRangeKey
+{
+    CPubKey pk;
+    uint32_t nChildOut = 0; // Has bit 31 set for hardened keys
+    std::string sAddress;
+};
+
+/**
+ * Derive nKeys keys from sek starting at child nStart, as sek->DeriveKey for each child.
+ * Unhardened keys are derived in batches with CExtKeyPair::DerivePubKeys, the range is
+ * split between threads.
+ */
+static int DeriveRangeKeys(const CStoredExtKey *sek, uint32_t nStart, uint32_t nKeys, bool fHardened, bool f256bit,
+    std::vector<CDerivedRangeKey> &vKeys)
+{
+    vKeys.clear();
+    vKeys.resize(nKeys);
+
+    std::atomic<bool> fFailed{false};
+    auto derive = [&](size_t nBegin, size_t nEnd) {
+        std::vector<CPubKey> vPubKeys;
+        if (!fHardened
+            && !sek->kp.DerivePubKeys(vPubKeys, nStart + nBegin, nEnd - nBegin)) {
+            vPubKeys.clear();
+        }
+
+        for (size_t i = nBegin; i < nEnd && !fFailed; ++i) {
+            CDerivedRangeKey &k = vKeys[i];
+            if (!vPubKeys.empty() && vPubKeys[i - nBegin].IsValid()) {
+                k.pk = vPubKeys[i - nBegin];
+                k.nChildOut = nStart + i;
+            } else {
+                // Skips invalid children as DeriveKey does
+                if (0 != sek->DeriveKey(k.pk, nStart + i, k.nChildOut, fHardened)) {
+                    fFailed = true;
+                    break;
+                }
+                if (nStart + i != (k.nChildOut & ~(1U << 31))) {
+                    LogPrintf("Warning: %s - DeriveKey skipped key %d.\n", __func__, nStart + i);
+                }
+            }
+            k.sAddress = f256bit ? CBitcoinAddress(k.pk.GetID256()).ToString() : CBitcoinAddress(k.pk.GetID()).ToString();
+        }
+    };
+
+    size_t nThreads = std::min(std::min(MAX_DERIVE_RANGE_THREADS, (size_t)std::max(1, GetNumCores())), (size_t)nKeys / MIN_DERIVE_RANGE_KEYS_PER_THREAD);
+    if (nThreads < 2) {
+        derive(0, nKeys);
+    } else {
+        std::vector<std::thread> threads;
+        size_t nPerThread = (nKeys + nThreads - 1) / nThreads;
+        for (size_t t = 0; t < nThreads; ++t) {
+            size_t nBegin = t * nPerThread, nEnd = std::min((size_t)nKeys, nBegin + nPerThread);
+            threads.emplace_back(derive, nBegin, nEnd);
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    return fFailed ? 1 : 0;
+};
+
 static UniValue deriverangekeys(const JSONRPCRequest &request)
 {
     std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
@@ -2494,58 +2567,64 @@ static UniValue deriverangekeys(const JSONRPCRequest &request)
                 throw JSONRPCError(RPC_WALLET_ERROR, _("ExtKeyGetIndex failed."));
         };
 
-        uint32_t nChildIn = (uint32_t)nStart;
-        CPubKey newKey;
-        for (int i = nStart; i <= nEnd; ++i)
-        {
-            nChildIn = (uint32_t)i;
-            uint32_t nChildOut = 0;
-            if (0 != sek->DeriveKey(newKey, nChildIn, nChildOut, fHardened))
-                throw JSONRPCError(RPC_WALLET_ERROR, "DeriveKey failed.");
-
-            if (nChildIn != nChildOut)
-                LogPrintf("Warning: %s - DeriveKey skipped key %d.\n", __func__, nChildIn);
+        std::vector<CDerivedRangeKey> vKeys;
+        if (0 != DeriveRangeKeys(sek, (uint32_t)nStart, (uint32_t)nEnd - (uint32_t)nStart + 1, fHardened, f256bit, vKeys))
+            throw JSONRPCError(RPC_WALLET_ERROR, "DeriveKey failed.");
 
-            if (fHardened)
-                SetHardenedBit(nChildOut);
+        result.reserve(vKeys.size());
+        for (auto &k : vKeys)
+            result.push_back(std::move(k.sAddress));
 
-
-            CKeyID idk = newKey.GetID();
-            CKeyID256 idk256;
-            if (f256bit)
-            {
-                idk256 = newKey.GetID256();
-                result.push_back(CBitcoinAddress(idk256).ToString());
-            } else
+        if (fSave)
+        {
+            std::vector<uint32_t> vChainPath;
+            if (fAddToAddressBook)
             {
-                result.push_back(CBitcoinAddress(idk).ToString());
+                vChainPath.push_back(idIndex); // first entry is the index to the account / master key
+                if (0 != AppendChainPath(sek, vChainPath))
+                    vChainPath.clear();
             };
 
-            if (fSave)
+            // Keys are saved in batches, a single db transaction would run out of locks for large ranges
+            for (size_t nBatch = 0; nBatch < vKeys.size(); nBatch += DERIVE_RANGE_KEYS_PER_TXN)
             {
-                if (HK_YES != sea->HaveSavedKey(idk))
+                size_t nBatchEnd = std::min(vKeys.size(), nBatch + DERIVE_RANGE_KEYS_PER_TXN);
+
+                std::vector<std::pair<CKeyID, CEKAKey> > vSave;
+                for (size_t i = nBatch; i < nBatchEnd; ++i)
                 {
-                    CEKAKey ak(nChain, nChildOut);
-                    if (0 != pwallet->ExtKeySaveKey(sea, idk, ak))
-                        throw JSONRPCError(RPC_WALLET_ERROR, "ExtKeySaveKey failed.");
+                    CKeyID idk = vKeys[i].pk.GetID();
+                    if (HK_YES != sea->HaveSavedKey(idk))
+                        vSave.emplace_back(idk, CEKAKey(nChain, vKeys[i].nChildOut));
                 };
 
-                if (fAddToAddressBook)
-                {
-                    std::vector<uint32_t> vPath;
-                    vPath.push_back(idIndex); // first entry is the index to the account / master key
+                if (!wdb.TxnBegin())
+                    throw JSONRPCError(RPC_WALLET_ERROR, "TxnBegin failed.");
 
-                    if (0 == AppendChainPath(sek, vPath))
-                        vPath.push_back(nChildOut);
-                    else
-                        vPath.clear();
+                if (0 != pwallet->ExtKeySaveKeys(&wdb, sea, vSave))
+                {
+                    wdb.TxnAbort();
+                    throw JSONRPCError(RPC_WALLET_ERROR, "ExtKeySaveKey failed.");
+                };
 
+                if (fAddToAddressBook)
+                {
                     std::string strAccount = "";
-                    if (f256bit)
-                        pwallet->SetAddressBook(&wdb, idk256, strAccount, "receive", vPath, false);
-                    else
-                        pwallet->SetAddressBook(&wdb, idk, strAccount, "receive", vPath, false);
+                    for (size_t i = nBatch; i < nBatchEnd; ++i)
+                    {
+                        std::vector<uint32_t> vPath = vChainPath;
+                        if (!vPath.empty())
+                            vPath.push_back(vKeys[i].nChildOut);
+
+                        if (f256bit)
+                            pwallet->SetAddressBook(&wdb, vKeys[i].pk.GetID256(), strAccount, "receive", vPath, false);
+                        else
+                            pwallet->SetAddressBook(&wdb, vKeys[i].pk.GetID(), strAccount, "receive", vPath, false);
+                    };
                 };
+
+                if (!wdb.TxnCommit())
+                    throw JSONRPCError(RPC_WALLET_ERROR, "TxnCommit failed.");
             };
         };
     }
@@ -2671,6 +2750,176 @@ static UniValue clearwallettransactions(const JSONRPCRequest &request)
     return result;
 }
 
+//! Default depth below which compactwallet trims stored transactions
+static const int DEFAULT_COMPACT_TRIM_DEPTH = 1000;
+
+static UniValue compactwallet(const JSONRPCRequest &request)
+{
+    std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
+    CHDWallet *const pwallet = GetBitcoinCWallet(wallet.get());
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp))
+        return NullUniValue;
+
+    if (request.fHelp || request.params.size() > 2)
+        throw std::runtime_error(
+            "compactwallet ( stake_depth trim_depth )\n"
+            "Compact the wallet database in the background, the progress is logged and shown in the GUI.\n"
+            "Erases coinstakes deeper than stake_depth with all outputs spent. Transactions spending them\n"
+            "no longer show the erased stakes as inputs from the wallet.\n"
+            "Strips range proofs, signatures and blinding factors from the stored blinded and anon transactions\n"
+            "deeper than trim_depth with all outputs spent. gettransaction shows their hex without witness data.\n"
+            "Then rewrites the database file in key order, the wallet is blocked while the file is copied.\n"
+            "Warning: Backup your wallet before using!\n"
+            "\nArguments:\n"
+            "1. stake_depth          (int, optional, default=-1) Erase spent coinstakes deeper than this, -1 to keep all.\n"
+            "2. trim_depth           (int, optional, default=" + std::to_string(DEFAULT_COMPACT_TRIM_DEPTH) + ") Trim spent stored transactions deeper than this, -1 to keep all.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"started\": true|false,   (boolean) False if a compaction is already running\n"
+            "  \"progress\": n,           (numeric) Percent done of the running compaction, if not started\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("compactwallet", "")
+            + HelpExampleCli("compactwallet", "10000 1000")
+            + HelpExampleRpc("compactwallet", "10000, 1000"));
+
+    int nStakeDepth = request.params.size() > 0 && !request.params[0].isNull() ? request.params[0].get_int() : -1;
+    int nTrimDepth = request.params.size() > 1 && !request.params[1].isNull() ? request.params[1].get_int() : DEFAULT_COMPACT_TRIM_DEPTH;
+    if (nStakeDepth < -1 || nTrimDepth < -1)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Depths must be -1 or more.");
+
+    UniValue result(UniValue::VOBJ);
+    if (!pwallet->StartCompactDB(nStakeDepth, nTrimDepth))
+    {
+        result.pushKV("started", false);
+        result.pushKV("progress", std::max(0, pwallet->GetCompactDBProgress()));
+        return result;
+    };
+
+    result.pushKV("started", true);
+    return result;
+}
+
+enum class FilterTxCategory
+{
+    SEND,
+    ORPHAN,
+    IMMATURE,
+    COINBASE,
+    RECEIVE,
+    ORPHANED_STAKE,
+    STAKE,
+    INTERNAL_TRANSFER,
+    UNKNOWN,
+};
+
+static const char *FilterTxCategoryName(FilterTxCategory category)
+{
+    switch (category) {
+        case FilterTxCategory::SEND:                return "send";
+        case FilterTxCategory::ORPHAN:              return "orphan";
+        case FilterTxCategory::IMMATURE:            return "immature";
+        case FilterTxCategory::COINBASE:            return "coinbase";
+        case FilterTxCategory::RECEIVE:             return "receive";
+        case FilterTxCategory::ORPHANED_STAKE:      return "orphaned_stake";
+        case FilterTxCategory::STAKE:               return "stake";
+        case FilterTxCategory::INTERNAL_TRANSFER:   return "internal_transfer";
+        case FilterTxCategory::UNKNOWN:             break;
+    }
+    return "unknown";
+}
+
+static bool FilterTxCategoryFromName(const std::string &name, FilterTxCategory &category)
+{
+    for (int i = (int)FilterTxCategory::SEND; i < (int)FilterTxCategory::UNKNOWN; ++i) {
+        if (name == FilterTxCategoryName((FilterTxCategory)i)) {
+            category = (FilterTxCategory)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Category of a wallet txn that isn't a stake, amount is adjusted for sends partially funded by the wallet
+static FilterTxCategory WalletTxCategory(const CWalletTx &wtx, CAmount nFee, CAmount &amount)
+{
+    if (wtx.IsCoinBase()) {
+        if (wtx.GetDepthInMainChain() < 1) {
+            return FilterTxCategory::ORPHAN;
+        }
+        if (wtx.GetBlocksToMaturity() > 0) {
+            return FilterTxCategory::IMMATURE;
+        }
+        return FilterTxCategory::COINBASE;
+    }
+    if (!nFee) {
+        return FilterTxCategory::RECEIVE;
+    }
+    if (amount == 0) {
+        return FilterTxCategory::INTERNAL_TRANSFER;
+    }
+    // Handle txns partially funded by wallet
+    if (nFee < 0) {
+        amount = wtx.GetCredit(ISMINE_ALL) - wtx.GetDebit(ISMINE_ALL);
+    }
+    return FilterTxCategory::SEND;
+}
+
+static FilterTxCategory RecordCategoryAndAmount(CHDWallet *const pwallet, const CTransactionRecord &rtx,
+    const isminefilter &watchonly_filter, CAmount &amount)
+{
+    size_t nOwned = 0, nFrom = 0, nOutputs = 0;
+    CAmount totalAmount = 0;
+    for (const auto &record : rtx.vout) {
+        if (record.nFlags & ORF_CHANGE) {
+            continue;
+        }
+        nOutputs++;
+        if (record.nFlags & ORF_OWN_ANY) {
+            nOwned++;
+            totalAmount += record.nValue;
+        } else {
+            totalAmount -= record.nValue;
+        }
+        if (record.nFlags & ORF_FROM) {
+            nFrom++;
+        }
+    }
+
+    if (nOwned && nFrom && nOwned != nOutputs) {
+        // Must check against the owned input value
+        CAmount nInput = 0;
+        for (const auto &vin : rtx.vin) {
+            if (vin.IsAnonInput()) {
+                continue;
+            }
+            nInput += pwallet->GetOwnedOutputValue(vin, watchonly_filter);
+        }
+
+        CAmount nOutput = 0;
+        for (const auto &record : rtx.vout) {
+            if ((record.nFlags & ORF_OWNED && watchonly_filter & ISMINE_SPENDABLE)
+                || (record.nFlags & ORF_OWN_WATCH && watchonly_filter & ISMINE_WATCH_ONLY)) {
+                nOutput += record.nValue;
+            }
+        }
+        amount = nOutput - nInput;
+    } else {
+        amount = totalAmount;
+    }
+
+    if (nOwned && nFrom) {
+        return FilterTxCategory::INTERNAL_TRANSFER;
+    }
+    if (nOwned) {
+        return FilterTxCategory::RECEIVE;
+    }
+    if (nFrom) {
+        return FilterTxCategory::SEND;
+    }
+    return FilterTxCategory::UNKNOWN;
+}
+
 static bool ParseOutput(
     UniValue &                 output,
     const COutputEntry &       o,
@@ -2757,11 +3006,8 @@ static void ParseOutputs(
 
     // staked
     if (!listStaked.empty()) {
-        if (wtx.GetDepthInMainChain() < 1) {
-            entry.pushKV("category", "orphaned_stake");
-        } else {
-            entry.pushKV("category", "stake");
-        }
+        entry.pushKV("category", FilterTxCategoryName(wtx.GetDepthInMainChain() < 1
+            ? FilterTxCategory::ORPHANED_STAKE : FilterTxCategory::STAKE));
         for (const auto &s : listStaked) {
             UniValue output(UniValue::VOBJ);
             if (!ParseOutput(
@@ -2839,29 +3085,12 @@ static void ParseOutputs(
             }
         }
 
-        if (wtx.IsCoinBase()) {
-            if (wtx.GetDepthInMainChain() < 1) {
-                entry.pushKV("category", "orphan");
-            } else if (wtx.GetBlocksToMaturity() > 0) {
-                entry.pushKV("category", "immature");
-            } else {
-                entry.pushKV("category", "coinbase");
-            }
-        } else if (!nFee) {
-            entry.pushKV("category", "receive");
-        } else if (amount == 0) {
-            if (listSent.empty())
-                entry.pushKV("fee", ValueFromAmount(-nFee));
-            entry.pushKV("category", "internal_transfer");
-        } else {
-            entry.pushKV("category", "send");
-
-            // Handle txns partially funded by wallet
-            if (nFee < 0)
-                amount = wtx.GetCredit(ISMINE_ALL) - wtx.GetDebit(ISMINE_ALL);
-            else
-                entry.pushKV("fee", ValueFromAmount(-nFee));
-        }
+        FilterTxCategory category = WalletTxCategory(wtx, nFee, amount);
+        if (category == FilterTxCategory::INTERNAL_TRANSFER && listSent.empty())
+            entry.pushKV("fee", ValueFromAmount(-nFee));
+        entry.pushKV("category", FilterTxCategoryName(category));
+        if (category == FilterTxCategory::SEND && nFee >= 0)
+            entry.pushKV("fee", ValueFromAmount(-nFee));
     };
 
     entry.pushKV("outputs", outputs);
@@ -2934,7 +3163,6 @@ static void ParseRecords(
     std::vector<std::string> amounts;
     UniValue   entry(UniValue::VOBJ);
     UniValue outputs(UniValue::VARR);
-    size_t  nOwned      = 0;
     size_t  nFrom       = 0;
     size_t  nWatchOnly  = 0;
     CAmount totalAmount = 0;
@@ -2968,9 +3196,6 @@ static void ParseRecords(
         if (record.nFlags & ORF_CHANGE) {
             continue ;
         }
-        if (record.nFlags & ORF_OWN_ANY) {
-            nOwned++;
-        }
         if (record.nFlags & ORF_FROM) {
             nFrom++;
         }
@@ -3052,15 +3277,8 @@ static void ParseRecords(
         push(entry, "fee", ValueFromAmount(-rtx.nFee));
     }
 
-    if (nOwned && nFrom) {
-        push(entry, "category", "internal_transfer");
-    } else if (nOwned && !nFrom) {
-        push(entry, "category", "receive");
-    } else if (nFrom) {
-        push(entry, "category", "send");
-    } else {
-        push(entry, "category", "unknown");
-    }
+    CAmount amount;
+    push(entry, "category", FilterTxCategoryName(RecordCategoryAndAmount(pwallet, rtx, watchonly_filter, amount)));
 
     if (nLockedOutputs) {
         push(entry, "requires_unlock", true);
@@ -3070,31 +3288,7 @@ static void ParseRecords(
     }
 
     push(entry, "outputs", outputs);
-
-    if (nOwned && nFrom && nOwned != outputs.size())
-    {
-        // Must check against the owned input value
-        CAmount nInput = 0;
-        for (const auto &vin : rtx.vin)
-        {
-            if (vin.IsAnonInput())
-                continue;
-            nInput += pwallet->GetOwnedOutputValue(vin, watchonly_filter);
-        };
-
-        CAmount nOutput = 0;
-        for (auto &record : rtx.vout)
-        {
-            if ((record.nFlags & ORF_OWNED && watchonly_filter & ISMINE_SPENDABLE)
-                || (record.nFlags & ORF_OWN_WATCH && watchonly_filter & ISMINE_WATCH_ONLY))
-                nOutput += record.nValue;
-        };
-
-        push(entry, "amount", ValueFromAmount(nOutput-nInput));
-    } else
-    {
-        push(entry, "amount", ValueFromAmount(totalAmount));
-    };
+    push(entry, "amount", ValueFromAmount(amount));
     amounts.push_back(std::to_string(ValueFromAmount(totalAmount).get_real()));
 
     if (search != "") {
@@ -3118,21 +3312,169 @@ static void ParseRecords(
     }
 }
 
-static std::string getAddress(UniValue const & transaction)
+/** A txn or record listed by filtertransactions, ordered newest first. */
+struct FilterTxItem
+{
+    int64_t nTime; // The "time" field of the entry
+    uint256 hash;
+    CWalletTx *pwtx;
+    const CTransactionRecord *prtx;
+
+    bool operator<(const FilterTxItem &b) const
+    {
+        return nTime > b.nTime || (nTime == b.nTime && b.hash < hash);
+    }
+};
+
+static std::string FilterTxCursor(const FilterTxItem &item)
+{
+    return strprintf("%d:%s", item.nTime, item.hash.ToString());
+}
+
+static bool ParseFilterTxCursor(const std::string &s, FilterTxItem &item)
+{
+    size_t n = s.find(':');
+    if (n == std::string::npos
+        || !ParseInt64(s.substr(0, n), &item.nTime)
+        || s.size() - (n + 1) != 64
+        || !IsHex(s.substr(n + 1))) {
+        return false;
+    }
+    item.hash.SetHex(s.substr(n + 1));
+    return true;
+}
+
+/** The filter and sort keys of a filtertransactions entry, found without building its JSON. */
+struct FilterTxKeys
+{
+    FilterTxCategory category = FilterTxCategory::UNKNOWN;
+    CAmount nAmount = 0; // The "amount" field of the entry
+    int nConfirmations = 0;
+    std::string sAddress; // Stealth address or else address of the first output, only set if fWithAddress
+};
+
+// Returns false if ParseOutputs would list no entry for wtx
+static bool GetWalletTxKeys(FilterTxKeys &keys, CWalletTx &wtx, CHDWallet *const pwallet,
+    const isminefilter &watchonly, bool fBech32, bool fWithAddress)
 {
-    if (transaction["stealth_address"].getType() != 0) {
-        return transaction["stealth_address"].get_str();
+    std::list<COutputEntry> listReceived;
+    std::list<COutputEntry> listSent;
+    std::list<COutputEntry> listStaked;
+    CAmount nFee;
+    std::string strSentAccount;
+    wtx.GetAmounts(listReceived, listSent, listStaked, nFee, strSentAccount, ISMINE_ALL, true);
+
+    if (wtx.IsFromMe(ISMINE_WATCH_ONLY) && !(watchonly & ISMINE_WATCH_ONLY)) {
+        return false;
+    }
+    // A watch-only output drops the entry unless watch-only is included, see ParseOutput
+    auto excluded = [&](const std::list<COutputEntry> &list) {
+        return !(watchonly & ISMINE_WATCH_ONLY) && std::any_of(list.begin(), list.end(),
+            [](const COutputEntry &o) { return o.ismine & ISMINE_WATCH_ONLY; });
+    };
+
+    keys.nConfirmations = wtx.GetDepthInMainChain();
+    const COutputEntry *pFirst = nullptr;
+    bool fFirstReceived = false;
+    if (!listStaked.empty()) {
+        if (excluded(listStaked)) {
+            return false;
+        }
+        keys.category = keys.nConfirmations < 1 ? FilterTxCategory::ORPHANED_STAKE : FilterTxCategory::STAKE;
+        keys.nAmount = -nFee;
+        pFirst = &listStaked.front();
+    } else {
+        if (excluded(listSent) || excluded(listReceived)) {
+            return false;
+        }
+        CAmount amount = 0;
+        for (const auto &o : listSent) {
+            amount -= o.amount;
+        }
+        for (const auto &o : listReceived) {
+            amount += o.amount;
+        }
+        keys.category = WalletTxCategory(wtx, nFee, amount);
+        keys.nAmount = amount;
+        if (!listSent.empty()) {
+            pFirst = &listSent.front();
+        } else
+        if (!listReceived.empty()) {
+            pFirst = &listReceived.front();
+            fFirstReceived = true;
+        }
+    }
+
+    if (fWithAddress && pFirst) {
+        CStealthAddress sx;
+        CBitcoinAddress addr;
+        if (fFirstReceived
+            && pFirst->destination.type() == typeid(CKeyID)
+            && pwallet->GetStealthLinked(boost::get<CKeyID>(pFirst->destination), sx)) {
+            keys.sAddress = sx.Encoded(fBech32);
+        } else
+        if (addr.Set(pFirst->destination)) {
+            keys.sAddress = addr.ToString();
+        }
     }
-    if (transaction["address"].getType() != 0) {
-        return transaction["address"].get_str();
+    return true;
+}
+
+static void GetRecordKeys(FilterTxKeys &keys, const CTransactionRecord &rtx, CHDWallet *const pwallet,
+    const isminefilter &watchonly_filter, bool fWithAddress)
+{
+    keys.nConfirmations = pwallet->GetDepthInMainChain(rtx.blockHash);
+    keys.category = RecordCategoryAndAmount(pwallet, rtx, watchonly_filter, keys.nAmount);
+    if (!fWithAddress) {
+        return;
     }
-    if (transaction["outputs"][0]["stealth_address"].getType() != 0) {
-        return transaction["outputs"][0]["stealth_address"].get_str();
+
+    // The first output as listed by ParseRecords
+    for (const auto &record : rtx.vout) {
+        if (record.nFlags & ORF_CHANGE) {
+            continue;
+        }
+        CTxDestination dest;
+        bool extracted = ExtractDestination(record.scriptPubKey, dest);
+
+        CStealthAddress sx;
+        if (record.vPath.size() > 0) {
+            if (record.vPath[0] == ORA_STEALTH && record.vPath.size() >= 5) {
+                uint32_t sidx;
+                memcpy(&sidx, &record.vPath[1], 4);
+                if (pwallet->GetStealthByIndex(sidx, sx)) {
+                    keys.sAddress = sx.Encoded();
+                    return;
+                }
+            }
+        } else
+        if (extracted && dest.type() == typeid(CKeyID)
+            && pwallet->GetStealthLinked(boost::get<CKeyID>(dest), sx)) {
+            keys.sAddress = sx.Encoded();
+            return;
+        }
+
+        if (extracted && dest.type() == typeid(CNoDestination)) {
+            keys.sAddress = "none";
+        } else
+        if (extracted) {
+            CBitcoinAddress addr;
+            if (!record.scriptPubKey.IsUnspendable()) {
+                addr.Set(dest);
+            }
+            keys.sAddress = addr.ToString();
+        }
+        return;
     }
-    if (transaction["outputs"][0]["address"].getType() != 0) {
-        return transaction["outputs"][0]["address"].get_str();
+}
+
+static bool MatchFilterTx(const FilterTxKeys &keys, bool fAllCategories, FilterTxCategory category, const std::string &type)
+{
+    if (!fAllCategories && keys.category != category) {
+        return false;
     }
-    return std::string();
+    // Entries carry no type, they are listed as staking
+    return type == "all" || type == "staking";
 }
 
 static UniValue filtertransactions(const JSONRPCRequest &request)
@@ -3162,6 +3504,7 @@ static UniValue filtertransactions(const JSONRPCRequest &request)
             "    \"collate\":           false\n"
             "    \"with_reward\":       false\n"
             "    \"use_bech32\":        false\n"
+            "    \"cursor\":            ''\n"
             "  }\n"
             "\n"
             "  Expected values are:\n"
@@ -3195,6 +3538,10 @@ static UniValue filtertransactions(const JSONRPCRequest &request)
             "    collate:           display number of records and sum of amount fields\n"
             "    with_reward        calculate reward explicitly from txindex if necessary\n"
             "    use_bech32         display addresses in bech32 encoding\n"
+            "    cursor:            page after the entry returned in \"cursor\" by a previous call,\n"
+            "                       \"\" for the first page. Only with sort 'time', skip applies after the cursor.\n"
+            "                       Returns an object with the entries in \"tx\" and the \"cursor\" of the next page,\n"
+            "                       null once the last page was returned.\n"
             "\n"
             "\nExamples:\n"
             "\nList only when category is 'stake'\n"
@@ -3216,6 +3563,8 @@ static UniValue filtertransactions(const JSONRPCRequest &request)
     isminefilter watchonly = ISMINE_SPENDABLE;
     std::string  search    = "";
     std::string  category  = "all";
+    bool         fAllCategories = true;
+    FilterTxCategory filterCategory = FilterTxCategory::UNKNOWN;
     std::string  type      = "all";
     std::string  sort      = "time";
 
@@ -3224,6 +3573,8 @@ static UniValue filtertransactions(const JSONRPCRequest &request)
     bool fCollate = false;
     bool fWithReward = false;
     bool fBech32 = false;
+    bool fCursor = false;
+    FilterTxItem cursor;
 
     if (!request.params[0].isNull()) {
         const UniValue & options = request.params[0].get_obj();
@@ -3239,6 +3590,7 @@ static UniValue filtertransactions(const JSONRPCRequest &request)
                 {"collate",           UniValueType(UniValue::VBOOL)},
                 {"with_reward",       UniValueType(UniValue::VBOOL)},
                 {"use_bech32",        UniValueType(UniValue::VBOOL)},
+                {"cursor",            UniValueType(UniValue::VSTR)},
             },
             true, // allow null
             false // strict
@@ -3268,21 +3620,12 @@ static UniValue filtertransactions(const JSONRPCRequest &request)
         }
         if (options.exists("category")) {
             category = options["category"].get_str();
-            std::vector<std::string> categories = {
-                "all",
-                "send",
-                "orphan",
-                "immature",
-                "coinbase",
-                "receive",
-                "orphaned_stake",
-                "stake",
-                "internal_transfer"
-            };
-            auto it = std::find(categories.begin(), categories.end(), category);
-            if (it == categories.end()) {
-                throw JSONRPCError(RPC_INVALID_PARAMETER,
-                    strprintf("Invalid category: %s.", category));
+            if (category != "all") {
+                fAllCategories = false;
+                if (!FilterTxCategoryFromName(category, filterCategory)) {
+                    throw JSONRPCError(RPC_INVALID_PARAMETER,
+                        strprintf("Invalid category: %s.", category));
+                }
             }
         }
         if (options.exists("type")) {
@@ -3331,6 +3674,16 @@ static UniValue filtertransactions(const JSONRPCRequest &request)
             fWithReward = options["with_reward"].get_bool();
         if (options["use_bech32"].isBool())
             fBech32 = options["use_bech32"].get_bool();
+        if (options["cursor"].isStr()) {
+            fCursor = true;
+            const std::string &sCursor = options["cursor"].get_str();
+            if (sort != "time") {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "cursor requires sort 'time'.");
+            }
+            if (!sCursor.empty() && !ParseFilterTxCursor(sCursor, cursor)) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid cursor: %s.", sCursor));
+            }
+        }
     }
 
 
@@ -3348,20 +3701,44 @@ static UniValue filtertransactions(const JSONRPCRequest &request)
     }
 
 
-    // for transactions and records
-    UniValue transactions(UniValue::VARR);
+    // Index the txns and records in range, the entries are only built for the page requested when
+    // sorting by time
+    MapRecords_t mapArchived;
+    RtxOrdered_t rtxMerged;
+    const RtxOrdered_t &rtxOrdered = pwallet->GetRecordsOrdered(mapArchived, rtxMerged);
 
-    // transaction processing
-    const CHDWallet::TxItems &txOrdered = pwallet->wtxOrdered;
-    CWallet::TxItems::const_reverse_iterator tit = txOrdered.rbegin();
-    while (tit != txOrdered.rend()) {
-        CWalletTx* const pwtx = tit->second.first;
+    std::vector<FilterTxItem> vItems;
+    vItems.reserve(pwallet->mapWallet.size() + rtxOrdered.size());
+    for (auto &item : pwallet->mapWallet) {
+        CWalletTx *const pwtx = &item.second;
         int64_t txTime = pwtx->GetTxTime();
-        if (txTime < timeFrom) break;
-        if (txTime <= timeTo)
+        if (txTime < timeFrom || txTime > timeTo) {
+            continue;
+        }
+        vItems.push_back(FilterTxItem{txTime, item.first, pwtx, nullptr});
+    }
+    for (const auto &item : rtxOrdered) {
+        const CTransactionRecord &rtx = item.second->second;
+        int64_t txTime = rtx.GetTxTime();
+        if (txTime < timeFrom || txTime > timeTo) {
+            continue;
+        }
+        vItems.push_back(FilterTxItem{rtx.nTimeReceived, item.second->first, nullptr, &rtx});
+    }
+
+    auto GetItemKeys = [&](FilterTxKeys &keys, const FilterTxItem &item, bool fWithAddress) -> bool {
+        if (item.pwtx) {
+            return GetWalletTxKeys(keys, *item.pwtx, pwallet, watchonly, fBech32, fWithAddress);
+        }
+        GetRecordKeys(keys, *item.prtx, pwallet, watchonly, fWithAddress);
+        return true;
+    };
+
+    auto ParseItem = [&](UniValue &entries, const FilterTxItem &item) {
+        if (item.pwtx) {
             ParseOutputs(
-                transactions,
-                *pwtx,
+                entries,
+                *item.pwtx,
                 pwallet,
                 watchonly,
                 search,
@@ -3369,102 +3746,175 @@ static UniValue filtertransactions(const JSONRPCRequest &request)
                 fBech32,
                 vDevFundScripts
             );
-        tit++;
-    }
-
-    // records processing
-    const RtxOrdered_t &rtxOrdered = pwallet->rtxOrdered;
-    RtxOrdered_t::const_reverse_iterator rit = rtxOrdered.rbegin();
-    while (rit != rtxOrdered.rend()) {
-        const uint256 &hash = rit->second->first;
-        const CTransactionRecord &rtx = rit->second->second;
-        int64_t txTime = rtx.GetTxTime();
-        if (txTime < timeFrom) break;
-        if (txTime <= timeTo)
+        } else {
             ParseRecords(
-                transactions,
-                hash,
-                rtx,
+                entries,
+                item.hash,
+                *item.prtx,
                 pwallet,
                 watchonly,
                 search
             );
-        rit++;
-    }
-
-    // sort
-    std::vector<UniValue> values = transactions.getValues();
-    std::sort(values.begin(), values.end(), [sort] (UniValue a, UniValue b) -> bool {
-        std::string a_address = getAddress(a);
-        std::string b_address = getAddress(b);
-        double a_amount =   a["category"].get_str() == "send"
-                        ? -(a["amount"  ].get_real())
-                        :   a["amount"  ].get_real();
-        double b_amount =   b["category"].get_str() == "send"
-                        ? -(b["amount"  ].get_real())
-                        :   b["amount"  ].get_real();
-        return (
-              sort == "address"
-                ? a_address < b_address
-            : sort == "category" || sort == "txid"
-                ? a[sort].get_str() < b[sort].get_str()
-            : sort == "time" || sort == "confirmations"
-                ? a[sort].get_real() > b[sort].get_real()
-            : sort == "amount"
-                ? a_amount > b_amount
-            : false
-        );
-    });
+        }
+    };
 
-    // filter, skip, count and sum
+    // filter, skip, count and sum, entries are streamed as they are found if possible
     CAmount nTotalAmount = 0, nTotalReward = 0;
     UniValue result(UniValue::VARR);
-    if (count == 0) {
-        count = values.size();
-    }
-    // for every value while count is positive
-    for (unsigned int i = 0; i < values.size() && count != 0; i++) {
-        // if value's category is relevant
-        if (values[i]["category"].get_str() == category || category == "all") {
-            // if value's type is not relevant
-            if (values[i]["type"].getType() == 0) {
-                // value's type is undefined
-                if (!(type == "all" || type == "staking")) {
-                    // type is not 'all' or 'staking'
-                    continue ;
-                }
-            } else if (!(values[i]["type"].get_str() == type || type == "all")) {
-                // value's type is defined
-                // value's type is not type or 'all'
-                continue ;
-            }
-            // if we've skipped enough valid values
-            if (skip-- <= 0) {
-                result.push_back(values[i]);
-                count--;
-
-                if (fCollate) {
-                    if (!values[i]["amount"].isNull())
-                        nTotalAmount += AmountFromValue(values[i]["amount"]);
-                    if (!values[i]["reward"].isNull())
-                        nTotalReward += AmountFromValue(values[i]["reward"]);
-                };
+    size_t nRecords = 0;
+    UniValue nextCursor;
+    CJSONStreamWriter *stream = request.stream;
+    if (stream) {
+        if (fCollate || fCursor) {
+            stream->BeginObject();
+            stream->Key("tx");
+        }
+        stream->BeginArray();
+    }
+    auto AddResult = [&](const UniValue &entry) {
+        if (stream) {
+            stream->Value(entry);
+        } else {
+            result.push_back(entry);
+        }
+        nRecords++;
+        if (fCollate) {
+            if (!entry["amount"].isNull())
+                nTotalAmount += AmountFromValue(entry["amount"]);
+            if (!entry["reward"].isNull())
+                nTotalReward += AmountFromValue(entry["reward"]);
+        };
+    };
+
+    // Entries are filtered and sorted on typed keys, JSON is only built for the page returned,
+    // and for every candidate when searching as the search runs over the built entries
+    bool fFilterKeys = !fAllCategories || type != "all";
+    if (sort == "time") {
+        std::sort(vItems.begin(), vItems.end());
+        auto it = vItems.begin();
+        if (!cursor.hash.IsNull()) {
+            it = std::upper_bound(vItems.begin(), vItems.end(), cursor);
+        }
+        for (; it != vItems.end(); ++it) {
+            if (count != 0 && nRecords >= count) {
+                nextCursor = FilterTxCursor(*(it - 1));
+                break;
+            }
+            FilterTxKeys keys;
+            if (fFilterKeys
+                && (!GetItemKeys(keys, *it, false) || !MatchFilterTx(keys, fAllCategories, filterCategory, type))) {
+                continue;
+            }
+            UniValue entries(UniValue::VARR);
+            ParseItem(entries, *it);
+            if (entries.empty()) {
+                continue;
+            }
+            if (skip-- > 0) {
+                continue;
+            }
+            AddResult(entries[0]);
+        }
+    } else {
+        bool fStrKey = sort == "address" || sort == "category" || sort == "txid";
+        std::vector<size_t> vOrder;
+        std::vector<std::string> vStrKey;
+        std::vector<int64_t> vNumKey;
+        std::map<size_t, UniValue> mapBuilt;
+        for (size_t i = 0; i < vItems.size(); ++i) {
+            const FilterTxItem &item = vItems[i];
+            FilterTxKeys keys;
+            if (!GetItemKeys(keys, item, sort == "address")
+                || !MatchFilterTx(keys, fAllCategories, filterCategory, type)) {
+                continue;
+            }
+            if (search != "") {
+                UniValue entries(UniValue::VARR);
+                ParseItem(entries, item);
+                if (entries.empty()) {
+                    continue;
+                }
+                mapBuilt[vOrder.size()] = entries[0];
+            }
+            if (sort == "address") {
+                vStrKey.push_back(std::move(keys.sAddress));
+            } else
+            if (sort == "category") {
+                vStrKey.push_back(FilterTxCategoryName(keys.category));
+            } else
+            if (sort == "txid") {
+                vStrKey.push_back(item.hash.GetHex());
+            } else
+            if (sort == "amount") {
+                vNumKey.push_back(keys.category == FilterTxCategory::SEND ? -keys.nAmount : keys.nAmount);
+            } else {
+                vNumKey.push_back(keys.nConfirmations);
+            }
+            vOrder.push_back(i);
+        }
+
+        // sort only as far as the page ends
+        std::vector<size_t> vSorted(vOrder.size());
+        for (size_t k = 0; k < vSorted.size(); ++k) {
+            vSorted[k] = k;
+        }
+        size_t nEnd = count == 0 ? vSorted.size() : std::min(vSorted.size(), (size_t)skip + count);
+        std::partial_sort(vSorted.begin(), vSorted.begin() + nEnd, vSorted.end(), [&](size_t a, size_t b) -> bool {
+            return fStrKey ? vStrKey[a] < vStrKey[b] : vNumKey[a] > vNumKey[b];
+        });
+        for (size_t k = skip; k < nEnd; ++k) {
+            auto mi = mapBuilt.find(vSorted[k]);
+            if (mi != mapBuilt.end()) {
+                AddResult(mi->second);
+                continue;
+            }
+            UniValue entries(UniValue::VARR);
+            ParseItem(entries, vItems[vOrder[vSorted[k]]]);
+            if (!entries.empty()) {
+                AddResult(entries[0]);
             }
         }
     }
 
+    UniValue stats(UniValue::VOBJ);
     if (fCollate) {
-        UniValue retObj(UniValue::VOBJ);
-        UniValue stats(UniValue::VOBJ);
-        stats.pushKV("records", (int)result.size());
+        stats.pushKV("records", (int)nRecords);
         stats.pushKV("total_amount", ValueFromAmount(nTotalAmount));
         if (fWithReward)
             stats.pushKV("total_reward", ValueFromAmount(nTotalReward));
+    }
+
+    if (stream) {
+        stream->EndArray();
+        if (fCollate) {
+            stream->KeyValue("collated", stats);
+        }
+        if (fCursor) {
+            stream->KeyValue("cursor", nextCursor);
+        }
+        if (fCollate || fCursor) {
+            stream->EndObject();
+        }
+        return NullUniValue;
+    }
+
+    if (fCollate) {
+        UniValue retObj(UniValue::VOBJ);
         retObj.pushKV("tx", result);
         retObj.pushKV("collated", stats);
+        if (fCursor) {
+            retObj.pushKV("cursor", nextCursor);
+        }
         return retObj;
     };
 
+    if (fCursor) {
+        UniValue retObj(UniValue::VOBJ);
+        retObj.pushKV("tx", result);
+        retObj.pushKV("cursor", nextCursor);
+        return retObj;
+    }
+
     return result;
 }
 
@@ -3852,6 +4302,80 @@ static UniValue manageaddressbook(const JSONRPCRequest &request)
 }
 
 extern double GetDifficulty(const CBlockIndex* blockindex = nullptr);
+static UniValue getbalances(const JSONRPCRequest &request)
+{
+    std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
+    CHDWallet *const pwallet = GetBitcoinCWallet(wallet.get());
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp))
+        return NullUniValue;
+
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getbalances\n"
+            "Returns the balances of the wallet, as in getwalletinfo.\n"
+            "Served from the last balances snapshot without waiting on the wallet lock unless the wallet changed since.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance_total\": xxxxxxx,        (numeric) the total balance of the wallet in " + CURRENCY_UNIT + "\n"
+            "  \"balance_spending\" : {\n"
+            "      \"unconfirmed\": xxxxxxx,      (numeric) the unconfirmed spending balance of the wallet in " + CURRENCY_UNIT + "\n"
+            "      \"locked\": xxxxxxx,           (numeric) the locked spending balance of the wallet in " + CURRENCY_UNIT + "\n"
+            "      \"available\": xxxxxxx,        (numeric) the available spending balance of the wallet in " + CURRENCY_UNIT + "\n"
+            "   }\n"
+            "  \"balance_staking\" : {\n"
+            "      \"unconfirmed\": xxxxxxx,      (numeric) the unconfirmed staking balance of the wallet in " + CURRENCY_UNIT + "\n"
+            "      \"immature\": xxxxxxx,         (numeric) the immature staking balance of the wallet in " + CURRENCY_UNIT + "\n"
+            "      \"available\": xxxxxxx,        (numeric) the available staking balance of the wallet in " + CURRENCY_UNIT + "\n"
+            "   }\n"
+            "  \"total_balance_watchonly\", \"balance_spending_watchonly\", \"balance_staking_watchonly\"\n"
+            "                                   (optional) as above for watch-only outputs, when the wallet has any\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getbalances", "")
+            + HelpExampleRpc("getbalances", ""));
+
+    // Make sure the results are valid at least up to the most recent block
+    // the user could have gotten from another RPC command prior to now
+    pwallet->BlockUntilSyncedToCurrentChain();
+
+    std::shared_ptr<const CHDWalletBalances> snapshot = pwallet->GetBalancesSnapshot();
+    const CHDWalletBalances &bal = *snapshot;
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("balance_total", ValueFromAmount(
+          bal.nStaking + bal.nStakingUnconf + bal.nStakingLocked
+        + bal.nSpending + bal.nSpendingUnconf + bal.nSpendingLocked));
+
+    UniValue balSpending(UniValue::VOBJ), balStaking(UniValue::VOBJ);
+    balSpending.pushKV("unconfirmed", ValueFromAmount(bal.nSpendingUnconf));
+    balSpending.pushKV("locked", ValueFromAmount(bal.nSpendingLocked));
+    balSpending.pushKV("available", ValueFromAmount(bal.nSpending));
+    balStaking.pushKV("unconfirmed", ValueFromAmount(bal.nStakingUnconf));
+    balStaking.pushKV("immature", ValueFromAmount(bal.nStakingLocked));
+    balStaking.pushKV("available", ValueFromAmount(bal.nStaking));
+    result.pushKV("balance_spending", balSpending);
+    result.pushKV("balance_staking", balStaking);
+
+    if (bal.nStakingWatchOnly > 0 || bal.nStakingWatchOnlyUnconf > 0 || bal.nStakingWatchOnlyLocked > 0 ||
+        bal.nSpendingWatchOnly > 0 || bal.nSpendingWatchOnlyUnconf > 0 || bal.nSpendingWatchOnlyLocked > 0) {
+        UniValue balSpendingWatch(UniValue::VOBJ), balStakingWatch(UniValue::VOBJ);
+        balSpendingWatch.pushKV("unconfirmed", ValueFromAmount(bal.nSpendingWatchOnlyUnconf));
+        balSpendingWatch.pushKV("locked", ValueFromAmount(bal.nSpendingWatchOnlyLocked));
+        balSpendingWatch.pushKV("available", ValueFromAmount(bal.nSpendingWatchOnly));
+        balStakingWatch.pushKV("unconfirmed", ValueFromAmount(bal.nStakingWatchOnlyUnconf));
+        balStakingWatch.pushKV("immature", ValueFromAmount(bal.nStakingWatchOnlyLocked));
+        balStakingWatch.pushKV("available", ValueFromAmount(bal.nStakingWatchOnly));
+
+        result.pushKV("total_balance_watchonly",
+            ValueFromAmount(bal.nStakingWatchOnly + bal.nStakingWatchOnlyUnconf + bal.nStakingWatchOnlyLocked +
+                            bal.nSpendingWatchOnly + bal.nSpendingWatchOnlyUnconf + bal.nSpendingWatchOnlyLocked));
+        result.pushKV("balance_spending_watchonly", balSpendingWatch);
+        result.pushKV("balance_staking_watchonly", balStakingWatch);
+    }
+
+    return result;
+};
+
 static UniValue getstakinginfo(const JSONRPCRequest &request)
 {
     std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
@@ -3899,80 +4423,20 @@ static UniValue getstakinginfo(const JSONRPCRequest &request)
     // the user could have gotten from another RPC command prior to now
     pwallet->BlockUntilSyncedToCurrentChain();
 
-    std::vector<COutput> vecOutputs;
-
-    bool include_unsafe = false;
-    bool fIncludeImmature = true;
-    CAmount nMinimumAmount = 0;
-    CAmount nMaximumAmount = MAX_MONEY;
-    CAmount nMinimumSumAmount = MAX_MONEY;
-    uint64_t nMaximumCount = 0;
-    int nMinDepth = 0;
-    int nMaxDepth = 0x7FFFFFFF;
-    int nHeight, nRequiredDepth;
-
-    int64_t nTipTime;
-    float rCoinYearReward;
-    CAmount nMoneySupply;
-
-    CAmount nStakeable = 0;
-    CAmount nColdStakeable = 0;
-    CAmount nWalletStaking = 0;
-    CAmount nColdStakingWeight = 0;
-
-    CKeyID keyID;
-    {
-        LOCK2(cs_main, pwallet->cs_wallet);
-
-        nHeight = chainActive.Tip()->nHeight;
-        nRequiredDepth = std::min((int)(Params().GetStakeMinConfirmations()-1), (int)(nHeight / 2));
-
-        nTipTime = chainActive.Tip()->nTime;
-        rCoinYearReward = Params().GetCoinYearReward(nTipTime) / CENT;
-        nMoneySupply = chainActive.Tip()->nMoneySupply;
-
-        pwallet->AvailableCoins(vecOutputs, !include_unsafe, nullptr, nMinimumAmount, nMaximumAmount, nMinimumSumAmount, nMaximumCount, nMinDepth, nMaxDepth, fIncludeImmature);
-
-        for (const auto &out : vecOutputs) {
-            const CScript *scriptPubKey = out.tx->tx->vpout[out.i]->GetPScriptPubKey();
-            CAmount nValue = out.tx->tx->vpout[out.i]->GetValue();
-
-            if (scriptPubKey->IsPayToPublicKeyHash() || scriptPubKey->IsPayToPublicKeyHash256()) {
-                if (!out.fSpendable) {
-                    continue;
-                }
-                nStakeable += nValue;
-            } else
-            if (scriptPubKey->IsPayToPublicKeyHash256_CS() || scriptPubKey->IsPayToScriptHash256_CS() || scriptPubKey->IsPayToScriptHash_CS()) {
-                // Show output on both the spending and staking wallets
-                if (!out.fSpendable) {
-                    if (!ExtractStakingKeyID(*scriptPubKey, keyID)
-                        || !pwallet->HaveKey(keyID)) {
-                        continue;
-                    }
-                }
-                nColdStakeable += nValue;
-
-            } else {
-                continue;
-            }
-
-            if (out.nDepth < nRequiredDepth) {
-                continue;
-            }
+    // Polled by staking dashboards, read the published tip and sums instead of queueing on cs_main
+    std::shared_ptr<const CChainStatus> status = GetChainStatus();
+    if (!status || !status->pindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "No blocks connected");
+    }
+    std::shared_ptr<const CHDWalletStakingSums> sums = pwallet->GetStakingSumsSnapshot();
 
-            if (!ExtractStakingKeyID(*scriptPubKey, keyID)) {
-                continue;
-            }
-            if (pwallet->HaveKey(keyID)) {
-                nWalletStaking += nValue;
-            }
+    int64_t nTipTime = status->nTime;
+    float rCoinYearReward = Params().GetCoinYearReward(nTipTime) / CENT;
+    CAmount nMoneySupply = status->nMoneySupply;
 
-            if (scriptPubKey->IsPayToPublicKeyHash256_CS() || scriptPubKey->IsPayToScriptHash256_CS() || scriptPubKey->IsPayToScriptHash_CS()) {
-                nColdStakingWeight += nValue;
-            }
-        }
-    }
+    CAmount nStakeable = sums->nStakeable;
+    CAmount nColdStakeable = sums->nColdStakeable;
+    CAmount nColdStakingWeight = sums->nColdStakingWeight;
 
     UniValue jsonSettings;
     std::string addrColdStaking;
@@ -4066,7 +4530,7 @@ static UniValue getstakinginfo(const JSONRPCRequest &request)
     obj.pushKV("currentblocktx", (uint64_t)nLastBlockTx);
     obj.pushKV("pooledtx", (uint64_t)mempool.size());
 
-    obj.pushKV("difficulty", GetDifficulty(chainActive.Tip()));
+    obj.pushKV("difficulty", GetDifficulty(status->pindex));
     obj.pushKV("lastsearchtime", (uint64_t)pwallet->nLastCoinStakeSearchTime);
 
     obj.pushKV("amount_in_stakeable_script", ValueFromAmount(nStakeable));
@@ -4091,6 +4555,101 @@ static UniValue getstakinginfo(const JSONRPCRequest &request)
     return obj;
 }
 
+static UniValue ColdStakeSumToJSON(const CHDWallet::CColdStakeSum &sum)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("count", (uint64_t)sum.nCount);
+    obj.pushKV("amount", ValueFromAmount(sum.nValue));
+    return obj;
+}
+
+static UniValue listcoldstakedelegations(const JSONRPCRequest &request)
+{
+    std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
+    CHDWallet *const pwallet = GetBitcoinCWallet(wallet.get());
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp))
+        return NullUniValue;
+
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "listcoldstakedelegations ( \"address\" )\n"
+            "Returns the unspent coldstake outputs in the wallet, summed per role and per address.\n"
+            "Outputs are \"delegated\" when the wallet owns the spend key, \"staking\" when it owns the stake key.\n"
+            "\nArguments:\n"
+            "1. \"address\"          (string, optional) Only sum the outputs with this stake or spend address.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"total\": {\"count\": n, \"amount\": x.xxx},       (object) All coldstake outputs in the wallet\n"
+            "  \"delegated\": {\"count\": n, \"amount\": x.xxx},   (object) Outputs with the spend key in the wallet\n"
+            "  \"staking\": {\"count\": n, \"amount\": x.xxx},     (object) Outputs with the stake key in the wallet\n"
+            "  \"stakers\": [                    (array) The delegated outputs per stake address\n"
+            "    {\"count\": n, \"amount\": x.xxx, \"address\": \"str\"}, ...\n"
+            "  ],\n"
+            "  \"delegators\": [                 (array) The staking outputs per spend address\n"
+            "    {\"count\": n, \"amount\": x.xxx, \"address\": \"str\"}, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nResult with address:\n"
+            "{\n"
+            "  \"as_staker\": {\"count\": n, \"amount\": x.xxx},   (object) Outputs with address as stake address\n"
+            "  \"as_spender\": {\"count\": n, \"amount\": x.xxx},  (object) Outputs with address as spend address\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("listcoldstakedelegations", "")
+            + HelpExampleCli("listcoldstakedelegations", "\"address\"")
+            + HelpExampleRpc("listcoldstakedelegations", "\"address\""));
+
+    pwallet->BlockUntilSyncedToCurrentChain();
+
+    UniValue result(UniValue::VOBJ);
+    if (request.params.size() > 0 && !request.params[0].isNull()) {
+        CBitcoinAddress addr(request.params[0].get_str());
+        if (!addr.IsValid()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address.");
+        }
+        CTxDestination dest = addr.Get();
+
+        CHDWallet::CColdStakeSum sumStaker;
+        if (dest.type() == typeid(CKeyID)) {
+            sumStaker = pwallet->GetColdStakeSumByStaker(boost::get<CKeyID>(dest));
+        }
+        result.pushKV("as_staker", ColdStakeSumToJSON(sumStaker));
+        result.pushKV("as_spender", ColdStakeSumToJSON(pwallet->GetColdStakeSumBySpend(GetScriptForDestination(dest))));
+        return result;
+    }
+
+    CHDWallet::CColdStakeSum sumAll, sumDelegated, sumStaking;
+    std::map<CKeyID, CHDWallet::CColdStakeSum> mapByStaker;
+    std::map<CScript, CHDWallet::CColdStakeSum> mapBySpend;
+    pwallet->GetColdStakeSums(sumAll, sumDelegated, sumStaking);
+    pwallet->GetColdStakeDelegations(mapByStaker, mapBySpend);
+
+    result.pushKV("total", ColdStakeSumToJSON(sumAll));
+    result.pushKV("delegated", ColdStakeSumToJSON(sumDelegated));
+    result.pushKV("staking", ColdStakeSumToJSON(sumStaking));
+
+    UniValue stakers(UniValue::VARR);
+    stakers.reserve(mapByStaker.size());
+    for (const auto &ms : mapByStaker) {
+        UniValue entry = ColdStakeSumToJSON(ms.second);
+        entry.pushKVEnd("address", CBitcoinAddress(ms.first).ToString());
+        stakers.push_back(std::move(entry));
+    }
+    result.pushKV("stakers", std::move(stakers));
+
+    UniValue delegators(UniValue::VARR);
+    delegators.reserve(mapBySpend.size());
+    for (const auto &ms : mapBySpend) {
+        CTxDestination dest;
+        UniValue entry = ColdStakeSumToJSON(ms.second);
+        entry.pushKVEnd("address", ExtractDestination(ms.first, dest) ? CBitcoinAddress(dest).ToString() : HexStr(ms.first.begin(), ms.first.end()));
+        delegators.push_back(std::move(entry));
+    }
+    result.pushKV("delegators", std::move(delegators));
+
+    return result;
+}
+
 static UniValue listunspent(const JSONRPCRequest &request)
 {
     std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
@@ -4311,6 +4870,171 @@ static int AddOutput(uint8_t nType, std::vector<CTempRecipient> &vecSend, const
     return 0;
 };
 
+static void ParseSendOutput(CHDWallet *pwallet, const UniValue &obj, OutputTypes typeIn, OutputTypes typeOut,
+    std::vector<CTempRecipient> &vecSend, CAmount &nTotal)
+{
+    std::string sAddress;
+    CAmount nAmount;
+
+    if (obj.exists("address")) {
+        sAddress = obj["address"].get_str();
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Must provide an address.");
+    }
+
+    CBitcoinAddress address(sAddress);
+
+    if (typeOut == OUTPUT_RINGCT
+        && !address.IsValidStealthAddress()) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid spending address");
+    }
+
+    if (typeOut == OUTPUT_STANDARD
+        && sAddress != "script"
+        && !address.IsValid(CChainParams::PUBKEY_ADDRESS)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid stake address");
+    }
+
+    if (!obj.exists("script") && !address.IsValid()) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid BitcoinC address");
+    }
+
+    if (address.getVchVersion() == Params().Bech32Prefix(CChainParams::STAKE_ONLY_PKADDR)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Can't send to stake-only address version.");
+    }
+
+    if (obj.exists("amount")) {
+        nAmount = AmountFromValue(obj["amount"]);
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Must provide an amount.");
+    }
+
+    if (nAmount <= 0) {
+        throw JSONRPCError(RPC_TYPE_ERROR, "Invalid amount");
+    }
+    nTotal += nAmount;
+
+    bool fSubtractFeeFromAmount = false;
+    if (obj.exists("subfee")) {
+        fSubtractFeeFromAmount = obj["subfee"].get_bool();
+    }
+
+    {
+        LOCK(pwallet->cs_wallet);
+        CStealthAddress stealthAddress;
+        if( !(typeIn == OUTPUT_RINGCT && typeOut == OUTPUT_RINGCT) &&
+            address.IsValidStealthAddress() &&
+            ( !stealthAddress.SetEncoded(sAddress) || !pwallet->HaveStealthAddress(stealthAddress))){
+            throw JSONRPCError(RPC_TYPE_ERROR, "All stealth addresses must be from your wallet.");
+        }
+    }
+
+    std::string sNarr;
+    if (obj.exists("narr")) {
+        sNarr = obj["narr"].get_str();
+    }
+
+    std::string sError;
+    if (0 != AddOutput(typeOut, vecSend, address.Get(), nAmount, fSubtractFeeFromAmount, sNarr, sError)) {
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("AddOutput failed: %s.", sError));
+    }
+
+    if (obj.exists("script")) {
+        CTempRecipient &r = vecSend.back();
+
+        if (sAddress != "script") {
+            JSONRPCError(RPC_INVALID_PARAMETER, "Address parameter must be 'script' to set script explicitly.");
+        }
+
+        std::string sScript = obj["script"].get_str();
+        std::vector<uint8_t> scriptData = ParseHex(sScript);
+        r.scriptPubKey = CScript(scriptData.begin(), scriptData.end());
+        r.fScriptSet = true;
+
+        if (typeOut != OUTPUT_STANDARD) {
+            throw std::runtime_error("TODO: Currently setting a script only works for standard outputs.");
+        }
+    }
+};
+
+static void ParseCoinControl(const UniValue &uvCoinControl, CCoinControl &coincontrol, bool &fShowHex, bool &fShowFee)
+{
+    if (uvCoinControl.exists("changeaddress")) {
+        std::string sChangeAddress = uvCoinControl["changeaddress"].get_str();
+
+        // Check for script
+        bool fHaveScript = false;
+        if (IsHex(sChangeAddress)) {
+            std::vector<uint8_t> vScript = ParseHex(sChangeAddress);
+            CScript script(vScript.begin(), vScript.end());
+
+            txnouttype whichType;
+            if (IsStandard(script, whichType)) {
+                coincontrol.scriptChange = script;
+                fHaveScript = true;
+            }
+        }
+
+        if (!fHaveScript) {
+            CBitcoinAddress addrChange(sChangeAddress);
+            coincontrol.destChange = addrChange.Get();
+        }
+    }
+
+    const UniValue &uvInputs = uvCoinControl["inputs"];
+    if (uvInputs.isArray()) {
+        for (size_t i = 0; i < uvInputs.size(); ++i) {
+            const UniValue &uvi = uvInputs[i];
+            RPCTypeCheckObj(uvi,
+            {
+                {"tx", UniValueType(UniValue::VSTR)},
+                {"n", UniValueType(UniValue::VNUM)},
+            });
+
+            COutPoint op(uint256S(uvi["tx"].get_str()), uvi["n"].get_int());
+            coincontrol.setSelected.insert(op);
+        }
+    }
+
+    if (uvCoinControl.exists("feeRate") && uvCoinControl.exists("estimate_mode")) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot specify both estimate_mode and feeRate");
+    }
+    if (uvCoinControl.exists("feeRate") && uvCoinControl.exists("conf_target")) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot specify both conf_target and feeRate");
+    }
+
+    if (uvCoinControl.exists("replaceable")) {
+        if (!uvCoinControl["replaceable"].isBool())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Replaceable parameter must be boolean.");
+        coincontrol.m_signal_bip125_rbf = uvCoinControl["replaceable"].get_bool();
+    }
+
+    if (uvCoinControl.exists("conf_target")) {
+        if (!uvCoinControl["conf_target"].isNum())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "conf_target parameter must be numeric.");
+        coincontrol.m_confirm_target = ParseConfirmTarget(uvCoinControl["conf_target"]);
+    }
+
+    if (uvCoinControl.exists("estimate_mode")) {
+        if (!uvCoinControl["estimate_mode"].isStr())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "estimate_mode parameter must be a string.");
+        if (!FeeModeFromString(uvCoinControl["estimate_mode"].get_str(), coincontrol.m_fee_mode))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid estimate_mode parameter");
+    }
+
+    if (uvCoinControl.exists("feeRate")) {
+        coincontrol.m_feerate = CFeeRate(AmountFromValue(uvCoinControl["feeRate"]));
+        coincontrol.fOverrideFeeRate = true;
+    }
+
+    if (uvCoinControl["debug"].isBool() && uvCoinControl["debug"].get_bool() == true) {
+        fShowHex = true;
+    }
+    if (uvCoinControl["show_fee"].isBool() && uvCoinControl["show_fee"].get_bool() == true) {
+        fShowFee = true;
+    }
+};
+
 static UniValue SendToInner(const JSONRPCRequest &request, OutputTypes typeIn, OutputTypes typeOut)
 {
     std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
@@ -4352,89 +5076,7 @@ static UniValue SendToInner(const JSONRPCRequest &request, OutputTypes typeIn, O
             if (!outputs[k].isObject()) {
                 throw JSONRPCError(RPC_TYPE_ERROR, "Not an object");
             }
-            const UniValue &obj = outputs[k].get_obj();
-
-            std::string sAddress;
-            CAmount nAmount;
-
-            if (obj.exists("address")) {
-                sAddress = obj["address"].get_str();
-            } else {
-                throw JSONRPCError(RPC_INVALID_PARAMETER, "Must provide an address.");
-            }
-
-            CBitcoinAddress address(sAddress);
-
-            if (typeOut == OUTPUT_RINGCT
-                && !address.IsValidStealthAddress()) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid spending address");
-            }
-
-            if (typeOut == OUTPUT_STANDARD
-                && sAddress != "script"
-                && !address.IsValid(CChainParams::PUBKEY_ADDRESS)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid stake address");
-            }
-
-            if (!obj.exists("script") && !address.IsValid()) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid BitcoinC address");
-            }
-
-            if (address.getVchVersion() == Params().Bech32Prefix(CChainParams::STAKE_ONLY_PKADDR)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Can't send to stake-only address version.");
-            }
-
-            if (obj.exists("amount")) {
-                nAmount = AmountFromValue(obj["amount"]);
-            } else {
-                throw JSONRPCError(RPC_INVALID_PARAMETER, "Must provide an amount.");
-            }
-
-            if (nAmount <= 0) {
-                throw JSONRPCError(RPC_TYPE_ERROR, "Invalid amount");
-            }
-            nTotal += nAmount;
-
-            bool fSubtractFeeFromAmount = false;
-            if (obj.exists("subfee")) {
-                fSubtractFeeFromAmount = obj["subfee"].get_bool();
-            }
-
-            {
-                LOCK(pwallet->cs_wallet);
-                CStealthAddress stealthAddress;
-                if( !(typeIn == OUTPUT_RINGCT && typeOut == OUTPUT_RINGCT) &&
-                    address.IsValidStealthAddress() &&
-                    ( !stealthAddress.SetEncoded(sAddress) || !pwallet->HaveStealthAddress(stealthAddress))){
-                    throw JSONRPCError(RPC_TYPE_ERROR, "All stealth addresses must be from your wallet.");
-                }
-            }
-
-            std::string sNarr;
-            if (obj.exists("narr")) {
-                sNarr = obj["narr"].get_str();
-            }
-
-            if (0 != AddOutput(typeOut, vecSend, address.Get(), nAmount, fSubtractFeeFromAmount, sNarr, sError)) {
-                throw JSONRPCError(RPC_MISC_ERROR, strprintf("AddOutput failed: %s.", sError));
-            }
-
-            if (obj.exists("script")) {
-                CTempRecipient &r = vecSend.back();
-
-                if (sAddress != "script") {
-                    JSONRPCError(RPC_INVALID_PARAMETER, "Address parameter must be 'script' to set script explicitly.");
-                }
-
-                std::string sScript = obj["script"].get_str();
-                std::vector<uint8_t> scriptData = ParseHex(sScript);
-                r.scriptPubKey = CScript(scriptData.begin(), scriptData.end());
-                r.fScriptSet = true;
-
-                if (typeOut != OUTPUT_STANDARD) {
-                    throw std::runtime_error("TODO: Currently setting a script only works for standard outputs.");
-                }
-            }
+            ParseSendOutput(pwallet, outputs[k].get_obj(), typeIn, typeOut, vecSend, nTotal);
         }
         nCommentOfs = 1;
         nRingSizeOfs = 3;
@@ -4558,82 +5200,7 @@ static UniValue SendToInner(const JSONRPCRequest &request, OutputTypes typeIn, O
     nv = nCoinControlOfs;
     if (request.params.size() > nv
         && request.params[nv].isObject()) {
-        const UniValue &uvCoinControl = request.params[nv].get_obj();
-
-        if (uvCoinControl.exists("changeaddress")) {
-            std::string sChangeAddress = uvCoinControl["changeaddress"].get_str();
-
-            // Check for script
-            bool fHaveScript = false;
-            if (IsHex(sChangeAddress)) {
-                std::vector<uint8_t> vScript = ParseHex(sChangeAddress);
-                CScript script(vScript.begin(), vScript.end());
-
-                txnouttype whichType;
-                if (IsStandard(script, whichType)) {
-                    coincontrol.scriptChange = script;
-                    fHaveScript = true;
-                }
-            }
-
-            if (!fHaveScript) {
-                CBitcoinAddress addrChange(sChangeAddress);
-                coincontrol.destChange = addrChange.Get();
-            }
-        }
-
-        const UniValue &uvInputs = uvCoinControl["inputs"];
-        if (uvInputs.isArray()) {
-            for (size_t i = 0; i < uvInputs.size(); ++i) {
-                const UniValue &uvi = uvInputs[i];
-                RPCTypeCheckObj(uvi,
-                {
-                    {"tx", UniValueType(UniValue::VSTR)},
-                    {"n", UniValueType(UniValue::VNUM)},
-                });
-
-                COutPoint op(uint256S(uvi["tx"].get_str()), uvi["n"].get_int());
-                coincontrol.setSelected.insert(op);
-            }
-        }
-
-        if (uvCoinControl.exists("feeRate") && uvCoinControl.exists("estimate_mode")) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot specify both estimate_mode and feeRate");
-        }
-        if (uvCoinControl.exists("feeRate") && uvCoinControl.exists("conf_target")) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot specify both conf_target and feeRate");
-        }
-
-        if (uvCoinControl.exists("replaceable")) {
-            if (!uvCoinControl["replaceable"].isBool())
-                throw JSONRPCError(RPC_INVALID_PARAMETER, "Replaceable parameter must be boolean.");
-            coincontrol.m_signal_bip125_rbf = uvCoinControl["replaceable"].get_bool();
-        }
-
-        if (uvCoinControl.exists("conf_target")) {
-            if (!uvCoinControl["conf_target"].isNum())
-                throw JSONRPCError(RPC_INVALID_PARAMETER, "conf_target parameter must be numeric.");
-            coincontrol.m_confirm_target = ParseConfirmTarget(uvCoinControl["conf_target"]);
-        }
-
-        if (uvCoinControl.exists("estimate_mode")) {
-            if (!uvCoinControl["estimate_mode"].isStr())
-                throw JSONRPCError(RPC_INVALID_PARAMETER, "estimate_mode parameter must be a string.");
-            if (!FeeModeFromString(uvCoinControl["estimate_mode"].get_str(), coincontrol.m_fee_mode))
-                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid estimate_mode parameter");
-        }
-
-        if (uvCoinControl.exists("feeRate")) {
-            coincontrol.m_feerate = CFeeRate(AmountFromValue(uvCoinControl["feeRate"]));
-            coincontrol.fOverrideFeeRate = true;
-        }
-
-        if (uvCoinControl["debug"].isBool() && uvCoinControl["debug"].get_bool() == true) {
-            fShowHex = true;
-        }
-        if (uvCoinControl["show_fee"].isBool() && uvCoinControl["show_fee"].get_bool() == true) {
-            fShowFee = true;
-        }
+        ParseCoinControl(request.params[nv].get_obj(), coincontrol, fShowHex, fShowFee);
     }
 
 
@@ -4909,6 +5476,281 @@ UniValue sendtypeto(const JSONRPCRequest &request)
     return SendToInner(req, typeIn, typeOut);
 };
 
+//! Recipients per transaction of a sendtypetomany batch, a range proof makes an anon output far larger
+static const size_t DEFAULT_BATCH_OUTPUTS_STANDARD = 250;
+static const size_t DEFAULT_BATCH_OUTPUTS_RINGCT = 30;
+
+/** A transaction of a sendtypetomany batch, built and signed before any of the batch is committed */
+struct CBatchSendTx
+{
+    explicit CBatchSendTx(CWallet *pwallet) : wtx(pwallet, nullptr) {};
+
+    CWalletTx wtx;
+    CTransactionRecord rtx;
+    std::vector<CTempRecipient> vecSend;
+    CAmount nFee = 0;
+};
+
+// The wallet outputs tx spends, anon inputs are found from their key images
+static void GetSpentOutpoints(CHDWallet *pwallet, const CTransaction &tx, std::vector<COutPoint> &vSpent)
+{
+    CHDWalletDB wdb(pwallet->GetDBHandle(), "r");
+    for (const auto &txin : tx.vin) {
+        if (!txin.IsAnonInput()) {
+            vSpent.push_back(txin.prevout);
+            continue;
+        }
+        uint32_t nInputs, nRingSize;
+        txin.GetAnonInfo(nInputs, nRingSize);
+        const std::vector<uint8_t> &vKeyImages = txin.scriptData.stack[0];
+        for (size_t k = 0; k < nInputs && (k+1) * 33 <= vKeyImages.size(); ++k) {
+            const CCmpPubKey &ki = *((CCmpPubKey*)&vKeyImages[k*33]);
+            COutPoint op;
+            if (wdb.ReadAnonKeyImage(ki, op)) {
+                vSpent.push_back(op);
+            }
+        }
+    }
+};
+
+static UniValue sendtypetomany(const JSONRPCRequest &request)
+{
+    std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
+    CHDWallet *const pwallet = GetBitcoinCWallet(wallet.get());
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp))
+        return NullUniValue;
+    if (request.fHelp || request.params.size() < 3 || request.params.size() > 4)
+        throw std::runtime_error(
+            "sendtypetomany \"typein\" \"typeout\" [{address: , amount: , narr: , subfee:},...] ( options )\n"
+            "\nPay many recipients from one call, split over as many transactions as needed.\n"
+            "All transactions are built and signed before the first is committed, coins spent by one are never\n"
+            "selected for another. The transactions are then committed together.\n"
+            + HelpRequiringPassphrase(pwallet) +
+            "\nArguments:\n"
+            "1. \"typein\"          (string, required) spending/staking\n"
+            "2. \"typeout\"         (string, required) spending/staking\n"
+            "3. \"outputs\"         (json, required) Array of output objects, as for sendtypeto\n"
+            "4. options           (json, optional)\n"
+            "   {\n"
+            "     \"max_outputs\":     (numeric, optional) Recipients per transaction,\n"
+            "                        default " + std::to_string(DEFAULT_BATCH_OUTPUTS_STANDARD) + " to staking and " + std::to_string(DEFAULT_BATCH_OUTPUTS_RINGCT) + " to spending addresses.\n"
+            "     \"comment\":         (string, optional) A comment stored with each transaction.\n"
+            "     \"comment_to\":      (string, optional) A comment to store the name of the recipient.\n"
+            "     \"ringsize\":        (numeric, optional, default=4) Only applies when typein is spending.\n"
+            "     \"inputs_per_sig\":  (numeric, optional, default=32) Only applies when typein is spending.\n"
+            "     \"test_fee\":        (boolean, optional, default=false) Only return the fees, the transactions are discarded.\n"
+            "     \"coin_control\":    (json, optional) Coincontrol object as for sendtypeto, applied to every transaction.\n"
+            "   }\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txids\": [\"txid\",...], (array) The transactions committed, in recipient order.\n"
+            "  \"fee\": n,              (numeric) The fee paid over all transactions.\n"
+            "  \"bytes\": n,            (numeric) The size of all transactions.\n"
+            "  \"errors\": [...],       (array) Present if a transaction failed to commit, those after it are discarded.\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendtypetomany", "staking staking \"[{\\\"address\\\":\\\"bbgpWMXWA5J2zq4oyHae3DocYG4nKBdeU3\\\",\\\"amount\\\":0.1}]\" \"{\\\"max_outputs\\\":100}\""));
+
+    std::string sTypeIn = request.params[0].get_str();
+    std::string sTypeOut = request.params[1].get_str();
+
+    OutputTypes typeIn = WordToType(sTypeIn);
+    OutputTypes typeOut = WordToType(sTypeOut);
+
+    if (typeIn == OUTPUT_NULL)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown input type.");
+    if (typeOut == OUTPUT_NULL)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown output type.");
+
+    const UniValue &outputs = request.params[2].get_array();
+    if (outputs.empty()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "No outputs.");
+    }
+
+    size_t nMaxOutputs = typeOut == OUTPUT_RINGCT ? DEFAULT_BATCH_OUTPUTS_RINGCT : DEFAULT_BATCH_OUTPUTS_STANDARD;
+    std::string sComment, sCommentTo;
+    size_t nRingSize = DEFAULT_RING_SIZE;
+    size_t nInputsPerSig = DEFAULT_INPUTS_PER_SIG;
+    bool fCheckFeeOnly = false, fShowHex = false, fShowFee = false;
+    CCoinControl coincontrol;
+    if (request.params.size() > 3 && !request.params[3].isNull()) {
+        const UniValue &options = request.params[3].get_obj();
+        RPCTypeCheckObj(options,
+            {
+                {"max_outputs", UniValueType(UniValue::VNUM)},
+                {"comment", UniValueType(UniValue::VSTR)},
+                {"comment_to", UniValueType(UniValue::VSTR)},
+                {"ringsize", UniValueType(UniValue::VNUM)},
+                {"inputs_per_sig", UniValueType(UniValue::VNUM)},
+                {"test_fee", UniValueType(UniValue::VBOOL)},
+                {"coin_control", UniValueType(UniValue::VOBJ)},
+            }, true, true);
+        if (options.exists("max_outputs")) {
+            int n = options["max_outputs"].get_int();
+            if (n < 1) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "max_outputs must be positive.");
+            }
+            nMaxOutputs = n;
+        }
+        if (options.exists("comment")) {
+            sComment = options["comment"].get_str();
+            part::TrimQuotes(sComment);
+        }
+        if (options.exists("comment_to")) {
+            sCommentTo = options["comment_to"].get_str();
+            part::TrimQuotes(sCommentTo);
+        }
+        if (options.exists("ringsize")) {
+            nRingSize = options["ringsize"].get_int();
+        }
+        if (options.exists("inputs_per_sig")) {
+            nInputsPerSig = options["inputs_per_sig"].get_int();
+        }
+        if (options.exists("test_fee")) {
+            fCheckFeeOnly = options["test_fee"].get_bool();
+        }
+        if (options.exists("coin_control")) {
+            ParseCoinControl(options["coin_control"].get_obj(), coincontrol, fShowHex, fShowFee);
+        }
+    }
+
+    // Make sure the results are valid at least up to the most recent block
+    // the user could have gotten from another RPC command prior to now
+    if (!request.fSkipBlock) {
+        pwallet->BlockUntilSyncedToCurrentChain();
+    }
+
+    EnsureWalletIsUnlocked(pwallet);
+
+    if (pwallet->GetBroadcastTransactions() && !g_connman) {
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+    }
+
+    CAmount nTotal = 0;
+    std::vector<CTempRecipient> vecAll;
+    for (size_t k = 0; k < outputs.size(); ++k) {
+        if (!outputs[k].isObject()) {
+            throw JSONRPCError(RPC_TYPE_ERROR, "Not an object");
+        }
+        ParseSendOutput(pwallet, outputs[k].get_obj(), typeIn, typeOut, vecAll, nTotal);
+    }
+
+    LOCK2(cs_main, pwallet->cs_wallet);
+
+    switch (typeIn) {
+        case OUTPUT_STANDARD:
+            if (nTotal > pwallet->GetBalance()) {
+                throw JSONRPCError(RPC_WALLET_INSUFFICIENT_FUNDS, "Insufficient staking funds");
+            }
+            break;
+        case OUTPUT_RINGCT:
+            if (nTotal > pwallet->GetAnonBalance()) {
+                throw JSONRPCError(RPC_WALLET_INSUFFICIENT_FUNDS, "Insufficient spendable funds");
+            }
+            break;
+        default:
+            throw JSONRPCError(RPC_WALLET_ERROR, strprintf("Unknown input type: %d.", typeIn));
+    }
+
+    // The inputs of each built transaction are locked until the batch is committed or discarded,
+    // so the next transaction selects other coins
+    std::vector<COutPoint> vBatchLocked;
+    auto unlock_batch = [&]() {
+        for (const auto &op : vBatchLocked) {
+            pwallet->UnlockCoin(op);
+        }
+        vBatchLocked.clear();
+    };
+
+    std::vector<std::unique_ptr<CBatchSendTx> > vBatch;
+    CAmount nFeeTotal = 0;
+    int64_t nBytesTotal = 0;
+    std::string sError;
+    for (size_t nBegin = 0; nBegin < vecAll.size(); nBegin += nMaxOutputs) {
+        size_t nEnd = std::min(vecAll.size(), nBegin + nMaxOutputs);
+        vBatch.emplace_back(MakeUnique<CBatchSendTx>(pwallet));
+        CBatchSendTx &btx = *vBatch.back();
+        btx.vecSend.assign(vecAll.begin() + nBegin, vecAll.begin() + nEnd);
+
+        if (!sComment.empty()) {
+            btx.wtx.mapValue["comment"] = sComment;
+            btx.rtx.mapValue[RTXVT_COMMENT] = std::vector<uint8_t>(sComment.begin(), sComment.end());
+        }
+        if (!sCommentTo.empty()) {
+            btx.wtx.mapValue["to"] = sCommentTo;
+            btx.rtx.mapValue[RTXVT_TO] = std::vector<uint8_t>(sCommentTo.begin(), sCommentTo.end());
+        }
+
+        CCoinControl cctx = coincontrol;
+        int rv = typeIn == OUTPUT_STANDARD
+            ? pwallet->AddStandardInputs(btx.wtx, btx.rtx, btx.vecSend, !fCheckFeeOnly, btx.nFee, &cctx, sError)
+            : pwallet->AddSpendingInputs(btx.wtx, btx.rtx, btx.vecSend, !fCheckFeeOnly, nRingSize, nInputsPerSig, btx.nFee, &cctx, sError);
+        if (0 != rv) {
+            unlock_batch();
+            throw JSONRPCError(RPC_WALLET_ERROR, strprintf("Transaction %d of the batch failed: %s.", vBatch.size(), sError));
+        }
+        nFeeTotal += btx.nFee;
+        nBytesTotal += GetVirtualTransactionSize(*btx.wtx.tx);
+
+        std::vector<COutPoint> vSpent;
+        GetSpentOutpoints(pwallet, *btx.wtx.tx, vSpent);
+        for (const auto &op : vSpent) {
+            if (!pwallet->IsLockedCoin(op.hash, op.n)) {
+                pwallet->LockCoin(op);
+                vBatchLocked.push_back(op);
+            }
+        }
+    }
+    unlock_batch();
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("fee", ValueFromAmount(nFeeTotal));
+    result.pushKV("bytes", nBytesTotal);
+    if (fCheckFeeOnly) {
+        result.pushKV("transactions", (int)vBatch.size());
+        return result;
+    }
+
+    // Writes of all the commits share one wallet db handle
+    UniValue txids(UniValue::VARR), errors(UniValue::VARR);
+    pwallet->BeginBlockBatch();
+    for (size_t i = 0; i < vBatch.size(); ++i) {
+        CBatchSendTx &btx = *vBatch[i];
+
+        // Store sent narrations
+        for (const auto &r : btx.vecSend) {
+            if (r.nType != OUTPUT_STANDARD
+                || r.sNarration.size() < 1)
+                continue;
+            std::string sKey = strprintf("n%d", r.n);
+            btx.wtx.mapValue[sKey] = r.sNarration;
+        }
+
+        CValidationState state;
+        CReserveKey reservekey(pwallet);
+        bool fCommitted;
+        if (typeIn == OUTPUT_STANDARD && typeOut == OUTPUT_STANDARD) {
+            std::string sFromAccount = "";
+            fCommitted = pwallet->CommitTransaction(btx.wtx.tx, btx.wtx.mapValue, btx.wtx.vOrderForm, sFromAccount, reservekey, g_connman.get(), state);
+        } else {
+            fCommitted = pwallet->CommitTransaction(btx.wtx, btx.rtx, reservekey, g_connman.get(), state);
+        }
+        if (!fCommitted) {
+            errors.push_back(strprintf("Transaction %d commit failed: %s", i + 1, FormatStateMessage(state)));
+            break;
+        }
+        pwallet->PostProcessTempRecipients(btx.vecSend);
+        txids.push_back(btx.wtx.GetHash().GetHex());
+    }
+    pwallet->EndBlockBatch();
+
+    result.pushKV("txids", txids);
+    if (!errors.empty()) {
+        result.pushKV("errors", errors);
+    }
+    return result;
+};
+
 
 static UniValue createsignatureinner(const JSONRPCRequest &request, CHDWallet *const pwallet)
 {
@@ -7072,12 +7914,15 @@ static const CRPCCommand commands[] =
     { "wallet",             "reservebalance",                   &reservebalance,                {"enabled","amount"} },
     { "wallet",             "deriverangekeys",                  &deriverangekeys,               {"start","end","key/id","hardened","save","add_to_addressbook","256bithash"} },
     { "wallet",             "clearwallettransactions",          &clearwallettransactions,       {"remove_all"} },
+    { "wallet",             "compactwallet",                    &compactwallet,                 {"stake_depth","trim_depth"} },
 
     { "wallet",             "filtertransactions",               &filtertransactions,            {"options"} },
     { "wallet",             "filteraddresses",                  &filteraddresses,               {"offset","count","sort_code"} },
     { "wallet",             "manageaddressbook",                &manageaddressbook,             {"action","address","label","purpose"} },
 
+    { "wallet",             "getbalances",                      &getbalances,                   {} },
     { "wallet",             "getstakinginfo",                   &getstakinginfo,                {} },
+    { "wallet",             "listcoldstakedelegations",         &listcoldstakedelegations,      {"address"} },
 
     { "wallet",             "listunspent",                      &listunspent,                   {"minconf","maxconf","addresses","include_unsafe","query_options"} },
 
@@ -7087,6 +7932,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "sendspending",                     &sendspending,                  {"address","amount","comment","comment_to","subtractfeefromamount","narration","ringsize","inputs_per_sig"} },
 
     { "wallet",             "sendtypeto",                       &sendtypeto,                    {"typein","typeout","outputs","comment","comment_to","ringsize","inputs_per_sig","test_fee","coincontrol"} },
+    { "wallet",             "sendtypetomany",                   &sendtypetomany,                {"typein","typeout","outputs","options"} },
 
     { "wallet",             "createsignaturewithwallet",        &createsignaturewithwallet,     {"hexstring","prevtx","address","sighashtype"} },
     { "rawtransactions",    "createsignaturewithkey",           &createsignaturewithkey,        {"hexstring","prevtx","privkey","sighashtype"} },
@@ -2489,7 +2489,9 @@ UniValue listtransactions(const JSONRPCRequest& request)
         LOCK2(cs_main, pwallet->cs_wallet);
 
         CHDWallet *phdw = GetBitcoinCWallet(pwallet);
-        const RtxOrdered_t &txOrdered = phdw->rtxOrdered;
+        MapRecords_t mapArchived;
+        RtxOrdered_t rtxMerged;
+        const RtxOrdered_t &txOrdered = phdw->GetRecordsOrdered(mapArchived, rtxMerged);
 
         // TODO: Combine finding and inserting into ret loops
 
@@ -3071,6 +3073,7 @@ static UniValue walletpassphrase(const JSONRPCRequest& request)
             "Issuing the walletpassphrase command while the wallet is already unlocked will set a new unlock\n"
             "time that overrides the old one.\n"
             "If [stakingonly] is true and <timeout> is 0, the wallet will remain unlocked for staking until manually locked again.\n"
+            "Outputs received while the wallet was locked are added in the background once it's unlocked.\n"
             "\nExamples:\n"
             "\nUnlock the wallet for 60 seconds\n"
             + HelpExampleCli("walletpassphrase", "\"my pass phrase\" 60") +
@@ -0,0 +1,130 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/scancache.h>
+
+#include <sync.h>
+#include <wallet/wallet.h>
+
+#include <list>
+#include <string.h>
+#include <unordered_map>
+
+void FillScanOutput(const CTxOutBase *txout, const CTxOutData *pdata, CScanOutput &so)
+{
+    so.nType = txout->GetType();
+
+    if (txout->IsType(OUTPUT_RINGCT)) {
+        const CTxOutRingCT *rctout = (const CTxOutRingCT*)txout;
+        const std::vector<uint8_t> &vData = rctout->vData;
+        so.dest = rctout->pk.GetID();
+        if (vData.size() == 33) {
+            so.fStealth = true;
+        } else
+        if (vData.size() == 38 // Have prefix
+            && vData[33] == DO_STEALTH_PREFIX) {
+            so.fStealth = true;
+            so.fHavePrefix = true;
+            memcpy(&so.nPrefix, &vData[34], 4);
+        }
+        if (so.fStealth) {
+            so.vchEphemPK.assign(vData.begin(), vData.begin() + 33);
+        }
+        return;
+    }
+
+    if (!txout->IsStandardOutput() || !pdata) {
+        return;
+    }
+    const std::vector<uint8_t> &vData = pdata->vData;
+    if (vData.size() < 34 || vData[0] != DO_STEALTH) {
+        return;
+    }
+    so.fStealth = true;
+    so.vchEphemPK.assign(vData.begin() + 1, vData.begin() + 34);
+    if (vData.size() >= 34 + 5
+        && vData[34] == DO_STEALTH_PREFIX) {
+        so.fHavePrefix = true;
+        memcpy(&so.nPrefix, &vData[35], 4);
+    }
+    if (!ExtractDestination(*txout->GetPScriptPubKey(), so.dest)) {
+        so.dest = CNoDestination();
+    }
+};
+
+CWalletScanTx::CWalletScanTx(const CTransaction &tx)
+{
+    for (size_t i = 0; i < tx.vpout.size(); ++i) {
+        const CTxOutBase *txout = tx.vpout[i].get();
+        if (!txout->IsType(OUTPUT_STANDARD) && !txout->IsType(OUTPUT_RINGCT)) {
+            continue;
+        }
+
+        // A data output always applies to the preceding output
+        const CTxOutData *pdata = nullptr;
+        if (txout->IsType(OUTPUT_STANDARD)
+            && i + 1 < tx.vpout.size()
+            && tx.vpout[i+1]->IsType(OUTPUT_DATA)) {
+            pdata = (const CTxOutData*)tx.vpout[i+1].get();
+        }
+
+        vOutputs.emplace_back();
+        CScanOutput &so = vOutputs.back();
+        so.n = i;
+        so.nData = pdata ? i + 1 : -1;
+        FillScanOutput(txout, pdata, so);
+
+        if (txout->IsType(OUTPUT_RINGCT)) {
+            nRingCT++;
+        }
+    }
+};
+
+namespace {
+
+struct CheapTxidHasher
+{
+    size_t operator()(const uint256 &txid) const { return txid.GetCheapHash(); };
+};
+
+typedef std::list<std::pair<uint256, std::shared_ptr<const CWalletScanTx> > > ScanTxList;
+
+CCriticalSection cs_scan_cache;
+ScanTxList scan_cache_lru GUARDED_BY(cs_scan_cache); // Most recently used at the front
+std::unordered_map<uint256, ScanTxList::iterator, CheapTxidHasher> scan_cache_map GUARDED_BY(cs_scan_cache);
+
+} // namespace
+
+std::shared_ptr<const CWalletScanTx> GetWalletScanTx(const CTransaction &tx)
+{
+    if (GetWallets().size() < 2) {
+        return std::make_shared<const CWalletScanTx>(tx);
+    }
+
+    const uint256 &txid = tx.GetHash();
+    {
+        LOCK(cs_scan_cache);
+        auto mi = scan_cache_map.find(txid);
+        if (mi != scan_cache_map.end()) {
+            scan_cache_lru.splice(scan_cache_lru.begin(), scan_cache_lru, mi->second);
+            return mi->second->second;
+        }
+    }
+
+    std::shared_ptr<const CWalletScanTx> scan_tx = std::make_shared<const CWalletScanTx>(tx);
+
+    LOCK(cs_scan_cache);
+    auto ret = scan_cache_map.emplace(txid, scan_cache_lru.end());
+    if (!ret.second) {
+        return ret.first->second->second; // Added by another wallet meanwhile
+    }
+    scan_cache_lru.emplace_front(txid, scan_tx);
+    ret.first->second = scan_cache_lru.begin();
+    if (scan_cache_lru.size() > WALLET_SCAN_CACHE_SIZE) {
+        scan_cache_map.erase(scan_cache_lru.back().first);
+        scan_cache_lru.pop_back();
+    }
+
+    return scan_tx;
+};
@@ -0,0 +1,55 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_WALLET_SCANCACHE_H
+#define BITCOINC_WALLET_SCANCACHE_H
+
+#include <key/extkey.h>                // For CTxDestination
+#include <key/stealth.h>               // For CTxDestination
+#include <primitives/transaction.h>
+#include <script/standard.h>
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+//! Number of preprocessed transactions kept for the other loaded wallets, about a full block
+static const size_t WALLET_SCAN_CACHE_SIZE = 4096;
+
+/** An output reduced to what the wallets probe their key and stealth tables with */
+struct CScanOutput
+{
+    int32_t n = -1;                     //!< Index in vpout
+    uint8_t nType = 0;                  //!< OUTPUT_STANDARD or OUTPUT_RINGCT
+    int32_t nData = -1;                 //!< Index of the data output following a standard output
+    CTxDestination dest;                //!< Key id of an anon output, destination of a standard stealth output
+    bool fStealth = false;              //!< vchEphemPK is set
+    bool fHavePrefix = false;
+    uint32_t nPrefix = 0;
+    std::vector<uint8_t> vchEphemPK;
+};
+
+/** Parse an anon output, or a standard output and the data output following it */
+void FillScanOutput(const CTxOutBase *txout, const CTxOutData *pdata, CScanOutput &so);
+
+/**
+ * The standard and anon outputs of a transaction, parsed and hashed once for all loaded wallets.
+ * Each wallet still probes its own key and stealth tables with them.
+ */
+class CWalletScanTx
+{
+public:
+    explicit CWalletScanTx(const CTransaction &tx);
+
+    std::vector<CScanOutput> vOutputs;
+    size_t nRingCT = 0;
+};
+
+/**
+ * Get the preprocessed outputs of tx. With more than one wallet loaded the result is cached,
+ * the wallets processing the same block or mempool transaction after the first reuse it.
+ */
+std::shared_ptr<const CWalletScanTx> GetWalletScanTx(const CTransaction &tx);
+
+#endif // BITCOINC_WALLET_SCANCACHE_H
@@ -254,6 +254,45 @@ BOOST_AUTO_TEST_CASE(bnb_search_test)
     BOOST_CHECK(!coin_selection_params_bnb.use_bnb);
 }
 
+BOOST_AUTO_TEST_CASE(bnb_equal_cost_search_test)
+{
+    std::vector<CAmount> values;
+    std::vector<size_t> selection;
+    CAmount value_ret = 0;
+
+    // Empty pool
+    BOOST_CHECK(!SelectCoinsBnB(values, 0, 1 * CENT, 0.5 * CENT, selection, value_ret));
+
+    values = {5 * CENT, 4 * CENT, 3 * CENT, 2 * CENT, 1 * CENT};
+
+    // Select 5 Cent, the single input beats 3+2 and 4+1
+    BOOST_CHECK(SelectCoinsBnB(values, 1000, 5 * CENT, 0.5 * CENT, selection, value_ret));
+    BOOST_CHECK(selection == std::vector<size_t>({0}));
+    BOOST_CHECK_EQUAL(value_ret, 5 * CENT);
+
+    // Select 7 Cent, two inputs
+    BOOST_CHECK(SelectCoinsBnB(values, 1000, 7 * CENT, 0.5 * CENT, selection, value_ret));
+    BOOST_CHECK_EQUAL(selection.size(), 2U);
+    BOOST_CHECK_EQUAL(value_ret, 7 * CENT);
+
+    // Within cost of change, fewest inputs over least excess
+    BOOST_CHECK(SelectCoinsBnB(values, 1 * CENT, 3.5 * CENT, 1 * CENT, selection, value_ret));
+    BOOST_CHECK(selection == std::vector<size_t>({1}));
+    BOOST_CHECK_EQUAL(value_ret, 4 * CENT);
+
+    // Select 16 Cent, not possible
+    BOOST_CHECK(!SelectCoinsBnB(values, 1000, 16 * CENT, 0.5 * CENT, selection, value_ret));
+
+    // Select 0.25 Cent, no value in range
+    BOOST_CHECK(!SelectCoinsBnB(values, 1000, 0.25 * CENT, 0.5 * CENT, selection, value_ret));
+
+    // Same value early bailout, must not exhaust on many equal values
+    values = {7 * CENT, 7 * CENT, 7 * CENT, 7 * CENT, 2 * CENT};
+    values.insert(values.begin() + 4, 50000, 5 * CENT);
+    BOOST_CHECK(SelectCoinsBnB(values, 1000, 30 * CENT, 5000, selection, value_ret));
+    BOOST_CHECK_EQUAL(value_ret, 30 * CENT);
+}
+
 BOOST_AUTO_TEST_CASE(knapsack_solver_test)
 {
     CoinSet setCoinsRet, setCoinsRet2;
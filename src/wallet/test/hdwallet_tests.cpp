@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <wallet/hdwallet.h>
+#include <wallet/scancache.h>
 
 #include <wallet/test/hdwallet_test_fixture.h>
 #include <base58.h>
@@ -203,6 +204,15 @@ BOOST_AUTO_TEST_CASE(stealth_key_index)
     BOOST_CHECK(pwallet->GetStealthKeyIndex(sxi, sxId));
     BOOST_CHECK(sxId == 1);
 
+    // The index is reloaded from the db into memory
+    BOOST_CHECK(pwallet->LoadStealthAddresses() == 0);
+    BOOST_CHECK(pwallet->GetStealthByIndex(2, sxOut));
+    BOOST_CHECK(sxOut.ToString() == "SPGx7SrLpMcMUjJhQkMp7D8eRAxzVj34StgQdYHr9887nCNBAiUTr4eiJKunzDaBxUqTWGX1sCCJxvUH9WG1JkJw9o15Xn2JSjnpD9");
+    BOOST_CHECK(pwallet->GetStealthKeyIndex(sxi, sxId));
+    BOOST_CHECK(sxId == 1);
+    BOOST_CHECK(!pwallet->GetStealthByIndex(0, sxOut));
+    BOOST_CHECK(!pwallet->GetStealthByIndex(4, sxOut));
+
 
     CHDWalletDB wdb(pwallet->GetDBHandle(), "r+");
     uint160 hash;
@@ -232,6 +242,94 @@ BOOST_AUTO_TEST_CASE(ext_key_index)
     BOOST_CHECK(nIndex == 512);
 }
 
+BOOST_AUTO_TEST_CASE(account_key_table)
+{
+    CAccountKeyTable table;
+    CExtKeyAccount *pa1 = reinterpret_cast<CExtKeyAccount*>(0x10);
+    CExtKeyAccount *pa2 = reinterpret_cast<CExtKeyAccount*>(0x20);
+
+    std::vector<CKeyID> vIds(5000);
+    for (size_t k = 0; k < vIds.size(); ++k)
+    {
+        vIds[k] = CKeyID(Hash160(std::vector<uint8_t>{(uint8_t)k, (uint8_t)(k >> 8)}));
+        table.Insert(vIds[k], k % 2 ? pa2 : pa1);
+    };
+    BOOST_CHECK(table.Size() == vIds.size());
+
+    for (size_t k = 0; k < vIds.size(); ++k)
+        BOOST_CHECK(table.Find(vIds[k]) == (k % 2 ? pa2 : pa1));
+
+    // The first account inserted is kept
+    table.Insert(vIds[0], pa2);
+    BOOST_CHECK(table.Find(vIds[0]) == pa1);
+    BOOST_CHECK(table.Size() == vIds.size());
+
+    BOOST_CHECK(table.Find(CKeyID(Hash160(std::vector<uint8_t>{0xff, 0xff, 0xff}))) == nullptr);
+
+    table.Clear();
+    BOOST_CHECK(table.Find(vIds[1]) == nullptr);
+}
+
+
 
+BOOST_AUTO_TEST_CASE(wallet_scan_tx)
+{
+    CKey k;
+    k.MakeNewKey(true);
+    CPubKey pkEphem = k.GetPubKey();
+    k.MakeNewKey(true);
+    CPubKey pkDest = k.GetPubKey();
+    uint32_t nPrefix = 0xA5C3E7F1;
+
+    CMutableTransaction txn;
+    txn.nVersion = BITCOINC_TXN_VERSION;
+
+    // Standard output followed by a stealth data output with a prefix
+    OUTPUT_PTR<CTxOutStandard> outStd = MAKE_OUTPUT<CTxOutStandard>();
+    outStd->nValue = 1 * COIN;
+    outStd->scriptPubKey = GetScriptForDestination(pkDest.GetID());
+    txn.vpout.push_back(outStd);
+
+    OUTPUT_PTR<CTxOutData> outData = MAKE_OUTPUT<CTxOutData>();
+    outData->vData.push_back(DO_STEALTH);
+    outData->vData.insert(outData->vData.end(), pkEphem.begin(), pkEphem.end());
+    outData->vData.push_back(DO_STEALTH_PREFIX);
+    outData->vData.resize(outData->vData.size() + 4);
+    memcpy(&outData->vData[35], &nPrefix, 4);
+    txn.vpout.push_back(outData);
+
+    // Anon output without a prefix, and one with bad data
+    OUTPUT_PTR<CTxOutRingCT> outAnon = MAKE_OUTPUT<CTxOutRingCT>();
+    outAnon->pk = CCmpPubKey(pkDest);
+    outAnon->vData.assign(pkEphem.begin(), pkEphem.end());
+    txn.vpout.push_back(outAnon);
+
+    OUTPUT_PTR<CTxOutRingCT> outAnonBad = MAKE_OUTPUT<CTxOutRingCT>();
+    outAnonBad->vData.resize(34);
+    txn.vpout.push_back(outAnonBad);
+
+    CTransaction tx(txn);
+    CWalletScanTx scan_tx(tx);
+
+    BOOST_REQUIRE(scan_tx.vOutputs.size() == 3);
+    BOOST_CHECK(scan_tx.nRingCT == 2);
+
+    const CScanOutput &so0 = scan_tx.vOutputs[0];
+    BOOST_CHECK(so0.n == 0 && so0.nData == 1 && so0.nType == OUTPUT_STANDARD);
+    BOOST_CHECK(so0.fStealth && so0.fHavePrefix && so0.nPrefix == nPrefix);
+    BOOST_CHECK(so0.vchEphemPK == std::vector<uint8_t>(pkEphem.begin(), pkEphem.end()));
+    BOOST_CHECK(so0.dest == CTxDestination(pkDest.GetID()));
+
+    const CScanOutput &so1 = scan_tx.vOutputs[1];
+    BOOST_CHECK(so1.n == 2 && so1.nData == -1 && so1.nType == OUTPUT_RINGCT);
+    BOOST_CHECK(so1.fStealth && !so1.fHavePrefix);
+    BOOST_CHECK(so1.vchEphemPK == std::vector<uint8_t>(pkEphem.begin(), pkEphem.end()));
+    BOOST_CHECK(so1.dest == CTxDestination(pkDest.GetID()));
+
+    BOOST_CHECK(!scan_tx.vOutputs[2].fStealth);
+
+    // Fewer than two wallets are loaded, nothing is cached
+    BOOST_CHECK(GetWalletScanTx(tx) != GetWalletScanTx(tx));
+}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -187,10 +187,10 @@ BOOST_AUTO_TEST_CASE(stake_test)
         LOCK2(cs_main, pwallet->cs_wallet);
         BOOST_REQUIRE(pwallet->GetBalance() == 12500000000000);
     }
-    BOOST_REQUIRE(chainActive.Tip()->nMoneySupply == 12500000000000);
+    BOOST_REQUIRE(chainActive.Tip()->GetMoneySupply() == 12500000000000);
 
     StakeNBlocks(pwallet, 2);
-    BOOST_REQUIRE(chainActive.Tip()->nMoneySupply == 12500000079274);
+    BOOST_REQUIRE(chainActive.Tip()->GetMoneySupply() == 12500000079274);
 
     CBlockIndex *pindexDelete = chainActive.Tip();
     BOOST_REQUIRE(pindexDelete);
@@ -213,7 +213,7 @@ BOOST_AUTO_TEST_CASE(stake_test)
 
     BOOST_CHECK(chainActive.Height() == pindexDelete->nHeight - 1);
     BOOST_CHECK(chainActive.Tip()->GetBlockHash() == pindexDelete->pprev->GetBlockHash());
-    BOOST_REQUIRE(chainActive.Tip()->nMoneySupply == 12500000039637);
+    BOOST_REQUIRE(chainActive.Tip()->GetMoneySupply() == 12500000039637);
 
 
     // Reconnect block
@@ -225,7 +225,7 @@ BOOST_AUTO_TEST_CASE(stake_test)
         CCoinsViewCache view(pcoinsTip.get());
         const Coin &coin = view.AccessCoin(txin.prevout);
         BOOST_REQUIRE(coin.IsSpent());
-        BOOST_REQUIRE(chainActive.Tip()->nMoneySupply == 12500000079274);
+        BOOST_REQUIRE(chainActive.Tip()->GetMoneySupply() == 12500000079274);
     }
 
     CKey kRecv;
@@ -317,7 +317,7 @@ BOOST_AUTO_TEST_CASE(stake_test)
             UpdateTip(pindexDelete, chainparams);
 
             BOOST_CHECK(tipHash == chainActive.Tip()->GetBlockHash());
-            BOOST_CHECK(chainActive.Tip()->nMoneySupply == 12500000153511);
+            BOOST_CHECK(chainActive.Tip()->GetMoneySupply() == 12500000153511);
         }
     }
 
@@ -360,7 +360,7 @@ BOOST_AUTO_TEST_CASE(stake_test)
         }
 
         BOOST_CHECK(chainActive.Tip()->nAnonOutputs == 0);
-        BOOST_CHECK(chainActive.Tip()->nMoneySupply == 12500000153511);
+        BOOST_CHECK(chainActive.Tip()->GetMoneySupply() == 12500000153511);
     }
 
 }
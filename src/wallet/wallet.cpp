@@ -5,6 +5,7 @@
 
 #include <wallet/wallet.h>
 
+#include <blockreadahead.h>
 #include <checkpoints.h>
 #include <chain.h>
 #include <wallet/coincontrol.h>
@@ -31,7 +32,11 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <condition_variable>
+#include <deque>
 #include <future>
+#include <mutex>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 
@@ -49,6 +54,9 @@ bool AddWallet(const std::shared_ptr<CWallet>& wallet)
     std::vector<std::shared_ptr<CWallet>>::const_iterator i = std::find(vpwallets.begin(), vpwallets.end(), wallet);
     if (i != vpwallets.end()) return false;
     vpwallets.push_back(wallet);
+    std::string wallet_name = wallet->GetName();
+    wallet->m_notifier_connection = wallet->NotifyTransactionChanged.connect(
+        [wallet_name](CWallet*, const uint256 &txid, ChangeType status) { g_wallet_notifier.QueueChange(wallet_name, txid, status); });
     return true;
 }
 
@@ -58,6 +66,7 @@ bool RemoveWallet(const std::shared_ptr<CWallet>& wallet)
     assert(wallet);
     std::vector<std::shared_ptr<CWallet>>::iterator i = std::find(vpwallets.begin(), vpwallets.end(), wallet);
     if (i == vpwallets.end()) return false;
+    wallet->m_notifier_connection.disconnect();
     vpwallets.erase(i);
     return true;
 }
@@ -916,6 +925,8 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (std::pair<const uint256, CWalletTx>& item : mapWallet)
             item.second.MarkDirty();
+        ClearCachedBalances();
+        ClearCachedOutputs();
     }
 }
 
@@ -1028,14 +1039,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
     // Notify UI of new or updated transaction
     NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
     // notify an external script when a wallet transaction comes in or is updated
-    std::string strCmd = gArgs.GetArg("-walletnotify", "");
-
-    if (!strCmd.empty())
-    {
-        boost::replace_all(strCmd, "%s", wtxIn.GetHash().GetHex());
-        std::thread t(runCommand, strCmd);
-        t.detach(); // thread runs free
-    }
+    WalletNotifyCommand(wtxIn.GetHash());
 
     std::string sName = GetName();
     GetMainSignals().TransactionAddedToWallet(sName, wtxIn.tx);
@@ -1264,13 +1268,20 @@ void CWallet::SyncTransaction(const CTransactionRef& ptx, const CBlockIndex *pin
 }
 
 void CWallet::TransactionAddedToMempool(const CTransactionRef& ptx) {
+    TransactionsAddedToMempool({ptx});
+}
+
+void CWallet::TransactionsAddedToMempool(const std::vector<CTransactionRef>& vtx) {
     LOCK2(cs_main, cs_wallet);
-    SyncTransaction(ptx);
+    for (const CTransactionRef& ptx : vtx) {
+        SyncTransaction(ptx);
 
-    auto it = mapWallet.find(ptx->GetHash());
-    if (it != mapWallet.end()) {
-        it->second.fInMempool = true;
+        auto it = mapWallet.find(ptx->GetHash());
+        if (it != mapWallet.end()) {
+            it->second.fInMempool = true;
+        }
     }
+    ClearCachedBalances();
 }
 
 void CWallet::TransactionRemovedFromMempool(const CTransactionRef &ptx) {
@@ -1279,6 +1290,8 @@ void CWallet::TransactionRemovedFromMempool(const CTransactionRef &ptx) {
     if (it != mapWallet.end()) {
         it->second.fInMempool = false;
     }
+    // Unconfirmed records count while in the mempool
+    ClearCachedBalances();
 }
 
 void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindex, const std::vector<CTransactionRef>& vtxConflicted) {
@@ -1291,6 +1304,7 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
     // to abandon a transaction and then have it inadvertently cleared by
     // the notification that the conflicted transaction was evicted.
 
+    BeginBlockBatch();
     for (const CTransactionRef& ptx : vtxConflicted) {
         SyncTransaction(ptx);
         TransactionRemovedFromMempool(ptx);
@@ -1299,6 +1313,7 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
         SyncTransaction(pblock->vtx[i], pindex, i);
         TransactionRemovedFromMempool(pblock->vtx[i]);
     }
+    EndBlockBatch();
 
     m_last_block_processed = pindex;
     ClearCachedBalances();
@@ -1307,9 +1322,11 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
 void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) {
     LOCK2(cs_main, cs_wallet);
 
+    BeginBlockBatch();
     for (const CTransactionRef& ptx : pblock->vtx) {
         SyncTransaction(ptx);
     }
+    EndBlockBatch();
     ClearCachedBalances();
 }
 
@@ -1842,6 +1859,130 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
     return startTime;
 }
 
+//! Blocks read ahead of the rescan
+static const size_t RESCAN_PREFETCH_BLOCKS = 16;
+
+/**
+ * Reads and deserializes the next blocks of a rescan on a thread of its own
+ * while the wallet matches the current block.
+ * The blocks to read are scheduled by the rescan under cs_main, the reader
+ * thread never takes it, as rescans may be started with cs_main held.
+ */
+class RescanBlockReader
+{
+private:
+    struct Job
+    {
+        const CBlockIndex* pindex;
+        CBlock block;
+        bool fRead = false;
+        bool fStarted = false;
+        bool fDone = false;
+    };
+
+    const CBlockIndex* const m_stop_index;
+    std::mutex m_cs;
+    std::condition_variable m_cv_queued;
+    std::condition_variable m_cv_done;
+    //! Blocks scheduled, in chain order.
+    std::deque<std::shared_ptr<Job> > m_jobs;
+    bool m_stop = false;
+    std::thread m_thread;
+
+    void ThreadRead()
+    {
+        const Consensus::Params& consensus_params = Params().GetConsensus();
+        while (true)
+        {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(m_cs);
+                m_cv_queued.wait(lock, [this, &job] {
+                    if (m_stop)
+                        return true;
+                    for (const auto &j : m_jobs) {
+                        if (!j->fStarted) {
+                            job = j;
+                            return true;
+                        }
+                    }
+                    return false;
+                });
+                if (m_stop)
+                    return;
+                job->fStarted = true;
+            }
+
+            bool fRead = ReadBlockFromDisk(job->block, job->pindex, consensus_params);
+
+            {
+                std::lock_guard<std::mutex> lock(m_cs);
+                job->fRead = fRead;
+                job->fDone = true;
+            }
+            m_cv_done.notify_all();
+        };
+    }
+
+public:
+    explicit RescanBlockReader(const CBlockIndex* pindexStop) : m_stop_index(pindexStop)
+    {
+        m_thread = std::thread(&TraceThread<std::function<void()> >, "rescanread",
+                               std::bind(&RescanBlockReader::ThreadRead, this));
+    }
+
+    ~RescanBlockReader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_cs);
+            m_stop = true;
+        }
+        m_cv_queued.notify_all();
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    //! Schedule pindex and the blocks following it in chainActive
+    void Prefetch(const CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        AssertLockHeld(cs_main);
+        {
+            std::lock_guard<std::mutex> lock(m_cs);
+            while (!m_jobs.empty() && m_jobs.front()->pindex != pindex)
+                m_jobs.pop_front();
+
+            const CBlockIndex* pnext = m_jobs.empty() ? pindex : nullptr;
+            if (!pnext && m_jobs.back()->pindex != m_stop_index)
+                pnext = chainActive.Next(m_jobs.back()->pindex);
+            while (pnext && m_jobs.size() < RESCAN_PREFETCH_BLOCKS) {
+                std::shared_ptr<Job> job = std::make_shared<Job>();
+                job->pindex = pnext;
+                m_jobs.push_back(job);
+                if (pnext->nStatus & BLOCK_HAVE_DATA)
+                    g_block_read_ahead.Block(pnext->GetBlockPos());
+                pnext = pnext == m_stop_index ? nullptr : chainActive.Next(pnext);
+            }
+        }
+        m_cv_queued.notify_all();
+    }
+
+    //! Same result as ReadBlockFromDisk(block, pindex)
+    bool Read(CBlock& block, const CBlockIndex* pindex)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_cs);
+            if (!m_jobs.empty() && m_jobs.front()->pindex == pindex) {
+                std::shared_ptr<Job> job = m_jobs.front();
+                m_cv_done.wait(lock, [&job] { return job->fDone; });
+                m_jobs.pop_front();
+                block = std::move(job->block);
+                return job->fRead;
+            }
+        }
+        return ReadBlockFromDisk(block, pindex, Params().GetConsensus());
+    }
+};
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
@@ -1890,6 +2031,11 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
             }
         }
         double progress_current = progress_begin;
+        RescanBlockReader reader(pindexStop);
+        if (pindex) {
+            LOCK(cs_main);
+            reader.Prefetch(pindex);
+        }
         while (pindex && !fAbortRescan && !ShutdownRequested())
         {
             if (pindex->nHeight % 100 == 0 && progress_end - progress_begin > 0.0) {
@@ -1901,7 +2047,7 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
             }
 
             CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
+            if (reader.Read(block, pindex)) {
                 LOCK2(cs_main, cs_wallet);
                 if (pindex && !chainActive.Contains(pindex)) {
                     // Abort scan if current block is no longer active, to prevent
@@ -1909,9 +2055,11 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
                     ret = pindex;
                     break;
                 }
+                BeginBlockBatch();
                 for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
                     SyncTransaction(block.vtx[posInBlock], pindex, posInBlock, fUpdate);
                 }
+                EndBlockBatch();
             } else {
                 ret = pindex;
             }
@@ -1921,6 +2069,9 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
             {
                 LOCK(cs_main);
                 pindex = chainActive.Next(pindex);
+                if (pindex) {
+                    reader.Prefetch(pindex);
+                }
                 progress_current = GuessVerificationProgress(chainParams.TxData(), pindex);
                 if (pindexStop == nullptr && tip != chainActive.Tip()) {
                     tip = chainActive.Tip();
@@ -3326,6 +3477,8 @@ DBErrors CWallet::ZapSelectTx(std::vector<uint256>& vHashIn, std::vector<uint256
         wtxOrdered.erase(it->second.m_it_wtxOrdered);
         mapWallet.erase(it);
     }
+    ClearCachedBalances();
+    ClearCachedOutputs();
 
     if (nZapSelectTxRet == DBErrors::NEED_REWRITE)
     {
@@ -21,6 +21,7 @@
 #include <wallet/coinselection.h>
 #include <wallet/walletdb.h>
 #include <wallet/rpcwallet.h>
+#include <wallet/walletnotify.h>
 #include <key/extkey.h>
 #include <key/stealth.h>
 
@@ -1003,10 +1004,16 @@ public:
 
     //! For BitcoinCWallet, clear cached balances from wallet called at new block and adding new transaction
     virtual void ClearCachedBalances() {};
+    //! For BitcoinCWallet, drop indexes of unspent wallet outputs when ownership or spends may have changed outside of a sync
+    virtual void ClearCachedOutputs() {};
+    //! For BitcoinCWallet, share one db handle between the writes of a synced block, flushed once at the block boundary
+    virtual void BeginBlockBatch() {};
+    virtual void EndBlockBatch() {};
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose=true);
     virtual void LoadToWallet(const CWalletTx& wtxIn);
     void TransactionAddedToMempool(const CTransactionRef& tx) override;
+    void TransactionsAddedToMempool(const std::vector<CTransactionRef>& vtx) override;
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindex, const std::vector<CTransactionRef>& vtxConflicted) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) override;
     int64_t RescanFromTime(int64_t startTime, const WalletRescanReserver& reserver, bool update);
@@ -1187,6 +1194,15 @@ public:
     boost::signals2::signal<void (CWallet *wallet, const uint256 &hashTx,
             ChangeType status)> NotifyTransactionChanged;
 
+    /**
+     * Wallet transactions added, removed or updated, one entry per txn, coalesced by g_wallet_notifier.
+     * @note called from the notifier thread without locks held.
+     */
+    boost::signals2::signal<void (CWallet *wallet, const WalletChanges_t &changes)> NotifyTransactionsChanged;
+
+    /** Feeds NotifyTransactionChanged to g_wallet_notifier while the wallet is loaded */
+    boost::signals2::scoped_connection m_notifier_connection;
+
     /** Show progress e.g. for rescan */
     boost::signals2::signal<void (const std::string &title, int nProgress)> ShowProgress;
 
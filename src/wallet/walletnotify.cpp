@@ -0,0 +1,175 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/walletnotify.h>
+
+#include <util.h>
+#include <wallet/wallet.h>
+
+#include <set>
+
+#include <boost/algorithm/string/replace.hpp>
+
+CWalletNotifier g_wallet_notifier;
+
+CWalletNotifier::~CWalletNotifier()
+{
+    Stop();
+}
+
+void CWalletNotifier::Start(int64_t window_ms, const std::string &batch_command)
+{
+    std::lock_guard<std::mutex> lock(m_cs);
+    if (m_thread.joinable()) {
+        return;
+    }
+    m_window_ms = window_ms;
+    m_command = batch_command;
+    m_stop = false;
+    m_thread = std::thread(&TraceThread<std::function<void()> >, "walletnotify",
+                           std::bind(&CWalletNotifier::ThreadNotify, this));
+}
+
+void CWalletNotifier::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_cs);
+        if (!m_thread.joinable()) {
+            return;
+        }
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+
+    // Don't drop what was queued in the last window
+    std::map<std::string, WalletChanges_t> changes;
+    std::vector<uint256> txids;
+    {
+        std::lock_guard<std::mutex> lock(m_cs);
+        changes.swap(m_changes);
+        txids.swap(m_command_txids);
+    }
+    Deliver(changes, txids);
+}
+
+bool CWalletNotifier::IsBatchingCommand()
+{
+    std::lock_guard<std::mutex> lock(m_cs);
+    return !m_command.empty();
+}
+
+void CWalletNotifier::QueueChange(const std::string &wallet_name, const uint256 &txid, ChangeType status)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_cs);
+        m_changes[wallet_name].emplace_back(txid, status);
+    }
+    m_cv.notify_one();
+}
+
+void CWalletNotifier::QueueCommand(const uint256 &txid)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_cs);
+        m_command_txids.push_back(txid);
+    }
+    m_cv.notify_one();
+}
+
+void CWalletNotifier::ThreadNotify()
+{
+    std::unique_lock<std::mutex> lock(m_cs);
+    while (!m_stop) {
+        if (m_changes.empty() && m_command_txids.empty()) {
+            m_cv.wait(lock);
+            continue;
+        }
+
+        // Collect what else changes in the window opened by the first change
+        m_cv.wait_for(lock, std::chrono::milliseconds(m_window_ms), [this] { return m_stop; });
+        if (m_stop) {
+            break;
+        }
+
+        std::map<std::string, WalletChanges_t> changes;
+        std::vector<uint256> txids;
+        changes.swap(m_changes);
+        txids.swap(m_command_txids);
+
+        lock.unlock();
+        Deliver(changes, txids);
+        lock.lock();
+    }
+}
+
+void CWalletNotifier::Deliver(std::map<std::string, WalletChanges_t> &changes, std::vector<uint256> &txids)
+{
+    for (const auto &wc : changes) {
+        std::shared_ptr<CWallet> pwallet = GetWallet(wc.first);
+        if (!pwallet) {
+            continue; // Unloaded
+        }
+
+        // One entry per txn, a txn new in the window stays new
+        WalletChanges_t vChanges;
+        std::map<uint256, size_t> mapIndex;
+        for (const auto &c : wc.second) {
+            auto mi = mapIndex.find(c.first);
+            if (mi == mapIndex.end()) {
+                mapIndex[c.first] = vChanges.size();
+                vChanges.push_back(c);
+                continue;
+            }
+            ChangeType &status = vChanges[mi->second].second;
+            if (!(status == CT_NEW && c.second == CT_UPDATED)) {
+                status = c.second;
+            }
+        }
+        pwallet->NotifyTransactionsChanged(pwallet.get(), vChanges);
+    }
+
+    std::string strCommand;
+    {
+        std::lock_guard<std::mutex> lock(m_cs);
+        strCommand = m_command;
+    }
+    if (strCommand.empty() || txids.empty()) {
+        return;
+    }
+
+    std::set<uint256> setSeen;
+    std::string sTxids;
+    size_t nTxids = 0;
+    for (size_t i = 0; i < txids.size(); ++i) {
+        if (setSeen.insert(txids[i]).second) {
+            if (nTxids++) {
+                sTxids += " ";
+            }
+            sTxids += txids[i].GetHex();
+        }
+        if (nTxids > 0 && (nTxids == MAX_WALLETNOTIFY_BATCH_TXIDS || i + 1 == txids.size())) {
+            std::string strCmd = strCommand;
+            boost::replace_all(strCmd, "%s", sTxids);
+            runCommand(strCmd);
+            sTxids.clear();
+            nTxids = 0;
+        }
+    }
+}
+
+void WalletNotifyCommand(const uint256 &txid)
+{
+    if (g_wallet_notifier.IsBatchingCommand()) {
+        g_wallet_notifier.QueueCommand(txid);
+        return;
+    }
+
+    std::string strCmd = gArgs.GetArg("-walletnotify", "");
+    if (!strCmd.empty()) {
+        boost::replace_all(strCmd, "%s", txid.GetHex());
+        std::thread t(runCommand, strCmd);
+        t.detach(); // thread runs free
+    }
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOINC_WALLET_WALLETNOTIFY_H
+#define BITCOINC_WALLET_WALLETNOTIFY_H
+
+#include <ui_interface.h>
+#include <uint256.h>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int64_t DEFAULT_WALLETNOTIFY_WINDOW = 100; // ms, changes delivered together
+static const int64_t DEFAULT_WALLETNOTIFY_BATCH = 0; // ms, 0 runs -walletnotify once per txn
+static const size_t MAX_WALLETNOTIFY_BATCH_TXIDS = 100; // txids passed to one -walletnotify
+
+typedef std::vector<std::pair<uint256, ChangeType> > WalletChanges_t;
+
+/**
+ * Coalesces the transaction changes of all wallets and delivers them from its own thread,
+ * away from cs_wallet.
+ * Each window the changes of a wallet are sent through its NotifyTransactionsChanged signal,
+ * one entry per txn, and with -walletnotifybatch the -walletnotify command runs once per
+ * MAX_WALLETNOTIFY_BATCH_TXIDS txids, space separated in %s.
+ * Changes queued before Start, as by the rescan of a loading wallet, are delivered once
+ * the thread runs.
+ */
+class CWalletNotifier
+{
+private:
+    std::mutex m_cs;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+    bool m_stop = false;
+
+    int64_t m_window_ms = DEFAULT_WALLETNOTIFY_WINDOW;
+    std::string m_command;
+
+    std::map<std::string, WalletChanges_t> m_changes; // By wallet name, in order queued
+    std::vector<uint256> m_command_txids;
+
+    void ThreadNotify();
+    void Deliver(std::map<std::string, WalletChanges_t> &changes, std::vector<uint256> &txids);
+
+public:
+    ~CWalletNotifier();
+
+    /** batch_command is run for batches of txids, leave empty to run -walletnotify per txn. */
+    void Start(int64_t window_ms, const std::string &batch_command);
+    void Stop();
+
+    bool IsBatchingCommand();
+
+    void QueueChange(const std::string &wallet_name, const uint256 &txid, ChangeType status);
+    void QueueCommand(const uint256 &txid);
+};
+
+extern CWalletNotifier g_wallet_notifier;
+
+/** Run -walletnotify for txid, or queue it for the next batch. */
+void WalletNotifyCommand(const uint256 &txid);
+
+#endif // BITCOINC_WALLET_WALLETNOTIFY_H
@@ -16,12 +16,17 @@ bool CZMQAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/)
     return true;
 }
 
-bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/)
+bool CZMQAbstractNotifier::NotifyBlockConnected(const std::shared_ptr<const CBlock> &/*pblock*/, const CBlockIndex */*pindex*/, bool /*fConnected*/)
 {
     return true;
 }
 
-bool CZMQAbstractNotifier::NotifyTransaction(const std::string &sWalletName, const CTransaction &/*transaction*/)
+bool CZMQAbstractNotifier::NotifyTransaction(const CTransactionRef &/*ptx*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyTransaction(const std::string &sWalletName, const CTransactionRef &/*ptx*/)
 {
     return true;
 }
@@ -7,6 +7,8 @@
 
 #include <zmq/zmqconfig.h>
 
+#include <memory>
+
 class CBlockIndex;
 namespace smsg {
 class SecureMessage;
@@ -36,9 +38,11 @@ public:
     virtual void Shutdown() = 0;
 
     virtual bool NotifyBlock(const CBlockIndex *pindex);
-    virtual bool NotifyTransaction(const CTransaction &transaction);
+    /** Every block connected to or disconnected from the chain, including during initial sync */
+    virtual bool NotifyBlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex, bool fConnected);
+    virtual bool NotifyTransaction(const CTransactionRef &ptx);
 
-    virtual bool NotifyTransaction(const std::string &sWalletName, const CTransaction &transaction);
+    virtual bool NotifyTransaction(const std::string &sWalletName, const CTransactionRef &ptx);
     virtual bool NotifySecureMessage(const smsg::SecureMessage *psmsg, const uint160 &hash);
 
 protected:
@@ -4,6 +4,7 @@
 
 #include <zmq/zmqnotificationinterface.h>
 #include <zmq/zmqpublishnotifier.h>
+#include <zmq/zmqpublisher.h>
 
 #include <version.h>
 #include <validation.h>
@@ -118,6 +119,9 @@ CZMQNotificationInterface* CZMQNotificationInterface::Create()
 
     factories["pubhashwtx"] = CZMQAbstractNotifier::Create<CZMQPublishHashWalletTransactionNotifier>;
     factories["pubsmsg"] = CZMQAbstractNotifier::Create<CZMQPublishSMSGNotifier>;
+    factories["pubrawsmsg"] = CZMQAbstractNotifier::Create<CZMQPublishRawSMSGNotifier>;
+    factories["pubrawanonoutputs"] = CZMQAbstractNotifier::Create<CZMQPublishRawAnonOutputsNotifier>;
+    factories["pubkeyimages"] = CZMQAbstractNotifier::Create<CZMQPublishKeyImagesNotifier>;
 
     for (const auto& entry : factories)
     {
@@ -210,6 +214,8 @@ bool CZMQNotificationInterface::Initialize()
         return false;
     }
 
+    g_zmq_publisher.Start(gArgs.GetArg("-zmqqueuesize", DEFAULT_ZMQ_QUEUE_SIZE));
+
     return true;
 }
 
@@ -224,6 +230,9 @@ void CZMQNotificationInterface::Shutdown()
         threadZAP.join();
     };
 
+    // Publish what's queued before the sockets close
+    g_zmq_publisher.Stop();
+
     if (pcontext)
     {
         for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
@@ -262,12 +271,10 @@ void CZMQNotificationInterface::TransactionAddedToMempool(const CTransactionRef&
 {
     // Used by BlockConnected and BlockDisconnected as well, because they're
     // all the same external callback.
-    const CTransaction& tx = *ptx;
-
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx))
+        if (notifier->NotifyTransaction(ptx))
         {
             i++;
         }
@@ -279,12 +286,27 @@ void CZMQNotificationInterface::TransactionAddedToMempool(const CTransactionRef&
     }
 }
 
+void CZMQNotificationInterface::NotifyBlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, bool fConnected)
+{
+    for (auto i = notifiers.begin(); i!=notifiers.end(); ) {
+        CZMQAbstractNotifier *notifier = *i;
+        if (notifier->NotifyBlockConnected(pblock, pindex, fConnected)) {
+            i++;
+        } else {
+            notifier->Shutdown();
+            i = notifiers.erase(i);
+        }
+    }
+}
+
 void CZMQNotificationInterface::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexConnected, const std::vector<CTransactionRef>& vtxConflicted)
 {
     for (const CTransactionRef& ptx : pblock->vtx) {
         // Do a normal notify for each transaction added in the block
         TransactionAddedToMempool(ptx);
     }
+
+    NotifyBlockConnected(pblock, pindexConnected, true);
 }
 
 void CZMQNotificationInterface::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock)
@@ -293,14 +315,22 @@ void CZMQNotificationInterface::BlockDisconnected(const std::shared_ptr<const CB
         // Do a normal notify for each transaction removed in block disconnection
         TransactionAddedToMempool(ptx);
     }
+
+    const CBlockIndex *pindex;
+    {
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(pblock->GetHash());
+    }
+    if (pindex) {
+        NotifyBlockConnected(pblock, pindex, false);
+    }
 }
 
 void CZMQNotificationInterface::TransactionAddedToWallet(const std::string &sWalletName, const CTransactionRef& ptx)
 {
-    const CTransaction& tx = *ptx;
     for (auto i = notifiers.begin(); i!=notifiers.end(); ) {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(sWalletName, tx)) {
+        if (notifier->NotifyTransaction(sWalletName, ptx)) {
             i++;
         } else {
             notifier->Shutdown();
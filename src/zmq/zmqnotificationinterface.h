@@ -44,6 +44,8 @@ protected:
 private:
     CZMQNotificationInterface();
 
+    void NotifyBlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, bool fConnected);
+
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
 
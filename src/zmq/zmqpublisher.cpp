@@ -0,0 +1,70 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <zmq/zmqpublisher.h>
+
+#include <util.h>
+#include <zmq/zmqpublishnotifier.h>
+
+CZMQPublisher g_zmq_publisher;
+
+void CZMQPublisher::Start(size_t nMaxQueuedIn)
+{
+    std::lock_guard<std::mutex> lock(m_cs);
+    if (m_thread.joinable()) {
+        return;
+    }
+    m_max_queued = std::max((size_t)1, nMaxQueuedIn);
+    m_stop = false;
+    m_thread = std::thread(&TraceThread<std::function<void()> >, "zmqpub",
+                           std::function<void()>(std::bind(&CZMQPublisher::ThreadPublish, this)));
+}
+
+void CZMQPublisher::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_cs);
+        if (!m_thread.joinable()) {
+            return;
+        }
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+bool CZMQPublisher::Queue(CZMQPublishJob &&job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_cs);
+        size_t &nQueued = m_queued[job.notifier];
+        if (nQueued >= m_max_queued) {
+            return false;
+        }
+        nQueued++;
+        m_queue.push_back(std::move(job));
+    }
+    m_cv.notify_one();
+    return true;
+}
+
+void CZMQPublisher::ThreadPublish()
+{
+    std::unique_lock<std::mutex> lock(m_cs);
+    for (;;) {
+        m_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+        if (m_queue.empty()) {
+            return; // Stopping, the queue is drained first
+        }
+        CZMQPublishJob job(std::move(m_queue.front()));
+        m_queue.pop_front();
+        if (--m_queued[job.notifier] == 0) {
+            m_queued.erase(job.notifier);
+        }
+
+        lock.unlock();
+        job.notifier->Publish(job);
+        lock.lock();
+    }
+}
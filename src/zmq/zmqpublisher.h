@@ -0,0 +1,67 @@
+// Copyright (c) 2019 The Bitcoin Confidential Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ZMQ_ZMQPUBLISHER_H
+#define BITCOIN_ZMQ_ZMQPUBLISHER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+class CZMQAbstractPublishNotifier;
+
+//! Default for -zmqqueuesize, messages waiting to be published per notifier
+static const int DEFAULT_ZMQ_QUEUE_SIZE = 1000;
+
+/** Builds the payload of a message on the publisher thread */
+typedef std::function<bool(std::vector<unsigned char>&)> ZMQPayloadFn;
+
+/** A message waiting for the publisher thread */
+struct CZMQPublishJob
+{
+    CZMQAbstractPublishNotifier *notifier;
+    const char *command;
+    uint32_t nSequence;
+    ZMQPayloadFn fnPayload;
+};
+
+/**
+ * Thread building and sending the messages of all publish notifiers, so a
+ * slow subscriber, disk read or big payload doesn't hold up the validation
+ * interface callbacks.
+ *
+ * It is also the only thread using the zmq sockets, which are not thread safe.
+ */
+class CZMQPublisher
+{
+public:
+    ~CZMQPublisher() { Stop(); };
+
+    void Start(size_t nMaxQueuedIn);
+    /** Publish what is still queued and join the thread */
+    void Stop();
+
+    /** False if the notifier already has nMaxQueued messages waiting, the message is dropped */
+    bool Queue(CZMQPublishJob &&job);
+
+private:
+    void ThreadPublish();
+
+    std::mutex m_cs;
+    std::condition_variable m_cv;
+    std::deque<CZMQPublishJob> m_queue;
+    std::map<const CZMQAbstractPublishNotifier*, size_t> m_queued;
+    size_t m_max_queued = DEFAULT_ZMQ_QUEUE_SIZE;
+    bool m_stop = false;
+    std::thread m_thread;
+};
+
+extern CZMQPublisher g_zmq_publisher;
+
+#endif // BITCOIN_ZMQ_ZMQPUBLISHER_H
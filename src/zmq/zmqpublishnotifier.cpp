@@ -21,6 +21,9 @@ static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
 static const char *MSG_HASHWTX   = "hashwtx";
 static const char *MSG_SMSG      = "smsg";
+static const char *MSG_RAWSMSG   = "rawsmsg";
+static const char *MSG_RAWANONOUTPUTS = "rawanonoutputs";
+static const char *MSG_KEYIMAGES = "keyimages";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -159,20 +162,47 @@ void CZMQAbstractPublishNotifier::Shutdown()
     psocket = nullptr;
 }
 
-bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size)
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size, uint32_t nSequenceIn)
 {
     assert(psocket);
 
     /* send three parts, command & data & a LE 4byte sequence number */
     unsigned char msgseq[sizeof(uint32_t)];
-    WriteLE32(&msgseq[0], nSequence);
+    WriteLE32(&msgseq[0], nSequenceIn);
     int rc = zmq_send_multipart(psocket, command, strlen(command), data, size, msgseq, (size_t)sizeof(uint32_t), nullptr);
     if (rc == -1)
         return false;
 
-    /* increment memory only sequence number after sending */
-    nSequence++;
+    return true;
+}
+
+bool CZMQAbstractPublishNotifier::QueueMessage(const char *command, ZMQPayloadFn fnPayload)
+{
+    if (fFailed)
+        return false;
+
+    uint32_t nSequenceQueued = nSequence++;
+    if (!g_zmq_publisher.Queue(CZMQPublishJob{this, command, nSequenceQueued, std::move(fnPayload)}))
+        LogPrint(BCLog::ZMQ, "zmq: Queue full, dropped %s %u for %s\n", command, nSequenceQueued, address);
+
+    return true;
+}
+
+void CZMQAbstractPublishNotifier::Publish(const CZMQPublishJob &job)
+{
+    if (fFailed)
+        return;
 
+    std::vector<unsigned char> vPayload;
+    if (!job.fnPayload(vPayload) || !SendMessage(job.command, vPayload.data(), vPayload.size(), job.nSequence))
+        fFailed = true;
+}
+
+static bool HashPayload(const uint256 &hash, std::vector<unsigned char> &vPayload)
+{
+    vPayload.resize(32);
+    for (unsigned int i = 0; i < 32; i++)
+        vPayload[31 - i] = hash.begin()[i];
     return true;
 }
 
@@ -180,75 +210,181 @@ bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     uint256 hash = pindex->GetBlockHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish hashblock %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHBLOCK, data, 32);
+    return QueueMessage(MSG_HASHBLOCK, std::bind(HashPayload, hash, std::placeholders::_1));
 }
 
-bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransactionRef &ptx)
 {
-    uint256 hash = transaction.GetHash();
+    uint256 hash = ptx->GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish hashtx %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHTX, data, 32);
+    return QueueMessage(MSG_HASHTX, std::bind(HashPayload, hash, std::placeholders::_1));
 }
 
 bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     LogPrint(BCLog::ZMQ, "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
-    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    {
-        LOCK(cs_main);
+    // Block index entries are never freed, the block is read on the publisher thread
+    return QueueMessage(MSG_RAWBLOCK, [pindex](std::vector<unsigned char> &vPayload) {
         CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams))
+        if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()))
         {
             zmqError("Can't read block from disk");
             return false;
         }
 
+        CVectorWriter ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags(), vPayload, 0);
         ss << block;
-    }
-
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+        return true;
+    });
 }
 
-bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransactionRef &ptx)
 {
-    uint256 hash = transaction.GetHash();
-    LogPrint(BCLog::ZMQ, "zmq: Publish rawtx %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ss << transaction;
-    return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
+    LogPrint(BCLog::ZMQ, "zmq: Publish rawtx %s\n", ptx->GetHash().GetHex());
+    return QueueMessage(MSG_RAWTX, [ptx](std::vector<unsigned char> &vPayload) {
+        CVectorWriter ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags(), vPayload, 0);
+        ss << *ptx;
+        return true;
+    });
 }
 
-bool CZMQPublishHashWalletTransactionNotifier::NotifyTransaction(const std::string &sWalletName, const CTransaction &transaction)
+bool CZMQPublishHashWalletTransactionNotifier::NotifyTransaction(const std::string &sWalletName, const CTransactionRef &ptx)
 {
-    uint256 hash = transaction.GetHash();
+    uint256 hash = ptx->GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish hashwtx %s, %s\n", sWalletName, hash.GetHex());
-    char data[128];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
 
-    size_t nName = sWalletName.length();
-    if (nName > sizeof(data) - 32)
-        nName = 0;
-    memcpy(&data[32], sWalletName.c_str(), nName);
-    return SendMessage(MSG_HASHWTX, data, 32 + nName);
+    std::string sName = sWalletName.length() > 128 - 32 ? "" : sWalletName;
+    return QueueMessage(MSG_HASHWTX, [hash, sName](std::vector<unsigned char> &vPayload) {
+        HashPayload(hash, vPayload);
+        vPayload.insert(vPayload.end(), sName.begin(), sName.end());
+        return true;
+    });
 }
 
 bool CZMQPublishSMSGNotifier::NotifySecureMessage(const smsg::SecureMessage *psmsg, const uint160 &hash)
 {
     LogPrint(BCLog::ZMQ, "zmq: Publish smsg %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+
+    // psmsg doesn't outlive the call, the payload is small
+    std::vector<unsigned char> vData;
+    CVectorWriter ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags(), vData, 0);
     ss << psmsg->version[0];
     ss << psmsg->version[1];
     int64_t timestamp_be = bswap_64(psmsg->timestamp);
     ss << timestamp_be;
     ss << hash;
-    return SendMessage(MSG_SMSG, &(*ss.begin()), ss.size());
+    return QueueMessage(MSG_SMSG, [vData](std::vector<unsigned char> &vPayload) {
+        vPayload = vData;
+        return true;
+    });
+}
+
+bool CZMQPublishRawSMSGNotifier::NotifySecureMessage(const smsg::SecureMessage *psmsg, const uint160 &hash)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish rawsmsg %s\n", hash.GetHex());
+
+    // msgid, then the header fields and encrypted payload
+    std::vector<unsigned char> vData;
+    CVectorWriter ss(SER_NETWORK, PROTOCOL_VERSION, vData, 0);
+    ss << hash;
+    ss << psmsg->version[0] << psmsg->version[1] << psmsg->flags;
+    ss << psmsg->timestamp;
+    ss.write((const char*)psmsg->iv, sizeof(psmsg->iv));
+    ss.write((const char*)psmsg->cpkR, sizeof(psmsg->cpkR));
+    ss.write((const char*)psmsg->mac, sizeof(psmsg->mac));
+    ss.write((const char*)psmsg->nonce, sizeof(psmsg->nonce));
+    ss << psmsg->nPayload;
+    if (psmsg->pPayload)
+        ss.write((const char*)psmsg->pPayload, psmsg->nPayload);
+    return QueueMessage(MSG_RAWSMSG, [vData](std::vector<unsigned char> &vPayload) {
+        vPayload = vData;
+        return true;
+    });
+}
+
+/** Block records start with the connect flag, block hash, height and record count */
+static void WriteBlockRecordHeader(CVectorWriter &ss, const CBlockIndex *pindex, bool fConnected, uint32_t nRecords)
+{
+    std::vector<unsigned char> vHash;
+    HashPayload(pindex->GetBlockHash(), vHash);
+    ss << (uint8_t)(fConnected ? 1 : 0);
+    ss.write((const char*)vHash.data(), vHash.size());
+    ss << (int32_t)pindex->nHeight;
+    ss << nRecords;
+}
+
+static void WriteTxid(CVectorWriter &ss, const uint256 &txid)
+{
+    std::vector<unsigned char> vHash;
+    HashPayload(txid, vHash);
+    ss.write((const char*)vHash.data(), vHash.size());
+}
+
+bool CZMQPublishRawAnonOutputsNotifier::NotifyBlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex, bool fConnected)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish rawanonoutputs %s\n", pindex->GetBlockHash().GetHex());
+
+    return QueueMessage(MSG_RAWANONOUTPUTS, [pblock, pindex, fConnected](std::vector<unsigned char> &vPayload) {
+        // Anon indices are assigned in block order, following those of the previous block
+        int64_t nIndex = pindex->pprev ? pindex->pprev->nAnonOutputs : 0;
+        uint32_t nRecords = 0;
+        for (const auto &tx : pblock->vtx)
+            for (const auto &txout : tx->vpout)
+                if (txout->IsType(OUTPUT_RINGCT))
+                    nRecords++;
+
+        // index, pubkey, commitment, txid, vout
+        CVectorWriter ss(SER_NETWORK, PROTOCOL_VERSION, vPayload, 0);
+        WriteBlockRecordHeader(ss, pindex, fConnected, nRecords);
+        for (const auto &tx : pblock->vtx)
+        {
+            for (uint32_t k = 0; k < tx->vpout.size(); ++k)
+            {
+                if (!tx->vpout[k]->IsType(OUTPUT_RINGCT))
+                    continue;
+                const CTxOutRingCT *txout = (const CTxOutRingCT*)tx->vpout[k].get();
+                ss << ++nIndex;
+                ss.write((const char*)txout->pk.begin(), 33);
+                ss.write((const char*)txout->commitment.data, 33);
+                WriteTxid(ss, tx->GetHash());
+                ss << k;
+            }
+        }
+        return true;
+    });
+}
+
+bool CZMQPublishKeyImagesNotifier::NotifyBlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex, bool fConnected)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish keyimages %s\n", pindex->GetBlockHash().GetHex());
+
+    return QueueMessage(MSG_KEYIMAGES, [pblock, pindex, fConnected](std::vector<unsigned char> &vPayload) {
+        // key image, spending txid
+        std::vector<std::pair<const uint8_t*, uint256> > vKeyImages;
+        for (const auto &tx : pblock->vtx)
+        {
+            for (const auto &txin : tx->vin)
+            {
+                if (!txin.IsAnonInput())
+                    continue;
+                uint32_t nInputs, nRingSize;
+                txin.GetAnonInfo(nInputs, nRingSize);
+                if (txin.scriptData.stack.size() != 1
+                    || txin.scriptData.stack[0].size() != 33 * nInputs)
+                    continue; // Checked when the block was connected
+                for (size_t k = 0; k < nInputs; ++k)
+                    vKeyImages.emplace_back(&txin.scriptData.stack[0][k * 33], tx->GetHash());
+            }
+        }
+
+        CVectorWriter ss(SER_NETWORK, PROTOCOL_VERSION, vPayload, 0);
+        WriteBlockRecordHeader(ss, pindex, fConnected, vKeyImages.size());
+        for (const auto &ki : vKeyImages)
+        {
+            ss.write((const char*)ki.first, 33);
+            WriteTxid(ss, ki.second);
+        }
+        return true;
+    });
 }
@@ -6,13 +6,17 @@
 #define BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
 
 #include <zmq/zmqabstractnotifier.h>
+#include <zmq/zmqpublisher.h>
+
+#include <atomic>
 
 class CBlockIndex;
 
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
 private:
-    uint32_t nSequence; //!< upcounting per message sequence number
+    std::atomic<uint32_t> nSequence{0}; //!< upcounting per message sequence number, dropped messages leave a gap
+    std::atomic<bool> fFailed{false}; //!< a message couldn't be built or sent, nothing more is published
 
 public:
 
@@ -22,7 +26,12 @@ public:
           * data
           * message sequence number
     */
-    bool SendMessage(const char *command, const void* data, size_t size);
+    bool SendMessage(const char *command, const void* data, size_t size, uint32_t nSequenceIn);
+
+    /** Queue a message for g_zmq_publisher, fnPayload is run on its thread. False once the notifier failed */
+    bool QueueMessage(const char *command, ZMQPayloadFn fnPayload);
+    /** Build and send a queued message, only called by the publisher thread */
+    void Publish(const CZMQPublishJob &job);
 
     bool Initialize(void *pcontext) override;
     void Shutdown() override;
@@ -37,7 +46,7 @@ public:
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction) override;
+    bool NotifyTransaction(const CTransactionRef &ptx) override;
 };
 
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
@@ -49,13 +58,13 @@ public:
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction) override;
+    bool NotifyTransaction(const CTransactionRef &ptx) override;
 };
 
 class CZMQPublishHashWalletTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const std::string &sWalletName, const CTransaction &transaction) override;
+    bool NotifyTransaction(const std::string &sWalletName, const CTransactionRef &ptx) override;
 };
 
 class CZMQPublishSMSGNotifier : public CZMQAbstractPublishNotifier
@@ -64,5 +73,23 @@ public:
     bool NotifySecureMessage(const smsg::SecureMessage *psmsg, const uint160 &hash) override;
 };
 
+class CZMQPublishRawSMSGNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifySecureMessage(const smsg::SecureMessage *psmsg, const uint160 &hash) override;
+};
+
+class CZMQPublishRawAnonOutputsNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex, bool fConnected) override;
+};
+
+class CZMQPublishKeyImagesNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex, bool fConnected) override;
+};
+
 
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
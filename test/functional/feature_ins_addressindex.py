@@ -20,7 +20,7 @@ class AddressIndexTest(BitcoinCTestFramework):
             ['-debug',],
             ['-debug','-addressindex'],
             # Nodes 2/3 are used for testing
-            ['-debug','-addressindex',],
+            ['-debug','-addressindex','-addressbalanceindex'],
             ['-debug','-addressindex'],]
 
     def setup_network(self):
@@ -206,6 +206,31 @@ class AddressIndexTest(BitcoinCTestFramework):
         deltasAll = self.nodes[1].getaddressdeltas({"addresses": [address2]})
         assert_equal(len(deltasAll), 4)
 
+        # Check that deltas can be paged through
+        paged = []
+        page = self.nodes[1].getaddressdeltas({"addresses": [address2], "limit": 1})
+        while True:
+            paged += page["deltas"]
+            if page["next"] is None:
+                break
+            page = self.nodes[1].getaddressdeltas({"addresses": [address2], "limit": 1, "after": page["next"]})
+        assert_equal(paged, deltasAll)
+
+        # Check that deltas of several addresses are merged in chain order
+        address1 = 'pqavEUgLCZeGh8o9sTcCfYVAsrTgnQTUsK'
+        deltas1 = self.nodes[1].getaddressdeltas({"addresses": [address1]})
+        deltasBoth = self.nodes[1].getaddressdeltas({"addresses": [address2, address1, address2]})
+        assert_equal(len(deltasBoth), len(deltas1) + len(deltasAll))
+        assert_equal(deltasBoth, sorted(deltasBoth, key=lambda d: (d["height"], d["blockindex"])))
+        balanceBoth = self.nodes[1].getaddressbalance({"addresses": [address1, address2]})
+        assert_equal(balanceBoth["balance"], sum(d["satoshis"] for d in deltasBoth))
+        txidsAll = []
+        for delta in deltasAll:
+            if delta["txid"] not in txidsAll:
+                txidsAll.append(delta["txid"])
+        page = self.nodes[1].getaddresstxids({"addresses": [address2], "limit": 1, "offset": 1})
+        assert_equal(page["txids"], txidsAll[1:2])
+
         # Check that deltas can be returned from range of block heights
         deltas = self.nodes[1].getaddressdeltas({"addresses": [address2], "start": 3, "end": 3})
         assert_equal(len(deltas), 1)
@@ -218,6 +243,12 @@ class AddressIndexTest(BitcoinCTestFramework):
 
 
 
+        # Node 2 answers from running balances
+        balance_agg = self.nodes[2].getaddressbalance(address2)
+        balance_sum = self.nodes[1].getaddressbalance(address2)
+        assert_equal(balance_agg['balance'], balance_sum['balance'])
+        assert_equal(balance_agg['received'], balance_sum['received'])
+
         # Check that indexes will be updated with a reorg
         self.log.info("Testing reorg...")
         height_before = self.nodes[1].getblockcount()
@@ -232,6 +263,9 @@ class AddressIndexTest(BitcoinCTestFramework):
 
         balance4 = self.nodes[1].getaddressbalance(address2)
         assert_equal(balance4['balance'], 4500000000)
+        balance_agg = self.nodes[2].getaddressbalance(address2)
+        assert_equal(balance_agg['balance'], balance4['balance'])
+        assert_equal(balance_agg['received'], balance4['received'])
 
         utxos2 = self.nodes[1].getaddressutxos({"addresses": [address2]})
         assert_equal(len(utxos2), 3)
@@ -91,6 +91,12 @@ class TxIndexTest(BitcoinCTestFramework):
         assert(len(ro) == 2)
         assert(ro[0]['value'] == ro[1]['value'] == 1200000000000)
         assert(ro[0]['addrspend'] == ro[1]['addrspend'] == addrSpend)
+        rw = nodes[2].getcoldstakeweights(addrStake)
+        assert(rw['weight'] == 2400000000000)
+        assert(len(rw['addrspend']) == 1)
+        assert(rw['addrspend'][0]['addrspend'] == addrSpend)
+        assert(rw['addrspend'][0]['weight'] == 2400000000000)
+        assert(nodes[2].getcoldstakeweights(addrStake, 1)['weight'] == 0)
         ro = nodes[2].listcoldstakeunspent(addrStake, 2, {'mature_only': True})
         assert(len(ro) == 0)
         ro = nodes[2].listcoldstakeunspent(addrStake, 2, {'mature_only': True, 'all_staked': True})
@@ -113,6 +119,7 @@ class TxIndexTest(BitcoinCTestFramework):
         self.stakeBlocks(1,nStakeNode=2)
         ro = nodes[2].listcoldstakeunspent(addrStake)
         assert(len(ro) == 3)
+        assert(nodes[2].getcoldstakeweights(addrStake)['weight'] == sum(o['value'] for o in ro))
 
         ro = nodes[2].listcoldstakeunspent(addrStake, 4, {'mature_only': True})
         assert(len(ro) == 1)
@@ -128,6 +135,7 @@ class TxIndexTest(BitcoinCTestFramework):
         assert(ro[0]['height'] == 2)
         assert(ro[1]['height'] == 2)
         assert(len(ro) == 2)
+        assert(nodes[2].getcoldstakeweights(addrStake)['weight'] == sum(o['value'] for o in ro))
 
         ro = nodes[1].listcoldstakeunspent(addrStake)
         assert(len(ro) == 3)
@@ -140,6 +148,11 @@ class TxIndexTest(BitcoinCTestFramework):
         ro = nodes[1].getblockreward(2)
         assert(ro['stakereward'] < ro['blockreward'])
 
+        ro = nodes[1].getblockrewards(1, 3)
+        assert(len(ro) == 3)
+        assert(ro[1]['height'] == 2)
+        assert(ro[1]['stakereward'] == nodes[1].getblockreward(2)['stakereward'])
+
 
 if __name__ == '__main__':
     TxIndexTest().main()
@@ -70,6 +70,24 @@ class TimestampIndexTest(BitcoinCTestFramework):
 
         assert_equal(hashes, blockhashes)
 
+        hashes = self.nodes[1].getblockhashes(high, low, {'noOrphans': True, 'logicalTimes': True})
+        assert_equal([h['blockhash'] for h in hashes], blockhashes)
+        assert_equal(self.nodes[1].getblockhashes(high, low, {'noOrphans': False, 'logicalTimes': True}), hashes)
+
+        print('Checking timestamp index built in the background...')
+        self.restart_node(2, extra_args=['-debug', '-timestampindex'])
+
+        def built(node):
+            try:
+                return node.getblockhashes(high, low) == blockhashes
+            except JSONRPCException:
+                return False  # Not enabled until the build reaches the tip
+        wait_until(lambda: built(self.nodes[2]), timeout=30)
+
+        print('Checking timestamp index rebuilt by -reindex on worker threads...')
+        self.restart_node(3, extra_args=['-debug', '-timestampindex', '-reindex', '-insightindexthreads=2'])
+        wait_until(lambda: built(self.nodes[3]), timeout=30)
+
         print('Passed\n')
 
 
@@ -60,6 +60,21 @@ class NotificationsTest(BitcoinTestFramework):
         wait_until(lambda: os.path.isfile(self.tx_filename) and os.stat(self.tx_filename).st_size >= (block_count * 65), timeout=10)
 
         # file content should equal the generated transaction hashes
+        txids_rpc = list(map(lambda t: t['txid'], self.nodes[1].listtransactions("*", block_count)))
+        with open(self.tx_filename, 'r', encoding="ascii") as f:
+            assert_equal(sorted(txids_rpc), sorted(l.strip() for l in f.read().splitlines()))
+        os.remove(self.tx_filename)
+
+        self.log.info("test -walletnotifybatch")
+        # txids of a batch are passed space separated, write them one per line
+        self.restart_node(1, ["-blockversion=211",
+                              "-walletnotifybatch=200",
+                              "-walletnotify=echo %%s | tr ' ' '\\n' >> %s" % self.tx_filename])
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.nodes[1].generate(block_count)
+
+        wait_until(lambda: os.path.isfile(self.tx_filename) and os.stat(self.tx_filename).st_size >= (block_count * 65), timeout=10)
+
         txids_rpc = list(map(lambda t: t['txid'], self.nodes[1].listtransactions("*", block_count)))
         with open(self.tx_filename, 'r', encoding="ascii") as f:
             assert_equal(sorted(txids_rpc), sorted(l.strip() for l in f.read().splitlines()))
@@ -3,6 +3,8 @@
 # Distributed under the MIT software license, see the accompanying
 # file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+import os
+
 from test_framework.test_bitcoinc import BitcoinCTestFramework
 from test_framework.util import *
 
@@ -97,6 +99,21 @@ class AnonTest(BitcoinCTestFramework):
         ro = nodes[1].anonoutput()
         assert(ro['lastindex'] == 20)
 
+        ro = nodes[1].anonoutput('5', 100)
+        assert(ro['lastindex'] == 20)
+        assert(len(ro['outputs']) == 16)
+        assert(ro['outputs'][0] == nodes[1].anonoutput('5'))
+        assert(ro['outputs'][15]['index'] == 20)
+
+        exportPath = os.path.join(self.options.tmpdir, 'rctoutputs.bin')
+        ro = nodes[1].exportanonoutputs(exportPath, 2)
+        assert(ro['start'] == 2 and ro['count'] == 19)
+        with open(exportPath, 'rb') as fp:
+            data = fp.read()
+        assert(data[:4] == b'rctx')
+        assert(len(data) == 16 + 19 * 108)
+        assert(data[16 + 1:16 + 34].hex() == nodes[1].anonoutput('2')['publickey'])
+
         txnHash = nodes[1].sendanontoanon(sxAddrTo0_1, 101, '', '', False, 'node1 -> node0 a->a', 5, 1)
         txnHashes = [txnHash,]
 
@@ -247,6 +247,14 @@ class ColdStakingTest(BitcoinCTestFramework):
         ro = nodes[1].getwalletinfo()
         assert(ro['watchonly_staked_balance'] > 0)
 
+        ro = nodes[0].listcoldstakedelegations()
+        assert(ro['staking']['count'] > 0)
+        assert(ro['staking']['amount'] == sum(d['amount'] for d in ro['delegators']))
+        delegator = ro['delegators'][0]
+        ro = nodes[0].listcoldstakedelegations(delegator['address'])
+        assert(ro['as_spender']['count'] == delegator['count'])
+        assert(ro['as_spender']['amount'] == delegator['amount'])
+
         ro = nodes[0].extkey('list', 'true')
         fFound = False
         for ek in ro:
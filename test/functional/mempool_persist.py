@@ -78,6 +78,8 @@ class MempoolPersistTest(BitcoinTestFramework):
         # Give bitcoind a second to reload the mempool
         wait_until(lambda: len(self.nodes[0].getrawmempool()) == 5, timeout=1)
         wait_until(lambda: len(self.nodes[2].getrawmempool()) == 5, timeout=1)
+        # node0 wrote the file, its MAC key lets it skip the context-free checks
+        self.wait_for_import_log(0, "5 succeeded, 0 failed, 0 expired, 0 already there, 5 prechecked by MAC")
         # The others have loaded their mempool. If node_1 loaded anything, we'd probably notice by now:
         assert_equal(len(self.nodes[1].getrawmempool()), 0)
 
@@ -109,6 +111,8 @@ class MempoolPersistTest(BitcoinTestFramework):
         self.stop_nodes()
         self.start_node(1, extra_args=[])
         wait_until(lambda: len(self.nodes[1].getrawmempool()) == 5)
+        # node1 has a different mempool.key, every transaction is checked again
+        self.wait_for_import_log(1, "5 succeeded, 0 failed, 0 expired, 0 already there, 0 prechecked by MAC")
 
         self.log.debug("Prevent bitcoind from writing mempool.dat to disk. Verify that `savemempool` fails")
         # to test the exception we are creating a tmp folder called mempool.dat.new
@@ -118,6 +122,14 @@ class MempoolPersistTest(BitcoinTestFramework):
         assert_raises_rpc_error(-1, "Unable to dump mempool to disk", self.nodes[1].savemempool)
         os.rmdir(mempooldotnew1)
 
+    def wait_for_import_log(self, node_index, counts):
+        debug_log = os.path.join(self.nodes[node_index].datadir, 'regtest', 'debug.log')
+
+        def imported():
+            with open(debug_log, encoding='utf-8') as dl:
+                return "Imported mempool transactions from disk: " + counts in dl.read()
+        wait_until(imported)
+
 
 if __name__ == '__main__':
     MempoolPersistTest().main()
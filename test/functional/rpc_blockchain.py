@@ -14,6 +14,7 @@ Test the following RPCs:
     - getchaintxstats
     - getnetworkhashps
     - verifychain
+    - verifychainbackground
 
 Tests correspond to code in rpc/blockchain.cpp.
 """
@@ -31,6 +32,7 @@ from test_framework.util import (
     assert_raises_rpc_error,
     assert_is_hex_string,
     assert_is_hash_string,
+    wait_until,
 )
 from test_framework.blocktools import (
     create_block,
@@ -63,6 +65,26 @@ class BlockchainTest(BitcoinTestFramework):
         self._test_stopatheight()
         self._test_waitforblockheight()
         assert self.nodes[0].verifychain(4, 0)
+        self._test_verifychainbackground()
+
+    def _test_verifychainbackground(self):
+        node = self.nodes[0]
+        assert_raises_rpc_error(-8, "Invalid action", node.verifychainbackground, "begin")
+        assert_raises_rpc_error(-8, "checklevel out of range", node.verifychainbackground, "start", 5)
+
+        status = node.verifychainbackground("start", 4, 0, {"threads": 3, "maxrate": 0})
+        assert_equal(status['checklevel'], 4)
+        assert_equal(status['threads'], 3)
+        assert_equal(status['end_height'], node.getblockcount())
+        wait_until(lambda: not node.verifychainbackground("status")['running'])
+
+        status = node.verifychainbackground("status")
+        assert_equal(status['aborted'], False)
+        assert_equal(status['failed'], 0)
+        assert_equal(status['failures'], [])
+        assert_equal(status['checked'] + status['skipped'], status['blocks'])
+        assert_greater_than(status['checked'], 0)
+        assert_greater_than(status['bytes_read'], 0)
 
     def _test_getblockchaininfo(self):
         self.log.info("Test getblockchaininfo")
@@ -203,6 +225,11 @@ class BlockchainTest(BitcoinTestFramework):
         del res['disk_size'], res3['disk_size']
         assert_equal(res, res3)
 
+        self.log.info("Test that gettxoutsetinfo() without a flush reads the flushed state")
+        res4 = node.gettxoutsetinfo(False)
+        del res4['disk_size']
+        assert_equal(res, res4)
+
     def _test_getblockheader(self):
         node = self.nodes[0]
 
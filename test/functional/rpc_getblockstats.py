@@ -6,10 +6,12 @@
 #
 # Test getblockstats rpc call
 #
+from test_framework.authproxy import JSONRPCException
 from test_framework.test_framework import BitcoinTestFramework
 from test_framework.util import (
     assert_equal,
     assert_raises_rpc_error,
+    wait_until,
 )
 import json
 import os
@@ -44,8 +46,8 @@ class GetblockstatsTest(BitcoinTestFramework):
                             help='Test data file')
 
     def set_test_params(self):
-        self.num_nodes = 2
-        self.extra_args = [['-txindex'], ['-paytxfee=0.003']]
+        self.num_nodes = 3
+        self.extra_args = [['-txindex'], ['-paytxfee=0.003'], ['-blockstatsindex']]
         self.setup_clean_chain = True
 
     def get_stats(self):
@@ -94,6 +96,7 @@ class GetblockstatsTest(BitcoinTestFramework):
         # Set the timestamps from the file so that the nodes can get out of Initial Block Download
         self.nodes[0].setmocktime(mocktime)
         self.nodes[1].setmocktime(mocktime)
+        self.nodes[2].setmocktime(mocktime)
 
         for b in blocks:
             self.nodes[0].submitblock(b)
@@ -172,9 +175,43 @@ class GetblockstatsTest(BitcoinTestFramework):
         assert_raises_rpc_error(-8, 'One or more of the selected stats requires -txindex enabled',
                                 self.nodes[1].getblockstats, hash_or_height=self.start_height + self.max_stat_pos)
 
+        self._test_blockstatsindex()
+
         # Mainchain's genesis block shouldn't be found on regtest
         assert_raises_rpc_error(-5, 'Block not found', self.nodes[0].getblockstats,
                                 hash_or_height='000000000019d6689c085ae165831e934ff763ae46a2a6c172b3f1b60a8ce26f')
 
+    def _test_blockstatsindex(self):
+        # The node with -blockstatsindex reports all stats without -txindex
+        node = self.nodes[2]
+        tip = self.start_height + self.max_stat_pos
+
+        def index_synced():
+            try:
+                node.getblockstats(hash_or_height=tip, stats=['totalfee'])
+                return True
+            except JSONRPCException:
+                return False
+        wait_until(index_synced)
+
+        for i in range(self.max_stat_pos+1):
+            assert_equal(node.getblockstats(hash_or_height=self.start_height + i), self.expected_stats[i])
+
+        # Ranges are served from the index, or read block by block without it
+        stats = node.getblockstatsrange(self.start_height, tip)
+        assert_equal(stats, self.expected_stats)
+        assert_equal(self.nodes[0].getblockstatsrange(self.start_height, tip), self.expected_stats)
+
+        some_stats = ['anon_outs', 'totalfee']
+        stats = node.getblockstatsrange(self.start_height, tip, some_stats)
+        assert_equal([set(s.keys()) for s in stats], [set(some_stats)] * (self.max_stat_pos+1))
+
+        assert_raises_rpc_error(-8, 'End height %d after current tip %d' % (tip+1, tip),
+                                node.getblockstatsrange, self.start_height, tip+1)
+        assert_raises_rpc_error(-8, 'End height %d below start height %d' % (self.start_height, tip),
+                                node.getblockstatsrange, tip, self.start_height)
+        assert_raises_rpc_error(-8, 'One or more of the selected stats requires -txindex enabled',
+                                self.nodes[1].getblockstatsrange, self.start_height, tip)
+
 if __name__ == '__main__':
     GetblockstatsTest().main()
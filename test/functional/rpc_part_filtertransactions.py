@@ -201,6 +201,33 @@ class FilterTransactionsTest(BitcoinCTestFramework):
         })
         assert(float(ro[0]['amount']) == -20.0)
 
+        #
+        # cursor
+        #
+
+        # pages joined by cursor => all transactions
+        txids = [t['txid'] for t in nodes[0].filtertransactions({ 'count': 0 })]
+        paged = []
+        cursor = ''
+        while cursor is not None:
+            ro = nodes[0].filtertransactions({ 'count': 3, 'cursor': cursor })
+            assert(len(ro['tx']) <= 3)
+            paged += [t['txid'] for t in ro['tx']]
+            cursor = ro['cursor']
+        assert(paged == txids)
+
+        try:
+            nodes[0].filtertransactions({ 'cursor': '', 'sort': 'amount' })
+            assert(False)
+        except JSONRPCException as e:
+            assert('cursor requires sort' in e.error['message'])
+
+        try:
+            nodes[0].filtertransactions({ 'cursor': 'invalid' })
+            assert(False)
+        except JSONRPCException as e:
+            assert('Invalid cursor' in e.error['message'])
+
         #
         # include_watchonly
         #
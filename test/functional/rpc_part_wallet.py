@@ -49,6 +49,22 @@ class WalletRPCTest(BitcoinCTestFramework):
         assert(isclose(ro[0]['amount'], 2.999512))
         assert(len(ro[0]['outputs']) == 2)
 
+        # Batch payout
+        outputs = [{'address':nodes[1].getnewaddress(), 'amount':1} for i in range(4)]
+        ro = nodes[0].sendtypetomany('staking', 'staking', outputs, {'test_fee':True})
+        assert(ro['transactions'] == 1)
+        assert(ro['fee'] > 0)
+
+        ro = nodes[0].sendtypetomany('staking', 'staking', outputs, {'comment':'payout'})
+        assert(len(ro['txids']) == 1)
+        assert('errors' not in ro)
+        txnid = ro['txids'][0]
+        self.sync_all()
+
+        ro = nodes[1].filtertransactions()
+        assert(ro[0]['txid'] == txnid)
+        assert(len(ro[0]['outputs']) == 4)
+
 
 if __name__ == '__main__':
     WalletRPCTest().main()
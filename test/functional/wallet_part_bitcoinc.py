@@ -570,6 +570,19 @@ class WalletBitcoinCTest(BitcoinCTestFramework):
                 break
         assert(sPath == "m/0/0'")
 
+        # Large ranges are derived in parallel and saved in batches
+        ro = nodes[0].deriverangekeys(1000, 1599, sExternalChainId)
+        assert(len(ro) == 600)
+        for i in [0, 255, 256, 599]:
+            assert(nodes[0].deriverangekeys(1000 + i, 1000 + i, sExternalChainId)[0] == ro[i])
+        sRangeAddrs = ro
+
+        ro = nodes[0].deriverangekeys(1000, 1599, sExternalChainId, 'false', 'true', 'true')
+        assert(ro == sRangeAddrs)
+        ro = nodes[0].getaddressinfo(sRangeAddrs[599])
+        assert(ro['ismine'] == True)
+        assert(nodes[0].getnewaddress() == nodes[0].deriverangekeys(1600, 1600, sExternalChainId)[0])
+
         addr = nodes[0].getnewaddress('', 'false', 'false', 'true')
         ro = nodes[0].validateaddress(addr)
         assert(ro['isvalid'] == True)
@@ -646,6 +659,15 @@ class WalletBitcoinCTest(BitcoinCTestFramework):
         txnid = nodes[1].sendtoaddress(address1, 0.01, "", "", False, "", True)
         assert(len(nodes[1].bumpfee(txnid)['errors']) == 0)
 
+        self.log.info('Test compactwallet')
+        nBalance = nodes[2].getwalletinfo()['total_balance']
+        ro = nodes[2].compactwallet(-1, 0)
+        assert(ro['started'] == True)
+        # A new compaction starts once the running one finished
+        wait_until(lambda: nodes[2].compactwallet(-1, 0)['started'] == True)
+        wait_until(lambda: nodes[2].compactwallet(-1, 0)['started'] == True)
+        assert(nodes[2].getwalletinfo()['total_balance'] == nBalance)
+
 
 if __name__ == '__main__':
     WalletBitcoinCTest().main()